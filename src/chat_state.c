@@ -33,6 +33,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib.h>
 
@@ -43,15 +44,37 @@
 
 #define PAUSED_TIMEOUT 10.0
 #define INACTIVE_TIMEOUT 30.0
+// inactive chats are looked at again at least this often, so a change
+// to the gone preference is picked up
+#define GONE_RECHECK 60.0
+// at most this many composing notifications in a row to one contact,
+// then one more for each refill period
+#define COMPOSING_BURST 3.0
+#define COMPOSING_REFILL 10.0
+
+// chat states waiting on a timeout, ordered by deadline
+static GSequence *deadlines = NULL;
 
 static void _send_if_supported(const char *const barejid, void (*send_func)(const char *const));
+static void _chat_state_handle_due(ChatState *state, gint64 now);
+static void _set_type(ChatState *state, chat_state_type_t type);
+static void _schedule(ChatState *state, gint64 deadline);
+static void _unschedule(ChatState *state);
+static gint _compare_deadlines(gconstpointer a, gconstpointer b, gpointer data);
+static gint64 _now(void);
+static gboolean _take_token(ChatState *state);
 
 ChatState*
-chat_state_new(void)
+chat_state_new(const char *const barejid)
 {
     ChatState *new_state = malloc(sizeof(struct prof_chat_state_t));
+    new_state->barejid = strdup(barejid);
     new_state->type = CHAT_STATE_GONE;
-    new_state->timer = g_timer_new();
+    new_state->since = _now();
+    new_state->deadline = 0;
+    new_state->scheduled = NULL;
+    new_state->tokens = COMPOSING_BURST;
+    new_state->refilled = new_state->since;
 
     return new_state;
 }
@@ -59,21 +82,42 @@ chat_state_new(void)
 void
 chat_state_free(ChatState *state)
 {
-    if (state && state->timer!= NULL) {
-        g_timer_destroy(state->timer);
+    if (state) {
+        _unschedule(state);
+        free(state->barejid);
     }
     free(state);
 }
 
 void
-chat_state_handle_idle(const char *const barejid, ChatState *state)
+chat_state_idle(void)
+{
+    if (deadlines == NULL) {
+        return;
+    }
+
+    gint64 now = _now();
+    GSequenceIter *first = g_sequence_get_begin_iter(deadlines);
+    while (!g_sequence_iter_is_end(first)) {
+        ChatState *state = g_sequence_get(first);
+        if (state->deadline > now) {
+            break;
+        }
+        _unschedule(state);
+        _chat_state_handle_due(state, now);
+        first = g_sequence_get_begin_iter(deadlines);
+    }
+}
+
+static void
+_chat_state_handle_due(ChatState *state, gint64 now)
 {
-    gdouble elapsed = g_timer_elapsed(state->timer, NULL);
+    const char *const barejid = state->barejid;
+    gdouble elapsed = (now - state->since) / (gdouble)G_USEC_PER_SEC;
 
     // TYPING -> PAUSED
     if (state->type == CHAT_STATE_COMPOSING && elapsed > PAUSED_TIMEOUT) {
-        state->type = CHAT_STATE_PAUSED;
-        g_timer_start(state->timer);
+        _set_type(state, CHAT_STATE_PAUSED);
         if (prefs_get_boolean(PREF_STATES) && prefs_get_boolean(PREF_OUTTYPE)) {
             _send_if_supported(barejid, message_send_paused);
         }
@@ -82,8 +126,7 @@ chat_state_handle_idle(const char *const barejid, ChatState *state)
 
     // PAUSED|ACTIVE -> INACTIVE
     if ((state->type == CHAT_STATE_PAUSED || state->type == CHAT_STATE_ACTIVE) && elapsed > INACTIVE_TIMEOUT) {
-        state->type = CHAT_STATE_INACTIVE;
-        g_timer_start(state->timer);
+        _set_type(state, CHAT_STATE_INACTIVE);
         if (prefs_get_boolean(PREF_STATES)) {
             _send_if_supported(barejid, message_send_inactive);
         }
@@ -102,19 +145,21 @@ chat_state_handle_idle(const char *const barejid, ChatState *state)
                         _send_if_supported(barejid, message_send_gone);
                     }
                     chat_session_remove(barejid);
-                    state->type = CHAT_STATE_GONE;
-                    g_timer_start(state->timer);
+                    _set_type(state, CHAT_STATE_GONE);
+                    return;
                 }
             } else {
                 if (prefs_get_boolean(PREF_STATES)) {
                     message_send_gone(barejid);
                 }
-                state->type = CHAT_STATE_GONE;
-                g_timer_start(state->timer);
+                _set_type(state, CHAT_STATE_GONE);
+                return;
             }
-            return;
         }
     }
+
+    // not due yet, or held back, wait for the next deadline
+    _schedule(state, now + GONE_RECHECK * G_USEC_PER_SEC);
 }
 
 void
@@ -122,10 +167,17 @@ chat_state_handle_typing(const char *const barejid, ChatState *state)
 {
     // ACTIVE|INACTIVE|PAUSED|GONE -> COMPOSING
     if (state->type != CHAT_STATE_COMPOSING) {
-        state->type = CHAT_STATE_COMPOSING;
-        g_timer_start(state->timer);
         if (prefs_get_boolean(PREF_STATES) && prefs_get_boolean(PREF_OUTTYPE)) {
+            // held back, the state is left as it is so a later key press
+            // sends composing once there is a token, and no paused follows
+            // a composing that was never sent
+            if (!_take_token(state)) {
+                return;
+            }
+            _set_type(state, CHAT_STATE_COMPOSING);
             _send_if_supported(barejid, message_send_composing);
+        } else {
+            _set_type(state, CHAT_STATE_COMPOSING);
         }
     }
 }
@@ -133,8 +185,7 @@ chat_state_handle_typing(const char *const barejid, ChatState *state)
 void
 chat_state_active(ChatState *state)
 {
-    state->type = CHAT_STATE_ACTIVE;
-    g_timer_start(state->timer);
+    _set_type(state, CHAT_STATE_ACTIVE);
 }
 
 void
@@ -144,9 +195,106 @@ chat_state_gone(const char *const barejid, ChatState *state)
         if (prefs_get_boolean(PREF_STATES)) {
             _send_if_supported(barejid, message_send_gone);
         }
-        state->type = CHAT_STATE_GONE;
-        g_timer_start(state->timer);
+        _set_type(state, CHAT_STATE_GONE);
+    }
+}
+
+// enter a state, and schedule the timeout that moves on from it
+static void
+_set_type(ChatState *state, chat_state_type_t type)
+{
+    state->type = type;
+    state->since = _now();
+
+    gdouble timeout;
+    switch (type) {
+    case CHAT_STATE_COMPOSING:
+        timeout = PAUSED_TIMEOUT;
+        break;
+    case CHAT_STATE_ACTIVE:
+    case CHAT_STATE_PAUSED:
+        timeout = INACTIVE_TIMEOUT;
+        break;
+    case CHAT_STATE_INACTIVE:
+        timeout = GONE_RECHECK;
+        if (prefs_get_gone() != 0 && prefs_get_gone() * 60.0 < timeout) {
+            timeout = prefs_get_gone() * 60.0;
+        }
+        break;
+    default:
+        _unschedule(state);
+        return;
+    }
+
+    // the transitions fire once the timeout has passed, not at it
+    _schedule(state, state->since + timeout * G_USEC_PER_SEC + 1);
+}
+
+static void
+_schedule(ChatState *state, gint64 deadline)
+{
+    _unschedule(state);
+    if (deadlines == NULL) {
+        deadlines = g_sequence_new(NULL);
+    }
+    state->deadline = deadline;
+    state->scheduled = g_sequence_insert_sorted(deadlines, state, _compare_deadlines, NULL);
+}
+
+static void
+_unschedule(ChatState *state)
+{
+    if (state->scheduled) {
+        g_sequence_remove(state->scheduled);
+        state->scheduled = NULL;
+    }
+}
+
+static gint
+_compare_deadlines(gconstpointer a, gconstpointer b, gpointer data)
+{
+    const ChatState *state1 = a;
+    const ChatState *state2 = b;
+
+    if (state1->deadline != state2->deadline) {
+        return state1->deadline < state2->deadline ? -1 : 1;
+    }
+    if (state1 == state2) {
+        return 0;
+    }
+    return state1 < state2 ? -1 : 1;
+}
+
+// typing, sending and typing again sends a composing notification each
+// time, the bucket stops a quick exchange from sending one per message
+static gboolean
+_take_token(ChatState *state)
+{
+    gint64 now = _now();
+    state->tokens += (now - state->refilled) / (COMPOSING_REFILL * G_USEC_PER_SEC);
+    if (state->tokens > COMPOSING_BURST) {
+        state->tokens = COMPOSING_BURST;
     }
+    state->refilled = now;
+
+    if (state->tokens < 1.0) {
+        return FALSE;
+    }
+    state->tokens -= 1.0;
+
+    return TRUE;
+}
+
+static gint64
+_now(void)
+{
+#if GLIB_CHECK_VERSION(2,28,0)
+    return g_get_monotonic_time();
+#else
+    GTimeVal now;
+    g_get_current_time(&now);
+    return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+#endif
 }
 
 static void
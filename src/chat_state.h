@@ -46,14 +46,20 @@ typedef enum {
 } chat_state_type_t;
 
 typedef struct prof_chat_state_t {
+    char *barejid;
     chat_state_type_t type;
-    GTimer *timer;
+    gint64 since;
+    gint64 deadline;
+    GSequenceIter *scheduled;
+    // composing notifications that may be sent before waiting for a refill
+    gdouble tokens;
+    gint64 refilled;
 } ChatState;
 
-ChatState* chat_state_new(void);
+ChatState* chat_state_new(const char *const barejid);
 void chat_state_free(ChatState *state);
 
-void chat_state_handle_idle(const char *const barejid, ChatState *state);
+void chat_state_idle(void);
 void chat_state_handle_typing(const char *const barejid, ChatState *state);
 void chat_state_active(ChatState *state);
 void chat_state_gone(const char *const barejid, ChatState *state);
@@ -67,7 +67,9 @@
 #include "profanity.h"
 #include "tools/autocomplete.h"
 #include "tools/parser.h"
+#include "tools/perf.h"
 #include "tools/tinyurl.h"
+#include "tools/watchdog.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/bookmark.h"
 #include "ui/ui.h"
@@ -113,8 +115,32 @@ static char* _wins_autocomplete(ProfWin *window, const char *const input);
 static char* _tls_autocomplete(ProfWin *window, const char *const input);
 static char* _script_autocomplete(ProfWin *window, const char *const input);
 static char* _subject_autocomplete(ProfWin *window, const char *const input);
-
-GHashTable *commands = NULL;
+static char* _xmlconsole_autocomplete(ProfWin *window, const char *const input);
+static char* _stats_autocomplete(ProfWin *window, const char *const input);
+static char* _boolean_autocomplete(ProfWin *window, const char *const input);
+static char* _contact_autocomplete(ProfWin *window, const char *const input);
+static char* _fulljid_autocomplete(ProfWin *window, const char *const input);
+static char* _ping_autocomplete(ProfWin *window, const char *const input);
+static char* _invite_autocomplete(ProfWin *window, const char *const input);
+static char* _decline_autocomplete(ProfWin *window, const char *const input);
+static char* _prefs_autocomplete(ProfWin *window, const char *const input);
+static char* _disco_autocomplete(ProfWin *window, const char *const input);
+static char* _close_autocomplete(ProfWin *window, const char *const input);
+static char* _room_autocomplete(ProfWin *window, const char *const input);
+static char* _history_autocomplete(ProfWin *window, const char *const input);
+
+// what a typed command runs, its definition or the expansion of an alias,
+// built by cmd_init and kept up to date by /alias so running a line needs
+// one lookup and no preferences
+typedef struct cmd_handler_t {
+    Command *cmd;
+    char *alias;
+} CmdHandler;
+
+static GHashTable *handlers = NULL;
+
+static void _cmd_handler_free(CmdHandler *handler);
+static void _cmd_handler_add(const char *const name, Command *cmd, char *alias);
 
 #define CMD_TAG_CHAT        "chat"
 #define CMD_TAG_GROUPCHAT   "groupchat"
@@ -132,6 +158,7 @@ GHashTable *commands = NULL;
 #define CMD_ARGS(...)       { __VA_ARGS__, { NULL, NULL } },
 #define CMD_NOEXAMPLES      { NULL } }
 #define CMD_EXAMPLES(...)   { __VA_ARGS__, NULL } }
+#define CMD_COMPLETE(func)  , func
 
 /*
  * Command list
@@ -157,6 +184,7 @@ static struct cmd_t command_defs[] =
             "/help commands",
             "/help presence",
             "/help who")
+        CMD_COMPLETE(_help_autocomplete)
     },
 
     { "/about",
@@ -195,6 +223,7 @@ static struct cmd_t command_defs[] =
             "/connect bob@someplace port 5678",
             "/connect me@localhost.test.org server 127.0.0.1 tls disable",
             "/connect me@chatty server chatty.com port 5443")
+        CMD_COMPLETE(_connect_autocomplete)
         },
 
     { "/tls",
@@ -229,6 +258,7 @@ static struct cmd_t command_defs[] =
             { "certpath clear",       "Clear the trusted certificate path." },
             { "show on|off",          "Show or hide the TLS indicator in the titlebar." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_tls_autocomplete)
     },
 
     { "/disconnect",
@@ -264,6 +294,7 @@ static struct cmd_t command_defs[] =
             "/msg otherfriend@server.com",
             "/msg Bob Here is a private message",
             "/msg \"My Friend\" Hi, how are you?")
+        CMD_COMPLETE(_contact_autocomplete)
     },
 
     { "/roster",
@@ -313,6 +344,7 @@ static struct cmd_t command_defs[] =
             "/roster nick myfriend@chat.org My Friend",
             "/roster clearnick kai@server.com",
             "/roster size 15")
+        CMD_COMPLETE(_roster_autocomplete)
     },
 
     { "/group",
@@ -338,6 +370,7 @@ static struct cmd_t command_defs[] =
             "/group add friends newfriend@server.org",
             "/group add family Brother",
             "/group remove colleagues boss@work.com")
+        CMD_COMPLETE(_group_autocomplete)
     },
 
     { "/info",
@@ -359,6 +392,7 @@ static struct cmd_t command_defs[] =
         CMD_EXAMPLES(
             "/info mybuddy@chat.server.org",
             "/info kai")
+        CMD_COMPLETE(_contact_autocomplete)
     },
 
     { "/caps",
@@ -380,28 +414,32 @@ static struct cmd_t command_defs[] =
             "/caps mybuddy@chat.server.org/laptop",
             "/caps mybuddy@chat.server.org/phone",
             "/caps bruce")
+        CMD_COMPLETE(_fulljid_autocomplete)
     },
 
     { "/software",
-        cmd_software, parse_args, 0, 1, NULL,
+        cmd_software, parse_args, 0, 10, NULL,
         CMD_TAGS(
             CMD_TAG_DISCOVERY,
             CMD_TAG_CHAT,
             CMD_TAG_GROUPCHAT)
         CMD_SYN(
             "/software",
-            "/software <fulljid>|<nick>")
+            "/software <fulljid>|<nick>",
+            "/software <fulljid> <fulljid> ...")
         CMD_DESC(
             "Find out a contact, or room members software version information. "
             "If in private chat initiated from a chat room, no parameter is required. "
-            "If the contact's software does not support software version requests, nothing will be displayed.")
+            "If the contact's software does not support software version requests, nothing will be displayed. "
+            "Results are remembered for a few minutes, until the contact goes offline or changes client.")
         CMD_ARGS(
-            { "<fulljid>", "If in the console or a chat window, the full JID for which you wish to see software information." },
+            { "<fulljid>", "If in the console, the full JID, or up to ten full JIDs, for which you wish to see software information." },
             { "<nick>",    "If in a chat room, nickname for which you wish to see software information." })
         CMD_EXAMPLES(
             "/software mybuddy@chat.server.org/laptop",
             "/software mybuddy@chat.server.org/phone",
             "/software bruce")
+        CMD_COMPLETE(_fulljid_autocomplete)
     },
 
     { "/status",
@@ -421,6 +459,7 @@ static struct cmd_t command_defs[] =
         CMD_EXAMPLES(
             "/status buddy@server.com",
             "/status jon")
+        CMD_COMPLETE(_contact_autocomplete)
     },
 
     { "/resource",
@@ -441,6 +480,7 @@ static struct cmd_t command_defs[] =
             { "title on|off",   "Show or hide the current resource in the titlebar." },
             { "message on|off", "Show or hide the resource when showing an incoming message." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_resource_autocomplete)
     },
 
     { "/join",
@@ -466,6 +506,7 @@ static struct cmd_t command_defs[] =
             "/join jdev@conference.jabber.org nick mynick",
             "/join private@conference.jabber.org nick mynick password mypassword",
             "/join jdev")
+        CMD_COMPLETE(_join_autocomplete)
     },
 
     { "/leave",
@@ -492,6 +533,7 @@ static struct cmd_t command_defs[] =
             { "<contact>", "The contact you wish to invite." },
             { "<message>", "An optional message to send with the invite." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_invite_autocomplete)
     },
 
     { "/invites",
@@ -517,21 +559,30 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "<room>", "The room for the invite you wish to decline." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_decline_autocomplete)
     },
 
     { "/room",
-        cmd_room, parse_args, 1, 1, NULL,
+        cmd_room, parse_args, 1, 2, NULL,
         CMD_TAGS(
             CMD_TAG_GROUPCHAT)
         CMD_SYN(
-            "/room accept|destroy|config")
+            "/room accept|destroy|config",
+            "/room policy [live|buffer|digest|mentions]")
         CMD_DESC(
-            "Chat room configuration.")
+            "Chat room configuration, and how much of the room's traffic is shown while it is not the current window. "
+            "Quiet messages are stored and laid out when the room is focused, without console notices, flashes, beeps or desktop notifications.")
         CMD_ARGS(
-            { "accept",  "Accept default room configuration." },
-            { "destroy", "Reject default room configuration, and destroy the room." },
-            { "config",  "Edit room configuration." })
+            { "accept",          "Accept default room configuration." },
+            { "destroy",         "Reject default room configuration, and destroy the room." },
+            { "config",          "Edit room configuration." },
+            { "policy",          "Show the traffic policy for the room." },
+            { "policy live",     "Show every message as it arrives, the default." },
+            { "policy buffer",   "Keep every message quiet." },
+            { "policy digest",   "Keep every message quiet, and summarise them in the console every five minutes." },
+            { "policy mentions", "Keep every message quiet except those mentioning you." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_room_autocomplete)
     },
 
     { "/kick",
@@ -546,6 +597,7 @@ static struct cmd_t command_defs[] =
             { "<nick>",   "Nickname of the occupant to kick from the room." },
             { "<reason>", "Optional reason for kicking the occupant." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_kick_autocomplete)
     },
 
     { "/ban",
@@ -560,6 +612,7 @@ static struct cmd_t command_defs[] =
             { "<jid>",    "Bare JID of the user to ban from the room." },
             { "<reason>", "Optional reason for banning the user." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_ban_autocomplete)
     },
 
     { "/subject",
@@ -581,6 +634,7 @@ static struct cmd_t command_defs[] =
             { "append <text>",  "Append text to the current room subject, use double quotes if a preceeding space is needed." },
             { "clear",          "Clear the room subject." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_subject_autocomplete)
     },
 
     { "/affiliation",
@@ -597,6 +651,7 @@ static struct cmd_t command_defs[] =
             { "set <affiliation> <jid> [<reason>]", "Set the affiliation of user with jid, with an optional reason." },
             { "list [<affiliation>]",               "List all users with the specified affiliation, or all if none specified." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_affiliation_autocomplete)
     },
 
     { "/role",
@@ -613,6 +668,7 @@ static struct cmd_t command_defs[] =
             { "set <role> <nick> [<reason>]", "Set the role of occupant with nick, with an optional reason." },
             { "list [<role>]",                "List all occupants with the specified role, or all if none specified." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_role_autocomplete)
     },
 
     { "/occupants",
@@ -623,7 +679,8 @@ static struct cmd_t command_defs[] =
         CMD_SYN(
             "/occupants show|hide [jid]",
             "/occupants default show|hide [jid]",
-            "/occupants size [<percent>]")
+            "/occupants size [<percent>]",
+            "/occupants large <count>|off")
         CMD_DESC(
             "Show or hide room occupants, and occupants panel display settings.")
         CMD_ARGS(
@@ -633,8 +690,11 @@ static struct cmd_t command_defs[] =
             { "hide jid",              "Hide jid in the occupants panel in current room." },
             { "default show|hide",     "Whether occupants are shown by default in new rooms." },
             { "default show|hide jid", "Whether occupants jids are shown by default in new rooms." },
-            { "size <percent>",        "Percentage of the screen taken by the occupants list in rooms (1-99)." })
+            { "size <percent>",        "Percentage of the screen taken by the occupants list in rooms (1-99)." },
+            { "large <count>",         "Rooms reaching this many occupants only keep the jid and status of moderators, admins and occupants looked up with /info, default 5000." },
+            { "large off",             "Keep the details of every occupant however large the room." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_occupants_autocomplete)
     },
 
     { "/form",
@@ -654,21 +714,26 @@ static struct cmd_t command_defs[] =
             { "cancel",       "Cancel changes to the current form." },
             { "help [<tag>]", "Display help for form, or a specific field." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_form_autocomplete)
     },
 
     { "/rooms",
-        cmd_rooms, parse_args, 0, 1, NULL,
+        cmd_rooms, parse_args, 0, 3, NULL,
         CMD_TAGS(
             CMD_TAG_GROUPCHAT)
         CMD_SYN(
-            "/rooms [<service>]")
+            "/rooms [<service>] [filter <text>]")
         CMD_DESC(
             "List the chat rooms available at the specified conference service. "
-            "If no argument is supplied, the account preference 'muc.service' is used, 'conference.<domain-part>' by default.")
+            "If no service is supplied, the account preference 'muc.service' is used, 'conference.<domain-part>' by default. "
+            "Rooms are listed a page at a time as the service sends them, and a list is shown again from memory for a minute.")
         CMD_ARGS(
-            { "<service>", "The conference service to query." })
+            { "<service>",     "The conference service to query." },
+            { "filter <text>", "Only list rooms whose address or name contains the text, ignoring case." })
         CMD_EXAMPLES(
-            "/rooms conference.jabber.org")
+            "/rooms conference.jabber.org",
+            "/rooms filter linux",
+            "/rooms conference.jabber.org filter linux")
     },
 
     { "/bookmark",
@@ -695,6 +760,7 @@ static struct cmd_t command_defs[] =
             { "autojoin on|off", "Whether to join the room automatically on login." },
             { "join <room>", "Join room using the properties associated with the bookmark." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_bookmark_autocomplete)
     },
 
     { "/disco",
@@ -715,26 +781,30 @@ static struct cmd_t command_defs[] =
             "/disco items myserver.org",
             "/disco items conference.jabber.org",
             "/disco info myfriend@server.com/laptop")
+        CMD_COMPLETE(_disco_autocomplete)
     },
 
     { "/lastactivity",
-        cmd_lastactivity, parse_args, 0, 1, NULL,
+        cmd_lastactivity, parse_args, 0, 10, NULL,
         CMD_TAGS(
             CMD_TAG_PRESENCE)
         CMD_SYN(
             "/lastactivity on|off",
-            "/lastactivity [<jid>]")
+            "/lastactivity [<jid>]",
+            "/lastactivity <jid> <jid> ...")
         CMD_DESC(
             "Enable/disable sending last activity, and send last activity requests.")
         CMD_ARGS(
             { "on|off", "Enable or disable sending of last activity." },
-            { "<jid>",  "The JID of the entity to query, omitting the JID will query your server." })
+            { "<jid>",  "The JID of the entity to query, or up to ten JIDs, omitting the JID will query your server." })
         CMD_EXAMPLES(
             "/lastactivity",
             "/lastactivity off",
             "/lastactivity alice@securechat.org",
             "/lastactivity alice@securechat.org/laptop",
+            "/lastactivity alice@securechat.org bob@securechat.org",
             "/lastactivity someserver.com")
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/nick",
@@ -771,7 +841,11 @@ static struct cmd_t command_defs[] =
             "/wins tidy",
             "/wins autotidy on|off",
             "/wins prune",
-            "/wins swap <source> <target>")
+            "/wins stats",
+            "/wins swap <source> <target>",
+            "/wins scrollback <mb>|off",
+            "/wins hibernate <minutes>|off",
+            "/wins restore on|off")
         CMD_DESC(
             "Manage windows. "
             "Passing no argument will list all currently active windows and information about their usage.")
@@ -779,8 +853,15 @@ static struct cmd_t command_defs[] =
             { "tidy",                   "Move windows so there are no gaps." },
             { "autotidy on|off",        "Automatically remove gaps when closing windows." },
             { "prune",                  "Close all windows with no unread messages, and then tidy so there are no gaps." },
-            { "swap <source> <target>", "Swap windows, target may be an empty position." })
-        CMD_NOEXAMPLES
+            { "stats",                  "Show what each window costs: entries and memory of its messages, memory of its drawing pads, lines added in the last minute, time spent drawing it and chat log bytes written this session." },
+            { "swap <source> <target>", "Swap windows, target may be an empty position." },
+            { "scrollback <mb>|off",    "Limit the memory used by messages in all windows, the oldest messages of the least recently viewed windows are removed first. Chat and room history can be fetched again from the server archive by paging up." },
+            { "hibernate <minutes>|off", "Free the drawing memory of windows not viewed for the given number of minutes, they are redrawn when next shown." },
+            { "restore on|off",         "Save chat windows and their messages every minute and on quitting, and open them again with the same numbers on the next start." })
+        CMD_EXAMPLES(
+            "/wins scrollback 64",
+            "/wins hibernate 30")
+        CMD_COMPLETE(_wins_autocomplete)
     },
 
     { "/sub",
@@ -790,7 +871,9 @@ static struct cmd_t command_defs[] =
         CMD_SYN(
             "/sub request [<jid>]",
             "/sub allow [<jid>]",
+            "/sub allow all|<pattern>",
             "/sub deny [<jid>]",
+            "/sub deny all|<pattern>",
             "/sub show [<jid>]",
             "/sub sent",
             "/sub received")
@@ -801,14 +884,18 @@ static struct cmd_t command_defs[] =
             { "request [<jid>]", "Send a subscription request to the user." },
             { "allow [<jid>]",   "Approve a contact's subscription request." },
             { "deny [<jid>]",    "Remove subscription for a contact, or deny a request." },
+            { "allow|deny all",  "Approve or deny every received subscription request." },
+            { "allow|deny <pattern>", "Approve or deny the received requests from jids matching a pattern, using * and ?." },
             { "show [<jid>]",    "Show subscription status for a contact." },
             { "sent",            "Show all sent subscription requests pending a response." },
             { "received",        "Show all received subscription requests awaiting your response." })
         CMD_EXAMPLES(
             "/sub request myfriend@jabber.org",
             "/sub allow myfriend@jabber.org",
+            "/sub deny *@spam.example.com",
             "/sub request",
             "/sub sent")
+        CMD_COMPLETE(_sub_autocomplete)
     },
 
     { "/tiny",
@@ -826,6 +913,22 @@ static struct cmd_t command_defs[] =
             "Example: /tiny http://www.profanity.im")
     },
 
+    { "/sendfile",
+        cmd_sendfile, parse_args_with_freetext, 1, 1, NULL,
+        CMD_TAGS(
+            CMD_TAG_CHAT,
+            CMD_TAG_GROUPCHAT)
+        CMD_SYN(
+            "/sendfile <file>")
+        CMD_DESC(
+            "Upload a file to the server's HTTP File Upload service and send the link in the current chat. "
+            "The file is streamed from disk, progress is shown in the status bar and several uploads can run at once.")
+        CMD_ARGS(
+            { "<file>", "Path to the file to send." })
+        CMD_EXAMPLES(
+            "/sendfile ~/images/holiday.jpg")
+    },
+
     { "/who",
         cmd_who, parse_args, 0, 2, NULL,
         CMD_TAGS(
@@ -855,6 +958,7 @@ static struct cmd_t command_defs[] =
             "/who any family",
             "/who participant",
             "/who admin")
+        CMD_COMPLETE(_who_autocomplete)
     },
 
     { "/close",
@@ -872,6 +976,7 @@ static struct cmd_t command_defs[] =
             { "all", "Close all windows." },
             { "read", "Close all windows that have no unread messages." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_close_autocomplete)
     },
 
     { "/clear",
@@ -909,6 +1014,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable privilege information." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/beep",
@@ -924,6 +1030,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable terminal bell." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/encwarn",
@@ -938,6 +1045,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enabled or disable the unencrypted warning message in the titlebar." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/presence",
@@ -952,6 +1060,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Switch display of the contacts presence in the titlebar on or off." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/wrap",
@@ -965,6 +1074,23 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable word wrapping in the main window." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
+    },
+
+    { "/fuzzy",
+        cmd_fuzzy, parse_args, 1, 1, &cons_fuzzy_setting,
+        CMD_TAGS(
+            CMD_TAG_UI)
+        CMD_SYN(
+            "/fuzzy on|off")
+        CMD_DESC(
+            "Fuzzy tab completion of contacts, rooms and nicknames. "
+            "Any item containing the typed characters in order is offered, best matches first, "
+            "with recent and frequent conversations ranked higher.")
+        CMD_ARGS(
+            { "on|off", "Enable or disable fuzzy completion, when off only items starting with the typed text are offered." })
+        CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/time",
@@ -1005,6 +1131,7 @@ static struct cmd_t command_defs[] =
             "/time xml off",
             "/time statusbar set %H:%M",
             "/time lastactivity set \"%d-%m-%y %H:%M:%S\"")
+        CMD_COMPLETE(_time_autocomplete)
     },
 
     { "/inpblock",
@@ -1013,17 +1140,23 @@ static struct cmd_t command_defs[] =
             CMD_TAG_UI)
         CMD_SYN(
             "/inpblock timeout <millis>",
-            "/inpblock dynamic on|off")
+            "/inpblock dynamic on|off",
+            "/inpblock budget <millis>",
+            "/inpblock render <millis>")
         CMD_DESC(
-            "How long to wait for keyboard input before checking for new messages or checking for state changes such as 'idle'.")
+            "How long to wait for keyboard input before checking for new messages or checking for state changes such as 'idle'. "
+            "How long to spend handling incoming stanzas before the screen is updated and input is read again.")
         CMD_ARGS(
             { "timeout <millis>", "Time to wait (1-1000) in milliseconds before reading input from the terminal buffer, default: 1000." },
-            { "dynamic on|off", "Start with 0 millis and dynamically increase up to timeout when no activity, default: on." })
+            { "dynamic on|off", "Start with 0 millis and dynamically increase up to timeout when no activity, default: on." },
+            { "budget <millis>", "Time (1-1000) in milliseconds spent on incoming stanzas in each pass, the rest are handled in the next pass, default: 20. Messages to you and in the current room are handled before presence, typing notifications and other rooms." },
+            { "render <millis>", "Time (0-1000) in milliseconds that a window flooded with messages waits between redraws, messages that scroll past unseen are shown as collapsed, 0 to disable, default: 0." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_inpblock_autocomplete)
     },
 
     { "/notify",
-        cmd_notify, parse_args, 2, 3, &cons_notify_setting,
+        cmd_notify, parse_args, 2, 4, &cons_notify_setting,
         CMD_TAGS(
             CMD_TAG_UI,
             CMD_TAG_CHAT,
@@ -1033,6 +1166,10 @@ static struct cmd_t command_defs[] =
             "/notify message current on|off",
             "/notify message text on|off",
             "/notify room on|off|mention",
+            "/notify room mention case_sensitive|case_insensitive",
+            "/notify room mention word_whole|word_part",
+            "/notify room trigger add|remove <text>",
+            "/notify room trigger list",
             "/notify room current on|off",
             "/notify room text on|off",
             "/notify remind <seconds>",
@@ -1046,7 +1183,11 @@ static struct cmd_t command_defs[] =
             { "message on|off", "Notifications for regular chat messages." },
             { "message current on|off", "Whether messages in the current window trigger notifications." },
             { "message text on|off", "Show message text in regular message notifications." },
-            { "room on|off|mention", "Notifications for chat room messages, mention triggers notifications only when your nick is mentioned." },
+            { "room on|off|mention", "Notifications for chat room messages, mention triggers notifications only when your nick or a trigger is mentioned." },
+            { "room mention case_sensitive|case_insensitive", "Whether mentions must match the case of your nick and triggers, mentions are also highlighted in the room." },
+            { "room mention word_whole|word_part", "Whether mentions must be whole words, or may be part of a longer word." },
+            { "room trigger add|remove <text>", "Words to treat as mentions as well as your nick, use quotes for text with spaces." },
+            { "room trigger list", "List the room mention triggers." },
             { "room current on|off", "Whether chat room messages in the current window trigger notifications." },
             { "room text on|off", "Show message text in chat room message notifications." },
             { "remind <seconds>", "Notification reminder period for unread messages, use 0 to disable." },
@@ -1058,11 +1199,14 @@ static struct cmd_t command_defs[] =
             "/notify message on",
             "/notify message text on",
             "/notify room mention",
+            "/notify room mention word_whole",
+            "/notify room trigger add \"on call\"",
             "/notify room current off",
             "/notify room text off",
             "/notify remind 10",
             "/notify typing on",
             "/notify invite on")
+        CMD_COMPLETE(_notify_autocomplete)
     },
 
     { "/flash",
@@ -1077,6 +1221,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable terminal flash." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/intype",
@@ -1091,6 +1236,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable contact typing messages." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/splash",
@@ -1104,6 +1250,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable splash logo." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/autoconnect",
@@ -1122,6 +1269,7 @@ static struct cmd_t command_defs[] =
         CMD_EXAMPLES(
             "/autoconnect set jc@stuntteam.org",
             "/autoconnect off")
+        CMD_COMPLETE(_autoconnect_autocomplete)
     },
 
     { "/vercheck",
@@ -1135,6 +1283,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable the version check." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/titlebar",
@@ -1150,6 +1299,7 @@ static struct cmd_t command_defs[] =
             { "show on|off",    "Show current logged in user, and unread messages as the window title." },
             { "goodbye on|off", "Show a message in the title when exiting profanity." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_titlebar_autocomplete)
     },
 
     { "/alias",
@@ -1171,6 +1321,7 @@ static struct cmd_t command_defs[] =
             "/alias a /away \"I'm in a meeting.\"",
             "/alias remove q",
             "/alias list")
+        CMD_COMPLETE(_alias_autocomplete)
     },
 
     { "/chlog",
@@ -1187,6 +1338,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable chat logging." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/grlog",
@@ -1201,6 +1353,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable chat room logging." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/states",
@@ -1214,6 +1367,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable sending of chat state notifications." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/pgp",
@@ -1249,6 +1403,7 @@ static struct cmd_t command_defs[] =
             "/pgp start buddy@buddychat.org",
             "/pgp end",
             "/pgp char P")
+        CMD_COMPLETE(_pgp_autocomplete)
     },
 
     { "/otr",
@@ -1302,6 +1457,7 @@ static struct cmd_t command_defs[] =
             "/otr question \"What is the name of my rabbit?\" fiffi",
             "/otr end",
             "/otr char *")
+        CMD_COMPLETE(_otr_autocomplete)
     },
 
     { "/outtype",
@@ -1315,6 +1471,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable sending typing notifications." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/gone",
@@ -1332,36 +1489,92 @@ static struct cmd_t command_defs[] =
     },
 
     { "/history",
-        cmd_history, parse_args, 1, 1, &cons_history_setting,
+        cmd_history, parse_args_with_freetext, 1, 2, &cons_history_setting,
         CMD_TAGS(
             CMD_TAG_UI,
             CMD_TAG_CHAT)
         CMD_SYN(
-            "/history on|off")
+            "/history on|off",
+            "/history search <words>",
+            "/history index")
         CMD_DESC(
             "Switch chat history on or off, /chlog will automatically be enabled when this setting is on. "
-            "When history is enabled, previous messages are shown in chat windows.")
+            "When history is enabled, previous messages are shown in chat windows. "
+            "Chat and room logs for the current account are indexed as they are written and can be searched.")
         CMD_ARGS(
-            { "on|off", "Enable or disable showing chat history." })
-        CMD_NOEXAMPLES
+            { "on|off",          "Enable or disable showing chat history." },
+            { "search <words>",  "Show the most recent logged messages containing all of the words." },
+            { "index",           "Index logs written before the search index existed." })
+        CMD_EXAMPLES(
+            "/history search release date")
+        CMD_COMPLETE(_history_autocomplete)
+    },
+
+    { "/search",
+        cmd_search, parse_args_with_freetext, 1, 1, NULL,
+        CMD_TAGS(
+            CMD_TAG_UI)
+        CMD_SYN(
+            "/search <text>")
+        CMD_DESC(
+            "Jump to the most recent message in the current window containing the text, ignoring case. "
+            "Repeating the search moves to older matches, the match stays highlighted until the window is scrolled back to the end. "
+            "Alt-s starts the same search as you type, Ctrl-R moves to the next older match and Ctrl-G returns to the end. "
+            "Only messages still in the window are searched, use /history search for the logs.")
+        CMD_ARGS(
+            { "<text>", "Text to look for." })
+        CMD_EXAMPLES(
+            "/search release date")
     },
 
     { "/log",
-        cmd_log, parse_args, 1, 2, &cons_log_setting,
+        cmd_log, parse_args, 1, 4, &cons_log_setting,
         CMD_NOTAGS
         CMD_SYN(
             "/log where",
             "/log rotate on|off",
             "/log maxsize <bytes>",
-            "/log shared on|off")
+            "/log shared on|off",
+            "/log flush on|off",
+            "/log async on|off",
+            "/log binary on|off",
+            "/log compress on|off",
+            "/log chatmaxsize <bytes>",
+            "/log slow <ms>",
+            "/log retention maxage <days>",
+            "/log retention maxsize <bytes>",
+            "/log retention archive <days>",
+            "/log convert",
+            "/log area <area> level DEBUG|INFO|WARN|ERROR",
+            "/log area <area> rate <records>",
+            "/log area <area> sample <n>",
+            "/log area <area> clear")
         CMD_DESC(
             "Manage profanity log settings.")
         CMD_ARGS(
             { "where",           "Show the current log file location." },
             { "rotate on|off",   "Rotate log, default on." },
             { "maxsize <bytes>", "With rotate enabled, specifies the max log size, defaults to 1048580 (1MB)." },
-            { "shared on|off",   "Share logs between all instances, default: on. When off, the process id will be included in the log." })
-        CMD_NOEXAMPLES
+            { "shared on|off",   "Share logs between all instances, default: on. When off, the process id will be included in the log." },
+            { "flush on|off",    "Write chat and room logs to disk after every message, default: off. When off, logs are written at most a second after a message is received." },
+            { "async on|off",    "Write the main log and chat logs from a background thread, default: off." },
+            { "binary on|off",   "Write chat logs in a binary format keeping full timestamps, message ids, receipts and encryption, default: off." },
+            { "compress on|off", "Compress the rotated log with gzip, default: off." },
+            { "chatmaxsize <bytes>", "Start a new numbered part of a chat or room log once the day's log reaches this size, 0 to only start new logs daily, default: 0." },
+            { "slow <ms>",       "Log a warning for each main loop iteration, command, timer or stanza handler taking longer than this, naming any disk, gpgme or curl calls it made, 0 to turn off, default: 0." },
+            { "retention maxage <days>", "Delete chat and room logs older than this many days, 0 to keep them, default: 0." },
+            { "retention maxsize <bytes>", "Delete the oldest days of a chat or room log while its logs take more than this, 0 for no limit, default: 0." },
+            { "retention archive <days>", "Compress chat and room logs older than this many days with gzip, they can still be read as history, 0 to never compress, default: 0." },
+            { "convert",         "Convert the text chat logs of the current account to the binary format." },
+            { "area <area> level DEBUG|INFO|WARN|ERROR", "Override the log level for one area of the main log, e.g. xmpp." },
+            { "area <area> rate <records>", "Write at most this many DEBUG and INFO records per second for the area, 0 for no limit." },
+            { "area <area> sample <n>", "Write only one in every n DEBUG and INFO records for the area, 0 or 1 to write all." },
+            { "area <area> clear", "Remove all overrides for the area." })
+        CMD_EXAMPLES(
+            "/log area xmpp level DEBUG",
+            "/log area xmpp sample 10",
+            "/log area xmpp rate 100")
+        CMD_COMPLETE(_log_autocomplete)
     },
 
     { "/carbons",
@@ -1376,6 +1589,39 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "on|off", "Enable or disable message carbons." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
+    },
+
+    { "/sm",
+        cmd_sm, parse_args, 1, 1, &cons_sm_setting,
+        CMD_TAGS(
+            CMD_TAG_CONNECTION)
+        CMD_SYN(
+            "/sm on|off")
+        CMD_DESC(
+            "Enable or disable stream management (XEP-0198) for the next login. "
+            "The server acknowledges the messages it receives, messages not acknowledged when the connection drops are sent again after reconnecting. "
+            "Only enable this for servers that support stream management.")
+        CMD_ARGS(
+            { "on|off", "Enable or disable stream management." })
+        CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
+    },
+
+    { "/csi",
+        cmd_csi, parse_args, 1, 1, &cons_csi_setting,
+        CMD_TAGS(
+            CMD_TAG_CONNECTION)
+        CMD_SYN(
+            "/csi on|off")
+        CMD_DESC(
+            "Enable or disable client state indication (XEP-0352). "
+            "The server is told when you are idle, using the autoaway time, so it can hold back presence updates and chat states until you return. "
+            "Only enable this for servers that support client state indication.")
+        CMD_ARGS(
+            { "on|off", "Enable or disable client state indication." })
+        CMD_NOEXAMPLES
+        CMD_COMPLETE(_boolean_autocomplete)
     },
 
     { "/receipts",
@@ -1384,13 +1630,16 @@ static struct cmd_t command_defs[] =
             CMD_TAG_CHAT)
         CMD_SYN(
             "/receipts request on|off",
-            "/receipts send on|off")
+            "/receipts send on|off",
+            "/receipts markers on|off")
         CMD_DESC(
             "Enable or disable message delivery receipts. The interface will indicate when a message has been received.")
         CMD_ARGS(
             { "request on|off", "Whether or not to request a receipt upon sending a message." },
-            { "send on|off",    "Whether or not to send a receipt if one has been requested with a received message." })
+            { "send on|off",    "Whether or not to send a receipt if one has been requested with a received message." },
+            { "markers on|off", "Whether or not to use chat markers, sending one displayed marker for the latest message when its window is viewed, instead of a receipt per message." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_receipts_autocomplete)
     },
 
     { "/reconnect",
@@ -1407,15 +1656,18 @@ static struct cmd_t command_defs[] =
     },
 
     { "/autoping",
-        cmd_autoping, parse_args, 1, 1, &cons_autoping_setting,
+        cmd_autoping, parse_args, 1, 2, &cons_autoping_setting,
         CMD_TAGS(
             CMD_TAG_CONNECTION)
         CMD_SYN(
-            "/autoping <seconds>")
+            "/autoping <seconds>",
+            "/autoping misses <count>")
         CMD_DESC(
-            "Set the interval between sending ping requests to the server to ensure the connection is kept alive.")
+            "Ping the server when nothing has been received from it for a while, to ensure the connection is kept alive. "
+            "When pings go unanswered the connection is dropped, and reconnected if /reconnect is set.")
         CMD_ARGS(
-            { "<seconds>", "Number of seconds between sending pings, a value of 0 disables autoping." })
+            { "<seconds>", "Number of seconds without traffic before sending a ping, a value of 0 disables autoping." },
+            { "misses <count>", "Number of unanswered pings in a row before the connection is dropped, 2 by default." })
         CMD_NOEXAMPLES
     },
 
@@ -1431,6 +1683,7 @@ static struct cmd_t command_defs[] =
         CMD_ARGS(
             { "<jid>", "The Jabber ID to send the ping request to." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_ping_autocomplete)
     },
 
     { "/autoaway",
@@ -1462,6 +1715,7 @@ static struct cmd_t command_defs[] =
             "/autoaway time xa 120",
             "/autoaway message xa Away from computer for a very long time",
             "/autoaway check off")
+        CMD_COMPLETE(_autoaway_autocomplete)
     },
 
     { "/priority",
@@ -1510,13 +1764,17 @@ static struct cmd_t command_defs[] =
             "/account set <account> pgpkeyid <pgpkeyid>",
             "/account set <account> startscript <script>",
             "/account set <account> tls force|allow|disable",
+            "/account set <account> compression on|off",
+            "/account set <account> history.maxstanzas|history.maxchars|history.seconds <value>",
+            "/account set <account> history.since on|off",
             "/account clear <account> password",
             "/account clear <account> eval_password",
             "/account clear <account> server",
             "/account clear <account> port",
             "/account clear <account> otr",
             "/account clear <account> pgpkeyid",
-            "/account clear <account> startscript")
+            "/account clear <account> startscript",
+            "/account clear <account> history")
         CMD_DESC(
             "Commands for creating and managing accounts. "
             "Calling with no arguments will display information for the current account.")
@@ -1547,13 +1805,19 @@ static struct cmd_t command_defs[] =
             { "set <account> tls force",                "Force TLS connection, and fail if one cannot be established, this is default behaviour." },
             { "set <account> tls allow",                "Use TLS for the connection if it is available." },
             { "set <account> tls disable",              "Disable TLS for the connection." },
+            { "set <account> compression on|off",       "Request zlib stream compression (XEP-0138) on connect, when supported by libstrophe and the server." },
+            { "set <account> history.maxstanzas <value>", "Maximum number of history messages to request when joining a room." },
+            { "set <account> history.maxchars <value>", "Maximum number of characters of history to request when joining a room." },
+            { "set <account> history.seconds <value>",  "Only request history from the last number of seconds when joining a room." },
+            { "set <account> history.since on|off",     "Only request history newer than the last logged message in the room, requires /grlog." },
             { "clear <account> server",                 "Remove the server setting for this account." },
             { "clear <account> port",                   "Remove the port setting for this account." },
             { "clear <account> password",               "Remove the password setting for this account." },
             { "clear <account> eval_password",          "Remove the eval_password setting for this account." },
             { "clear <account> otr",                    "Remove the OTR policy setting for this account." },
             { "clear <account> pgpkeyid",               "Remove pgpkeyid associated with this account." },
-            { "clear <account> startscript",            "Remove startscript associated with this account." })
+            { "clear <account> startscript",            "Remove startscript associated with this account." },
+            { "clear <account> history",                "Remove the room history settings, rooms send their default history." })
         CMD_EXAMPLES(
             "/account add me",
             "/account set me jid me@chatty",
@@ -1564,6 +1828,7 @@ static struct cmd_t command_defs[] =
             "/account set me status dnd",
             "/account set me dnd -1",
             "/account rename me gtalk")
+        CMD_COMPLETE(_account_autocomplete)
     },
 
     { "/prefs",
@@ -1584,6 +1849,7 @@ static struct cmd_t command_defs[] =
             { "otr",      "Off The Record preferences." },
             { "pgp",      "OpenPGP preferences." })
         CMD_NOEXAMPLES
+        CMD_COMPLETE(_prefs_autocomplete)
     },
 
     { "/theme",
@@ -1603,6 +1869,7 @@ static struct cmd_t command_defs[] =
         CMD_EXAMPLES(
             "/theme list",
             "/theme load forest")
+        CMD_COMPLETE(_theme_autocomplete)
     },
 
     { "/statuses",
@@ -1627,18 +1894,62 @@ static struct cmd_t command_defs[] =
             "/statuses console none",
             "/statuses chat online",
             "/statuses muc all")
+        CMD_COMPLETE(_statuses_autocomplete)
     },
 
     { "/xmlconsole",
-        cmd_xmlconsole, parse_args, 0, 0, NULL,
+        cmd_xmlconsole, parse_args, 0, 3, NULL,
         CMD_TAGS(
             CMD_TAG_UI)
         CMD_SYN(
-            "/xmlconsole")
+            "/xmlconsole",
+            "/xmlconsole filter",
+            "/xmlconsole filter add <name>|<namespace>",
+            "/xmlconsole filter remove <name>|<namespace>",
+            "/xmlconsole filter clear")
         CMD_DESC(
-            "Open the XML console to view incoming and outgoing XMPP traffic.")
-        CMD_NOARGS
-        CMD_NOEXAMPLES
+            "Open the XML console to view incoming and outgoing XMPP traffic. "
+            "Filters limit the console to stanzas with a matching top level element name, or containing a matching namespace.")
+        CMD_ARGS(
+            { "filter",                                 "Show the current filters." },
+            { "filter add <name>|<namespace>",          "Only show stanzas matching this, or any other filter." },
+            { "filter remove <name>|<namespace>",       "Remove a filter." },
+            { "filter clear",                           "Remove all filters and show all traffic." })
+        CMD_EXAMPLES(
+            "/xmlconsole filter add message",
+            "/xmlconsole filter add urn:xmpp:mam:1",
+            "/xmlconsole filter clear")
+        CMD_COMPLETE(_xmlconsole_autocomplete)
+    },
+
+    { "/stats",
+        cmd_stats, parse_args, 0, 2, NULL,
+        CMD_TAGS(
+            CMD_TAG_UI)
+        CMD_SYN(
+            "/stats",
+            "/stats histograms",
+            "/stats dump <file>",
+            "/stats reset",
+            "/stats memory",
+            "/stats traffic [<count>]")
+        CMD_DESC(
+            "Show counts and latencies recorded for stanza handling, rendering, logging and encryption. "
+            "Latencies are kept in power of two microsecond buckets, percentiles are the upper bound of their bucket. "
+            "Only available when Profanity is built with --enable-stats, "
+            "memory use by structure needs --enable-alloc-stats. "
+            "Traffic for the current connection is always available.")
+        CMD_ARGS(
+            { "histograms",     "Also show the count in each latency bucket." },
+            { "dump <file>",    "Write the statistics and histograms to a file." },
+            { "reset",          "Clear everything recorded so far." },
+            { "memory",         "Show the count and bytes of live allocations for each kind of structure." },
+            { "traffic [<count>]", "Show stanzas and bytes sent and received since connecting by stanza type, the current rate, and the <count> busiest namespaces and contacts or rooms, 10 by default, 0 for all." })
+        CMD_EXAMPLES(
+            "/stats",
+            "/stats traffic 5",
+            "/stats dump /tmp/profanity-stats.txt")
+        CMD_COMPLETE(_stats_autocomplete)
     },
 
     { "/away",
@@ -1725,7 +2036,9 @@ static struct cmd_t command_defs[] =
             "/script show <script>")
         CMD_DESC(
             "Run command scripts. "
-            "Scripts are stored in $XDG_DATA_HOME/profanity/scripts/ which is usually $HOME/.local/share/profanity/scripts/.")
+            "Scripts are stored in $XDG_DATA_HOME/profanity/scripts/ which is usually $HOME/.local/share/profanity/scripts/. "
+            "A line of 'wait-for connected', 'wait-for roster' or 'wait-for room <roomjid>' pauses the script "
+            "until connected, the roster is received or the room is joined, for at most 30 seconds.")
         CMD_ARGS(
             { "script run <script>",    "Execute a script." },
             { "script list",            "List all scripts TODO." },
@@ -1734,9 +2047,19 @@ static struct cmd_t command_defs[] =
             "/script list",
             "/script run myscript",
             "/script show somescript")
+        CMD_COMPLETE(_script_autocomplete)
     },
 };
 
+// command_defs by name and the names /help completes, both filled once so
+// lookups, /help lists and docgen need no table or sorting of their own
+static Command *cmd_index[ARRAY_SIZE(command_defs)];
+static const char *help_items[ARRAY_SIZE(command_defs) + 2];
+static gboolean cmd_index_built = FALSE;
+
+static void _cmd_index_build(void);
+static int _cmd_index_find(const void *key, const void *item);
+
 static Autocomplete commands_ac;
 static Autocomplete who_room_ac;
 static Autocomplete who_roster_ac;
@@ -1744,11 +2067,15 @@ static Autocomplete help_ac;
 static Autocomplete help_commands_ac;
 static Autocomplete notify_ac;
 static Autocomplete notify_room_ac;
+static Autocomplete notify_mention_ac;
+static Autocomplete notify_trigger_ac;
 static Autocomplete notify_message_ac;
 static Autocomplete notify_typing_ac;
 static Autocomplete prefs_ac;
 static Autocomplete sub_ac;
 static Autocomplete log_ac;
+static Autocomplete log_retention_ac;
+static Autocomplete history_ac;
 static Autocomplete autoaway_ac;
 static Autocomplete autoaway_mode_ac;
 static Autocomplete autoaway_presence_ac;
@@ -1782,6 +2109,7 @@ static Autocomplete alias_ac;
 static Autocomplete aliases_ac;
 static Autocomplete join_property_ac;
 static Autocomplete room_ac;
+static Autocomplete room_policy_ac;
 static Autocomplete affiliation_ac;
 static Autocomplete role_ac;
 static Autocomplete privilege_cmd_ac;
@@ -1802,6 +2130,287 @@ static Autocomplete tls_ac;
 static Autocomplete tls_certpath_ac;
 static Autocomplete script_ac;
 static Autocomplete script_show_ac;
+static Autocomplete xmlconsole_ac;
+static Autocomplete xmlconsole_filter_ac;
+static Autocomplete stats_ac;
+
+// fixed completions, each sorted and used in place by autocomplete_new_static
+static const char *const help_commands_items[] = {
+    "chat", "connection", "discovery", "groupchat", "presence", "roster", "ui",
+};
+
+static const char *const prefs_items[] = {
+    "chat", "conn", "desktop", "log", "otr", "pgp", "presence", "ui",
+};
+
+static const char *const notify_items[] = {
+    "invite", "message", "remind", "room", "sub", "typing",
+};
+
+static const char *const notify_message_items[] = {
+    "current", "off", "on", "text",
+};
+
+static const char *const notify_room_items[] = {
+    "current", "mention", "off", "on", "text", "trigger",
+};
+
+static const char *const notify_mention_items[] = {
+    "case_insensitive", "case_sensitive", "word_part", "word_whole",
+};
+
+static const char *const notify_trigger_items[] = {
+    "add", "list", "remove",
+};
+
+static const char *const notify_typing_items[] = {
+    "current", "off", "on",
+};
+
+static const char *const sub_items[] = {
+    "allow", "deny", "received", "request", "sent", "show",
+};
+
+static const char *const titlebar_items[] = {
+    "goodbye", "show",
+};
+
+static const char *const log_retention_items[] = {
+    "archive", "maxage", "maxsize",
+};
+
+static const char *const history_items[] = {
+    "index", "off", "on", "search",
+};
+
+static const char *const log_items[] = {
+    "area", "async", "binary", "chatmaxsize", "compress", "convert", "flush", "maxsize",
+    "retention", "rotate", "shared", "slow", "where",
+};
+
+static const char *const autoaway_items[] = {
+    "check", "message", "mode", "time",
+};
+
+static const char *const autoaway_mode_items[] = {
+    "away", "idle", "off",
+};
+
+static const char *const autoaway_presence_items[] = {
+    "away", "xa",
+};
+
+static const char *const autoconnect_items[] = {
+    "off", "set",
+};
+
+static const char *const theme_items[] = {
+    "colours", "list", "load",
+};
+
+static const char *const disco_items[] = {
+    "info", "items",
+};
+
+static const char *const account_items[] = {
+    "add", "clear", "default", "disable", "enable", "list", "remove", "rename", "set", "show",
+};
+
+static const char *const account_set_items[] = {
+    "away", "chat", "compression", "dnd", "eval_password", "history.maxchars", "history.maxstanzas",
+    "history.seconds", "history.since", "jid", "muc", "nick", "online", "otr", "password",
+    "pgpkeyid", "port", "resource", "server", "startscript", "status", "tls", "xa",
+};
+
+static const char *const account_clear_items[] = {
+    "eval_password", "history", "otr", "password", "pgpkeyid", "port", "server", "startscript",
+};
+
+static const char *const account_default_items[] = {
+    "off", "set",
+};
+
+static const char *const account_status_items[] = {
+    "away", "chat", "dnd", "last", "online", "xa",
+};
+
+static const char *const close_items[] = {
+    "all", "read",
+};
+
+static const char *const wins_items[] = {
+    "autotidy", "hibernate", "prune", "restore", "scrollback", "stats", "swap", "tidy",
+};
+
+static const char *const roster_items[] = {
+    "add", "by", "clearnick", "hide", "nick", "online", "remove", "remove_all", "show", "size",
+};
+
+static const char *const roster_option_items[] = {
+    "empty", "offline", "resource",
+};
+
+static const char *const roster_by_items[] = {
+    "group", "none", "presence",
+};
+
+static const char *const roster_remove_all_items[] = {
+    "contacts",
+};
+
+static const char *const group_items[] = {
+    "add", "remove", "show",
+};
+
+static const char *const who_roster_items[] = {
+    "any", "available", "away", "chat", "dnd", "offline", "online", "unavailable", "xa",
+};
+
+static const char *const who_room_items[] = {
+    "admin", "available", "away", "chat", "dnd", "member", "moderator", "online", "owner",
+    "participant", "unavailable", "visitor", "xa",
+};
+
+static const char *const bookmark_items[] = {
+    "add", "join", "list", "remove", "update",
+};
+
+static const char *const bookmark_property_items[] = {
+    "autojoin", "nick", "password",
+};
+
+static const char *const otr_items[] = {
+    "answer", "char", "end", "gen", "libver", "log", "myfp", "policy", "question", "secret",
+    "start", "theirfp", "trust", "untrust",
+};
+
+static const char *const otr_log_items[] = {
+    "off", "on", "redact",
+};
+
+static const char *const otr_policy_items[] = {
+    "always", "manual", "opportunistic",
+};
+
+static const char *const connect_property_items[] = {
+    "port", "server", "tls",
+};
+
+static const char *const tls_property_items[] = {
+    "allow", "disable", "force",
+};
+
+static const char *const join_property_items[] = {
+    "nick", "password",
+};
+
+static const char *const statuses_items[] = {
+    "chat", "console", "muc",
+};
+
+static const char *const statuses_setting_items[] = {
+    "all", "none", "online",
+};
+
+static const char *const alias_items[] = {
+    "add", "list", "remove",
+};
+
+static const char *const room_items[] = {
+    "accept", "config", "destroy", "policy",
+};
+
+static const char *const room_policy_items[] = {
+    "buffer", "digest", "live", "mentions",
+};
+
+static const char *const affiliation_items[] = {
+    "admin", "member", "none", "outcast", "owner",
+};
+
+static const char *const role_items[] = {
+    "moderator", "none", "participant", "visitor",
+};
+
+static const char *const privilege_cmd_items[] = {
+    "list", "set",
+};
+
+static const char *const subject_items[] = {
+    "append", "clear", "edit", "prepend", "set",
+};
+
+static const char *const form_items[] = {
+    "cancel", "help", "show", "submit",
+};
+
+static const char *const form_field_multi_items[] = {
+    "add", "remove",
+};
+
+static const char *const occupants_items[] = {
+    "default", "hide", "large", "show", "size",
+};
+
+static const char *const occupants_default_items[] = {
+    "hide", "show",
+};
+
+static const char *const occupants_show_items[] = {
+    "jid",
+};
+
+static const char *const time_items[] = {
+    "chat", "console", "lastactivity", "muc", "mucconfig", "private", "statusbar", "xml",
+};
+
+static const char *const time_format_items[] = {
+    "off", "set",
+};
+
+static const char *const resource_items[] = {
+    "message", "off", "set", "title",
+};
+
+static const char *const inpblock_items[] = {
+    "budget", "dynamic", "render", "timeout",
+};
+
+static const char *const receipts_items[] = {
+    "markers", "request", "send",
+};
+
+static const char *const pgp_items[] = {
+    "char", "contacts", "end", "keys", "libver", "log", "setkey", "start",
+};
+
+static const char *const pgp_log_items[] = {
+    "off", "on", "redact",
+};
+
+static const char *const tls_items[] = {
+    "allow", "always", "cert", "certpath", "deny", "revoke", "show", "trust", "trusted",
+};
+
+static const char *const tls_certpath_items[] = {
+    "clear", "set",
+};
+
+static const char *const script_items[] = {
+    "list", "run", "show",
+};
+
+static const char *const xmlconsole_items[] = {
+    "filter",
+};
+
+static const char *const xmlconsole_filter_items[] = {
+    "add", "clear", "remove",
+};
+
+static const char *const stats_items[] = {
+    "dump", "histograms", "memory", "reset", "traffic",
+};
 
 /*
  * Initialise command autocompleter and history
@@ -1814,22 +2423,18 @@ cmd_init(void)
     commands_ac = autocomplete_new();
     aliases_ac = autocomplete_new();
 
-    help_ac = autocomplete_new();
-    autocomplete_add(help_ac, "commands");
-    autocomplete_add(help_ac, "navigation");
+    _cmd_index_build();
+    help_ac = autocomplete_new_static(help_items, ARRAY_SIZE(help_items));
 
-    // load command defs into hash table
-    commands = g_hash_table_new(g_str_hash, g_str_equal);
+    if (handlers) {
+        g_hash_table_destroy(handlers);
+    }
+    handlers = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_cmd_handler_free);
     unsigned int i;
     for (i = 0; i < ARRAY_SIZE(command_defs); i++) {
         Command *pcmd = command_defs+i;
-
-        // add to hash
-        g_hash_table_insert(commands, pcmd->cmd, pcmd);
-
-        // add to commands and help autocompleters
+        _cmd_handler_add(pcmd->cmd, pcmd, NULL);
         autocomplete_add(commands_ac, pcmd->cmd);
-        autocomplete_add(help_ac, pcmd->cmd+1);
     }
 
     // load aliases
@@ -1841,406 +2446,152 @@ cmd_init(void)
         g_string_append(ac_alias, alias->name);
         autocomplete_add(commands_ac, ac_alias->str);
         autocomplete_add(aliases_ac, alias->name);
+        if (!g_hash_table_lookup(handlers, ac_alias->str)) {
+            _cmd_handler_add(ac_alias->str, NULL, strdup(alias->value));
+        }
         g_string_free(ac_alias, TRUE);
         curr = g_list_next(curr);
     }
     prefs_free_aliases(aliases);
 
-    help_commands_ac = autocomplete_new();
-    autocomplete_add(help_commands_ac, "chat");
-    autocomplete_add(help_commands_ac, "groupchat");
-    autocomplete_add(help_commands_ac, "roster");
-    autocomplete_add(help_commands_ac, "presence");
-    autocomplete_add(help_commands_ac, "discovery");
-    autocomplete_add(help_commands_ac, "connection");
-    autocomplete_add(help_commands_ac, "ui");
-
-    prefs_ac = autocomplete_new();
-    autocomplete_add(prefs_ac, "ui");
-    autocomplete_add(prefs_ac, "desktop");
-    autocomplete_add(prefs_ac, "chat");
-    autocomplete_add(prefs_ac, "log");
-    autocomplete_add(prefs_ac, "conn");
-    autocomplete_add(prefs_ac, "presence");
-    autocomplete_add(prefs_ac, "otr");
-    autocomplete_add(prefs_ac, "pgp");
-
-    notify_ac = autocomplete_new();
-    autocomplete_add(notify_ac, "message");
-    autocomplete_add(notify_ac, "room");
-    autocomplete_add(notify_ac, "typing");
-    autocomplete_add(notify_ac, "remind");
-    autocomplete_add(notify_ac, "invite");
-    autocomplete_add(notify_ac, "sub");
-
-    notify_message_ac = autocomplete_new();
-    autocomplete_add(notify_message_ac, "on");
-    autocomplete_add(notify_message_ac, "off");
-    autocomplete_add(notify_message_ac, "current");
-    autocomplete_add(notify_message_ac, "text");
-
-    notify_room_ac = autocomplete_new();
-    autocomplete_add(notify_room_ac, "on");
-    autocomplete_add(notify_room_ac, "off");
-    autocomplete_add(notify_room_ac, "mention");
-    autocomplete_add(notify_room_ac, "current");
-    autocomplete_add(notify_room_ac, "text");
-
-    notify_typing_ac = autocomplete_new();
-    autocomplete_add(notify_typing_ac, "on");
-    autocomplete_add(notify_typing_ac, "off");
-    autocomplete_add(notify_typing_ac, "current");
-
-    sub_ac = autocomplete_new();
-    autocomplete_add(sub_ac, "request");
-    autocomplete_add(sub_ac, "allow");
-    autocomplete_add(sub_ac, "deny");
-    autocomplete_add(sub_ac, "show");
-    autocomplete_add(sub_ac, "sent");
-    autocomplete_add(sub_ac, "received");
-
-    titlebar_ac = autocomplete_new();
-    autocomplete_add(titlebar_ac, "show");
-    autocomplete_add(titlebar_ac, "goodbye");
-
-    log_ac = autocomplete_new();
-    autocomplete_add(log_ac, "maxsize");
-    autocomplete_add(log_ac, "rotate");
-    autocomplete_add(log_ac, "shared");
-    autocomplete_add(log_ac, "where");
-
-    autoaway_ac = autocomplete_new();
-    autocomplete_add(autoaway_ac, "mode");
-    autocomplete_add(autoaway_ac, "time");
-    autocomplete_add(autoaway_ac, "message");
-    autocomplete_add(autoaway_ac, "check");
-
-    autoaway_mode_ac = autocomplete_new();
-    autocomplete_add(autoaway_mode_ac, "away");
-    autocomplete_add(autoaway_mode_ac, "idle");
-    autocomplete_add(autoaway_mode_ac, "off");
-
-    autoaway_presence_ac = autocomplete_new();
-    autocomplete_add(autoaway_presence_ac, "away");
-    autocomplete_add(autoaway_presence_ac, "xa");
-
-    autoconnect_ac = autocomplete_new();
-    autocomplete_add(autoconnect_ac, "set");
-    autocomplete_add(autoconnect_ac, "off");
-
-    theme_ac = autocomplete_new();
-    autocomplete_add(theme_ac, "load");
-    autocomplete_add(theme_ac, "list");
-    autocomplete_add(theme_ac, "colours");
-
-    disco_ac = autocomplete_new();
-    autocomplete_add(disco_ac, "info");
-    autocomplete_add(disco_ac, "items");
-
-    account_ac = autocomplete_new();
-    autocomplete_add(account_ac, "list");
-    autocomplete_add(account_ac, "show");
-    autocomplete_add(account_ac, "add");
-    autocomplete_add(account_ac, "remove");
-    autocomplete_add(account_ac, "enable");
-    autocomplete_add(account_ac, "disable");
-    autocomplete_add(account_ac, "default");
-    autocomplete_add(account_ac, "rename");
-    autocomplete_add(account_ac, "set");
-    autocomplete_add(account_ac, "clear");
-
-    account_set_ac = autocomplete_new();
-    autocomplete_add(account_set_ac, "jid");
-    autocomplete_add(account_set_ac, "server");
-    autocomplete_add(account_set_ac, "port");
-    autocomplete_add(account_set_ac, "status");
-    autocomplete_add(account_set_ac, "online");
-    autocomplete_add(account_set_ac, "chat");
-    autocomplete_add(account_set_ac, "away");
-    autocomplete_add(account_set_ac, "xa");
-    autocomplete_add(account_set_ac, "dnd");
-    autocomplete_add(account_set_ac, "resource");
-    autocomplete_add(account_set_ac, "password");
-    autocomplete_add(account_set_ac, "eval_password");
-    autocomplete_add(account_set_ac, "muc");
-    autocomplete_add(account_set_ac, "nick");
-    autocomplete_add(account_set_ac, "otr");
-    autocomplete_add(account_set_ac, "pgpkeyid");
-    autocomplete_add(account_set_ac, "startscript");
-    autocomplete_add(account_set_ac, "tls");
-
-    account_clear_ac = autocomplete_new();
-    autocomplete_add(account_clear_ac, "password");
-    autocomplete_add(account_clear_ac, "eval_password");
-    autocomplete_add(account_clear_ac, "server");
-    autocomplete_add(account_clear_ac, "port");
-    autocomplete_add(account_clear_ac, "otr");
-    autocomplete_add(account_clear_ac, "pgpkeyid");
-    autocomplete_add(account_clear_ac, "startscript");
-
-    account_default_ac = autocomplete_new();
-    autocomplete_add(account_default_ac, "set");
-    autocomplete_add(account_default_ac, "off");
-
-    account_status_ac = autocomplete_new();
-    autocomplete_add(account_status_ac, "online");
-    autocomplete_add(account_status_ac, "chat");
-    autocomplete_add(account_status_ac, "away");
-    autocomplete_add(account_status_ac, "xa");
-    autocomplete_add(account_status_ac, "dnd");
-    autocomplete_add(account_status_ac, "last");
-
-    close_ac = autocomplete_new();
-    autocomplete_add(close_ac, "read");
-    autocomplete_add(close_ac, "all");
-
-    wins_ac = autocomplete_new();
-    autocomplete_add(wins_ac, "prune");
-    autocomplete_add(wins_ac, "tidy");
-    autocomplete_add(wins_ac, "autotidy");
-    autocomplete_add(wins_ac, "swap");
-
-    roster_ac = autocomplete_new();
-    autocomplete_add(roster_ac, "add");
-    autocomplete_add(roster_ac, "online");
-    autocomplete_add(roster_ac, "nick");
-    autocomplete_add(roster_ac, "clearnick");
-    autocomplete_add(roster_ac, "remove");
-    autocomplete_add(roster_ac, "remove_all");
-    autocomplete_add(roster_ac, "show");
-    autocomplete_add(roster_ac, "hide");
-    autocomplete_add(roster_ac, "by");
-    autocomplete_add(roster_ac, "size");
-
-    roster_option_ac = autocomplete_new();
-    autocomplete_add(roster_option_ac, "offline");
-    autocomplete_add(roster_option_ac, "resource");
-    autocomplete_add(roster_option_ac, "empty");
-
-    roster_by_ac = autocomplete_new();
-    autocomplete_add(roster_by_ac, "group");
-    autocomplete_add(roster_by_ac, "presence");
-    autocomplete_add(roster_by_ac, "none");
-
-    roster_remove_all_ac = autocomplete_new();
-    autocomplete_add(roster_remove_all_ac, "contacts");
-
-    group_ac = autocomplete_new();
-    autocomplete_add(group_ac, "show");
-    autocomplete_add(group_ac, "add");
-    autocomplete_add(group_ac, "remove");
+    help_commands_ac = autocomplete_new_static(help_commands_items, ARRAY_SIZE(help_commands_items));
+
+    prefs_ac = autocomplete_new_static(prefs_items, ARRAY_SIZE(prefs_items));
+
+    notify_ac = autocomplete_new_static(notify_items, ARRAY_SIZE(notify_items));
+
+    notify_message_ac = autocomplete_new_static(notify_message_items, ARRAY_SIZE(notify_message_items));
+
+    notify_room_ac = autocomplete_new_static(notify_room_items, ARRAY_SIZE(notify_room_items));
+
+    notify_mention_ac = autocomplete_new_static(notify_mention_items, ARRAY_SIZE(notify_mention_items));
+
+    notify_trigger_ac = autocomplete_new_static(notify_trigger_items, ARRAY_SIZE(notify_trigger_items));
+
+    notify_typing_ac = autocomplete_new_static(notify_typing_items, ARRAY_SIZE(notify_typing_items));
+
+    sub_ac = autocomplete_new_static(sub_items, ARRAY_SIZE(sub_items));
+
+    titlebar_ac = autocomplete_new_static(titlebar_items, ARRAY_SIZE(titlebar_items));
+
+    log_retention_ac = autocomplete_new_static(log_retention_items, ARRAY_SIZE(log_retention_items));
+
+    history_ac = autocomplete_new_static(history_items, ARRAY_SIZE(history_items));
+
+    log_ac = autocomplete_new_static(log_items, ARRAY_SIZE(log_items));
+
+    autoaway_ac = autocomplete_new_static(autoaway_items, ARRAY_SIZE(autoaway_items));
+
+    autoaway_mode_ac = autocomplete_new_static(autoaway_mode_items, ARRAY_SIZE(autoaway_mode_items));
+
+    autoaway_presence_ac = autocomplete_new_static(autoaway_presence_items, ARRAY_SIZE(autoaway_presence_items));
+
+    autoconnect_ac = autocomplete_new_static(autoconnect_items, ARRAY_SIZE(autoconnect_items));
+
+    theme_ac = autocomplete_new_static(theme_items, ARRAY_SIZE(theme_items));
+
+    disco_ac = autocomplete_new_static(disco_items, ARRAY_SIZE(disco_items));
+
+    account_ac = autocomplete_new_static(account_items, ARRAY_SIZE(account_items));
+
+    account_set_ac = autocomplete_new_static(account_set_items, ARRAY_SIZE(account_set_items));
+
+    account_clear_ac = autocomplete_new_static(account_clear_items, ARRAY_SIZE(account_clear_items));
+
+    account_default_ac = autocomplete_new_static(account_default_items, ARRAY_SIZE(account_default_items));
+
+    account_status_ac = autocomplete_new_static(account_status_items, ARRAY_SIZE(account_status_items));
+
+    close_ac = autocomplete_new_static(close_items, ARRAY_SIZE(close_items));
+
+    wins_ac = autocomplete_new_static(wins_items, ARRAY_SIZE(wins_items));
+
+    roster_ac = autocomplete_new_static(roster_items, ARRAY_SIZE(roster_items));
+
+    roster_option_ac = autocomplete_new_static(roster_option_items, ARRAY_SIZE(roster_option_items));
+
+    roster_by_ac = autocomplete_new_static(roster_by_items, ARRAY_SIZE(roster_by_items));
+
+    roster_remove_all_ac = autocomplete_new_static(roster_remove_all_items, ARRAY_SIZE(roster_remove_all_items));
+
+    group_ac = autocomplete_new_static(group_items, ARRAY_SIZE(group_items));
 
     theme_load_ac = NULL;
 
-    who_roster_ac = autocomplete_new();
-    autocomplete_add(who_roster_ac, "chat");
-    autocomplete_add(who_roster_ac, "online");
-    autocomplete_add(who_roster_ac, "away");
-    autocomplete_add(who_roster_ac, "xa");
-    autocomplete_add(who_roster_ac, "dnd");
-    autocomplete_add(who_roster_ac, "offline");
-    autocomplete_add(who_roster_ac, "available");
-    autocomplete_add(who_roster_ac, "unavailable");
-    autocomplete_add(who_roster_ac, "any");
-
-    who_room_ac = autocomplete_new();
-    autocomplete_add(who_room_ac, "chat");
-    autocomplete_add(who_room_ac, "online");
-    autocomplete_add(who_room_ac, "away");
-    autocomplete_add(who_room_ac, "xa");
-    autocomplete_add(who_room_ac, "dnd");
-    autocomplete_add(who_room_ac, "available");
-    autocomplete_add(who_room_ac, "unavailable");
-    autocomplete_add(who_room_ac, "moderator");
-    autocomplete_add(who_room_ac, "participant");
-    autocomplete_add(who_room_ac, "visitor");
-    autocomplete_add(who_room_ac, "owner");
-    autocomplete_add(who_room_ac, "admin");
-    autocomplete_add(who_room_ac, "member");
-
-    bookmark_ac = autocomplete_new();
-    autocomplete_add(bookmark_ac, "list");
-    autocomplete_add(bookmark_ac, "add");
-    autocomplete_add(bookmark_ac, "update");
-    autocomplete_add(bookmark_ac, "remove");
-    autocomplete_add(bookmark_ac, "join");
-
-    bookmark_property_ac = autocomplete_new();
-    autocomplete_add(bookmark_property_ac, "nick");
-    autocomplete_add(bookmark_property_ac, "password");
-    autocomplete_add(bookmark_property_ac, "autojoin");
-
-    otr_ac = autocomplete_new();
-    autocomplete_add(otr_ac, "gen");
-    autocomplete_add(otr_ac, "start");
-    autocomplete_add(otr_ac, "end");
-    autocomplete_add(otr_ac, "myfp");
-    autocomplete_add(otr_ac, "theirfp");
-    autocomplete_add(otr_ac, "trust");
-    autocomplete_add(otr_ac, "untrust");
-    autocomplete_add(otr_ac, "secret");
-    autocomplete_add(otr_ac, "log");
-    autocomplete_add(otr_ac, "libver");
-    autocomplete_add(otr_ac, "policy");
-    autocomplete_add(otr_ac, "question");
-    autocomplete_add(otr_ac, "answer");
-    autocomplete_add(otr_ac, "char");
-
-    otr_log_ac = autocomplete_new();
-    autocomplete_add(otr_log_ac, "on");
-    autocomplete_add(otr_log_ac, "off");
-    autocomplete_add(otr_log_ac, "redact");
-
-    otr_policy_ac = autocomplete_new();
-    autocomplete_add(otr_policy_ac, "manual");
-    autocomplete_add(otr_policy_ac, "opportunistic");
-    autocomplete_add(otr_policy_ac, "always");
-
-    connect_property_ac = autocomplete_new();
-    autocomplete_add(connect_property_ac, "server");
-    autocomplete_add(connect_property_ac, "port");
-    autocomplete_add(connect_property_ac, "tls");
-
-    tls_property_ac = autocomplete_new();
-    autocomplete_add(tls_property_ac, "force");
-    autocomplete_add(tls_property_ac, "allow");
-    autocomplete_add(tls_property_ac, "disable");
-
-    join_property_ac = autocomplete_new();
-    autocomplete_add(join_property_ac, "nick");
-    autocomplete_add(join_property_ac, "password");
-
-    statuses_ac = autocomplete_new();
-    autocomplete_add(statuses_ac, "console");
-    autocomplete_add(statuses_ac, "chat");
-    autocomplete_add(statuses_ac, "muc");
-
-    statuses_setting_ac = autocomplete_new();
-    autocomplete_add(statuses_setting_ac, "all");
-    autocomplete_add(statuses_setting_ac, "online");
-    autocomplete_add(statuses_setting_ac, "none");
-
-    alias_ac = autocomplete_new();
-    autocomplete_add(alias_ac, "add");
-    autocomplete_add(alias_ac, "remove");
-    autocomplete_add(alias_ac, "list");
-
-    room_ac = autocomplete_new();
-    autocomplete_add(room_ac, "accept");
-    autocomplete_add(room_ac, "destroy");
-    autocomplete_add(room_ac, "config");
-
-    affiliation_ac = autocomplete_new();
-    autocomplete_add(affiliation_ac, "owner");
-    autocomplete_add(affiliation_ac, "admin");
-    autocomplete_add(affiliation_ac, "member");
-    autocomplete_add(affiliation_ac, "none");
-    autocomplete_add(affiliation_ac, "outcast");
-
-    role_ac = autocomplete_new();
-    autocomplete_add(role_ac, "moderator");
-    autocomplete_add(role_ac, "participant");
-    autocomplete_add(role_ac, "visitor");
-    autocomplete_add(role_ac, "none");
-
-    privilege_cmd_ac = autocomplete_new();
-    autocomplete_add(privilege_cmd_ac, "list");
-    autocomplete_add(privilege_cmd_ac, "set");
-
-    subject_ac = autocomplete_new();
-    autocomplete_add(subject_ac, "set");
-    autocomplete_add(subject_ac, "edit");
-    autocomplete_add(subject_ac, "prepend");
-    autocomplete_add(subject_ac, "append");
-    autocomplete_add(subject_ac, "clear");
-
-    form_ac = autocomplete_new();
-    autocomplete_add(form_ac, "submit");
-    autocomplete_add(form_ac, "cancel");
-    autocomplete_add(form_ac, "show");
-    autocomplete_add(form_ac, "help");
-
-    form_field_multi_ac = autocomplete_new();
-    autocomplete_add(form_field_multi_ac, "add");
-    autocomplete_add(form_field_multi_ac, "remove");
-
-    occupants_ac = autocomplete_new();
-    autocomplete_add(occupants_ac, "show");
-    autocomplete_add(occupants_ac, "hide");
-    autocomplete_add(occupants_ac, "default");
-    autocomplete_add(occupants_ac, "size");
-
-    occupants_default_ac = autocomplete_new();
-    autocomplete_add(occupants_default_ac, "show");
-    autocomplete_add(occupants_default_ac, "hide");
-
-    occupants_show_ac = autocomplete_new();
-    autocomplete_add(occupants_show_ac, "jid");
-
-    time_ac = autocomplete_new();
-    autocomplete_add(time_ac, "console");
-    autocomplete_add(time_ac, "chat");
-    autocomplete_add(time_ac, "muc");
-    autocomplete_add(time_ac, "mucconfig");
-    autocomplete_add(time_ac, "private");
-    autocomplete_add(time_ac, "xml");
-    autocomplete_add(time_ac, "statusbar");
-    autocomplete_add(time_ac, "lastactivity");
-
-    time_format_ac = autocomplete_new();
-    autocomplete_add(time_format_ac, "set");
-    autocomplete_add(time_format_ac, "off");
-
-    resource_ac = autocomplete_new();
-    autocomplete_add(resource_ac, "set");
-    autocomplete_add(resource_ac, "off");
-    autocomplete_add(resource_ac, "title");
-    autocomplete_add(resource_ac, "message");
-
-    inpblock_ac = autocomplete_new();
-    autocomplete_add(inpblock_ac, "timeout");
-    autocomplete_add(inpblock_ac, "dynamic");
-
-    receipts_ac = autocomplete_new();
-    autocomplete_add(receipts_ac, "send");
-    autocomplete_add(receipts_ac, "request");
-
-    pgp_ac = autocomplete_new();
-    autocomplete_add(pgp_ac, "keys");
-    autocomplete_add(pgp_ac, "contacts");
-    autocomplete_add(pgp_ac, "setkey");
-    autocomplete_add(pgp_ac, "libver");
-    autocomplete_add(pgp_ac, "start");
-    autocomplete_add(pgp_ac, "end");
-    autocomplete_add(pgp_ac, "log");
-    autocomplete_add(pgp_ac, "char");
-
-    pgp_log_ac = autocomplete_new();
-    autocomplete_add(pgp_log_ac, "on");
-    autocomplete_add(pgp_log_ac, "off");
-    autocomplete_add(pgp_log_ac, "redact");
-
-    tls_ac = autocomplete_new();
-    autocomplete_add(tls_ac, "allow");
-    autocomplete_add(tls_ac, "always");
-    autocomplete_add(tls_ac, "deny");
-    autocomplete_add(tls_ac, "cert");
-    autocomplete_add(tls_ac, "trust");
-    autocomplete_add(tls_ac, "trusted");
-    autocomplete_add(tls_ac, "revoke");
-    autocomplete_add(tls_ac, "certpath");
-    autocomplete_add(tls_ac, "show");
-
-    tls_certpath_ac = autocomplete_new();
-    autocomplete_add(tls_certpath_ac, "set");
-    autocomplete_add(tls_certpath_ac, "clear");
-
-    script_ac = autocomplete_new();
-    autocomplete_add(script_ac, "run");
-    autocomplete_add(script_ac, "list");
-    autocomplete_add(script_ac, "show");
+    who_roster_ac = autocomplete_new_static(who_roster_items, ARRAY_SIZE(who_roster_items));
+
+    who_room_ac = autocomplete_new_static(who_room_items, ARRAY_SIZE(who_room_items));
+
+    bookmark_ac = autocomplete_new_static(bookmark_items, ARRAY_SIZE(bookmark_items));
+
+    bookmark_property_ac = autocomplete_new_static(bookmark_property_items, ARRAY_SIZE(bookmark_property_items));
+
+    otr_ac = autocomplete_new_static(otr_items, ARRAY_SIZE(otr_items));
+
+    otr_log_ac = autocomplete_new_static(otr_log_items, ARRAY_SIZE(otr_log_items));
+
+    otr_policy_ac = autocomplete_new_static(otr_policy_items, ARRAY_SIZE(otr_policy_items));
+
+    connect_property_ac = autocomplete_new_static(connect_property_items, ARRAY_SIZE(connect_property_items));
+
+    tls_property_ac = autocomplete_new_static(tls_property_items, ARRAY_SIZE(tls_property_items));
+
+    join_property_ac = autocomplete_new_static(join_property_items, ARRAY_SIZE(join_property_items));
+
+    statuses_ac = autocomplete_new_static(statuses_items, ARRAY_SIZE(statuses_items));
+
+    statuses_setting_ac = autocomplete_new_static(statuses_setting_items, ARRAY_SIZE(statuses_setting_items));
+
+    alias_ac = autocomplete_new_static(alias_items, ARRAY_SIZE(alias_items));
+
+    room_ac = autocomplete_new_static(room_items, ARRAY_SIZE(room_items));
+    room_policy_ac = autocomplete_new_static(room_policy_items, ARRAY_SIZE(room_policy_items));
+
+    affiliation_ac = autocomplete_new_static(affiliation_items, ARRAY_SIZE(affiliation_items));
+
+    role_ac = autocomplete_new_static(role_items, ARRAY_SIZE(role_items));
+
+    privilege_cmd_ac = autocomplete_new_static(privilege_cmd_items, ARRAY_SIZE(privilege_cmd_items));
+
+    subject_ac = autocomplete_new_static(subject_items, ARRAY_SIZE(subject_items));
+
+    form_ac = autocomplete_new_static(form_items, ARRAY_SIZE(form_items));
+
+    form_field_multi_ac = autocomplete_new_static(form_field_multi_items, ARRAY_SIZE(form_field_multi_items));
+
+    occupants_ac = autocomplete_new_static(occupants_items, ARRAY_SIZE(occupants_items));
+
+    occupants_default_ac = autocomplete_new_static(occupants_default_items, ARRAY_SIZE(occupants_default_items));
+
+    occupants_show_ac = autocomplete_new_static(occupants_show_items, ARRAY_SIZE(occupants_show_items));
+
+    time_ac = autocomplete_new_static(time_items, ARRAY_SIZE(time_items));
+
+    time_format_ac = autocomplete_new_static(time_format_items, ARRAY_SIZE(time_format_items));
+
+    resource_ac = autocomplete_new_static(resource_items, ARRAY_SIZE(resource_items));
+
+    inpblock_ac = autocomplete_new_static(inpblock_items, ARRAY_SIZE(inpblock_items));
+
+    receipts_ac = autocomplete_new_static(receipts_items, ARRAY_SIZE(receipts_items));
+
+    pgp_ac = autocomplete_new_static(pgp_items, ARRAY_SIZE(pgp_items));
+
+    pgp_log_ac = autocomplete_new_static(pgp_log_items, ARRAY_SIZE(pgp_log_items));
+
+    tls_ac = autocomplete_new_static(tls_items, ARRAY_SIZE(tls_items));
+
+    tls_certpath_ac = autocomplete_new_static(tls_certpath_items, ARRAY_SIZE(tls_certpath_items));
+
+    script_ac = autocomplete_new_static(script_items, ARRAY_SIZE(script_items));
 
     script_show_ac = NULL;
+
+    xmlconsole_ac = autocomplete_new_static(xmlconsole_items, ARRAY_SIZE(xmlconsole_items));
+
+    xmlconsole_filter_ac = autocomplete_new_static(xmlconsole_filter_items, ARRAY_SIZE(xmlconsole_filter_items));
+
+    stats_ac = autocomplete_new_static(stats_items, ARRAY_SIZE(stats_items));
 }
 
 void
@@ -2254,10 +2605,14 @@ cmd_uninit(void)
     autocomplete_free(notify_ac);
     autocomplete_free(notify_message_ac);
     autocomplete_free(notify_room_ac);
+    autocomplete_free(notify_mention_ac);
+    autocomplete_free(notify_trigger_ac);
     autocomplete_free(notify_typing_ac);
     autocomplete_free(sub_ac);
     autocomplete_free(titlebar_ac);
     autocomplete_free(log_ac);
+    autocomplete_free(log_retention_ac);
+    autocomplete_free(history_ac);
     autocomplete_free(prefs_ac);
     autocomplete_free(autoaway_ac);
     autocomplete_free(autoaway_mode_ac);
@@ -2289,8 +2644,13 @@ cmd_uninit(void)
     autocomplete_free(statuses_setting_ac);
     autocomplete_free(alias_ac);
     autocomplete_free(aliases_ac);
+    if (handlers) {
+        g_hash_table_destroy(handlers);
+        handlers = NULL;
+    }
     autocomplete_free(join_property_ac);
     autocomplete_free(room_ac);
+    autocomplete_free(room_policy_ac);
     autocomplete_free(affiliation_ac);
     autocomplete_free(role_ac);
     autocomplete_free(privilege_cmd_ac);
@@ -2311,6 +2671,9 @@ cmd_uninit(void)
     autocomplete_free(tls_certpath_ac);
     autocomplete_free(script_ac);
     autocomplete_free(script_show_ac);
+    autocomplete_free(xmlconsole_ac);
+    autocomplete_free(xmlconsole_filter_ac);
+    autocomplete_free(stats_ac);
 }
 
 gboolean
@@ -2383,6 +2746,16 @@ cmd_alias_add(char *value)
     if (aliases_ac) {
         autocomplete_add(aliases_ac, value);
     }
+
+    if (handlers) {
+        GString *name = g_string_new("/");
+        g_string_append(name, value);
+        char *alias = prefs_get_alias(value);
+        if (alias) {
+            _cmd_handler_add(name->str, NULL, alias);
+        }
+        g_string_free(name, TRUE);
+    }
 }
 
 void
@@ -2391,6 +2764,16 @@ cmd_alias_remove(char *value)
     if (aliases_ac) {
         autocomplete_remove(aliases_ac, value);
     }
+
+    if (handlers) {
+        GString *name = g_string_new("/");
+        g_string_append(name, value);
+        CmdHandler *handler = g_hash_table_lookup(handlers, name->str);
+        if (handler && handler->alias) {
+            g_hash_table_remove(handlers, name->str);
+        }
+        g_string_free(name, TRUE);
+    }
 }
 
 // Command autocompletion functions
@@ -2434,6 +2817,8 @@ cmd_reset_autocomplete(ProfWin *window)
     autocomplete_reset(notify_ac);
     autocomplete_reset(notify_message_ac);
     autocomplete_reset(notify_room_ac);
+    autocomplete_reset(notify_mention_ac);
+    autocomplete_reset(notify_trigger_ac);
     autocomplete_reset(notify_typing_ac);
     autocomplete_reset(sub_ac);
 
@@ -2441,6 +2826,8 @@ cmd_reset_autocomplete(ProfWin *window)
     autocomplete_reset(who_roster_ac);
     autocomplete_reset(prefs_ac);
     autocomplete_reset(log_ac);
+    autocomplete_reset(log_retention_ac);
+    autocomplete_reset(history_ac);
     autocomplete_reset(commands_ac);
     autocomplete_reset(autoaway_ac);
     autocomplete_reset(autoaway_mode_ac);
@@ -2478,6 +2865,7 @@ cmd_reset_autocomplete(ProfWin *window)
     autocomplete_reset(aliases_ac);
     autocomplete_reset(join_property_ac);
     autocomplete_reset(room_ac);
+    autocomplete_reset(room_policy_ac);
     autocomplete_reset(affiliation_ac);
     autocomplete_reset(role_ac);
     autocomplete_reset(privilege_cmd_ac);
@@ -2497,6 +2885,9 @@ cmd_reset_autocomplete(ProfWin *window)
     autocomplete_reset(tls_ac);
     autocomplete_reset(tls_certpath_ac);
     autocomplete_reset(script_ac);
+    autocomplete_reset(xmlconsole_ac);
+    autocomplete_reset(xmlconsole_filter_ac);
+    autocomplete_reset(stats_ac);
     if (script_show_ac) {
         autocomplete_free(script_show_ac);
         script_show_ac = NULL;
@@ -2529,6 +2920,29 @@ cmd_reset_autocomplete(ProfWin *window)
     bookmark_autocomplete_reset();
 }
 
+Command*
+cmd_get(const char *const name)
+{
+    if (name == NULL) {
+        return NULL;
+    }
+
+    _cmd_index_build();
+    Command **found = bsearch(name, cmd_index, ARRAY_SIZE(cmd_index), sizeof(Command*), _cmd_index_find);
+
+    return found ? *found : NULL;
+}
+
+// every command in name order
+Command**
+cmd_get_ordered(guint *count)
+{
+    _cmd_index_build();
+    *count = ARRAY_SIZE(cmd_index);
+
+    return cmd_index;
+}
+
 gboolean
 cmd_valid_tag(const char *const str)
 {
@@ -2571,14 +2985,19 @@ cmd_process_input(ProfWin *window, char *inp)
 
     // handle command if input starts with a '/'
     } else if (inp[0] == '/') {
-        char *inp_cpy = strdup(inp);
-        char *command = strtok(inp_cpy, " ");
+        char *command = g_strndup(inp, strcspn(inp, " "));
+        gint64 watch = watchdog_start();
         result = _cmd_execute(window, command, inp);
-        free(inp_cpy);
+        watchdog_check("command", command, watch);
+        g_free(command);
 
     // call a default handler if input didn't start with '/'
     } else {
+        gint64 watch = watchdog_start();
+        gint64 start = perf_start();
         result = cmd_execute_default(window, inp);
+        perf_record(PERF_HANDLER, start);
+        watchdog_check("message input", NULL, watch);
     }
 
     return result;
@@ -2605,190 +3024,214 @@ _cmd_execute(ProfWin *window, const char *const command, const char *const inp)
             ui_current_print_formatted_line('!', 0, "Invalid command, see /form help");
             result = TRUE;
         } else {
-            gchar **tokens = g_strsplit(inp, " ", 2);
-            char *field = tokens[0] + 1;
-            result = cmd_form_field(window, field, args);
-            g_strfreev(tokens);
+            // the command is the first token, without the slash it names the field
+            result = cmd_form_field(window, (char*)command + 1, args);
         }
 
-        g_strfreev(args);
+        parse_args_free(args);
         return result;
     }
 
-    Command *cmd = g_hash_table_lookup(commands, command);
+    CmdHandler *handler = g_hash_table_lookup(handlers, command);
+    Command *cmd = handler ? handler->cmd : NULL;
     gboolean result = FALSE;
 
     if (cmd) {
+        gint64 start = perf_start();
         gchar **args = cmd->parser(inp, cmd->min_args, cmd->max_args, &result);
+        perf_record(PERF_PARSE, start);
         if (result == FALSE) {
             ui_invalid_command_usage(cmd->cmd, cmd->setting_func);
             return TRUE;
         } else {
+            start = perf_start();
             gboolean result = cmd->func(window, command, args);
-            g_strfreev(args);
+            perf_record(PERF_HANDLER, start);
+            parse_args_free(args);
             return result;
         }
+    } else if (handler && handler->alias && strcmp(command, inp) == 0) {
+        // aliases only run when given on their own, as the expansion is run
+        // as input it may remove the alias while running
+        char *alias = strdup(handler->alias);
+        result = cmd_process_input(window, alias);
+        free(alias);
+        return result;
     } else {
-        gboolean ran_alias = FALSE;
-        gboolean alias_result = cmd_execute_alias(window, inp, &ran_alias);
-        if (!ran_alias) {
-            return cmd_execute_default(window, inp);
-        } else {
-            return alias_result;
-        }
+        return cmd_execute_default(window, inp);
     }
 }
 
+static void
+_cmd_handler_free(CmdHandler *handler)
+{
+    free(handler->alias);
+    free(handler);
+}
+
+// takes the alias value
+static void
+_cmd_handler_add(const char *const name, Command *cmd, char *alias)
+{
+    CmdHandler *handler = malloc(sizeof(CmdHandler));
+    handler->cmd = cmd;
+    handler->alias = alias;
+    g_hash_table_replace(handlers, strdup(name), handler);
+}
+
 static char*
 _cmd_complete_parameters(ProfWin *window, const char *const input)
 {
-    int i;
     char *result = NULL;
 
-    // autocomplete boolean settings
-    gchar *boolean_choices[] = { "/beep", "/intype", "/states", "/outtype",
-        "/flash", "/splash", "/chlog", "/grlog", "/history", "/vercheck",
-        "/privileges", "/presence", "/wrap", "/winstidy", "/carbons", "/encwarn", "/lastactivity" };
+    int len = strlen(input);
+    char parsed[len+1];
+    int i = 0;
+    while (i < len) {
+        if (input[i] == ' ') {
+            break;
+        } else {
+            parsed[i] = input[i];
+        }
+        i++;
+    }
+    parsed[i] = '\0';
+
+    // completers are kept with the command definitions
+    Command *cmd = cmd_get(parsed);
+    if (cmd && cmd->complete_func) {
+        result = cmd->complete_func(window, input);
+        if (result) {
+            return result;
+        }
+    }
 
-    for (i = 0; i < ARRAY_SIZE(boolean_choices); i++) {
-        result = autocomplete_param_with_func(input, boolean_choices[i], prefs_autocomplete_boolean_choice);
+    if (g_str_has_prefix(input, "/field")) {
+        result = _form_field_autocomplete(window, input);
         if (result) {
             return result;
         }
     }
 
-    // autocomplete nickname in chat rooms
+    return NULL;
+}
+
+// on|off settings, the command is taken from the input
+static char*
+_boolean_autocomplete(ProfWin *window, const char *const input)
+{
+    char *command = g_strndup(input, strcspn(input, " "));
+    char *result = autocomplete_param_with_func(input, command, prefs_autocomplete_boolean_choice);
+    g_free(command);
+
+    return result;
+}
+
+// nicknames in chat rooms, otherwise contacts from the roster
+static char*
+_contact_autocomplete(ProfWin *window, const char *const input)
+{
+    char *command = g_strndup(input, strcspn(input, " "));
+    char *result = NULL;
+
+    // Remove quote character before and after names when doing autocomplete
+    char *unquoted = strip_arg_quotes(input);
     if (window->type == WIN_MUC) {
         ProfMucWin *mucwin = (ProfMucWin*)window;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
         Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
         if (nick_ac) {
-            gchar *nick_choices[] = { "/msg", "/info", "/caps", "/status", "/software" } ;
+            result = autocomplete_param_with_ac(unquoted, command, nick_ac, TRUE);
+        }
+    } else {
+        result = autocomplete_param_with_func(unquoted, command, roster_contact_autocomplete);
+    }
+    free(unquoted);
+    g_free(command);
+
+    return result;
+}
 
+// nicknames in chat rooms, otherwise full jids from the roster
+static char*
+_fulljid_autocomplete(ProfWin *window, const char *const input)
+{
+    char *command = g_strndup(input, strcspn(input, " "));
+    char *result = NULL;
+
+    if (window->type == WIN_MUC) {
+        ProfMucWin *mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
+        if (nick_ac) {
             // Remove quote character before and after names when doing autocomplete
             char *unquoted = strip_arg_quotes(input);
-            for (i = 0; i < ARRAY_SIZE(nick_choices); i++) {
-                result = autocomplete_param_with_ac(unquoted, nick_choices[i], nick_ac, TRUE);
-                if (result) {
-                    free(unquoted);
-                    return result;
-                }
-            }
+            result = autocomplete_param_with_ac(unquoted, command, nick_ac, TRUE);
             free(unquoted);
         }
-
-    // otherwise autocomplete using roster
     } else {
-        gchar *contact_choices[] = { "/msg", "/info", "/status" };
-        // Remove quote character before and after names when doing autocomplete
-        char *unquoted = strip_arg_quotes(input);
-        for (i = 0; i < ARRAY_SIZE(contact_choices); i++) {
-            result = autocomplete_param_with_func(unquoted, contact_choices[i], roster_contact_autocomplete);
-            if (result) {
-                free(unquoted);
-                return result;
-            }
-        }
-        free(unquoted);
-
-        gchar *resource_choices[] = { "/caps", "/software", "/ping" };
-        for (i = 0; i < ARRAY_SIZE(resource_choices); i++) {
-            result = autocomplete_param_with_func(input, resource_choices[i], roster_fulljid_autocomplete);
-            if (result) {
-                return result;
-            }
-        }
+        result = autocomplete_param_with_func(input, command, roster_fulljid_autocomplete);
     }
+    g_free(command);
 
-    result = autocomplete_param_with_func(input, "/invite", roster_contact_autocomplete);
-    if (result) {
-        return result;
-    }
+    return result;
+}
 
-    gchar *invite_choices[] = { "/decline", "/join" };
-    for (i = 0; i < ARRAY_SIZE(invite_choices); i++) {
-        result = autocomplete_param_with_func(input, invite_choices[i], muc_invites_find);
-        if (result) {
-            return result;
-        }
+static char*
+_ping_autocomplete(ProfWin *window, const char *const input)
+{
+    if (window->type == WIN_MUC) {
+        return NULL;
     }
 
-    gchar *cmds[] = { "/prefs", "/disco", "/close", "/room" };
-    Autocomplete completers[] = { prefs_ac, disco_ac, close_ac, room_ac };
+    return autocomplete_param_with_func(input, "/ping", roster_fulljid_autocomplete);
+}
 
-    for (i = 0; i < ARRAY_SIZE(cmds); i++) {
-        result = autocomplete_param_with_ac(input, cmds[i], completers[i], TRUE);
-        if (result) {
-            return result;
-        }
-    }
+static char*
+_invite_autocomplete(ProfWin *window, const char *const input)
+{
+    return autocomplete_param_with_func(input, "/invite", roster_contact_autocomplete);
+}
 
-    GHashTable *ac_funcs = g_hash_table_new(g_str_hash, g_str_equal);
-    g_hash_table_insert(ac_funcs, "/help",          _help_autocomplete);
-    g_hash_table_insert(ac_funcs, "/who",           _who_autocomplete);
-    g_hash_table_insert(ac_funcs, "/sub",           _sub_autocomplete);
-    g_hash_table_insert(ac_funcs, "/notify",        _notify_autocomplete);
-    g_hash_table_insert(ac_funcs, "/autoaway",      _autoaway_autocomplete);
-    g_hash_table_insert(ac_funcs, "/theme",         _theme_autocomplete);
-    g_hash_table_insert(ac_funcs, "/log",           _log_autocomplete);
-    g_hash_table_insert(ac_funcs, "/account",       _account_autocomplete);
-    g_hash_table_insert(ac_funcs, "/roster",        _roster_autocomplete);
-    g_hash_table_insert(ac_funcs, "/group",         _group_autocomplete);
-    g_hash_table_insert(ac_funcs, "/bookmark",      _bookmark_autocomplete);
-    g_hash_table_insert(ac_funcs, "/autoconnect",   _autoconnect_autocomplete);
-    g_hash_table_insert(ac_funcs, "/otr",           _otr_autocomplete);
-    g_hash_table_insert(ac_funcs, "/pgp",           _pgp_autocomplete);
-    g_hash_table_insert(ac_funcs, "/connect",       _connect_autocomplete);
-    g_hash_table_insert(ac_funcs, "/statuses",      _statuses_autocomplete);
-    g_hash_table_insert(ac_funcs, "/alias",         _alias_autocomplete);
-    g_hash_table_insert(ac_funcs, "/join",          _join_autocomplete);
-    g_hash_table_insert(ac_funcs, "/form",          _form_autocomplete);
-    g_hash_table_insert(ac_funcs, "/occupants",     _occupants_autocomplete);
-    g_hash_table_insert(ac_funcs, "/kick",          _kick_autocomplete);
-    g_hash_table_insert(ac_funcs, "/ban",           _ban_autocomplete);
-    g_hash_table_insert(ac_funcs, "/affiliation",   _affiliation_autocomplete);
-    g_hash_table_insert(ac_funcs, "/role",          _role_autocomplete);
-    g_hash_table_insert(ac_funcs, "/resource",      _resource_autocomplete);
-    g_hash_table_insert(ac_funcs, "/titlebar",      _titlebar_autocomplete);
-    g_hash_table_insert(ac_funcs, "/inpblock",      _inpblock_autocomplete);
-    g_hash_table_insert(ac_funcs, "/time",          _time_autocomplete);
-    g_hash_table_insert(ac_funcs, "/receipts",      _receipts_autocomplete);
-    g_hash_table_insert(ac_funcs, "/wins",          _wins_autocomplete);
-    g_hash_table_insert(ac_funcs, "/tls",           _tls_autocomplete);
-    g_hash_table_insert(ac_funcs, "/script",        _script_autocomplete);
-    g_hash_table_insert(ac_funcs, "/subject",        _subject_autocomplete);
+static char*
+_decline_autocomplete(ProfWin *window, const char *const input)
+{
+    return autocomplete_param_with_func(input, "/decline", muc_invites_find);
+}
 
-    int len = strlen(input);
-    char parsed[len+1];
-    i = 0;
-    while (i < len) {
-        if (input[i] == ' ') {
-            break;
-        } else {
-            parsed[i] = input[i];
-        }
-        i++;
-    }
-    parsed[i] = '\0';
+static char*
+_prefs_autocomplete(ProfWin *window, const char *const input)
+{
+    return autocomplete_param_with_ac(input, "/prefs", prefs_ac, TRUE);
+}
 
-    char * (*ac_func)(ProfWin*, const char * const) = g_hash_table_lookup(ac_funcs, parsed);
-    if (ac_func) {
-        result = ac_func(window, input);
-        if (result) {
-            g_hash_table_destroy(ac_funcs);
-            return result;
-        }
-    }
-    g_hash_table_destroy(ac_funcs);
+static char*
+_disco_autocomplete(ProfWin *window, const char *const input)
+{
+    return autocomplete_param_with_ac(input, "/disco", disco_ac, TRUE);
+}
 
-    if (g_str_has_prefix(input, "/field")) {
-        result = _form_field_autocomplete(window, input);
-        if (result) {
-            return result;
-        }
+static char*
+_close_autocomplete(ProfWin *window, const char *const input)
+{
+    return autocomplete_param_with_ac(input, "/close", close_ac, TRUE);
+}
+
+static char*
+_room_autocomplete(ProfWin *window, const char *const input)
+{
+    char *result = autocomplete_param_with_ac(input, "/room policy", room_policy_ac, TRUE);
+    if (result) {
+        return result;
     }
 
-    return NULL;
+    return autocomplete_param_with_ac(input, "/room", room_ac, TRUE);
+}
+
+static char*
+_history_autocomplete(ProfWin *window, const char *const input)
+{
+    return autocomplete_param_with_ac(input, "/history", history_ac, TRUE);
 }
 
 static char*
@@ -2971,12 +3414,12 @@ _bookmark_autocomplete(ProfWin *window, const char *const input)
         }
         g_string_free(beginning, TRUE);
         if (found) {
-            g_strfreev(args);
+            parse_args_free(args);
             return found;
         }
     }
 
-    g_strfreev(args);
+    parse_args_free(args);
 
     found = autocomplete_param_with_func(input, "/bookmark remove", bookmark_find);
     if (found) {
@@ -3026,6 +3469,16 @@ _notify_autocomplete(ProfWin *window, const char *const input)
         return result;
     }
 
+    result = autocomplete_param_with_ac(input, "/notify room mention", notify_mention_ac, TRUE);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/notify room trigger", notify_trigger_ac, TRUE);
+    if (result) {
+        return result;
+    }
+
     result = autocomplete_param_with_ac(input, "/notify room", notify_room_ac, TRUE);
     if (result) {
         return result;
@@ -3105,6 +3558,30 @@ _log_autocomplete(ProfWin *window, const char *const input)
     if (result) {
         return result;
     }
+    result = autocomplete_param_with_func(input, "/log flush",
+        prefs_autocomplete_boolean_choice);
+    if (result) {
+        return result;
+    }
+    result = autocomplete_param_with_func(input, "/log async",
+        prefs_autocomplete_boolean_choice);
+    if (result) {
+        return result;
+    }
+    result = autocomplete_param_with_func(input, "/log binary",
+        prefs_autocomplete_boolean_choice);
+    if (result) {
+        return result;
+    }
+    result = autocomplete_param_with_func(input, "/log compress",
+        prefs_autocomplete_boolean_choice);
+    if (result) {
+        return result;
+    }
+    result = autocomplete_param_with_ac(input, "/log retention", log_retention_ac, TRUE);
+    if (result) {
+        return result;
+    }
     result = autocomplete_param_with_ac(input, "/log", log_ac, TRUE);
     if (result) {
         return result;
@@ -3158,12 +3635,12 @@ _otr_autocomplete(ProfWin *window, const char *const input)
         found = autocomplete_param_with_func(input, beginning->str, roster_contact_autocomplete);
         g_string_free(beginning, TRUE);
         if (found) {
-            g_strfreev(args);
+            parse_args_free(args);
             return found;
         }
     }
 
-    g_strfreev(args);
+    parse_args_free(args);
 
     found = autocomplete_param_with_ac(input, "/otr policy", otr_policy_ac, TRUE);
     if (found) {
@@ -3206,11 +3683,11 @@ _pgp_autocomplete(ProfWin *window, const char *const input)
         found = autocomplete_param_with_func(input, beginning->str, p_gpg_autocomplete_key);
         g_string_free(beginning, TRUE);
         if (found) {
-            g_strfreev(args);
+            parse_args_free(args);
             return found;
         }
     }
-    g_strfreev(args);
+    parse_args_free(args);
 #endif
 
     found = autocomplete_param_with_func(input, "/pgp setkey", roster_barejid_autocomplete);
@@ -3299,6 +3776,37 @@ _script_autocomplete(ProfWin *window, const char *const input)
     return NULL;
 }
 
+static char*
+_xmlconsole_autocomplete(ProfWin *window, const char *const input)
+{
+    char *result = NULL;
+
+    result = autocomplete_param_with_ac(input, "/xmlconsole filter", xmlconsole_filter_ac, TRUE);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/xmlconsole", xmlconsole_ac, TRUE);
+    if (result) {
+        return result;
+    }
+
+    return NULL;
+}
+
+static char*
+_stats_autocomplete(ProfWin *window, const char *const input)
+{
+    char *result = NULL;
+
+    result = autocomplete_param_with_ac(input, "/stats", stats_ac, TRUE);
+    if (result) {
+        return result;
+    }
+
+    return NULL;
+}
+
 static char*
 _resource_autocomplete(ProfWin *window, const char *const input)
 {
@@ -3627,12 +4135,12 @@ _affiliation_autocomplete(ProfWin *window, const char *const input)
             result = autocomplete_param_with_ac(input, beginning->str, jid_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (result) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return result;
             }
         }
 
-        g_strfreev(args);
+        parse_args_free(args);
     }
 
     result = autocomplete_param_with_ac(input, "/affiliation set", affiliation_ac, TRUE);
@@ -3675,12 +4183,12 @@ _role_autocomplete(ProfWin *window, const char *const input)
             result = autocomplete_param_with_ac(input, beginning->str, nick_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (result) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return result;
             }
         }
 
-        g_strfreev(args);
+        parse_args_free(args);
     }
 
     result = autocomplete_param_with_ac(input, "/role set", role_ac, TRUE);
@@ -3739,6 +4247,11 @@ _wins_autocomplete(ProfWin *window, const char *const input)
         return result;
     }
 
+    result = autocomplete_param_with_func(input, "/wins restore", prefs_autocomplete_boolean_choice);
+    if (result) {
+        return result;
+    }
+
     result = autocomplete_param_with_ac(input, "/wins", wins_ac, TRUE);
     if (result) {
         return result;
@@ -3790,6 +4303,11 @@ _receipts_autocomplete(ProfWin *window, const char *const input)
         return result;
     }
 
+    result = autocomplete_param_with_func(input, "/receipts markers", prefs_autocomplete_boolean_choice);
+    if (result) {
+        return result;
+    }
+
     result = autocomplete_param_with_ac(input, "/receipts", receipts_ac, TRUE);
     if (result) {
         return result;
@@ -3842,12 +4360,12 @@ _connect_autocomplete(ProfWin *window, const char *const input)
         found = autocomplete_param_with_ac(input, beginning->str, connect_property_ac, TRUE);
         g_string_free(beginning, TRUE);
         if (found) {
-            g_strfreev(args);
+            parse_args_free(args);
             return found;
         }
     }
 
-    g_strfreev(args);
+    parse_args_free(args);
 
     result = FALSE;
     args = parse_args(input, 2, 7, &result);
@@ -3879,7 +4397,7 @@ _connect_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_ac(input, beginning->str, tls_property_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
         } else {
@@ -3887,7 +4405,7 @@ _connect_autocomplete(ProfWin *window, const char *const input)
         }
     }
 
-    g_strfreev(args);
+    parse_args_free(args);
 
     found = autocomplete_param_with_func(input, "/connect", accounts_find_enabled);
     if (found) {
@@ -3921,6 +4439,11 @@ _join_autocomplete(ProfWin *window, const char *const input)
     char *found = NULL;
     gboolean result = FALSE;
 
+    found = autocomplete_param_with_func(input, "/join", muc_invites_find);
+    if (found) {
+        return found;
+    }
+
     found = autocomplete_param_with_func(input, "/join", bookmark_find);
     if (found) {
         return found;
@@ -3940,12 +4463,12 @@ _join_autocomplete(ProfWin *window, const char *const input)
         found = autocomplete_param_with_ac(input, beginning->str, join_property_ac, TRUE);
         g_string_free(beginning, TRUE);
         if (found) {
-            g_strfreev(args);
+            parse_args_free(args);
             return found;
         }
     }
 
-    g_strfreev(args);
+    parse_args_free(args);
 
     return NULL;
 }
@@ -4005,7 +4528,7 @@ _account_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_ac(input, beginning->str, otr_policy_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
         } else if ((g_strv_length(args) > 3) && (g_strcmp0(args[2], "status")) == 0) {
@@ -4014,7 +4537,7 @@ _account_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_ac(input, beginning->str, account_status_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
         } else if ((g_strv_length(args) > 3) && (g_strcmp0(args[2], "tls")) == 0) {
@@ -4023,7 +4546,7 @@ _account_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_ac(input, beginning->str, tls_property_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
         } else if ((g_strv_length(args) > 3) && (g_strcmp0(args[2], "startscript")) == 0) {
@@ -4032,7 +4555,7 @@ _account_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_func(input, beginning->str, _script_autocomplete_func);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
 #ifdef HAVE_LIBGPGME
@@ -4042,7 +4565,7 @@ _account_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_func(input, beginning->str, p_gpg_autocomplete_key);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
 #endif
@@ -4050,7 +4573,7 @@ _account_autocomplete(ProfWin *window, const char *const input)
             found = autocomplete_param_with_ac(input, beginning->str, account_set_ac, TRUE);
             g_string_free(beginning, TRUE);
             if (found) {
-                g_strfreev(args);
+                parse_args_free(args);
                 return found;
             }
         }
@@ -4062,12 +4585,12 @@ _account_autocomplete(ProfWin *window, const char *const input)
         found = autocomplete_param_with_ac(input, beginning->str, account_clear_ac, TRUE);
         g_string_free(beginning, TRUE);
         if (found) {
-            g_strfreev(args);
+            parse_args_free(args);
             return found;
         }
     }
 
-    g_strfreev(args);
+    parse_args_free(args);
 
     found = autocomplete_param_with_ac(input, "/account default", account_default_ac, TRUE);
     if(found){
@@ -4091,20 +4614,54 @@ _account_autocomplete(ProfWin *window, const char *const input)
 }
 
 static int
-_cmp_command(Command *cmd1, Command *cmd2)
+_cmd_index_cmp(const void *a, const void *b)
 {
-    return g_strcmp0(cmd1->cmd, cmd2->cmd);
+    const Command *cmd1 = *(Command *const *)a;
+    const Command *cmd2 = *(Command *const *)b;
+    return strcmp(cmd1->cmd, cmd2->cmd);
 }
 
-void
-command_docgen(void)
+static int
+_cmd_index_find(const void *key, const void *item)
+{
+    const Command *pcmd = *(Command *const *)item;
+    return strcmp(key, pcmd->cmd);
+}
+
+static int
+_help_items_cmp(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// command_defs never changes, so this is only ever done once
+static void
+_cmd_index_build(void)
 {
-    GList *cmds = NULL;
+    if (cmd_index_built) {
+        return;
+    }
+
     unsigned int i;
     for (i = 0; i < ARRAY_SIZE(command_defs); i++) {
-        Command *pcmd = command_defs+i;
-        cmds = g_list_insert_sorted(cmds, pcmd, (GCompareFunc)_cmp_command);
+        cmd_index[i] = command_defs+i;
     }
+    qsort(cmd_index, ARRAY_SIZE(cmd_index), sizeof(Command*), _cmd_index_cmp);
+
+    for (i = 0; i < ARRAY_SIZE(cmd_index); i++) {
+        help_items[i] = cmd_index[i]->cmd + 1;
+    }
+    help_items[i++] = "commands";
+    help_items[i] = "navigation";
+    qsort(help_items, ARRAY_SIZE(help_items), sizeof(char*), _help_items_cmp);
+
+    cmd_index_built = TRUE;
+}
+
+void
+command_docgen(void)
+{
+    _cmd_index_build();
 
     FILE *toc_fragment = fopen("toc_fragment.html", "w");
     FILE *main_fragment = fopen("main_fragment.html", "w");
@@ -4112,9 +4669,9 @@ command_docgen(void)
     fputs("<ul><li><ul><li>\n", toc_fragment);
     fputs("<hr>\n", main_fragment);
 
-    GList *curr = cmds;
-    while (curr) {
-        Command *pcmd = curr->data;
+    unsigned int c;
+    for (c = 0; c < ARRAY_SIZE(cmd_index); c++) {
+        Command *pcmd = cmd_index[c];
 
         fprintf(toc_fragment, "<a href=\"#%s\">%s</a>,\n", &pcmd->cmd[1], pcmd->cmd);
         fprintf(main_fragment, "<a name=\"%s\"></a>\n", &pcmd->cmd[1]);
@@ -4169,14 +4726,11 @@ command_docgen(void)
 
         fputs("<a href=\"#top\"><h5>back to top</h5></a><br><hr>\n", main_fragment);
         fputs("\n", main_fragment);
-
-        curr = g_list_next(curr);
     }
 
     fputs("</ul></ul>\n", toc_fragment);
 
     fclose(toc_fragment);
     fclose(main_fragment);
-    printf("\nProcessed %d commands.\n\n", g_list_length(cmds));
-    g_list_free(cmds);
+    printf("\nProcessed %d commands.\n\n", (int)ARRAY_SIZE(cmd_index));
 }
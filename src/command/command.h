@@ -40,8 +40,6 @@
 #include "xmpp/form.h"
 #include "ui/ui.h"
 
-GHashTable *commands;
-
 void cmd_init(void);
 void cmd_uninit(void);
 
@@ -54,6 +52,9 @@ void cmd_autocomplete_remove_form_fields(DataForm *form);
 void cmd_alias_add(char *value);
 void cmd_alias_remove(char *value);
 
+Command* cmd_get(const char *const name);
+Command** cmd_get_ordered(guint *count);
+
 gboolean cmd_valid_tag(const char *const str);
 gboolean cmd_has_tag(Command *pcmd, const char *const tag);
 
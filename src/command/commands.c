@@ -63,8 +63,14 @@
 #endif
 #include "profanity.h"
 #include "tools/autocomplete.h"
+#include "tools/history_index.h"
+#include "tools/ipc.h"
+#include "tools/log_retention.h"
 #include "tools/parser.h"
+#include "tools/stats.h"
+#include "tools/traffic.h"
 #include "tools/tinyurl.h"
+#include "tools/watchdog.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/bookmark.h"
 #include "ui/ui.h"
@@ -77,9 +83,27 @@ static gboolean _cmd_set_boolean_preference(gchar *arg, const char *const comman
     const char *const display, preference_t pref);
 static void _who_room(ProfWin *window, const char *const command, gchar **args);
 static void _who_roster(ProfWin *window, const char *const command, gchar **args);
+static void _cmd_tiny_done(const char *const tiny, void *userdata);
+static void _cmd_connect_eval_done(ProfAccount *account, gboolean success);
+static void _cmd_sendfile_done(const char *const filename, const char *const url, const char *const error,
+    void *userdata);
+
+// the window could be closed before a reply arrives, so remember which one
+// asked and look it up again
+typedef struct window_request_t {
+    win_type_t type;
+    char *jid;
+} WindowRequest;
+
+static WindowRequest* _window_request_new(ProfWin *window);
+static ProfWin* _window_request_lookup(WindowRequest *request);
+static void _window_request_free(WindowRequest *request);
+static void _window_send(ProfWin *window, const char *const msg);
 
 extern GHashTable *commands;
 
+#define HISTORY_SEARCH_MAX_RESULTS 50
+
 gboolean
 cmd_execute_default(ProfWin *window, const char *inp)
 {
@@ -102,6 +126,15 @@ cmd_execute_default(ProfWin *window, const char *inp)
 
     jabber_conn_status_t status = jabber_get_connection_status();
     if (status != JABBER_CONNECTED) {
+        // still have an account to reconnect with, keep plain chat messages
+        if ((window->type == WIN_CHAT) && jabber_get_account_name()) {
+            ProfChatWin *chatwin = (ProfChatWin*)window;
+            assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+            if (cl_ev_can_queue_msg(chatwin->barejid)) {
+                cl_ev_queue_msg(chatwin, inp);
+                return TRUE;
+            }
+        }
         ui_current_print_line("You are not currently connected.");
         return TRUE;
     }
@@ -111,6 +144,8 @@ cmd_execute_default(ProfWin *window, const char *inp)
     {
         ProfChatWin *chatwin = (ProfChatWin*)window;
         assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+        const char *encryption = chatwin->pgp_send ? "pgp" : chatwin->is_otr ? "otr" : NULL;
+        ipc_emit(IPC_INPUT, "input", "to", chatwin->barejid, "body", inp, "encryption", encryption, NULL);
         cl_ev_send_msg(chatwin, inp);
         break;
     }
@@ -118,6 +153,7 @@ cmd_execute_default(ProfWin *window, const char *inp)
     {
         ProfPrivateWin *privatewin = (ProfPrivateWin*)window;
         assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
+        ipc_emit(IPC_INPUT, "input", "to", privatewin->fulljid, "body", inp, NULL);
         cl_ev_send_priv_msg(privatewin, inp);
         break;
     }
@@ -125,6 +161,7 @@ cmd_execute_default(ProfWin *window, const char *inp)
     {
         ProfMucWin *mucwin = (ProfMucWin*)window;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        ipc_emit(IPC_INPUT, "input", "to", mucwin->roomjid, "body", inp, NULL);
         cl_ev_send_muc_msg(mucwin, inp);
         break;
     }
@@ -135,26 +172,6 @@ cmd_execute_default(ProfWin *window, const char *inp)
     return TRUE;
 }
 
-gboolean
-cmd_execute_alias(ProfWin *window, const char *const inp, gboolean *ran)
-{
-    if (inp[0] != '/') {
-        ran = FALSE;
-        return TRUE;
-    }
-
-    char *alias = strdup(inp+1);
-    char *value = prefs_get_alias(alias);
-    free(alias);
-    if (value) {
-        *ran = TRUE;
-        return cmd_process_input(window, value);
-    }
-
-    *ran = FALSE;
-    return TRUE;
-}
-
 gboolean
 cmd_tls(ProfWin *window, const char *const command, gchar **args)
 {
@@ -240,7 +257,6 @@ cmd_tls(ProfWin *window, const char *const command, gchar **args)
             cons_show("");
             curr = g_list_next(curr);
         }
-        g_list_free_full(certs, (GDestroyNotify)tlscerts_free);
         return TRUE;
 #else
         cons_show("Manual certificate trust only supported when built with libmesode.");
@@ -303,6 +319,10 @@ cmd_connect(ProfWin *window, const char *const command, gchar **args)
         cons_show("You are either connected already, or a login is in process.");
         return TRUE;
     }
+    if (account_eval_pending()) {
+        cons_show("A login is in process, waiting for eval_password.");
+        return TRUE;
+    }
 
     gchar *opt_keys[] = { "server", "port", "tls", NULL };
     gboolean parsed;
@@ -364,19 +384,18 @@ cmd_connect(ProfWin *window, const char *const command, gchar **args)
         if (account->password) {
             conn_status = cl_ev_connect_account(account);
 
-        // use eval_password if set
+        // use eval_password if set, connecting once it has given the
+        // password so the ui carries on meanwhile
         } else if (account->eval_password) {
-            gboolean res = account_eval_password(account);
-            if (res) {
-                conn_status = cl_ev_connect_account(account);
-                free(account->password);
-                account->password = NULL;
+            if (account_eval_password(account, _cmd_connect_eval_done)) {
+                cons_show("Evaluating password for %s...", account->name);
             } else {
                 cons_show("Error evaluating password, see logs for details.");
-                g_free(lower);
                 account_free(account);
-                return TRUE;
             }
+            options_destroy(options);
+            g_free(lower);
+            return TRUE;
 
         // no account password setting, prompt
         } else {
@@ -409,6 +428,27 @@ cmd_connect(ProfWin *window, const char *const command, gchar **args)
     return TRUE;
 }
 
+static void
+_cmd_connect_eval_done(ProfAccount *account, gboolean success)
+{
+    jabber_conn_status_t conn_status = jabber_get_connection_status();
+    if (!success) {
+        cons_show("Error evaluating password, see logs for details.");
+    } else if ((conn_status != JABBER_DISCONNECTED) && (conn_status != JABBER_STARTED)) {
+        log_info("Not connecting with %s, already connected", account->name);
+    } else {
+        conn_status = cl_ev_connect_account(account);
+        if (conn_status == JABBER_DISCONNECTED) {
+            char *jid = account_create_full_jid(account);
+            cons_show_error("Connection attempt for %s failed.", jid);
+            log_info("Connection attempt for %s failed", jid);
+            free(jid);
+        }
+    }
+
+    account_free(account);
+}
+
 gboolean
 cmd_account(ProfWin *window, const char *const command, gchar **args)
 {
@@ -659,6 +699,36 @@ cmd_account(ProfWin *window, const char *const command, gchar **args)
                         cons_show("Updated TLS policy for account %s: %s", account_name, value);
                         cons_show("");
                     }
+                } else if (strcmp(property, "compression") == 0) {
+                    if ((g_strcmp0(value, "on") != 0) && (g_strcmp0(value, "off") != 0)) {
+                        cons_show("Compression must be one of: on or off.");
+                    } else {
+                        accounts_set_compression(account_name, g_strcmp0(value, "on") == 0);
+                        cons_show("Updated compression for account %s: %s", account_name, value);
+                        cons_show("");
+                    }
+                } else if ((strcmp(property, "history.maxstanzas") == 0)
+                        || (strcmp(property, "history.maxchars") == 0)
+                        || (strcmp(property, "history.seconds") == 0)) {
+                    int intval;
+                    char *err_msg = NULL;
+                    gboolean res = strtoi_range(value, &intval, 0, INT_MAX, &err_msg);
+                    if (!res) {
+                        cons_show(err_msg);
+                        free(err_msg);
+                    } else {
+                        accounts_set_muc_history(account_name, property + strlen("history."), intval);
+                        cons_show("Updated %s for account %s: %s", property, account_name, value);
+                    }
+                    cons_show("");
+                } else if (strcmp(property, "history.since") == 0) {
+                    if ((g_strcmp0(value, "on") != 0) && (g_strcmp0(value, "off") != 0)) {
+                        cons_show("History since must be one of: on or off.");
+                    } else {
+                        accounts_set_muc_history(account_name, "since", g_strcmp0(value, "on") == 0);
+                        cons_show("Updated history.since for account %s: %s", account_name, value);
+                        cons_show("");
+                    }
                 } else if (valid_resource_presence_string(property)) {
                     int intval;
                     char *err_msg = NULL;
@@ -745,6 +815,10 @@ cmd_account(ProfWin *window, const char *const command, gchar **args)
                     accounts_clear_script_start(account_name);
                     cons_show("Removed start script for account %s", account_name);
                     cons_show("");
+                } else if (strcmp(property, "history") == 0) {
+                    accounts_clear_muc_history(account_name);
+                    cons_show("Removed room history settings for account %s", account_name);
+                    cons_show("");
                 } else {
                     cons_show("Invalid property: %s", property);
                     cons_show("");
@@ -811,6 +885,24 @@ cmd_sub(ProfWin *window, const char *const command, gchar **args)
         return TRUE;
     }
 
+    // answer every pending request matching a pattern at once
+    if (jid && ((strcmp(subcmd, "allow") == 0) || (strcmp(subcmd, "deny") == 0)) &&
+            ((strcmp(jid, "all") == 0) || strpbrk(jid, "*?"))) {
+        const char *pattern = strcmp(jid, "all") == 0 ? "*" : jid;
+        gboolean allow = strcmp(subcmd, "allow") == 0;
+        int count = presence_subscription_batch(pattern, allow ? PRESENCE_SUBSCRIBED : PRESENCE_UNSUBSCRIBED);
+        if (count == 0) {
+            cons_show("No subscription requests match %s.", jid);
+        } else if (allow) {
+            cons_show("Accepted %d subscription request%s.", count, count == 1 ? "" : "s");
+            log_info("Accepted %d subscription requests matching %s", count, pattern);
+        } else {
+            cons_show("Denied %d subscription request%s.", count, count == 1 ? "" : "s");
+            log_info("Denied %d subscription requests matching %s", count, pattern);
+        }
+        return TRUE;
+    }
+
     if ((window->type != WIN_CHAT) && (jid == NULL)) {
         cons_show("You must specify a contact.");
         return TRUE;
@@ -916,6 +1008,8 @@ cmd_wins(ProfWin *window, const char *const command, gchar **args)
         }
     } else if (strcmp(args[0], "prune") == 0) {
         ui_prune_wins();
+    } else if (strcmp(args[0], "stats") == 0) {
+        cons_show_wins_stats();
     } else if (strcmp(args[0], "swap") == 0) {
         if ((args[1] == NULL) || (args[2] == NULL)) {
             cons_bad_cmd_usage(command);
@@ -937,6 +1031,43 @@ cmd_wins(ProfWin *window, const char *const command, gchar **args)
                 cons_show("Same source and target window supplied.");
             }
         }
+    } else if (strcmp(args[0], "scrollback") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            prefs_set_scrollback_limit(0);
+            cons_show("Scrollback limit disabled.");
+        } else {
+            int limit = 0;
+            char *err_msg = NULL;
+            if (strtoi_range(args[1], &limit, 1, 65536, &err_msg)) {
+                prefs_set_scrollback_limit(limit);
+                cons_show("Scrollback limited to %dMB.", limit);
+                wins_trim_scrollback();
+            } else {
+                cons_show(err_msg);
+                cons_bad_cmd_usage(command);
+                free(err_msg);
+            }
+        }
+    } else if (strcmp(args[0], "hibernate") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            prefs_set_wins_hibernate(0);
+            cons_show("Window hibernation disabled.");
+        } else {
+            int minutes = 0;
+            char *err_msg = NULL;
+            if (strtoi_range(args[1], &minutes, 1, 10080, &err_msg)) {
+                prefs_set_wins_hibernate(minutes);
+                cons_show("Windows not viewed for %d minutes will hibernate.", minutes);
+            } else {
+                cons_show(err_msg);
+                cons_bad_cmd_usage(command);
+                free(err_msg);
+            }
+        }
     } else if (strcmp(args[0], "autotidy") == 0) {
         if (g_strcmp0(args[1], "on") == 0) {
             cons_show("Window autotidy enabled");
@@ -948,6 +1079,18 @@ cmd_wins(ProfWin *window, const char *const command, gchar **args)
         } else {
             cons_bad_cmd_usage(command);
         }
+    } else if (strcmp(args[0], "restore") == 0) {
+        if (g_strcmp0(args[1], "on") == 0) {
+            cons_show("Chat windows will be restored on the next start.");
+            prefs_set_boolean(PREF_WINS_RESTORE, TRUE);
+            snapshot_save();
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            cons_show("Chat windows will not be restored.");
+            prefs_set_boolean(PREF_WINS_RESTORE, FALSE);
+            snapshot_clear();
+        } else {
+            cons_bad_cmd_usage(command);
+        }
     } else {
         cons_bad_cmd_usage(command);
     }
@@ -973,6 +1116,7 @@ cmd_win(ProfWin *window, const char *const command, gchar **args)
 static void
 _cmd_help_cmd_list(const char *const tag)
 {
+    cons_batch_begin();
     cons_show("");
     ProfWin *console = wins_get_console();
     if (tag) {
@@ -981,55 +1125,39 @@ _cmd_help_cmd_list(const char *const tag)
         win_print(console, '-', 0, NULL, 0, THEME_WHITE_BOLD, "", "All commands");
     }
 
-    GList *ordered_commands = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
-
-    g_hash_table_iter_init(&iter, commands);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        Command *pcmd = (Command *)value;
-        if (tag) {
-            if (cmd_has_tag(pcmd, tag)) {
-                ordered_commands = g_list_insert_sorted(ordered_commands, pcmd->cmd, (GCompareFunc)g_strcmp0);
-            }
-        } else {
-            ordered_commands = g_list_insert_sorted(ordered_commands, pcmd->cmd, (GCompareFunc)g_strcmp0);
-        }
-    }
+    guint total = 0;
+    Command **ordered = cmd_get_ordered(&total);
 
     int maxlen = 0;
-    GList *curr = ordered_commands;
-    while (curr) {
-        gchar *cmd = curr->data;
-        int len = strlen(cmd);
-        if (len > maxlen) maxlen = len;
-        curr = g_list_next(curr);
+    guint i;
+    for (i = 0; i < total; i++) {
+        if (!tag || cmd_has_tag(ordered[i], tag)) {
+            int len = strlen(ordered[i]->cmd);
+            if (len > maxlen) maxlen = len;
+        }
     }
 
     GString *cmds = g_string_new("");
-    curr = ordered_commands;
     int count = 0;
-    while (curr) {
-        gchar *cmd = curr->data;
+    for (i = 0; i < total; i++) {
+        if (tag && !cmd_has_tag(ordered[i], tag)) {
+            continue;
+        }
         if (count == 5) {
             cons_show(cmds->str);
-            g_string_free(cmds, TRUE);
-            cmds = g_string_new("");
+            g_string_truncate(cmds, 0);
             count = 0;
         }
-        g_string_append_printf(cmds, "%-*s", maxlen + 1, cmd);
-        curr = g_list_next(curr);
+        g_string_append_printf(cmds, "%-*s", maxlen + 1, ordered[i]->cmd);
         count++;
     }
     cons_show(cmds->str);
     g_string_free(cmds, TRUE);
-    g_list_free(ordered_commands);
-    g_list_free(curr);
 
     cons_show("");
     cons_show("Use /help [command] without the leading slash, for help on a specific command");
     cons_show("");
+    cons_batch_end();
 }
 
 gboolean
@@ -1055,7 +1183,7 @@ cmd_help(ProfWin *window, const char *const command, gchar **args)
         char cmd_with_slash[1 + strlen(cmd) + 1];
         sprintf(cmd_with_slash, "/%s", cmd);
 
-        Command *command = g_hash_table_lookup(commands, cmd_with_slash);
+        Command *command = cmd_get(cmd_with_slash);
         if (command) {
             cons_show_help(command);
         } else {
@@ -1136,6 +1264,7 @@ cmd_theme(ProfWin *window, const char *const command, gchar **args)
         } else if (theme_load(args[1])) {
             ui_load_colours();
             prefs_set_string(PREF_THEME, args[1]);
+            chatwin_display_settings_changed();
             if (prefs_get_boolean(PREF_ROSTER)) {
                 ui_show_roster();
             } else {
@@ -1318,188 +1447,41 @@ _who_roster(ProfWin *window, const char *const command, gchar **args)
     }
 
     cons_show("");
-    GSList *list = NULL;
     if (group) {
-        list = roster_get_group(group);
-        if (list == NULL) {
+        if (roster_group_size(group) == 0) {
             cons_show("No such group: %s.", group);
             return;
         }
-    } else {
-        list = roster_get_contacts();
-        if (list == NULL) {
-            cons_show("No contacts in roster.");
-            return;
-        }
+    } else if (!roster_has_contacts()) {
+        cons_show("No contacts in roster.");
+        return;
     }
 
+    RosterQuery query = { presence, group, NULL, NULL };
+    GSList *list = roster_query(&query);
+
     // no arg, show all contacts
     if ((presence == NULL) || (g_strcmp0(presence, "any") == 0)) {
         if (group) {
-            if (list == NULL) {
-                cons_show("No contacts in group %s.", group);
-            } else {
-                cons_show("%s:", group);
-                cons_show_contacts(list);
-            }
-        } else {
-            if (list == NULL) {
-                cons_show("You have no contacts.");
-            } else {
-                cons_show("All contacts:");
-                cons_show_contacts(list);
-            }
-        }
-
-    // available
-    } else if (strcmp("available", presence) == 0) {
-        GSList *filtered = NULL;
-
-        GSList *curr = list;
-        while (curr) {
-            PContact contact = curr->data;
-            if (p_contact_is_available(contact)) {
-                filtered = g_slist_append(filtered, contact);
-            }
-            curr = g_slist_next(curr);
-        }
-
-        if (group) {
-            if (filtered == NULL) {
-                cons_show("No contacts in group %s are %s.", group, presence);
-            } else {
-                cons_show("%s (%s):", group, presence);
-                cons_show_contacts(filtered);
-            }
-        } else {
-            if (filtered == NULL) {
-                cons_show("No contacts are %s.", presence);
-            } else {
-                cons_show("Contacts (%s):", presence);
-                cons_show_contacts(filtered);
-            }
-        }
-        g_slist_free(filtered);
-
-    // unavailable
-    } else if (strcmp("unavailable", presence) == 0) {
-        GSList *filtered = NULL;
-
-        GSList *curr = list;
-        while (curr) {
-            PContact contact = curr->data;
-            if (!p_contact_is_available(contact)) {
-                filtered = g_slist_append(filtered, contact);
-            }
-            curr = g_slist_next(curr);
-        }
-
-        if (group) {
-            if (filtered == NULL) {
-                cons_show("No contacts in group %s are %s.", group, presence);
-            } else {
-                cons_show("%s (%s):", group, presence);
-                cons_show_contacts(filtered);
-            }
-        } else {
-            if (filtered == NULL) {
-                cons_show("No contacts are %s.", presence);
-            } else {
-                cons_show("Contacts (%s):", presence);
-                cons_show_contacts(filtered);
-            }
-        }
-        g_slist_free(filtered);
-
-    // online, available resources
-    } else if (strcmp("online", presence) == 0) {
-        GSList *filtered = NULL;
-
-        GSList *curr = list;
-        while (curr) {
-            PContact contact = curr->data;
-            if (p_contact_has_available_resource(contact)) {
-                filtered = g_slist_append(filtered, contact);
-            }
-            curr = g_slist_next(curr);
-        }
-
-        if (group) {
-            if (filtered == NULL) {
-                cons_show("No contacts in group %s are %s.", group, presence);
-            } else {
-                cons_show("%s (%s):", group, presence);
-                cons_show_contacts(filtered);
-            }
+            cons_show("%s:", group);
         } else {
-            if (filtered == NULL) {
-                cons_show("No contacts are %s.", presence);
-            } else {
-                cons_show("Contacts (%s):", presence);
-                cons_show_contacts(filtered);
-            }
-        }
-        g_slist_free(filtered);
-
-    // offline, no available resources
-    } else if (strcmp("offline", presence) == 0) {
-        GSList *filtered = NULL;
-
-        GSList *curr = list;
-        while (curr) {
-            PContact contact = curr->data;
-            if (!p_contact_has_available_resource(contact)) {
-                filtered = g_slist_append(filtered, contact);
-            }
-            curr = g_slist_next(curr);
+            cons_show("All contacts:");
         }
-
-        if (group) {
-            if (filtered == NULL) {
-                cons_show("No contacts in group %s are %s.", group, presence);
-            } else {
-                cons_show("%s (%s):", group, presence);
-                cons_show_contacts(filtered);
-            }
+        cons_show_contacts(list);
+    } else if (group) {
+        if (list == NULL) {
+            cons_show("No contacts in group %s are %s.", group, presence);
         } else {
-            if (filtered == NULL) {
-                cons_show("No contacts are %s.", presence);
-            } else {
-                cons_show("Contacts (%s):", presence);
-                cons_show_contacts(filtered);
-            }
+            cons_show("%s (%s):", group, presence);
+            cons_show_contacts(list);
         }
-        g_slist_free(filtered);
-
-    // show specific status
     } else {
-        GSList *filtered = NULL;
-
-        GSList *curr = list;
-        while (curr) {
-            PContact contact = curr->data;
-            if (strcmp(p_contact_presence(contact), presence) == 0) {
-                filtered = g_slist_append(filtered, contact);
-            }
-            curr = g_slist_next(curr);
-        }
-
-        if (group) {
-            if (filtered == NULL) {
-                cons_show("No contacts in group %s are %s.", group, presence);
-            } else {
-                cons_show("%s (%s):", group, presence);
-                cons_show_contacts(filtered);
-            }
+        if (list == NULL) {
+            cons_show("No contacts are %s.", presence);
         } else {
-            if (filtered == NULL) {
-                cons_show("No contacts are %s.", presence);
-            } else {
-                cons_show("Contacts (%s):", presence);
-                cons_show_contacts(filtered);
-            }
+            cons_show("Contacts (%s):", presence);
+            cons_show_contacts(list);
         }
-        g_slist_free(filtered);
     }
 
     g_slist_free(list);
@@ -1609,7 +1591,7 @@ cmd_group(ProfWin *window, const char *const command, gchar **args)
         if (curr) {
             cons_show("Groups:");
             while (curr) {
-                cons_show("  %s", curr->data);
+                cons_show("  %s (%d)", curr->data, roster_group_size(curr->data));
                 curr = g_slist_next(curr);
             }
 
@@ -1972,7 +1954,9 @@ cmd_resource(ProfWin *window, const char *const command, gchar **args)
             cons_bad_cmd_usage(command);
             return TRUE;
         } else {
-            return _cmd_set_boolean_preference(setting, command, "Message resource", PREF_RESOURCE_MESSAGE);
+            _cmd_set_boolean_preference(setting, command, "Message resource", PREF_RESOURCE_MESSAGE);
+            chatwin_display_settings_changed();
+            return TRUE;
         }
     } else if (g_strcmp0(cmd, "title") == 0) {
         setting = args[1];
@@ -2017,14 +2001,14 @@ cmd_resource(ProfWin *window, const char *const command, gchar **args)
 
         chatwin->resource_override = strdup(resource);
         chat_state_free(chatwin->state);
-        chatwin->state = chat_state_new();
+        chatwin->state = chat_state_new(chatwin->barejid);
         chat_session_resource_override(chatwin->barejid, resource);
         return TRUE;
 
     } else if (g_strcmp0(cmd, "off") == 0) {
         FREE_SET_NULL(chatwin->resource_override);
         chat_state_free(chatwin->state);
-        chatwin->state = chat_state_new();
+        chatwin->state = chat_state_new(chatwin->barejid);
         chat_session_remove(chatwin->barejid);
         return TRUE;
     } else {
@@ -2130,6 +2114,9 @@ cmd_info(ProfWin *window, const char *const command, gchar **args)
                 Occupant *occupant = muc_roster_item(mucwin->roomjid, usr);
                 if (occupant) {
                     win_show_occupant_info(window, mucwin->roomjid, occupant);
+                    if (muc_occupant_want_details(mucwin->roomjid, usr)) {
+                        ui_current_print_line("Large room, the jid and status of %s are kept from their next presence.", usr);
+                    }
                 } else {
                     ui_current_print_line("No such occupant \"%s\" in room.", usr);
                 }
@@ -2326,17 +2313,20 @@ cmd_software(ProfWin *window, const char *const command, gchar **args)
         case WIN_CONSOLE:
             if (args[0]) {
                 Jid *myJid = jid_create(jabber_get_fulljid());
-                Jid *jid = jid_create(args[0]);
-
-                if (jid == NULL || jid->fulljid == NULL) {
-                    cons_show("You must provide a full jid to the /software command.");
-                } else if (g_strcmp0(jid->barejid, myJid->barejid) == 0) {
-                    cons_show("Cannot request software version for yourself.");
-                } else {
-                    iq_send_software_version(jid->fulljid);
+                int i;
+                for (i = 0; args[i]; i++) {
+                    Jid *jid = jid_create(args[i]);
+
+                    if (jid == NULL || jid->fulljid == NULL) {
+                        cons_show("You must provide a full jid to the /software command.");
+                    } else if (g_strcmp0(jid->barejid, myJid->barejid) == 0) {
+                        cons_show("Cannot request software version for yourself.");
+                    } else {
+                        iq_send_software_version(jid->fulljid);
+                    }
+                    jid_destroy(jid);
                 }
                 jid_destroy(myJid);
-                jid_destroy(jid);
             } else {
                 cons_show("You must provide a jid to the /software command.");
             }
@@ -2394,7 +2384,7 @@ cmd_join(ProfWin *window, const char *const command, gchar **args)
     char *room = NULL;
     char *nick = NULL;
     char *passwd = NULL;
-    GString *room_str = g_string_new("");
+    gchar *room_full = NULL;
     char *account_name = jabber_get_account_name();
     ProfAccount *account = accounts_get_account(account_name);
 
@@ -2404,10 +2394,8 @@ cmd_join(ProfWin *window, const char *const command, gchar **args)
 
     // server not supplied (room), use account preference
     } else {
-        g_string_append(room_str, args[0]);
-        g_string_append(room_str, "@");
-        g_string_append(room_str, account->muc_service);
-        room = room_str->str;
+        room_full = g_strdup_printf("%s@%s", args[0], account->muc_service);
+        room = room_full;
     }
 
     // Additional args supplied
@@ -2419,6 +2407,8 @@ cmd_join(ProfWin *window, const char *const command, gchar **args)
         cons_bad_cmd_usage(command);
         cons_show("");
         jid_destroy(room_arg);
+        g_free(room_full);
+        account_free(account);
         return TRUE;
     }
 
@@ -2445,7 +2435,7 @@ cmd_join(ProfWin *window, const char *const command, gchar **args)
     }
 
     jid_destroy(room_arg);
-    g_string_free(room_str, TRUE);
+    g_free(room_full);
     account_free(account);
 
     return TRUE;
@@ -2766,7 +2756,7 @@ cmd_form(ProfWin *window, const char *const command, gchar **args)
             mucconfwin_form_help(confwin);
 
             const gchar **help_text = NULL;
-            Command *command = g_hash_table_lookup(commands, "/form");
+            Command *command = cmd_get("/form");
 
             if (command) {
                 help_text = command->help.synopsis;
@@ -3110,13 +3100,32 @@ cmd_room(ProfWin *window, const char *const command, gchar **args)
 
     if ((g_strcmp0(args[0], "accept") != 0) &&
             (g_strcmp0(args[0], "destroy") != 0) &&
-            (g_strcmp0(args[0], "config") != 0)) {
+            (g_strcmp0(args[0], "config") != 0) &&
+            (g_strcmp0(args[0], "policy") != 0)) {
         cons_bad_cmd_usage(command);
         return TRUE;
     }
 
     ProfMucWin *mucwin = (ProfMucWin*)window;
     assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+
+    if (g_strcmp0(args[0], "policy") == 0) {
+        if (args[1] == NULL) {
+            win_vprint(window, '!', 0, NULL, 0, THEME_ROOMINFO, "", "Room traffic policy: %s",
+                mucwin_policy_name(mucwin->policy));
+            return TRUE;
+        }
+
+        room_policy_t policy = mucwin_policy_from_name(args[1]);
+        if (policy == ROOM_POLICY_LIVE && g_strcmp0(args[1], "live") != 0) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        mucwin_set_policy(mucwin, policy);
+        win_vprint(window, '!', 0, NULL, 0, THEME_ROOMINFO, "", "Room traffic policy set to: %s", args[1]);
+        return TRUE;
+    }
     int num = wins_get_num(window);
 
     int ui_index = num;
@@ -3187,6 +3196,32 @@ cmd_occupants(ProfWin *window, const char *const command, gchar **args)
         }
     }
 
+    if (g_strcmp0(args[0], "large") == 0) {
+        if (!args[1]) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            prefs_set_occupants_large(0);
+            muc_set_large(0);
+            cons_show("Large room mode disabled.");
+            return TRUE;
+        } else {
+            int intval = 0;
+            char *err_msg = NULL;
+            gboolean res = strtoi_range(args[1], &intval, 100, 1000000, &err_msg);
+            if (res) {
+                prefs_set_occupants_large(intval);
+                muc_set_large(intval);
+                cons_show("Rooms with %d or more occupants keep compact occupant records.", intval);
+                return TRUE;
+            } else {
+                cons_show(err_msg);
+                free(err_msg);
+                return TRUE;
+            }
+        }
+    }
+
     if (g_strcmp0(args[0], "default") == 0) {
         if (g_strcmp0(args[1], "show") == 0) {
             if (g_strcmp0(args[2], "jid") == 0) {
@@ -3251,12 +3286,29 @@ cmd_rooms(ProfWin *window, const char *const command, gchar **args)
         return TRUE;
     }
 
-    if (args[0] == NULL) {
+    gchar *service = args[0];
+    gchar *filter = NULL;
+    if (g_strcmp0(args[0], "filter") == 0) {
+        service = NULL;
+        filter = args[1];
+        if (filter == NULL || args[2]) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+    } else if (args[0] && args[1]) {
+        filter = args[2];
+        if ((g_strcmp0(args[1], "filter") != 0) || (filter == NULL)) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+    }
+
+    if (service == NULL) {
         ProfAccount *account = accounts_get_account(jabber_get_account_name());
-        iq_room_list_request(account->muc_service);
+        iq_room_list_request(account->muc_service, filter);
         account_free(account);
     } else {
-        iq_room_list_request(args[0]);
+        iq_room_list_request(service, filter);
     }
 
     return TRUE;
@@ -3428,7 +3480,10 @@ cmd_lastactivity(ProfWin *window, const char *const command, gchar **args)
 
         return TRUE;
     } else {
-        iq_last_activity_request(args[0]);
+        int i;
+        for (i = 0; args[i]; i++) {
+            iq_last_activity_request(args[i]);
+        }
         return TRUE;
     }
 }
@@ -3542,45 +3597,160 @@ cmd_tiny(ProfWin *window, const char *const command, gchar **args)
         return TRUE;
     }
 
-    char *tiny = tinyurl_get(url);
-    if (!tiny) {
+    WindowRequest *request = _window_request_new(window);
+    if (!tinyurl_get(url, _cmd_tiny_done, request)) {
         win_print(window, '-', 0, NULL, 0, THEME_ERROR, "", "Couldn't create tinyurl.");
-        return TRUE;
+        _window_request_free(request);
     }
 
-    switch (window->type){
-    case WIN_CHAT:
-    {
-        ProfChatWin *chatwin = (ProfChatWin*)window;
-        assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-        cl_ev_send_msg(chatwin, tiny);
-        break;
-    }
-    case WIN_PRIVATE:
-    {
-        ProfPrivateWin *privatewin = (ProfPrivateWin*)window;
-        assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
-        cl_ev_send_priv_msg(privatewin, tiny);
-        break;
-    }
-    case WIN_MUC:
-    {
-        ProfMucWin *mucwin = (ProfMucWin*)window;
-        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        cl_ev_send_muc_msg(mucwin, tiny);
-        break;
-    }
-    default:
-        break;
-    }
+    return TRUE;
+}
 
-    free(tiny);
+static void
+_cmd_tiny_done(const char *const tiny, void *userdata)
+{
+    WindowRequest *request = userdata;
+    ProfWin *window = _window_request_lookup(request);
 
-    return TRUE;
+    if (window == NULL) {
+        // window closed in the meantime
+    } else if (!tiny) {
+        win_print(window, '-', 0, NULL, 0, THEME_ERROR, "", "Couldn't create tinyurl.");
+    } else {
+        _window_send(window, tiny);
+    }
+
+    _window_request_free(request);
 }
 
 gboolean
-cmd_clear(ProfWin *window, const char *const command, gchar **args)
+cmd_sendfile(ProfWin *window, const char *const command, gchar **args)
+{
+    jabber_conn_status_t conn_status = jabber_get_connection_status();
+    if (conn_status != JABBER_CONNECTED) {
+        cons_show("You are not currently connected.");
+        return TRUE;
+    }
+
+    if (window->type != WIN_CHAT && window->type != WIN_MUC && window->type != WIN_PRIVATE) {
+        cons_show("/sendfile can only be used in chat windows");
+        return TRUE;
+    }
+
+    char *path = NULL;
+    if (g_str_has_prefix(args[0], "~/")) {
+        path = g_build_filename(g_get_home_dir(), args[0] + 2, NULL);
+    } else {
+        path = g_strdup(args[0]);
+    }
+
+    if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        win_vprint(window, '-', 0, NULL, 0, THEME_ERROR, "", "/sendfile, no such file: %s", path);
+        g_free(path);
+        return TRUE;
+    }
+
+    // the url is sent once the file is up, other uploads can go at once
+    win_vprint(window, '-', 0, NULL, 0, 0, "", "Uploading %s...", path);
+    http_upload_file(path, _cmd_sendfile_done, _window_request_new(window));
+    g_free(path);
+
+    return TRUE;
+}
+
+static void
+_cmd_sendfile_done(const char *const filename, const char *const url, const char *const error, void *userdata)
+{
+    WindowRequest *request = userdata;
+    ProfWin *window = _window_request_lookup(request);
+
+    if (window == NULL) {
+        if (error) {
+            cons_show_error("Couldn't upload %s: %s", filename, error);
+        } else {
+            cons_show("Uploaded %s, its window was closed so the link wasn't sent: %s", filename, url);
+        }
+    } else if (error) {
+        win_vprint(window, '-', 0, NULL, 0, THEME_ERROR, "", "Couldn't upload %s: %s", filename, error);
+    } else {
+        _window_send(window, url);
+    }
+
+    _window_request_free(request);
+}
+
+static WindowRequest*
+_window_request_new(ProfWin *window)
+{
+    WindowRequest *request = malloc(sizeof(WindowRequest));
+    request->type = window->type;
+    switch (window->type) {
+    case WIN_CHAT:
+        request->jid = strdup(((ProfChatWin*)window)->barejid);
+        break;
+    case WIN_PRIVATE:
+        request->jid = strdup(((ProfPrivateWin*)window)->fulljid);
+        break;
+    default:
+        request->jid = strdup(((ProfMucWin*)window)->roomjid);
+        break;
+    }
+
+    return request;
+}
+
+static ProfWin*
+_window_request_lookup(WindowRequest *request)
+{
+    switch (request->type) {
+    case WIN_CHAT:
+        return (ProfWin*)wins_get_chat(request->jid);
+    case WIN_PRIVATE:
+        return (ProfWin*)wins_get_private(request->jid);
+    default:
+        return (ProfWin*)wins_get_muc(request->jid);
+    }
+}
+
+static void
+_window_request_free(WindowRequest *request)
+{
+    free(request->jid);
+    free(request);
+}
+
+static void
+_window_send(ProfWin *window, const char *const msg)
+{
+    switch (window->type) {
+    case WIN_CHAT:
+    {
+        ProfChatWin *chatwin = (ProfChatWin*)window;
+        assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+        cl_ev_send_msg(chatwin, msg);
+        break;
+    }
+    case WIN_PRIVATE:
+    {
+        ProfPrivateWin *privatewin = (ProfPrivateWin*)window;
+        assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
+        cl_ev_send_priv_msg(privatewin, msg);
+        break;
+    }
+    case WIN_MUC:
+    {
+        ProfMucWin *mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        cl_ev_send_muc_msg(mucwin, msg);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+gboolean
+cmd_clear(ProfWin *window, const char *const command, gchar **args)
 {
     win_clear(window);
     return TRUE;
@@ -3987,8 +4157,59 @@ cmd_notify(ProfWin *window, const char *const command, gchar **args)
             cons_show("Chat room notifications disabled.");
             prefs_set_string(PREF_NOTIFY_ROOM, "off");
         } else if (strcmp(args[1], "mention") == 0) {
-            cons_show("Chat room notifications enabled on mention.");
-            prefs_set_string(PREF_NOTIFY_ROOM, "mention");
+            if (args[2] == NULL) {
+                cons_show("Chat room notifications enabled on mention.");
+                prefs_set_string(PREF_NOTIFY_ROOM, "mention");
+            } else if (strcmp(args[2], "case_sensitive") == 0) {
+                cons_show("Case sensitive room mentions enabled.");
+                prefs_set_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE, TRUE);
+                mucwin_mention_settings_changed();
+            } else if (strcmp(args[2], "case_insensitive") == 0) {
+                cons_show("Case sensitive room mentions disabled.");
+                prefs_set_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE, FALSE);
+                mucwin_mention_settings_changed();
+            } else if (strcmp(args[2], "word_whole") == 0) {
+                cons_show("Room mentions only match whole words.");
+                prefs_set_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD, TRUE);
+                mucwin_mention_settings_changed();
+            } else if (strcmp(args[2], "word_part") == 0) {
+                cons_show("Room mentions match within words.");
+                prefs_set_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD, FALSE);
+                mucwin_mention_settings_changed();
+            } else {
+                cons_show("Usage: /notify room mention [case_sensitive|case_insensitive|word_whole|word_part]");
+            }
+        } else if (strcmp(args[1], "trigger") == 0) {
+            if (g_strcmp0(args[2], "add") == 0 && args[3]) {
+                if (prefs_add_room_notify_trigger(args[3])) {
+                    cons_show("Added room mention trigger: %s", args[3]);
+                    mucwin_mention_settings_changed();
+                } else {
+                    cons_show("Room mention trigger already exists: %s", args[3]);
+                }
+            } else if (g_strcmp0(args[2], "remove") == 0 && args[3]) {
+                if (prefs_remove_room_notify_trigger(args[3])) {
+                    cons_show("Removed room mention trigger: %s", args[3]);
+                    mucwin_mention_settings_changed();
+                } else {
+                    cons_show("No such room mention trigger: %s", args[3]);
+                }
+            } else if (g_strcmp0(args[2], "list") == 0) {
+                GList *triggers = prefs_get_room_notify_triggers();
+                if (triggers) {
+                    cons_show("Room mention triggers:");
+                    GList *curr = triggers;
+                    while (curr) {
+                        cons_show("  %s", curr->data);
+                        curr = g_list_next(curr);
+                    }
+                } else {
+                    cons_show("No room mention triggers.");
+                }
+                g_list_free_full(triggers, free);
+            } else {
+                cons_show("Usage: /notify room trigger add|remove <text>|list");
+            }
         } else if (strcmp(args[1], "current") == 0) {
             if (g_strcmp0(args[2], "on") == 0) {
                 cons_show("Current window chat room message notifications enabled.");
@@ -4119,6 +4340,50 @@ cmd_inpblock(ProfWin *window, const char *const command, gchar **args)
         return _cmd_set_boolean_preference(value, command, "Dynamic input blocking", PREF_INPBLOCK_DYNAMIC);
     }
 
+    if (g_strcmp0(subcmd, "budget") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        int intval = 0;
+        char *err_msg = NULL;
+        gboolean res = strtoi_range(value, &intval, 1, 1000, &err_msg);
+        if (res) {
+            cons_show("Stanza budget set to %d milliseconds.", intval);
+            prefs_set_inpblock_budget(intval);
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+
+        return TRUE;
+    }
+
+    if (g_strcmp0(subcmd, "render") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        int intval = 0;
+        char *err_msg = NULL;
+        gboolean res = strtoi_range(value, &intval, 0, 1000, &err_msg);
+        if (res) {
+            if (intval == 0) {
+                cons_show("Render interval disabled.");
+            } else {
+                cons_show("Render interval set to %d milliseconds.", intval);
+            }
+            prefs_set_render_interval(intval);
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+
+        return TRUE;
+    }
+
     cons_bad_cmd_usage(command);
 
     return TRUE;
@@ -4154,7 +4419,64 @@ cmd_log(ProfWin *window, const char *const command, gchar **args)
             cons_bad_cmd_usage(command);
             return TRUE;
         }
-        return _cmd_set_boolean_preference(value, command, "Log rotate", PREF_LOG_ROTATE);
+        gboolean result = _cmd_set_boolean_preference(value, command, "Log rotate", PREF_LOG_ROTATE);
+        log_reinit();
+        return result;
+    }
+
+    if (strcmp(subcmd, "compress") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        return _cmd_set_boolean_preference(value, command, "Rotated log compression", PREF_LOG_COMPRESS);
+    }
+
+    if (strcmp(subcmd, "chatmaxsize") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        int intval = 0;
+        char *err_msg = NULL;
+        gboolean res = strtoi_range(value, &intval, 0, INT_MAX, &err_msg);
+        if (res) {
+            prefs_set_max_chat_log_size(intval);
+            if (intval == 0) {
+                cons_show("Chat logs will only be rolled daily");
+            } else {
+                cons_show("Chat log maximum size set to %d bytes", intval);
+            }
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+        return TRUE;
+    }
+
+    if (strcmp(subcmd, "slow") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        int intval = 0;
+        char *err_msg = NULL;
+        gboolean res = strtoi_range(value, &intval, 0, G_MAXINT, &err_msg);
+        if (res) {
+            prefs_set_log_slow(intval);
+            watchdog_set_threshold(intval);
+            if (intval == 0) {
+                cons_show("Slow operations will not be logged");
+            } else {
+                cons_show("Operations taking over %dms will be logged", intval);
+            }
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+        return TRUE;
     }
 
     if (strcmp(subcmd, "shared") == 0) {
@@ -4167,6 +4489,95 @@ cmd_log(ProfWin *window, const char *const command, gchar **args)
         return result;
     }
 
+    if (strcmp(subcmd, "flush") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        gboolean result = _cmd_set_boolean_preference(value, command, "Chat log flush", PREF_LOG_FLUSH);
+        chat_log_flush();
+        return result;
+    }
+
+    if (strcmp(subcmd, "binary") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        return _cmd_set_boolean_preference(value, command, "Binary chat logs", PREF_LOG_BINARY);
+    }
+
+    if (strcmp(subcmd, "retention") == 0) {
+        char *setting = args[1];
+        if (setting == NULL || args[2] == NULL ||
+                (strcmp(setting, "maxage") != 0 && strcmp(setting, "maxsize") != 0 && strcmp(setting, "archive") != 0)) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        int intval = 0;
+        char *err_msg = NULL;
+        gboolean res = strtoi_range(args[2], &intval, 0, INT_MAX, &err_msg);
+        if (res) {
+            prefs_set_log_retention(setting, intval);
+            if (strcmp(setting, "archive") == 0 && intval > 0 && !log_archive_supported()) {
+                cons_show("Log archival not supported, profanity was built without zlib.");
+            } else {
+                cons_show("Log retention %s set to %d.", setting, intval);
+            }
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+        return TRUE;
+    }
+
+    if (strcmp(subcmd, "area") == 0) {
+        char *area = args[1];
+        char *setting = area ? args[2] : NULL;
+        if (setting == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        if (strcmp(setting, "clear") == 0) {
+            log_area_clear(area);
+            cons_show("Cleared log settings for area %s.", area);
+            return TRUE;
+        }
+        if (args[3] == NULL || !log_area_set(area, setting, args[3])) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        cons_show("Log %s for area %s set to %s.", setting, area, args[3]);
+        return TRUE;
+    }
+
+    if (strcmp(subcmd, "convert") == 0) {
+        if (jabber_get_connection_status() != JABBER_CONNECTED) {
+            cons_show("You are not currently connected.");
+            return TRUE;
+        }
+        Jid *jidp = jid_create(jabber_get_fulljid());
+        int converted = chat_log_convert(jidp->barejid);
+        jid_destroy(jidp);
+        cons_show("Converted %d chat logs to the binary format.", converted);
+        return TRUE;
+    }
+
+    if (strcmp(subcmd, "async") == 0) {
+        if (value == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        gboolean result = _cmd_set_boolean_preference(value, command, "Background log writer", PREF_LOG_ASYNC);
+        if (prefs_get_boolean(PREF_LOG_ASYNC)) {
+            log_async_start();
+        } else {
+            log_async_stop();
+        }
+        return result;
+    }
+
     if (strcmp(subcmd, "where") == 0) {
         char *logfile = get_log_file_location();
         cons_show("Log file: %s", logfile);
@@ -4211,6 +4622,20 @@ cmd_autoping(ProfWin *window, const char *const command, gchar **args)
 
     int intval = 0;
     char *err_msg = NULL;
+    if (g_strcmp0(value, "misses") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+        } else if (strtoi_range(args[1], &intval, 1, G_MAXINT, &err_msg)) {
+            prefs_set_autoping_misses(intval);
+            cons_show("Connection dropped after %d unanswered pings.", intval);
+        } else {
+            cons_show(err_msg);
+            cons_bad_cmd_usage(command);
+            free(err_msg);
+        }
+        return TRUE;
+    }
+
     gboolean res = strtoi_range(value, &intval, 0, INT_MAX, &err_msg);
     if (res) {
         prefs_set_autoping(intval);
@@ -4449,6 +4874,44 @@ cmd_vercheck(ProfWin *window, const char *const command, gchar **args)
 gboolean
 cmd_xmlconsole(ProfWin *window, const char *const command, gchar **args)
 {
+    if (args[0]) {
+        if (g_strcmp0(args[0], "filter") != 0) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        if (args[1] == NULL) {
+            GSList *filters = xmlwin_filter_list();
+            if (filters == NULL) {
+                cons_show("No XML console filters, all traffic is shown.");
+                return TRUE;
+            }
+            cons_show("XML console filters:");
+            while (filters) {
+                cons_show("  %s", filters->data);
+                filters = g_slist_next(filters);
+            }
+        } else if (g_strcmp0(args[1], "clear") == 0) {
+            xmlwin_filter_clear();
+            cons_show("XML console filters cleared, all traffic will be shown.");
+        } else if (args[2] == NULL) {
+            cons_bad_cmd_usage(command);
+        } else if (g_strcmp0(args[1], "add") == 0) {
+            xmlwin_filter_add(args[2]);
+            cons_show("XML console filter added: %s", args[2]);
+        } else if (g_strcmp0(args[1], "remove") == 0) {
+            if (xmlwin_filter_remove(args[2])) {
+                cons_show("XML console filter removed: %s", args[2]);
+            } else {
+                cons_show("No XML console filter: %s", args[2]);
+            }
+        } else {
+            cons_bad_cmd_usage(command);
+        }
+
+        return TRUE;
+    }
+
     ProfXMLWin *xmlwin = wins_get_xmlconsole();
     if (xmlwin) {
         ui_focus_win((ProfWin*)xmlwin);
@@ -4460,12 +4923,110 @@ cmd_xmlconsole(ProfWin *window, const char *const command, gchar **args)
     return TRUE;
 }
 
+static void
+_cmd_stats_show(GString *report)
+{
+    gchar **lines = g_strsplit(report->str, "\n", -1);
+    int i;
+    for (i = 0; lines[i] && lines[i][0] != '\0'; i++) {
+        cons_show("%s", lines[i]);
+    }
+    g_strfreev(lines);
+}
+
+gboolean
+cmd_stats(ProfWin *window, const char *const command, gchar **args)
+{
+    if (g_strcmp0(args[0], "traffic") == 0) {
+        int top = 10;
+        if (args[1]) {
+            char *err_msg = NULL;
+            if (!strtoi_range(args[1], &top, 0, G_MAXINT, &err_msg)) {
+                cons_show(err_msg);
+                cons_show("");
+                free(err_msg);
+                return TRUE;
+            }
+        }
+
+        GString *report = g_string_new("");
+        traffic_report(report, top);
+        _cmd_stats_show(report);
+        g_string_free(report, TRUE);
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "memory") == 0) {
+#ifdef HAVE_ALLOC_STATS
+        GString *report = g_string_new("");
+        stats_memory_report(report);
+        _cmd_stats_show(report);
+        g_string_free(report, TRUE);
+#else
+        cons_show("This version of Profanity has not been built with allocation accounting enabled");
+#endif
+        return TRUE;
+    }
+
+#ifdef HAVE_STATS
+    if (g_strcmp0(args[0], "reset") == 0) {
+        stats_reset();
+        cons_show("Statistics reset.");
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "dump") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        GString *report = g_string_new("");
+        stats_report(report, TRUE);
+#ifdef HAVE_ALLOC_STATS
+        g_string_append(report, "\n");
+        stats_memory_report(report);
+#endif
+        GError *error = NULL;
+        if (g_file_set_contents(args[1], report->str, report->len, &error)) {
+            cons_show("Statistics written to %s", args[1]);
+        } else {
+            cons_show_error("Could not write statistics to %s: %s", args[1], error->message);
+            g_error_free(error);
+        }
+        g_string_free(report, TRUE);
+        return TRUE;
+    }
+
+    gboolean histograms = g_strcmp0(args[0], "histograms") == 0;
+    if ((args[0] && !histograms) || args[1]) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    GString *report = g_string_new("");
+    stats_report(report, histograms);
+    _cmd_stats_show(report);
+    g_string_free(report, TRUE);
+    return TRUE;
+#else
+    cons_show("This version of Profanity has not been built with statistics support enabled");
+    return TRUE;
+#endif
+}
+
 gboolean
 cmd_flash(ProfWin *window, const char *const command, gchar **args)
 {
     return _cmd_set_boolean_preference(args[0], command, "Screen flash", PREF_FLASH);
 }
 
+gboolean
+cmd_fuzzy(ProfWin *window, const char *const command, gchar **args)
+{
+    return _cmd_set_boolean_preference(args[0], command, "Fuzzy completion", PREF_COMPLETE_FUZZY);
+}
+
 gboolean
 cmd_intype(ProfWin *window, const char *const command, gchar **args)
 {
@@ -4517,6 +5078,28 @@ cmd_grlog(ProfWin *window, const char *const command, gchar **args)
 gboolean
 cmd_history(ProfWin *window, const char *const command, gchar **args)
 {
+    if (strcmp(args[0], "search") == 0 || strcmp(args[0], "index") == 0) {
+        if (jabber_get_connection_status() != JABBER_CONNECTED) {
+            cons_show("You are not currently connected.");
+            return TRUE;
+        }
+
+        Jid *jidp = jid_create(jabber_get_fulljid());
+        if (strcmp(args[0], "index") == 0) {
+            int updated = chat_log_index_all(jidp->barejid);
+            cons_show("Indexed %d log files.", updated);
+        } else if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+        } else {
+            GSList *matches = chat_log_search(jidp->barejid, args[1], HISTORY_SEARCH_MAX_RESULTS);
+            cons_show_history_search(args[1], matches);
+            g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+        }
+        jid_destroy(jidp);
+
+        return TRUE;
+    }
+
     gboolean result = _cmd_set_boolean_preference(args[0], command, "Chat history", PREF_HISTORY);
 
     // if set to on, set chlog
@@ -4527,6 +5110,25 @@ cmd_history(ProfWin *window, const char *const command, gchar **args)
     return result;
 }
 
+gboolean
+cmd_search(ProfWin *window, const char *const command, gchar **args)
+{
+    // the same text again carries on from the match shown
+    gboolean older = g_strcmp0(win_search_query(window), args[0]) == 0;
+    if (win_search(window, args[0], older)) {
+        return TRUE;
+    }
+
+    // not repeating the text, so the next search does not find this line
+    if (older) {
+        win_println(window, 0, "No older matches.");
+    } else {
+        win_println(window, 0, "No matches in this window, /history search looks through the logs.");
+    }
+
+    return TRUE;
+}
+
 gboolean
 cmd_carbons(ProfWin *window, const char *const command, gchar **args)
 {
@@ -4547,6 +5149,32 @@ cmd_carbons(ProfWin *window, const char *const command, gchar **args)
     return result;
 }
 
+gboolean
+cmd_sm(ProfWin *window, const char *const command, gchar **args)
+{
+    gboolean result = _cmd_set_boolean_preference(args[0], command, "Stream management", PREF_STREAM_MGMT);
+
+    gboolean valid = (g_strcmp0(args[0], "on") == 0) || (g_strcmp0(args[0], "off") == 0);
+    if (valid && jabber_get_connection_status() == JABBER_CONNECTED) {
+        cons_show("Stream management will be changed on next login.");
+    }
+
+    return result;
+}
+
+gboolean
+cmd_csi(ProfWin *window, const char *const command, gchar **args)
+{
+    gboolean result = _cmd_set_boolean_preference(args[0], command, "Client state indication", PREF_CSI);
+
+    // tell the server we're back if we had reported being inactive
+    if (!prefs_get_boolean(PREF_CSI)) {
+        jabber_set_client_active(TRUE);
+    }
+
+    return result;
+}
+
 gboolean
 cmd_receipts(ProfWin *window, const char *const command, gchar **args)
 {
@@ -4554,6 +5182,8 @@ cmd_receipts(ProfWin *window, const char *const command, gchar **args)
         return _cmd_set_boolean_preference(args[1], command, "Send delivery receipts", PREF_RECEIPTS_SEND);
     } else if (g_strcmp0(args[0], "request") == 0) {
         return _cmd_set_boolean_preference(args[1], command, "Request delivery receipts", PREF_RECEIPTS_REQUEST);
+    } else if (g_strcmp0(args[0], "markers") == 0) {
+        return _cmd_set_boolean_preference(args[1], command, "Chat markers", PREF_CHAT_MARKERS);
     } else {
         cons_bad_cmd_usage(command);
         return TRUE;
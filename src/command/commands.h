@@ -64,9 +64,9 @@ typedef struct cmd_t {
     int max_args;
     void (*setting_func)(void);
     CommandHelp help;
+    char* (*complete_func)(ProfWin *window, const char *const input);
 } Command;
 
-gboolean cmd_execute_alias(ProfWin *window, const char *const inp, gboolean *ran);
 gboolean cmd_execute_default(ProfWin *window, const char *inp);
 
 gboolean cmd_about(ProfWin *window, const char *const command, gchar **args);
@@ -94,7 +94,10 @@ gboolean cmd_grlog(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_group(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_help(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_history(ProfWin *window, const char *const command, gchar **args);
+gboolean cmd_search(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_carbons(ProfWin *window, const char *const command, gchar **args);
+gboolean cmd_sm(ProfWin *window, const char *const command, gchar **args);
+gboolean cmd_csi(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_receipts(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_info(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_intype(ProfWin *window, const char *const command, gchar **args);
@@ -126,6 +129,7 @@ gboolean cmd_statuses(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_sub(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_theme(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_tiny(ProfWin *window, const char *const command, gchar **args);
+gboolean cmd_sendfile(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_titlebar(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_vercheck(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_who(ProfWin *window, const char *const command, gchar **args);
@@ -134,6 +138,7 @@ gboolean cmd_wins(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_xa(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_alias(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_xmlconsole(ProfWin *window, const char *const command, gchar **args);
+gboolean cmd_stats(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_ping(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_form(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_occupants(ProfWin *window, const char *const command, gchar **args);
@@ -145,6 +150,7 @@ gboolean cmd_role(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_privileges(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_presence(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_wrap(ProfWin *window, const char *const command, gchar **args);
+gboolean cmd_fuzzy(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_time(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_resource(ProfWin *window, const char *const command, gchar **args);
 gboolean cmd_inpblock(ProfWin *window, const char *const command, gchar **args);
@@ -41,25 +41,21 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#include <curl/curl.h>
-#include <curl/easy.h>
 #include <glib.h>
 
 #include "tools/p_sha1.h"
+#include "tools/http.h"
+#include "tools/width.h"
 
 #include "log.h"
 #include "common.h"
 
 
-struct curl_data_t
-{
-    char *buffer;
-    size_t size;
-};
-
 static unsigned long unique_id = 0;
 
-static size_t _data_callback(void *ptr, size_t size, size_t nmemb, void *data);
+// shared copies of strings repeated across many objects, each with a count
+// of its users
+static GHashTable *interned = NULL;
 
 // taken from glib 2.30.3
 gchar*
@@ -204,6 +200,73 @@ str_contains_str(const char *const searchstr, const char *const substr)
     return g_strrstr(searchstr, substr) != NULL;
 }
 
+// the same string always gives the same pointer, so interned strings can be
+// compared by address, each str_intern must be matched by a str_unintern
+const char*
+str_intern(const char *const str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+
+    if (interned == NULL) {
+        interned = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    gpointer key = NULL;
+    gpointer refs = NULL;
+    if (g_hash_table_lookup_extended(interned, str, &key, &refs)) {
+        g_hash_table_insert(interned, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) + 1));
+        return key;
+    }
+
+    char *copy = strdup(str);
+    g_hash_table_insert(interned, copy, GUINT_TO_POINTER(1));
+
+    return copy;
+}
+
+void
+str_unintern(const char *const str)
+{
+    if (str == NULL) {
+        return;
+    }
+
+    assert(interned != NULL);
+    guint refs = GPOINTER_TO_UINT(g_hash_table_lookup(interned, str));
+    assert(refs > 0);
+    if (refs == 1) {
+        g_hash_table_remove(interned, str);
+        free((char*)str);
+    } else {
+        g_hash_table_insert(interned, (gpointer)str, GUINT_TO_POINTER(refs - 1));
+    }
+}
+
+// the shared copy of a string if it is in use, without taking a reference,
+// a string that has never been interned cannot be equal to any that has
+const char*
+str_interned(const char *const str)
+{
+    if (str == NULL || interned == NULL) {
+        return NULL;
+    }
+
+    gpointer key = NULL;
+    if (g_hash_table_lookup_extended(interned, str, &key, NULL)) {
+        return key;
+    }
+
+    return NULL;
+}
+
+guint
+str_interned_count(void)
+{
+    return interned ? g_hash_table_size(interned) : 0;
+}
+
 int
 str_contains(const char str[], int size, char ch)
 {
@@ -250,19 +313,7 @@ utf8_display_len(const char *const str)
         return 0;
     }
 
-    int len = 0;
-    gchar *curr = g_utf8_offset_to_pointer(str, 0);
-    while (*curr != '\0') {
-        gunichar curru = g_utf8_get_char(curr);
-        if (g_unichar_iswide(curru)) {
-            len += 2;
-        } else {
-            len ++;
-        }
-        curr = g_utf8_next_char(curr);
-    }
-
-    return len;
+    return width_utf8(str, strlen(str));
 }
 
 char*
@@ -309,30 +360,12 @@ prof_getline(FILE *stream)
     return s;
 }
 
-char*
-release_get_latest(void)
+gboolean
+release_get_latest(http_callback callback, void *userdata)
 {
     char *url = "http://www.profanity.im/profanity_version.txt";
 
-    CURL *handle = curl_easy_init();
-    struct curl_data_t output;
-    output.buffer = NULL;
-    output.size = 0;
-
-    curl_easy_setopt(handle, CURLOPT_URL, url);
-    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, _data_callback);
-    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 2);
-    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)&output);
-
-    curl_easy_perform(handle);
-    curl_easy_cleanup(handle);
-
-    if (output.buffer) {
-        output.buffer[output.size++] = '\0';
-        return output.buffer;
-    } else {
-        return NULL;
-    }
+    return http_get(url, 2, callback, userdata);
 }
 
 gboolean
@@ -496,15 +529,12 @@ char*
 p_sha1_hash(char *str)
 {
     P_SHA1_CTX ctx;
-    uint8_t digest[20];
-    uint8_t *input = (uint8_t*)malloc(strlen(str) + 1);
-    memcpy(input, str, strlen(str) + 1);
+    uint8_t digest[P_SHA1_DIGEST_SIZE];
 
     P_SHA1_Init(&ctx);
-    P_SHA1_Update(&ctx, input, strlen(str));
+    P_SHA1_Update(&ctx, (uint8_t*)str, strlen(str));
     P_SHA1_Final(&ctx, digest);
 
-    free(input);
     return g_base64_encode(digest, sizeof(digest));
 }
 
@@ -580,22 +610,23 @@ get_next_available_win_num(GList *used)
     }
 }
 
-
-static size_t
-_data_callback(void *ptr, size_t size, size_t nmemb, void *data)
+// whether path differs from stamp, which is updated to the file as it is now
+gboolean
+file_stamp_changed(const char *const path, FileStamp *stamp)
 {
-    size_t realsize = size * nmemb;
-    struct curl_data_t *mem = (struct curl_data_t *) data;
-    mem->buffer = realloc(mem->buffer, mem->size + realsize + 1);
-
-    if ( mem->buffer )
-    {
-        memcpy( &( mem->buffer[ mem->size ] ), ptr, realsize );
-        mem->size += realsize;
-        mem->buffer[ mem->size ] = 0;
+    time_t mtime = 0;
+    off_t size = 0;
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        mtime = st.st_mtime;
+        size = st.st_size;
     }
 
-    return realsize;
+    gboolean changed = (mtime != stamp->mtime) || (size != stamp->size);
+    stamp->mtime = mtime;
+    stamp->size = size;
+
+    return changed;
 }
 
 char*
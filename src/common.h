@@ -36,10 +36,14 @@
 #define COMMON_H
 
 #include <stdio.h>
+#include <time.h>
 #include <wchar.h>
+#include <sys/types.h>
 
 #include <glib.h>
 
+#include "tools/http.h"
+
 #if !GLIB_CHECK_VERSION(2,28,0)
 #define g_slist_free_full(items, free_func)         p_slist_free_full(items, free_func)
 #define g_list_free_full(items, free_func)          p_list_free_full(items, free_func)
@@ -104,11 +108,15 @@ gboolean create_dir(char *name);
 gboolean mkdir_recursive(const char *dir);
 char* str_replace(const char *string, const char *substr, const char *replacement);
 gboolean str_contains_str(const char *const searchstr, const char *const substr);
+const char* str_intern(const char *const str);
+void str_unintern(const char *const str);
+const char* str_interned(const char *const str);
+guint str_interned_count(void);
 int str_contains(const char str[], int size, char ch);
 gboolean strtoi_range(char *str, int *saveptr, int min, int max, char **err_msg);
 int utf8_display_len(const char *const str);
 char* prof_getline(FILE *stream);
-char* release_get_latest(void);
+gboolean release_get_latest(http_callback callback, void *userdata);
 gboolean release_is_new(char *found_version);
 gchar* xdg_get_config_home(void);
 gchar* xdg_get_data_home(void);
@@ -126,6 +134,15 @@ int cmp_win_num(gconstpointer a, gconstpointer b);
 int get_next_available_win_num(GList *used);
 
 char* get_file_or_linked(char *loc, char *basedir);
+
+// a file's mtime and size when last seen, to notice another process
+// writing it, both are 0 for a missing file
+typedef struct file_stamp_t {
+    time_t mtime;
+    off_t size;
+} FileStamp;
+
+gboolean file_stamp_changed(const char *const path, FileStamp *stamp);
 char* strip_arg_quotes(const char *const input);
 gboolean is_notify_enabled(void);
 
@@ -32,9 +32,15 @@
  *
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include <glib.h>
 
@@ -43,6 +49,29 @@
 #include "common.h"
 #include "log.h"
 
+// an eval_password command is given this many seconds to print the
+// password, long enough to unlock a key or touch a token
+#define EVAL_PASSWORD_TIMEOUT 60
+
+// the command being run, at most one as it is only run on /connect
+typedef struct eval_password_t {
+    ProfAccount *account;
+    account_eval_callback callback;
+    GPid pid;
+    int fd;
+    char output[READ_BUF_SIZE];
+    size_t len;
+    gboolean line_done;
+    gint64 started;
+} EvalPassword;
+
+static EvalPassword *eval = NULL;
+
+static void _eval_child_setup(gpointer data);
+static void _eval_append(const char *const buf, ssize_t count);
+static void _eval_clear(char *buf, size_t len);
+static void _eval_stop(void);
+
 ProfAccount*
 account_new(const gchar *const name, const gchar *const jid,
     const gchar *const password, const gchar *eval_password, gboolean enabled, const gchar *const server,
@@ -176,42 +205,152 @@ account_create_full_jid(ProfAccount *account)
     }
 }
 
+// run the account's eval_password command without waiting for it, the
+// callback is run from account_eval_process with the account, holding the
+// password on success, and must free it, returns FALSE when the command
+// could not be started, the caller then still owns the account
 gboolean
-account_eval_password(ProfAccount *account)
+account_eval_password(ProfAccount *account, account_eval_callback callback)
 {
     assert(account != NULL);
     assert(account->eval_password != NULL);
 
+    if (eval) {
+        log_error("Already evaluating a password for %s", eval->account->name);
+        return FALSE;
+    }
+
     // Evaluate as shell command to retrieve password
-    GString *cmd = g_string_new("");
-    g_string_append_printf(cmd, "%s 2>/dev/null", account->eval_password);
-
-    FILE *stream = popen(cmd->str, "r");
-    g_string_free(cmd, TRUE);
-    if (stream) {
-        // Limit to READ_BUF_SIZE bytes to prevent overflows in the case of a poorly chosen command
-        account->password = g_malloc(READ_BUF_SIZE);
-        if (!account->password) {
-            log_error("Failed to allocate enough memory to read eval_password output");
-            return FALSE;
+    gchar *argv[] = { "/bin/sh", "-c", account->eval_password, NULL };
+    GPid pid;
+    int out_fd = -1;
+    GError *error = NULL;
+    if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_STDERR_TO_DEV_NULL,
+            _eval_child_setup, NULL, &pid, NULL, &out_fd, NULL, &error)) {
+        log_error("Failed to run eval_password: %s", error ? error->message : "unknown error");
+        if (error) {
+            g_error_free(error);
         }
-        account->password = fgets(account->password, READ_BUF_SIZE, stream);
-        pclose(stream);
-        if (!account->password) {
-            log_error("No result from eval_password.");
-            return FALSE;
+        return FALSE;
+    }
+    fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) | O_NONBLOCK);
+
+    eval = malloc(sizeof(EvalPassword));
+    eval->account = account;
+    eval->callback = callback;
+    eval->pid = pid;
+    eval->fd = out_fd;
+    eval->len = 0;
+    eval->line_done = FALSE;
+    eval->started = g_get_monotonic_time();
+
+    return TRUE;
+}
+
+gboolean
+account_eval_pending(void)
+{
+    return eval != NULL;
+}
+
+// read what the command has printed so far, and call back once it has
+// finished or run out of time, run from the main loop
+void
+account_eval_process(void)
+{
+    if (eval == NULL) {
+        return;
+    }
+
+    gboolean finished = FALSE;
+    while (!eval->line_done) {
+        char buf[256];
+        ssize_t count = read(eval->fd, buf, sizeof(buf));
+        if (count > 0) {
+            _eval_append(buf, count);
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else {
+            finished = count == 0 || errno != EAGAIN;
+            break;
         }
+    }
 
-        // strip trailing newline
-        if (g_str_has_suffix(account->password, "\n")) {
-            account->password[strlen(account->password)-1] = '\0';
+    // the password is the first line, the command needn't exit after it
+    if (!finished && !eval->line_done) {
+        if (g_get_monotonic_time() - eval->started < (gint64)EVAL_PASSWORD_TIMEOUT * G_USEC_PER_SEC) {
+            return;
         }
-    } else {
-        log_error("popen failed when running eval_password.");
-        return FALSE;
+        log_error("eval_password did not finish within %d seconds.", EVAL_PASSWORD_TIMEOUT);
+        eval->len = 0;
+    } else if (eval->len == 0) {
+        log_error("No result from eval_password.");
     }
 
-    return TRUE;
+    ProfAccount *account = eval->account;
+    account_eval_callback callback = eval->callback;
+    gboolean success = eval->len > 0;
+    if (success) {
+        account->password = g_strndup(eval->output, eval->len);
+    }
+    _eval_stop();
+
+    callback(account, success);
+}
+
+// give up on a running command, the account is freed without calling back
+void
+account_eval_cancel(void)
+{
+    if (eval == NULL) {
+        return;
+    }
+
+    account_free(eval->account);
+    _eval_stop();
+}
+
+// the whole process group goes, whatever the shell started with it
+static void
+_eval_stop(void)
+{
+    kill(-eval->pid, SIGKILL);
+    waitpid(eval->pid, NULL, 0);
+    g_spawn_close_pid(eval->pid);
+    close(eval->fd);
+    _eval_clear(eval->output, sizeof(eval->output));
+    free(eval);
+    eval = NULL;
+}
+
+static void
+_eval_child_setup(gpointer data)
+{
+    setpgid(0, 0);
+}
+
+// only the first line is the password, limited to READ_BUF_SIZE bytes to
+// prevent overflows in the case of a poorly chosen command
+static void
+_eval_append(const char *const buf, ssize_t count)
+{
+    ssize_t i;
+    for (i = 0; i < count && !eval->line_done; i++) {
+        if (buf[i] == '\n') {
+            eval->line_done = TRUE;
+        } else if (eval->len < sizeof(eval->output) - 1) {
+            eval->output[eval->len++] = buf[i];
+        }
+    }
+}
+
+static void
+_eval_clear(char *buf, size_t len)
+{
+    volatile char *p = buf;
+    while (len--) {
+        *p++ = '\0';
+    }
 }
 
 void
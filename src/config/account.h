@@ -73,8 +73,15 @@ ProfAccount* account_new(const gchar *const name, const gchar *const jid,
     const gchar *const otr_policy, GList *otr_manual, GList *otr_opportunistic,
     GList *otr_always, const gchar *const pgp_keyid, const char *const startscript,
     gchar *tls_policy);
+// run with the account once its eval_password command is done, success
+// is TRUE when it gave a password
+typedef void (*account_eval_callback)(ProfAccount *account, gboolean success);
+
 char* account_create_full_jid(ProfAccount *account);
-gboolean account_eval_password(ProfAccount *account);
+gboolean account_eval_password(ProfAccount *account, account_eval_callback callback);
+gboolean account_eval_pending(void);
+void account_eval_process(void);
+void account_eval_cancel(void);
 void account_free(ProfAccount *account);
 
 #endif
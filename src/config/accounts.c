@@ -46,6 +46,7 @@
 #include "log.h"
 #include "tools/autocomplete.h"
 #include "xmpp/xmpp.h"
+#include "tools/watchdog.h"
 
 static gchar *accounts_loc;
 static GKeyFile *accounts;
@@ -53,7 +54,17 @@ static GKeyFile *accounts;
 static Autocomplete all_ac;
 static Autocomplete enabled_ac;
 
+// bumped whenever the accounts file is loaded or written
+static guint generation;
+
+// parsed accounts by name, emptied whenever the file is loaded or written
+static GHashTable *account_cache;
+
+// set when accounts has changes not yet written, see accounts_flush
+static gboolean accounts_dirty;
+
 static void _save_accounts(void);
+static void _write_accounts(void);
 static gchar* _get_accounts_file(void);
 static void _remove_from_list(GKeyFile *accounts, const char *const account_name, const char *const key, const char *const contact_jid);
 
@@ -71,6 +82,8 @@ accounts_load(void)
 
     accounts = g_key_file_new();
     g_key_file_load_from_file(accounts, accounts_loc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    generation++;
+    account_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)account_free);
 
     // create the logins searchable list for autocompletion
     gsize naccounts;
@@ -90,11 +103,21 @@ accounts_load(void)
 void
 accounts_close(void)
 {
+    accounts_flush();
     autocomplete_free(all_ac);
     autocomplete_free(enabled_ac);
+    g_hash_table_destroy(account_cache);
+    account_cache = NULL;
     g_key_file_free(accounts);
 }
 
+// lets callers cache values derived from account settings
+guint
+accounts_generation(void)
+{
+    return generation;
+}
+
 char*
 accounts_find_enabled(const char *const prefix)
 {
@@ -304,6 +327,26 @@ accounts_get_account(const char *const name)
     }
 }
 
+// the returned account is owned by the cache and only valid until the
+// accounts are next changed, use accounts_get_account to keep a copy
+const ProfAccount*
+accounts_peek_account(const char *const name)
+{
+    if (name == NULL) {
+        return NULL;
+    }
+
+    ProfAccount *account = g_hash_table_lookup(account_cache, name);
+    if (account == NULL) {
+        account = accounts_get_account(name);
+        if (account) {
+            g_hash_table_insert(account_cache, g_strdup(name), account);
+        }
+    }
+
+    return account;
+}
+
 gboolean
 accounts_enable(const char *const name)
 {
@@ -543,6 +586,19 @@ accounts_clear_script_start(const char *const account_name)
         _save_accounts();
     }
 }
+
+void
+accounts_clear_muc_history(const char *const account_name)
+{
+    if (accounts_account_exists(account_name)) {
+        g_key_file_remove_key(accounts, account_name, "muc.history.maxstanzas", NULL);
+        g_key_file_remove_key(accounts, account_name, "muc.history.maxchars", NULL);
+        g_key_file_remove_key(accounts, account_name, "muc.history.seconds", NULL);
+        g_key_file_remove_key(accounts, account_name, "muc.history.since", NULL);
+        _save_accounts();
+    }
+}
+
 void
 accounts_clear_otr(const char *const account_name)
 {
@@ -758,6 +814,48 @@ accounts_set_priority_all(const char *const account_name, const gint value)
     }
 }
 
+void
+accounts_set_compression(const char *const account_name, gboolean value)
+{
+    if (accounts_account_exists(account_name)) {
+        g_key_file_set_boolean(accounts, account_name, "compression", value);
+        _save_accounts();
+    }
+}
+
+gboolean
+accounts_get_compression(const char *const account_name)
+{
+    return g_key_file_get_boolean(accounts, account_name, "compression", NULL);
+}
+
+// setting is one of maxstanzas, maxchars, seconds or since
+void
+accounts_set_muc_history(const char *const account_name, const char *const setting, const gint value)
+{
+    if (accounts_account_exists(account_name)) {
+        gchar *key = g_strdup_printf("muc.history.%s", setting);
+        g_key_file_set_integer(accounts, account_name, key, value);
+        g_free(key);
+        _save_accounts();
+    }
+}
+
+// returns -1 when the setting is not set, and the room default is used
+gint
+accounts_get_muc_history(const char *const account_name, const char *const setting)
+{
+    gint result = -1;
+
+    gchar *key = g_strdup_printf("muc.history.%s", setting);
+    if (g_key_file_has_key(accounts, account_name, key, NULL)) {
+        result = g_key_file_get_integer(accounts, account_name, key, NULL);
+    }
+    g_free(key);
+
+    return result;
+}
+
 gint
 accounts_get_priority_for_presence_type(const char *const account_name,
     resource_presence_t presence_type)
@@ -852,7 +950,8 @@ resource_presence_t
 accounts_get_last_presence(const char *const account_name)
 {
     resource_presence_t result;
-    gchar *setting = g_key_file_get_string(accounts, account_name, "presence.last", NULL);
+    const ProfAccount *account = accounts_peek_account(account_name);
+    const char *setting = account ? account->last_presence : NULL;
 
     if (setting == NULL || (strcmp(setting, "online") == 0)) {
         result = RESOURCE_ONLINE;
@@ -870,9 +969,6 @@ accounts_get_last_presence(const char *const account_name)
         result = RESOURCE_ONLINE;
     }
 
-    if (setting) {
-        g_free(setting);
-    }
     return result;
 }
 
@@ -912,15 +1008,36 @@ accounts_get_login_presence(const char *const account_name)
     return result;
 }
 
+// readers see the change straight away, the file is written by
+// accounts_flush
 static void
 _save_accounts(void)
 {
+    generation++;
+    g_hash_table_remove_all(account_cache);
+    accounts_dirty = TRUE;
+}
+
+void
+accounts_flush(void)
+{
+    if (accounts_dirty) {
+        _write_accounts();
+    }
+}
+
+static void
+_write_accounts(void)
+{
+    accounts_dirty = FALSE;
+
     gsize g_data_size;
     gchar *g_accounts_data = g_key_file_to_data(accounts, &g_data_size, NULL);
     gchar *xdg_data = xdg_get_data_home();
     GString *base_str = g_string_new(xdg_data);
     g_string_append(base_str, "/profanity/");
     gchar *true_loc = get_file_or_linked(accounts_loc, base_str->str);
+    watchdog_tag(WATCHDOG_DISK);
     g_file_set_contents(true_loc, g_accounts_data, g_data_size, NULL);
     g_chmod(accounts_loc, S_IRUSR | S_IWUSR);
     g_free(xdg_data);
@@ -42,6 +42,8 @@
 
 void accounts_load(void);
 void accounts_close(void);
+void accounts_flush(void);
+guint accounts_generation(void);
 
 char* accounts_find_all(const char *const prefix);
 char* accounts_find_enabled(const char *const prefix);
@@ -51,6 +53,7 @@ void accounts_add(const char *jid, const char *altdomain, const int port, const
 int  accounts_remove(const char *jid);
 gchar** accounts_get_list(void);
 ProfAccount* accounts_get_account(const char *const name);
+const ProfAccount* accounts_peek_account(const char *const name);
 gboolean accounts_enable(const char *const name);
 gboolean accounts_disable(const char *const name);
 gboolean accounts_rename(const char *const account_name,
@@ -82,6 +85,10 @@ void accounts_set_priority_dnd(const char *const account_name, const gint value)
 void accounts_set_priority_all(const char *const account_name, const gint value);
 gint accounts_get_priority_for_presence_type(const char *const account_name,
     resource_presence_t presence_type);
+void accounts_set_compression(const char *const account_name, gboolean value);
+gboolean accounts_get_compression(const char *const account_name);
+void accounts_set_muc_history(const char *const account_name, const char *const setting, const gint value);
+gint accounts_get_muc_history(const char *const account_name, const char *const setting);
 void accounts_set_pgp_keyid(const char *const account_name, const char *const value);
 void accounts_set_script_start(const char *const account_name, const char *const value);
 void accounts_clear_password(const char *const account_name);
@@ -91,6 +98,7 @@ void accounts_clear_port(const char *const account_name);
 void accounts_clear_otr(const char *const account_name);
 void accounts_clear_pgp_keyid(const char *const account_name);
 void accounts_clear_script_start(const char *const account_name);
+void accounts_clear_muc_history(const char *const account_name);
 void accounts_add_otr_policy(const char *const account_name, const char *const contact_jid, const char *const policy);
 
 #endif
@@ -0,0 +1,187 @@
+/*
+ * bookmarkcache.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "config/bookmarkcache.h"
+#include "log.h"
+#include "common.h"
+#include "xmpp/bookmark.h"
+#include "tools/watchdog.h"
+
+// the last bookmarks the server sent or we stored, one group per room jid
+static gchar *bookmarkcache_loc;
+
+void
+bookmarkcache_on_connect(const char *const barejid)
+{
+    bookmarkcache_on_disconnect();
+
+    gchar *data_home = xdg_get_data_home();
+    GString *cachefile = g_string_new(data_home);
+    free(data_home);
+
+    g_string_append(cachefile, "/profanity/bookmarks");
+
+    errno = 0;
+    int res = g_mkdir_with_parents(cachefile->str, S_IRWXU);
+    if (res == -1) {
+        char *errmsg = strerror(errno);
+        if (errmsg) {
+            log_error("Error creating directory: %s, %s", cachefile->str, errmsg);
+        } else {
+            log_error("Error creating directory: %s", cachefile->str);
+        }
+    }
+
+    gchar *account_file = str_replace(barejid, "@", "_at_");
+    g_string_append(cachefile, "/");
+    g_string_append(cachefile, account_file);
+    free(account_file);
+
+    bookmarkcache_loc = cachefile->str;
+    g_string_free(cachefile, FALSE);
+}
+
+void
+bookmarkcache_on_disconnect(void)
+{
+    g_free(bookmarkcache_loc);
+    bookmarkcache_loc = NULL;
+}
+
+// returns a new list of the cached bookmarks, in the order stored
+GList*
+bookmarkcache_load(void)
+{
+    if (!bookmarkcache_loc || !g_file_test(bookmarkcache_loc, G_FILE_TEST_EXISTS)) {
+        return NULL;
+    }
+
+    g_chmod(bookmarkcache_loc, S_IRUSR | S_IWUSR);
+    GKeyFile *bookmarkcache = g_key_file_new();
+    g_key_file_load_from_file(bookmarkcache, bookmarkcache_loc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    GList *result = NULL;
+    gsize len = 0;
+    gchar **jids = g_key_file_get_groups(bookmarkcache, &len);
+    gsize i = 0;
+    for (i = 0; i < len; i++) {
+        Bookmark *item = malloc(sizeof(*item));
+        item->jid = strdup(jids[i]);
+        item->nick = NULL;
+        item->password = NULL;
+
+        gchar *nick = g_key_file_get_string(bookmarkcache, jids[i], "nick", NULL);
+        if (nick) {
+            item->nick = strdup(nick);
+            g_free(nick);
+        }
+        gchar *password = g_key_file_get_string(bookmarkcache, jids[i], "password", NULL);
+        if (password) {
+            item->password = strdup(password);
+            g_free(password);
+        }
+        item->autojoin = g_key_file_get_boolean(bookmarkcache, jids[i], "autojoin", NULL);
+
+        result = g_list_append(result, item);
+    }
+
+    g_strfreev(jids);
+    g_key_file_free(bookmarkcache);
+
+    return result;
+}
+
+void
+bookmarkcache_save(const GList *const bookmarks)
+{
+    if (!bookmarkcache_loc) {
+        return;
+    }
+
+    GKeyFile *bookmarkcache = g_key_file_new();
+    const GList *curr = bookmarks;
+    while (curr) {
+        Bookmark *item = curr->data;
+        if (item->nick) {
+            g_key_file_set_string(bookmarkcache, item->jid, "nick", item->nick);
+        }
+        if (item->password) {
+            g_key_file_set_string(bookmarkcache, item->jid, "password", item->password);
+        }
+        g_key_file_set_boolean(bookmarkcache, item->jid, "autojoin", item->autojoin);
+        curr = g_list_next(curr);
+    }
+
+    gsize g_data_size;
+    gchar *g_bookmarkcache_data = g_key_file_to_data(bookmarkcache, &g_data_size, NULL);
+    watchdog_tag(WATCHDOG_DISK);
+    g_file_set_contents(bookmarkcache_loc, g_bookmarkcache_data, g_data_size, NULL);
+    g_chmod(bookmarkcache_loc, S_IRUSR | S_IWUSR);
+    g_free(g_bookmarkcache_data);
+    g_key_file_free(bookmarkcache);
+}
+
+GList*
+bookmarkcache_autojoin_dropped(const GList *const joined, const GList *const bookmarks)
+{
+    GList *result = NULL;
+    const GList *curr = joined;
+    while (curr) {
+        const char *jid = curr->data;
+        gboolean autojoin = FALSE;
+        const GList *bookmark = bookmarks;
+        while (bookmark) {
+            Bookmark *item = bookmark->data;
+            if (g_strcmp0(item->jid, jid) == 0) {
+                autojoin = item->autojoin;
+                break;
+            }
+            bookmark = g_list_next(bookmark);
+        }
+        if (!autojoin) {
+            result = g_list_append(result, (gpointer)jid);
+        }
+        curr = g_list_next(curr);
+    }
+
+    return result;
+}
@@ -0,0 +1,51 @@
+/*
+ * bookmarkcache.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef BOOKMARKCACHE_H
+#define BOOKMARKCACHE_H
+
+#include <glib.h>
+
+void bookmarkcache_on_connect(const char *const barejid);
+void bookmarkcache_on_disconnect(void);
+
+GList* bookmarkcache_load(void);
+void bookmarkcache_save(const GList *const bookmarks);
+
+// the jids in joined that bookmarks does not have, or does not autojoin,
+// a new list of the same strings
+GList* bookmarkcache_autojoin_dropped(const GList *const joined, const GList *const bookmarks);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * outbox.c
+ *
+ * Copyright (C) 2012 - 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "config/outbox.h"
+#include "log.h"
+#include "common.h"
+#include "tools/watchdog.h"
+
+// chat messages written while waiting to reconnect, one group per message
+// id in the order they were sent, kept on disk until the next login
+static gchar* _outbox_file(const char *const account_name);
+static void _save_outbox(GKeyFile *outbox, const char *const location);
+
+void
+outbox_add(const char *const account_name, const char *const barejid, const char *const id,
+    const char *const message)
+{
+    gchar *location = _outbox_file(account_name);
+    GKeyFile *outbox = g_key_file_new();
+    g_key_file_load_from_file(outbox, location, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    g_key_file_set_string(outbox, id, "jid", barejid);
+    g_key_file_set_string(outbox, id, "message", message);
+    _save_outbox(outbox, location);
+
+    g_key_file_free(outbox);
+    g_free(location);
+}
+
+// queued messages oldest first, the outbox is emptied
+GSList*
+outbox_take(const char *const account_name)
+{
+    gchar *location = _outbox_file(account_name);
+    if (!g_file_test(location, G_FILE_TEST_EXISTS)) {
+        g_free(location);
+        return NULL;
+    }
+
+    GKeyFile *outbox = g_key_file_new();
+    g_key_file_load_from_file(outbox, location, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    GSList *result = NULL;
+    gsize len = 0;
+    gchar **ids = g_key_file_get_groups(outbox, &len);
+    int i = 0;
+    for (i = 0; i < len; i++) {
+        gchar *barejid = g_key_file_get_string(outbox, ids[i], "jid", NULL);
+        gchar *message = g_key_file_get_string(outbox, ids[i], "message", NULL);
+        if (barejid && message) {
+            OutboxMessage *queued = malloc(sizeof(OutboxMessage));
+            queued->id = strdup(ids[i]);
+            queued->barejid = strdup(barejid);
+            queued->message = strdup(message);
+            result = g_slist_append(result, queued);
+        }
+        g_free(barejid);
+        g_free(message);
+    }
+    g_strfreev(ids);
+    g_key_file_free(outbox);
+
+    if (g_remove(location) == -1) {
+        log_error("Error removing outbox: %s", location);
+    }
+    g_free(location);
+
+    return result;
+}
+
+void
+outbox_message_free(OutboxMessage *message)
+{
+    if (message) {
+        free(message->id);
+        free(message->barejid);
+        free(message->message);
+        free(message);
+    }
+}
+
+static gchar*
+_outbox_file(const char *const account_name)
+{
+    gchar *data_home = xdg_get_data_home();
+    GString *outboxfile = g_string_new(data_home);
+    free(data_home);
+
+    g_string_append(outboxfile, "/profanity/outbox");
+
+    errno = 0;
+    int res = g_mkdir_with_parents(outboxfile->str, S_IRWXU);
+    if (res == -1) {
+        char *errmsg = strerror(errno);
+        if (errmsg) {
+            log_error("Error creating directory: %s, %s", outboxfile->str, errmsg);
+        } else {
+            log_error("Error creating directory: %s", outboxfile->str);
+        }
+    }
+
+    gchar *account_file = str_replace(account_name, "@", "_at_");
+    g_string_append(outboxfile, "/");
+    g_string_append(outboxfile, account_file);
+    free(account_file);
+
+    gchar *result = outboxfile->str;
+    g_string_free(outboxfile, FALSE);
+
+    return result;
+}
+
+static void
+_save_outbox(GKeyFile *outbox, const char *const location)
+{
+    gsize g_data_size;
+    gchar *g_outbox_data = g_key_file_to_data(outbox, &g_data_size, NULL);
+    watchdog_tag(WATCHDOG_DISK);
+    g_file_set_contents(location, g_outbox_data, g_data_size, NULL);
+    g_chmod(location, S_IRUSR | S_IWUSR);
+    g_free(g_outbox_data);
+}
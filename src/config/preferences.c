@@ -45,6 +45,7 @@
 #include "log.h"
 #include "preferences.h"
 #include "tools/autocomplete.h"
+#include "tools/watchdog.h"
 
 // preference groups refer to the sections in .profrc, for example [ui]
 #define PREF_GROUP_LOGGING "logging"
@@ -54,18 +55,36 @@
 #define PREF_GROUP_PRESENCE "presence"
 #define PREF_GROUP_CONNECTION "connection"
 #define PREF_GROUP_ALIAS "alias"
+#define PREF_GROUP_LOG_AREAS "logareas"
 #define PREF_GROUP_OTR "otr"
 #define PREF_GROUP_PGP "pgp"
+#define PREF_GROUP_ROOM_POLICY "roompolicy"
 
 #define INPBLOCK_DEFAULT 1000
+#define INPBLOCK_BUDGET_DEFAULT 20
 
 static gchar *prefs_loc;
 static GKeyFile *prefs;
+
+// set when prefs has changes not yet written, see prefs_flush
+static gboolean prefs_dirty;
 gint log_maxsize = 0;
+gint chlog_maxsize = 0;
 
 static Autocomplete boolean_choice_ac;
 
+// values read from the key file, indexed by preference_t
+// entries are loaded on first use and updated by the setters
+static struct {
+    gboolean bool_cached;
+    gboolean bool_value;
+    gboolean string_cached;
+    char *string_value;
+} cache[PREF_COUNT];
+
+static void _cache_clear(void);
 static void _save_prefs(void);
+static void _write_prefs(void);
 static gchar* _get_preferences_file(void);
 static const char* _get_group(preference_t pref);
 static const char* _get_key(preference_t pref);
@@ -77,6 +96,7 @@ prefs_load(void)
 {
     GError *err;
     prefs_loc = _get_preferences_file();
+    _cache_clear();
 
     if (g_file_test(prefs_loc, G_FILE_TEST_EXISTS)) {
         g_chmod(prefs_loc, S_IRUSR | S_IWUSR);
@@ -93,6 +113,8 @@ prefs_load(void)
         g_error_free(err);
     }
 
+    chlog_maxsize = g_key_file_get_integer(prefs, PREF_GROUP_LOGGING, "chatmaxsize", NULL);
+
     // move pre 0.4.8 autoaway.time to autoaway.awaytime
     if (g_key_file_has_key(prefs, PREF_GROUP_PRESENCE, "autoaway.time", NULL)) {
         gint time = g_key_file_get_integer(prefs, PREF_GROUP_PRESENCE, "autoaway.time", NULL);
@@ -137,9 +159,11 @@ prefs_load(void)
 void
 prefs_close(void)
 {
+    prefs_flush();
     autocomplete_free(boolean_choice_ac);
     g_key_file_free(prefs);
     prefs = NULL;
+    _cache_clear();
 }
 
 char*
@@ -157,15 +181,22 @@ prefs_reset_boolean_choice(void)
 gboolean
 prefs_get_boolean(preference_t pref)
 {
+    if (cache[pref].bool_cached) {
+        return cache[pref].bool_value;
+    }
+
     const char *group = _get_group(pref);
     const char *key = _get_key(pref);
-    gboolean def = _get_default_boolean(pref);
+    gboolean result = _get_default_boolean(pref);
 
-    if (!g_key_file_has_key(prefs, group, key, NULL)) {
-        return def;
+    if (g_key_file_has_key(prefs, group, key, NULL)) {
+        result = g_key_file_get_boolean(prefs, group, key, NULL);
     }
 
-    return g_key_file_get_boolean(prefs, group, key, NULL);
+    cache[pref].bool_value = result;
+    cache[pref].bool_cached = TRUE;
+
+    return result;
 }
 
 void
@@ -174,26 +205,49 @@ prefs_set_boolean(preference_t pref, gboolean value)
     const char *group = _get_group(pref);
     const char *key = _get_key(pref);
     g_key_file_set_boolean(prefs, group, key, value);
+    cache[pref].bool_value = value;
+    cache[pref].bool_cached = TRUE;
+    g_free(cache[pref].string_value);
+    cache[pref].string_value = NULL;
+    cache[pref].string_cached = FALSE;
     _save_prefs();
 }
 
-char*
-prefs_get_string(preference_t pref)
+// returned string is owned by the preference cache and is valid
+// until the preference is next set, or prefs are reloaded
+const char*
+prefs_peek_string(preference_t pref)
 {
+    if (cache[pref].string_cached) {
+        return cache[pref].string_value;
+    }
+
     const char *group = _get_group(pref);
     const char *key = _get_key(pref);
-    char *def = _get_default_string(pref);
-
     char *result = g_key_file_get_string(prefs, group, key, NULL);
 
     if (result == NULL) {
+        char *def = _get_default_string(pref);
         if (def) {
-            return g_strdup(def);
-        } else {
-            return NULL;
+            result = g_strdup(def);
         }
+    }
+
+    cache[pref].string_value = result;
+    cache[pref].string_cached = TRUE;
+
+    return result;
+}
+
+char*
+prefs_get_string(preference_t pref)
+{
+    const char *result = prefs_peek_string(pref);
+
+    if (result) {
+        return g_strdup(result);
     } else {
-        return result;
+        return NULL;
     }
 }
 
@@ -216,6 +270,10 @@ prefs_set_string(preference_t pref, char *value)
     } else {
         g_key_file_set_string(prefs, group, key, value);
     }
+    g_free(cache[pref].string_value);
+    cache[pref].string_value = NULL;
+    cache[pref].string_cached = FALSE;
+    cache[pref].bool_cached = FALSE;
     _save_prefs();
 }
 
@@ -262,6 +320,132 @@ prefs_set_max_log_size(gint value)
     _save_prefs();
 }
 
+// 0 when chat logs are only rolled daily
+gint
+prefs_get_max_chat_log_size(void)
+{
+    return chlog_maxsize;
+}
+
+void
+prefs_set_max_chat_log_size(gint value)
+{
+    chlog_maxsize = value;
+    g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, "chatmaxsize", value);
+    _save_prefs();
+}
+
+// milliseconds an operation may block the main loop before it is logged,
+// 0 when the watchdog is off
+gint
+prefs_get_log_slow(void)
+{
+    return g_key_file_get_integer(prefs, PREF_GROUP_LOGGING, "slow", NULL);
+}
+
+void
+prefs_set_log_slow(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, "slow", value);
+    _save_prefs();
+}
+
+gint
+prefs_get_scrollback_limit(void)
+{
+    return g_key_file_get_integer(prefs, PREF_GROUP_UI, "scrollback.limit", NULL);
+}
+
+void
+prefs_set_scrollback_limit(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "scrollback.limit", value);
+    _save_prefs();
+}
+
+gint
+prefs_get_wins_hibernate(void)
+{
+    return g_key_file_get_integer(prefs, PREF_GROUP_UI, "hibernate", NULL);
+}
+
+void
+prefs_set_wins_hibernate(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "hibernate", value);
+    _save_prefs();
+}
+
+// words that highlight a room message as a mention, as well as your nick
+gboolean
+prefs_add_room_notify_trigger(const char *const text)
+{
+    gsize len = 0;
+    gchar **list = g_key_file_get_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", &len, NULL);
+    gsize i;
+    for (i = 0; i < len; i++) {
+        if (g_strcmp0(list[i], text) == 0) {
+            g_strfreev(list);
+            return FALSE;
+        }
+    }
+
+    list = g_renew(gchar*, list, len + 2);
+    list[len] = g_strdup(text);
+    list[len + 1] = NULL;
+    g_key_file_set_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", (const gchar* const*)list, len + 1);
+    g_strfreev(list);
+    _save_prefs();
+
+    return TRUE;
+}
+
+gboolean
+prefs_remove_room_notify_trigger(const char *const text)
+{
+    gsize len = 0;
+    gchar **list = g_key_file_get_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", &len, NULL);
+    gboolean removed = FALSE;
+    gsize i, kept = 0;
+    for (i = 0; i < len; i++) {
+        if (!removed && g_strcmp0(list[i], text) == 0) {
+            g_free(list[i]);
+            removed = TRUE;
+        } else {
+            list[kept++] = list[i];
+        }
+    }
+
+    if (removed) {
+        list[kept] = NULL;
+        if (kept == 0) {
+            g_key_file_remove_key(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", NULL);
+        } else {
+            g_key_file_set_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list",
+                (const gchar* const*)list, kept);
+        }
+        _save_prefs();
+    }
+    g_strfreev(list);
+
+    return removed;
+}
+
+GList*
+prefs_get_room_notify_triggers(void)
+{
+    GList *result = NULL;
+    gsize len = 0;
+    gchar **list = g_key_file_get_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", &len, NULL);
+    gsize i;
+    for (i = 0; i < len; i++) {
+        result = g_list_append(result, strdup(list[i]));
+    }
+    g_strfreev(list);
+
+    return result;
+}
+
 gint
 prefs_get_inpblock(void)
 {
@@ -280,6 +464,38 @@ prefs_set_inpblock(gint value)
     _save_prefs();
 }
 
+gint
+prefs_get_inpblock_budget(void)
+{
+    int val = g_key_file_get_integer(prefs, PREF_GROUP_UI, "inpblock.budget", NULL);
+    if (val == 0) {
+        return INPBLOCK_BUDGET_DEFAULT;
+    } else {
+        return val;
+    }
+}
+
+void
+prefs_set_inpblock_budget(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "inpblock.budget", value);
+    _save_prefs();
+}
+
+// 0 when drawing is never held back
+gint
+prefs_get_render_interval(void)
+{
+    return g_key_file_get_integer(prefs, PREF_GROUP_UI, "inpblock.render", NULL);
+}
+
+void
+prefs_set_render_interval(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "inpblock.render", value);
+    _save_prefs();
+}
+
 gint
 prefs_get_priority(void)
 {
@@ -320,6 +536,23 @@ prefs_set_autoping(gint value)
     _save_prefs();
 }
 
+gint
+prefs_get_autoping_misses(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_CONNECTION, "autoping.misses", NULL)) {
+        return 2;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_CONNECTION, "autoping.misses", NULL);
+    }
+}
+
+void
+prefs_set_autoping_misses(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_CONNECTION, "autoping.misses", value);
+    _save_prefs();
+}
+
 gint
 prefs_get_autoaway_time(void)
 {
@@ -371,6 +604,23 @@ prefs_get_occupants_size(void)
     }
 }
 
+gint
+prefs_get_occupants_large(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, "occupants.large", NULL)) {
+        return 5000;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_UI, "occupants.large", NULL);
+    }
+}
+
+void
+prefs_set_occupants_large(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "occupants.large", value);
+    _save_prefs();
+}
+
 void
 prefs_set_roster_size(gint value)
 {
@@ -475,6 +725,69 @@ prefs_remove_alias(const char *const name)
     }
 }
 
+// log area settings are stored as a string parsed by log.c, NULL removes them
+void
+prefs_set_log_area(const char *const area, const char *const spec)
+{
+    if (spec) {
+        g_key_file_set_string(prefs, PREF_GROUP_LOG_AREAS, area, spec);
+    } else {
+        g_key_file_remove_key(prefs, PREF_GROUP_LOG_AREAS, area, NULL);
+    }
+    _save_prefs();
+}
+
+char*
+prefs_get_log_area(const char *const area)
+{
+    return g_key_file_get_string(prefs, PREF_GROUP_LOG_AREAS, area, NULL);
+}
+
+// traffic policy names keyed by room jid, NULL removes the room's policy
+void
+prefs_set_room_policy(const char *const roomjid, const char *const policy)
+{
+    if (policy) {
+        g_key_file_set_string(prefs, PREF_GROUP_ROOM_POLICY, roomjid, policy);
+    } else {
+        g_key_file_remove_key(prefs, PREF_GROUP_ROOM_POLICY, roomjid, NULL);
+    }
+    _save_prefs();
+}
+
+char*
+prefs_get_room_policy(const char *const roomjid)
+{
+    return g_key_file_get_string(prefs, PREF_GROUP_ROOM_POLICY, roomjid, NULL);
+}
+
+// chat log retention settings, maxage and archive in days and maxsize in
+// bytes, 0 when not limited
+void
+prefs_set_log_retention(const char *const setting, gint value)
+{
+    gchar *key = g_strdup_printf("retention.%s", setting);
+    g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, key, value);
+    g_free(key);
+    _save_prefs();
+}
+
+gint
+prefs_get_log_retention(const char *const setting)
+{
+    gchar *key = g_strdup_printf("retention.%s", setting);
+    gint result = g_key_file_get_integer(prefs, PREF_GROUP_LOGGING, key, NULL);
+    g_free(key);
+
+    return result;
+}
+
+gchar**
+prefs_get_log_areas(void)
+{
+    return g_key_file_get_keys(prefs, PREF_GROUP_LOG_AREAS, NULL, NULL);
+}
+
 static gint
 _alias_cmp(gconstpointer *p1, gconstpointer *p2)
 {
@@ -529,15 +842,45 @@ prefs_free_aliases(GList *aliases)
     g_list_free_full(aliases, (GDestroyNotify)_free_alias);
 }
 
+static void
+_cache_clear(void)
+{
+    int i;
+    for (i = 0; i < PREF_COUNT; i++) {
+        g_free(cache[i].string_value);
+        cache[i].string_value = NULL;
+        cache[i].string_cached = FALSE;
+        cache[i].bool_cached = FALSE;
+    }
+}
+
+// writes are coalesced, the file is written by prefs_flush
 static void
 _save_prefs(void)
 {
+    prefs_dirty = TRUE;
+}
+
+void
+prefs_flush(void)
+{
+    if (prefs_dirty) {
+        _write_prefs();
+    }
+}
+
+static void
+_write_prefs(void)
+{
+    prefs_dirty = FALSE;
+
     gsize g_data_size;
     gchar *g_prefs_data = g_key_file_to_data(prefs, &g_data_size, NULL);
     gchar *xdg_config = xdg_get_config_home();
     GString *base_str = g_string_new(xdg_config);
     g_string_append(base_str, "/profanity/");
     gchar *true_loc = get_file_or_linked(prefs_loc, base_str->str);
+    watchdog_tag(WATCHDOG_DISK);
     g_file_set_contents(true_loc, g_prefs_data, g_data_size, NULL);
     g_chmod(prefs_loc, S_IRUSR | S_IWUSR);
     g_free(xdg_config);
@@ -586,6 +929,8 @@ _get_group(preference_t pref)
         case PREF_PRESENCE:
         case PREF_WRAP:
         case PREF_WINS_AUTO_TIDY:
+        case PREF_WINS_RESTORE:
+        case PREF_COMPLETE_FUZZY:
         case PREF_TIME_CONSOLE:
         case PREF_TIME_CHAT:
         case PREF_TIME_MUC:
@@ -616,6 +961,8 @@ _get_group(preference_t pref)
         case PREF_NOTIFY_ROOM:
         case PREF_NOTIFY_ROOM_CURRENT:
         case PREF_NOTIFY_ROOM_TEXT:
+        case PREF_NOTIFY_MENTION_CASE_SENSITIVE:
+        case PREF_NOTIFY_MENTION_WHOLE_WORD:
         case PREF_NOTIFY_INVITE:
         case PREF_NOTIFY_SUB:
             return PREF_GROUP_NOTIFICATIONS;
@@ -623,6 +970,10 @@ _get_group(preference_t pref)
         case PREF_GRLOG:
         case PREF_LOG_ROTATE:
         case PREF_LOG_SHARED:
+        case PREF_LOG_FLUSH:
+        case PREF_LOG_ASYNC:
+        case PREF_LOG_BINARY:
+        case PREF_LOG_COMPRESS:
             return PREF_GROUP_LOGGING;
         case PREF_AUTOAWAY_CHECK:
         case PREF_AUTOAWAY_MODE:
@@ -635,6 +986,9 @@ _get_group(preference_t pref)
         case PREF_CARBONS:
         case PREF_RECEIPTS_SEND:
         case PREF_RECEIPTS_REQUEST:
+        case PREF_CHAT_MARKERS:
+        case PREF_STREAM_MGMT:
+        case PREF_CSI:
         case PREF_TLS_CERTPATH:
             return PREF_GROUP_CONNECTION;
         case PREF_OTR_LOG:
@@ -678,6 +1032,12 @@ _get_key(preference_t pref)
             return "receipts.send";
         case PREF_RECEIPTS_REQUEST:
             return "receipts.request";
+        case PREF_CHAT_MARKERS:
+            return "receipts.markers";
+        case PREF_STREAM_MGMT:
+            return "streammgmt";
+        case PREF_CSI:
+            return "csi";
         case PREF_OCCUPANTS:
             return "occupants";
         case PREF_OCCUPANTS_JID:
@@ -712,6 +1072,10 @@ _get_key(preference_t pref)
             return "room.current";
         case PREF_NOTIFY_ROOM_TEXT:
             return "room.text";
+        case PREF_NOTIFY_MENTION_CASE_SENSITIVE:
+            return "room.mention.casesensitive";
+        case PREF_NOTIFY_MENTION_WHOLE_WORD:
+            return "room.mention.wholeword";
         case PREF_NOTIFY_INVITE:
             return "invite";
         case PREF_NOTIFY_SUB:
@@ -740,12 +1104,24 @@ _get_key(preference_t pref)
             return "rotate";
         case PREF_LOG_SHARED:
             return "shared";
+        case PREF_LOG_FLUSH:
+            return "flush";
+        case PREF_LOG_ASYNC:
+            return "async";
+        case PREF_LOG_BINARY:
+            return "binary";
+        case PREF_LOG_COMPRESS:
+            return "compress";
         case PREF_PRESENCE:
             return "presence";
         case PREF_WRAP:
             return "wrap";
         case PREF_WINS_AUTO_TIDY:
             return "wins.autotidy";
+        case PREF_WINS_RESTORE:
+            return "wins.restore";
+        case PREF_COMPLETE_FUZZY:
+            return "complete.fuzzy";
         case PREF_TIME_CONSOLE:
             return "time.console";
         case PREF_TIME_CHAT:
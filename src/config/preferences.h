@@ -57,6 +57,9 @@ typedef enum {
     PREF_CARBONS,
     PREF_RECEIPTS_SEND,
     PREF_RECEIPTS_REQUEST,
+    PREF_CHAT_MARKERS,
+    PREF_STREAM_MGMT,
+    PREF_CSI,
     PREF_OCCUPANTS,
     PREF_OCCUPANTS_SIZE,
     PREF_OCCUPANTS_JID,
@@ -70,6 +73,7 @@ typedef enum {
     PREF_PRESENCE,
     PREF_WRAP,
     PREF_WINS_AUTO_TIDY,
+    PREF_WINS_RESTORE,
     PREF_TIME_CONSOLE,
     PREF_TIME_CHAT,
     PREF_TIME_MUC,
@@ -92,6 +96,8 @@ typedef enum {
     PREF_NOTIFY_ROOM,
     PREF_NOTIFY_ROOM_CURRENT,
     PREF_NOTIFY_ROOM_TEXT,
+    PREF_NOTIFY_MENTION_CASE_SENSITIVE,
+    PREF_NOTIFY_MENTION_WHOLE_WORD,
     PREF_NOTIFY_INVITE,
     PREF_NOTIFY_SUB,
     PREF_CHLOG,
@@ -104,6 +110,10 @@ typedef enum {
     PREF_DEFAULT_ACCOUNT,
     PREF_LOG_ROTATE,
     PREF_LOG_SHARED,
+    PREF_LOG_FLUSH,
+    PREF_LOG_ASYNC,
+    PREF_LOG_BINARY,
+    PREF_LOG_COMPRESS,
     PREF_OTR_LOG,
     PREF_OTR_POLICY,
     PREF_RESOURCE_TITLE,
@@ -114,6 +124,8 @@ typedef enum {
     PREF_TLS_CERTPATH,
     PREF_TLS_SHOW,
     PREF_LASTACTIVITY,
+    PREF_COMPLETE_FUZZY,
+    PREF_COUNT // must be last
 } preference_t;
 
 typedef struct prof_alias_t {
@@ -123,6 +135,7 @@ typedef struct prof_alias_t {
 
 void prefs_load(void);
 void prefs_close(void);
+void prefs_flush(void);
 
 char* prefs_find_login(char *prefix);
 void prefs_reset_login_search(void);
@@ -137,16 +150,35 @@ gint prefs_get_notify_remind(void);
 
 void prefs_set_max_log_size(gint value);
 gint prefs_get_max_log_size(void);
+void prefs_set_max_chat_log_size(gint value);
+gint prefs_get_max_chat_log_size(void);
+void prefs_set_log_slow(gint value);
+gint prefs_get_log_slow(void);
+void prefs_set_scrollback_limit(gint value);
+gint prefs_get_scrollback_limit(void);
+void prefs_set_wins_hibernate(gint value);
+gboolean prefs_add_room_notify_trigger(const char *const text);
+gboolean prefs_remove_room_notify_trigger(const char *const text);
+GList* prefs_get_room_notify_triggers(void);
+gint prefs_get_wins_hibernate(void);
 gint prefs_get_priority(void);
 void prefs_set_reconnect(gint value);
 gint prefs_get_reconnect(void);
 void prefs_set_autoping(gint value);
 gint prefs_get_autoping(void);
+void prefs_set_autoping_misses(gint value);
+gint prefs_get_autoping_misses(void);
 gint prefs_get_inpblock(void);
 void prefs_set_inpblock(gint value);
+gint prefs_get_inpblock_budget(void);
+void prefs_set_inpblock_budget(gint value);
+gint prefs_get_render_interval(void);
+void prefs_set_render_interval(gint value);
 
 void prefs_set_occupants_size(gint value);
 gint prefs_get_occupants_size(void);
+void prefs_set_occupants_large(gint value);
+gint prefs_get_occupants_large(void);
 void prefs_set_roster_size(gint value);
 gint prefs_get_roster_size(void);
 
@@ -168,9 +200,20 @@ char* prefs_get_alias(const char *const name);
 GList* prefs_get_aliases(void);
 void prefs_free_aliases(GList *aliases);
 
+void prefs_set_log_area(const char *const area, const char *const spec);
+char* prefs_get_log_area(const char *const area);
+gchar** prefs_get_log_areas(void);
+
+void prefs_set_room_policy(const char *const roomjid, const char *const policy);
+char* prefs_get_room_policy(const char *const roomjid);
+
+void prefs_set_log_retention(const char *const setting, gint value);
+gint prefs_get_log_retention(const char *const setting);
+
 gboolean prefs_get_boolean(preference_t pref);
 void prefs_set_boolean(preference_t pref, gboolean value);
 char* prefs_get_string(preference_t pref);
+const char* prefs_peek_string(preference_t pref);
 void prefs_free_string(char *pref);
 void prefs_set_string(preference_t pref, char *value);
 
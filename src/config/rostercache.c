@@ -0,0 +1,248 @@
+/*
+ * rostercache.c
+ *
+ * Copyright (C) 2012 - 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "config/rostercache.h"
+#include "log.h"
+#include "common.h"
+#include "roster_list.h"
+#include "tools/watchdog.h"
+
+// roster version, stored alongside the contacts, one group per barejid
+#define ROSTERCACHE_GROUP "roster"
+
+static gchar *rostercache_loc;
+static GKeyFile *rostercache;
+static gchar *version;
+
+static void _save_rostercache(void);
+
+void
+rostercache_on_connect(const char *const barejid)
+{
+    rostercache_on_disconnect();
+
+    gchar *data_home = xdg_get_data_home();
+    GString *cachefile = g_string_new(data_home);
+    free(data_home);
+
+    g_string_append(cachefile, "/profanity/roster");
+
+    errno = 0;
+    int res = g_mkdir_with_parents(cachefile->str, S_IRWXU);
+    if (res == -1) {
+        char *errmsg = strerror(errno);
+        if (errmsg) {
+            log_error("Error creating directory: %s, %s", cachefile->str, errmsg);
+        } else {
+            log_error("Error creating directory: %s", cachefile->str);
+        }
+    }
+
+    gchar *account_file = str_replace(barejid, "@", "_at_");
+    g_string_append(cachefile, "/");
+    g_string_append(cachefile, account_file);
+    free(account_file);
+
+    rostercache_loc = cachefile->str;
+    g_string_free(cachefile, FALSE);
+
+    if (g_file_test(rostercache_loc, G_FILE_TEST_EXISTS)) {
+        g_chmod(rostercache_loc, S_IRUSR | S_IWUSR);
+    }
+
+    rostercache = g_key_file_new();
+    g_key_file_load_from_file(rostercache, rostercache_loc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    version = g_key_file_get_string(rostercache, ROSTERCACHE_GROUP, "version", NULL);
+}
+
+void
+rostercache_on_disconnect(void)
+{
+    if (rostercache) {
+        g_key_file_free(rostercache);
+        rostercache = NULL;
+    }
+
+    g_free(rostercache_loc);
+    rostercache_loc = NULL;
+
+    g_free(version);
+    version = NULL;
+}
+
+const char*
+rostercache_get_version(void)
+{
+    return version;
+}
+
+// called with the version of each roster result or push, a NULL version
+// means the server does not support versioning and the cache is not used
+void
+rostercache_set_version(const char *const new_version)
+{
+    if (!rostercache) {
+        return;
+    }
+
+    g_free(version);
+    if (new_version) {
+        version = g_strdup(new_version);
+        g_key_file_set_string(rostercache, ROSTERCACHE_GROUP, "version", version);
+    } else {
+        version = NULL;
+        g_key_file_remove_key(rostercache, ROSTERCACHE_GROUP, "version", NULL);
+    }
+
+    _save_rostercache();
+}
+
+// add the cached contacts to the roster, returns FALSE if there is no
+// usable cache, in which case the roster is left empty
+gboolean
+rostercache_load(void)
+{
+    if (!rostercache || !version) {
+        return FALSE;
+    }
+
+    gsize len = 0;
+    gchar **barejids = g_key_file_get_groups(rostercache, &len);
+
+    roster_batch_begin();
+    int i = 0;
+    for (i = 0; i < len; i++) {
+        if (g_strcmp0(barejids[i], ROSTERCACHE_GROUP) == 0) {
+            continue;
+        }
+
+        gchar *name = g_key_file_get_string(rostercache, barejids[i], "name", NULL);
+        gchar *sub = g_key_file_get_string(rostercache, barejids[i], "subscription", NULL);
+        gboolean pending_out = g_key_file_get_boolean(rostercache, barejids[i], "pending_out", NULL);
+
+        GSList *groups = NULL;
+        gsize groups_len = 0;
+        gchar **group_names = g_key_file_get_string_list(rostercache, barejids[i], "groups", &groups_len, NULL);
+        if (group_names) {
+            int j = 0;
+            for (j = 0; j < groups_len; j++) {
+                groups = g_slist_append(groups, strdup(group_names[j]));
+            }
+            g_strfreev(group_names);
+        }
+
+        roster_add(barejids[i], name, groups, sub, pending_out);
+
+        g_free(name);
+        g_free(sub);
+    }
+    roster_batch_end();
+
+    g_strfreev(barejids);
+
+    return TRUE;
+}
+
+// drop all cached contacts before a full roster is stored
+void
+rostercache_clear(void)
+{
+    if (!rostercache) {
+        return;
+    }
+
+    g_key_file_free(rostercache);
+    rostercache = g_key_file_new();
+    g_free(version);
+    version = NULL;
+}
+
+void
+rostercache_update(const char *const barejid, const char *const name, GSList *groups,
+    const char *const subscription, gboolean pending_out)
+{
+    if (!rostercache) {
+        return;
+    }
+
+    g_key_file_remove_group(rostercache, barejid, NULL);
+
+    if (name) {
+        g_key_file_set_string(rostercache, barejid, "name", name);
+    }
+    if (subscription) {
+        g_key_file_set_string(rostercache, barejid, "subscription", subscription);
+    }
+    g_key_file_set_boolean(rostercache, barejid, "pending_out", pending_out);
+
+    int len = g_slist_length(groups);
+    if (len > 0) {
+        const gchar *group_names[len];
+        int i = 0;
+        while (groups) {
+            group_names[i++] = groups->data;
+            groups = g_slist_next(groups);
+        }
+        g_key_file_set_string_list(rostercache, barejid, "groups", group_names, len);
+    }
+}
+
+void
+rostercache_remove(const char *const barejid)
+{
+    if (!rostercache) {
+        return;
+    }
+
+    g_key_file_remove_group(rostercache, barejid, NULL);
+}
+
+static void
+_save_rostercache(void)
+{
+    gsize g_data_size;
+    gchar *g_rostercache_data = g_key_file_to_data(rostercache, &g_data_size, NULL);
+    watchdog_tag(WATCHDOG_DISK);
+    g_file_set_contents(rostercache_loc, g_rostercache_data, g_data_size, NULL);
+    g_chmod(rostercache_loc, S_IRUSR | S_IWUSR);
+    g_free(g_rostercache_data);
+}
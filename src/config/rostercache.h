@@ -0,0 +1,52 @@
+/*
+ * rostercache.h
+ *
+ * Copyright (C) 2012 - 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef ROSTERCACHE_H
+#define ROSTERCACHE_H
+
+#include <glib.h>
+
+void rostercache_on_connect(const char *const barejid);
+void rostercache_on_disconnect(void);
+
+const char* rostercache_get_version(void);
+void rostercache_set_version(const char *const version);
+
+gboolean rostercache_load(void);
+void rostercache_clear(void);
+void rostercache_update(const char *const barejid, const char *const name, GSList *groups,
+    const char *const subscription, gboolean pending_out);
+void rostercache_remove(const char *const barejid);
+
+#endif
@@ -44,7 +44,10 @@
 #include "log.h"
 #include "window_list.h"
 #include "command/command.h"
+#include "muc.h"
+#include "roster_list.h"
 #include "ui/ui.h"
+#include "xmpp/xmpp.h"
 
 void
 scripts_init(void)
@@ -132,39 +135,113 @@ scripts_read(const char *const script)
     return result;
 }
 
+// lines starting with this pause the script until the condition holds
+#define SCRIPT_WAIT_FOR "wait-for "
+// seconds before a script waiting on a condition is stopped
+#define SCRIPT_WAIT_TIMEOUT 30
+
+// scripts are run from the main loop, one at a time in the order started
+typedef struct script_job_t {
+    char *name;
+    GSList *lines;
+    GSList *curr;
+    GTimer *waiting;
+} ScriptJob;
+
+static GSList *jobs = NULL;
+
+static void
+_scripts_job_free(ScriptJob *job)
+{
+    free(job->name);
+    g_slist_free_full(job->lines, g_free);
+    if (job->waiting) {
+        g_timer_destroy(job->waiting);
+    }
+    free(job);
+}
+
 gboolean
 scripts_exec(const char *const script)
 {
-    gchar *data_home = xdg_get_data_home();
-    GString *scriptpath = g_string_new(data_home);
-    free(data_home);
-
-    g_string_append(scriptpath, "/profanity/scripts/");
-    g_string_append(scriptpath, script);
-
-    FILE *scriptfile = g_fopen(scriptpath->str, "r");
-    if (!scriptfile) {
-        log_info("Script not found: %s", scriptpath->str);
-        g_string_free(scriptpath, TRUE);
+    GSList *lines = scripts_read(script);
+    if (lines == NULL) {
         return FALSE;
     }
 
-    g_string_free(scriptpath, TRUE);
+    ScriptJob *job = malloc(sizeof(ScriptJob));
+    job->name = strdup(script);
+    job->lines = lines;
+    job->curr = lines;
+    job->waiting = NULL;
+    jobs = g_slist_append(jobs, job);
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
+    return TRUE;
+}
 
-    while ((read = getline(&line, &len, scriptfile)) != -1) {
-        ProfWin *win = wins_get_current();
-        cmd_process_input(win, line);
-        jabber_process_events(10);
-        ui_update();
+gboolean
+scripts_running(void)
+{
+    return jobs != NULL;
+}
+
+// wait-for connected, wait-for roster or wait-for room <roomjid>
+static gboolean
+_scripts_wait_over(ScriptJob *job, const char *const condition)
+{
+    if (g_strcmp0(condition, "connected") == 0) {
+        return jabber_get_connection_status() == JABBER_CONNECTED;
+    } else if (g_strcmp0(condition, "roster") == 0) {
+        return roster_received();
+    } else if (g_str_has_prefix(condition, "room ")) {
+        return muc_active(&condition[5]) && muc_roster_complete(&condition[5]);
+    } else {
+        cons_show_error("Script %s, unknown wait-for: %s", job->name, condition);
+        return TRUE;
     }
+}
 
-    fclose(scriptfile);
-    if (line) free(line);
+// run the lines of the current script back to back until it finishes or
+// has to wait, called once per main loop pass so the screen is only
+// updated once for all of them
+void
+scripts_run(void)
+{
+    while (jobs) {
+        ScriptJob *job = jobs->data;
+
+        while (job->curr) {
+            char *line = job->curr->data;
+
+            if (g_str_has_prefix(line, SCRIPT_WAIT_FOR)) {
+                if (job->waiting == NULL) {
+                    job->waiting = g_timer_new();
+                }
+                gchar *condition = g_strstrip(g_strdup(&line[strlen(SCRIPT_WAIT_FOR)]));
+                gboolean over = _scripts_wait_over(job, condition);
+                g_free(condition);
+                if (!over) {
+                    if (g_timer_elapsed(job->waiting, NULL) < SCRIPT_WAIT_TIMEOUT) {
+                        return;
+                    }
+                    cons_show_error("Script %s stopped, timed out at: %s", job->name, line);
+                    job->curr = NULL;
+                    break;
+                }
+                g_timer_destroy(job->waiting);
+                job->waiting = NULL;
+                job->curr = g_slist_next(job->curr);
+                continue;
+            }
+
+            // the line is changed in place when run
+            job->curr = g_slist_next(job->curr);
+            char *inp = strdup(line);
+            cmd_process_input(wins_get_current(), inp);
+            free(inp);
+        }
 
-    return TRUE;
+        jobs = g_slist_remove(jobs, job);
+        _scripts_job_free(job);
+    }
 }
-
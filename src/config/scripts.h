@@ -38,3 +38,5 @@ void scripts_init(void);
 GSList* scripts_list(void);
 GSList* scripts_read(const char *const script);
 gboolean scripts_exec(const char *const script);
+gboolean scripts_running(void);
+void scripts_run(void);
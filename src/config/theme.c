@@ -37,7 +37,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/stat.h>
+
 #include <glib.h>
+#include <glib/gstdio.h>
 #ifdef HAVE_NCURSESW_NCURSES_H
 #include <ncursesw/ncurses.h>
 #elif HAVE_NCURSES_H
@@ -53,6 +56,10 @@ static GString *theme_loc;
 static GKeyFile *theme;
 static GHashTable *bold_items;
 
+// attributes for every theme item, worked out when the theme is loaded
+#define THEME_ITEMS (THEME_MAGENTA_BOLD + 1)
+static int item_attrs[THEME_ITEMS];
+
 struct colour_string_t {
     char *str;
     NCURSES_COLOR_T colour;
@@ -124,14 +131,42 @@ static struct colours_t {
         NCURSES_COLOR_T receiptsent;
 } colour_prefs;
 
+// a parsed theme file with the colours and attributes resolved from it,
+// kept while the file on disk is unchanged
+typedef struct theme_cache_t {
+    GKeyFile *keyfile;
+    time_t mtime;
+    off_t size;
+    gboolean compiled;
+    struct colours_t colours;
+    int attrs[THEME_ITEMS];
+} ThemeCache;
+
+// parsed themes by file path, the default theme under "default"
+static GHashTable *theme_cache;
+static ThemeCache *current_theme;
+
+// colour pairs as last given to ncurses, only changed pairs are redefined
+#define THEME_PAIRS 55
+static struct {
+    gboolean set;
+    NCURSES_COLOR_T fg;
+    NCURSES_COLOR_T bg;
+} pairs[THEME_PAIRS];
+
 static NCURSES_COLOR_T _lookup_colour(const char *const colour);
 static void _set_colour(gchar *val, NCURSES_COLOR_T *pref, NCURSES_COLOR_T def, theme_item_t theme_item);
 static void _load_colours(void);
+static void _load_attrs(void);
+static int _theme_colour_pair(theme_item_t attrs);
 static void _load_preferences(void);
 static gchar* _get_themes_dir(void);
 void _theme_list_dir(const gchar *const dir, GSList **result);
 static GString* _theme_find(const char *const theme_name);
 static gboolean _theme_load_file(const char *const theme_name);
+static ThemeCache* _theme_cache_get(const char *const key, const char *const path);
+static void _theme_cache_free(ThemeCache *entry);
+static void _init_pair(short pair, NCURSES_COLOR_T fg, NCURSES_COLOR_T bg);
 
 void
 theme_init(const char *const theme_name)
@@ -160,10 +195,7 @@ _theme_load_file(const char *const theme_name)
 {
     // use default theme
     if (theme_name == NULL || strcmp(theme_name, "default") == 0) {
-        if (theme) {
-            g_key_file_free(theme);
-        }
-        theme = g_key_file_new();
+        current_theme = _theme_cache_get("default", NULL);
 
     // load theme from file
     } else {
@@ -178,17 +210,57 @@ _theme_load_file(const char *const theme_name)
         }
         theme_loc = new_theme_file;
         log_info("Loading theme \"%s\"", theme_name);
-        if (theme) {
-            g_key_file_free(theme);
-        }
-        theme = g_key_file_new();
-        g_key_file_load_from_file(theme, theme_loc->str, G_KEY_FILE_KEEP_COMMENTS,
-            NULL);
+        current_theme = _theme_cache_get(theme_loc->str, theme_loc->str);
     }
+    theme = current_theme->keyfile;
 
     return TRUE;
 }
 
+// returns the cached theme for key, parsing the file at path again when
+// it has changed since it was cached
+static ThemeCache*
+_theme_cache_get(const char *const key, const char *const path)
+{
+    if (theme_cache == NULL) {
+        theme_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_theme_cache_free);
+    }
+
+    time_t mtime = 0;
+    off_t size = 0;
+    if (path) {
+        GStatBuf st;
+        if (g_stat(path, &st) == 0) {
+            mtime = st.st_mtime;
+            size = st.st_size;
+        }
+    }
+
+    ThemeCache *entry = g_hash_table_lookup(theme_cache, key);
+    if (entry && entry->mtime == mtime && entry->size == size) {
+        return entry;
+    }
+
+    entry = malloc(sizeof(ThemeCache));
+    entry->keyfile = g_key_file_new();
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->compiled = FALSE;
+    if (path) {
+        g_key_file_load_from_file(entry->keyfile, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    }
+    g_hash_table_replace(theme_cache, strdup(key), entry);
+
+    return entry;
+}
+
+static void
+_theme_cache_free(ThemeCache *entry)
+{
+    g_key_file_free(entry->keyfile);
+    free(entry);
+}
+
 GSList*
 theme_list(void)
 {
@@ -205,10 +277,13 @@ theme_list(void)
 void
 theme_close(void)
 {
-    if (theme) {
-        g_key_file_free(theme);
-        theme = NULL;
+    theme = NULL;
+    current_theme = NULL;
+    if (theme_cache) {
+        g_hash_table_destroy(theme_cache);
+        theme_cache = NULL;
     }
+    memset(pairs, 0, sizeof(pairs));
     if (theme_loc) {
         g_string_free(theme_loc, TRUE);
         theme_loc = NULL;
@@ -223,80 +298,94 @@ void
 theme_init_colours(void)
 {
     // main text
-    init_pair(1, colour_prefs.maintext, colour_prefs.bkgnd);
-    init_pair(2, colour_prefs.maintextme, colour_prefs.bkgnd);
-    init_pair(3, colour_prefs.maintextthem, colour_prefs.bkgnd);
-    init_pair(4, colour_prefs.splashtext, colour_prefs.bkgnd);
-    init_pair(5, colour_prefs.error, colour_prefs.bkgnd);
-    init_pair(6, colour_prefs.incoming, colour_prefs.bkgnd);
-    init_pair(7, colour_prefs.inputtext, colour_prefs.bkgnd);
-    init_pair(8, colour_prefs.timetext, colour_prefs.bkgnd);
+    _init_pair(1, colour_prefs.maintext, colour_prefs.bkgnd);
+    _init_pair(2, colour_prefs.maintextme, colour_prefs.bkgnd);
+    _init_pair(3, colour_prefs.maintextthem, colour_prefs.bkgnd);
+    _init_pair(4, colour_prefs.splashtext, colour_prefs.bkgnd);
+    _init_pair(5, colour_prefs.error, colour_prefs.bkgnd);
+    _init_pair(6, colour_prefs.incoming, colour_prefs.bkgnd);
+    _init_pair(7, colour_prefs.inputtext, colour_prefs.bkgnd);
+    _init_pair(8, colour_prefs.timetext, colour_prefs.bkgnd);
 
     // title bar
-    init_pair(9, colour_prefs.titlebartext, colour_prefs.titlebar);
-    init_pair(10, colour_prefs.titlebarbrackets, colour_prefs.titlebar);
-    init_pair(11, colour_prefs.titlebarunencrypted, colour_prefs.titlebar);
-    init_pair(12, colour_prefs.titlebarencrypted, colour_prefs.titlebar);
-    init_pair(13, colour_prefs.titlebaruntrusted, colour_prefs.titlebar);
-    init_pair(14, colour_prefs.titlebartrusted, colour_prefs.titlebar);
-    init_pair(15, colour_prefs.titlebaronline, colour_prefs.titlebar);
-    init_pair(16, colour_prefs.titlebaroffline, colour_prefs.titlebar);
-    init_pair(17, colour_prefs.titlebaraway, colour_prefs.titlebar);
-    init_pair(18, colour_prefs.titlebarchat, colour_prefs.titlebar);
-    init_pair(19, colour_prefs.titlebardnd, colour_prefs.titlebar);
-    init_pair(20, colour_prefs.titlebarxa, colour_prefs.titlebar);
+    _init_pair(9, colour_prefs.titlebartext, colour_prefs.titlebar);
+    _init_pair(10, colour_prefs.titlebarbrackets, colour_prefs.titlebar);
+    _init_pair(11, colour_prefs.titlebarunencrypted, colour_prefs.titlebar);
+    _init_pair(12, colour_prefs.titlebarencrypted, colour_prefs.titlebar);
+    _init_pair(13, colour_prefs.titlebaruntrusted, colour_prefs.titlebar);
+    _init_pair(14, colour_prefs.titlebartrusted, colour_prefs.titlebar);
+    _init_pair(15, colour_prefs.titlebaronline, colour_prefs.titlebar);
+    _init_pair(16, colour_prefs.titlebaroffline, colour_prefs.titlebar);
+    _init_pair(17, colour_prefs.titlebaraway, colour_prefs.titlebar);
+    _init_pair(18, colour_prefs.titlebarchat, colour_prefs.titlebar);
+    _init_pair(19, colour_prefs.titlebardnd, colour_prefs.titlebar);
+    _init_pair(20, colour_prefs.titlebarxa, colour_prefs.titlebar);
 
     // status bar
-    init_pair(21, colour_prefs.statusbartext, colour_prefs.statusbar);
-    init_pair(22, colour_prefs.statusbarbrackets, colour_prefs.statusbar);
-    init_pair(23, colour_prefs.statusbaractive, colour_prefs.statusbar);
-    init_pair(24, colour_prefs.statusbarnew, colour_prefs.statusbar);
+    _init_pair(21, colour_prefs.statusbartext, colour_prefs.statusbar);
+    _init_pair(22, colour_prefs.statusbarbrackets, colour_prefs.statusbar);
+    _init_pair(23, colour_prefs.statusbaractive, colour_prefs.statusbar);
+    _init_pair(24, colour_prefs.statusbarnew, colour_prefs.statusbar);
 
     // chat
-    init_pair(25, colour_prefs.me, colour_prefs.bkgnd);
-    init_pair(26, colour_prefs.them, colour_prefs.bkgnd);
-    init_pair(27, colour_prefs.receiptsent, colour_prefs.bkgnd);
+    _init_pair(25, colour_prefs.me, colour_prefs.bkgnd);
+    _init_pair(26, colour_prefs.them, colour_prefs.bkgnd);
+    _init_pair(27, colour_prefs.receiptsent, colour_prefs.bkgnd);
 
     // room chat
-    init_pair(28, colour_prefs.roominfo, colour_prefs.bkgnd);
-    init_pair(29, colour_prefs.roommention, colour_prefs.bkgnd);
+    _init_pair(28, colour_prefs.roominfo, colour_prefs.bkgnd);
+    _init_pair(29, colour_prefs.roommention, colour_prefs.bkgnd);
 
     // statuses
-    init_pair(30, colour_prefs.online, colour_prefs.bkgnd);
-    init_pair(31, colour_prefs.offline, colour_prefs.bkgnd);
-    init_pair(32, colour_prefs.away, colour_prefs.bkgnd);
-    init_pair(33, colour_prefs.chat, colour_prefs.bkgnd);
-    init_pair(34, colour_prefs.dnd, colour_prefs.bkgnd);
-    init_pair(35, colour_prefs.xa, colour_prefs.bkgnd);
+    _init_pair(30, colour_prefs.online, colour_prefs.bkgnd);
+    _init_pair(31, colour_prefs.offline, colour_prefs.bkgnd);
+    _init_pair(32, colour_prefs.away, colour_prefs.bkgnd);
+    _init_pair(33, colour_prefs.chat, colour_prefs.bkgnd);
+    _init_pair(34, colour_prefs.dnd, colour_prefs.bkgnd);
+    _init_pair(35, colour_prefs.xa, colour_prefs.bkgnd);
 
     // states
-    init_pair(36, colour_prefs.typing, colour_prefs.bkgnd);
-    init_pair(37, colour_prefs.gone, colour_prefs.bkgnd);
+    _init_pair(36, colour_prefs.typing, colour_prefs.bkgnd);
+    _init_pair(37, colour_prefs.gone, colour_prefs.bkgnd);
 
     // subscription status
-    init_pair(38, colour_prefs.subscribed, colour_prefs.bkgnd);
-    init_pair(39, colour_prefs.unsubscribed, colour_prefs.bkgnd);
+    _init_pair(38, colour_prefs.subscribed, colour_prefs.bkgnd);
+    _init_pair(39, colour_prefs.unsubscribed, colour_prefs.bkgnd);
 
     // otr messages
-    init_pair(40, colour_prefs.otrstartedtrusted, colour_prefs.bkgnd);
-    init_pair(41, colour_prefs.otrstarteduntrusted, colour_prefs.bkgnd);
-    init_pair(42, colour_prefs.otrended, colour_prefs.bkgnd);
-    init_pair(43, colour_prefs.otrtrusted, colour_prefs.bkgnd);
-    init_pair(44, colour_prefs.otruntrusted, colour_prefs.bkgnd);
+    _init_pair(40, colour_prefs.otrstartedtrusted, colour_prefs.bkgnd);
+    _init_pair(41, colour_prefs.otrstarteduntrusted, colour_prefs.bkgnd);
+    _init_pair(42, colour_prefs.otrended, colour_prefs.bkgnd);
+    _init_pair(43, colour_prefs.otrtrusted, colour_prefs.bkgnd);
+    _init_pair(44, colour_prefs.otruntrusted, colour_prefs.bkgnd);
 
     // subwin headers
-    init_pair(45, colour_prefs.rosterheader, colour_prefs.bkgnd);
-    init_pair(46, colour_prefs.occupantsheader, colour_prefs.bkgnd);
+    _init_pair(45, colour_prefs.rosterheader, colour_prefs.bkgnd);
+    _init_pair(46, colour_prefs.occupantsheader, colour_prefs.bkgnd);
 
     // raw
-    init_pair(47, COLOR_WHITE, colour_prefs.bkgnd);
-    init_pair(48, COLOR_GREEN, colour_prefs.bkgnd);
-    init_pair(49, COLOR_RED, colour_prefs.bkgnd);
-    init_pair(50, COLOR_YELLOW, colour_prefs.bkgnd);
-    init_pair(51, COLOR_BLUE, colour_prefs.bkgnd);
-    init_pair(52, COLOR_CYAN, colour_prefs.bkgnd);
-    init_pair(53, COLOR_BLACK, colour_prefs.bkgnd);
-    init_pair(54, COLOR_MAGENTA, colour_prefs.bkgnd);
+    _init_pair(47, COLOR_WHITE, colour_prefs.bkgnd);
+    _init_pair(48, COLOR_GREEN, colour_prefs.bkgnd);
+    _init_pair(49, COLOR_RED, colour_prefs.bkgnd);
+    _init_pair(50, COLOR_YELLOW, colour_prefs.bkgnd);
+    _init_pair(51, COLOR_BLUE, colour_prefs.bkgnd);
+    _init_pair(52, COLOR_CYAN, colour_prefs.bkgnd);
+    _init_pair(53, COLOR_BLACK, colour_prefs.bkgnd);
+    _init_pair(54, COLOR_MAGENTA, colour_prefs.bkgnd);
+}
+
+// pairs already in use take their new colours in place on the next refresh
+static void
+_init_pair(short pair, NCURSES_COLOR_T fg, NCURSES_COLOR_T bg)
+{
+    if (pairs[pair].set && pairs[pair].fg == fg && pairs[pair].bg == bg) {
+        return;
+    }
+
+    init_pair(pair, fg, bg);
+    pairs[pair].set = TRUE;
+    pairs[pair].fg = fg;
+    pairs[pair].bg = bg;
 }
 
 static NCURSES_COLOR_T
@@ -341,6 +430,12 @@ _set_colour(char *setting, NCURSES_COLOR_T *pref, NCURSES_COLOR_T def, theme_ite
 static void
 _load_colours(void)
 {
+    if (current_theme->compiled) {
+        colour_prefs = current_theme->colours;
+        memcpy(item_attrs, current_theme->attrs, sizeof(item_attrs));
+        return;
+    }
+
     if (bold_items) {
         g_hash_table_destroy(bold_items);
     }
@@ -403,6 +498,24 @@ _load_colours(void)
     _set_colour("roster.header",            &colour_prefs.rosterheader,         COLOR_YELLOW,   THEME_ROSTER_HEADER);
     _set_colour("occupants.header",         &colour_prefs.occupantsheader,      COLOR_YELLOW,   THEME_OCCUPANTS_HEADER);
     _set_colour("receipt.sent",             &colour_prefs.receiptsent,          COLOR_RED,      THEME_RECEIPT_SENT);
+
+    _load_attrs();
+
+    current_theme->colours = colour_prefs;
+    memcpy(current_theme->attrs, item_attrs, sizeof(item_attrs));
+    current_theme->compiled = TRUE;
+}
+
+static void
+_load_attrs(void)
+{
+    int i = 0;
+    for (i = 0; i < THEME_ITEMS; i++) {
+        item_attrs[i] = _theme_colour_pair(i);
+        if (g_hash_table_lookup(bold_items, GINT_TO_POINTER(i))) {
+            item_attrs[i] |= A_BOLD;
+        }
+    }
 }
 
 static void
@@ -565,6 +678,16 @@ theme_main_presence_attrs(const char *const presence)
 
 int
 theme_attrs(theme_item_t attrs)
+{
+    if (attrs < 0 || attrs >= THEME_ITEMS) {
+        return 0;
+    }
+
+    return item_attrs[attrs];
+}
+
+static int
+_theme_colour_pair(theme_item_t attrs)
 {
     int result = 0;
 
@@ -634,10 +757,5 @@ theme_attrs(theme_item_t attrs)
     default:                            break;
     }
 
-    if (g_hash_table_lookup(bold_items, GINT_TO_POINTER(attrs))) {
-        return result | A_BOLD;
-    } else {
-        return result;
-
-    }
+    return result;
 }
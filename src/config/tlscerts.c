@@ -42,17 +42,30 @@
 #include "log.h"
 #include "common.h"
 #include "tools/autocomplete.h"
+#include "tools/watchdog.h"
 
 static gchar *tlscerts_loc;
 static GKeyFile *tlscerts;
 
+// set when tlscerts has changes not yet written, see tlscerts_flush
+static gboolean tlscerts_dirty;
+
 static gchar* _get_tlscerts_file(void);
 static void _save_tlscerts(void);
+static void _write_tlscerts(void);
 
 static Autocomplete certs_ac;
 
+// fingerprint to the TLSCertificate parsed from tlscerts, and the same
+// certificates in the order they appear there, both are owned by the store
+static GHashTable *certs;
+static GList *certs_list;
+
 static char *current_fp;
 
+static TLSCertificate* _tlscerts_load(const char *const fingerprint);
+static void _tlscerts_store(TLSCertificate *cert);
+
 void
 tlscerts_init(void)
 {
@@ -67,12 +80,15 @@ tlscerts_init(void)
     g_key_file_load_from_file(tlscerts, tlscerts_loc, G_KEY_FILE_KEEP_COMMENTS, NULL);
 
     certs_ac = autocomplete_new();
+    certs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)tlscerts_free);
+    certs_list = NULL;
     gsize len = 0;
     gchar **groups = g_key_file_get_groups(tlscerts, &len);
 
     int i = 0;
-    for (i = 0; i < g_strv_length(groups); i++) {
+    for (i = 0; i < len; i++) {
         autocomplete_add(certs_ac, groups[i]);
+        _tlscerts_store(_tlscerts_load(groups[i]));
     }
     g_strfreev(groups);
 
@@ -106,39 +122,15 @@ tlscerts_clear_current(void)
 gboolean
 tlscerts_exists(const char *const fingerprint)
 {
-    return g_key_file_has_group(tlscerts, fingerprint);
+    return g_hash_table_contains(certs, fingerprint);
 }
 
+// the list and its certificates belong to the store, valid until the next
+// tlscerts_add or tlscerts_revoke
 GList*
 tlscerts_list(void)
 {
-    GList *res = NULL;
-    gsize len = 0;
-    gchar **groups = g_key_file_get_groups(tlscerts, &len);
-
-    int i = 0;
-    for (i = 0; i < g_strv_length(groups); i++) {
-        char *fingerprint = strdup(groups[i]);
-        int version = g_key_file_get_integer(tlscerts, fingerprint, "version", NULL);
-        char *serialnumber = g_key_file_get_string(tlscerts, fingerprint, "serialnumber", NULL);
-        char *subjectname = g_key_file_get_string(tlscerts, fingerprint, "subjectname", NULL);
-        char *issuername = g_key_file_get_string(tlscerts, fingerprint, "issuername", NULL);
-        char *notbefore = g_key_file_get_string(tlscerts, fingerprint, "start", NULL);
-        char *notafter = g_key_file_get_string(tlscerts, fingerprint, "end", NULL);
-        char *keyalg = g_key_file_get_string(tlscerts, fingerprint, "keyalg", NULL);
-        char *signaturealg = g_key_file_get_string(tlscerts, fingerprint, "signaturealg", NULL);
-
-        TLSCertificate *cert = tlscerts_new(fingerprint, version, serialnumber, subjectname, issuername, notbefore,
-            notafter, keyalg, signaturealg);
-
-        res = g_list_append(res, cert);
-    }
-
-    if (groups) {
-        g_strfreev(groups);
-    }
-
-    return res;
+    return certs_list;
 }
 
 TLSCertificate*
@@ -289,6 +281,9 @@ tlscerts_add(TLSCertificate *cert)
 
     autocomplete_add(certs_ac, cert->fingerprint);
 
+    _tlscerts_store(tlscerts_new(cert->fingerprint, cert->version, cert->serialnumber, cert->subjectname,
+        cert->issuername, cert->notbefore, cert->notafter, cert->key_alg, cert->signature_alg));
+
     g_key_file_set_integer(tlscerts, cert->fingerprint, "version", cert->version);
     if (cert->serialnumber) {
         g_key_file_set_string(tlscerts, cert->fingerprint, "serialnumber", cert->serialnumber);
@@ -323,6 +318,12 @@ tlscerts_revoke(const char *const fingerprint)
         autocomplete_remove(certs_ac, fingerprint);
     }
 
+    TLSCertificate *cert = g_hash_table_lookup(certs, fingerprint);
+    if (cert) {
+        certs_list = g_list_remove(certs_list, cert);
+        g_hash_table_remove(certs, fingerprint);
+    }
+
     _save_tlscerts();
 
     return result;
@@ -372,21 +373,67 @@ tlscerts_free(TLSCertificate *cert)
 
         free(cert->key_alg);
         free(cert->signature_alg);
+
+        free(cert);
     }
 }
 
 void
 tlscerts_close(void)
 {
+    tlscerts_flush();
     g_key_file_free(tlscerts);
     tlscerts = NULL;
 
     free(current_fp);
     current_fp = NULL;
 
+    g_list_free(certs_list);
+    certs_list = NULL;
+    g_hash_table_destroy(certs);
+    certs = NULL;
+
     autocomplete_free(certs_ac);
 }
 
+static TLSCertificate*
+_tlscerts_load(const char *const fingerprint)
+{
+    int version = g_key_file_get_integer(tlscerts, fingerprint, "version", NULL);
+    char *serialnumber = g_key_file_get_string(tlscerts, fingerprint, "serialnumber", NULL);
+    char *subjectname = g_key_file_get_string(tlscerts, fingerprint, "subjectname", NULL);
+    char *issuername = g_key_file_get_string(tlscerts, fingerprint, "issuername", NULL);
+    char *notbefore = g_key_file_get_string(tlscerts, fingerprint, "start", NULL);
+    char *notafter = g_key_file_get_string(tlscerts, fingerprint, "end", NULL);
+    char *keyalg = g_key_file_get_string(tlscerts, fingerprint, "keyalg", NULL);
+    char *signaturealg = g_key_file_get_string(tlscerts, fingerprint, "signaturealg", NULL);
+
+    TLSCertificate *cert = tlscerts_new(fingerprint, version, serialnumber, subjectname, issuername, notbefore,
+        notafter, keyalg, signaturealg);
+
+    g_free(serialnumber);
+    g_free(subjectname);
+    g_free(issuername);
+    g_free(notbefore);
+    g_free(notafter);
+    g_free(keyalg);
+    g_free(signaturealg);
+
+    return cert;
+}
+
+// replaces any certificate already stored with the same fingerprint
+static void
+_tlscerts_store(TLSCertificate *cert)
+{
+    TLSCertificate *existing = g_hash_table_lookup(certs, cert->fingerprint);
+    if (existing) {
+        certs_list = g_list_remove(certs_list, existing);
+    }
+    certs_list = g_list_append(certs_list, cert);
+    g_hash_table_replace(certs, cert->fingerprint, cert);
+}
+
 static gchar*
 _get_tlscerts_file(void)
 {
@@ -400,11 +447,29 @@ _get_tlscerts_file(void)
     return result;
 }
 
+// writes are coalesced, the file is written by tlscerts_flush
 static void
 _save_tlscerts(void)
 {
+    tlscerts_dirty = TRUE;
+}
+
+void
+tlscerts_flush(void)
+{
+    if (tlscerts_dirty) {
+        _write_tlscerts();
+    }
+}
+
+static void
+_write_tlscerts(void)
+{
+    tlscerts_dirty = FALSE;
+
     gsize g_data_size;
     gchar *g_tlscerts_data = g_key_file_to_data(tlscerts, &g_data_size, NULL);
+    watchdog_tag(WATCHDOG_DISK);
     g_file_set_contents(tlscerts_loc, g_tlscerts_data, g_data_size, NULL);
     g_chmod(tlscerts_loc, S_IRUSR | S_IWUSR);
     g_free(g_tlscerts_data);
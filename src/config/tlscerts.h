@@ -90,5 +90,6 @@ char* tlscerts_complete(const char *const prefix);
 void tlscerts_reset_ac(void);
 
 void tlscerts_close(void);
+void tlscerts_flush(void);
 
 #endif
@@ -42,21 +42,37 @@
 #include "common.h"
 #include "resource.h"
 #include "tools/autocomplete.h"
+#include "tools/stats.h"
 
 struct p_contact_t {
     char *barejid;
     gchar *barejid_collate_key;
     char *name;
     gchar *name_collate_key;
+    // interned, like the subscription, group names are shared by many
+    // contacts
     GSList *groups;
-    char *subscription;
+    const char *subscription;
     char *offline_message;
     gboolean pending_out;
     GDateTime *last_activity;
-    GHashTable *available_resources;
+    // kept in order of availability, the first is the most available,
+    // created with the first resource and freed with the last, most
+    // contacts in a large roster are offline
+    GPtrArray *resources;
+    // only built once resources are completed for the contact
     Autocomplete resource_ac;
+    int version;
 };
 
+// taken from one counter so a contact rebuilt under the same jid never
+// reuses a version, see p_contact_version
+static int contact_versions = 0;
+
+static Resource* _most_available(PContact contact);
+static GSList* _groups_intern(GSList *groups);
+static int _resource_index(PContact contact, const char *const name);
+
 PContact
 p_contact_new(const char *const barejid, const char *const name,
     GSList *groups, const char *const subscription,
@@ -74,12 +90,12 @@ p_contact_new(const char *const barejid, const char *const name,
         contact->name_collate_key = NULL;
     }
 
-    contact->groups = groups;
+    contact->groups = _groups_intern(groups);
 
     if (subscription)
-        contact->subscription = strdup(subscription);
+        contact->subscription = str_intern(subscription);
     else
-        contact->subscription = strdup("none");
+        contact->subscription = str_intern("none");
 
     if (offline_message)
         contact->offline_message = strdup(offline_message);
@@ -89,10 +105,10 @@ p_contact_new(const char *const barejid, const char *const name,
     contact->pending_out = pending_out;
     contact->last_activity = NULL;
 
-    contact->available_resources = g_hash_table_new_full(g_str_hash, g_str_equal, free,
-        (GDestroyNotify)resource_destroy);
-
-    contact->resource_ac = autocomplete_new();
+    contact->resources = NULL;
+    contact->resource_ac = NULL;
+    stats_alloc(STATS_MEM_CONTACT, sizeof(struct p_contact_t) + strlen(contact->barejid) + 1);
+    contact->version = ++contact_versions;
 
     return contact;
 }
@@ -106,25 +122,46 @@ p_contact_set_name(const PContact contact, const char *const name)
         contact->name = strdup(name);
         contact->name_collate_key = g_utf8_collate_key(contact->name, -1);
     }
+    contact->version = ++contact_versions;
 }
 
 void
 p_contact_set_groups(const PContact contact, GSList *groups)
 {
     if (contact->groups) {
-        g_slist_free_full(contact->groups, g_free);
+        g_slist_free_full(contact->groups, (GDestroyNotify)str_unintern);
         contact->groups = NULL;
     }
 
-    contact->groups = groups;
+    contact->groups = _groups_intern(groups);
+}
+
+// the list is taken over, its names are swapped for interned ones
+static GSList*
+_groups_intern(GSList *groups)
+{
+    GSList *curr = groups;
+    while (curr) {
+        char *group = curr->data;
+        curr->data = (gpointer)str_intern(group);
+        g_free(group);
+        curr = g_slist_next(curr);
+    }
+
+    return groups;
 }
 
 gboolean
 p_contact_in_group(const PContact contact, const char *const group)
 {
+    const char *interned = str_interned(group);
+    if (interned == NULL) {
+        return FALSE;
+    }
+
     GSList *groups = contact->groups;
     while (groups) {
-        if (strcmp(groups->data, group) == 0) {
+        if (groups->data == interned) {
             return TRUE;
         }
         groups = g_slist_next(groups);
@@ -142,32 +179,47 @@ p_contact_groups(const PContact contact)
 gboolean
 p_contact_remove_resource(PContact contact, const char *const resource)
 {
-    gboolean result = g_hash_table_remove(contact->available_resources, resource);
-    autocomplete_remove(contact->resource_ac, resource);
+    int index = _resource_index(contact, resource);
+    if (index < 0) {
+        return FALSE;
+    }
 
-    return result;
+    if (contact->resource_ac) {
+        autocomplete_remove(contact->resource_ac, resource);
+    }
+    g_ptr_array_remove_index(contact->resources, index);
+    if (contact->resources->len == 0) {
+        g_ptr_array_free(contact->resources, TRUE);
+        contact->resources = NULL;
+    }
+    contact->version = ++contact_versions;
+
+    return TRUE;
 }
 
 void
 p_contact_free(PContact contact)
 {
     if (contact) {
+        stats_free(STATS_MEM_CONTACT, sizeof(struct p_contact_t) + strlen(contact->barejid) + 1);
         free(contact->barejid);
         free(contact->barejid_collate_key);
         free(contact->name);
         free(contact->name_collate_key);
-        free(contact->subscription);
         free(contact->offline_message);
 
         if (contact->groups) {
-            g_slist_free_full(contact->groups, g_free);
+            g_slist_free_full(contact->groups, (GDestroyNotify)str_unintern);
         }
+        str_unintern(contact->subscription);
 
         if (contact->last_activity) {
             g_date_time_unref(contact->last_activity);
         }
 
-        g_hash_table_destroy(contact->available_resources);
+        if (contact->resources) {
+            g_ptr_array_free(contact->resources, TRUE);
+        }
         autocomplete_free(contact->resource_ac);
         free(contact);
     }
@@ -230,61 +282,32 @@ p_contact_create_display_string(const PContact contact, const char *const resour
 }
 
 static Resource*
-_highest_presence(Resource *first, Resource *second)
-{
-    if (first->presence == RESOURCE_CHAT) {
-        return first;
-    } else if (second->presence == RESOURCE_CHAT) {
-        return second;
-    } else if (first->presence == RESOURCE_ONLINE) {
-        return first;
-    } else if (second->presence == RESOURCE_ONLINE) {
-        return second;
-    } else if (first->presence == RESOURCE_AWAY) {
-        return first;
-    } else if (second->presence == RESOURCE_AWAY) {
-        return second;
-    } else if (first->presence == RESOURCE_XA) {
-        return first;
-    } else if (second->presence == RESOURCE_XA) {
-        return second;
-    } else {
-        return first;
+_most_available(PContact contact)
+{
+    if (contact->resources == NULL) {
+        return NULL;
     }
-}
 
-Resource*
-_get_most_available_resource(PContact contact)
-{
-    // find resource with highest priority, if more than one,
-    // use highest availability, in the following order:
-    //      chat
-    //      online
-    //      away
-    //      xa
-    //      dnd
-    GList *resources = g_hash_table_get_values(contact->available_resources);
-    GList *curr = resources;
-    Resource *current = curr->data;
-    Resource *highest = current;
-    curr = g_list_next(curr);
-    while (curr) {
-        current = curr->data;
+    return g_ptr_array_index(contact->resources, 0);
+}
 
-        // priority is same as current highest, choose presence
-        if (current->priority == highest->priority) {
-            highest = _highest_presence(highest, current);
+// contacts have only a few resources, a scan is cheaper than a table
+static int
+_resource_index(PContact contact, const char *const name)
+{
+    if (contact->resources == NULL) {
+        return -1;
+    }
 
-        // priority higher than current highest, set new presence
-        } else if (current->priority > highest->priority) {
-            highest = current;
+    guint i;
+    for (i = 0; i < contact->resources->len; i++) {
+        Resource *resource = g_ptr_array_index(contact->resources, i);
+        if (g_strcmp0(resource->name, name) == 0) {
+            return i;
         }
-
-        curr = g_list_next(curr);
     }
-    g_list_free(resources);
 
-    return highest;
+    return -1;
 }
 
 const char*
@@ -293,13 +316,12 @@ p_contact_presence(const PContact contact)
     assert(contact != NULL);
 
     // no available resources, offline
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource *most_available = _most_available(contact);
+    if (most_available == NULL) {
         return "offline";
     }
 
-    Resource *resource = _get_most_available_resource(contact);
-
-    return string_from_resource_presence(resource->presence);
+    return string_from_resource_presence(most_available->presence);
 }
 
 const char*
@@ -308,13 +330,12 @@ p_contact_status(const PContact contact)
     assert(contact != NULL);
 
     // no available resources, use offline message
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource *most_available = _most_available(contact);
+    if (most_available == NULL) {
         return contact->offline_message;
     }
 
-    Resource *resource = _get_most_available_resource(contact);
-
-    return resource->status;
+    return most_available->status;
 }
 
 const char*
@@ -340,7 +361,12 @@ p_contact_subscribed(const PContact contact)
 Resource*
 p_contact_get_resource(const PContact contact, const char *const resource)
 {
-    return g_hash_table_lookup(contact->available_resources, resource);
+    int index = _resource_index(contact, resource);
+    if (index < 0) {
+        return NULL;
+    }
+
+    return g_ptr_array_index(contact->resources, index);
 }
 
 gboolean
@@ -355,35 +381,42 @@ p_contact_last_activity(const PContact contact)
     return contact->last_activity;
 }
 
-GList*
-p_contact_get_available_resources(const PContact contact)
+// the resources in order of availability, the contact must not change
+// while they are walked
+void
+p_contact_resource_iter_init(PContactResourceIter *iter, const PContact contact)
 {
     assert(contact != NULL);
-    GList *resources = g_hash_table_get_values(contact->available_resources);
-    GList *ordered = NULL;
-
-    GList *curr_resource = resources;
-    while (curr_resource) {
-        Resource *resource = curr_resource->data;
-        ordered = g_list_insert_sorted(ordered, resource, (GCompareFunc)resource_compare_availability);
-        curr_resource = g_list_next(curr_resource);
-    }
+    iter->resources = contact->resources;
+    iter->pos = 0;
+}
 
-    g_list_free(resources);
+guint
+p_contact_resource_count(const PContact contact)
+{
+    return contact->resources->len;
+}
 
-    return ordered;
+Resource*
+p_contact_resource_iter_next(PContactResourceIter *iter)
+{
+    if (iter->resources == NULL || iter->pos >= iter->resources->len) {
+        return NULL;
+    }
+
+    return g_ptr_array_index(iter->resources, iter->pos++);
 }
 
 gboolean
 p_contact_is_available(const PContact contact)
 {
     // no available resources, unavailable
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource *most_available = _most_available(contact);
+    if (most_available == NULL) {
         return FALSE;
     }
 
     // if most available resource is CHAT or ONLINE, available
-    Resource *most_available = _get_most_available_resource(contact);
     if ((most_available->presence == RESOURCE_ONLINE) ||
         (most_available->presence == RESOURCE_CHAT)) {
         return TRUE;
@@ -395,23 +428,52 @@ p_contact_is_available(const PContact contact)
 gboolean
 p_contact_has_available_resource(const PContact contact)
 {
-    return (g_hash_table_size(contact->available_resources) > 0);
+    return contact->resources != NULL;
 }
 
 void
 p_contact_set_presence(const PContact contact, Resource *resource)
 {
-    g_hash_table_replace(contact->available_resources, strdup(resource->name), resource);
-    autocomplete_add(contact->resource_ac, resource->name);
+    if (contact->resources == NULL) {
+        contact->resources = g_ptr_array_new_with_free_func((GDestroyNotify)resource_destroy);
+    }
+
+    int index = _resource_index(contact, resource->name);
+    if (index >= 0) {
+        g_ptr_array_remove_index(contact->resources, index);
+    }
+
+    // kept sorted here so showing the resources never sorts them, equally
+    // available resources stay in the order they arrived
+    guint pos = 0;
+    while (pos < contact->resources->len &&
+            resource_compare_availability(g_ptr_array_index(contact->resources, pos), resource) <= 0) {
+        pos++;
+    }
+    g_ptr_array_add(contact->resources, NULL);
+    memmove(&contact->resources->pdata[pos + 1], &contact->resources->pdata[pos],
+        (contact->resources->len - pos - 1) * sizeof(gpointer));
+    contact->resources->pdata[pos] = resource;
+
+    if (contact->resource_ac) {
+        autocomplete_add(contact->resource_ac, resource->name);
+    }
+    contact->version = ++contact_versions;
+}
+
+// changes whenever the name, presence or resources of the contact change
+int
+p_contact_version(const PContact contact)
+{
+    return contact->version;
 }
 
 void
 p_contact_set_subscription(const PContact contact, const char *const subscription)
 {
-    FREE_SET_NULL(contact->subscription);
-    if (subscription) {
-        contact->subscription = strdup(subscription);
-    }
+    const char *previous = contact->subscription;
+    contact->subscription = str_intern(subscription);
+    str_unintern(previous);
 }
 
 void
@@ -436,11 +498,23 @@ p_contact_set_last_activity(const PContact contact, GDateTime *last_activity)
 Autocomplete
 p_contact_resource_ac(const PContact contact)
 {
+    if (contact->resource_ac == NULL) {
+        contact->resource_ac = autocomplete_new();
+        PContactResourceIter iter;
+        p_contact_resource_iter_init(&iter, contact);
+        Resource *resource;
+        while ((resource = p_contact_resource_iter_next(&iter))) {
+            autocomplete_add(contact->resource_ac, resource->name);
+        }
+    }
+
     return contact->resource_ac;
 }
 
 void
 p_contact_resource_ac_reset(const PContact contact)
 {
-    autocomplete_reset(contact->resource_ac);
+    if (contact->resource_ac) {
+        autocomplete_reset(contact->resource_ac);
+    }
 }
@@ -40,6 +40,11 @@
 
 typedef struct p_contact_t *PContact;
 
+typedef struct p_contact_resource_iter_t {
+    GPtrArray *resources;
+    guint pos;
+} PContactResourceIter;
+
 PContact p_contact_new(const char *const barejid, const char *const name, GSList *groups,
     const char *const subscription, const char *const offline_message, gboolean pending_out);
 void p_contact_add_resource(PContact contact, Resource *resource);
@@ -53,7 +58,9 @@ const char* p_contact_name_or_jid(const PContact contact);
 const char* p_contact_presence(PContact contact);
 const char* p_contact_status(PContact contact);
 const char* p_contact_subscription(const PContact contact);
-GList* p_contact_get_available_resources(const PContact contact);
+void p_contact_resource_iter_init(PContactResourceIter *iter, const PContact contact);
+Resource* p_contact_resource_iter_next(PContactResourceIter *iter);
+guint p_contact_resource_count(const PContact contact);
 GDateTime* p_contact_last_activity(const PContact contact);
 gboolean p_contact_pending_out(const PContact contact);
 void p_contact_set_presence(const PContact contact, Resource *resource);
@@ -72,5 +79,6 @@ gboolean p_contact_subscribed(const PContact contact);
 char* p_contact_create_display_string(const PContact contact, const char *const resource);
 Autocomplete p_contact_resource_ac(const PContact contact);
 void p_contact_resource_ac_reset(const PContact contact);
+int p_contact_version(const PContact contact);
 
 #endif
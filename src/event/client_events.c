@@ -37,10 +37,13 @@
 #include <stdlib.h>
 #include <glib.h>
 
+#include "common.h"
 #include "log.h"
+#include "config/outbox.h"
 #include "ui/ui.h"
 #include "window_list.h"
 #include "xmpp/xmpp.h"
+#include "roster_list.h"
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
 #endif
@@ -48,10 +51,30 @@
 #include "pgp/gpg.h"
 #endif
 
+// read and resolve the account's keys on worker threads while the
+// connection is being made, the login handlers collect them
+static void
+_cl_ev_preload(const char *const barejid)
+{
+#ifdef HAVE_LIBOTR
+    otr_preload(barejid);
+#endif
+#ifdef HAVE_LIBGPGME
+    p_gpg_preload(barejid);
+#endif
+}
+
 jabber_conn_status_t
 cl_ev_connect_jid(const char *const jid, const char *const passwd, const char *const altdomain, const int port, const char *const tls_policy)
 {
     cons_show("Connecting as %s", jid);
+
+    Jid *jidp = jid_create(jid);
+    if (jidp) {
+        _cl_ev_preload(jidp->barejid);
+        jid_destroy(jidp);
+    }
+
     return jabber_connect_with_details(jid, passwd, altdomain, port, tls_policy);
 }
 
@@ -62,6 +85,8 @@ cl_ev_connect_account(ProfAccount *account)
     cons_show("Connecting with account %s as %s", account->name, jid);
     free(jid);
 
+    _cl_ev_preload(account->jid);
+
     return jabber_connect_with_account(account);
 }
 
@@ -72,11 +97,10 @@ cl_ev_presence_send(const resource_presence_t presence_type, const char *const m
 
 #ifdef HAVE_LIBGPGME
     char *account_name = jabber_get_account_name();
-    ProfAccount *account = accounts_get_account(account_name);
+    const ProfAccount *account = accounts_peek_account(account_name);
     if (account->pgp_keyid) {
         signed_status = p_gpg_sign(msg, account->pgp_keyid);
     }
-    account_free(account);
 #endif
 
     presence_send(presence_type, msg, idle_secs, signed_status);
@@ -84,24 +108,60 @@ cl_ev_presence_send(const resource_presence_t presence_type, const char *const m
     free(signed_status);
 }
 
+// queued messages are sent as plaintext, so none that must be encrypted
+gboolean
+cl_ev_can_queue_msg(const char *const barejid)
+{
+    ProfChatWin *chatwin = wins_get_chat(barejid);
+    if (chatwin && (chatwin->is_otr || chatwin->pgp_send)) {
+        return FALSE;
+    }
+
+#ifdef HAVE_LIBOTR
+    if (otr_get_policy(barejid) == PROF_OTRPOLICY_ALWAYS) {
+        return FALSE;
+    }
+#endif
+
+    return TRUE;
+}
+
+// connection lost while waiting to reconnect, the message is stored and
+// sent after the next login
+void
+cl_ev_queue_msg(ProfChatWin *chatwin, const char *const msg)
+{
+    char *id = create_unique_id("msg");
+    outbox_add(jabber_get_account_name(), chatwin->barejid, id, msg);
+    chat_log_msg_out(chatwin->barejid, msg, id);
+    chatwin_outgoing_queued(chatwin, msg, id);
+    free(id);
+}
+
 void
 cl_ev_send_msg(ProfChatWin *chatwin, const char *const msg)
 {
     chat_state_active(chatwin->state);
+    roster_touch(chatwin->barejid);
 
 // OTR suported, PGP supported
 #ifdef HAVE_LIBOTR
 #ifdef HAVE_LIBGPGME
     if (chatwin->pgp_send) {
-        char *id = message_send_chat_pgp(chatwin->barejid, msg);
-        chat_log_pgp_msg_out(chatwin->barejid, msg);
-        chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PGP);
+        gboolean pending = FALSE;
+        char *id = message_send_chat_pgp(chatwin->barejid, msg, &pending);
+        if (pending) {
+            chatwin_outgoing_pending(chatwin, msg, id, PROF_MSG_PGP);
+        } else {
+            chat_log_pgp_msg_out(chatwin->barejid, msg, id);
+            chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PGP);
+        }
         free(id);
     } else {
         gboolean handled = otr_on_message_send(chatwin, msg);
         if (!handled) {
             char *id = message_send_chat(chatwin->barejid, msg);
-            chat_log_msg_out(chatwin->barejid, msg);
+            chat_log_msg_out(chatwin->barejid, msg, id);
             chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PLAIN);
             free(id);
         }
@@ -116,7 +176,7 @@ cl_ev_send_msg(ProfChatWin *chatwin, const char *const msg)
     gboolean handled = otr_on_message_send(chatwin, msg);
     if (!handled) {
         char *id = message_send_chat(chatwin->barejid, msg);
-        chat_log_msg_out(chatwin->barejid, msg);
+        chat_log_msg_out(chatwin->barejid, msg, id);
         chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PLAIN);
         free(id);
     }
@@ -128,13 +188,18 @@ cl_ev_send_msg(ProfChatWin *chatwin, const char *const msg)
 #ifndef HAVE_LIBOTR
 #ifdef HAVE_LIBGPGME
     if (chatwin->pgp_send) {
-        char *id = message_send_chat_pgp(chatwin->barejid, msg);
-        chat_log_pgp_msg_out(chatwin->barejid, msg);
-        chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PGP);
+        gboolean pending = FALSE;
+        char *id = message_send_chat_pgp(chatwin->barejid, msg, &pending);
+        if (pending) {
+            chatwin_outgoing_pending(chatwin, msg, id, PROF_MSG_PGP);
+        } else {
+            chat_log_pgp_msg_out(chatwin->barejid, msg, id);
+            chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PGP);
+        }
         free(id);
     } else {
         char *id = message_send_chat(chatwin->barejid, msg);
-        chat_log_msg_out(chatwin->barejid, msg);
+        chat_log_msg_out(chatwin->barejid, msg, id);
         chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PLAIN);
         free(id);
     }
@@ -146,7 +211,7 @@ cl_ev_send_msg(ProfChatWin *chatwin, const char *const msg)
 #ifndef HAVE_LIBOTR
 #ifndef HAVE_LIBGPGME
     char *id = message_send_chat(chatwin->barejid, msg);
-    chat_log_msg_out(chatwin->barejid, msg);
+    chat_log_msg_out(chatwin->barejid, msg, id);
     chatwin_outgoing_msg(chatwin, msg, id, PROF_MSG_PLAIN);
     free(id);
     return;
@@ -158,6 +223,7 @@ void
 cl_ev_send_muc_msg(ProfMucWin *mucwin, const char *const msg)
 {
     message_send_groupchat(mucwin->roomjid, msg);
+    bookmark_touch(mucwin->roomjid);
 }
 
 void
@@ -41,6 +41,8 @@ jabber_conn_status_t cl_ev_connect_account(ProfAccount *account);
 void cl_ev_presence_send(const resource_presence_t presence_type, const char *const msg, const int idle_secs);
 
 void cl_ev_send_msg(ProfChatWin *chatwin, const char *const msg);
+gboolean cl_ev_can_queue_msg(const char *const barejid);
+void cl_ev_queue_msg(ProfChatWin *chatwin, const char *const msg);
 void cl_ev_send_muc_msg(ProfMucWin *mucwin, const char *const msg);
 void cl_ev_send_priv_msg(ProfPrivateWin *privwin, const char *const msg);
 
@@ -44,10 +44,13 @@
 #include "config/preferences.h"
 #include "config/account.h"
 #include "config/scripts.h"
+#include "config/outbox.h"
 #include "roster_list.h"
 #include "window_list.h"
 #include "config/tlscerts.h"
 #include "profanity.h"
+#include "event/client_events.h"
+#include "tools/ipc.h"
 
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
@@ -58,6 +61,150 @@
 
 #include "ui/ui.h"
 
+// repeated typing notifications from a contact within this many seconds
+// are only shown once, less than the time the title bar shows typing for
+#define TYPING_COALESCE 5
+
+// autojoined rooms whose join completed since the last summary
+static GSList *autojoined = NULL;
+
+// barejid to when typing was last shown for that contact
+static GHashTable *typing_shown = NULL;
+
+// a contact's resource changing presence, shown by sv_ev_flush
+typedef enum {
+    PRESENCE_EV_ONLINE,
+    PRESENCE_EV_OFFLINE
+} presence_ev_t;
+
+typedef struct presence_event_t {
+    presence_ev_t type;
+    char *barejid;
+    char *resource;
+    char *status;
+} PresenceEvent;
+
+// presence events in the order first seen, with "barejid/resource" to
+// the queued event so a later change replaces it
+static GQueue *presence_events = NULL;
+static GHashTable *presence_pending = NULL;
+
+static void
+_sv_ev_presence_event_free(PresenceEvent *event)
+{
+    free(event->barejid);
+    free(event->resource);
+    free(event->status);
+    free(event);
+}
+
+static void
+_sv_ev_presence_queue(presence_ev_t type, const char *const barejid, const char *const resource,
+    const char *const status)
+{
+    if (presence_events == NULL) {
+        presence_events = g_queue_new();
+        presence_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    gchar *key = g_strdup_printf("%s/%s", barejid, resource);
+    PresenceEvent *event = g_hash_table_lookup(presence_pending, key);
+    if (event) {
+        g_free(key);
+        free(event->status);
+    } else {
+        event = malloc(sizeof(PresenceEvent));
+        event->barejid = strdup(barejid);
+        event->resource = strdup(resource);
+        g_queue_push_tail(presence_events, event);
+        g_hash_table_insert(presence_pending, key, event);
+    }
+    event->type = type;
+    event->status = status ? strdup(status) : NULL;
+}
+
+static gboolean
+_sv_ev_typing_due(const char *const barejid)
+{
+    if (typing_shown == NULL) {
+        typing_shown = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 *shown = g_hash_table_lookup(typing_shown, barejid);
+    if (shown && now - *shown < TYPING_COALESCE * G_USEC_PER_SEC) {
+        return FALSE;
+    }
+
+    if (shown == NULL) {
+        shown = malloc(sizeof(gint64));
+        g_hash_table_insert(typing_shown, strdup(barejid), shown);
+    }
+    *shown = now;
+
+    return TRUE;
+}
+
+// the contact has moved on, so the next typing notification is shown
+static void
+_sv_ev_typing_reset(const char *const barejid)
+{
+    if (typing_shown && barejid) {
+        g_hash_table_remove(typing_shown, barejid);
+    }
+}
+
+// room is NULL when a join failed, one summary is shown once no
+// autojoined room is still waiting
+static void
+_sv_ev_autojoin_complete(const char *const room)
+{
+    if (room) {
+        autojoined = g_slist_append(autojoined, strdup(room));
+    }
+    if (autojoined && muc_autojoin_pending() == 0) {
+        ui_rooms_autojoined(autojoined);
+        g_slist_free_full(autojoined, free);
+        autojoined = NULL;
+    }
+}
+
+// messages written while disconnected, sent together in order
+static void
+_send_queued_messages(const char *const account_name)
+{
+    GSList *queued = outbox_take(account_name);
+    if (queued) {
+        log_info("Sending %d queued messages", g_slist_length(queued));
+    }
+
+    GSList *curr = queued;
+    while (curr) {
+        OutboxMessage *message = curr->data;
+        ProfChatWin *chatwin = wins_get_chat(message->barejid);
+
+        // encryption may have been switched on since it was queued
+        if (!cl_ev_can_queue_msg(message->barejid)) {
+            log_warning("Dropped queued message for %s, it must be encrypted", message->barejid);
+            if (chatwin) {
+                win_vprint((ProfWin*)chatwin, '!', 0, NULL, 0, THEME_ERROR, "",
+                    "Queued message not sent, it must be encrypted: %s", message->message);
+            }
+            curr = g_slist_next(curr);
+            continue;
+        }
+
+        message_send_chat_with_id(message->barejid, message->message, message->id);
+
+        // without receipts or markers there is nothing more to wait for
+        if (chatwin && !prefs_get_boolean(PREF_RECEIPTS_REQUEST) && !prefs_get_boolean(PREF_CHAT_MARKERS)) {
+            chatwin_receipt_received(chatwin, message->id);
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(queued, (GDestroyNotify)outbox_message_free);
+}
+
 void
 sv_ev_login_account_success(char *account_name, int secured)
 {
@@ -72,6 +219,7 @@ sv_ev_login_account_success(char *account_name, int secured)
 #endif
 
     ui_handle_login_account_success(account, secured);
+    snapshot_restore(account_name);
 
     // attempt to rejoin rooms with passwords
     GList *curr = muc_rooms();
@@ -87,6 +235,8 @@ sv_ev_login_account_success(char *account_name, int secured)
 
     log_info("%s logged in successfully", account->jid);
 
+    _send_queued_messages(account_name);
+
     if (account->startscript) {
         scripts_exec(account->startscript);
     }
@@ -97,18 +247,49 @@ sv_ev_login_account_success(char *account_name, int secured)
 void
 sv_ev_roster_received(void)
 {
+    roster_set_received();
+
     if (prefs_get_boolean(PREF_ROSTER)) {
         ui_show_roster();
     }
 }
 
+// show the presence changes queued since the last call, only the latest
+// for each resource, the roster itself is already up to date
+void
+sv_ev_flush(void)
+{
+    if (presence_events == NULL || g_queue_is_empty(presence_events)) {
+        return;
+    }
+
+    PresenceEvent *event = NULL;
+    while ((event = g_queue_pop_head(presence_events))) {
+        PContact contact = roster_get_contact(event->barejid);
+        if (contact && event->type == PRESENCE_EV_ONLINE) {
+            Resource *resource = p_contact_get_resource(contact, event->resource);
+            if (resource) {
+                ui_contact_online(event->barejid, resource, p_contact_last_activity(contact));
+            }
+        } else if (contact) {
+            ui_contact_offline(event->barejid, event->resource, event->status);
+        }
+        _sv_ev_presence_event_free(event);
+    }
+    g_hash_table_remove_all(presence_pending);
+}
+
 void
 sv_ev_lost_connection(void)
 {
+    sv_ev_flush();
     cons_show_error("Lost connection.");
     roster_clear();
     muc_invites_clear();
     chat_sessions_clear();
+    if (typing_shown) {
+        g_hash_table_remove_all(typing_shown);
+    }
     ui_disconnected();
 #ifdef HAVE_LIBGPGME
     p_gpg_on_disconnect();
@@ -167,6 +348,25 @@ sv_ev_room_history(const char *const room_jid, const char *const nick,
     }
 }
 
+// returns how many of the messages, newest first, the window took
+int
+sv_ev_history_page(const char *const barejid, gboolean muc, GSList *messages)
+{
+    if (muc) {
+        ProfMucWin *mucwin = wins_get_muc(barejid);
+        if (mucwin) {
+            return mucwin_history_page(mucwin, messages);
+        }
+    } else {
+        ProfChatWin *chatwin = wins_get_chat(barejid);
+        if (chatwin) {
+            return chatwin_history_page(chatwin, messages);
+        }
+    }
+
+    return 0;
+}
+
 void
 sv_ev_room_message(const char *const room_jid, const char *const nick,
     const char *const message)
@@ -175,11 +375,12 @@ sv_ev_room_message(const char *const room_jid, const char *const nick,
     if (mucwin) {
         mucwin_message(mucwin, nick, message);
     }
+    muc_nick_touch(room_jid, nick);
+    ipc_emit(IPC_MUC, "room_message", "room", room_jid, "nick", nick, "body", message, NULL);
 
-    if (prefs_get_boolean(PREF_GRLOG)) {
-        Jid *jid = jid_create(jabber_get_fulljid());
+    const Jid *jid = jabber_get_jid();
+    if (prefs_get_boolean(PREF_GRLOG) && jid) {
         groupchat_log_chat(jid->barejid, room_jid, nick, message);
-        jid_destroy(jid);
     }
 }
 
@@ -192,6 +393,7 @@ sv_ev_incoming_private_message(const char *const fulljid, char *message)
         privatewin = (ProfPrivateWin*)window;
     }
     privwin_incoming_msg(privatewin, message, NULL);
+    ipc_emit(IPC_MESSAGE, "private", "from", fulljid, "body", message, NULL);
 }
 
 void
@@ -214,6 +416,7 @@ sv_ev_outgoing_carbon(char *barejid, char *message)
     }
 
     chat_state_active(chatwin->state);
+    roster_touch(barejid);
 
     chatwin_outgoing_carbon(chatwin, message);
 }
@@ -221,6 +424,7 @@ sv_ev_outgoing_carbon(char *barejid, char *message)
 void
 sv_ev_incoming_carbon(char *barejid, char *resource, char *message)
 {
+    sv_ev_flush();
     gboolean new_win = FALSE;
     ProfChatWin *chatwin = wins_get_chat(barejid);
     if (!chatwin) {
@@ -231,6 +435,8 @@ sv_ev_incoming_carbon(char *barejid, char *resource, char *message)
 
     chatwin_incoming_msg(chatwin, resource, message, NULL, new_win, PROF_MSG_PLAIN);
     chat_log_msg_in(barejid, message, NULL);
+    ipc_emit(IPC_MESSAGE, "chat", "from", barejid, "resource", resource, "body", message, NULL);
+    roster_touch(barejid);
 }
 
 #ifdef HAVE_LIBGPGME
@@ -241,11 +447,14 @@ _sv_ev_incoming_pgp(ProfChatWin *chatwin, gboolean new_win, char *barejid, char
     if (decrypted) {
         chatwin_incoming_msg(chatwin, resource, decrypted, timestamp, new_win, PROF_MSG_PGP);
         chat_log_pgp_msg_in(barejid, decrypted, timestamp);
+        ipc_emit(IPC_MESSAGE, "chat", "from", barejid, "resource", resource, "body", decrypted,
+            "encryption", "pgp", NULL);
         chatwin->pgp_recv = TRUE;
         p_gpg_free_decrypted(decrypted);
     } else {
         chatwin_incoming_msg(chatwin, resource, message, timestamp, new_win, PROF_MSG_PLAIN);
         chat_log_msg_in(barejid, message, timestamp);
+        ipc_emit(IPC_MESSAGE, "chat", "from", barejid, "resource", resource, "body", message, NULL);
         chatwin->pgp_recv = FALSE;
     }
 }
@@ -265,6 +474,8 @@ _sv_ev_incoming_otr(ProfChatWin *chatwin, gboolean new_win, char *barejid, char
             chatwin_incoming_msg(chatwin, resource, otr_res, timestamp, new_win, PROF_MSG_PLAIN);
         }
         chat_log_otr_msg_in(barejid, otr_res, decrypted, timestamp);
+        ipc_emit(IPC_MESSAGE, "chat", "from", barejid, "resource", resource, "body", otr_res,
+            "encryption", decrypted ? "otr" : NULL, NULL);
         otr_free_message(otr_res);
         chatwin->pgp_recv = FALSE;
     }
@@ -277,6 +488,7 @@ _sv_ev_incoming_plain(ProfChatWin *chatwin, gboolean new_win, char *barejid, cha
 {
     chatwin_incoming_msg(chatwin, resource, message, timestamp, new_win, PROF_MSG_PLAIN);
     chat_log_msg_in(barejid, message, timestamp);
+    ipc_emit(IPC_MESSAGE, "chat", "from", barejid, "resource", resource, "body", message, NULL);
     chatwin->pgp_recv = FALSE;
 }
 #endif
@@ -284,6 +496,8 @@ _sv_ev_incoming_plain(ProfChatWin *chatwin, gboolean new_win, char *barejid, cha
 void
 sv_ev_incoming_message(char *barejid, char *resource, char *message, char *pgp_message, GDateTime *timestamp)
 {
+    // presence shown before the message that followed it
+    sv_ev_flush();
     gboolean new_win = FALSE;
     ProfChatWin *chatwin = wins_get_chat(barejid);
     if (!chatwin) {
@@ -291,6 +505,8 @@ sv_ev_incoming_message(char *barejid, char *resource, char *message, char *pgp_m
         chatwin = (ProfChatWin*)window;
         new_win = TRUE;
     }
+    roster_touch(barejid);
+    _sv_ev_typing_reset(barejid);
 
 // OTR suported, PGP supported
 #ifdef HAVE_LIBOTR
@@ -340,6 +556,48 @@ sv_ev_incoming_message(char *barejid, char *resource, char *message, char *pgp_m
 void
 sv_ev_message_receipt(char *barejid, char *id)
 {
+    chat_log_receipt(barejid, id);
+
+    ProfChatWin *chatwin = wins_get_chat(barejid);
+    if (!chatwin)
+        return;
+
+    chatwin_receipt_received(chatwin, id);
+}
+
+// only the marked message is logged as received, earlier ones are only
+// shown as received
+void
+sv_ev_message_marker(char *barejid, char *id)
+{
+    chat_log_receipt(barejid, id);
+
+    ProfChatWin *chatwin = wins_get_chat(barejid);
+    if (!chatwin)
+        return;
+
+    chatwin_marker_received(chatwin, id);
+}
+
+void
+sv_ev_message_markable(char *barejid, char *fulljid, char *id)
+{
+    ProfChatWin *chatwin = wins_get_chat(barejid);
+    if (!chatwin)
+        return;
+
+    chatwin_markable(chatwin, fulljid, id);
+}
+
+// a message held back before sending, while it was encrypted, has gone
+// out, unless a receipt or marker was asked for that is all there is to show
+void
+sv_ev_message_sent(const char *const barejid, const char *const id)
+{
+    if (prefs_get_boolean(PREF_RECEIPTS_REQUEST) || prefs_get_boolean(PREF_CHAT_MARKERS)) {
+        return;
+    }
+
     ProfChatWin *chatwin = wins_get_chat(barejid);
     if (!chatwin)
         return;
@@ -347,10 +605,32 @@ sv_ev_message_receipt(char *barejid, char *id)
     chatwin_receipt_received(chatwin, id);
 }
 
+// a PGP message is only logged once a worker has encrypted it and it has
+// gone out
+void
+sv_ev_outgoing_pgp_sent(const char *const barejid, const char *const message, const char *const id)
+{
+    chat_log_pgp_msg_out(barejid, message, id);
+    sv_ev_message_sent(barejid, id);
+}
+
+void
+sv_ev_outgoing_pgp_failed(const char *const barejid, const char *const id)
+{
+    ProfChatWin *chatwin = wins_get_chat(barejid);
+    if (!chatwin)
+        return;
+
+    win_vprint((ProfWin*)chatwin, '!', 0, NULL, 0, THEME_ERROR, "", "%s",
+        "PGP encryption failed, the message above was not sent.");
+}
+
 void
 sv_ev_typing(char *barejid, char *resource)
 {
-    ui_contact_typing(barejid, resource);
+    if (_sv_ev_typing_due(barejid)) {
+        ui_contact_typing(barejid, resource);
+    }
     if (wins_chat_exists(barejid)) {
         chat_session_recipient_typing(barejid, resource);
     }
@@ -359,6 +639,7 @@ sv_ev_typing(char *barejid, char *resource)
 void
 sv_ev_paused(char *barejid, char *resource)
 {
+    _sv_ev_typing_reset(barejid);
     if (wins_chat_exists(barejid)) {
         chat_session_recipient_paused(barejid, resource);
     }
@@ -367,6 +648,7 @@ sv_ev_paused(char *barejid, char *resource)
 void
 sv_ev_inactive(char *barejid, char *resource)
 {
+    _sv_ev_typing_reset(barejid);
     if (wins_chat_exists(barejid)) {
         chat_session_recipient_inactive(barejid, resource);
     }
@@ -375,6 +657,7 @@ sv_ev_inactive(char *barejid, char *resource)
 void
 sv_ev_gone(const char *const barejid, const char *const resource)
 {
+    _sv_ev_typing_reset(barejid);
     if (barejid && resource) {
         gboolean show_message = TRUE;
 
@@ -438,7 +721,8 @@ sv_ev_contact_offline(char *barejid, char *resource, char *status)
     gboolean updated = roster_contact_offline(barejid, resource, status);
 
     if (resource && updated) {
-        ui_contact_offline(barejid, resource, status);
+        _sv_ev_presence_queue(PRESENCE_EV_OFFLINE, barejid, resource, status);
+        ipc_emit(IPC_PRESENCE, "offline", "jid", barejid, "resource", resource, "status", status, NULL);
     }
 
     rosterwin_roster();
@@ -451,7 +735,9 @@ sv_ev_contact_online(char *barejid, Resource *resource, GDateTime *last_activity
     gboolean updated = roster_update_presence(barejid, resource, last_activity);
 
     if (updated) {
-        ui_contact_online(barejid, resource, last_activity);
+        _sv_ev_presence_queue(PRESENCE_EV_ONLINE, barejid, resource->name, NULL);
+        ipc_emit(IPC_PRESENCE, "online", "jid", barejid, "resource", resource->name,
+            "show", string_from_resource_presence(resource->presence), "status", resource->status, NULL);
     }
 
 #ifdef HAVE_LIBGPGME
@@ -471,6 +757,16 @@ sv_ev_leave_room(const char *const room)
     ui_leave_room(room);
 }
 
+void
+sv_ev_room_join_error(const char *const room, const char *const err)
+{
+    if (muc_active(room)) {
+        muc_leave(room);
+    }
+    cons_show_error("Error joining room %s, reason: %s", room, err);
+    _sv_ev_autojoin_complete(NULL);
+}
+
 void
 sv_ev_room_destroy(const char *const room)
 {
@@ -505,6 +801,7 @@ sv_ev_room_occupant_offline(const char *const room, const char *const nick,
     const char *const show, const char *const status)
 {
     muc_roster_remove(room, nick);
+    ipc_emit(IPC_MUC, "occupant_offline", "room", room, "nick", nick, NULL);
 
     char *muc_status_pref = prefs_get_string(PREF_STATUSES_MUC);
     ProfMucWin *mucwin = wins_get_muc(room);
@@ -548,11 +845,11 @@ sv_ev_roster_update(const char *const barejid, const char *const name,
 }
 
 void
-sv_ev_xmpp_stanza(const char *const msg)
+sv_ev_xmpp_stanza(traffic_dir_t dir, const char *const text)
 {
     ProfXMLWin *xmlwin = wins_get_xmlconsole();
     if (xmlwin) {
-        xmlwin_show(xmlwin, msg);
+        xmlwin_show(xmlwin, dir == TRAFFIC_SENT, text);
     }
 }
 
@@ -577,11 +874,8 @@ sv_ev_muc_self_online(const char *const room, const char *const nick, gboolean c
 
     // handle roster complete
     } else if (!muc_roster_complete(room)) {
-        if (muc_autojoin(room)) {
-            ui_room_join(room, FALSE);
-        } else {
-            ui_room_join(room, TRUE);
-        }
+        gboolean autojoin = muc_autojoin(room);
+        ui_room_join(room, !autojoin);
 
         iq_room_info_request(room, FALSE);
 
@@ -618,6 +912,10 @@ sv_ev_muc_self_online(const char *const room, const char *const nick, gboolean c
             }
         }
 
+        if (autojoin) {
+            _sv_ev_autojoin_complete(room);
+        }
+
     // check for change in role/affiliation
     } else {
         ProfMucWin *mucwin = wins_get_muc(room);
@@ -675,6 +973,8 @@ sv_ev_muc_occupant_online(const char *const room, const char *const nick, const
 
     // joined room
     if (!occupant) {
+        ipc_emit(IPC_MUC, "occupant_online", "room", room, "nick", nick, "jid", jid, "role", role,
+            "affiliation", affiliation, NULL);
         char *muc_status_pref = prefs_get_string(PREF_STATUSES_MUC);
         ProfMucWin *mucwin = wins_get_muc(room);
         if (mucwin && g_strcmp0(muc_status_pref, "none") != 0) {
@@ -38,6 +38,7 @@
 #include "xmpp/xmpp.h"
 
 void sv_ev_login_account_success(char *account_name, int secured);
+void sv_ev_flush(void);
 void sv_ev_lost_connection(void);
 void sv_ev_failed_login(void);
 void sv_ev_room_invite(jabber_invite_t invite_type,
@@ -47,6 +48,7 @@ void sv_ev_room_broadcast(const char *const room_jid, const char *const message)
 void sv_ev_room_subject(const char *const room, const char *const nick, const char *const subject);
 void sv_ev_room_history(const char *const room_jid, const char *const nick,
     GDateTime *timestamp, const char *const message);
+int sv_ev_history_page(const char *const barejid, gboolean muc, GSList *messages);
 void sv_ev_room_message(const char *const room_jid, const char *const nick,
     const char *const message);
 void sv_ev_incoming_message(char *barejid, char *resource, char *message, char *pgp_message, GDateTime *timestamp);
@@ -59,9 +61,15 @@ void sv_ev_activity(char *barejid, char *resource, gboolean send_states);
 void sv_ev_gone(const char *const barejid, const char *const resource);
 void sv_ev_subscription(const char *from, jabber_subscr_t type);
 void sv_ev_message_receipt(char *barejid, char *id);
+void sv_ev_message_marker(char *barejid, char *id);
+void sv_ev_message_markable(char *barejid, char *fulljid, char *id);
+void sv_ev_message_sent(const char *const barejid, const char *const id);
+void sv_ev_outgoing_pgp_sent(const char *const barejid, const char *const message, const char *const id);
+void sv_ev_outgoing_pgp_failed(const char *const barejid, const char *const id);
 void sv_ev_contact_offline(char *contact, char *resource, char *status);
 void sv_ev_contact_online(char *contact, Resource *resource, GDateTime *last_activity, char *pgpkey);
 void sv_ev_leave_room(const char *const room);
+void sv_ev_room_join_error(const char *const room, const char *const err);
 void sv_ev_room_destroy(const char *const room);
 void sv_ev_room_occupant_offline(const char *const room, const char *const nick,
     const char *const show, const char *const status);
@@ -75,7 +83,7 @@ void sv_ev_room_occupent_banned(const char *const room, const char *const nick,
     const char *const reason);
 void sv_ev_outgoing_carbon(char *barejid, char *message);
 void sv_ev_incoming_carbon(char *barejid, char *resource, char *message);
-void sv_ev_xmpp_stanza(const char *const msg);
+void sv_ev_xmpp_stanza(traffic_dir_t dir, const char *const text);
 void sv_ev_muc_self_online(const char *const room, const char *const nick, gboolean config_required,
     const char *const role, const char *const affiliation, const char *const actor, const char *const reason,
     const char *const jid, const char *const show, const char *const status);
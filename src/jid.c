@@ -32,6 +32,7 @@
  *
  */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -41,17 +42,39 @@
 
 #include "common.h"
 
+// Jids are shared, jid_create returns the existing Jid for a string while
+// it is still referenced. Bare jids are interned with str_intern, so two
+// Jids with the same bare jid can be compared by pointer with
+// jid_bare_equal, the bare jid is released with the last Jid holding it.
+static GHashTable *jids = NULL;
+
+// the thread the first Jid was created on, every other call must be on it
+static GThread *jids_thread = NULL;
+
+static void _jid_free(Jid *jid);
+static void _jid_check_thread(void);
+static char* _jid_intern_lower(const char *const str);
+
 Jid*
 jid_create(const gchar *const str)
 {
     Jid *result = NULL;
 
-    /* if str is NULL g_strdup returns NULL */
-    gchar *trimmed = g_strdup(str);
-    if (trimmed == NULL) {
+    if (str == NULL) {
         return NULL;
     }
 
+    _jid_check_thread();
+    if (jids) {
+        result = g_hash_table_lookup(jids, str);
+        if (result) {
+            result->refs++;
+            return result;
+        }
+    }
+
+    gchar *trimmed = g_strdup(str);
+
     if (strlen(trimmed) == 0) {
         g_free(trimmed);
         return NULL;
@@ -74,6 +97,7 @@ jid_create(const gchar *const str)
     result->resourcepart = NULL;
     result->barejid = NULL;
     result->fulljid = NULL;
+    result->refs = 1;
 
     gchar *atp = g_utf8_strchr(trimmed, -1, '@');
     gchar *slashp = g_utf8_strchr(trimmed, -1, '/');
@@ -88,21 +112,27 @@ jid_create(const gchar *const str)
         result->resourcepart = g_strdup(slashp + 1);
         result->domainpart = g_utf8_substring(domain_start, 0, g_utf8_pointer_to_offset(domain_start, slashp));
         char *barejidraw = g_utf8_substring(trimmed, 0, g_utf8_pointer_to_offset(trimmed, slashp));
-        result->barejid = g_utf8_strdown(barejidraw, -1);
+        result->barejid = _jid_intern_lower(barejidraw);
         result->fulljid = g_strdup(trimmed);
         g_free(barejidraw);
     } else {
         result->domainpart = g_strdup(domain_start);
-        result->barejid = g_utf8_strdown(trimmed, -1);
+        result->barejid = _jid_intern_lower(trimmed);
     }
 
     if (result->domainpart == NULL) {
-        jid_destroy(result);
+        _jid_free(result);
+        g_free(trimmed);
         return NULL;
     }
 
     result->str = trimmed;
 
+    if (jids == NULL) {
+        jids = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    g_hash_table_insert(jids, result->str, result);
+
     return result;
 }
 
@@ -117,20 +147,58 @@ jid_create_from_bare_and_resource(const char *const room, const char *const nick
     return result;
 }
 
+// drops a reference, the Jid is freed with the last one
 void
 jid_destroy(Jid *jid)
 {
-    if (jid) {
+    if (jid == NULL) {
+        return;
+    }
+
+    _jid_check_thread();
+    if (--jid->refs == 0) {
+        g_hash_table_remove(jids, jid->str);
         g_free(jid->str);
-        g_free(jid->localpart);
-        g_free(jid->domainpart);
-        g_free(jid->resourcepart);
-        g_free(jid->barejid);
-        g_free(jid->fulljid);
-        free(jid);
+        _jid_free(jid);
     }
 }
 
+gboolean
+jid_bare_equal(const Jid *const jid1, const Jid *const jid2)
+{
+    return jid1->barejid == jid2->barejid;
+}
+
+static void
+_jid_free(Jid *jid)
+{
+    str_unintern(jid->barejid);
+    g_free(jid->localpart);
+    g_free(jid->domainpart);
+    g_free(jid->resourcepart);
+    g_free(jid->fulljid);
+    free(jid);
+}
+
+static void
+_jid_check_thread(void)
+{
+    if (jids_thread == NULL) {
+        jids_thread = g_thread_self();
+    }
+    assert(jids_thread == g_thread_self());
+}
+
+static char*
+_jid_intern_lower(const char *const str)
+{
+    gchar *lower = g_utf8_strdown(str, -1);
+    char *result = (char*)str_intern(lower);
+    g_free(lower);
+
+    return result;
+}
+
 gboolean
 jid_is_valid_room_form(Jid *jid)
 {
@@ -44,13 +44,17 @@ struct jid_t {
     char *resourcepart;
     char *barejid;
     char *fulljid;
+    int refs;
 };
 
 typedef struct jid_t Jid;
 
+// Jids are shared through a table and counted without locks, they are only
+// created and destroyed on the main thread, workers are given strings
 Jid* jid_create(const gchar *const str);
 Jid* jid_create_from_bare_and_resource(const char *const room, const char *const nick);
 void jid_destroy(Jid *jid);
+gboolean jid_bare_equal(const Jid *const jid1, const Jid *const jid2);
 
 gboolean jid_is_valid_room_form(Jid *jid);
 char* create_fulljid(const char *const barejid, const char *const resource);
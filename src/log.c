@@ -31,6 +31,7 @@
  * source files in the program, then also delete it here.
  *
  */
+#include "config.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -38,7 +39,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "glib.h"
 #include "glib/gstdio.h"
@@ -47,42 +52,173 @@
 
 #include "common.h"
 #include "config/preferences.h"
+#include "tools/binlog.h"
+#include "tools/history_index.h"
+#include "tools/log_export.h"
+#include "tools/log_filter.h"
+#include "tools/log_retention.h"
+#include "tools/perf.h"
+#include "tools/stats.h"
+#include "tools/trace.h"
+#include "tools/watchdog.h"
 #include "xmpp/xmpp.h"
 
 #define PROF "prof"
 
+// bounded queue of records for the log writer thread
+#define LOG_QUEUE_SIZE 1024
+
 static FILE *logp;
+static long logp_size;
+static gboolean logp_rotate;
 GString *mainlogfile;
 
 static GTimeZone *tz;
 static GDateTime *dt;
+
+// the date prefix of main log records, formatted once a second
+static time_t stamp_time = 0;
+static gchar stamp[32];
 static log_level_t level_filter;
 
 static GHashTable *logs;
 static GHashTable *groupchat_logs;
+// time of the last message logged for each room
+static GHashTable *groupchat_last_times;
+// bytes logged for each contact and room this session
+static GHashTable *log_written;
 static GDateTime *session_started;
 
 enum {
     STDERR_BUFSIZE = 4000,
     STDERR_RETRY_NR = 5,
 };
+
+typedef enum {
+    LOG_RECORD_WRITE,
+    LOG_RECORD_FLUSH,
+    LOG_RECORD_CLOSE,
+    LOG_RECORD_COMPRESS,
+    LOG_RECORD_HISTORY,
+    LOG_RECORD_RETENTION
+} log_record_type_t;
+
+// the retention policy applied to one directory by the writer thread,
+// handed back so the search index can forget the files that went
+typedef struct retention_run_t {
+    gchar *dir;
+    LogRetention policy;
+    GDateTime *now;
+    GSList *gone;
+    int changed;
+} RetentionRun;
+
+// a read of a chat's history, run by the writer thread after everything
+// queued before it so it sees the log as it was when it was asked for
+typedef struct history_read_t {
+    gchar *login;
+    gchar *recipient;
+    int max_lines;
+    ChatLogHistoryFunc func;
+    gpointer data;
+} HistoryRead;
+
+// each page is handed back to the main thread as it is read
+typedef struct history_page_t {
+    HistoryRead *read;
+    GSList *entries;
+    gboolean last;
+} HistoryPage;
+
+typedef struct log_record_t {
+    log_record_type_t type;
+    FILE *fp;
+    gchar *line;
+    gsize len;
+    HistoryRead *read;
+    RetentionRun *retention;
+} LogRecord;
+
+// Records are added under queue_lock, worker threads log too, and the
+// writer takes them from queue_head without the lock, as producers never
+// touch the slots between head and tail. queue_changed wakes the writer
+// when records are added and a producer waiting for room when the
+// writer moves queue_head, a full queue is waited on rather than dropped.
+static LogRecord log_queue[LOG_QUEUE_SIZE];
+static gint queue_head = 0;
+static gint queue_tail = 0;
+static gint writer_running = 0;
+static gint writer_errors = 0;
+static guint queue_full_count = 0;
+#if GLIB_CHECK_VERSION(2,32,0)
+static GThread *writer_thread = NULL;
+static GMutex queue_lock;
+static GCond queue_changed;
+#endif
+
+static GAsyncQueue *history_pages = NULL;
+static gint history_reads = 0;
+
+static GAsyncQueue *retention_runs = NULL;
+static gboolean retention_running = FALSE;
+
+// a read only view of part of a log file, mapped when possible
+typedef struct log_map_t {
+    const char *data;
+    size_t len;
+    void *base;
+    size_t base_len;
+} LogMap;
+
+// a line inside a LogMap, not NUL terminated
+typedef struct log_line_t {
+    const char *str;
+    size_t len;
+} LogLine;
+
+// the areas with settings of their own
+static GHashTable *log_areas = NULL;
+
 static int stderr_inited;
 static log_level_t stderr_level;
 static int stderr_pipe[2];
 static char *stderr_buf;
 static GString *stderr_msg;
 
+// log files stay open until the log is rolled or closed
 struct dated_chat_log {
     gchar *filename;
     GDateTime *date;
+    FILE *logp;
+    long size;
+    gboolean binary;
 };
 
+// contact and room log directories the retention policy has still to
+// check today, one is checked on each run
+static GSList *retention_dirs = NULL;
+static gint retention_day = 0;
+static LogRetention retention_policy = { 0, 0, 0 };
+
+// search index of the chat logs of the account last logged for
+static HistoryIndex history_index = NULL;
+static gchar *history_index_login = NULL;
+static gchar *history_index_dir = NULL;
+
 static gboolean _log_roll_needed(struct dated_chat_log *dated_log);
+static void _log_roll_size(struct dated_chat_log *dated_log);
+static char* _log_part_filename(const char *const filename, int part);
+static int _log_part_count(const char *const filename);
 static struct dated_chat_log* _create_log(const char *const other, const char *const login);
 static struct dated_chat_log* _create_groupchat_log(char *room, const char *const login);
 static void _free_chat_log(struct dated_chat_log *dated_log);
+static void _open_chat_log(struct dated_chat_log *dated_log);
+static void _write_done(struct dated_chat_log *dated_log);
+static void _log_written_add(const char *const jid, long bytes);
 static gboolean _key_equals(void *key1, void *key2);
 static char* _get_log_filename(const char *const other, const char *const login, GDateTime *dt, gboolean create);
+static char* _binary_log_filename(const char *const filename);
+static GDateTime* _groupchat_log_read_last_time(const char *const login, const char *const room);
 static char* _get_groupchat_log_filename(const char *const room, const char *const login, GDateTime *dt,
     gboolean create);
 static gchar* _get_chatlog_dir(void);
@@ -90,11 +226,48 @@ static gchar* _get_main_log_file(void);
 static void _rotate_log_file(void);
 static char* _log_string_from_level(log_level_t level);
 static void _chat_log_chat(const char *const login, const char *const other, const gchar *const msg,
-    chat_log_direction_t direction, GDateTime *timestamp);
+    chat_log_direction_t direction, GDateTime *timestamp, int flags, const char *const id);
+static void _log_record_push(log_record_type_t type, FILE *fp, gchar *line);
+static void _log_record_push_len(log_record_type_t type, FILE *fp, gchar *line, gsize len);
+static int _log_record_run(LogRecord *record);
+static void _log_queue_drain(void);
+static void _log_record_queue(LogRecord *record);
+static GSList* _chat_log_read_previous(const gchar *const login, const gchar *const recipient, int max_lines,
+    HistoryRead *read);
+static void _history_page_push(HistoryRead *read, GSList *entries, gboolean last);
+static void _history_page_free(HistoryPage *page);
+static void _retention_runs_process(void);
+static void _retention_run_free(RetentionRun *run);
+static GSList* _chat_log_read_tail(const char *const filename, int max_lines);
+static GSList* _chat_log_read_archive_tail(const char *const filename, int max_lines);
+static GSList* _binary_log_read(const char *const filename);
+static gboolean _log_file_exists(const char *const filename);
+static GSList* _retention_dirs(void);
+static GSList* _retention_subdirs(GSList *dirs, const char *const dir);
+static gboolean _chat_log_stale(gpointer key, struct dated_chat_log *dated_log, gpointer data);
+static GSList* _chat_log_text_entries(const char *const filename, GDateTime *date, const char *const contact,
+    int max_lines);
+static GSList* _entries_tail(GSList *entries, int max_entries);
+static gint _entry_cmp(const BinlogEntry *a, const BinlogEntry *b);
+static void _binary_log_write(struct dated_chat_log *dated_log, BinlogEntry *entry);
+static HistoryIndex _history_index_for(const char *const login);
+static void _history_index_add(const char *const login, struct dated_chat_log *dated_log, const char *const line);
+static gboolean _chat_log_index(FILE *logp, FILE *idxp, int max_lines, long *start, long *end);
+static gboolean _log_map_open(FILE *fp, long start, long end, LogMap *map);
+static void _log_map_close(LogMap *map);
+static void _log_write(log_level_t level, const char *const area, const char *const msg);
+static gboolean _log_level_enabled(log_level_t level, const char *const area);
+static void _log_areas_load(void);
+static gint64 _log_now(void);
+static gboolean _log_map_next_line(LogMap *map, size_t *pos, LogLine *line);
 
 void
 log_debug(const char *const msg, ...)
 {
+    if (!_log_level_enabled(PROF_LEVEL_DEBUG, PROF)) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
     GString *fmt_msg = g_string_new(NULL);
@@ -107,6 +280,10 @@ log_debug(const char *const msg, ...)
 void
 log_info(const char *const msg, ...)
 {
+    if (!_log_level_enabled(PROF_LEVEL_INFO, PROF)) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
     GString *fmt_msg = g_string_new(NULL);
@@ -119,6 +296,10 @@ log_info(const char *const msg, ...)
 void
 log_warning(const char *const msg, ...)
 {
+    if (!_log_level_enabled(PROF_LEVEL_WARN, PROF)) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
     GString *fmt_msg = g_string_new(NULL);
@@ -131,6 +312,10 @@ log_warning(const char *const msg, ...)
 void
 log_error(const char *const msg, ...)
 {
+    if (!_log_level_enabled(PROF_LEVEL_ERROR, PROF)) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
     GString *fmt_msg = g_string_new(NULL);
@@ -148,8 +333,19 @@ log_init(log_level_t filter)
     gchar *log_file = _get_main_log_file();
     logp = fopen(log_file, "a");
     g_chmod(log_file, S_IRUSR | S_IWUSR);
+    logp_size = 0;
+    if (logp) {
+        fseek(logp, 0, SEEK_END);
+        logp_size = ftell(logp);
+    }
+    logp_rotate = prefs_get_boolean(PREF_LOG_ROTATE);
+    stamp_time = 0;
     mainlogfile = g_string_new(log_file);
     free(log_file);
+
+    if (log_areas == NULL) {
+        _log_areas_load();
+    }
 }
 
 void
@@ -177,33 +373,179 @@ log_close(void)
     g_string_free(mainlogfile, TRUE);
     g_time_zone_unref(tz);
     if (logp) {
-        fclose(logp);
+        _log_record_push(LOG_RECORD_CLOSE, logp, NULL);
+        logp = NULL;
     }
 }
 
 void
 log_msg(log_level_t level, const char *const area, const char *const msg)
 {
-    if (level >= level_filter && logp) {
-        dt = g_date_time_new_now(tz);
+    if (!_log_level_enabled(level, area)) {
+        return;
+    }
 
-        char *level_str = _log_string_from_level(level);
+    LogFilter filter = log_areas ? g_hash_table_lookup(log_areas, area) : NULL;
+    if (filter) {
+        if (!log_filter_admit(filter, level, _log_now())) {
+            return;
+        }
+        guint64 suppressed = log_filter_take_suppressed(filter);
+        if (suppressed > 0) {
+            gchar *notice = g_strdup_printf("%" G_GUINT64_FORMAT " records suppressed", suppressed);
+            _log_write(PROF_LEVEL_WARN, area, notice);
+            g_free(notice);
+        }
+    }
 
-        gchar *date_fmt = g_date_time_format(dt, "%d/%m/%Y %H:%M:%S");
+    _log_write(level, area, msg);
+}
 
-        fprintf(logp, "%s: %s: %s: %s\n", date_fmt, area, level_str, msg);
-        g_date_time_unref(dt);
+// set one of level, rate or sample for an area and save it
+gboolean
+log_area_set(const char *const area, const char *const setting, const char *const value)
+{
+    if (log_areas == NULL) {
+        _log_areas_load();
+    }
 
-        fflush(logp);
-        g_free(date_fmt);
+    LogFilter filter = g_hash_table_lookup(log_areas, area);
+    gboolean created = filter == NULL;
+    if (created) {
+        filter = log_filter_new();
+    }
 
-        if (prefs_get_boolean(PREF_LOG_ROTATE)) {
-            long result = ftell(logp);
-            if (result != -1 && result >= prefs_get_max_log_size()) {
-                _rotate_log_file();
-            }
+    if (!log_filter_set(filter, setting, value, _log_now())) {
+        if (created) {
+            log_filter_free(filter);
+        }
+        return FALSE;
+    }
+
+    if (created) {
+        g_hash_table_insert(log_areas, strdup(area), filter);
+    }
+    gchar *spec = log_filter_spec(filter);
+    prefs_set_log_area(area, spec);
+    g_free(spec);
+
+    return TRUE;
+}
+
+void
+log_area_clear(const char *const area)
+{
+    if (log_areas) {
+        g_hash_table_remove(log_areas, area);
+    }
+    prefs_set_log_area(area, NULL);
+}
+
+// the configured areas, sorted
+GList*
+log_area_list(void)
+{
+    GList *result = NULL;
+    if (log_areas) {
+        GList *names = g_hash_table_get_keys(log_areas);
+        GList *curr = names;
+        while (curr) {
+            result = g_list_insert_sorted(result, strdup(curr->data), (GCompareFunc)strcmp);
+            curr = g_list_next(curr);
+        }
+        g_list_free(names);
+    }
+
+    return result;
+}
+
+gchar*
+log_area_describe(const char *const area)
+{
+    LogFilter filter = log_areas ? g_hash_table_lookup(log_areas, area) : NULL;
+    if (filter == NULL) {
+        return NULL;
+    }
+
+    gchar *spec = log_filter_spec(filter);
+    gchar *result = g_strdup_printf("%s, %" G_GUINT64_FORMAT " dropped", spec, log_filter_dropped(filter));
+    g_free(spec);
+
+    return result;
+}
+
+static gboolean
+_log_level_enabled(log_level_t level, const char *const area)
+{
+    if (logp == NULL) {
+        return FALSE;
+    }
+
+    LogFilter filter = log_areas ? g_hash_table_lookup(log_areas, area) : NULL;
+    return log_filter_enabled(filter, level, level_filter);
+}
+
+static void
+_log_areas_load(void)
+{
+    log_areas = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)log_filter_free);
+
+    gchar **areas = prefs_get_log_areas();
+    if (areas == NULL) {
+        return;
+    }
+
+    int i;
+    for (i = 0; areas[i] != NULL; i++) {
+        char *spec = prefs_get_log_area(areas[i]);
+        if (spec == NULL) {
+            continue;
         }
+
+        g_hash_table_insert(log_areas, strdup(areas[i]), log_filter_parse(spec, _log_now()));
+        g_free(spec);
+    }
+    g_strfreev(areas);
+}
+
+static gint64
+_log_now(void)
+{
+#if GLIB_CHECK_VERSION(2,28,0)
+    return g_get_monotonic_time();
+#else
+    GTimeVal now;
+    g_get_current_time(&now);
+    return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+#endif
+}
+
+static void
+_log_write(log_level_t level, const char *const area, const char *const msg)
+{
+    gint64 start = stats_start();
+    time_t now = time(NULL);
+    if (now != stamp_time) {
+        dt = g_date_time_new_now(tz);
+        gchar *date_fmt = g_date_time_format(dt, "%d/%m/%Y %H:%M:%S");
+        g_strlcpy(stamp, date_fmt, sizeof(stamp));
+        g_free(date_fmt);
+        g_date_time_unref(dt);
+        stamp_time = now;
+    }
+
+    char *level_str = _log_string_from_level(level);
+    gchar *line = g_strdup_printf("%s: %s: %s: %s\n", stamp, area, level_str, msg);
+    gsize len = strlen(line);
+
+    logp_size += len;
+    _log_record_push_len(LOG_RECORD_WRITE, logp, line, len);
+    _log_record_push(LOG_RECORD_FLUSH, logp, NULL);
+
+    if (logp_rotate && logp_size >= prefs_get_max_log_size()) {
+        _rotate_log_file();
     }
+    stats_record(STATS_LOG_WRITE, start);
 }
 
 log_level_t
@@ -226,21 +568,21 @@ log_level_from_string(char *log_level)
 static void
 _rotate_log_file(void)
 {
-    gchar *log_file = _get_main_log_file();
-    size_t len = strlen(log_file);
-    char *log_file_new = malloc(len + 3);
-
-    strncpy(log_file_new, log_file, len);
-    log_file_new[len] = '.';
-    log_file_new[len+1] = '1';
-    log_file_new[len+2] = 0;
-
-    log_close();
-    rename(log_file, log_file_new);
-    log_init(log_get_filter());
+    gchar *log_file = mainlogfile->str;
+    gchar *log_file_new = g_strdup_printf("%s.1", log_file);
+
+    // records still queued for the old file follow it through the rename
+    _log_record_push(LOG_RECORD_CLOSE, logp, NULL);
+    g_rename(log_file, log_file_new);
+    if (prefs_get_boolean(PREF_LOG_COMPRESS)) {
+        _log_record_push(LOG_RECORD_COMPRESS, NULL, log_file_new);
+    } else {
+        g_free(log_file_new);
+    }
 
-    free(log_file_new);
-    free(log_file);
+    logp = fopen(log_file, "a");
+    g_chmod(log_file, S_IRUSR | S_IWUSR);
+    logp_size = 0;
     log_info("Log has been rotated");
 }
 
@@ -251,6 +593,9 @@ chat_log_init(void)
     log_info("Initialising chat logs");
     logs = g_hash_table_new_full(g_str_hash, (GEqualFunc) _key_equals, free,
         (GDestroyNotify)_free_chat_log);
+    log_written = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    history_pages = g_async_queue_new();
+    retention_runs = g_async_queue_new();
 }
 
 void
@@ -259,102 +604,94 @@ groupchat_log_init(void)
     log_info("Initialising groupchat logs");
     groupchat_logs = g_hash_table_new_full(g_str_hash, (GEqualFunc) _key_equals, free,
         (GDestroyNotify)_free_chat_log);
+    groupchat_last_times = g_hash_table_new_full(g_str_hash, g_str_equal, free,
+        (GDestroyNotify)g_date_time_unref);
 }
 
 void
-chat_log_msg_out(const char *const barejid, const char *const msg)
+chat_log_msg_out(const char *const barejid, const char *const msg, const char *const id)
 {
-    if (prefs_get_boolean(PREF_CHLOG)) {
-        const char *jid = jabber_get_fulljid();
-        Jid *jidp = jid_create(jid);
-        _chat_log_chat(jidp->barejid, barejid, msg, PROF_OUT_LOG, NULL);
-        jid_destroy(jidp);
+    const Jid *jidp = jabber_get_jid();
+    if (prefs_get_boolean(PREF_CHLOG) && jidp) {
+        _chat_log_chat(jidp->barejid, barejid, msg, PROF_OUT_LOG, NULL, 0, id);
     }
 }
 
 void
-chat_log_otr_msg_out(const char *const barejid, const char *const msg)
+chat_log_otr_msg_out(const char *const barejid, const char *const msg, const char *const id)
 {
-    if (prefs_get_boolean(PREF_CHLOG)) {
-        const char *jid = jabber_get_fulljid();
-        Jid *jidp = jid_create(jid);
+    const Jid *jidp = jabber_get_jid();
+    if (prefs_get_boolean(PREF_CHLOG) && jidp) {
         char *pref_otr_log = prefs_get_string(PREF_OTR_LOG);
         if (strcmp(pref_otr_log, "on") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, msg, PROF_OUT_LOG, NULL);
+            _chat_log_chat(jidp->barejid, barejid, msg, PROF_OUT_LOG, NULL, BINLOG_FLAG_OTR, id);
         } else if (strcmp(pref_otr_log, "redact") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_OUT_LOG, NULL);
+            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_OUT_LOG, NULL, BINLOG_FLAG_OTR | BINLOG_FLAG_REDACTED, id);
         }
         prefs_free_string(pref_otr_log);
-        jid_destroy(jidp);
     }
 }
 
 void
-chat_log_pgp_msg_out(const char *const barejid, const char *const msg)
+chat_log_pgp_msg_out(const char *const barejid, const char *const msg, const char *const id)
 {
-    if (prefs_get_boolean(PREF_CHLOG)) {
-        const char *jid = jabber_get_fulljid();
-        Jid *jidp = jid_create(jid);
+    const Jid *jidp = jabber_get_jid();
+    if (prefs_get_boolean(PREF_CHLOG) && jidp) {
         char *pref_pgp_log = prefs_get_string(PREF_PGP_LOG);
         if (strcmp(pref_pgp_log, "on") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, msg, PROF_OUT_LOG, NULL);
+            _chat_log_chat(jidp->barejid, barejid, msg, PROF_OUT_LOG, NULL, BINLOG_FLAG_PGP, id);
         } else if (strcmp(pref_pgp_log, "redact") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_OUT_LOG, NULL);
+            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_OUT_LOG, NULL, BINLOG_FLAG_PGP | BINLOG_FLAG_REDACTED, id);
         }
         prefs_free_string(pref_pgp_log);
-        jid_destroy(jidp);
     }
 }
 
 void
 chat_log_otr_msg_in(const char *const barejid, const char *const msg, gboolean was_decrypted, GDateTime *timestamp)
 {
-    if (prefs_get_boolean(PREF_CHLOG)) {
-        const char *jid = jabber_get_fulljid();
-        Jid *jidp = jid_create(jid);
+    const Jid *jidp = jabber_get_jid();
+    if (prefs_get_boolean(PREF_CHLOG) && jidp) {
         char *pref_otr_log = prefs_get_string(PREF_OTR_LOG);
         if (!was_decrypted || (strcmp(pref_otr_log, "on") == 0)) {
-            _chat_log_chat(jidp->barejid, barejid, msg, PROF_IN_LOG, timestamp);
+            _chat_log_chat(jidp->barejid, barejid, msg, PROF_IN_LOG, timestamp, was_decrypted ? BINLOG_FLAG_OTR : 0, NULL);
         } else if (strcmp(pref_otr_log, "redact") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_IN_LOG, timestamp);
+            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_IN_LOG, timestamp, BINLOG_FLAG_OTR | BINLOG_FLAG_REDACTED, NULL);
         }
         prefs_free_string(pref_otr_log);
-        jid_destroy(jidp);
     }
 }
 
 void
 chat_log_pgp_msg_in(const char *const barejid, const char *const msg, GDateTime *timestamp)
 {
-    if (prefs_get_boolean(PREF_CHLOG)) {
-        const char *jid = jabber_get_fulljid();
-        Jid *jidp = jid_create(jid);
+    const Jid *jidp = jabber_get_jid();
+    if (prefs_get_boolean(PREF_CHLOG) && jidp) {
         char *pref_pgp_log = prefs_get_string(PREF_PGP_LOG);
         if (strcmp(pref_pgp_log, "on") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, msg, PROF_IN_LOG, timestamp);
+            _chat_log_chat(jidp->barejid, barejid, msg, PROF_IN_LOG, timestamp, BINLOG_FLAG_PGP, NULL);
         } else if (strcmp(pref_pgp_log, "redact") == 0) {
-            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_IN_LOG, timestamp);
+            _chat_log_chat(jidp->barejid, barejid, "[redacted]", PROF_IN_LOG, timestamp, BINLOG_FLAG_PGP | BINLOG_FLAG_REDACTED, NULL);
         }
         prefs_free_string(pref_pgp_log);
-        jid_destroy(jidp);
     }
 }
 
 void
 chat_log_msg_in(const char *const barejid, const char *const msg, GDateTime *timestamp)
 {
-    if (prefs_get_boolean(PREF_CHLOG)) {
-        const char *jid = jabber_get_fulljid();
-        Jid *jidp = jid_create(jid);
-        _chat_log_chat(jidp->barejid, barejid, msg, PROF_IN_LOG, timestamp);
-        jid_destroy(jidp);
+    const Jid *jidp = jabber_get_jid();
+    if (prefs_get_boolean(PREF_CHLOG) && jidp) {
+        _chat_log_chat(jidp->barejid, barejid, msg, PROF_IN_LOG, timestamp, 0, NULL);
     }
 }
 
 static void
 _chat_log_chat(const char *const login, const char *const other, const char *const msg,
-    chat_log_direction_t direction, GDateTime *timestamp)
+    chat_log_direction_t direction, GDateTime *timestamp, int flags, const char *const id)
 {
+    gint64 start = perf_start();
+    gint64 stats = stats_start();
     struct dated_chat_log *dated_log = g_hash_table_lookup(logs, other);
 
     // no log for user
@@ -362,10 +699,13 @@ _chat_log_chat(const char *const login, const char *const other, const char *con
         dated_log = _create_log(other, login);
         g_hash_table_insert(logs, strdup(other), dated_log);
 
-    // log exists but needs rolling
-    } else if (_log_roll_needed(dated_log)) {
+    // log exists but needs rolling, or the log format has changed
+    } else if (_log_roll_needed(dated_log) || dated_log->binary != prefs_get_boolean(PREF_LOG_BINARY)) {
         dated_log = _create_log(other, login);
         g_hash_table_replace(logs, strdup(other), dated_log);
+
+    } else {
+        _log_roll_size(dated_log);
     }
 
     if (timestamp == NULL) {
@@ -374,37 +714,91 @@ _chat_log_chat(const char *const login, const char *const other, const char *con
         g_date_time_ref(timestamp);
     }
 
+    long size = dated_log->size;
+    if (dated_log->binary) {
+        if (dated_log->logp) {
+            binlog_direction_t bin_direction = direction == PROF_IN_LOG ? BINLOG_IN : BINLOG_OUT;
+            binlog_receipt_t receipt = BINLOG_RECEIPT_NONE;
+            if (bin_direction == BINLOG_OUT && id &&
+                    (prefs_get_boolean(PREF_RECEIPTS_REQUEST) || prefs_get_boolean(PREF_CHAT_MARKERS))) {
+                receipt = BINLOG_RECEIPT_PENDING;
+            }
+            BinlogEntry *entry = binlog_message_new(timestamp, bin_direction, flags, receipt, id,
+                bin_direction == BINLOG_IN ? other : "me", msg);
+            _binary_log_write(dated_log, entry);
+            binlog_entry_free(entry);
+            _write_done(dated_log);
+        }
+        _log_written_add(other, dated_log->size - size);
+        g_date_time_unref(timestamp);
+        perf_record(PERF_LOG, start);
+        stats_record(STATS_LOG_CHAT, stats);
+        return;
+    }
+
     gchar *date_fmt = g_date_time_format(timestamp, "%H:%M:%S");
-    FILE *logp = fopen(dated_log->filename, "a");
-    g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+    FILE *logp = dated_log->logp;
     if (logp) {
+        gchar *line = NULL;
         if (direction == PROF_IN_LOG) {
             if (strncmp(msg, "/me ", 4) == 0) {
-                fprintf(logp, "%s - *%s %s\n", date_fmt, other, msg + 4);
+                line = g_strdup_printf("%s - *%s %s\n", date_fmt, other, msg + 4);
             } else {
-                fprintf(logp, "%s - %s: %s\n", date_fmt, other, msg);
+                line = g_strdup_printf("%s - %s: %s\n", date_fmt, other, msg);
             }
         } else {
             if (strncmp(msg, "/me ", 4) == 0) {
-                fprintf(logp, "%s - *me %s\n", date_fmt, msg + 4);
+                line = g_strdup_printf("%s - *me %s\n", date_fmt, msg + 4);
             } else {
-                fprintf(logp, "%s - me: %s\n", date_fmt, msg);
+                line = g_strdup_printf("%s - me: %s\n", date_fmt, msg);
             }
         }
-        fflush(logp);
-        int result = fclose(logp);
-        if (result == EOF) {
-            log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
-        }
+        _history_index_add(login, dated_log, line);
+        _log_record_push(LOG_RECORD_WRITE, logp, line);
+        _write_done(dated_log);
+        _log_written_add(other, dated_log->size - size);
     }
 
     g_free(date_fmt);
     g_date_time_unref(timestamp);
+    perf_record(PERF_LOG, start);
+    stats_record(STATS_LOG_CHAT, stats);
+}
+
+// what has been logged for a contact or room since starting
+guint64
+chat_log_written(const char *const jid)
+{
+    if (log_written == NULL) {
+        return 0;
+    }
+
+    guint64 *written = g_hash_table_lookup(log_written, jid);
+    return written ? *written : 0;
+}
+
+// receipts are only kept by binary logs
+void
+chat_log_receipt(const char *const barejid, const char *const id)
+{
+    if (!prefs_get_boolean(PREF_CHLOG) || logs == NULL) {
+        return;
+    }
+
+    struct dated_chat_log *dated_log = g_hash_table_lookup(logs, barejid);
+    if (dated_log && dated_log->binary && dated_log->logp) {
+        BinlogEntry *entry = binlog_receipt_new(id);
+        _binary_log_write(dated_log, entry);
+        binlog_entry_free(entry);
+        _write_done(dated_log);
+    }
 }
 
 void
 groupchat_log_chat(const gchar *const login, const gchar *const room, const gchar *const nick, const gchar *const msg)
 {
+    gint64 start = perf_start();
+    gint64 stats = stats_start();
     gchar *room_copy = strdup(room);
     struct dated_chat_log *dated_log = g_hash_table_lookup(groupchat_logs, room_copy);
 
@@ -416,38 +810,140 @@ groupchat_log_chat(const gchar *const login, const gchar *const room, const gcha
     // log exists but needs rolling
     } else if (_log_roll_needed(dated_log)) {
         dated_log = _create_groupchat_log(room_copy, login);
-        g_hash_table_replace(logs, room_copy, dated_log);
+        g_hash_table_replace(groupchat_logs, room_copy, dated_log);
+
+    } else {
+        _log_roll_size(dated_log);
+        free(room_copy);
     }
 
     GDateTime *dt = g_date_time_new_now_local();
 
     gchar *date_fmt = g_date_time_format(dt, "%H:%M:%S");
 
-    FILE *logp = fopen(dated_log->filename, "a");
-    g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+    FILE *logp = dated_log->logp;
     if (logp) {
+        gchar *line = NULL;
         if (strncmp(msg, "/me ", 4) == 0) {
-            fprintf(logp, "%s - *%s %s\n", date_fmt, nick, msg + 4);
+            line = g_strdup_printf("%s - *%s %s\n", date_fmt, nick, msg + 4);
         } else {
-            fprintf(logp, "%s - %s: %s\n", date_fmt, nick, msg);
+            line = g_strdup_printf("%s - %s: %s\n", date_fmt, nick, msg);
         }
 
-        fflush(logp);
-        int result = fclose(logp);
-        if (result == EOF) {
-            log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
-        }
+        _log_written_add(room, strlen(line));
+        _history_index_add(login, dated_log, line);
+        _log_record_push(LOG_RECORD_WRITE, logp, line);
+        _write_done(dated_log);
     }
 
+    g_hash_table_replace(groupchat_last_times, strdup(room), g_date_time_ref(dt));
+
     g_free(date_fmt);
     g_date_time_unref(dt);
+    perf_record(PERF_LOG, start);
+    stats_record(STATS_LOG_GROUPCHAT, stats);
+}
+
+GDateTime*
+groupchat_log_get_last_time(const gchar *const login, const gchar *const room)
+{
+    GDateTime *last = g_hash_table_lookup(groupchat_last_times, room);
+    if (last) {
+        return g_date_time_ref(last);
+    }
+
+    last = _groupchat_log_read_last_time(login, room);
+    if (last) {
+        g_hash_table_insert(groupchat_last_times, strdup(room), g_date_time_ref(last));
+    }
+
+    return last;
 }
 
 
 GSList*
-chat_log_get_previous(const gchar *const login, const gchar *const recipient)
+chat_log_get_previous(const gchar *const login, const gchar *const recipient, int max_lines)
+{
+    // make sure buffered lines are on disk before reading them back
+    chat_log_flush();
+    _log_queue_drain();
+
+    return _chat_log_read_previous(login, recipient, max_lines, NULL);
+}
+
+void
+chat_log_get_previous_async(const gchar *const login, const gchar *const recipient, int max_lines,
+    ChatLogHistoryFunc func, gpointer data)
+{
+    HistoryRead *read = malloc(sizeof(HistoryRead));
+    read->login = g_strdup(login);
+    read->recipient = g_strdup(recipient);
+    read->max_lines = max_lines;
+    read->func = func;
+    read->data = data;
+    history_reads++;
+
+    // the flushes are queued ahead of the read, so it finds the lines on disk
+    chat_log_flush();
+    LogRecord record = { LOG_RECORD_HISTORY, NULL, NULL, 0, read, NULL };
+    _log_record_queue(&record);
+}
+
+// called from the main loop, hands each page read so far to its window
+void
+chat_log_history_process(void)
+{
+    if (history_pages == NULL) {
+        return;
+    }
+
+    HistoryPage *page = NULL;
+    while ((page = g_async_queue_try_pop(history_pages))) {
+        page->read->func(page->read->recipient, page->entries, page->last, page->read->data);
+        if (page->last) {
+            history_reads--;
+        }
+        _history_page_free(page);
+    }
+}
+
+gboolean
+chat_log_history_pending(void)
+{
+    return history_reads > 0;
+}
+
+static void
+_history_page_push(HistoryRead *read, GSList *entries, gboolean last)
+{
+    HistoryPage *page = malloc(sizeof(HistoryPage));
+    page->read = read;
+    page->entries = entries;
+    page->last = last;
+    g_async_queue_push(history_pages, page);
+}
+
+// the read goes with its last page
+static void
+_history_page_free(HistoryPage *page)
+{
+    g_slist_free_full(page->entries, (GDestroyNotify)binlog_entry_free);
+    if (page->last) {
+        g_free(page->read->login);
+        g_free(page->read->recipient);
+        free(page->read);
+    }
+    free(page);
+}
+
+// the last max_lines messages, oldest first, or when read is given each
+// log part is passed back as a page, newest page first, and NULL returned
+static GSList*
+_chat_log_read_previous(const gchar *const login, const gchar *const recipient, int max_lines,
+    HistoryRead *read)
 {
     GSList *history = NULL;
+
     GDateTime *now = g_date_time_new_now_local();
     GDateTime *log_date = g_date_time_new(tz,
         g_date_time_get_year(session_started),
@@ -457,121 +953,1179 @@ chat_log_get_previous(const gchar *const login, const gchar *const recipient)
         g_date_time_get_minute(session_started),
         g_date_time_get_second(session_started));
 
-    // get data from all logs from the day the session was started to today
+    // list the days from the session start to today, newest first
+    GSList *dates = NULL;
     while (g_date_time_compare(log_date, now) != 1) {
-        char *filename = _get_log_filename(recipient, login, log_date, FALSE);
-
-        FILE *logp = fopen(filename, "r");
-        if (logp) {
-            GString *header = g_string_new("");
-            g_string_append_printf(header, "%d/%d/%d:",
-                g_date_time_get_day_of_month(log_date),
-                g_date_time_get_month(log_date),
-                g_date_time_get_year(log_date));
-            history = g_slist_append(history, header->str);
-            g_string_free(header, FALSE);
-
-            char *line;
-            while ((line = prof_getline(logp)) != NULL) {
-                history = g_slist_append(history, line);
+        dates = g_slist_prepend(dates, log_date);
+        log_date = g_date_time_add_days(log_date, 1);
+    }
+    g_date_time_unref(log_date);
+    g_date_time_unref(now);
+
+    // read each day from its end until the window is full, a day may
+    // have both a text and a binary log if the format was changed
+    int remaining = max_lines;
+    GSList *curr = dates;
+    while (curr && remaining > 0) {
+        GDateTime *date = curr->data;
+        char *filename = _get_log_filename(recipient, login, date, FALSE);
+
+        // the current file of a day is the newest, then any parts rolled
+        // off it when it grew too large, newest part first
+        int parts = _log_part_count(filename);
+        int i;
+        for (i = 0; i <= parts && remaining > 0; i++) {
+            char *part_filename = i == 0 ? strdup(filename) : _log_part_filename(filename, parts - i + 1);
+            GSList *entries = _chat_log_text_entries(part_filename, date, recipient, remaining);
+
+            char *bin_filename = _binary_log_filename(part_filename);
+            GSList *bin_entries = _binary_log_read(bin_filename);
+            free(bin_filename);
+            free(part_filename);
+
+            if (bin_entries) {
+                entries = g_slist_sort(g_slist_concat(entries, bin_entries), (GCompareFunc)_entry_cmp);
+                entries = _entries_tail(entries, remaining);
             }
 
-            fclose(logp);
+            if (entries) {
+                remaining -= g_slist_length(entries);
+                if (read) {
+                    _history_page_push(read, entries, FALSE);
+                } else {
+                    history = g_slist_concat(entries, history);
+                }
+            }
         }
-
         free(filename);
 
-        GDateTime *next = g_date_time_add_days(log_date, 1);
-        g_date_time_unref(log_date);
-        log_date = next;
+        curr = g_slist_next(curr);
     }
 
-    g_date_time_unref(log_date);
-    g_date_time_unref(now);
+    g_slist_free_full(dates, (GDestroyNotify)g_date_time_unref);
+
+    if (read) {
+        _history_page_push(read, NULL, TRUE);
+    }
 
     return history;
 }
 
-void
-chat_log_close(void)
+// export matching messages from every account's chat logs
+int
+chat_log_export(const LogExport *const export, FILE *out)
 {
-    g_hash_table_destroy(logs);
-    g_hash_table_destroy(groupchat_logs);
-    g_date_time_unref(session_started);
+    gchar *chatlogs_dir = _get_chatlog_dir();
+    int written = log_export_run(chatlogs_dir, export, out);
+    g_free(chatlogs_dir);
+
+    return written;
 }
 
-static struct dated_chat_log*
-_create_log(const char *const other, const char *const login)
+// called periodically from the main loop, and before chat logs are read
+void
+chat_log_flush(void)
 {
-    GDateTime *now = g_date_time_new_now_local();
-    char *filename = _get_log_filename(other, login, now, TRUE);
-
-    struct dated_chat_log *new_log = malloc(sizeof(struct dated_chat_log));
-    new_log->filename = strdup(filename);
-    new_log->date = now;
-
-    free(filename);
+    GHashTableIter iter;
+    gpointer value;
+
+    if (logs) {
+        g_hash_table_iter_init(&iter, logs);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            struct dated_chat_log *dated_log = value;
+            if (dated_log->logp) {
+                _log_record_push(LOG_RECORD_FLUSH, dated_log->logp, NULL);
+            }
+        }
+    }
 
-    return new_log;
+    if (groupchat_logs) {
+        g_hash_table_iter_init(&iter, groupchat_logs);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            struct dated_chat_log *dated_log = value;
+            if (dated_log->logp) {
+                _log_record_push(LOG_RECORD_FLUSH, dated_log->logp, NULL);
+            }
+        }
+    }
 }
 
-static struct dated_chat_log*
-_create_groupchat_log(char *room, const char *const login)
+// called periodically from the main loop, applies the retention policy to
+// one log directory at a time and goes through them all at most once a day
+void
+chat_log_retention(void)
 {
-    GDateTime *now = g_date_time_new_now_local();
-    char *filename = _get_groupchat_log_filename(room, login, now, TRUE);
+    LogRetention policy = {
+        prefs_get_log_retention("maxage"),
+        prefs_get_log_retention("maxsize"),
+        prefs_get_log_retention("archive")
+    };
+    if (policy.max_age_days <= 0 && policy.max_size <= 0 && policy.archive_days <= 0) {
+        return;
+    }
 
-    struct dated_chat_log *new_log = malloc(sizeof(struct dated_chat_log));
-    new_log->filename = strdup(filename);
-    new_log->date = now;
+    // the last directory is still being worked on by the writer
+    _retention_runs_process();
+    if (retention_running) {
+        return;
+    }
 
-    free(filename);
+    GDateTime *now = g_date_time_new_now_local();
+    gint today = g_date_time_get_year(now) * 1000 + g_date_time_get_day_of_year(now);
+    gboolean changed = policy.max_age_days != retention_policy.max_age_days ||
+        policy.max_size != retention_policy.max_size || policy.archive_days != retention_policy.archive_days;
+    if (changed || (retention_dirs == NULL && retention_day != today)) {
+        g_slist_free_full(retention_dirs, g_free);
+        retention_dirs = _retention_dirs();
+        retention_day = today;
+        retention_policy = policy;
+    }
 
-    return new_log;
-}
+    if (retention_dirs) {
+        // close logs still open from an earlier day before their files
+        // can be removed, they are reopened on the next message, the
+        // closes are queued ahead of the run so the writer does them first
+        if (logs) {
+            g_hash_table_foreach_remove(logs, (GHRFunc)_chat_log_stale, NULL);
+        }
+        if (groupchat_logs) {
+            g_hash_table_foreach_remove(groupchat_logs, (GHRFunc)_chat_log_stale, NULL);
+        }
 
-static gboolean
-_log_roll_needed(struct dated_chat_log *dated_log)
-{
-    gboolean result = FALSE;
-    GDateTime *now = g_date_time_new_now_local();
-    if (g_date_time_get_day_of_year(dated_log->date) !=
-            g_date_time_get_day_of_year(now)) {
-        result = TRUE;
+        // deleting and compressing files is left to the writer thread
+        RetentionRun *run = malloc(sizeof(RetentionRun));
+        run->dir = retention_dirs->data;
+        run->policy = policy;
+        run->now = g_date_time_ref(now);
+        run->gone = NULL;
+        run->changed = 0;
+        retention_dirs = g_slist_delete_link(retention_dirs, retention_dirs);
+        retention_running = TRUE;
+
+        LogRecord record = { LOG_RECORD_RETENTION, NULL, NULL, 0, NULL, run };
+        _log_record_queue(&record);
     }
     g_date_time_unref(now);
-
-    return result;
 }
 
+// back on the main thread, the search postings of the files removed or
+// archived are dropped
 static void
-_free_chat_log(struct dated_chat_log *dated_log)
+_retention_runs_process(void)
 {
-    if (dated_log) {
-        if (dated_log->filename) {
-            g_free(dated_log->filename);
-            dated_log->filename = NULL;
+    if (retention_runs == NULL) {
+        return;
+    }
+
+    RetentionRun *run = NULL;
+    while ((run = g_async_queue_try_pop(retention_runs))) {
+        retention_running = FALSE;
+        if (run->changed > 0) {
+            log_info("Log retention removed or archived %d files in %s", run->changed, run->dir);
         }
-        if (dated_log->date) {
-            g_date_time_unref(dated_log->date);
-            dated_log->date = NULL;
+
+        if (history_index) {
+            size_t dir_len = strlen(history_index_dir);
+            GSList *curr = run->gone;
+            while (curr) {
+                const char *path = curr->data;
+                if (strncmp(path, history_index_dir, dir_len) == 0 && path[dir_len] == '/') {
+                    history_index_remove(history_index, path + dir_len + 1);
+                }
+                curr = g_slist_next(curr);
+            }
         }
-        free(dated_log);
+        _retention_run_free(run);
     }
 }
 
-static
-gboolean _key_equals(void *key1, void *key2)
+static void
+_retention_run_free(RetentionRun *run)
 {
-    gchar *str1 = (gchar *) key1;
-    gchar *str2 = (gchar *) key2;
-
-    return (g_strcmp0(str1, str2) == 0);
+    g_free(run->dir);
+    g_date_time_unref(run->now);
+    g_slist_free_full(run->gone, g_free);
+    free(run);
 }
 
-static char*
-_get_log_filename(const char *const other, const char *const login, GDateTime *dt, gboolean create)
-{
+void
+chat_log_close(void)
+{
+    // history reads still queued need the log state below
+    _log_queue_drain();
+    HistoryPage *page = NULL;
+    while ((page = g_async_queue_try_pop(history_pages))) {
+        _history_page_free(page);
+    }
+    g_async_queue_unref(history_pages);
+    history_pages = NULL;
+    history_reads = 0;
+
+    RetentionRun *run = NULL;
+    while ((run = g_async_queue_try_pop(retention_runs))) {
+        _retention_run_free(run);
+    }
+    g_async_queue_unref(retention_runs);
+    retention_runs = NULL;
+    retention_running = FALSE;
+
+    g_slist_free_full(retention_dirs, g_free);
+    retention_dirs = NULL;
+
+    g_hash_table_destroy(logs);
+    g_hash_table_destroy(groupchat_logs);
+    g_hash_table_destroy(groupchat_last_times);
+    g_hash_table_destroy(log_written);
+    log_written = NULL;
+    g_date_time_unref(session_started);
+
+    history_index_close(history_index);
+    history_index = NULL;
+    g_free(history_index_login);
+    history_index_login = NULL;
+    g_free(history_index_dir);
+    history_index_dir = NULL;
+}
+
+GSList*
+chat_log_search(const gchar *const login, const gchar *const query, int max_results)
+{
+    // search reads matching lines back from the logs
+    chat_log_flush();
+    _log_queue_drain();
+
+    return history_index_search(_history_index_for(login), query, max_results);
+}
+
+// convert the text chat logs of an account to the binary format, the
+// text logs are kept with a .bak suffix
+int
+chat_log_convert(const gchar *const login)
+{
+    chat_log_flush();
+    _log_queue_drain();
+
+    gchar *chatlogs_dir = _get_chatlog_dir();
+    gchar *login_dir = str_replace(login, "@", "_at_");
+    gchar *account_dir = g_strdup_printf("%s/%s", chatlogs_dir, login_dir);
+    free(login_dir);
+    free(chatlogs_dir);
+
+    int converted = 0;
+    GDir *dir = g_dir_open(account_dir, 0, NULL);
+    if (dir == NULL) {
+        g_free(account_dir);
+        return 0;
+    }
+
+    const gchar *contact_dir;
+    while ((contact_dir = g_dir_read_name(dir)) != NULL) {
+        if (contact_dir[0] == '.' || strcmp(contact_dir, "rooms") == 0) {
+            continue;
+        }
+
+        gchar *contact_path = g_strdup_printf("%s/%s", account_dir, contact_dir);
+        char *contact = str_replace(contact_dir, "_at_", "@");
+        GDir *logs_dir = g_dir_open(contact_path, 0, NULL);
+        const gchar *log_name;
+        while (logs_dir && (log_name = g_dir_read_name(logs_dir)) != NULL) {
+            int year, month, day;
+            if (!g_str_has_suffix(log_name, ".log") || sscanf(log_name, "%4d_%2d_%2d", &year, &month, &day) != 3) {
+                continue;
+            }
+
+            gchar *text_file = g_strdup_printf("%s/%s", contact_path, log_name);
+            char *bin_file = _binary_log_filename(text_file);
+            GDateTime *date = g_date_time_new_local(year, month, day, 0, 0, 0);
+            if (date && !g_file_test(bin_file, G_FILE_TEST_EXISTS) &&
+                    binlog_convert_file(text_file, bin_file, date, contact)) {
+                gchar *bak_file = g_strdup_printf("%s.bak", text_file);
+                gchar *idx_file = g_strdup_printf("%s.idx", text_file);
+                g_rename(text_file, bak_file);
+                g_unlink(idx_file);
+                g_free(bak_file);
+                g_free(idx_file);
+                converted++;
+            }
+            if (date) {
+                g_date_time_unref(date);
+            }
+            free(bin_file);
+            g_free(text_file);
+        }
+        if (logs_dir) {
+            g_dir_close(logs_dir);
+        }
+        free(contact);
+        g_free(contact_path);
+    }
+    g_dir_close(dir);
+    g_free(account_dir);
+
+    return converted;
+}
+
+int
+chat_log_index_all(const gchar *const login)
+{
+    chat_log_flush();
+    _log_queue_drain();
+
+    return history_index_scan(_history_index_for(login));
+}
+
+static struct dated_chat_log*
+_create_log(const char *const other, const char *const login)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    char *filename = _get_log_filename(other, login, now, TRUE);
+
+    struct dated_chat_log *new_log = malloc(sizeof(struct dated_chat_log));
+    new_log->binary = prefs_get_boolean(PREF_LOG_BINARY);
+    new_log->filename = new_log->binary ? _binary_log_filename(filename) : strdup(filename);
+    new_log->date = now;
+    _open_chat_log(new_log);
+
+    free(filename);
+
+    return new_log;
+}
+
+static struct dated_chat_log*
+_create_groupchat_log(char *room, const char *const login)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    char *filename = _get_groupchat_log_filename(room, login, now, TRUE);
+
+    struct dated_chat_log *new_log = malloc(sizeof(struct dated_chat_log));
+    new_log->binary = FALSE;
+    new_log->filename = strdup(filename);
+    new_log->date = now;
+    _open_chat_log(new_log);
+
+    free(filename);
+
+    return new_log;
+}
+
+static gboolean
+_log_roll_needed(struct dated_chat_log *dated_log)
+{
+    gboolean result = FALSE;
+    GDateTime *now = g_date_time_new_now_local();
+    if (g_date_time_get_day_of_year(dated_log->date) !=
+            g_date_time_get_day_of_year(now)) {
+        result = TRUE;
+    }
+    g_date_time_unref(now);
+
+    return result;
+}
+
+// start a new file once a day's log reaches the size limit, the full one
+// is kept as the next numbered part of the day, e.g. 2016_01_31.1.log
+static void
+_log_roll_size(struct dated_chat_log *dated_log)
+{
+    gint max_size = prefs_get_max_chat_log_size();
+    if (max_size <= 0 || dated_log->logp == NULL || dated_log->size < max_size) {
+        return;
+    }
+
+    int part = _log_part_count(dated_log->filename) + 1;
+    char *part_filename = _log_part_filename(dated_log->filename, part);
+
+    _log_record_push(LOG_RECORD_CLOSE, dated_log->logp, NULL);
+    dated_log->logp = NULL;
+
+    // history reads queued before the roll may have the file open, let
+    // them finish before it is renamed
+    _log_queue_drain();
+    g_rename(dated_log->filename, part_filename);
+
+    // the offset index stays valid for the renamed file
+    gchar *idx_filename = g_strdup_printf("%s.idx", dated_log->filename);
+    gchar *part_idx_filename = g_strdup_printf("%s.idx", part_filename);
+    g_rename(idx_filename, part_idx_filename);
+    g_free(idx_filename);
+    g_free(part_idx_filename);
+
+    // and so do the search postings, they now point at the part
+    if (history_index) {
+        size_t dir_len = strlen(history_index_dir);
+        if (strncmp(dated_log->filename, history_index_dir, dir_len) == 0 && dated_log->filename[dir_len] == '/'
+                && strncmp(part_filename, history_index_dir, dir_len) == 0) {
+            history_index_rename(history_index, dated_log->filename + dir_len + 1, part_filename + dir_len + 1);
+        }
+    }
+    free(part_filename);
+
+    _open_chat_log(dated_log);
+}
+
+static char*
+_log_part_filename(const char *const filename, int part)
+{
+    const char *ext = strrchr(filename, '.');
+    if (ext == NULL || strchr(ext, '/')) {
+        ext = filename + strlen(filename);
+    }
+
+    GString *part_file = g_string_new_len(filename, ext - filename);
+    g_string_append_printf(part_file, ".%d%s", part, ext);
+
+    char *result = strdup(part_file->str);
+    g_string_free(part_file, TRUE);
+
+    return result;
+}
+
+// the number of parts rolled off a text log or its binary log
+static int
+_log_part_count(const char *const filename)
+{
+    char *bin_filename = _binary_log_filename(filename);
+    int count = 0;
+    while (TRUE) {
+        char *part_filename = _log_part_filename(filename, count + 1);
+        char *bin_part_filename = _log_part_filename(bin_filename, count + 1);
+        gboolean exists = _log_file_exists(part_filename) || _log_file_exists(bin_part_filename);
+        free(part_filename);
+        free(bin_part_filename);
+        if (!exists) {
+            break;
+        }
+        count++;
+    }
+    free(bin_filename);
+
+    return count;
+}
+
+static void
+_open_chat_log(struct dated_chat_log *dated_log)
+{
+    dated_log->logp = fopen(dated_log->filename, dated_log->binary ? "ab" : "a");
+    dated_log->size = 0;
+    if (dated_log->logp) {
+        g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+        fseek(dated_log->logp, 0, SEEK_END);
+        dated_log->size = ftell(dated_log->logp);
+    } else {
+        log_error("Error opening file %s, errno = %d", dated_log->filename, errno);
+    }
+}
+
+static void
+_binary_log_write(struct dated_chat_log *dated_log, BinlogEntry *entry)
+{
+    GString *out = g_string_new("");
+    if (dated_log->size == 0) {
+        g_string_append_len(out, BINLOG_MAGIC, BINLOG_MAGIC_LEN);
+    }
+    binlog_encode(entry, out);
+
+    gsize len = out->len;
+    dated_log->size += len;
+    _log_record_push_len(LOG_RECORD_WRITE, dated_log->logp, g_string_free(out, FALSE), len);
+}
+
+static HistoryIndex
+_history_index_for(const char *const login)
+{
+    if (history_index && g_strcmp0(login, history_index_login) == 0) {
+        return history_index;
+    }
+
+    gchar *chatlogs_dir = _get_chatlog_dir();
+    gchar *login_dir = str_replace(login, "@", "_at_");
+    gchar *dir = g_strdup_printf("%s/%s", chatlogs_dir, login_dir);
+    free(login_dir);
+    free(chatlogs_dir);
+
+    history_index_close(history_index);
+    g_free(history_index_login);
+    g_free(history_index_dir);
+    history_index = history_index_open(dir);
+    history_index_login = g_strdup(login);
+    history_index_dir = dir;
+
+    return history_index;
+}
+
+static void
+_history_index_add(const char *const login, struct dated_chat_log *dated_log, const char *const line)
+{
+    HistoryIndex index = _history_index_for(login);
+    size_t dir_len = strlen(history_index_dir);
+    if (strncmp(dated_log->filename, history_index_dir, dir_len) == 0 && dated_log->filename[dir_len] == '/') {
+        history_index_add(index, dated_log->filename + dir_len + 1, dated_log->size, line);
+    }
+    dated_log->size += strlen(line);
+}
+
+static void
+_log_written_add(const char *const jid, long bytes)
+{
+    if (log_written == NULL || bytes <= 0) {
+        return;
+    }
+
+    gpointer key = NULL;
+    gpointer value = NULL;
+    if (g_hash_table_lookup_extended(log_written, jid, &key, &value)) {
+        guint64 *written = value;
+        *written += bytes;
+    } else {
+        guint64 *written = malloc(sizeof(guint64));
+        *written = bytes;
+        g_hash_table_insert(log_written, strdup(jid), written);
+    }
+}
+
+static void
+_write_done(struct dated_chat_log *dated_log)
+{
+    if (prefs_get_boolean(PREF_LOG_FLUSH)) {
+        _log_record_push(LOG_RECORD_FLUSH, dated_log->logp, NULL);
+    }
+}
+
+static void
+_free_chat_log(struct dated_chat_log *dated_log)
+{
+    if (dated_log) {
+        if (dated_log->logp) {
+            _log_record_push(LOG_RECORD_CLOSE, dated_log->logp, NULL);
+            dated_log->logp = NULL;
+        }
+        if (dated_log->filename) {
+            g_free(dated_log->filename);
+            dated_log->filename = NULL;
+        }
+        if (dated_log->date) {
+            g_date_time_unref(dated_log->date);
+            dated_log->date = NULL;
+        }
+        free(dated_log);
+    }
+}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+static gpointer
+_log_writer(gpointer data)
+{
+    g_mutex_lock(&queue_lock);
+    while (TRUE) {
+        while ((queue_head == queue_tail) && writer_running) {
+            g_cond_wait(&queue_changed, &queue_lock);
+        }
+        if (queue_head == queue_tail) {
+            break;
+        }
+
+        // write everything queued so far before waiting again
+        gint head = queue_head;
+        gint tail = queue_tail;
+        g_mutex_unlock(&queue_lock);
+        while (head != tail) {
+            if (_log_record_run(&log_queue[head]) == EOF) {
+                g_atomic_int_inc(&writer_errors);
+            }
+            head = (head + 1) % LOG_QUEUE_SIZE;
+        }
+        g_mutex_lock(&queue_lock);
+        g_atomic_int_set(&queue_head, head);
+        g_cond_broadcast(&queue_changed);
+    }
+    g_mutex_unlock(&queue_lock);
+
+    return NULL;
+}
+#endif
+
+// start writing log files from a background thread
+void
+log_async_start(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (writer_thread) {
+        return;
+    }
+
+    g_atomic_int_set(&writer_running, 1);
+    writer_thread = g_thread_new("log writer", _log_writer, NULL);
+    log_info("Started log writer thread");
+#else
+    log_warning("Asynchronous logging requires glib 2.32 or later");
+#endif
+}
+
+// write out everything queued and stop the writer thread
+void
+log_async_stop(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (writer_thread == NULL) {
+        return;
+    }
+
+    g_mutex_lock(&queue_lock);
+    g_atomic_int_set(&writer_running, 0);
+    g_cond_broadcast(&queue_changed);
+    g_mutex_unlock(&queue_lock);
+    g_thread_join(writer_thread);
+    writer_thread = NULL;
+#endif
+}
+
+gboolean
+log_async_running(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    return writer_thread != NULL;
+#else
+    return FALSE;
+#endif
+}
+
+int
+log_async_queue_depth(void)
+{
+    gint head = g_atomic_int_get(&queue_head);
+    gint tail = g_atomic_int_get(&queue_tail);
+
+    return (tail - head + LOG_QUEUE_SIZE) % LOG_QUEUE_SIZE;
+}
+
+guint
+log_async_queue_full_count(void)
+{
+    return queue_full_count;
+}
+
+int
+log_async_error_count(void)
+{
+    return g_atomic_int_get(&writer_errors);
+}
+
+static void
+_log_record_push(log_record_type_t type, FILE *fp, gchar *line)
+{
+    _log_record_push_len(type, fp, line, line ? strlen(line) : 0);
+}
+
+static void
+_log_record_push_len(log_record_type_t type, FILE *fp, gchar *line, gsize len)
+{
+    LogRecord record = { type, fp, line, len, NULL, NULL };
+    _log_record_queue(&record);
+}
+
+static void
+_log_record_queue(LogRecord *record)
+{
+    if (!log_async_running()) {
+        if (_log_record_run(record) == EOF && record->type == LOG_RECORD_CLOSE) {
+            log_error("Error closing log file, errno = %d", errno);
+        }
+        return;
+    }
+
+#if GLIB_CHECK_VERSION(2,32,0)
+    g_mutex_lock(&queue_lock);
+    gint tail = queue_tail;
+    gint next = (tail + 1) % LOG_QUEUE_SIZE;
+    if (next == queue_head) {
+        queue_full_count++;
+        while (next == queue_head) {
+            g_cond_wait(&queue_changed, &queue_lock);
+        }
+    }
+
+    log_queue[tail] = *record;
+    g_atomic_int_set(&queue_tail, next);
+    g_cond_broadcast(&queue_changed);
+    g_mutex_unlock(&queue_lock);
+#endif
+}
+
+static int
+_log_record_run(LogRecord *record)
+{
+    gint64 start = stats_start();
+    gint64 trace = trace_start();
+    watchdog_tag(WATCHDOG_DISK);
+    int result = 0;
+
+    switch (record->type) {
+        case LOG_RECORD_WRITE:
+            if (fwrite(record->line, 1, record->len, record->fp) != record->len) {
+                result = EOF;
+            }
+            g_free(record->line);
+            record->line = NULL;
+            break;
+        case LOG_RECORD_FLUSH:
+            result = fflush(record->fp);
+            break;
+        case LOG_RECORD_CLOSE:
+            result = fclose(record->fp);
+            break;
+        case LOG_RECORD_COMPRESS:
+        {
+            // gzip runs in its own process, double forked so it is reaped
+            gchar *argv[] = { "gzip", "-f", record->line, NULL };
+            if (!g_spawn_async(NULL, argv, NULL,
+                    G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                    NULL, NULL, NULL, NULL)) {
+                result = EOF;
+            }
+            g_free(record->line);
+            record->line = NULL;
+            break;
+        }
+        case LOG_RECORD_HISTORY:
+            _chat_log_read_previous(record->read->login, record->read->recipient, record->read->max_lines,
+                record->read);
+            record->read = NULL;
+            break;
+        case LOG_RECORD_RETENTION:
+            record->retention->changed = log_retention_apply(record->retention->dir, &record->retention->policy,
+                record->retention->now, &record->retention->gone);
+            g_async_queue_push(retention_runs, record->retention);
+            record->retention = NULL;
+            break;
+    }
+    trace_record(stats_name(STATS_LOG_IO), trace);
+    stats_record(STATS_LOG_IO, start);
+
+    return result;
+}
+
+// wait until the writer thread has written everything queued
+static void
+_log_queue_drain(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (!log_async_running()) {
+        return;
+    }
+
+    g_mutex_lock(&queue_lock);
+    while (queue_head != queue_tail) {
+        g_cond_wait(&queue_changed, &queue_lock);
+    }
+    g_mutex_unlock(&queue_lock);
+#endif
+}
+
+// the messages in the last max_lines lines of a text chat log
+static GSList*
+_chat_log_text_entries(const char *const filename, GDateTime *date, const char *const contact, int max_lines)
+{
+    GSList *lines = _chat_log_read_tail(filename, max_lines);
+    GSList *entries = NULL;
+
+    GSList *curr = lines;
+    while (curr) {
+        char *line = curr->data;
+        BinlogEntry *entry = binlog_parse_text_line(line, date, contact);
+        if (entry) {
+            entries = g_slist_prepend(entries, entry);
+
+        // continuation of a multi line message
+        } else if (entries) {
+            BinlogEntry *last = entries->data;
+            char *message = malloc(strlen(last->message) + strlen(line) + 2);
+            sprintf(message, "%s\n%s", last->message, line);
+            free(last->message);
+            last->message = message;
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(lines, free);
+
+    return g_slist_reverse(entries);
+}
+
+static GSList*
+_entries_tail(GSList *entries, int max_entries)
+{
+    int drop = (int)g_slist_length(entries) - max_entries;
+    while (drop-- > 0) {
+        binlog_entry_free(entries->data);
+        entries = g_slist_delete_link(entries, entries);
+    }
+
+    return entries;
+}
+
+static gint
+_entry_cmp(const BinlogEntry *a, const BinlogEntry *b)
+{
+    if (a->timestamp == b->timestamp) {
+        return 0;
+    }
+
+    return a->timestamp < b->timestamp ? -1 : 1;
+}
+
+// read at most max_lines lines from the end of a chat log, oldest first
+static GSList*
+_chat_log_read_tail(const char *const filename, int max_lines)
+{
+    FILE *logp = fopen(filename, "r");
+    if (logp == NULL) {
+        return _chat_log_read_archive_tail(filename, max_lines);
+    }
+
+    // the index lives next to the log, fall back to a temporary one if
+    // the chat log directory is not writable
+    gchar *idx_filename = g_strdup_printf("%s.idx", filename);
+    FILE *idxp = fopen(idx_filename, "r+b");
+    if (idxp == NULL) {
+        idxp = fopen(idx_filename, "w+b");
+    }
+    if (idxp == NULL) {
+        idxp = tmpfile();
+    }
+    g_free(idx_filename);
+    if (idxp == NULL) {
+        fclose(logp);
+        return NULL;
+    }
+
+    long start = 0;
+    long end = 0;
+    gboolean indexed = _chat_log_index(logp, idxp, max_lines, &start, &end);
+    fclose(idxp);
+    if (!indexed || end <= start) {
+        fclose(logp);
+        return NULL;
+    }
+
+    LogMap map;
+    if (!_log_map_open(logp, start, end, &map)) {
+        fclose(logp);
+        return NULL;
+    }
+    fclose(logp);
+
+    GSList *lines = NULL;
+    LogLine line;
+    size_t pos = 0;
+    while (_log_map_next_line(&map, &pos, &line)) {
+        lines = g_slist_prepend(lines, strndup(line.str, line.len));
+    }
+    _log_map_close(&map);
+
+    return g_slist_reverse(lines);
+}
+
+// the last max_lines lines of a log compressed by the retention policy
+static GSList*
+_chat_log_read_archive_tail(const char *const filename, int max_lines)
+{
+    gsize len = 0;
+    gchar *contents = log_archive_read(filename, &len);
+    if (contents == NULL) {
+        return NULL;
+    }
+
+    GSList *lines = NULL;
+    int count = 0;
+    gsize end = len;
+    if (end > 0 && contents[end - 1] == '\n') {
+        end--;
+    }
+    while (end > 0 && count < max_lines) {
+        const char *newline = g_strrstr_len(contents, end, "\n");
+        gsize start = newline ? (gsize)(newline - contents) + 1 : 0;
+        lines = g_slist_prepend(lines, strndup(contents + start, end - start));
+        count++;
+        if (start == 0) {
+            break;
+        }
+        end = start - 1;
+    }
+    g_free(contents);
+
+    return lines;
+}
+
+static GSList*
+_binary_log_read(const char *const filename)
+{
+    if (g_file_test(filename, G_FILE_TEST_EXISTS)) {
+        return binlog_read_file(filename);
+    }
+
+    gsize len = 0;
+    gchar *contents = log_archive_read(filename, &len);
+    if (contents == NULL) {
+        return NULL;
+    }
+    GSList *entries = binlog_read_data(contents, len);
+    g_free(contents);
+
+    return entries;
+}
+
+// every contact and room log directory of every account
+static GSList*
+_retention_dirs(void)
+{
+    gchar *chatlogs_dir = _get_chatlog_dir();
+    GSList *logins = _retention_subdirs(NULL, chatlogs_dir);
+    g_free(chatlogs_dir);
+
+    GSList *dirs = NULL;
+    GSList *curr = logins;
+    while (curr) {
+        dirs = _retention_subdirs(dirs, curr->data);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(logins, g_free);
+
+    // rooms are kept one level down, in a rooms directory of the account
+    GSList *result = NULL;
+    curr = dirs;
+    while (curr) {
+        char *dir = curr->data;
+        if (g_str_has_suffix(dir, "/rooms")) {
+            result = _retention_subdirs(result, dir);
+            g_free(dir);
+        } else {
+            result = g_slist_prepend(result, dir);
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(dirs);
+
+    return result;
+}
+
+static GSList*
+_retention_subdirs(GSList *dirs, const char *const dir)
+{
+    GDir *gdir = g_dir_open(dir, 0, NULL);
+    if (gdir == NULL) {
+        return dirs;
+    }
+
+    const gchar *name;
+    while ((name = g_dir_read_name(gdir)) != NULL) {
+        if (name[0] == '.') {
+            continue;
+        }
+        gchar *path = g_strdup_printf("%s/%s", dir, name);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            dirs = g_slist_prepend(dirs, path);
+        } else {
+            g_free(path);
+        }
+    }
+    g_dir_close(gdir);
+
+    return dirs;
+}
+
+static gboolean
+_chat_log_stale(gpointer key, struct dated_chat_log *dated_log, gpointer data)
+{
+    return _log_roll_needed(dated_log);
+}
+
+// whether a log exists, or has been archived
+static gboolean
+_log_file_exists(const char *const filename)
+{
+    if (g_file_test(filename, G_FILE_TEST_EXISTS)) {
+        return TRUE;
+    }
+
+    gchar *archive_filename = g_strdup_printf("%s.gz", filename);
+    gboolean result = g_file_test(archive_filename, G_FILE_TEST_EXISTS);
+    g_free(archive_filename);
+
+    return result;
+}
+
+// Bring the offset index for logp up to date and find the byte range
+// holding its last max_lines lines. The index is a header holding the
+// length of the log it covers, followed by the offset just past each
+// newline, so only lines written since the last read are scanned.
+static gboolean
+_chat_log_index(FILE *logp, FILE *idxp, int max_lines, long *start, long *end)
+{
+    if (fseek(logp, 0, SEEK_END) != 0) {
+        return FALSE;
+    }
+    long size = ftell(logp);
+
+    gint64 covered = 0;
+    long count = 0;
+    if (fseek(idxp, 0, SEEK_END) == 0) {
+        long idx_size = ftell(idxp);
+        rewind(idxp);
+        if (idx_size >= (long)sizeof(gint64) && fread(&covered, sizeof(gint64), 1, idxp) == 1) {
+            count = (idx_size - sizeof(gint64)) / sizeof(gint64);
+        }
+    }
+
+    // the log was truncated or replaced, start over
+    if (covered > size || covered < 0) {
+        covered = 0;
+        count = 0;
+        fflush(idxp);
+        if (ftruncate(fileno(idxp), 0) != 0) {
+            return FALSE;
+        }
+    }
+
+    if (covered < size) {
+        LogMap map;
+        if (!_log_map_open(logp, covered, size, &map)) {
+            return FALSE;
+        }
+        if (fseek(idxp, sizeof(gint64) + count * sizeof(gint64), SEEK_SET) != 0) {
+            _log_map_close(&map);
+            return FALSE;
+        }
+
+        gint64 scanned = covered;
+        LogLine line;
+        size_t pos = 0;
+        while (_log_map_next_line(&map, &pos, &line)) {
+            // a partially written last line is left for the next read
+            if (line.str + line.len == map.data + map.len) {
+                break;
+            }
+            gint64 offset = scanned + pos;
+            if (fwrite(&offset, sizeof(gint64), 1, idxp) != 1) {
+                _log_map_close(&map);
+                return FALSE;
+            }
+            count++;
+            covered = offset;
+        }
+        _log_map_close(&map);
+
+        rewind(idxp);
+        if (fwrite(&covered, sizeof(gint64), 1, idxp) != 1) {
+            return FALSE;
+        }
+    }
+
+    gint64 first = 0;
+    if (count > max_lines) {
+        if (fseek(idxp, sizeof(gint64) + (count - max_lines - 1) * sizeof(gint64), SEEK_SET) != 0 ||
+                fread(&first, sizeof(gint64), 1, idxp) != 1) {
+            return FALSE;
+        }
+    }
+
+    *start = first;
+    *end = covered;
+
+    return TRUE;
+}
+
+// map bytes start to end of fp, reading them instead if mmap is
+// unavailable or fails
+static gboolean
+_log_map_open(FILE *fp, long start, long end, LogMap *map)
+{
+    map->data = NULL;
+    map->len = end - start;
+    map->base = NULL;
+    map->base_len = 0;
+
+    if (map->len == 0) {
+        return TRUE;
+    }
+
+#ifdef HAVE_MMAP
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size > 0) {
+        long map_start = start - (start % page_size);
+        size_t base_len = end - map_start;
+        void *base = mmap(NULL, base_len, PROT_READ, MAP_PRIVATE, fileno(fp), map_start);
+        if (base != MAP_FAILED) {
+            map->base = base;
+            map->base_len = base_len;
+            map->data = (const char *)base + (start - map_start);
+            return TRUE;
+        }
+    }
+#endif
+
+    char *buf = malloc(map->len);
+    if (buf == NULL) {
+        return FALSE;
+    }
+    if (fseek(fp, start, SEEK_SET) != 0 || fread(buf, 1, map->len, fp) != map->len) {
+        free(buf);
+        return FALSE;
+    }
+    map->data = buf;
+
+    return TRUE;
+}
+
+static void
+_log_map_close(LogMap *map)
+{
+#ifdef HAVE_MMAP
+    if (map->base) {
+        munmap(map->base, map->base_len);
+        map->base = NULL;
+        map->data = NULL;
+        return;
+    }
+#endif
+    free((char *)map->data);
+    map->data = NULL;
+}
+
+// find the next line at or after pos, leaving pos just past its newline
+static gboolean
+_log_map_next_line(LogMap *map, size_t *pos, LogLine *line)
+{
+    if (*pos >= map->len) {
+        return FALSE;
+    }
+
+    const char *str = map->data + *pos;
+    size_t remaining = map->len - *pos;
+    const char *nl = memchr(str, '\n', remaining);
+
+    line->str = str;
+    if (nl) {
+        line->len = nl - str;
+        *pos += line->len + 1;
+    } else {
+        line->len = remaining;
+        *pos = map->len;
+    }
+
+    return TRUE;
+}
+
+static
+gboolean _key_equals(void *key1, void *key2)
+{
+    gchar *str1 = (gchar *) key1;
+    gchar *str2 = (gchar *) key2;
+
+    return (g_strcmp0(str1, str2) == 0);
+}
+
+static char*
+_get_log_filename(const char *const other, const char *const login, GDateTime *dt, gboolean create)
+{
     gchar *chatlogs_dir = _get_chatlog_dir();
     GString *log_file = g_string_new(chatlogs_dir);
     free(chatlogs_dir);
@@ -600,6 +2154,87 @@ _get_log_filename(const char *const other, const char *const login, GDateTime *d
     return result;
 }
 
+// the time of the last line in the room's latest log, only the tail
+// of the file is read
+static GDateTime*
+_groupchat_log_read_last_time(const char *const login, const char *const room)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    char *filename = _get_groupchat_log_filename(room, login, now, FALSE);
+    g_date_time_unref(now);
+    gchar *room_dir = g_path_get_dirname(filename);
+    free(filename);
+
+    GDir *dir = g_dir_open(room_dir, 0, NULL);
+    if (dir == NULL) {
+        g_free(room_dir);
+        return NULL;
+    }
+
+    // logs are named by date, so the greatest name is the latest
+    gchar *latest = NULL;
+    int year = 0, month = 0, day = 0;
+    const gchar *name = g_dir_read_name(dir);
+    while (name) {
+        int y, m, d;
+        if (strlen(name) == 14 && g_str_has_suffix(name, ".log")
+                && sscanf(name, "%4d_%2d_%2d", &y, &m, &d) == 3
+                && g_strcmp0(name, latest) > 0) {
+            g_free(latest);
+            latest = g_strdup(name);
+            year = y;
+            month = m;
+            day = d;
+        }
+        name = g_dir_read_name(dir);
+    }
+    g_dir_close(dir);
+
+    if (latest == NULL) {
+        g_free(room_dir);
+        return NULL;
+    }
+
+    gchar *path = g_build_filename(room_dir, latest, NULL);
+    g_free(room_dir);
+    g_free(latest);
+
+    FILE *fp = fopen(path, "r");
+    g_free(path);
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    char tail[4096];
+    size_t len = 0;
+    if (fseek(fp, -(long)(sizeof(tail) - 1), SEEK_END) != 0) {
+        rewind(fp);
+    }
+    len = fread(tail, 1, sizeof(tail) - 1, fp);
+    fclose(fp);
+    tail[len] = '\0';
+
+    // messages can span lines, find the last line starting with a time
+    GDateTime *result = NULL;
+    char *line = tail;
+    while (line) {
+        int h, m, s;
+        if (strlen(line) > 11 && line[2] == ':' && line[5] == ':' && strncmp(line + 8, " - ", 3) == 0
+                && sscanf(line, "%2d:%2d:%2d", &h, &m, &s) == 3) {
+            if (result) {
+                g_date_time_unref(result);
+            }
+            result = g_date_time_new_local(year, month, day, h, m, s);
+        }
+        line = strchr(line, '\n');
+        if (line) {
+            line++;
+        }
+    }
+
+    return result;
+}
+
 static char*
 _get_groupchat_log_filename(const char *const room, const char *const login, GDateTime *dt, gboolean create)
 {
@@ -636,6 +2271,22 @@ _get_groupchat_log_filename(const char *const room, const char *const login, GDa
     return result;
 }
 
+// binary logs sit next to the text logs, as <date>.plog
+static char*
+_binary_log_filename(const char *const filename)
+{
+    GString *bin_file = g_string_new(filename);
+    if (g_str_has_suffix(bin_file->str, ".log")) {
+        g_string_truncate(bin_file, bin_file->len - 4);
+    }
+    g_string_append(bin_file, ".plog");
+
+    char *result = strdup(bin_file->str);
+    g_string_free(bin_file, TRUE);
+
+    return result;
+}
+
 static gchar*
 _get_chatlog_dir(void)
 {
@@ -691,7 +2342,6 @@ log_stderr_handler(void)
     char * const buf = stderr_buf;
     ssize_t size;
     int retry = 0;
-    int i;
 
     if (!stderr_inited)
         return;
@@ -703,13 +2353,16 @@ log_stderr_handler(void)
         if (size <= 0 || retry++ >= STDERR_RETRY_NR)
             break;
 
-        for (i = 0; i < size; ++i) {
-            if (buf[i] == '\n') {
-                log_msg(stderr_level, "stderr", s->str);
-                g_string_assign(s, "");
-            } else
-                g_string_append_c(s, buf[i]);
+        const char *curr = buf;
+        const char *const end = buf + size;
+        const char *newline = NULL;
+        while ((newline = memchr(curr, '\n', end - curr)) != NULL) {
+            g_string_append_len(s, curr, newline - curr);
+            log_msg(stderr_level, "stderr", s->str);
+            g_string_truncate(s, 0);
+            curr = newline + 1;
         }
+        g_string_append_len(s, curr, end - curr);
     } while (1);
 
     if (s->len > 0 && s->str[0] != '\0') {
@@ -718,6 +2371,14 @@ log_stderr_handler(void)
     }
 }
 
+// the read end of the stderr pipe, for the main loop to wait on, -1 when
+// stderr is not being captured
+int
+log_stderr_fd(void)
+{
+    return stderr_inited ? stderr_pipe[0] : -1;
+}
+
 void
 log_stderr_init(log_level_t level)
 {
@@ -37,6 +37,8 @@
 
 #include "glib.h"
 
+#include "tools/log_export.h"
+
 // log levels
 typedef enum {
     PROF_LEVEL_DEBUG,
@@ -62,25 +64,57 @@ void log_error(const char *const msg, ...);
 void log_msg(log_level_t level, const char *const area, const char *const msg);
 log_level_t log_level_from_string(char *log_level);
 
+void log_async_start(void);
+void log_async_stop(void);
+gboolean log_async_running(void);
+int log_async_queue_depth(void);
+guint log_async_queue_full_count(void);
+int log_async_error_count(void);
+
+gboolean log_area_set(const char *const area, const char *const setting, const char *const value);
+void log_area_clear(const char *const area);
+GList* log_area_list(void);
+gchar* log_area_describe(const char *const area);
+
 void log_stderr_init(log_level_t level);
 void log_stderr_close(void);
 void log_stderr_handler(void);
+int log_stderr_fd(void);
 
 void chat_log_init(void);
 
-void chat_log_msg_out(const char *const barejid, const char *const msg);
-void chat_log_otr_msg_out(const char *const barejid, const char *const msg);
-void chat_log_pgp_msg_out(const char *const barejid, const char *const msg);
+void chat_log_msg_out(const char *const barejid, const char *const msg, const char *const id);
+void chat_log_otr_msg_out(const char *const barejid, const char *const msg, const char *const id);
+void chat_log_pgp_msg_out(const char *const barejid, const char *const msg, const char *const id);
 
 void chat_log_msg_in(const char *const barejid, const char *const msg, GDateTime *timestamp);
 void chat_log_otr_msg_in(const char *const barejid, const char *const msg, gboolean was_decrypted, GDateTime *timestamp);
 void chat_log_pgp_msg_in(const char *const barejid, const char *const msg, GDateTime *timestamp);
 
+void chat_log_receipt(const char *const barejid, const char *const id);
+guint64 chat_log_written(const char *const jid);
+void chat_log_flush(void);
+void chat_log_retention(void);
 void chat_log_close(void);
-GSList* chat_log_get_previous(const gchar *const login, const gchar *const recipient);
+
+// the last max_lines logged messages as BinlogEntry, oldest first
+GSList* chat_log_get_previous(const gchar *const login, const gchar *const recipient, int max_lines);
+// the same read done in the background, func is called from
+// chat_log_history_process with each page of BinlogEntry, oldest first
+// within a page and the newest page first, entries are freed after
+typedef void (*ChatLogHistoryFunc)(const char *const recipient, GSList *entries, gboolean last, gpointer data);
+void chat_log_get_previous_async(const gchar *const login, const gchar *const recipient, int max_lines,
+    ChatLogHistoryFunc func, gpointer data);
+void chat_log_history_process(void);
+gboolean chat_log_history_pending(void);
+GSList* chat_log_search(const gchar *const login, const gchar *const query, int max_results);
+int chat_log_index_all(const gchar *const login);
+int chat_log_convert(const gchar *const login);
+int chat_log_export(const LogExport *const export, FILE *out);
 
 void groupchat_log_init(void);
 void groupchat_log_chat(const gchar *const login, const gchar *const room, const gchar *const nick,
     const gchar *const msg);
+GDateTime* groupchat_log_get_last_time(const gchar *const login, const gchar *const room);
 
 #endif
@@ -34,6 +34,7 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <glib.h>
 
@@ -43,11 +44,63 @@
 
 #include "profanity.h"
 #include "common.h"
+#include "log.h"
 #include "command/command.h"
+#include "tools/trace.h"
 
 static gboolean version = FALSE;
 static char *log = "INFO";
 static char *account_name = NULL;
+static char *bench_input = NULL;
+static char *bench_events = NULL;
+static char *bench_stanzas = NULL;
+static gboolean bench_realtime = FALSE;
+static gboolean startup_profile = FALSE;
+static gboolean headless = FALSE;
+static char *ipc_path = NULL;
+static char *trace_file = NULL;
+static gboolean export_logs = FALSE;
+static char *export_jid = NULL;
+static char *export_since = NULL;
+static char *export_until = NULL;
+static char *export_grep = NULL;
+
+// write the matching chat log messages to stdout
+static int
+_export_logs(void)
+{
+    LogExport export = { account_name, export_jid, 0, 0, NULL, 0 };
+
+    if (export_since && (export.from_day = log_export_parse_day(export_since)) == 0) {
+        g_print("Invalid date for --export-since, use YYYY-MM-DD: %s\n", export_since);
+        return 1;
+    }
+    if (export_until && (export.to_day = log_export_parse_day(export_until)) == 0) {
+        g_print("Invalid date for --export-until, use YYYY-MM-DD: %s\n", export_until);
+        return 1;
+    }
+
+    if (export_grep) {
+        GError *error = NULL;
+        export.regex = g_regex_new(export_grep, G_REGEX_OPTIMIZE, 0, &error);
+        if (export.regex == NULL) {
+            g_print("Invalid regular expression for --export-grep: %s\n", error->message);
+            g_error_free(error);
+            return 1;
+        }
+    }
+
+    int written = chat_log_export(&export, stdout);
+    if (export.regex) {
+        g_regex_unref(export.regex);
+    }
+    if (written < 0) {
+        g_print("No chat logs found\n");
+        return 1;
+    }
+
+    return 0;
+}
 
 int
 main(int argc, char **argv)
@@ -62,6 +115,19 @@ main(int argc, char **argv)
         { "version", 'v', 0, G_OPTION_ARG_NONE, &version, "Show version information", NULL },
         { "account", 'a', 0, G_OPTION_ARG_STRING, &account_name, "Auto connect to an account on startup" },
         { "log",'l', 0, G_OPTION_ARG_STRING, &log, "Set logging levels, DEBUG, INFO (default), WARN, ERROR", "LEVEL" },
+        { "bench", 0, 0, G_OPTION_ARG_FILENAME, &bench_input, "Replay input lines offline and report stage latencies", "FILE" },
+        { "bench-events", 0, 0, G_OPTION_ARG_FILENAME, &bench_events, "Replay server events offline before any --bench input", "FILE" },
+        { "bench-stanzas", 0, 0, G_OPTION_ARG_FILENAME, &bench_stanzas, "Replay stanzas received in a log or XML console capture offline", "FILE" },
+        { "bench-realtime", 0, 0, G_OPTION_ARG_NONE, &bench_realtime, "Keep the time between stanzas in a --bench-stanzas log", NULL },
+        { "headless", 0, 0, G_OPTION_ARG_NONE, &headless, "Keep the session running without drawing to the terminal, stop with SIGTERM", NULL },
+        { "ipc", 0, 0, G_OPTION_ARG_FILENAME, &ipc_path, "Take input and send events as JSON lines on a Unix socket", "FILE" },
+        { "startup-profile", 0, 0, G_OPTION_ARG_NONE, &startup_profile, "Report the time taken by each stage of startup on exit", NULL },
+        { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_file, "Write main loop activity to a Chrome trace event file", "FILE" },
+        { "export-logs", 0, 0, G_OPTION_ARG_NONE, &export_logs, "Write chat log messages to stdout in time order, only for --account if given", NULL },
+        { "export-jid", 0, 0, G_OPTION_ARG_STRING, &export_jid, "Only export messages with this contact or room", "JID" },
+        { "export-since", 0, 0, G_OPTION_ARG_STRING, &export_since, "Only export messages from this day on", "YYYY-MM-DD" },
+        { "export-until", 0, 0, G_OPTION_ARG_STRING, &export_until, "Only export messages up to and including this day", "YYYY-MM-DD" },
+        { "export-grep", 0, 0, G_OPTION_ARG_STRING, &export_grep, "Only export messages matching this regular expression", "REGEX" },
         { NULL }
     };
 
@@ -127,7 +193,21 @@ main(int argc, char **argv)
         return 0;
     }
 
-    prof_run(log, account_name);
+    if (export_logs) {
+        return _export_logs();
+    }
+
+    if (trace_file && !trace_open(trace_file)) {
+        g_print("Could not open trace file: %s\n", trace_file);
+        return 1;
+    }
+
+    if (bench_input || bench_events || bench_stanzas) {
+        prof_bench(log, bench_input, bench_events, bench_stanzas, bench_realtime);
+        return 0;
+    }
+
+    prof_run(log, account_name, startup_profile, headless, ipc_path);
 
     return 0;
 }
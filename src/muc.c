@@ -40,8 +40,11 @@
 
 #include "contact.h"
 #include "common.h"
+#include "log.h"
 #include "jid.h"
 #include "tools/autocomplete.h"
+#include "tools/stats.h"
+#include "config/preferences.h"
 #include "ui/ui.h"
 #include "window_list.h"
 #include "muc.h"
@@ -59,19 +62,58 @@ typedef struct _muc_room_t {
     gboolean autojoin;
     gboolean pending_nick_change;
     GHashTable *roster;
+    GHashTable *roster_index;
+    GSequence *sorted_roster;
+    GSequence *roles[MUC_ROLE_COUNT];
+    GSequence *affiliations[MUC_AFFILIATION_COUNT];
     Autocomplete nick_ac;
     Autocomplete jid_ac;
     GHashTable *nick_changes;
     gboolean roster_received;
     muc_member_type_t member_type;
+
+    // occupants who have spoken, most recent first, with each nick's
+    // link so a speaker moves to the front in constant time
+    GQueue *speakers;
+    GHashTable *speaker_links;
+
+    // nicks offered by the current completion, recent speakers first
+    GSList *nick_matches;
+    GSList *nick_next;
+
+    // once past the large room threshold only the nicks, roles and
+    // affiliations of most occupants are kept, details holds the nicks
+    // whose jid and status are kept anyway
+    gboolean large;
+    GHashTable *details;
 } ChatRoom;
 
+// positions of an occupant in the sorted room indexes
+typedef struct occupant_index_t {
+    GSequenceIter *sorted;
+    GSequenceIter *role;
+    GSequenceIter *affiliation;
+} OccupantIndex;
+
 GHashTable *rooms = NULL;
 GHashTable *invite_passwords = NULL;
 Autocomplete invite_ac;
 
+// occupants are replaced rather than changed, other than being renamed or
+// compacted, and
+// each one gets a new version
+static int occupant_versions = 0;
+
+// occupants at which a room becomes large, 0 for never
+static int large_threshold = 0;
+
 static void _free_room(ChatRoom *room);
 static gint _compare_occupants(Occupant *a, Occupant *b);
+static gint _compare_occupants_data(gconstpointer a, gconstpointer b, gpointer data);
+static void _roster_index_add(ChatRoom *chat_room, Occupant *occupant);
+static void _roster_index_remove(ChatRoom *chat_room, const char *const nick);
+static void _roster_rename(ChatRoom *chat_room, const char *const old_nick, const char *const new_nick);
+static GSList* _sequence_to_slist(GSequence *sequence);
 static muc_role_t _role_from_string(const char *const role);
 static muc_affiliation_t _affiliation_from_string(const char *const affiliation);
 static char* _role_to_string(muc_role_t role);
@@ -79,6 +121,14 @@ static char* _affiliation_to_string(muc_affiliation_t affiliation);
 static Occupant* _muc_occupant_new(const char *const nick, const char *const jid, muc_role_t role,
     muc_affiliation_t affiliation, resource_presence_t presence, const char *const status);
 static void _occupant_free(Occupant *occupant);
+static size_t _occupant_size(Occupant *occupant);
+static void _speaker_touch(ChatRoom *chat_room, const char *const nick);
+static void _speaker_remove(ChatRoom *chat_room, const char *const nick);
+static char* _nick_complete(ChatRoom *chat_room, const char *const search_str);
+static void _nick_complete_reset(ChatRoom *chat_room);
+static gboolean _occupant_keeps_details(ChatRoom *chat_room, const char *const nick, muc_role_t role,
+    muc_affiliation_t affiliation);
+static void _room_compact(ChatRoom *chat_room);
 
 void
 muc_init(void)
@@ -98,6 +148,12 @@ muc_close(void)
     invite_passwords = NULL;
 }
 
+void
+muc_set_large(int occupants)
+{
+    large_threshold = occupants;
+}
+
 void
 muc_invites_add(const char *const room, const char *const password)
 {
@@ -189,6 +245,15 @@ muc_join(const char *const room, const char *const nick, const char *const passw
     new_room->pending_broadcasts = NULL;
     new_room->pending_config = FALSE;
     new_room->roster = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_occupant_free);
+    new_room->roster_index = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    new_room->sorted_roster = g_sequence_new(NULL);
+    int i;
+    for (i = 0; i < MUC_ROLE_COUNT; i++) {
+        new_room->roles[i] = g_sequence_new(NULL);
+    }
+    for (i = 0; i < MUC_AFFILIATION_COUNT; i++) {
+        new_room->affiliations[i] = g_sequence_new(NULL);
+    }
     new_room->nick_ac = autocomplete_new();
     new_room->jid_ac = autocomplete_new();
     new_room->nick_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
@@ -196,6 +261,12 @@ muc_join(const char *const room, const char *const nick, const char *const passw
     new_room->pending_nick_change = FALSE;
     new_room->autojoin = autojoin;
     new_room->member_type = MUC_MEMBER_TYPE_UNKNOWN;
+    new_room->speakers = g_queue_new();
+    new_room->speaker_links = g_hash_table_new(g_str_hash, g_str_equal);
+    new_room->nick_matches = NULL;
+    new_room->nick_next = NULL;
+    new_room->large = FALSE;
+    new_room->details = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
 
     g_hash_table_insert(rooms, strdup(room), new_room);
 }
@@ -250,6 +321,24 @@ muc_active(const char *const room)
     return (chat_room != NULL);
 }
 
+// autojoined rooms still waiting for their own presence
+int
+muc_autojoin_pending(void)
+{
+    int pending = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, rooms);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ChatRoom *chat_room = value;
+        if (chat_room->autojoin && !chat_room->roster_received) {
+            pending++;
+        }
+    }
+
+    return pending;
+}
+
 gboolean
 muc_autojoin(const char *const room)
 {
@@ -355,6 +444,7 @@ muc_nick_change_complete(const char *const room, const char *const nick)
 {
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
+        _roster_index_remove(chat_room, chat_room->nick);
         g_hash_table_remove(chat_room->roster, chat_room->nick);
         autocomplete_remove(chat_room->nick_ac, chat_room->nick);
         free(chat_room->nick);
@@ -421,7 +511,8 @@ muc_roster_contains_nick(const char *const room, const char *const nick)
 }
 
 /*
- * Add a new chat room member to the room's roster
+ * Add a new chat room member to the room's roster, while joining the
+ * autocompleters are left for muc_roster_set_complete to build in bulk
  */
 gboolean
 muc_roster_add(const char *const room, const char *const nick, const char *const jid, const char *const role,
@@ -434,22 +525,37 @@ muc_roster_add(const char *const room, const char *const nick, const char *const
     if (chat_room) {
         Occupant *old = g_hash_table_lookup(chat_room->roster, nick);
 
+        if (!old && !chat_room->large && large_threshold > 0 &&
+                g_hash_table_size(chat_room->roster) + 1 >= large_threshold) {
+            _room_compact(chat_room);
+        }
+
+        muc_role_t role_t = _role_from_string(role);
+        muc_affiliation_t affiliation_t = _affiliation_from_string(affiliation);
+        const char *kept_jid = jid;
+        const char *kept_status = status;
+        if (!_occupant_keeps_details(chat_room, nick, role_t, affiliation_t)) {
+            kept_jid = NULL;
+            kept_status = NULL;
+        }
+
         if (!old) {
             updated = TRUE;
-            autocomplete_add(chat_room->nick_ac, nick);
+            if (chat_room->roster_received) {
+                autocomplete_add(chat_room->nick_ac, nick);
+            }
         } else if (old->presence != new_presence ||
-                    (g_strcmp0(old->status, status) != 0)) {
+                    (g_strcmp0(old->status, kept_status) != 0)) {
             updated = TRUE;
         }
 
-        resource_presence_t presence = resource_presence_from_string(show);
-        muc_role_t role_t = _role_from_string(role);
-        muc_affiliation_t affiliation_t = _affiliation_from_string(affiliation);
-        Occupant *occupant = _muc_occupant_new(nick, jid, role_t, affiliation_t, presence, status);
+        Occupant *occupant = _muc_occupant_new(nick, kept_jid, role_t, affiliation_t, new_presence, kept_status);
+        _roster_index_remove(chat_room, nick);
         g_hash_table_replace(chat_room->roster, strdup(nick), occupant);
+        _roster_index_add(chat_room, occupant);
 
-        if (jid) {
-            Jid *jidp = jid_create(jid);
+        if (kept_jid && chat_room->roster_received) {
+            Jid *jidp = jid_create(kept_jid);
             if (jidp->barejid) {
                 autocomplete_add(chat_room->jid_ac, jidp->barejid);
             }
@@ -468,11 +574,53 @@ muc_roster_remove(const char *const room, const char *const nick)
 {
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
+        _roster_index_remove(chat_room, nick);
+        _speaker_remove(chat_room, nick);
         g_hash_table_remove(chat_room->roster, nick);
+        g_hash_table_remove(chat_room->details, nick);
         autocomplete_remove(chat_room->nick_ac, nick);
     }
 }
 
+/*
+ * Returns TRUE if the room has grown past the large room threshold, and most
+ * of its occupants are kept without their jid and status
+ */
+gboolean
+muc_roster_large(const char *const room)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return chat_room->large;
+    } else {
+        return FALSE;
+    }
+}
+
+/*
+ * Keep the jid and status of an occupant of a large room from their next
+ * presence on, returns TRUE if they were not kept until now
+ */
+gboolean
+muc_occupant_want_details(const char *const room, const char *const nick)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    if (!chat_room || !chat_room->large) {
+        return FALSE;
+    }
+
+    Occupant *occupant = g_hash_table_lookup(chat_room->roster, nick);
+    if (!occupant || g_hash_table_contains(chat_room->details, nick)) {
+        return FALSE;
+    }
+    if (_occupant_keeps_details(chat_room, nick, occupant->role, occupant->affiliation)) {
+        return FALSE;
+    }
+
+    g_hash_table_add(chat_room->details, strdup(nick));
+    return TRUE;
+}
+
 Occupant*
 muc_roster_item(const char *const room, const char *const nick)
 {
@@ -486,7 +634,7 @@ muc_roster_item(const char *const room, const char *const nick)
 }
 
 /*
- * Return a list of PContacts representing the room members in the room's roster
+ * Return a list of Occupants in the room's roster, sorted by nick
  */
 GList*
 muc_roster(const char *const room)
@@ -494,16 +642,12 @@ muc_roster(const char *const room)
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
         GList *result = NULL;
-        GList *occupants = g_hash_table_get_values(chat_room->roster);
-
-        GList *curr = occupants;
-        while (curr) {
-            result = g_list_insert_sorted(result, curr->data, (GCompareFunc)_compare_occupants);
-            curr = g_list_next(curr);
+        GSequenceIter *curr = g_sequence_get_end_iter(chat_room->sorted_roster);
+        while (!g_sequence_iter_is_begin(curr)) {
+            curr = g_sequence_iter_prev(curr);
+            result = g_list_prepend(result, g_sequence_get(curr));
         }
 
-        g_list_free(occupants);
-
         return result;
     } else {
         return NULL;
@@ -536,13 +680,38 @@ muc_roster_jid_ac(const char *const room)
 }
 
 /*
- * Set to TRUE when the rooms roster has been fully received
+ * Set to TRUE when the rooms roster has been fully received, the nick and
+ * jid autocompleters are built from the whole roster at this point
  */
 void
 muc_roster_set_complete(const char *const room)
 {
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
-    if (chat_room) {
+    if (chat_room && !chat_room->roster_received) {
+        GSList *nicks = NULL;
+        GSList *barejids = NULL;
+        GHashTableIter iter;
+        gpointer key;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, chat_room->roster);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            Occupant *occupant = value;
+            nicks = g_slist_prepend(nicks, key);
+            if (occupant->jid) {
+                Jid *jidp = jid_create(occupant->jid);
+                if (jidp && jidp->barejid) {
+                    barejids = g_slist_prepend(barejids, strdup(jidp->barejid));
+                }
+                jid_destroy(jidp);
+            }
+        }
+
+        autocomplete_add_all(chat_room->nick_ac, nicks);
+        autocomplete_add_all(chat_room->jid_ac, barejids);
+        g_slist_free(nicks);
+        g_slist_free_full(barejids, free);
+
         chat_room->roster_received = TRUE;
     }
 }
@@ -584,22 +753,71 @@ muc_occupants_by_role(const char *const room, muc_role_t role)
 {
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        GSList *result = NULL;
-        GHashTableIter iter;
-        gpointer key;
-        gpointer value;
+        return _sequence_to_slist(chat_room->roles[role]);
+    } else {
+        return NULL;
+    }
+}
 
-        g_hash_table_iter_init(&iter, chat_room->roster);
-        while (g_hash_table_iter_next(&iter, &key, &value)) {
-            Occupant *occupant = (Occupant *)value;
-            if (occupant->role == role) {
-                result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_occupants);
-            }
-        }
-        return result;
+static void
+_roster_iter_init(MucRosterIter *iter, GSequence *sequence, int pos)
+{
+    if (sequence) {
+        iter->curr = g_sequence_get_iter_at_pos(sequence, pos);
     } else {
+        iter->curr = NULL;
+    }
+}
+
+// occupants in nick order from the pos'th, without copying the room's index,
+// the roster must not change while the iterator is used
+void
+muc_roster_iter_init(MucRosterIter *iter, const char *const room, int pos)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    _roster_iter_init(iter, chat_room ? chat_room->sorted_roster : NULL, pos);
+}
+
+void
+muc_roster_role_iter_init(MucRosterIter *iter, const char *const room, muc_role_t role, int pos)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    _roster_iter_init(iter, chat_room ? chat_room->roles[role] : NULL, pos);
+}
+
+Occupant*
+muc_roster_iter_next(MucRosterIter *iter)
+{
+    if (iter->curr == NULL || g_sequence_iter_is_end(iter->curr)) {
         return NULL;
     }
+
+    Occupant *occupant = g_sequence_get(iter->curr);
+    iter->curr = g_sequence_iter_next(iter->curr);
+
+    return occupant;
+}
+
+int
+muc_roster_size(const char *const room)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return g_sequence_get_length(chat_room->sorted_roster);
+    } else {
+        return 0;
+    }
+}
+
+int
+muc_occupants_count_by_role(const char *const room, muc_role_t role)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return g_sequence_get_length(chat_room->roles[role]);
+    } else {
+        return 0;
+    }
 }
 
 GSList*
@@ -607,27 +825,15 @@ muc_occupants_by_affiliation(const char *const room, muc_affiliation_t affiliati
 {
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        GSList *result = NULL;
-        GHashTableIter iter;
-        gpointer key;
-        gpointer value;
-
-        g_hash_table_iter_init(&iter, chat_room->roster);
-        while (g_hash_table_iter_next(&iter, &key, &value)) {
-            Occupant *occupant = (Occupant *)value;
-            if (occupant->affiliation == affiliation) {
-                result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_occupants);
-            }
-        }
-        return result;
+        return _sequence_to_slist(chat_room->affiliations[affiliation]);
     } else {
         return NULL;
     }
 }
 
 /*
- * Remove the old_nick from the roster, and flag that a pending nickname change
- * is in progress
+ * Rename the occupant in the room's roster, and flag that a pending nickname
+ * change is in progress
  */
 void
 muc_occupant_nick_change_start(const char *const room, const char *const new_nick, const char *const old_nick)
@@ -635,7 +841,7 @@ muc_occupant_nick_change_start(const char *const room, const char *const new_nic
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
         g_hash_table_insert(chat_room->nick_changes, strdup(new_nick), strdup(old_nick));
-        muc_roster_remove(room, old_nick);
+        _roster_rename(chat_room, old_nick, new_nick);
     }
 }
 
@@ -686,7 +892,12 @@ muc_autocomplete(ProfWin *window, const char *const input)
                 }
             }
 
-            char *result = autocomplete_complete(chat_room->nick_ac, search_str, FALSE);
+            char *result = NULL;
+            if (prefs_get_boolean(PREF_COMPLETE_FUZZY)) {
+                result = autocomplete_complete_fuzzy(chat_room->nick_ac, search_str, FALSE);
+            } else {
+                result = _nick_complete(chat_room, search_str);
+            }
             if (result) {
                 GString *replace_with = g_string_new(chat_room->autocomplete_prefix);
                 g_string_append(replace_with, result);
@@ -721,18 +932,34 @@ muc_jid_autocomplete_add_all(const char *const room, GSList *jids)
     ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
         if (chat_room->jid_ac) {
+            GSList *barejids = NULL;
             GSList *curr_jid = jids;
             while (curr_jid) {
                 char *jid = curr_jid->data;
                 Jid *jidp = jid_create(jid);
                 if (jidp) {
                     if (jidp->barejid) {
-                        autocomplete_add(chat_room->jid_ac, jidp->barejid);
+                        barejids = g_slist_prepend(barejids, strdup(jidp->barejid));
                     }
                 }
                 jid_destroy(jidp);
                 curr_jid = g_slist_next(curr_jid);
             }
+            autocomplete_add_all(chat_room->jid_ac, barejids);
+            g_slist_free_full(barejids, free);
+        }
+    }
+}
+
+// the occupant spoke, their nick is offered before others when completing
+void
+muc_nick_touch(const char *const room, const char *const nick)
+{
+    ChatRoom *chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room && chat_room->nick_ac) {
+        autocomplete_touch(chat_room->nick_ac, nick);
+        if (g_hash_table_contains(chat_room->roster, nick) && g_strcmp0(nick, chat_room->nick) != 0) {
+            _speaker_touch(chat_room, nick);
         }
     }
 }
@@ -745,6 +972,7 @@ muc_autocomplete_reset(const char *const room)
         if (chat_room->nick_ac) {
             autocomplete_reset(chat_room->nick_ac);
         }
+        _nick_complete_reset(chat_room);
 
         if (chat_room->autocomplete_prefix) {
             free(chat_room->autocomplete_prefix);
@@ -817,6 +1045,15 @@ _free_room(ChatRoom *room)
         if (room->roster) {
             g_hash_table_destroy(room->roster);
         }
+        g_hash_table_destroy(room->roster_index);
+        g_sequence_free(room->sorted_roster);
+        int i;
+        for (i = 0; i < MUC_ROLE_COUNT; i++) {
+            g_sequence_free(room->roles[i]);
+        }
+        for (i = 0; i < MUC_AFFILIATION_COUNT; i++) {
+            g_sequence_free(room->affiliations[i]);
+        }
         autocomplete_free(room->nick_ac);
         autocomplete_free(room->jid_ac);
         if (room->nick_changes) {
@@ -825,6 +1062,10 @@ _free_room(ChatRoom *room)
         if (room->pending_broadcasts) {
             g_list_free_full(room->pending_broadcasts, free);
         }
+        _nick_complete_reset(room);
+        g_hash_table_destroy(room->speaker_links);
+        g_queue_free_full(room->speakers, free);
+        g_hash_table_destroy(room->details);
         free(room);
     }
 }
@@ -840,6 +1081,110 @@ _compare_occupants(Occupant *a, Occupant *b)
     return result;
 }
 
+static gint
+_compare_occupants_data(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return _compare_occupants((Occupant*)a, (Occupant*)b);
+}
+
+static void
+_roster_index_add(ChatRoom *chat_room, Occupant *occupant)
+{
+    OccupantIndex *index = malloc(sizeof(OccupantIndex));
+    index->sorted = g_sequence_insert_sorted(chat_room->sorted_roster, occupant, _compare_occupants_data, NULL);
+    index->role = g_sequence_insert_sorted(chat_room->roles[occupant->role], occupant,
+        _compare_occupants_data, NULL);
+    index->affiliation = g_sequence_insert_sorted(chat_room->affiliations[occupant->affiliation], occupant,
+        _compare_occupants_data, NULL);
+
+    g_hash_table_replace(chat_room->roster_index, strdup(occupant->nick), index);
+}
+
+static void
+_roster_index_remove(ChatRoom *chat_room, const char *const nick)
+{
+    OccupantIndex *index = g_hash_table_lookup(chat_room->roster_index, nick);
+    if (index) {
+        g_sequence_remove(index->sorted);
+        g_sequence_remove(index->role);
+        g_sequence_remove(index->affiliation);
+        g_hash_table_remove(chat_room->roster_index, nick);
+    }
+}
+
+// the occupant is rekeyed and moved within the sorted indexes, keeping its
+// place among recent speakers, rather than removed and added again
+static void
+_roster_rename(ChatRoom *chat_room, const char *const old_nick, const char *const new_nick)
+{
+    // the new nick is only taken if the old presence was missed
+    if (g_hash_table_contains(chat_room->roster, new_nick)) {
+        muc_roster_remove(chat_room->room, old_nick);
+        return;
+    }
+
+    gpointer roster_key = NULL;
+    gpointer value = NULL;
+    if (!g_hash_table_lookup_extended(chat_room->roster, old_nick, &roster_key, &value)) {
+        return;
+    }
+    Occupant *occupant = value;
+    g_hash_table_steal(chat_room->roster, old_nick);
+    g_free(roster_key);
+
+    gpointer index_key = NULL;
+    OccupantIndex *index = NULL;
+    if (g_hash_table_lookup_extended(chat_room->roster_index, old_nick, &index_key, &value)) {
+        index = value;
+        g_hash_table_steal(chat_room->roster_index, old_nick);
+        free(index_key);
+    }
+
+    GList *link = g_hash_table_lookup(chat_room->speaker_links, old_nick);
+    if (link) {
+        g_hash_table_remove(chat_room->speaker_links, old_nick);
+        free(link->data);
+        link->data = strdup(new_nick);
+        g_hash_table_insert(chat_room->speaker_links, link->data, link);
+    }
+
+    if (g_hash_table_remove(chat_room->details, old_nick)) {
+        g_hash_table_add(chat_room->details, strdup(new_nick));
+    }
+
+    autocomplete_remove(chat_room->nick_ac, old_nick);
+    autocomplete_add(chat_room->nick_ac, new_nick);
+
+    stats_free(STATS_MEM_OCCUPANT, _occupant_size(occupant));
+    free(occupant->nick);
+    free(occupant->nick_collate_key);
+    occupant->nick = strdup(new_nick);
+    occupant->nick_collate_key = g_utf8_collate_key(occupant->nick, -1);
+    occupant->version = ++occupant_versions;
+    stats_alloc(STATS_MEM_OCCUPANT, _occupant_size(occupant));
+
+    g_hash_table_insert(chat_room->roster, strdup(new_nick), occupant);
+    if (index) {
+        g_sequence_sort_changed(index->sorted, _compare_occupants_data, NULL);
+        g_sequence_sort_changed(index->role, _compare_occupants_data, NULL);
+        g_sequence_sort_changed(index->affiliation, _compare_occupants_data, NULL);
+        g_hash_table_insert(chat_room->roster_index, strdup(new_nick), index);
+    }
+}
+
+static GSList*
+_sequence_to_slist(GSequence *sequence)
+{
+    GSList *result = NULL;
+    GSequenceIter *curr = g_sequence_get_end_iter(sequence);
+    while (!g_sequence_iter_is_begin(curr)) {
+        curr = g_sequence_iter_prev(curr);
+        result = g_slist_prepend(result, g_sequence_get(curr));
+    }
+
+    return result;
+}
+
 static muc_role_t
 _role_from_string(const char *const role)
 {
@@ -963,14 +1308,35 @@ _muc_occupant_new(const char *const nick, const char *const jid, muc_role_t role
 
     occupant->role = role;
     occupant->affiliation = affiliation;
+    occupant->version = ++occupant_versions;
+    stats_alloc(STATS_MEM_OCCUPANT, _occupant_size(occupant));
 
     return occupant;
 }
 
+// occupants are only changed by a rename, which accounts for the new size
+static size_t
+_occupant_size(Occupant *occupant)
+{
+    size_t size = sizeof(Occupant);
+    if (occupant->nick) {
+        size += strlen(occupant->nick) + 1;
+    }
+    if (occupant->jid) {
+        size += strlen(occupant->jid) + 1;
+    }
+    if (occupant->status) {
+        size += strlen(occupant->status) + 1;
+    }
+
+    return size;
+}
+
 static void
 _occupant_free(Occupant *occupant)
 {
     if (occupant) {
+        stats_free(STATS_MEM_OCCUPANT, _occupant_size(occupant));
         free(occupant->nick);
         free(occupant->nick_collate_key);
         free(occupant->jid);
@@ -978,3 +1344,136 @@ _occupant_free(Occupant *occupant)
         free(occupant);
     }
 }
+
+static void
+_speaker_touch(ChatRoom *chat_room, const char *const nick)
+{
+    GList *link = g_hash_table_lookup(chat_room->speaker_links, nick);
+    if (link) {
+        g_queue_unlink(chat_room->speakers, link);
+        g_queue_push_head_link(chat_room->speakers, link);
+    } else {
+        char *speaker = strdup(nick);
+        g_queue_push_head(chat_room->speakers, speaker);
+        g_hash_table_insert(chat_room->speaker_links, speaker, chat_room->speakers->head);
+    }
+}
+
+static void
+_speaker_remove(ChatRoom *chat_room, const char *const nick)
+{
+    GList *link = g_hash_table_lookup(chat_room->speaker_links, nick);
+    if (link) {
+        char *speaker = link->data;
+        g_hash_table_remove(chat_room->speaker_links, speaker);
+        g_queue_delete_link(chat_room->speakers, link);
+        free(speaker);
+    }
+}
+
+// recent speakers with the prefix, most recent first, then the other
+// occupants with it alphabetically
+static char*
+_nick_complete(ChatRoom *chat_room, const char *const search_str)
+{
+    if (chat_room->nick_matches == NULL) {
+        size_t len = strlen(search_str);
+        GSList *matches = NULL;
+        GList *curr_speaker = chat_room->speakers->head;
+        while (curr_speaker) {
+            if (strncmp(curr_speaker->data, search_str, len) == 0) {
+                matches = g_slist_prepend(matches, strdup(curr_speaker->data));
+            }
+            curr_speaker = g_list_next(curr_speaker);
+        }
+
+        GSList *others = NULL;
+        GSList *nicks = autocomplete_create_list(chat_room->nick_ac);
+        GSList *curr_nick = nicks;
+        while (curr_nick) {
+            char *nick = curr_nick->data;
+            if (strncmp(nick, search_str, len) == 0 && !g_hash_table_contains(chat_room->speaker_links, nick)) {
+                others = g_slist_prepend(others, strdup(nick));
+            }
+            curr_nick = g_slist_next(curr_nick);
+        }
+        g_slist_free_full(nicks, free);
+
+        chat_room->nick_matches = g_slist_concat(g_slist_reverse(matches), g_slist_reverse(others));
+        chat_room->nick_next = chat_room->nick_matches;
+    }
+
+    if (chat_room->nick_matches == NULL) {
+        return NULL;
+    }
+
+    // cycle back to the first
+    if (chat_room->nick_next == NULL) {
+        chat_room->nick_next = chat_room->nick_matches;
+    }
+
+    char *result = strdup(chat_room->nick_next->data);
+    chat_room->nick_next = g_slist_next(chat_room->nick_next);
+
+    return result;
+}
+
+static void
+_nick_complete_reset(ChatRoom *chat_room)
+{
+    g_slist_free_full(chat_room->nick_matches, free);
+    chat_room->nick_matches = NULL;
+    chat_room->nick_next = NULL;
+}
+
+// our own occupant, moderators and admins keep their details in large rooms,
+// as do occupants whose details were asked for
+static gboolean
+_occupant_keeps_details(ChatRoom *chat_room, const char *const nick, muc_role_t role, muc_affiliation_t affiliation)
+{
+    if (!chat_room->large) {
+        return TRUE;
+    }
+    if (g_strcmp0(nick, chat_room->nick) == 0) {
+        return TRUE;
+    }
+    if (role == MUC_ROLE_MODERATOR || affiliation == MUC_AFFILIATION_ADMIN || affiliation == MUC_AFFILIATION_OWNER) {
+        return TRUE;
+    }
+
+    return g_hash_table_contains(chat_room->details, nick);
+}
+
+// drops the jid and status of the occupants already in the room, which are
+// only kept again for those whose details are asked for
+static void
+_room_compact(ChatRoom *chat_room)
+{
+    chat_room->large = TRUE;
+
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    g_hash_table_iter_init(&iter, chat_room->roster);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        Occupant *occupant = value;
+        if (_occupant_keeps_details(chat_room, occupant->nick, occupant->role, occupant->affiliation)) {
+            continue;
+        }
+        if (!occupant->jid && !occupant->status) {
+            continue;
+        }
+
+        stats_free(STATS_MEM_OCCUPANT, _occupant_size(occupant));
+        free(occupant->jid);
+        occupant->jid = NULL;
+        free(occupant->status);
+        occupant->status = NULL;
+        occupant->version = ++occupant_versions;
+        stats_alloc(STATS_MEM_OCCUPANT, _occupant_size(occupant));
+    }
+
+    autocomplete_clear(chat_room->jid_ac);
+    log_info("Room %s has %d occupants, keeping compact occupant records", chat_room->room,
+        g_hash_table_size(chat_room->roster));
+}
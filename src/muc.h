@@ -49,6 +49,8 @@ typedef enum {
     MUC_ROLE_MODERATOR
 } muc_role_t;
 
+#define MUC_ROLE_COUNT (MUC_ROLE_MODERATOR + 1)
+
 typedef enum {
     MUC_AFFILIATION_NONE,
     MUC_AFFILIATION_OUTCAST,
@@ -57,6 +59,8 @@ typedef enum {
     MUC_AFFILIATION_OWNER
 } muc_affiliation_t;
 
+#define MUC_AFFILIATION_COUNT (MUC_AFFILIATION_OWNER + 1)
+
 typedef enum {
     MUC_MEMBER_TYPE_UNKNOWN,
     MUC_MEMBER_TYPE_PUBLIC,
@@ -71,16 +75,23 @@ typedef struct _muc_occupant_t {
     muc_affiliation_t affiliation;
     resource_presence_t presence;
     char *status;
+    int version;
 } Occupant;
 
+typedef struct muc_roster_iter_t {
+    GSequenceIter *curr;
+} MucRosterIter;
+
 void muc_init(void);
 void muc_close(void);
+void muc_set_large(int occupants);
 
 void muc_join(const char *const room, const char *const nick, const char *const password, gboolean autojoin);
 void muc_leave(const char *const room);
 
 gboolean muc_active(const char *const room);
 gboolean muc_autojoin(const char *const room);
+int muc_autojoin_pending(void);
 
 GList* muc_rooms(void);
 
@@ -107,12 +118,19 @@ void muc_jid_autocomplete_reset(const char *const room);
 void muc_jid_autocomplete_add_all(const char *const room, GSList *jids);
 
 Occupant* muc_roster_item(const char *const room, const char *const nick);
+gboolean muc_roster_large(const char *const room);
+gboolean muc_occupant_want_details(const char *const room, const char *const nick);
 
 gboolean muc_occupant_available(Occupant *occupant);
 const char* muc_occupant_affiliation_str(Occupant *occupant);
 const char* muc_occupant_role_str(Occupant *occupant);
 GSList* muc_occupants_by_role(const char *const room, muc_role_t role);
 GSList* muc_occupants_by_affiliation(const char *const room, muc_affiliation_t affiliation);
+void muc_roster_iter_init(MucRosterIter *iter, const char *const room, int pos);
+void muc_roster_role_iter_init(MucRosterIter *iter, const char *const room, muc_role_t role, int pos);
+Occupant* muc_roster_iter_next(MucRosterIter *iter);
+int muc_roster_size(const char *const room);
+int muc_occupants_count_by_role(const char *const room, muc_role_t role);
 
 void muc_occupant_nick_change_start(const char *const room, const char *const new_nick, const char *const old_nick);
 char* muc_roster_nick_change_complete(const char *const room, const char *const nick);
@@ -135,6 +153,7 @@ GList* muc_pending_broadcasts(const char *const room);
 
 char* muc_autocomplete(ProfWin *window, const char *const input);
 void muc_autocomplete_reset(const char *const room);
+void muc_nick_touch(const char *const room, const char *const nick);
 
 gboolean muc_requires_config(const char *const room);
 void muc_set_requires_config(const char *const room, gboolean val);
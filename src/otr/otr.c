@@ -37,6 +37,7 @@
 #include <libotr/message.h>
 #include <libotr/sm.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include "otr/otr.h"
 #include "otr/otrlib.h"
@@ -47,6 +48,8 @@
 #include "ui/ui.h"
 #include "config/preferences.h"
 #include "chat_session.h"
+#include "profanity.h"
+#include "tools/stats.h"
 
 #define PRESENCE_ONLINE 1
 #define PRESENCE_OFFLINE 0
@@ -58,6 +61,61 @@ static char *jid;
 static gboolean data_loaded;
 static GHashTable *smp_initiators;
 
+// effective account policy per contact, see otr_get_policy
+#define POLICY_UNSET -1
+static GHashTable *policy_cache;
+static char *policy_account;
+static guint policy_generation;
+
+static void _otr_policy_cache_clear(void);
+
+// persisted trust per fingerprints file entry, changes are appended and the
+// file is only rewritten by libotr once FPS_JOURNAL_MAX lines have been added
+#define FPS_JOURNAL_MAX 256
+static GHashTable *fps_index;
+static int fps_journal;
+
+// an account's key and fingerprints as read from disk
+typedef struct otr_load_t {
+    char *jid;
+    char *basedir;
+    gboolean dir_created;
+    OtrlUserState user_state;
+    gboolean has_key;
+    gcry_error_t key_err;
+    gboolean has_fps;
+    gcry_error_t fps_err;
+    int fps_lines;
+#if GLIB_CHECK_VERSION(2,32,0)
+    GThread *thread;
+#endif
+} OtrLoad;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+// started by otr_preload while connecting, joined by otr_on_connect
+static OtrLoad *preload;
+
+static void _otr_preload_discard(void);
+#endif
+
+#if GLIB_CHECK_VERSION(2,32,0)
+// background key generation, owned by the main thread once done is set
+typedef struct otr_keygen_t {
+    OtrlUserState user_state;
+    void *newkey;
+    char *basedir;
+    GThread *thread;
+    GTimer *timer;
+    gcry_error_t err;
+    volatile gint done;
+} OtrKeygen;
+
+static OtrKeygen *keygen;
+
+// how often a running key generation is checked and its progress shown
+#define KEYGEN_POLL_MS 1000
+#endif
+
 OtrlUserState
 otr_userstate(void)
 {
@@ -115,30 +173,187 @@ cb_inject_message(void *opdata, const char *accountname,
     free(id);
 }
 
-static void
-cb_write_fingerprints(void *opdata)
+static char*
+_otr_fps_filename(void)
 {
-    gcry_error_t err = 0;
-
     gchar *data_home = xdg_get_data_home();
-    GString *basedir = g_string_new(data_home);
+    GString *fpsfilename = g_string_new(data_home);
     free(data_home);
 
     gchar *account_dir = str_replace(jid, "@", "_at_");
-    g_string_append(basedir, "/profanity/otr/");
-    g_string_append(basedir, account_dir);
-    g_string_append(basedir, "/");
+    g_string_append(fpsfilename, "/profanity/otr/");
+    g_string_append(fpsfilename, account_dir);
+    g_string_append(fpsfilename, "/fingerprints.txt");
     free(account_dir);
 
-    GString *fpsfilename = g_string_new(basedir->str);
-    g_string_append(fpsfilename, "fingerprints.txt");
-    err = otrl_privkey_write_fingerprints(user_state, fpsfilename->str);
+    char *result = fpsfilename->str;
+    g_string_free(fpsfilename, FALSE);
+
+    return result;
+}
+
+// the start of a fingerprints file line, as libotr writes it
+static char*
+_otr_fps_entry(ConnContext *context, Fingerprint *fprint)
+{
+    GString *entry = g_string_new(NULL);
+    g_string_printf(entry, "%s\t%s\t%s\t", context->username, context->accountname, context->protocol);
+    int i;
+    for (i = 0; i < 20; i++) {
+        g_string_append_printf(entry, "%02x", fprint->fingerprint[i]);
+    }
+
+    char *result = entry->str;
+    g_string_free(entry, FALSE);
+
+    return result;
+}
+
+// index what the fingerprints file holds once journal lines have been
+// replayed, journal is how many lines were appended since the last rewrite
+static void
+_otr_fps_index_rebuild(int journal)
+{
+    if (fps_index) {
+        g_hash_table_destroy(fps_index);
+    }
+    fps_index = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    fps_journal = journal;
+
+    ConnContext *context;
+    for (context = user_state->context_root; context; context = context->next) {
+        if (!otrlib_context_is_master(context)) {
+            continue;
+        }
+        Fingerprint *fprint;
+        for (fprint = context->fingerprint_root.next; fprint; fprint = fprint->next) {
+            g_hash_table_replace(fps_index, _otr_fps_entry(context, fprint), strdup(fprint->trust ? fprint->trust : ""));
+        }
+    }
+}
+
+// append fingerprints that are new or changed trust, libotr reads the file
+// in order so the last line for a fingerprint wins, returns FALSE when the
+// file must be rewritten instead
+static gboolean
+_otr_fps_append(const char *const filename)
+{
+    if (fps_index == NULL || fps_journal >= FPS_JOURNAL_MAX) {
+        return FALSE;
+    }
+
+    GString *lines = g_string_new(NULL);
+    int changed = 0;
+    guint found = 0;
+    ConnContext *context;
+    for (context = user_state->context_root; context; context = context->next) {
+        if (!otrlib_context_is_master(context)) {
+            continue;
+        }
+        Fingerprint *fprint;
+        for (fprint = context->fingerprint_root.next; fprint; fprint = fprint->next) {
+            char *entry = _otr_fps_entry(context, fprint);
+            const char *trust = fprint->trust ? fprint->trust : "";
+            char *saved = g_hash_table_lookup(fps_index, entry);
+            if (saved) {
+                found++;
+            }
+            if (g_strcmp0(saved, trust) == 0) {
+                free(entry);
+                continue;
+            }
+            g_string_append_printf(lines, "%s\t%s\n", entry, trust);
+            changed++;
+            free(entry);
+        }
+    }
+
+    // a fingerprint was forgotten, only a rewrite drops it
+    if (found < g_hash_table_size(fps_index)) {
+        g_string_free(lines, TRUE);
+        return FALSE;
+    }
+
+    if (changed == 0) {
+        g_string_free(lines, TRUE);
+        return TRUE;
+    }
+
+    FILE *fps = g_fopen(filename, "a");
+    if (fps == NULL) {
+        g_string_free(lines, TRUE);
+        return FALSE;
+    }
+    size_t written = fwrite(lines->str, 1, lines->len, fps);
+    gboolean ok = fclose(fps) == 0 && written == lines->len;
+    g_string_free(lines, TRUE);
+    if (!ok) {
+        return FALSE;
+    }
+
+    _otr_fps_index_rebuild(fps_journal + changed);
+
+    return TRUE;
+}
+
+static int
+_otr_fps_count_lines(const char *const filename)
+{
+    int lines = 0;
+    gchar *contents = NULL;
+    gsize len = 0;
+    if (g_file_get_contents(filename, &contents, &len, NULL)) {
+        gsize i;
+        for (i = 0; i < len; i++) {
+            if (contents[i] == '\n') {
+                lines++;
+            }
+        }
+        g_free(contents);
+    }
+
+    return lines;
+}
+
+// the file holds a line per fingerprint plus those appended since libotr
+// last rewrote it
+static void
+_otr_fps_index_load(int lines)
+{
+    _otr_fps_index_rebuild(0);
+    int journal = lines - (int)g_hash_table_size(fps_index);
+    fps_journal = journal > 0 ? journal : 0;
+}
+
+static void
+_otr_fps_index_clear(void)
+{
+    if (fps_index) {
+        g_hash_table_destroy(fps_index);
+        fps_index = NULL;
+    }
+    fps_journal = 0;
+}
+
+static void
+cb_write_fingerprints(void *opdata)
+{
+    gcry_error_t err = 0;
+
+    char *fpsfilename = _otr_fps_filename();
+    if (_otr_fps_append(fpsfilename)) {
+        free(fpsfilename);
+        return;
+    }
+
+    err = otrl_privkey_write_fingerprints(user_state, fpsfilename);
     if (!err == GPG_ERR_NO_ERROR) {
         log_error("Failed to write fingerprints file");
         cons_show_error("Failed to create fingerprints file");
+    } else {
+        _otr_fps_index_rebuild(0);
     }
-    g_string_free(basedir, TRUE);
-    g_string_free(fpsfilename, TRUE);
+    free(fpsfilename);
 }
 
 static void
@@ -192,6 +407,11 @@ otr_shutdown(void)
         free(jid);
         jid = NULL;
     }
+    _otr_policy_cache_clear();
+    _otr_fps_index_clear();
+#if GLIB_CHECK_VERSION(2,32,0)
+    _otr_preload_discard();
+#endif
 }
 
 void
@@ -200,47 +420,92 @@ otr_poll(void)
     otrlib_poll();
 }
 
-void
-otr_on_connect(ProfAccount *account)
+static OtrLoad*
+_otr_load_new(const char *const barejid)
 {
-    if (jid) {
-        free(jid);
-    }
-    jid = strdup(account->jid);
-    log_info("Loading OTR key for %s", jid);
+    OtrLoad *load = malloc(sizeof(OtrLoad));
+    load->jid = strdup(barejid);
 
     gchar *data_home = xdg_get_data_home();
     GString *basedir = g_string_new(data_home);
     free(data_home);
 
-    gchar *account_dir = str_replace(jid, "@", "_at_");
+    gchar *account_dir = str_replace(barejid, "@", "_at_");
     g_string_append(basedir, "/profanity/otr/");
     g_string_append(basedir, account_dir);
     g_string_append(basedir, "/");
     free(account_dir);
 
-    if (!mkdir_recursive(basedir->str)) {
-        log_error("Could not create %s for account %s.", basedir->str, jid);
-        cons_show_error("Could not create %s for account %s.", basedir->str, jid);
-        g_string_free(basedir, TRUE);
+    load->basedir = basedir->str;
+    g_string_free(basedir, FALSE);
+
+    load->dir_created = FALSE;
+    load->user_state = NULL;
+    load->has_key = FALSE;
+    load->key_err = GPG_ERR_NO_ERROR;
+    load->has_fps = FALSE;
+    load->fps_err = GPG_ERR_NO_ERROR;
+    load->fps_lines = 0;
+#if GLIB_CHECK_VERSION(2,32,0)
+    load->thread = NULL;
+#endif
+
+    return load;
+}
+
+// reads the key and fingerprints files into a new userstate, touches no
+// other state so may run on a worker thread
+static void
+_otr_load_run(OtrLoad *load)
+{
+    load->dir_created = mkdir_recursive(load->basedir);
+    if (!load->dir_created) {
         return;
     }
 
-    user_state = otrl_userstate_create();
+    load->user_state = otrl_userstate_create();
 
-    gcry_error_t err = 0;
-
-    GString *keysfilename = g_string_new(basedir->str);
+    GString *keysfilename = g_string_new(load->basedir);
     g_string_append(keysfilename, "keys.txt");
-    if (!g_file_test(keysfilename->str, G_FILE_TEST_IS_REGULAR)) {
-        log_info("No private key file found %s", keysfilename->str);
+    load->has_key = g_file_test(keysfilename->str, G_FILE_TEST_IS_REGULAR);
+    if (load->has_key) {
+        load->key_err = otrl_privkey_read(load->user_state, keysfilename->str);
+    }
+    g_string_free(keysfilename, TRUE);
+    if (load->key_err != GPG_ERR_NO_ERROR) {
+        return;
+    }
+
+    GString *fpsfilename = g_string_new(load->basedir);
+    g_string_append(fpsfilename, "fingerprints.txt");
+    load->has_fps = g_file_test(fpsfilename->str, G_FILE_TEST_IS_REGULAR);
+    if (load->has_fps) {
+        load->fps_err = otrl_privkey_read_fingerprints(load->user_state, fpsfilename->str, NULL, NULL);
+        load->fps_lines = _otr_fps_count_lines(fpsfilename->str);
+    }
+    g_string_free(fpsfilename, TRUE);
+}
+
+// take over the userstate read by _otr_load_run and report what was found
+static void
+_otr_load_apply(OtrLoad *load)
+{
+    if (!load->dir_created) {
+        log_error("Could not create %s for account %s.", load->basedir, jid);
+        cons_show_error("Could not create %s for account %s.", load->basedir, jid);
+        return;
+    }
+
+    user_state = load->user_state;
+    load->user_state = NULL;
+    _otr_fps_index_clear();
+
+    if (!load->has_key) {
+        log_info("No private key file found %skeys.txt", load->basedir);
         data_loaded = FALSE;
     } else {
-        log_info("Loading OTR private key %s", keysfilename->str);
-        err = otrl_privkey_read(user_state, keysfilename->str);
-        if (!err == GPG_ERR_NO_ERROR) {
-            g_string_free(basedir, TRUE);
-            g_string_free(keysfilename, TRUE);
+        log_info("Loading OTR private key %skeys.txt", load->basedir);
+        if (!load->key_err == GPG_ERR_NO_ERROR) {
             log_error("Failed to load private key");
             return;
         } else {
@@ -249,22 +514,17 @@ otr_on_connect(ProfAccount *account)
         }
     }
 
-    GString *fpsfilename = g_string_new(basedir->str);
-    g_string_append(fpsfilename, "fingerprints.txt");
-    if (!g_file_test(fpsfilename->str, G_FILE_TEST_IS_REGULAR)) {
-        log_info("No fingerprints file found %s", fpsfilename->str);
+    if (!load->has_fps) {
+        log_info("No fingerprints file found %sfingerprints.txt", load->basedir);
         data_loaded = FALSE;
     } else {
-        log_info("Loading fingerprints %s", fpsfilename->str);
-        err = otrl_privkey_read_fingerprints(user_state, fpsfilename->str, NULL, NULL);
-        if (!err == GPG_ERR_NO_ERROR) {
-            g_string_free(basedir, TRUE);
-            g_string_free(keysfilename, TRUE);
-            g_string_free(fpsfilename, TRUE);
+        log_info("Loading fingerprints %sfingerprints.txt", load->basedir);
+        if (!load->fps_err == GPG_ERR_NO_ERROR) {
             log_error("Failed to load fingerprints");
             return;
         } else {
             log_info("Loaded fingerprints");
+            _otr_fps_index_load(load->fps_lines);
             data_loaded = TRUE;
         }
     }
@@ -272,11 +532,75 @@ otr_on_connect(ProfAccount *account)
     if (data_loaded) {
         cons_show("Loaded OTR private key for %s", jid);
     }
+}
 
-    g_string_free(basedir, TRUE);
-    g_string_free(keysfilename, TRUE);
-    g_string_free(fpsfilename, TRUE);
-    return;
+static void
+_otr_load_free(OtrLoad *load)
+{
+    if (load->user_state) {
+        otrl_userstate_free(load->user_state);
+    }
+    free(load->jid);
+    free(load->basedir);
+    free(load);
+}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+static gpointer
+_otr_preload_thread(gpointer data)
+{
+    _otr_load_run(data);
+    return NULL;
+}
+
+static void
+_otr_preload_discard(void)
+{
+    if (preload) {
+        g_thread_join(preload->thread);
+        _otr_load_free(preload);
+        preload = NULL;
+    }
+}
+#endif
+
+// start reading the account's OTR files while the connection is made
+void
+otr_preload(const char *const barejid)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    _otr_preload_discard();
+    preload = _otr_load_new(barejid);
+    preload->thread = g_thread_new("otr-load", _otr_preload_thread, preload);
+#endif
+}
+
+void
+otr_on_connect(ProfAccount *account)
+{
+    if (jid) {
+        free(jid);
+    }
+    jid = strdup(account->jid);
+    log_info("Loading OTR key for %s", jid);
+
+    OtrLoad *load = NULL;
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (preload && g_strcmp0(preload->jid, jid) == 0) {
+        g_thread_join(preload->thread);
+        load = preload;
+        preload = NULL;
+    } else {
+        _otr_preload_discard();
+    }
+#endif
+    if (load == NULL) {
+        load = _otr_load_new(jid);
+        _otr_load_run(load);
+    }
+
+    _otr_load_apply(load);
+    _otr_load_free(load);
 }
 
 char*
@@ -330,7 +654,7 @@ otr_on_message_send(ProfChatWin *chatwin, const char *const message)
         char *encrypted = otr_encrypt_message(chatwin->barejid, message);
         if (encrypted) {
             id = message_send_chat_otr(chatwin->barejid, encrypted);
-            chat_log_otr_msg_out(chatwin->barejid, message);
+            chat_log_otr_msg_out(chatwin->barejid, message, id);
             chatwin_outgoing_msg(chatwin, message, id, PROF_MSG_OTR);
             otr_free_message(encrypted);
             free(id);
@@ -352,7 +676,7 @@ otr_on_message_send(ProfChatWin *chatwin, const char *const message)
         char *otr_tagged_msg = otr_tag_message(message);
         id = message_send_chat_otr(chatwin->barejid, otr_tagged_msg);
         chatwin_outgoing_msg(chatwin, message, id, PROF_MSG_PLAIN);
-        chat_log_msg_out(chatwin->barejid, message);
+        chat_log_msg_out(chatwin->barejid, message, id);
         free(otr_tagged_msg);
         free(id);
         return TRUE;
@@ -361,6 +685,118 @@ otr_on_message_send(ProfChatWin *chatwin, const char *const message)
     return FALSE;
 }
 
+// load the newly written key and create the fingerprints file
+static void
+_otr_keygen_complete(const char *const basedir)
+{
+    gcry_error_t err = 0;
+
+    log_info("Private key generated");
+    cons_show("");
+    cons_show("Private key generation complete.");
+
+    GString *keysfilename = g_string_new(basedir);
+    g_string_append(keysfilename, "keys.txt");
+    GString *fpsfilename = g_string_new(basedir);
+    g_string_append(fpsfilename, "fingerprints.txt");
+    log_debug("Generating fingerprints file %s for %s", fpsfilename->str, jid);
+    err = otrl_privkey_write_fingerprints(user_state, fpsfilename->str);
+    if (!err == GPG_ERR_NO_ERROR) {
+        g_string_free(keysfilename, TRUE);
+        g_string_free(fpsfilename, TRUE);
+        log_error("Failed to create fingerprints file");
+        cons_show_error("Failed to create fingerprints file");
+        return;
+    }
+    log_info("Fingerprints file created");
+
+    err = otrl_privkey_read(user_state, keysfilename->str);
+    if (!err == GPG_ERR_NO_ERROR) {
+        g_string_free(keysfilename, TRUE);
+        g_string_free(fpsfilename, TRUE);
+        log_error("Failed to load private key");
+        data_loaded = FALSE;
+        return;
+    }
+
+    err = otrl_privkey_read_fingerprints(user_state, fpsfilename->str, NULL, NULL);
+    if (!err == GPG_ERR_NO_ERROR) {
+        g_string_free(keysfilename, TRUE);
+        g_string_free(fpsfilename, TRUE);
+        log_error("Failed to load fingerprints");
+        data_loaded = FALSE;
+        return;
+    }
+
+    _otr_fps_index_rebuild(0);
+    data_loaded = TRUE;
+
+    g_string_free(keysfilename, TRUE);
+    g_string_free(fpsfilename, TRUE);
+}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+static gpointer
+_otr_keygen_thread(gpointer data)
+{
+    OtrKeygen *gen = data;
+    gen->err = otrlib_keygen_calculate(gen->newkey);
+    g_atomic_int_set(&gen->done, 1);
+
+    return NULL;
+}
+
+#endif
+
+void
+otr_keygen_poll(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (!keygen) {
+        prof_timer_interval(otr_keygen_poll, 0);
+        return;
+    }
+
+    if (!g_atomic_int_get(&keygen->done)) {
+        char *progress = g_strdup_printf("Generating OTR private key... %ds", (int)g_timer_elapsed(keygen->timer, NULL));
+        ui_show_progress(progress);
+        g_free(progress);
+        return;
+    }
+
+    OtrKeygen *gen = keygen;
+    keygen = NULL;
+    prof_timer_interval(otr_keygen_poll, 0);
+    g_thread_join(gen->thread);
+    ui_clear_progress();
+
+    if (gen->user_state != user_state) {
+        // reconnected while generating, the key belongs to the old userstate
+        log_info("Discarding OTR key generated for previous session");
+        otrlib_keygen_cancel(gen->user_state, gen->newkey);
+    } else if (gen->err != GPG_ERR_NO_ERROR) {
+        otrlib_keygen_cancel(gen->user_state, gen->newkey);
+        log_error("Failed to generate private key");
+        cons_show_error("Failed to generate private key");
+    } else {
+        GString *keysfilename = g_string_new(gen->basedir);
+        g_string_append(keysfilename, "keys.txt");
+        gcry_error_t err = otrlib_keygen_finish(user_state, gen->newkey, keysfilename->str);
+        g_string_free(keysfilename, TRUE);
+        if (err != GPG_ERR_NO_ERROR) {
+            log_error("Failed to write private key");
+            cons_show_error("Failed to generate private key");
+        } else {
+            _otr_keygen_complete(gen->basedir);
+        }
+    }
+
+    g_timer_destroy(gen->timer);
+    free(gen->basedir);
+    free(gen);
+#endif
+}
+
 void
 otr_keygen(ProfAccount *account)
 {
@@ -369,6 +805,13 @@ otr_keygen(ProfAccount *account)
         return;
     }
 
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (keygen) {
+        cons_show("OTR key generation already in progress.");
+        return;
+    }
+#endif
+
     if (jid) {
         free(jid);
     }
@@ -399,56 +842,50 @@ otr_keygen(ProfAccount *account)
     log_debug("Generating private key file %s for %s", keysfilename->str, jid);
     cons_show("Generating private key, this may take some time.");
     cons_show("Moving the mouse randomly around the screen may speed up the process!");
-    ui_update();
-    err = otrl_privkey_generate(user_state, keysfilename->str, account->jid, "xmpp");
-    if (!err == GPG_ERR_NO_ERROR) {
-        g_string_free(basedir, TRUE);
-        g_string_free(keysfilename, TRUE);
-        log_error("Failed to generate private key");
-        cons_show_error("Failed to generate private key");
-        return;
-    }
-    log_info("Private key generated");
-    cons_show("");
-    cons_show("Private key generation complete.");
 
-    GString *fpsfilename = g_string_new(basedir->str);
-    g_string_append(fpsfilename, "fingerprints.txt");
-    log_debug("Generating fingerprints file %s for %s", fpsfilename->str, jid);
-    err = otrl_privkey_write_fingerprints(user_state, fpsfilename->str);
-    if (!err == GPG_ERR_NO_ERROR) {
-        g_string_free(basedir, TRUE);
-        g_string_free(keysfilename, TRUE);
-        log_error("Failed to create fingerprints file");
-        cons_show_error("Failed to create fingerprints file");
-        return;
-    }
-    log_info("Fingerprints file created");
+#if GLIB_CHECK_VERSION(2,32,0)
+    // compute the key on a worker thread, otr_keygen_poll picks up the result
+    void *newkey = NULL;
+    if (otrlib_keygen_start(user_state, account->jid, &newkey, &err)) {
+        if (err != GPG_ERR_NO_ERROR) {
+            g_string_free(basedir, TRUE);
+            g_string_free(keysfilename, TRUE);
+            log_error("Failed to start private key generation");
+            cons_show_error("Failed to generate private key");
+            return;
+        }
+
+        keygen = malloc(sizeof(OtrKeygen));
+        keygen->user_state = user_state;
+        keygen->newkey = newkey;
+        keygen->basedir = strdup(basedir->str);
+        keygen->timer = g_timer_new();
+        keygen->err = GPG_ERR_NO_ERROR;
+        keygen->done = 0;
+        keygen->thread = g_thread_new("otr-keygen", _otr_keygen_thread, keygen);
+        ui_show_progress("Generating OTR private key...");
+        prof_timer_interval(otr_keygen_poll, KEYGEN_POLL_MS);
 
-    err = otrl_privkey_read(user_state, keysfilename->str);
-    if (!err == GPG_ERR_NO_ERROR) {
         g_string_free(basedir, TRUE);
         g_string_free(keysfilename, TRUE);
-        log_error("Failed to load private key");
-        data_loaded = FALSE;
         return;
     }
+#endif
 
-    err = otrl_privkey_read_fingerprints(user_state, fpsfilename->str, NULL, NULL);
+    ui_update();
+    err = otrl_privkey_generate(user_state, keysfilename->str, account->jid, "xmpp");
     if (!err == GPG_ERR_NO_ERROR) {
         g_string_free(basedir, TRUE);
         g_string_free(keysfilename, TRUE);
-        log_error("Failed to load fingerprints");
-        data_loaded = FALSE;
+        log_error("Failed to generate private key");
+        cons_show_error("Failed to generate private key");
         return;
     }
 
-    data_loaded = TRUE;
+    _otr_keygen_complete(basedir->str);
 
     g_string_free(basedir, TRUE);
     g_string_free(keysfilename, TRUE);
-    g_string_free(fpsfilename, TRUE);
-    return;
 }
 
 gboolean
@@ -656,64 +1093,79 @@ otr_get_their_fingerprint(const char *const recipient)
     }
 }
 
-prof_otrpolicy_t
-otr_get_policy(const char *const recipient)
+// policy set for a contact by the account, either in the contact lists or
+// as the account default, POLICY_UNSET when the global preference applies
+static int
+_otr_account_policy(const char *const account_name, const char *const recipient)
 {
-    char *account_name = jabber_get_account_name();
-    ProfAccount *account = accounts_get_account(account_name);
+    const ProfAccount *account = accounts_peek_account(account_name);
+    int result = POLICY_UNSET;
+
     // check contact specific setting
     if (g_list_find_custom(account->otr_manual, recipient, (GCompareFunc)g_strcmp0)) {
-        account_free(account);
-        return PROF_OTRPOLICY_MANUAL;
-    }
-    if (g_list_find_custom(account->otr_opportunistic, recipient, (GCompareFunc)g_strcmp0)) {
-        account_free(account);
-        return PROF_OTRPOLICY_OPPORTUNISTIC;
-    }
-    if (g_list_find_custom(account->otr_always, recipient, (GCompareFunc)g_strcmp0)) {
-        account_free(account);
-        return PROF_OTRPOLICY_ALWAYS;
-    }
+        result = PROF_OTRPOLICY_MANUAL;
+    } else if (g_list_find_custom(account->otr_opportunistic, recipient, (GCompareFunc)g_strcmp0)) {
+        result = PROF_OTRPOLICY_OPPORTUNISTIC;
+    } else if (g_list_find_custom(account->otr_always, recipient, (GCompareFunc)g_strcmp0)) {
+        result = PROF_OTRPOLICY_ALWAYS;
 
     // check default account setting
-    if (account->otr_policy) {
-        prof_otrpolicy_t result;
-        if (g_strcmp0(account->otr_policy, "manual") == 0) {
-            result = PROF_OTRPOLICY_MANUAL;
-        }
-        if (g_strcmp0(account->otr_policy, "opportunistic") == 0) {
-            result = PROF_OTRPOLICY_OPPORTUNISTIC;
-        }
-        if (g_strcmp0(account->otr_policy, "always") == 0) {
-            result = PROF_OTRPOLICY_ALWAYS;
-        }
-        account_free(account);
-        return result;
+    } else if (g_strcmp0(account->otr_policy, "manual") == 0) {
+        result = PROF_OTRPOLICY_MANUAL;
+    } else if (g_strcmp0(account->otr_policy, "opportunistic") == 0) {
+        result = PROF_OTRPOLICY_OPPORTUNISTIC;
+    } else if (g_strcmp0(account->otr_policy, "always") == 0) {
+        result = PROF_OTRPOLICY_ALWAYS;
     }
-    account_free(account);
 
-    // check global setting
-    char *pref_otr_policy = prefs_get_string(PREF_OTR_POLICY);
+    return result;
+}
 
-    // pref defaults to manual
-    prof_otrpolicy_t result = PROF_OTRPOLICY_MANUAL;
+prof_otrpolicy_t
+otr_get_policy(const char *const recipient)
+{
+    // account settings are cached per contact until the accounts file
+    // changes or another account connects
+    char *account_name = jabber_get_account_name();
+    guint generation = accounts_generation();
+    if (policy_cache == NULL || generation != policy_generation || g_strcmp0(account_name, policy_account) != 0) {
+        _otr_policy_cache_clear();
+        policy_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        policy_account = account_name ? strdup(account_name) : NULL;
+        policy_generation = generation;
+    }
 
-    if (strcmp(pref_otr_policy, "opportunistic") == 0) {
-        result = PROF_OTRPOLICY_OPPORTUNISTIC;
-    } else if (strcmp(pref_otr_policy, "always") == 0) {
-        result = PROF_OTRPOLICY_ALWAYS;
+    int policy;
+    gpointer cached = NULL;
+    if (g_hash_table_lookup_extended(policy_cache, recipient, NULL, &cached)) {
+        policy = GPOINTER_TO_INT(cached);
+    } else {
+        policy = _otr_account_policy(account_name, recipient);
+        g_hash_table_insert(policy_cache, strdup(recipient), GINT_TO_POINTER(policy));
     }
 
-    prefs_free_string(pref_otr_policy);
+    if (policy != POLICY_UNSET) {
+        return policy;
+    }
 
-    return result;
+    // check global setting, pref defaults to manual
+    const char *pref_otr_policy = prefs_peek_string(PREF_OTR_POLICY);
+    if (g_strcmp0(pref_otr_policy, "opportunistic") == 0) {
+        return PROF_OTRPOLICY_OPPORTUNISTIC;
+    } else if (g_strcmp0(pref_otr_policy, "always") == 0) {
+        return PROF_OTRPOLICY_ALWAYS;
+    } else {
+        return PROF_OTRPOLICY_MANUAL;
+    }
 }
 
 char*
 otr_encrypt_message(const char *const to, const char *const message)
 {
     char *newmessage = NULL;
+    gint64 start = stats_start();
     gcry_error_t err = otrlib_encrypt_message(user_state, &ops, jid, to, message, &newmessage);
+    stats_record(STATS_OTR_ENCRYPT, start);
 
     if (err != 0) {
         return NULL;
@@ -736,7 +1188,9 @@ otr_decrypt_message(const char *const from, const char *const message, gboolean
     char *newmessage = NULL;
     OtrlTLV *tlvs = NULL;
 
+    gint64 start = stats_start();
     int result = otrlib_decrypt_message(user_state, &ops, jid, from, message, &newmessage, &tlvs);
+    stats_record(STATS_OTR_DECRYPT, start);
 
     // internal libotr message
     if (result == 1) {
@@ -781,3 +1235,14 @@ otr_free_message(char *message)
 {
     otrl_message_free(message);
 }
+
+static void
+_otr_policy_cache_clear(void)
+{
+    if (policy_cache) {
+        g_hash_table_destroy(policy_cache);
+        policy_cache = NULL;
+    }
+    free(policy_account);
+    policy_account = NULL;
+}
@@ -69,6 +69,8 @@ void otr_shutdown(void);
 char* otr_libotr_version(void);
 char* otr_start_query(void);
 void otr_poll(void);
+void otr_keygen_poll(void);
+void otr_preload(const char *const barejid);
 void otr_on_connect(ProfAccount *account);
 
 char* otr_on_message_recv(const char *const barejid, const char *const resource, const char *const message, gboolean *decrypted);
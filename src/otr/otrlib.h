@@ -45,6 +45,7 @@ void otrlib_init_timer(void);
 void otrlib_poll(void);
 
 ConnContext* otrlib_context_find(OtrlUserState user_state, const char *const recipient, char *jid);
+gboolean otrlib_context_is_master(ConnContext *context);
 
 void otrlib_end_session(OtrlUserState user_state, const char *const recipient, char *jid, OtrlMessageAppOps *ops);
 
@@ -56,4 +57,11 @@ int otrlib_decrypt_message(OtrlUserState user_state, OtrlMessageAppOps *ops, cha
 
 void otrlib_handle_tlvs(OtrlUserState user_state, OtrlMessageAppOps *ops, ConnContext *context, OtrlTLV *tlvs, GHashTable *smp_initiators);
 
+// split key generation, start and finish on the main thread, calculate may
+// run on any thread, otrlib_keygen_start returns FALSE when not supported
+gboolean otrlib_keygen_start(OtrlUserState user_state, const char *const jid, void **newkey, gcry_error_t *err);
+gcry_error_t otrlib_keygen_calculate(void *newkey);
+gcry_error_t otrlib_keygen_finish(OtrlUserState user_state, void *newkey, const char *const filename);
+void otrlib_keygen_cancel(OtrlUserState user_state, void *newkey);
+
 #endif
@@ -82,6 +82,12 @@ otrlib_context_find(OtrlUserState user_state, const char *const recipient, char
     return otrl_context_find(user_state, recipient, jid, "xmpp", 0, NULL, NULL, NULL);
 }
 
+gboolean
+otrlib_context_is_master(ConnContext *context)
+{
+    return TRUE;
+}
+
 void
 otrlib_end_session(OtrlUserState user_state, const char *const recipient, char *jid, OtrlMessageAppOps *ops)
 {
@@ -226,3 +232,29 @@ otrlib_handle_tlvs(OtrlUserState user_state, OtrlMessageAppOps *ops, ConnContext
         otr_untrust(context->username);
     }
 }
+
+// libotr 3 has no split key generation, callers use otrl_privkey_generate
+gboolean
+otrlib_keygen_start(OtrlUserState user_state, const char *const jid, void **newkey, gcry_error_t *err)
+{
+    *newkey = NULL;
+    *err = GPG_ERR_NO_ERROR;
+    return FALSE;
+}
+
+gcry_error_t
+otrlib_keygen_calculate(void *newkey)
+{
+    return gcry_error(GPG_ERR_NOT_IMPLEMENTED);
+}
+
+gcry_error_t
+otrlib_keygen_finish(OtrlUserState user_state, void *newkey, const char *const filename)
+{
+    return gcry_error(GPG_ERR_NOT_IMPLEMENTED);
+}
+
+void
+otrlib_keygen_cancel(OtrlUserState user_state, void *newkey)
+{
+}
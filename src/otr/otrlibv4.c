@@ -41,9 +41,7 @@
 #include "log.h"
 #include "otr/otr.h"
 #include "otr/otrlib.h"
-
-static GTimer *timer;
-static unsigned int current_interval;
+#include "profanity.h"
 
 OtrlPolicy
 otrlib_policy(void)
@@ -51,25 +49,19 @@ otrlib_policy(void)
     return OTRL_POLICY_ALLOW_V1 | OTRL_POLICY_ALLOW_V2;
 }
 
+// libotr asks for polling through timer_control only when it has work
 void
 otrlib_init_timer(void)
 {
-    OtrlUserState user_state = otr_userstate();
-    timer = g_timer_new();
-    current_interval = otrl_message_poll_get_default_interval(user_state);
+    prof_timer_interval(otr_poll, 0);
 }
 
 void
 otrlib_poll(void)
 {
-    gdouble elapsed = g_timer_elapsed(timer, NULL);
-
-    if (current_interval != 0 && elapsed > current_interval) {
-        OtrlUserState user_state = otr_userstate();
-        OtrlMessageAppOps *ops = otr_messageops();
-        otrl_message_poll(user_state, ops, NULL);
-        g_timer_start(timer);
-    }
+    OtrlUserState user_state = otr_userstate();
+    OtrlMessageAppOps *ops = otr_messageops();
+    otrl_message_poll(user_state, ops, NULL);
 }
 
 char*
@@ -105,7 +97,7 @@ cb_otr_error_message_free(void *opdata, const char *err_msg)
 static void
 cb_timer_control(void *opdata, unsigned int interval)
 {
-    current_interval = interval;
+    prof_timer_interval(otr_poll, interval * 1000);
 }
 
 static void
@@ -259,6 +251,13 @@ otrlib_context_find(OtrlUserState user_state, const char *const recipient, char
     return otrl_context_find(user_state, recipient, jid, "xmpp", OTRL_INSTAG_MASTER, 0, NULL, NULL, NULL);
 }
 
+// fingerprints are only kept in the master context of each contact
+gboolean
+otrlib_context_is_master(ConnContext *context)
+{
+    return context->their_instance == OTRL_INSTAG_MASTER;
+}
+
 void
 otrlib_end_session(OtrlUserState user_state, const char *const recipient, char *jid, OtrlMessageAppOps *ops)
 {
@@ -318,3 +317,28 @@ void
 otrlib_handle_tlvs(OtrlUserState user_state, OtrlMessageAppOps *ops, ConnContext *context, OtrlTLV *tlvs, GHashTable *smp_initiators)
 {
 }
+
+gboolean
+otrlib_keygen_start(OtrlUserState user_state, const char *const jid, void **newkey, gcry_error_t *err)
+{
+    *err = otrl_privkey_generate_start(user_state, jid, "xmpp", newkey);
+    return TRUE;
+}
+
+gcry_error_t
+otrlib_keygen_calculate(void *newkey)
+{
+    return otrl_privkey_generate_calculate(newkey);
+}
+
+gcry_error_t
+otrlib_keygen_finish(OtrlUserState user_state, void *newkey, const char *const filename)
+{
+    return otrl_privkey_generate_finish(user_state, newkey, filename);
+}
+
+void
+otrlib_keygen_cancel(OtrlUserState user_state, void *newkey)
+{
+    otrl_privkey_generate_cancelled(user_state, newkey);
+}
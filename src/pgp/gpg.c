@@ -48,6 +48,8 @@
 #include "log.h"
 #include "common.h"
 #include "tools/autocomplete.h"
+#include "tools/stats.h"
+#include "tools/watchdog.h"
 #include "ui/ui.h"
 
 #define PGP_SIGNATURE_HEADER "-----BEGIN PGP SIGNATURE-----"
@@ -61,14 +63,133 @@ static GHashTable *pubkeys;
 static gchar *pubsloc;
 static GKeyFile *pubkeyfile;
 
+// keys appended to the pubkeys file since it was last rewritten, GKeyFile
+// merges repeated groups when loading so the last keyid for a jid wins
+#define PUBKEYS_JOURNAL_MAX 64
+static int pubkeys_journal;
+
 static char *passphrase;
 static char *passphrase_attempt;
 
 static Autocomplete key_ac;
 
+// keys as last listed from the keyring, shared with callers of
+// p_gpg_list_keys and kept until the keyring files change
+static GHashTable *key_list;
+static gchar *key_list_stamp;
+
+typedef enum {
+    GPG_CTX_ENCRYPT,
+    GPG_CTX_DECRYPT,
+    GPG_CTX_SIGN,
+    GPG_CTX_VERIFY,
+    GPG_CTX_KEYS,
+    GPG_CTX_COUNT
+} gpg_ctx_type_t;
+
+// one context per kind of operation, set up once and kept until close
+static gpgme_ctx_t contexts[GPG_CTX_COUNT];
+
+// fingerprint of the key last added as signer to the sign context
+static char *signer_fp;
+
+// resolved keys by the id they were looked up with, a secret lookup may
+// return a different key so they are kept apart
+static GHashTable *pubkey_cache;
+static GHashTable *seckey_cache;
+
+// signer key id by barejid and digest of the signature block, empty when
+// the signature checked out but the key is not in the keyring, so a
+// repeated signed presence skips gpgme
+#define VERIFIED_CACHE_MAX 1024
+static GHashTable *verified_cache;
+
+// how many operations may run off the main thread at once
+#define PGP_WORKERS 2
+
+typedef enum {
+    PGP_JOB_ENCRYPT,
+    PGP_JOB_VERIFY
+} pgp_job_type_t;
+
+// an operation given to a worker, the worker only fills in the results and
+// never logs or touches shared state, the job is finished on the main thread
+typedef struct pgp_job_t {
+    pgp_job_type_t type;
+    guint session;
+    guint64 seq;
+    char *barejid;
+    char *input;
+    gpgme_key_t key;
+    char *output;
+    char *fpr;
+    char *verified_key;
+    gpgme_error_t error;
+    p_gpg_encrypted_cb callback;
+    void *userdata;
+} PgpJob;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+// contexts belong to the worker thread that made them
+typedef struct pgp_worker_t {
+    gpgme_ctx_t encrypt;
+    gpgme_ctx_t verify;
+    gpgme_ctx_t keys;
+} PgpWorker;
+
+static void _p_gpg_worker_free(PgpWorker *worker);
+
+static GThreadPool *workers;
+static GPrivate worker_contexts = G_PRIVATE_INIT((GDestroyNotify)_p_gpg_worker_free);
+#endif
+
+static GAsyncQueue *completed;
+static guint pending_jobs;
+
+// encryptions are numbered as they are submitted and finished in that
+// order, so messages go out as they were typed even when a worker
+// finishes a later one first
+static guint64 encrypts_submitted;
+static guint64 encrypts_finished;
+static GList *encrypts_done;
+
+// bumped on disconnect so results for the last session are dropped
+static guint session;
+
+// an account's pubkeys file and the keys it names
+typedef struct pgp_load_t {
+    char *barejid;
+    gchar *pubsdir;
+    gchar *pubsloc;
+    int mkdir_errno;
+    GKeyFile *keyfile;
+    GHashTable *keys;
+    GHashTable *errors;
+#if GLIB_CHECK_VERSION(2,32,0)
+    GThread *thread;
+#endif
+} PgpLoad;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+// started by p_gpg_preload while connecting, joined by p_gpg_on_connect
+static PgpLoad *preload;
+
+static void _p_gpg_preload_discard(void);
+#endif
+
+static gpgme_ctx_t _p_gpg_ctx(gpg_ctx_type_t type);
+static gpgme_key_t _p_gpg_get_key(const char *const id, gboolean secret, gpgme_error_t *error);
+static void _p_gpg_release_contexts(void);
+static void _p_gpg_job_run(PgpJob *job, gpointer unused);
+static void _p_gpg_job_submit(PgpJob *job);
+static void _p_gpg_job_finish(PgpJob *job);
+static gint _p_gpg_job_cmp(const PgpJob *a, const PgpJob *b);
+static void _p_gpg_job_free(PgpJob *job);
+static void _p_gpg_signer_found(const char *const barejid, const char *const keyid);
 static char* _remove_header_footer(char *str, const char *const footer);
 static char* _add_header_footer(const char *const str, const char *const header, const char *const footer);
 static void _save_pubkeys(void);
+static void _append_pubkey(const char *const jid);
 
 void
 _p_gpg_free_pubkeyid(ProfPGPPubKeyId *pubkeyid)
@@ -114,10 +235,16 @@ p_gpg_init(void)
     gpgme_set_locale(NULL, LC_CTYPE, setlocale(LC_CTYPE, NULL));
 
     pubkeys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_p_gpg_free_pubkeyid);
+    pubkey_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)gpgme_key_unref);
+    seckey_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)gpgme_key_unref);
+    verified_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+
+    completed = g_async_queue_new();
+    pending_jobs = 0;
 
+    // the workers are started by the first operation and the key list is
+    // read when first needed, so startup doesn't wait on the gpg engine
     key_ac = autocomplete_new();
-    GHashTable *keys = p_gpg_list_keys();
-    p_gpg_free_keys(keys);
 
     passphrase = NULL;
     passphrase_attempt = NULL;
@@ -126,6 +253,10 @@ p_gpg_init(void)
 void
 p_gpg_close(void)
 {
+#if GLIB_CHECK_VERSION(2,32,0)
+    _p_gpg_preload_discard();
+#endif
+
     if (pubkeys) {
         g_hash_table_destroy(pubkeys);
         pubkeys = NULL;
@@ -139,9 +270,47 @@ p_gpg_close(void)
     free(pubsloc);
     pubsloc = NULL;
 
+    // let running and queued jobs finish, then drop what they returned
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (workers) {
+        g_thread_pool_free(workers, FALSE, TRUE);
+        workers = NULL;
+    }
+#endif
+    if (completed) {
+        session++;
+        p_gpg_process();
+        g_async_queue_unref(completed);
+        completed = NULL;
+    }
+
+    _p_gpg_release_contexts();
+
+    if (pubkey_cache) {
+        g_hash_table_destroy(pubkey_cache);
+        pubkey_cache = NULL;
+    }
+
+    if (seckey_cache) {
+        g_hash_table_destroy(seckey_cache);
+        seckey_cache = NULL;
+    }
+
+    if (verified_cache) {
+        g_hash_table_destroy(verified_cache);
+        verified_cache = NULL;
+    }
+
     autocomplete_free(key_ac);
     key_ac = NULL;
 
+    if (key_list) {
+        g_hash_table_unref(key_list);
+        key_list = NULL;
+    }
+    g_free(key_list_stamp);
+    key_list_stamp = NULL;
+
     if (passphrase) {
         free(passphrase);
         passphrase = NULL;
@@ -153,55 +322,174 @@ p_gpg_close(void)
     }
 }
 
-void
-p_gpg_on_connect(const char *const barejid)
+static PgpLoad*
+_p_gpg_load_new(const char *const barejid)
 {
+    PgpLoad *load = malloc(sizeof(PgpLoad));
+    load->barejid = strdup(barejid);
+
     gchar *data_home = xdg_get_data_home();
-    GString *pubsfile = g_string_new(data_home);
+    GString *pubsdir = g_string_new(data_home);
     free(data_home);
 
     gchar *account_dir = str_replace(barejid, "@", "_at_");
-    g_string_append(pubsfile, "/profanity/pgp/");
-    g_string_append(pubsfile, account_dir);
+    g_string_append(pubsdir, "/profanity/pgp/");
+    g_string_append(pubsdir, account_dir);
     free(account_dir);
 
+    load->pubsdir = pubsdir->str;
+    g_string_free(pubsdir, FALSE);
+    load->pubsloc = g_strdup_printf("%s/pubkeys", load->pubsdir);
+    load->mkdir_errno = 0;
+    load->keyfile = NULL;
+    load->keys = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)gpgme_key_unref);
+    load->errors = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+#if GLIB_CHECK_VERSION(2,32,0)
+    load->thread = NULL;
+#endif
+
+    return load;
+}
+
+// reads the pubkeys file, and when resolve is set looks up each key with a
+// context of its own, touches no other state so may run on a worker thread
+static void
+_p_gpg_load_run(PgpLoad *load, gboolean resolve)
+{
     // mkdir if doesn't exist for account
     errno = 0;
-    int res = g_mkdir_with_parents(pubsfile->str, S_IRWXU);
-    if (res == -1) {
-        char *errmsg = strerror(errno);
-        if (errmsg) {
-            log_error("Error creating directory: %s, %s", pubsfile->str, errmsg);
-        } else {
-            log_error("Error creating directory: %s", pubsfile->str);
+    if (g_mkdir_with_parents(load->pubsdir, S_IRWXU) == -1) {
+        load->mkdir_errno = errno;
+    }
+
+    if (g_file_test(load->pubsloc, G_FILE_TEST_EXISTS)) {
+        g_chmod(load->pubsloc, S_IRUSR | S_IWUSR);
+    }
+
+    load->keyfile = g_key_file_new();
+    g_key_file_load_from_file(load->keyfile, load->pubsloc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    gpgme_ctx_t ctx = NULL;
+    if (!resolve || gpgme_new(&ctx) != GPG_ERR_NO_ERROR) {
+        return;
+    }
+
+    gsize len = 0;
+    gchar **jids = g_key_file_get_groups(load->keyfile, &len);
+    int i = 0;
+    for (i = 0; i < len; i++) {
+        gchar *keyid = g_key_file_get_string(load->keyfile, jids[i], "keyid", NULL);
+        if (keyid && !g_hash_table_contains(load->keys, keyid) && !g_hash_table_contains(load->errors, keyid)) {
+            gpgme_key_t key = NULL;
+            gpgme_error_t error = gpgme_get_key(ctx, keyid, &key, 0);
+            if (error || key == NULL) {
+                if (key) {
+                    gpgme_key_unref(key);
+                }
+                g_hash_table_insert(load->errors, strdup(keyid), GUINT_TO_POINTER(error ? error : gpg_error(GPG_ERR_GENERAL)));
+            } else {
+                g_hash_table_insert(load->keys, strdup(keyid), key);
+            }
         }
+        g_free(keyid);
     }
+    g_strfreev(jids);
 
-    // create or read publickeys
-    g_string_append(pubsfile, "/pubkeys");
-    pubsloc = pubsfile->str;
-    g_string_free(pubsfile, FALSE);
+    gpgme_release(ctx);
+}
 
-    if (g_file_test(pubsloc, G_FILE_TEST_EXISTS)) {
-        g_chmod(pubsloc, S_IRUSR | S_IWUSR);
+static void
+_p_gpg_load_free(PgpLoad *load)
+{
+    if (load->keyfile) {
+        g_key_file_free(load->keyfile);
     }
+    g_hash_table_destroy(load->keys);
+    g_hash_table_destroy(load->errors);
+    free(load->barejid);
+    g_free(load->pubsdir);
+    g_free(load->pubsloc);
+    free(load);
+}
 
-    pubkeyfile = g_key_file_new();
-    g_key_file_load_from_file(pubkeyfile, pubsloc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+#if GLIB_CHECK_VERSION(2,32,0)
+static gpointer
+_p_gpg_preload_thread(gpointer data)
+{
+    _p_gpg_load_run(data, TRUE);
+    return NULL;
+}
 
-    // load each keyid
-    gsize len = 0;
-    gchar **jids = g_key_file_get_groups(pubkeyfile, &len);
+static void
+_p_gpg_preload_discard(void)
+{
+    if (preload) {
+        g_thread_join(preload->thread);
+        _p_gpg_load_free(preload);
+        preload = NULL;
+    }
+}
+#endif
 
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
+// start reading and resolving the account's public keys while the
+// connection is made
+void
+p_gpg_preload(const char *const barejid)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    _p_gpg_preload_discard();
+    preload = _p_gpg_load_new(barejid);
+    preload->thread = g_thread_new("pgp-load", _p_gpg_preload_thread, preload);
+#endif
+}
 
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        g_strfreev(jids);
-        return;
+void
+p_gpg_on_connect(const char *const barejid)
+{
+    PgpLoad *load = NULL;
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (preload && g_strcmp0(preload->barejid, barejid) == 0) {
+        g_thread_join(preload->thread);
+        load = preload;
+        preload = NULL;
+    } else {
+        _p_gpg_preload_discard();
+    }
+#endif
+    if (load == NULL) {
+        load = _p_gpg_load_new(barejid);
+        _p_gpg_load_run(load, FALSE);
+    }
+
+    if (load->mkdir_errno) {
+        char *errmsg = strerror(load->mkdir_errno);
+        if (errmsg) {
+            log_error("Error creating directory: %s, %s", load->pubsdir, errmsg);
+        } else {
+            log_error("Error creating directory: %s", load->pubsdir);
+        }
     }
 
+    // create or read publickeys
+    pubsloc = strdup(load->pubsloc);
+    pubkeyfile = load->keyfile;
+    load->keyfile = NULL;
+
+    // keys resolved while connecting
+    GHashTableIter iter;
+    gpointer keyid_p, key_p;
+    g_hash_table_iter_init(&iter, load->keys);
+    while (g_hash_table_iter_next(&iter, &keyid_p, &key_p)) {
+        if (!g_hash_table_contains(pubkey_cache, keyid_p)) {
+            gpgme_key_ref(key_p);
+            g_hash_table_insert(pubkey_cache, strdup(keyid_p), key_p);
+        }
+    }
+
+    // load each keyid, the keys resolved are kept for encrypting later
+    gsize len = 0;
+    gchar **jids = g_key_file_get_groups(pubkeyfile, &len);
+
     int i = 0;
     for (i = 0; i < len; i++) {
         GError *gerr = NULL;
@@ -212,10 +500,17 @@ p_gpg_on_connect(const char *const barejid)
             g_error_free(gerr);
             g_free(keyid);
         } else {
+            gpgme_error_t error = GPG_ERR_NO_ERROR;
             gpgme_key_t key = NULL;
-            error = gpgme_get_key(ctx, keyid, &key, 0);
-            if (error || key == NULL) {
+            gpointer failed = NULL;
+            if (g_hash_table_lookup_extended(load->errors, keyid, NULL, &failed)) {
+                error = GPOINTER_TO_UINT(failed);
+            } else {
+                key = _p_gpg_get_key(keyid, FALSE, &error);
+            }
+            if (key == NULL) {
                 log_warning("GPG: Failed to get key for %s: %s %s", jid, gpgme_strsource(error), gpgme_strerror(error));
+                g_free(keyid);
                 continue;
             }
 
@@ -224,12 +519,11 @@ p_gpg_on_connect(const char *const barejid)
             pubkeyid->received = FALSE;
             g_hash_table_replace(pubkeys, strdup(jid), pubkeyid);
             g_free(keyid);
-            gpgme_key_unref(key);
         }
     }
 
-    gpgme_release(ctx);
     g_strfreev(jids);
+    _p_gpg_load_free(load);
 
     _save_pubkeys();
 }
@@ -237,11 +531,25 @@ p_gpg_on_connect(const char *const barejid)
 void
 p_gpg_on_disconnect(void)
 {
+    session++;
+
     if (pubkeys) {
         g_hash_table_destroy(pubkeys);
         pubkeys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_p_gpg_free_pubkeyid);
     }
 
+    if (pubkey_cache) {
+        g_hash_table_remove_all(pubkey_cache);
+    }
+    if (seckey_cache) {
+        g_hash_table_remove_all(seckey_cache);
+    }
+    if (verified_cache) {
+        g_hash_table_remove_all(verified_cache);
+    }
+    free(signer_fp);
+    signer_fp = NULL;
+
     if (pubkeyfile) {
         g_key_file_free(pubkeyfile);
         pubkeyfile = NULL;
@@ -264,32 +572,31 @@ p_gpg_on_disconnect(void)
 gboolean
 p_gpg_addkey(const char *const jid, const char *const keyid)
 {
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        return FALSE;
+    // setting a key always resolves it again, and drops the one it replaces
+    ProfPGPPubKeyId *current = g_hash_table_lookup(pubkeys, jid);
+    if (current && current->id) {
+        g_hash_table_remove(pubkey_cache, current->id);
     }
+    g_hash_table_remove(pubkey_cache, keyid);
+    g_hash_table_remove_all(verified_cache);
 
-    gpgme_key_t key = NULL;
-    error = gpgme_get_key(ctx, keyid, &key, 0);
-    gpgme_release(ctx);
+    gpgme_error_t error = GPG_ERR_NO_ERROR;
+    gpgme_key_t key = _p_gpg_get_key(keyid, FALSE, &error);
 
-    if (error || key == NULL) {
+    if (key == NULL) {
         log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
         return FALSE;
     }
 
     // save to public key file
     g_key_file_set_string(pubkeyfile, jid, "keyid", keyid);
-    _save_pubkeys();
+    _append_pubkey(jid);
 
     // update in memory pubkeys list
     ProfPGPPubKeyId *pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
     pubkeyid->id = strdup(keyid);
     pubkeyid->received = FALSE;
     g_hash_table_replace(pubkeys, strdup(jid), pubkeyid);
-    gpgme_key_unref(key);
 
     return TRUE;
 }
@@ -321,20 +628,65 @@ _p_gpg_free_key(ProfPGPKey *key)
     }
 }
 
+// modification times and sizes of the keyring files, listing the keyring
+// again is only needed when this changes
+static gchar*
+_p_gpg_keyring_stamp(void)
+{
+    gchar *homedir = NULL;
+    gpgme_engine_info_t info = NULL;
+    if (gpgme_get_engine_info(&info) == GPG_ERR_NO_ERROR) {
+        for (; info; info = info->next) {
+            if (info->protocol == GPGME_PROTOCOL_OpenPGP && info->home_dir) {
+                homedir = g_strdup(info->home_dir);
+                break;
+            }
+        }
+    }
+    if (homedir == NULL) {
+        const char *gnupghome = g_getenv("GNUPGHOME");
+        homedir = gnupghome ? g_strdup(gnupghome) : g_build_filename(g_get_home_dir(), ".gnupg", NULL);
+    }
+
+    const char *files[] = { "pubring.kbx", "pubring.gpg", "secring.gpg", "private-keys-v1.d" };
+    GString *stamp = g_string_new(NULL);
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(files); i++) {
+        gchar *path = g_build_filename(homedir, files[i], NULL);
+        GStatBuf st;
+        if (g_stat(path, &st) == 0) {
+            g_string_append_printf(stamp, "%s:%ld:%ld;", files[i], (long)st.st_mtime, (long)st.st_size);
+        }
+        g_free(path);
+    }
+    g_free(homedir);
+
+    return g_string_free(stamp, FALSE);
+}
+
+// the returned table is shared, release it with p_gpg_free_keys
 GHashTable*
 p_gpg_list_keys(void)
 {
-    gpgme_error_t error;
-    GHashTable *result = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_p_gpg_free_key);
+    gchar *stamp = _p_gpg_keyring_stamp();
+    if (key_list && g_strcmp0(stamp, key_list_stamp) == 0) {
+        g_free(stamp);
+        return g_hash_table_ref(key_list);
+    }
 
+    gpgme_error_t error;
     gpgme_ctx_t ctx;
     error = gpgme_new(&ctx);
 
     if (error) {
         log_error("GPG: Could not list keys. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+        g_free(stamp);
         return NULL;
     }
 
+    GHashTable *result = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_p_gpg_free_key);
+
+    watchdog_tag(WATCHDOG_GPGME);
     error = gpgme_op_keylist_start(ctx, NULL, 0);
     if (error == GPG_ERR_NO_ERROR) {
         gpgme_key_t key;
@@ -391,6 +743,13 @@ p_gpg_list_keys(void)
 
     gpgme_release(ctx);
 
+    if (key_list) {
+        g_hash_table_unref(key_list);
+    }
+    key_list = result;
+    g_free(key_list_stamp);
+    key_list_stamp = stamp;
+
     autocomplete_clear(key_ac);
     GList *ids = g_hash_table_get_keys(result);
     GList *curr = ids;
@@ -401,13 +760,13 @@ p_gpg_list_keys(void)
     }
     g_list_free(ids);
 
-    return result;
+    return g_hash_table_ref(result);
 }
 
 void
 p_gpg_free_keys(GHashTable *keys)
 {
-    g_hash_table_destroy(keys);
+    g_hash_table_unref(keys);
 }
 
 
@@ -426,30 +785,15 @@ p_gpg_libver(void)
 gboolean
 p_gpg_valid_key(const char *const keyid)
 {
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        return FALSE;
-    }
+    gpgme_error_t error = GPG_ERR_NO_ERROR;
+    gpgme_key_t key = _p_gpg_get_key(keyid, TRUE, &error);
 
-    gpgme_key_t key = NULL;
-    error = gpgme_get_key(ctx, keyid, &key, 1);
-
-    if (error || key == NULL) {
+    if (key == NULL) {
         log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
         return FALSE;
     }
 
-    if (key) {
-        gpgme_release(ctx);
-        gpgme_key_unref(key);
-        return TRUE;
-    }
-
-    gpgme_release(ctx);
-    return FALSE;
+    return TRUE;
 }
 
 gboolean
@@ -459,6 +803,8 @@ p_gpg_available(const char *const barejid)
     return (pubkey != NULL);
 }
 
+// checked by a worker, the key found is noted for the contact once the
+// result is back on the main thread
 void
 p_gpg_verify(const char *const barejid, const char *const sign)
 {
@@ -466,83 +812,55 @@ p_gpg_verify(const char *const barejid, const char *const sign)
         return;
     }
 
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        return;
-    }
-
-    char *sign_with_header_footer = _add_header_footer(sign, PGP_SIGNATURE_HEADER, PGP_SIGNATURE_FOOTER);
-    gpgme_data_t sign_data;
-    gpgme_data_new_from_mem(&sign_data, sign_with_header_footer, strlen(sign_with_header_footer), 1);
-    free(sign_with_header_footer);
-
-    gpgme_data_t plain_data;
-    gpgme_data_new(&plain_data);
-
-    error = gpgme_op_verify(ctx, sign_data, NULL, plain_data);
-    gpgme_data_release(sign_data);
-    gpgme_data_release(plain_data);
+    gchar *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, sign, -1);
+    gchar *verified_key = g_strdup_printf("%s %s", barejid, digest);
+    g_free(digest);
 
-    if (error) {
-        log_error("GPG: Failed to verify. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
-        return;
-    }
-
-    gpgme_verify_result_t result = gpgme_op_verify_result(ctx);
-    if (result) {
-        if (result->signatures) {
-            gpgme_key_t key = NULL;
-            error = gpgme_get_key(ctx, result->signatures->fpr, &key, 0);
-            if (error) {
-                log_debug("Could not find PGP key with ID %s for %s", result->signatures->fpr, barejid);
-            } else {
-                log_debug("Fingerprint found for %s: %s ", barejid, key->subkeys->fpr);
-                ProfPGPPubKeyId *pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
-                pubkeyid->id = strdup(key->subkeys->keyid);
-                pubkeyid->received = TRUE;
-                g_hash_table_replace(pubkeys, strdup(barejid), pubkeyid);
-            }
-
-            gpgme_key_unref(key);
+    char *keyid = g_hash_table_lookup(verified_cache, verified_key);
+    if (keyid) {
+        g_free(verified_key);
+        if (keyid[0] != '\0') {
+            _p_gpg_signer_found(barejid, keyid);
         }
+        return;
     }
 
-    gpgme_release(ctx);
+    PgpJob *job = calloc(1, sizeof(PgpJob));
+    job->type = PGP_JOB_VERIFY;
+    job->barejid = strdup(barejid);
+    job->input = strdup(sign);
+    job->verified_key = verified_key;
+    _p_gpg_job_submit(job);
 }
 
 char*
 p_gpg_sign(const char *const str, const char *const fp)
 {
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    gpgme_ctx_t ctx = _p_gpg_ctx(GPG_CTX_SIGN);
+    if (ctx == NULL) {
         return NULL;
     }
 
-    gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+    // the signer stays on the context until a different key is asked for
+    if (g_strcmp0(signer_fp, fp) != 0) {
+        gpgme_error_t error = GPG_ERR_NO_ERROR;
+        gpgme_key_t key = _p_gpg_get_key(fp, TRUE, &error);
 
-    gpgme_key_t key = NULL;
-    error = gpgme_get_key(ctx, fp, &key, 1);
-
-    if (error || key == NULL) {
-        log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
-        return NULL;
-    }
+        if (key == NULL) {
+            log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+            return NULL;
+        }
 
-    gpgme_signers_clear(ctx);
-    error = gpgme_signers_add(ctx, key);
-    gpgme_key_unref(key);
+        free(signer_fp);
+        signer_fp = NULL;
+        gpgme_signers_clear(ctx);
+        error = gpgme_signers_add(ctx, key);
 
-    if (error) {
-        log_error("GPG: Failed to load signer. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
-        return NULL;
+        if (error) {
+            log_error("GPG: Failed to load signer. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+            return NULL;
+        }
+        signer_fp = strdup(fp);
     }
 
     char *str_or_empty = NULL;
@@ -558,10 +876,11 @@ p_gpg_sign(const char *const str, const char *const fp)
     gpgme_data_t signed_data;
     gpgme_data_new(&signed_data);
 
-    gpgme_set_armor(ctx,1);
-    error = gpgme_op_sign(ctx, str_data, signed_data, GPGME_SIG_MODE_DETACH);
+    gint64 start = stats_start();
+    watchdog_tag(WATCHDOG_GPGME);
+    gpgme_error_t error = gpgme_op_sign(ctx, str_data, signed_data, GPGME_SIG_MODE_DETACH);
+    stats_record(STATS_PGP_SIGN, start);
     gpgme_data_release(str_data);
-    gpgme_release(ctx);
 
     if (error) {
         log_error("GPG: Failed to sign string. %s %s", gpgme_strsource(error), gpgme_strerror(error));
@@ -588,8 +907,9 @@ p_gpg_sign(const char *const str, const char *const fp)
     return result;
 }
 
-char*
-p_gpg_encrypt(const char *const barejid, const char *const message)
+// the recipient key for a contact, NULL when none is set or it can't be found
+static gpgme_key_t
+_p_gpg_recipient(const char *const barejid)
 {
     ProfPGPPubKeyId *pubkeyid = g_hash_table_lookup(pubkeys, barejid);
     if (!pubkeyid) {
@@ -599,28 +919,24 @@ p_gpg_encrypt(const char *const barejid, const char *const message)
         return NULL;
     }
 
-    gpgme_key_t keys[2];
-
-    keys[0] = NULL;
-    keys[1] = NULL;
+    gpgme_error_t error = GPG_ERR_NO_ERROR;
+    gpgme_key_t key = _p_gpg_get_key(pubkeyid->id, FALSE, &error);
 
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        return NULL;
+    if (key == NULL) {
+        log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
     }
 
-    gpgme_key_t key;
-    error = gpgme_get_key(ctx, pubkeyid->id, &key, 0);
+    return key;
+}
 
-    if (error || key == NULL) {
-        log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
-        return NULL;
-    }
+// safe to call from a worker with a context of its own
+static char*
+_p_gpg_encrypt_with(gpgme_ctx_t ctx, gpgme_key_t key, const char *const message, gpgme_error_t *error)
+{
+    gpgme_key_t keys[2];
 
     keys[0] = key;
+    keys[1] = NULL;
 
     gpgme_data_t plain;
     gpgme_data_new_from_mem(&plain, message, strlen(message), 1);
@@ -628,14 +944,14 @@ p_gpg_encrypt(const char *const barejid, const char *const message)
     gpgme_data_t cipher;
     gpgme_data_new(&cipher);
 
-    gpgme_set_armor(ctx, 1);
-    error = gpgme_op_encrypt(ctx, keys, GPGME_ENCRYPT_ALWAYS_TRUST, plain, cipher);
+    gint64 start = stats_start();
+    watchdog_tag(WATCHDOG_GPGME);
+    *error = gpgme_op_encrypt(ctx, keys, GPGME_ENCRYPT_ALWAYS_TRUST, plain, cipher);
+    stats_record(STATS_PGP_ENCRYPT, start);
     gpgme_data_release(plain);
-    gpgme_release(ctx);
-    gpgme_key_unref(key);
 
-    if (error) {
-        log_error("GPG: Failed to encrypt message. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    if (*error) {
+        gpgme_data_release(cipher);
         return NULL;
     }
 
@@ -654,18 +970,132 @@ p_gpg_encrypt(const char *const barejid, const char *const message)
     return result;
 }
 
+// safe to call from a worker, leaves the signer's fingerprint and key id
+// on the job
+static void
+_p_gpg_verify_with(gpgme_ctx_t ctx, gpgme_ctx_t keys_ctx, PgpJob *job)
+{
+    char *sign_with_header_footer = _add_header_footer(job->input, PGP_SIGNATURE_HEADER, PGP_SIGNATURE_FOOTER);
+    gpgme_data_t sign_data;
+    gpgme_data_new_from_mem(&sign_data, sign_with_header_footer, strlen(sign_with_header_footer), 1);
+    free(sign_with_header_footer);
+
+    gpgme_data_t plain_data;
+    gpgme_data_new(&plain_data);
+
+    gint64 start = stats_start();
+    watchdog_tag(WATCHDOG_GPGME);
+    job->error = gpgme_op_verify(ctx, sign_data, NULL, plain_data);
+    stats_record(STATS_PGP_VERIFY, start);
+    gpgme_data_release(sign_data);
+    gpgme_data_release(plain_data);
+
+    if (job->error) {
+        return;
+    }
+
+    gpgme_verify_result_t result = gpgme_op_verify_result(ctx);
+    if (result && result->signatures && result->signatures->fpr) {
+        job->fpr = strdup(result->signatures->fpr);
+
+        gpgme_key_t key = NULL;
+        if (gpgme_get_key(keys_ctx, job->fpr, &key, 0) == GPG_ERR_NO_ERROR && key) {
+            job->output = strdup(key->subkeys->keyid);
+        }
+        if (key) {
+            gpgme_key_unref(key);
+        }
+    }
+}
+
 char*
-p_gpg_decrypt(const char *const cipher)
+p_gpg_encrypt(const char *const barejid, const char *const message)
 {
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
+    gpgme_ctx_t ctx = _p_gpg_ctx(GPG_CTX_ENCRYPT);
+    if (ctx == NULL) {
+        return NULL;
+    }
 
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    gpgme_key_t key = _p_gpg_recipient(barejid);
+    if (key == NULL) {
         return NULL;
     }
 
-    gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+    gpgme_error_t error = GPG_ERR_NO_ERROR;
+    char *result = _p_gpg_encrypt_with(ctx, key, message, &error);
+    if (error) {
+        log_error("GPG: Failed to encrypt message. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    }
+
+    return result;
+}
+
+// encrypted by a worker, returns FALSE without calling back when the
+// contact has no usable key
+gboolean
+p_gpg_encrypt_async(const char *const barejid, const char *const message, p_gpg_encrypted_cb callback,
+    void *userdata)
+{
+    gpgme_key_t key = _p_gpg_recipient(barejid);
+    if (key == NULL) {
+        return FALSE;
+    }
+
+    PgpJob *job = calloc(1, sizeof(PgpJob));
+    job->type = PGP_JOB_ENCRYPT;
+    job->barejid = strdup(barejid);
+    job->input = strdup(message);
+    job->key = key;
+    gpgme_key_ref(key);
+    job->callback = callback;
+    job->userdata = userdata;
+    _p_gpg_job_submit(job);
+
+    return TRUE;
+}
+
+gboolean
+p_gpg_pending(void)
+{
+    return pending_jobs > 0;
+}
+
+// finish the jobs the workers have completed
+void
+p_gpg_process(void)
+{
+    if (completed == NULL) {
+        return;
+    }
+
+    PgpJob *job = NULL;
+    while ((job = g_async_queue_try_pop(completed)) != NULL) {
+        if (job->type == PGP_JOB_ENCRYPT) {
+            encrypts_done = g_list_insert_sorted(encrypts_done, job, (GCompareFunc)_p_gpg_job_cmp);
+            continue;
+        }
+        pending_jobs--;
+        _p_gpg_job_finish(job);
+        _p_gpg_job_free(job);
+    }
+
+    while (encrypts_done && ((PgpJob*)encrypts_done->data)->seq == encrypts_finished) {
+        job = encrypts_done->data;
+        encrypts_done = g_list_delete_link(encrypts_done, encrypts_done);
+        encrypts_finished++;
+        pending_jobs--;
+        _p_gpg_job_finish(job);
+        _p_gpg_job_free(job);
+    }
+}
+
+char*
+p_gpg_decrypt(const char *const cipher)
+{
+    gpgme_ctx_t ctx = _p_gpg_ctx(GPG_CTX_DECRYPT);
+    if (ctx == NULL) {
+        return NULL;
+    }
 
     char *cipher_with_headers = _add_header_footer(cipher, PGP_MESSAGE_HEADER, PGP_MESSAGE_FOOTER);
     gpgme_data_t cipher_data;
@@ -675,13 +1105,15 @@ p_gpg_decrypt(const char *const cipher)
     gpgme_data_t plain_data;
     gpgme_data_new(&plain_data);
 
-    error = gpgme_op_decrypt(ctx, cipher_data, plain_data);
+    gint64 start = stats_start();
+    watchdog_tag(WATCHDOG_GPGME);
+    gpgme_error_t error = gpgme_op_decrypt(ctx, cipher_data, plain_data);
+    stats_record(STATS_PGP_DECRYPT, start);
     gpgme_data_release(cipher_data);
 
     if (error) {
         log_error("GPG: Failed to encrypt message. %s %s", gpgme_strsource(error), gpgme_strerror(error));
         gpgme_data_release(plain_data);
-        gpgme_release(ctx);
         return NULL;
     }
 
@@ -689,19 +1121,13 @@ p_gpg_decrypt(const char *const cipher)
     if (res) {
         gpgme_recipient_t recipient = res->recipients;
         if (recipient) {
-            gpgme_key_t key;
-            error = gpgme_get_key(ctx, recipient->keyid, &key, 1);
+            gpgme_key_t key = _p_gpg_get_key(recipient->keyid, TRUE, &error);
 
-            if (!error && key) {
-                const char *addr = gpgme_key_get_string_attr(key, GPGME_ATTR_EMAIL, NULL, 0);
-                if (addr) {
-                    log_debug("GPG: Decrypted message for recipient: %s", addr);
-                }
-                gpgme_key_unref(key);
+            if (key && key->uids && key->uids->email) {
+                log_debug("GPG: Decrypted message for recipient: %s", key->uids->email);
             }
         }
     }
-    gpgme_release(ctx);
 
     size_t len = 0;
     char *plain_str = gpgme_data_release_and_get_mem(plain_data, &len);
@@ -728,6 +1154,13 @@ p_gpg_free_decrypted(char *decrypted)
 char*
 p_gpg_autocomplete_key(const char *const search_str)
 {
+    if (key_list == NULL) {
+        GHashTable *keys = p_gpg_list_keys();
+        if (keys) {
+            p_gpg_free_keys(keys);
+        }
+    }
+
     return autocomplete_complete(key_ac, search_str, TRUE);
 }
 
@@ -760,6 +1193,258 @@ p_gpg_format_fp_str(char *fp)
     return result;
 }
 
+static gpgme_ctx_t
+_p_gpg_ctx(gpg_ctx_type_t type)
+{
+    if (contexts[type]) {
+        return contexts[type];
+    }
+
+    gpgme_ctx_t ctx;
+    gpgme_error_t error = gpgme_new(&ctx);
+    if (error) {
+        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+        return NULL;
+    }
+
+    switch (type) {
+    case GPG_CTX_ENCRYPT:
+        gpgme_set_armor(ctx, 1);
+        break;
+    case GPG_CTX_SIGN:
+        gpgme_set_armor(ctx, 1);
+        gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+        break;
+    case GPG_CTX_DECRYPT:
+        gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+        break;
+    default:
+        break;
+    }
+
+    contexts[type] = ctx;
+    return ctx;
+}
+
+static void
+_p_gpg_release_contexts(void)
+{
+    int i;
+    for (i = 0; i < GPG_CTX_COUNT; i++) {
+        if (contexts[i]) {
+            gpgme_release(contexts[i]);
+            contexts[i] = NULL;
+        }
+    }
+
+    free(signer_fp);
+    signer_fp = NULL;
+}
+
+// the key returned belongs to the cache, it stays valid until the cache is
+// cleared on disconnect or the key is replaced with /pgp setkey
+static gpgme_key_t
+_p_gpg_get_key(const char *const id, gboolean secret, gpgme_error_t *error)
+{
+    GHashTable *cache = secret ? seckey_cache : pubkey_cache;
+    gpgme_key_t key = g_hash_table_lookup(cache, id);
+    if (key) {
+        return key;
+    }
+
+    gpgme_ctx_t ctx = _p_gpg_ctx(GPG_CTX_KEYS);
+    if (ctx == NULL) {
+        *error = gpg_error(GPG_ERR_GENERAL);
+        return NULL;
+    }
+
+    key = NULL;
+    *error = gpgme_get_key(ctx, id, &key, secret ? 1 : 0);
+    if (*error || key == NULL) {
+        if (key) {
+            gpgme_key_unref(key);
+        }
+        return NULL;
+    }
+
+    g_hash_table_insert(cache, strdup(id), key);
+    return key;
+}
+
+// run on a worker, or on the main thread when there are none
+static void
+_p_gpg_job_run(PgpJob *job, gpointer unused)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+    PgpWorker *worker = g_private_get(&worker_contexts);
+    if (worker == NULL) {
+        worker = calloc(1, sizeof(PgpWorker));
+        if (gpgme_new(&worker->encrypt) == GPG_ERR_NO_ERROR) {
+            gpgme_set_armor(worker->encrypt, 1);
+        } else {
+            worker->encrypt = NULL;
+        }
+        if (gpgme_new(&worker->verify) != GPG_ERR_NO_ERROR) {
+            worker->verify = NULL;
+        }
+        if (gpgme_new(&worker->keys) != GPG_ERR_NO_ERROR) {
+            worker->keys = NULL;
+        }
+        g_private_set(&worker_contexts, worker);
+    }
+    gpgme_ctx_t encrypt_ctx = worker->encrypt;
+    gpgme_ctx_t verify_ctx = worker->verify;
+    gpgme_ctx_t keys_ctx = worker->keys;
+#else
+    gpgme_ctx_t encrypt_ctx = _p_gpg_ctx(GPG_CTX_ENCRYPT);
+    gpgme_ctx_t verify_ctx = _p_gpg_ctx(GPG_CTX_VERIFY);
+    gpgme_ctx_t keys_ctx = _p_gpg_ctx(GPG_CTX_KEYS);
+#endif
+
+    if (job->type == PGP_JOB_ENCRYPT) {
+        if (encrypt_ctx) {
+            job->output = _p_gpg_encrypt_with(encrypt_ctx, job->key, job->input, &job->error);
+        } else {
+            job->error = gpg_error(GPG_ERR_GENERAL);
+        }
+    } else {
+        if (verify_ctx && keys_ctx) {
+            _p_gpg_verify_with(verify_ctx, keys_ctx, job);
+        } else {
+            job->error = gpg_error(GPG_ERR_GENERAL);
+        }
+    }
+
+    g_async_queue_push(completed, job);
+}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+static void
+_p_gpg_worker_free(PgpWorker *worker)
+{
+    if (worker->encrypt) {
+        gpgme_release(worker->encrypt);
+    }
+    if (worker->verify) {
+        gpgme_release(worker->verify);
+    }
+    if (worker->keys) {
+        gpgme_release(worker->keys);
+    }
+    free(worker);
+}
+#endif
+
+// without worker threads the job runs now, it is still finished from
+// p_gpg_process so callers see the same order either way
+static void
+_p_gpg_job_submit(PgpJob *job)
+{
+    job->session = session;
+    if (job->type == PGP_JOB_ENCRYPT) {
+        job->seq = encrypts_submitted++;
+    }
+    pending_jobs++;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+    GError *error = NULL;
+    if (workers == NULL) {
+        // exclusive so the workers, and the contexts they hold, stay alive
+        // between bursts of messages rather than being set up again each time
+        workers = g_thread_pool_new((GFunc)_p_gpg_job_run, NULL, PGP_WORKERS, TRUE, &error);
+        if (error) {
+            log_warning("GPG: Could not start workers. %s", error->message);
+            g_error_free(error);
+            error = NULL;
+        }
+    }
+    if (workers && g_thread_pool_push(workers, job, &error)) {
+        return;
+    }
+    if (error) {
+        log_warning("GPG: Could not queue operation, running it now. %s", error->message);
+        g_error_free(error);
+    }
+#endif
+
+    _p_gpg_job_run(job, NULL);
+}
+
+static void
+_p_gpg_job_finish(PgpJob *job)
+{
+    gboolean current = job->session == session;
+
+    if (job->type == PGP_JOB_ENCRYPT) {
+        if (current && job->error) {
+            log_error("GPG: Failed to encrypt message. %s %s", gpgme_strsource(job->error), gpgme_strerror(job->error));
+        }
+        // callbacks always run so they can free what they were given
+        job->callback(current ? job->output : NULL, job->userdata);
+        return;
+    }
+
+    if (!current) {
+        return;
+    }
+
+    if (job->error) {
+        log_error("GPG: Failed to verify. %s %s", gpgme_strsource(job->error), gpgme_strerror(job->error));
+        return;
+    }
+
+    // only a signature with a signer is worth remembering
+    if (job->fpr == NULL) {
+        return;
+    }
+
+    if (g_hash_table_size(verified_cache) >= VERIFIED_CACHE_MAX) {
+        g_hash_table_remove_all(verified_cache);
+    }
+    g_hash_table_replace(verified_cache, job->verified_key, strdup(job->output ? job->output : ""));
+    job->verified_key = NULL;
+
+    if (job->output == NULL) {
+        log_debug("Could not find PGP key with ID %s for %s", job->fpr, job->barejid);
+    } else {
+        log_debug("Fingerprint found for %s: %s ", job->barejid, job->fpr);
+        _p_gpg_signer_found(job->barejid, job->output);
+    }
+}
+
+static gint
+_p_gpg_job_cmp(const PgpJob *a, const PgpJob *b)
+{
+    if (a->seq < b->seq) {
+        return -1;
+    }
+
+    return a->seq > b->seq ? 1 : 0;
+}
+
+static void
+_p_gpg_signer_found(const char *const barejid, const char *const keyid)
+{
+    ProfPGPPubKeyId *pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
+    pubkeyid->id = strdup(keyid);
+    pubkeyid->received = TRUE;
+    g_hash_table_replace(pubkeys, strdup(barejid), pubkeyid);
+}
+
+static void
+_p_gpg_job_free(PgpJob *job)
+{
+    if (job->key) {
+        gpgme_key_unref(job->key);
+    }
+    free(job->barejid);
+    free(job->input);
+    free(job->output);
+    free(job->fpr);
+    g_free(job->verified_key);
+    free(job);
+}
+
 static char*
 _remove_header_footer(char *str, const char *const footer)
 {
@@ -804,9 +1489,45 @@ _add_header_footer(const char *const str, const char *const header, const char *
 static void
 _save_pubkeys(void)
 {
+    pubkeys_journal = 0;
+
     gsize g_data_size;
     gchar *g_pubkeys_data = g_key_file_to_data(pubkeyfile, &g_data_size, NULL);
+    watchdog_tag(WATCHDOG_DISK);
     g_file_set_contents(pubsloc, g_pubkeys_data, g_data_size, NULL);
     g_chmod(pubsloc, S_IRUSR | S_IWUSR);
     g_free(g_pubkeys_data);
 }
+
+// write a single key after the others, the whole file is only written again
+// once PUBKEYS_JOURNAL_MAX keys have been appended
+static void
+_append_pubkey(const char *const jid)
+{
+    gchar *value = g_key_file_get_value(pubkeyfile, jid, "keyid", NULL);
+    if (value == NULL || pubkeys_journal >= PUBKEYS_JOURNAL_MAX) {
+        g_free(value);
+        _save_pubkeys();
+        return;
+    }
+
+    gchar *entry = g_strdup_printf("\n[%s]\nkeyid=%s\n", jid, value);
+    g_free(value);
+
+    gboolean ok = FALSE;
+    FILE *pubs = g_fopen(pubsloc, "a");
+    if (pubs) {
+        size_t len = strlen(entry);
+        ok = fwrite(entry, 1, len, pubs) == len;
+        ok = fclose(pubs) == 0 && ok;
+    }
+    g_free(entry);
+
+    if (!ok) {
+        _save_pubkeys();
+        return;
+    }
+
+    g_chmod(pubsloc, S_IRUSR | S_IWUSR);
+    pubkeys_journal++;
+}
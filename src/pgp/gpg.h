@@ -51,8 +51,13 @@ typedef struct pgp_pubkeyid_t {
     gboolean received;
 } ProfPGPPubKeyId;
 
+// run with the cipher text, or NULL when encryption failed or the session
+// it was started in has ended
+typedef void (*p_gpg_encrypted_cb)(const char *const cipher, void *userdata);
+
 void p_gpg_init(void);
 void p_gpg_close(void);
+void p_gpg_preload(const char *const barejid);
 void p_gpg_on_connect(const char *const barejid);
 void p_gpg_on_disconnect(void);
 GHashTable* p_gpg_list_keys(void);
@@ -65,6 +70,10 @@ const char* p_gpg_libver(void);
 char* p_gpg_sign(const char *const str, const char *const fp);
 void p_gpg_verify(const char *const barejid, const char *const sign);
 char* p_gpg_encrypt(const char *const barejid, const char *const message);
+gboolean p_gpg_encrypt_async(const char *const barejid, const char *const message, p_gpg_encrypted_cb callback,
+    void *userdata);
+gboolean p_gpg_pending(void);
+void p_gpg_process(void);
 char* p_gpg_decrypt(const char *const cipher);
 void p_gpg_free_decrypted(char *decrypted);
 char* p_gpg_autocomplete_key(const char *const search_str);
@@ -0,0 +1,547 @@
+/*
+ * plugins.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <gmodule.h>
+
+#include "common.h"
+#include "log.h"
+#include "window_list.h"
+#include "event/client_events.h"
+#include "plugins/plugins.h"
+#include "plugins/profapi.h"
+#include "tools/ipc.h"
+#include "ui/ui.h"
+#include "xmpp/xmpp.h"
+
+typedef struct plugin_t {
+    char *name;
+    GModule *module;
+    ProfPluginShutdown shutdown;
+    GSList *handlers;
+} Plugin;
+
+typedef struct plugin_handler_t {
+    Plugin *plugin;
+    int types;
+    ProfPluginHandler func;
+    gpointer data;
+    // a single thread so batches are handled in order, NULL for the main loop
+    GThreadPool *worker;
+} PluginHandler;
+
+// the events of one main loop iteration, shared by every handler given them
+typedef struct plugin_batch_t {
+    GPtrArray *events;
+    gint refs;
+} PluginBatch;
+
+// the events of a batch one handler asked for
+typedef struct plugin_delivery_t {
+    PluginHandler *handler;
+    PluginBatch *batch;
+    GPtrArray *events;
+} PluginDelivery;
+
+typedef enum {
+    PLUGIN_ACTION_CONS_SHOW,
+    PLUGIN_ACTION_SEND_CHAT,
+    PLUGIN_ACTION_SEND_ROOM
+} plugin_action_t;
+
+// asked for by a plugin from any thread, carried out by plugins_process
+typedef struct plugin_action_s {
+    plugin_action_t type;
+    char *to;
+    char *message;
+} PluginAction;
+
+static GSList *plugins = NULL;
+
+// the plugin whose prof_plugin_init is running, the only time handlers
+// can be added
+static Plugin *loading = NULL;
+
+static int listened = 0;
+static GPtrArray *pending = NULL;
+static GAsyncQueue *actions = NULL;
+
+// deliveries queued for or being handled by a worker
+static gint in_flight = 0;
+
+static gboolean _api_handle(int types, ProfPluginHandler handler, gboolean threaded, gpointer data);
+static void _api_cons_show(const char *const message);
+static void _api_send_chat(const char *const barejid, const char *const message);
+static void _api_send_room(const char *const roomjid, const char *const message);
+
+static const ProfPluginApi api = {
+    PROF_PLUGIN_API_VERSION,
+    _api_handle,
+    _api_cons_show,
+    _api_send_chat,
+    _api_send_room,
+};
+
+static void _plugins_load(const char *const dir, const char *const name);
+static void _plugin_free(Plugin *plugin);
+static void _plugins_event(ipc_event_t type, const char *const name, const char *const *keys,
+    const char *const *values, int count, gpointer data);
+static void _plugins_event_free(ProfPluginEvent *event);
+static gboolean _plugins_event_encrypted(const ProfPluginEvent *const event);
+static void _plugins_batch_unref(PluginBatch *batch);
+static void _plugins_deliver(PluginDelivery *delivery, PluginHandler *handler);
+static void _plugins_action_queue(plugin_action_t type, const char *const to, const char *const message);
+static void _plugins_action_run(PluginAction *action);
+static void _plugins_action_free(PluginAction *action);
+
+void
+plugins_init(void)
+{
+    pending = g_ptr_array_new_with_free_func((GDestroyNotify)_plugins_event_free);
+    actions = g_async_queue_new_full((GDestroyNotify)_plugins_action_free);
+
+    if (!g_module_supported()) {
+        log_warning("Plugins are not supported on this platform");
+        return;
+    }
+
+    gchar *data_home = xdg_get_data_home();
+    GString *pluginsdir = g_string_new(data_home);
+    free(data_home);
+
+    g_string_append(pluginsdir, "/profanity/plugins");
+
+    // mkdir if doesn't exist
+    errno = 0;
+    int res = g_mkdir_with_parents(pluginsdir->str, S_IRWXU);
+    if (res == -1) {
+        char *errmsg = strerror(errno);
+        if (errmsg) {
+            log_error("Error creating directory: %s, %s", pluginsdir->str, errmsg);
+        } else {
+            log_error("Error creating directory: %s", pluginsdir->str);
+        }
+    }
+
+    // loaded in name order so plugins see events in the same order each run
+    GSList *names = NULL;
+    GDir *dir = g_dir_open(pluginsdir->str, 0, NULL);
+    if (dir) {
+        const gchar *file = NULL;
+        while ((file = g_dir_read_name(dir))) {
+            if (g_str_has_suffix(file, "." G_MODULE_SUFFIX)) {
+                names = g_slist_insert_sorted(names, strdup(file), (GCompareFunc)g_strcmp0);
+            }
+        }
+        g_dir_close(dir);
+    }
+
+    GSList *curr = names;
+    while (curr) {
+        _plugins_load(pluginsdir->str, curr->data);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(names, free);
+    g_string_free(pluginsdir, TRUE);
+
+    if (listened) {
+        ipc_listen(listened, _plugins_event, NULL);
+    }
+}
+
+void
+plugins_close(void)
+{
+    if (listened) {
+        ipc_unlisten(_plugins_event, NULL);
+        listened = 0;
+    }
+
+    g_slist_free_full(plugins, (GDestroyNotify)_plugin_free);
+    plugins = NULL;
+
+    // nothing is left to carry out what the handlers asked for last
+    if (actions) {
+        g_async_queue_unref(actions);
+        actions = NULL;
+    }
+    if (pending) {
+        g_ptr_array_free(pending, TRUE);
+        pending = NULL;
+    }
+}
+
+gboolean
+plugins_pending(void)
+{
+    if (pending && pending->len > 0) {
+        return TRUE;
+    }
+    if (actions && g_async_queue_length(actions) > 0) {
+        return TRUE;
+    }
+
+    return g_atomic_int_get(&in_flight) > 0;
+}
+
+// hand the events since the last call to the handlers, then carry out what
+// the plugins have asked for
+void
+plugins_process(void)
+{
+    if (pending == NULL) {
+        return;
+    }
+
+    if (pending->len > 0) {
+        PluginBatch *batch = malloc(sizeof(PluginBatch));
+        batch->events = pending;
+        batch->refs = 1;
+        pending = g_ptr_array_new_with_free_func((GDestroyNotify)_plugins_event_free);
+
+        GSList *curr_plugin = plugins;
+        while (curr_plugin) {
+            Plugin *plugin = curr_plugin->data;
+            GSList *curr = plugin->handlers;
+            while (curr) {
+                PluginHandler *handler = curr->data;
+                PluginDelivery *delivery = NULL;
+                guint i;
+                for (i = 0; i < batch->events->len; i++) {
+                    ProfPluginEvent *event = g_ptr_array_index(batch->events, i);
+                    if ((handler->types & event->type & ~PROF_PLUGIN_EVENT_DECRYPTED) == 0) {
+                        continue;
+                    }
+                    // an encrypted message is in the batch with its body and
+                    // without, each handler is given the one it asked for
+                    if (_plugins_event_encrypted(event) &&
+                            (handler->types & PROF_PLUGIN_EVENT_DECRYPTED) != (event->type & PROF_PLUGIN_EVENT_DECRYPTED)) {
+                        continue;
+                    }
+                    if (delivery == NULL) {
+                        delivery = malloc(sizeof(PluginDelivery));
+                        delivery->handler = handler;
+                        delivery->batch = batch;
+                        delivery->events = g_ptr_array_new();
+                        g_atomic_int_inc(&batch->refs);
+                    }
+                    g_ptr_array_add(delivery->events, event);
+                }
+
+                if (delivery) {
+                    g_atomic_int_inc(&in_flight);
+                    if (handler->worker == NULL || !g_thread_pool_push(handler->worker, delivery, NULL)) {
+                        _plugins_deliver(delivery, handler);
+                    }
+                }
+                curr = g_slist_next(curr);
+            }
+            curr_plugin = g_slist_next(curr_plugin);
+        }
+
+        _plugins_batch_unref(batch);
+    }
+
+    PluginAction *action = NULL;
+    while ((action = g_async_queue_try_pop(actions)) != NULL) {
+        _plugins_action_run(action);
+        _plugins_action_free(action);
+    }
+}
+
+static void
+_plugins_load(const char *const dir, const char *const name)
+{
+    gchar *path = g_build_filename(dir, name, NULL);
+    GModule *module = g_module_open(path, G_MODULE_BIND_LOCAL);
+    g_free(path);
+    if (module == NULL) {
+        log_error("Plugin %s could not be loaded: %s", name, g_module_error());
+        return;
+    }
+
+    gpointer init = NULL;
+    if (!g_module_symbol(module, PROF_PLUGIN_INIT, &init) || init == NULL) {
+        log_error("Plugin %s has no %s", name, PROF_PLUGIN_INIT);
+        g_module_close(module);
+        return;
+    }
+
+    Plugin *plugin = malloc(sizeof(Plugin));
+    plugin->name = strdup(name);
+    plugin->module = module;
+    plugin->shutdown = NULL;
+    plugin->handlers = NULL;
+
+    gpointer shutdown = NULL;
+    if (g_module_symbol(module, PROF_PLUGIN_SHUTDOWN, &shutdown)) {
+        plugin->shutdown = (ProfPluginShutdown)shutdown;
+    }
+
+    loading = plugin;
+    gboolean loaded = ((ProfPluginInit)init)(&api);
+    loading = NULL;
+
+    if (!loaded) {
+        log_warning("Plugin %s failed to initialise", name);
+        plugin->shutdown = NULL;
+        _plugin_free(plugin);
+        return;
+    }
+
+    GSList *curr = plugin->handlers;
+    while (curr) {
+        PluginHandler *handler = curr->data;
+        listened |= handler->types;
+        curr = g_slist_next(curr);
+    }
+
+    log_info("Loaded plugin %s", name);
+    plugins = g_slist_append(plugins, plugin);
+}
+
+// waits for the workers to finish what they were given first
+static void
+_plugin_free(Plugin *plugin)
+{
+    GSList *curr = plugin->handlers;
+    while (curr) {
+        PluginHandler *handler = curr->data;
+        if (handler->worker) {
+            g_thread_pool_free(handler->worker, FALSE, TRUE);
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(plugin->handlers, free);
+
+    if (plugin->shutdown) {
+        plugin->shutdown();
+    }
+    if (!g_module_close(plugin->module)) {
+        log_warning("Plugin %s could not be unloaded: %s", plugin->name, g_module_error());
+    }
+    free(plugin->name);
+    free(plugin);
+}
+
+static gboolean
+_api_handle(int types, ProfPluginHandler handler, gboolean threaded, gpointer data)
+{
+    if (loading == NULL || handler == NULL || types == 0) {
+        return FALSE;
+    }
+
+    PluginHandler *entry = malloc(sizeof(PluginHandler));
+    entry->plugin = loading;
+    entry->types = types;
+    entry->func = handler;
+    entry->data = data;
+    entry->worker = NULL;
+
+    if (threaded) {
+        GError *error = NULL;
+        entry->worker = g_thread_pool_new((GFunc)_plugins_deliver, entry, 1, FALSE, &error);
+        if (error) {
+            log_warning("Plugin %s: could not start a worker, handling events on the main loop. %s",
+                loading->name, error->message);
+            g_error_free(error);
+            entry->worker = NULL;
+        }
+    }
+
+    loading->handlers = g_slist_append(loading->handlers, entry);
+    return TRUE;
+}
+
+static void
+_api_cons_show(const char *const message)
+{
+    _plugins_action_queue(PLUGIN_ACTION_CONS_SHOW, NULL, message);
+}
+
+static void
+_api_send_chat(const char *const barejid, const char *const message)
+{
+    _plugins_action_queue(PLUGIN_ACTION_SEND_CHAT, barejid, message);
+}
+
+static void
+_api_send_room(const char *const roomjid, const char *const message)
+{
+    _plugins_action_queue(PLUGIN_ACTION_SEND_ROOM, roomjid, message);
+}
+
+static ProfPluginEvent*
+_plugins_event_new(int type, const char *const name, const char *const *keys, const char *const *values,
+    int count, gboolean withhold_body)
+{
+    gchar **event_keys = g_new0(gchar*, count + 1);
+    gchar **event_values = g_new0(gchar*, count + 1);
+    int i;
+    for (i = 0; i < count; i++) {
+        event_keys[i] = g_strdup(keys[i]);
+        if (!withhold_body || g_strcmp0(keys[i], "body") != 0) {
+            event_values[i] = g_strdup(values[i]);
+        }
+    }
+
+    ProfPluginEvent *event = malloc(sizeof(ProfPluginEvent));
+    event->type = type;
+    event->name = g_strdup(name);
+    event->keys = (const char *const *)event_keys;
+    event->values = (const char *const *)event_values;
+    event->count = count;
+
+    return event;
+}
+
+// copied, the strings only live as long as the ipc_emit call, a decrypted
+// body is only given when some handler asked for it, so the event is also
+// kept without it for the others
+static void
+_plugins_event(ipc_event_t type, const char *const name, const char *const *keys, const char *const *values,
+    int count, gpointer data)
+{
+    g_ptr_array_add(pending, _plugins_event_new(type, name, keys, values, count, FALSE));
+    if (type & IPC_DECRYPTED) {
+        g_ptr_array_add(pending, _plugins_event_new(type & ~IPC_DECRYPTED, name, keys, values, count, TRUE));
+    }
+}
+
+static gboolean
+_plugins_event_encrypted(const ProfPluginEvent *const event)
+{
+    int i;
+    for (i = 0; i < event->count; i++) {
+        if (event->values[i] && g_strcmp0(event->keys[i], "encryption") == 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_plugins_event_free(ProfPluginEvent *event)
+{
+    int i;
+    for (i = 0; i < event->count; i++) {
+        g_free((gchar*)event->keys[i]);
+        g_free((gchar*)event->values[i]);
+    }
+    g_free((gchar**)event->keys);
+    g_free((gchar**)event->values);
+    g_free((gchar*)event->name);
+    free(event);
+}
+
+// the last handler to finish with a batch, on whichever thread, frees it
+static void
+_plugins_batch_unref(PluginBatch *batch)
+{
+    if (g_atomic_int_dec_and_test(&batch->refs)) {
+        g_ptr_array_free(batch->events, TRUE);
+        free(batch);
+    }
+}
+
+static void
+_plugins_deliver(PluginDelivery *delivery, PluginHandler *handler)
+{
+    handler->func((const ProfPluginEvent *const *)delivery->events->pdata, delivery->events->len, handler->data);
+
+    g_ptr_array_free(delivery->events, TRUE);
+    _plugins_batch_unref(delivery->batch);
+    free(delivery);
+    g_atomic_int_add(&in_flight, -1);
+}
+
+static void
+_plugins_action_queue(plugin_action_t type, const char *const to, const char *const message)
+{
+    if (actions == NULL || message == NULL || (type != PLUGIN_ACTION_CONS_SHOW && to == NULL)) {
+        return;
+    }
+
+    PluginAction *action = malloc(sizeof(PluginAction));
+    action->type = type;
+    action->to = to ? strdup(to) : NULL;
+    action->message = strdup(message);
+    g_async_queue_push(actions, action);
+}
+
+static void
+_plugins_action_run(PluginAction *action)
+{
+    if (action->type == PLUGIN_ACTION_CONS_SHOW) {
+        cons_show("%s", action->message);
+        return;
+    }
+
+    if (jabber_get_connection_status() != JABBER_CONNECTED) {
+        log_warning("Plugin message to %s dropped, not connected", action->to);
+        return;
+    }
+
+    if (action->type == PLUGIN_ACTION_SEND_CHAT) {
+        ProfChatWin *chatwin = wins_get_chat(action->to);
+        if (chatwin == NULL) {
+            chatwin = chatwin_new(action->to);
+        }
+        cl_ev_send_msg(chatwin, action->message);
+    } else {
+        ProfMucWin *mucwin = wins_get_muc(action->to);
+        if (mucwin == NULL) {
+            log_warning("Plugin message to %s dropped, not in the room", action->to);
+            return;
+        }
+        cl_ev_send_muc_msg(mucwin, action->message);
+    }
+}
+
+static void
+_plugins_action_free(PluginAction *action)
+{
+    free(action->to);
+    free(action->message);
+    free(action);
+}
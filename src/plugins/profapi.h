@@ -0,0 +1,89 @@
+/*
+ * profapi.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef PROFAPI_H
+#define PROFAPI_H
+
+#include <glib.h>
+
+// the API plugins are built against, bumped when it changes incompatibly
+#define PROF_PLUGIN_API_VERSION 1
+
+// the events a handler can ask for
+#define PROF_PLUGIN_EVENT_MESSAGE (1 << 0)
+#define PROF_PLUGIN_EVENT_PRESENCE (1 << 1)
+#define PROF_PLUGIN_EVENT_MUC (1 << 2)
+#define PROF_PLUGIN_EVENT_INPUT (1 << 3)
+// not an event, asks for the body of encrypted messages, without it the
+// body of those is NULL, set in the type of events carrying one
+#define PROF_PLUGIN_EVENT_DECRYPTED (1 << 4)
+
+// an event such as "chat", "online" or "input" with its fields, a value
+// may be NULL
+typedef struct prof_plugin_event_t {
+    int type;
+    const char *name;
+    const char *const *keys;
+    const char *const *values;
+    int count;
+} ProfPluginEvent;
+
+// given the events since the last call, in the order they happened, the
+// events are only valid until the handler returns
+typedef void (*ProfPluginHandler)(const ProfPluginEvent *const *events, guint count, gpointer data);
+
+// every function may be called from any thread, what changes profanity is
+// done on the main thread once the caller has returned
+typedef struct prof_plugin_api_t {
+    int version;
+
+    // only from prof_plugin_init, a threaded handler runs on a thread of
+    // its own rather than the main loop
+    gboolean (*handle)(int events, ProfPluginHandler handler, gboolean threaded, gpointer data);
+
+    void (*cons_show)(const char *const message);
+    void (*send_chat)(const char *const barejid, const char *const message);
+    void (*send_room)(const char *const roomjid, const char *const message);
+} ProfPluginApi;
+
+// exported by each plugin, returning FALSE unloads it again
+typedef gboolean (*ProfPluginInit)(const ProfPluginApi *const api);
+#define PROF_PLUGIN_INIT "prof_plugin_init"
+
+// optionally exported, called once every handler has finished
+typedef void (*ProfPluginShutdown)(void);
+#define PROF_PLUGIN_SHUTDOWN "prof_plugin_shutdown"
+
+#endif
@@ -56,7 +56,13 @@
 #include "common.h"
 #include "contact.h"
 #include "roster_list.h"
+#include "jid.h"
 #include "config/tlscerts.h"
+#include "tools/http.h"
+#include "tools/ipc.h"
+#include "tools/perf.h"
+#include "tools/trace.h"
+#include "tools/watchdog.h"
 #include "log.h"
 #include "muc.h"
 #ifdef HAVE_LIBOTR
@@ -65,18 +71,31 @@
 #ifdef HAVE_LIBGPGME
 #include "pgp/gpg.h"
 #endif
+#ifdef HAVE_PLUGINS
+#include "plugins/plugins.h"
+#endif
 #include "resource.h"
 #include "xmpp/xmpp.h"
 #include "ui/ui.h"
 #include "window_list.h"
 #include "event/client_events.h"
+#include "event/server_events.h"
 #include "config/tlscerts.h"
 
 static void _check_autoaway(void);
-static void _init(char *log_level);
+static void _timers_init(void);
+static void _timers_run(void);
+static void _timers_close(void);
+static void _init(char *log_level, gboolean headless);
 static void _shutdown(void);
+static void _quit_handler(int sig);
 static void _create_directories(void);
 static void _connect_default(const char * const account);
+static void _bench_replay_events(const char *const path);
+static void _bench_replay_input(const char *const path);
+static void _bench_report(void);
+static void _startup_stage(const char *const name);
+static void _startup_report(void);
 
 typedef enum {
     ACTIVITY_ST_ACTIVE,
@@ -89,42 +108,261 @@ activity_state_t activity_state;
 resource_presence_t saved_presence;
 char *saved_status;
 
+// how often a script waiting for an event is checked
+#define SCRIPT_POLL_MS 100
+
+// how often outstanding http requests are moved along
+#define HTTP_POLL_MS 50
+
+// how often events are written to a client that stopped taking them
+#define IPC_POLL_MS 50
+
+// how often finished PGP operations are picked up
+#define PGP_POLL_MS 50
+
+// how often plugin events are handed out and their results picked up
+#define PLUGINS_POLL_MS 50
+
+// how often an eval_password command is checked for the password
+#define EVAL_POLL_MS 50
+
+// how often pages of chat history read from the logs are shown
+#define HISTORY_POLL_MS 50
+
+// how often changed preferences, accounts and certificates are written
+#define CONFIG_SAVE_INTERVAL_MS 1000
+
+// chat windows are saved for /wins restore this often, and on quitting
+#define SNAPSHOT_SAVE_INTERVAL_MS 60000
+
+// who the benchmark replay is logged in as
+#define BENCH_JID "bench@localhost/profanity"
+
+// time taken by each stage of startup, only kept with --startup-profile
+typedef struct startup_stage_t {
+    const char *name;
+    gint64 elapsed;
+} StartupStage;
+
+static GArray *startup_stages = NULL;
+static gint64 startup_start;
+static gint64 startup_mark;
+
 static gboolean cont = TRUE;
-static gboolean force_quit = FALSE;
+static volatile sig_atomic_t force_quit = FALSE;
+
+// periodic tasks run from the main loop when their interval has elapsed,
+// an interval of 0 leaves the task disabled until prof_timer_interval
+typedef struct prof_timer_t {
+    const char *name;
+    gulong interval_ms;
+    void (*func)(void);
+    GTimer *timer;
+} ProfTimer;
+
+static ProfTimer timers[] = {
+    { "timer.autoaway", 1000, _check_autoaway, NULL },
+#ifdef HAVE_LIBOTR
+    { "timer.otr_poll", 0, otr_poll, NULL },
+    { "timer.otr_keygen_poll", 0, otr_keygen_poll, NULL },
+#endif
+    { "timer.notify_remind", 1000, notify_remind, NULL },
+    { "timer.chat_log_flush", 1000, chat_log_flush, NULL },
+    { "timer.prefs_flush", CONFIG_SAVE_INTERVAL_MS, prefs_flush, NULL },
+    { "timer.accounts_flush", CONFIG_SAVE_INTERVAL_MS, accounts_flush, NULL },
+    { "timer.tlscerts_flush", CONFIG_SAVE_INTERVAL_MS, tlscerts_flush, NULL },
+    { "timer.chat_log_retention", 10000, chat_log_retention, NULL },
+    { "timer.caps_flush", CAPS_SAVE_INTERVAL_MS, caps_flush, NULL },
+    { "timer.caps_check_requests", 1000, caps_check_requests, NULL },
+    { "timer.expire_requests", 1000, jabber_expire_requests, NULL },
+    { "timer.wins_hibernate", 60000, wins_hibernate_idle, NULL },
+    { "timer.room_digest", 300000, wins_room_digest, NULL },
+    { "timer.wins_usage", 60000, wins_usage_sample, NULL },
+    { "timer.markers", 1000, wins_send_markers, NULL },
+    { "timer.snapshot", SNAPSHOT_SAVE_INTERVAL_MS, snapshot_save, NULL },
+};
 
 void
-prof_run(char *log_level, char *account_name)
+prof_run(char *log_level, char *account_name, gboolean startup_profile, gboolean headless,
+    char *ipc_path)
 {
-    _init(log_level);
+    if (startup_profile) {
+        startup_stages = g_array_new(FALSE, FALSE, sizeof(StartupStage));
+        startup_start = g_get_monotonic_time();
+        startup_mark = startup_start;
+        atexit(_startup_report);
+    }
+
+    _init(log_level, headless);
+    if (ipc_path && !ipc_open(ipc_path)) {
+        cons_show_error("Could not open IPC socket %s, see the log for details.", ipc_path);
+    }
     _connect_default(account_name);
+    _startup_stage("connect");
     ui_update();
+    _startup_stage("first frame");
 
     log_info("Starting main event loop");
 
     activity_state = ACTIVITY_ST_ACTIVE;
     saved_status = NULL;
 
+    // with --trace each iteration and its stages are written as events,
+    // the timers and stanza handlers record their own
     char *line = NULL;
     while(cont && !force_quit) {
-        log_stderr_handler();
-        _check_autoaway();
+        gint64 watch = watchdog_start();
+        gint64 iteration = trace_start();
+        _timers_run();
 
+        gint64 trace = trace_start();
         line = inp_readline();
+        trace_record("readline", trace);
         if (line) {
+            trace = trace_start();
             ProfWin *window = wins_get_current();
             cont = cmd_process_input(window, line);
             free(line);
             line = NULL;
+            trace_record("command", trace);
         } else {
             cont = TRUE;
         }
 
-#ifdef HAVE_LIBOTR
-        otr_poll();
+        trace = trace_start();
+        scripts_run();
+        http_process();
+        ipc_process();
+        account_eval_process();
+        chat_log_history_process();
+#ifdef HAVE_LIBGPGME
+        p_gpg_process();
+#endif
+#ifdef HAVE_PLUGINS
+        plugins_process();
 #endif
-        notify_remind();
+        trace_record("background", trace);
+
+        trace = trace_start();
         jabber_process_events(10);
+        trace_record("xmpp", trace);
+
+        trace = trace_start();
         ui_update();
+        trace_record("ui_update", trace);
+        trace_record("iteration", iteration);
+        watchdog_check("main loop iteration", NULL, watch);
+    }
+}
+
+// replay recorded events, captured stanzas then input against a connection
+// that sends nothing, timing each stage of the pipeline, the report is
+// printed once the ui has been closed
+void
+prof_bench(char *log_level, const char *const input_path, const char *const events_path,
+    const char *const stanzas_path, gboolean realtime)
+{
+    atexit(_bench_report);
+    _init(log_level, FALSE);
+    ui_update();
+
+    activity_state = ACTIVITY_ST_ACTIVE;
+    saved_status = NULL;
+
+    log_info("Starting benchmark replay");
+    jabber_bench_connect(BENCH_JID);
+    perf_enable();
+
+    if (events_path) {
+        _bench_replay_events(events_path);
+    }
+    if (stanzas_path) {
+        jabber_bench_replay(stanzas_path, realtime);
+    }
+    if (input_path) {
+        _bench_replay_input(input_path);
+    }
+
+    jabber_bench_disconnect();
+}
+
+gulong
+prof_timers_next_due(void)
+{
+    gulong next = G_MAXULONG;
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(timers); i++) {
+        if (timers[i].timer == NULL || timers[i].interval_ms == 0) {
+            continue;
+        }
+        gulong elapsed_ms = g_timer_elapsed(timers[i].timer, NULL) * 1000;
+        if (elapsed_ms >= timers[i].interval_ms) {
+            return 0;
+        }
+        gulong remaining = timers[i].interval_ms - elapsed_ms;
+        if (remaining < next) {
+            next = remaining;
+        }
+    }
+
+    // stanzas left from the last iteration are handled without waiting
+    if (jabber_events_pending()) {
+        return 0;
+    }
+
+    // a script waiting for an event checks again soon
+    if (scripts_running() && next > SCRIPT_POLL_MS) {
+        next = SCRIPT_POLL_MS;
+    }
+
+    if (http_pending() && next > HTTP_POLL_MS) {
+        next = HTTP_POLL_MS;
+    }
+
+    if (ipc_pending() && next > IPC_POLL_MS) {
+        next = IPC_POLL_MS;
+    }
+
+    if (account_eval_pending() && next > EVAL_POLL_MS) {
+        next = EVAL_POLL_MS;
+    }
+
+    if (chat_log_history_pending() && next > HISTORY_POLL_MS) {
+        next = HISTORY_POLL_MS;
+    }
+
+    // a window held back by its render interval is drawn once it is up
+    if (ui_render_pending() && next > (gulong)prefs_get_render_interval()) {
+        next = prefs_get_render_interval();
+    }
+
+#ifdef HAVE_LIBGPGME
+    if (p_gpg_pending() && next > PGP_POLL_MS) {
+        next = PGP_POLL_MS;
+    }
+#endif
+#ifdef HAVE_PLUGINS
+    if (plugins_pending() && next > PLUGINS_POLL_MS) {
+        next = PLUGINS_POLL_MS;
+    }
+#endif
+
+    return next;
+}
+
+// change how often a periodic task runs, counting from now, 0 disables it
+void
+prof_timer_interval(void (*func)(void), gulong interval_ms)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(timers); i++) {
+        if (timers[i].func == func) {
+            timers[i].interval_ms = interval_ms;
+            if (timers[i].timer) {
+                g_timer_start(timers[i].timer);
+            }
+            return;
+        }
     }
 }
 
@@ -139,19 +377,7 @@ prof_handle_idle(void)
 {
     jabber_conn_status_t status = jabber_get_connection_status();
     if (status == JABBER_CONNECTED) {
-        GSList *recipients = wins_get_chat_recipients();
-        GSList *curr = recipients;
-
-        while (curr) {
-            char *barejid = curr->data;
-            ProfChatWin *chatwin = wins_get_chat(barejid);
-            chat_state_handle_idle(chatwin->barejid, chatwin->state);
-            curr = g_slist_next(curr);
-        }
-
-        if (recipients) {
-            g_slist_free(recipients);
-        }
+        chat_state_idle();
     }
 }
 
@@ -161,6 +387,8 @@ prof_handle_activity(void)
     jabber_conn_status_t status = jabber_get_connection_status();
     ProfWin *current = wins_get_current();
 
+    jabber_set_client_active(TRUE);
+
     if ((status == JABBER_CONNECTED) && (current->type == WIN_CHAT)) {
         ProfChatWin *chatwin = (ProfChatWin*)current;
         assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
@@ -168,6 +396,47 @@ prof_handle_activity(void)
     }
 }
 
+static void
+_timers_init(void)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(timers); i++) {
+        timers[i].timer = g_timer_new();
+    }
+}
+
+static void
+_timers_run(void)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(timers); i++) {
+        if (timers[i].interval_ms == 0) {
+            continue;
+        }
+        gulong elapsed_ms = g_timer_elapsed(timers[i].timer, NULL) * 1000;
+        if (elapsed_ms >= timers[i].interval_ms) {
+            gint64 watch = watchdog_start();
+            gint64 trace = trace_start();
+            timers[i].func();
+            trace_record(timers[i].name, trace);
+            watchdog_check(timers[i].name, NULL, watch);
+            g_timer_start(timers[i].timer);
+        }
+    }
+}
+
+static void
+_timers_close(void)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(timers); i++) {
+        if (timers[i].timer) {
+            g_timer_destroy(timers[i].timer);
+            timers[i].timer = NULL;
+        }
+    }
+}
+
 static void
 _connect_default(const char *const account)
 {
@@ -191,7 +460,7 @@ _check_autoaway(void)
         return;
     }
 
-    char *mode = prefs_get_string(PREF_AUTOAWAY_MODE);
+    const char *mode = prefs_peek_string(PREF_AUTOAWAY_MODE);
     gboolean check = prefs_get_boolean(PREF_AUTOAWAY_CHECK);
     gint away_time = prefs_get_autoaway_time();
     gint xa_time = prefs_get_autoxa_time();
@@ -200,10 +469,12 @@ _check_autoaway(void)
 
     char *account = jabber_get_account_name();
     resource_presence_t curr_presence = accounts_get_last_presence(account);
-    char *curr_status = accounts_get_last_status(account);
 
     unsigned long idle_ms = ui_get_idle_time();
 
+    // idle for the autoaway time, whatever the autoaway mode
+    jabber_set_client_active(idle_ms < away_time_ms);
+
     switch (activity_state) {
     case ACTIVITY_ST_ACTIVE:
         if (idle_ms >= away_time_ms) {
@@ -216,7 +487,7 @@ _check_autoaway(void)
                     if (saved_status) {
                         free(saved_status);
                     }
-                    saved_status = curr_status;
+                    saved_status = accounts_get_last_status(account);
 
                     // send away presence with last activity
                     char *message = prefs_get_string(PREF_AUTOAWAY_MESSAGE);
@@ -240,7 +511,9 @@ _check_autoaway(void)
                 activity_state = ACTIVITY_ST_IDLE;
 
                 // send current presence with last activity
+                char *curr_status = accounts_get_last_status(account);
                 cl_ev_presence_send(curr_presence, curr_status, idle_ms / 1000);
+                free(curr_status);
             }
         }
         break;
@@ -251,7 +524,9 @@ _check_autoaway(void)
             cons_show("No longer idle.");
 
             // send current presence without last activity
+            char *curr_status = accounts_get_last_status(account);
             cl_ev_presence_send(curr_presence, curr_status, 0);
+            free(curr_status);
         }
         break;
     case ACTIVITY_ST_AWAY:
@@ -299,12 +574,10 @@ _check_autoaway(void)
         }
         break;
     }
-
-    prefs_free_string(mode);
 }
 
 static void
-_init(char *log_level)
+_init(char *log_level, gboolean headless)
 {
     setlocale(LC_ALL, "");
     // ignore SIGPIPE
@@ -312,10 +585,23 @@ _init(char *log_level)
     signal(SIGINT, SIG_IGN);
     signal(SIGTSTP, SIG_IGN);
     signal(SIGWINCH, ui_sigwinch_handler);
+    // headless outlives the terminal it was started from, and is stopped
+    // with SIGTERM rather than /quit
+    if (headless) {
+        signal(SIGHUP, SIG_IGN);
+        signal(SIGTERM, _quit_handler);
+    }
     _create_directories();
+    _startup_stage("directories");
     log_level_t prof_log_level = log_level_from_string(log_level);
     prefs_load();
+    _startup_stage("preferences");
     log_init(prof_log_level);
+    watchdog_init();
+    watchdog_set_threshold(prefs_get_log_slow());
+    if (prefs_get_boolean(PREF_LOG_ASYNC)) {
+        log_async_start();
+    }
     log_stderr_init(PROF_LEVEL_ERROR);
     if (strcmp(PACKAGE_STATUS, "development") == 0) {
 #ifdef HAVE_GIT_VERSION
@@ -326,43 +612,75 @@ _init(char *log_level)
     } else {
         log_info("Starting Profanity (%s)...", PACKAGE_VERSION);
     }
+    _startup_stage("logging");
     chat_log_init();
     groupchat_log_init();
+    _startup_stage("chat logs");
     accounts_load();
+    _startup_stage("accounts");
     char *theme = prefs_get_string(PREF_THEME);
     theme_init(theme);
     prefs_free_string(theme);
-    ui_init();
+    _startup_stage("theme");
+    http_init();
+    ui_init(headless);
+    _startup_stage("ui");
     jabber_init();
+    _startup_stage("xmpp");
     cmd_init();
+    _startup_stage("commands");
     log_info("Initialising contact list");
     roster_init();
     muc_init();
+    muc_set_large(prefs_get_occupants_large());
     tlscerts_init();
+    _startup_stage("tls certificates");
     scripts_init();
+    _startup_stage("scripts");
 #ifdef HAVE_LIBOTR
     otr_init();
+    _startup_stage("otr");
 #endif
 #ifdef HAVE_LIBGPGME
     p_gpg_init();
+    _startup_stage("pgp");
 #endif
+#ifdef HAVE_PLUGINS
+    plugins_init();
+    _startup_stage("plugins");
+#endif
+    _timers_init();
     atexit(_shutdown);
     inp_nonblocking(TRUE);
 }
 
+static void
+_quit_handler(int sig)
+{
+    force_quit = TRUE;
+}
+
 static void
 _shutdown(void)
 {
-    if (prefs_get_boolean(PREF_TITLEBAR_SHOW)) {
+    if (!ui_is_headless() && prefs_get_boolean(PREF_TITLEBAR_SHOW)) {
         if (prefs_get_boolean(PREF_TITLEBAR_GOODBYE)) {
             ui_goodbye_title();
         } else {
             ui_clear_win_title();
         }
     }
+#ifdef HAVE_PLUGINS
+    plugins_close();
+#endif
+    snapshot_save();
     ui_close_all_wins();
+    jabber_bench_disconnect();
     jabber_disconnect();
     jabber_shutdown();
+    http_close();
+    ipc_close();
+    account_eval_cancel();
     roster_free();
     muc_close();
     caps_close();
@@ -380,7 +698,10 @@ _shutdown(void)
     cmd_uninit();
     log_stderr_close();
     log_close();
+    log_async_stop();
+    trace_close();
     prefs_close();
+    _timers_close();
     if (saved_status) {
         free(saved_status);
     }
@@ -416,3 +737,165 @@ _create_directories(void)
     g_free(xdg_config);
     g_free(xdg_data);
 }
+
+static gchar**
+_bench_read_lines(const char *const path)
+{
+    gchar *contents = NULL;
+    GError *error = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, &error)) {
+        log_error("Benchmark could not read %s: %s", path, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    return lines;
+}
+
+// one event per line, blank lines and lines starting with # are skipped:
+//   roster <barejid> [name]
+//   presence <fulljid> <show> [status]
+//   message <fulljid> <text>
+//   join <room> <nick>
+//   occupant <room>/<nick>
+//   groupchat <room>/<nick> <text>
+static void
+_bench_replay_event(const char *const line)
+{
+    gchar **tokens = g_strsplit(line, " ", 3);
+    const char *type = tokens[0];
+    const char *target = tokens[1];
+    const char *rest = target ? tokens[2] : NULL;
+
+    if (target == NULL) {
+        log_warning("Benchmark event without a target: %s", line);
+        g_strfreev(tokens);
+        return;
+    }
+
+    Jid *jidp = jid_create(target);
+    if (jidp == NULL) {
+        log_warning("Benchmark event with invalid JID: %s", line);
+        g_strfreev(tokens);
+        return;
+    }
+
+    if (g_strcmp0(type, "roster") == 0) {
+        roster_add(jidp->barejid, rest, NULL, "both", FALSE);
+    } else if (g_strcmp0(type, "presence") == 0 && jidp->resourcepart && rest) {
+        gchar **show_status = g_strsplit(rest, " ", 2);
+        if (roster_get_contact(jidp->barejid)) {
+            Resource *resource = resource_new(jidp->resourcepart,
+                resource_presence_from_string(show_status[0]), show_status[1], 0);
+            sv_ev_contact_online(jidp->barejid, resource, NULL, NULL);
+        }
+        g_strfreev(show_status);
+    } else if (g_strcmp0(type, "message") == 0 && rest) {
+        char *message = strdup(rest);
+        sv_ev_incoming_message(jidp->barejid, jidp->resourcepart, message, NULL, NULL);
+        free(message);
+    } else if (g_strcmp0(type, "join") == 0 && rest) {
+        muc_join(jidp->barejid, rest, NULL, FALSE);
+        sv_ev_muc_self_online(jidp->barejid, rest, FALSE, "participant", "none", NULL, NULL, NULL, "online", NULL);
+    } else if (g_strcmp0(type, "occupant") == 0 && jidp->resourcepart) {
+        sv_ev_muc_occupant_online(jidp->barejid, jidp->resourcepart, NULL, "participant", "none", NULL, NULL,
+            "online", NULL);
+    } else if (g_strcmp0(type, "groupchat") == 0 && jidp->resourcepart && rest) {
+        sv_ev_room_message(jidp->barejid, jidp->resourcepart, rest);
+    } else {
+        log_warning("Benchmark event not understood: %s", line);
+    }
+
+    jid_destroy(jidp);
+    g_strfreev(tokens);
+}
+
+static void
+_bench_replay_events(const char *const path)
+{
+    gchar **lines = _bench_read_lines(path);
+    if (lines == NULL) {
+        return;
+    }
+
+    int i;
+    for (i = 0; lines[i]; i++) {
+        g_strchomp(lines[i]);
+        if (lines[i][0] == '\0' || lines[i][0] == '#') {
+            continue;
+        }
+        _bench_replay_event(lines[i]);
+        sv_ev_flush();
+        ui_update();
+    }
+
+    g_strfreev(lines);
+}
+
+static void
+_bench_replay_input(const char *const path)
+{
+    gchar **lines = _bench_read_lines(path);
+    if (lines == NULL) {
+        return;
+    }
+
+    int i;
+    for (i = 0; lines[i] && cont && !force_quit; i++) {
+        if (lines[i][0] == '\0') {
+            continue;
+        }
+        ProfWin *window = wins_get_current();
+        cont = cmd_process_input(window, lines[i]);
+        ui_update();
+    }
+
+    g_strfreev(lines);
+}
+
+static void
+_bench_report(void)
+{
+    if (perf_enabled()) {
+        perf_report(stdout);
+        perf_disable();
+    }
+    jabber_bench_replay_report(stdout);
+}
+
+// attributes the time since the previous stage to name
+static void
+_startup_stage(const char *const name)
+{
+    if (startup_stages == NULL) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    StartupStage stage = { name, now - startup_mark };
+    g_array_append_val(startup_stages, stage);
+    startup_mark = now;
+}
+
+// printed once the ui has been closed, like the benchmark report
+static void
+_startup_report(void)
+{
+    if (startup_stages == NULL) {
+        return;
+    }
+
+    fprintf(stdout, "%-18s %8s\n", "stage", "us");
+    guint i;
+    for (i = 0; i < startup_stages->len; i++) {
+        StartupStage *stage = &g_array_index(startup_stages, StartupStage, i);
+        fprintf(stdout, "%-18s %8" G_GINT64_FORMAT "\n", stage->name, stage->elapsed);
+    }
+    fprintf(stdout, "%-18s %8" G_GINT64_FORMAT "\n", "total", startup_mark - startup_start);
+
+    g_array_free(startup_stages, TRUE);
+    startup_stages = NULL;
+}
@@ -38,10 +38,15 @@
 #include "resource.h"
 #include "xmpp/xmpp.h"
 
-void prof_run(char *log_level, char *account_name);
+void prof_run(char *log_level, char *account_name, gboolean startup_profile, gboolean headless,
+    char *ipc_path);
+void prof_bench(char *log_level, const char *const input_path, const char *const events_path,
+    const char *const stanzas_path, gboolean realtime);
 
 void prof_handle_idle(void);
 void prof_handle_activity(void);
+gulong prof_timers_next_due(void);
+void prof_timer_interval(void (*func)(void), gulong interval_ms);
 
 gboolean process_input(char *inp);
 
@@ -38,13 +38,26 @@
 
 #include <common.h>
 #include <resource.h>
+#include <tools/stats.h>
+
+// the status is fixed once created, the name is shared so not counted
+static size_t
+_resource_size(Resource *resource)
+{
+    size_t size = sizeof(struct resource_t);
+    if (resource->status) {
+        size += strlen(resource->status) + 1;
+    }
+
+    return size;
+}
 
 Resource*
 resource_new(const char *const name, resource_presence_t presence, const char *const status, const int priority)
 {
     assert(name != NULL);
     Resource *new_resource = malloc(sizeof(struct resource_t));
-    new_resource->name = strdup(name);
+    new_resource->name = str_intern(name);
     new_resource->presence = presence;
     if (status) {
         new_resource->status = strdup(status);
@@ -52,6 +65,7 @@ resource_new(const char *const name, resource_presence_t presence, const char *c
         new_resource->status = NULL;
     }
     new_resource->priority = priority;
+    stats_alloc(STATS_MEM_RESOURCE, _resource_size(new_resource));
 
     return new_resource;
 }
@@ -90,7 +104,8 @@ void
 resource_destroy(Resource *resource)
 {
     if (resource) {
-        free(resource->name);
+        stats_free(STATS_MEM_RESOURCE, _resource_size(resource));
+        str_unintern(resource->name);
         free(resource->status);
         free(resource);
     }
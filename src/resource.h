@@ -38,7 +38,8 @@
 #include "common.h"
 
 typedef struct resource_t {
-    char *name;
+    // interned, the same few names are used by many contacts
+    const char *name;
     resource_presence_t presence;
     char *status;
     int priority;
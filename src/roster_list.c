@@ -33,6 +33,7 @@
  */
 
 
+#include <stdlib.h>
 #include <string.h>
 #include <glib.h>
 #include <assert.h>
@@ -62,11 +63,52 @@ static GHashTable *contacts;
 // nickname to jid map
 static GHashTable *name_to_barejid;
 
+// contacts kept in display order, with a lookup from contact to position
+typedef struct contact_index_t {
+    GSequence *contacts;
+    GHashTable *positions;
+} ContactIndex;
+
+// all contacts
+static ContactIndex *all_index;
+
+// interned group name to index of its members, keyed by address
+static GHashTable *group_index;
+
+// contacts with no group
+static ContactIndex *nogroup_index;
+
+// presence to index of contacts with that presence
+static GHashTable *presence_index;
+
+// autocomplete items collected while adding a batch of contacts
+static gboolean in_batch = FALSE;
+static GSList *batch_names;
+static GSList *batch_barejids;
+static GSList *batch_groups;
+
+// set once the server has sent the roster for this session
+static gboolean received = FALSE;
+
 static gboolean _key_equals(void *key1, void *key2);
 static gboolean _datetimes_equal(GDateTime *dt1, GDateTime *dt2);
 static void _replace_name(const char *const current_name, const char *const new_name, const char *const barejid);
 static void _add_name_and_barejid(const char *const name, const char *const barejid);
+static void _batch_flush(Autocomplete ac, GSList **items);
 static gint _compare_contacts(PContact a, PContact b);
+static gint _compare_contacts_data(gconstpointer a, gconstpointer b, gpointer data);
+static ContactIndex* _index_new(void);
+static void _index_free(ContactIndex *index);
+static void _index_add(ContactIndex *index, PContact contact);
+static void _index_remove(ContactIndex *index, PContact contact);
+static GSList* _index_list(ContactIndex *index);
+static void _indexes_init(void);
+static void _indexes_free(void);
+static void _indexes_add_contact(PContact contact);
+static void _indexes_remove_contact(PContact contact);
+static const char* const* _query_presences(const char *const presence);
+static gboolean _query_matches(const RosterQuery *const query, const char *const *presences, ContactIndex *group,
+    const char *const text, PContact contact);
 
 void
 roster_clear(void)
@@ -75,12 +117,27 @@ roster_clear(void)
     autocomplete_clear(barejid_ac);
     autocomplete_clear(fulljid_ac);
     autocomplete_clear(groups_ac);
+    _indexes_free();
     g_hash_table_destroy(contacts);
-    contacts = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, g_free,
+    contacts = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, NULL,
         (GDestroyNotify)p_contact_free);
     g_hash_table_destroy(name_to_barejid);
     name_to_barejid = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
         g_free);
+    _indexes_init();
+    received = FALSE;
+}
+
+void
+roster_set_received(void)
+{
+    received = TRUE;
+}
+
+gboolean
+roster_received(void)
+{
+    return received;
 }
 
 gboolean
@@ -96,7 +153,9 @@ roster_update_presence(const char *const barejid, Resource *resource, GDateTime
     if (!_datetimes_equal(p_contact_last_activity(contact), last_activity)) {
         p_contact_set_last_activity(contact, last_activity);
     }
+    _indexes_remove_contact(contact);
     p_contact_set_presence(contact, resource);
+    _indexes_add_contact(contact);
     Jid *jid = jid_create_from_bare_and_resource(barejid, resource->name);
     autocomplete_add(fulljid_ac, jid->fulljid);
     jid_destroy(jid);
@@ -152,7 +211,9 @@ roster_contact_offline(const char *const barejid, const char *const resource, co
     if (resource == NULL) {
         return TRUE;
     } else {
+        _indexes_remove_contact(contact);
         gboolean result = p_contact_remove_resource(contact, resource);
+        _indexes_add_contact(contact);
         if (result == TRUE) {
             Jid *jid = jid_create_from_bare_and_resource(barejid, resource);
             autocomplete_remove(fulljid_ac, jid->fulljid);
@@ -179,10 +240,12 @@ roster_init(void)
     barejid_ac = autocomplete_new();
     fulljid_ac = autocomplete_new();
     groups_ac = autocomplete_new();
-    contacts = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, g_free,
+    contacts = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, NULL,
         (GDestroyNotify)p_contact_free);
     name_to_barejid = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
         g_free);
+    _indexes_init();
+    received = FALSE;
 }
 
 void
@@ -192,6 +255,7 @@ roster_free(void)
     autocomplete_free(barejid_ac);
     autocomplete_free(fulljid_ac);
     autocomplete_free(groups_ac);
+    _indexes_free();
 }
 
 void
@@ -206,7 +270,9 @@ roster_change_name(PContact contact, const char *const new_name)
         current_name = strdup(p_contact_name(contact));
     }
 
+    _indexes_remove_contact(contact);
     p_contact_set_name(contact, new_name);
+    _indexes_add_contact(contact);
     _replace_name(current_name, new_name, barejid);
 }
 
@@ -220,19 +286,22 @@ roster_remove(const char *const name, const char *const barejid)
     // remove each fulljid
     PContact contact = roster_get_contact(barejid);
     if (contact) {
-        GList *resources = p_contact_get_available_resources(contact);
-        while (resources) {
-            GString *fulljid = g_string_new(strdup(barejid));
+        PContactResourceIter iter;
+        p_contact_resource_iter_init(&iter, contact);
+        Resource *resource;
+        while ((resource = p_contact_resource_iter_next(&iter))) {
+            GString *fulljid = g_string_new(barejid);
             g_string_append(fulljid, "/");
-            g_string_append(fulljid, resources->data);
+            g_string_append(fulljid, resource->name);
             autocomplete_remove(fulljid_ac, fulljid->str);
             g_string_free(fulljid, TRUE);
-            resources = g_list_next(resources);
         }
-        g_list_free(resources);
     }
 
     // remove the contact
+    if (contact) {
+        _indexes_remove_contact(contact);
+    }
     g_hash_table_remove(contacts, barejid);
 }
 
@@ -252,8 +321,10 @@ roster_update(const char *const barejid, const char *const name, GSList *groups,
         current_name = strdup(p_contact_name(contact));
     }
 
+    _indexes_remove_contact(contact);
     p_contact_set_name(contact, new_name);
     p_contact_set_groups(contact, groups);
+    _indexes_add_contact(contact);
     _replace_name(current_name, new_name, barejid);
 
     // add groups
@@ -277,17 +348,50 @@ roster_add(const char *const barejid, const char *const name, GSList *groups, co
 
     // add groups
     while (groups) {
-        autocomplete_add(groups_ac, groups->data);
+        if (in_batch) {
+            batch_groups = g_slist_prepend(batch_groups, strdup(groups->data));
+        } else {
+            autocomplete_add(groups_ac, groups->data);
+        }
         groups = g_slist_next(groups);
     }
 
-    g_hash_table_insert(contacts, strdup(barejid), contact);
-    autocomplete_add(barejid_ac, barejid);
+    // a contact stored under the same key is replaced by the insert
+    PContact replaced = g_hash_table_lookup(contacts, barejid);
+    if (replaced) {
+        _indexes_remove_contact(replaced);
+    }
+    // keyed by the contact's own barejid, replace so the key stays valid
+    // when a contact is replaced
+    g_hash_table_replace(contacts, (gpointer)p_contact_barejid(contact), contact);
+    _indexes_add_contact(contact);
+    if (in_batch) {
+        batch_barejids = g_slist_prepend(batch_barejids, strdup(barejid));
+    } else {
+        autocomplete_add(barejid_ac, barejid);
+    }
     _add_name_and_barejid(name, barejid);
 
     return TRUE;
 }
 
+// contacts added until roster_batch_end have their autocomplete
+// entries collected and sorted in one go, for the initial roster
+void
+roster_batch_begin(void)
+{
+    in_batch = TRUE;
+}
+
+void
+roster_batch_end(void)
+{
+    in_batch = FALSE;
+    _batch_flush(name_ac, &batch_names);
+    _batch_flush(barejid_ac, &batch_barejids);
+    _batch_flush(groups_ac, &batch_groups);
+}
+
 char*
 roster_barejid_from_name(const char *const name)
 {
@@ -301,52 +405,38 @@ roster_barejid_from_name(const char *const name)
 GSList*
 roster_get_contacts_by_presence(const char *const presence)
 {
-    GSList *result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
-
-    g_hash_table_iter_init(&iter, contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        PContact contact = (PContact)value;
-        if (g_strcmp0(p_contact_presence(contact), presence) == 0) {
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_contacts);
-        }
+    ContactIndex *index = g_hash_table_lookup(presence_index, presence);
+    if (index == NULL) {
+        return NULL;
     }
 
-    // return all contact structs
-    return result;
+    return _index_list(index);
 }
 
 GSList*
 roster_get_contacts(void)
 {
-    GSList *result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
-
-    g_hash_table_iter_init(&iter, contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_contacts);
-    }
+    return _index_list(all_index);
+}
 
-    // return all contact structs
-    return result;
+gboolean
+roster_has_contacts(void)
+{
+    return g_hash_table_size(contacts) > 0;
 }
 
 GSList*
 roster_get_contacts_online(void)
 {
     GSList *result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    GSequenceIter *curr = g_sequence_get_end_iter(all_index->contacts);
 
-    g_hash_table_iter_init(&iter, contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        if(strcmp(p_contact_presence(value), "offline"))
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_contacts);
+    while (!g_sequence_iter_is_begin(curr)) {
+        curr = g_sequence_iter_prev(curr);
+        PContact contact = g_sequence_get(curr);
+        if (strcmp(p_contact_presence(contact), "offline")) {
+            result = g_slist_prepend(result, contact);
+        }
     }
 
     // return all contact structs
@@ -374,6 +464,10 @@ roster_has_pending_subscriptions(void)
 char*
 roster_contact_autocomplete(const char *const search_str)
 {
+    if (prefs_get_boolean(PREF_COMPLETE_FUZZY)) {
+        return autocomplete_complete_fuzzy(name_ac, search_str, TRUE);
+    }
+
     return autocomplete_complete(name_ac, search_str, TRUE);
 }
 
@@ -386,44 +480,71 @@ roster_fulljid_autocomplete(const char *const search_str)
 GSList*
 roster_get_nogroup(void)
 {
-    GSList *result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    return _index_list(nogroup_index);
+}
 
-    g_hash_table_iter_init(&iter, contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        GSList *groups = p_contact_groups(value);
-        if (groups == NULL) {
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_contacts);
-        }
+GSList*
+roster_get_group(const char *const group)
+{
+    ContactIndex *index = g_hash_table_lookup(group_index, str_interned(group));
+    if (index == NULL) {
+        return NULL;
     }
 
-    // return all contact structs
-    return result;
+    return _index_list(index);
 }
 
+int
+roster_group_size(const char *const group)
+{
+    ContactIndex *index = g_hash_table_lookup(group_index, str_interned(group));
+    if (index == NULL) {
+        return 0;
+    }
+
+    return g_sequence_get_length(index->contacts);
+}
+
+// contacts matching the query in roster order, only the smallest index
+// that can hold every match is walked
 GSList*
-roster_get_group(const char *const group)
+roster_query(const RosterQuery *const query)
 {
-    GSList *result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    ContactIndex *driver = all_index;
 
-    g_hash_table_iter_init(&iter, contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        GSList *groups = p_contact_groups(value);
-        while (groups) {
-            if (strcmp(groups->data, group) == 0) {
-                result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_contacts);
-                break;
-            }
-            groups = g_slist_next(groups);
+    ContactIndex *group = NULL;
+    if (query->group) {
+        group = g_hash_table_lookup(group_index, str_interned(query->group));
+        if (group == NULL) {
+            return NULL;
         }
+        driver = group;
     }
 
-    // return all contact structs
+    const char *const *presences = _query_presences(query->presence);
+    if (presences && presences[1] == NULL) {
+        ContactIndex *index = g_hash_table_lookup(presence_index, presences[0]);
+        if (index == NULL) {
+            return NULL;
+        }
+        if (g_sequence_get_length(index->contacts) < g_sequence_get_length(driver->contacts)) {
+            driver = index;
+        }
+    }
+
+    char *text = query->text ? g_utf8_casefold(query->text, -1) : NULL;
+
+    GSList *result = NULL;
+    GSequenceIter *curr = g_sequence_get_end_iter(driver->contacts);
+    while (!g_sequence_iter_is_begin(curr)) {
+        curr = g_sequence_iter_prev(curr);
+        PContact contact = g_sequence_get(curr);
+        if (_query_matches(query, presences, group, text, contact)) {
+            result = g_slist_prepend(result, contact);
+        }
+    }
+    g_free(text);
+
     return result;
 }
 
@@ -442,9 +563,26 @@ roster_group_autocomplete(const char *const search_str)
 char*
 roster_barejid_autocomplete(const char *const search_str)
 {
+    if (prefs_get_boolean(PREF_COMPLETE_FUZZY)) {
+        return autocomplete_complete_fuzzy(barejid_ac, search_str, TRUE);
+    }
+
     return autocomplete_complete(barejid_ac, search_str, TRUE);
 }
 
+// a message to or from the contact, ranks it higher in fuzzy completion
+void
+roster_touch(const char *const barejid)
+{
+    autocomplete_touch(barejid_ac, barejid);
+
+    PContact contact = roster_get_contact(barejid);
+    if (contact) {
+        const char *name = p_contact_name(contact);
+        autocomplete_touch(name_ac, name ? name : barejid);
+    }
+}
+
 static gboolean
 _key_equals(void *key1, void *key2)
 {
@@ -487,13 +625,22 @@ _replace_name(const char *const current_name, const char *const new_name, const
 static void
 _add_name_and_barejid(const char *const name, const char *const barejid)
 {
-    if (name) {
-        autocomplete_add(name_ac, name);
-        g_hash_table_insert(name_to_barejid, strdup(name), strdup(barejid));
+    const char *key = name ? name : barejid;
+
+    if (in_batch) {
+        batch_names = g_slist_prepend(batch_names, strdup(key));
     } else {
-        autocomplete_add(name_ac, barejid);
-        g_hash_table_insert(name_to_barejid, strdup(barejid), strdup(barejid));
+        autocomplete_add(name_ac, key);
     }
+    g_hash_table_insert(name_to_barejid, strdup(key), strdup(barejid));
+}
+
+static void
+_batch_flush(Autocomplete ac, GSList **items)
+{
+    autocomplete_add_all(ac, *items);
+    g_slist_free_full(*items, free);
+    *items = NULL;
 }
 
 static gint
@@ -517,3 +664,222 @@ _compare_contacts(PContact a, PContact b)
 
     return result;
 }
+
+static gint
+_compare_contacts_data(gconstpointer a, gconstpointer b, gpointer data)
+{
+    gint result = _compare_contacts((PContact)a, (PContact)b);
+
+    // order equal names by pointer so every contact has a fixed position
+    if (result == 0 && a != b) {
+        result = a < b ? -1 : 1;
+    }
+
+    return result;
+}
+
+static ContactIndex*
+_index_new(void)
+{
+    ContactIndex *index = malloc(sizeof(ContactIndex));
+    index->contacts = g_sequence_new(NULL);
+    index->positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    return index;
+}
+
+static void
+_index_free(ContactIndex *index)
+{
+    if (index) {
+        g_sequence_free(index->contacts);
+        g_hash_table_destroy(index->positions);
+        free(index);
+    }
+}
+
+static void
+_index_add(ContactIndex *index, PContact contact)
+{
+    if (g_hash_table_lookup(index->positions, contact)) {
+        return;
+    }
+
+    GSequenceIter *pos = g_sequence_insert_sorted(index->contacts, contact, _compare_contacts_data, NULL);
+    g_hash_table_insert(index->positions, contact, pos);
+}
+
+static void
+_index_remove(ContactIndex *index, PContact contact)
+{
+    GSequenceIter *pos = g_hash_table_lookup(index->positions, contact);
+    if (pos) {
+        g_sequence_remove(pos);
+        g_hash_table_remove(index->positions, contact);
+    }
+}
+
+static GSList*
+_index_list(ContactIndex *index)
+{
+    GSList *result = NULL;
+    GSequenceIter *curr = g_sequence_get_end_iter(index->contacts);
+
+    while (!g_sequence_iter_is_begin(curr)) {
+        curr = g_sequence_iter_prev(curr);
+        result = g_slist_prepend(result, g_sequence_get(curr));
+    }
+
+    return result;
+}
+
+static void
+_indexes_init(void)
+{
+    all_index = _index_new();
+    nogroup_index = _index_new();
+    group_index = g_hash_table_new_full(g_direct_hash, g_direct_equal, (GDestroyNotify)str_unintern,
+        (GDestroyNotify)_index_free);
+    presence_index = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_index_free);
+}
+
+static void
+_indexes_free(void)
+{
+    _index_free(all_index);
+    all_index = NULL;
+    _index_free(nogroup_index);
+    nogroup_index = NULL;
+    if (group_index) {
+        g_hash_table_destroy(group_index);
+        group_index = NULL;
+    }
+    if (presence_index) {
+        g_hash_table_destroy(presence_index);
+        presence_index = NULL;
+    }
+}
+
+// must be called after any change to a contact's name, groups or presence
+static void
+_indexes_add_contact(PContact contact)
+{
+    _index_add(all_index, contact);
+
+    GSList *groups = p_contact_groups(contact);
+    if (groups == NULL) {
+        _index_add(nogroup_index, contact);
+    }
+    while (groups) {
+        ContactIndex *index = g_hash_table_lookup(group_index, groups->data);
+        if (index == NULL) {
+            index = _index_new();
+            g_hash_table_insert(group_index, (gpointer)str_intern(groups->data), index);
+        }
+        _index_add(index, contact);
+        groups = g_slist_next(groups);
+    }
+
+    const char *presence = p_contact_presence(contact);
+    ContactIndex *index = g_hash_table_lookup(presence_index, presence);
+    if (index == NULL) {
+        index = _index_new();
+        g_hash_table_insert(presence_index, strdup(presence), index);
+    }
+    _index_add(index, contact);
+}
+
+// must be called before any change to a contact's name, groups or presence
+static void
+_indexes_remove_contact(PContact contact)
+{
+    _index_remove(all_index, contact);
+    _index_remove(nogroup_index, contact);
+
+    GSList *groups = p_contact_groups(contact);
+    while (groups) {
+        ContactIndex *index = g_hash_table_lookup(group_index, groups->data);
+        if (index) {
+            _index_remove(index, contact);
+            if (g_sequence_get_length(index->contacts) == 0) {
+                g_hash_table_remove(group_index, groups->data);
+            }
+        }
+        groups = g_slist_next(groups);
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, presence_index);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        _index_remove(value, contact);
+    }
+}
+
+// the contact presences a /who presence name stands for, NULL for any
+static const char* const*
+_query_presences(const char *const presence)
+{
+    static const char *const available[] = { "chat", "online", NULL };
+    static const char *const unavailable[] = { "away", "xa", "dnd", "offline", NULL };
+    static const char *const online[] = { "chat", "online", "away", "xa", "dnd", NULL };
+    static const char *one[2] = { NULL, NULL };
+
+    if (presence == NULL || g_strcmp0(presence, "any") == 0) {
+        return NULL;
+    } else if (g_strcmp0(presence, "available") == 0) {
+        return available;
+    } else if (g_strcmp0(presence, "unavailable") == 0) {
+        return unavailable;
+    } else if (g_strcmp0(presence, "online") == 0) {
+        return online;
+    } else {
+        one[0] = presence;
+        return one;
+    }
+}
+
+static gboolean
+_query_text_matches(const char *const str, const char *const text)
+{
+    if (str == NULL) {
+        return FALSE;
+    }
+
+    char *folded = g_utf8_casefold(str, -1);
+    gboolean matches = strstr(folded, text) != NULL;
+    g_free(folded);
+
+    return matches;
+}
+
+static gboolean
+_query_matches(const RosterQuery *const query, const char *const *presences, ContactIndex *group,
+    const char *const text, PContact contact)
+{
+    if (group && !g_hash_table_contains(group->positions, contact)) {
+        return FALSE;
+    }
+
+    if (presences) {
+        const char *presence = p_contact_presence(contact);
+        int i = 0;
+        while (presences[i] && strcmp(presences[i], presence) != 0) {
+            i++;
+        }
+        if (presences[i] == NULL) {
+            return FALSE;
+        }
+    }
+
+    if (query->subscription && g_strcmp0(p_contact_subscription(contact), query->subscription) != 0) {
+        return FALSE;
+    }
+
+    if (text && !_query_text_matches(p_contact_name(contact), text) &&
+            !_query_text_matches(p_contact_barejid(contact), text)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -40,7 +40,18 @@
 #include "resource.h"
 #include "contact.h"
 
+// what roster_query selects, fields left NULL match every contact, presence
+// takes the names /who does
+typedef struct roster_query_t {
+    const char *presence;
+    const char *group;
+    const char *subscription;
+    const char *text;
+} RosterQuery;
+
 void roster_clear(void);
+void roster_set_received(void);
+gboolean roster_received(void);
 gboolean roster_update_presence(const char *const barejid, Resource *resource, GDateTime *last_activity);
 PContact roster_get_contact(const char *const barejid);
 gboolean roster_contact_offline(const char *const barejid, const char *const resource, const char *const status);
@@ -53,18 +64,24 @@ void roster_update(const char *const barejid, const char *const name, GSList *gr
     gboolean pending_out);
 gboolean roster_add(const char *const barejid, const char *const name, GSList *groups, const char *const subscription,
     gboolean pending_out);
+void roster_batch_begin(void);
+void roster_batch_end(void);
 char* roster_barejid_from_name(const char *const name);
 GSList* roster_get_contacts(void);
+gboolean roster_has_contacts(void);
 GSList* roster_get_contacts_online(void);
 gboolean roster_has_pending_subscriptions(void);
 char* roster_contact_autocomplete(const char *const search_str);
 char* roster_fulljid_autocomplete(const char *const search_str);
 GSList* roster_get_group(const char *const group);
+int roster_group_size(const char *const group);
 GSList* roster_get_groups(void);
 char* roster_group_autocomplete(const char *const search_str);
 char* roster_barejid_autocomplete(const char *const search_str);
+void roster_touch(const char *const barejid);
 GSList* roster_get_contacts_by_presence(const char *const presence);
 GSList* roster_get_nogroup(void);
+GSList* roster_query(const RosterQuery *const query);
 char* roster_get_msg_display_name(const char *const barejid, const char *const resource);
 
 #endif
@@ -0,0 +1,157 @@
+/*
+ * arena.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/arena.h"
+#include "tools/stats.h"
+
+// most stanzas fit in the first block, which is kept between scopes
+#define ARENA_BLOCK_SIZE 16384
+#define ARENA_ALIGN sizeof(void*)
+
+typedef struct arena_block_t {
+    struct arena_block_t *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+static ArenaBlock *blocks = NULL;
+static int depth = 0;
+static size_t used = 0;
+
+static ArenaBlock*
+_arena_block_new(size_t size, ArenaBlock *next)
+{
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    stats_alloc(STATS_MEM_ARENA, sizeof(ArenaBlock) + size);
+
+    return block;
+}
+
+static void
+_arena_block_free(ArenaBlock *block)
+{
+    stats_free(STATS_MEM_ARENA, sizeof(ArenaBlock) + block->size);
+    free(block);
+}
+
+void
+arena_begin(void)
+{
+    depth++;
+}
+
+// blocks added for a large scope are freed, the first is emptied for reuse
+void
+arena_end(void)
+{
+    assert(depth > 0);
+    depth--;
+    if (depth > 0 || blocks == NULL) {
+        return;
+    }
+
+    while (blocks->next) {
+        ArenaBlock *next = blocks->next;
+        _arena_block_free(blocks);
+        blocks = next;
+    }
+    if (blocks->size > ARENA_BLOCK_SIZE) {
+        _arena_block_free(blocks);
+        blocks = NULL;
+    } else {
+        blocks->used = 0;
+    }
+    used = 0;
+}
+
+void*
+arena_alloc(size_t size)
+{
+    assert(depth > 0);
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (blocks == NULL || blocks->size - blocks->used < size) {
+        blocks = _arena_block_new(MAX(size, ARENA_BLOCK_SIZE), blocks);
+    }
+
+    void *result = blocks->data + blocks->used;
+    blocks->used += size;
+    used += size;
+
+    return result;
+}
+
+char*
+arena_strdup(const char *const str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(str) + 1;
+    char *result = arena_alloc(len);
+    memcpy(result, str, len);
+
+    return result;
+}
+
+size_t
+arena_used(void)
+{
+    return used;
+}
+
+int
+arena_blocks(void)
+{
+    int count = 0;
+    ArenaBlock *block = blocks;
+    while (block) {
+        count++;
+        block = block->next;
+    }
+
+    return count;
+}
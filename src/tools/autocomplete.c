@@ -39,22 +39,91 @@
 #include "common.h"
 #include "tools/autocomplete.h"
 #include "tools/parser.h"
+#include "tools/stats.h"
 
+// items are kept sorted with strcmp, so all items with a given prefix
+// form a contiguous range that can be found with a binary search
 struct autocomplete_t {
-    GSList *items;
-    GSList *last_found;
+    GPtrArray *items;
+    gint last_found;
     gchar *search_str;
+
+    // items point at a constant table and can't be changed
+    gboolean fixed;
+
+    // for fuzzy completion, how often each item has been used and the
+    // ranked matches of the last search, kept until the items change,
+    // both created when first needed
+    GHashTable *usage;
+    guint version;
+    gchar *ranked_search;
+    guint ranked_version;
+    GPtrArray *ranked;
+    guint ranked_pos;
 };
 
-static gchar* _search_from(Autocomplete ac, GSList *curr, gboolean quote);
+// an interaction counts for half as much after a week
+#define AUTOCOMPLETE_USAGE_HALF_LIFE (7 * 24 * 60 * 60 * G_TIME_SPAN_SECOND)
+
+typedef struct autocomplete_usage_t {
+    double weight;
+    gint64 last;
+} AutocompleteUsage;
+
+typedef struct autocomplete_ranked_t {
+    char *item;
+    int rank;
+} AutocompleteRanked;
+
+static Autocomplete _new(GPtrArray *items);
+static gint _item_cmp(gconstpointer a, gconstpointer b);
+static guint _lower_bound(Autocomplete ac, const char *const str);
+static gboolean _find(Autocomplete ac, const char *const item, guint *index);
+static gchar* _found(Autocomplete ac, guint index, gboolean quote);
+static gchar* _quote(const char *const item, gboolean quote);
+static void _rank(Autocomplete ac, const char *const search_str);
+static int _fuzzy_score(const char *const item, const char *const search_str);
+static double _usage_weight(Autocomplete ac, const char *const item, gint64 now);
+static gint _ranked_cmp(gconstpointer a, gconstpointer b);
+static void _item_free(gpointer item);
 
 Autocomplete
 autocomplete_new(void)
+{
+    return _new(g_ptr_array_new_with_free_func(_item_free));
+}
+
+// items must already be sorted with strcmp and without duplicates, they
+// are used in place rather than copied
+Autocomplete
+autocomplete_new_static(const char *const items[], guint count)
+{
+    GPtrArray *fixed_items = g_ptr_array_sized_new(count);
+    guint i;
+    for (i = 0; i < count; i++) {
+        g_ptr_array_add(fixed_items, (gpointer)items[i]);
+    }
+
+    Autocomplete new = _new(fixed_items);
+    new->fixed = TRUE;
+
+    return new;
+}
+
+static Autocomplete
+_new(GPtrArray *items)
 {
     Autocomplete new = malloc(sizeof(struct autocomplete_t));
-    new->items = NULL;
-    new->last_found = NULL;
+    new->items = items;
+    new->last_found = -1;
     new->search_str = NULL;
+    new->fixed = FALSE;
+    new->usage = NULL;
+    new->version = 0;
+    new->ranked_search = NULL;
+    new->ranked_version = 0;
+    new->ranked = NULL;
+    new->ranked_pos = 0;
 
     return new;
 }
@@ -62,9 +131,9 @@ autocomplete_new(void)
 void
 autocomplete_clear(Autocomplete ac)
 {
-    if (ac) {
-        g_slist_free_full(ac->items, free);
-        ac->items = NULL;
+    if (ac && !ac->fixed) {
+        g_ptr_array_set_size(ac->items, 0);
+        ac->version++;
 
         autocomplete_reset(ac);
     }
@@ -73,7 +142,7 @@ autocomplete_clear(Autocomplete ac)
 void
 autocomplete_reset(Autocomplete ac)
 {
-    ac->last_found = NULL;
+    ac->last_found = -1;
     FREE_SET_NULL(ac->search_str);
 }
 
@@ -81,7 +150,15 @@ void
 autocomplete_free(Autocomplete ac)
 {
     if (ac) {
-        autocomplete_clear(ac);
+        autocomplete_reset(ac);
+        g_ptr_array_free(ac->items, TRUE);
+        if (ac->usage) {
+            g_hash_table_destroy(ac->usage);
+        }
+        g_free(ac->ranked_search);
+        if (ac->ranked) {
+            g_ptr_array_free(ac->ranked, TRUE);
+        }
         free(ac);
     }
 }
@@ -91,49 +168,96 @@ autocomplete_length(Autocomplete ac)
 {
     if (!ac) {
         return 0;
-    } else if (!ac->items) {
-        return 0;
     } else {
-        return g_slist_length(ac->items);
+        return ac->items->len;
     }
 }
 
 void
 autocomplete_add(Autocomplete ac, const char *item)
 {
-    if (ac) {
-        char *item_cpy;
-        GSList *curr = g_slist_find_custom(ac->items, item, (GCompareFunc)strcmp);
+    if (ac && !ac->fixed) {
+        guint index;
 
         // if item already exists
-        if (curr) {
+        if (_find(ac, item, &index)) {
             return;
         }
 
-        item_cpy = strdup(item);
-        ac->items = g_slist_insert_sorted(ac->items, item_cpy, (GCompareFunc)strcmp);
+        g_ptr_array_add(ac->items, NULL);
+        memmove(&ac->items->pdata[index + 1], &ac->items->pdata[index],
+            (ac->items->len - index - 1) * sizeof(gpointer));
+        ac->items->pdata[index] = strdup(item);
+        stats_alloc(STATS_MEM_AUTOCOMPLETE, strlen(item) + 1);
+        ac->version++;
+
+        // keep last found pointing at the same item
+        if (ac->last_found >= (gint)index) {
+            ac->last_found++;
+        }
     }
 
     return;
 }
 
+void
+autocomplete_add_all(Autocomplete ac, GSList *items)
+{
+    if (ac && !ac->fixed) {
+        if (!items) {
+            return;
+        }
+
+        GSList *curr = items;
+        while (curr) {
+            g_ptr_array_add(ac->items, strdup(curr->data));
+            stats_alloc(STATS_MEM_AUTOCOMPLETE, strlen(curr->data) + 1);
+            curr = g_slist_next(curr);
+        }
+
+        g_ptr_array_sort(ac->items, _item_cmp);
+
+        // drop duplicates, keeping the first of each run
+        guint i;
+        guint kept = 0;
+        for (i = 0; i < ac->items->len; i++) {
+            char *item = g_ptr_array_index(ac->items, i);
+            if (kept > 0 && strcmp(g_ptr_array_index(ac->items, kept - 1), item) == 0) {
+                _item_free(item);
+            } else {
+                ac->items->pdata[kept++] = item;
+            }
+        }
+        for (i = kept; i < ac->items->len; i++) {
+            ac->items->pdata[i] = NULL;
+        }
+        g_ptr_array_set_size(ac->items, kept);
+        ac->version++;
+
+        // positions have changed, start any search again
+        autocomplete_reset(ac);
+    }
+}
+
 void
 autocomplete_remove(Autocomplete ac, const char *const item)
 {
-    if (ac) {
-        GSList *curr = g_slist_find_custom(ac->items, item, (GCompareFunc)strcmp);
+    if (ac && !ac->fixed) {
+        guint index;
 
-        if (!curr) {
+        if (!_find(ac, item, &index)) {
             return;
         }
 
         // reset last found if it points to the item to be removed
-        if (ac->last_found == curr) {
-            ac->last_found = NULL;
+        if (ac->last_found == (gint)index) {
+            ac->last_found = -1;
+        } else if (ac->last_found > (gint)index) {
+            ac->last_found--;
         }
 
-        free(curr->data);
-        ac->items = g_slist_delete_link(ac->items, curr);
+        g_ptr_array_remove_index(ac->items, index);
+        ac->version++;
     }
 
     return;
@@ -143,11 +267,10 @@ GSList*
 autocomplete_create_list(Autocomplete ac)
 {
     GSList *copy = NULL;
-    GSList *curr = ac->items;
+    guint i;
 
-    while(curr) {
-        copy = g_slist_append(copy, strdup(curr->data));
-        curr = g_slist_next(curr);
+    for (i = ac->items->len; i > 0; i--) {
+        copy = g_slist_prepend(copy, strdup(g_ptr_array_index(ac->items, i - 1)));
     }
 
     return copy;
@@ -156,63 +279,119 @@ autocomplete_create_list(Autocomplete ac)
 gboolean
 autocomplete_contains(Autocomplete ac, const char *value)
 {
-    GSList *curr = ac->items;
-
-    while(curr) {
-        if (strcmp(curr->data, value) == 0) {
-            return TRUE;
-        }
-        curr = g_slist_next(curr);
-    }
-
-    return FALSE;
+    return _find(ac, value, NULL);
 }
 
 gchar*
 autocomplete_complete(Autocomplete ac, const gchar *search_str, gboolean quote)
 {
-    gchar *found = NULL;
-
     // no autocomplete to search
     if (!ac) {
         return NULL;
     }
 
     // no items to search
-    if (!ac->items) {
+    if (ac->items->len == 0) {
         return NULL;
     }
 
     // first search attempt
-    if (!ac->last_found) {
+    if (ac->last_found == -1) {
         if (ac->search_str) {
             FREE_SET_NULL(ac->search_str);
         }
 
         ac->search_str = strdup(search_str);
-        found = _search_from(ac, ac->items, quote);
+    }
 
-        return found;
+    size_t search_len = strlen(ac->search_str);
 
-    // subsequent search attempt
-    } else {
-        // search from here+1 to end
-        found = _search_from(ac, g_slist_next(ac->last_found), quote);
-        if (found) {
-            return found;
+    // subsequent search attempt, try the item after the last found
+    if (ac->last_found != -1) {
+        guint next = ac->last_found + 1;
+        if (next < ac->items->len &&
+                strncmp(g_ptr_array_index(ac->items, next), ac->search_str, search_len) == 0) {
+            return _found(ac, next, quote);
         }
+    }
 
-        // search from beginning
-        found = _search_from(ac, ac->items, quote);
-        if (found) {
-            return found;
-        }
+    // search from the first item with the prefix
+    guint first = _lower_bound(ac, ac->search_str);
+    if (first < ac->items->len &&
+            strncmp(g_ptr_array_index(ac->items, first), ac->search_str, search_len) == 0) {
+        return _found(ac, first, quote);
+    }
 
-        // we found nothing, reset search
+    // we found nothing, reset search
+    if (ac->last_found != -1) {
         autocomplete_reset(ac);
+    }
+
+    return NULL;
+}
 
+// find the next item containing the characters of search string in order,
+// best matches and most used first
+gchar*
+autocomplete_complete_fuzzy(Autocomplete ac, const gchar *search_str, gboolean quote)
+{
+    if (!ac) {
         return NULL;
     }
+
+    if (ac->items->len == 0) {
+        return NULL;
+    }
+
+    // first search attempt, only rank again when something changed
+    if (ac->last_found == -1) {
+        FREE_SET_NULL(ac->search_str);
+        ac->search_str = strdup(search_str);
+        if (ac->ranked_version != ac->version || g_strcmp0(ac->ranked_search, search_str) != 0) {
+            _rank(ac, search_str);
+        }
+        ac->ranked_pos = 0;
+    } else {
+        ac->ranked_pos++;
+    }
+
+    if (ac->ranked && ac->ranked_pos < ac->ranked->len) {
+        ac->last_found = ac->ranked_pos;
+        return _quote(g_ptr_array_index(ac->ranked, ac->ranked_pos), quote);
+    }
+
+    // we found nothing, reset search
+    if (ac->last_found != -1) {
+        autocomplete_reset(ac);
+    }
+
+    return NULL;
+}
+
+// record an interaction with item, ranking it higher in fuzzy completion
+void
+autocomplete_touch(Autocomplete ac, const char *const item)
+{
+    if (!ac || !item) {
+        return;
+    }
+
+    if (ac->usage == NULL) {
+        ac->usage = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    gint64 now = g_get_real_time();
+    AutocompleteUsage *usage = g_hash_table_lookup(ac->usage, item);
+    if (usage == NULL) {
+        usage = malloc(sizeof(AutocompleteUsage));
+        usage->weight = 0;
+        g_hash_table_insert(ac->usage, g_strdup(item), usage);
+    } else {
+        usage->weight = _usage_weight(ac, item, now);
+    }
+    usage->weight += 1;
+    usage->last = now;
+    ac->version++;
 }
 
 char*
@@ -309,36 +488,185 @@ autocomplete_param_no_with_func(const char *const input, char *command, int arg_
     return NULL;
 }
 
+static gint
+_item_cmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+// index of the first item not less than str
+static guint
+_lower_bound(Autocomplete ac, const char *const str)
+{
+    guint lo = 0;
+    guint hi = ac->items->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (strcmp(g_ptr_array_index(ac->items, mid), str) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static gboolean
+_find(Autocomplete ac, const char *const item, guint *index)
+{
+    guint pos = _lower_bound(ac, item);
+    if (index) {
+        *index = pos;
+    }
+
+    return pos < ac->items->len && strcmp(g_ptr_array_index(ac->items, pos), item) == 0;
+}
+
 static gchar*
-_search_from(Autocomplete ac, GSList *curr, gboolean quote)
+_found(Autocomplete ac, guint index, gboolean quote)
 {
-    while(curr) {
+    char *item = g_ptr_array_index(ac->items, index);
 
-        // match found
-        if (strncmp(curr->data, ac->search_str, strlen(ac->search_str)) == 0) {
+    // set pointer to last found
+    ac->last_found = index;
 
-            // set pointer to last found
-            ac->last_found = curr;
+    return _quote(item, quote);
+}
 
-            // if contains space, quote before returning
-            if (quote && g_strrstr(curr->data, " ")) {
-                GString *quoted = g_string_new("\"");
-                g_string_append(quoted, curr->data);
-                g_string_append(quoted, "\"");
+static gchar*
+_quote(const char *const item, gboolean quote)
+{
+    // if contains space, quote before returning
+    if (quote && g_strrstr(item, " ")) {
+        GString *quoted = g_string_new("\"");
+        g_string_append(quoted, item);
+        g_string_append(quoted, "\"");
 
-                gchar *result = quoted->str;
-                g_string_free(quoted, FALSE);
+        gchar *result = quoted->str;
+        g_string_free(quoted, FALSE);
 
-                return result;
+        return result;
 
-            // otherwise just return the string
-            } else {
-                return strdup(curr->data);
-            }
+    // otherwise just return the string
+    } else {
+        return strdup(item);
+    }
+}
+
+static void
+_rank(Autocomplete ac, const char *const search_str)
+{
+    gint64 now = g_get_real_time();
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(AutocompleteRanked));
+    guint i;
+    for (i = 0; i < ac->items->len; i++) {
+        char *item = g_ptr_array_index(ac->items, i);
+        int score = _fuzzy_score(item, search_str);
+        if (score < 0) {
+            continue;
         }
 
-        curr = g_slist_next(curr);
+        // a few recent interactions outweigh a slightly better match
+        AutocompleteRanked match;
+        match.item = item;
+        guint used = _usage_weight(ac, item, now) + 0.5;
+        match.rank = score + 4 * (g_bit_storage(used + 1) - 1);
+        g_array_append_val(matches, match);
     }
+    g_array_sort(matches, _ranked_cmp);
 
-    return NULL;
+    if (ac->ranked == NULL) {
+        ac->ranked = g_ptr_array_new_with_free_func(free);
+    }
+    g_ptr_array_set_size(ac->ranked, 0);
+    for (i = 0; i < matches->len; i++) {
+        g_ptr_array_add(ac->ranked, strdup(g_array_index(matches, AutocompleteRanked, i).item));
+    }
+    g_array_free(matches, TRUE);
+
+    g_free(ac->ranked_search);
+    ac->ranked_search = g_strdup(search_str);
+    ac->ranked_version = ac->version;
+}
+
+// -1 unless every character of search string appears in item in order,
+// otherwise higher for matches at the start of words and in runs
+static int
+_fuzzy_score(const char *const item, const char *const search_str)
+{
+    int score = 0;
+    const char *curr = item;
+    gunichar prev = 0;
+    gboolean in_run = FALSE;
+    const char *search = search_str;
+
+    while (*search != '\0') {
+        gunichar wanted = g_unichar_tolower(g_utf8_get_char(search));
+        int skipped = 0;
+        while (*curr != '\0' && g_unichar_tolower(g_utf8_get_char(curr)) != wanted) {
+            prev = g_utf8_get_char(curr);
+            curr = g_utf8_next_char(curr);
+            skipped++;
+            in_run = FALSE;
+        }
+        if (*curr == '\0') {
+            return -1;
+        }
+
+        if (curr == item) {
+            score += 8;
+        } else if (prev == ' ' || prev == '.' || prev == '@' || prev == '_' || prev == '-' || prev == '/') {
+            score += 6;
+        } else if (in_run) {
+            score += 4;
+        }
+        score += 1 - MIN(skipped, 3);
+
+        prev = g_utf8_get_char(curr);
+        curr = g_utf8_next_char(curr);
+        in_run = TRUE;
+        search = g_utf8_next_char(search);
+    }
+
+    return score;
+}
+
+static double
+_usage_weight(Autocomplete ac, const char *const item, gint64 now)
+{
+    if (ac->usage == NULL) {
+        return 0;
+    }
+
+    AutocompleteUsage *usage = g_hash_table_lookup(ac->usage, item);
+    if (usage == NULL) {
+        return 0;
+    }
+
+    return usage->weight / (1 + (double)(now - usage->last) / AUTOCOMPLETE_USAGE_HALF_LIFE);
+}
+
+static gint
+_ranked_cmp(gconstpointer a, gconstpointer b)
+{
+    const AutocompleteRanked *ranked_a = a;
+    const AutocompleteRanked *ranked_b = b;
+    if (ranked_a->rank != ranked_b->rank) {
+        return ranked_b->rank - ranked_a->rank;
+    }
+
+    return strcmp(ranked_a->item, ranked_b->item);
+}
+
+// items of all but the fixed autocompleters are owned, shrinking the array
+// also passes the emptied slots
+static void
+_item_free(gpointer item)
+{
+    if (item) {
+        stats_free(STATS_MEM_AUTOCOMPLETE, strlen(item) + 1);
+        free(item);
+    }
 }
@@ -43,6 +43,10 @@ typedef struct autocomplete_t *Autocomplete;
 // allocate new autocompleter with no items
 Autocomplete autocomplete_new(void);
 
+// autocompleter over a constant table of sorted items, which can't be
+// added to or removed from
+Autocomplete autocomplete_new_static(const char *const items[], guint count);
+
 // Remove all items from the autocompleter
 void autocomplete_clear(Autocomplete ac);
 
@@ -50,11 +54,19 @@ void autocomplete_clear(Autocomplete ac);
 void autocomplete_free(Autocomplete ac);
 
 void autocomplete_add(Autocomplete ac, const char *item);
+
+// add a list of items, sorting and removing duplicates once
+void autocomplete_add_all(Autocomplete ac, GSList *items);
 void autocomplete_remove(Autocomplete ac, const char *const item);
 
 // find the next item prefixed with search string
 gchar* autocomplete_complete(Autocomplete ac, const gchar *search_str, gboolean quote);
 
+// find the next item best matching the search string as a subsequence,
+// items touched recently and often are ranked higher
+gchar* autocomplete_complete_fuzzy(Autocomplete ac, const gchar *search_str, gboolean quote);
+void autocomplete_touch(Autocomplete ac, const char *const item);
+
 GSList* autocomplete_create_list(Autocomplete ac);
 gint autocomplete_length(Autocomplete ac);
 
@@ -0,0 +1,422 @@
+/*
+ * binlog.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/binlog.h"
+#include "tools/watchdog.h"
+
+// Records are a little endian u32 payload length followed by the payload,
+// so readers can skip record types they do not know. Strings are stored
+// as a u32 length and the bytes, a zero length string decodes to NULL.
+//
+// message: u8 type, i64 timestamp, u8 direction, u8 flags, u8 receipt,
+//          id, from, message
+// receipt: u8 type, id
+
+typedef struct binlog_reader_t {
+    const unsigned char *data;
+    gsize len;
+    gsize pos;
+    gboolean ok;
+} BinlogReader;
+
+static void _put_u8(GString *out, guint8 value);
+static void _put_u32(GString *out, guint32 value);
+static void _put_i64(GString *out, gint64 value);
+static void _put_str(GString *out, const char *const str);
+static guint8 _get_u8(BinlogReader *reader);
+static guint32 _get_u32(BinlogReader *reader);
+static gint64 _get_i64(BinlogReader *reader);
+static char* _get_str(BinlogReader *reader);
+
+BinlogEntry*
+binlog_message_new(GDateTime *timestamp, binlog_direction_t direction, int flags,
+    binlog_receipt_t receipt, const char *const id, const char *const from, const char *const message)
+{
+    BinlogEntry *entry = malloc(sizeof(BinlogEntry));
+    entry->type = BINLOG_MESSAGE;
+    entry->timestamp = g_date_time_to_unix(timestamp) * G_USEC_PER_SEC + g_date_time_get_microsecond(timestamp);
+    entry->direction = direction;
+    entry->flags = flags;
+    entry->receipt = receipt;
+    entry->id = id ? strdup(id) : NULL;
+    entry->from = from ? strdup(from) : NULL;
+    entry->message = message ? strdup(message) : NULL;
+
+    return entry;
+}
+
+BinlogEntry*
+binlog_receipt_new(const char *const id)
+{
+    BinlogEntry *entry = malloc(sizeof(BinlogEntry));
+    memset(entry, 0, sizeof(BinlogEntry));
+    entry->type = BINLOG_RECEIPT;
+    entry->id = id ? strdup(id) : NULL;
+
+    return entry;
+}
+
+void
+binlog_entry_free(BinlogEntry *entry)
+{
+    if (entry) {
+        free(entry->id);
+        free(entry->from);
+        free(entry->message);
+        free(entry);
+    }
+}
+
+void
+binlog_encode(const BinlogEntry *const entry, GString *out)
+{
+    gsize start = out->len;
+    _put_u32(out, 0);
+
+    _put_u8(out, entry->type);
+    if (entry->type == BINLOG_MESSAGE) {
+        _put_i64(out, entry->timestamp);
+        _put_u8(out, entry->direction);
+        _put_u8(out, entry->flags);
+        _put_u8(out, entry->receipt);
+        _put_str(out, entry->id);
+        _put_str(out, entry->from);
+        _put_str(out, entry->message);
+    } else {
+        _put_str(out, entry->id);
+    }
+
+    // fill in the payload length
+    guint32 payload = out->len - start - 4;
+    int i;
+    for (i = 0; i < 4; i++) {
+        out->str[start + i] = (payload >> (8 * i)) & 0xff;
+    }
+}
+
+BinlogEntry*
+binlog_decode(const char *const data, gsize len, gsize *pos)
+{
+    while (*pos + 4 <= len) {
+        BinlogReader header = { (const unsigned char *)data, len, *pos, TRUE };
+        guint32 payload = _get_u32(&header);
+        if (payload > len - header.pos) {
+            return NULL;
+        }
+
+        BinlogReader reader = { (const unsigned char *)data, header.pos + payload, header.pos, TRUE };
+        *pos = header.pos + payload;
+
+        guint8 type = _get_u8(&reader);
+        if (type != BINLOG_MESSAGE && type != BINLOG_RECEIPT) {
+            continue;
+        }
+
+        BinlogEntry *entry = malloc(sizeof(BinlogEntry));
+        memset(entry, 0, sizeof(BinlogEntry));
+        entry->type = type;
+        if (type == BINLOG_MESSAGE) {
+            entry->timestamp = _get_i64(&reader);
+            entry->direction = _get_u8(&reader);
+            entry->flags = _get_u8(&reader);
+            entry->receipt = _get_u8(&reader);
+            entry->id = _get_str(&reader);
+            entry->from = _get_str(&reader);
+            entry->message = _get_str(&reader);
+        } else {
+            entry->id = _get_str(&reader);
+        }
+
+        if (!reader.ok) {
+            binlog_entry_free(entry);
+            return NULL;
+        }
+
+        return entry;
+    }
+
+    return NULL;
+}
+
+GSList*
+binlog_read_file(const char *const filename)
+{
+    GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+    if (map == NULL) {
+        return NULL;
+    }
+
+    GSList *messages = binlog_read_data(g_mapped_file_get_contents(map), g_mapped_file_get_length(map));
+    g_mapped_file_unref(map);
+
+    return messages;
+}
+
+GSList*
+binlog_read_data(const char *const data, gsize len)
+{
+    if (len < BINLOG_MAGIC_LEN || memcmp(data, BINLOG_MAGIC, BINLOG_MAGIC_LEN) != 0) {
+        return NULL;
+    }
+
+    GSList *messages = NULL;
+    GHashTable *sent = g_hash_table_new(g_str_hash, g_str_equal);
+    gsize pos = BINLOG_MAGIC_LEN;
+    BinlogEntry *entry;
+    while ((entry = binlog_decode(data, len, &pos)) != NULL) {
+        if (entry->type == BINLOG_MESSAGE) {
+            messages = g_slist_prepend(messages, entry);
+            if (entry->id) {
+                g_hash_table_insert(sent, entry->id, entry);
+            }
+        } else {
+            BinlogEntry *message = entry->id ? g_hash_table_lookup(sent, entry->id) : NULL;
+            if (message) {
+                message->receipt = BINLOG_RECEIPT_RECEIVED;
+            }
+            binlog_entry_free(entry);
+        }
+    }
+    g_hash_table_destroy(sent);
+
+    return g_slist_reverse(messages);
+}
+
+// lines look like "HH:MM:SS - from: message" or "HH:MM:SS - *from message"
+BinlogEntry*
+binlog_parse_text_line(const char *const line, GDateTime *day, const char *const contact)
+{
+    int hh, mm, ss;
+    if (strlen(line) < 11 || sscanf(line, "%2d:%2d:%2d", &hh, &mm, &ss) != 3 || strncmp(&line[8], " - ", 3) != 0) {
+        return NULL;
+    }
+
+    const char *rest = &line[11];
+    binlog_direction_t direction = BINLOG_IN;
+    gchar *from = NULL;
+    gchar *message = NULL;
+
+    if (rest[0] == '*') {
+        gchar *contact_me = g_strdup_printf("*%s ", contact);
+        if (g_str_has_prefix(rest, "*me ")) {
+            direction = BINLOG_OUT;
+            from = g_strdup("me");
+            message = g_strdup_printf("/me %s", rest + 4);
+        } else if (g_str_has_prefix(rest, contact_me)) {
+            from = g_strdup(contact);
+            message = g_strdup_printf("/me %s", rest + strlen(contact_me));
+        }
+        g_free(contact_me);
+    } else {
+        gchar *contact_from = g_strdup_printf("%s: ", contact);
+        if (g_str_has_prefix(rest, "me: ")) {
+            direction = BINLOG_OUT;
+            from = g_strdup("me");
+            message = g_strdup(rest + 4);
+        } else if (g_str_has_prefix(rest, contact_from)) {
+            from = g_strdup(contact);
+            message = g_strdup(rest + strlen(contact_from));
+        } else {
+            const char *sep = strstr(rest, ": ");
+            if (sep) {
+                from = g_strndup(rest, sep - rest);
+                message = g_strdup(sep + 2);
+            }
+        }
+        g_free(contact_from);
+    }
+
+    if (message == NULL) {
+        g_free(from);
+        return NULL;
+    }
+
+    GDateTime *timestamp = g_date_time_new_local(g_date_time_get_year(day), g_date_time_get_month(day),
+        g_date_time_get_day_of_month(day), hh, mm, ss);
+    int flags = strcmp(message, "[redacted]") == 0 ? BINLOG_FLAG_REDACTED : 0;
+    BinlogEntry *entry = binlog_message_new(timestamp, direction, flags, BINLOG_RECEIPT_NONE, NULL, from, message);
+    g_date_time_unref(timestamp);
+    g_free(from);
+    g_free(message);
+
+    return entry;
+}
+
+gboolean
+binlog_convert_file(const char *const text_file, const char *const binary_file,
+    GDateTime *day, const char *const contact)
+{
+    gchar *contents = NULL;
+    if (!g_file_get_contents(text_file, &contents, NULL, NULL)) {
+        return FALSE;
+    }
+
+    GString *out = g_string_new_len(BINLOG_MAGIC, BINLOG_MAGIC_LEN);
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    // lines that do not parse continue a multi line message
+    BinlogEntry *pending = NULL;
+    int i;
+    for (i = 0; lines[i] != NULL; i++) {
+        BinlogEntry *entry = binlog_parse_text_line(lines[i], day, contact);
+        if (entry) {
+            if (pending) {
+                binlog_encode(pending, out);
+                binlog_entry_free(pending);
+            }
+            pending = entry;
+        } else if (pending && lines[i + 1] != NULL) {
+            gchar *message = g_strdup_printf("%s\n%s", pending->message, lines[i]);
+            free(pending->message);
+            pending->message = strdup(message);
+            g_free(message);
+        }
+    }
+    if (pending) {
+        binlog_encode(pending, out);
+        binlog_entry_free(pending);
+    }
+    g_strfreev(lines);
+
+    watchdog_tag(WATCHDOG_DISK);
+    gboolean result = g_file_set_contents(binary_file, out->str, out->len, NULL);
+    g_string_free(out, TRUE);
+
+    return result;
+}
+
+static void
+_put_u8(GString *out, guint8 value)
+{
+    g_string_append_c(out, value);
+}
+
+static void
+_put_u32(GString *out, guint32 value)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        g_string_append_c(out, (value >> (8 * i)) & 0xff);
+    }
+}
+
+static void
+_put_i64(GString *out, gint64 value)
+{
+    guint64 bits = value;
+    int i;
+    for (i = 0; i < 8; i++) {
+        g_string_append_c(out, (bits >> (8 * i)) & 0xff);
+    }
+}
+
+static void
+_put_str(GString *out, const char *const str)
+{
+    guint32 len = str ? strlen(str) : 0;
+    _put_u32(out, len);
+    if (len > 0) {
+        g_string_append_len(out, str, len);
+    }
+}
+
+static guint8
+_get_u8(BinlogReader *reader)
+{
+    if (!reader->ok || reader->pos + 1 > reader->len) {
+        reader->ok = FALSE;
+        return 0;
+    }
+
+    return reader->data[reader->pos++];
+}
+
+static guint32
+_get_u32(BinlogReader *reader)
+{
+    if (!reader->ok || reader->pos + 4 > reader->len) {
+        reader->ok = FALSE;
+        return 0;
+    }
+
+    guint32 value = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        value |= (guint32)reader->data[reader->pos++] << (8 * i);
+    }
+
+    return value;
+}
+
+static gint64
+_get_i64(BinlogReader *reader)
+{
+    if (!reader->ok || reader->pos + 8 > reader->len) {
+        reader->ok = FALSE;
+        return 0;
+    }
+
+    guint64 value = 0;
+    int i;
+    for (i = 0; i < 8; i++) {
+        value |= (guint64)reader->data[reader->pos++] << (8 * i);
+    }
+
+    return (gint64)value;
+}
+
+static char*
+_get_str(BinlogReader *reader)
+{
+    guint32 len = _get_u32(reader);
+    if (!reader->ok || len == 0) {
+        return NULL;
+    }
+    if (len > reader->len - reader->pos) {
+        reader->ok = FALSE;
+        return NULL;
+    }
+
+    char *str = strndup((const char *)reader->data + reader->pos, len);
+    reader->pos += len;
+
+    return str;
+}
@@ -0,0 +1,102 @@
+/*
+ * binlog.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <glib.h>
+
+#define BINLOG_MAGIC "PRFLOG01"
+#define BINLOG_MAGIC_LEN 8
+
+// message flags
+#define BINLOG_FLAG_OTR         1
+#define BINLOG_FLAG_PGP         2
+#define BINLOG_FLAG_REDACTED    4
+
+typedef enum {
+    BINLOG_MESSAGE = 1,
+    BINLOG_RECEIPT = 2
+} binlog_record_t;
+
+typedef enum {
+    BINLOG_IN,
+    BINLOG_OUT
+} binlog_direction_t;
+
+typedef enum {
+    BINLOG_RECEIPT_NONE,
+    BINLOG_RECEIPT_PENDING,
+    BINLOG_RECEIPT_RECEIVED
+} binlog_receipt_t;
+
+// A receipt record only carries the id of the message it acknowledges,
+// timestamp is in microseconds since the epoch.
+typedef struct binlog_entry_t {
+    binlog_record_t type;
+    gint64 timestamp;
+    binlog_direction_t direction;
+    int flags;
+    binlog_receipt_t receipt;
+    char *id;
+    char *from;
+    char *message;
+} BinlogEntry;
+
+BinlogEntry* binlog_message_new(GDateTime *timestamp, binlog_direction_t direction, int flags,
+    binlog_receipt_t receipt, const char *const id, const char *const from, const char *const message);
+BinlogEntry* binlog_receipt_new(const char *const id);
+void binlog_entry_free(BinlogEntry *entry);
+
+// append the encoded entry to out, a file starts with BINLOG_MAGIC
+void binlog_encode(const BinlogEntry *const entry, GString *out);
+
+// decode the entry at *pos, advancing it, NULL at the end of the data or
+// if the remaining record is truncated or corrupt
+BinlogEntry* binlog_decode(const char *const data, gsize len, gsize *pos);
+
+// the messages in a log file with receipts applied, oldest first
+GSList* binlog_read_file(const char *const filename);
+
+// the same for the contents of a log already in memory
+GSList* binlog_read_data(const char *const data, gsize len);
+
+// parse a line from a text chat log written on day with contact
+BinlogEntry* binlog_parse_text_line(const char *const line, GDateTime *day, const char *const contact);
+
+// convert a text chat log to the binary format
+gboolean binlog_convert_file(const char *const text_file, const char *const binary_file,
+    GDateTime *day, const char *const contact);
+
+#endif
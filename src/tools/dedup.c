@@ -0,0 +1,149 @@
+/*
+ * dedup.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/dedup.h"
+
+typedef struct dedup_entry_t {
+    char *key;
+    gint64 seen;
+} DedupEntry;
+
+// the queue runs from the most to the least recently seen key, the table
+// holds the queue link of each key
+struct dedup_t {
+    guint max;
+    gint64 max_age;
+    GQueue *order;
+    GHashTable *links;
+};
+
+static void _dedup_drop_last(Dedup dedup);
+
+Dedup
+dedup_new(guint max, gint64 max_age)
+{
+    Dedup dedup = malloc(sizeof(struct dedup_t));
+    dedup->max = max;
+    dedup->max_age = max_age;
+    dedup->order = g_queue_new();
+    dedup->links = g_hash_table_new(g_str_hash, g_str_equal);
+
+    return dedup;
+}
+
+void
+dedup_free(Dedup dedup)
+{
+    if (dedup == NULL) {
+        return;
+    }
+
+    dedup_clear(dedup);
+    g_queue_free(dedup->order);
+    g_hash_table_destroy(dedup->links);
+    free(dedup);
+}
+
+void
+dedup_clear(Dedup dedup)
+{
+    while (!g_queue_is_empty(dedup->order)) {
+        _dedup_drop_last(dedup);
+    }
+}
+
+gboolean
+dedup_seen(Dedup dedup, const char *const key, gint64 now)
+{
+    // anything past its age is forgotten, oldest first
+    DedupEntry *last = g_queue_peek_tail(dedup->order);
+    while (last && now - last->seen >= dedup->max_age) {
+        _dedup_drop_last(dedup);
+        last = g_queue_peek_tail(dedup->order);
+    }
+
+    GList *link = g_hash_table_lookup(dedup->links, key);
+    if (link) {
+        DedupEntry *entry = link->data;
+        entry->seen = now;
+        g_queue_unlink(dedup->order, link);
+        g_queue_push_head_link(dedup->order, link);
+        return TRUE;
+    }
+
+    DedupEntry *entry = malloc(sizeof(DedupEntry));
+    entry->key = strdup(key);
+    entry->seen = now;
+    g_queue_push_head(dedup->order, entry);
+    g_hash_table_insert(dedup->links, entry->key, g_queue_peek_head_link(dedup->order));
+
+    if (g_queue_get_length(dedup->order) > dedup->max) {
+        _dedup_drop_last(dedup);
+    }
+
+    return FALSE;
+}
+
+gboolean
+dedup_contains(Dedup dedup, const char *const key, gint64 now)
+{
+    GList *link = g_hash_table_lookup(dedup->links, key);
+    if (link == NULL) {
+        return FALSE;
+    }
+
+    DedupEntry *entry = link->data;
+    return now - entry->seen < dedup->max_age;
+}
+
+guint
+dedup_size(Dedup dedup)
+{
+    return g_queue_get_length(dedup->order);
+}
+
+static void
+_dedup_drop_last(Dedup dedup)
+{
+    DedupEntry *entry = g_queue_pop_tail(dedup->order);
+    g_hash_table_remove(dedup->links, entry->key);
+    free(entry->key);
+    free(entry);
+}
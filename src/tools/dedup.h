@@ -0,0 +1,58 @@
+/*
+ * dedup.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <glib.h>
+
+typedef struct dedup_t *Dedup;
+
+// remembers at most max keys, each for max_age microseconds
+Dedup dedup_new(guint max, gint64 max_age);
+void dedup_free(Dedup dedup);
+void dedup_clear(Dedup dedup);
+
+// TRUE when key was last seen less than max_age before now, either way
+// it is remembered as seen now
+gboolean dedup_seen(Dedup dedup, const char *const key, gint64 now);
+
+// TRUE when key was last seen less than max_age before now, nothing is
+// remembered or moved
+gboolean dedup_contains(Dedup dedup, const char *const key, gint64 now);
+
+guint dedup_size(Dedup dedup);
+
+#endif
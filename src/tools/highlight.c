@@ -0,0 +1,263 @@
+/*
+ * highlight.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/highlight.h"
+
+#define ROOT 0
+#define NONE -1
+
+// a trie of the words with the links of an Aho-Corasick automaton, each
+// node's children are a list as few nodes have more than one
+typedef struct highlight_node_t {
+    guchar byte;
+    int child;
+    int sibling;
+    int fail;
+    // length of the word ending here, 0 if none does
+    int word_len;
+    // the next node along the fail links that ends a word
+    int output;
+} HighlightNode;
+
+struct highlight_t {
+    GArray *nodes;
+    int words;
+    gboolean case_sensitive;
+    gboolean whole_word;
+    // fail links are worked out again after words are added
+    gboolean linked;
+};
+
+#define NODE(highlight, i) (&g_array_index((highlight)->nodes, HighlightNode, (i)))
+
+static int _node_new(Highlight highlight, guchar byte);
+static int _node_next(Highlight highlight, int node, guchar byte);
+static void _link(Highlight highlight);
+static gboolean _word_bounded(const char *const text, size_t start, size_t end);
+
+Highlight
+highlight_new(gboolean case_sensitive, gboolean whole_word)
+{
+    Highlight highlight = malloc(sizeof(struct highlight_t));
+    highlight->nodes = g_array_new(FALSE, FALSE, sizeof(HighlightNode));
+    highlight->words = 0;
+    highlight->case_sensitive = case_sensitive;
+    highlight->whole_word = whole_word;
+    highlight->linked = FALSE;
+    _node_new(highlight, 0);
+
+    return highlight;
+}
+
+void
+highlight_free(Highlight highlight)
+{
+    if (highlight) {
+        g_array_free(highlight->nodes, TRUE);
+        free(highlight);
+    }
+}
+
+void
+highlight_add(Highlight highlight, const char *const word)
+{
+    if (word == NULL || word[0] == '\0') {
+        return;
+    }
+
+    char *folded = highlight->case_sensitive ? g_strdup(word) : g_utf8_casefold(word, -1);
+    int node = ROOT;
+    const guchar *curr = (const guchar*)folded;
+    while (*curr) {
+        int next = _node_next(highlight, node, *curr);
+        if (next == NONE) {
+            next = _node_new(highlight, *curr);
+            NODE(highlight, next)->sibling = NODE(highlight, node)->child;
+            NODE(highlight, node)->child = next;
+        }
+        node = next;
+        curr++;
+    }
+
+    if (NODE(highlight, node)->word_len == 0) {
+        highlight->words++;
+    }
+    NODE(highlight, node)->word_len = strlen(folded);
+    highlight->linked = FALSE;
+    g_free(folded);
+}
+
+int
+highlight_size(Highlight highlight)
+{
+    return highlight->words;
+}
+
+gboolean
+highlight_match(Highlight highlight, const char *const text)
+{
+    if (text == NULL || highlight->words == 0) {
+        return FALSE;
+    }
+
+    if (!highlight->linked) {
+        _link(highlight);
+    }
+
+    char *folded = highlight->case_sensitive ? (char*)text : g_utf8_casefold(text, -1);
+    gboolean found = FALSE;
+    int node = ROOT;
+    size_t i;
+    for (i = 0; folded[i] && !found; i++) {
+        guchar byte = folded[i];
+        int next = _node_next(highlight, node, byte);
+        while (next == NONE && node != ROOT) {
+            node = NODE(highlight, node)->fail;
+            next = _node_next(highlight, node, byte);
+        }
+        node = next == NONE ? ROOT : next;
+
+        int match = NODE(highlight, node)->word_len ? node : NODE(highlight, node)->output;
+        while (match != NONE) {
+            size_t len = NODE(highlight, match)->word_len;
+            if (!highlight->whole_word || _word_bounded(folded, i + 1 - len, i + 1)) {
+                found = TRUE;
+                break;
+            }
+            match = NODE(highlight, match)->output;
+        }
+    }
+
+    if (folded != text) {
+        g_free(folded);
+    }
+
+    return found;
+}
+
+static int
+_node_new(Highlight highlight, guchar byte)
+{
+    HighlightNode node;
+    node.byte = byte;
+    node.child = NONE;
+    node.sibling = NONE;
+    node.fail = ROOT;
+    node.word_len = 0;
+    node.output = NONE;
+    g_array_append_val(highlight->nodes, node);
+
+    return highlight->nodes->len - 1;
+}
+
+static int
+_node_next(Highlight highlight, int node, guchar byte)
+{
+    int child = NODE(highlight, node)->child;
+    while (child != NONE && NODE(highlight, child)->byte != byte) {
+        child = NODE(highlight, child)->sibling;
+    }
+
+    return child;
+}
+
+// breadth first, so a node's fail link is always to a node already linked
+static void
+_link(Highlight highlight)
+{
+    GQueue *queue = g_queue_new();
+    int child = NODE(highlight, ROOT)->child;
+    while (child != NONE) {
+        NODE(highlight, child)->fail = ROOT;
+        NODE(highlight, child)->output = NONE;
+        g_queue_push_tail(queue, GINT_TO_POINTER(child));
+        child = NODE(highlight, child)->sibling;
+    }
+
+    while (!g_queue_is_empty(queue)) {
+        int node = GPOINTER_TO_INT(g_queue_pop_head(queue));
+        child = NODE(highlight, node)->child;
+        while (child != NONE) {
+            guchar byte = NODE(highlight, child)->byte;
+            int fail = NODE(highlight, node)->fail;
+            int next = _node_next(highlight, fail, byte);
+            while (next == NONE && fail != ROOT) {
+                fail = NODE(highlight, fail)->fail;
+                next = _node_next(highlight, fail, byte);
+            }
+            fail = next == NONE ? ROOT : next;
+
+            NODE(highlight, child)->fail = fail;
+            NODE(highlight, child)->output = NODE(highlight, fail)->word_len ? fail : NODE(highlight, fail)->output;
+            g_queue_push_tail(queue, GINT_TO_POINTER(child));
+            child = NODE(highlight, child)->sibling;
+        }
+    }
+
+    g_queue_free(queue);
+    highlight->linked = TRUE;
+}
+
+static gboolean
+_word_char(const char *const pos)
+{
+    gunichar ch = g_utf8_get_char(pos);
+    return g_unichar_isalnum(ch) || ch == '_';
+}
+
+// whether the bytes from start to end are not joined to a letter or digit
+// either side
+static gboolean
+_word_bounded(const char *const text, size_t start, size_t end)
+{
+    if (start > 0) {
+        const char *prev = g_utf8_find_prev_char(text, &text[start]);
+        if (prev && _word_char(prev)) {
+            return FALSE;
+        }
+    }
+
+    if (text[end] && _word_char(&text[end])) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
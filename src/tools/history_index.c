@@ -0,0 +1,903 @@
+/*
+ * history_index.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "tools/history_index.h"
+#include "tools/watchdog.h"
+
+// Each search segment is an array of postings sorted by term hash, so
+// the lines containing a word can be found with a binary search. New
+// postings are kept in memory and written out as a segment once there
+// are enough of them, segments are merged when there are too many.
+// An index written with another version is dropped and built again.
+#define HISTORY_INDEX_FLUSH_SIZE 16384
+#define HISTORY_INDEX_MAX_SEGMENTS 8
+#define HISTORY_INDEX_VERSION "2"
+
+// time is when the line was logged, seconds since 1970 in the local time
+// the log was written in, it only orders results
+typedef struct history_posting_t {
+    guint32 term;
+    guint32 file;
+    guint32 offset;
+    guint32 time;
+} HistoryPosting;
+
+// day is the start of the date in the log's name, last_time the time of
+// the last line read, for lines without one
+typedef struct history_file_t {
+    gchar *path;
+    long length;
+    guint32 day;
+    guint32 last_time;
+} HistoryFile;
+
+typedef struct history_segment_t {
+    guint number;
+    GMappedFile *map;
+    const HistoryPosting *postings;
+    gsize len;
+} HistorySegment;
+
+struct history_index_t {
+    gchar *dir;
+    gchar *index_dir;
+    GPtrArray *files;
+    GHashTable *file_ids;
+    GArray *pending;
+    GPtrArray *segments;
+    guint next_segment;
+};
+
+static void _check_version(HistoryIndex index);
+static void _load_files(HistoryIndex index);
+static void _save_files(HistoryIndex index);
+static void _load_segments(HistoryIndex index);
+static HistorySegment* _segment_open(HistoryIndex index, guint number);
+static void _segment_free(HistorySegment *segment);
+static gchar* _segment_filename(HistoryIndex index, guint number);
+static void _merge_segments(HistoryIndex index);
+static guint32 _file_id(HistoryIndex index, const char *const path);
+static guint32 _file_replaced(HistoryIndex index, guint32 id);
+static void _file_retire(HistoryIndex index, guint32 id);
+static GPtrArray* _tokens(const char *const text, gssize len);
+static guint32 _term_hash(const char *const token);
+static guint32 _file_day(const char *const path);
+static guint32 _line_time(HistoryFile *file, const char *const text, gssize len);
+static void _index_text(HistoryIndex index, guint32 file_id, long offset, const char *text, gssize len);
+static void _index_range(HistoryIndex index, guint32 file_id, long start, long end);
+static int _scan_dir(HistoryIndex index, const char *const rel_dir);
+static GArray* _lookup(HistoryIndex index, guint32 term);
+static int _posting_cmp(gconstpointer a, gconstpointer b);
+static int _location_cmp(gconstpointer a, gconstpointer b);
+static int _time_cmp(gconstpointer a, gconstpointer b);
+static void _map_unref(GMappedFile *map);
+
+HistoryIndex
+history_index_open(const char *const dir)
+{
+    HistoryIndex index = malloc(sizeof(struct history_index_t));
+    index->dir = g_strdup(dir);
+    index->index_dir = g_strdup_printf("%s/.index", dir);
+    index->files = g_ptr_array_new();
+    index->file_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    index->pending = g_array_new(FALSE, FALSE, sizeof(HistoryPosting));
+    index->segments = g_ptr_array_new_with_free_func((GDestroyNotify)_segment_free);
+    index->next_segment = 0;
+
+    g_mkdir_with_parents(index->index_dir, S_IRWXU);
+    _check_version(index);
+    _load_files(index);
+    _load_segments(index);
+
+    return index;
+}
+
+void
+history_index_close(HistoryIndex index)
+{
+    if (index == NULL) {
+        return;
+    }
+
+    history_index_flush(index);
+
+    guint i;
+    for (i = 0; i < index->files->len; i++) {
+        HistoryFile *file = g_ptr_array_index(index->files, i);
+        g_free(file->path);
+        free(file);
+    }
+    g_ptr_array_free(index->files, TRUE);
+    g_hash_table_destroy(index->file_ids);
+    g_array_free(index->pending, TRUE);
+    g_ptr_array_free(index->segments, TRUE);
+    g_free(index->dir);
+    g_free(index->index_dir);
+    free(index);
+}
+
+void
+history_index_add(HistoryIndex index, const char *const file, long offset, const char *const line)
+{
+    guint32 id = _file_id(index, file);
+    HistoryFile *history_file = g_ptr_array_index(index->files, id);
+
+    // written from the start again, what was indexed is gone
+    if (offset < history_file->length) {
+        id = _file_replaced(index, id);
+        history_file = g_ptr_array_index(index->files, id);
+    }
+
+    // lines written before the file was known to the index
+    if (history_file->length < offset) {
+        _index_range(index, id, history_file->length, offset);
+    }
+
+    _index_text(index, id, offset, line, -1);
+    history_file->length = offset + strlen(line);
+}
+
+void
+history_index_remove(HistoryIndex index, const char *const file)
+{
+    gpointer id = g_hash_table_lookup(index->file_ids, file);
+    if (id == NULL) {
+        return;
+    }
+
+    _file_retire(index, GPOINTER_TO_UINT(id) - 1);
+    _save_files(index);
+}
+
+void
+history_index_rename(HistoryIndex index, const char *const from, const char *const to)
+{
+    gpointer id = g_hash_table_lookup(index->file_ids, from);
+    if (id == NULL) {
+        return;
+    }
+
+    gpointer stale = g_hash_table_lookup(index->file_ids, to);
+    if (stale) {
+        _file_retire(index, GPOINTER_TO_UINT(stale) - 1);
+    }
+
+    HistoryFile *file = g_ptr_array_index(index->files, GPOINTER_TO_UINT(id) - 1);
+    g_hash_table_remove(index->file_ids, file->path);
+    g_free(file->path);
+    file->path = g_strdup(to);
+    g_hash_table_insert(index->file_ids, file->path, id);
+
+    _save_files(index);
+}
+
+int
+history_index_scan(HistoryIndex index)
+{
+    int updated = _scan_dir(index, NULL);
+    history_index_flush(index);
+
+    return updated;
+}
+
+void
+history_index_flush(HistoryIndex index)
+{
+    if (index->pending->len == 0) {
+        return;
+    }
+
+    g_array_sort(index->pending, _posting_cmp);
+
+    guint number = index->next_segment++;
+    gchar *filename = _segment_filename(index, number);
+    gchar *tmp_filename = g_strdup_printf("%s.tmp", filename);
+    FILE *segp = fopen(tmp_filename, "wb");
+    if (segp) {
+        size_t written = fwrite(index->pending->data, sizeof(HistoryPosting), index->pending->len, segp);
+        int closed = fclose(segp);
+        if (written == index->pending->len && closed == 0 && g_rename(tmp_filename, filename) == 0) {
+            HistorySegment *segment = _segment_open(index, number);
+            if (segment) {
+                g_ptr_array_add(index->segments, segment);
+            }
+        } else {
+            g_unlink(tmp_filename);
+        }
+    }
+    g_free(tmp_filename);
+    g_free(filename);
+
+    g_array_set_size(index->pending, 0);
+    _save_files(index);
+
+    if (index->segments->len > HISTORY_INDEX_MAX_SEGMENTS) {
+        _merge_segments(index);
+    }
+}
+
+GSList*
+history_index_search(HistoryIndex index, const char *const query, int max_results)
+{
+    history_index_flush(index);
+
+    GPtrArray *words = _tokens(query, -1);
+    if (words == NULL || words->len == 0) {
+        if (words) {
+            g_ptr_array_free(words, TRUE);
+        }
+        return NULL;
+    }
+
+    // start from the rarest word and keep the lines the others appear on
+    GArray *candidates = NULL;
+    guint i;
+    for (i = 0; i < words->len; i++) {
+        GArray *postings = _lookup(index, _term_hash(g_ptr_array_index(words, i)));
+        if (candidates == NULL) {
+            candidates = postings;
+            continue;
+        }
+
+        GArray *smaller = postings->len < candidates->len ? postings : candidates;
+        GArray *larger = smaller == postings ? candidates : postings;
+        GArray *both = g_array_new(FALSE, FALSE, sizeof(HistoryPosting));
+        guint j;
+        for (j = 0; j < smaller->len; j++) {
+            HistoryPosting *posting = &g_array_index(smaller, HistoryPosting, j);
+            if (bsearch(posting, larger->data, larger->len, sizeof(HistoryPosting), _location_cmp)) {
+                g_array_append_val(both, *posting);
+            }
+        }
+        g_array_free(postings, TRUE);
+        g_array_free(candidates, TRUE);
+        candidates = both;
+    }
+
+    // term hashes can collide, so check the newest lines really match, the
+    // files they are in are mapped once each
+    g_array_sort(candidates, _time_cmp);
+    GHashTable *maps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_map_unref);
+    GSList *matches = NULL;
+    int found = 0;
+    gint pos;
+    for (pos = (gint)candidates->len - 1; pos >= 0 && found < max_results; pos--) {
+        HistoryPosting *posting = &g_array_index(candidates, HistoryPosting, pos);
+        HistoryFile *file = g_ptr_array_index(index->files, posting->file);
+
+        GMappedFile *map = NULL;
+        gpointer key = GUINT_TO_POINTER(posting->file);
+        if (!g_hash_table_lookup_extended(maps, key, NULL, (gpointer *)&map)) {
+            gchar *filename = g_strdup_printf("%s/%s", index->dir, file->path);
+            map = g_mapped_file_new(filename, FALSE, NULL);
+            g_free(filename);
+            g_hash_table_insert(maps, key, map);
+        }
+        if (map == NULL || posting->offset >= g_mapped_file_get_length(map)) {
+            continue;
+        }
+
+        const char *line = g_mapped_file_get_contents(map) + posting->offset;
+        gsize remaining = g_mapped_file_get_length(map) - posting->offset;
+        const char *nl = memchr(line, '\n', remaining);
+        gsize len = nl ? (gsize)(nl - line) : remaining;
+
+        GPtrArray *line_words = _tokens(line, len);
+        gboolean matched = line_words != NULL;
+        for (i = 0; matched && i < words->len; i++) {
+            matched = FALSE;
+            guint j;
+            for (j = 0; j < line_words->len; j++) {
+                if (g_strcmp0(g_ptr_array_index(words, i), g_ptr_array_index(line_words, j)) == 0) {
+                    matched = TRUE;
+                    break;
+                }
+            }
+        }
+        if (line_words) {
+            g_ptr_array_free(line_words, TRUE);
+        }
+
+        if (matched) {
+            HistoryMatch *match = malloc(sizeof(HistoryMatch));
+            match->file = g_strdup(file->path);
+            match->offset = posting->offset;
+            match->line = g_strndup(line, len);
+            matches = g_slist_prepend(matches, match);
+            found++;
+        }
+    }
+
+    g_hash_table_destroy(maps);
+    g_array_free(candidates, TRUE);
+    g_ptr_array_free(words, TRUE);
+
+    return matches;
+}
+
+void
+history_match_free(HistoryMatch *match)
+{
+    if (match) {
+        g_free(match->file);
+        g_free(match->line);
+        free(match);
+    }
+}
+
+// an index of another version is removed, the next scan builds it again
+static void
+_check_version(HistoryIndex index)
+{
+    gchar *filename = g_strdup_printf("%s/version", index->index_dir);
+    gchar *version = NULL;
+    g_file_get_contents(filename, &version, NULL, NULL);
+
+    if (g_strcmp0(version, HISTORY_INDEX_VERSION) != 0) {
+        GDir *dir = g_dir_open(index->index_dir, 0, NULL);
+        if (dir) {
+            const gchar *name;
+            while ((name = g_dir_read_name(dir)) != NULL) {
+                if (g_str_has_prefix(name, "seg.") || g_strcmp0(name, "files") == 0) {
+                    gchar *path = g_strdup_printf("%s/%s", index->index_dir, name);
+                    g_unlink(path);
+                    g_free(path);
+                }
+            }
+            g_dir_close(dir);
+        }
+        g_file_set_contents(filename, HISTORY_INDEX_VERSION, -1, NULL);
+    }
+
+    g_free(version);
+    g_free(filename);
+}
+
+// the files list holds the indexed length and path of each log, one per line
+static void
+_load_files(HistoryIndex index)
+{
+    gchar *filename = g_strdup_printf("%s/files", index->index_dir);
+    gchar *contents = NULL;
+    if (g_file_get_contents(filename, &contents, NULL, NULL)) {
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        int i;
+        for (i = 0; lines[i] != NULL; i++) {
+            char *path = NULL;
+            long length = strtol(lines[i], &path, 10);
+            if (path == lines[i] || *path != ' ') {
+                continue;
+            }
+            guint32 id = _file_id(index, path + 1);
+            HistoryFile *file = g_ptr_array_index(index->files, id);
+            file->length = length;
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+    g_free(filename);
+}
+
+static void
+_save_files(HistoryIndex index)
+{
+    GString *contents = g_string_new("");
+    guint i;
+    for (i = 0; i < index->files->len; i++) {
+        HistoryFile *file = g_ptr_array_index(index->files, i);
+        g_string_append_printf(contents, "%ld %s\n", file->length, file->path);
+    }
+
+    gchar *filename = g_strdup_printf("%s/files", index->index_dir);
+    watchdog_tag(WATCHDOG_DISK);
+    g_file_set_contents(filename, contents->str, contents->len, NULL);
+    g_free(filename);
+    g_string_free(contents, TRUE);
+}
+
+static void
+_load_segments(HistoryIndex index)
+{
+    GDir *dir = g_dir_open(index->index_dir, 0, NULL);
+    if (dir == NULL) {
+        return;
+    }
+
+    GArray *numbers = g_array_new(FALSE, FALSE, sizeof(guint));
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        guint number;
+        char end;
+        if (sscanf(name, "seg.%u%c", &number, &end) == 1) {
+            g_array_append_val(numbers, number);
+        }
+    }
+    g_dir_close(dir);
+
+    guint i;
+    for (i = 0; i < numbers->len; i++) {
+        guint number = g_array_index(numbers, guint, i);
+        HistorySegment *segment = _segment_open(index, number);
+        if (segment) {
+            g_ptr_array_add(index->segments, segment);
+        }
+        if (number >= index->next_segment) {
+            index->next_segment = number + 1;
+        }
+    }
+    g_array_free(numbers, TRUE);
+}
+
+static gchar*
+_segment_filename(HistoryIndex index, guint number)
+{
+    return g_strdup_printf("%s/seg.%u", index->index_dir, number);
+}
+
+static HistorySegment*
+_segment_open(HistoryIndex index, guint number)
+{
+    gchar *filename = _segment_filename(index, number);
+    GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+    g_free(filename);
+    if (map == NULL) {
+        return NULL;
+    }
+
+    HistorySegment *segment = malloc(sizeof(HistorySegment));
+    segment->number = number;
+    segment->map = map;
+    segment->postings = (const HistoryPosting *)g_mapped_file_get_contents(map);
+    segment->len = g_mapped_file_get_length(map) / sizeof(HistoryPosting);
+
+    return segment;
+}
+
+static void
+_segment_free(HistorySegment *segment)
+{
+    if (segment) {
+        g_mapped_file_unref(segment->map);
+        free(segment);
+    }
+}
+
+// merge all segments into one, reading each once in order
+static void
+_merge_segments(HistoryIndex index)
+{
+    guint count = index->segments->len;
+    gsize *pos = calloc(count, sizeof(gsize));
+
+    guint number = index->next_segment++;
+    gchar *filename = _segment_filename(index, number);
+    gchar *tmp_filename = g_strdup_printf("%s.tmp", filename);
+    FILE *segp = fopen(tmp_filename, "wb");
+    gboolean ok = segp != NULL;
+
+    while (ok) {
+        HistorySegment *next = NULL;
+        guint next_i = 0;
+        guint i;
+        for (i = 0; i < count; i++) {
+            HistorySegment *segment = g_ptr_array_index(index->segments, i);
+            if (pos[i] < segment->len && (next == NULL ||
+                    _posting_cmp(&segment->postings[pos[i]], &next->postings[pos[next_i]]) < 0)) {
+                next = segment;
+                next_i = i;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+        ok = fwrite(&next->postings[pos[next_i]], sizeof(HistoryPosting), 1, segp) == 1;
+        pos[next_i]++;
+    }
+    free(pos);
+
+    if (segp && fclose(segp) != 0) {
+        ok = FALSE;
+    }
+
+    if (ok && g_rename(tmp_filename, filename) == 0) {
+        guint i;
+        for (i = 0; i < count; i++) {
+            HistorySegment *segment = g_ptr_array_index(index->segments, i);
+            gchar *old_filename = _segment_filename(index, segment->number);
+            g_unlink(old_filename);
+            g_free(old_filename);
+        }
+        g_ptr_array_set_size(index->segments, 0);
+        HistorySegment *segment = _segment_open(index, number);
+        if (segment) {
+            g_ptr_array_add(index->segments, segment);
+        }
+    } else {
+        g_unlink(tmp_filename);
+    }
+
+    g_free(tmp_filename);
+    g_free(filename);
+}
+
+static guint32
+_file_id(HistoryIndex index, const char *const path)
+{
+    gpointer id = g_hash_table_lookup(index->file_ids, path);
+    if (id) {
+        return GPOINTER_TO_UINT(id) - 1;
+    }
+
+    HistoryFile *file = malloc(sizeof(HistoryFile));
+    file->path = g_strdup(path);
+    file->length = 0;
+    file->day = _file_day(path);
+    file->last_time = file->day;
+    g_ptr_array_add(index->files, file);
+    g_hash_table_insert(index->file_ids, file->path, GUINT_TO_POINTER(index->files->len));
+
+    return index->files->len - 1;
+}
+
+// the file at the path of id was replaced, returns the id it is indexed
+// under from now on
+static guint32
+_file_replaced(HistoryIndex index, guint32 id)
+{
+    HistoryFile *file = g_ptr_array_index(index->files, id);
+    gchar *path = g_strdup(file->path);
+    _file_retire(index, id);
+    guint32 new_id = _file_id(index, path);
+    g_free(path);
+
+    return new_id;
+}
+
+// postings for a file that is gone are not rewritten, its entry is moved
+// to a path no log can have, under the skipped dot directory, so they
+// stop matching and the ids of the files after it stay the same
+static void
+_file_retire(HistoryIndex index, guint32 id)
+{
+    HistoryFile *file = g_ptr_array_index(index->files, id);
+    g_hash_table_remove(index->file_ids, file->path);
+    g_free(file->path);
+    file->path = g_strdup_printf(".retired/%u", id);
+    file->length = 0;
+    g_hash_table_insert(index->file_ids, file->path, GUINT_TO_POINTER(id + 1));
+}
+
+// lower case words made of letters and digits
+static GPtrArray*
+_tokens(const char *const text, gssize len)
+{
+    if (!g_utf8_validate(text, len, NULL)) {
+        return NULL;
+    }
+
+    GPtrArray *tokens = g_ptr_array_new_with_free_func(g_free);
+    gchar *lower = g_utf8_strdown(text, len);
+    const gchar *start = NULL;
+    const gchar *curr = lower;
+    while (TRUE) {
+        gunichar ch = g_utf8_get_char(curr);
+        gboolean word = ch != 0 && g_unichar_isalnum(ch);
+        if (word && start == NULL) {
+            start = curr;
+        } else if (!word && start) {
+            g_ptr_array_add(tokens, g_strndup(start, curr - start));
+            start = NULL;
+        }
+        if (ch == 0) {
+            break;
+        }
+        curr = g_utf8_next_char(curr);
+    }
+    g_free(lower);
+
+    return tokens;
+}
+
+// FNV-1a
+static guint32
+_term_hash(const char *const token)
+{
+    guint32 hash = 2166136261u;
+    const unsigned char *curr = (const unsigned char *)token;
+    while (*curr) {
+        hash ^= *curr++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void
+_index_text(HistoryIndex index, guint32 file_id, long offset, const char *text, gssize len)
+{
+    if (len < 0) {
+        len = strlen(text);
+    }
+
+    // chat log lines start with the time, which is not worth indexing
+    guint32 time = _line_time(g_ptr_array_index(index->files, file_id), text, len);
+    if (len > 11 && text[2] == ':' && text[5] == ':' && strncmp(&text[8], " - ", 3) == 0) {
+        text += 11;
+        len -= 11;
+    }
+
+    GPtrArray *tokens = _tokens(text, len);
+    if (tokens == NULL) {
+        return;
+    }
+
+    GArray *terms = g_array_sized_new(FALSE, FALSE, sizeof(guint32), tokens->len);
+    guint i;
+    for (i = 0; i < tokens->len; i++) {
+        guint32 term = _term_hash(g_ptr_array_index(tokens, i));
+        g_array_append_val(terms, term);
+    }
+    g_ptr_array_free(tokens, TRUE);
+
+    // index each word once per line
+    for (i = 0; i < terms->len; i++) {
+        guint32 term = g_array_index(terms, guint32, i);
+        gboolean seen = FALSE;
+        guint j;
+        for (j = 0; j < i; j++) {
+            if (g_array_index(terms, guint32, j) == term) {
+                seen = TRUE;
+                break;
+            }
+        }
+        if (!seen) {
+            HistoryPosting posting = { term, file_id, offset, time };
+            g_array_append_val(index->pending, posting);
+        }
+    }
+    g_array_free(terms, TRUE);
+
+    if (index->pending->len >= HISTORY_INDEX_FLUSH_SIZE) {
+        history_index_flush(index);
+    }
+}
+
+// index the complete lines between start and end of a log file
+static void
+_index_range(HistoryIndex index, guint32 file_id, long start, long end)
+{
+    HistoryFile *file = g_ptr_array_index(index->files, file_id);
+    gchar *filename = g_strdup_printf("%s/%s", index->dir, file->path);
+    GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+    g_free(filename);
+    if (map == NULL) {
+        return;
+    }
+
+    const char *contents = g_mapped_file_get_contents(map);
+    long length = g_mapped_file_get_length(map);
+    if (end > length) {
+        end = length;
+    }
+
+    long pos = start;
+    while (pos < end) {
+        const char *nl = memchr(contents + pos, '\n', end - pos);
+        if (nl == NULL) {
+            break;
+        }
+        long next = nl - contents + 1;
+        _index_text(index, file_id, pos, contents + pos, next - pos - 1);
+        pos = next;
+    }
+    g_mapped_file_unref(map);
+
+    if (pos > file->length) {
+        file->length = pos;
+    }
+}
+
+static int
+_scan_dir(HistoryIndex index, const char *const rel_dir)
+{
+    gchar *path = rel_dir ? g_strdup_printf("%s/%s", index->dir, rel_dir) : g_strdup(index->dir);
+    GDir *dir = g_dir_open(path, 0, NULL);
+    g_free(path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int updated = 0;
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (name[0] == '.') {
+            continue;
+        }
+
+        gchar *rel_path = rel_dir ? g_strdup_printf("%s/%s", rel_dir, name) : g_strdup(name);
+        gchar *full_path = g_strdup_printf("%s/%s", index->dir, rel_path);
+        if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+            updated += _scan_dir(index, rel_path);
+        } else if (g_str_has_suffix(name, ".log")) {
+            GStatBuf st;
+            if (g_stat(full_path, &st) == 0) {
+                guint32 id = _file_id(index, rel_path);
+                HistoryFile *file = g_ptr_array_index(index->files, id);
+                if (file->length > st.st_size) {
+                    id = _file_replaced(index, id);
+                    file = g_ptr_array_index(index->files, id);
+                }
+                if (file->length < st.st_size) {
+                    _index_range(index, id, file->length, st.st_size);
+                    updated++;
+                }
+            }
+        }
+        g_free(full_path);
+        g_free(rel_path);
+    }
+    g_dir_close(dir);
+
+    return updated;
+}
+
+// the locations of the lines containing a term, in file order
+static GArray*
+_lookup(HistoryIndex index, guint32 term)
+{
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(HistoryPosting));
+
+    guint i;
+    for (i = 0; i < index->segments->len; i++) {
+        HistorySegment *segment = g_ptr_array_index(index->segments, i);
+        gsize low = 0;
+        gsize high = segment->len;
+        while (low < high) {
+            gsize mid = low + (high - low) / 2;
+            if (segment->postings[mid].term < term) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        while (low < segment->len && segment->postings[low].term == term) {
+            g_array_append_val(result, segment->postings[low]);
+            low++;
+        }
+    }
+
+    g_array_sort(result, _location_cmp);
+
+    return result;
+}
+
+// logs are named by date, e.g. contact/2016_01_31.log or 2016_01_31.1.log
+static guint32
+_file_day(const char *const path)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    int year, month, day;
+    if (sscanf(name, "%4d_%2d_%2d", &year, &month, &day) != 3 ||
+            !g_date_valid_dmy(day, month, year) || year < 1970) {
+        return 0;
+    }
+
+    GDate date;
+    g_date_clear(&date, 1);
+    g_date_set_dmy(&date, day, month, year);
+    GDate epoch;
+    g_date_clear(&epoch, 1);
+    g_date_set_dmy(&epoch, 1, G_DATE_JANUARY, 1970);
+
+    return (guint32)g_date_days_between(&epoch, &date) * 86400;
+}
+
+// the time at the start of a log line, HH:MM:SS - , on the file's day
+static guint32
+_line_time(HistoryFile *file, const char *const text, gssize len)
+{
+    if (len > 11 && text[2] == ':' && text[5] == ':' && strncmp(&text[8], " - ", 3) == 0 &&
+            g_ascii_isdigit(text[0]) && g_ascii_isdigit(text[1]) &&
+            g_ascii_isdigit(text[3]) && g_ascii_isdigit(text[4]) &&
+            g_ascii_isdigit(text[6]) && g_ascii_isdigit(text[7])) {
+        guint32 seconds = ((text[0] - '0') * 10 + (text[1] - '0')) * 3600 +
+            ((text[3] - '0') * 10 + (text[4] - '0')) * 60 +
+            (text[6] - '0') * 10 + (text[7] - '0');
+        file->last_time = file->day + seconds;
+    }
+
+    return file->last_time;
+}
+
+static int
+_posting_cmp(gconstpointer a, gconstpointer b)
+{
+    const HistoryPosting *pa = a;
+    const HistoryPosting *pb = b;
+
+    if (pa->term != pb->term) {
+        return pa->term < pb->term ? -1 : 1;
+    }
+
+    return _location_cmp(a, b);
+}
+
+static int
+_location_cmp(gconstpointer a, gconstpointer b)
+{
+    const HistoryPosting *pa = a;
+    const HistoryPosting *pb = b;
+
+    if (pa->file != pb->file) {
+        return pa->file < pb->file ? -1 : 1;
+    }
+    if (pa->offset != pb->offset) {
+        return pa->offset < pb->offset ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// oldest logged first, lines logged in the same second in file order
+static int
+_time_cmp(gconstpointer a, gconstpointer b)
+{
+    const HistoryPosting *pa = a;
+    const HistoryPosting *pb = b;
+
+    if (pa->time != pb->time) {
+        return pa->time < pb->time ? -1 : 1;
+    }
+
+    return _location_cmp(a, b);
+}
+
+// a file that could not be mapped is kept as NULL
+static void
+_map_unref(GMappedFile *map)
+{
+    if (map) {
+        g_mapped_file_unref(map);
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * history_index.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef HISTORY_INDEX_H
+#define HISTORY_INDEX_H
+
+#include <glib.h>
+
+typedef struct history_index_t *HistoryIndex;
+
+typedef struct history_match_t {
+    gchar *file;
+    long offset;
+    gchar *line;
+} HistoryMatch;
+
+// open the index of the chat logs under dir, creating it if needed
+HistoryIndex history_index_open(const char *const dir);
+
+// write out pending entries and free the index
+void history_index_close(HistoryIndex index);
+
+// index a line appended at offset to file, a path relative to the logs
+// directory, indexing any earlier part of the file not yet seen
+void history_index_add(HistoryIndex index, const char *const file, long offset, const char *const line);
+
+// a log was removed or compressed, its lines are no longer found
+void history_index_remove(HistoryIndex index, const char *const file);
+
+// a log was renamed, its lines are found under the new path
+void history_index_rename(HistoryIndex index, const char *const from, const char *const to);
+
+// index everything under the logs directory not yet indexed, a file
+// shorter than what was indexed of it is indexed again, returns
+// the number of files updated
+int history_index_scan(HistoryIndex index);
+
+// write pending entries to a new segment
+void history_index_flush(HistoryIndex index);
+
+// find the newest max_results lines containing every word in query, by the
+// time they were logged, returned oldest first
+GSList* history_index_search(HistoryIndex index, const char *const query, int max_results);
+
+void history_match_free(HistoryMatch *match);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * http.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <curl/curl.h>
+#include <glib.h>
+
+#include "log.h"
+#include "tools/http.h"
+#include "tools/watchdog.h"
+
+// a transfer in progress, the response is collected until it completes,
+// an upload is read from its file as it is sent
+typedef struct http_request_t {
+    CURL *handle;
+    GString *body;
+    FILE *upload;
+    struct curl_slist *headers;
+    http_progress progress;
+    http_callback callback;
+    void *userdata;
+} HttpRequest;
+
+static CURLM *multi = NULL;
+static GSList *requests = NULL;
+
+static size_t _http_data(void *ptr, size_t size, size_t nmemb, void *data);
+static int _http_xferinfo(void *data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+static HttpRequest* _http_request_new(const char *const url, http_callback callback, void *userdata);
+static gboolean _http_request_start(HttpRequest *request);
+static void _http_request_free(HttpRequest *request);
+
+void
+http_init(void)
+{
+    multi = curl_multi_init();
+}
+
+void
+http_close(void)
+{
+    // outstanding transfers are dropped without calling back
+    GSList *curr = requests;
+    while (curr) {
+        HttpRequest *request = curr->data;
+        curl_multi_remove_handle(multi, request->handle);
+        _http_request_free(request);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(requests);
+    requests = NULL;
+
+    if (multi) {
+        curl_multi_cleanup(multi);
+        multi = NULL;
+    }
+}
+
+// start fetching the url, the callback is run from http_process with the
+// body, or NULL when the request failed, timeout_secs of 0 means no limit
+gboolean
+http_get(const char *const url, long timeout_secs, http_callback callback, void *userdata)
+{
+    if (multi == NULL) {
+        return FALSE;
+    }
+
+    HttpRequest *request = _http_request_new(url, callback, userdata);
+    if (request == NULL) {
+        return FALSE;
+    }
+
+    if (timeout_secs > 0) {
+        curl_easy_setopt(request->handle, CURLOPT_TIMEOUT, timeout_secs);
+    }
+
+    return _http_request_start(request);
+}
+
+// put the file at path to the url with the "Name: value" headers given,
+// curl reads the file a buffer at a time as the socket takes it, so the
+// whole file is never held in memory, the callback is run with the body
+// or NULL when the request failed or the server refused the file
+gboolean
+http_put_file(const char *const url, const char *const path, GSList *headers, http_progress progress,
+    http_callback callback, void *userdata)
+{
+    if (multi == NULL) {
+        return FALSE;
+    }
+
+    FILE *upload = fopen(path, "rb");
+    if (upload == NULL) {
+        return FALSE;
+    }
+    struct stat st;
+    if (fstat(fileno(upload), &st) != 0) {
+        fclose(upload);
+        return FALSE;
+    }
+
+    HttpRequest *request = _http_request_new(url, callback, userdata);
+    if (request == NULL) {
+        fclose(upload);
+        return FALSE;
+    }
+    request->upload = upload;
+    request->progress = progress;
+
+    GSList *curr = headers;
+    while (curr) {
+        request->headers = curl_slist_append(request->headers, curr->data);
+        curr = g_slist_next(curr);
+    }
+
+    CURL *handle = request->handle;
+    curl_easy_setopt(handle, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(handle, CURLOPT_READDATA, (void *)upload);
+    curl_easy_setopt(handle, CURLOPT_INFILESIZE_LARGE, (curl_off_t)st.st_size);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+    if (request->headers) {
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request->headers);
+    }
+    if (progress) {
+        curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, _http_xferinfo);
+        curl_easy_setopt(handle, CURLOPT_XFERINFODATA, (void *)request);
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    }
+
+    return _http_request_start(request);
+}
+
+gboolean
+http_pending(void)
+{
+    return requests != NULL;
+}
+
+// move transfers along without blocking and call back for those done,
+// run from the main loop
+void
+http_process(void)
+{
+    if (requests == NULL) {
+        return;
+    }
+
+    int running = 0;
+    watchdog_tag(WATCHDOG_CURL);
+    curl_multi_perform(multi, &running);
+
+    int queued = 0;
+    CURLMsg *msg = NULL;
+    while ((msg = curl_multi_info_read(multi, &queued))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        HttpRequest *request = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+        CURLcode result = msg->data.result;
+        curl_multi_remove_handle(multi, request->handle);
+        requests = g_slist_remove(requests, request);
+
+        if (result != CURLE_OK) {
+            log_debug("HTTP request failed: %s", curl_easy_strerror(result));
+        }
+
+        // the callback may start new requests
+        if (request->callback) {
+            request->callback(result == CURLE_OK ? request->body->str : NULL, request->userdata);
+        }
+        _http_request_free(request);
+    }
+}
+
+static size_t
+_http_data(void *ptr, size_t size, size_t nmemb, void *data)
+{
+    size_t realsize = size * nmemb;
+    g_string_append_len((GString*)data, ptr, realsize);
+
+    return realsize;
+}
+
+static int
+_http_xferinfo(void *data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    HttpRequest *request = data;
+    request->progress((gint64)ulnow, (gint64)ultotal, request->userdata);
+
+    return 0;
+}
+
+static HttpRequest*
+_http_request_new(const char *const url, http_callback callback, void *userdata)
+{
+    CURL *handle = curl_easy_init();
+    if (handle == NULL) {
+        return NULL;
+    }
+
+    HttpRequest *request = malloc(sizeof(HttpRequest));
+    request->handle = handle;
+    request->body = g_string_new("");
+    request->upload = NULL;
+    request->headers = NULL;
+    request->progress = NULL;
+    request->callback = callback;
+    request->userdata = userdata;
+
+    curl_easy_setopt(handle, CURLOPT_URL, url);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, _http_data);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)request->body);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, (void *)request);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+
+    return request;
+}
+
+static gboolean
+_http_request_start(HttpRequest *request)
+{
+    if (curl_multi_add_handle(multi, request->handle) != CURLM_OK) {
+        _http_request_free(request);
+        return FALSE;
+    }
+    requests = g_slist_prepend(requests, request);
+
+    // get the connection started straight away
+    http_process();
+
+    return TRUE;
+}
+
+static void
+_http_request_free(HttpRequest *request)
+{
+    curl_easy_cleanup(request->handle);
+    if (request->headers) {
+        curl_slist_free_all(request->headers);
+    }
+    if (request->upload) {
+        fclose(request->upload);
+    }
+    g_string_free(request->body, TRUE);
+    free(request);
+}
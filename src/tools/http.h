@@ -0,0 +1,54 @@
+/*
+ * http.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <glib.h>
+
+// run with the response body, or NULL when the request failed
+typedef void (*http_callback)(const char *const body, void *userdata);
+// run as a transfer moves along with the bytes sent so far
+typedef void (*http_progress)(gint64 sent, gint64 total, void *userdata);
+
+void http_init(void);
+void http_close(void);
+gboolean http_get(const char *const url, long timeout_secs, http_callback callback, void *userdata);
+gboolean http_put_file(const char *const url, const char *const path, GSList *headers, http_progress progress,
+    http_callback callback, void *userdata);
+gboolean http_pending(void);
+void http_process(void);
+
+#endif
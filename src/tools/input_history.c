@@ -0,0 +1,332 @@
+/*
+ * input_history.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "tools/input_history.h"
+#include "tools/stats.h"
+#include "tools/watchdog.h"
+
+// Lines are kept oldest first. The search index maps each three byte
+// sequence to the lines containing it, it is only built on the first
+// search so loading a long history stays cheap.
+struct input_history_t {
+    gchar *path;
+    FILE *file;
+    GPtrArray *lines;
+    GHashTable *trigrams;
+};
+
+// commands whose arguments are secrets, never kept
+static const char *const private_commands[] = {
+    "/pgp",
+    "/otr secret",
+    "/otr question",
+    "/otr answer",
+};
+
+// commands that are kept unless they carry one of the private options
+static const char *const password_commands[] = {
+    "/account",
+    "/connect",
+    "/join",
+    "/bookmark",
+};
+static const char *const password_options[] = {
+    " password ",
+    " eval_password ",
+};
+
+static gboolean _line_private(const char *const line);
+static FILE* _history_file(const char *const path);
+static void _index_line(InputHistory history, int line);
+static guint32 _trigram(const char *const str);
+static void _postings_free(GArray *postings);
+static void _line_free(gpointer line);
+
+InputHistory
+input_history_open(const char *const path)
+{
+    InputHistory history = malloc(sizeof(struct input_history_t));
+    history->path = g_strdup(path);
+    history->file = NULL;
+    history->lines = g_ptr_array_new_with_free_func(_line_free);
+    history->trigrams = NULL;
+
+    if (path == NULL) {
+        return history;
+    }
+
+    GMappedFile *map = g_mapped_file_new(path, FALSE, NULL);
+    if (map) {
+        const gchar *contents = g_mapped_file_get_contents(map);
+        const gchar *end = contents + g_mapped_file_get_length(map);
+        const gchar *curr = contents;
+        while (curr && curr < end) {
+            const gchar *eol = memchr(curr, '\n', end - curr);
+            if (eol == NULL) {
+                // partly written last line
+                break;
+            }
+            if (eol > curr) {
+                g_ptr_array_add(history->lines, g_strndup(curr, eol - curr));
+                stats_alloc(STATS_MEM_INPUT_HISTORY, eol - curr + 1);
+            }
+            curr = eol + 1;
+        }
+        g_mapped_file_unref(map);
+    }
+
+    history->file = _history_file(path);
+
+    return history;
+}
+
+void
+input_history_close(InputHistory history)
+{
+    if (history == NULL) {
+        return;
+    }
+
+    if (history->file) {
+        fclose(history->file);
+    }
+    if (history->trigrams) {
+        g_hash_table_destroy(history->trigrams);
+    }
+    g_ptr_array_free(history->lines, TRUE);
+    g_free(history->path);
+    free(history);
+}
+
+void
+input_history_add(InputHistory history, const char *const line)
+{
+    if (line == NULL || line[0] == '\0' || strchr(line, '\n')) {
+        return;
+    }
+    if (_line_private(line)) {
+        return;
+    }
+
+    // repeating the previous line adds nothing to search
+    if (history->lines->len > 0) {
+        const char *last = g_ptr_array_index(history->lines, history->lines->len - 1);
+        if (g_strcmp0(last, line) == 0) {
+            return;
+        }
+    }
+
+    g_ptr_array_add(history->lines, g_strdup(line));
+    stats_alloc(STATS_MEM_INPUT_HISTORY, strlen(line) + 1);
+    if (history->trigrams) {
+        _index_line(history, history->lines->len - 1);
+    }
+
+    if (history->file) {
+        fputs(line, history->file);
+        fputc('\n', history->file);
+        watchdog_tag(WATCHDOG_DISK);
+        fflush(history->file);
+    }
+}
+
+int
+input_history_size(InputHistory history)
+{
+    return history->lines->len;
+}
+
+const char*
+input_history_get(InputHistory history, int line)
+{
+    if (line < 0 || line >= history->lines->len) {
+        return NULL;
+    }
+
+    return g_ptr_array_index(history->lines, line);
+}
+
+int
+input_history_search(InputHistory history, const char *const query, int before)
+{
+    if (before > history->lines->len || before < 0) {
+        before = history->lines->len;
+    }
+
+    size_t query_len = strlen(query);
+    if (query_len < 3) {
+        int i;
+        for (i = before - 1; i >= 0; i--) {
+            if (strstr(g_ptr_array_index(history->lines, i), query)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    if (history->trigrams == NULL) {
+        history->trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_postings_free);
+        int i;
+        for (i = 0; i < history->lines->len; i++) {
+            _index_line(history, i);
+        }
+    }
+
+    // only lines containing the rarest trigram of the query need checking
+    GArray *shortest = NULL;
+    size_t i;
+    for (i = 0; i + 3 <= query_len; i++) {
+        GArray *postings = g_hash_table_lookup(history->trigrams, GUINT_TO_POINTER(_trigram(&query[i])));
+        if (postings == NULL) {
+            return -1;
+        }
+        if (shortest == NULL || postings->len < shortest->len) {
+            shortest = postings;
+        }
+    }
+
+    int pos;
+    for (pos = shortest->len - 1; pos >= 0; pos--) {
+        int line = g_array_index(shortest, int, pos);
+        if (line < before && strstr(g_ptr_array_index(history->lines, line), query)) {
+            return line;
+        }
+    }
+
+    return -1;
+}
+
+static gboolean
+_command_matches(const char *const line, const char *const command)
+{
+    size_t len = strlen(command);
+    return strncmp(line, command, len) == 0 && (line[len] == '\0' || line[len] == ' ');
+}
+
+static gboolean
+_line_private(const char *const line)
+{
+    if (line[0] != '/') {
+        return FALSE;
+    }
+
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(private_commands); i++) {
+        if (_command_matches(line, private_commands[i])) {
+            return TRUE;
+        }
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(password_commands); i++) {
+        if (_command_matches(line, password_commands[i])) {
+            int j;
+            for (j = 0; j < G_N_ELEMENTS(password_options); j++) {
+                if (strstr(line, password_options[j])) {
+                    return TRUE;
+                }
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+// only readable by the user, also when the file was made by an older
+// version
+static FILE*
+_history_file(const char *const path)
+{
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return NULL;
+    }
+    fchmod(fd, S_IRUSR | S_IWUSR);
+
+    FILE *file = fdopen(fd, "a");
+    if (file == NULL) {
+        close(fd);
+    }
+
+    return file;
+}
+
+static void
+_index_line(InputHistory history, int line)
+{
+    const char *text = g_ptr_array_index(history->lines, line);
+    size_t len = strlen(text);
+    size_t i;
+    for (i = 0; i + 3 <= len; i++) {
+        gpointer key = GUINT_TO_POINTER(_trigram(&text[i]));
+        GArray *postings = g_hash_table_lookup(history->trigrams, key);
+        if (postings == NULL) {
+            postings = g_array_new(FALSE, FALSE, sizeof(int));
+            g_hash_table_insert(history->trigrams, key, postings);
+        }
+        // lines are indexed in order, so a repeat can only be the last entry
+        if (postings->len == 0 || g_array_index(postings, int, postings->len - 1) != line) {
+            g_array_append_val(postings, line);
+        }
+    }
+}
+
+static guint32
+_trigram(const char *const str)
+{
+    const guchar *bytes = (const guchar *)str;
+    return ((guint32)bytes[0] << 16) | ((guint32)bytes[1] << 8) | bytes[2];
+}
+
+static void
+_line_free(gpointer line)
+{
+    stats_free(STATS_MEM_INPUT_HISTORY, strlen(line) + 1);
+    g_free(line);
+}
+
+static void
+_postings_free(GArray *postings)
+{
+    g_array_free(postings, TRUE);
+}
@@ -0,0 +1,58 @@
+/*
+ * input_history.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef INPUT_HISTORY_H
+#define INPUT_HISTORY_H
+
+#include <glib.h>
+
+typedef struct input_history_t *InputHistory;
+
+// load the lines stored at path, new lines are appended to it, a NULL
+// path keeps the history in memory only
+InputHistory input_history_open(const char *const path);
+void input_history_close(InputHistory history);
+
+// empty lines, repeats and commands carrying a password or secret are
+// not kept
+void input_history_add(InputHistory history, const char *const line);
+int input_history_size(InputHistory history);
+const char* input_history_get(InputHistory history, int line);
+
+// the newest line before line number before containing query, or -1,
+// a before of -1 searches the whole history
+int input_history_search(InputHistory history, const char *const query, int before);
+
+#endif
@@ -0,0 +1,647 @@
+/*
+ * ipc.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "log.h"
+#include "profanity.h"
+#include "window_list.h"
+#include "command/command.h"
+#include "tools/ipc.h"
+
+#define IPC_BACKLOG 8
+
+// a client sending a longer line without a newline is dropped
+#define IPC_LINE_MAX 65536
+
+// a client reading events slower than they are written is dropped once
+// this much is waiting for it
+#define IPC_PENDING_MAX (4 * 1024 * 1024)
+
+// one connection to the socket, lines are read into in and events are
+// queued on out until the socket takes them
+typedef struct ipc_client_t {
+    int fd;
+    GString *in;
+    GString *out;
+    int events;
+    gboolean closed;
+} IpcClient;
+
+typedef struct ipc_event_name_t {
+    const char *name;
+    int events;
+} IpcEventName;
+
+static const IpcEventName event_names[] = {
+    { "message", IPC_MESSAGE },
+    { "presence", IPC_PRESENCE },
+    { "muc", IPC_MUC },
+    // what the user types, only given to those asking for it by name
+    { "input", IPC_INPUT },
+    // the body of encrypted messages, also only given when asked for
+    { "decrypted", IPC_DECRYPTED },
+    { "all", IPC_MESSAGE | IPC_PRESENCE | IPC_MUC },
+    { "none", 0 },
+};
+
+static int listen_fd = -1;
+static char *socket_path = NULL;
+static GSList *clients = NULL;
+
+// in-process listeners, such as plugins, given events without a socket
+typedef struct ipc_listener_t {
+    int types;
+    IpcListener func;
+    gpointer data;
+    gboolean removed;
+} IpcListenerEntry;
+
+static GSList *listeners = NULL;
+
+// listeners removed while events are given out are only marked, and
+// dropped from the list once the outermost ipc_emit is done with it
+static int emitting = 0;
+
+// every event some client has asked for, and every event some listener
+// has, checked before building any
+static int wanted = 0;
+static int listened = 0;
+
+static gboolean _ipc_nonblocking(int fd);
+static void _ipc_accept(void);
+static void _ipc_read(IpcClient *client);
+static void _ipc_write(IpcClient *client);
+static void _ipc_line(IpcClient *client, char *line);
+static void _ipc_events(IpcClient *client, const char *const line, const char *const names);
+static void _ipc_reply(IpcClient *client, const char *const name, ...);
+static void _ipc_append_event(GString *out, const char *const name, const char *const *keys,
+    const char *const *values, int count);
+static void _ipc_append_string(GString *out, const char *const str);
+static void _ipc_client_free(IpcClient *client);
+static void _ipc_wanted_update(void);
+static void _ipc_listeners_prune(void);
+
+// listen on a Unix socket at path, only the user may connect to it
+gboolean
+ipc_open(const char *const path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("IPC socket path too long: %s", path);
+        return FALSE;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_error("Could not create IPC socket: %s", strerror(errno));
+        return FALSE;
+    }
+
+    // a socket left by a profanity that did not shut down is replaced, one
+    // still being listened on is not
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            log_error("IPC socket already in use: %s", path);
+            close(fd);
+            return FALSE;
+        }
+        unlink(path);
+    }
+
+    mode_t mask = umask(0177);
+    int res = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (res < 0 || listen(fd, IPC_BACKLOG) < 0 || !_ipc_nonblocking(fd)) {
+        log_error("Could not listen on IPC socket %s: %s", path, strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    listen_fd = fd;
+    socket_path = strdup(path);
+    log_info("Listening on IPC socket %s", path);
+
+    return TRUE;
+}
+
+void
+ipc_close(void)
+{
+    g_slist_free_full(clients, (GDestroyNotify)_ipc_client_free);
+    clients = NULL;
+    wanted = 0;
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (socket_path) {
+        unlink(socket_path);
+        free(socket_path);
+        socket_path = NULL;
+    }
+}
+
+// add the sockets to wait on for connections and input
+void
+ipc_fds(fd_set *fds)
+{
+    if (listen_fd < 0) {
+        return;
+    }
+
+    FD_SET(listen_fd, fds);
+    GSList *curr = clients;
+    while (curr) {
+        IpcClient *client = curr->data;
+        FD_SET(client->fd, fds);
+        curr = g_slist_next(curr);
+    }
+}
+
+// whether events are waiting for a client to take them
+gboolean
+ipc_pending(void)
+{
+    GSList *curr = clients;
+    while (curr) {
+        IpcClient *client = curr->data;
+        if (client->out->len > 0) {
+            return TRUE;
+        }
+        curr = g_slist_next(curr);
+    }
+
+    return FALSE;
+}
+
+// accept connections, run the lines clients have sent and write queued
+// events, without blocking, run from the main loop
+void
+ipc_process(void)
+{
+    if (listen_fd < 0) {
+        return;
+    }
+
+    _ipc_accept();
+
+    // a line may emit events to any client, clients are only removed below
+    GSList *curr = clients;
+    while (curr) {
+        _ipc_read(curr->data);
+        curr = g_slist_next(curr);
+    }
+
+    curr = clients;
+    while (curr) {
+        IpcClient *client = curr->data;
+        GSList *next = g_slist_next(curr);
+        _ipc_write(client);
+        if (client->closed) {
+            clients = g_slist_delete_link(clients, curr);
+            _ipc_client_free(client);
+            _ipc_wanted_update();
+        }
+        curr = next;
+    }
+}
+
+void
+ipc_emit(ipc_event_t type, const char *const name, ...)
+{
+    if (((wanted | listened) & type) == 0) {
+        return;
+    }
+
+    GPtrArray *keys = g_ptr_array_new();
+    GPtrArray *values = g_ptr_array_new();
+    gboolean encrypted = FALSE;
+    va_list pairs;
+    va_start(pairs, name);
+    const char *key = NULL;
+    while ((key = va_arg(pairs, const char*))) {
+        const char *value = va_arg(pairs, const char*);
+        if (value && g_strcmp0(key, "encryption") == 0) {
+            encrypted = TRUE;
+        }
+        g_ptr_array_add(keys, (gpointer)key);
+        g_ptr_array_add(values, (gpointer)value);
+    }
+    va_end(pairs);
+
+    // the same pairs with the body of an encrypted message left out, for
+    // those not asking for it
+    GPtrArray *withheld = g_ptr_array_new();
+    guint i;
+    for (i = 0; i < keys->len; i++) {
+        gboolean body = encrypted && g_strcmp0(g_ptr_array_index(keys, i), "body") == 0;
+        g_ptr_array_add(withheld, body ? NULL : g_ptr_array_index(values, i));
+    }
+
+    emitting++;
+    GSList *curr = listeners;
+    while (curr) {
+        IpcListenerEntry *listener = curr->data;
+        if (!listener->removed && (listener->types & type)) {
+            if (encrypted && (listener->types & IPC_DECRYPTED)) {
+                listener->func(type | IPC_DECRYPTED, name, (const char *const *)keys->pdata,
+                    (const char *const *)values->pdata, keys->len, listener->data);
+            } else {
+                listener->func(type, name, (const char *const *)keys->pdata, (const char *const *)withheld->pdata,
+                    keys->len, listener->data);
+            }
+        }
+        curr = g_slist_next(curr);
+    }
+    if (--emitting == 0) {
+        _ipc_listeners_prune();
+    }
+
+    GString *event = NULL;
+    GString *decrypted = NULL;
+    curr = clients;
+    while (curr) {
+        IpcClient *client = curr->data;
+        if (client->events & type) {
+            if (encrypted && (client->events & IPC_DECRYPTED)) {
+                if (decrypted == NULL) {
+                    decrypted = g_string_new("");
+                    _ipc_append_event(decrypted, name, (const char *const *)keys->pdata,
+                        (const char *const *)values->pdata, keys->len);
+                }
+                g_string_append_len(client->out, decrypted->str, decrypted->len);
+            } else {
+                if (event == NULL) {
+                    event = g_string_new("");
+                    _ipc_append_event(event, name, (const char *const *)keys->pdata,
+                        (const char *const *)withheld->pdata, keys->len);
+                }
+                g_string_append_len(client->out, event->str, event->len);
+            }
+        }
+        curr = g_slist_next(curr);
+    }
+
+    if (event) {
+        g_string_free(event, TRUE);
+    }
+    if (decrypted) {
+        g_string_free(decrypted, TRUE);
+    }
+    g_ptr_array_free(withheld, TRUE);
+    g_ptr_array_free(keys, TRUE);
+    g_ptr_array_free(values, TRUE);
+}
+
+void
+ipc_listen(int types, IpcListener listener, gpointer data)
+{
+    IpcListenerEntry *entry = malloc(sizeof(IpcListenerEntry));
+    entry->types = types;
+    entry->func = listener;
+    entry->data = data;
+    entry->removed = FALSE;
+    listeners = g_slist_append(listeners, entry);
+    listened |= types;
+}
+
+void
+ipc_unlisten(IpcListener listener, gpointer data)
+{
+    listened = 0;
+    GSList *curr = listeners;
+    while (curr) {
+        GSList *next = g_slist_next(curr);
+        IpcListenerEntry *entry = curr->data;
+        if (entry->func == listener && entry->data == data) {
+            entry->removed = TRUE;
+        } else if (!entry->removed) {
+            listened |= entry->types;
+        }
+        curr = next;
+    }
+
+    if (emitting == 0) {
+        _ipc_listeners_prune();
+    }
+}
+
+static void
+_ipc_listeners_prune(void)
+{
+    GSList *curr = listeners;
+    while (curr) {
+        GSList *next = g_slist_next(curr);
+        IpcListenerEntry *entry = curr->data;
+        if (entry->removed) {
+            listeners = g_slist_delete_link(listeners, curr);
+            free(entry);
+        }
+        curr = next;
+    }
+}
+
+static gboolean
+_ipc_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void
+_ipc_accept(void)
+{
+    while (TRUE) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_error("IPC accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        if (!_ipc_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+
+        IpcClient *client = malloc(sizeof(IpcClient));
+        client->fd = fd;
+        client->in = g_string_new("");
+        client->out = g_string_new("");
+        client->events = 0;
+        client->closed = FALSE;
+        clients = g_slist_append(clients, client);
+        log_debug("IPC client connected");
+    }
+}
+
+static void
+_ipc_read(IpcClient *client)
+{
+    char buf[4096];
+    while (!client->closed) {
+        ssize_t len = read(client->fd, buf, sizeof(buf));
+        if (len > 0) {
+            g_string_append_len(client->in, buf, len);
+        } else if (len == 0) {
+            client->closed = TRUE;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client->closed = TRUE;
+            }
+            break;
+        }
+    }
+
+    // one pass over the buffer, not moving the rest down for each line
+    gsize start = 0;
+    char *newline = NULL;
+    while ((newline = memchr(client->in->str + start, '\n', client->in->len - start))) {
+        *newline = '\0';
+        char *line = client->in->str + start;
+        if (newline > line && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        start = newline - client->in->str + 1;
+        _ipc_line(client, line);
+    }
+    g_string_erase(client->in, 0, start);
+
+    if (client->in->len > IPC_LINE_MAX) {
+        log_warning("IPC client sent a line longer than %d bytes, disconnecting", IPC_LINE_MAX);
+        client->closed = TRUE;
+    }
+}
+
+static void
+_ipc_write(IpcClient *client)
+{
+    while (!client->closed && client->out->len > 0) {
+        ssize_t len = send(client->fd, client->out->str, client->out->len, MSG_NOSIGNAL);
+        if (len > 0) {
+            g_string_erase(client->out, 0, len);
+        } else if (len < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                client->closed = TRUE;
+            }
+            break;
+        }
+    }
+
+    if (client->out->len > IPC_PENDING_MAX) {
+        log_warning("IPC client not reading events, disconnecting");
+        client->closed = TRUE;
+    }
+}
+
+// lines starting with ! are requests to the socket, anything else is
+// handled as if typed in the current window
+static void
+_ipc_line(IpcClient *client, char *line)
+{
+    if (line[0] == '\0') {
+        return;
+    }
+
+    if (line[0] == '!') {
+        if (g_str_has_prefix(line, "!events") && (line[7] == '\0' || line[7] == ' ')) {
+            _ipc_events(client, line, line + 7);
+        } else {
+            _ipc_reply(client, "error", "input", line, "error", "Unknown request", NULL);
+        }
+        return;
+    }
+
+    char *input = strdup(line);
+    ProfWin *window = wins_get_current();
+    if (!cmd_process_input(window, input)) {
+        prof_set_quit();
+    }
+    _ipc_reply(client, "done", "input", line, NULL);
+    free(input);
+}
+
+// "!events message muc" replaces the events sent to the client, no
+// names stops them
+static void
+_ipc_events(IpcClient *client, const char *const line, const char *const names)
+{
+    int events = 0;
+    gchar **split = g_strsplit(names, " ", 0);
+    int i;
+    for (i = 0; split[i]; i++) {
+        if (split[i][0] == '\0') {
+            continue;
+        }
+        int j;
+        for (j = 0; j < G_N_ELEMENTS(event_names); j++) {
+            if (g_strcmp0(split[i], event_names[j].name) == 0) {
+                events |= event_names[j].events;
+                break;
+            }
+        }
+        if (j == G_N_ELEMENTS(event_names)) {
+            _ipc_reply(client, "error", "input", line, "error", "Unknown event", NULL);
+            g_strfreev(split);
+            return;
+        }
+    }
+    g_strfreev(split);
+
+    client->events = events;
+    _ipc_wanted_update();
+    _ipc_reply(client, "done", "input", line, NULL);
+}
+
+static void
+_ipc_reply(IpcClient *client, const char *const name, ...)
+{
+    GPtrArray *keys = g_ptr_array_new();
+    GPtrArray *values = g_ptr_array_new();
+    va_list pairs;
+    va_start(pairs, name);
+    const char *key = NULL;
+    while ((key = va_arg(pairs, const char*))) {
+        g_ptr_array_add(keys, (gpointer)key);
+        g_ptr_array_add(values, va_arg(pairs, char*));
+    }
+    va_end(pairs);
+
+    _ipc_append_event(client->out, name, (const char *const *)keys->pdata, (const char *const *)values->pdata,
+        keys->len);
+    g_ptr_array_free(keys, TRUE);
+    g_ptr_array_free(values, TRUE);
+}
+
+// one JSON object on its own line
+static void
+_ipc_append_event(GString *out, const char *const name, const char *const *keys, const char *const *values,
+    int count)
+{
+    g_string_append(out, "{\"event\":");
+    _ipc_append_string(out, name);
+
+    int i;
+    for (i = 0; i < count; i++) {
+        const char *value = values[i];
+        g_string_append_c(out, ',');
+        _ipc_append_string(out, keys[i]);
+        g_string_append_c(out, ':');
+        if (value) {
+            _ipc_append_string(out, value);
+        } else {
+            g_string_append(out, "null");
+        }
+    }
+    g_string_append(out, "}\n");
+}
+
+// text is UTF-8 already, only quotes, backslashes and control characters
+// need escaping
+static void
+_ipc_append_string(GString *out, const char *const str)
+{
+    g_string_append_c(out, '"');
+    const unsigned char *curr = (const unsigned char*)str;
+    while (*curr) {
+        switch (*curr) {
+            case '"':
+                g_string_append(out, "\\\"");
+                break;
+            case '\\':
+                g_string_append(out, "\\\\");
+                break;
+            case '\n':
+                g_string_append(out, "\\n");
+                break;
+            case '\r':
+                g_string_append(out, "\\r");
+                break;
+            case '\t':
+                g_string_append(out, "\\t");
+                break;
+            default:
+                if (*curr < 0x20) {
+                    g_string_append_printf(out, "\\u%04x", *curr);
+                } else {
+                    g_string_append_c(out, *curr);
+                }
+                break;
+        }
+        curr++;
+    }
+    g_string_append_c(out, '"');
+}
+
+static void
+_ipc_client_free(IpcClient *client)
+{
+    close(client->fd);
+    g_string_free(client->in, TRUE);
+    g_string_free(client->out, TRUE);
+    free(client);
+}
+
+static void
+_ipc_wanted_update(void)
+{
+    wanted = 0;
+    GSList *curr = clients;
+    while (curr) {
+        IpcClient *client = curr->data;
+        wanted |= client->events;
+        curr = g_slist_next(curr);
+    }
+}
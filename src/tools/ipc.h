@@ -0,0 +1,74 @@
+/*
+ * ipc.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef IPC_H
+#define IPC_H
+
+#include <sys/select.h>
+
+#include <glib.h>
+
+// the events a client can ask for with "!events"
+typedef enum {
+    IPC_MESSAGE = 1 << 0,
+    IPC_PRESENCE = 1 << 1,
+    IPC_MUC = 1 << 2,
+    IPC_INPUT = 1 << 3,
+    // not an event, asks for the body of messages that arrived or are
+    // sent encrypted, without it the body of those is null
+    IPC_DECRYPTED = 1 << 4,
+} ipc_event_t;
+
+// given each event of the types listened for as it is emitted, keys and
+// values hold count pairs, a value may be NULL, type has IPC_DECRYPTED set
+// when the body of an encrypted message is given
+typedef void (*IpcListener)(ipc_event_t type, const char *const name, const char *const *keys,
+    const char *const *values, int count, gpointer data);
+
+gboolean ipc_open(const char *const path);
+void ipc_close(void);
+void ipc_fds(fd_set *fds);
+gboolean ipc_pending(void);
+void ipc_process(void);
+
+// name is the event, followed by key and value pairs ending with a NULL
+// key, a NULL value is written as null, an "encryption" key with a value
+// marks the body as only for those asking for IPC_DECRYPTED
+void ipc_emit(ipc_event_t type, const char *const name, ...);
+
+void ipc_listen(int types, IpcListener listener, gpointer data);
+void ipc_unlisten(IpcListener listener, gpointer data);
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * log_export.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "common.h"
+#include "tools/binlog.h"
+#include "tools/log_export.h"
+#include "tools/log_retention.h"
+
+// one day file, read by a worker thread into its own list of messages
+typedef struct export_file_t {
+    gchar *path;
+    gchar *account;
+    gchar *contact;
+    GDateTime *day;
+    gboolean binary;
+    gboolean archived;
+    guint order;
+    GSList *entries;
+} ExportFile;
+
+// a message with where it came from, for the merge
+typedef struct export_line_t {
+    ExportFile *file;
+    guint pos;
+    BinlogEntry *entry;
+} ExportLine;
+
+static GPtrArray* _export_files(const char *const dir, const LogExport *const export);
+static void _export_contact_dir(GPtrArray *files, const char *const path, const char *const account,
+    const char *const contact, const LogExport *const export);
+static gchar* _export_jid(const char *const dir_name);
+static gboolean _export_day_file(const char *const name, int *day, gboolean *binary, gboolean *archived);
+static void _export_read(ExportFile *file, const LogExport *const export);
+static GSList* _export_read_text(const char *const data, gsize len, GDateTime *day, const char *const contact);
+static gint _export_line_cmp(gconstpointer a, gconstpointer b);
+static void _export_write(FILE *out, const ExportLine *const line);
+static void _export_file_free(ExportFile *file);
+
+int
+log_export_run(const char *const dir, const LogExport *const export, FILE *out)
+{
+    GPtrArray *files = _export_files(dir, export);
+    if (files == NULL) {
+        return -1;
+    }
+
+    // each file is read and filtered by its own task
+    int threads = export->threads > 0 ? export->threads : (int)g_get_num_processors();
+    GThreadPool *pool = g_thread_pool_new((GFunc)_export_read, (gpointer)export, threads, TRUE, NULL);
+    guint i;
+    for (i = 0; i < files->len; i++) {
+        g_thread_pool_push(pool, g_ptr_array_index(files, i), NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    // every file is already in time order, ties between files keep the
+    // order the files were found in
+    GArray *lines = g_array_new(FALSE, FALSE, sizeof(ExportLine));
+    for (i = 0; i < files->len; i++) {
+        ExportFile *file = g_ptr_array_index(files, i);
+        guint pos = 0;
+        GSList *curr = file->entries;
+        while (curr) {
+            ExportLine line = { file, pos++, curr->data };
+            g_array_append_val(lines, line);
+            curr = g_slist_next(curr);
+        }
+    }
+    g_array_sort(lines, _export_line_cmp);
+
+    for (i = 0; i < lines->len; i++) {
+        _export_write(out, &g_array_index(lines, ExportLine, i));
+    }
+    int written = lines->len;
+
+    g_array_free(lines, TRUE);
+    g_ptr_array_free(files, TRUE);
+
+    return written;
+}
+
+int
+log_export_parse_day(const char *const date)
+{
+    int year, month, day;
+    char end;
+    if (date == NULL || sscanf(date, "%4d-%2d-%2d%c", &year, &month, &day, &end) != 3) {
+        return 0;
+    }
+    if (!g_date_valid_dmy(day, month, year)) {
+        return 0;
+    }
+
+    return year * 10000 + month * 100 + day;
+}
+
+// the day files under dir/<account>/<contact> and dir/<account>/rooms/<room>
+// that pass the account, contact and date filters, in name order
+static GPtrArray*
+_export_files(const char *const dir, const LogExport *const export)
+{
+    GDir *accounts = g_dir_open(dir, 0, NULL);
+    if (accounts == NULL) {
+        return NULL;
+    }
+
+    GPtrArray *files = g_ptr_array_new_with_free_func((GDestroyNotify)_export_file_free);
+    GSList *account_names = NULL;
+    const gchar *name;
+    while ((name = g_dir_read_name(accounts)) != NULL) {
+        account_names = g_slist_insert_sorted(account_names, g_strdup(name), (GCompareFunc)g_strcmp0);
+    }
+    g_dir_close(accounts);
+
+    GSList *curr = account_names;
+    while (curr) {
+        gchar *account = _export_jid(curr->data);
+        if (export->account == NULL || g_strcmp0(account, export->account) == 0) {
+            gchar *account_path = g_strdup_printf("%s/%s", dir, (char*)curr->data);
+            _export_contact_dir(files, account_path, account, NULL, export);
+            g_free(account_path);
+        }
+        g_free(account);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(account_names, g_free);
+
+    guint i;
+    for (i = 0; i < files->len; i++) {
+        ExportFile *file = g_ptr_array_index(files, i);
+        file->order = i;
+    }
+
+    return files;
+}
+
+// with no contact, path is an account or rooms directory holding one
+// directory per contact, otherwise it holds the contact's day files
+static void
+_export_contact_dir(GPtrArray *files, const char *const path, const char *const account,
+    const char *const contact, const LogExport *const export)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir == NULL) {
+        return;
+    }
+
+    GSList *names = NULL;
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        names = g_slist_insert_sorted(names, g_strdup(name), (GCompareFunc)g_strcmp0);
+    }
+    g_dir_close(dir);
+
+    GSList *curr = names;
+    while (curr) {
+        gchar *child = g_strdup_printf("%s/%s", path, (char*)curr->data);
+        if (contact == NULL) {
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+                if (g_strcmp0(curr->data, "rooms") == 0) {
+                    _export_contact_dir(files, child, account, NULL, export);
+                } else {
+                    gchar *jid = _export_jid(curr->data);
+                    if (export->contact == NULL || g_strcmp0(jid, export->contact) == 0) {
+                        _export_contact_dir(files, child, account, jid, export);
+                    }
+                    g_free(jid);
+                }
+            }
+        } else {
+            int day = 0;
+            gboolean binary = FALSE;
+            gboolean archived = FALSE;
+            if (_export_day_file(curr->data, &day, &binary, &archived) &&
+                    (export->from_day == 0 || day >= export->from_day) &&
+                    (export->to_day == 0 || day <= export->to_day)) {
+                ExportFile *file = malloc(sizeof(ExportFile));
+                file->path = child;
+                child = NULL;
+                file->account = g_strdup(account);
+                file->contact = g_strdup(contact);
+                file->day = g_date_time_new_local(day / 10000, day / 100 % 100, day % 100, 0, 0, 0);
+                file->binary = binary;
+                file->archived = archived;
+                file->order = 0;
+                file->entries = NULL;
+                g_ptr_array_add(files, file);
+            }
+        }
+        g_free(child);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(names, g_free);
+}
+
+static gchar*
+_export_jid(const char *const dir_name)
+{
+    return str_replace(dir_name, "_at_", "@");
+}
+
+// YYYY_MM_DD then an optional part number, and .log, .log.gz or .plog
+static gboolean
+_export_day_file(const char *const name, int *day, gboolean *binary, gboolean *archived)
+{
+    int year, month, day_of_month;
+    int len = 0;
+    if (sscanf(name, "%4d_%2d_%2d%n", &year, &month, &day_of_month, &len) != 3 || len != 10 ||
+            !g_date_valid_dmy(day_of_month, month, year)) {
+        return FALSE;
+    }
+
+    const char *ext = name + len;
+    if (ext[0] == '.' && g_ascii_isdigit(ext[1])) {
+        ext++;
+        while (g_ascii_isdigit(*ext)) {
+            ext++;
+        }
+    }
+
+    *day = year * 10000 + month * 100 + day_of_month;
+    *binary = g_strcmp0(ext, ".plog") == 0;
+    *archived = g_strcmp0(ext, ".log.gz") == 0;
+
+    return *binary || *archived || g_strcmp0(ext, ".log") == 0;
+}
+
+// runs on a worker thread, only touching its own file
+static void
+_export_read(ExportFile *file, const LogExport *const export)
+{
+    GSList *entries = NULL;
+    if (file->binary) {
+        entries = binlog_read_file(file->path);
+    } else if (file->archived) {
+        gchar *filename = g_strndup(file->path, strlen(file->path) - strlen(".gz"));
+        gsize len = 0;
+        gchar *contents = log_archive_read(filename, &len);
+        if (contents) {
+            entries = _export_read_text(contents, len, file->day, file->contact);
+            g_free(contents);
+        }
+        g_free(filename);
+    } else {
+        GMappedFile *map = g_mapped_file_new(file->path, FALSE, NULL);
+        if (map) {
+            entries = _export_read_text(g_mapped_file_get_contents(map), g_mapped_file_get_length(map),
+                file->day, file->contact);
+            g_mapped_file_unref(map);
+        }
+    }
+
+    GSList *matched = NULL;
+    GSList *curr = entries;
+    while (curr) {
+        BinlogEntry *entry = curr->data;
+        if (entry->type == BINLOG_MESSAGE && entry->message &&
+                (export->regex == NULL || g_regex_match(export->regex, entry->message, 0, NULL))) {
+            matched = g_slist_prepend(matched, entry);
+        } else {
+            binlog_entry_free(entry);
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(entries);
+
+    file->entries = g_slist_reverse(matched);
+}
+
+// the messages in a text log, lines that do not start with a time
+// continue the message before them
+static GSList*
+_export_read_text(const char *const data, gsize len, GDateTime *day, const char *const contact)
+{
+    GSList *entries = NULL;
+    gsize pos = 0;
+    while (pos < len) {
+        const char *start = data + pos;
+        const char *end = memchr(start, '\n', len - pos);
+        gsize line_len = end ? (gsize)(end - start) : len - pos;
+        pos += line_len + 1;
+        if (line_len > 0 && start[line_len - 1] == '\r') {
+            line_len--;
+        }
+
+        gchar *line = g_strndup(start, line_len);
+        BinlogEntry *entry = binlog_parse_text_line(line, day, contact);
+        if (entry) {
+            entries = g_slist_prepend(entries, entry);
+        } else if (entries && line_len > 0) {
+            BinlogEntry *last = entries->data;
+            char *message = malloc(strlen(last->message) + line_len + 2);
+            sprintf(message, "%s\n%s", last->message, line);
+            free(last->message);
+            last->message = message;
+        }
+        g_free(line);
+    }
+
+    return g_slist_reverse(entries);
+}
+
+static gint
+_export_line_cmp(gconstpointer a, gconstpointer b)
+{
+    const ExportLine *line_a = a;
+    const ExportLine *line_b = b;
+
+    if (line_a->entry->timestamp != line_b->entry->timestamp) {
+        return line_a->entry->timestamp < line_b->entry->timestamp ? -1 : 1;
+    }
+    if (line_a->file->order != line_b->file->order) {
+        return line_a->file->order < line_b->file->order ? -1 : 1;
+    }
+
+    return line_a->pos < line_b->pos ? -1 : line_a->pos > line_b->pos;
+}
+
+// time, account, contact, sender and message, with tabs, newlines and
+// backslashes in the message escaped
+static void
+_export_write(FILE *out, const ExportLine *const line)
+{
+    GDateTime *time = g_date_time_new_from_unix_local(line->entry->timestamp / G_USEC_PER_SEC);
+    gchar *time_str = g_date_time_format(time, "%Y-%m-%d %H:%M:%S");
+    g_date_time_unref(time);
+
+    GString *message = g_string_new(NULL);
+    const char *curr = line->entry->message;
+    while (*curr) {
+        switch (*curr) {
+            case '\\':
+                g_string_append(message, "\\\\");
+                break;
+            case '\n':
+                g_string_append(message, "\\n");
+                break;
+            case '\t':
+                g_string_append(message, "\\t");
+                break;
+            default:
+                g_string_append_c(message, *curr);
+                break;
+        }
+        curr++;
+    }
+
+    fprintf(out, "%s\t%s\t%s\t%s\t%s\n", time_str, line->file->account, line->file->contact,
+        line->entry->from ? line->entry->from : "", message->str);
+
+    g_string_free(message, TRUE);
+    g_free(time_str);
+}
+
+static void
+_export_file_free(ExportFile *file)
+{
+    g_free(file->path);
+    g_free(file->account);
+    g_free(file->contact);
+    g_date_time_unref(file->day);
+    g_slist_free_full(file->entries, (GDestroyNotify)binlog_entry_free);
+    free(file);
+}
@@ -0,0 +1,63 @@
+/*
+ * log_export.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef LOG_EXPORT_H
+#define LOG_EXPORT_H
+
+#include <stdio.h>
+#include <glib.h>
+
+// which logged messages to export, a NULL or 0 field matches everything
+typedef struct log_export_t {
+    const char *account;
+    const char *contact;
+    // inclusive days as YYYYMMDD
+    int from_day;
+    int to_day;
+    // matched against the message text
+    GRegex *regex;
+    // files read at once, 0 for one per processor
+    int threads;
+} LogExport;
+
+// write every matching message in the chat logs under dir to out, one
+// tab separated line each, oldest first. Returns the number of messages
+// written or -1 if dir cannot be read.
+int log_export_run(const char *const dir, const LogExport *const export, FILE *out);
+
+// a YYYY-MM-DD date as YYYYMMDD, 0 if it is not a valid date
+int log_export_parse_day(const char *const date);
+
+#endif
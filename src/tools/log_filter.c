@@ -0,0 +1,197 @@
+/*
+ * log_filter.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "log.h"
+#include "tools/log_filter.h"
+
+// the token bucket holds at most a second's worth of records
+struct log_filter_t {
+    gboolean has_level;
+    log_level_t level;
+    int rate;
+    int sample;
+    gdouble tokens;
+    gint64 refilled;
+    guint64 seen;
+    guint64 suppressed;
+    guint64 dropped;
+};
+
+static const char *const level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+LogFilter
+log_filter_new(void)
+{
+    return calloc(1, sizeof(struct log_filter_t));
+}
+
+void
+log_filter_free(LogFilter filter)
+{
+    free(filter);
+}
+
+LogFilter
+log_filter_parse(const char *const spec, gint64 now)
+{
+    LogFilter filter = log_filter_new();
+
+    gchar **settings = g_strsplit(spec, " ", -1);
+    int i;
+    for (i = 0; settings[i] != NULL; i++) {
+        gchar **pair = g_strsplit(settings[i], "=", 2);
+        if (pair[0] && pair[1]) {
+            log_filter_set(filter, pair[0], pair[1], now);
+        }
+        g_strfreev(pair);
+    }
+    g_strfreev(settings);
+
+    return filter;
+}
+
+gchar*
+log_filter_spec(LogFilter filter)
+{
+    GString *spec = g_string_new("");
+    if (filter->has_level) {
+        g_string_append_printf(spec, "level=%s", level_names[filter->level]);
+    }
+    if (filter->rate > 0) {
+        g_string_append_printf(spec, "%srate=%d", spec->len ? " " : "", filter->rate);
+    }
+    if (filter->sample > 1) {
+        g_string_append_printf(spec, "%ssample=%d", spec->len ? " " : "", filter->sample);
+    }
+
+    return g_string_free(spec, FALSE);
+}
+
+gboolean
+log_filter_set(LogFilter filter, const char *const setting, const char *const value, gint64 now)
+{
+    if (strcmp(setting, "level") == 0) {
+        int i;
+        for (i = 0; i < G_N_ELEMENTS(level_names); i++) {
+            if (g_strcmp0(value, level_names[i]) == 0) {
+                filter->has_level = TRUE;
+                filter->level = i;
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+
+    if (strcmp(setting, "rate") == 0 || strcmp(setting, "sample") == 0) {
+        char *end = NULL;
+        long number = value ? strtol(value, &end, 10) : -1;
+        if (end == value || (end && *end != '\0') || number < 0 || number > G_MAXINT) {
+            return FALSE;
+        }
+        if (setting[0] == 'r') {
+            filter->rate = number;
+            filter->tokens = number;
+            filter->refilled = now;
+        } else {
+            filter->sample = number;
+            filter->seen = 0;
+        }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+gboolean
+log_filter_enabled(LogFilter filter, log_level_t level, log_level_t filter_level)
+{
+    if (filter && filter->has_level) {
+        return level >= filter->level;
+    }
+
+    return level >= filter_level;
+}
+
+gboolean
+log_filter_admit(LogFilter filter, log_level_t level, gint64 now)
+{
+    if (level >= PROF_LEVEL_WARN) {
+        return TRUE;
+    }
+
+    filter->seen++;
+    if (filter->sample > 1 && (filter->seen - 1) % filter->sample != 0) {
+        filter->dropped++;
+        filter->suppressed++;
+        return FALSE;
+    }
+
+    if (filter->rate > 0) {
+        filter->tokens += (gdouble)(now - filter->refilled) * filter->rate / G_USEC_PER_SEC;
+        if (filter->tokens > filter->rate) {
+            filter->tokens = filter->rate;
+        }
+        filter->refilled = now;
+
+        if (filter->tokens < 1) {
+            filter->dropped++;
+            filter->suppressed++;
+            return FALSE;
+        }
+        filter->tokens -= 1;
+    }
+
+    return TRUE;
+}
+
+guint64
+log_filter_take_suppressed(LogFilter filter)
+{
+    guint64 suppressed = filter->suppressed;
+    filter->suppressed = 0;
+
+    return suppressed;
+}
+
+guint64
+log_filter_dropped(LogFilter filter)
+{
+    return filter->dropped;
+}
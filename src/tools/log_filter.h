@@ -0,0 +1,69 @@
+/*
+ * log_filter.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef LOG_FILTER_H
+#define LOG_FILTER_H
+
+#include <glib.h>
+
+#include "log.h"
+
+// the settings of one log area, its own level and, for records below
+// WARN, sampling one in every n and a per second rate limit
+typedef struct log_filter_t *LogFilter;
+
+LogFilter log_filter_new(void);
+void log_filter_free(LogFilter filter);
+
+// a spec such as "level=INFO rate=10", settings that do not parse are
+// left out
+LogFilter log_filter_parse(const char *const spec, gint64 now);
+gchar* log_filter_spec(LogFilter filter);
+
+// set one of level, rate or sample, FALSE leaves the filter as it was, a
+// new rate starts with a full second of records at now
+gboolean log_filter_set(LogFilter filter, const char *const setting, const char *const value, gint64 now);
+
+// the area's level when it has one, otherwise filter_level
+gboolean log_filter_enabled(LogFilter filter, log_level_t level, log_level_t filter_level);
+
+// FALSE when a record at now is dropped by sampling or the rate limit
+gboolean log_filter_admit(LogFilter filter, log_level_t level, gint64 now);
+
+// records dropped since the last call, for reporting them
+guint64 log_filter_take_suppressed(LogFilter filter);
+guint64 log_filter_dropped(LogFilter filter);
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ * log_retention.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "tools/log_retention.h"
+
+#define LOG_ARCHIVE_CHUNK 16384
+
+// the files of one day, named from the date, e.g. 2016_01_31.log,
+// 2016_01_31.1.log, 2016_01_31.plog and 2016_01_31.log.idx
+typedef struct log_day_t {
+    gint date;
+    gint64 size;
+    GSList *files;
+} LogDay;
+
+static gint _date_number(GDateTime *date);
+static GSList* _list_days(const char *const dir);
+static void _day_free(LogDay *day);
+static gint _day_cmp(const LogDay *a, const LogDay *b);
+static int _remove_day(const char *const dir, LogDay *day, GSList **gone);
+static int _archive_day(const char *const dir, LogDay *day, GSList **gone);
+
+int
+log_retention_apply(const char *const dir, const LogRetention *const policy, GDateTime *now, GSList **gone)
+{
+    gint today = _date_number(now);
+
+    gint expire_before = 0;
+    if (policy->max_age_days > 0) {
+        GDateTime *oldest = g_date_time_add_days(now, -policy->max_age_days);
+        expire_before = _date_number(oldest);
+        g_date_time_unref(oldest);
+    }
+
+    gint archive_before = 0;
+    if (policy->archive_days > 0 && log_archive_supported()) {
+        GDateTime *oldest = g_date_time_add_days(now, -policy->archive_days);
+        archive_before = _date_number(oldest);
+        g_date_time_unref(oldest);
+    }
+
+    GSList *days = _list_days(dir);
+    gint64 total = 0;
+    GSList *curr = days;
+    while (curr) {
+        total += ((LogDay*)curr->data)->size;
+        curr = g_slist_next(curr);
+    }
+
+    // days are oldest first, so the oldest go first when over the size limit
+    int changed = 0;
+    curr = days;
+    while (curr) {
+        LogDay *day = curr->data;
+        if (day->date >= today) {
+            break;
+        }
+
+        if (day->date < expire_before || (policy->max_size > 0 && total > policy->max_size)) {
+            total -= day->size;
+            changed += _remove_day(dir, day, gone);
+        } else if (day->date < archive_before) {
+            changed += _archive_day(dir, day, gone);
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(days, (GDestroyNotify)_day_free);
+
+    return changed;
+}
+
+gboolean
+log_archive_supported(void)
+{
+#ifdef HAVE_LIBZ
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+gboolean
+log_archive_file(const char *const filename)
+{
+#ifdef HAVE_LIBZ
+    gchar *contents = NULL;
+    gsize len = 0;
+    if (!g_file_get_contents(filename, &contents, &len, NULL)) {
+        return FALSE;
+    }
+
+    // write to a temporary file so a failed archive never replaces the log
+    gchar *tmp_filename = g_strdup_printf("%s.gz.tmp", filename);
+    gboolean result = FALSE;
+    gzFile gz = gzopen(tmp_filename, "wb");
+    if (gz) {
+        result = TRUE;
+        gsize written = 0;
+        while (result && written < len) {
+            unsigned chunk = MIN(len - written, LOG_ARCHIVE_CHUNK);
+            result = gzwrite(gz, contents + written, chunk) == (int)chunk;
+            written += chunk;
+        }
+        if (gzclose(gz) != Z_OK) {
+            result = FALSE;
+        }
+    }
+    g_free(contents);
+
+    if (result) {
+        gchar *archive_filename = g_strdup_printf("%s.gz", filename);
+        result = g_rename(tmp_filename, archive_filename) == 0;
+        if (result) {
+            g_chmod(archive_filename, S_IRUSR | S_IWUSR);
+            g_unlink(filename);
+        }
+        g_free(archive_filename);
+    }
+    if (!result) {
+        g_unlink(tmp_filename);
+    }
+    g_free(tmp_filename);
+
+    return result;
+#else
+    return FALSE;
+#endif
+}
+
+gchar*
+log_archive_read(const char *const filename, gsize *len)
+{
+#ifdef HAVE_LIBZ
+    gchar *archive_filename = g_strdup_printf("%s.gz", filename);
+    gzFile gz = gzopen(archive_filename, "rb");
+    g_free(archive_filename);
+    if (gz == NULL) {
+        return NULL;
+    }
+
+    GString *contents = g_string_new("");
+    char buf[LOG_ARCHIVE_CHUNK];
+    int read;
+    while ((read = gzread(gz, buf, sizeof(buf))) > 0) {
+        g_string_append_len(contents, buf, read);
+    }
+    gzclose(gz);
+
+    if (read < 0) {
+        g_string_free(contents, TRUE);
+        return NULL;
+    }
+
+    *len = contents->len;
+    return g_string_free(contents, FALSE);
+#else
+    return NULL;
+#endif
+}
+
+static gint
+_date_number(GDateTime *date)
+{
+    return g_date_time_get_year(date) * 10000 + g_date_time_get_month(date) * 100 +
+        g_date_time_get_day_of_month(date);
+}
+
+// the days with files in dir, oldest first
+static GSList*
+_list_days(const char *const dir)
+{
+    GDir *gdir = g_dir_open(dir, 0, NULL);
+    if (gdir == NULL) {
+        return NULL;
+    }
+
+    GHashTable *days = g_hash_table_new(g_direct_hash, g_direct_equal);
+    const gchar *name;
+    while ((name = g_dir_read_name(gdir)) != NULL) {
+        int year, month, day;
+        if (strlen(name) < 11 || name[10] != '.' || sscanf(name, "%4d_%2d_%2d", &year, &month, &day) != 3) {
+            continue;
+        }
+
+        gint date = year * 10000 + month * 100 + day;
+        LogDay *log_day = g_hash_table_lookup(days, GINT_TO_POINTER(date));
+        if (log_day == NULL) {
+            log_day = calloc(1, sizeof(LogDay));
+            log_day->date = date;
+            g_hash_table_insert(days, GINT_TO_POINTER(date), log_day);
+        }
+
+        gchar *path = g_strdup_printf("%s/%s", dir, name);
+        GStatBuf st;
+        if (g_stat(path, &st) == 0) {
+            log_day->size += st.st_size;
+        }
+        g_free(path);
+        log_day->files = g_slist_prepend(log_day->files, strdup(name));
+    }
+    g_dir_close(gdir);
+
+    GList *values = g_hash_table_get_values(days);
+    GSList *result = NULL;
+    GList *curr = values;
+    while (curr) {
+        result = g_slist_insert_sorted(result, curr->data, (GCompareFunc)_day_cmp);
+        curr = g_list_next(curr);
+    }
+    g_list_free(values);
+    g_hash_table_destroy(days);
+
+    return result;
+}
+
+static void
+_day_free(LogDay *day)
+{
+    g_slist_free_full(day->files, free);
+    free(day);
+}
+
+static gint
+_day_cmp(const LogDay *a, const LogDay *b)
+{
+    return a->date - b->date;
+}
+
+static int
+_remove_day(const char *const dir, LogDay *day, GSList **gone)
+{
+    int removed = 0;
+    GSList *curr = day->files;
+    while (curr) {
+        gchar *path = g_strdup_printf("%s/%s", dir, (char*)curr->data);
+        if (g_unlink(path) == 0) {
+            removed++;
+            if (gone) {
+                *gone = g_slist_append(*gone, path);
+                path = NULL;
+            }
+        }
+        g_free(path);
+        curr = g_slist_next(curr);
+    }
+
+    return removed;
+}
+
+static int
+_archive_day(const char *const dir, LogDay *day, GSList **gone)
+{
+    int archived = 0;
+    GSList *curr = day->files;
+    while (curr) {
+        char *name = curr->data;
+        if (g_str_has_suffix(name, ".log") || g_str_has_suffix(name, ".plog")) {
+            gchar *path = g_strdup_printf("%s/%s", dir, name);
+            if (log_archive_file(path)) {
+                archived++;
+                if (gone) {
+                    *gone = g_slist_append(*gone, path);
+                    path = NULL;
+                }
+            }
+            g_free(path);
+        }
+        curr = g_slist_next(curr);
+    }
+
+    // offset indexes are only kept for uncompressed logs
+    curr = day->files;
+    while (curr) {
+        char *name = curr->data;
+        if (g_str_has_suffix(name, ".idx")) {
+            gchar *path = g_strdup_printf("%s/%s", dir, name);
+            gchar *log_path = g_strndup(path, strlen(path) - 4);
+            if (!g_file_test(log_path, G_FILE_TEST_EXISTS)) {
+                g_unlink(path);
+            }
+            g_free(log_path);
+            g_free(path);
+        }
+        curr = g_slist_next(curr);
+    }
+
+    return archived;
+}
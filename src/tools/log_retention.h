@@ -0,0 +1,65 @@
+/*
+ * log_retention.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef LOG_RETENTION_H
+#define LOG_RETENTION_H
+
+#include <glib.h>
+
+// limits on the day files of one contact or room, 0 disables each
+typedef struct log_retention_t {
+    int max_age_days;
+    gint64 max_size;
+    int archive_days;
+} LogRetention;
+
+// delete day files older than max_age_days, then the oldest days while
+// the directory is over max_size, and compress day files older than
+// archive_days. Today's files are never touched. Returns the number of
+// files removed or compressed, the paths of the files no longer there
+// are added to gone when it is not NULL. Safe to call from any thread.
+int log_retention_apply(const char *const dir, const LogRetention *const policy, GDateTime *now,
+    GSList **gone);
+
+// whether archived logs can be written and read
+gboolean log_archive_supported(void);
+
+// compress filename to filename.gz and remove it
+gboolean log_archive_file(const char *const filename);
+
+// the uncompressed contents of filename.gz, NULL if there is no archive
+gchar* log_archive_read(const char *const filename, gsize *len);
+
+#endif
@@ -80,8 +80,6 @@ A million repetitions of "a"
   34AA973C D4C4DAA4 F61EEB2B DBAD2731 6534016F
 */
 
-/* #define SHA1HANDSOFF  */
-
 #include <stdio.h>
 #include <string.h>
 
@@ -101,9 +99,28 @@ A million repetitions of "a"
 
 #include "p_sha1.h"
 
+/* hardware SHA-1, used when the CPU running us has it */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define P_SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+#define P_SHA1_ARMV8
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA1
+#define HWCAP_SHA1 (1 << 5)
+#endif
+#endif
+#endif
+
 static uint32_t host_to_be(uint32_t i);
 void P_SHA1_Transform(uint32_t state[5], const uint8_t buffer[64]);
 
+typedef void (*P_SHA1_TRANSFORM)(uint32_t state[5], const uint8_t buffer[64]);
+static P_SHA1_TRANSFORM transform = NULL;
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
 /* blk0() and blk() perform the initial expand. */
@@ -164,13 +181,11 @@ void P_SHA1_Transform(uint32_t state[5], const uint8_t buffer[64])
     } CHAR64LONG16;
     CHAR64LONG16* block;
 
-#ifdef SHA1HANDSOFF
-    static uint8_t workspace[64];
-    block = (CHAR64LONG16*)workspace;
+    /* the block is byte swapped in place, so work on a copy rather than
+       the caller's data */
+    CHAR64LONG16 workspace;
+    block = &workspace;
     memcpy(block, buffer, 64);
-#else
-    block = (CHAR64LONG16*)buffer;
-#endif
 
     /* Copy context->state[] to working vars */
     a = state[0];
@@ -213,9 +228,151 @@ void P_SHA1_Transform(uint32_t state[5], const uint8_t buffer[64])
 }
 
 
+#ifdef P_SHA1_SHANI
+/* four rounds, the message words for rounds 16 on come from the previous
+   sixteen */
+#define SHANI_ROUNDS(i, f) \
+    if (i >= 4) { \
+        msg[i & 3] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(msg[i & 3], msg[(i + 1) & 3]), \
+            msg[(i + 2) & 3]), msg[(i + 3) & 3]); \
+    } \
+    e = (i == 0) ? _mm_add_epi32(e, msg[0]) : _mm_sha1nexte_epu32(abcd_prev, msg[i & 3]); \
+    abcd_prev = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+
+/* Hash a single 512-bit block with the SHA extensions */
+__attribute__((target("sha,ssse3,sse4.1")))
+static void P_SHA1_Transform_SHANI(uint32_t state[5], const uint8_t buffer[64])
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i msg[4];
+    __m128i abcd, abcd_save, abcd_prev, e, e_save;
+    int i;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    e = _mm_set_epi32(state[4], 0, 0, 0);
+    abcd_save = abcd;
+    e_save = e;
+    abcd_prev = abcd;
+
+    for (i = 0; i < 4; i++) {
+        msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buffer + i * 16)), mask);
+    }
+
+    SHANI_ROUNDS(0, 0);  SHANI_ROUNDS(1, 0);  SHANI_ROUNDS(2, 0);  SHANI_ROUNDS(3, 0);
+    SHANI_ROUNDS(4, 0);  SHANI_ROUNDS(5, 1);  SHANI_ROUNDS(6, 1);  SHANI_ROUNDS(7, 1);
+    SHANI_ROUNDS(8, 1);  SHANI_ROUNDS(9, 1);  SHANI_ROUNDS(10, 2); SHANI_ROUNDS(11, 2);
+    SHANI_ROUNDS(12, 2); SHANI_ROUNDS(13, 2); SHANI_ROUNDS(14, 2); SHANI_ROUNDS(15, 3);
+    SHANI_ROUNDS(16, 3); SHANI_ROUNDS(17, 3); SHANI_ROUNDS(18, 3); SHANI_ROUNDS(19, 3);
+
+    e = _mm_sha1nexte_epu32(abcd_prev, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(e, 3);
+}
+
+static int P_SHA1_Hardware(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) {
+        return 0;
+    }
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return 0;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+    /* SHA is bit 29 of ebx, not named by older cpuid.h */
+    return (ebx & (1 << 29)) != 0;
+}
+#endif /* P_SHA1_SHANI */
+
+
+#ifdef P_SHA1_ARMV8
+/* Hash a single 512-bit block with the ARMv8 crypto extensions, four
+   rounds at a time, each group of four message words worked out from the
+   last four */
+static void P_SHA1_Transform_ARMV8(uint32_t state[5], const uint8_t buffer[64])
+{
+    const uint32_t k[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+    uint32x4_t msg[4];
+    uint32x4_t abcd, abcd_save, tmp;
+    uint32_t e, e_save, e_next;
+    int i;
+
+    abcd = vld1q_u32(state);
+    e = state[4];
+    abcd_save = abcd;
+    e_save = e;
+
+    for (i = 0; i < 20; i++) {
+        uint32x4_t *w = &msg[i & 3];
+        if (i < 4) {
+            *w = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer + i * 16)));
+        } else {
+            *w = vsha1su0q_u32(*w, msg[(i + 1) & 3], msg[(i + 2) & 3]);
+            *w = vsha1su1q_u32(*w, msg[(i + 3) & 3]);
+        }
+
+        tmp = vaddq_u32(*w, vdupq_n_u32(k[i / 5]));
+        e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+        if (i < 5) {
+            abcd = vsha1cq_u32(abcd, e, tmp);
+        } else if (i >= 10 && i < 15) {
+            abcd = vsha1mq_u32(abcd, e, tmp);
+        } else {
+            abcd = vsha1pq_u32(abcd, e, tmp);
+        }
+        e = e_next;
+    }
+
+    vst1q_u32(state, vaddq_u32(abcd, abcd_save));
+    state[4] = e + e_save;
+}
+
+static int P_SHA1_Hardware(void)
+{
+#ifdef __linux__
+    return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#else
+    /* built for a CPU with the crypto extensions */
+    return 1;
+#endif
+}
+#endif /* P_SHA1_ARMV8 */
+
+
+/* Use the hardware transform when asked and the CPU has it, returns
+   whether it is now in use */
+int P_SHA1_Accelerate(int enable)
+{
+    transform = P_SHA1_Transform;
+#if defined(P_SHA1_SHANI)
+    if (enable && P_SHA1_Hardware()) {
+        transform = P_SHA1_Transform_SHANI;
+    }
+#elif defined(P_SHA1_ARMV8)
+    if (enable && P_SHA1_Hardware()) {
+        transform = P_SHA1_Transform_ARMV8;
+    }
+#endif
+
+    return transform != P_SHA1_Transform;
+}
+
+
 /* SHA1Init - Initialize new context */
 void P_SHA1_Init(P_SHA1_CTX* context)
 {
+    if (transform == NULL) {
+        P_SHA1_Accelerate(1);
+    }
+
     /* SHA1 initialization constants */
     context->state[0] = 0x67452301;
     context->state[1] = 0xEFCDAB89;
@@ -240,9 +397,9 @@ void P_SHA1_Update(P_SHA1_CTX* context, const uint8_t* data, const size_t len)
     context->count[1] += (len >> 29);
     if ((j + len) > 63) {
         memcpy(&context->buffer[j], data, (i = 64-j));
-        P_SHA1_Transform(context->state, context->buffer);
+        transform(context->state, context->buffer);
         for ( ; i + 63 < len; i += 64) {
-            P_SHA1_Transform(context->state, data + i);
+            transform(context->state, data + i);
         }
         j = 0;
     }
@@ -281,10 +438,6 @@ void P_SHA1_Final(P_SHA1_CTX* context, uint8_t digest[P_SHA1_DIGEST_SIZE])
     memset(context->state, 0, 20);
     memset(context->count, 0, 8);
     memset(finalcount, 0, 8);	/* SWR */
-
-#ifdef SHA1HANDSOFF  /* make SHA1Transform overwrite its own static vars */
-    P_SHA1_Transform(context->state, context->buffer);
-#endif
 }
 
 /*************************************************************/
@@ -23,6 +23,7 @@ typedef struct {
 void P_SHA1_Init(P_SHA1_CTX* context);
 void P_SHA1_Update(P_SHA1_CTX* context, const uint8_t* data, const size_t len);
 void P_SHA1_Final(P_SHA1_CTX* context, uint8_t digest[P_SHA1_DIGEST_SIZE]);
+int P_SHA1_Accelerate(int enable);
 
 #ifdef __cplusplus
 }
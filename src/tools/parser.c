@@ -39,6 +39,42 @@
 
 #include "common.h"
 
+// the argument array and the text it points into are one allocation, the
+// line is copied in after enough slots for the most tokens it could hold
+// and each token is terminated in place
+static gchar**
+_args_new(const char *const inp, char **line)
+{
+    size_t len = strlen(inp);
+    size_t slots = len / 2 + 3;
+    gchar **args = g_malloc(slots * sizeof(*args) + len + 1);
+    *line = (char*)(args + slots);
+    memcpy(*line, inp, len + 1);
+    g_strstrip(*line);
+
+    return args;
+}
+
+// drop the command token and check the number of arguments
+static gchar**
+_args_result(gchar **args, int num_tokens, int min, int max, gboolean *result)
+{
+    int num = num_tokens - 1;
+
+    // if num args not valid return NULL
+    if ((num < min) || (num > max)) {
+        g_free(args);
+        *result = FALSE;
+        return NULL;
+    }
+
+    memmove(args, args + 1, num * sizeof(*args));
+    args[num] = NULL;
+
+    *result = TRUE;
+    return args;
+}
+
 /*
  * Take a full line of input and return an array of strings representing
  * the arguments of a command.
@@ -50,7 +86,7 @@
  * max - The maximum allowed number of arguments
  *
  * Returns - An NULL terminated array of strings representing the arguments
- * of the command, or NULL if the validation fails.
+ * of the command, or NULL if the validation fails. Free with parse_args_free.
  *
  * E.g. the following input line:
  *
@@ -70,103 +106,74 @@ parse_args(const char *const inp, int min, int max, gboolean *result)
     }
 
     // copy and strip input of leading/trailing whitespace
-    char *copy = strdup(inp);
-    g_strstrip(copy);
+    char *copy = NULL;
+    gchar **args = _args_new(inp, &copy);
 
-    int inp_size = g_utf8_strlen(copy, -1);
     gboolean in_token = FALSE;
     gboolean in_quotes = FALSE;
     char *token_start = &copy[0];
     int token_size = 0;
-    GSList *tokens = NULL;
+    int num_tokens = 0;
 
-    // add tokens to GSList
-    int i;
-    for (i = 0; i < inp_size; i++) {
-        gchar *curr_ch = g_utf8_offset_to_pointer(copy, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
+    // one pass over the input, only ASCII space and quote are special so
+    // the position is moved a character at a time without counting
+    gchar *curr_ch = copy;
+    while (*curr_ch) {
+        gchar *next_ch = g_utf8_next_char(curr_ch);
+        int curr_size = next_ch - curr_ch;
 
         if (!in_token) {
-            if (curr_uni  == ' ') {
+            if (*curr_ch == ' ') {
+                curr_ch = next_ch;
                 continue;
             } else {
                 in_token = TRUE;
-                if (curr_uni == '"') {
+                if (*curr_ch == '"') {
+                    // the character after the quote is always taken
                     in_quotes = TRUE;
-                    i++;
-                    gchar *next_ch = g_utf8_next_char(curr_ch);
-                    gunichar next_uni = g_utf8_get_char(next_ch);
                     token_start = next_ch;
-                    token_size += g_unichar_to_utf8(next_uni, NULL);
+                    if (*next_ch) {
+                        gchar *after_ch = g_utf8_next_char(next_ch);
+                        token_size += after_ch - next_ch;
+                        next_ch = after_ch;
+                    }
                 } else {
                     token_start = curr_ch;
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
+                    token_size += curr_size;
                 }
             }
         } else {
             if (in_quotes) {
-                if (curr_uni == '"') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                        token_size));
+                if (*curr_ch == '"') {
+                    token_start[token_size] = '\0';
+                    args[num_tokens++] = token_start;
                     token_size = 0;
                     in_token = FALSE;
                     in_quotes = FALSE;
                 } else {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
+                    token_size += curr_size;
                 }
             } else {
-                if (curr_uni == ' ') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                        token_size));
+                if (*curr_ch == ' ') {
+                    token_start[token_size] = '\0';
+                    args[num_tokens++] = token_start;
                     token_size = 0;
                     in_token = FALSE;
                 } else {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
+                    token_size += curr_size;
                 }
             }
         }
+
+        curr_ch = next_ch;
     }
 
     if (in_token) {
-        tokens = g_slist_append(tokens, g_strndup(token_start, token_size));
+        token_start[token_size] = '\0';
+        args[num_tokens++] = token_start;
     }
 
-    int num = g_slist_length(tokens) - 1;
-
-    // if num args not valid return NULL
-    if ((num < min) || (num > max)) {
-        g_slist_free_full(tokens, free);
-        g_free(copy);
-        *result = FALSE;
-        return NULL;
-
-    // if min allowed is 0 and 0 found, return empty char* array
-    } else if (min == 0 && num == 0) {
-        g_slist_free_full(tokens, free);
-        gchar **args = malloc((num + 1) * sizeof(*args));
-        args[0] = NULL;
-        g_free(copy);
-        *result = TRUE;
-        return args;
-
-    // otherwise return args array
-    } else {
-        gchar **args = malloc((num + 1) * sizeof(*args));
-        GSList *token = tokens;
-        token = g_slist_next(token);
-        int arg_count = 0;
-
-        while (token) {
-            args[arg_count++] = strdup(token->data);
-            token = g_slist_next(token);
-        }
-
-        args[arg_count] = NULL;
-        g_slist_free_full(tokens, free);
-        g_free(copy);
-        *result = TRUE;
-        return args;
-    }
+    return _args_result(args, num_tokens, min, max, result);
 }
 
 /*
@@ -184,7 +191,7 @@ parse_args(const char *const inp, int min, int max, gboolean *result)
  * max - The maximum allowed number of arguments
  *
  * Returns - An NULL terminated array of strings representing the arguments
- * of the command, or NULL if the validation fails.
+ * of the command, or NULL if the validation fails. Free with parse_args_free.
  *
  * E.g. the following input line:
  *
@@ -204,137 +211,105 @@ parse_args_with_freetext(const char *const inp, int min, int max, gboolean *resu
     }
 
     // copy and strip input of leading/trailing whitepsace
-    char *copy = strdup(inp);
-    g_strstrip(copy);
+    char *copy = NULL;
+    gchar **args = _args_new(inp, &copy);
 
-    int inp_size = g_utf8_strlen(copy, -1);
     gboolean in_token = FALSE;
     gboolean in_freetext = FALSE;
     gboolean in_quotes = FALSE;
     char *token_start = &copy[0];
     int token_size = 0;
     int num_tokens = 0;
-    GSList *tokens = NULL;
 
-    // add tokens to GSList
-    int i;
-    for (i = 0; i < inp_size; i++) {
-        gchar *curr_ch = g_utf8_offset_to_pointer(copy, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
+    // one pass over the input, as for parse_args
+    gchar *curr_ch = copy;
+    while (*curr_ch) {
+        gchar *next_ch = g_utf8_next_char(curr_ch);
+        int curr_size = next_ch - curr_ch;
 
         if (!in_token) {
-            if (curr_uni == ' ') {
+            if (*curr_ch == ' ') {
+                curr_ch = next_ch;
                 continue;
             } else {
                 in_token = TRUE;
                 num_tokens++;
-                if ((num_tokens == max + 1) && (curr_uni != '"')) {
+                if ((num_tokens == max + 1) && (*curr_ch != '"')) {
                     in_freetext = TRUE;
-                } else if (curr_uni == '"') {
+                    token_start = curr_ch;
+                    token_size += curr_size;
+                } else if (*curr_ch == '"') {
+                    // the character after the quote is always taken
                     in_quotes = TRUE;
-                    i++;
-                    gchar *next_ch = g_utf8_next_char(curr_ch);
-                    gunichar next_uni = g_utf8_get_char(next_ch);
-                    token_start = next_ch;
-                    token_size += g_unichar_to_utf8(next_uni, NULL);
-                }
-                if (curr_uni == '"') {
-                    gchar *next_ch = g_utf8_next_char(curr_ch);
                     token_start = next_ch;
+                    if (*next_ch) {
+                        gchar *after_ch = g_utf8_next_char(next_ch);
+                        token_size += after_ch - next_ch;
+                        next_ch = after_ch;
+                    }
                 } else {
                     token_start = curr_ch;
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
+                    token_size += curr_size;
                 }
             }
         } else {
             if (in_quotes) {
-                if (curr_uni == '"') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                        token_size));
+                if (*curr_ch == '"') {
+                    token_start[token_size] = '\0';
+                    args[num_tokens - 1] = token_start;
                     token_size = 0;
                     in_token = FALSE;
                     in_quotes = FALSE;
                 } else {
-                    if (curr_uni != '"') {
-                        token_size += g_unichar_to_utf8(curr_uni, NULL);
-                    }
+                    token_size += curr_size;
                 }
             } else {
                 if (in_freetext) {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                } else if (curr_uni == ' ') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                        token_size));
+                    token_size += curr_size;
+                } else if (*curr_ch == ' ') {
+                    token_start[token_size] = '\0';
+                    args[num_tokens - 1] = token_start;
                     token_size = 0;
                     in_token = FALSE;
-                } else if (curr_uni != '"') {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
+                } else if (*curr_ch != '"') {
+                    token_size += curr_size;
                 }
             }
         }
+
+        curr_ch = next_ch;
     }
 
     if (in_token) {
-        tokens = g_slist_append(tokens, g_strndup(token_start, token_size));
+        token_start[token_size] = '\0';
+        args[num_tokens - 1] = token_start;
     }
 
-    free(copy);
-
-    int num = g_slist_length(tokens) - 1;
-
-    // if num args not valid return NULL
-    if ((num < min) || (num > max)) {
-        g_slist_free_full(tokens, free);
-        *result = FALSE;
-        return NULL;
-
-    // if min allowed is 0 and 0 found, return empty char* array
-    } else if (min == 0 && num == 0) {
-        g_slist_free_full(tokens, free);
-        gchar **args = malloc((num + 1) * sizeof(*args));
-        args[0] = NULL;
-        *result = TRUE;
-        return args;
-
-    // otherwise return args array
-    } else {
-        gchar **args = malloc((num + 1) * sizeof(*args));
-        GSList *token = tokens;
-        token = g_slist_next(token);
-        int arg_count = 0;
-
-        while (token) {
-            args[arg_count++] = strdup(token->data);
-            token = g_slist_next(token);
-        }
+    return _args_result(args, num_tokens, min, max, result);
+}
 
-        args[arg_count] = NULL;
-        g_slist_free_full(tokens, free);
-        *result = TRUE;
-        return args;
-    }
+void
+parse_args_free(gchar **args)
+{
+    g_free(args);
 }
 
 int
 count_tokens(const char *const string)
 {
-    int length = g_utf8_strlen(string, -1);
     gboolean in_quotes = FALSE;
     int num_tokens = 0;
-    int i = 0;
 
     // include first token
     num_tokens++;
 
-    for (i = 0; i < length; i++) {
-        gchar *curr_ch = g_utf8_offset_to_pointer(string, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
-
-        if (curr_uni == ' ') {
+    const char *curr_ch = NULL;
+    for (curr_ch = string; *curr_ch; curr_ch = g_utf8_next_char(curr_ch)) {
+        if (*curr_ch == ' ') {
             if (!in_quotes) {
                 num_tokens++;
             }
-        } else if (curr_uni == '"') {
+        } else if (*curr_ch == '"') {
             if (in_quotes) {
                 in_quotes = FALSE;
             } else {
@@ -350,30 +325,23 @@ char*
 get_start(const char *const string, int tokens)
 {
     GString *result = g_string_new("");
-    int length = g_utf8_strlen(string, -1);
     gboolean in_quotes = FALSE;
     char *result_str = NULL;
     int num_tokens = 0;
-    int i = 0;
 
     // include first token
     num_tokens++;
 
-    for (i = 0; i < length; i++) {
-        gchar *curr_ch = g_utf8_offset_to_pointer(string, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
-
+    const char *curr_ch = NULL;
+    for (curr_ch = string; *curr_ch; curr_ch = g_utf8_next_char(curr_ch)) {
         if (num_tokens < tokens) {
-            gchar *uni_char = malloc(7);
-            int len = g_unichar_to_utf8(curr_uni, uni_char);
-            uni_char[len] = '\0';
-            g_string_append(result, uni_char);
+            g_string_append_len(result, curr_ch, g_utf8_next_char(curr_ch) - curr_ch);
         }
-        if (curr_uni == ' ') {
+        if (*curr_ch == ' ') {
             if (!in_quotes) {
                 num_tokens++;
             }
-        } else if (curr_uni == '"') {
+        } else if (*curr_ch == '"') {
             if (in_quotes) {
                 in_quotes = FALSE;
             } else {
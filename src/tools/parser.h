@@ -39,6 +39,7 @@
 
 gchar** parse_args(const char *const inp, int min, int max, gboolean *result);
 gchar** parse_args_with_freetext(const char *const inp, int min, int max, gboolean *result);
+void parse_args_free(gchar **args);
 int count_tokens(const char *const string);
 char* get_start(const char *const string, int tokens);
 GHashTable* parse_options(gchar **args, gchar **keys, gboolean *res);
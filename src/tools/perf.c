@@ -0,0 +1,175 @@
+/*
+ * perf.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "tools/perf.h"
+
+static const char *stage_names[PERF_STAGE_COUNT] = {
+    "parse",
+    "handler",
+    "log",
+    "render"
+};
+
+// elapsed microseconds for each stage, in the order recorded
+static GArray *samples[PERF_STAGE_COUNT];
+static gboolean sorted[PERF_STAGE_COUNT];
+static gboolean enabled = FALSE;
+
+static gint _cmp_sample(gconstpointer a, gconstpointer b);
+
+void
+perf_enable(void)
+{
+    int i;
+    for (i = 0; i < PERF_STAGE_COUNT; i++) {
+        if (samples[i] == NULL) {
+            samples[i] = g_array_new(FALSE, FALSE, sizeof(gint64));
+        }
+        g_array_set_size(samples[i], 0);
+        sorted[i] = TRUE;
+    }
+    enabled = TRUE;
+}
+
+void
+perf_disable(void)
+{
+    int i;
+    for (i = 0; i < PERF_STAGE_COUNT; i++) {
+        if (samples[i]) {
+            g_array_free(samples[i], TRUE);
+            samples[i] = NULL;
+        }
+    }
+    enabled = FALSE;
+}
+
+gboolean
+perf_enabled(void)
+{
+    return enabled;
+}
+
+gint64
+perf_start(void)
+{
+    if (!enabled) {
+        return 0;
+    }
+
+    return g_get_monotonic_time();
+}
+
+void
+perf_record(perf_stage_t stage, gint64 start)
+{
+    if (!enabled || start == 0 || stage >= PERF_STAGE_COUNT) {
+        return;
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+    g_array_append_val(samples[stage], elapsed);
+    sorted[stage] = FALSE;
+}
+
+guint
+perf_count(perf_stage_t stage)
+{
+    if (stage >= PERF_STAGE_COUNT || samples[stage] == NULL) {
+        return 0;
+    }
+
+    return samples[stage]->len;
+}
+
+// nearest rank, so the value returned is always one that was recorded
+gint64
+perf_percentile(perf_stage_t stage, int percent)
+{
+    guint count = perf_count(stage);
+    if (count == 0) {
+        return 0;
+    }
+
+    if (!sorted[stage]) {
+        g_array_sort(samples[stage], _cmp_sample);
+        sorted[stage] = TRUE;
+    }
+
+    if (percent <= 0) {
+        return g_array_index(samples[stage], gint64, 0);
+    }
+    if (percent >= 100) {
+        return g_array_index(samples[stage], gint64, count - 1);
+    }
+
+    guint rank = ((guint64)count * percent + 99) / 100;
+    return g_array_index(samples[stage], gint64, rank - 1);
+}
+
+void
+perf_report(FILE *stream)
+{
+    fprintf(stream, "%-8s %8s %8s %8s %8s %8s\n", "stage", "count", "p50us", "p90us", "p99us", "maxus");
+
+    int i;
+    for (i = 0; i < PERF_STAGE_COUNT; i++) {
+        fprintf(stream, "%-8s %8u %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT "\n",
+            stage_names[i],
+            perf_count(i),
+            perf_percentile(i, 50),
+            perf_percentile(i, 90),
+            perf_percentile(i, 99),
+            perf_percentile(i, 100));
+    }
+}
+
+static gint
+_cmp_sample(gconstpointer a, gconstpointer b)
+{
+    gint64 first = *(const gint64*)a;
+    gint64 second = *(const gint64*)b;
+
+    if (first < second) {
+        return -1;
+    } else if (first > second) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
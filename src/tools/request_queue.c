@@ -0,0 +1,126 @@
+/*
+ * request_queue.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "tools/request_queue.h"
+
+// requests once sent belong to whoever handles their result, only those
+// still waiting are freed here
+struct request_queue_t {
+    guint parallel;
+    guint active;
+    GQueue *waiting;
+    GFunc send;
+    gpointer userdata;
+    GDestroyNotify free_request;
+};
+
+RequestQueue
+request_queue_new(guint parallel, GFunc send, gpointer userdata, GDestroyNotify free_request)
+{
+    RequestQueue queue = malloc(sizeof(struct request_queue_t));
+    queue->parallel = parallel;
+    queue->active = 0;
+    queue->waiting = g_queue_new();
+    queue->send = send;
+    queue->userdata = userdata;
+    queue->free_request = free_request;
+
+    return queue;
+}
+
+void
+request_queue_free(RequestQueue queue)
+{
+    if (queue) {
+        request_queue_clear(queue);
+        g_queue_free(queue->waiting);
+        free(queue);
+    }
+}
+
+void
+request_queue_clear(RequestQueue queue)
+{
+    gpointer request = g_queue_pop_head(queue->waiting);
+    while (request) {
+        if (queue->free_request) {
+            queue->free_request(request);
+        }
+        request = g_queue_pop_head(queue->waiting);
+    }
+    queue->active = 0;
+}
+
+void
+request_queue_add(RequestQueue queue, gpointer request)
+{
+    if (queue->active < queue->parallel) {
+        queue->active++;
+        queue->send(request, queue->userdata);
+    } else {
+        g_queue_push_tail(queue->waiting, request);
+    }
+}
+
+void
+request_queue_done(RequestQueue queue)
+{
+    if (queue->active > 0) {
+        queue->active--;
+    }
+
+    gpointer next = g_queue_pop_head(queue->waiting);
+    if (next) {
+        queue->active++;
+        queue->send(next, queue->userdata);
+    }
+}
+
+guint
+request_queue_active(RequestQueue queue)
+{
+    return queue->active;
+}
+
+guint
+request_queue_waiting(RequestQueue queue)
+{
+    return g_queue_get_length(queue->waiting);
+}
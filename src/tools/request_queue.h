@@ -0,0 +1,60 @@
+/*
+ * request_queue.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef REQUEST_QUEUE_H
+#define REQUEST_QUEUE_H
+
+#include <glib.h>
+
+typedef struct request_queue_t *RequestQueue;
+
+// requests sent with send, at most parallel waiting for a result at once,
+// the rest wait in the order they were added
+RequestQueue request_queue_new(guint parallel, GFunc send, gpointer userdata, GDestroyNotify free_request);
+void request_queue_free(RequestQueue queue);
+
+// drop the waiting requests and forget those sent
+void request_queue_clear(RequestQueue queue);
+
+// send request now if there is room, otherwise once earlier ones are done
+void request_queue_add(RequestQueue queue, gpointer request);
+
+// a sent request has its result or timed out, the next one is sent
+void request_queue_done(RequestQueue queue);
+
+guint request_queue_active(RequestQueue queue);
+guint request_queue_waiting(RequestQueue queue);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * result_cache.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/result_cache.h"
+
+typedef struct result_cache_entry_t {
+    gpointer result;
+    char *tag;
+    gint64 fetched;
+} ResultCacheEntry;
+
+struct result_cache_t {
+    GHashTable *entries;
+    gint64 max_age;
+    GDestroyNotify free_result;
+};
+
+static void _entry_free(ResultCacheEntry *entry, GDestroyNotify free_result);
+static void _entries_free(gpointer key, gpointer value, gpointer userdata);
+
+ResultCache
+result_cache_new(gint64 max_age, GDestroyNotify free_result)
+{
+    ResultCache cache = malloc(sizeof(struct result_cache_t));
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    cache->max_age = max_age;
+    cache->free_result = free_result;
+
+    return cache;
+}
+
+void
+result_cache_free(ResultCache cache)
+{
+    if (cache) {
+        result_cache_clear(cache);
+        g_hash_table_destroy(cache->entries);
+        free(cache);
+    }
+}
+
+void
+result_cache_clear(ResultCache cache)
+{
+    g_hash_table_foreach(cache->entries, _entries_free, cache);
+    g_hash_table_remove_all(cache->entries);
+}
+
+void
+result_cache_add(ResultCache cache, const char *const jid, const char *const tag, gpointer result, gint64 now)
+{
+    result_cache_remove(cache, jid);
+
+    ResultCacheEntry *entry = malloc(sizeof(ResultCacheEntry));
+    entry->result = result;
+    entry->tag = tag ? strdup(tag) : NULL;
+    entry->fetched = now;
+    g_hash_table_insert(cache->entries, strdup(jid), entry);
+}
+
+gpointer
+result_cache_lookup(ResultCache cache, const char *const jid, const char *const tag, gint64 now, gint64 *fetched)
+{
+    ResultCacheEntry *entry = g_hash_table_lookup(cache->entries, jid);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    if ((now - entry->fetched >= cache->max_age) || (g_strcmp0(entry->tag, tag) != 0)) {
+        result_cache_remove(cache, jid);
+        return NULL;
+    }
+
+    if (fetched) {
+        *fetched = entry->fetched;
+    }
+
+    return entry->result;
+}
+
+void
+result_cache_remove(ResultCache cache, const char *const jid)
+{
+    ResultCacheEntry *entry = g_hash_table_lookup(cache->entries, jid);
+    if (entry) {
+        g_hash_table_remove(cache->entries, jid);
+        _entry_free(entry, cache->free_result);
+    }
+}
+
+guint
+result_cache_size(ResultCache cache)
+{
+    return g_hash_table_size(cache->entries);
+}
+
+static void
+_entry_free(ResultCacheEntry *entry, GDestroyNotify free_result)
+{
+    if (free_result) {
+        free_result(entry->result);
+    }
+    free(entry->tag);
+    free(entry);
+}
+
+static void
+_entries_free(gpointer key, gpointer value, gpointer userdata)
+{
+    ResultCache cache = userdata;
+    _entry_free(value, cache->free_result);
+}
@@ -0,0 +1,61 @@
+/*
+ * result_cache.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <glib.h>
+
+typedef struct result_cache_t *ResultCache;
+
+// query results by jid, each kept for max_age microseconds and while the
+// tag it was added with, such as the jid's caps ver, is unchanged
+ResultCache result_cache_new(gint64 max_age, GDestroyNotify free_result);
+void result_cache_free(ResultCache cache);
+void result_cache_clear(ResultCache cache);
+
+void result_cache_add(ResultCache cache, const char *const jid, const char *const tag, gpointer result,
+    gint64 now);
+
+// the result for jid, or NULL once it is too old or tag differs, fetched
+// if not NULL is set to when it was added
+gpointer result_cache_lookup(ResultCache cache, const char *const jid, const char *const tag, gint64 now,
+    gint64 *fetched);
+
+void result_cache_remove(ResultCache cache, const char *const jid);
+
+guint result_cache_size(ResultCache cache);
+
+#endif
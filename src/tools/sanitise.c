@@ -0,0 +1,225 @@
+/*
+ * sanitise.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "tools/sanitise.h"
+
+#define ESC 0x1B
+#define BEL 0x07
+
+static size_t _sanitise_printable_len(const unsigned char *const s, size_t len);
+static size_t _sanitise_utf8_len(const unsigned char *const s, uint32_t *ch);
+static size_t _sanitise_escape_len(const unsigned char *const s);
+
+// clean text from the network in place before it is drawn or logged,
+// each byte of invalid UTF-8 becomes '?', terminal escape sequences and control
+// characters other than tab and newline are removed, the result is never
+// longer than the text given
+int
+sanitise_text(char *const text)
+{
+    if (text == NULL) {
+        return SANITISE_ASCII;
+    }
+
+    unsigned char *read = (unsigned char *)text;
+    unsigned char *end = read + strlen(text);
+    unsigned char *write = read;
+    int ascii = 1;
+    int changed = 0;
+
+    while (read < end) {
+        size_t run = _sanitise_printable_len(read, end - read);
+        if (run > 0) {
+            if (write != read) {
+                memmove(write, read, run);
+            }
+            write += run;
+            read += run;
+            continue;
+        }
+
+        unsigned char b = *read;
+        if (b == '\n' || b == '\t') {
+            *write++ = b;
+            read++;
+        } else if (b == ESC) {
+            read += _sanitise_escape_len(read);
+            changed = 1;
+        } else if (b < 0x80) {
+            read++;
+            changed = 1;
+        } else {
+            uint32_t ch = 0;
+            size_t len = _sanitise_utf8_len(read, &ch);
+            if (len == 0) {
+                *write++ = '?';
+                read++;
+                changed = 1;
+            } else if (ch < 0xA0) {
+                // C1 controls
+                read += len;
+                changed = 1;
+            } else {
+                if (write != read) {
+                    memmove(write, read, len);
+                }
+                write += len;
+                read += len;
+                ascii = 0;
+            }
+        }
+    }
+    *write = '\0';
+
+    return (ascii ? SANITISE_ASCII : 0) | (changed ? SANITISE_CHANGED : 0);
+}
+
+// how many of the len bytes from s are printable ASCII, 16 at a time
+// where the CPU has vectors
+static size_t
+_sanitise_printable_len(const unsigned char *const s, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    while (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        // signed, so bytes from 0x80 are below space too
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        int mask = _mm_movemask_epi8(bad);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t del = vdupq_n_u8(0x7F);
+    while (i + 16 <= len) {
+        uint8x16_t v = vld1q_u8(s + i);
+        uint8x16_t bad = vorrq_u8(vcltq_u8(v, space), vcgeq_u8(v, del));
+        if (vmaxvq_u8(bad) != 0) {
+            break;
+        }
+        i += 16;
+    }
+#endif
+
+    while (i < len && s[i] >= 0x20 && s[i] < 0x7F) {
+        i++;
+    }
+
+    return i;
+}
+
+// the length of the well formed UTF-8 sequence at s, with its character
+// in ch, or 0 when it is overlong, a surrogate, past U+10FFFF or cut short
+static size_t
+_sanitise_utf8_len(const unsigned char *const s, uint32_t *ch)
+{
+    size_t len = 0;
+    uint32_t min = 0;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        len = 2;
+        min = 0x80;
+        *ch = s[0] & 0x1F;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        len = 3;
+        min = 0x800;
+        *ch = s[0] & 0x0F;
+    } else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        len = 4;
+        min = 0x10000;
+        *ch = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+
+    size_t i;
+    for (i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *ch = (*ch << 6) | (s[i] & 0x3F);
+    }
+
+    if (*ch < min || *ch > 0x10FFFF || (*ch >= 0xD800 && *ch <= 0xDFFF)) {
+        return 0;
+    }
+
+    return len;
+}
+
+// the length of the escape sequence at s, control sequences run to their
+// final byte, operating system commands to BEL or the string terminator
+static size_t
+_sanitise_escape_len(const unsigned char *const s)
+{
+    size_t i = 1;
+    if (s[i] == '[') {
+        i++;
+        while (s[i] >= 0x20 && s[i] <= 0x3F) {
+            i++;
+        }
+        if (s[i] >= 0x40 && s[i] <= 0x7E) {
+            i++;
+        }
+    } else if (s[i] == ']') {
+        i++;
+        while (s[i] && s[i] != BEL && !(s[i] == ESC && s[i + 1] == '\\')) {
+            i++;
+        }
+        if (s[i] == BEL) {
+            i++;
+        } else if (s[i] == ESC) {
+            i += 2;
+        }
+    } else if (s[i] >= 0x20 && s[i] <= 0x7E) {
+        i++;
+    }
+
+    return i;
+}
@@ -0,0 +1,312 @@
+/*
+ * stats.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "tools/stats.h"
+
+// bucket 0 holds times under a microsecond, bucket n those under 2^n
+// microseconds, the last bucket everything slower
+#define STATS_BUCKETS 24
+
+typedef struct stats_entry_t {
+    guint64 count;
+    guint64 total_us;
+    guint64 max_us;
+    guint64 buckets[STATS_BUCKETS];
+} StatsEntry;
+
+static const char *stats_names[STATS_COUNT] = {
+    "message.error",
+    "message.groupchat",
+    "message.chat",
+    "message.muc_invite",
+    "message.conference",
+    "message.captcha",
+    "message.receipt",
+    "message.marker",
+    "message.mam_result",
+    "presence.error",
+    "presence.muc_user",
+    "presence.unavailable",
+    "presence.subscribe",
+    "presence.subscribed",
+    "presence.unsubscribed",
+    "presence.available",
+    "iq.error",
+    "iq.disco_info_get",
+    "iq.disco_items_get",
+    "iq.last_activity_get",
+    "iq.version_get",
+    "iq.ping_get",
+    "iq.rtt.ping",
+    "iq.rtt.disco",
+    "iq.rtt.caps",
+    "iq.rtt.version",
+    "iq.rtt.last_activity",
+    "iq.rtt.room",
+    "iq.rtt.carbons",
+    "iq.rtt.upload",
+    "win.print",
+    "win.redraw",
+    "rosterwin.draw",
+    "log.write",
+    "log.chat",
+    "log.groupchat",
+    "log.io",
+    "otr.encrypt",
+    "otr.decrypt",
+    "pgp.encrypt",
+    "pgp.decrypt",
+    "pgp.sign",
+    "pgp.verify"
+};
+
+static const char *stats_mem_names[STATS_MEM_COUNT] = {
+    "buffer_entry",
+    "contact",
+    "resource",
+    "occupant",
+    "capabilities",
+    "autocomplete",
+    "input_history",
+    "arena"
+};
+
+typedef struct stats_mem_entry_t {
+    gint64 live_count;
+    gint64 live_bytes;
+    guint64 total_count;
+    guint64 total_bytes;
+} StatsMemEntry;
+
+// updated from the log writer and pgp workers as well as the main thread,
+// totals only need to be eventually right so no ordering is asked for
+static StatsEntry stats[STATS_COUNT];
+static StatsMemEntry mem_stats[STATS_MEM_COUNT];
+
+#ifdef HAVE_STATS
+gint64
+stats_start(void)
+{
+    return g_get_monotonic_time();
+}
+
+void
+stats_record(stats_t stat, gint64 start)
+{
+    if (stat >= STATS_COUNT) {
+        return;
+    }
+
+    guint64 elapsed = g_get_monotonic_time() - start;
+    StatsEntry *entry = &stats[stat];
+
+    guint bucket = 0;
+    if (elapsed > 0) {
+        bucket = MIN(g_bit_storage(elapsed), STATS_BUCKETS - 1);
+    }
+
+    __atomic_fetch_add(&entry->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->total_us, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+    guint64 max = __atomic_load_n(&entry->max_us, __ATOMIC_RELAXED);
+    while (elapsed > max) {
+        if (__atomic_compare_exchange_n(&entry->max_us, &max, elapsed, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+#endif
+
+#ifdef HAVE_ALLOC_STATS
+void
+stats_alloc(stats_mem_t tag, size_t size)
+{
+    if (tag >= STATS_MEM_COUNT) {
+        return;
+    }
+
+    StatsMemEntry *entry = &mem_stats[tag];
+    __atomic_fetch_add(&entry->live_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->live_bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->total_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->total_bytes, size, __ATOMIC_RELAXED);
+}
+
+void
+stats_free(stats_mem_t tag, size_t size)
+{
+    if (tag >= STATS_MEM_COUNT) {
+        return;
+    }
+
+    StatsMemEntry *entry = &mem_stats[tag];
+    __atomic_fetch_sub(&entry->live_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&entry->live_bytes, size, __ATOMIC_RELAXED);
+}
+#endif
+
+const char*
+stats_name(stats_t stat)
+{
+    if (stat >= STATS_COUNT) {
+        return NULL;
+    }
+
+    return stats_names[stat];
+}
+
+// live allocations are still held, so only the latency statistics are reset
+void
+stats_reset(void)
+{
+    int i;
+    for (i = 0; i < STATS_COUNT; i++) {
+        StatsEntry *entry = &stats[i];
+        __atomic_store_n(&entry->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->total_us, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->max_us, 0, __ATOMIC_RELAXED);
+        int j;
+        for (j = 0; j < STATS_BUCKETS; j++) {
+            __atomic_store_n(&entry->buckets[j], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// upper bound of the bucket holding the given percentile
+static guint64
+_stats_percentile(const guint64 *const buckets, guint64 count, int percent)
+{
+    guint64 rank = (count * percent + 99) / 100;
+    guint64 seen = 0;
+    int i;
+    for (i = 0; i < STATS_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return (guint64)1 << i;
+        }
+    }
+
+    return (guint64)1 << (STATS_BUCKETS - 1);
+}
+
+static void
+_stats_histogram(GString *report, const guint64 *const buckets)
+{
+    g_string_append(report, "   ");
+    int i;
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        if (i == STATS_BUCKETS - 1) {
+            g_string_append_printf(report, " >=%" G_GUINT64_FORMAT "us:%" G_GUINT64_FORMAT,
+                (guint64)1 << (i - 1), buckets[i]);
+        } else {
+            g_string_append_printf(report, " <%" G_GUINT64_FORMAT "us:%" G_GUINT64_FORMAT,
+                (guint64)1 << i, buckets[i]);
+        }
+    }
+    g_string_append(report, "\n");
+}
+
+// one line per statistic recorded at least once, percentiles are the upper
+// bound of their histogram bucket
+void
+stats_report(GString *report, gboolean histograms)
+{
+    g_string_append_printf(report, "%-22s %9s %10s %8s %8s %8s %8s\n",
+        "stat", "count", "total_ms", "mean_us", "p50_us", "p99_us", "max_us");
+
+    int i;
+    for (i = 0; i < STATS_COUNT; i++) {
+        guint64 buckets[STATS_BUCKETS];
+        int j;
+        for (j = 0; j < STATS_BUCKETS; j++) {
+            buckets[j] = __atomic_load_n(&stats[i].buckets[j], __ATOMIC_RELAXED);
+        }
+        guint64 count = __atomic_load_n(&stats[i].count, __ATOMIC_RELAXED);
+        if (count == 0) {
+            continue;
+        }
+        guint64 total = __atomic_load_n(&stats[i].total_us, __ATOMIC_RELAXED);
+        guint64 max = __atomic_load_n(&stats[i].max_us, __ATOMIC_RELAXED);
+
+        g_string_append_printf(report,
+            "%-22s %9" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " <=%6" G_GUINT64_FORMAT " <=%6" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT "\n",
+            stats_names[i],
+            count,
+            total / 1000,
+            total / count,
+            _stats_percentile(buckets, count, 50),
+            _stats_percentile(buckets, count, 99),
+            max);
+
+        if (histograms) {
+            _stats_histogram(report, buckets);
+        }
+    }
+}
+
+// one line per tag, live counts and bytes are what is held now, totals
+// everything allocated since starting
+void
+stats_memory_report(GString *report)
+{
+    g_string_append_printf(report, "%-16s %10s %12s %12s %14s\n",
+        "tag", "live", "live_bytes", "total", "total_bytes");
+
+    gint64 live_bytes = 0;
+    int i;
+    for (i = 0; i < STATS_MEM_COUNT; i++) {
+        StatsMemEntry *entry = &mem_stats[i];
+        gint64 bytes = __atomic_load_n(&entry->live_bytes, __ATOMIC_RELAXED);
+        live_bytes += bytes;
+
+        g_string_append_printf(report,
+            "%-16s %10" G_GINT64_FORMAT " %12" G_GINT64_FORMAT " %12" G_GUINT64_FORMAT " %14" G_GUINT64_FORMAT "\n",
+            stats_mem_names[i],
+            __atomic_load_n(&entry->live_count, __ATOMIC_RELAXED),
+            bytes,
+            __atomic_load_n(&entry->total_count, __ATOMIC_RELAXED),
+            __atomic_load_n(&entry->total_bytes, __ATOMIC_RELAXED));
+    }
+
+    g_string_append_printf(report, "%-16s %10s %12" G_GINT64_FORMAT "\n", "all", "", live_bytes);
+}
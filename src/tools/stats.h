@@ -0,0 +1,126 @@
+/*
+ * stats.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "config.h"
+
+#include <glib.h>
+
+typedef enum {
+    STATS_MESSAGE_ERROR,
+    STATS_MESSAGE_GROUPCHAT,
+    STATS_MESSAGE_CHAT,
+    STATS_MESSAGE_MUC_INVITE,
+    STATS_MESSAGE_CONFERENCE,
+    STATS_MESSAGE_CAPTCHA,
+    STATS_MESSAGE_RECEIPT,
+    STATS_MESSAGE_MARKER,
+    STATS_MESSAGE_MAM_RESULT,
+    STATS_PRESENCE_ERROR,
+    STATS_PRESENCE_MUC_USER,
+    STATS_PRESENCE_UNAVAILABLE,
+    STATS_PRESENCE_SUBSCRIBE,
+    STATS_PRESENCE_SUBSCRIBED,
+    STATS_PRESENCE_UNSUBSCRIBED,
+    STATS_PRESENCE_AVAILABLE,
+    STATS_IQ_ERROR,
+    STATS_IQ_DISCO_INFO_GET,
+    STATS_IQ_DISCO_ITEMS_GET,
+    STATS_IQ_LAST_ACTIVITY_GET,
+    STATS_IQ_VERSION_GET,
+    STATS_IQ_PING_GET,
+    STATS_IQ_RTT_PING,
+    STATS_IQ_RTT_DISCO,
+    STATS_IQ_RTT_CAPS,
+    STATS_IQ_RTT_VERSION,
+    STATS_IQ_RTT_LAST_ACTIVITY,
+    STATS_IQ_RTT_ROOM,
+    STATS_IQ_RTT_CARBONS,
+    STATS_IQ_RTT_UPLOAD,
+    STATS_WIN_PRINT,
+    STATS_WIN_REDRAW,
+    STATS_ROSTERWIN,
+    STATS_LOG_WRITE,
+    STATS_LOG_CHAT,
+    STATS_LOG_GROUPCHAT,
+    STATS_LOG_IO,
+    STATS_OTR_ENCRYPT,
+    STATS_OTR_DECRYPT,
+    STATS_PGP_ENCRYPT,
+    STATS_PGP_DECRYPT,
+    STATS_PGP_SIGN,
+    STATS_PGP_VERIFY,
+    STATS_COUNT
+} stats_t;
+
+typedef enum {
+    STATS_MEM_BUFFER_ENTRY,
+    STATS_MEM_CONTACT,
+    STATS_MEM_RESOURCE,
+    STATS_MEM_OCCUPANT,
+    STATS_MEM_CAPABILITIES,
+    STATS_MEM_AUTOCOMPLETE,
+    STATS_MEM_INPUT_HISTORY,
+    STATS_MEM_ARENA,
+    STATS_MEM_COUNT
+} stats_mem_t;
+
+// recording compiles away unless configured with --enable-stats
+#ifdef HAVE_STATS
+gint64 stats_start(void);
+void stats_record(stats_t stat, gint64 start);
+#else
+static inline gint64 stats_start(void) { return 0; }
+static inline void stats_record(stats_t stat, gint64 start) {}
+#endif
+
+// allocation accounting compiles away unless configured with
+// --enable-alloc-stats, callers pass the same size when freeing
+#ifdef HAVE_ALLOC_STATS
+void stats_alloc(stats_mem_t tag, size_t size);
+void stats_free(stats_mem_t tag, size_t size);
+#else
+static inline void stats_alloc(stats_mem_t tag, size_t size) {}
+static inline void stats_free(stats_mem_t tag, size_t size) {}
+#endif
+
+const char* stats_name(stats_t stat);
+void stats_reset(void);
+void stats_report(GString *report, gboolean histograms);
+void stats_memory_report(GString *report);
+
+#endif
@@ -33,19 +33,11 @@
  */
 
 #include <stdlib.h>
-#include <string.h>
 
-#include <curl/curl.h>
-#include <curl/easy.h>
 #include <glib.h>
 
-struct curl_data_t
-{
-    char *buffer;
-    size_t size;
-};
-
-static size_t _data_callback(void *ptr, size_t size, size_t nmemb, void *data);
+#include "tools/http.h"
+#include "tools/tinyurl.h"
 
 gboolean
 tinyurl_valid(char *url)
@@ -54,47 +46,15 @@ tinyurl_valid(char *url)
         g_str_has_prefix(url, "https://"));
 }
 
-char*
-tinyurl_get(char *url)
+// request the short url, the callback receives it or NULL on failure
+gboolean
+tinyurl_get(char *url, http_callback callback, void *userdata)
 {
     GString *full_url = g_string_new("http://tinyurl.com/api-create.php?url=");
     g_string_append(full_url, url);
 
-    CURL *handle = curl_easy_init();
-    struct curl_data_t output;
-    output.buffer = NULL;
-    output.size = 0;
-
-    curl_easy_setopt(handle, CURLOPT_URL, full_url->str);
-    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, _data_callback);
-    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)&output);
-
-    curl_easy_perform(handle);
-    curl_easy_cleanup(handle);
-
+    gboolean result = http_get(full_url->str, 0, callback, userdata);
     g_string_free(full_url, TRUE);
 
-    if (output.buffer) {
-        output.buffer[output.size++] = '\0';
-        return output.buffer;
-    } else {
-        return NULL;
-    }
-}
-
-static size_t
-_data_callback(void *ptr, size_t size, size_t nmemb, void *data)
-{
-    size_t realsize = size * nmemb;
-    struct curl_data_t *mem = (struct curl_data_t *) data;
-    mem->buffer = realloc(mem->buffer, mem->size + realsize + 1);
-
-    if ( mem->buffer )
-    {
-        memcpy( &( mem->buffer[ mem->size ] ), ptr, realsize );
-        mem->size += realsize;
-        mem->buffer[ mem->size ] = 0;
-    }
-
-    return realsize;
+    return result;
 }
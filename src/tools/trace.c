@@ -0,0 +1,121 @@
+/*
+ * trace.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "tools/trace.h"
+
+// events are written in the Chrome trace event format, which Perfetto and
+// chrome://tracing both load
+static FILE *trace_fp = NULL;
+static gint64 trace_origin = 0;
+static gboolean trace_first = TRUE;
+
+// threads are numbered in the order they first record an event
+static GHashTable *thread_ids = NULL;
+
+G_LOCK_DEFINE_STATIC(trace_lock);
+
+gboolean
+trace_open(const char *const path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        return FALSE;
+    }
+
+    fputs("[\n", fp);
+    trace_origin = g_get_monotonic_time();
+    trace_first = TRUE;
+    thread_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_atomic_pointer_set(&trace_fp, fp);
+
+    return TRUE;
+}
+
+void
+trace_close(void)
+{
+    G_LOCK(trace_lock);
+    FILE *fp = g_atomic_pointer_get(&trace_fp);
+    if (fp) {
+        g_atomic_pointer_set(&trace_fp, NULL);
+        fputs("\n]\n", fp);
+        fclose(fp);
+        g_hash_table_destroy(thread_ids);
+        thread_ids = NULL;
+    }
+    G_UNLOCK(trace_lock);
+}
+
+gint64
+trace_start(void)
+{
+    if (g_atomic_pointer_get(&trace_fp) == NULL) {
+        return 0;
+    }
+
+    return g_get_monotonic_time();
+}
+
+// written as a complete event, the writer thread and pgp workers record
+// their own
+void
+trace_record(const char *const name, gint64 start)
+{
+    if (start == 0) {
+        return;
+    }
+
+    gint64 end = g_get_monotonic_time();
+
+    G_LOCK(trace_lock);
+    FILE *fp = g_atomic_pointer_get(&trace_fp);
+    if (fp) {
+        gpointer self = g_thread_self();
+        guint tid = GPOINTER_TO_UINT(g_hash_table_lookup(thread_ids, self));
+        if (tid == 0) {
+            tid = g_hash_table_size(thread_ids) + 1;
+            g_hash_table_insert(thread_ids, self, GUINT_TO_POINTER(tid));
+        }
+
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+            trace_first ? "" : ",\n", name, tid, start - trace_origin, end - start);
+        trace_first = FALSE;
+    }
+    G_UNLOCK(trace_lock);
+}
@@ -0,0 +1,295 @@
+/*
+ * traffic.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/traffic.h"
+
+// the rate is averaged over this many whole seconds
+#define TRAFFIC_RATE_SECS 10
+
+typedef struct traffic_count_t {
+    const char *key;
+    guint64 stanzas[TRAFFIC_DIRECTIONS];
+    guint64 bytes[TRAFFIC_DIRECTIONS];
+} TrafficCount;
+
+static TrafficCount total;
+static GHashTable *by_kind = NULL;
+static GHashTable *by_ns = NULL;
+static GHashTable *by_jid = NULL;
+static gint64 since = 0;
+
+// bytes in each of the last seconds, a slot is reused once its second
+// has passed
+static struct {
+    gint64 second;
+    guint64 bytes[TRAFFIC_DIRECTIONS];
+} rate[TRAFFIC_RATE_SECS];
+
+static void
+_traffic_count_clear(TrafficCount *count)
+{
+    int i;
+    for (i = 0; i < TRAFFIC_DIRECTIONS; i++) {
+        count->stanzas[i] = 0;
+        count->bytes[i] = 0;
+    }
+}
+
+static void
+_traffic_tables_init(void)
+{
+    by_kind = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+    by_ns = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+    by_jid = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+}
+
+void
+traffic_reset(void)
+{
+    if (by_kind) {
+        g_hash_table_remove_all(by_kind);
+        g_hash_table_remove_all(by_ns);
+        g_hash_table_remove_all(by_jid);
+    } else {
+        _traffic_tables_init();
+    }
+
+    _traffic_count_clear(&total);
+    memset(rate, 0, sizeof(rate));
+    since = g_get_monotonic_time();
+}
+
+static void
+_traffic_count_add(GHashTable *table, const char *const key, traffic_dir_t dir, gsize bytes)
+{
+    TrafficCount *count = g_hash_table_lookup(table, key);
+    if (count == NULL) {
+        count = malloc(sizeof(TrafficCount));
+        _traffic_count_clear(count);
+        gchar *owned = g_strdup(key);
+        count->key = owned;
+        g_hash_table_insert(table, owned, count);
+    }
+
+    count->stanzas[dir]++;
+    count->bytes[dir] += bytes;
+}
+
+void
+traffic_record(traffic_dir_t dir, const char *const name, const char *const type, const char *const ns,
+    const char *const jid, gsize bytes)
+{
+    if (by_kind == NULL) {
+        traffic_reset();
+    }
+
+    total.stanzas[dir]++;
+    total.bytes[dir] += bytes;
+
+    gint64 second = g_get_monotonic_time() / G_USEC_PER_SEC;
+    int slot = second % TRAFFIC_RATE_SECS;
+    if (rate[slot].second != second) {
+        rate[slot].second = second;
+        rate[slot].bytes[TRAFFIC_RECEIVED] = 0;
+        rate[slot].bytes[TRAFFIC_SENT] = 0;
+    }
+    rate[slot].bytes[dir] += bytes;
+
+    if (type) {
+        gchar *kind = g_strdup_printf("%s %s", name ? name : "other", type);
+        _traffic_count_add(by_kind, kind, dir, bytes);
+        g_free(kind);
+    } else {
+        _traffic_count_add(by_kind, name ? name : "other", dir, bytes);
+    }
+    _traffic_count_add(by_ns, ns ? ns : "none", dir, bytes);
+
+    // rooms and contacts are counted as a whole, not by occupant or resource
+    if (jid) {
+        const char *slash = strchr(jid, '/');
+        gchar *barejid = slash ? g_strndup(jid, slash - jid) : g_strdup(jid);
+        _traffic_count_add(by_jid, barejid, dir, bytes);
+        g_free(barejid);
+    } else {
+        _traffic_count_add(by_jid, "server", dir, bytes);
+    }
+}
+
+// the value of attribute in the start tag running from start to end
+static gchar*
+_traffic_attr(const char *const start, const char *const end, const char *const attr)
+{
+    size_t attr_len = strlen(attr);
+    const char *curr = start;
+    while ((curr = g_strstr_len(curr, end - curr, attr)) != NULL) {
+        const char *value = curr + attr_len;
+        if (g_ascii_isspace(curr[-1]) && value + 1 < end && value[0] == '=' && (value[1] == '"' || value[1] == '\'')) {
+            char quote = value[1];
+            value += 2;
+            const char *close = memchr(value, quote, end - value);
+            if (close) {
+                return g_strndup(value, close - value);
+            }
+            return NULL;
+        }
+        curr = value;
+    }
+
+    return NULL;
+}
+
+// picks out just enough of a serialised stanza to count it, its name, the
+// type, from and to attributes of its start tag and the first namespace
+// after it, the text is not otherwise checked
+void
+traffic_record_text(traffic_dir_t dir, const char *const text, gsize bytes)
+{
+    const char *start = strchr(text, '<');
+    if (start == NULL) {
+        traffic_record(dir, NULL, NULL, NULL, NULL, bytes);
+        return;
+    }
+
+    const char *name_end = start + 1 + strcspn(start + 1, " \t\r\n/>");
+    const char *tag_end = strchr(name_end, '>');
+    if (tag_end == NULL) {
+        tag_end = name_end + strlen(name_end);
+    }
+
+    gchar *name = name_end > start + 1 ? g_strndup(start + 1, name_end - start - 1) : NULL;
+    gchar *type = _traffic_attr(name_end, tag_end, "type");
+    gchar *jid = _traffic_attr(name_end, tag_end, dir == TRAFFIC_RECEIVED ? "from" : "to");
+
+    gchar *ns = NULL;
+    if (*tag_end == '>') {
+        const char *rest = tag_end + 1;
+        ns = _traffic_attr(rest, rest + strlen(rest), "xmlns");
+    }
+
+    traffic_record(dir, name, type, ns, jid, bytes);
+
+    g_free(name);
+    g_free(type);
+    g_free(jid);
+    g_free(ns);
+}
+
+static gint
+_cmp_count(gconstpointer a, gconstpointer b)
+{
+    const TrafficCount *first = a;
+    const TrafficCount *second = b;
+    guint64 first_bytes = first->bytes[TRAFFIC_RECEIVED] + first->bytes[TRAFFIC_SENT];
+    guint64 second_bytes = second->bytes[TRAFFIC_RECEIVED] + second->bytes[TRAFFIC_SENT];
+
+    if (first_bytes > second_bytes) {
+        return -1;
+    } else if (first_bytes < second_bytes) {
+        return 1;
+    } else {
+        return g_strcmp0(first->key, second->key);
+    }
+}
+
+static void
+_traffic_count_line(GString *report, const TrafficCount *count)
+{
+    g_string_append_printf(report, "  %-40s %8" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n",
+        count->key,
+        count->stanzas[TRAFFIC_RECEIVED],
+        count->bytes[TRAFFIC_RECEIVED],
+        count->stanzas[TRAFFIC_SENT],
+        count->bytes[TRAFFIC_SENT]);
+}
+
+// the top entries of a table by bytes in both directions, top 0 for all
+static void
+_traffic_table_report(GString *report, const char *const title, GHashTable *table, int top)
+{
+    g_string_append_printf(report, "%-42s %8s %10s %8s %10s\n", title, "recv", "recv_bytes", "sent", "sent_bytes");
+
+    GList *counts = g_list_sort(g_hash_table_get_values(table), _cmp_count);
+    GList *curr = counts;
+    int shown = 0;
+    while (curr && (top == 0 || shown < top)) {
+        _traffic_count_line(report, curr->data);
+        shown++;
+        curr = g_list_next(curr);
+    }
+    g_list_free(counts);
+}
+
+void
+traffic_report(GString *report, int top)
+{
+    if (by_kind == NULL) {
+        traffic_reset();
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 elapsed = MAX(now - since, 1);
+    g_string_append_printf(report, "Since connecting %" G_GINT64_FORMAT "s ago: received %" G_GUINT64_FORMAT " stanzas, %"
+        G_GUINT64_FORMAT " bytes, sent %" G_GUINT64_FORMAT " stanzas, %" G_GUINT64_FORMAT " bytes\n",
+        elapsed / G_USEC_PER_SEC,
+        total.stanzas[TRAFFIC_RECEIVED], total.bytes[TRAFFIC_RECEIVED],
+        total.stanzas[TRAFFIC_SENT], total.bytes[TRAFFIC_SENT]);
+
+    // the current second is still filling, so the window ends before it
+    gint64 second = now / G_USEC_PER_SEC;
+    guint64 recent[TRAFFIC_DIRECTIONS] = { 0, 0 };
+    int i;
+    for (i = 0; i < TRAFFIC_RATE_SECS; i++) {
+        if (rate[i].second < second && rate[i].second >= second - TRAFFIC_RATE_SECS) {
+            recent[TRAFFIC_RECEIVED] += rate[i].bytes[TRAFFIC_RECEIVED];
+            recent[TRAFFIC_SENT] += rate[i].bytes[TRAFFIC_SENT];
+        }
+    }
+    g_string_append_printf(report, "Last %ds: received %" G_GUINT64_FORMAT " bytes/s, sent %" G_GUINT64_FORMAT
+        " bytes/s, on average received %" G_GUINT64_FORMAT " bytes/s, sent %" G_GUINT64_FORMAT " bytes/s\n",
+        TRAFFIC_RATE_SECS,
+        recent[TRAFFIC_RECEIVED] / TRAFFIC_RATE_SECS,
+        recent[TRAFFIC_SENT] / TRAFFIC_RATE_SECS,
+        total.bytes[TRAFFIC_RECEIVED] * G_USEC_PER_SEC / elapsed,
+        total.bytes[TRAFFIC_SENT] * G_USEC_PER_SEC / elapsed);
+
+    _traffic_table_report(report, "By stanza type", by_kind, 0);
+    _traffic_table_report(report, "By namespace", by_ns, top);
+    _traffic_table_report(report, "Top talkers", by_jid, top);
+}
@@ -0,0 +1,58 @@
+/*
+ * traffic.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <glib.h>
+
+typedef enum {
+    TRAFFIC_RECEIVED,
+    TRAFFIC_SENT,
+    TRAFFIC_DIRECTIONS
+} traffic_dir_t;
+
+void traffic_reset(void);
+
+// jid is the sender of received stanzas and the recipient of sent ones,
+// any of name, type, ns and jid may be NULL
+void traffic_record(traffic_dir_t dir, const char *const name, const char *const type, const char *const ns,
+    const char *const jid, gsize bytes);
+void traffic_record_text(traffic_dir_t dir, const char *const text, gsize bytes);
+
+void traffic_report(GString *report, int top);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * watchdog.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <glib.h>
+
+#include "log.h"
+#include "tools/watchdog.h"
+
+static const char *tag_names[] = {
+    "disk",
+    "gpgme",
+    "curl",
+};
+
+// in microseconds, 0 when off
+static gint64 threshold = 0;
+
+// when each kind of blocking work was last done on the main thread, an
+// operation did it when this is after the operation started
+static gint64 tag_seen[WATCHDOG_TAG_COUNT];
+static GThread *main_thread = NULL;
+
+void
+watchdog_init(void)
+{
+    main_thread = g_thread_self();
+
+    int i;
+    for (i = 0; i < WATCHDOG_TAG_COUNT; i++) {
+        tag_seen[i] = 0;
+    }
+}
+
+void
+watchdog_set_threshold(gint ms)
+{
+    threshold = ms > 0 ? (gint64)ms * 1000 : 0;
+}
+
+gint64
+watchdog_start(void)
+{
+    if (threshold == 0) {
+        return 0;
+    }
+
+    return g_get_monotonic_time();
+}
+
+// work done by the log writer and pgp worker threads does not stall the ui
+void
+watchdog_tag(watchdog_tag_t tag)
+{
+    if (threshold == 0 || g_thread_self() != main_thread) {
+        return;
+    }
+
+    tag_seen[tag] = g_get_monotonic_time();
+}
+
+// lets callers skip describing an operation that was quick enough
+gboolean
+watchdog_exceeded(gint64 start)
+{
+    return start != 0 && g_get_monotonic_time() - start >= threshold;
+}
+
+// the warning for an operation that took longer than the threshold, or
+// NULL when it did not
+gchar*
+watchdog_describe(const char *const operation, const char *const detail, gint64 start)
+{
+    if (start == 0) {
+        return NULL;
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+    if (elapsed < threshold) {
+        return NULL;
+    }
+
+    GString *description = g_string_new("Slow ");
+    g_string_append(description, operation);
+    if (detail) {
+        g_string_append_printf(description, " %s", detail);
+    }
+    g_string_append_printf(description, ": %" G_GINT64_FORMAT "ms", elapsed / 1000);
+
+    gboolean tagged = FALSE;
+    int i;
+    for (i = 0; i < WATCHDOG_TAG_COUNT; i++) {
+        if (tag_seen[i] >= start) {
+            g_string_append(description, tagged ? ", " : ", during ");
+            g_string_append(description, tag_names[i]);
+            tagged = TRUE;
+        }
+    }
+
+    return g_string_free(description, FALSE);
+}
+
+void
+watchdog_check(const char *const operation, const char *const detail, gint64 start)
+{
+    gchar *description = watchdog_describe(operation, detail, start);
+    if (description) {
+        log_warning("%s", description);
+        g_free(description);
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * watchdog.h
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <glib.h>
+
+// blocking work done on the main thread, named in the warning for a slow
+// operation that did it
+typedef enum {
+    WATCHDOG_DISK,
+    WATCHDOG_GPGME,
+    WATCHDOG_CURL,
+    WATCHDOG_TAG_COUNT
+} watchdog_tag_t;
+
+void watchdog_init(void);
+void watchdog_set_threshold(gint ms);
+
+// returns 0 when the watchdog is off so callers can pass it straight to
+// watchdog_check
+gint64 watchdog_start(void);
+void watchdog_tag(watchdog_tag_t tag);
+gboolean watchdog_exceeded(gint64 start);
+gchar* watchdog_describe(const char *const operation, const char *const detail, gint64 start);
+void watchdog_check(const char *const operation, const char *const detail, gint64 start);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * width.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "tools/width.h"
+
+// widths are looked up in blocks of 256 characters, each worked out from
+// glib the first time a character in it is drawn, the planes above the
+// CJK extensions are asked of glib every time, blocks are published
+// atomically so widths can be looked up from any thread
+#define WIDTH_BLOCK_BITS 8
+#define WIDTH_BLOCK_SIZE (1 << WIDTH_BLOCK_BITS)
+#define WIDTH_BLOCKS (0x40000 >> WIDTH_BLOCK_BITS)
+
+static gpointer blocks[WIDTH_BLOCKS];
+
+// most blocks are all one width, so they share one of these
+static guint8 block_narrow[WIDTH_BLOCK_SIZE];
+static guint8 block_wide[WIDTH_BLOCK_SIZE];
+
+static int _width_glib(gunichar ch);
+static const guint8* _width_block(guint index);
+
+// columns a character takes on the terminal, combining and other zero
+// width characters take none
+int
+width_char(gunichar ch)
+{
+    if (ch < 0x80) {
+        return 1;
+    }
+    if (ch >= (WIDTH_BLOCKS << WIDTH_BLOCK_BITS)) {
+        return _width_glib(ch);
+    }
+
+    guint index = ch >> WIDTH_BLOCK_BITS;
+    const guint8 *block = g_atomic_pointer_get(&blocks[index]);
+    if (block == NULL) {
+        block = _width_block(index);
+    }
+
+    return block[ch & (WIDTH_BLOCK_SIZE - 1)];
+}
+
+// columns for the UTF-8 character at str, len is set to its length in
+// bytes, an invalid sequence is taken as one narrow byte, as is the
+// terminator, so nothing past it is read
+int
+width_utf8_char(const char *const str, size_t *len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    if (s[0] < 0x80) {
+        *len = 1;
+        return 1;
+    }
+
+    size_t need = 0;
+    gunichar ch = 0;
+    if ((s[0] & 0xE0) == 0xC0) {
+        need = 2;
+        ch = s[0] & 0x1F;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        need = 3;
+        ch = s[0] & 0x0F;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        need = 4;
+        ch = s[0] & 0x07;
+    } else {
+        *len = 1;
+        return 1;
+    }
+
+    size_t i;
+    for (i = 1; i < need; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *len = 1;
+            return 1;
+        }
+        ch = (ch << 6) | (s[i] & 0x3F);
+    }
+
+    *len = need;
+    return width_char(ch);
+}
+
+// columns for the first len bytes of str, runs of ASCII are counted
+// without decoding
+int
+width_utf8(const char *const str, size_t len)
+{
+    int width = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t ascii = width_ascii_len(str + pos, len - pos);
+        width += ascii;
+        pos += ascii;
+        if (pos >= len) {
+            break;
+        }
+
+        size_t ch_len = 0;
+        width += width_utf8_char(str + pos, &ch_len);
+        pos += ch_len;
+    }
+
+    return width;
+}
+
+// how many of the first len bytes of str are ASCII before the first that
+// isn't, 32 bytes at a time where the CPU has vectors and 8 otherwise
+size_t
+width_ascii_len(const char *const str, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    while (i + 32 <= len) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(lo, hi)) != 0) {
+            break;
+        }
+        i += 32;
+    }
+    while (i + 16 <= len) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    while (i + 32 <= len) {
+        uint8x16_t bits = vorrq_u8(vld1q_u8(s + i), vld1q_u8(s + i + 16));
+        if (vmaxvq_u8(bits) >= 0x80) {
+            break;
+        }
+        i += 32;
+    }
+#else
+    while (i + 8 <= len) {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof(word));
+        if ((word & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+        i += 8;
+    }
+#endif
+
+    while (i < len && s[i] < 0x80) {
+        i++;
+    }
+
+    return i;
+}
+
+static int
+_width_glib(gunichar ch)
+{
+    if (g_unichar_iszerowidth(ch)) {
+        return 0;
+    }
+
+    return g_unichar_iswide(ch) ? 2 : 1;
+}
+
+static const guint8*
+_width_block(guint index)
+{
+    guint8 widths[WIDTH_BLOCK_SIZE];
+    gunichar first = index << WIDTH_BLOCK_BITS;
+    gboolean narrow = TRUE;
+    gboolean wide = TRUE;
+    guint i;
+    for (i = 0; i < WIDTH_BLOCK_SIZE; i++) {
+        widths[i] = _width_glib(first + i);
+        narrow = narrow && (widths[i] == 1);
+        wide = wide && (widths[i] == 2);
+    }
+
+    static gsize shared = 0;
+    if (g_once_init_enter(&shared)) {
+        memset(block_narrow, 1, sizeof(block_narrow));
+        memset(block_wide, 2, sizeof(block_wide));
+        g_once_init_leave(&shared, 1);
+    }
+
+    guint8 *mixed = NULL;
+    gpointer block = NULL;
+    if (narrow) {
+        block = block_narrow;
+    } else if (wide) {
+        block = block_wide;
+    } else {
+        mixed = malloc(WIDTH_BLOCK_SIZE);
+        memcpy(mixed, widths, WIDTH_BLOCK_SIZE);
+        block = mixed;
+    }
+
+    // another thread worked out the same block first
+    if (!g_atomic_pointer_compare_and_exchange(&blocks[index], NULL, block)) {
+        free(mixed);
+        block = g_atomic_pointer_get(&blocks[index]);
+    }
+
+    return block;
+}
@@ -48,92 +48,424 @@
 
 #include "ui/window.h"
 #include "ui/buffer.h"
-
-#define BUFF_SIZE 1200
+#include "tools/stats.h"
 
 struct prof_buff_t {
-    GSList *entries;
+    ProfBuffEntry *entries[BUFF_SIZE];
+    int start;
+    int count;
+    size_t bytes;
+    // entries by message id, the key is the id held by the entry
+    GHashTable *ids;
+    guint pushed;
 };
 
+// held by the entries of every buffer, for the scrollback limit
+static size_t total_bytes = 0;
+
+static ProfBuffEntry* _entry_new(const char show_char, int pad_indent, GDateTime *time, int flags,
+    theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt);
+static void _entry_set(ProfBuffEntry *e, const char show_char, int pad_indent, GDateTime *time, int flags,
+    theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt);
+static void _entry_set_message(ProfBuff buffer, ProfBuffEntry *e, const char *const message);
+static void _entry_unindex(ProfBuff buffer, ProfBuffEntry *e);
+static void _entry_clear(ProfBuffEntry *entry);
 static void _free_entry(ProfBuffEntry *entry);
 
 ProfBuff
 buffer_create(void)
 {
     ProfBuff new_buff = malloc(sizeof(struct prof_buff_t));
-    new_buff->entries = NULL;
+    new_buff->start = 0;
+    new_buff->count = 0;
+    new_buff->bytes = 0;
+    new_buff->pushed = 0;
+    new_buff->ids = g_hash_table_new(g_str_hash, g_str_equal);
     return new_buff;
 }
 
 int
 buffer_size(ProfBuff buffer)
 {
-    return g_slist_length(buffer->entries);
+    return buffer->count;
+}
+
+// every entry ever pushed, so callers can tell how many arrived since
+guint
+buffer_pushed(ProfBuff buffer)
+{
+    return buffer->pushed;
 }
 
 void
 buffer_free(ProfBuff buffer)
 {
-    g_slist_free_full(buffer->entries, (GDestroyNotify)_free_entry);
+    int i;
+    for (i = 0; i < buffer->count; i++) {
+        _free_entry(buffer_yield_entry(buffer, i));
+    }
+    total_bytes -= buffer->bytes;
+    g_hash_table_destroy(buffer->ids);
     free(buffer);
 }
 
-void
-buffer_push(ProfBuff buffer, const char show_char, int pad_indent, GDateTime *time,
-    int flags, theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt)
+// the entry and its text, not the layout and date worked out from them
+static size_t
+_entry_bytes(ProfBuffEntry *entry)
+{
+    return sizeof(struct prof_buff_entry_t) + entry->text_size;
+}
+
+static void
+_buffer_account(ProfBuff buffer, size_t added, size_t removed)
+{
+    buffer->bytes += added;
+    buffer->bytes -= removed;
+    total_bytes += added;
+    total_bytes -= removed;
+}
+
+static ProfBuffEntry*
+_entry_new(const char show_char, int pad_indent, GDateTime *time, int flags, theme_item_t theme_item,
+    const char *const from, const char *const message, DeliveryReceipt *receipt)
 {
     ProfBuffEntry *e = malloc(sizeof(struct prof_buff_entry_t));
+    e->from = NULL;
+    e->text_size = 0;
+    stats_alloc(STATS_MEM_BUFFER_ENTRY, sizeof(struct prof_buff_entry_t));
+    _entry_set(e, show_char, pad_indent, time, flags, theme_item, from, message, receipt);
+
+    return e;
+}
+
+// fills a new or cleared entry, the text block is only grown when the
+// text does not fit in it
+static void
+_entry_set(ProfBuffEntry *e, const char show_char, int pad_indent, GDateTime *time, int flags,
+    theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt)
+{
+    size_t from_len = strlen(from);
+    size_t message_len = strlen(message);
+    size_t text_size = from_len + message_len + 2;
+    if (text_size > e->text_size) {
+        stats_free(STATS_MEM_BUFFER_ENTRY, e->text_size);
+        stats_alloc(STATS_MEM_BUFFER_ENTRY, text_size);
+        free(e->from);
+        e->from = malloc(text_size);
+        e->text_size = text_size;
+    }
+    memcpy(e->from, from, from_len + 1);
+    e->message = e->from + from_len + 1;
+    memcpy(e->message, message, message_len + 1);
+
     e->show_char = show_char;
     e->pad_indent = pad_indent;
     e->flags = flags;
     e->theme_item = theme_item;
-    e->time = g_date_time_ref(time);
-    e->from = strdup(from);
-    e->message = strdup(message);
+    e->time = g_date_time_to_unix(time) * G_USEC_PER_SEC + g_date_time_get_microsecond(time);
     e->receipt = receipt;
+    e->id = NULL;
+    e->y_start_pos = -1;
+    e->x_start_pos = 0;
+    e->y_end_pos = -1;
+    e->layout = NULL;
+    e->date_fmt = NULL;
+    e->date_fmt_version = 0;
+}
+
+ProfBuffEntry*
+buffer_push(ProfBuff buffer, const char show_char, int pad_indent, GDateTime *time,
+    int flags, theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt)
+{
+    ProfBuffEntry *e = NULL;
+
+    // full, the oldest entry is reused for the new one
+    if (buffer->count == BUFF_SIZE) {
+        e = buffer->entries[buffer->start];
+        _entry_unindex(buffer, e);
+        size_t old_bytes = _entry_bytes(e);
+        _entry_clear(e);
+        _entry_set(e, show_char, pad_indent, time, flags, theme_item, from, message, receipt);
+        _buffer_account(buffer, _entry_bytes(e), old_bytes);
+        buffer->start = (buffer->start + 1) % BUFF_SIZE;
+    } else {
+        e = _entry_new(show_char, pad_indent, time, flags, theme_item, from, message, receipt);
+        _buffer_account(buffer, _entry_bytes(e), 0);
+        buffer->entries[(buffer->start + buffer->count) % BUFF_SIZE] = e;
+        buffer->count++;
+    }
+
+    if (receipt) {
+        buffer_set_id(buffer, e, receipt->id);
+    }
+    buffer->pushed++;
+
+    return e;
+}
+
+// insert before the oldest entry, for history fetched later, nothing is
+// evicted so returns NULL when the buffer is full
+ProfBuffEntry*
+buffer_prepend(ProfBuff buffer, const char show_char, int pad_indent, GDateTime *time,
+    int flags, theme_item_t theme_item, const char *const from, const char *const message)
+{
+    if (buffer->count == BUFF_SIZE) {
+        return NULL;
+    }
+
+    ProfBuffEntry *e = _entry_new(show_char, pad_indent, time, flags, theme_item, from, message, NULL);
+    _buffer_account(buffer, _entry_bytes(e), 0);
+    buffer->start = (buffer->start + BUFF_SIZE - 1) % BUFF_SIZE;
+    buffer->entries[buffer->start] = e;
+    buffer->count++;
+
+    return e;
+}
+
+// gives the newest entry new text and time, its layout and date are worked
+// out again, returns NULL when the buffer is empty
+ProfBuffEntry*
+buffer_update_last(ProfBuff buffer, GDateTime *time, const char *const message)
+{
+    ProfBuffEntry *e = buffer_yield_entry(buffer, buffer->count - 1);
+    if (e == NULL) {
+        return NULL;
+    }
+
+    _entry_set_message(buffer, e, message);
+    e->time = g_date_time_to_unix(time) * G_USEC_PER_SEC + g_date_time_get_microsecond(time);
+    g_free(e->date_fmt);
+    e->date_fmt = NULL;
+
+    return e;
+}
+
+// the entry can be found by id until it leaves the buffer, a later entry
+// given the same id takes its place
+void
+buffer_set_id(ProfBuff buffer, ProfBuffEntry *entry, const char *const id)
+{
+    _entry_unindex(buffer, entry);
+    free(entry->id);
+    entry->id = strdup(id);
+    g_hash_table_replace(buffer->ids, entry->id, entry);
+}
+
+// gives the entry with the id new text, keeping its time and sender, for
+// corrected or retracted messages, returns NULL when no entry has the id
+ProfBuffEntry*
+buffer_replace_by_id(ProfBuff buffer, const char *const id, const char *const message)
+{
+    ProfBuffEntry *e = buffer_get_entry_by_id(buffer, id);
+    if (e) {
+        _entry_set_message(buffer, e, message);
+    }
+
+    return e;
+}
+
+// the text block is only grown when the new message does not fit, the
+// layout is worked out again when next drawn
+static void
+_entry_set_message(ProfBuff buffer, ProfBuffEntry *e, const char *const message)
+{
+    size_t old_bytes = _entry_bytes(e);
+    size_t from_len = strlen(e->from);
+    size_t message_len = strlen(message);
+    size_t text_size = from_len + message_len + 2;
+    if (text_size > e->text_size) {
+        char *text = malloc(text_size);
+        memcpy(text, e->from, from_len + 1);
+        stats_free(STATS_MEM_BUFFER_ENTRY, e->text_size);
+        stats_alloc(STATS_MEM_BUFFER_ENTRY, text_size);
+        free(e->from);
+        e->from = text;
+        e->text_size = text_size;
+    }
+    e->message = e->from + from_len + 1;
+    memcpy(e->message, message, message_len + 1);
+    _buffer_account(buffer, _entry_bytes(e), old_bytes);
+
+    if (e->layout) {
+        free(e->layout->text);
+        free(e->layout);
+        e->layout = NULL;
+    }
+}
+
+static void
+_entry_unindex(ProfBuff buffer, ProfBuffEntry *e)
+{
+    if (e->id && g_hash_table_lookup(buffer->ids, e->id) == e) {
+        g_hash_table_remove(buffer->ids, e->id);
+    }
+}
+
+// drops the oldest entries until at least bytes have been freed or only
+// keep entries are left, returns the number dropped
+int
+buffer_evict_oldest(ProfBuff buffer, size_t bytes, int keep)
+{
+    size_t freed = 0;
+    int evicted = 0;
+    while (freed < bytes && buffer->count > keep) {
+        ProfBuffEntry *oldest = buffer->entries[buffer->start];
+        _entry_unindex(buffer, oldest);
+        size_t entry_bytes = _entry_bytes(oldest);
+        _buffer_account(buffer, 0, entry_bytes);
+        _free_entry(oldest);
+        freed += entry_bytes;
+        evicted++;
+
+        buffer->start = (buffer->start + 1) % BUFF_SIZE;
+        buffer->count--;
+    }
 
-    if (g_slist_length(buffer->entries) == BUFF_SIZE) {
-        _free_entry(buffer->entries->data);
-        buffer->entries = g_slist_delete_link(buffer->entries, buffer->entries);
+    return evicted;
+}
+
+// the layouts and dates worked out for drawing, entries are measured
+// again when the buffer is next drawn
+void
+buffer_forget_layouts(ProfBuff buffer)
+{
+    int i;
+    for (i = 0; i < buffer->count; i++) {
+        ProfBuffEntry *entry = buffer_yield_entry(buffer, i);
+        if (entry->layout) {
+            free(entry->layout->text);
+            free(entry->layout);
+            entry->layout = NULL;
+        }
+        g_free(entry->date_fmt);
+        entry->date_fmt = NULL;
+        entry->y_start_pos = -1;
+        entry->y_end_pos = -1;
     }
+}
+
+size_t
+buffer_bytes(ProfBuff buffer)
+{
+    return buffer->bytes;
+}
 
-    buffer->entries = g_slist_append(buffer->entries, e);
+size_t
+buffer_total_bytes(void)
+{
+    return total_bytes;
 }
 
 gboolean
 buffer_mark_received(ProfBuff buffer, const char *const id)
 {
-    GSList *entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry *entry = entries->data;
-        if (entry->receipt && g_strcmp0(entry->receipt->id, id) == 0) {
-            if (!entry->receipt->received) {
-                entry->receipt->received = TRUE;
-                return TRUE;
-            }
-        }
-        entries = g_slist_next(entries);
+    ProfBuffEntry *entry = buffer_get_entry_by_id(buffer, id);
+    if (entry && entry->receipt && !entry->receipt->received) {
+        entry->receipt->received = TRUE;
+        return TRUE;
     }
 
     return FALSE;
 }
 
+// marks the entry and all before it, returns how many were marked
+int
+buffer_mark_received_upto(ProfBuff buffer, const char *const id)
+{
+    ProfBuffEntry *last = buffer_get_entry_by_id(buffer, id);
+    if (!last) {
+        return 0;
+    }
+
+    int marked = 0;
+    int i;
+    for (i = 0; i < buffer->count; i++) {
+        ProfBuffEntry *entry = buffer->entries[(buffer->start + i) % BUFF_SIZE];
+        if (entry->receipt && !entry->receipt->received) {
+            entry->receipt->received = TRUE;
+            marked++;
+        }
+        if (entry == last) {
+            break;
+        }
+    }
+
+    return marked;
+}
+
+ProfBuffEntry*
+buffer_get_entry_by_id(ProfBuff buffer, const char *const id)
+{
+    if (id == NULL) {
+        return NULL;
+    }
+
+    return g_hash_table_lookup(buffer->ids, id);
+}
+
+GDateTime*
+buffer_entry_datetime(ProfBuffEntry *entry)
+{
+    GDateTime *second = g_date_time_new_from_unix_local(entry->time / G_USEC_PER_SEC);
+    GDateTime *result = g_date_time_add(second, entry->time % G_USEC_PER_SEC);
+    g_date_time_unref(second);
+
+    return result;
+}
+
 ProfBuffEntry*
 buffer_yield_entry(ProfBuff buffer, int entry)
 {
-    GSList *node = g_slist_nth(buffer->entries, entry);
-    return node->data;
+    if (entry < 0 || entry >= buffer->count) {
+        return NULL;
+    }
+
+    return buffer->entries[(buffer->start + entry) % BUFF_SIZE];
+}
+
+void
+buffer_iter_init(ProfBuffIter *iter, ProfBuff buffer)
+{
+    iter->buffer = buffer;
+    iter->pos = 0;
+}
+
+ProfBuffEntry*
+buffer_iter_next(ProfBuffIter *iter)
+{
+    ProfBuffEntry *entry = buffer_yield_entry(iter->buffer, iter->pos);
+    if (entry) {
+        iter->pos++;
+    }
+
+    return entry;
 }
 
+// everything but the text block, which is kept for reuse
 static void
-_free_entry(ProfBuffEntry *entry)
+_entry_clear(ProfBuffEntry *entry)
 {
-    free(entry->message);
-    free(entry->from);
-    g_date_time_unref(entry->time);
     if (entry->receipt) {
         free(entry->receipt->id);
         free(entry->receipt);
+        entry->receipt = NULL;
+    }
+    free(entry->id);
+    entry->id = NULL;
+    if (entry->layout) {
+        free(entry->layout->text);
+        free(entry->layout);
+        entry->layout = NULL;
     }
+    g_free(entry->date_fmt);
+    entry->date_fmt = NULL;
+}
+
+static void
+_free_entry(ProfBuffEntry *entry)
+{
+    stats_free(STATS_MEM_BUFFER_ENTRY, sizeof(struct prof_buff_entry_t) + entry->text_size);
+    _entry_clear(entry);
+    free(entry->from);
     free(entry);
 }
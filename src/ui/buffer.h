@@ -40,30 +40,72 @@
 
 #include <glib.h>
 
+#define BUFF_SIZE 1200
+
 typedef struct delivery_receipt_t {
     char *id;
     gboolean received;
 } DeliveryReceipt;
 
+typedef struct prof_buff_layout_t {
+    int width;
+    int wrap_x;
+    size_t indent;
+    char *text;
+} ProfBuffLayout;
+
 typedef struct prof_buff_entry_t {
     char show_char;
     int pad_indent;
-    GDateTime *time;
+    // local time in microseconds since the epoch
+    gint64 time;
     int flags;
     theme_item_t theme_item;
+    // from and message share one block of text_size bytes, kept when the
+    // entry is reused for a newer message
     char *from;
     char *message;
+    size_t text_size;
     DeliveryReceipt *receipt;
+    // the message id the entry was shown for, indexed by its buffer
+    char *id;
+    int y_start_pos;
+    int x_start_pos;
+    int y_end_pos;
+    ProfBuffLayout *layout;
+    char *date_fmt;
+    int date_fmt_version;
 } ProfBuffEntry;
 
 typedef struct prof_buff_t *ProfBuff;
 
+typedef struct prof_buff_iter_t {
+    ProfBuff buffer;
+    int pos;
+} ProfBuffIter;
+
 ProfBuff buffer_create();
 void buffer_free(ProfBuff buffer);
-void buffer_push(ProfBuff buffer, const char show_char, int pad_indent, GDateTime *time, int flags, theme_item_t theme_item,
+ProfBuffEntry* buffer_push(ProfBuff buffer, const char show_char, int pad_indent, GDateTime *time, int flags, theme_item_t theme_item,
     const char *const from, const char *const message, DeliveryReceipt *receipt);
+ProfBuffEntry* buffer_prepend(ProfBuff buffer, const char show_char, int pad_indent, GDateTime *time, int flags,
+    theme_item_t theme_item, const char *const from, const char *const message);
+ProfBuffEntry* buffer_update_last(ProfBuff buffer, GDateTime *time, const char *const message);
+void buffer_set_id(ProfBuff buffer, ProfBuffEntry *entry, const char *const id);
+ProfBuffEntry* buffer_replace_by_id(ProfBuff buffer, const char *const id, const char *const message);
 int buffer_size(ProfBuff buffer);
+guint buffer_pushed(ProfBuff buffer);
 ProfBuffEntry* buffer_yield_entry(ProfBuff buffer, int entry);
 gboolean buffer_mark_received(ProfBuff buffer, const char *const id);
+int buffer_mark_received_upto(ProfBuff buffer, const char *const id);
+ProfBuffEntry* buffer_get_entry_by_id(ProfBuff buffer, const char *const id);
+GDateTime* buffer_entry_datetime(ProfBuffEntry *entry);
+int buffer_evict_oldest(ProfBuff buffer, size_t bytes, int keep);
+void buffer_forget_layouts(ProfBuff buffer);
+size_t buffer_bytes(ProfBuff buffer);
+size_t buffer_total_bytes(void);
+
+void buffer_iter_init(ProfBuffIter *iter, ProfBuff buffer);
+ProfBuffEntry* buffer_iter_next(ProfBuffIter *iter);
 
 #endif
@@ -46,11 +46,47 @@
 #include "ui/ui.h"
 #include "ui/window.h"
 #include "ui/titlebar.h"
+#include "tools/binlog.h"
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
 #endif
 
 static void _chatwin_history(ProfChatWin *chatwin, const char *const contact);
+static void _chatwin_history_page(const char *const recipient, GSList *entries, gboolean last, gpointer data);
+static char _chatwin_enc_char(prof_enc_t enc_mode);
+
+// bumped when the message resource setting changes, so each chat builds
+// its display name again for the next message
+static int display_version = 1;
+
+// tells a window's history read from any earlier window for the contact
+static guint history_ids = 0;
+
+void
+chatwin_display_settings_changed(void)
+{
+    display_version++;
+}
+
+// only rebuilt when the contact, the resource or the settings have changed
+static const char*
+_chatwin_display_name(ProfChatWin *chatwin, const char *const resource)
+{
+    PContact contact = roster_get_contact(chatwin->barejid);
+    int contact_version = contact ? p_contact_version(contact) : 0;
+
+    if (chatwin->display_name == NULL || chatwin->display_contact != contact_version ||
+            chatwin->display_version != display_version || g_strcmp0(chatwin->display_resource, resource) != 0) {
+        free(chatwin->display_name);
+        chatwin->display_name = roster_get_msg_display_name(chatwin->barejid, resource);
+        free(chatwin->display_resource);
+        chatwin->display_resource = resource ? strdup(resource) : NULL;
+        chatwin->display_contact = contact_version;
+        chatwin->display_version = display_version;
+    }
+
+    return chatwin->display_name;
+}
 
 ProfChatWin*
 chatwin_new(const char *const barejid)
@@ -84,6 +120,46 @@ chatwin_receipt_received(ProfChatWin *chatwin, const char *const id)
     win_mark_received(win, id);
 }
 
+void
+chatwin_marker_received(ProfChatWin *chatwin, const char *const id)
+{
+    assert(chatwin != NULL);
+
+    win_mark_received_upto((ProfWin*)chatwin, id);
+}
+
+// replaces any earlier message waiting to be marked, which the marker for
+// this one covers
+void
+chatwin_markable(ProfChatWin *chatwin, const char *const fulljid, const char *const id)
+{
+    assert(chatwin != NULL);
+
+    free(chatwin->marker_jid);
+    free(chatwin->marker_id);
+    chatwin->marker_jid = strdup(fulljid);
+    chatwin->marker_id = strdup(id);
+}
+
+void
+chatwin_send_marker(ProfChatWin *chatwin)
+{
+    assert(chatwin != NULL);
+
+    if (!chatwin->marker_id) {
+        return;
+    }
+
+    if (jabber_get_connection_status() == JABBER_CONNECTED) {
+        message_send_displayed(chatwin->marker_jid, chatwin->marker_id);
+    }
+
+    free(chatwin->marker_jid);
+    free(chatwin->marker_id);
+    chatwin->marker_jid = NULL;
+    chatwin->marker_id = NULL;
+}
+
 #ifdef HAVE_LIBOTR
 void
 chatwin_otr_secured(ProfChatWin *chatwin, gboolean trusted)
@@ -237,7 +313,7 @@ chatwin_incoming_msg(ProfChatWin *chatwin, const char *const resource, const cha
     ProfWin *window = (ProfWin*)chatwin;
     int num = wins_get_num(window);
 
-    char *display_name = roster_get_msg_display_name(chatwin->barejid, resource);
+    const char *display_name = _chatwin_display_name(chatwin, resource);
 
     // currently viewing chat window with sender
     if (wins_is_current(window)) {
@@ -254,7 +330,7 @@ chatwin_incoming_msg(ProfChatWin *chatwin, const char *const resource, const cha
             flash();
         }
 
-        chatwin->unread++;
+        wins_add_unread((ProfWin*)chatwin);
         if (prefs_get_boolean(PREF_CHLOG) && prefs_get_boolean(PREF_HISTORY)) {
             _chatwin_history(chatwin, chatwin->barejid);
         }
@@ -277,8 +353,6 @@ chatwin_incoming_msg(ProfChatWin *chatwin, const char *const resource, const cha
     if (prefs_get_boolean(PREF_NOTIFY_MESSAGE)) {
         notify_message(window, display_name, message);
     }
-
-    free(display_name);
 }
 
 void
@@ -286,20 +360,34 @@ chatwin_outgoing_msg(ProfChatWin *chatwin, const char *const message, char *id,
 {
     assert(chatwin != NULL);
 
-    char enc_char = '-';
-    if (enc_mode == PROF_MSG_OTR) {
-        enc_char = prefs_get_otr_char();
-    } else if (enc_mode == PROF_MSG_PGP) {
-        enc_char = prefs_get_pgp_char();
-    }
+    char enc_char = _chatwin_enc_char(enc_mode);
 
-    if (prefs_get_boolean(PREF_RECEIPTS_REQUEST) && id) {
+    if ((prefs_get_boolean(PREF_RECEIPTS_REQUEST) || prefs_get_boolean(PREF_CHAT_MARKERS)) && id) {
         win_print_with_receipt((ProfWin*)chatwin, enc_char, 0, NULL, 0, THEME_TEXT_ME, "me", message, id);
     } else {
         win_print((ProfWin*)chatwin, enc_char, 0, NULL, 0, THEME_TEXT_ME, "me", message);
     }
 }
 
+// still being encrypted, shown as pending until it has been sent
+void
+chatwin_outgoing_pending(ProfChatWin *chatwin, const char *const message, const char *const id, prof_enc_t enc_mode)
+{
+    assert(chatwin != NULL);
+
+    win_print_with_receipt((ProfWin*)chatwin, _chatwin_enc_char(enc_mode), 0, NULL, 0, THEME_TEXT_ME, "me", message,
+        (char*)id);
+}
+
+// not sent yet, always shown with a pending receipt
+void
+chatwin_outgoing_queued(ProfChatWin *chatwin, const char *const message, const char *const id)
+{
+    assert(chatwin != NULL);
+
+    win_print_with_receipt((ProfWin*)chatwin, '-', 0, NULL, 0, THEME_TEXT_ME, "me", message, (char*)id);
+}
+
 void
 chatwin_outgoing_carbon(ProfChatWin *chatwin, const char *const message)
 {
@@ -310,6 +398,39 @@ chatwin_outgoing_carbon(ProfChatWin *chatwin, const char *const message)
     status_bar_active(num);
 }
 
+// messages from the server archive, newest first
+// returns how many messages were shown, the rest did not fit the buffer
+int
+chatwin_history_page(ProfChatWin *chatwin, GSList *messages)
+{
+    assert(chatwin != NULL);
+
+    ProfWin *window = (ProfWin*)chatwin;
+    char *display_name = roster_get_msg_display_name(chatwin->barejid, NULL);
+
+    int shown = 0;
+    GSList *curr = messages;
+    while (curr) {
+        ArchivedMessage *archived = curr->data;
+        gboolean added;
+        if (archived->outgoing) {
+            added = win_prepend(window, '-', 0, archived->timestamp, 0, THEME_TEXT_ME, "me", archived->message);
+        } else {
+            added = win_prepend(window, '-', 0, archived->timestamp, NO_ME, THEME_TEXT_THEM, display_name, archived->message);
+        }
+        if (!added) {
+            break;
+        }
+        shown++;
+        curr = g_slist_next(curr);
+    }
+
+    free(display_name);
+    win_refresh_prepended(window);
+
+    return shown;
+}
+
 void
 chatwin_contact_online(ProfChatWin *chatwin, Resource *resource, GDateTime *last_activity)
 {
@@ -341,28 +462,111 @@ static void
 _chatwin_history(ProfChatWin *chatwin, const char *const contact)
 {
     if (!chatwin->history_shown) {
-        Jid *jid = jid_create(jabber_get_fulljid());
-        GSList *history = chat_log_get_previous(jid->barejid, contact);
-        jid_destroy(jid);
-        GSList *curr = history;
-        while (curr) {
-            char *line = curr->data;
-            // entry
-            if (line[2] == ':') {
-                char hh[3]; memcpy(hh, &line[0], 2); hh[2] = '\0'; int ihh = atoi(hh);
-                char mm[3]; memcpy(mm, &line[3], 2); mm[2] = '\0'; int imm = atoi(mm);
-                char ss[3]; memcpy(ss, &line[6], 2); ss[2] = '\0'; int iss = atoi(ss);
-                GDateTime *timestamp = g_date_time_new_local(2000, 1, 1, ihh, imm, iss);
-                win_print((ProfWin*)chatwin, '-', 0, timestamp, NO_COLOUR_DATE, 0, "", curr->data+11);
-                g_date_time_unref(timestamp);
-            // header
-            } else {
-                win_print((ProfWin*)chatwin, '-', 0, NULL, 0, 0, "", curr->data);
-            }
-            curr = g_slist_next(curr);
+        const Jid *jid = jabber_get_jid();
+        if (jid) {
+            chatwin->history_id = ++history_ids;
+            chatwin->history_oldest = 0;
+            chat_log_get_previous_async(jid->barejid, contact, PAD_SIZE, _chatwin_history_page,
+                GUINT_TO_POINTER(chatwin->history_id));
         }
         chatwin->history_shown = TRUE;
+    }
+}
+
+static gboolean
+_chatwin_history_day(ProfWin *window, gint64 time)
+{
+    GDateTime *timestamp = g_date_time_new_from_unix_local(time / G_USEC_PER_SEC);
+    gchar *day = g_strdup_printf("%d/%d/%d:",
+        g_date_time_get_day_of_month(timestamp),
+        g_date_time_get_month(timestamp),
+        g_date_time_get_year(timestamp));
+    gboolean added = win_prepend(window, '-', 0, timestamp, 0, 0, "", day);
+    g_free(day);
+    g_date_time_unref(timestamp);
+
+    return added;
+}
+
+static gboolean
+_chatwin_history_same_day(gint64 time1, gint64 time2)
+{
+    GDateTime *day1 = g_date_time_new_from_unix_local(time1 / G_USEC_PER_SEC);
+    GDateTime *day2 = g_date_time_new_from_unix_local(time2 / G_USEC_PER_SEC);
+    gboolean same = g_date_time_get_day_of_year(day1) == g_date_time_get_day_of_year(day2) &&
+        g_date_time_get_year(day1) == g_date_time_get_year(day2);
+    g_date_time_unref(day1);
+    g_date_time_unref(day2);
+
+    return same;
+}
 
-        g_slist_free_full(history, free);
+// pages arrive newest first while the window is in use, so each goes above
+// what is already shown, with a header above each day's lines
+static void
+_chatwin_history_page(const char *const recipient, GSList *entries, gboolean last, gpointer data)
+{
+    ProfChatWin *chatwin = wins_get_chat(recipient);
+    if (chatwin == NULL || chatwin->history_id != GPOINTER_TO_UINT(data)) {
+        return;
+    }
+
+    ProfWin *window = (ProfWin*)chatwin;
+    gboolean added = TRUE;
+    GSList *newest = g_slist_reverse(g_slist_copy(entries));
+    GSList *curr = newest;
+    while (curr && added) {
+        BinlogEntry *entry = curr->data;
+        if (chatwin->history_oldest && !_chatwin_history_same_day(chatwin->history_oldest, entry->timestamp)) {
+            added = _chatwin_history_day(window, chatwin->history_oldest);
+        }
+
+        char enc_char = '-';
+        if (entry->flags & BINLOG_FLAG_OTR) {
+            enc_char = prefs_get_otr_char();
+        } else if (entry->flags & BINLOG_FLAG_PGP) {
+            enc_char = prefs_get_pgp_char();
+        }
+
+        const char *from = entry->from ? entry->from : "";
+        gchar *line = NULL;
+        if (entry->message && strncmp(entry->message, "/me ", 4) == 0) {
+            line = g_strdup_printf("*%s %s", from, entry->message + 4);
+        } else {
+            line = g_strdup_printf("%s: %s", from, entry->message ? entry->message : "");
+        }
+        GDateTime *timestamp = g_date_time_new_from_unix_local(entry->timestamp / G_USEC_PER_SEC);
+        added = added && win_prepend(window, enc_char, 0, timestamp, NO_COLOUR_DATE, 0, "", line);
+        g_date_time_unref(timestamp);
+        g_free(line);
+
+        chatwin->history_oldest = entry->timestamp;
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(newest);
+
+    if (added && last && chatwin->history_oldest) {
+        added = _chatwin_history_day(window, chatwin->history_oldest);
+    }
+
+    // once the buffer is full the rest of the history is left out
+    if (!added || last) {
+        chatwin->history_id = 0;
+    }
+
+    if (entries || last) {
+        win_refresh_prepended(window);
+    }
+}
+
+static char
+_chatwin_enc_char(prof_enc_t enc_mode)
+{
+    if (enc_mode == PROF_MSG_OTR) {
+        return prefs_get_otr_char();
+    } else if (enc_mode == PROF_MSG_PGP) {
+        return prefs_get_pgp_char();
+    } else {
+        return '-';
     }
 }
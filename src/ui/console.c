@@ -44,11 +44,13 @@
 
 #include "command/command.h"
 #include "common.h"
+#include "config/accounts.h"
 #include "log.h"
 #include "muc.h"
 #include "roster_list.h"
 #include "config/preferences.h"
 #include "config/theme.h"
+#include "tools/history_index.h"
 #include "ui/window.h"
 #include "window_list.h"
 #include "ui/ui.h"
@@ -60,7 +62,22 @@
 #include "gitversion.h"
 #endif
 
+// windows listed on the incoming message line before a new one is started
+#define CONS_ACTIVITY_MAX 8
+
+typedef struct activity_item_t {
+    int ui_index;
+    char *from;
+    int count;
+} ActivityItem;
+
+static GList *activity = NULL;
+static int activity_count = 0;
+static GString *activity_text = NULL;
+static ProfBuffEntry *activity_entry = NULL;
+
 static void _cons_splash_logo(void);
+static void _cons_release_received(const char *const latest_release, void *userdata);
 void _show_roster_contacts(GSList *list, gboolean show_groups);
 
 void
@@ -122,6 +139,7 @@ void
 cons_show_help(Command *command)
 {
     ProfWin *console = wins_get_console();
+    cons_batch_begin();
 
     cons_show("");
     win_vprint(console, '-', 0, NULL, 0, THEME_WHITE_BOLD, "", "%s", &command->cmd[1]);
@@ -159,6 +177,8 @@ cons_show_help(Command *command)
         win_print(console, '-', 0, NULL, 0, THEME_WHITE_BOLD, "", "Examples");
         ui_show_lines(console, command->help.examples);
     }
+
+    cons_batch_end();
 }
 
 void
@@ -288,6 +308,25 @@ cons_show_typing(const char *const barejid)
     cons_alert();
 }
 
+static void
+_free_activity_item(ActivityItem *item)
+{
+    free(item->from);
+    free(item);
+}
+
+// a new line is started once anything else has been printed to the console,
+// the text is compared as well because the entry is reused once it is the
+// oldest in a full buffer
+static gboolean
+_cons_activity_is_last(ProfWin *console)
+{
+    ProfBuffEntry *last = win_last_entry(console);
+    return activity_entry && last == activity_entry && g_strcmp0(last->message, activity_text->str) == 0;
+}
+
+// one line lists the windows messages arrived in, with how many each has
+// had, and is updated in place instead of a line being added per message
 void
 cons_show_incoming_message(const char *const short_from, const int win_index)
 {
@@ -297,7 +336,70 @@ cons_show_incoming_message(const char *const short_from, const int win_index)
     if (ui_index == 10) {
         ui_index = 0;
     }
-    win_vprint(console, '-', 0, NULL, 0, THEME_INCOMING, "", "<< incoming from %s (%d)", short_from, ui_index);
+
+    gboolean update = _cons_activity_is_last(console);
+    if (!update) {
+        g_list_free_full(activity, (GDestroyNotify)_free_activity_item);
+        activity = NULL;
+        activity_count = 0;
+    }
+
+    ActivityItem *item = NULL;
+    GList *curr = activity;
+    while (curr) {
+        ActivityItem *candidate = curr->data;
+        if (candidate->ui_index == ui_index) {
+            item = candidate;
+            break;
+        }
+        curr = g_list_next(curr);
+    }
+
+    if (item == NULL && activity_count == CONS_ACTIVITY_MAX) {
+        g_list_free_full(activity, (GDestroyNotify)_free_activity_item);
+        activity = NULL;
+        activity_count = 0;
+        update = FALSE;
+    }
+
+    if (item) {
+        if (g_strcmp0(item->from, short_from) != 0) {
+            free(item->from);
+            item->from = strdup(short_from);
+        }
+        item->count++;
+    } else {
+        item = malloc(sizeof(ActivityItem));
+        item->ui_index = ui_index;
+        item->from = strdup(short_from);
+        item->count = 1;
+        activity = g_list_append(activity, item);
+        activity_count++;
+    }
+
+    if (activity_text == NULL) {
+        activity_text = g_string_new(NULL);
+    }
+    g_string_assign(activity_text, "<< incoming from ");
+    curr = activity;
+    while (curr) {
+        ActivityItem *shown = curr->data;
+        g_string_append_printf(activity_text, "%s (%d)", shown->from, shown->ui_index);
+        if (shown->count > 1) {
+            g_string_append_printf(activity_text, " x%d", shown->count);
+        }
+        curr = g_list_next(curr);
+        if (curr) {
+            g_string_append(activity_text, ", ");
+        }
+    }
+
+    if (update) {
+        win_update_last(console, activity_text->str);
+    } else {
+        win_print(console, '-', 0, NULL, 0, THEME_INCOMING, "", activity_text->str);
+        activity_entry = win_last_entry(console);
+    }
 
     cons_alert();
 }
@@ -306,8 +408,6 @@ void
 cons_about(void)
 {
     ProfWin *console = wins_get_console();
-    int rows, cols;
-    getmaxyx(stdscr, rows, cols);
 
     if (prefs_get_boolean(PREF_SPLASH)) {
         _cons_splash_logo();
@@ -337,7 +437,7 @@ cons_about(void)
         cons_check_version(FALSE);
     }
 
-    pnoutrefresh(console->layout->win, 0, 0, 1, 0, rows-3, cols-1);
+    win_refresh_without_subwin(console);
 
     cons_alert();
 }
@@ -345,14 +445,20 @@ cons_about(void)
 void
 cons_check_version(gboolean not_available_msg)
 {
+    release_get_latest(_cons_release_received, GINT_TO_POINTER(not_available_msg));
+}
+
+static void
+_cons_release_received(const char *const latest_release, void *userdata)
+{
+    gboolean not_available_msg = GPOINTER_TO_INT(userdata);
     ProfWin *console = wins_get_console();
-    char *latest_release = release_get_latest();
 
     if (latest_release) {
         gboolean relase_valid = g_regex_match_simple("^\\d+\\.\\d+\\.\\d+$", latest_release, 0, 0);
 
         if (relase_valid) {
-            if (release_is_new(latest_release)) {
+            if (release_is_new((char*)latest_release)) {
                 win_vprint(console, '-', 0, NULL, 0, 0, "", "A new version of Profanity is available: %s", latest_release);
                 win_println(console, 0, "Check <http://www.profanity.im> for details.");
                 win_println(console, 0, "");
@@ -365,7 +471,6 @@ cons_check_version(gboolean not_available_msg)
 
             cons_alert();
         }
-        free(latest_release);
     }
 }
 
@@ -393,6 +498,7 @@ void
 cons_show_wins(void)
 {
     ProfWin *console = wins_get_console();
+    cons_batch_begin();
     cons_show("");
     cons_show("Active windows:");
     GSList *window_strings = wins_create_summary();
@@ -402,9 +508,32 @@ cons_show_wins(void)
         win_println(console, 0, curr->data);
         curr = g_slist_next(curr);
     }
-    g_slist_free_full(window_strings, free);
+    g_slist_free(window_strings);
 
     cons_show("");
+    cons_batch_end();
+    cons_alert();
+}
+
+void
+cons_show_wins_stats(void)
+{
+    ProfWin *console = wins_get_console();
+    cons_batch_begin();
+    cons_show("");
+    cons_show("Window usage:");
+    cons_show(" # %8s %8s %8s %8s %8s %8s  %s", "entries", "buffer", "pads", "per min", "drawing", "logged", "window");
+    GSList *window_strings = wins_create_stats();
+
+    GSList *curr = window_strings;
+    while (curr) {
+        win_println(console, 0, curr->data);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(window_strings, g_free);
+
+    cons_show("");
+    cons_batch_end();
     cons_alert();
 }
 
@@ -545,23 +674,69 @@ cons_show_sent_subs(void)
     cons_alert();
 }
 
+// called for each page of rooms as it arrives, shown is how many rooms
+// have been listed before it
 void
-cons_show_room_list(GSList *rooms, const char *const conference_node)
+cons_show_room_list(GSList *rooms, const char *const conference_node, int shown)
 {
     ProfWin *console = wins_get_console();
-    if (rooms && (g_slist_length(rooms) > 0)) {
+    if (shown == 0) {
         cons_show("Chat rooms at %s:", conference_node);
-        while (rooms) {
-            DiscoItem *room = rooms->data;
-            win_vprint(console, '-', 0, NULL, NO_EOL, 0, "", "  %s", room->jid);
-            if (room->name) {
-                win_vprint(console, '-', 0, NULL, NO_DATE | NO_EOL, 0, "", ", (%s)", room->name);
-            }
-            win_newline(console);
-            rooms = g_slist_next(rooms);
+    }
+    while (rooms) {
+        DiscoItem *room = rooms->data;
+        win_vprint(console, '-', 0, NULL, NO_EOL, 0, "", "  %s", room->jid);
+        if (room->name) {
+            win_vprint(console, '-', 0, NULL, NO_DATE | NO_EOL, 0, "", ", (%s)", room->name);
         }
-    } else {
-        cons_show("No chat rooms at %s", conference_node);
+        win_newline(console);
+        rooms = g_slist_next(rooms);
+    }
+
+    cons_alert();
+}
+
+void
+cons_show_room_list_end(const char *const conference_node, const char *const filter, int shown,
+    gboolean truncated)
+{
+    if (shown == 0) {
+        if (filter) {
+            cons_show("No chat rooms at %s matching \"%s\"", conference_node, filter);
+        } else {
+            cons_show("No chat rooms at %s", conference_node);
+        }
+    } else if (truncated) {
+        cons_show("Only the first %d chat rooms are shown, use /rooms filter to narrow the list.", shown);
+    }
+
+    cons_alert();
+}
+
+void
+cons_show_history_search(const char *const query, GSList *matches)
+{
+    cons_show("");
+    if (matches == NULL) {
+        cons_show("No logged messages found containing: %s", query);
+        cons_alert();
+        return;
+    }
+
+    cons_show("Logged messages containing: %s", query);
+    GSList *curr = matches;
+    while (curr) {
+        HistoryMatch *match = curr->data;
+
+        // files are <contact>/<date>.log or rooms/<room>/<date>.log
+        gchar *where = str_replace(match->file, "_at_", "@");
+        if (g_str_has_suffix(where, ".log")) {
+            where[strlen(where) - 4] = '\0';
+        }
+        cons_show("  %s %s", where, match->line);
+        free(where);
+
+        curr = g_slist_next(curr);
     }
 
     cons_alert();
@@ -653,25 +828,37 @@ cons_show_disco_info(const char *jid, GSList *identities, GSList *features)
     }
 }
 
+// called for each page of items as it arrives, shown is how many items
+// have been listed before it
 void
-cons_show_disco_items(GSList *items, const char *const jid)
+cons_show_disco_items(GSList *items, const char *const jid, int shown)
 {
     ProfWin *console = wins_get_console();
-    if (items && (g_slist_length(items) > 0)) {
+    if (shown == 0) {
         cons_show("");
         cons_show("Service discovery items for %s:", jid);
-        while (items) {
-            DiscoItem *item = items->data;
-            win_vprint(console, '-', 0, NULL, NO_EOL, 0, "", "  %s", item->jid);
-            if (item->name) {
-                win_vprint(console, '-', 0, NULL, NO_DATE | NO_EOL, 0, "", ", (%s)", item->name);
-            }
-            win_vprint(console, '-', 0, NULL, NO_DATE, 0, "", "");
-            items = g_slist_next(items);
+    }
+    while (items) {
+        DiscoItem *item = items->data;
+        win_vprint(console, '-', 0, NULL, NO_EOL, 0, "", "  %s", item->jid);
+        if (item->name) {
+            win_vprint(console, '-', 0, NULL, NO_DATE | NO_EOL, 0, "", ", (%s)", item->name);
         }
-    } else {
+        win_vprint(console, '-', 0, NULL, NO_DATE, 0, "", "");
+        items = g_slist_next(items);
+    }
+
+    cons_alert();
+}
+
+void
+cons_show_disco_items_end(const char *const jid, int shown, gboolean truncated)
+{
+    if (shown == 0) {
         cons_show("");
         cons_show("No service discovery items for %s", jid);
+    } else if (truncated) {
+        cons_show("Only the first %d service discovery items are shown.", shown);
     }
 
     cons_alert();
@@ -790,6 +977,9 @@ cons_show_account(ProfAccount *account)
     if (account->tls_policy) {
         cons_show   ("TLS policy        : %s", account->tls_policy);
     }
+    if (accounts_get_compression(account->name)) {
+        cons_show   ("Compression       : on");
+    }
     if (account->last_presence) {
         cons_show   ("Last presence     : %s", account->last_presence);
     }
@@ -1007,6 +1197,15 @@ cons_wrap_setting(void)
         cons_show("Word wrap (/wrap)             : OFF");
 }
 
+void
+cons_fuzzy_setting(void)
+{
+    if (prefs_get_boolean(PREF_COMPLETE_FUZZY))
+        cons_show("Fuzzy completion (/fuzzy)     : ON");
+    else
+        cons_show("Fuzzy completion (/fuzzy)     : OFF");
+}
+
 void
 cons_winstidy_setting(void)
 {
@@ -1014,6 +1213,21 @@ cons_winstidy_setting(void)
         cons_show("Window Auto Tidy (/wins)      : ON");
     else
         cons_show("Window Auto Tidy (/wins)      : OFF");
+
+    if (prefs_get_boolean(PREF_WINS_RESTORE))
+        cons_show("Restore windows (/wins)       : ON");
+    else
+        cons_show("Restore windows (/wins)       : OFF");
+
+    if (prefs_get_scrollback_limit() > 0)
+        cons_show("Scrollback limit (/wins)      : %dMB", prefs_get_scrollback_limit());
+    else
+        cons_show("Scrollback limit (/wins)      : OFF");
+
+    if (prefs_get_wins_hibernate() > 0)
+        cons_show("Window hibernate (/wins)      : %d minutes", prefs_get_wins_hibernate());
+    else
+        cons_show("Window hibernate (/wins)      : OFF");
 }
 
 void
@@ -1078,6 +1292,12 @@ cons_occupants_setting(void)
 
     int size = prefs_get_occupants_size();
     cons_show("Occupants size (/occupants)   : %d", size);
+
+    int large = prefs_get_occupants_large();
+    if (large > 0)
+        cons_show("Large rooms (/occupants)      : %d", large);
+    else
+        cons_show("Large rooms (/occupants)      : OFF");
 }
 
 void
@@ -1231,6 +1451,7 @@ cons_show_ui_prefs(void)
     cons_splash_setting();
     cons_wrap_setting();
     cons_winstidy_setting();
+    cons_fuzzy_setting();
     cons_time_setting();
     cons_resource_setting();
     cons_vercheck_setting();
@@ -1286,6 +1507,20 @@ cons_notify_setting(void)
         else
             cons_show("Room text (/notify room)            : OFF");
 
+        if (prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE))
+            cons_show("Room mention case (/notify room)    : Case sensitive");
+        else
+            cons_show("Room mention case (/notify room)    : Case insensitive");
+
+        if (prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD))
+            cons_show("Room mention word (/notify room)    : Whole word only");
+        else
+            cons_show("Room mention word (/notify room)    : Part of word");
+
+        GList *triggers = prefs_get_room_notify_triggers();
+        cons_show("Room mention triggers (/notify room): %d", g_list_length(triggers));
+        g_list_free_full(triggers, free);
+
         if (prefs_get_boolean(PREF_NOTIFY_TYPING))
             cons_show("Composing (/notify typing)          : ON");
         else
@@ -1387,6 +1622,24 @@ cons_carbons_setting(void)
         cons_show("Message carbons (/carbons)    : OFF");
 }
 
+void
+cons_sm_setting(void)
+{
+    if (prefs_get_boolean(PREF_STREAM_MGMT))
+        cons_show("Stream management (/sm)         : ON");
+    else
+        cons_show("Stream management (/sm)         : OFF");
+}
+
+void
+cons_csi_setting(void)
+{
+    if (prefs_get_boolean(PREF_CSI))
+        cons_show("Client state indication (/csi)  : ON");
+    else
+        cons_show("Client state indication (/csi)  : OFF");
+}
+
 void
 cons_receipts_setting(void)
 {
@@ -1400,6 +1653,10 @@ cons_receipts_setting(void)
     else
         cons_show("Send receipts (/receipts)     : OFF");
 
+    if (prefs_get_boolean(PREF_CHAT_MARKERS))
+        cons_show("Chat markers (/receipts)      : ON");
+    else
+        cons_show("Chat markers (/receipts)      : OFF");
 }
 
 void
@@ -1427,6 +1684,12 @@ cons_inpblock_setting(void)
     } else {
         cons_show("Dynamic timeout (/inpblock)   : OFF");
     }
+    cons_show("Stanza budget (/inpblock)     : %d milliseconds", prefs_get_inpblock_budget());
+    if (prefs_get_render_interval() == 0) {
+        cons_show("Render interval (/inpblock)   : OFF");
+    } else {
+        cons_show("Render interval (/inpblock)   : %d milliseconds", prefs_get_render_interval());
+    }
 }
 
 void
@@ -1440,10 +1703,67 @@ cons_log_setting(void)
     else
         cons_show("Log rotation (/log rotate)  : OFF");
 
+    if (prefs_get_boolean(PREF_LOG_COMPRESS))
+        cons_show("Compression (/log compress) : ON");
+    else
+        cons_show("Compression (/log compress) : OFF");
+
+    if (prefs_get_max_chat_log_size() > 0)
+        cons_show("Chat log size (/log chatmaxsize) : %d bytes", prefs_get_max_chat_log_size());
+    else
+        cons_show("Chat log size (/log chatmaxsize) : daily only");
+
     if (prefs_get_boolean(PREF_LOG_SHARED))
         cons_show("Shared log (/log shared)    : ON");
     else
         cons_show("Shared log (/log shared)    : OFF");
+
+    if (prefs_get_boolean(PREF_LOG_FLUSH))
+        cons_show("Chat log flush (/log flush) : ON");
+    else
+        cons_show("Chat log flush (/log flush) : OFF");
+
+    if (prefs_get_boolean(PREF_LOG_BINARY))
+        cons_show("Binary logs (/log binary)   : ON");
+    else
+        cons_show("Binary logs (/log binary)   : OFF");
+
+    if (log_async_running()) {
+        cons_show("Log writer (/log async)     : ON, %d queued, queue full %u times, %d write errors",
+            log_async_queue_depth(), log_async_queue_full_count(), log_async_error_count());
+    } else {
+        cons_show("Log writer (/log async)     : OFF");
+    }
+
+    if (prefs_get_log_slow() > 0)
+        cons_show("Slow operations (/log slow) : over %dms", prefs_get_log_slow());
+    else
+        cons_show("Slow operations (/log slow) : OFF");
+
+    if (prefs_get_log_retention("maxage") > 0)
+        cons_show("Log max age (/log retention) : %d days", prefs_get_log_retention("maxage"));
+    else
+        cons_show("Log max age (/log retention) : OFF");
+
+    if (prefs_get_log_retention("maxsize") > 0)
+        cons_show("Log max size (/log retention): %d bytes", prefs_get_log_retention("maxsize"));
+    else
+        cons_show("Log max size (/log retention): OFF");
+
+    if (prefs_get_log_retention("archive") > 0)
+        cons_show("Log archive (/log retention) : after %d days", prefs_get_log_retention("archive"));
+    else
+        cons_show("Log archive (/log retention) : OFF");
+
+    GList *areas = log_area_list();
+    GList *curr = areas;
+    while (curr) {
+        gchar *description = log_area_describe(curr->data);
+        cons_show("Log area %-19s: %s", (char*)curr->data, description);
+        g_free(description);
+        curr = g_list_next(curr);
+    }
+    g_list_free_full(areas, free);
 }
 
 void
@@ -1566,6 +1886,13 @@ cons_autoping_setting(void)
     } else {
         cons_show("Autoping interval (/autoping)   : %d seconds", autoping_interval);
     }
+
+    gint autoping_misses = prefs_get_autoping_misses();
+    if (autoping_misses == 1) {
+        cons_show("Autoping misses (/autoping)     : 1 ping");
+    } else {
+        cons_show("Autoping misses (/autoping)     : %d pings", autoping_misses);
+    }
 }
 
 void
@@ -1583,6 +1910,8 @@ cons_show_connection_prefs(void)
     cons_reconnect_setting();
     cons_autoping_setting();
     cons_autoconnect_setting();
+    cons_sm_setting();
+    cons_csi_setting();
 
     cons_alert();
 }
@@ -1692,6 +2021,7 @@ cons_show_script(const char *const script, GSList *commands)
 void
 cons_prefs(void)
 {
+    cons_batch_begin();
     cons_show("");
     cons_show_ui_prefs();
     cons_show("");
@@ -1709,6 +2039,7 @@ cons_prefs(void)
     cons_show("");
     cons_show_pgp_prefs();
     cons_show("");
+    cons_batch_end();
 
     cons_alert();
 }
@@ -1763,7 +2094,9 @@ cons_show_roster_group(const char *const group, GSList *list)
         cons_show("No group named %s exists.", group);
     }
 
+    cons_batch_begin();
     _show_roster_contacts(list, FALSE);
+    cons_batch_end();
 
     cons_alert();
 }
@@ -1774,7 +2107,9 @@ cons_show_roster(GSList *list)
     cons_show("");
     cons_show("Roster: jid (nick) - subscription - groups");
 
+    cons_batch_begin();
     _show_roster_contacts(list, TRUE);
+    cons_batch_end();
 
     cons_alert();
 }
@@ -1809,6 +2144,7 @@ cons_show_contacts(GSList *list)
     ProfWin *console = wins_get_console();
     GSList *curr = list;
 
+    cons_batch_begin();
     while(curr) {
         PContact contact = curr->data;
         if ((strcmp(p_contact_subscription(contact), "to") == 0) ||
@@ -1817,9 +2153,24 @@ cons_show_contacts(GSList *list)
         }
         curr = g_slist_next(curr);
     }
+    cons_batch_end();
     cons_alert();
 }
 
+// lines shown between these are added to the console in one go, for
+// commands that print a lot
+void
+cons_batch_begin(void)
+{
+    win_batch_begin(wins_get_console());
+}
+
+void
+cons_batch_end(void)
+{
+    win_batch_end(wins_get_console());
+}
+
 void
 cons_alert(void)
 {
@@ -48,6 +48,7 @@
 #include <X11/extensions/scrnsaver.h>
 #endif
 #include <glib.h>
+#include <readline/readline.h>
 #ifdef HAVE_NCURSESW_NCURSES_H
 #include <ncursesw/ncurses.h>
 #elif HAVE_NCURSES_H
@@ -64,6 +65,7 @@
 #include "jid.h"
 #include "log.h"
 #include "muc.h"
+#include "tools/perf.h"
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
 #endif
@@ -80,17 +82,34 @@ static int inp_size;
 static gboolean perform_resize = FALSE;
 static GTimer *ui_idle_time;
 
+// with --headless the screen is kept in memory and never written out
+static gboolean headless = FALSE;
+static SCREEN *headless_screen = NULL;
+static FILE *headless_out = NULL;
+static FILE *headless_in = NULL;
+
+// bumped by anything that draws, ui_update skips the screen refresh when
+// nothing has since the last one
+static unsigned long screen_generation = 1;
+static unsigned long drawn_generation = 0;
+
 #ifdef HAVE_LIBXSS
 static Display *display;
 #endif
 
 static void _ui_draw_term_title(void);
+static void _ui_init_headless(void);
 
 void
-ui_init(void)
+ui_init(gboolean headless_mode)
 {
     log_info("Initialising UI");
-    initscr();
+    headless = headless_mode;
+    if (headless) {
+        _ui_init_headless();
+    } else {
+        initscr();
+    }
     nonl();
     cbreak();
     noecho();
@@ -113,6 +132,12 @@ ui_init(void)
     win_update_virtual(window);
 }
 
+gboolean
+ui_is_headless(void)
+{
+    return headless;
+}
+
 void
 ui_sigwinch_handler(int sig)
 {
@@ -122,20 +147,37 @@ ui_sigwinch_handler(int sig)
 void
 ui_update(void)
 {
+    gint64 start = perf_start();
+    wins_trim_scrollback();
+
+    // nobody to draw for, windows still take everything printed to them
+    if (headless) {
+        perf_record(PERF_RENDER, start);
+        return;
+    }
     ProfWin *current = wins_get_current();
-    if (current->layout->paged == 0) {
+    gboolean held = win_render_held(current);
+    if (!held && current->layout->paged == 0) {
         win_move_to_end(current);
     }
 
-    win_update_virtual(current);
+    rosterwin_draw_pending();
+    occupantswin_draw_pending();
 
     if (prefs_get_boolean(PREF_TITLEBAR_SHOW)) {
         _ui_draw_term_title();
     }
     title_bar_update_virtual();
     status_bar_update_virtual();
-    inp_put_back();
-    doupdate();
+
+    if (screen_generation != drawn_generation) {
+        if (!held) {
+            win_update_virtual(current);
+        }
+        inp_put_back();
+        doupdate();
+        drawn_generation = screen_generation;
+    }
 
     if (perform_resize) {
         signal(SIGWINCH, SIG_IGN);
@@ -143,6 +185,16 @@ ui_update(void)
         perform_resize = FALSE;
         signal(SIGWINCH, ui_sigwinch_handler);
     }
+
+    perf_record(PERF_RENDER, start);
+}
+
+// a window is waiting to be drawn once its render interval is up
+gboolean
+ui_render_pending(void)
+{
+    ProfWin *current = wins_get_current();
+    return current && current->layout->render_held;
 }
 
 unsigned long
@@ -173,6 +225,12 @@ ui_reset_idle_time(void)
     g_timer_start(ui_idle_time);
 }
 
+void
+ui_mark_dirty(void)
+{
+    screen_generation++;
+}
+
 void
 ui_close(void)
 {
@@ -180,6 +238,12 @@ ui_close(void)
     wins_destroy();
     inp_close();
     endwin();
+    if (headless) {
+        delscreen(headless_screen);
+        headless_screen = NULL;
+        fclose(headless_out);
+        fclose(headless_in);
+    }
 }
 
 void
@@ -356,6 +420,7 @@ ui_handle_login_account_success(ProfAccount *account, int secured)
     resource_presence_t resource_presence = accounts_get_login_presence(account->name);
     contact_presence_t contact_presence = contact_presence_from_resource_presence(resource_presence);
     cons_show_login_success(account, secured);
+    inp_history_load(account->name);
     title_bar_set_presence(contact_presence);
     title_bar_set_connected(TRUE);
     title_bar_set_tls(secured ? TRUE : FALSE);
@@ -463,6 +528,23 @@ ui_disconnected(void)
     ui_hide_roster();
 }
 
+// long running work reports in the status bar in place of the jid
+void
+ui_show_progress(const char *const msg)
+{
+    status_bar_print_message(msg);
+}
+
+void
+ui_clear_progress(void)
+{
+    if (jabber_get_connection_status() == JABBER_CONNECTED) {
+        status_bar_print_message(jabber_get_fulljid());
+    } else {
+        status_bar_clear_message();
+    }
+}
+
 void
 ui_close_connected_win(int index)
 {
@@ -488,60 +570,75 @@ ui_close_connected_win(int index)
     }
 }
 
-int
-ui_close_all_wins(void)
+// closes the windows with one round of bookkeeping, the leave presences
+// and gone states are queued and written together with the next flush,
+// the windows go without drawing anything and the title and status bar
+// are drawn once when they have all gone
+static int
+_ui_close_wins(gboolean read_only)
 {
-    int count = 0;
     jabber_conn_status_t conn_status = jabber_get_connection_status();
 
     GList *win_nums = wins_get_nums();
+    GList *closing = NULL;
     GList *curr = win_nums;
-
     while (curr) {
         int num = GPOINTER_TO_INT(curr->data);
-        if ((num != 1) && (!ui_win_has_unsaved_form(num))) {
-            if (conn_status == JABBER_CONNECTED) {
-                ui_close_connected_win(num);
-            }
-            ui_close_win(num);
-            count++;
+        if ((num != 1) && (!read_only || ui_win_unread(num) == 0) && (!ui_win_has_unsaved_form(num))) {
+            closing = g_list_prepend(closing, curr->data);
         }
         curr = g_list_next(curr);
     }
-
-    g_list_free(curr);
     g_list_free(win_nums);
 
-    return count;
-}
-
-int
-ui_close_read_wins(void)
-{
-    int count = 0;
-    jabber_conn_status_t conn_status = jabber_get_connection_status();
-
-    GList *win_nums = wins_get_nums();
-    GList *curr = win_nums;
+    if (closing == NULL) {
+        return 0;
+    }
 
+    curr = closing;
     while (curr) {
         int num = GPOINTER_TO_INT(curr->data);
-        if ((num != 1) && (ui_win_unread(num) == 0) && (!ui_win_has_unsaved_form(num))) {
-            if (conn_status == JABBER_CONNECTED) {
-                ui_close_connected_win(num);
+        if (conn_status == JABBER_CONNECTED) {
+            ui_close_connected_win(num);
+        }
+        ProfWin *window = wins_get_by_num(num);
+        if (window && window->type == WIN_MUC_CONFIG) {
+            ProfMucConfWin *confwin = (ProfMucConfWin*)window;
+            if (confwin->form) {
+                cmd_autocomplete_remove_form_fields(confwin->form);
             }
-            ui_close_win(num);
-            count++;
         }
         curr = g_list_next(curr);
     }
 
-    g_list_free(curr);
-    g_list_free(win_nums);
+    status_bar_batch_begin();
+    wins_close_nums(closing);
+    if (prefs_get_boolean(PREF_WINS_AUTO_TIDY)) {
+        wins_tidy();
+    }
+    title_bar_console();
+    status_bar_current(1);
+    status_bar_active(1);
+    status_bar_batch_end();
+
+    int count = g_list_length(closing);
+    g_list_free(closing);
 
     return count;
 }
 
+int
+ui_close_all_wins(void)
+{
+    return _ui_close_wins(FALSE);
+}
+
+int
+ui_close_read_wins(void)
+{
+    return _ui_close_wins(TRUE);
+}
+
 void
 ui_redraw_all_room_rosters(void)
 {
@@ -642,6 +739,10 @@ ui_focus_win(ProfWin *window)
     int i = wins_get_num(window);
     wins_set_current_by_num(i);
 
+    if (window->type == WIN_CHAT) {
+        chatwin_send_marker((ProfChatWin*)window);
+    }
+
     if (i == 1) {
         title_bar_console();
     } else {
@@ -792,17 +893,50 @@ ui_room_join(const char *const roomjid, gboolean focus)
     win_print(window, '!', 0, NULL, NO_DATE, THEME_ROOMINFO, "", "");
 
 
+    // autojoined rooms are listed together by ui_rooms_autojoined
     if (focus) {
         ui_focus_win(window);
     } else {
         int num = wins_get_num(window);
         status_bar_active(num);
-        ProfWin *console = wins_get_console();
-        char *nick = muc_nick(roomjid);
-        win_vprint(console, '!', 0, NULL, 0, THEME_TYPING, "", "-> Autojoined %s as %s (%d).", roomjid, nick, num);
     }
 }
 
+void
+ui_rooms_autojoined(GSList *roomjids)
+{
+    ProfWin *console = wins_get_console();
+    if (g_slist_length(roomjids) == 1) {
+        char *roomjid = roomjids->data;
+        ProfWin *window = (ProfWin*)wins_get_muc(roomjid);
+        if (window) {
+            win_vprint(console, '!', 0, NULL, 0, THEME_TYPING, "", "-> Autojoined %s as %s (%d).", roomjid, muc_nick(roomjid), wins_get_num(window));
+        }
+        return;
+    }
+
+    GString *rooms = g_string_new("");
+    int count = 0;
+    GSList *curr = roomjids;
+    while (curr) {
+        char *roomjid = curr->data;
+        ProfWin *window = (ProfWin*)wins_get_muc(roomjid);
+        if (window) {
+            if (count > 0) {
+                g_string_append(rooms, ", ");
+            }
+            g_string_append_printf(rooms, "%s (%d)", roomjid, wins_get_num(window));
+            count++;
+        }
+        curr = g_slist_next(curr);
+    }
+
+    if (count > 0) {
+        win_vprint(console, '!', 0, NULL, 0, THEME_TYPING, "", "-> Autojoined %d rooms: %s.", count, rooms->str);
+    }
+    g_string_free(rooms, TRUE);
+}
+
 void
 ui_switch_to_room(const char *const roomjid)
 {
@@ -1024,6 +1158,32 @@ ui_goodbye_title(void)
     if(result == -1) log_error("Error printing title on shutdown");
 }
 
+// the terminal type only decides which capabilities curses assumes,
+// nothing it would write is kept, readline is given the same streams so it
+// leaves the terminal profanity was started from alone
+static void
+_ui_init_headless(void)
+{
+    headless_out = fopen("/dev/null", "w");
+    headless_in = fopen("/dev/null", "r");
+    if (!headless_out || !headless_in) {
+        log_error("Could not open /dev/null for headless mode");
+        exit(EXIT_FAILURE);
+    }
+
+    headless_screen = newterm(NULL, headless_out, headless_in);
+    if (!headless_screen) {
+        headless_screen = newterm("vt100", headless_out, headless_in);
+    }
+    if (!headless_screen) {
+        log_error("Could not create a terminal for headless mode");
+        exit(EXIT_FAILURE);
+    }
+    set_term(headless_screen);
+    rl_instream = headless_in;
+    rl_outstream = headless_out;
+}
+
 static void
 _ui_draw_term_title(void)
 {
@@ -40,6 +40,7 @@
 #include <wchar.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -59,6 +60,9 @@
 #include "muc.h"
 #include "profanity.h"
 #include "roster_list.h"
+#include "tools/input_history.h"
+#include "tools/ipc.h"
+#include "tools/width.h"
 #include "ui/ui.h"
 #include "ui/statusbar.h"
 #include "ui/inputwin.h"
@@ -79,11 +83,40 @@ static int r;
 static char *inp_line = NULL;
 static gboolean get_password = FALSE;
 
+// the line as last drawn, and the column each byte offset of it starts at
+static GString *inp_drawn = NULL;
+static GArray *inp_cols = NULL;
+static int inp_drawn_offset = 0;
+
+// a bracketed paste is being read, drawn once it ends
+static gboolean in_paste = FALSE;
+
+// lines entered, stored for the account logged in to
+static InputHistory inp_history = NULL;
+static gchar *inp_history_account = NULL;
+
+// reverse search, the query typed so far, the history line shown for it
+// and the line being edited before the search started
+static Keymap search_keymap = NULL;
+static Keymap search_prev_keymap = NULL;
+static GString *search_query = NULL;
+static int search_match = -1;
+static gboolean search_failed = FALSE;
+static char *search_saved = NULL;
+// searching the current window's messages rather than the history
+static gboolean search_scrollback = FALSE;
+
 static void _inp_win_update_virtual(void);
 static int _inp_printable(const wint_t ch);
 static void _inp_win_handle_scroll(void);
-static int _inp_offset_to_col(char *str, int offset);
+static void _inp_reset(void);
 static void _inp_write(char *line, int offset);
+static void _inp_draw(void);
+static gboolean _inp_history_private(void);
+static void _inp_search_find(int before);
+static void _inp_search_scrollback(gboolean older);
+static void _inp_search_end(void);
+static gboolean _inp_input_pending(void);
 
 static int _inp_rl_getc(FILE *stream);
 static void _inp_rl_linehandler(char *line);
@@ -105,6 +138,14 @@ static int _inp_rl_pageup_handler(int count, int key);
 static int _inp_rl_pagedown_handler(int count, int key);
 static int _inp_rl_altpageup_handler(int count, int key);
 static int _inp_rl_altpagedown_handler(int count, int key);
+static int _inp_rl_paste_start_handler(int count, int key);
+static int _inp_rl_paste_end_handler(int count, int key);
+static int _inp_rl_search_handler(int count, int key);
+static int _inp_rl_scrollback_search_handler(int count, int key);
+static int _inp_rl_search_char_handler(int count, int key);
+static int _inp_rl_search_backspace_handler(int count, int key);
+static int _inp_rl_search_cancel_handler(int count, int key);
+static int _inp_rl_search_exit_handler(int count, int key);
 static int _inp_rl_startup_hook(void);
 
 void
@@ -123,7 +164,14 @@ create_input_window(void)
     inp_win = newpad(1, INP_WIN_MAX);
     wbkgd(inp_win, theme_attrs(THEME_INPUT_TEXT));;
     keypad(inp_win, TRUE);
-    wmove(inp_win, 0, 0);
+    inp_drawn = g_string_new(NULL);
+    inp_cols = g_array_new(FALSE, TRUE, sizeof(int));
+    inp_history = input_history_open(NULL);
+    _inp_reset();
+
+    // ask the terminal to mark pasted text
+    fputs("\033[?2004h", stdout);
+    fflush(stdout);
 
     _inp_win_update_virtual();
 }
@@ -133,10 +181,28 @@ inp_readline(void)
 {
     free(inp_line);
     inp_line = NULL;
-    p_rl_timeout.tv_sec = inp_timeout / 1000;
-    p_rl_timeout.tv_usec = inp_timeout % 1000 * 1000;
+
+    // don't block past the next due main loop timer
+    gulong timeout = inp_timeout;
+    gulong next_due = prof_timers_next_due();
+    if (next_due < timeout) {
+        timeout = next_due;
+    }
+    p_rl_timeout.tv_sec = timeout / 1000;
+    p_rl_timeout.tv_usec = timeout % 1000 * 1000;
     FD_ZERO(&fds);
-    FD_SET(fileno(rl_instream), &fds);
+    // headless there is no terminal to read from, only wait
+    gboolean tty = !ui_is_headless();
+    if (tty) {
+        FD_SET(fileno(rl_instream), &fds);
+    }
+    // clients of the IPC socket are answered as soon as they write
+    ipc_fds(&fds);
+    // captured stderr is read as it is written, not polled for
+    int stderr_fd = log_stderr_fd();
+    if (stderr_fd >= 0) {
+        FD_SET(stderr_fd, &fds);
+    }
     errno = 0;
     r = select(FD_SETSIZE, &fds, NULL, NULL, &p_rl_timeout);
     if (r < 0) {
@@ -147,9 +213,18 @@ inp_readline(void)
         return NULL;
     }
 
-    if (FD_ISSET(fileno(rl_instream), &fds)) {
+    if (stderr_fd >= 0 && FD_ISSET(stderr_fd, &fds)) {
+        log_stderr_handler();
+    }
+
+    if (tty && FD_ISSET(fileno(rl_instream), &fds)) {
         rl_callback_read_char();
 
+        // take the rest of a paste in one go
+        while (in_paste && !inp_line && _inp_input_pending()) {
+            rl_callback_read_char();
+        }
+
         if (rl_line_buffer &&
                 rl_line_buffer[0] != '/' &&
                 rl_line_buffer[0] != '\0' &&
@@ -157,12 +232,26 @@ inp_readline(void)
             prof_handle_activity();
         }
 
+        // a key replayed after leaving the search
+        while (!inp_line && rl_pending_input) {
+            rl_callback_read_char();
+        }
+
         ui_reset_idle_time();
         if (!get_password) {
-            _inp_write(rl_line_buffer, rl_point);
+            _inp_draw();
         }
         inp_nonblocking(TRUE);
-    } else {
+
+    // timed out, rather than woken by stderr
+    } else if (r == 0) {
+        // a paste never left input waiting this long, draw what there is
+        if (in_paste) {
+            in_paste = FALSE;
+            if (!get_password) {
+                _inp_draw();
+            }
+        }
         inp_nonblocking(FALSE);
         prof_handle_idle();
     }
@@ -222,13 +311,61 @@ void
 inp_close(void)
 {
     rl_callback_handler_remove();
+    fputs("\033[?2004l", stdout);
+    fflush(stdout);
+    g_string_free(inp_drawn, TRUE);
+    inp_drawn = NULL;
+    g_array_free(inp_cols, TRUE);
+    inp_cols = NULL;
+    input_history_close(inp_history);
+    inp_history = NULL;
+    g_free(inp_history_account);
+    inp_history_account = NULL;
+}
+
+// switch to the stored history of the account, lines entered before
+// logging in are kept with it
+void
+inp_history_load(const char *const account_name)
+{
+    if (g_strcmp0(account_name, inp_history_account) == 0) {
+        return;
+    }
+
+    gchar *xdg_data = xdg_get_data_home();
+    gchar *dir = g_strdup_printf("%s/profanity/inputhistory", xdg_data);
+    g_free(xdg_data);
+    g_mkdir_with_parents(dir, S_IRWXU);
+    gchar *account_file = str_replace(account_name, "@", "_at_");
+    gchar *path = g_strdup_printf("%s/%s", dir, account_file);
+    g_free(account_file);
+    g_free(dir);
+
+    InputHistory loaded = input_history_open(path);
+    g_free(path);
+
+    if (inp_history_account == NULL) {
+        int i;
+        for (i = 0; i < input_history_size(inp_history); i++) {
+            input_history_add(loaded, input_history_get(inp_history, i));
+        }
+    }
+    input_history_close(inp_history);
+    inp_history = loaded;
+    g_free(inp_history_account);
+    inp_history_account = g_strdup(account_name);
+
+    clear_history();
+    int i;
+    for (i = 0; i < input_history_size(inp_history); i++) {
+        add_history(input_history_get(inp_history, i));
+    }
 }
 
 char*
 inp_get_line(void)
 {
-    werase(inp_win);
-    wmove(inp_win, 0, 0);
+    _inp_reset();
     _inp_win_update_virtual();
     doupdate();
     char *line = NULL;
@@ -243,8 +380,12 @@ inp_get_line(void)
 char*
 inp_get_password(void)
 {
-    werase(inp_win);
-    wmove(inp_win, 0, 0);
+    if (ui_is_headless()) {
+        log_warning("No terminal to ask for a password, an account password or eval_password is needed");
+        return strdup("");
+    }
+
+    _inp_reset();
     _inp_win_update_virtual();
     doupdate();
     char *password = NULL;
@@ -270,21 +411,138 @@ _inp_win_update_virtual(void)
     int wrows, wcols;
     getmaxyx(stdscr, wrows, wcols);
     pnoutrefresh(inp_win, 0, pad_start, wrows-1, 0, wrows-1, wcols-2);
+    ui_mark_dirty();
 }
 
 static void
-_inp_write(char *line, int offset)
+_inp_reset(void)
 {
-    int col = _inp_offset_to_col(line, offset);
     werase(inp_win);
-    waddstr(inp_win, line);
-    wmove(inp_win, 0, col);
+    wmove(inp_win, 0, 0);
+    g_string_truncate(inp_drawn, 0);
+    g_array_set_size(inp_cols, 1);
+    g_array_index(inp_cols, int, 0) = 0;
+    inp_drawn_offset = 0;
+}
+
+// columns for the drawn line from byte offset from, which already has
+// its column set
+static void
+_inp_map_cols(size_t from)
+{
+    g_array_set_size(inp_cols, inp_drawn->len + 1);
+    int col = g_array_index(inp_cols, int, from);
+    size_t i = from;
+
+    while (i < inp_drawn->len) {
+        size_t ch_len = 0;
+        int width = width_utf8_char(&inp_drawn->str[i], &ch_len);
+
+        size_t j = 0;
+        for (j = 0; j < ch_len; j++) {
+            g_array_index(inp_cols, int, i + j) = col;
+        }
+        col += width;
+        i += ch_len;
+    }
+
+    g_array_index(inp_cols, int, inp_drawn->len) = col;
+}
+
+// only redraw from the first byte that changed since the last call
+static void
+_inp_write(char *line, int offset)
+{
+    if (in_paste) {
+        return;
+    }
+
+    size_t len = strlen(line);
+    size_t same = 0;
+    while ((same < inp_drawn->len) && (same < len) && (inp_drawn->str[same] == line[same])) {
+        same++;
+    }
+    while ((same > 0) && ((line[same] & 0xC0) == 0x80)) {
+        same--;
+    }
+
+    if ((same == len) && (same == inp_drawn->len) && (offset == inp_drawn_offset)) {
+        return;
+    }
+
+    if ((same < len) || (same < inp_drawn->len)) {
+        wmove(inp_win, 0, g_array_index(inp_cols, int, same));
+        wclrtoeol(inp_win);
+        waddstr(inp_win, &line[same]);
+
+        g_string_truncate(inp_drawn, same);
+        g_string_append(inp_drawn, &line[same]);
+        _inp_map_cols(same);
+    }
+
+    if (offset > len) {
+        offset = len;
+    }
+    inp_drawn_offset = offset;
+    wmove(inp_win, 0, g_array_index(inp_cols, int, offset));
     _inp_win_handle_scroll();
 
     _inp_win_update_virtual();
     doupdate();
 }
 
+// the line, or the reverse search prompt and its match
+static void
+_inp_draw(void)
+{
+    if (search_query == NULL) {
+        _inp_write(rl_line_buffer, rl_point);
+        return;
+    }
+
+    GString *display = g_string_new(search_failed ? "(failing " : "(");
+    g_string_append(display, search_scrollback ? "scrollback-i-search)`" : "reverse-i-search)`");
+    g_string_append(display, search_query->str);
+    g_string_append(display, "': ");
+    int offset = display->len + rl_point;
+    g_string_append(display, rl_line_buffer);
+    _inp_write(display->str, offset);
+    g_string_free(display, TRUE);
+}
+
+// nothing typed in an encrypted conversation is written to the history
+// file, secret bearing commands are left out by input_history_add
+static gboolean
+_inp_history_private(void)
+{
+    ProfWin *window = wins_get_current();
+    if (window && window->type == WIN_CHAT) {
+        ProfChatWin *chatwin = (ProfChatWin*)window;
+        if (chatwin->is_otr || chatwin->pgp_send) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+_inp_input_pending(void)
+{
+    fd_set pending;
+    struct timeval now = { 0, 0 };
+
+    // readline may already hold the next characters itself
+    if (rl_pending_input) {
+        return TRUE;
+    }
+
+    FD_ZERO(&pending);
+    FD_SET(fileno(rl_instream), &pending);
+
+    return (select(FD_SETSIZE, &pending, NULL, NULL, &now) > 0);
+}
+
 static int
 _inp_printable(const wint_t ch)
 {
@@ -296,25 +554,6 @@ _inp_printable(const wint_t ch)
     return g_unichar_isprint(unichar);
 }
 
-static int
-_inp_offset_to_col(char *str, int offset)
-{
-    int i = 0;
-    int col = 0;
-
-    while (i < offset && str[i] != '\0') {
-        gunichar uni = g_utf8_get_char(&str[i]);
-        size_t ch_len = mbrlen(&str[i], 4, NULL);
-        i += ch_len;
-        col++;
-        if (g_unichar_iswide(uni)) {
-            col++;
-        }
-    }
-
-    return col;
-}
-
 static void
 _inp_win_handle_scroll(void)
 {
@@ -384,8 +623,32 @@ _inp_rl_startup_hook(void)
     rl_bind_keyseq("\\e[6~", _inp_rl_pagedown_handler);
     rl_bind_keyseq("\\eOs", _inp_rl_pagedown_handler);
 
+    rl_bind_keyseq("\\e[200~", _inp_rl_paste_start_handler);
+    rl_bind_keyseq("\\e[201~", _inp_rl_paste_end_handler);
+
     rl_bind_key('\t', _inp_rl_tab_handler);
     rl_bind_key(CTRL('L'), _inp_rl_clear_handler);
+    rl_bind_key(CTRL('R'), _inp_rl_search_handler);
+    rl_bind_keyseq("\\es", _inp_rl_scrollback_search_handler);
+
+    // while searching, text edits the query and any other key ends the
+    // search and is then handled as usual
+    if (search_keymap == NULL) {
+        search_keymap = rl_make_bare_keymap();
+        int key;
+        for (key = 0; key < 256; key++) {
+            search_keymap[key].type = ISFUNC;
+            if (key >= ' ' && key != 127) {
+                search_keymap[key].function = _inp_rl_search_char_handler;
+            } else {
+                search_keymap[key].function = _inp_rl_search_exit_handler;
+            }
+        }
+        search_keymap[127].function = _inp_rl_search_backspace_handler;
+        search_keymap[CTRL('H')].function = _inp_rl_search_backspace_handler;
+        search_keymap[CTRL('R')].function = _inp_rl_search_handler;
+        search_keymap[CTRL('G')].function = _inp_rl_search_cancel_handler;
+    }
 
     // unbind unwanted mappings
     rl_bind_keyseq("\\e=", NULL);
@@ -399,6 +662,9 @@ _inp_rl_linehandler(char *line)
     if (line && *line) {
         if (!get_password) {
             add_history(line);
+            if (!_inp_history_private()) {
+                input_history_add(inp_history, line);
+            }
         }
     }
     inp_line = line;
@@ -581,3 +847,166 @@ _inp_rl_altpagedown_handler(int count, int key)
     win_sub_page_down(current);
     return 0;
 }
+
+static int
+_inp_rl_paste_start_handler(int count, int key)
+{
+    in_paste = TRUE;
+    return 0;
+}
+
+static int
+_inp_rl_paste_end_handler(int count, int key)
+{
+    in_paste = FALSE;
+    return 0;
+}
+
+static int
+_inp_rl_search_handler(int count, int key)
+{
+    if (search_query == NULL) {
+        search_query = g_string_new("");
+        search_match = -1;
+        search_failed = FALSE;
+        search_saved = strdup(rl_line_buffer);
+        search_prev_keymap = rl_get_keymap();
+        rl_set_keymap(search_keymap);
+    } else if (search_scrollback && !search_failed) {
+        _inp_search_scrollback(TRUE);
+    } else if (!search_failed) {
+        _inp_search_find(search_match);
+    }
+
+    return 0;
+}
+
+// the same search run over the messages in the current window, the line
+// being edited is left as it is
+static int
+_inp_rl_scrollback_search_handler(int count, int key)
+{
+    if (search_query == NULL) {
+        _inp_rl_search_handler(count, key);
+        search_scrollback = TRUE;
+        win_search_clear(wins_get_current());
+    }
+
+    return 0;
+}
+
+static int
+_inp_rl_search_char_handler(int count, int key)
+{
+    g_string_append_c(search_query, key);
+
+    // the line shown may still match the longer query
+    if (search_scrollback) {
+        _inp_search_scrollback(FALSE);
+    } else if (search_match == -1) {
+        _inp_search_find(-1);
+    } else {
+        _inp_search_find(search_match + 1);
+    }
+
+    return 0;
+}
+
+static int
+_inp_rl_search_backspace_handler(int count, int key)
+{
+    if (search_query->len == 0) {
+        return 0;
+    }
+
+    const char *prev = g_utf8_find_prev_char(search_query->str, search_query->str + search_query->len);
+    g_string_truncate(search_query, prev ? prev - search_query->str : 0);
+    search_failed = FALSE;
+    if (search_scrollback) {
+        win_search_clear(wins_get_current());
+        if (search_query->len > 0) {
+            _inp_search_scrollback(FALSE);
+        }
+    } else if (search_query->len == 0) {
+        search_match = -1;
+    } else {
+        _inp_search_find(-1);
+    }
+
+    return 0;
+}
+
+static int
+_inp_rl_search_cancel_handler(int count, int key)
+{
+    if (search_scrollback) {
+        win_move_to_end(wins_get_current());
+    } else {
+        rl_replace_line(search_saved, 0);
+        rl_point = rl_end;
+    }
+    _inp_search_end();
+
+    return 0;
+}
+
+static int
+_inp_rl_search_exit_handler(int count, int key)
+{
+    _inp_search_end();
+    rl_execute_next(key);
+
+    return 0;
+}
+
+// show the newest line before line number before matching the query
+static void
+_inp_search_find(int before)
+{
+    if (search_query->len == 0) {
+        return;
+    }
+
+    int found = input_history_search(inp_history, search_query->str, before);
+    if (found == -1) {
+        search_failed = TRUE;
+        rl_ding();
+        return;
+    }
+
+    const char *line = input_history_get(inp_history, found);
+    search_match = found;
+    search_failed = FALSE;
+    rl_replace_line(line, 0);
+    rl_point = strstr(line, search_query->str) - line;
+}
+
+// move the current window to the newest message matching the query,
+// the match stays shown once the search ends
+static void
+_inp_search_scrollback(gboolean older)
+{
+    if (search_query->len == 0) {
+        return;
+    }
+
+    if (win_search(wins_get_current(), search_query->str, older)) {
+        search_failed = FALSE;
+    } else {
+        search_failed = TRUE;
+        rl_ding();
+    }
+}
+
+static void
+_inp_search_end(void)
+{
+    rl_set_keymap(search_prev_keymap);
+    g_string_free(search_query, TRUE);
+    search_query = NULL;
+    free(search_saved);
+    search_saved = NULL;
+    search_match = -1;
+    search_failed = FALSE;
+    search_scrollback = FALSE;
+}
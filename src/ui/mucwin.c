@@ -34,11 +34,124 @@
 
 #include <assert.h>
 
+#include "common.h"
 #include "ui/win_types.h"
 #include "window_list.h"
 #include "log.h"
 #include "config/preferences.h"
 #include "ui/window.h"
+#include "tools/highlight.h"
+
+// bumped when the mention settings change, so each room builds its matcher
+// again for the next message
+static int mention_version = 1;
+
+void
+mucwin_mention_settings_changed(void)
+{
+    mention_version++;
+}
+
+// your nick or any trigger, found in one pass whatever the number of words
+static gboolean
+_mucwin_mentioned(ProfMucWin *mucwin, const char *const my_nick, const char *const message)
+{
+    if (mucwin->mentions == NULL || mucwin->mentions_version != mention_version ||
+            g_strcmp0(mucwin->mentions_nick, my_nick) != 0) {
+        highlight_free(mucwin->mentions);
+        mucwin->mentions = highlight_new(prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE),
+            prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD));
+        highlight_add(mucwin->mentions, my_nick);
+
+        GList *triggers = prefs_get_room_notify_triggers();
+        GList *curr = triggers;
+        while (curr) {
+            highlight_add(mucwin->mentions, curr->data);
+            curr = g_list_next(curr);
+        }
+        g_list_free_full(triggers, free);
+
+        g_free(mucwin->mentions_nick);
+        mucwin->mentions_nick = g_strdup(my_nick);
+        mucwin->mentions_version = mention_version;
+    }
+
+    return highlight_match(mucwin->mentions, message);
+}
+
+static const char *room_policies[] = { "live", "buffer", "digest", "mentions" };
+
+// unknown or missing names are the default, live
+room_policy_t
+mucwin_policy_from_name(const char *const name)
+{
+    int i;
+    for (i = 0; i < ARRAY_SIZE(room_policies); i++) {
+        if (g_strcmp0(room_policies[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return ROOM_POLICY_LIVE;
+}
+
+const char*
+mucwin_policy_name(room_policy_t policy)
+{
+    return room_policies[policy];
+}
+
+void
+mucwin_set_policy(ProfMucWin *mucwin, room_policy_t policy)
+{
+    assert(mucwin != NULL);
+
+    mucwin->policy = policy;
+    mucwin->digest_messages = 0;
+    mucwin->digest_mentions = 0;
+    if (policy == ROOM_POLICY_LIVE) {
+        prefs_set_room_policy(mucwin->roomjid, NULL);
+    } else {
+        prefs_set_room_policy(mucwin->roomjid, room_policies[policy]);
+    }
+}
+
+// shows and resets the counts gathered since the last digest
+void
+mucwin_digest(ProfMucWin *mucwin)
+{
+    assert(mucwin != NULL);
+
+    if (mucwin->policy != ROOM_POLICY_DIGEST || mucwin->digest_messages == 0) {
+        return;
+    }
+
+    int num = wins_get_num((ProfWin*)mucwin);
+    if (mucwin->digest_mentions > 0) {
+        cons_show("%s (win %d): %d new messages, %d mentioning you.", mucwin->roomjid, num,
+            mucwin->digest_messages, mucwin->digest_mentions);
+    } else {
+        cons_show("%s (win %d): %d new messages.", mucwin->roomjid, num, mucwin->digest_messages);
+    }
+    mucwin->digest_messages = 0;
+    mucwin->digest_mentions = 0;
+}
+
+// a quiet message is only stored, it is laid out when the room is focused
+// and raises no console notice, flash, beep or notification
+static gboolean
+_mucwin_quiet(ProfMucWin *mucwin, gboolean mentioned)
+{
+    switch (mucwin->policy) {
+    case ROOM_POLICY_BUFFER:
+    case ROOM_POLICY_DIGEST:
+        return TRUE;
+    case ROOM_POLICY_MENTIONS:
+        return !mentioned;
+    default:
+        return FALSE;
+    }
+}
 
 void
 mucwin_role_change(ProfMucWin *mucwin, const char *const role, const char *const actor, const char *const reason)
@@ -354,6 +467,45 @@ mucwin_history(ProfMucWin *mucwin, const char *const nick, GDateTime *timestamp,
     g_string_free(line, TRUE);
 }
 
+// messages from the room archive, newest first
+// returns how many messages were shown, the rest did not fit the buffer
+int
+mucwin_history_page(ProfMucWin *mucwin, GSList *messages)
+{
+    assert(mucwin != NULL);
+
+    ProfWin *window = (ProfWin*)mucwin;
+
+    int shown = 0;
+    GSList *curr = messages;
+    while (curr) {
+        ArchivedMessage *archived = curr->data;
+        GString *line = g_string_new("");
+        if (strncmp(archived->message, "/me ", 4) == 0) {
+            g_string_append(line, "*");
+            g_string_append(line, archived->from);
+            g_string_append(line, " ");
+            g_string_append(line, archived->message + 4);
+        } else {
+            g_string_append(line, archived->from);
+            g_string_append(line, ": ");
+            g_string_append(line, archived->message);
+        }
+
+        gboolean added = win_prepend(window, '-', 0, archived->timestamp, NO_COLOUR_DATE, 0, "", line->str);
+        g_string_free(line, TRUE);
+        if (!added) {
+            break;
+        }
+        shown++;
+        curr = g_slist_next(curr);
+    }
+
+    win_refresh_prepended(window);
+
+    return shown;
+}
+
 void
 mucwin_message(ProfMucWin *mucwin, const char *const nick, const char *const message)
 {
@@ -363,8 +515,22 @@ mucwin_message(ProfMucWin *mucwin, const char *const nick, const char *const mes
     int num = wins_get_num(window);
     char *my_nick = muc_nick(mucwin->roomjid);
 
+    gboolean mentioned = FALSE;
+    if (g_strcmp0(nick, my_nick) != 0) {
+        mentioned = _mucwin_mentioned(mucwin, my_nick, message);
+    }
+
+    gboolean quiet = !wins_is_current(window) && _mucwin_quiet(mucwin, mentioned);
+    if (quiet) {
+        win_hibernate(window);
+        mucwin->digest_messages++;
+        if (mentioned) {
+            mucwin->digest_mentions++;
+        }
+    }
+
     if (g_strcmp0(nick, my_nick) != 0) {
-        if (g_strrstr(message, my_nick)) {
+        if (mentioned) {
             win_print(window, '-', 0, NULL, NO_ME, THEME_ROOMMENTION, nick, message);
         } else {
             win_print(window, '-', 0, NULL, NO_ME, THEME_TEXT_THEM, nick, message);
@@ -380,13 +546,16 @@ mucwin_message(ProfMucWin *mucwin, const char *const nick, const char *const mes
     // not currently on groupchat window
     } else {
         status_bar_new(num);
+        wins_add_unread((ProfWin*)mucwin);
+        if (quiet) {
+            return;
+        }
+
         cons_show_incoming_message(nick, num);
 
         if (prefs_get_boolean(PREF_FLASH) && (strcmp(nick, my_nick) != 0)) {
             flash();
         }
-
-        mucwin->unread++;
     }
 
     int ui_index = num;
@@ -409,13 +578,7 @@ mucwin_message(ProfMucWin *mucwin, const char *const nick, const char *const mes
         notify = TRUE;
     }
     if (g_strcmp0(room_setting, "mention") == 0) {
-        char *message_lower = g_utf8_strdown(message, -1);
-        char *nick_lower = g_utf8_strdown(nick, -1);
-        if (g_strrstr(message_lower, nick_lower)) {
-            notify = TRUE;
-        }
-        g_free(message_lower);
-        g_free(nick_lower);
+        notify = mentioned;
     }
     prefs_free_string(room_setting);
 
@@ -604,12 +767,10 @@ mucwin_show_affiliation_list(ProfMucWin *mucwin, muc_affiliation_t affiliation)
         GSList *curr_occupant = occupants;
         while(curr_occupant) {
             Occupant *occupant = curr_occupant->data;
-            if (occupant->affiliation == affiliation) {
-                if (occupant->jid) {
-                    win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s (%s)", occupant->nick, occupant->jid);
-                } else {
-                    win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s", occupant->nick);
-                }
+            if (occupant->jid) {
+                win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s (%s)", occupant->nick, occupant->jid);
+            } else {
+                win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s", occupant->nick);
             }
 
             curr_occupant = g_slist_next(curr_occupant);
@@ -699,12 +860,10 @@ mucwin_show_role_list(ProfMucWin *mucwin, muc_role_t role)
         GSList *curr_occupant = occupants;
         while(curr_occupant) {
             Occupant *occupant = curr_occupant->data;
-            if (occupant->role == role) {
-                if (occupant->jid) {
-                    win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s (%s)", occupant->nick, occupant->jid);
-                } else {
-                    win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s", occupant->nick);
-                }
+            if (occupant->jid) {
+                win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s (%s)", occupant->nick, occupant->jid);
+            } else {
+                win_vprint(window, '!', 0, NULL, 0, 0, "", "  %s", occupant->nick);
             }
 
             curr_occupant = g_slist_next(curr_occupant);
@@ -51,23 +51,80 @@
 #include "window_list.h"
 #include "config/preferences.h"
 
+// notifications from one source within this long of the last one shown
+// are held back and shown together once it has passed
+#define NOTIFY_BURST_USEC (3 * G_USEC_PER_SEC)
+
+typedef struct notify_burst_t {
+    gint64 shown;
+    int held;
+    char *message;
+    int timeout;
+    const char *category;
+} NotifyBurst;
+
 static void _notify(const char *const message, int timeout, const char *const category);
+static void _notify_from(const char *const source, const char *const message, int timeout,
+    const char *const category);
+static void _notify_bursts_flush(void);
+static void _notify_burst_free(NotifyBurst *burst);
 
 static GTimer *remind_timer;
 
+// source to the notifications held back for it
+static GHashTable *bursts;
+
+#ifdef HAVE_LIBNOTIFY
+#if GLIB_CHECK_VERSION(2,32,0)
+// libnotify is only used from the sender thread, so a slow notification
+// daemon never holds up the UI
+typedef struct notify_job_t {
+    char *message;
+    int timeout;
+    const char *category;
+} NotifyJob;
+
+// an empty job tells the sender to stop
+static NotifyJob notify_stop;
+
+static GThread *sender;
+static GAsyncQueue *jobs;
+// errors from the sender, logged from the main thread
+static GAsyncQueue *errors;
+
+static gpointer _notify_sender(gpointer data);
+#endif
+static char* _notify_show(const char *const message, int timeout, const char *const category);
+#endif
+
 void
 notifier_initialise(void)
 {
     remind_timer = g_timer_new();
+    bursts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_notify_burst_free);
 }
 
 void
 notifier_uninit(void)
 {
+    g_hash_table_destroy(bursts);
+    bursts = NULL;
 #ifdef HAVE_LIBNOTIFY
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (sender) {
+        g_async_queue_push(jobs, &notify_stop);
+        g_thread_join(sender);
+        sender = NULL;
+        g_async_queue_unref(jobs);
+        jobs = NULL;
+        g_async_queue_unref(errors);
+        errors = NULL;
+    }
+#else
     if (notify_is_initted()) {
         notify_uninit();
     }
+#endif
 #endif
     g_timer_destroy(remind_timer);
 }
@@ -78,7 +135,9 @@ notify_typing(const char *const handle)
     char message[strlen(handle) + 1 + 11];
     sprintf(message, "%s: typing...", handle);
 
-    _notify(message, 10000, "Incoming message");
+    char *source = g_strdup_printf("typing/%s", handle);
+    _notify_from(source, message, 10000, "Incoming message");
+    g_free(source);
 }
 
 void
@@ -115,7 +174,7 @@ notify_message(ProfWin *window, const char *const name, const char *const text)
             g_string_append_printf(message, "\n%s", text);
         }
 
-        _notify(message->str, 10000, "incoming message");
+        _notify_from(name, message->str, 10000, "incoming message");
         g_string_free(message, TRUE);
     }
 }
@@ -129,7 +188,7 @@ notify_room_message(const char *const handle, const char *const room, int win, c
         g_string_append_printf(message, "\n%s", text);
     }
 
-    _notify(message->str, 10000, "incoming message");
+    _notify_from(room, message->str, 10000, "incoming message");
 
     g_string_free(message, TRUE);
 }
@@ -146,6 +205,17 @@ notify_subscription(const char *const from)
 void
 notify_remind(void)
 {
+    _notify_bursts_flush();
+#if defined(HAVE_LIBNOTIFY) && GLIB_CHECK_VERSION(2,32,0)
+    if (errors) {
+        char *error;
+        while ((error = g_async_queue_try_pop(errors)) != NULL) {
+            log_error("Error sending desktop notification: %s", error);
+            g_free(error);
+        }
+    }
+#endif
+
     gdouble elapsed = g_timer_elapsed(remind_timer, NULL);
     gint remind_period = prefs_get_notify_remind();
     if (remind_period > 0 && elapsed >= remind_period) {
@@ -195,39 +265,155 @@ notify_remind(void)
 }
 
 static void
-_notify(const char *const message, int timeout, const char *const category)
+_notify_burst_free(NotifyBurst *burst)
+{
+    free(burst->message);
+    free(burst);
+}
+
+// the first notification from a source is shown straight away, any more
+// within the burst are shown as one when it ends
+static void
+_notify_from(const char *const source, const char *const message, int timeout,
+    const char *const category)
 {
+    gint64 now = g_get_monotonic_time();
+    NotifyBurst *burst = g_hash_table_lookup(bursts, source);
+    if (burst == NULL) {
+        burst = malloc(sizeof(NotifyBurst));
+        burst->message = NULL;
+        burst->held = 0;
+        g_hash_table_insert(bursts, g_strdup(source), burst);
+    } else if (now - burst->shown < NOTIFY_BURST_USEC) {
+        free(burst->message);
+        burst->message = strdup(message);
+        burst->timeout = timeout;
+        burst->category = category;
+        burst->held++;
+        return;
+    }
+
+    burst->shown = now;
+    _notify(message, timeout, category);
+}
+
+static void
+_notify_bursts_flush(void)
+{
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, bursts);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        NotifyBurst *burst = value;
+        if (now - burst->shown < NOTIFY_BURST_USEC) {
+            continue;
+        }
+
+        if (burst->held == 0) {
+            g_hash_table_iter_remove(&iter);
+        } else {
+            if (burst->held == 1) {
+                _notify(burst->message, burst->timeout, burst->category);
+            } else {
+                char *summary = g_strdup_printf("%s\n(and %d more)", burst->message, burst->held - 1);
+                _notify(summary, burst->timeout, burst->category);
+                g_free(summary);
+            }
+            FREE_SET_NULL(burst->message);
+            burst->held = 0;
+            burst->shown = now;
+        }
+    }
+}
+
 #ifdef HAVE_LIBNOTIFY
-    log_debug("Attempting notification: %s", message);
-    if (notify_is_initted()) {
-        log_debug("Reinitialising libnotify");
-        notify_uninit();
-        notify_init("Profanity");
-    } else {
-        log_debug("Initialising libnotify");
+// one libnotify session is kept for the life of the process, returns why
+// the notification could not be shown
+static char*
+_notify_show(const char *const message, int timeout, const char *const category)
+{
+    if (!notify_is_initted()) {
         notify_init("Profanity");
     }
+    if (!notify_is_initted()) {
+        return g_strdup("Libnotify not initialised");
+    }
+
+    NotifyNotification *notification = notify_notification_new("Profanity", message, NULL);
+    notify_notification_set_timeout(notification, timeout);
+    notify_notification_set_category(notification, category);
+    notify_notification_set_urgency(notification, NOTIFY_URGENCY_NORMAL);
+
+    char *result = NULL;
+    GError *error = NULL;
+    if (!notify_notification_show(notification, &error)) {
+        result = g_strdup(error ? error->message : "unknown error");
+    }
+    if (error) {
+        g_error_free(error);
+    }
+    g_object_unref(notification);
+
+    return result;
+}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+static gpointer
+_notify_sender(gpointer data)
+{
+    while (TRUE) {
+        NotifyJob *job = g_async_queue_pop(jobs);
+        if (job == &notify_stop) {
+            break;
+        }
+
+        char *error = _notify_show(job->message, job->timeout, job->category);
+        if (error) {
+            g_async_queue_push(errors, error);
+        }
+        free(job->message);
+        free(job);
+    }
+
     if (notify_is_initted()) {
-        NotifyNotification *notification;
-        notification = notify_notification_new("Profanity", message, NULL);
-        notify_notification_set_timeout(notification, timeout);
-        notify_notification_set_category(notification, category);
-        notify_notification_set_urgency(notification, NOTIFY_URGENCY_NORMAL);
-
-        GError *error = NULL;
-        gboolean notify_success = notify_notification_show(notification, &error);
-
-        if (!notify_success) {
-            log_error("Error sending desktop notification:");
-            log_error("  -> Message : %s", message);
-            log_error("  -> Error   : %s", error->message);
-        } else {
-	    log_debug("Notification sent.");
-	}
+        notify_uninit();
+    }
+
+    return NULL;
+}
+#endif
+#endif
+
+static void
+_notify(const char *const message, int timeout, const char *const category)
+{
+#ifdef HAVE_LIBNOTIFY
+    log_debug("Attempting notification: %s", message);
+#if GLIB_CHECK_VERSION(2,32,0)
+    if (sender == NULL) {
+        jobs = g_async_queue_new();
+        errors = g_async_queue_new();
+        sender = g_thread_new("notify", _notify_sender, NULL);
+    }
+
+    NotifyJob *job = malloc(sizeof(NotifyJob));
+    job->message = strdup(message);
+    job->timeout = timeout;
+    job->category = category;
+    g_async_queue_push(jobs, job);
+#else
+    char *error = _notify_show(message, timeout, category);
+    if (error) {
+        log_error("Error sending desktop notification:");
+        log_error("  -> Message : %s", message);
+        log_error("  -> Error   : %s", error);
+        g_free(error);
     } else {
-        log_error("Libnotify not initialised.");
+        log_debug("Notification sent.");
     }
 #endif
+#endif
 #ifdef PLATFORM_CYGWIN
     NOTIFYICONDATA nid;
     nid.cbSize = sizeof(NOTIFYICONDATA);
@@ -33,95 +33,159 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ui/ui.h"
 #include "ui/window.h"
 #include "window_list.h"
 #include "config/preferences.h"
 
+// rooms whose occupants panel needs repainting, see occupantswin_draw_pending
+static GHashTable *dirty_rooms = NULL;
+
+// rows drawn for each occupant, by room
+static GHashTable *room_rows = NULL;
+
+static void _occupantswin_draw(const char *const roomjid);
+static void _occupantswin_list(PanelSlice *slice, GHashTable *rows_cache, const char *const roomjid,
+    muc_role_t role, gboolean by_role, gboolean showjid);
+
 static void
-_occuptantswin_occupant(ProfLayoutSplit *layout, Occupant *occupant, gboolean showjid)
+_occuptantswin_occupant(PanelSlice *slice, GHashTable *rows_cache, Occupant *occupant, gboolean showjid)
 {
-    const char *presence_str = string_from_resource_presence(occupant->presence);
-    theme_item_t presence_colour = theme_main_presence_attrs(presence_str);
-    wattron(layout->subwin, theme_attrs(presence_colour));
-
-    GString *msg = g_string_new("   ");
-    g_string_append(msg, occupant->nick);
-    win_printline_nowrap(layout->subwin, msg->str);
-    g_string_free(msg, TRUE);
-
-    if (showjid && occupant->jid) {
-        GString *msg = g_string_new("     ");
-        g_string_append(msg, occupant->jid);
-        win_printline_nowrap(layout->subwin, msg->str);
+    PanelRows *rows = win_panel_rows(rows_cache, occupant->nick, slice->win, occupant->version, showjid);
+    if (rows->text->len == 0) {
+        const char *presence_str = string_from_resource_presence(occupant->presence);
+        theme_item_t presence_colour = theme_main_presence_attrs(presence_str);
+
+        GString *msg = g_string_new("   ");
+        g_string_append(msg, occupant->nick);
+        win_panel_rows_add(rows, presence_colour, msg->str);
         g_string_free(msg, TRUE);
+
+        if (showjid && occupant->jid) {
+            GString *msg = g_string_new("     ");
+            g_string_append(msg, occupant->jid);
+            win_panel_rows_add(rows, presence_colour, msg->str);
+            g_string_free(msg, TRUE);
+        }
     }
 
-    wattroff(layout->subwin, theme_attrs(presence_colour));
+    win_panel_put(slice, rows);
 }
 
+// repaints are coalesced, the panel is drawn once by the next ui_update
 void
 occupantswin_occupants(const char *const roomjid)
 {
+    if (dirty_rooms == NULL) {
+        dirty_rooms = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    }
+    if (!g_hash_table_lookup(dirty_rooms, roomjid)) {
+        g_hash_table_insert(dirty_rooms, strdup(roomjid), GINT_TO_POINTER(TRUE));
+    }
+}
+
+void
+occupantswin_draw_pending(void)
+{
+    if (dirty_rooms == NULL || g_hash_table_size(dirty_rooms) == 0) {
+        return;
+    }
+
+    GList *rooms = g_hash_table_get_keys(dirty_rooms);
+    GList *curr = rooms;
+    while (curr) {
+        _occupantswin_draw(curr->data);
+        curr = g_list_next(curr);
+    }
+    g_list_free(rooms);
+    g_hash_table_remove_all(dirty_rooms);
+    ui_mark_dirty();
+}
+
+static void
+_occupantswin_draw(const char *const roomjid)
+{
+    if (room_rows == NULL) {
+        room_rows = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_hash_table_destroy);
+    }
+
     ProfMucWin *mucwin = wins_get_muc(roomjid);
-    if (mucwin) {
-        GList *occupants = muc_roster(roomjid);
-        if (occupants) {
-            ProfLayoutSplit *layout = (ProfLayoutSplit*)mucwin->window.layout;
-            assert(layout->memcheck == LAYOUT_SPLIT_MEMCHECK);
-
-            werase(layout->subwin);
-
-            if (prefs_get_boolean(PREF_MUC_PRIVILEGES)) {
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_printline_nowrap(layout->subwin, " -Moderators");
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                GList *roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant *occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_MODERATOR) {
-                        _occuptantswin_occupant(layout, occupant, mucwin->showjid);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                }
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_printline_nowrap(layout->subwin, " -Participants");
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant *occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_PARTICIPANT) {
-                        _occuptantswin_occupant(layout, occupant, mucwin->showjid);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                }
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_printline_nowrap(layout->subwin, " -Visitors");
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant *occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_VISITOR) {
-                        _occuptantswin_occupant(layout, occupant, mucwin->showjid);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                }
-            } else {
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_printline_nowrap(layout->subwin, " -Occupants\n");
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                GList *roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant *occupant = roster_curr->data;
-                    _occuptantswin_occupant(layout, occupant, mucwin->showjid);
-                    roster_curr = g_list_next(roster_curr);
-                }
-            }
+    if (mucwin == NULL) {
+        // the room was closed, its rows are not needed again
+        g_hash_table_remove(room_rows, roomjid);
+        return;
+    }
+
+    GHashTable *rows_cache = g_hash_table_lookup(room_rows, roomjid);
+    if (rows_cache == NULL) {
+        rows_cache = win_panel_cache_new();
+        g_hash_table_insert(room_rows, strdup(roomjid), rows_cache);
+    }
+
+    ProfLayoutSplit *layout = (ProfLayoutSplit*)mucwin->window.layout;
+    assert(layout->memcheck == LAYOUT_SPLIT_MEMCHECK);
+    if (muc_roster_size(roomjid) > 0 && layout->subwin) {
+        PanelSlice slice;
+        win_panel_begin(layout, &slice);
+
+        if (prefs_get_boolean(PREF_MUC_PRIVILEGES)) {
+            win_panel_header(&slice, THEME_OCCUPANTS_HEADER, " -Moderators");
+            _occupantswin_list(&slice, rows_cache, roomjid, MUC_ROLE_MODERATOR, TRUE, mucwin->showjid);
+            win_panel_header(&slice, THEME_OCCUPANTS_HEADER, " -Participants");
+            _occupantswin_list(&slice, rows_cache, roomjid, MUC_ROLE_PARTICIPANT, TRUE, mucwin->showjid);
+            win_panel_header(&slice, THEME_OCCUPANTS_HEADER, " -Visitors");
+            _occupantswin_list(&slice, rows_cache, roomjid, MUC_ROLE_VISITOR, TRUE, mucwin->showjid);
+        } else {
+            win_panel_header(&slice, THEME_OCCUPANTS_HEADER, " -Occupants");
+            _occupantswin_list(&slice, rows_cache, roomjid, MUC_ROLE_NONE, FALSE, mucwin->showjid);
         }
 
-        g_list_free(occupants);
+        win_panel_end(layout, &slice);
+        win_panel_cache_prune(rows_cache);
+    }
+}
+
+// the occupants in nick order, of one role or all of them, only the ones
+// in the drawn slice of the panel are laid out, with one row each they are
+// found by position in the room's index
+static void
+_occupantswin_list(PanelSlice *slice, GHashTable *rows_cache, const char *const roomjid,
+    muc_role_t role, gboolean by_role, gboolean showjid)
+{
+    int count = by_role ? muc_occupants_count_by_role(roomjid, role) : muc_roster_size(roomjid);
+    int pos = 0;
+    if (!showjid) {
+        if (!win_panel_shows(slice, count)) {
+            win_panel_skip(slice, count);
+            return;
+        }
+        if (slice->row < slice->first) {
+            pos = slice->first - slice->row;
+            win_panel_skip(slice, pos);
+        }
+    }
+
+    MucRosterIter iter;
+    if (by_role) {
+        muc_roster_role_iter_init(&iter, roomjid, role, pos);
+    } else {
+        muc_roster_iter_init(&iter, roomjid, pos);
+    }
+
+    Occupant *occupant = NULL;
+    while ((occupant = muc_roster_iter_next(&iter))) {
+        pos++;
+        int rows = (showjid && occupant->jid) ? 2 : 1;
+        if (win_panel_shows(slice, rows)) {
+            _occuptantswin_occupant(slice, rows_cache, occupant, showjid);
+        } else if (!showjid) {
+            win_panel_skip(slice, count - pos + 1);
+            return;
+        } else {
+            win_panel_skip(slice, rows);
+        }
     }
 }
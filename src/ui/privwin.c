@@ -59,7 +59,7 @@ privwin_incoming_msg(ProfPrivateWin *privatewin, const char *const message, GDat
 
     // not currently viewing chat window with sender
     } else {
-        privatewin->unread++;
+        wins_add_unread((ProfWin*)privatewin);
         status_bar_new(num);
         cons_show_incoming_message(display_from, num);
         win_print_incoming_message(window, timestamp, display_from, message, PROF_MSG_PLAIN);
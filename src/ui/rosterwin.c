@@ -41,157 +41,185 @@
 #include "window_list.h"
 #include "config/preferences.h"
 #include "roster_list.h"
+#include "tools/stats.h"
+
+// set when the roster panel needs repainting, see rosterwin_draw_pending
+static gboolean roster_dirty = FALSE;
+
+// rows drawn for each contact, and the roster settings they depend on,
+// worked out once per repaint
+static GHashTable *contact_rows = NULL;
+static gboolean show_offline = FALSE;
+static gboolean show_resources = FALSE;
 
 static void
-_rosterwin_contact(ProfLayoutSplit *layout, PContact contact)
+_rosterwin_contact_rows(PanelRows *rows, PContact contact, const char *const presence)
 {
     const char *name = p_contact_name_or_jid(contact);
+    theme_item_t presence_colour = theme_main_presence_attrs(presence);
+
+    GString *msg = g_string_new("   ");
+    g_string_append(msg, name);
+    win_panel_rows_add(rows, presence_colour, msg->str);
+    g_string_free(msg, TRUE);
+
+    if (show_resources) {
+        PContactResourceIter iter;
+        p_contact_resource_iter_init(&iter, contact);
+        Resource *resource;
+        while ((resource = p_contact_resource_iter_next(&iter))) {
+            const char *resource_presence = string_from_resource_presence(resource->presence);
+            theme_item_t resource_presence_colour = theme_main_presence_attrs(resource_presence);
+
+            GString *msg = g_string_new("     ");
+            g_string_append(msg, resource->name);
+            win_panel_rows_add(rows, resource_presence_colour, msg->str);
+            g_string_free(msg, TRUE);
+        }
+    }
+}
+
+// contacts outside the drawn slice of the panel are only counted
+static void
+_rosterwin_contact(PanelSlice *slice, PContact contact)
+{
     const char *presence = p_contact_presence(contact);
 
-    if ((g_strcmp0(presence, "offline") != 0) || ((g_strcmp0(presence, "offline") == 0) &&
-            (prefs_get_boolean(PREF_ROSTER_OFFLINE)))) {
-        theme_item_t presence_colour = theme_main_presence_attrs(presence);
-
-        wattron(layout->subwin, theme_attrs(presence_colour));
-        GString *msg = g_string_new("   ");
-        g_string_append(msg, name);
-        win_printline_nowrap(layout->subwin, msg->str);
-        g_string_free(msg, TRUE);
-        wattroff(layout->subwin, theme_attrs(presence_colour));
-
-        if (prefs_get_boolean(PREF_ROSTER_RESOURCE)) {
-            GList *resources = p_contact_get_available_resources(contact);
-            GList *curr_resource = resources;
-            while (curr_resource) {
-                Resource *resource = curr_resource->data;
-                const char *resource_presence = string_from_resource_presence(resource->presence);
-                theme_item_t resource_presence_colour = theme_main_presence_attrs(resource_presence);
-
-                wattron(layout->subwin, theme_attrs(resource_presence_colour));
-                GString *msg = g_string_new("     ");
-                g_string_append(msg, resource->name);
-                win_printline_nowrap(layout->subwin, msg->str);
-                g_string_free(msg, TRUE);
-                wattroff(layout->subwin, theme_attrs(resource_presence_colour));
-
-                curr_resource = g_list_next(curr_resource);
-            }
-            g_list_free(resources);
+    if ((g_strcmp0(presence, "offline") != 0) || show_offline) {
+        int count = 1;
+        if (show_resources) {
+            count += p_contact_resource_count(contact);
         }
+        if (!win_panel_shows(slice, count)) {
+            win_panel_skip(slice, count);
+            return;
+        }
+
+        PanelRows *rows = win_panel_rows(contact_rows, p_contact_barejid(contact), slice->win,
+            p_contact_version(contact), show_resources);
+        if (rows->text->len == 0) {
+            _rosterwin_contact_rows(rows, contact, presence);
+        }
+        win_panel_put(slice, rows);
+    }
+}
+
+static void
+_rosterwin_contacts(PanelSlice *slice, GSList *contacts)
+{
+    GSList *curr_contact = contacts;
+    while (curr_contact) {
+        PContact contact = curr_contact->data;
+        _rosterwin_contact(slice, contact);
+        curr_contact = g_slist_next(curr_contact);
     }
 }
 
 static void
-_rosterwin_contacts_by_presence(ProfLayoutSplit *layout, const char *const presence, char *title)
+_rosterwin_contacts_by_presence(PanelSlice *slice, const char *const presence, char *title)
 {
     GSList *contacts = roster_get_contacts_by_presence(presence);
 
     // if this group has contacts, or if we want to show empty groups
     if (contacts || prefs_get_boolean(PREF_ROSTER_EMPTY)) {
-        wattron(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
-        win_printline_nowrap(layout->subwin, title);
-        wattroff(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
+        win_panel_header(slice, THEME_ROSTER_HEADER, title);
     }
 
-    if (contacts) {
-        GSList *curr_contact = contacts;
-        while (curr_contact) {
-            PContact contact = curr_contact->data;
-            _rosterwin_contact(layout, contact);
-            curr_contact = g_slist_next(curr_contact);
-        }
-    }
+    _rosterwin_contacts(slice, contacts);
     g_slist_free(contacts);
 }
 
 static void
-_rosterwin_contacts_by_group(ProfLayoutSplit *layout, char *group)
+_rosterwin_contacts_by_group(PanelSlice *slice, char *group)
 {
-    wattron(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
     GString *title = g_string_new(" -");
     g_string_append(title, group);
-    win_printline_nowrap(layout->subwin, title->str);
+    win_panel_header(slice, THEME_ROSTER_HEADER, title->str);
     g_string_free(title, TRUE);
-    wattroff(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
 
     GSList *contacts = roster_get_group(group);
-    if (contacts) {
-        GSList *curr_contact = contacts;
-        while (curr_contact) {
-            PContact contact = curr_contact->data;
-            _rosterwin_contact(layout, contact);
-            curr_contact = g_slist_next(curr_contact);
-        }
-    }
+    _rosterwin_contacts(slice, contacts);
     g_slist_free(contacts);
 }
 
 static void
-_rosterwin_contacts_by_no_group(ProfLayoutSplit *layout)
+_rosterwin_contacts_by_no_group(PanelSlice *slice)
 {
     GSList *contacts = roster_get_nogroup();
     if (contacts) {
-        wattron(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
-        win_printline_nowrap(layout->subwin, " -no group");
-        wattroff(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
-
-        GSList *curr_contact = contacts;
-        while (curr_contact) {
-            PContact contact = curr_contact->data;
-            _rosterwin_contact(layout, contact);
-            curr_contact = g_slist_next(curr_contact);
-        }
+        win_panel_header(slice, THEME_ROSTER_HEADER, " -no group");
+        _rosterwin_contacts(slice, contacts);
     }
     g_slist_free(contacts);
 }
 
+// repaints are coalesced, the panel is drawn once by the next ui_update
 void
 rosterwin_roster(void)
 {
+    roster_dirty = TRUE;
+}
+
+void
+rosterwin_draw_pending(void)
+{
+    if (!roster_dirty) {
+        return;
+    }
+    roster_dirty = FALSE;
+    ui_mark_dirty();
+
     ProfWin *console = wins_get_console();
     if (console) {
         ProfLayoutSplit *layout = (ProfLayoutSplit*)console->layout;
         assert(layout->memcheck == LAYOUT_SPLIT_MEMCHECK);
+        if (layout->subwin == NULL) {
+            return;
+        }
+
+        gint64 start = stats_start();
+        if (contact_rows == NULL) {
+            contact_rows = win_panel_cache_new();
+        }
+        show_offline = prefs_get_boolean(PREF_ROSTER_OFFLINE);
+        show_resources = prefs_get_boolean(PREF_ROSTER_RESOURCE);
 
-       char *by = prefs_get_string(PREF_ROSTER_BY);
+        PanelSlice slice;
+        const char *by = prefs_peek_string(PREF_ROSTER_BY);
         if (g_strcmp0(by, "presence") == 0) {
-            werase(layout->subwin);
-            _rosterwin_contacts_by_presence(layout, "chat", " -Available for chat");
-            _rosterwin_contacts_by_presence(layout, "online", " -Online");
-            _rosterwin_contacts_by_presence(layout, "away", " -Away");
-            _rosterwin_contacts_by_presence(layout, "xa", " -Extended Away");
-            _rosterwin_contacts_by_presence(layout, "dnd", " -Do not disturb");
-            if (prefs_get_boolean(PREF_ROSTER_OFFLINE)) {
-                _rosterwin_contacts_by_presence(layout, "offline", " -Offline");
+            win_panel_begin(layout, &slice);
+            _rosterwin_contacts_by_presence(&slice, "chat", " -Available for chat");
+            _rosterwin_contacts_by_presence(&slice, "online", " -Online");
+            _rosterwin_contacts_by_presence(&slice, "away", " -Away");
+            _rosterwin_contacts_by_presence(&slice, "xa", " -Extended Away");
+            _rosterwin_contacts_by_presence(&slice, "dnd", " -Do not disturb");
+            if (show_offline) {
+                _rosterwin_contacts_by_presence(&slice, "offline", " -Offline");
             }
+            win_panel_end(layout, &slice);
         } else if (g_strcmp0(by, "group") == 0) {
-            werase(layout->subwin);
+            win_panel_begin(layout, &slice);
             GSList *groups = roster_get_groups();
             GSList *curr_group = groups;
             while (curr_group) {
-                _rosterwin_contacts_by_group(layout, curr_group->data);
+                _rosterwin_contacts_by_group(&slice, curr_group->data);
                 curr_group = g_slist_next(curr_group);
             }
             g_slist_free_full(groups, free);
-            _rosterwin_contacts_by_no_group(layout);
+            _rosterwin_contacts_by_no_group(&slice);
+            win_panel_end(layout, &slice);
         } else {
             GSList *contacts = roster_get_contacts();
             if (contacts) {
-                werase(layout->subwin);
-
-                wattron(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
-                win_printline_nowrap(layout->subwin, " -Roster");
-                wattroff(layout->subwin, theme_attrs(THEME_ROSTER_HEADER));
-
-                GSList *curr_contact = contacts;
-                while (curr_contact) {
-                    PContact contact = curr_contact->data;
-                    _rosterwin_contact(layout, contact);
-                    curr_contact = g_slist_next(curr_contact);
-                }
+                win_panel_begin(layout, &slice);
+                win_panel_header(&slice, THEME_ROSTER_HEADER, " -Roster");
+                _rosterwin_contacts(&slice, contacts);
+                win_panel_end(layout, &slice);
             }
             g_slist_free(contacts);
         }
-        free(by);
+
+        win_panel_cache_prune(contact_rows);
+        stats_record(STATS_ROSTERWIN, start);
     }
 }
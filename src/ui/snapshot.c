@@ -0,0 +1,346 @@
+/*
+ * snapshot.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common.h"
+#include "log.h"
+#include "config/preferences.h"
+#include "ui/ui.h"
+#include "ui/buffer.h"
+#include "ui/statusbar.h"
+#include "ui/win_types.h"
+#include "ui/window.h"
+#include "window_list.h"
+#include "xmpp/xmpp.h"
+
+// The snapshot is a serialised GVariant, read straight from the mapped
+// file: a format version, the number of theme items and the known flags,
+// then for each chat window its number, jid and buffer entries as show
+// char, indent, time, flags, theme item, from and message, the oldest entry
+// first. Theme items and flags are stored as numbers, a file written when
+// either was different is not read.
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_TYPE "(uuua(isa(yixiiss)))"
+#define SNAPSHOT_ENTRY_TYPE "(yixiiss)"
+
+#define SNAPSHOT_THEME_ITEMS (THEME_MAGENTA_BOLD + 1)
+#define SNAPSHOT_FLAGS (NO_ME | NO_DATE | NO_EOL | NO_COLOUR_FROM | NO_COLOUR_DATE)
+
+// what the windows held at the last save, a save that would write the same
+// is skipped
+static guint last_saved = 0;
+
+// the account whose snapshot has been restored, only once per run so
+// windows closed since are not brought back by a reconnect
+static gchar *restored_account = NULL;
+
+static gchar* _snapshot_dir(void);
+static gchar* _snapshot_file(const char *const account_name);
+static guint _snapshot_key(const char *const account_name);
+static gboolean _snapshot_skipped(ProfChatWin *chatwin);
+static GVariant* _snapshot_window(ProfChatWin *chatwin);
+static void _snapshot_restore_window(GVariant *window);
+
+// written every few minutes and at exit for the account logged in, only
+// while /wins restore and chat logging are on
+void
+snapshot_save(void)
+{
+    if (!prefs_get_boolean(PREF_WINS_RESTORE) || !prefs_get_boolean(PREF_CHLOG)) {
+        return;
+    }
+
+    const char *account_name = jabber_get_account_name();
+    if (account_name == NULL) {
+        return;
+    }
+
+    guint key = _snapshot_key(account_name);
+    if (key == last_saved) {
+        return;
+    }
+
+    GVariantBuilder windows;
+    g_variant_builder_init(&windows, G_VARIANT_TYPE("a(isa(yixiiss))"));
+    GList *nums = wins_get_nums();
+    GList *curr = nums;
+    while (curr) {
+        ProfWin *window = wins_get_by_num(GPOINTER_TO_INT(curr->data));
+        if (window && window->type == WIN_CHAT && !_snapshot_skipped((ProfChatWin*)window)) {
+            g_variant_builder_add_value(&windows, _snapshot_window((ProfChatWin*)window));
+        }
+        curr = g_list_next(curr);
+    }
+    g_list_free(nums);
+
+    GVariant *snapshot = g_variant_ref_sink(g_variant_new("(uuu@a(isa(yixiiss)))", SNAPSHOT_VERSION,
+        SNAPSHOT_THEME_ITEMS, SNAPSHOT_FLAGS, g_variant_builder_end(&windows)));
+
+    gchar *filename = _snapshot_file(account_name);
+    GError *error = NULL;
+    if (g_file_set_contents(filename, g_variant_get_data(snapshot), g_variant_get_size(snapshot), &error)) {
+        g_chmod(filename, S_IRUSR | S_IWUSR);
+        last_saved = key;
+    } else {
+        log_error("Could not save window snapshot %s: %s", filename, error->message);
+        g_error_free(error);
+    }
+    g_free(filename);
+    g_variant_unref(snapshot);
+}
+
+// put back the chat windows of the account's last session once it has
+// logged in, their messages are shown as they were and the chat log is not
+// read again
+void
+snapshot_restore(const char *const account_name)
+{
+    if (!prefs_get_boolean(PREF_WINS_RESTORE)) {
+        return;
+    }
+    if (g_strcmp0(restored_account, account_name) == 0) {
+        return;
+    }
+    g_free(restored_account);
+    restored_account = g_strdup(account_name);
+
+    gchar *filename = _snapshot_file(account_name);
+    GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+    g_free(filename);
+    if (map == NULL) {
+        return;
+    }
+
+    GBytes *bytes = g_mapped_file_get_bytes(map);
+    g_mapped_file_unref(map);
+    GVariant *snapshot = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(SNAPSHOT_TYPE), bytes, FALSE));
+    g_bytes_unref(bytes);
+
+    guint32 version = 0;
+    guint32 theme_items = 0;
+    guint32 flags = 0;
+    GVariant *windows = NULL;
+    g_variant_get(snapshot, "(uuu@a(isa(yixiiss)))", &version, &theme_items, &flags, &windows);
+    if (version != SNAPSHOT_VERSION || theme_items != SNAPSHOT_THEME_ITEMS || flags != SNAPSHOT_FLAGS) {
+        log_info("Ignoring window snapshot written by another version");
+    } else {
+        gsize count = g_variant_n_children(windows);
+        gsize i;
+        for (i = 0; i < count; i++) {
+            GVariant *window = g_variant_get_child_value(windows, i);
+            _snapshot_restore_window(window);
+            g_variant_unref(window);
+        }
+        log_info("Restored %d windows from snapshot", (int)count);
+    }
+    g_variant_unref(windows);
+    g_variant_unref(snapshot);
+
+    last_saved = _snapshot_key(account_name);
+}
+
+// forget the snapshots of every account, for when /wins restore is turned
+// off
+void
+snapshot_clear(void)
+{
+    gchar *dirname = _snapshot_dir();
+    GDir *dir = g_dir_open(dirname, 0, NULL);
+    if (dir) {
+        const gchar *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            gchar *filename = g_build_filename(dirname, name, NULL);
+            if (g_remove(filename) == -1 && errno != ENOENT) {
+                log_error("Could not remove window snapshot %s: %s", filename, strerror(errno));
+            }
+            g_free(filename);
+        }
+        g_dir_close(dir);
+    }
+    g_free(dirname);
+
+    // the single snapshot written before they were kept per account
+    gchar *data_home = xdg_get_data_home();
+    gchar *legacy = g_strdup_printf("%s/profanity/snapshot", data_home);
+    g_remove(legacy);
+    g_free(legacy);
+    g_free(data_home);
+
+    last_saved = 0;
+}
+
+static gchar*
+_snapshot_dir(void)
+{
+    gchar *data_home = xdg_get_data_home();
+    gchar *dirname = g_strdup_printf("%s/profanity/snapshots", data_home);
+    g_free(data_home);
+
+    return dirname;
+}
+
+static gchar*
+_snapshot_file(const char *const account_name)
+{
+    gchar *dirname = _snapshot_dir();
+    if (g_mkdir_with_parents(dirname, S_IRWXU) == -1) {
+        log_error("Error creating directory: %s, %s", dirname, strerror(errno));
+    }
+
+    gchar *account_file = str_replace(account_name, "@", "_at_");
+    gchar *filename = g_strdup_printf("%s/%s", dirname, account_file);
+    free(account_file);
+    g_free(dirname);
+
+    return filename;
+}
+
+// encrypted conversations are never written out, nor are those of a window
+// that has shown an encrypted message since
+static gboolean
+_snapshot_skipped(ProfChatWin *chatwin)
+{
+    if (chatwin->is_otr || chatwin->pgp_send || chatwin->pgp_recv) {
+        return TRUE;
+    }
+
+    char otr_char = prefs_get_otr_char();
+    char pgp_char = prefs_get_pgp_char();
+    ProfBuff buffer = ((ProfWin*)chatwin)->layout->buffer;
+    ProfBuffIter iter;
+    ProfBuffEntry *e = NULL;
+    buffer_iter_init(&iter, buffer);
+    while ((e = buffer_iter_next(&iter))) {
+        if (e->show_char == otr_char || e->show_char == pgp_char) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// changes with the account, the chat windows, their numbers and newest
+// messages
+static guint
+_snapshot_key(const char *const account_name)
+{
+    guint key = 17 * 31 + g_str_hash(account_name);
+    GList *nums = wins_get_nums();
+    GList *curr = nums;
+    while (curr) {
+        ProfWin *window = wins_get_by_num(GPOINTER_TO_INT(curr->data));
+        if (window && window->type == WIN_CHAT) {
+            ProfBuff buffer = window->layout->buffer;
+            int size = buffer_size(buffer);
+            ProfBuffEntry *last = buffer_yield_entry(buffer, size - 1);
+            key = key * 31 + g_str_hash(((ProfChatWin*)window)->barejid);
+            key = key * 31 + window->num;
+            key = key * 31 + size;
+            key = key * 31 + (last ? (guint)last->time : 0);
+        }
+        curr = g_list_next(curr);
+    }
+    g_list_free(nums);
+
+    return key;
+}
+
+static GVariant*
+_snapshot_window(ProfChatWin *chatwin)
+{
+    ProfWin *window = (ProfWin*)chatwin;
+    ProfBuff buffer = window->layout->buffer;
+
+    GVariantBuilder entries;
+    g_variant_builder_init(&entries, G_VARIANT_TYPE("a" SNAPSHOT_ENTRY_TYPE));
+    int size = buffer_size(buffer);
+    int i;
+    for (i = 0; i < size; i++) {
+        ProfBuffEntry *e = buffer_yield_entry(buffer, i);
+        g_variant_builder_add(&entries, SNAPSHOT_ENTRY_TYPE, (guchar)e->show_char, e->pad_indent, e->time,
+            e->flags, (gint32)e->theme_item, e->from ? e->from : "", e->message ? e->message : "");
+    }
+
+    return g_variant_new("(is@a" SNAPSHOT_ENTRY_TYPE ")", window->num, chatwin->barejid,
+        g_variant_builder_end(&entries));
+}
+
+static void
+_snapshot_restore_window(GVariant *window)
+{
+    gint32 num = 0;
+    const char *barejid = NULL;
+    GVariant *entries = NULL;
+    g_variant_get(window, "(i&s@a" SNAPSHOT_ENTRY_TYPE ")", &num, &barejid, &entries);
+
+    if (barejid[0] == '\0' || wins_get_chat(barejid)) {
+        g_variant_unref(entries);
+        return;
+    }
+
+    ProfWin *restored = wins_restore_chat(barejid, num);
+    ProfBuff buffer = restored->layout->buffer;
+
+    GVariantIter iter;
+    g_variant_iter_init(&iter, entries);
+    guchar show_char = 0;
+    gint32 pad_indent = 0;
+    gint64 time = 0;
+    gint32 flags = 0;
+    gint32 theme_item = 0;
+    const char *from = NULL;
+    const char *message = NULL;
+    while (g_variant_iter_next(&iter, "(yixii&s&s)", &show_char, &pad_indent, &time, &flags, &theme_item,
+            &from, &message)) {
+        GDateTime *timestamp = g_date_time_new_from_unix_local(time / G_USEC_PER_SEC);
+        buffer_push(buffer, show_char, pad_indent, timestamp, flags, theme_item, from, message, NULL);
+        g_date_time_unref(timestamp);
+    }
+    g_variant_unref(entries);
+
+    // the restored messages stand in for the chat log history
+    ((ProfChatWin*)restored)->history_shown = TRUE;
+    win_redraw(restored);
+    status_bar_active(restored->num);
+}
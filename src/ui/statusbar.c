@@ -62,13 +62,21 @@ static GHashTable *remaining_active;
 static int is_new[12];
 static GHashTable *remaining_new;
 static GDateTime *last_time;
+static char *drawn_time = NULL;
 static int current;
 
+// between status_bar_batch_begin and status_bar_batch_end slots are only
+// marked, the bar is drawn once at the end
+static gboolean in_batch = FALSE;
+static gboolean batch_draw = FALSE;
+
 static void _update_win_statuses(void);
 static void _mark_new(int num);
 static void _mark_active(int num);
 static void _mark_inactive(int num);
+static void _status_bar_set_slot(int num, gboolean active, gboolean new);
 static void _status_bar_draw(void);
+static gchar* _status_bar_time(GDateTime *time);
 
 void
 create_status_bar(void)
@@ -103,10 +111,30 @@ create_status_bar(void)
     _status_bar_draw();
 }
 
+// called every main loop, only the clock can have changed since the bar was
+// last drawn so nothing is drawn until its text does
 void
 status_bar_update_virtual(void)
 {
-    _status_bar_draw();
+    GDateTime *now = g_date_time_new_now_local();
+    if (last_time && (g_date_time_to_unix(now) == g_date_time_to_unix(last_time))) {
+        g_date_time_unref(now);
+        return;
+    }
+
+    gchar *time_str = _status_bar_time(now);
+    gboolean changed = g_strcmp0(time_str, drawn_time) != 0;
+    g_free(time_str);
+
+    if (changed) {
+        _status_bar_draw();
+    } else {
+        if (last_time) {
+            g_date_time_unref(last_time);
+        }
+        last_time = g_date_time_ref(now);
+    }
+    g_date_time_unref(now);
 }
 
 void
@@ -128,7 +156,7 @@ status_bar_resize(void)
     wattroff(status_bar, bracket_attrs);
 
     if (message) {
-        char *time_pref = prefs_get_string(PREF_TIME_STATUSBAR);
+        const char *time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
 
         gchar *date_fmt = NULL;
         if (g_strcmp0(time_pref, "off") == 0) {
@@ -146,7 +174,6 @@ status_bar_resize(void)
         } else {
             mvwprintw(status_bar, 0, 1, message);
         }
-        prefs_free_string(time_pref);
     }
     if (last_time) {
         g_date_time_unref(last_time);
@@ -156,6 +183,22 @@ status_bar_resize(void)
     _status_bar_draw();
 }
 
+void
+status_bar_batch_begin(void)
+{
+    in_batch = TRUE;
+}
+
+void
+status_bar_batch_end(void)
+{
+    in_batch = FALSE;
+    if (batch_draw) {
+        batch_draw = FALSE;
+        _status_bar_draw();
+    }
+}
+
 void
 status_bar_set_all_inactive(void)
 {
@@ -207,31 +250,21 @@ status_bar_inactive(const int win)
 
         // still have new windows
         if (g_hash_table_size(remaining_new) != 0) {
-            is_active[11] = TRUE;
-            is_new[11] = TRUE;
-            _mark_new(11);
+            _status_bar_set_slot(11, TRUE, TRUE);
 
         // still have active windows
         } else if (g_hash_table_size(remaining_active) != 0) {
-            is_active[11] = TRUE;
-            is_new[11] = FALSE;
-            _mark_active(11);
+            _status_bar_set_slot(11, TRUE, FALSE);
 
         // no active or new windows
         } else {
-            is_active[11] = FALSE;
-            is_new[11] = FALSE;
-            _mark_inactive(11);
+            _status_bar_set_slot(11, FALSE, FALSE);
         }
 
     // visible window indicators
     } else {
-        is_active[true_win] = FALSE;
-        is_new[true_win] = FALSE;
-        _mark_inactive(true_win);
+        _status_bar_set_slot(true_win, FALSE, FALSE);
     }
-
-    _status_bar_draw();
 }
 
 void
@@ -249,25 +282,17 @@ status_bar_active(const int win)
 
         // still have new windows
         if (g_hash_table_size(remaining_new) != 0) {
-            is_active[11] = TRUE;
-            is_new[11] = TRUE;
-            _mark_new(11);
+            _status_bar_set_slot(11, TRUE, TRUE);
 
         // only active windows
         } else {
-            is_active[11] = TRUE;
-            is_new[11] = FALSE;
-            _mark_active(11);
+            _status_bar_set_slot(11, TRUE, FALSE);
         }
 
     // visible window indicators
     } else {
-        is_active[true_win] = TRUE;
-        is_new[true_win] = FALSE;
-        _mark_active(true_win);
+        _status_bar_set_slot(true_win, TRUE, FALSE);
     }
-
-    _status_bar_draw();
 }
 
 void
@@ -281,18 +306,10 @@ status_bar_new(const int win)
     if (true_win > 10) {
         g_hash_table_add(remaining_active, GINT_TO_POINTER(true_win));
         g_hash_table_add(remaining_new, GINT_TO_POINTER(true_win));
-
-        is_active[11] = TRUE;
-        is_new[11] = TRUE;
-        _mark_new(11);
-
+        _status_bar_set_slot(11, TRUE, TRUE);
     } else {
-        is_active[true_win] = TRUE;
-        is_new[true_win] = TRUE;
-        _mark_new(true_win);
+        _status_bar_set_slot(true_win, TRUE, TRUE);
     }
-
-    _status_bar_draw();
 }
 
 void
@@ -313,7 +330,7 @@ status_bar_print_message(const char *const msg)
     }
     message = strdup(msg);
 
-    char *time_pref = prefs_get_string(PREF_TIME_STATUSBAR);
+    const char *time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
     gchar *date_fmt = NULL;
     if (g_strcmp0(time_pref, "off") == 0) {
         date_fmt = g_strdup("");
@@ -329,7 +346,6 @@ status_bar_print_message(const char *const msg)
     } else {
         mvwprintw(status_bar, 0, 1, message);
     }
-    prefs_free_string(time_pref);
 
     int cols = getmaxx(stdscr);
     int bracket_attrs = theme_attrs(THEME_STATUS_BRACKET);
@@ -401,6 +417,35 @@ _update_win_statuses(void)
     }
 }
 
+// called for every message, so only the one indicator is drawn and only
+// when it changes, the clock is kept up by status_bar_update_virtual
+static void
+_status_bar_set_slot(int num, gboolean active, gboolean new)
+{
+    if (is_active[num] == active && is_new[num] == new) {
+        return;
+    }
+
+    is_active[num] = active;
+    is_new[num] = new;
+    if (new) {
+        _mark_new(num);
+    } else if (active) {
+        _mark_active(num);
+    } else {
+        _mark_inactive(num);
+    }
+
+    if (in_batch) {
+        batch_draw = TRUE;
+        return;
+    }
+
+    wnoutrefresh(status_bar);
+    inp_put_back();
+    ui_mark_dirty();
+}
+
 static void
 _mark_new(int num)
 {
@@ -445,9 +490,28 @@ _mark_inactive(int num)
     mvwaddch(status_bar, 0, cols - 34 + active_pos, ' ');
 }
 
+static gchar*
+_status_bar_time(GDateTime *time)
+{
+    const char *time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
+    if (g_strcmp0(time_pref, "off") == 0) {
+        return NULL;
+    }
+
+    gchar *date_fmt = g_date_time_format(time, time_pref);
+    assert(date_fmt != NULL);
+
+    return date_fmt;
+}
+
 static void
 _status_bar_draw(void)
 {
+    if (in_batch) {
+        batch_draw = TRUE;
+        return;
+    }
+
     if (last_time) {
         g_date_time_unref(last_time);
     }
@@ -455,10 +519,10 @@ _status_bar_draw(void)
 
     int bracket_attrs = theme_attrs(THEME_STATUS_BRACKET);
 
-    char *time_pref = prefs_get_string(PREF_TIME_STATUSBAR);
-    if (g_strcmp0(time_pref, "off") != 0) {
-        gchar *date_fmt = g_date_time_format(last_time, time_pref);
-        assert(date_fmt != NULL);
+    g_free(drawn_time);
+    drawn_time = _status_bar_time(last_time);
+    if (drawn_time) {
+        const char *date_fmt = drawn_time;
         size_t len = strlen(date_fmt);
         wattron(status_bar, bracket_attrs);
         mvwaddch(status_bar, 0, 1, '[');
@@ -467,11 +531,10 @@ _status_bar_draw(void)
         wattron(status_bar, bracket_attrs);
         mvwaddch(status_bar, 0, 2 + len, ']');
         wattroff(status_bar, bracket_attrs);
-        g_free(date_fmt);
     }
-    prefs_free_string(time_pref);
 
     _update_win_statuses();
     wnoutrefresh(status_bar);
     inp_put_back();
+    ui_mark_dirty();
 }
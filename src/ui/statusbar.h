@@ -43,5 +43,7 @@ void status_bar_clear_message(void);
 void status_bar_get_password(void);
 void status_bar_print_message(const char *const msg);
 void status_bar_current(int i);
+void status_bar_batch_begin(void);
+void status_bar_batch_end(void);
 
 #endif
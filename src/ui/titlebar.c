@@ -57,7 +57,11 @@ static gboolean is_connected;
 static gboolean typing;
 static GTimer *typing_elapsed;
 
+// everything the bar showed when last drawn
+static char *drawn_state = NULL;
+
 static void _title_bar_draw(void);
+static char* _title_bar_state(ProfWin *current);
 static void _show_self_presence(void);
 static void _show_contact_presence(ProfChatWin *chatwin);
 static void _show_privacy(ProfChatWin *chatwin);
@@ -93,7 +97,14 @@ title_bar_update_virtual(void)
             }
         }
     }
-    _title_bar_draw();
+
+    char *state = _title_bar_state(window);
+    gboolean changed = g_strcmp0(state, drawn_state) != 0;
+    free(state);
+
+    if (changed) {
+        _title_bar_draw();
+    }
 }
 
 void
@@ -199,8 +210,50 @@ _title_bar_draw(void)
 
     _show_self_presence();
 
+    free(drawn_state);
+    drawn_state = _title_bar_state(current);
+
     wnoutrefresh(win);
     inp_put_back();
+    ui_mark_dirty();
+}
+
+// the inputs the bar is drawn from that can change without any of the
+// title_bar functions being called, such as contact presence
+static char*
+_title_bar_state(ProfWin *current)
+{
+    GString *state = g_string_new(NULL);
+    char *title = win_get_title(current);
+    g_string_printf(state, "%p %s %d%d%d%d %d%d", (void*)current, title, current_presence, tls_secured, is_connected,
+        typing, prefs_get_boolean(PREF_TLS_SHOW), getmaxx(stdscr));
+    free(title);
+
+    if (current && current->type == WIN_CHAT) {
+        ProfChatWin *chatwin = (ProfChatWin*) current;
+        const char *resource = chatwin->resource_override;
+        ChatSession *session = chat_session_get(chatwin->barejid);
+        if (!resource && session) {
+            resource = session->resource;
+        }
+
+        const char *presence = NULL;
+        PContact contact = roster_get_contact(chatwin->barejid);
+        if (contact && resource) {
+            Resource *resourcep = p_contact_get_resource(contact, resource);
+            if (resourcep) {
+                presence = string_from_resource_presence(resourcep->presence);
+            }
+        } else if (contact) {
+            presence = p_contact_presence(contact);
+        }
+
+        g_string_append_printf(state, " %s %s %d%d%d%d %d%d%d", resource ? resource : "", presence ? presence : "",
+            chatwin->is_otr, chatwin->otr_is_trusted, chatwin->pgp_send, chatwin->pgp_recv,
+            prefs_get_boolean(PREF_RESOURCE_TITLE), prefs_get_boolean(PREF_PRESENCE), prefs_get_boolean(PREF_ENC_WARN));
+    }
+
+    return g_string_free(state, FALSE);
 }
 
 static void
@@ -57,9 +57,12 @@ typedef enum {
 } prof_enc_t;
 
 // core UI
-void ui_init(void);
+void ui_init(gboolean headless);
+gboolean ui_is_headless(void);
 void ui_load_colours(void);
 void ui_update(void);
+gboolean ui_render_pending(void);
+void ui_mark_dirty(void);
 void ui_close(void);
 void ui_redraw(void);
 void ui_resize(void);
@@ -84,7 +87,10 @@ char* ui_ask_pgp_passphrase(const char *hint, int prev_fail);
 void ui_contact_online(char *barejid, Resource *resource, GDateTime *last_activity);
 void ui_contact_typing(const char *const barejid, const char *const resource);
 void ui_disconnected(void);
+void ui_show_progress(const char *const msg);
+void ui_clear_progress(void);
 void ui_room_join(const char *const roomjid, gboolean focus);
+void ui_rooms_autojoined(GSList *roomjids);
 void ui_switch_to_room(const char *const roomjid);
 void ui_room_destroy(const char *const roomjid);
 void ui_room_destroyed(const char *const roomjid, const char *const reason, const char *const new_jid,
@@ -126,12 +132,20 @@ void ui_inp_history_append(char *inp);
 
 // Chat window
 ProfChatWin* chatwin_new(const char *const barejid);
+void chatwin_display_settings_changed(void);
 void chatwin_incoming_msg(ProfChatWin *chatwin, const char *const resource, const char *const message,
     GDateTime *timestamp, gboolean win_created, prof_enc_t enc_mode);
 void chatwin_receipt_received(ProfChatWin *chatwin, const char *const id);
+void chatwin_marker_received(ProfChatWin *chatwin, const char *const id);
+void chatwin_markable(ProfChatWin *chatwin, const char *const fulljid, const char *const id);
+void chatwin_send_marker(ProfChatWin *chatwin);
 void chatwin_recipient_gone(ProfChatWin *chatwin);
 void chatwin_outgoing_msg(ProfChatWin *chatwin, const char *const message, char *id, prof_enc_t enc_mode);
 void chatwin_outgoing_carbon(ProfChatWin *chatwin, const char *const message);
+void chatwin_outgoing_pending(ProfChatWin *chatwin, const char *const message, const char *const id,
+    prof_enc_t enc_mode);
+void chatwin_outgoing_queued(ProfChatWin *chatwin, const char *const message, const char *const id);
+int chatwin_history_page(ProfChatWin *chatwin, GSList *messages);
 void chatwin_contact_online(ProfChatWin *chatwin, Resource *resource, GDateTime *last_activity);
 void chatwin_contact_offline(ProfChatWin *chatwin, char *resource, char *status);
 #ifdef HAVE_LIBOTR
@@ -156,6 +170,7 @@ void mucwin_occupant_role_and_affiliation_change(ProfMucWin *mucwin, const char
     const char *const role, const char *const affiliation, const char *const actor, const char *const reason);
 void mucwin_roster(ProfMucWin *mucwin, GList *occupants, const char *const presence);
 void mucwin_history(ProfMucWin *mucwin, const char *const nick, GDateTime *timestamp, const char *const message);
+int mucwin_history_page(ProfMucWin *mucwin, GSList *messages);
 void mucwin_message(ProfMucWin *mucwin, const char *const nick, const char *const message);
 void mucwin_subject(ProfMucWin *mucwin, const char *const nick, const char *const subject);
 void mucwin_requires_config(ProfMucWin *mucwin);
@@ -187,6 +202,11 @@ void mucwin_role_set_error(ProfMucWin *mucwin, const char *const nick, const cha
 void mucwin_role_list_error(ProfMucWin *mucwin, const char *const role, const char *const error);
 void mucwin_handle_role_list(ProfMucWin *mucwin, const char *const role, GSList *nicks);
 void mucwin_kick_error(ProfMucWin *mucwin, const char *const nick, const char *const error);
+void mucwin_mention_settings_changed(void);
+room_policy_t mucwin_policy_from_name(const char *const name);
+const char* mucwin_policy_name(room_policy_t policy);
+void mucwin_set_policy(ProfMucWin *mucwin, room_policy_t policy);
+void mucwin_digest(ProfMucWin *mucwin);
 
 // MUC private chat window
 void privwin_incoming_msg(ProfPrivateWin *privatewin, const char *const message, GDateTime *timestamp);
@@ -200,11 +220,16 @@ void mucconfwin_form_help(ProfMucConfWin *confwin);
 void mucconfwin_field_help(ProfMucConfWin *confwin, char *tag);
 
 // xml console
-void xmlwin_show(ProfXMLWin *xmlwin, const char *const msg);
+void xmlwin_show(ProfXMLWin *xmlwin, gboolean sent, const char *const text);
+void xmlwin_filter_add(const char *const filter);
+gboolean xmlwin_filter_remove(const char *const filter);
+void xmlwin_filter_clear(void);
+GSList* xmlwin_filter_list(void);
 
 // Input window
 char* inp_readline(void);
 void inp_nonblocking(gboolean reset);
+void inp_history_load(const char *const account_name);
 
 // Console window
 void cons_show(const char *const msg, ...);
@@ -232,6 +257,7 @@ void cons_show_contacts(GSList *list);
 void cons_show_roster(GSList *list);
 void cons_show_roster_group(const char *const group, GSList *list);
 void cons_show_wins(void);
+void cons_show_wins_stats(void);
 void cons_show_status(const char *const barejid);
 void cons_show_info(PContact pcontact);
 void cons_show_caps(const char *const fulljid, resource_presence_t presence);
@@ -243,9 +269,13 @@ void cons_show_login_success(ProfAccount *account, int secured);
 void cons_show_software_version(const char *const jid, const char *const presence, const char *const name,
     const char *const version, const char *const os);
 void cons_show_account_list(gchar **accounts);
-void cons_show_room_list(GSList *room, const char *const conference_node);
+void cons_show_room_list(GSList *rooms, const char *const conference_node, int shown);
+void cons_show_room_list_end(const char *const conference_node, const char *const filter, int shown,
+    gboolean truncated);
 void cons_show_bookmarks(const GList *list);
-void cons_show_disco_items(GSList *items, const char *const jid);
+void cons_show_history_search(const char *const query, GSList *matches);
+void cons_show_disco_items(GSList *items, const char *const jid, int shown);
+void cons_show_disco_items_end(const char *const jid, int shown, gboolean truncated);
 void cons_show_disco_info(const char *from, GSList *identities, GSList *features);
 void cons_show_room_invite(const char *const invitor, const char *const room, const char *const reason);
 void cons_check_version(gboolean not_available_msg);
@@ -255,11 +285,14 @@ void cons_show_room_invites(GSList *invites);
 void cons_show_received_subs(void);
 void cons_show_sent_subs(void);
 void cons_alert(void);
+void cons_batch_begin(void);
+void cons_batch_end(void);
 void cons_theme_setting(void);
 void cons_resource_setting(void);
 void cons_privileges_setting(void);
 void cons_beep_setting(void);
 void cons_flash_setting(void);
+void cons_fuzzy_setting(void);
 void cons_splash_setting(void);
 void cons_encwarn_setting(void);
 void cons_tlsshow_setting(void);
@@ -280,6 +313,8 @@ void cons_intype_setting(void);
 void cons_gone_setting(void);
 void cons_history_setting(void);
 void cons_carbons_setting(void);
+void cons_sm_setting(void);
+void cons_csi_setting(void);
 void cons_receipts_setting(void);
 void cons_log_setting(void);
 void cons_chlog_setting(void);
@@ -306,9 +341,16 @@ void status_bar_set_all_inactive(void);
 
 // roster window
 void rosterwin_roster(void);
+void rosterwin_draw_pending(void);
+
+// window snapshot
+void snapshot_save(void);
+void snapshot_restore(const char *const account_name);
+void snapshot_clear(void);
 
 // occupants window
 void occupantswin_occupants(const char *const room);
+void occupantswin_draw_pending(void);
 
 // window interface
 ProfWin* win_create_console(void);
@@ -318,9 +360,17 @@ ProfWin* win_create_muc(const char *const roomjid);
 ProfWin* win_create_muc_config(const char *const title, DataForm *form);
 ProfWin* win_create_private(const char *const fulljid);
 void win_update_virtual(ProfWin *window);
+gboolean win_render_held(ProfWin *window);
 void win_free(ProfWin *window);
 int win_unread(ProfWin *window);
 void win_resize(ProfWin *window);
+void win_mark_stale(ProfWin *window);
+void win_hibernate(ProfWin *window);
+void win_wake(ProfWin *window);
+gboolean win_is_hibernated(ProfWin *window);
+void win_usage(ProfWin *window, ProfWinUsage *usage);
+void win_usage_sample(ProfWin *window);
+void win_resize_if_stale(ProfWin *window);
 void win_hide_subwin(ProfWin *window);
 void win_show_subwin(ProfWin *window);
 void win_refresh_without_subwin(ProfWin *window);
@@ -335,6 +385,9 @@ void win_show_info(ProfWin *window, PContact contact);
 void win_println(ProfWin *window, int pad, const char *const message);
 void win_vprintln_ch(ProfWin *window, char ch, const char *const message, ...);
 void win_clear(ProfWin *window);
+gboolean win_search(ProfWin *window, const char *const query, gboolean older);
+const char* win_search_query(ProfWin *window);
+void win_search_clear(ProfWin *window);
 
 // desktop notifications
 void notifier_initialise(void);
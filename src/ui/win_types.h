@@ -47,6 +47,7 @@
 
 #include "xmpp/xmpp.h"
 #include "ui/buffer.h"
+#include "tools/highlight.h"
 #include "chat_state.h"
 
 #define LAYOUT_SPLIT_MEMCHECK       12345671
@@ -67,6 +68,38 @@ typedef struct prof_layout_t {
     ProfBuff buffer;
     int y_pos;
     int paged;
+    gboolean stale;
+    // when the window was last current, the least recently viewed windows
+    // lose scrollback first
+    gint64 viewed;
+    // idle window with its pads shrunk and entry layouts freed, nothing is
+    // measured until it is woken by being shown
+    gboolean hibernated;
+    int lines;
+    int last_x;
+    int top;
+    int rendered_pos;
+    // the position last shown on the terminal, lines appended since then
+    // can be scrolled into view rather than the whole view written again
+    int drawn_pos;
+    int batch;
+    // when the pad was last drawn and how many entries had been pushed by
+    // then, while lines arrive faster than the render interval drawing is
+    // held back
+    gint64 render_time;
+    guint render_pushed;
+    gboolean render_held;
+    // time spent drawing the window, and the entries pushed in the last
+    // full minute once one has been sampled, shown by /wins stats
+    gint64 usage_render;
+    guint usage_pushed;
+    guint usage_rate;
+    gboolean usage_sampled;
+    // the match of a scrollback search, shown until the window is back at
+    // its end, with the time it was written as entries are reused
+    ProfBuffEntry *search_entry;
+    gint64 search_time;
+    char *search_query;
 } ProfLayout;
 
 typedef struct prof_layout_simple_t {
@@ -76,10 +109,25 @@ typedef struct prof_layout_simple_t {
 typedef struct prof_layout_split_t {
     ProfLayout base;
     WINDOW *subwin;
+    // sub_y_pos is a row of the whole panel, the pad only holds the rows
+    // from sub_top around the view, of the sub_lines the panel has
     int sub_y_pos;
+    int sub_top;
+    int sub_lines;
+    // the subwin was freed by hibernation and is created again on waking
+    gboolean sub_hibernated;
     unsigned long memcheck;
 } ProfLayoutSplit;
 
+// what a window costs, see win_usage
+typedef struct prof_win_usage_t {
+    int entries;
+    size_t buffer_bytes;
+    size_t pad_bytes;
+    guint per_minute;
+    gint64 render_us;
+} ProfWinUsage;
+
 typedef enum {
     WIN_CONSOLE,
     WIN_CHAT,
@@ -92,6 +140,14 @@ typedef enum {
 typedef struct prof_win_t {
     win_type_t type;
     ProfLayout *layout;
+    // the key in the window list, -1 before the window is added to it
+    int num;
+    // the /wins line, rebuilt when the number, unread count or version
+    // it was made with changes, see wins_create_summary
+    char *summary;
+    int summary_num;
+    int summary_unread;
+    int summary_version;
 } ProfWin;
 
 typedef struct prof_console_win_t {
@@ -109,14 +165,43 @@ typedef struct prof_chat_win_t {
     gboolean pgp_recv;
     char *resource_override;
     gboolean history_shown;
+    // the history read for this window, and the time of the oldest line
+    // prepended from it so far
+    guint history_id;
+    gint64 history_oldest;
+    // the sender shown for incoming messages, built from the contact
+    // version, resource and settings it was made with
+    char *display_name;
+    char *display_resource;
+    int display_contact;
+    int display_version;
+    // the latest markable message not yet marked displayed, and who sent it
+    char *marker_jid;
+    char *marker_id;
     unsigned long memcheck;
 } ProfChatWin;
 
+// how much of a room's traffic is shown while it is not the current window
+typedef enum {
+    ROOM_POLICY_LIVE,
+    ROOM_POLICY_BUFFER,
+    ROOM_POLICY_DIGEST,
+    ROOM_POLICY_MENTIONS
+} room_policy_t;
+
 typedef struct prof_muc_win_t {
     ProfWin window;
     char *roomjid;
     int unread;
     gboolean showjid;
+    // built from the nick and mention settings it was made with
+    Highlight mentions;
+    char *mentions_nick;
+    int mentions_version;
+    room_policy_t policy;
+    // messages and mentions since the last digest
+    int digest_messages;
+    int digest_mentions;
     unsigned long memcheck;
 } ProfMucWin;
 
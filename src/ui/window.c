@@ -50,8 +50,12 @@
 #include "config/theme.h"
 #include "config/preferences.h"
 #include "roster_list.h"
+#include "tools/highlight.h"
+#include "tools/stats.h"
+#include "tools/width.h"
 #include "ui/ui.h"
 #include "ui/window.h"
+#include "window_list.h"
 #include "xmpp/xmpp.h"
 
 #define CONS_WIN_TITLE "Profanity. Type /help for help information."
@@ -59,9 +63,63 @@
 
 #define CEILING(X) (X-(int)(X) > 0 ? (int)(X+1) : (int)(X))
 
-static void _win_print(ProfWin *window, const char show_char, int pad_indent, GDateTime *time,
-    int flags, theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt);
-static void _win_print_wrapped(WINDOW *win, const char *const message, size_t indent, int pad_indent);
+// last timestamp formatted with each time preference, version changes
+// whenever a format does so entries know their stored string is stale
+typedef struct time_format_cache_t {
+    char *format;
+    gboolean subsecond;
+    int version;
+    gint64 second;
+    char *formatted;
+} TimeFormatCache;
+
+static TimeFormatCache time_formats[6];
+static int time_format_version = 0;
+
+// windows only keep a pad the size of the screen, entries are drawn here
+// first and the visible rows copied across, rows used since the last
+// clear are tracked so clearing does not touch the whole pad
+static WINDOW *scratch = NULL;
+static int scratch_rows = 0;
+
+// the layout whose rows are on the terminal
+static ProfLayout *drawn_layout = NULL;
+
+// windows drawn from the start with at least this many entries to wrap
+// have them wrapped on the layout workers, fewer are quicker done here
+#define WRAP_PARALLEL_MIN 256
+#define WRAP_WORKERS_MAX 8
+#define WRAP_CHUNK_MIN 64
+
+// an entry to wrap from the column its message starts at
+typedef struct wrap_job_t {
+    ProfBuffEntry *entry;
+    const char *message;
+    int x;
+    size_t indent;
+    char *text;
+} WrapJob;
+
+// a run of jobs handed to one worker, the last one done wakes the main
+// thread
+typedef struct wrap_chunk_t {
+    WrapJob *jobs;
+    int count;
+    int maxx;
+    int *pending;
+    GMutex *lock;
+    GCond *done;
+} WrapChunk;
+
+static GThreadPool *wrap_workers = NULL;
+
+static void _win_print(ProfWin *window, WINDOW *win, ProfBuffEntry *e);
+static void _win_print_wrapped(WINDOW *win, const char *const message, size_t indent, int pad_indent, GString *layout);
+static void _win_print_entry(ProfWin *window, ProfBuffEntry *e);
+static void _win_render(ProfWin *window);
+static void _win_measure_pending(ProfWin *window);
+static void _win_fetch_older(ProfWin *window);
+static void _win_wrap_parallel(ProfWin *window);
 
 int
 win_roster_cols(void)
@@ -79,6 +137,60 @@ win_occpuants_cols(void)
     return CEILING( (((double)cols) / 100) * occupants_win_percent);
 }
 
+static int
+_win_view_rows(void)
+{
+    int rows = getmaxy(stdscr) - 3;
+    return rows > 0 ? rows : 1;
+}
+
+static void
+_win_init_lines(ProfLayout *layout)
+{
+    layout->lines = 0;
+    layout->last_x = 0;
+    layout->top = 0;
+    layout->rendered_pos = -1;
+    layout->drawn_pos = -1;
+    ui_mark_dirty();
+}
+
+// rows before the oldest entry went when the buffer dropped it
+static int
+_win_first_line(ProfWin *window)
+{
+    ProfBuffEntry *e = buffer_yield_entry(window->layout->buffer, 0);
+    if (e && e->y_start_pos > 0) {
+        return e->y_start_pos;
+    }
+
+    return 0;
+}
+
+static WINDOW*
+_win_scratch(ProfWin *window)
+{
+    int width = getmaxx(window->layout->win);
+
+    if (scratch == NULL) {
+        scratch = newpad(PAD_SIZE, width);
+        scratch_rows = 0;
+    } else if (getmaxx(scratch) != width) {
+        wresize(scratch, PAD_SIZE, width);
+    }
+
+    wbkgdset(scratch, getbkgd(window->layout->win));
+    int row = 0;
+    for (row = 0; row < scratch_rows; row++) {
+        wmove(scratch, row, 0);
+        wclrtoeol(scratch);
+    }
+    scratch_rows = 0;
+    wmove(scratch, 0, 0);
+
+    return scratch;
+}
+
 static ProfLayout*
 _win_create_simple_layout(void)
 {
@@ -86,12 +198,25 @@ _win_create_simple_layout(void)
 
     ProfLayoutSimple *layout = malloc(sizeof(ProfLayoutSimple));
     layout->base.type = LAYOUT_SIMPLE;
-    layout->base.win = newpad(PAD_SIZE, cols);
+    layout->base.win = newpad(_win_view_rows(), cols);
     wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
     layout->base.buffer = buffer_create();
     layout->base.y_pos = 0;
     layout->base.paged = 0;
-    scrollok(layout->base.win, TRUE);
+    layout->base.stale = FALSE;
+    layout->base.viewed = g_get_monotonic_time();
+    layout->base.hibernated = FALSE;
+    layout->base.batch = 0;
+    layout->base.render_time = 0;
+    layout->base.render_pushed = 0;
+    layout->base.render_held = FALSE;
+    layout->base.usage_render = 0;
+    layout->base.usage_pushed = 0;
+    layout->base.usage_rate = 0;
+    layout->base.usage_sampled = FALSE;
+    layout->base.search_entry = NULL;
+    layout->base.search_query = NULL;
+    _win_init_lines(&layout->base);
 
     return &layout->base;
 }
@@ -103,14 +228,30 @@ _win_create_split_layout(void)
 
     ProfLayoutSplit *layout = malloc(sizeof(ProfLayoutSplit));
     layout->base.type = LAYOUT_SPLIT;
-    layout->base.win = newpad(PAD_SIZE, cols);
+    layout->base.win = newpad(_win_view_rows(), cols);
     wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
     layout->base.buffer = buffer_create();
     layout->base.y_pos = 0;
     layout->base.paged = 0;
-    scrollok(layout->base.win, TRUE);
+    layout->base.stale = FALSE;
+    layout->base.viewed = g_get_monotonic_time();
+    layout->base.hibernated = FALSE;
+    layout->base.batch = 0;
+    layout->base.render_time = 0;
+    layout->base.render_pushed = 0;
+    layout->base.render_held = FALSE;
+    layout->base.usage_render = 0;
+    layout->base.usage_pushed = 0;
+    layout->base.usage_rate = 0;
+    layout->base.usage_sampled = FALSE;
+    layout->base.search_entry = NULL;
+    layout->base.search_query = NULL;
+    _win_init_lines(&layout->base);
     layout->subwin = NULL;
     layout->sub_y_pos = 0;
+    layout->sub_top = 0;
+    layout->sub_lines = 0;
+    layout->sub_hibernated = FALSE;
     layout->memcheck = LAYOUT_SPLIT_MEMCHECK;
 
     return &layout->base;
@@ -121,6 +262,8 @@ win_create_console(void)
 {
     ProfConsoleWin *new_win = malloc(sizeof(ProfConsoleWin));
     new_win->window.type = WIN_CONSOLE;
+    new_win->window.num = -1;
+    new_win->window.summary = NULL;
     new_win->window.layout = _win_create_split_layout();
 
     return &new_win->window;
@@ -131,6 +274,8 @@ win_create_chat(const char *const barejid)
 {
     ProfChatWin *new_win = malloc(sizeof(ProfChatWin));
     new_win->window.type = WIN_CHAT;
+    new_win->window.num = -1;
+    new_win->window.summary = NULL;
     new_win->window.layout = _win_create_simple_layout();
 
     new_win->barejid = strdup(barejid);
@@ -140,8 +285,16 @@ win_create_chat(const char *const barejid)
     new_win->pgp_recv = FALSE;
     new_win->pgp_send = FALSE;
     new_win->history_shown = FALSE;
+    new_win->history_id = 0;
+    new_win->history_oldest = 0;
+    new_win->display_name = NULL;
+    new_win->display_resource = NULL;
+    new_win->display_contact = 0;
+    new_win->display_version = 0;
+    new_win->marker_jid = NULL;
+    new_win->marker_id = NULL;
     new_win->unread = 0;
-    new_win->state = chat_state_new();
+    new_win->state = chat_state_new(barejid);
 
     new_win->memcheck = PROFCHATWIN_MEMCHECK;
 
@@ -155,27 +308,45 @@ win_create_muc(const char *const roomjid)
     int cols = getmaxx(stdscr);
 
     new_win->window.type = WIN_MUC;
+    new_win->window.num = -1;
+    new_win->window.summary = NULL;
 
     ProfLayoutSplit *layout = malloc(sizeof(ProfLayoutSplit));
     layout->base.type = LAYOUT_SPLIT;
 
     if (prefs_get_boolean(PREF_OCCUPANTS)) {
         int subwin_cols = win_occpuants_cols();
-        layout->base.win = newpad(PAD_SIZE, cols - subwin_cols);
+        layout->base.win = newpad(_win_view_rows(), cols - subwin_cols);
         wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
         layout->subwin = newpad(PAD_SIZE, subwin_cols);;
         wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
     } else {
-        layout->base.win = newpad(PAD_SIZE, (cols));
+        layout->base.win = newpad(_win_view_rows(), (cols));
         wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
         layout->subwin = NULL;
     }
     layout->sub_y_pos = 0;
+    layout->sub_top = 0;
+    layout->sub_lines = 0;
+    layout->sub_hibernated = FALSE;
     layout->memcheck = LAYOUT_SPLIT_MEMCHECK;
     layout->base.buffer = buffer_create();
     layout->base.y_pos = 0;
     layout->base.paged = 0;
-    scrollok(layout->base.win, TRUE);
+    layout->base.stale = FALSE;
+    layout->base.viewed = g_get_monotonic_time();
+    layout->base.hibernated = FALSE;
+    layout->base.batch = 0;
+    layout->base.render_time = 0;
+    layout->base.render_pushed = 0;
+    layout->base.render_held = FALSE;
+    layout->base.usage_render = 0;
+    layout->base.usage_pushed = 0;
+    layout->base.usage_rate = 0;
+    layout->base.usage_sampled = FALSE;
+    layout->base.search_entry = NULL;
+    layout->base.search_query = NULL;
+    _win_init_lines(&layout->base);
     new_win->window.layout = (ProfLayout*)layout;
 
     new_win->roomjid = strdup(roomjid);
@@ -185,6 +356,14 @@ win_create_muc(const char *const roomjid)
     } else {
         new_win->showjid = FALSE;
     }
+    new_win->mentions = NULL;
+    new_win->mentions_nick = NULL;
+    new_win->mentions_version = 0;
+    char *policy = prefs_get_room_policy(roomjid);
+    new_win->policy = mucwin_policy_from_name(policy);
+    prefs_free_string(policy);
+    new_win->digest_messages = 0;
+    new_win->digest_mentions = 0;
 
     new_win->memcheck = PROFMUCWIN_MEMCHECK;
 
@@ -196,6 +375,8 @@ win_create_muc_config(const char *const roomjid, DataForm *form)
 {
     ProfMucConfWin *new_win = malloc(sizeof(ProfMucConfWin));
     new_win->window.type = WIN_MUC_CONFIG;
+    new_win->window.num = -1;
+    new_win->window.summary = NULL;
     new_win->window.layout = _win_create_simple_layout();
 
     new_win->roomjid = strdup(roomjid);
@@ -211,6 +392,8 @@ win_create_private(const char *const fulljid)
 {
     ProfPrivateWin *new_win = malloc(sizeof(ProfPrivateWin));
     new_win->window.type = WIN_PRIVATE;
+    new_win->window.num = -1;
+    new_win->window.summary = NULL;
     new_win->window.layout = _win_create_simple_layout();
 
     new_win->fulljid = strdup(fulljid);
@@ -226,6 +409,8 @@ win_create_xmlconsole(void)
 {
     ProfXMLWin *new_win = malloc(sizeof(ProfXMLWin));
     new_win->window.type = WIN_XML;
+    new_win->window.num = -1;
+    new_win->window.summary = NULL;
     new_win->window.layout = _win_create_simple_layout();
 
     new_win->memcheck = PROFXMLWIN_MEMCHECK;
@@ -292,12 +477,13 @@ win_hide_subwin(ProfWin *window)
         }
         layout->subwin = NULL;
         layout->sub_y_pos = 0;
+        layout->sub_top = 0;
         int cols = getmaxx(stdscr);
-        wresize(layout->base.win, PAD_SIZE, cols);
+        wresize(layout->base.win, _win_view_rows(), cols);
         win_redraw(window);
     } else {
         int cols = getmaxx(stdscr);
-        wresize(window->layout->win, PAD_SIZE, cols);
+        wresize(window->layout->win, _win_view_rows(), cols);
         win_redraw(window);
     }
 }
@@ -321,7 +507,7 @@ win_show_subwin(ProfWin *window)
     ProfLayoutSplit *layout = (ProfLayoutSplit*)window->layout;
     layout->subwin = newpad(PAD_SIZE, subwin_cols);
     wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
-    wresize(layout->base.win, PAD_SIZE, cols - subwin_cols);
+    wresize(layout->base.win, _win_view_rows(), cols - subwin_cols);
     win_redraw(window);
 }
 
@@ -339,18 +525,31 @@ win_free(ProfWin* window)
         buffer_free(window->layout->buffer);
         delwin(window->layout->win);
     }
+    if (drawn_layout == window->layout) {
+        drawn_layout = NULL;
+    }
+    free(window->layout->search_query);
     free(window->layout);
+    free(window->summary);
 
     if (window->type == WIN_CHAT) {
         ProfChatWin *chatwin = (ProfChatWin*)window;
+        mam_forget(chatwin->barejid);
         free(chatwin->barejid);
         free(chatwin->resource_override);
+        free(chatwin->display_name);
+        free(chatwin->display_resource);
+        free(chatwin->marker_jid);
+        free(chatwin->marker_id);
         chat_state_free(chatwin->state);
     }
 
     if (window->type == WIN_MUC) {
         ProfMucWin *mucwin = (ProfMucWin*)window;
+        mam_forget(mucwin->roomjid);
         free(mucwin->roomjid);
+        highlight_free(mucwin->mentions);
+        g_free(mucwin->mentions_nick);
     }
 
     if (window->type == WIN_MUC_CONFIG) {
@@ -370,16 +569,22 @@ win_free(ProfWin* window)
 void
 win_page_up(ProfWin *window)
 {
+    _win_measure_pending(window);
+
     int rows = getmaxy(stdscr);
-    int y = getcury(window->layout->win);
+    int y = window->layout->lines;
     int page_space = rows - 4;
     int *page_start = &(window->layout->y_pos);
 
+    int first = _win_first_line(window);
+
     *page_start -= page_space;
 
-    // went past beginning, show first page
-    if (*page_start < 0)
-        *page_start = 0;
+    // went past beginning, show first page and ask the server for more
+    if (*page_start < first) {
+        *page_start = first;
+        _win_fetch_older(window);
+    }
 
     window->layout->paged = 1;
     win_update_virtual(window);
@@ -390,11 +595,120 @@ win_page_up(ProfWin *window)
     }
 }
 
+// where the search match is in the buffer, -1 once it has been dropped
+static int
+_win_search_index(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    if (layout->search_entry == NULL) {
+        return -1;
+    }
+
+    int i;
+    for (i = buffer_size(layout->buffer) - 1; i >= 0; i--) {
+        ProfBuffEntry *e = buffer_yield_entry(layout->buffer, i);
+        if (e == layout->search_entry) {
+            return e->time == layout->search_time ? i : -1;
+        }
+    }
+
+    return -1;
+}
+
+// show the newest message containing query, older than the current match
+// when older is set, otherwise starting with it, the view jumps straight
+// to the match and is left alone when nothing matches
+gboolean
+win_search(ProfWin *window, const char *const query, gboolean older)
+{
+    ProfLayout *layout = window->layout;
+    _win_measure_pending(window);
+
+    int start = _win_search_index(window);
+    if (start == -1) {
+        start = buffer_size(layout->buffer) - 1;
+    } else if (older) {
+        start--;
+    }
+
+    Highlight highlight = highlight_new(FALSE, FALSE);
+    highlight_add(highlight, query);
+    ProfBuffEntry *found = NULL;
+    int i;
+    for (i = start; i >= 0 && found == NULL; i--) {
+        ProfBuffEntry *e = buffer_yield_entry(layout->buffer, i);
+        // cleared from view
+        if (e->y_end_pos < layout->top) {
+            break;
+        }
+        if (highlight_match(highlight, e->message)) {
+            found = e;
+        }
+    }
+    highlight_free(highlight);
+
+    if (found == NULL) {
+        return FALSE;
+    }
+
+    if (g_strcmp0(layout->search_query, query) != 0) {
+        free(layout->search_query);
+        layout->search_query = strdup(query);
+    }
+    layout->search_entry = found;
+    layout->search_time = found->time;
+
+    // the match a third of the way down the page
+    int page_space = getmaxy(stdscr) - 4;
+    int first = _win_first_line(window);
+    if (first < layout->top) {
+        first = layout->top;
+    }
+    int y_pos = found->y_start_pos - page_space / 3;
+    if (y_pos > layout->lines - page_space) {
+        y_pos = layout->lines - page_space;
+    }
+    if (y_pos < first) {
+        y_pos = first;
+    }
+
+    layout->y_pos = y_pos;
+    layout->paged = 1;
+    layout->rendered_pos = -1;
+    win_update_virtual(window);
+
+    return TRUE;
+}
+
+// the query of the match shown, NULL when there is none
+const char*
+win_search_query(ProfWin *window)
+{
+    if (_win_search_index(window) == -1) {
+        return NULL;
+    }
+
+    return window->layout->search_query;
+}
+
+void
+win_search_clear(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    layout->search_entry = NULL;
+    free(layout->search_query);
+    layout->search_query = NULL;
+    layout->rendered_pos = -1;
+    ui_mark_dirty();
+}
+
 void
 win_page_down(ProfWin *window)
 {
+    _win_measure_pending(window);
+
     int rows = getmaxy(stdscr);
-    int y = getcury(window->layout->win);
+    int y = window->layout->lines;
     int page_space = rows - 4;
     int *page_start = &(window->layout->y_pos);
 
@@ -417,6 +731,33 @@ win_page_down(ProfWin *window)
     }
 }
 
+// the pad row shown at the top of the panel, kept inside the pad while the
+// rows for a new position are still to be drawn
+static int
+_win_sub_pad_row(ProfLayoutSplit *layout)
+{
+    int row = layout->sub_y_pos - layout->sub_top;
+    int max = PAD_SIZE - _win_view_rows();
+    if (row > max) {
+        row = max;
+    }
+
+    return row > 0 ? row : 0;
+}
+
+// the panel is drawn again for the rows around its new position
+static void
+_win_sub_scrolled(ProfWin *window)
+{
+    if (window->type == WIN_MUC) {
+        ProfMucWin *mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        occupantswin_occupants(mucwin->roomjid);
+    } else if (window->type == WIN_CONSOLE) {
+        rosterwin_roster();
+    }
+}
+
 void
 win_sub_page_down(ProfWin *window)
 {
@@ -425,7 +766,7 @@ win_sub_page_down(ProfWin *window)
         int rows = getmaxy(stdscr);
         int page_space = rows - 4;
         ProfLayoutSplit *split_layout = (ProfLayoutSplit*)window->layout;
-        int sub_y = getcury(split_layout->subwin);
+        int sub_y = split_layout->sub_lines;
         int *sub_y_pos = &(split_layout->sub_y_pos);
 
         *sub_y_pos += page_space;
@@ -438,6 +779,10 @@ win_sub_page_down(ProfWin *window)
         else if (*sub_y_pos >= sub_y)
             *sub_y_pos = sub_y - page_space - 1;
 
+        if (*sub_y_pos < 0)
+            *sub_y_pos = 0;
+
+        _win_sub_scrolled(window);
         win_update_virtual(window);
     }
 }
@@ -457,6 +802,7 @@ win_sub_page_up(ProfWin *window)
         if (*sub_y_pos < 0)
             *sub_y_pos = 0;
 
+        _win_sub_scrolled(window);
         win_update_virtual(window);
     }
 }
@@ -464,7 +810,18 @@ win_sub_page_up(ProfWin *window)
 void
 win_clear(ProfWin *window)
 {
-    werase(window->layout->win);
+    ProfLayout *layout = window->layout;
+
+    // start on a fresh row and keep everything before it out of view
+    if (layout->last_x != 0) {
+        layout->lines++;
+        layout->last_x = 0;
+    }
+    layout->top = layout->lines;
+    layout->y_pos = layout->lines;
+    layout->paged = 0;
+    layout->rendered_pos = -1;
+
     win_update_virtual(window);
 }
 
@@ -482,7 +839,7 @@ win_resize(ProfWin *window)
             } else if (window->type == WIN_MUC) {
                 subwin_cols = win_occpuants_cols();
             }
-            wresize(layout->base.win, PAD_SIZE, cols - subwin_cols);
+            wresize(layout->base.win, _win_view_rows(), cols - subwin_cols);
             wresize(layout->subwin, PAD_SIZE, subwin_cols);
             if (window->type == WIN_CONSOLE) {
                 rosterwin_roster();
@@ -492,13 +849,114 @@ win_resize(ProfWin *window)
                 occupantswin_occupants(mucwin->roomjid);
             }
         } else {
-            wresize(layout->base.win, PAD_SIZE, cols);
+            wresize(layout->base.win, _win_view_rows(), cols);
         }
     } else {
-        wresize(window->layout->win, PAD_SIZE, cols);
+        wresize(window->layout->win, _win_view_rows(), cols);
     }
 
     win_redraw(window);
+    window->layout->stale = FALSE;
+}
+
+// keeps the pad width so entries printed while asleep are measured at the
+// width they will be shown at
+void
+win_hibernate(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    if (layout->hibernated) {
+        return;
+    }
+
+    if (layout->type == LAYOUT_SPLIT) {
+        ProfLayoutSplit *split = (ProfLayoutSplit*)layout;
+        if (split->subwin) {
+            delwin(split->subwin);
+            split->subwin = NULL;
+            split->sub_hibernated = TRUE;
+        }
+    }
+
+    wresize(layout->win, 1, getmaxx(layout->win));
+    buffer_forget_layouts(layout->buffer);
+    layout->rendered_pos = -1;
+    layout->hibernated = TRUE;
+    layout->stale = TRUE;
+}
+
+void
+win_wake(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    if (!layout->hibernated) {
+        return;
+    }
+
+    layout->hibernated = FALSE;
+    if (layout->type == LAYOUT_SPLIT) {
+        ProfLayoutSplit *split = (ProfLayoutSplit*)layout;
+        if (split->sub_hibernated) {
+            int subwin_cols = window->type == WIN_MUC ? win_occpuants_cols() : win_roster_cols();
+            split->subwin = newpad(PAD_SIZE, subwin_cols);
+            wbkgd(split->subwin, theme_attrs(THEME_TEXT));
+            split->sub_hibernated = FALSE;
+        }
+    }
+
+    win_resize(window);
+}
+
+gboolean
+win_is_hibernated(ProfWin *window)
+{
+    return window->layout->hibernated;
+}
+
+// the pads are estimated from their size, a cell of a wide character
+// curses holds attributes, colour and a few characters
+void
+win_usage(ProfWin *window, ProfWinUsage *usage)
+{
+    ProfLayout *layout = window->layout;
+    size_t cell = sizeof(chtype) + sizeof(int) + sizeof(wchar_t) * 5;
+
+    usage->entries = buffer_size(layout->buffer);
+    usage->buffer_bytes = buffer_bytes(layout->buffer);
+    usage->pad_bytes = (size_t)getmaxy(layout->win) * getmaxx(layout->win) * cell;
+    if (layout->type == LAYOUT_SPLIT) {
+        ProfLayoutSplit *split = (ProfLayoutSplit*)layout;
+        if (split->subwin) {
+            usage->pad_bytes += (size_t)getmaxy(split->subwin) * getmaxx(split->subwin) * cell;
+        }
+    }
+    usage->per_minute = layout->usage_sampled ? layout->usage_rate : buffer_pushed(layout->buffer);
+    usage->render_us = layout->usage_render;
+}
+
+// called once a minute, the rate shown is of the minute before the call
+void
+win_usage_sample(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    guint pushed = buffer_pushed(layout->buffer);
+    layout->usage_rate = pushed - layout->usage_pushed;
+    layout->usage_pushed = pushed;
+    layout->usage_sampled = TRUE;
+}
+
+void
+win_mark_stale(ProfWin *window)
+{
+    window->layout->stale = TRUE;
+}
+
+void
+win_resize_if_stale(ProfWin *window)
+{
+    if (window->layout->stale) {
+        win_resize(window);
+    }
 }
 
 void
@@ -507,6 +965,27 @@ win_update_virtual(ProfWin *window)
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
 
+    // waking redraws the window, which is counted by win_redraw
+    win_wake(window);
+    gint64 start = g_get_monotonic_time();
+    _win_render(window);
+    ui_mark_dirty();
+
+    ProfLayout *layout = window->layout;
+    layout->render_time = g_get_monotonic_time();
+    layout->render_pushed = buffer_pushed(layout->buffer);
+    layout->render_held = FALSE;
+
+    // following the end of the window the rows shown only move up, letting
+    // curses use the terminal's scrolling region means only the new rows are
+    // sent, anything else is drawn as before
+    int shift = layout->y_pos - layout->drawn_pos;
+    gboolean appended = !layout->paged && drawn_layout == layout && layout->drawn_pos >= 0 &&
+        shift > 0 && shift < getmaxy(layout->win);
+    idlok(layout->win, appended);
+    layout->drawn_pos = layout->y_pos;
+    drawn_layout = layout;
+
     if (window->layout->type == LAYOUT_SPLIT) {
         ProfLayoutSplit *layout = (ProfLayoutSplit*)window->layout;
         if (layout->subwin) {
@@ -516,14 +995,35 @@ win_update_virtual(ProfWin *window)
             } else {
                 subwin_cols = win_roster_cols();
             }
-            pnoutrefresh(layout->base.win, layout->base.y_pos, 0, 1, 0, rows-3, (cols-subwin_cols)-1);
-            pnoutrefresh(layout->subwin, layout->sub_y_pos, 0, 1, (cols-subwin_cols), rows-3, cols-1);
+            pnoutrefresh(layout->base.win, 0, 0, 1, 0, rows-3, (cols-subwin_cols)-1);
+            pnoutrefresh(layout->subwin, _win_sub_pad_row(layout), 0, 1, (cols-subwin_cols), rows-3, cols-1);
         } else {
-            pnoutrefresh(layout->base.win, layout->base.y_pos, 0, 1, 0, rows-3, cols-1);
+            pnoutrefresh(layout->base.win, 0, 0, 1, 0, rows-3, cols-1);
         }
     } else {
-        pnoutrefresh(window->layout->win, window->layout->y_pos, 0, 1, 0, rows-3, cols-1);
+        pnoutrefresh(window->layout->win, 0, 0, 1, 0, rows-3, cols-1);
+    }
+    layout->usage_render += g_get_monotonic_time() - start;
+}
+
+// whether drawing a window following its end should wait, lines arriving
+// less than the render interval after the last draw are drawn together
+// once the interval is up, the first line after a quiet spell is not held
+gboolean
+win_render_held(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    gint interval = prefs_get_render_interval();
+    if (interval == 0 || layout->paged || buffer_pushed(layout->buffer) == layout->render_pushed) {
+        return FALSE;
+    }
+
+    if (g_get_monotonic_time() - layout->render_time >= (gint64)interval * 1000) {
+        return FALSE;
     }
+
+    layout->render_held = TRUE;
+    return TRUE;
 }
 
 void
@@ -532,8 +1032,11 @@ win_refresh_without_subwin(ProfWin *window)
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
 
+    _win_render(window);
+    ui_mark_dirty();
+
     if ((window->type == WIN_MUC) || (window->type == WIN_CONSOLE)) {
-        pnoutrefresh(window->layout->win, window->layout->y_pos, 0, 1, 0, rows-3, cols-1);
+        pnoutrefresh(window->layout->win, 0, 0, 1, 0, rows-3, cols-1);
     }
 }
 
@@ -544,31 +1047,48 @@ win_refresh_with_subwin(ProfWin *window)
     getmaxyx(stdscr, rows, cols);
     int subwin_cols = 0;
 
+    _win_render(window);
+    ui_mark_dirty();
+
     if (window->type == WIN_MUC) {
         ProfLayoutSplit *layout = (ProfLayoutSplit*)window->layout;
         subwin_cols = win_occpuants_cols();
-        pnoutrefresh(layout->base.win, layout->base.y_pos, 0, 1, 0, rows-3, (cols-subwin_cols)-1);
-        pnoutrefresh(layout->subwin, layout->sub_y_pos, 0, 1, (cols-subwin_cols), rows-3, cols-1);
+        pnoutrefresh(layout->base.win, 0, 0, 1, 0, rows-3, (cols-subwin_cols)-1);
+        pnoutrefresh(layout->subwin, _win_sub_pad_row(layout), 0, 1, (cols-subwin_cols), rows-3, cols-1);
     } else if (window->type == WIN_CONSOLE) {
         ProfLayoutSplit *layout = (ProfLayoutSplit*)window->layout;
         subwin_cols = win_roster_cols();
-        pnoutrefresh(layout->base.win, layout->base.y_pos, 0, 1, 0, rows-3, (cols-subwin_cols)-1);
-        pnoutrefresh(layout->subwin, layout->sub_y_pos, 0, 1, (cols-subwin_cols), rows-3, cols-1);
+        pnoutrefresh(layout->base.win, 0, 0, 1, 0, rows-3, (cols-subwin_cols)-1);
+        pnoutrefresh(layout->subwin, _win_sub_pad_row(layout), 0, 1, (cols-subwin_cols), rows-3, cols-1);
     }
 }
 
 void
 win_move_to_end(ProfWin *window)
 {
+    if (window->layout->search_entry) {
+        win_search_clear(window);
+    }
     window->layout->paged = 0;
+    _win_measure_pending(window);
 
     int rows = getmaxy(stdscr);
-    int y = getcury(window->layout->win);
+    int y = window->layout->lines;
     int size = rows - 3;
 
-    window->layout->y_pos = y - (size - 1);
-    if (window->layout->y_pos < 0) {
-        window->layout->y_pos = 0;
+    int top = _win_first_line(window);
+    if (top < window->layout->top) {
+        top = window->layout->top;
+    }
+
+    int y_pos = y - (size - 1);
+    if (y_pos < top) {
+        y_pos = top;
+    }
+
+    if (y_pos != window->layout->y_pos) {
+        window->layout->y_pos = y_pos;
+        ui_mark_dirty();
     }
 }
 
@@ -749,25 +1269,14 @@ win_show_info(ProfWin *window, PContact contact)
         g_date_time_unref(now);
     }
 
-    GList *resources = p_contact_get_available_resources(contact);
-    GList *ordered_resources = NULL;
-    if (resources) {
+    if (p_contact_has_available_resource(contact)) {
         win_print(window, '-', 0, NULL, 0, 0, "", "Resources:");
-
-        // sort in order of availability
-        GList *curr = resources;
-        while (curr) {
-            Resource *resource = curr->data;
-            ordered_resources = g_list_insert_sorted(ordered_resources,
-                resource, (GCompareFunc)resource_compare_availability);
-            curr = g_list_next(curr);
-        }
     }
-    g_list_free(resources);
 
-    GList *curr = ordered_resources;
-    while (curr) {
-        Resource *resource = curr->data;
+    PContactResourceIter iter;
+    p_contact_resource_iter_init(&iter, contact);
+    Resource *resource;
+    while ((resource = p_contact_resource_iter_next(&iter))) {
         const char *resource_presence = string_from_resource_presence(resource->presence);
         theme_item_t presence_colour = theme_main_presence_attrs(resource_presence);
         win_vprint(window, '-', 0, NULL, NO_EOL, presence_colour, "", "  %s (%d), %s", resource->name, resource->priority, resource_presence);
@@ -821,10 +1330,7 @@ win_show_info(ProfWin *window, PContact contact)
             }
             caps_destroy(caps);
         }
-
-        curr = g_list_next(curr);
     }
-    g_list_free(ordered_resources);
 }
 
 void
@@ -919,12 +1425,86 @@ win_print(ProfWin *window, const char show_char, int pad_indent, GDateTime *time
     }
 
     buffer_push(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, from, message, NULL);
-    _win_print(window, show_char, pad_indent, timestamp, flags, theme_item, from, message, NULL);
+    if (window->layout->batch > 0) {
+        g_date_time_unref(timestamp);
+        return;
+    }
+    _win_measure_pending(window);
+    // TODO: cross-reference.. this should be replaced by a real event-based system
+    inp_nonblocking(TRUE);
+    g_date_time_unref(timestamp);
+}
+
+// collect lines printed until the matching win_batch_end, they are
+// measured together when the batch ends, batches may be nested
+void
+win_batch_begin(ProfWin *window)
+{
+    window->layout->batch++;
+}
+
+void
+win_batch_end(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    if (layout->batch == 0 || --layout->batch > 0) {
+        return;
+    }
+
+    _win_measure_pending(window);
     // TODO: cross-reference.. this should be replaced by a real event-based system
     inp_nonblocking(TRUE);
+}
+
+// add an entry whose rows are only worked out when the window is next
+// shown, for windows that can receive far more than anyone reads
+void
+win_print_deferred(ProfWin *window, const char show_char, int pad_indent, GDateTime *timestamp,
+    int flags, theme_item_t theme_item, const char *const from, const char *const message)
+{
+    if (timestamp == NULL) {
+        timestamp = g_date_time_new_now_local();
+    } else {
+        g_date_time_ref(timestamp);
+    }
+
+    buffer_push(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, from, message, NULL);
+    window->layout->rendered_pos = -1;
+    if (window == wins_get_current()) {
+        ui_mark_dirty();
+    }
     g_date_time_unref(timestamp);
 }
 
+// add an entry older than everything in the window, the caller redraws
+// with win_refresh_prepended once the whole page is added
+gboolean
+win_prepend(ProfWin *window, const char show_char, int pad_indent, GDateTime *timestamp,
+    int flags, theme_item_t theme_item, const char *const from, const char *const message)
+{
+    ProfBuffEntry *e = buffer_prepend(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, from, message);
+
+    return (e != NULL);
+}
+
+// redraw after prepending, keeping the lines on screen where they were,
+// a window showing its last lines stays there
+void
+win_refresh_prepended(ProfWin *window)
+{
+    int y = window->layout->lines;
+    win_redraw(window);
+    if (!window->layout->paged) {
+        win_update_virtual(window);
+        return;
+    }
+    int added = window->layout->lines - y;
+
+    window->layout->y_pos += added;
+    window->layout->paged = 1;
+    win_update_virtual(window);
+}
+
 void
 win_print_with_receipt(ProfWin *window, const char show_char, int pad_indent, GTimeVal *tstamp,
     int flags, theme_item_t theme_item, const char *const from, const char *const message, char *id)
@@ -942,7 +1522,7 @@ win_print_with_receipt(ProfWin *window, const char show_char, int pad_indent, GT
     receipt->received = FALSE;
 
     buffer_push(window->layout->buffer, show_char, pad_indent, time, flags, theme_item, from, message, receipt);
-    _win_print(window, show_char, pad_indent, time, flags, theme_item, from, message, receipt);
+    _win_measure_pending(window);
     // TODO: cross-reference.. this should be replaced by a real event-based system
     inp_nonblocking(TRUE);
     g_date_time_unref(time);
@@ -952,9 +1532,161 @@ void
 win_mark_received(ProfWin *window, const char *const id)
 {
     gboolean received = buffer_mark_received(window->layout->buffer, id);
-    if (received) {
+    if (!received) {
+        return;
+    }
+
+    // same text and width, so only the colour changes and the rows the
+    // entry takes stay the same
+    ProfBuffEntry *e = buffer_get_entry_by_id(window->layout->buffer, id);
+    ProfLayout *layout = window->layout;
+    if (e->y_end_pos >= layout->y_pos && e->y_start_pos < layout->y_pos + getmaxy(layout->win)) {
+        layout->rendered_pos = -1;
+        ui_mark_dirty();
+    }
+}
+
+// everything up to the entry is marked in one pass, with at most one redraw
+void
+win_mark_received_upto(ProfWin *window, const char *const id)
+{
+    int marked = buffer_mark_received_upto(window->layout->buffer, id);
+    if (marked > 0) {
+        window->layout->rendered_pos = -1;
+        ui_mark_dirty();
+    }
+}
+
+// lets the newest entry be found again by message id
+void
+win_set_last_id(ProfWin *window, const char *const id)
+{
+    ProfBuff buffer = window->layout->buffer;
+    ProfBuffEntry *e = buffer_yield_entry(buffer, buffer_size(buffer) - 1);
+    if (e && id) {
+        buffer_set_id(buffer, e, id);
+    }
+}
+
+// measure an entry given new text where it is, entries after it move by
+// the rows it gained or lost rather than all being measured again
+static void
+_win_remeasure_entry(ProfWin *window, ProfBuffEntry *e)
+{
+    ProfLayout *layout = window->layout;
+    ProfBuff buffer = layout->buffer;
+    if (e->y_start_pos < 0) {
+        layout->rendered_pos = -1;
+        return;
+    }
+
+    // the newest is measured as when it arrived
+    int size = buffer_size(buffer);
+    if (e == buffer_yield_entry(buffer, size - 1)) {
+        layout->lines = e->y_start_pos;
+        layout->last_x = e->x_start_pos;
+        _win_print_entry(window, e);
+        layout->rendered_pos = -1;
+        return;
+    }
+
+    // where the next entry starts depends on where this one ends
+    if (e->flags & NO_EOL) {
         win_redraw(window);
+        return;
+    }
+
+    WINDOW *win = _win_scratch(window);
+    wmove(win, 0, e->x_start_pos);
+    _win_print(window, win, e);
+    scratch_rows = getcury(win) + 1;
+
+    int old_end = e->y_end_pos;
+    int delta = e->y_start_pos + getcury(win) - old_end;
+    e->y_end_pos = old_end + delta;
+    if (delta != 0) {
+        // entries not measured yet follow from the lines of the window
+        int i;
+        for (i = size - 1; i >= 0; i--) {
+            ProfBuffEntry *later = buffer_yield_entry(buffer, i);
+            if (later == e) {
+                break;
+            }
+            if (later->y_start_pos >= 0) {
+                later->y_start_pos += delta;
+                later->y_end_pos += delta;
+            }
+        }
+        layout->lines += delta;
+        if (layout->top >= old_end) {
+            layout->top += delta;
+        }
+        if (layout->paged && layout->y_pos >= old_end) {
+            layout->y_pos += delta;
+        }
+    }
+
+    int view = getmaxy(layout->win);
+    if ((e->y_end_pos >= layout->y_pos && e->y_start_pos < layout->y_pos + view) ||
+            (delta != 0 && old_end < layout->y_pos + view)) {
+        layout->rendered_pos = -1;
+        ui_mark_dirty();
+    }
+}
+
+// gives the entry shown for a message new text, as for a correction, only
+// its own rows are measured again, returns FALSE when it isn't shown
+gboolean
+win_replace_by_id(ProfWin *window, const char *const id, const char *const message)
+{
+    ProfBuffEntry *e = buffer_replace_by_id(window->layout->buffer, id, message);
+    if (e == NULL) {
+        return FALSE;
+    }
+
+    _win_remeasure_entry(window, e);
+    return TRUE;
+}
+
+// a retracted message keeps its place and sender, its text is replaced by
+// a note drawn in the time colour
+gboolean
+win_retract_by_id(ProfWin *window, const char *const id)
+{
+    ProfBuffEntry *e = buffer_replace_by_id(window->layout->buffer, id, "This message was retracted");
+    if (e == NULL) {
+        return FALSE;
     }
+
+    e->theme_item = THEME_TIME;
+    _win_remeasure_entry(window, e);
+    return TRUE;
+}
+
+// the newest entry, for a line updated in place while it is still last
+ProfBuffEntry*
+win_last_entry(ProfWin *window)
+{
+    ProfBuff buffer = window->layout->buffer;
+    return buffer_yield_entry(buffer, buffer_size(buffer) - 1);
+}
+
+// gives the newest entry new text and the current time, it is measured
+// again from where it started
+void
+win_update_last(ProfWin *window, const char *const message)
+{
+    ProfLayout *layout = window->layout;
+    GDateTime *now = g_date_time_new_now_local();
+    ProfBuffEntry *e = buffer_update_last(layout->buffer, now, message);
+    g_date_time_unref(now);
+    if (e == NULL || e->y_start_pos < 0) {
+        return;
+    }
+
+    layout->lines = e->y_start_pos;
+    layout->last_x = e->x_start_pos;
+    _win_print_entry(window, e);
 }
 
 void
@@ -981,50 +1713,151 @@ win_newline(ProfWin *window)
     win_print(window, '-', 0, NULL, NO_DATE, 0, "", "");
 }
 
+// work out the rows taken by a new last entry, the viewport is only
+// drawn again when it shows them
 static void
-_win_print(ProfWin *window, const char show_char, int pad_indent, GDateTime *time,
-    int flags, theme_item_t theme_item, const char *const from, const char *const message, DeliveryReceipt *receipt)
+_win_print_entry(ProfWin *window, ProfBuffEntry *e)
 {
-    // flags : 1st bit =  0/1 - me/not me
-    //         2nd bit =  0/1 - date/no date
-    //         3rd bit =  0/1 - eol/no eol
-    //         4th bit =  0/1 - color from/no color from
-    //         5th bit =  0/1 - color date/no date
-    gboolean me_message = FALSE;
-    int offset = 0;
-    int colour = theme_attrs(THEME_ME);
-    size_t indent = 0;
+    ProfLayout *layout = window->layout;
+    WINDOW *win = _win_scratch(window);
+
+    wmove(win, 0, layout->last_x);
+    e->y_start_pos = layout->lines;
+    e->x_start_pos = layout->last_x;
+    _win_print(window, win, e);
+    scratch_rows = getcury(win) + 1;
+
+    layout->lines += getcury(win);
+    layout->last_x = getcurx(win);
+    e->y_end_pos = layout->lines;
+
+    if (e->y_start_pos < layout->y_pos + getmaxy(layout->win)) {
+        layout->rendered_pos = -1;
+        ui_mark_dirty();
+    }
+}
+
+static void
+_win_print_message_wrapped(WINDOW *win, ProfBuffEntry *e, const char *const message, size_t indent)
+{
+    int width = getmaxx(win);
+    int wrap_x = getcurx(win);
+
+    // replay the cached layout when it was computed for the same geometry
+    ProfBuffLayout *layout = e->layout;
+    if (layout && layout->width == width && layout->wrap_x == wrap_x && layout->indent == indent) {
+        waddstr(win, layout->text);
+        return;
+    }
+
+    GString *text = g_string_new(NULL);
+    _win_print_wrapped(win, message, indent, e->pad_indent, text);
+
+    if (layout == NULL) {
+        layout = malloc(sizeof(ProfBuffLayout));
+        e->layout = layout;
+    } else {
+        free(layout->text);
+    }
+    layout->width = width;
+    layout->wrap_x = wrap_x;
+    layout->indent = indent;
+    layout->text = g_string_free(text, FALSE);
+}
 
-    char *time_pref = NULL;
-    switch (window->type) {
+static preference_t
+_win_time_pref(win_type_t type, int *index)
+{
+    switch (type) {
         case WIN_CHAT:
-            time_pref = prefs_get_string(PREF_TIME_CHAT);
-            break;
+            *index = 0;
+            return PREF_TIME_CHAT;
         case WIN_MUC:
-            time_pref = prefs_get_string(PREF_TIME_MUC);
-            break;
+            *index = 1;
+            return PREF_TIME_MUC;
         case WIN_MUC_CONFIG:
-            time_pref = prefs_get_string(PREF_TIME_MUCCONFIG);
-            break;
+            *index = 2;
+            return PREF_TIME_MUCCONFIG;
         case WIN_PRIVATE:
-            time_pref = prefs_get_string(PREF_TIME_PRIVATE);
-            break;
+            *index = 3;
+            return PREF_TIME_PRIVATE;
         case WIN_XML:
-            time_pref = prefs_get_string(PREF_TIME_XMLCONSOLE);
-            break;
+            *index = 4;
+            return PREF_TIME_XMLCONSOLE;
         default:
-            time_pref = prefs_get_string(PREF_TIME_CONSOLE);
-            break;
+            *index = 5;
+            return PREF_TIME_CONSOLE;
     }
+}
 
-    gchar *date_fmt = NULL;
-    if (g_strcmp0(time_pref, "off") == 0) {
-        date_fmt = g_strdup("");
-    } else {
-        date_fmt = g_date_time_format(time, time_pref);
+// formatted timestamp for the entry, kept on the entry for redraws and
+// shared by entries from the same second
+static const char*
+_win_time_format(ProfWin *window, ProfBuffEntry *e)
+{
+    int index = 0;
+    preference_t pref = _win_time_pref(window->type, &index);
+    TimeFormatCache *cache = &time_formats[index];
+    const char *const time_pref = prefs_peek_string(pref);
+
+    // format changed, nothing formatted so far can be reused
+    if ((cache->version == 0) || (g_strcmp0(cache->format, time_pref) != 0)) {
+        g_free(cache->format);
+        g_free(cache->formatted);
+        cache->format = g_strdup(time_pref);
+        cache->formatted = NULL;
+        cache->subsecond = time_pref && strstr(time_pref, "%f");
+        cache->version = ++time_format_version;
+    }
+
+    if (e->date_fmt && (e->date_fmt_version == cache->version)) {
+        return e->date_fmt;
+    }
+
+    // entry times are all local, so the second alone identifies the text
+    gint64 second = e->time / G_USEC_PER_SEC;
+    if ((cache->formatted == NULL) || cache->subsecond || (cache->second != second)) {
+        g_free(cache->formatted);
+        if (g_strcmp0(time_pref, "off") == 0) {
+            cache->formatted = g_strdup("");
+        } else {
+            GDateTime *time = buffer_entry_datetime(e);
+            cache->formatted = g_date_time_format(time, time_pref);
+            g_date_time_unref(time);
+        }
+        assert(cache->formatted != NULL);
+        cache->second = second;
     }
-    prefs_free_string(time_pref);
-    assert(date_fmt != NULL);
+
+    g_free(e->date_fmt);
+    e->date_fmt = g_strdup(cache->formatted);
+    e->date_fmt_version = cache->version;
+
+    return e->date_fmt;
+}
+
+static void
+_win_print(ProfWin *window, WINDOW *win, ProfBuffEntry *e)
+{
+    gint64 start = stats_start();
+    const char show_char = e->show_char;
+    int flags = e->flags;
+    theme_item_t theme_item = e->theme_item;
+    const char *const from = e->from;
+    const char *const message = e->message;
+    DeliveryReceipt *receipt = e->receipt;
+
+    // flags : 1st bit =  0/1 - me/not me
+    //         2nd bit =  0/1 - date/no date
+    //         3rd bit =  0/1 - eol/no eol
+    //         4th bit =  0/1 - color from/no color from
+    //         5th bit =  0/1 - color date/no date
+    gboolean me_message = FALSE;
+    int offset = 0;
+    int colour = theme_attrs(THEME_ME);
+    size_t indent = 0;
+
+    const char *const date_fmt = _win_time_format(window, e);
 
     if(strlen(date_fmt) != 0){
         indent = 3 + strlen(date_fmt);
@@ -1033,11 +1866,11 @@ _win_print(ProfWin *window, const char show_char, int pad_indent, GDateTime *tim
     if ((flags & NO_DATE) == 0) {
         if (date_fmt && strlen(date_fmt)) {
             if ((flags & NO_COLOUR_DATE) == 0) {
-                wattron(window->layout->win, theme_attrs(THEME_TIME));
+                wattron(win, theme_attrs(THEME_TIME));
             }
-            wprintw(window->layout->win, "%s %c ", date_fmt, show_char);
+            wprintw(win, "%s %c ", date_fmt, show_char);
             if ((flags & NO_COLOUR_DATE) == 0) {
-                wattroff(window->layout->win, theme_attrs(THEME_TIME));
+                wattroff(win, theme_attrs(THEME_TIME));
             }
         }
     }
@@ -1055,182 +1888,561 @@ _win_print(ProfWin *window, const char show_char, int pad_indent, GDateTime *tim
             colour = theme_attrs(THEME_RECEIPT_SENT);
         }
 
-        wattron(window->layout->win, colour);
+        wattron(win, colour);
         if (strncmp(message, "/me ", 4) == 0) {
-            wprintw(window->layout->win, "*%s ", from);
+            wprintw(win, "*%s ", from);
             offset = 4;
             me_message = TRUE;
         } else {
-            wprintw(window->layout->win, "%s: ", from);
-            wattroff(window->layout->win, colour);
+            wprintw(win, "%s: ", from);
+            wattroff(win, colour);
         }
     }
 
     if (!me_message) {
         if (receipt && !receipt->received) {
-            wattron(window->layout->win, theme_attrs(THEME_RECEIPT_SENT));
+            wattron(win, theme_attrs(THEME_RECEIPT_SENT));
         } else {
-            wattron(window->layout->win, theme_attrs(theme_item));
+            wattron(win, theme_attrs(theme_item));
         }
     }
 
+    // the scrollback search match stands out
+    gboolean search_match = e == window->layout->search_entry && e->time == window->layout->search_time;
+    if (search_match) {
+        wattron(win, A_REVERSE);
+    }
+
     if (prefs_get_boolean(PREF_WRAP)) {
-        _win_print_wrapped(window->layout->win, message+offset, indent, pad_indent);
+        _win_print_message_wrapped(win, e, message+offset, indent);
     } else {
-        wprintw(window->layout->win, "%s", message+offset);
+        wprintw(win, "%s", message+offset);
+    }
+
+    if (search_match) {
+        wattroff(win, A_REVERSE);
     }
 
     if ((flags & NO_EOL) == 0) {
-        int curx = getcurx(window->layout->win);
+        int curx = getcurx(win);
         if (curx != 0) {
-            wprintw(window->layout->win, "\n");
+            wprintw(win, "\n");
         }
     }
 
     if (me_message) {
-        wattroff(window->layout->win, colour);
+        wattroff(win, colour);
     } else {
         if (receipt && !receipt->received) {
-            wattroff(window->layout->win, theme_attrs(THEME_RECEIPT_SENT));
+            wattroff(win, theme_attrs(THEME_RECEIPT_SENT));
         } else {
-            wattroff(window->layout->win, theme_attrs(theme_item));
+            wattroff(win, theme_attrs(theme_item));
         }
     }
+    stats_record(STATS_WIN_PRINT, start);
+}
+
+// where curses will leave the cursor once the layout so far is written,
+// so wrapping is worked out without any curses calls
+typedef struct wrap_cursor_t {
+    GString *text;
+    int x;
+    int line;
+    int maxx;
+} WrapCursor;
+
+static void
+_wrap_newline(WrapCursor *cursor)
+{
+    g_string_append_c(cursor->text, '\n');
+    cursor->x = 0;
+    cursor->line++;
+}
+
+static void
+_wrap_advance(WrapCursor *cursor, int width)
+{
+    // a wide character that does not fit starts the next line
+    if ((width == 2) && (cursor->x + width > cursor->maxx)) {
+        cursor->x = 0;
+        cursor->line++;
+    }
+    cursor->x += width;
+
+    // curses moves to the next line once the last column is written
+    while (cursor->x >= cursor->maxx) {
+        cursor->x -= cursor->maxx;
+        cursor->line++;
+    }
+}
+
+static int
+_wrap_char_width(const char *const ch, const char **next)
+{
+    size_t len = 0;
+    int width = width_utf8_char(ch, &len);
+    *next = ch + len;
+
+    return width;
+}
+
+static void
+_wrap_append(WrapCursor *cursor, const char *const str, size_t len, int width)
+{
+    g_string_append_len(cursor->text, str, len);
+
+    if ((cursor->x + width < cursor->maxx) || (width == len)) {
+        _wrap_advance(cursor, width);
+        return;
+    }
 
-    g_free(date_fmt);
+    // reaches the edge with wide characters, follow them one at a time
+    const char *curr = str;
+    while (curr < str + len) {
+        _wrap_advance(cursor, _wrap_char_width(curr, &curr));
+    }
 }
 
 static void
-_win_indent(WINDOW *win, int size)
+_wrap_spaces(WrapCursor *cursor, int size)
 {
     int i = 0;
     for (i = 0; i < size; i++) {
-        waddch(win, ' ');
+        g_string_append_c(cursor->text, ' ');
+    }
+    cursor->x += size;
+    while (cursor->x >= cursor->maxx) {
+        cursor->x -= cursor->maxx;
+        cursor->line++;
     }
 }
 
+// indent to the message start on the first line, and by the pad indent
+// as well on following lines
 static void
-_win_print_wrapped(WINDOW *win, const char *const message, size_t indent, int pad_indent)
+_wrap_indent(WrapCursor *cursor, size_t indent, int pad_indent)
+{
+    if (cursor->line == 0) {
+        if (cursor->x < indent) {
+            _wrap_spaces(cursor, indent);
+        }
+    } else if (cursor->x < (indent + pad_indent)) {
+        _wrap_spaces(cursor, indent + pad_indent);
+    }
+}
+
+static gboolean
+_wrap_is_ascii(const char *const str, size_t len)
 {
-    int starty = getcury(win);
-    int wordi = 0;
-    char *word = malloc(strlen(message) + 1);
+    return width_ascii_len(str, len) == len;
+}
 
-    gchar *curr_ch = g_utf8_offset_to_pointer(message, 0);
+// display width of the word at str, which ends at a space, newline or the
+// end of the message, len is set to its length in bytes
+static int
+_wrap_word_width(const char *const str, gboolean ascii, size_t *len)
+{
+    if (ascii) {
+        *len = strcspn(str, " \n");
+        return *len;
+    }
+
+    int width = 0;
+    const char *curr = str;
+    while (*curr != ' ' && *curr != '\n' && *curr != '\0') {
+        width += _wrap_char_width(curr, &curr);
+    }
+    *len = curr - str;
 
-    while (*curr_ch != '\0') {
+    return width;
+}
+
+// the text to write for message from the cursor, with the breaks and
+// indents wrapping adds, nothing here touches curses so it runs on the
+// layout workers as well
+static void
+_wrap_layout(WrapCursor *cursor, const char *const message, size_t indent, int pad_indent)
+{
+    gboolean ascii = _wrap_is_ascii(message, strlen(message));
+    const char *curr = message;
+
+    while (*curr != '\0') {
 
         // handle space
-        if (*curr_ch == ' ') {
-            waddch(win, ' ');
-            curr_ch = g_utf8_next_char(curr_ch);
+        if (*curr == ' ') {
+            _wrap_append(cursor, curr, 1, 1);
+            curr++;
 
         // handle newline
-        } else if (*curr_ch == '\n') {
-            waddch(win, '\n');
-            _win_indent(win, indent + pad_indent);
-            curr_ch = g_utf8_next_char(curr_ch);
+        } else if (*curr == '\n') {
+            _wrap_newline(cursor);
+            _wrap_spaces(cursor, indent + pad_indent);
+            curr++;
 
         // handle word
         } else {
-            wordi = 0;
-            int wordlen = 0;
-            while (*curr_ch != ' ' && *curr_ch != '\n' && *curr_ch != '\0') {
-                size_t ch_len = mbrlen(curr_ch, 4, NULL);
-                int offset = 0;
-                while (offset < ch_len) {
-                    word[wordi++] = curr_ch[offset++];
-                }
-                curr_ch = g_utf8_next_char(curr_ch);
-            }
-            word[wordi] = '\0';
-            wordlen = utf8_display_len(word);
-
-            int curx = getcurx(win);
-            int cury = getcury(win);
-            int maxx = getmaxx(win);
+            size_t wordlen_bytes = 0;
+            int wordlen = _wrap_word_width(curr, ascii, &wordlen_bytes);
+            const char *word_end = curr + wordlen_bytes;
 
             // wrap required
-            if (curx + wordlen > maxx) {
-                int linelen = maxx - (indent + pad_indent);
+            if (cursor->x + wordlen > cursor->maxx) {
+                int linelen = cursor->maxx - (indent + pad_indent);
 
                 // word larger than line
                 if (wordlen > linelen) {
-                    gchar *word_ch = g_utf8_offset_to_pointer(word, 0);
-                    while(*word_ch != '\0') {
-                        curx = getcurx(win);
-                        cury = getcury(win);
-                        gboolean firstline = cury == starty;
-
-                        if (firstline && curx < indent) {
-                            _win_indent(win, indent);
-                        }
-                        if (!firstline && curx < (indent + pad_indent)) {
-                            _win_indent(win, indent + pad_indent);
-                        }
-
-                        gchar copy[wordi+1];
-                        g_utf8_strncpy(copy, word_ch, 1);
-                        waddstr(win, copy);
-
-                        word_ch = g_utf8_next_char(word_ch);
+                    while (curr < word_end) {
+                        _wrap_indent(cursor, indent, pad_indent);
+                        const char *next = NULL;
+                        int ch_width = _wrap_char_width(curr, &next);
+                        _wrap_append(cursor, curr, next - curr, ch_width);
+                        curr = next;
                     }
 
                 // newline and print word
                 } else {
-                    waddch(win, '\n');
-                    curx = getcurx(win);
-                    cury = getcury(win);
-                    gboolean firstline = cury == starty;
-
-                    if (firstline && curx < indent) {
-                        _win_indent(win, indent);
-                    }
-                    if (!firstline && curx < (indent + pad_indent)) {
-                        _win_indent(win, indent + pad_indent);
-                    }
-                    waddstr(win, word);
+                    _wrap_newline(cursor);
+                    _wrap_indent(cursor, indent, pad_indent);
+                    _wrap_append(cursor, curr, wordlen_bytes, wordlen);
                 }
 
             // no wrap required
             } else {
-                curx = getcurx(win);
-                cury = getcury(win);
-                gboolean firstline = cury == starty;
-
-                if (firstline && curx < indent) {
-                    _win_indent(win, indent);
-                }
-                if (!firstline && curx < (indent + pad_indent)) {
-                    _win_indent(win, indent + pad_indent);
-                }
-                waddstr(win, word);
+                _wrap_indent(cursor, indent, pad_indent);
+                _wrap_append(cursor, curr, wordlen_bytes, wordlen);
             }
+            curr = word_end;
         }
 
         // consume first space of next line
-        int curx = getcurx(win);
-        int cury = getcury(win);
-        gboolean firstline = (cury == starty);
+        if ((cursor->line > 0) && (cursor->x == 0) && (*curr == ' ')) {
+            curr++;
+        }
+    }
+}
+
+static void
+_win_print_wrapped(WINDOW *win, const char *const message, size_t indent, int pad_indent, GString *layout)
+{
+    WrapCursor cursor;
+    cursor.text = layout;
+    cursor.x = getcurx(win);
+    cursor.line = 0;
+    cursor.maxx = getmaxx(win);
+
+    size_t start = layout->len;
+    _wrap_layout(&cursor, message, indent, pad_indent);
+    waddnstr(win, layout->str + start, layout->len - start);
+}
+
+static void
+_win_fetch_older(ProfWin *window)
+{
+    if (jabber_get_connection_status() != JABBER_CONNECTED) {
+        return;
+    }
+
+    ProfBuffEntry *oldest = buffer_yield_entry(window->layout->buffer, 0);
+    GDateTime *end = oldest ? buffer_entry_datetime(oldest) : NULL;
+
+    if (window->type == WIN_CHAT) {
+        ProfChatWin *chatwin = (ProfChatWin*)window;
+        mam_fetch_older(chatwin->barejid, FALSE, end);
+    } else if (window->type == WIN_MUC) {
+        ProfMucWin *mucwin = (ProfMucWin*)window;
+        mam_fetch_older(mucwin->roomjid, TRUE, end);
+    }
+
+    if (end) {
+        g_date_time_unref(end);
+    }
+}
+
+// where the message of an entry starting a row begins, as _win_print
+// leaves the cursor after the time and sender, -1 when that isn't known
+// without drawing it
+static int
+_win_message_x(ProfWin *window, ProfBuffEntry *e, int maxx, size_t *indent, int *offset)
+{
+    const char *const date_fmt = _win_time_format(window, e);
+    *indent = strlen(date_fmt) != 0 ? 3 + strlen(date_fmt) : 0;
+    *offset = 0;
+
+    int x = 0;
+    if (((e->flags & NO_DATE) == 0) && strlen(date_fmt)) {
+        x += utf8_display_len(date_fmt) + 3;
+    }
+    if (strlen(e->from) > 0) {
+        x += utf8_display_len(e->from) + 2;
+        if (strncmp(e->message, "/me ", 4) == 0) {
+            *offset = 4;
+        }
+    }
+
+    return x < maxx ? x : -1;
+}
+
+static void
+_wrap_job_run(WrapJob *job, int maxx)
+{
+    GString *text = g_string_new(NULL);
+    WrapCursor cursor;
+    cursor.text = text;
+    cursor.x = job->x;
+    cursor.line = 0;
+    cursor.maxx = maxx;
+    _wrap_layout(&cursor, job->message, job->indent, job->entry->pad_indent);
+    job->text = g_string_free(text, FALSE);
+}
+
+static void
+_wrap_chunk_run(WrapChunk *chunk, gpointer unused)
+{
+    int i;
+    for (i = 0; i < chunk->count; i++) {
+        _wrap_job_run(&chunk->jobs[i], chunk->maxx);
+    }
+
+    g_mutex_lock(chunk->lock);
+    if (--(*chunk->pending) == 0) {
+        g_cond_signal(chunk->done);
+    }
+    g_mutex_unlock(chunk->lock);
+}
+
+// wrap the messages of a window being drawn from the start across the
+// layout workers, the main thread waits for them and keeps one share for
+// itself, the layouts are then replayed by _win_print as if cached
+static void
+_win_wrap_parallel(ProfWin *window)
+{
+    ProfBuff buffer = window->layout->buffer;
+    int size = buffer_size(buffer);
+    if ((size < WRAP_PARALLEL_MIN) || !prefs_get_boolean(PREF_WRAP)) {
+        return;
+    }
+
+    if (wrap_workers == NULL) {
+        int threads = MIN(g_get_num_processors(), WRAP_WORKERS_MAX) - 1;
+        if (threads < 1) {
+            return;
+        }
+        wrap_workers = g_thread_pool_new((GFunc)_wrap_chunk_run, NULL, threads, FALSE, NULL);
+        if (wrap_workers == NULL) {
+            return;
+        }
+    }
+
+    // only entries starting a row, what follows one printed without a
+    // newline depends on where that ended
+    int maxx = getmaxx(window->layout->win);
+    WrapJob *jobs = malloc(sizeof(WrapJob) * size);
+    int count = 0;
+    gboolean row_start = TRUE;
+    int i;
+    for (i = 0; i < size; i++) {
+        ProfBuffEntry *e = buffer_yield_entry(buffer, i);
+        size_t indent = 0;
+        int offset = 0;
+        int x = row_start ? _win_message_x(window, e, maxx, &indent, &offset) : -1;
+        row_start = (e->flags & NO_EOL) == 0;
+        ProfBuffLayout *layout = e->layout;
+        if ((x < 0) || (layout && layout->width == maxx && layout->wrap_x == x && layout->indent == indent)) {
+            continue;
+        }
+        jobs[count].entry = e;
+        jobs[count].message = e->message + offset;
+        jobs[count].x = x;
+        jobs[count].indent = indent;
+        jobs[count].text = NULL;
+        count++;
+    }
+
+    if (count < WRAP_PARALLEL_MIN) {
+        free(jobs);
+        return;
+    }
 
-        if (!firstline && curx == 0 && *curr_ch == ' ') {
-            curr_ch = g_utf8_next_char(curr_ch);
+    int shares = MIN(g_get_num_processors(), WRAP_WORKERS_MAX);
+    int chunk_size = MAX((count + shares - 1) / shares, WRAP_CHUNK_MIN);
+    int chunks = (count + chunk_size - 1) / chunk_size;
+    WrapChunk *chunk_list = malloc(sizeof(WrapChunk) * chunks);
+    GMutex lock;
+    GCond done;
+    g_mutex_init(&lock);
+    g_cond_init(&done);
+    int pending = chunks - 1;
+    for (i = 0; i < chunks; i++) {
+        chunk_list[i].jobs = &jobs[i * chunk_size];
+        chunk_list[i].count = MIN(chunk_size, count - i * chunk_size);
+        chunk_list[i].maxx = maxx;
+        chunk_list[i].pending = &pending;
+        chunk_list[i].lock = &lock;
+        chunk_list[i].done = &done;
+        if ((i > 0) && !g_thread_pool_push(wrap_workers, &chunk_list[i], NULL)) {
+            _wrap_chunk_run(&chunk_list[i], NULL);
         }
     }
 
-    free(word);
+    // the first share is wrapped here while the workers do the rest
+    for (i = 0; i < chunk_list[0].count; i++) {
+        _wrap_job_run(&jobs[i], maxx);
+    }
+    g_mutex_lock(&lock);
+    while (pending > 0) {
+        g_cond_wait(&done, &lock);
+    }
+    g_mutex_unlock(&lock);
+    g_mutex_clear(&lock);
+    g_cond_clear(&done);
+    free(chunk_list);
+
+    for (i = 0; i < count; i++) {
+        ProfBuffEntry *e = jobs[i].entry;
+        if (e->layout == NULL) {
+            e->layout = malloc(sizeof(ProfBuffLayout));
+        } else {
+            free(e->layout->text);
+        }
+        e->layout->width = maxx;
+        e->layout->wrap_x = jobs[i].x;
+        e->layout->indent = jobs[i].indent;
+        e->layout->text = jobs[i].text;
+    }
+    free(jobs);
 }
 
 void
 win_redraw(ProfWin *window)
 {
-    int i, size;
-    werase(window->layout->win);
-    size = buffer_size(window->layout->buffer);
+    gint64 start = stats_start();
+    gint64 usage_start = g_get_monotonic_time();
+    ProfBuffIter iter;
+    ProfBuffEntry *e = NULL;
 
-    for (i = 0; i < size; i++) {
-        ProfBuffEntry *e = buffer_yield_entry(window->layout->buffer, i);
-        _win_print(window, e->show_char, e->pad_indent, e->time, e->flags, e->theme_item, e->from, e->message, e->receipt);
+    _win_init_lines(window->layout);
+    _win_wrap_parallel(window);
+
+    buffer_iter_init(&iter, window->layout->buffer);
+    while ((e = buffer_iter_next(&iter))) {
+        _win_print_entry(window, e);
+    }
+    window->layout->usage_render += g_get_monotonic_time() - usage_start;
+    stats_record(STATS_WIN_REDRAW, start);
+}
+
+// work out the rows of entries added with win_print_deferred, or of the
+// whole buffer when older entries were prepended
+static void
+_win_measure_pending(ProfWin *window)
+{
+    ProfBuff buffer = window->layout->buffer;
+    int size = buffer_size(buffer);
+    if (size == 0 || window->layout->hibernated) {
+        return;
+    }
+
+    if (buffer_yield_entry(buffer, 0)->y_start_pos < 0) {
+        win_redraw(window);
+        return;
+    }
+
+    int first = size;
+    while (buffer_yield_entry(buffer, first - 1)->y_start_pos < 0) {
+        first--;
+    }
+
+    int i = 0;
+    for (i = first; i < size; i++) {
+        _win_print_entry(window, buffer_yield_entry(buffer, i));
+    }
+}
+
+// draw the entries covering the visible rows, starting from the first one
+// on its row so entries printed without a newline come out the same
+static void
+_win_render(ProfWin *window)
+{
+    ProfLayout *layout = window->layout;
+    if (layout->rendered_pos == layout->y_pos) {
+        return;
+    }
+
+    _win_measure_pending(window);
+    int size = buffer_size(layout->buffer);
+
+    int pos = layout->y_pos > 0 ? layout->y_pos : 0;
+    int view = getmaxy(layout->win);
+    int width = getmaxx(layout->win);
+    werase(layout->win);
+    layout->rendered_pos = layout->y_pos;
+    if (size == 0) {
+        return;
+    }
+
+    // first entry reaching the top row
+    int low = 0;
+    int high = size - 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (buffer_yield_entry(layout->buffer, mid)->y_end_pos < pos) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    while (low > 0 && buffer_yield_entry(layout->buffer, low)->x_start_pos != 0) {
+        low--;
+    }
+
+    WINDOW *win = _win_scratch(window);
+    int base = buffer_yield_entry(layout->buffer, low)->y_start_pos;
+    int i = 0;
+    for (i = low; i < size; i++) {
+        ProfBuffEntry *e = buffer_yield_entry(layout->buffer, i);
+        if ((e->y_start_pos >= pos + view) || (e->y_start_pos - base >= PAD_SIZE)) {
+            break;
+        }
+        wmove(win, e->y_start_pos - base, e->x_start_pos);
+        _win_print(window, win, e);
+        scratch_rows = getcury(win) + 1;
+    }
+
+    // the view can start above the oldest entry once it has been dropped
+    int from = pos - base;
+    int to = 0;
+    if (from < 0) {
+        to = -from;
+        from = 0;
+    }
+    if ((to >= view) || (from >= PAD_SIZE)) {
+        return;
+    }
+
+    int rows = view - to;
+    if (rows > PAD_SIZE - from) {
+        rows = PAD_SIZE - from;
+    }
+    copywin(win, layout->win, from, 0, to, 0, to + rows - 1, width - 1, FALSE);
+
+    // lines that arrived while drawing was held back and went past the top
+    // without ever being shown
+    if (layout->render_held) {
+        guint arrived = buffer_pushed(layout->buffer) - layout->render_pushed;
+        int collapsed = 0;
+        for (i = arrived < (guint)size ? size - (int)arrived : 0; i < size; i++) {
+            if (buffer_yield_entry(layout->buffer, i)->y_end_pos >= pos) {
+                break;
+            }
+            collapsed++;
+        }
+        if (collapsed > 0) {
+            wattron(layout->win, theme_attrs(THEME_TIME));
+            mvwprintw(layout->win, 0, 0, "-- %d message%s collapsed, scroll up to read --", collapsed,
+                collapsed == 1 ? "" : "s");
+            wclrtoeol(layout->win);
+            wattroff(layout->win, theme_attrs(THEME_TIME));
+        }
     }
 }
 
@@ -1275,3 +2487,142 @@ win_printline_nowrap(WINDOW *win, char *msg)
 
     wmove(win, cury+1, 0);
 }
+
+static void
+_win_panel_rows_free(PanelRows *rows)
+{
+    g_ptr_array_free(rows->text, TRUE);
+    g_array_free(rows->items, TRUE);
+    free(rows);
+}
+
+// rows keyed by contact jid or occupant nick
+GHashTable*
+win_panel_cache_new(void)
+{
+    return g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_win_panel_rows_free);
+}
+
+// cached rows for the key, emptied to be built again with
+// win_panel_rows_add when anything they were built from has changed
+PanelRows*
+win_panel_rows(GHashTable *cache, const char *const key, WINDOW *win, int version, int settings)
+{
+    int width = getmaxx(win);
+    PanelRows *rows = g_hash_table_lookup(cache, key);
+    if (rows == NULL) {
+        rows = malloc(sizeof(PanelRows));
+        rows->text = g_ptr_array_new_with_free_func(g_free);
+        rows->items = g_array_new(FALSE, FALSE, sizeof(theme_item_t));
+        rows->version = version - 1;
+        g_hash_table_insert(cache, strdup(key), rows);
+    }
+
+    if (rows->version != version || rows->width != width || rows->settings != settings) {
+        g_ptr_array_set_size(rows->text, 0);
+        g_array_set_size(rows->items, 0);
+        rows->version = version;
+        rows->width = width;
+        rows->settings = settings;
+    }
+    rows->seen = TRUE;
+
+    return rows;
+}
+
+void
+win_panel_rows_add(PanelRows *rows, theme_item_t theme_item, const char *const msg)
+{
+    g_ptr_array_add(rows->text, g_strndup(msg, rows->width));
+    g_array_append_val(rows->items, theme_item);
+}
+
+// rows of the panel within a view either side of the view are written,
+// rows above them are counted but not drawn
+void
+win_panel_begin(ProfLayoutSplit *layout, PanelSlice *slice)
+{
+    int view = _win_view_rows();
+    int first = layout->sub_y_pos - view;
+    if (first < 0) {
+        first = 0;
+    }
+    int size = view * 3;
+    if (size > PAD_SIZE) {
+        size = PAD_SIZE;
+    }
+
+    werase(layout->subwin);
+    slice->win = layout->subwin;
+    slice->row = 0;
+    slice->first = first;
+    slice->last = first + size;
+    layout->sub_top = first;
+}
+
+// whether any of the next rows are written, when not their text need not
+// be worked out and win_panel_skip can be used instead
+gboolean
+win_panel_shows(PanelSlice *slice, int rows)
+{
+    return slice->row + rows > slice->first && slice->row < slice->last;
+}
+
+void
+win_panel_skip(PanelSlice *slice, int rows)
+{
+    slice->row += rows;
+}
+
+void
+win_panel_header(PanelSlice *slice, theme_item_t theme_item, const char *const text)
+{
+    if (win_panel_shows(slice, 1)) {
+        wmove(slice->win, slice->row - slice->first, 0);
+        wattron(slice->win, theme_attrs(theme_item));
+        win_printline_nowrap(slice->win, (char*)text);
+        wattroff(slice->win, theme_attrs(theme_item));
+    }
+    slice->row++;
+}
+
+void
+win_panel_put(PanelSlice *slice, PanelRows *rows)
+{
+    int i = 0;
+    for (i = 0; i < rows->text->len; i++) {
+        if (slice->row >= slice->first && slice->row < slice->last) {
+            int attrs = theme_attrs(g_array_index(rows->items, theme_item_t, i));
+            wmove(slice->win, slice->row - slice->first, 0);
+            wattron(slice->win, attrs);
+            waddstr(slice->win, g_ptr_array_index(rows->text, i));
+            wattroff(slice->win, attrs);
+        }
+        slice->row++;
+    }
+}
+
+void
+win_panel_end(ProfLayoutSplit *layout, PanelSlice *slice)
+{
+    layout->sub_lines = slice->row;
+}
+
+// drop rows for items not drawn since the last prune
+static gboolean
+_win_panel_rows_unseen(gpointer key, gpointer value, gpointer data)
+{
+    PanelRows *rows = value;
+    if (!rows->seen) {
+        return TRUE;
+    }
+    rows->seen = FALSE;
+
+    return FALSE;
+}
+
+void
+win_panel_cache_prune(GHashTable *cache)
+{
+    g_hash_table_foreach_remove(cache, _win_panel_rows_unseen, NULL);
+}
@@ -52,6 +52,7 @@
 #include <ncurses.h>
 #endif
 
+// rows of the pad entries are drawn on before being copied to a window
 #define PAD_SIZE 1000
 
 void win_move_to_end(ProfWin *window);
@@ -65,10 +66,54 @@ void win_print_with_receipt(ProfWin *window, const char show_char, int pad_inden
     theme_item_t theme_item, const char *const from, const char *const message, char *id);
 void win_newline(ProfWin *window);
 void win_redraw(ProfWin *window);
+gboolean win_prepend(ProfWin *window, const char show_char, int pad_indent, GDateTime *timestamp,
+    int flags, theme_item_t theme_item, const char *const from, const char *const message);
+void win_refresh_prepended(ProfWin *window);
+void win_print_deferred(ProfWin *window, const char show_char, int pad_indent, GDateTime *timestamp,
+    int flags, theme_item_t theme_item, const char *const from, const char *const message);
+void win_batch_begin(ProfWin *window);
+void win_batch_end(ProfWin *window);
 int win_roster_cols(void);
 int win_occpuants_cols(void);
 void win_printline_nowrap(WINDOW *win, char *msg);
+
+// the rows one contact or occupant takes in a side panel, reused while the
+// panel width, the settings and the version of the item stay the same
+typedef struct panel_rows_t {
+    int version;
+    int width;
+    int settings;
+    gboolean seen;
+    GPtrArray *text;
+    GArray *items;
+} PanelRows;
+
+GHashTable* win_panel_cache_new(void);
+PanelRows* win_panel_rows(GHashTable *cache, const char *const key, WINDOW *win, int version, int settings);
+void win_panel_rows_add(PanelRows *rows, theme_item_t theme_item, const char *const msg);
+void win_panel_cache_prune(GHashTable *cache);
+
+// the part of a side panel being drawn, by rows of the whole panel
+typedef struct panel_slice_t {
+    WINDOW *win;
+    int row;
+    int first;
+    int last;
+} PanelSlice;
+
+void win_panel_begin(ProfLayoutSplit *layout, PanelSlice *slice);
+gboolean win_panel_shows(PanelSlice *slice, int rows);
+void win_panel_skip(PanelSlice *slice, int rows);
+void win_panel_header(PanelSlice *slice, theme_item_t theme_item, const char *const text);
+void win_panel_put(PanelSlice *slice, PanelRows *rows);
+void win_panel_end(ProfLayoutSplit *layout, PanelSlice *slice);
 void win_mark_received(ProfWin *window, const char *const id);
+void win_mark_received_upto(ProfWin *window, const char *const id);
+void win_set_last_id(ProfWin *window, const char *const id);
+gboolean win_replace_by_id(ProfWin *window, const char *const id, const char *const message);
+gboolean win_retract_by_id(ProfWin *window, const char *const id);
+ProfBuffEntry* win_last_entry(ProfWin *window);
+void win_update_last(ProfWin *window, const char *const message);
 
 gboolean win_has_active_subwin(ProfWin *window);
 
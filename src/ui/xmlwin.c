@@ -33,23 +33,115 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
 
 #include "ui/win_types.h"
+#include "ui/window.h"
 #include "window_list.h"
 
+// element names or namespaces, when any are set only stanzas matching one
+// are kept
+static GSList *filters = NULL;
+
+static gboolean
+_xmlwin_matches(const char *const stanza)
+{
+    if (filters == NULL) {
+        return TRUE;
+    }
+
+    // name of the top level element, without any prefix
+    const char *name = stanza;
+    if (*name == '<') {
+        name++;
+    }
+    size_t name_len = strcspn(name, " \t\r\n/>");
+    const char *colon = memchr(name, ':', name_len);
+    if (colon) {
+        name_len -= (colon + 1) - name;
+        name = colon + 1;
+    }
+
+    GSList *curr = filters;
+    while (curr) {
+        const char *filter = curr->data;
+        if ((strlen(filter) == name_len) && (strncmp(filter, name, name_len) == 0)) {
+            return TRUE;
+        }
+
+        GString *ns = g_string_new(NULL);
+        g_string_printf(ns, "xmlns=\"%s\"", filter);
+        gboolean found = strstr(stanza, ns->str) != NULL;
+        if (!found) {
+            g_string_printf(ns, "xmlns='%s'", filter);
+            found = strstr(stanza, ns->str) != NULL;
+        }
+        g_string_free(ns, TRUE);
+        if (found) {
+            return TRUE;
+        }
+
+        curr = g_slist_next(curr);
+    }
+
+    return FALSE;
+}
+
 void
-xmlwin_show(ProfXMLWin *xmlwin, const char *const msg)
+xmlwin_show(ProfXMLWin *xmlwin, gboolean sent, const char *const text)
 {
     assert(xmlwin != NULL);
 
+    if (!_xmlwin_matches(text)) {
+        return;
+    }
+
+    // wrapped when the console is next looked at, not as traffic arrives
     ProfWin *window = (ProfWin*)xmlwin;
-    if (g_str_has_prefix(msg, "SENT:")) {
-        win_print(window, '-', 0, NULL, 0, 0, "", "SENT:");
-        win_print(window, '-', 0, NULL, 0, THEME_ONLINE, "", &msg[6]);
-        win_print(window, '-', 0, NULL, 0, THEME_ONLINE, "", "");
-    } else if (g_str_has_prefix(msg, "RECV:")) {
-        win_print(window, '-', 0, NULL, 0, 0, "", "RECV:");
-        win_print(window, '-', 0, NULL, 0, THEME_AWAY, "", &msg[6]);
-        win_print(window, '-', 0, NULL, 0, THEME_AWAY, "", "");
+    if (sent) {
+        win_print_deferred(window, '-', 0, NULL, 0, 0, "", "SENT:");
+        win_print_deferred(window, '-', 0, NULL, 0, THEME_ONLINE, "", text);
+        win_print_deferred(window, '-', 0, NULL, 0, THEME_ONLINE, "", "");
+    } else {
+        win_print_deferred(window, '-', 0, NULL, 0, 0, "", "RECV:");
+        win_print_deferred(window, '-', 0, NULL, 0, THEME_AWAY, "", text);
+        win_print_deferred(window, '-', 0, NULL, 0, THEME_AWAY, "", "");
     }
 }
+
+void
+xmlwin_filter_add(const char *const filter)
+{
+    if (!g_slist_find_custom(filters, filter, (GCompareFunc)g_strcmp0)) {
+        filters = g_slist_append(filters, strdup(filter));
+    }
+}
+
+gboolean
+xmlwin_filter_remove(const char *const filter)
+{
+    GSList *found = g_slist_find_custom(filters, filter, (GCompareFunc)g_strcmp0);
+    if (!found) {
+        return FALSE;
+    }
+
+    free(found->data);
+    filters = g_slist_delete_link(filters, found);
+    return TRUE;
+}
+
+void
+xmlwin_filter_clear(void)
+{
+    g_slist_free_full(filters, free);
+    filters = NULL;
+}
+
+GSList*
+xmlwin_filter_list(void)
+{
+    return filters;
+}
@@ -41,23 +41,53 @@
 #include <glib.h>
 
 #include "common.h"
+#include "log.h"
 #include "roster_list.h"
+#include "config/preferences.h"
 #include "config/theme.h"
 #include "ui/ui.h"
 #include "ui/statusbar.h"
+#include "ui/buffer.h"
 #include "window_list.h"
+#include "xmpp/xmpp.h"
+#include "event/server_events.h"
+
+// messages left in a window however far over the scrollback limit
+#define SCROLLBACK_KEEP 20
 
 static GHashTable *windows;
 static int current;
 
+// windows by the jid they are for, keyed by the window's own string so
+// entries must be removed before the window is freed
+static GHashTable *chat_wins;
+static GHashTable *muc_wins;
+static GHashTable *muc_conf_wins;
+static GHashTable *private_wins;
+
+// sum of the unread counts of all windows
+static int total_unread;
+
+static void _wins_insert(GHashTable *table, int num, ProfWin *window);
+static void _wins_index(ProfWin *window);
+static void _wins_unindex(ProfWin *window);
+static const char* _wins_summary(ProfWin *window);
+
+// the one XML console when open, stanza text is only passed to it then
+static ProfXMLWin *xmlconsole = NULL;
+
 void
 wins_init(void)
 {
     windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
         (GDestroyNotify)win_free);
+    chat_wins = g_hash_table_new(g_str_hash, g_str_equal);
+    muc_wins = g_hash_table_new(g_str_hash, g_str_equal);
+    muc_conf_wins = g_hash_table_new(g_str_hash, g_str_equal);
+    private_wins = g_hash_table_new(g_str_hash, g_str_equal);
 
     ProfWin *console = win_create_console();
-    g_hash_table_insert(windows, GINT_TO_POINTER(1), console);
+    _wins_insert(windows, 1, console);
 
     current = 1;
 }
@@ -78,89 +108,41 @@ wins_chat_exists(const char *const barejid)
 ProfChatWin*
 wins_get_chat(const char *const barejid)
 {
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
-
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (window->type == WIN_CHAT) {
-            ProfChatWin *chatwin = (ProfChatWin*)window;
-            if (g_strcmp0(chatwin->barejid, barejid) == 0) {
-                g_list_free(values);
-                return chatwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (barejid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(chat_wins, barejid);
 }
 
 ProfMucConfWin*
 wins_get_muc_conf(const char *const roomjid)
 {
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
-
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (window->type == WIN_MUC_CONFIG) {
-            ProfMucConfWin *confwin = (ProfMucConfWin*)window;
-            if (g_strcmp0(confwin->roomjid, roomjid) == 0) {
-                g_list_free(values);
-                return confwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (roomjid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(muc_conf_wins, roomjid);
 }
 
 ProfMucWin*
 wins_get_muc(const char *const roomjid)
 {
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
-
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (window->type == WIN_MUC) {
-            ProfMucWin *mucwin = (ProfMucWin*)window;
-            if (g_strcmp0(mucwin->roomjid, roomjid) == 0) {
-                g_list_free(values);
-                return mucwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (roomjid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(muc_wins, roomjid);
 }
 
 ProfPrivateWin*
 wins_get_private(const char *const fulljid)
 {
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
-
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (window->type == WIN_PRIVATE) {
-            ProfPrivateWin *privatewin = (ProfPrivateWin*)window;
-            if (g_strcmp0(privatewin->fulljid, fulljid) == 0) {
-                g_list_free(values);
-                return privatewin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (fulljid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(private_wins, fulljid);
 }
 
 ProfWin*
@@ -184,7 +166,15 @@ wins_set_current_by_num(int i)
 {
     ProfWin *window = g_hash_table_lookup(windows, GINT_TO_POINTER(i));
     if (window) {
+        ProfWin *previous = g_hash_table_lookup(windows, GINT_TO_POINTER(current));
+        if (previous) {
+            previous->layout->viewed = g_get_monotonic_time();
+        }
+        window->layout->viewed = g_get_monotonic_time();
         current = i;
+        win_wake(window);
+        win_resize_if_stale(window);
+        total_unread -= win_unread(window);
         if (window->type == WIN_CHAT) {
             ProfChatWin *chatwin = (ProfChatWin*) window;
             assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
@@ -193,6 +183,8 @@ wins_set_current_by_num(int i)
             ProfMucWin *mucwin = (ProfMucWin*) window;
             assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
             mucwin->unread = 0;
+            mucwin->digest_messages = 0;
+            mucwin->digest_mentions = 0;
         } else if (window->type == WIN_PRIVATE) {
             ProfPrivateWin *privatewin = (ProfPrivateWin*) window;
             privatewin->unread = 0;
@@ -268,21 +260,7 @@ wins_get_previous(void)
 int
 wins_get_num(ProfWin *window)
 {
-    GList *keys = g_hash_table_get_keys(windows);
-    GList *curr = keys;
-
-    while (curr) {
-        gconstpointer num_p = curr->data;
-        ProfWin *curr_win = g_hash_table_lookup(windows, num_p);
-        if (curr_win == window) {
-            g_list_free(keys);
-            return GPOINTER_TO_INT(num_p);
-        }
-        curr = g_list_next(curr);
-    }
-
-    g_list_free(keys);
-    return -1;
+    return window->num;
 }
 
 int
@@ -297,6 +275,22 @@ wins_close_current(void)
     wins_close_by_num(current);
 }
 
+static void
+_wins_remove(int i)
+{
+    ProfWin *window = g_hash_table_lookup(windows, GINT_TO_POINTER(i));
+    if (window) {
+        total_unread -= win_unread(window);
+        _wins_unindex(window);
+    }
+    if (window && window == (ProfWin*)xmlconsole) {
+        xmlconsole = NULL;
+        jabber_tap_remove(sv_ev_xmpp_stanza);
+    }
+    g_hash_table_remove(windows, GINT_TO_POINTER(i));
+    status_bar_inactive(i);
+}
+
 void
 wins_close_by_num(int i)
 {
@@ -310,9 +304,165 @@ wins_close_by_num(int i)
             win_update_virtual(window);
         }
 
-        g_hash_table_remove(windows, GINT_TO_POINTER(i));
-        status_bar_inactive(i);
+        _wins_remove(i);
+    }
+}
+
+// closes many windows with the console drawn once at the end, when the
+// current window was one of them
+void
+wins_close_nums(GList *nums)
+{
+    gboolean closed_current = FALSE;
+    GList *curr = nums;
+    while (curr) {
+        int i = GPOINTER_TO_INT(curr->data);
+        if (i != 1) {
+            if (i == current) {
+                current = 1;
+                closed_current = TRUE;
+            }
+            _wins_remove(i);
+        }
+        curr = g_list_next(curr);
+    }
+
+    if (closed_current) {
+        win_update_virtual(wins_get_current());
+    }
+}
+
+static gint
+_cmp_viewed(gconstpointer a, gconstpointer b)
+{
+    const ProfWin *first = a;
+    const ProfWin *second = b;
+    if (first->layout->viewed < second->layout->viewed) {
+        return -1;
+    } else if (first->layout->viewed > second->layout->viewed) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+// over the scrollback limit, the oldest messages go from the least recently
+// viewed windows first, the current window last, and every window keeps its
+// last few messages, chat and room history can be fetched again from the
+// archive by paging up
+void
+wins_trim_scrollback(void)
+{
+    gint limit = prefs_get_scrollback_limit();
+    if (limit <= 0) {
+        return;
+    }
+
+    size_t limit_bytes = (size_t)limit * 1024 * 1024;
+    if (buffer_total_bytes() <= limit_bytes) {
+        return;
+    }
+
+    ProfWin *current_window = wins_get_current();
+    GList *ordered = NULL;
+    GList *values = g_hash_table_get_values(windows);
+    GList *curr = values;
+    while (curr) {
+        if (curr->data != current_window) {
+            ordered = g_list_insert_sorted(ordered, curr->data, _cmp_viewed);
+        }
+        curr = g_list_next(curr);
+    }
+    g_list_free(values);
+    ordered = g_list_append(ordered, current_window);
+
+    curr = ordered;
+    while (curr && buffer_total_bytes() > limit_bytes) {
+        ProfWin *window = curr->data;
+        curr = g_list_next(curr);
+
+        size_t over = buffer_total_bytes() - limit_bytes;
+        if (buffer_evict_oldest(window->layout->buffer, over, SCROLLBACK_KEEP) == 0) {
+            continue;
+        }
+
+        if (window->type == WIN_CHAT) {
+            mam_forget(((ProfChatWin*)window)->barejid);
+        } else if (window->type == WIN_MUC) {
+            mam_forget(((ProfMucWin*)window)->roomjid);
+        }
+
+        win_mark_stale(window);
+        if (window == current_window) {
+            win_resize_if_stale(window);
+        }
+    }
+    g_list_free(ordered);
+}
+
+// windows not viewed for the hibernate time give up their pads and entry
+// layouts, messages still arrive while asleep and are laid out on waking
+void
+wins_hibernate_idle(void)
+{
+    gint minutes = prefs_get_wins_hibernate();
+    if (minutes <= 0) {
+        return;
+    }
+
+    gint64 cutoff = g_get_monotonic_time() - (gint64)minutes * 60 * G_USEC_PER_SEC;
+    ProfWin *current_window = wins_get_current();
+    GList *values = g_hash_table_get_values(windows);
+    GList *curr = values;
+    while (curr) {
+        ProfWin *window = curr->data;
+        if (window != current_window && window->type != WIN_CONSOLE && window->layout->viewed < cutoff) {
+            win_hibernate(window);
+        }
+        curr = g_list_next(curr);
+    }
+    g_list_free(values);
+}
+
+// each window's rate of lines is of the minute before the last call
+void
+wins_usage_sample(void)
+{
+    GList *values = g_hash_table_get_values(windows);
+    GList *curr = values;
+    while (curr) {
+        win_usage_sample(curr->data);
+        curr = g_list_next(curr);
+    }
+    g_list_free(values);
+}
+
+// the current chat is being viewed, so its latest message is displayed,
+// messages arriving in between share one marker
+void
+wins_send_markers(void)
+{
+    ProfWin *current = wins_get_current();
+    if (current && current->type == WIN_CHAT) {
+        chatwin_send_marker((ProfChatWin*)current);
+    }
+}
+
+// rooms with the digest policy summarise what arrived since the last digest
+void
+wins_room_digest(void)
+{
+    GList *keys = g_hash_table_get_keys(windows);
+    keys = g_list_sort(keys, cmp_win_num);
+    GList *curr = keys;
+    while (curr) {
+        ProfWin *window = g_hash_table_lookup(windows, curr->data);
+        if (window->type == WIN_MUC) {
+            mucwin_digest((ProfMucWin*)window);
+        }
+        curr = g_list_next(curr);
     }
+    g_list_free(keys);
 }
 
 gboolean
@@ -334,7 +484,9 @@ wins_new_xmlconsole(void)
     int result = get_next_available_win_num(keys);
     g_list_free(keys);
     ProfWin *newwin = win_create_xmlconsole();
-    g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_insert(windows, result, newwin);
+    xmlconsole = (ProfXMLWin*)newwin;
+    jabber_tap_add(sv_ev_xmpp_stanza);
     return newwin;
 }
 
@@ -345,7 +497,23 @@ wins_new_chat(const char *const barejid)
     int result = get_next_available_win_num(keys);
     g_list_free(keys);
     ProfWin *newwin = win_create_chat(barejid);
-    g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_insert(windows, result, newwin);
+    _wins_index(newwin);
+    return newwin;
+}
+
+// a chat window put back from a snapshot, at its old number unless that is
+// taken by now
+ProfWin*
+wins_restore_chat(const char *const barejid, int num)
+{
+    if (num < 0 || num == 1 || num == 10 || g_hash_table_contains(windows, GINT_TO_POINTER(num))) {
+        return wins_new_chat(barejid);
+    }
+
+    ProfWin *newwin = win_create_chat(barejid);
+    _wins_insert(windows, num, newwin);
+    _wins_index(newwin);
     return newwin;
 }
 
@@ -356,7 +524,8 @@ wins_new_muc(const char *const roomjid)
     int result = get_next_available_win_num(keys);
     g_list_free(keys);
     ProfWin *newwin = win_create_muc(roomjid);
-    g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_insert(windows, result, newwin);
+    _wins_index(newwin);
     return newwin;
 }
 
@@ -367,7 +536,8 @@ wins_new_muc_config(const char *const roomjid, DataForm *form)
     int result = get_next_available_win_num(keys);
     g_list_free(keys);
     ProfWin *newwin = win_create_muc_config(roomjid, form);
-    g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_insert(windows, result, newwin);
+    _wins_index(newwin);
     return newwin;
 }
 
@@ -378,39 +548,58 @@ wins_new_private(const char *const fulljid)
     int result = get_next_available_win_num(keys);
     g_list_free(keys);
     ProfWin *newwin = win_create_private(fulljid);
-    g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_insert(windows, result, newwin);
+    _wins_index(newwin);
     return newwin;
 }
 
+// count a message arriving in a window that is not being viewed
+void
+wins_add_unread(ProfWin *window)
+{
+    if (window->type == WIN_CHAT) {
+        ProfChatWin *chatwin = (ProfChatWin*) window;
+        assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+        chatwin->unread++;
+    } else if (window->type == WIN_MUC) {
+        ProfMucWin *mucwin = (ProfMucWin*) window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        mucwin->unread++;
+    } else if (window->type == WIN_PRIVATE) {
+        ProfPrivateWin *privatewin = (ProfPrivateWin*) window;
+        privatewin->unread++;
+    } else {
+        return;
+    }
+
+    total_unread++;
+}
+
 int
 wins_get_total_unread(void)
 {
-    int result = 0;
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
-
-    while (curr) {
-        ProfWin *window = curr->data;
-        result += win_unread(window);
-        curr = g_list_next(curr);
-    }
-    g_list_free(values);
-    return result;
+    return total_unread;
 }
 
 void
 wins_resize_all(void)
 {
+    ProfWin *current_win = wins_get_current();
+
+    // only the current window is visible, others are redrawn when focused
     GList *values = g_hash_table_get_values(windows);
     GList *curr = values;
     while (curr) {
         ProfWin *window = curr->data;
-        win_resize(window);
+        if (window == current_win) {
+            win_resize(window);
+        } else {
+            win_mark_stale(window);
+        }
         curr = g_list_next(curr);
     }
     g_list_free(values);
 
-    ProfWin *current_win = wins_get_current();
     win_update_virtual(current_win);
 }
 
@@ -435,62 +624,45 @@ wins_show_subwin(ProfWin *window)
 ProfXMLWin*
 wins_get_xmlconsole(void)
 {
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
-
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (window->type == WIN_XML) {
-            ProfXMLWin *xmlwin = (ProfXMLWin*)window;
-            assert(xmlwin->memcheck == PROFXMLWIN_MEMCHECK);
-            g_list_free(values);
-            return xmlwin;
-        }
-        curr = g_list_next(curr);
-    }
-
-    g_list_free(values);
-    return NULL;
+    return xmlconsole;
 }
 
 GSList*
 wins_get_chat_recipients(void)
 {
     GSList *result = NULL;
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
+    GHashTableIter iter;
+    gpointer barejid;
+    g_hash_table_iter_init(&iter, chat_wins);
+    while (g_hash_table_iter_next(&iter, &barejid, NULL)) {
+        result = g_slist_prepend(result, barejid);
+    }
 
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (window->type == WIN_CHAT) {
-            ProfChatWin *chatwin = (ProfChatWin*)window;
-            result = g_slist_append(result, chatwin->barejid);
+    return result;
+}
+
+static void
+_wins_add_read(GHashTable *index, GSList **result)
+{
+    GHashTableIter iter;
+    gpointer window;
+    g_hash_table_iter_init(&iter, index);
+    while (g_hash_table_iter_next(&iter, NULL, &window)) {
+        if (win_unread(window) == 0) {
+            *result = g_slist_prepend(*result, window);
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-    return result;
 }
 
+// chat and private windows without unread messages, rooms and the console
+// are never pruned
 GSList*
 wins_get_prune_wins(void)
 {
     GSList *result = NULL;
-    GList *values = g_hash_table_get_values(windows);
-    GList *curr = values;
+    _wins_add_read(chat_wins, &result);
+    _wins_add_read(private_wins, &result);
 
-    while (curr) {
-        ProfWin *window = curr->data;
-        if (win_unread(window) == 0 &&
-                window->type != WIN_MUC &&
-                window->type != WIN_MUC_CONFIG &&
-                window->type != WIN_XML &&
-                window->type != WIN_CONSOLE) {
-            result = g_slist_append(result, window);
-        }
-        curr = g_list_next(curr);
-    }
-    g_list_free(values);
     return result;
 }
 
@@ -527,7 +699,7 @@ wins_swap(int source_win, int target_win)
         // target window empty
         if (!target) {
             g_hash_table_steal(windows, GINT_TO_POINTER(source_win));
-            g_hash_table_insert(windows, GINT_TO_POINTER(target_win), source);
+            _wins_insert(windows, target_win, source);
             status_bar_inactive(source_win);
             if (win_unread(source) > 0) {
                 status_bar_new(target_win);
@@ -544,8 +716,8 @@ wins_swap(int source_win, int target_win)
         } else {
             g_hash_table_steal(windows, GINT_TO_POINTER(source_win));
             g_hash_table_steal(windows, GINT_TO_POINTER(target_win));
-            g_hash_table_insert(windows, GINT_TO_POINTER(source_win), target);
-            g_hash_table_insert(windows, GINT_TO_POINTER(target_win), source);
+            _wins_insert(windows, source_win, target);
+            _wins_insert(windows, target_win, source);
             if (win_unread(source) > 0) {
                 status_bar_new(target_win);
             } else {
@@ -596,14 +768,14 @@ wins_tidy(void)
         while (curr) {
             ProfWin *window = g_hash_table_lookup(windows, curr->data);
             if (num == 10) {
-                g_hash_table_insert(new_windows, GINT_TO_POINTER(0), window);
+                _wins_insert(new_windows, 0, window);
                 if (win_unread(window) > 0) {
                     status_bar_new(0);
                 } else {
                     status_bar_active(0);
                 }
             } else {
-                g_hash_table_insert(new_windows, GINT_TO_POINTER(num), window);
+                _wins_insert(new_windows, num, window);
                 if (win_unread(window) > 0) {
                     status_bar_new(num);
                 } else {
@@ -626,6 +798,8 @@ wins_tidy(void)
     }
 }
 
+// lines owned by the windows, valid until the next call or until a window
+// is closed, only lines for windows that have changed are built again
 GSList*
 wins_create_summary(void)
 {
@@ -637,111 +811,192 @@ wins_create_summary(void)
 
     while (curr) {
         ProfWin *window = g_hash_table_lookup(windows, curr->data);
-        int ui_index = GPOINTER_TO_INT(curr->data);
-
-        GString *chat_string;
-        GString *priv_string;
-        GString *muc_string;
-        GString *muc_config_string;
-        GString *xml_string;
-
-        switch (window->type)
-        {
-            case WIN_CONSOLE:
-                result = g_slist_append(result, strdup("1: Console"));
-                break;
-            case WIN_CHAT:
-                chat_string = g_string_new("");
-
-                ProfChatWin *chatwin = (ProfChatWin*)window;
-                PContact contact = roster_get_contact(chatwin->barejid);
-                if (contact == NULL) {
-                    g_string_printf(chat_string, "%d: Chat %s", ui_index, chatwin->barejid);
-                } else {
-                    const char *display_name = p_contact_name_or_jid(contact);
-                    g_string_printf(chat_string, "%d: Chat %s", ui_index, display_name);
-                    GString *chat_presence = g_string_new("");
-                    g_string_printf(chat_presence, " - %s", p_contact_presence(contact));
-                    g_string_append(chat_string, chat_presence->str);
-                    g_string_free(chat_presence, TRUE);
-                }
-
-                if (chatwin->unread > 0) {
-                    GString *chat_unread = g_string_new("");
-                    g_string_printf(chat_unread, ", %d unread", chatwin->unread);
-                    g_string_append(chat_string, chat_unread->str);
-                    g_string_free(chat_unread, TRUE);
-                }
-
-                result = g_slist_append(result, strdup(chat_string->str));
-                g_string_free(chat_string, TRUE);
-
-                break;
+        result = g_slist_prepend(result, (gpointer)_wins_summary(window));
+        curr = g_list_next(curr);
+    }
 
-            case WIN_PRIVATE:
-                priv_string = g_string_new("");
-                ProfPrivateWin *privatewin = (ProfPrivateWin*)window;
-                g_string_printf(priv_string, "%d: Private %s", ui_index, privatewin->fulljid);
+    g_list_free(keys);
+    return g_slist_reverse(result);
+}
 
-                if (privatewin->unread > 0) {
-                    GString *priv_unread = g_string_new("");
-                    g_string_printf(priv_unread, ", %d unread", privatewin->unread);
-                    g_string_append(priv_string, priv_unread->str);
-                    g_string_free(priv_unread, TRUE);
-                }
+// one line for each window of what it costs, owned by the caller
+GSList*
+wins_create_stats(void)
+{
+    GSList *result = NULL;
 
-                result = g_slist_append(result, strdup(priv_string->str));
-                g_string_free(priv_string, TRUE);
+    GList *keys = g_hash_table_get_keys(windows);
+    keys = g_list_sort(keys, cmp_win_num);
+    GList *curr = keys;
 
-                break;
+    while (curr) {
+        ProfWin *window = g_hash_table_lookup(windows, curr->data);
+        ProfWinUsage usage;
+        win_usage(window, &usage);
+
+        const char *name = NULL;
+        const char *logged = NULL;
+        switch (window->type) {
+        case WIN_CONSOLE:
+            name = "Console";
+            break;
+        case WIN_CHAT:
+            name = logged = ((ProfChatWin*)window)->barejid;
+            break;
+        case WIN_MUC:
+            name = logged = ((ProfMucWin*)window)->roomjid;
+            break;
+        case WIN_MUC_CONFIG:
+            name = ((ProfMucConfWin*)window)->roomjid;
+            break;
+        case WIN_PRIVATE:
+            name = ((ProfPrivateWin*)window)->fulljid;
+            break;
+        case WIN_XML:
+            name = "XML console";
+            break;
+        }
+        guint64 written = logged ? chat_log_written(logged) : 0;
 
-            case WIN_MUC:
-                muc_string = g_string_new("");
-                ProfMucWin *mucwin = (ProfMucWin*)window;
-                g_string_printf(muc_string, "%d: Room %s", ui_index, mucwin->roomjid);
+        result = g_slist_prepend(result, g_strdup_printf("%2d %8d %7zuK %7zuK %8u %7.1fs %7" G_GUINT64_FORMAT "K  %s",
+            window->num, usage.entries, usage.buffer_bytes / 1024, usage.pad_bytes / 1024, usage.per_minute,
+            (double)usage.render_us / G_USEC_PER_SEC, written / 1024, name));
+        curr = g_list_next(curr);
+    }
 
-                if (mucwin->unread > 0) {
-                    GString *muc_unread = g_string_new("");
-                    g_string_printf(muc_unread, ", %d unread", mucwin->unread);
-                    g_string_append(muc_string, muc_unread->str);
-                    g_string_free(muc_unread, TRUE);
-                }
+    g_list_free(keys);
+    return g_slist_reverse(result);
+}
 
-                result = g_slist_append(result, strdup(muc_string->str));
-                g_string_free(muc_string, TRUE);
+void
+wins_destroy(void)
+{
+    if (xmlconsole) {
+        xmlconsole = NULL;
+        jabber_tap_remove(sv_ev_xmpp_stanza);
+    }
+    g_hash_table_destroy(chat_wins);
+    g_hash_table_destroy(muc_wins);
+    g_hash_table_destroy(muc_conf_wins);
+    g_hash_table_destroy(private_wins);
+    g_hash_table_destroy(windows);
+}
 
-                break;
+// the window keeps its own number so finding it is not a search of the table
+static void
+_wins_insert(GHashTable *table, int num, ProfWin *window)
+{
+    window->num = num;
+    g_hash_table_insert(table, GINT_TO_POINTER(num), window);
+}
+
+static GHashTable*
+_wins_index_for(ProfWin *window, const char **jid)
+{
+    switch (window->type) {
+    case WIN_CHAT:
+        *jid = ((ProfChatWin*)window)->barejid;
+        return chat_wins;
+    case WIN_MUC:
+        *jid = ((ProfMucWin*)window)->roomjid;
+        return muc_wins;
+    case WIN_MUC_CONFIG:
+        *jid = ((ProfMucConfWin*)window)->roomjid;
+        return muc_conf_wins;
+    case WIN_PRIVATE:
+        *jid = ((ProfPrivateWin*)window)->fulljid;
+        return private_wins;
+    default:
+        *jid = NULL;
+        return NULL;
+    }
+}
 
-            case WIN_MUC_CONFIG:
-                muc_config_string = g_string_new("");
-                char *title = win_get_title(window);
-                g_string_printf(muc_config_string, "%d: %s", ui_index, title);
-                result = g_slist_append(result, strdup(muc_config_string->str));
-                g_string_free(muc_config_string, TRUE);
-                free(title);
+static void
+_wins_index(ProfWin *window)
+{
+    const char *jid = NULL;
+    GHashTable *index = _wins_index_for(window, &jid);
+    if (index && jid) {
+        g_hash_table_replace(index, (gpointer)jid, window);
+    }
+}
 
-                break;
+static void
+_wins_unindex(ProfWin *window)
+{
+    const char *jid = NULL;
+    GHashTable *index = _wins_index_for(window, &jid);
+    if (index && jid && g_hash_table_lookup(index, jid) == window) {
+        g_hash_table_remove(index, jid);
+    }
+}
 
-            case WIN_XML:
-                xml_string = g_string_new("");
-                g_string_printf(xml_string, "%d: XML console", ui_index);
-                result = g_slist_append(result, strdup(xml_string->str));
-                g_string_free(xml_string, TRUE);
+static const char*
+_wins_summary(ProfWin *window)
+{
+    int unread = win_unread(window);
+    PContact contact = NULL;
+    int version = 0;
+    if (window->type == WIN_CHAT) {
+        contact = roster_get_contact(((ProfChatWin*)window)->barejid);
+        version = contact ? p_contact_version(contact) : 0;
+    } else if (window->type == WIN_MUC_CONFIG) {
+        version = ((ProfMucConfWin*)window)->form->modified;
+    }
 
-                break;
+    if (window->summary && window->summary_num == window->num && window->summary_unread == unread &&
+            window->summary_version == version) {
+        return window->summary;
+    }
 
-            default:
-                break;
+    GString *summary = g_string_sized_new(64);
+    switch (window->type)
+    {
+        case WIN_CONSOLE:
+            g_string_printf(summary, "%d: Console", window->num);
+            break;
+        case WIN_CHAT:
+        {
+            ProfChatWin *chatwin = (ProfChatWin*)window;
+            if (contact == NULL) {
+                g_string_printf(summary, "%d: Chat %s", window->num, chatwin->barejid);
+            } else {
+                g_string_printf(summary, "%d: Chat %s - %s", window->num, p_contact_name_or_jid(contact),
+                    p_contact_presence(contact));
+            }
+            break;
         }
-        curr = g_list_next(curr);
+        case WIN_PRIVATE:
+            g_string_printf(summary, "%d: Private %s", window->num, ((ProfPrivateWin*)window)->fulljid);
+            break;
+        case WIN_MUC:
+            g_string_printf(summary, "%d: Room %s", window->num, ((ProfMucWin*)window)->roomjid);
+            break;
+        case WIN_MUC_CONFIG:
+        {
+            char *title = win_get_title(window);
+            g_string_printf(summary, "%d: %s", window->num, title);
+            free(title);
+            break;
+        }
+        case WIN_XML:
+            g_string_printf(summary, "%d: XML console", window->num);
+            break;
+        default:
+            break;
     }
 
-    g_list_free(keys);
-    return result;
-}
+    if (unread > 0) {
+        g_string_append_printf(summary, ", %d unread", unread);
+    }
 
-void
-wins_destroy(void)
-{
-    g_hash_table_destroy(windows);
+    free(window->summary);
+    window->summary = strdup(summary->str);
+    window->summary_num = window->num;
+    window->summary_unread = unread;
+    window->summary_version = version;
+    g_string_free(summary, TRUE);
+
+    return window->summary;
 }
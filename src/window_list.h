@@ -41,6 +41,7 @@ void wins_init(void);
 
 ProfWin* wins_new_xmlconsole(void);
 ProfWin* wins_new_chat(const char *const barejid);
+ProfWin* wins_restore_chat(const char *const barejid, int num);
 ProfWin* wins_new_muc(const char *const roomjid);
 ProfWin* wins_new_muc_config(const char *const roomjid, DataForm *form);
 ProfWin* wins_new_private(const char *const fulljid);
@@ -66,14 +67,22 @@ int wins_get_num(ProfWin *window);
 int wins_get_current_num(void);
 void wins_close_current(void);
 void wins_close_by_num(int i);
+void wins_close_nums(GList *nums);
 gboolean wins_is_current(ProfWin *window);
+void wins_add_unread(ProfWin *window);
 int wins_get_total_unread(void);
 void wins_resize_all(void);
+void wins_trim_scrollback(void);
+void wins_hibernate_idle(void);
+void wins_room_digest(void);
+void wins_usage_sample(void);
+void wins_send_markers(void);
 GSList* wins_get_chat_recipients(void);
 GSList* wins_get_prune_wins(void);
 void wins_lost_connection(void);
 gboolean wins_tidy(void);
 GSList* wins_create_summary(void);
+GSList* wins_create_stats(void);
 void wins_destroy(void);
 GList* wins_get_nums(void);
 gboolean wins_swap(int source_win, int target_win);
@@ -55,6 +55,8 @@
 #include "xmpp/stanza.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/bookmark.h"
+#include "config/preferences.h"
+#include "config/bookmarkcache.h"
 #include "ui/ui.h"
 
 #define BOOKMARK_TIMEOUT 5000
@@ -62,6 +64,10 @@
 static Autocomplete bookmark_ac;
 static GList *bookmark_list;
 
+// rooms joined from the cache, left again when the server no longer has
+// them bookmarked for autojoin
+static GList *cache_joined;
+
 static int _bookmark_handle_result(xmpp_conn_t *const conn,
     xmpp_stanza_t *const stanza, void *const userdata);
 static int _bookmark_handle_delete(xmpp_conn_t *const conn,
@@ -69,6 +75,9 @@ static int _bookmark_handle_delete(xmpp_conn_t *const conn,
 static void _bookmark_item_destroy(gpointer item);
 static int _match_bookmark_by_jid(gconstpointer a, gconstpointer b);
 static void _send_bookmarks(void);
+static gboolean _bookmark_autojoin(Bookmark *item);
+static void _bookmark_leave_dropped(void);
+static void _bookmarks_clear(void);
 
 void
 bookmark_request(void)
@@ -80,11 +89,23 @@ bookmark_request(void)
 
     id = strdup("bookmark_init_request");
 
-    autocomplete_free(bookmark_ac);
-    bookmark_ac = autocomplete_new();
-    if (bookmark_list) {
-        g_list_free_full(bookmark_list, _bookmark_item_destroy);
-        bookmark_list = NULL;
+    // join from the bookmarks cached last session without waiting for the
+    // server, its result then replaces them
+    _bookmarks_clear();
+    Jid *my_jid = jid_create(jabber_get_fulljid());
+    bookmarkcache_on_connect(my_jid->barejid);
+    jid_destroy(my_jid);
+    bookmark_list = bookmarkcache_load();
+    g_list_free_full(cache_joined, free);
+    cache_joined = NULL;
+    GList *curr = bookmark_list;
+    while (curr) {
+        Bookmark *item = curr->data;
+        autocomplete_add(bookmark_ac, item->jid);
+        if (item->autojoin && _bookmark_autojoin(item)) {
+            cache_joined = g_list_append(cache_joined, strdup(item->jid));
+        }
+        curr = g_list_next(curr);
     }
 
     xmpp_timed_handler_add(conn, _bookmark_handle_delete, BOOKMARK_TIMEOUT, id);
@@ -92,7 +113,7 @@ bookmark_request(void)
 
     iq = stanza_create_bookmarks_storage_request(ctx);
     xmpp_stanza_set_id(iq, id);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
@@ -230,9 +251,21 @@ bookmark_get_list(void)
 char*
 bookmark_find(const char *const search_str)
 {
+    if (prefs_get_boolean(PREF_COMPLETE_FUZZY)) {
+        return autocomplete_complete_fuzzy(bookmark_ac, search_str, TRUE);
+    }
+
     return autocomplete_complete(bookmark_ac, search_str, TRUE);
 }
 
+void
+bookmark_touch(const char *const jid)
+{
+    if (bookmark_ac) {
+        autocomplete_touch(bookmark_ac, jid);
+    }
+}
+
 void
 bookmark_autocomplete_reset(void)
 {
@@ -255,7 +288,6 @@ _bookmark_handle_result(xmpp_conn_t *const conn,
     char *autojoin;
     char *password;
     gboolean autojoin_val;
-    Jid *my_jid;
     Bookmark *item;
 
     xmpp_timed_handler_delete(conn, _bookmark_handle_delete);
@@ -275,10 +307,7 @@ _bookmark_handle_result(xmpp_conn_t *const conn,
         return 0;
     }
 
-    if (bookmark_ac == NULL) {
-        bookmark_ac = autocomplete_new();
-    }
-    my_jid = jid_create(jabber_get_fulljid());
+    _bookmarks_clear();
 
     ptr = xmpp_stanza_get_children(ptr);
     while (ptr) {
@@ -332,33 +361,77 @@ _bookmark_handle_result(xmpp_conn_t *const conn,
         item->autojoin = autojoin_val;
         bookmark_list = g_list_append(bookmark_list, item);
 
+        // rooms already joined from the cache are left as they are
         if (autojoin_val) {
-            Jid *room_jid;
-
-            char *account_name = jabber_get_account_name();
-            ProfAccount *account = accounts_get_account(account_name);
-            if (name == NULL) {
-                name = account->muc_nick;
-            }
-
-            log_debug("Autojoin %s with nick=%s", jid, name);
-            room_jid = jid_create_from_bare_and_resource(jid, name);
-            if (!muc_active(room_jid->barejid)) {
-                presence_join_room(jid, name, password);
-                muc_join(jid, name, password, TRUE);
-            }
-            jid_destroy(room_jid);
-            account_free(account);
+            _bookmark_autojoin(item);
         }
 
         ptr = xmpp_stanza_get_next(ptr);
     }
 
-    jid_destroy(my_jid);
+    _bookmark_leave_dropped();
+    bookmarkcache_save(bookmark_list);
 
     return 0;
 }
 
+// leave the rooms joined from a stale cache that the server's bookmarks
+// removed or stopped autojoining
+static void
+_bookmark_leave_dropped(void)
+{
+    GList *dropped = bookmarkcache_autojoin_dropped(cache_joined, bookmark_list);
+    GList *curr = dropped;
+    while (curr) {
+        char *jid = curr->data;
+        if (muc_active(jid)) {
+            log_info("Leaving %s, no longer bookmarked for autojoin", jid);
+            presence_leave_chat_room(jid);
+            muc_leave(jid);
+            ui_leave_room(jid);
+        }
+        curr = g_list_next(curr);
+    }
+    g_list_free(dropped);
+
+    g_list_free_full(cache_joined, free);
+    cache_joined = NULL;
+}
+
+// returns TRUE when the room was joined now
+static gboolean
+_bookmark_autojoin(Bookmark *item)
+{
+    gboolean joined = FALSE;
+    char *account_name = jabber_get_account_name();
+    ProfAccount *account = accounts_get_account(account_name);
+    char *nick = item->nick;
+    if (nick == NULL) {
+        nick = account->muc_nick;
+    }
+
+    log_debug("Autojoin %s with nick=%s", item->jid, nick);
+    if (!muc_active(item->jid)) {
+        presence_join_room(item->jid, nick, item->password);
+        muc_join(item->jid, nick, item->password, TRUE);
+        joined = TRUE;
+    }
+    account_free(account);
+
+    return joined;
+}
+
+static void
+_bookmarks_clear(void)
+{
+    autocomplete_free(bookmark_ac);
+    bookmark_ac = autocomplete_new();
+    if (bookmark_list) {
+        g_list_free_full(bookmark_list, _bookmark_item_destroy);
+        bookmark_list = NULL;
+    }
+}
+
 static int
 _bookmark_handle_delete(xmpp_conn_t *const conn,
     void *const userdata)
@@ -369,6 +442,10 @@ _bookmark_handle_delete(xmpp_conn_t *const conn,
 
     log_debug("Timeout for handler with id=%s", id);
 
+    // without an answer the cached rooms are kept
+    g_list_free_full(cache_joined, free);
+    cache_joined = NULL;
+
     xmpp_id_handler_delete(conn, _bookmark_handle_result, id);
     g_free(id);
 
@@ -402,7 +479,6 @@ _match_bookmark_by_jid(gconstpointer a, gconstpointer b)
 static void
 _send_bookmarks(void)
 {
-    xmpp_conn_t *conn = connection_get_conn();
     xmpp_ctx_t *ctx = connection_get_ctx();
 
     xmpp_stanza_t *iq = xmpp_stanza_new(ctx);
@@ -474,6 +550,8 @@ _send_bookmarks(void)
     xmpp_stanza_release(storage);
     xmpp_stanza_release(query);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
+
+    bookmarkcache_save(bookmark_list);
 }
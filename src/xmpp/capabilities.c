@@ -54,40 +54,105 @@
 #include "common.h"
 #include "log.h"
 #include "xmpp/xmpp.h"
+#include "xmpp/connection.h"
 #include "xmpp/stanza.h"
 #include "xmpp/form.h"
 #include "xmpp/capabilities.h"
+#include "tools/p_sha1.h"
+#include "tools/stats.h"
+#include "tools/watchdog.h"
+
+// Capabilities by verification string. The cache is saved in a compact
+// binary form at most every CAPS_SAVE_INTERVAL_MS while new entries are
+// seen, and when closed. The key file written by earlier versions is
+// only read when there is no binary cache yet.
+#define CAPS_CACHE_MAGIC "PRFCAPS1"
+#define CAPS_CACHE_MAGIC_LEN 8
+#define CAPS_CACHE_NULL G_MAXUINT32
 
 static gchar *cache_loc;
-static GKeyFile *cache;
+static gchar *bin_cache_loc;
+static gboolean cache_dirty;
+
+// the binary cache as last read or written, it is shared by every running
+// instance so entries another one wrote are merged in before saving
+static FileStamp cache_stamp;
+static GHashTable *ver_to_caps;
 
 static GHashTable *jid_to_ver;
 static GHashTable *jid_to_caps;
 
+// disco#info requests in flight, keyed by ver, or node#ver for legacy caps.
+// Contacts seen with the same key while waiting are added to the request
+// and all get the capabilities when one response arrives. A request that
+// times out is sent again to the next waiting contact.
+#define CAPS_REQUEST_TIMEOUT_SEC 30
+#define CAPS_REQUEST_MAX_ATTEMPTS 3
+
+// at most this many requests are sent at once, the rest wait their turn
+// so a busy room does not flood the service with queries
+#define CAPS_REQUESTS_MAX_SENT 8
+
+typedef struct caps_request_t {
+    char *node;
+    char *ver;
+    gboolean legacy;
+    GSList *jids;
+    int attempts;
+    GTimer *timer;
+} CapsRequest;
+
+static GHashTable *caps_requests;
+
+// what to ask for keys mapped with caps_defer, only requested once a jid
+// advertising them is looked up
+typedef struct caps_deferred_t {
+    char *node;
+    char *ver;
+    gboolean legacy;
+} CapsDeferred;
+
+static GHashTable *caps_deferred;
+
 static char *my_sha1;
 
 static gchar* _get_cache_file(void);
 static void _save_cache(void);
+static gboolean _load_cache(void);
+static void _load_legacy_cache(void);
+static void _cache_put_str(GString *out, const char *const str);
+static gboolean _cache_get_u32(const char *const data, gsize len, gsize *pos, guint32 *value);
+static gboolean _cache_get_str(const char *const data, gsize len, gsize *pos, char **str);
 static Capabilities* _caps_by_ver(const char *const ver);
 static Capabilities* _caps_by_jid(const char *const jid);
-Capabilities* _caps_copy(Capabilities *caps);
+static Capabilities* _caps_ref(Capabilities *caps);
+static GHashTable* _caps_feature_set(GSList *features);
+static Capabilities* _caps_load(GKeyFile *cache, const char *const ver);
+static size_t _caps_size(Capabilities *caps);
+static void _caps_request_send(CapsRequest *request);
+static void _caps_request_free(CapsRequest *request);
+static guint _caps_requests_sent(void);
+static void _caps_requests_send_waiting(void);
+static void _caps_resolve(const char *const jid, const char *const ver);
+static void _caps_deferred_free(CapsDeferred *deferred);
 
 void
 caps_init(void)
 {
     log_info("Loading capabilities cache");
     cache_loc = _get_cache_file();
+    bin_cache_loc = g_strdup_printf("%s.bin", cache_loc);
+    cache_dirty = FALSE;
 
-    if (g_file_test(cache_loc, G_FILE_TEST_EXISTS)) {
-        g_chmod(cache_loc, S_IRUSR | S_IWUSR);
+    ver_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)caps_destroy);
+    if (!_load_cache()) {
+        _load_legacy_cache();
     }
 
-    cache = g_key_file_new();
-    g_key_file_load_from_file(cache, cache_loc, G_KEY_FILE_KEEP_COMMENTS,
-        NULL);
-
     jid_to_ver = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     jid_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)caps_destroy);
+    caps_requests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_caps_request_free);
+    caps_deferred = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_caps_deferred_free);
 
     my_sha1 = NULL;
 }
@@ -95,42 +160,11 @@ caps_init(void)
 void
 caps_add_by_ver(const char *const ver, Capabilities *caps)
 {
-    gboolean cached = g_key_file_has_group(cache, ver);
+    gboolean cached = g_hash_table_contains(ver_to_caps, ver);
     if (!cached) {
-        if (caps->name) {
-            g_key_file_set_string(cache, ver, "name", caps->name);
-        }
-        if (caps->category) {
-            g_key_file_set_string(cache, ver, "category", caps->category);
-        }
-        if (caps->type) {
-            g_key_file_set_string(cache, ver, "type", caps->type);
-        }
-        if (caps->software) {
-            g_key_file_set_string(cache, ver, "software", caps->software);
-        }
-        if (caps->software_version) {
-            g_key_file_set_string(cache, ver, "software_version", caps->software_version);
-        }
-        if (caps->os) {
-            g_key_file_set_string(cache, ver, "os", caps->os);
-        }
-        if (caps->os_version) {
-            g_key_file_set_string(cache, ver, "os_version", caps->os_version);
-        }
-        if (caps->features) {
-            GSList *curr_feature = caps->features;
-            int num = g_slist_length(caps->features);
-            const gchar* features_list[num];
-            int curr = 0;
-            while (curr_feature) {
-                features_list[curr++] = curr_feature->data;
-                curr_feature = g_slist_next(curr_feature);
-            }
-            g_key_file_set_string_list(cache, ver, "features", features_list, num);
-        }
-
-        _save_cache();
+        g_hash_table_insert(ver_to_caps, g_strdup(ver), _caps_ref(caps));
+        g_hash_table_remove(caps_deferred, ver);
+        cache_dirty = TRUE;
     }
 }
 
@@ -146,17 +180,207 @@ caps_map_jid_to_ver(const char *const jid, const char *const ver)
     g_hash_table_insert(jid_to_ver, strdup(jid), strdup(ver));
 }
 
+// the verification string last advertised by jid, NULL if none is known
+const char*
+caps_get_ver(const char *const jid)
+{
+    return g_hash_table_lookup(jid_to_ver, jid);
+}
+
+// add jid to the request for key, sending one if none is in flight
+void
+caps_request(const char *const key, const char *const jid, const char *const node, const char *const ver,
+    gboolean legacy)
+{
+    CapsRequest *request = g_hash_table_lookup(caps_requests, key);
+    if (request) {
+        if (!g_slist_find_custom(request->jids, jid, (GCompareFunc)g_strcmp0)) {
+            log_debug("Capabilities request in flight for %s, adding %s", key, jid);
+            request->jids = g_slist_append(request->jids, strdup(jid));
+        }
+        return;
+    }
+
+    request = malloc(sizeof(CapsRequest));
+    request->node = strdup(node);
+    request->ver = strdup(ver);
+    request->legacy = legacy;
+    request->jids = g_slist_append(NULL, strdup(jid));
+    request->attempts = 0;
+    request->timer = g_timer_new();
+    g_hash_table_insert(caps_requests, strdup(key), request);
+
+    if (_caps_requests_sent() < CAPS_REQUESTS_MAX_SENT) {
+        _caps_request_send(request);
+    } else {
+        log_debug("Capabilities request for %s waiting, %d already sent", key, CAPS_REQUESTS_MAX_SENT);
+    }
+}
+
+// map jid to key as caps_request would, but only ask for the capabilities
+// once something looks them up, for room occupants who are mostly never
+// asked about
+void
+caps_defer(const char *const key, const char *const jid, const char *const node, const char *const ver,
+    gboolean legacy)
+{
+    caps_map_jid_to_ver(jid, key);
+    if (caps_contains(key) || g_hash_table_contains(caps_deferred, key)) {
+        return;
+    }
+
+    CapsDeferred *deferred = malloc(sizeof(CapsDeferred));
+    deferred->node = strdup(node);
+    deferred->ver = strdup(ver);
+    deferred->legacy = legacy;
+    g_hash_table_insert(caps_deferred, strdup(key), deferred);
+}
+
+// the capabilities for key have been cached, map every waiting jid to them
+void
+caps_request_resolved(const char *const key)
+{
+    CapsRequest *request = g_hash_table_lookup(caps_requests, key);
+    if (request == NULL) {
+        return;
+    }
+
+    GSList *curr = request->jids;
+    while (curr) {
+        caps_map_jid_to_ver(curr->data, key);
+        curr = g_slist_next(curr);
+    }
+    g_hash_table_remove(caps_requests, key);
+    _caps_requests_send_waiting();
+}
+
+// called periodically from the main loop, retries timed out requests
+void
+caps_check_requests(void)
+{
+    if (jabber_get_connection_status() != JABBER_CONNECTED) {
+        g_hash_table_remove_all(caps_requests);
+        g_hash_table_remove_all(caps_deferred);
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, caps_requests);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        CapsRequest *request = value;
+        if (request->attempts == 0 || g_timer_elapsed(request->timer, NULL) < CAPS_REQUEST_TIMEOUT_SEC) {
+            continue;
+        }
+
+        if (request->attempts >= CAPS_REQUEST_MAX_ATTEMPTS || request->attempts >= g_slist_length(request->jids)) {
+            log_info("Capabilities request for %s timed out, giving up", (char*)key);
+            g_hash_table_iter_remove(&iter);
+        } else {
+            log_info("Capabilities request for %s timed out, retrying", (char*)key);
+            _caps_request_send(request);
+        }
+    }
+
+    _caps_requests_send_waiting();
+}
+
+static guint
+_caps_requests_sent(void)
+{
+    guint sent = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, caps_requests);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (((CapsRequest*)value)->attempts > 0) {
+            sent++;
+        }
+    }
+
+    return sent;
+}
+
+static void
+_caps_requests_send_waiting(void)
+{
+    guint sent = _caps_requests_sent();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, caps_requests);
+    while (sent < CAPS_REQUESTS_MAX_SENT && g_hash_table_iter_next(&iter, NULL, &value)) {
+        CapsRequest *request = value;
+        if (request->attempts == 0) {
+            _caps_request_send(request);
+            sent++;
+        }
+    }
+}
+
+// ask for the capabilities of a deferred key, now that jid needs them
+static void
+_caps_resolve(const char *const jid, const char *const ver)
+{
+    CapsDeferred *deferred = g_hash_table_lookup(caps_deferred, ver);
+    if (deferred) {
+        log_debug("Capabilities for %s needed, requesting %s", jid, ver);
+        caps_request(ver, jid, deferred->node, deferred->ver, deferred->legacy);
+    }
+}
+
+static void
+_caps_deferred_free(CapsDeferred *deferred)
+{
+    free(deferred->node);
+    free(deferred->ver);
+    free(deferred);
+}
+
+static void
+_caps_request_send(CapsRequest *request)
+{
+    char *jid = g_slist_nth_data(request->jids, request->attempts);
+    char *id = create_unique_id("caps");
+    if (request->legacy) {
+        iq_send_caps_request_legacy(jid, id, request->node, request->ver);
+    } else {
+        iq_send_caps_request(jid, id, request->node, request->ver);
+    }
+    free(id);
+
+    request->attempts++;
+    g_timer_start(request->timer);
+}
+
+static void
+_caps_request_free(CapsRequest *request)
+{
+    free(request->node);
+    free(request->ver);
+    g_slist_free_full(request->jids, free);
+    g_timer_destroy(request->timer);
+    free(request);
+}
+
 gboolean
 caps_contains(const char *const ver)
 {
-    return (g_key_file_has_group(cache, ver));
+    return g_hash_table_contains(ver_to_caps, ver);
 }
 
 static Capabilities*
 _caps_by_ver(const char *const ver)
+{
+    return g_hash_table_lookup(ver_to_caps, ver);
+}
+
+// decode the capabilities of a verification string from the key file
+static Capabilities*
+_caps_load(GKeyFile *cache, const char *const ver)
 {
     if (g_key_file_has_group(cache, ver)) {
         Capabilities *new_caps = malloc(sizeof(struct capabilities_t));
+        new_caps->refs = 1;
 
         char *category = g_key_file_get_string(cache, ver, "category", NULL);
         if (category) {
@@ -213,13 +437,15 @@ _caps_by_ver(const char *const ver)
             GSList *features_list = NULL;
             int i;
             for (i = 0; i < features_len; i++) {
-                features_list = g_slist_append(features_list, strdup(features[i]));
+                features_list = g_slist_prepend(features_list, (gpointer)str_intern(features[i]));
             }
-            new_caps->features = features_list;
+            new_caps->features = g_slist_reverse(features_list);
             g_strfreev(features);
         } else {
             new_caps->features = NULL;
         }
+        new_caps->feature_set = _caps_feature_set(new_caps->features);
+        stats_alloc(STATS_MEM_CAPABILITIES, _caps_size(new_caps));
         return new_caps;
     } else {
         return NULL;
@@ -240,13 +466,14 @@ caps_lookup(const char *const jid)
         Capabilities *caps = _caps_by_ver(ver);
         if (caps) {
             log_debug("Capabilities lookup %s, found by verification string %s.", jid, ver);
-            return caps;
+            return _caps_ref(caps);
         }
+        _caps_resolve(jid, ver);
     } else {
         Capabilities *caps = _caps_by_jid(jid);
         if (caps) {
             log_debug("Capabilities lookup %s, found by JID.", jid);
-            return _caps_copy(caps);
+            return _caps_ref(caps);
         }
     }
 
@@ -254,138 +481,237 @@ caps_lookup(const char *const jid)
     return NULL;
 }
 
-Capabilities*
-_caps_copy(Capabilities *caps)
+// a hash lookup, cheap enough to be done for every message
+gboolean
+caps_jid_has_feature(const char *const jid, const char *const feature)
 {
-    if (!caps) {
-        return NULL;
+    Capabilities *caps = NULL;
+    char *ver = g_hash_table_lookup(jid_to_ver, jid);
+    if (ver) {
+        caps = _caps_by_ver(ver);
+        if (caps == NULL) {
+            _caps_resolve(jid, ver);
+        }
     } else {
-        Capabilities *result = (Capabilities *)malloc(sizeof(Capabilities));
-        result->category = caps->category ? strdup(caps->category) : NULL;
-        result->type = caps->type ? strdup(caps->type) : NULL;
-        result->name = caps->name ? strdup(caps->name) : NULL;
-        result->software = caps->software ? strdup(caps->software) : NULL;
-        result->software_version = caps->software_version ? strdup(caps->software_version) : NULL;
-        result->os = caps->os ? strdup(caps->os) : NULL;
-        result->os_version = caps->os_version ? strdup(caps->os_version) : NULL;
-
-        result->features = NULL;
-        GSList *curr = caps->features;
-        while (curr) {
-            result->features = g_slist_append(result->features, strdup(curr->data));
-            curr = g_slist_next(curr);
+        caps = _caps_by_jid(jid);
+    }
+
+    return caps && g_hash_table_contains(caps->feature_set, feature);
+}
+
+static Capabilities*
+_caps_ref(Capabilities *caps)
+{
+    caps->refs++;
+    return caps;
+}
+
+static GHashTable*
+_caps_feature_set(GSList *features)
+{
+    GHashTable *feature_set = g_hash_table_new(g_str_hash, g_str_equal);
+    GSList *curr = features;
+    while (curr) {
+        g_hash_table_add(feature_set, curr->data);
+        curr = g_slist_next(curr);
+    }
+
+    return feature_set;
+}
+
+typedef struct caps_form_t {
+    char *type;
+    xmpp_stanza_t *stanza;
+} CapsForm;
+
+static void
+_caps_sha1_update(P_SHA1_CTX *sha1, const char *const str)
+{
+    if (str) {
+        P_SHA1_Update(sha1, (const uint8_t*)str, strlen(str));
+    }
+    P_SHA1_Update(sha1, (const uint8_t*)"<", 1);
+}
+
+static int
+_caps_str_cmp(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(*(char**)a, *(char**)b);
+}
+
+static int
+_caps_form_cmp(gconstpointer a, gconstpointer b)
+{
+    const CapsForm *form_a = *(CapsForm**)a;
+    const CapsForm *form_b = *(CapsForm**)b;
+    return strcmp(form_a->type, form_b->type);
+}
+
+static int
+_caps_field_cmp(gconstpointer a, gconstpointer b)
+{
+    xmpp_stanza_t *field_a = *(xmpp_stanza_t**)a;
+    xmpp_stanza_t *field_b = *(xmpp_stanza_t**)b;
+    return g_strcmp0(xmpp_stanza_get_attribute(field_a, "var"), xmpp_stanza_get_attribute(field_b, "var"));
+}
+
+// values of a form field, in document order, freed with xmpp_free
+static GPtrArray*
+_caps_field_values(xmpp_stanza_t *const field)
+{
+    GPtrArray *values = g_ptr_array_new();
+    xmpp_stanza_t *child = xmpp_stanza_get_children(field);
+    while (child) {
+        if (g_strcmp0(xmpp_stanza_get_name(child), "value") == 0) {
+            char *value = xmpp_stanza_get_text(child);
+            if (value) {
+                g_ptr_array_add(values, value);
+            }
         }
+        child = xmpp_stanza_get_next(child);
+    }
 
-        return result;
+    return values;
+}
+
+static void
+_caps_field_values_free(xmpp_ctx_t *const ctx, GPtrArray *values)
+{
+    int i;
+    for (i = 0; i < values->len; i++) {
+        xmpp_free(ctx, g_ptr_array_index(values, i));
     }
+    g_ptr_array_free(values, TRUE);
 }
 
+// the first value of the hidden FORM_TYPE field, NULL if there is none
+static char*
+_caps_form_type(xmpp_ctx_t *const ctx, xmpp_stanza_t *const form)
+{
+    xmpp_stanza_t *child = xmpp_stanza_get_children(form);
+    while (child) {
+        if (g_strcmp0(xmpp_stanza_get_name(child), "field") == 0 &&
+                g_strcmp0(xmpp_stanza_get_attribute(child, "var"), "FORM_TYPE") == 0) {
+            char *form_type = NULL;
+            GPtrArray *values = _caps_field_values(child);
+            if (values->len > 0) {
+                form_type = g_strdup(g_ptr_array_index(values, 0));
+            }
+            _caps_field_values_free(ctx, values);
+            return form_type;
+        }
+        child = xmpp_stanza_get_next(child);
+    }
+
+    return NULL;
+}
+
+static void
+_caps_sha1_form(P_SHA1_CTX *sha1, xmpp_ctx_t *const ctx, CapsForm *form)
+{
+    _caps_sha1_update(sha1, form->type);
+
+    GPtrArray *fields = g_ptr_array_new();
+    xmpp_stanza_t *child = xmpp_stanza_get_children(form->stanza);
+    while (child) {
+        if (g_strcmp0(xmpp_stanza_get_name(child), "field") == 0 &&
+                g_strcmp0(xmpp_stanza_get_attribute(child, "var"), "FORM_TYPE") != 0) {
+            g_ptr_array_add(fields, child);
+        }
+        child = xmpp_stanza_get_next(child);
+    }
+    g_ptr_array_sort(fields, _caps_field_cmp);
+
+    int i, j;
+    for (i = 0; i < fields->len; i++) {
+        xmpp_stanza_t *field = g_ptr_array_index(fields, i);
+        _caps_sha1_update(sha1, xmpp_stanza_get_attribute(field, "var"));
+
+        GPtrArray *values = _caps_field_values(field);
+        g_ptr_array_sort(values, _caps_str_cmp);
+        for (j = 0; j < values->len; j++) {
+            _caps_sha1_update(sha1, g_ptr_array_index(values, j));
+        }
+        _caps_field_values_free(ctx, values);
+    }
+    g_ptr_array_free(fields, TRUE);
+}
+
+static void
+_caps_form_free(CapsForm *form)
+{
+    g_free(form->type);
+    free(form);
+}
+
+// each part of the verification string is fed to the hash as it is
+// produced, rather than joining them all into one string first
 char*
 caps_create_sha1_str(xmpp_stanza_t *const query)
 {
-    char *category = NULL;
-    char *type = NULL;
-    char *lang = NULL;
-    char *name = NULL;
-    char *feature_str = NULL;
-    GSList *identities = NULL;
-    GSList *features = NULL;
-    GSList *form_names = NULL;
-    DataForm *form = NULL;
-    FormField *field = NULL;
-    GHashTable *forms = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)form_destroy);
+    xmpp_ctx_t *ctx = connection_get_ctx();
+    GPtrArray *identities = g_ptr_array_new_with_free_func(g_free);
+    GPtrArray *features = g_ptr_array_new();
+    GPtrArray *forms = g_ptr_array_new_with_free_func((GDestroyNotify)_caps_form_free);
 
     xmpp_stanza_t *child = xmpp_stanza_get_children(query);
     while (child) {
         if (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_IDENTITY) == 0) {
-            category = xmpp_stanza_get_attribute(child, "category");
-            type = xmpp_stanza_get_attribute(child, "type");
-            lang = xmpp_stanza_get_attribute(child, "xml:lang");
-            name = xmpp_stanza_get_attribute(child, "name");
-
-            GString *identity_str = g_string_new(category);
-            g_string_append(identity_str, "/");
-            if (type) {
-                g_string_append(identity_str, type);
-            }
-            g_string_append(identity_str, "/");
-            if (lang) {
-                g_string_append(identity_str, lang);
-            }
-            g_string_append(identity_str, "/");
-            if (name) {
-                g_string_append(identity_str, name);
-            }
-            g_string_append(identity_str, "<");
-            identities = g_slist_insert_sorted(identities, g_strdup(identity_str->str), (GCompareFunc)strcmp);
-            g_string_free(identity_str, TRUE);
+            const char *category = xmpp_stanza_get_attribute(child, "category");
+            const char *type = xmpp_stanza_get_attribute(child, "type");
+            const char *lang = xmpp_stanza_get_attribute(child, "xml:lang");
+            const char *name = xmpp_stanza_get_attribute(child, "name");
+            g_ptr_array_add(identities, g_strdup_printf("%s/%s/%s/%s",
+                category ? category : "",
+                type ? type : "",
+                lang ? lang : "",
+                name ? name : ""));
         } else if (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_FEATURE) == 0) {
-            feature_str = xmpp_stanza_get_attribute(child, "var");
-            features = g_slist_insert_sorted(features, g_strdup(feature_str), (GCompareFunc)strcmp);
+            const char *feature = xmpp_stanza_get_attribute(child, "var");
+            if (feature) {
+                g_ptr_array_add(features, (char*)feature);
+            }
         } else if (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_X) == 0) {
             if (g_strcmp0(xmpp_stanza_get_ns(child), STANZA_NS_DATA) == 0) {
-                form = form_create(child);
-                char *form_type = form_get_form_type_field(form);
-                form_names = g_slist_insert_sorted(form_names, g_strdup(form_type), (GCompareFunc)strcmp);
-                g_hash_table_insert(forms, g_strdup(form_type), form);
+                // forms without a FORM_TYPE are not part of the string
+                char *form_type = _caps_form_type(ctx, child);
+                if (form_type) {
+                    CapsForm *form = malloc(sizeof(CapsForm));
+                    form->type = form_type;
+                    form->stanza = child;
+                    g_ptr_array_add(forms, form);
+                }
             }
         }
         child = xmpp_stanza_get_next(child);
     }
 
-    GString *s = g_string_new("");
+    g_ptr_array_sort(identities, _caps_str_cmp);
+    g_ptr_array_sort(features, _caps_str_cmp);
+    g_ptr_array_sort(forms, _caps_form_cmp);
 
-    GSList *curr = identities;
-    while (curr) {
-        g_string_append(s, curr->data);
-        curr = g_slist_next(curr);
-    }
+    P_SHA1_CTX sha1;
+    P_SHA1_Init(&sha1);
 
-    curr = features;
-    while (curr) {
-        g_string_append(s, curr->data);
-        g_string_append(s, "<");
-        curr = g_slist_next(curr);
+    int i;
+    for (i = 0; i < identities->len; i++) {
+        _caps_sha1_update(&sha1, g_ptr_array_index(identities, i));
     }
-
-    curr = form_names;
-    while (curr) {
-        form = g_hash_table_lookup(forms, curr->data);
-        char *form_type = form_get_form_type_field(form);
-        g_string_append(s, form_type);
-        g_string_append(s, "<");
-
-        GSList *sorted_fields = form_get_non_form_type_fields_sorted(form);
-        GSList *curr_field = sorted_fields;
-        while (curr_field) {
-            field = curr_field->data;
-            g_string_append(s, field->var);
-            g_string_append(s, "<");
-
-            GSList *sorted_values = form_get_field_values_sorted(field);
-            GSList *curr_value = sorted_values;
-            while (curr_value) {
-                g_string_append(s, curr_value->data);
-                g_string_append(s, "<");
-                curr_value = g_slist_next(curr_value);
-            }
-            g_slist_free(sorted_values);
-            curr_field = g_slist_next(curr_field);
-        }
-        g_slist_free(sorted_fields);
-
-        curr = g_slist_next(curr);
+    for (i = 0; i < features->len; i++) {
+        _caps_sha1_update(&sha1, g_ptr_array_index(features, i));
+    }
+    for (i = 0; i < forms->len; i++) {
+        _caps_sha1_form(&sha1, ctx, g_ptr_array_index(forms, i));
     }
 
-    char *result = p_sha1_hash(s->str);
+    uint8_t digest[P_SHA1_DIGEST_SIZE];
+    P_SHA1_Final(&sha1, digest);
 
-    g_string_free(s, TRUE);
-    g_slist_free_full(identities, g_free);
-    g_slist_free_full(features, g_free);
-    g_slist_free_full(form_names, g_free);
-    g_hash_table_destroy(forms);
+    g_ptr_array_free(identities, TRUE);
+    g_ptr_array_free(features, TRUE);
+    g_ptr_array_free(forms, TRUE);
 
-    return result;
+    return g_base64_encode(digest, sizeof(digest));
 }
 
 Capabilities*
@@ -432,14 +758,19 @@ caps_create(xmpp_stanza_t *query)
     GSList *identity_stanzas = NULL;
     while (child) {
         if (g_strcmp0(xmpp_stanza_get_name(child), "feature") == 0) {
-            features = g_slist_append(features, strdup(xmpp_stanza_get_attribute(child, "var")));
+            const char *var = xmpp_stanza_get_attribute(child, "var");
+            if (var) {
+                features = g_slist_prepend(features, (gpointer)str_intern(var));
+            }
         }
         if (g_strcmp0(xmpp_stanza_get_name(child), "identity") == 0) {
-            identity_stanzas = g_slist_append(identity_stanzas, child);
+            identity_stanzas = g_slist_prepend(identity_stanzas, child);
         }
 
         child = xmpp_stanza_get_next(child);
     }
+    features = g_slist_reverse(features);
+    identity_stanzas = g_slist_reverse(identity_stanzas);
 
     // find identity by locale
     const gchar* const *langs = g_get_language_names();
@@ -495,6 +826,7 @@ caps_create(xmpp_stanza_t *query)
     }
 
     Capabilities *new_caps = malloc(sizeof(struct capabilities_t));
+    new_caps->refs = 1;
 
     if (category) {
         new_caps->category = strdup(category);
@@ -536,6 +868,8 @@ caps_create(xmpp_stanza_t *query)
     } else {
         new_caps->features = NULL;
     }
+    new_caps->feature_set = _caps_feature_set(new_caps->features);
+    stats_alloc(STATS_MEM_CAPABILITIES, _caps_size(new_caps));
 
     return new_caps;
 }
@@ -615,6 +949,10 @@ caps_create_query_response_stanza(xmpp_ctx_t *const ctx)
     xmpp_stanza_set_name(feature_receipts, STANZA_NAME_FEATURE);
     xmpp_stanza_set_attribute(feature_receipts, STANZA_ATTR_VAR, STANZA_NS_RECEIPTS);
 
+    xmpp_stanza_t *feature_markers = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(feature_markers, STANZA_NAME_FEATURE);
+    xmpp_stanza_set_attribute(feature_markers, STANZA_ATTR_VAR, STANZA_NS_CHAT_MARKERS);
+
     xmpp_stanza_t *feature_last = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(feature_last, STANZA_NAME_FEATURE);
     xmpp_stanza_set_attribute(feature_last, STANZA_ATTR_VAR, STANZA_NS_LASTACTIVITY);
@@ -631,7 +969,9 @@ caps_create_query_response_stanza(xmpp_ctx_t *const ctx)
     xmpp_stanza_add_child(query, feature_conference);
     xmpp_stanza_add_child(query, feature_ping);
     xmpp_stanza_add_child(query, feature_receipts);
+    xmpp_stanza_add_child(query, feature_markers);
 
+    xmpp_stanza_release(feature_markers);
     xmpp_stanza_release(feature_receipts);
     xmpp_stanza_release(feature_ping);
     xmpp_stanza_release(feature_conference);
@@ -647,19 +987,38 @@ caps_create_query_response_stanza(xmpp_ctx_t *const ctx)
     return query;
 }
 
+// called periodically from the main loop
+void
+caps_flush(void)
+{
+    if (cache_dirty) {
+        _save_cache();
+    }
+}
+
 void
 caps_close(void)
 {
-    g_key_file_free(cache);
-    cache = NULL;
+    caps_flush();
+    g_free(cache_loc);
+    cache_loc = NULL;
+    g_free(bin_cache_loc);
+    bin_cache_loc = NULL;
+    g_hash_table_destroy(ver_to_caps);
     g_hash_table_destroy(jid_to_ver);
     g_hash_table_destroy(jid_to_caps);
+    g_hash_table_destroy(caps_requests);
+    g_hash_table_destroy(caps_deferred);
 }
 
+// capabilities are shared, this drops one reference and frees them with
+// the last
 void
 caps_destroy(Capabilities *caps)
 {
-    if (caps) {
+    if (caps && --caps->refs == 0) {
+        stats_free(STATS_MEM_CAPABILITIES, _caps_size(caps));
+        g_hash_table_destroy(caps->feature_set);
         free(caps->category);
         free(caps->type);
         free(caps->name);
@@ -668,12 +1027,35 @@ caps_destroy(Capabilities *caps)
         free(caps->os);
         free(caps->os_version);
         if (caps->features) {
-            g_slist_free_full(caps->features, free);
+            g_slist_free_full(caps->features, (GDestroyNotify)str_unintern);
         }
         free(caps);
     }
 }
 
+// shared capabilities are never changed, the feature set only points at
+// the feature list and feature names are interned so neither is counted
+static size_t
+_caps_size(Capabilities *caps)
+{
+    size_t size = sizeof(struct capabilities_t);
+    const char *strings[] = { caps->category, caps->type, caps->name, caps->software,
+        caps->software_version, caps->os, caps->os_version };
+    int i;
+    for (i = 0; i < ARRAY_SIZE(strings); i++) {
+        if (strings[i]) {
+            size += strlen(strings[i]) + 1;
+        }
+    }
+    GSList *curr = caps->features;
+    while (curr) {
+        size += sizeof(GSList);
+        curr = g_slist_next(curr);
+    }
+
+    return size;
+}
+
 static gchar*
 _get_cache_file(void)
 {
@@ -687,12 +1069,178 @@ _get_cache_file(void)
     return result;
 }
 
+// each entry is the verification string, identity, software and os
+// strings and the feature list, each string a 32 bit length and its
+// bytes. g_file_set_contents replaces the file with an atomic rename.
 static void
 _save_cache(void)
 {
-    gsize g_data_size;
-    gchar *g_cache_data = g_key_file_to_data(cache, &g_data_size, NULL);
-    g_file_set_contents(cache_loc, g_cache_data, g_data_size, NULL);
-    g_chmod(cache_loc, S_IRUSR | S_IWUSR);
-    g_free(g_cache_data);
+    if (file_stamp_changed(bin_cache_loc, &cache_stamp)) {
+        _load_cache();
+    }
+
+    GString *out = g_string_new_len(CAPS_CACHE_MAGIC, CAPS_CACHE_MAGIC_LEN);
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ver_to_caps);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        Capabilities *caps = value;
+        _cache_put_str(out, key);
+        _cache_put_str(out, caps->category);
+        _cache_put_str(out, caps->type);
+        _cache_put_str(out, caps->name);
+        _cache_put_str(out, caps->software);
+        _cache_put_str(out, caps->software_version);
+        _cache_put_str(out, caps->os);
+        _cache_put_str(out, caps->os_version);
+
+        guint32 num = GUINT32_TO_LE(g_slist_length(caps->features));
+        g_string_append_len(out, (char*)&num, sizeof(num));
+        GSList *curr = caps->features;
+        while (curr) {
+            _cache_put_str(out, curr->data);
+            curr = g_slist_next(curr);
+        }
+    }
+
+    watchdog_tag(WATCHDOG_DISK);
+    if (g_file_set_contents(bin_cache_loc, out->str, out->len, NULL)) {
+        g_chmod(bin_cache_loc, S_IRUSR | S_IWUSR);
+        cache_dirty = FALSE;
+        file_stamp_changed(bin_cache_loc, &cache_stamp);
+    } else {
+        log_error("Error saving capabilities cache %s", bin_cache_loc);
+    }
+    g_string_free(out, TRUE);
+}
+
+static gboolean
+_load_cache(void)
+{
+    gchar *data = NULL;
+    gsize len = 0;
+    file_stamp_changed(bin_cache_loc, &cache_stamp);
+    if (!g_file_get_contents(bin_cache_loc, &data, &len, NULL)) {
+        return FALSE;
+    }
+    if (len < CAPS_CACHE_MAGIC_LEN || memcmp(data, CAPS_CACHE_MAGIC, CAPS_CACHE_MAGIC_LEN) != 0) {
+        log_warning("Ignoring invalid capabilities cache %s", bin_cache_loc);
+        g_free(data);
+        return FALSE;
+    }
+
+    gsize pos = CAPS_CACHE_MAGIC_LEN;
+    while (pos < len) {
+        char *ver = NULL;
+        Capabilities *caps = calloc(1, sizeof(Capabilities));
+        caps->refs = 1;
+        guint32 num = 0;
+        gboolean valid = _cache_get_str(data, len, &pos, &ver) &&
+            _cache_get_str(data, len, &pos, &caps->category) &&
+            _cache_get_str(data, len, &pos, &caps->type) &&
+            _cache_get_str(data, len, &pos, &caps->name) &&
+            _cache_get_str(data, len, &pos, &caps->software) &&
+            _cache_get_str(data, len, &pos, &caps->software_version) &&
+            _cache_get_str(data, len, &pos, &caps->os) &&
+            _cache_get_str(data, len, &pos, &caps->os_version) &&
+            _cache_get_u32(data, len, &pos, &num);
+
+        guint32 i;
+        for (i = 0; valid && i < num; i++) {
+            char *feature = NULL;
+            valid = _cache_get_str(data, len, &pos, &feature) && feature;
+            if (valid) {
+                caps->features = g_slist_prepend(caps->features, (gpointer)str_intern(feature));
+            }
+            free(feature);
+        }
+        caps->features = g_slist_reverse(caps->features);
+        caps->feature_set = _caps_feature_set(caps->features);
+
+        // keep what was read before a truncated entry, it is rewritten
+        if (!valid || ver == NULL) {
+            free(ver);
+            caps_destroy(caps);
+            cache_dirty = TRUE;
+            break;
+        }
+        // entries already held are the same, keep those in use
+        if (g_hash_table_contains(ver_to_caps, ver)) {
+            caps_destroy(caps);
+        } else {
+            g_hash_table_insert(ver_to_caps, g_strdup(ver), caps);
+        }
+        free(ver);
+    }
+    g_free(data);
+
+    return TRUE;
+}
+
+static void
+_load_legacy_cache(void)
+{
+    if (!g_file_test(cache_loc, G_FILE_TEST_EXISTS)) {
+        return;
+    }
+
+    GKeyFile *cache = g_key_file_new();
+    g_key_file_load_from_file(cache, cache_loc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    gsize num_groups = 0;
+    gchar **groups = g_key_file_get_groups(cache, &num_groups);
+    int i;
+    for (i = 0; i < num_groups; i++) {
+        g_hash_table_insert(ver_to_caps, g_strdup(groups[i]), _caps_load(cache, groups[i]));
+    }
+    g_strfreev(groups);
+    g_key_file_free(cache);
+
+    if (num_groups > 0) {
+        cache_dirty = TRUE;
+    }
+}
+
+static void
+_cache_put_str(GString *out, const char *const str)
+{
+    guint32 len = GUINT32_TO_LE(str ? strlen(str) : CAPS_CACHE_NULL);
+    g_string_append_len(out, (char*)&len, sizeof(len));
+    if (str) {
+        g_string_append(out, str);
+    }
+}
+
+static gboolean
+_cache_get_u32(const char *const data, gsize len, gsize *pos, guint32 *value)
+{
+    if (len - *pos < sizeof(guint32)) {
+        return FALSE;
+    }
+    memcpy(value, data + *pos, sizeof(guint32));
+    *value = GUINT32_FROM_LE(*value);
+    *pos += sizeof(guint32);
+
+    return TRUE;
+}
+
+static gboolean
+_cache_get_str(const char *const data, gsize len, gsize *pos, char **str)
+{
+    guint32 str_len = 0;
+    if (!_cache_get_u32(data, len, pos, &str_len)) {
+        return FALSE;
+    }
+    if (str_len == CAPS_CACHE_NULL) {
+        *str = NULL;
+        return TRUE;
+    }
+    if (len - *pos < str_len) {
+        return FALSE;
+    }
+    *str = strndup(data + *pos, str_len);
+    *pos += str_len;
+
+    return TRUE;
 }
@@ -51,7 +51,13 @@ void caps_init(void);
 void caps_add_by_ver(const char *const ver, Capabilities *caps);
 void caps_add_by_jid(const char *const jid, Capabilities *caps);
 void caps_map_jid_to_ver(const char *const jid, const char *const ver);
+const char* caps_get_ver(const char *const jid);
 gboolean caps_contains(const char *const ver);
+void caps_request(const char *const key, const char *const jid, const char *const node, const char *const ver,
+    gboolean legacy);
+void caps_request_resolved(const char *const key);
+void caps_defer(const char *const key, const char *const jid, const char *const node, const char *const ver,
+    gboolean legacy);
 
 char* caps_create_sha1_str(xmpp_stanza_t *const query);
 xmpp_stanza_t* caps_create_query_response_stanza(xmpp_ctx_t *const ctx);
@@ -37,6 +37,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 #ifdef HAVE_LIBMESODE
 #include <mesode.h>
@@ -48,6 +49,8 @@
 #include "chat_session.h"
 #include "common.h"
 #include "config/preferences.h"
+#include "config/rostercache.h"
+#include "config/bookmarkcache.h"
 #include "jid.h"
 #include "log.h"
 #include "muc.h"
@@ -56,12 +59,34 @@
 #include "xmpp/bookmark.h"
 #include "xmpp/capabilities.h"
 #include "xmpp/connection.h"
+#include "xmpp/http_upload.h"
 #include "xmpp/iq.h"
+#include "xmpp/mam.h"
 #include "xmpp/message.h"
 #include "xmpp/presence.h"
 #include "xmpp/roster.h"
+#include "xmpp/srv.h"
 #include "xmpp/stanza.h"
+#include "xmpp/stream_mgmt.h"
 #include "xmpp/xmpp.h"
+#include "tools/arena.h"
+#include "tools/trace.h"
+#include "tools/traffic.h"
+#include "tools/watchdog.h"
+#include "window_list.h"
+
+// flush early once this much is queued, about one TLS record
+#define SEND_QUEUE_FLUSH_SIZE 16384
+
+// a stanza whose handler ran out of time in its iteration, from is the
+// bare jid of a background stanza, see _connection_stanza_lane
+typedef struct deferred_stanza_t {
+    ConnectionHandler *handler;
+    xmpp_stanza_t *stanza;
+    char *from;
+} DeferredStanza;
+
+static gboolean bench_connected = FALSE;
 
 static struct _jabber_conn_t {
     xmpp_log_t *log;
@@ -70,9 +95,32 @@ static struct _jabber_conn_t {
     jabber_conn_status_t conn_status;
     char *presence_message;
     int priority;
-    char *domain;
+    Jid *jid;
+    gboolean client_active;
+    GString *send_queue;
+    GSList *handlers;
+    // DeferredStanzas in the order they were read, those the user is
+    // waiting for are handled before the background ones
+    GQueue *urgent;
+    GQueue *deferred;
+    // bare jid to how many of its stanzas are in deferred
+    GHashTable *deferred_from;
+    gint64 events_deadline;
+    // id to the ConnectionRequest waiting for its result
+    GHashTable *requests;
+    gint64 last_received;
+    // the last <stream:features/> read, after login those of the
+    // authenticated stream
+    char *stream_features;
 } jabber_conn;
 
+typedef struct connection_request_t {
+    char *id;
+    const RequestType *type;
+    void *userdata;
+    gint64 sent;
+} ConnectionRequest;
+
 static GHashTable *available_resources;
 
 // for auto reconnect
@@ -91,6 +139,8 @@ static struct {
 } saved_details;
 
 static GTimer *reconnect_timer;
+// set when a dead connection was dropped, so the reconnect does not wait
+static gboolean reconnect_now = FALSE;
 
 static log_level_t _get_log_level(xmpp_log_level_t xmpp_level);
 static xmpp_log_level_t _get_xmpp_log_level();
@@ -100,10 +150,34 @@ static void _xmpp_file_logger(void *const userdata, const xmpp_log_level_t level
 
 static xmpp_log_t* _xmpp_get_file_logger();
 
+// the jabber_tap_t functions added, see jabber_tap_add
+static GSList *taps = NULL;
+
+static void _connection_tap(traffic_dir_t dir, const char *const text);
+static void _connection_traffic_tap(traffic_dir_t dir, const char *const text);
+
 static jabber_conn_status_t _jabber_connect(const char *const fulljid, const char *const passwd,
     const char *const altdomain, int port, const char *const tls_policy);
 
 static void _jabber_reconnect(void);
+static jabber_conn_status_t _connection_connect_client(const char *const host, int port);
+static void _connection_srv_raced(const char *const host, int port);
+static void _connection_login_failed(void);
+static char* _connection_passwd_new(const char *const passwd);
+static void _connection_passwd_free(char *passwd);
+static void _connection_queue(xmpp_stanza_t *const stanza);
+static void _connection_count_text(xmpp_stanza_t *const stanza, size_t len);
+static void _connection_count_sent(xmpp_stanza_t *const stanza);
+static void _connection_handler_free(ConnectionHandler *handler);
+static void _connection_handlers_clear(void);
+static int _connection_stanza_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static GQueue* _connection_stanza_lane(xmpp_stanza_t *const stanza, const char *const from);
+static void _connection_deferred_run(void);
+static void _connection_deferred_free(DeferredStanza *deferred);
+static void _connection_deferred_clear(ConnectionHandler *handler);
+static void _connection_requests_clear(void);
+static void _connection_request_free(ConnectionRequest *request);
+static int _connection_request_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 
 static void _connection_handler(xmpp_conn_t *const conn, const xmpp_conn_event_t status, const int error,
     xmpp_stream_error_t *const stream_error, void *const userdata);
@@ -120,9 +194,22 @@ jabber_init(void)
     jabber_conn.presence_message = NULL;
     jabber_conn.conn = NULL;
     jabber_conn.ctx = NULL;
-    jabber_conn.domain = NULL;
+    jabber_conn.jid = NULL;
+    jabber_conn.client_active = TRUE;
+    jabber_conn.send_queue = g_string_new("");
+    jabber_conn.handlers = NULL;
+    jabber_conn.urgent = g_queue_new();
+    jabber_conn.deferred = g_queue_new();
+    jabber_conn.deferred_from = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    jabber_conn.events_deadline = 0;
+    jabber_conn.last_received = 0;
+    jabber_conn.stream_features = NULL;
+    jabber_conn.requests = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+        (GDestroyNotify)_connection_request_free);
+    jabber_tap_add(_connection_traffic_tap);
     presence_sub_requests_init();
     caps_init();
+    stream_mgmt_init();
     available_resources = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)resource_destroy);
     xmpp_initialize();
 }
@@ -139,10 +226,8 @@ jabber_connect_with_account(const ProfAccount *const account)
         free(saved_account.name);
     }
     saved_account.name = strdup(account->name);
-    if (saved_account.passwd) {
-        free(saved_account.passwd);
-    }
-    saved_account.passwd = strdup(account->password);
+    _connection_passwd_free(saved_account.passwd);
+    saved_account.passwd = _connection_passwd_new(account->password);
 
     // connect with fulljid
     Jid *jidp = jid_create_from_bare_and_resource(account->jid, account->resource);
@@ -162,7 +247,7 @@ jabber_connect_with_details(const char *const jid, const char *const passwd, con
 
     // save details for reconnect, remember name for account creating on success
     saved_details.name = strdup(jid);
-    saved_details.passwd = strdup(passwd);
+    saved_details.passwd = _connection_passwd_new(passwd);
     if (altdomain) {
         saved_details.altdomain = strdup(altdomain);
     } else {
@@ -204,11 +289,14 @@ jabber_connect_with_details(const char *const jid, const char *const passwd, con
 void
 jabber_disconnect(void)
 {
+    srv_race_cancel();
+
     // if connected, send end stream and wait for response
     if (jabber_conn.conn_status == JABBER_CONNECTED) {
         log_info("Closing connection");
         accounts_set_last_activity(jabber_get_account_name());
         jabber_conn.conn_status = JABBER_DISCONNECTING;
+        connection_flush();
         xmpp_disconnect(jabber_conn.conn);
 
         while (jabber_get_connection_status() == JABBER_DISCONNECTING) {
@@ -217,6 +305,7 @@ jabber_disconnect(void)
         _connection_free_saved_account();
         _connection_free_saved_details();
         _connection_free_session_data();
+        _connection_deferred_clear(NULL);
         if (jabber_conn.conn) {
             xmpp_conn_release(jabber_conn.conn);
             jabber_conn.conn = NULL;
@@ -228,8 +317,10 @@ jabber_disconnect(void)
     }
 
     jabber_conn.conn_status = JABBER_STARTED;
+    stream_mgmt_clear();
     FREE_SET_NULL(jabber_conn.presence_message);
-    FREE_SET_NULL(jabber_conn.domain);
+    jid_destroy(jabber_conn.jid);
+    jabber_conn.jid = NULL;
 }
 
 void
@@ -238,9 +329,83 @@ jabber_shutdown(void)
     _connection_free_saved_account();
     _connection_free_saved_details();
     _connection_free_session_data();
+    _connection_handlers_clear();
+    _connection_requests_clear();
+    g_hash_table_destroy(jabber_conn.requests);
+    jabber_conn.requests = NULL;
+    stream_mgmt_clear();
+    srv_race_cancel();
+    srv_cache_clear();
+    g_string_free(jabber_conn.send_queue, TRUE);
+    jabber_conn.send_queue = NULL;
+    g_queue_free(jabber_conn.urgent);
+    jabber_conn.urgent = NULL;
+    g_queue_free(jabber_conn.deferred);
+    jabber_conn.deferred = NULL;
+    g_hash_table_destroy(jabber_conn.deferred_from);
+    jabber_conn.deferred_from = NULL;
     xmpp_shutdown();
     free(jabber_conn.log);
     jabber_conn.log = NULL;
+    jabber_tap_remove(_connection_traffic_tap);
+}
+
+// a connection that never opens a socket, stanzas are built as usual and
+// dropped by libstrophe on send, used by the benchmark replay
+void
+jabber_bench_connect(const char *const fulljid)
+{
+    Jid *jidp = jid_create(fulljid);
+    if (jidp == NULL) {
+        log_error("Benchmark connection needs a valid JID, received: %s", fulljid);
+        return;
+    }
+
+    if (jabber_conn.log == NULL) {
+        jabber_conn.log = _xmpp_get_file_logger();
+    }
+    jabber_conn.ctx = xmpp_ctx_new(NULL, jabber_conn.log);
+    jabber_conn.conn = xmpp_conn_new(jabber_conn.ctx);
+    xmpp_conn_set_jid(jabber_conn.conn, fulljid);
+    jid_destroy(jabber_conn.jid);
+    jabber_conn.jid = jidp;
+    jabber_conn.conn_status = JABBER_CONNECTED;
+    bench_connected = TRUE;
+
+    // never fired by libstrophe, only by jabber_bench_replay
+    chat_sessions_init();
+    _connection_handlers_clear();
+    roster_add_handlers();
+    message_add_handlers();
+    presence_add_handlers();
+    iq_add_handlers();
+
+    log_info("Benchmark connection as %s", fulljid);
+}
+
+// nothing will answer a stream close, so tear down without waiting
+void
+jabber_bench_disconnect(void)
+{
+    if (!bench_connected) {
+        return;
+    }
+
+    bench_connected = FALSE;
+    _connection_handlers_clear();
+    _connection_requests_clear();
+    g_string_truncate(jabber_conn.send_queue, 0);
+    if (jabber_conn.conn) {
+        xmpp_conn_release(jabber_conn.conn);
+        jabber_conn.conn = NULL;
+    }
+    if (jabber_conn.ctx) {
+        xmpp_ctx_free(jabber_conn.ctx);
+        jabber_conn.ctx = NULL;
+    }
+    jabber_conn.conn_status = JABBER_STARTED;
+    jid_destroy(jabber_conn.jid);
+    jabber_conn.jid = NULL;
 }
 
 void
@@ -253,13 +418,22 @@ jabber_process_events(int millis)
         case JABBER_CONNECTED:
         case JABBER_CONNECTING:
         case JABBER_DISCONNECTING:
-            xmpp_run_once(jabber_conn.ctx, millis);
+            srv_process();
+            connection_flush();
+            // everything handled in one pass shares a scope, see tools/arena.h
+            arena_begin();
+            jabber_conn.events_deadline = g_get_monotonic_time() + (gint64)prefs_get_inpblock_budget() * 1000;
+            _connection_deferred_run();
+            xmpp_run_once(jabber_conn.ctx, jabber_events_pending() ? 0 : millis);
+            sv_ev_flush();
+            arena_end();
             break;
         case JABBER_DISCONNECTED:
             reconnect_sec = prefs_get_reconnect();
             if ((reconnect_sec != 0) && reconnect_timer) {
                 int elapsed_sec = g_timer_elapsed(reconnect_timer, NULL);
-                if (elapsed_sec > reconnect_sec) {
+                if (elapsed_sec > reconnect_sec || reconnect_now) {
+                    reconnect_now = FALSE;
                     _jabber_reconnect();
                 }
             }
@@ -269,6 +443,17 @@ jabber_process_events(int millis)
     }
 }
 
+// stanzas read but not yet handled, the main loop should not wait for input
+gboolean
+jabber_events_pending(void)
+{
+    if (jabber_conn.deferred == NULL) {
+        return FALSE;
+    }
+
+    return !g_queue_is_empty(jabber_conn.urgent) || !g_queue_is_empty(jabber_conn.deferred);
+}
+
 GList*
 jabber_get_available_resources(void)
 {
@@ -302,7 +487,14 @@ jabber_get_fulljid(void)
 const char*
 jabber_get_domain(void)
 {
-    return jabber_conn.domain;
+    return jabber_conn.jid ? jabber_conn.jid->domainpart : NULL;
+}
+
+// the jid of the current session, parsed once at login
+const Jid*
+jabber_get_jid(void)
+{
+    return jabber_conn.jid;
 }
 
 char*
@@ -352,17 +544,543 @@ connection_add_available_resource(Resource *resource)
     g_hash_table_replace(available_resources, strdup(resource->name), resource);
 }
 
+// XEP-0352, lets the server hold back non urgent traffic while we are
+// inactive, going back to active is always allowed so turning the
+// preference off never leaves the server thinking we are away
+void
+jabber_set_client_active(gboolean active)
+{
+    if (jabber_conn.conn_status != JABBER_CONNECTED || active == jabber_conn.client_active) {
+        return;
+    }
+    if (!active && !prefs_get_boolean(PREF_CSI)) {
+        return;
+    }
+
+    jabber_conn.client_active = active;
+    xmpp_stanza_t *csi = stanza_create_csi(jabber_conn.ctx, active);
+    connection_send_nonza(csi);
+    xmpp_stanza_release(csi);
+}
+
+// the wrapped handler is given the context, as when registered directly
+int
+connection_timed_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    const TimedHandler *timed = userdata;
+
+    gint64 start = stats_start();
+    gint64 trace = trace_start();
+    gint64 watch = watchdog_start();
+    int result = timed->handler(conn, stanza, jabber_conn.ctx);
+    connection_watchdog_check(stats_name(timed->stat), stanza, watch);
+    trace_record(stats_name(timed->stat), trace);
+    stats_record(timed->stat, start);
+
+    return result;
+}
+
+void
+connection_handler_add(xmpp_handler handler, const char *const ns, const char *const name, const char *const type,
+    void *const userdata, const char *const label)
+{
+    ConnectionHandler *entry = malloc(sizeof(ConnectionHandler));
+    entry->handler = handler;
+    entry->ns = g_strdup(ns);
+    entry->name = g_strdup(name);
+    entry->type = g_strdup(type);
+    entry->userdata = userdata;
+    entry->label = label;
+    entry->removed = FALSE;
+    jabber_conn.handlers = g_slist_append(jabber_conn.handlers, entry);
+
+    xmpp_handler_add(jabber_conn.conn, _connection_stanza_handler, ns, name, type, entry);
+}
+
+// stanza handlers run for at most the input block budget in each main loop
+// iteration, the rest of a burst waits for the next so input is not held
+// up, once one stanza of a lane has waited those read after it wait behind
+// it so each lane is still handled in order
+static int
+_connection_stanza_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    ConnectionHandler *handler = userdata;
+    if (handler->removed) {
+        return 0;
+    }
+
+    char *from = NULL;
+    const char *stanza_from = xmpp_stanza_get_from(stanza);
+    if (stanza_from) {
+        const char *slash = strchr(stanza_from, '/');
+        from = slash ? g_strndup(stanza_from, slash - stanza_from) : g_strdup(stanza_from);
+    }
+
+    GQueue *lane = _connection_stanza_lane(stanza, from);
+    if (!g_queue_is_empty(lane) || g_get_monotonic_time() >= jabber_conn.events_deadline) {
+        DeferredStanza *deferred = malloc(sizeof(DeferredStanza));
+        deferred->handler = handler;
+        deferred->stanza = xmpp_stanza_clone(stanza);
+        deferred->from = NULL;
+        if (lane == jabber_conn.deferred && from) {
+            int count = GPOINTER_TO_INT(g_hash_table_lookup(jabber_conn.deferred_from, from));
+            g_hash_table_replace(jabber_conn.deferred_from, strdup(from), GINT_TO_POINTER(count + 1));
+            deferred->from = from;
+            from = NULL;
+        }
+        g_queue_push_tail(lane, deferred);
+        g_free(from);
+        return 1;
+    }
+
+    g_free(from);
+    return handler->handler(conn, stanza, handler->userdata);
+}
+
+// direct messages, requests and the focused room go first, presence, chat
+// states and other rooms are background, a stanza from a contact or room
+// with background stanzas still waiting waits behind them
+static GQueue*
+_connection_stanza_lane(xmpp_stanza_t *const stanza, const char *const from)
+{
+    if (from && g_hash_table_lookup(jabber_conn.deferred_from, from)) {
+        return jabber_conn.deferred;
+    }
+
+    const char *name = xmpp_stanza_get_name(stanza);
+    if (g_strcmp0(name, STANZA_NAME_PRESENCE) == 0) {
+        return jabber_conn.deferred;
+    }
+
+    if (g_strcmp0(name, STANZA_NAME_MESSAGE) == 0) {
+        if (g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_GROUPCHAT) == 0) {
+            ProfMucWin *mucwin = from ? wins_get_muc(from) : NULL;
+            return mucwin && wins_is_current((ProfWin*)mucwin) ? jabber_conn.urgent : jabber_conn.deferred;
+        }
+        if (xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY) == NULL &&
+                xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CHATSTATES)) {
+            return jabber_conn.deferred;
+        }
+    }
+
+    return jabber_conn.urgent;
+}
+
+static void
+_connection_deferred_run(void)
+{
+    while (g_get_monotonic_time() < jabber_conn.events_deadline) {
+        DeferredStanza *deferred = g_queue_pop_head(jabber_conn.urgent);
+        if (deferred == NULL) {
+            deferred = g_queue_pop_head(jabber_conn.deferred);
+        }
+        if (deferred == NULL) {
+            break;
+        }
+
+        ConnectionHandler *handler = deferred->handler;
+        if (!handler->removed && !handler->handler(jabber_conn.conn, deferred->stanza, handler->userdata)) {
+            // the handler may have disconnected, taking every handler with it
+            if (g_slist_find(jabber_conn.handlers, handler)) {
+                handler->removed = TRUE;
+            }
+        }
+        _connection_deferred_free(deferred);
+    }
+}
+
+static void
+_connection_deferred_free(DeferredStanza *deferred)
+{
+    if (deferred->from) {
+        int count = GPOINTER_TO_INT(g_hash_table_lookup(jabber_conn.deferred_from, deferred->from));
+        if (count > 1) {
+            g_hash_table_replace(jabber_conn.deferred_from, strdup(deferred->from), GINT_TO_POINTER(count - 1));
+        } else {
+            g_hash_table_remove(jabber_conn.deferred_from, deferred->from);
+        }
+        g_free(deferred->from);
+    }
+    xmpp_stanza_release(deferred->stanza);
+    free(deferred);
+}
+
+// drops the stanzas waiting for handler, or for any handler when NULL
+static void
+_connection_deferred_clear(ConnectionHandler *handler)
+{
+    if (jabber_conn.deferred == NULL) {
+        return;
+    }
+
+    GQueue *lanes[] = { jabber_conn.urgent, jabber_conn.deferred };
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(lanes); i++) {
+        GList *curr = lanes[i]->head;
+        while (curr) {
+            GList *next = g_list_next(curr);
+            DeferredStanza *deferred = curr->data;
+            if (handler == NULL || deferred->handler == handler) {
+                g_queue_delete_link(lanes[i], curr);
+                _connection_deferred_free(deferred);
+            }
+            curr = next;
+        }
+    }
+}
+
+GSList*
+connection_get_handlers(void)
+{
+    return jabber_conn.handlers;
+}
+
+// names the stanza by its id and the namespace of its first child that
+// has one, the stanza's own is always jabber:client
+void
+connection_watchdog_check(const char *const handler, xmpp_stanza_t *const stanza, gint64 start)
+{
+    if (!watchdog_exceeded(start)) {
+        return;
+    }
+
+    const char *ns = NULL;
+    xmpp_stanza_t *child = xmpp_stanza_get_children(stanza);
+    while (child && ns == NULL) {
+        ns = xmpp_stanza_get_ns(child);
+        child = xmpp_stanza_get_next(child);
+    }
+
+    const char *id = xmpp_stanza_get_id(stanza);
+    gchar *detail = g_strdup_printf("%s (id %s, ns %s)", handler, id ? id : "none", ns ? ns : "none");
+    watchdog_check("stanza handler", detail, start);
+    g_free(detail);
+}
+
+// only forgets the handler, libstrophe removes its own copy when the
+// handler returns 0
+void
+connection_handler_remove(ConnectionHandler *handler)
+{
+    _connection_deferred_clear(handler);
+    jabber_conn.handlers = g_slist_remove(jabber_conn.handlers, handler);
+    _connection_handler_free(handler);
+}
+
+static void
+_connection_handler_free(ConnectionHandler *handler)
+{
+    g_free(handler->ns);
+    g_free(handler->name);
+    g_free(handler->type);
+    free(handler);
+}
+
+static void
+_connection_handlers_clear(void)
+{
+    _connection_deferred_clear(NULL);
+    g_slist_free_full(jabber_conn.handlers, (GDestroyNotify)_connection_handler_free);
+    jabber_conn.handlers = NULL;
+}
+
+void
+connection_request_add(const char *const id, const RequestType *const type, void *const userdata)
+{
+    ConnectionRequest *request = malloc(sizeof(ConnectionRequest));
+    request->id = strdup(id);
+    request->type = type;
+    request->userdata = userdata;
+    request->sent = g_get_monotonic_time();
+
+    ConnectionRequest *previous = g_hash_table_lookup(jabber_conn.requests, id);
+    if (previous) {
+        xmpp_id_handler_delete(jabber_conn.conn, _connection_request_handler, previous->id);
+        if (previous->type->free_userdata) {
+            previous->type->free_userdata(previous->userdata);
+        }
+    }
+
+    g_hash_table_replace(jabber_conn.requests, request->id, request);
+    xmpp_id_handler_add(jabber_conn.conn, _connection_request_handler, request->id, request);
+}
+
+gint64
+connection_last_received(void)
+{
+    return jabber_conn.last_received;
+}
+
+// the server has stopped answering, rather than wait for TCP to notice the
+// connection is dropped to be handled as lost and reconnected straight away
+void
+connection_lost(void)
+{
+    if (jabber_conn.conn_status != JABBER_CONNECTED) {
+        return;
+    }
+
+    log_warning("Server not responding, dropping connection");
+    reconnect_now = TRUE;
+    xmpp_disconnect(jabber_conn.conn);
+}
+
+// called periodically from the main loop, gives up on requests that have
+// waited too long so their handlers and userdata do not stay for the rest
+// of the session
+void
+jabber_expire_requests(void)
+{
+    if (jabber_conn.requests == NULL || g_hash_table_size(jabber_conn.requests) == 0) {
+        return;
+    }
+
+    // on_timeout may send new requests, so they are collected first
+    gint64 now = g_get_monotonic_time();
+    GSList *expired = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, jabber_conn.requests);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ConnectionRequest *request = value;
+        if (now - request->sent >= (gint64)request->type->timeout * G_USEC_PER_SEC) {
+            g_hash_table_iter_steal(&iter);
+            expired = g_slist_prepend(expired, request);
+        }
+    }
+
+    GSList *curr = expired;
+    while (curr) {
+        ConnectionRequest *request = curr->data;
+        log_debug("Request %s timed out after %d seconds", request->id, request->type->timeout);
+        if (jabber_conn.conn) {
+            xmpp_id_handler_delete(jabber_conn.conn, _connection_request_handler, request->id);
+        }
+        if (request->type->on_timeout) {
+            request->type->on_timeout(request->userdata);
+        }
+        if (request->type->free_userdata) {
+            request->type->free_userdata(request->userdata);
+        }
+        _connection_request_free(request);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(expired);
+}
+
+static int
+_connection_request_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    ConnectionRequest *request = userdata;
+    stats_record(request->type->stat, request->sent);
+
+    // the handler may disconnect, which frees the request
+    char *id = strdup(request->id);
+    int result = request->type->handler(conn, stanza, request->userdata);
+    if (result == 0) {
+        g_hash_table_remove(jabber_conn.requests, id);
+    }
+    free(id);
+
+    return result;
+}
+
+static void
+_connection_request_free(ConnectionRequest *request)
+{
+    free(request->id);
+    free(request);
+}
+
+// the connection is going, its handlers go with it
+static void
+_connection_requests_clear(void)
+{
+    if (jabber_conn.requests == NULL) {
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, jabber_conn.requests);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ConnectionRequest *request = value;
+        if (jabber_conn.conn) {
+            xmpp_id_handler_delete(jabber_conn.conn, _connection_request_handler, request->id);
+        }
+        if (request->type->free_userdata) {
+            request->type->free_userdata(request->userdata);
+        }
+    }
+    g_hash_table_remove_all(jabber_conn.requests);
+}
+
+// stanzas are queued and written together once per main loop iteration,
+// so bursts such as pasted lines or room autojoin share writes
+void
+connection_send(xmpp_stanza_t *const stanza)
+{
+    _connection_queue(stanza);
+    stream_mgmt_sent(stanza);
+}
+
+// for latency sensitive stanzas such as pings, anything queued before is
+// written first to keep the stream in order
+void
+connection_send_priority(xmpp_stanza_t *const stanza)
+{
+    connection_flush();
+    _connection_count_sent(stanza);
+    xmpp_send(jabber_conn.conn, stanza);
+    stream_mgmt_sent(stanza);
+}
+
+// stream level elements not counted by stream management
+void
+connection_send_nonza(xmpp_stanza_t *const stanza)
+{
+    _connection_queue(stanza);
+}
+
+// a stanza written by one of the stanza_text functions, it is counted with
+// the name, type, namespace and recipient it was written with
+void
+connection_send_text(const char *const text, const char *const name, const char *const type,
+    const char *const ns, const char *const to)
+{
+    size_t len = strlen(text);
+    traffic_record(TRAFFIC_SENT, name, type, ns, to, len);
+    g_string_append_len(jabber_conn.send_queue, text, len);
+    stream_mgmt_sent_text(name, text);
+    if (jabber_conn.send_queue->len >= SEND_QUEUE_FLUSH_SIZE) {
+        connection_flush();
+    }
+}
+
+// libstrophe handles the features itself, they are only seen as text, see
+// _xmpp_file_logger
+gboolean
+connection_stream_feature(const char *const ns)
+{
+    if (!jabber_conn.stream_features) {
+        return FALSE;
+    }
+
+    char *quoted = g_strdup_printf("xmlns=\"%s\"", ns);
+    char *single = g_strdup_printf("xmlns='%s'", ns);
+    gboolean found = (strstr(jabber_conn.stream_features, quoted) != NULL) ||
+        (strstr(jabber_conn.stream_features, single) != NULL);
+    g_free(quoted);
+    g_free(single);
+
+    return found;
+}
+
+void
+connection_send_raw(const char *const text)
+{
+    traffic_record_text(TRAFFIC_SENT, text, strlen(text));
+    g_string_append(jabber_conn.send_queue, text);
+    if (jabber_conn.send_queue->len >= SEND_QUEUE_FLUSH_SIZE) {
+        connection_flush();
+    }
+}
+
+void
+connection_flush(void)
+{
+    if (jabber_conn.send_queue == NULL || jabber_conn.send_queue->len == 0) {
+        return;
+    }
+
+    if (jabber_conn.conn) {
+        xmpp_send_raw(jabber_conn.conn, jabber_conn.send_queue->str, jabber_conn.send_queue->len);
+    }
+    g_string_truncate(jabber_conn.send_queue, 0);
+}
+
 void
 connection_remove_available_resource(const char *const resource)
 {
     g_hash_table_remove(available_resources, resource);
 }
 
+static void
+_connection_count_text(xmpp_stanza_t *const stanza, size_t len)
+{
+    xmpp_stanza_t *child = xmpp_stanza_get_children(stanza);
+    traffic_record(TRAFFIC_SENT, xmpp_stanza_get_name(stanza), xmpp_stanza_get_type(stanza),
+        child ? xmpp_stanza_get_ns(child) : NULL, xmpp_stanza_get_to(stanza), len);
+}
+
+// stanzas sent directly are only serialised to count them
+static void
+_connection_count_sent(xmpp_stanza_t *const stanza)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    if (xmpp_stanza_to_text(stanza, &buf, &len) == XMPP_EOK) {
+        _connection_count_text(stanza, len);
+        xmpp_free(jabber_conn.ctx, buf);
+    }
+}
+
+static void
+_connection_queue(xmpp_stanza_t *const stanza)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    if (xmpp_stanza_to_text(stanza, &buf, &len) != XMPP_EOK) {
+        log_error("Failed to serialise stanza for sending");
+        return;
+    }
+
+    _connection_count_text(stanza, len);
+    g_string_append_len(jabber_conn.send_queue, buf, len);
+    xmpp_free(jabber_conn.ctx, buf);
+    if (jabber_conn.send_queue->len >= SEND_QUEUE_FLUSH_SIZE) {
+        connection_flush();
+    }
+}
+
 void
 _connection_free_saved_account(void)
 {
     FREE_SET_NULL(saved_account.name);
-    FREE_SET_NULL(saved_account.passwd);
+    _connection_passwd_free(saved_account.passwd);
+    saved_account.passwd = NULL;
+}
+
+// the password is kept for reconnecting without asking, or running an
+// eval_password command, again, locked in memory so it is never swapped out
+static char*
+_connection_passwd_new(const char *const passwd)
+{
+    size_t len = strlen(passwd) + 1;
+    char *copy = malloc(len);
+    memcpy(copy, passwd, len);
+    if (mlock(copy, len) != 0) {
+        log_debug("Could not lock the saved password in memory");
+    }
+
+    return copy;
+}
+
+static void
+_connection_passwd_free(char *passwd)
+{
+    if (passwd == NULL) {
+        return;
+    }
+
+    size_t len = strlen(passwd) + 1;
+    volatile char *p = passwd;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        p[i] = '\0';
+    }
+    munlock(passwd, len);
+    free(passwd);
 }
 
 void
@@ -370,7 +1088,8 @@ _connection_free_saved_details(void)
 {
     FREE_SET_NULL(saved_details.name);
     FREE_SET_NULL(saved_details.jid);
-    FREE_SET_NULL(saved_details.passwd);
+    _connection_passwd_free(saved_details.passwd);
+    saved_details.passwd = NULL;
     FREE_SET_NULL(saved_details.altdomain);
     FREE_SET_NULL(saved_details.tls_policy);
 }
@@ -381,6 +1100,16 @@ _connection_free_session_data(void)
     g_hash_table_remove_all(available_resources);
     chat_sessions_clear();
     presence_clear_sub_requests();
+    rostercache_on_disconnect();
+    bookmarkcache_on_disconnect();
+    mam_clear();
+    http_upload_clear();
+    _connection_requests_clear();
+    if (jabber_conn.send_queue) {
+        g_string_truncate(jabber_conn.send_queue, 0);
+    }
+    g_free(jabber_conn.stream_features);
+    jabber_conn.stream_features = NULL;
 }
 
 #ifdef HAVE_LIBMESODE
@@ -466,6 +1195,8 @@ _jabber_connect(const char *const fulljid, const char *const passwd, const char
     }
     jabber_conn.log = _xmpp_get_file_logger();
 
+    // stanzas still waiting belong to the old context
+    _connection_deferred_clear(NULL);
     if (jabber_conn.conn) {
         xmpp_conn_release(jabber_conn.conn);
     }
@@ -491,6 +1222,17 @@ _jabber_connect(const char *const fulljid, const char *const passwd, const char
         xmpp_conn_set_flags(jabber_conn.conn, XMPP_CONN_FLAG_DISABLE_TLS);
     }
 
+    // only accounts can ask for compression, libstrophe negotiates it
+    // after authentication when the server offers zlib
+    if (saved_account.name && accounts_get_compression(saved_account.name)) {
+#ifdef XMPP_CONN_FLAG_ENABLE_COMPRESSION
+        long flags = xmpp_conn_get_flags(jabber_conn.conn);
+        xmpp_conn_set_flags(jabber_conn.conn, flags | XMPP_CONN_FLAG_ENABLE_COMPRESSION);
+#else
+        log_warning("Stream compression requested but not supported by this libstrophe");
+#endif
+    }
+
 #ifdef HAVE_LIBMESODE
     char *cert_path = prefs_get_string(PREF_TLS_CERTPATH);
     if (cert_path) {
@@ -498,10 +1240,28 @@ _jabber_connect(const char *const fulljid, const char *const passwd, const char
     }
 #endif
 
+    // without a configured server, pick the SRV target that answers
+    // first rather than waiting on a slow one, the race runs off the main
+    // thread and the connection is made when it is done
+    if (!altdomain && (port == 0)) {
+        Jid *jidp = jid_create(fulljid);
+        jabber_conn.conn_status = JABBER_CONNECTING;
+        srv_race_start(jidp->domainpart, _connection_srv_raced);
+        jid_destroy(jidp);
+
+        return jabber_conn.conn_status;
+    }
+
+    return _connection_connect_client(altdomain, port);
+}
+
+static jabber_conn_status_t
+_connection_connect_client(const char *const host, int port)
+{
 #ifdef HAVE_LIBMESODE
     int connect_status = xmpp_connect_client(
         jabber_conn.conn,
-        altdomain,
+        host,
         port,
         _connection_certfail_cb,
         _connection_handler,
@@ -509,7 +1269,7 @@ _jabber_connect(const char *const fulljid, const char *const passwd, const char
 #else
     int connect_status = xmpp_connect_client(
         jabber_conn.conn,
-        altdomain,
+        host,
         port,
         _connection_handler,
         jabber_conn.ctx);
@@ -524,6 +1284,20 @@ _jabber_connect(const char *const fulljid, const char *const passwd, const char
     return jabber_conn.conn_status;
 }
 
+// a NULL host leaves finding the server to libstrophe
+static void
+_connection_srv_raced(const char *const host, int port)
+{
+    if (jabber_conn.conn_status != JABBER_CONNECTING) {
+        return;
+    }
+
+    if (_connection_connect_client(host, port) == JABBER_DISCONNECTED) {
+        log_debug("Connection attempt after SRV race failed");
+        _connection_login_failed();
+    }
+}
+
 static void
 _jabber_reconnect(void)
 {
@@ -548,10 +1322,22 @@ _connection_handler(xmpp_conn_t *const conn, const xmpp_conn_event_t status, con
     // login success
     if (status == XMPP_CONN_CONNECT) {
         log_debug("Connection handler: XMPP_CONN_CONNECT");
+        traffic_reset();
         jabber_conn.conn_status = JABBER_CONNECTED;
+        jabber_conn.client_active = TRUE;
+        jabber_conn.last_received = g_get_monotonic_time();
+        reconnect_now = FALSE;
+
+        jid_destroy(jabber_conn.jid);
+        jabber_conn.jid = jid_create(jabber_get_fulljid());
 
         int secured = xmpp_conn_is_secured(jabber_conn.conn);
 
+        // enabled before the login events send the initial presence and
+        // flush the outbox, so those are counted and resent if dropped
+        stream_mgmt_add_handlers();
+        stream_mgmt_enable();
+
         // logged in with account
         if (saved_account.name) {
             log_debug("Connection handler: logged in with account name: %s", saved_account.name);
@@ -565,17 +1351,14 @@ _connection_handler(xmpp_conn_t *const conn, const xmpp_conn_event_t status, con
 
             sv_ev_login_account_success(saved_details.name, secured);
             saved_account.name = strdup(saved_details.name);
-            saved_account.passwd = strdup(saved_details.passwd);
+            saved_account.passwd = _connection_passwd_new(saved_details.passwd);
 
             _connection_free_saved_details();
         }
 
-        Jid *my_jid = jid_create(jabber_get_fulljid());
-        jabber_conn.domain = strdup(my_jid->domainpart);
-        jid_destroy(my_jid);
-
         chat_sessions_init();
 
+        _connection_handlers_clear();
         roster_add_handlers();
         message_add_handlers();
         presence_add_handlers();
@@ -600,6 +1383,7 @@ _connection_handler(xmpp_conn_t *const conn, const xmpp_conn_event_t status, con
         if (jabber_conn.conn_status == JABBER_CONNECTED) {
             log_debug("Connection handler: Lost connection for unknown reason");
             sv_ev_lost_connection();
+            stream_mgmt_disconnected();
             if (prefs_get_reconnect() != 0) {
                 assert(reconnect_timer == NULL);
                 reconnect_timer = g_timer_new();
@@ -609,25 +1393,13 @@ _connection_handler(xmpp_conn_t *const conn, const xmpp_conn_event_t status, con
                 _connection_free_saved_account();
                 _connection_free_saved_details();
                 _connection_free_session_data();
+                stream_mgmt_clear();
             }
 
         // login attempt failed
         } else if (jabber_conn.conn_status != JABBER_DISCONNECTING) {
             log_debug("Connection handler: Login failed");
-            if (reconnect_timer == NULL) {
-                log_debug("Connection handler: No reconnect timer");
-                sv_ev_failed_login();
-                _connection_free_saved_account();
-                _connection_free_saved_details();
-                _connection_free_session_data();
-            } else {
-                log_debug("Connection handler: Restarting reconnect timer");
-                if (prefs_get_reconnect() != 0) {
-                    g_timer_start(reconnect_timer);
-                }
-                // free resources but leave saved_user untouched
-                _connection_free_session_data();
-            }
+            _connection_login_failed();
         }
 
         // close stream response from server after disconnect is handled too
@@ -639,6 +1411,26 @@ _connection_handler(xmpp_conn_t *const conn, const xmpp_conn_event_t status, con
     }
 }
 
+static void
+_connection_login_failed(void)
+{
+    if (reconnect_timer == NULL) {
+        log_debug("Connection handler: No reconnect timer");
+        sv_ev_failed_login();
+        _connection_free_saved_account();
+        _connection_free_saved_details();
+        _connection_free_session_data();
+        stream_mgmt_clear();
+    } else {
+        log_debug("Connection handler: Restarting reconnect timer");
+        if (prefs_get_reconnect() != 0) {
+            g_timer_start(reconnect_timer);
+        }
+        // free resources but leave saved_user untouched
+        _connection_free_session_data();
+    }
+}
+
 static log_level_t
 _get_log_level(const xmpp_log_level_t xmpp_level)
 {
@@ -674,8 +1466,55 @@ _xmpp_file_logger(void *const userdata, const xmpp_log_level_t level, const char
 {
     log_level_t prof_level = _get_log_level(level);
     log_msg(prof_level, area, msg);
-    if ((g_strcmp0(area, "xmpp") == 0) || (g_strcmp0(area, "conn")) == 0) {
-        sv_ev_xmpp_stanza(msg);
+
+    // libstrophe logs every stanza it reads and writes, whatever the log
+    // level, it has no other way to see the text
+    if ((g_strcmp0(area, "xmpp") != 0) && (g_strcmp0(area, "conn") != 0)) {
+        return;
+    }
+    if (g_str_has_prefix(msg, "RECV: ")) {
+        jabber_conn.last_received = g_get_monotonic_time();
+        if (g_str_has_prefix(msg + 6, "<stream:features")) {
+            g_free(jabber_conn.stream_features);
+            jabber_conn.stream_features = g_strdup(msg + 6);
+        }
+        _connection_tap(TRAFFIC_RECEIVED, msg + 6);
+    } else if (g_str_has_prefix(msg, "SENT: ")) {
+        _connection_tap(TRAFFIC_SENT, msg + 6);
+    }
+}
+
+void
+jabber_tap_add(jabber_tap_t tap)
+{
+    if (!g_slist_find(taps, (gpointer)tap)) {
+        taps = g_slist_append(taps, (gpointer)tap);
+    }
+}
+
+void
+jabber_tap_remove(jabber_tap_t tap)
+{
+    taps = g_slist_remove(taps, (gpointer)tap);
+}
+
+static void
+_connection_tap(traffic_dir_t dir, const char *const text)
+{
+    GSList *curr = taps;
+    while (curr) {
+        jabber_tap_t tap = (jabber_tap_t)curr->data;
+        tap(dir, text);
+        curr = g_slist_next(curr);
+    }
+}
+
+// sent stanzas are counted as they are queued, see _connection_count_text
+static void
+_connection_traffic_tap(traffic_dir_t dir, const char *const text)
+{
+    if (dir == TRAFFIC_RECEIVED) {
+        traffic_record_text(TRAFFIC_RECEIVED, text, strlen(text));
     }
 }
 
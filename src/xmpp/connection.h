@@ -45,6 +45,53 @@
 #endif
 
 #include "resource.h"
+#include "tools/stats.h"
+
+// registered as a handler's userdata so its time is recorded against stat,
+// and traced under the statistic's name
+typedef struct timed_handler_t {
+    xmpp_handler handler;
+    stats_t stat;
+} TimedHandler;
+
+int connection_timed_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+
+// how a request waits for its result, the handler frees the userdata it is
+// given, unless no result arrives within timeout seconds, then on_timeout,
+// if any, is called and free_userdata, if any, frees it, the time to the
+// result is recorded against stat
+typedef struct request_type_t {
+    xmpp_handler handler;
+    stats_t stat;
+    int timeout;
+    void (*on_timeout)(void *const userdata);
+    GDestroyNotify free_userdata;
+} RequestType;
+
+void connection_request_add(const char *const id, const RequestType *const type, void *const userdata);
+
+// when a stanza was last read, from g_get_monotonic_time
+gint64 connection_last_received(void);
+void connection_lost(void);
+
+// stanza handlers added here are also kept so the benchmark replay can fire
+// them without a stream, label names the handler in its report
+typedef struct connection_handler_t {
+    xmpp_handler handler;
+    char *ns;
+    char *name;
+    char *type;
+    void *userdata;
+    const char *label;
+    // returned 0 after being run late, gone from libstrophe at its next stanza
+    gboolean removed;
+} ConnectionHandler;
+
+void connection_handler_add(xmpp_handler handler, const char *const ns, const char *const name, const char *const type,
+    void *const userdata, const char *const label);
+GSList* connection_get_handlers(void);
+void connection_watchdog_check(const char *const handler, xmpp_stanza_t *const stanza, gint64 start);
+void connection_handler_remove(ConnectionHandler *handler);
 
 xmpp_conn_t* connection_get_conn(void);
 xmpp_ctx_t* connection_get_ctx(void);
@@ -52,5 +99,13 @@ void connection_set_priority(int priority);
 void connection_set_presence_message(const char *const message);
 void connection_add_available_resource(Resource *resource);
 void connection_remove_available_resource(const char *const resource);
+void connection_send(xmpp_stanza_t *const stanza);
+void connection_send_priority(xmpp_stanza_t *const stanza);
+void connection_send_nonza(xmpp_stanza_t *const stanza);
+void connection_send_text(const char *const text, const char *const name, const char *const type,
+    const char *const ns, const char *const to);
+void connection_send_raw(const char *const text);
+void connection_flush(void);
+gboolean connection_stream_feature(const char *const ns);
 
 #endif
@@ -88,6 +88,8 @@ _form_new(void)
     form->fields = NULL;
     form->var_to_tag = NULL;
     form->tag_to_var = NULL;
+    form->tag_to_field = NULL;
+    form->sorted_fields = NULL;
     form->tag_ac = NULL;
 
     return form;
@@ -184,6 +186,45 @@ _get_field_type(const char *const type)
     return FIELD_UNKNOWN;
 }
 
+// maps each tag to its field, so lookups by tag need not walk the fields
+static void
+_form_index_fields(DataForm *form)
+{
+    form->tag_to_field = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    GHashTable *var_to_field = g_hash_table_new(g_str_hash, g_str_equal);
+    GSList *curr = form->fields;
+    while (curr) {
+        FormField *field = curr->data;
+        if (field->var && !g_hash_table_contains(var_to_field, field->var)) {
+            g_hash_table_insert(var_to_field, field->var, field);
+        }
+        curr = g_slist_next(curr);
+    }
+
+    GHashTableIter iter;
+    gpointer tag, var;
+    g_hash_table_iter_init(&iter, form->tag_to_var);
+    while (g_hash_table_iter_next(&iter, &tag, &var)) {
+        FormField *field = g_hash_table_lookup(var_to_field, var);
+        if (field) {
+            g_hash_table_insert(form->tag_to_field, strdup(tag), field);
+        }
+    }
+
+    g_hash_table_destroy(var_to_field);
+}
+
+static FormField*
+_form_get_field(DataForm *form, const char *const tag)
+{
+    if (form->tag_to_field == NULL) {
+        _form_index_fields(form);
+    }
+
+    return g_hash_table_lookup(form->tag_to_field, tag);
+}
+
 DataForm*
 form_create(xmpp_stanza_t *const form_stanza)
 {
@@ -278,6 +319,8 @@ form_create(xmpp_stanza_t *const form_stanza)
         form_child = xmpp_stanza_get_next(form_child);
     }
 
+    _form_index_fields(form);
+
     return form;
 }
 
@@ -397,6 +440,10 @@ form_destroy(DataForm *form)
         g_slist_free_full(form->fields, (GDestroyNotify)_free_field);
         g_hash_table_destroy(form->var_to_tag);
         g_hash_table_destroy(form->tag_to_var);
+        if (form->tag_to_field) {
+            g_hash_table_destroy(form->tag_to_field);
+        }
+        g_slist_free(form->sorted_fields);
         autocomplete_free(form->tag_ac);
         free(form);
     }
@@ -408,20 +455,26 @@ _field_compare_by_var(FormField *a, FormField *b)
     return g_strcmp0(a->var, b->var);
 }
 
+// sorted once and kept by the form, fields are never added or removed
+// after the form is created
 GSList*
 form_get_non_form_type_fields_sorted(DataForm *form)
 {
-    GSList *sorted = NULL;
+    if (form->sorted_fields) {
+        return form->sorted_fields;
+    }
+
     GSList *curr = form->fields;
     while (curr) {
         FormField *field = curr->data;
         if (g_strcmp0(field->var, "FORM_TYPE") != 0) {
-            sorted = g_slist_insert_sorted(sorted, field, (GCompareFunc)_field_compare_by_var);
+            form->sorted_fields = g_slist_prepend(form->sorted_fields, field);
         }
         curr = g_slist_next(curr);
     }
+    form->sorted_fields = g_slist_sort(form->sorted_fields, (GCompareFunc)_field_compare_by_var);
 
-    return sorted;
+    return form->sorted_fields;
 }
 
 GSList*
@@ -458,32 +511,15 @@ form_get_form_type_field(DataForm *form)
 gboolean
 form_tag_exists(DataForm *form, const char *const tag)
 {
-    GList *tags = g_hash_table_get_keys(form->tag_to_var);
-    GList *curr = tags;
-    while (curr) {
-        if (g_strcmp0(curr->data, tag) == 0) {
-            return TRUE;
-        }
-        curr = g_list_next(curr);
-    }
-
-    g_list_free(tags);
-    return FALSE;
+    return g_hash_table_contains(form->tag_to_var, tag);
 }
 
 form_field_type_t
 form_get_field_type(DataForm *form, const char *const tag)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field->type_t;
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        return field->type_t;
     }
     return FIELD_UNKNOWN;
 }
@@ -491,24 +527,17 @@ form_get_field_type(DataForm *form, const char *const tag)
 void
 form_set_value(DataForm *form, const char *const tag, char *value)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                if (g_slist_length(field->values) == 0) {
-                    field->values = g_slist_append(field->values, strdup(value));
-                    form->modified = TRUE;
-                    return;
-                } else if (g_slist_length(field->values) == 1) {
-                    free(field->values->data);
-                    field->values->data = strdup(value);
-                    form->modified = TRUE;
-                    return;
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        if (g_slist_length(field->values) == 0) {
+            field->values = g_slist_append(field->values, strdup(value));
+            form->modified = TRUE;
+            return;
+        } else if (g_slist_length(field->values) == 1) {
+            free(field->values->data);
+            field->values->data = strdup(value);
+            form->modified = TRUE;
+            return;
         }
     }
 }
@@ -516,54 +545,39 @@ form_set_value(DataForm *form, const char *const tag, char *value)
 void
 form_add_value(DataForm *form, const char *const tag, char *value)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                field->values = g_slist_append(field->values, strdup(value));
-                if (field->type_t == FIELD_TEXT_MULTI) {
-                    int total = g_slist_length(field->values);
-                    GString *value_index = g_string_new("");
-                    g_string_printf(value_index, "val%d", total);
-                    autocomplete_add(field->value_ac, value_index->str);
-                    g_string_free(value_index, TRUE);
-                }
-                form->modified = TRUE;
-                return;
-            }
-            curr = g_slist_next(curr);
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        field->values = g_slist_append(field->values, strdup(value));
+        if (field->type_t == FIELD_TEXT_MULTI) {
+            int total = g_slist_length(field->values);
+            GString *value_index = g_string_new("");
+            g_string_printf(value_index, "val%d", total);
+            autocomplete_add(field->value_ac, value_index->str);
+            g_string_free(value_index, TRUE);
         }
+        form->modified = TRUE;
     }
 }
 
 gboolean
 form_add_unique_value(DataForm *form, const char *const tag, char *value)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList *curr_value = field->values;
-                while (curr_value) {
-                    if (g_strcmp0(curr_value->data, value) == 0) {
-                        return FALSE;
-                    }
-                    curr_value = g_slist_next(curr_value);
-                }
-
-                field->values = g_slist_append(field->values, strdup(value));
-                if (field->type_t == FIELD_JID_MULTI) {
-                    autocomplete_add(field->value_ac, value);
-                }
-                form->modified = TRUE;
-                return TRUE;
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        GSList *curr_value = field->values;
+        while (curr_value) {
+            if (g_strcmp0(curr_value->data, value) == 0) {
+                return FALSE;
             }
-            curr = g_slist_next(curr);
+            curr_value = g_slist_next(curr_value);
         }
+
+        field->values = g_slist_append(field->values, strdup(value));
+        if (field->type_t == FIELD_JID_MULTI) {
+            autocomplete_add(field->value_ac, value);
+        }
+        form->modified = TRUE;
+        return TRUE;
     }
 
     return FALSE;
@@ -572,27 +586,20 @@ form_add_unique_value(DataForm *form, const char *const tag, char *value)
 gboolean
 form_remove_value(DataForm *form, const char *const tag, char *value)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList *found = g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0);
-                if (found) {
-                    free(found->data);
-                    found->data = NULL;
-                    field->values = g_slist_delete_link(field->values, found);
-                    if (field->type_t == FIELD_JID_MULTI) {
-                        autocomplete_remove(field->value_ac, value);
-                    }
-                    form->modified = TRUE;
-                    return TRUE;
-                } else {
-                    return FALSE;
-                }
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        GSList *found = g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0);
+        if (found) {
+            free(found->data);
+            found->data = NULL;
+            field->values = g_slist_delete_link(field->values, found);
+            if (field->type_t == FIELD_JID_MULTI) {
+                autocomplete_remove(field->value_ac, value);
             }
-            curr = g_slist_next(curr);
+            form->modified = TRUE;
+            return TRUE;
+        } else {
+            return FALSE;
         }
     }
 
@@ -603,28 +610,21 @@ gboolean
 form_remove_text_multi_value(DataForm *form, const char *const tag, int index)
 {
     index--;
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList *item = g_slist_nth(field->values, index);
-                if (item) {
-                    free(item->data);
-                    item->data = NULL;
-                    field->values = g_slist_delete_link(field->values, item);
-                    GString *value_index = g_string_new("");
-                    g_string_printf(value_index, "val%d", index+1);
-                    autocomplete_remove(field->value_ac, value_index->str);
-                    g_string_free(value_index, TRUE);
-                    form->modified = TRUE;
-                    return TRUE;
-                } else {
-                    return FALSE;
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        GSList *item = g_slist_nth(field->values, index);
+        if (item) {
+            free(item->data);
+            item->data = NULL;
+            field->values = g_slist_delete_link(field->values, item);
+            GString *value_index = g_string_new("");
+            g_string_printf(value_index, "val%d", index+1);
+            autocomplete_remove(field->value_ac, value_index->str);
+            g_string_free(value_index, TRUE);
+            form->modified = TRUE;
+            return TRUE;
+        } else {
+            return FALSE;
         }
     }
 
@@ -634,19 +634,12 @@ form_remove_text_multi_value(DataForm *form, const char *const tag, int index)
 int
 form_get_value_count(DataForm *form, const char *const tag)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                if ((g_slist_length(field->values) == 1) && (field->values->data == NULL)) {
-                    return 0;
-                } else {
-                    return g_slist_length(field->values);
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        if ((g_slist_length(field->values) == 1) && (field->values->data == NULL)) {
+            return 0;
+        } else {
+            return g_slist_length(field->values);
         }
     }
 
@@ -656,22 +649,15 @@ form_get_value_count(DataForm *form, const char *const tag)
 gboolean
 form_field_contains_option(DataForm *form, const char *const tag, char *value)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList *curr_option = field->options;
-                while (curr_option) {
-                    FormOption *option = curr_option->data;
-                    if (g_strcmp0(option->value, value) == 0) {
-                        return TRUE;
-                    }
-                    curr_option = g_slist_next(curr_option);
-                }
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        GSList *curr_option = field->options;
+        while (curr_option) {
+            FormOption *option = curr_option->data;
+            if (g_strcmp0(option->value, value) == 0) {
+                return TRUE;
             }
-            curr = g_slist_next(curr);
+            curr_option = g_slist_next(curr_option);
         }
     }
 
@@ -681,33 +667,15 @@ form_field_contains_option(DataForm *form, const char *const tag, char *value)
 FormField*
 form_get_field_by_tag(DataForm *form, const char *const tag)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field;
-            }
-            curr = g_slist_next(curr);
-        }
-    }
-    return NULL;
+    return _form_get_field(form, tag);
 }
 
 Autocomplete
 form_get_value_ac(DataForm *form, const char *const tag)
 {
-    char *var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList *curr = form->fields;
-        while (curr) {
-            FormField *field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field->value_ac;
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField *field = _form_get_field(form, tag);
+    if (field) {
+        return field->value_ac;
     }
     return NULL;
 }
@@ -0,0 +1,513 @@
+/*
+ * http_upload.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_LIBMESODE
+#include <mesode.h>
+#endif
+#ifdef HAVE_LIBSTROPHE
+#include <strophe.h>
+#endif
+
+#include "common.h"
+#include "jid.h"
+#include "log.h"
+#include "ui/ui.h"
+#include "tools/http.h"
+#include "xmpp/connection.h"
+#include "xmpp/http_upload.h"
+#include "xmpp/stanza.h"
+#include "xmpp/xmpp.h"
+
+#define HTTP_UPLOAD_IQ_TIMEOUT 60
+#define HTTP_UPLOAD_DISCO_ITEMS 100
+
+typedef enum {
+    UPLOAD_DISCOVERING,
+    UPLOAD_REQUESTING,
+    UPLOAD_SENDING
+} upload_state_t;
+
+// a file on its way, waiting for the service to be found, then for a
+// slot, then being put
+typedef struct http_upload_t {
+    char *path;
+    char *filename;
+    goffset size;
+    gint64 sent;
+    char *get_url;
+    upload_state_t state;
+    http_upload_callback callback;
+    void *userdata;
+} HttpUpload;
+
+typedef enum {
+    DISCOVERY_NONE,
+    DISCOVERY_RUNNING,
+    DISCOVERY_DONE
+} discovery_state_t;
+
+// the upload service is looked for once per connection, on the domain and
+// the items it lists, max_size is 0 when the service gives no limit
+static discovery_state_t discovery = DISCOVERY_NONE;
+static int discovery_pending = 0;
+static char *service = NULL;
+static goffset max_size = 0;
+
+static GSList *uploads = NULL;
+static int progress_shown = -1;
+
+static int _upload_disco_items_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _upload_disco_info_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _upload_slot_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static void _upload_discovery_timeout(void *const userdata);
+static void _upload_slot_timeout(void *const userdata);
+static void _upload_discover(const char *const domain);
+static void _upload_disco_info_send(const char *const jid);
+static void _upload_discovery_step(void);
+static void _upload_request_slot(HttpUpload *upload);
+static void _upload_progress(gint64 sent, gint64 total, void *userdata);
+static void _upload_put_done(const char *const body, void *userdata);
+static void _upload_show_progress(void);
+static goffset _upload_max_size(xmpp_stanza_t *const query);
+static GSList* _upload_slot_headers(xmpp_stanza_t *const put);
+static void _upload_done(HttpUpload *upload, const char *const url, const char *const error);
+static void _upload_free(HttpUpload *upload);
+
+static const RequestType disco_items_request = { _upload_disco_items_handler, STATS_IQ_RTT_DISCO,
+    HTTP_UPLOAD_IQ_TIMEOUT, _upload_discovery_timeout, NULL };
+static const RequestType disco_info_request = { _upload_disco_info_handler, STATS_IQ_RTT_DISCO,
+    HTTP_UPLOAD_IQ_TIMEOUT, _upload_discovery_timeout, NULL };
+static const RequestType slot_request = { _upload_slot_handler, STATS_IQ_RTT_UPLOAD,
+    HTTP_UPLOAD_IQ_TIMEOUT, _upload_slot_timeout, NULL };
+
+// the callback is run once, from the main loop, with the url the file can
+// be fetched from, or NULL and why the upload failed
+void
+http_upload_file(const char *const path, http_upload_callback callback, void *userdata)
+{
+    HttpUpload *upload = malloc(sizeof(HttpUpload));
+    upload->path = strdup(path);
+    upload->filename = g_path_get_basename(path);
+    upload->size = 0;
+    upload->sent = 0;
+    upload->get_url = NULL;
+    upload->state = UPLOAD_DISCOVERING;
+    upload->callback = callback;
+    upload->userdata = userdata;
+    uploads = g_slist_append(uploads, upload);
+
+    GStatBuf st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        _upload_done(upload, NULL, "Not a file");
+        return;
+    }
+    upload->size = st.st_size;
+
+    if (service) {
+        _upload_request_slot(upload);
+    } else if (discovery == DISCOVERY_DONE) {
+        _upload_done(upload, NULL, "Server does not support HTTP File Upload");
+    } else if (discovery == DISCOVERY_NONE) {
+        const Jid *jid = jabber_get_jid();
+        if (jid == NULL) {
+            _upload_done(upload, NULL, "Not connected");
+            return;
+        }
+        _upload_discover(jid->domainpart);
+    }
+}
+
+// the connection is going, uploads still waiting on the server fail, those
+// already being put carry on
+void
+http_upload_clear(void)
+{
+    GSList *waiting = NULL;
+    GSList *curr = uploads;
+    while (curr) {
+        HttpUpload *upload = curr->data;
+        if (upload->state != UPLOAD_SENDING) {
+            waiting = g_slist_append(waiting, upload);
+        }
+        curr = g_slist_next(curr);
+    }
+
+    curr = waiting;
+    while (curr) {
+        _upload_done(curr->data, NULL, "Disconnected");
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(waiting);
+
+    discovery = DISCOVERY_NONE;
+    discovery_pending = 0;
+    FREE_SET_NULL(service);
+    max_size = 0;
+}
+
+static void
+_upload_discover(const char *const domain)
+{
+    log_debug("Looking for an HTTP File Upload service on %s", domain);
+    discovery = DISCOVERY_RUNNING;
+
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+    char *id = create_unique_id("upload_disco_items");
+    xmpp_stanza_t *iq = stanza_create_disco_items_iq(ctx, id, domain, HTTP_UPLOAD_DISCO_ITEMS, NULL);
+    connection_request_add(id, &disco_items_request, NULL);
+    discovery_pending++;
+    connection_send(iq);
+    xmpp_stanza_release(iq);
+    free(id);
+
+    _upload_disco_info_send(domain);
+}
+
+static void
+_upload_disco_info_send(const char *const jid)
+{
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+    char *id = create_unique_id("upload_disco_info");
+    xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, jid, NULL);
+    connection_request_add(id, &disco_info_request, NULL);
+    discovery_pending++;
+    connection_send(iq);
+    xmpp_stanza_release(iq);
+    free(id);
+}
+
+static int
+_upload_disco_items_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    xmpp_stanza_t *query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    if (query && g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_ERROR) != 0) {
+        xmpp_stanza_t *child = xmpp_stanza_get_children(query);
+        while (child) {
+            const char *jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
+            if (jid && (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_ITEM) == 0)) {
+                _upload_disco_info_send(jid);
+            }
+            child = xmpp_stanza_get_next(child);
+        }
+    }
+
+    _upload_discovery_step();
+
+    return 0;
+}
+
+static int
+_upload_disco_info_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    const char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
+    xmpp_stanza_t *query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+
+    if (service == NULL && from && query && g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_ERROR) != 0) {
+        xmpp_stanza_t *child = xmpp_stanza_get_children(query);
+        while (child) {
+            const char *var = xmpp_stanza_get_attribute(child, STANZA_ATTR_VAR);
+            if ((g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_FEATURE) == 0) &&
+                    (g_strcmp0(var, STANZA_NS_HTTP_UPLOAD) == 0)) {
+                service = strdup(from);
+                max_size = _upload_max_size(query);
+                log_info("Using HTTP File Upload service %s", service);
+                break;
+            }
+            child = xmpp_stanza_get_next(child);
+        }
+    }
+
+    _upload_discovery_step();
+
+    return 0;
+}
+
+static void
+_upload_discovery_timeout(void *const userdata)
+{
+    _upload_discovery_step();
+}
+
+// a discovery request is done, the waiting uploads go on as soon as a
+// service is found, or fail once every item has been asked
+static void
+_upload_discovery_step(void)
+{
+    discovery_pending--;
+    if (service == NULL && discovery_pending > 0) {
+        return;
+    }
+    if (discovery != DISCOVERY_DONE) {
+        discovery = DISCOVERY_DONE;
+        if (service == NULL) {
+            log_info("No HTTP File Upload service found");
+        }
+    }
+
+    GSList *waiting = NULL;
+    GSList *curr = uploads;
+    while (curr) {
+        HttpUpload *upload = curr->data;
+        if (upload->state == UPLOAD_DISCOVERING) {
+            waiting = g_slist_append(waiting, upload);
+        }
+        curr = g_slist_next(curr);
+    }
+
+    curr = waiting;
+    while (curr) {
+        if (service) {
+            _upload_request_slot(curr->data);
+        } else {
+            _upload_done(curr->data, NULL, "Server does not support HTTP File Upload");
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(waiting);
+}
+
+static void
+_upload_request_slot(HttpUpload *upload)
+{
+    if (max_size > 0 && upload->size > max_size) {
+        char *error = g_strdup_printf("File is larger than the server allows, %" G_GOFFSET_FORMAT " bytes",
+            max_size);
+        _upload_done(upload, NULL, error);
+        g_free(error);
+        return;
+    }
+
+    upload->state = UPLOAD_REQUESTING;
+
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+    char *id = create_unique_id("upload");
+    xmpp_stanza_t *iq = stanza_create_http_upload_request(ctx, id, service, upload->filename, upload->size);
+    connection_request_add(id, &slot_request, upload);
+    connection_send(iq);
+    xmpp_stanza_release(iq);
+    free(id);
+}
+
+static int
+_upload_slot_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    HttpUpload *upload = userdata;
+
+    if (g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_ERROR) == 0) {
+        char *error_message = stanza_get_error_message(stanza);
+        _upload_done(upload, NULL, error_message);
+        free(error_message);
+        return 0;
+    }
+
+    xmpp_stanza_t *slot = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_HTTP_UPLOAD);
+    xmpp_stanza_t *put = slot ? xmpp_stanza_get_child_by_name(slot, STANZA_NAME_PUT) : NULL;
+    xmpp_stanza_t *get = slot ? xmpp_stanza_get_child_by_name(slot, STANZA_NAME_GET) : NULL;
+    const char *put_url = put ? xmpp_stanza_get_attribute(put, STANZA_ATTR_URL) : NULL;
+    const char *get_url = get ? xmpp_stanza_get_attribute(get, STANZA_ATTR_URL) : NULL;
+    if (!put_url || !get_url) {
+        _upload_done(upload, NULL, "Server sent a bad upload slot");
+        return 0;
+    }
+
+    log_debug("Uploading %s to %s", upload->path, put_url);
+    upload->get_url = strdup(get_url);
+    upload->state = UPLOAD_SENDING;
+
+    GSList *headers = _upload_slot_headers(put);
+    gboolean started = http_put_file(put_url, upload->path, headers, _upload_progress, _upload_put_done, upload);
+    g_slist_free_full(headers, g_free);
+    if (!started) {
+        _upload_done(upload, NULL, "Couldn't read file");
+        return 0;
+    }
+
+    _upload_show_progress();
+
+    return 0;
+}
+
+static void
+_upload_slot_timeout(void *const userdata)
+{
+    _upload_done(userdata, NULL, "No upload slot from the server");
+}
+
+static void
+_upload_progress(gint64 sent, gint64 total, void *userdata)
+{
+    HttpUpload *upload = userdata;
+    if (sent != upload->sent) {
+        upload->sent = sent;
+        _upload_show_progress();
+    }
+}
+
+static void
+_upload_put_done(const char *const body, void *userdata)
+{
+    HttpUpload *upload = userdata;
+    if (body) {
+        _upload_done(upload, upload->get_url, NULL);
+    } else {
+        _upload_done(upload, NULL, "Upload failed");
+    }
+}
+
+// one line for all the files being put, only redrawn when the
+// percentage changes
+static void
+_upload_show_progress(void)
+{
+    int count = 0;
+    gint64 sent = 0;
+    gint64 total = 0;
+    HttpUpload *first = NULL;
+    GSList *curr = uploads;
+    while (curr) {
+        HttpUpload *upload = curr->data;
+        if (upload->state == UPLOAD_SENDING) {
+            if (first == NULL) {
+                first = upload;
+            }
+            count++;
+            sent += upload->sent;
+            total += upload->size;
+        }
+        curr = g_slist_next(curr);
+    }
+
+    if (count == 0) {
+        if (progress_shown != -1) {
+            progress_shown = -1;
+            ui_clear_progress();
+        }
+        return;
+    }
+
+    int percent = total > 0 ? (int)(sent * 100 / total) : 100;
+    if (percent == progress_shown) {
+        return;
+    }
+    progress_shown = percent;
+
+    char *msg = NULL;
+    if (count == 1) {
+        msg = g_strdup_printf("Uploading %s... %d%%", first->filename, percent);
+    } else {
+        msg = g_strdup_printf("Uploading %d files... %d%%", count, percent);
+    }
+    ui_show_progress(msg);
+    g_free(msg);
+}
+
+// the max-file-size field of the service's extended disco#info form
+static goffset
+_upload_max_size(xmpp_stanza_t *const query)
+{
+    xmpp_stanza_t *form = xmpp_stanza_get_child_by_ns(query, STANZA_NS_DATA);
+    xmpp_stanza_t *field = form ? xmpp_stanza_get_children(form) : NULL;
+    while (field) {
+        const char *var = xmpp_stanza_get_attribute(field, STANZA_ATTR_VAR);
+        if ((g_strcmp0(xmpp_stanza_get_name(field), STANZA_NAME_FIELD) == 0) &&
+                (g_strcmp0(var, "max-file-size") == 0)) {
+            xmpp_stanza_t *value = xmpp_stanza_get_child_by_name(field, STANZA_NAME_VALUE);
+            char *text = stanza_decoded_text(value, NULL);
+            goffset size = text ? g_ascii_strtoll(text, NULL, 10) : 0;
+            free(text);
+            return size > 0 ? size : 0;
+        }
+        field = xmpp_stanza_get_next(field);
+    }
+
+    return 0;
+}
+
+// only the headers the specification lets a slot set are sent, as
+// "Name: value" strings
+static GSList*
+_upload_slot_headers(xmpp_stanza_t *const put)
+{
+    GSList *headers = NULL;
+    xmpp_stanza_t *child = xmpp_stanza_get_children(put);
+    while (child) {
+        const char *name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
+        if ((g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_HEADER) == 0) && name &&
+                ((g_ascii_strcasecmp(name, "Authorization") == 0) ||
+                (g_ascii_strcasecmp(name, "Cookie") == 0) ||
+                (g_ascii_strcasecmp(name, "Expires") == 0))) {
+            char *value = stanza_decoded_text(child, NULL);
+            if (value && !strpbrk(value, "\r\n")) {
+                headers = g_slist_append(headers, g_strdup_printf("%s: %s", name, value));
+            }
+            free(value);
+        }
+        child = xmpp_stanza_get_next(child);
+    }
+
+    return headers;
+}
+
+static void
+_upload_done(HttpUpload *upload, const char *const url, const char *const error)
+{
+    uploads = g_slist_remove(uploads, upload);
+    if (error) {
+        log_info("Upload of %s failed: %s", upload->path, error);
+    }
+    if (upload->callback) {
+        upload->callback(upload->filename, url, error, upload->userdata);
+    }
+    _upload_free(upload);
+    _upload_show_progress();
+}
+
+static void
+_upload_free(HttpUpload *upload)
+{
+    free(upload->path);
+    g_free(upload->filename);
+    free(upload->get_url);
+    free(upload);
+}
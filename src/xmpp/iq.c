@@ -62,15 +62,88 @@
 #include "xmpp/stanza.h"
 #include "xmpp/form.h"
 #include "roster_list.h"
+#include "tools/request_queue.h"
+#include "tools/result_cache.h"
 #include "xmpp/xmpp.h"
 
-#define HANDLE(ns, type, func) xmpp_handler_add(conn, func, ns, STANZA_NAME_IQ, type, ctx)
+#define HANDLE(ns, type, func, stat) { \
+    static const TimedHandler timed = { func, stat }; \
+    connection_handler_add(connection_timed_handler, ns, STANZA_NAME_IQ, type, (void*)&timed, stats_name(stat)); \
+}
+
+// a request with no result after this many seconds is given up on
+#define IQ_REQUEST_TIMEOUT 60
+#define IQ_PING_TIMEOUT 30
+
+// an autoping waits for four round trips, within these bounds in seconds
+#define IQ_AUTOPING_MIN_TIMEOUT 5
+#define IQ_AUTOPING_RTTS 4
+// times the autoping interval is checked for idleness, so a ping goes out
+// soon after the connection has been quiet for the interval
+#define IQ_AUTOPING_CHECKS 4
+
+#define REQUEST(id, func, stat, free_func, userdata) { \
+    static const RequestType request = { func, stat, IQ_REQUEST_TIMEOUT, NULL, free_func }; \
+    connection_request_add(id, &request, userdata); \
+}
+
+// disco#items results are asked for a page at a time, and paging stops
+// once this many items have been shown
+#define IQ_DISCO_ITEMS_PAGE 100
+#define IQ_DISCO_ITEMS_MAX 1000
+
+// a complete room list is shown again from memory for this many seconds
+#define IQ_ROOM_LIST_TTL 60
+
+// software version and last activity queries, at most this many wait for
+// a result at once and the rest are queued, so many can be asked for
+#define IQ_QUERIES_PARALLEL 4
+// their results are shown again from memory for this many seconds
+#define IQ_QUERY_RESULT_TTL 300
+
+typedef enum {
+    QUERY_SOFTWARE_VERSION,
+    QUERY_LAST_ACTIVITY
+} iq_query_type_t;
+
+typedef struct iq_query_t {
+    iq_query_type_t type;
+    char *jid;
+} IqQuery;
+
+typedef struct iq_query_result_t {
+    char *name;
+    char *version;
+    char *os;
+    int seconds;
+    char *msg;
+} IqQueryResult;
+
+typedef struct disco_items_query_t {
+    char *jid;
+    gboolean rooms;
+    char *filter;
+    char *filter_key;
+    char *after;
+    GSList *items;
+    int shown;
+} DiscoItemsQuery;
+
+typedef struct room_list_t {
+    GSList *items;
+    gint64 fetched;
+} RoomList;
 
 typedef struct p_room_info_data_t {
     char *room;
     gboolean display;
 } ProfRoomInfoData;
 
+struct privilege_set_t {
+    char *item;
+    char *privilege;
+};
+
 static int _error_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _ping_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _version_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
@@ -92,8 +165,47 @@ static int _room_role_list_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t
 static int _room_kick_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _enable_carbons_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _disable_carbons_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _pong_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _manual_pong_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _ping_timed_handler(xmpp_conn_t *const conn, void *const userdata);
+static void _ping_timeout(void *const userdata);
+static void _manual_ping_timeout(void *const userdata);
+static void _room_info_data_free(ProfRoomInfoData *cb_data);
+static void _disco_items_query_free(DiscoItemsQuery *query);
+static void _iq_query_done(IqQuery *query);
+static void _iq_query_timeout(void *const userdata);
+static void _iq_query_free(IqQuery *query);
+static void _iq_query_send(IqQuery *query);
+static void _iq_query_result_free(IqQueryResult *result);
+static void _software_version_show(const char *const fulljid, const char *const name, const char *const version,
+    const char *const os);
+static void _disco_items_send(DiscoItemsQuery *query);
+static void _item_destroy(DiscoItem *item);
+static void _privilege_set_free(struct privilege_set_t *privilege_set);
+static void _autoping_start(int seconds);
+static int _autoping_timeout(void);
+
+// a ping is only sent once nothing has been received for the autoping
+// interval, and once enough in a row go unanswered the connection is
+// dropped, ping_sent is 0 when no autoping is waiting
+static gint64 ping_sent = 0;
+static gint64 ping_rtt = 0;
+static int pings_missed = 0;
+static RequestType autoping_request = { _pong_handler, STATS_IQ_RTT_PING, IQ_PING_TIMEOUT, _ping_timeout, NULL };
+
+// conference service jid to the RoomList last fetched from it
+static GHashTable *room_lists = NULL;
+
+static RequestQueue queries = NULL;
+static const RequestType version_request = { _version_result_handler, STATS_IQ_RTT_VERSION, IQ_REQUEST_TIMEOUT,
+    _iq_query_timeout, (GDestroyNotify)_iq_query_free };
+static const RequestType last_activity_request = { _last_activity_response_handler, STATS_IQ_RTT_LAST_ACTIVITY,
+    IQ_REQUEST_TIMEOUT, _iq_query_timeout, (GDestroyNotify)_iq_query_free };
+
+// full jid to the IqQueryResult of its software version, and any jid to
+// that of its last activity, both kept while the jid's caps are the same
+static ResultCache software_versions = NULL;
+static ResultCache last_activities = NULL;
 static int _caps_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _caps_response_handler_for_jid(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _caps_response_handler_legacy(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
@@ -101,119 +213,365 @@ static int _caps_response_handler_legacy(xmpp_conn_t *const conn, xmpp_stanza_t
 void
 iq_add_handlers(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
+    HANDLE(NULL,                    STANZA_TYPE_ERROR,  _error_handler,                 STATS_IQ_ERROR);
 
-    HANDLE(NULL,                    STANZA_TYPE_ERROR,  _error_handler);
+    HANDLE(XMPP_NS_DISCO_INFO,      STANZA_TYPE_GET,    _disco_info_get_handler,        STATS_IQ_DISCO_INFO_GET);
 
-    HANDLE(XMPP_NS_DISCO_INFO,      STANZA_TYPE_GET,    _disco_info_get_handler);
+    HANDLE(XMPP_NS_DISCO_ITEMS,     STANZA_TYPE_GET,    _disco_items_get_handler,       STATS_IQ_DISCO_ITEMS_GET);
 
-    HANDLE(XMPP_NS_DISCO_ITEMS,     STANZA_TYPE_GET,    _disco_items_get_handler);
-    HANDLE(XMPP_NS_DISCO_ITEMS,     STANZA_TYPE_RESULT, _disco_items_result_handler);
+    HANDLE(STANZA_NS_LASTACTIVITY,  STANZA_TYPE_GET,    _last_activity_get_handler,     STATS_IQ_LAST_ACTIVITY_GET);
 
-    HANDLE(STANZA_NS_LASTACTIVITY,  STANZA_TYPE_GET,    _last_activity_get_handler);
+    HANDLE(STANZA_NS_VERSION,       STANZA_TYPE_GET,    _version_get_handler,           STATS_IQ_VERSION_GET);
 
-    HANDLE(STANZA_NS_VERSION,       STANZA_TYPE_GET,    _version_get_handler);
+    HANDLE(STANZA_NS_PING,          STANZA_TYPE_GET,    _ping_get_handler,              STATS_IQ_PING_GET);
 
-    HANDLE(STANZA_NS_PING,          STANZA_TYPE_GET,    _ping_get_handler);
-
-    if (prefs_get_autoping() != 0) {
-        int millis = prefs_get_autoping() * 1000;
-        xmpp_timed_handler_add(conn, _ping_timed_handler, millis, ctx);
+    // room lists may differ once reconnected, perhaps as another user
+    if (room_lists) {
+        g_hash_table_remove_all(room_lists);
+    }
+    if (software_versions == NULL) {
+        software_versions = result_cache_new((gint64)IQ_QUERY_RESULT_TTL * G_USEC_PER_SEC,
+            (GDestroyNotify)_iq_query_result_free);
+        last_activities = result_cache_new((gint64)IQ_QUERY_RESULT_TTL * G_USEC_PER_SEC,
+            (GDestroyNotify)_iq_query_result_free);
+        queries = request_queue_new(IQ_QUERIES_PARALLEL, (GFunc)_iq_query_send, NULL,
+            (GDestroyNotify)_iq_query_free);
     }
+    result_cache_clear(software_versions);
+    result_cache_clear(last_activities);
+    request_queue_clear(queries);
+
+    // round trips are kept from the last connection, to the same server
+    ping_sent = 0;
+    pings_missed = 0;
+    _autoping_start(prefs_get_autoping());
 }
 
 void
 iq_set_autoping(const int seconds)
 {
     xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
 
     if (jabber_get_connection_status() == JABBER_CONNECTED) {
         xmpp_timed_handler_delete(conn, _ping_timed_handler);
+        _autoping_start(seconds);
+    }
+}
 
-        if (seconds != 0) {
-            int millis = seconds * 1000;
-            xmpp_timed_handler_add(conn, _ping_timed_handler, millis,
-                ctx);
-        }
+static void
+_autoping_start(int seconds)
+{
+    if (seconds != 0) {
+        int millis = MAX(1000, seconds * 1000 / IQ_AUTOPING_CHECKS);
+        xmpp_timed_handler_add(connection_get_conn(), _ping_timed_handler, millis, connection_get_ctx());
     }
 }
 
-void
-iq_room_list_request(gchar *conferencejid)
+// long enough for a few round trips, a server that has not answered
+// before is given the longest wait
+static int
+_autoping_timeout(void)
+{
+    if (ping_rtt == 0) {
+        return IQ_PING_TIMEOUT;
+    }
+
+    int timeout = (ping_rtt * IQ_AUTOPING_RTTS + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC;
+    return CLAMP(timeout, IQ_AUTOPING_MIN_TIMEOUT, IQ_PING_TIMEOUT);
+}
+
+static void
+_room_list_free(RoomList *room_list)
+{
+    g_slist_free_full(room_list->items, (GDestroyNotify)_item_destroy);
+    free(room_list);
+}
+
+// the casefolded filter is matched against the jid and the name
+static gboolean
+_disco_item_matches(DiscoItem *item, const char *const filter)
+{
+    if (filter == NULL) {
+        return TRUE;
+    }
+
+    gboolean matches = FALSE;
+    char *jid = g_utf8_casefold(item->jid, -1);
+    if (strstr(jid, filter)) {
+        matches = TRUE;
+    } else if (item->name) {
+        char *name = g_utf8_casefold(item->name, -1);
+        matches = strstr(name, filter) != NULL;
+        g_free(name);
+    }
+    g_free(jid);
+
+    return matches;
+}
+
+static DiscoItemsQuery*
+_disco_items_query_new(const char *const jid, gboolean rooms, const char *const filter)
+{
+    DiscoItemsQuery *query = malloc(sizeof(DiscoItemsQuery));
+    query->jid = strdup(jid);
+    query->rooms = rooms;
+    query->filter = filter ? strdup(filter) : NULL;
+    query->filter_key = filter ? g_utf8_casefold(filter, -1) : NULL;
+    query->after = NULL;
+    query->items = NULL;
+    query->shown = 0;
+
+    return query;
+}
+
+static void
+_disco_items_query_free(DiscoItemsQuery *query)
+{
+    free(query->jid);
+    free(query->filter);
+    g_free(query->filter_key);
+    free(query->after);
+    g_slist_free_full(query->items, (GDestroyNotify)_item_destroy);
+    free(query);
+}
+
+static void
+_disco_items_send(DiscoItemsQuery *query)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *iq = stanza_create_disco_items_iq(ctx, "confreq", conferencejid);
-    xmpp_send(conn, iq);
+    char *id = create_unique_id(query->rooms ? "confreq" : "discoitemsreq");
+    xmpp_stanza_t *iq = stanza_create_disco_items_iq(ctx, id, query->jid, IQ_DISCO_ITEMS_PAGE, query->after);
+
+    REQUEST(id, _disco_items_result_handler, STATS_IQ_RTT_DISCO, (GDestroyNotify)_disco_items_query_free, query);
+
+    free(id);
+
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
+// shows the items of a page that match the filter, up to the most shown
+// for one query, returns FALSE once there is no room for more
+static gboolean
+_disco_items_show(DiscoItemsQuery *query, GSList *items)
+{
+    GSList *matches = NULL;
+    int count = 0;
+    gboolean room_left = TRUE;
+    GSList *curr = items;
+    while (curr) {
+        if (_disco_item_matches(curr->data, query->filter_key)) {
+            if (query->shown + count == IQ_DISCO_ITEMS_MAX) {
+                room_left = FALSE;
+                break;
+            }
+            matches = g_slist_prepend(matches, curr->data);
+            count++;
+        }
+        curr = g_slist_next(curr);
+    }
+    matches = g_slist_reverse(matches);
+
+    if (matches) {
+        if (query->rooms) {
+            cons_show_room_list(matches, query->jid, query->shown);
+        } else {
+            cons_show_disco_items(matches, query->jid, query->shown);
+        }
+        query->shown += count;
+        g_slist_free(matches);
+    }
+
+    return room_left;
+}
+
+static void
+_disco_items_done(DiscoItemsQuery *query, gboolean truncated)
+{
+    if (query->rooms) {
+        cons_show_room_list_end(query->jid, query->filter, query->shown, truncated);
+    } else {
+        cons_show_disco_items_end(query->jid, query->shown, truncated);
+    }
+}
+
+void
+iq_room_list_request(gchar *conferencejid, gchar *filter)
+{
+    DiscoItemsQuery *query = _disco_items_query_new(conferencejid, TRUE, filter);
+
+    RoomList *room_list = room_lists ? g_hash_table_lookup(room_lists, conferencejid) : NULL;
+    if (room_list && (g_get_monotonic_time() - room_list->fetched < (gint64)IQ_ROOM_LIST_TTL * G_USEC_PER_SEC)) {
+        log_debug("Showing room list for %s from memory", conferencejid);
+        gboolean room_left = _disco_items_show(query, room_list->items);
+        _disco_items_done(query, !room_left);
+        _disco_items_query_free(query);
+        return;
+    }
+
+    _disco_items_send(query);
+}
+
 void
 iq_enable_carbons(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_enable_carbons(ctx);
     char *id = xmpp_stanza_get_id(iq);
 
-    xmpp_id_handler_add(conn, _enable_carbons_handler, id, NULL);
+    REQUEST(id, _enable_carbons_handler, STATS_IQ_RTT_CARBONS, NULL, NULL);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_disable_carbons(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_disable_carbons(ctx);
     char *id = xmpp_stanza_get_id(iq);
 
-    xmpp_id_handler_add(conn, _disable_carbons_handler, id, NULL);
+    REQUEST(id, _disable_carbons_handler, STATS_IQ_RTT_CARBONS, NULL, NULL);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_disco_info_request(gchar *jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     char *id = create_unique_id("disco_info");
     xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, jid, NULL);
 
-    xmpp_id_handler_add(conn, _disco_info_response_handler, id, NULL);
+    REQUEST(id, _disco_info_response_handler, STATS_IQ_RTT_DISCO, NULL, NULL);
 
     free(id);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
+static void
+_iq_query_result_free(IqQueryResult *result)
+{
+    free(result->name);
+    free(result->version);
+    free(result->os);
+    free(result->msg);
+    free(result);
+}
+
+static IqQueryResult*
+_iq_query_result_new(void)
+{
+    IqQueryResult *result = malloc(sizeof(IqQueryResult));
+    result->name = NULL;
+    result->version = NULL;
+    result->os = NULL;
+    result->seconds = 0;
+    result->msg = NULL;
+
+    return result;
+}
+
+// a presence from jid changes what either query would answer, and the
+// last activity of the bare jid counts from its last resource leaving
 void
-iq_last_activity_request(gchar *jid)
+iq_forget_results(const char *const jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    char *id = create_unique_id("lastactivity");
-    xmpp_stanza_t *iq = stanza_create_last_activity_iq(ctx, id, jid);
+    if (software_versions == NULL) {
+        return;
+    }
 
-    xmpp_id_handler_add(conn, _last_activity_response_handler, id, NULL);
+    result_cache_remove(software_versions, jid);
+    result_cache_remove(last_activities, jid);
 
-    free(id);
+    Jid *jidp = jid_create(jid);
+    if (jidp) {
+        result_cache_remove(last_activities, jidp->barejid);
+        jid_destroy(jidp);
+    }
+}
 
-    xmpp_send(conn, iq);
+static void
+_iq_query_free(IqQuery *query)
+{
+    free(query->jid);
+    free(query);
+}
+
+static void
+_iq_query_send(IqQuery *query)
+{
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+    xmpp_stanza_t *iq = NULL;
+    char *id = NULL;
+
+    if (query->type == QUERY_SOFTWARE_VERSION) {
+        iq = stanza_create_software_version_iq(ctx, query->jid);
+        connection_request_add(xmpp_stanza_get_id(iq), &version_request, query);
+    } else {
+        id = create_unique_id("lastactivity");
+        iq = stanza_create_last_activity_iq(ctx, id, query->jid);
+        connection_request_add(id, &last_activity_request, query);
+        free(id);
+    }
+
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
+static void
+_iq_query_add(iq_query_type_t type, const char *const jid)
+{
+    IqQuery *query = malloc(sizeof(IqQuery));
+    query->type = type;
+    query->jid = strdup(jid);
+
+    request_queue_add(queries, query);
+}
+
+// a query with its result or timed out gives its place to the next one
+static void
+_iq_query_done(IqQuery *query)
+{
+    _iq_query_free(query);
+    request_queue_done(queries);
+}
+
+// the request frees the query itself once it has timed out
+static void
+_iq_query_timeout(void *const userdata)
+{
+    IqQuery *query = (IqQuery*)userdata;
+    log_debug("No response to query for %s", query->jid);
+    request_queue_done(queries);
+}
+
+void
+iq_last_activity_request(gchar *jid)
+{
+    gint64 now = g_get_monotonic_time();
+    gint64 fetched = now;
+    IqQueryResult *result = result_cache_lookup(last_activities, jid, caps_get_ver(jid), now, &fetched);
+    if (result) {
+        log_debug("Showing last activity for %s from memory", jid);
+        int seconds = result->seconds;
+        if (seconds > 0) {
+            seconds += (now - fetched) / G_USEC_PER_SEC;
+        }
+        sv_ev_lastactivity_response(jid, seconds, result->msg);
+        return;
+    }
+
+    _iq_query_add(QUERY_LAST_ACTIVITY, jid);
+}
+
 void
 iq_room_info_request(const char *const room, gboolean display_result)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     char *id = create_unique_id("room_disco_info");
     xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, room, NULL);
@@ -222,11 +580,11 @@ iq_room_info_request(const char *const room, gboolean display_result)
     cb_data->room = strdup(room);
     cb_data->display = display_result;
 
-    xmpp_id_handler_add(conn, _room_info_response_handler, id, cb_data);
+    REQUEST(id, _room_info_response_handler, STATS_IQ_RTT_ROOM, (GDestroyNotify)_room_info_data_free, cb_data);
 
     free(id);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
@@ -236,7 +594,6 @@ void
 iq_send_caps_request_for_jid(const char *const to, const char *const id,
     const char *const node, const char *const ver)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
     if (!node) {
@@ -253,9 +610,9 @@ iq_send_caps_request_for_jid(const char *const to, const char *const id,
     xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, to, node_str->str);
     g_string_free(node_str, TRUE);
 
-    xmpp_id_handler_add(conn, _caps_response_handler_for_jid, id, strdup(to));
+    REQUEST(id, _caps_response_handler_for_jid, STATS_IQ_RTT_CAPS, free, strdup(to));
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
@@ -263,7 +620,6 @@ void
 iq_send_caps_request(const char *const to, const char *const id,
     const char *const node, const char *const ver)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
     if (!node) {
@@ -280,9 +636,9 @@ iq_send_caps_request(const char *const to, const char *const id,
     xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, to, node_str->str);
     g_string_free(node_str, TRUE);
 
-    xmpp_id_handler_add(conn, _caps_response_handler, id, NULL);
+    REQUEST(id, _caps_response_handler, STATS_IQ_RTT_CAPS, NULL, NULL);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
@@ -290,7 +646,6 @@ void
 iq_send_caps_request_legacy(const char *const to, const char *const id,
     const char *const node, const char *const ver)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
     if (!node) {
@@ -306,137 +661,120 @@ iq_send_caps_request_legacy(const char *const to, const char *const id,
     g_string_printf(node_str, "%s#%s", node, ver);
     xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, to, node_str->str);
 
-    xmpp_id_handler_add(conn, _caps_response_handler_legacy, id, node_str->str);
+    REQUEST(id, _caps_response_handler_legacy, STATS_IQ_RTT_CAPS, g_free, node_str->str);
     g_string_free(node_str, FALSE);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_disco_items_request(gchar *jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *iq = stanza_create_disco_items_iq(ctx, "discoitemsreq", jid);
-    xmpp_send(conn, iq);
-    xmpp_stanza_release(iq);
+    _disco_items_send(_disco_items_query_new(jid, FALSE, NULL));
 }
 
 void
 iq_send_software_version(const char *const fulljid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *iq = stanza_create_software_version_iq(ctx, fulljid);
-
-    char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _version_result_handler, id, strdup(fulljid));
+    IqQueryResult *result = result_cache_lookup(software_versions, fulljid, caps_get_ver(fulljid),
+        g_get_monotonic_time(), NULL);
+    if (result) {
+        log_debug("Showing software version for %s from memory", fulljid);
+        _software_version_show(fulljid, result->name, result->version, result->os);
+        return;
+    }
 
-    xmpp_send(conn, iq);
-    xmpp_stanza_release(iq);
+    _iq_query_add(QUERY_SOFTWARE_VERSION, fulljid);
 }
 
 void
 iq_confirm_instant_room(const char *const room_jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_instant_room_request_iq(ctx, room_jid);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_destroy_room(const char *const room_jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_instant_room_destroy_iq(ctx, room_jid);
 
     char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _destroy_room_result_handler, id, NULL);
+    REQUEST(id, _destroy_room_result_handler, STATS_IQ_RTT_ROOM, NULL, NULL);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_request_room_config_form(const char *const room_jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_config_request_iq(ctx, room_jid);
 
     char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _room_config_handler, id, NULL);
+    REQUEST(id, _room_config_handler, STATS_IQ_RTT_ROOM, NULL, NULL);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_submit_room_config(const char *const room, DataForm *form)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_config_submit_iq(ctx, room, form);
 
     char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _room_config_submit_handler, id, NULL);
+    REQUEST(id, _room_config_submit_handler, STATS_IQ_RTT_ROOM, NULL, NULL);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_room_config_cancel(const char *const room_jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_config_cancel_iq(ctx, room_jid);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_room_affiliation_list(const char *const room, char *affiliation)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_affiliation_list_iq(ctx, room, affiliation);
 
     char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _room_affiliation_list_result_handler, id, strdup(affiliation));
+    REQUEST(id, _room_affiliation_list_result_handler, STATS_IQ_RTT_ROOM, free, strdup(affiliation));
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_room_kick_occupant(const char *const room, const char *const nick, const char *const reason)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_kick_iq(ctx, room, nick, reason);
 
     char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _room_kick_result_handler, id, strdup(nick));
+    REQUEST(id, _room_kick_result_handler, STATS_IQ_RTT_ROOM, free, strdup(nick));
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
-struct privilege_set_t {
-    char *item;
-    char *privilege;
-};
-
 void
 iq_room_affiliation_set(const char *const room, const char *const jid, char *affiliation,
     const char *const reason)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_affiliation_set_iq(ctx, room, jid, affiliation, reason);
 
@@ -446,9 +784,9 @@ iq_room_affiliation_set(const char *const room, const char *const jid, char *aff
     affiliation_set->item = strdup(jid);
     affiliation_set->privilege = strdup(affiliation);
 
-    xmpp_id_handler_add(conn, _room_affiliation_set_result_handler, id, affiliation_set);
+    REQUEST(id, _room_affiliation_set_result_handler, STATS_IQ_RTT_ROOM, (GDestroyNotify)_privilege_set_free, affiliation_set);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
@@ -456,7 +794,6 @@ void
 iq_room_role_set(const char *const room, const char *const nick, char *role,
     const char *const reason)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_role_set_iq(ctx, room, nick, role, reason);
 
@@ -466,39 +803,48 @@ iq_room_role_set(const char *const room, const char *const nick, char *role,
     role_set->item = strdup(nick);
     role_set->privilege = strdup(role);
 
-    xmpp_id_handler_add(conn, _room_role_set_result_handler, id, role_set);
+    REQUEST(id, _room_role_set_result_handler, STATS_IQ_RTT_ROOM, (GDestroyNotify)_privilege_set_free, role_set);
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 iq_room_role_list(const char *const room, char *role)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_room_role_list_iq(ctx, room, role);
 
     char *id = xmpp_stanza_get_id(iq);
-    xmpp_id_handler_add(conn, _room_role_list_result_handler, id, strdup(role));
+    REQUEST(id, _room_role_list_result_handler, STATS_IQ_RTT_ROOM, free, strdup(role));
 
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
+// pings are latency sensitive, anything queued before is written with them
+// rather than after
+static void
+_ping_send(const char *const id, const char *const target)
+{
+    gchar *text = stanza_text_ping_iq(id, target);
+    connection_send_text(text, STANZA_NAME_IQ, STANZA_TYPE_GET, STANZA_NS_PING, target);
+    connection_flush();
+    g_free(text);
+}
+
 void
 iq_send_ping(const char *const target)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *iq = stanza_create_ping_iq(ctx, target);
-    char *id = xmpp_stanza_get_id(iq);
+    char *id = create_unique_id("ping");
 
+    static const RequestType request = { _manual_pong_handler, STATS_IQ_RTT_PING, IQ_PING_TIMEOUT,
+        _manual_ping_timeout, (GDestroyNotify)g_date_time_unref };
     GDateTime *now = g_date_time_new_now_local();
-    xmpp_id_handler_add(conn, _manual_pong_handler, id, now);
+    connection_request_add(id, &request, now);
 
-    xmpp_send(conn, iq);
-    xmpp_stanza_release(iq);
+    _ping_send(id, target);
+    free(id);
 }
 
 static int
@@ -534,6 +880,13 @@ _pong_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         log_debug("IQ pong handler fired.");
     }
 
+    if (ping_sent) {
+        gint64 rtt = g_get_monotonic_time() - ping_sent;
+        ping_rtt = ping_rtt ? (ping_rtt * 7 + rtt) / 8 : rtt;
+        ping_sent = 0;
+    }
+    pings_missed = 0;
+
     if (id && type) {
         // show warning if error
         if (strcmp(type, STANZA_TYPE_ERROR) == 0) {
@@ -627,6 +980,7 @@ _caps_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         }
 
         caps_map_jid_to_ver(from, given_sha1);
+        caps_request_resolved(given_sha1);
     }
 
     g_free(generated_sha1);
@@ -757,6 +1111,7 @@ _caps_response_handler_legacy(xmpp_conn_t *const conn, xmpp_stanza_t *const stan
         }
 
         caps_map_jid_to_ver(from, node);
+        caps_request_resolved(node);
 
     // node match fail
     } else {
@@ -843,33 +1198,85 @@ _ping_timed_handler(xmpp_conn_t *const conn, void *const userdata)
 {
     xmpp_ctx_t *ctx = (xmpp_ctx_t *)userdata;
 
-    if (jabber_get_connection_status() == JABBER_CONNECTED) {
+    if (jabber_get_connection_status() != JABBER_CONNECTED || ping_sent) {
+        return 1;
+    }
 
-        xmpp_stanza_t *iq = stanza_create_ping_iq(ctx, NULL);
-        char *id = xmpp_stanza_get_id(iq);
+    // no need to ping while the server is being heard from
+    gint64 now = g_get_monotonic_time();
+    if (now - connection_last_received() >= (gint64)prefs_get_autoping() * G_USEC_PER_SEC) {
+        char *id = create_unique_id("ping");
 
         // add pong handler
-        xmpp_id_handler_add(conn, _pong_handler, id, ctx);
+        ping_sent = now;
+        autoping_request.timeout = _autoping_timeout();
+        connection_request_add(id, &autoping_request, ctx);
 
-        xmpp_send(conn, iq);
-        xmpp_stanza_release(iq);
+        _ping_send(id, NULL);
+        free(id);
     }
 
     return 1;
 }
 
-static int
-_version_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
-    void *const userdata)
+// anything received since the ping was sent shows the connection is up
+static void
+_ping_timeout(void *const userdata)
 {
-    char *id = xmpp_stanza_get_id(stanza);
+    gboolean heard = connection_last_received() > ping_sent;
+    ping_sent = 0;
+    if (heard) {
+        pings_missed = 0;
+        return;
+    }
 
-    if (id) {
-        log_debug("IQ version result handler fired, id: %s.", id);
+    pings_missed++;
+    log_warning("Server ping timed out after %d seconds, %d unanswered.", autoping_request.timeout, pings_missed);
+    if (pings_missed >= prefs_get_autoping_misses()) {
+        pings_missed = 0;
+        connection_lost();
+    }
+}
+
+static void
+_manual_ping_timeout(void *const userdata)
+{
+    cons_show_error("No ping response after %d seconds.", IQ_PING_TIMEOUT);
+}
+
+static void
+_software_version_show(const char *const fulljid, const char *const name, const char *const version,
+    const char *const os)
+{
+    Jid *jidp = jid_create(fulljid);
+    const char *presence = NULL;
+    if (muc_active(jidp->barejid)) {
+        Occupant *occupant = muc_roster_item(jidp->barejid, jidp->resourcepart);
+        if (!occupant) {
+            ui_handle_software_version_error(jidp->fulljid, "Unknown resource");
+            jid_destroy(jidp);
+            return;
+        }
+        presence = string_from_resource_presence(occupant->presence);
     } else {
-        log_debug("IQ version result handler fired.");
+        PContact contact = roster_get_contact(jidp->barejid);
+        Resource *resource = p_contact_get_resource(contact, jidp->resourcepart);
+        if (!resource) {
+            ui_handle_software_version_error(jidp->fulljid, "Unknown resource");
+            jid_destroy(jidp);
+            return;
+        }
+        presence = string_from_resource_presence(resource->presence);
     }
 
+    ui_show_software_version(jidp->fulljid, presence, name, version, os);
+
+    jid_destroy(jidp);
+}
+
+static void
+_version_result(xmpp_stanza_t *const stanza, IqQuery *query)
+{
     char *type = xmpp_stanza_get_type(stanza);
     char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
 
@@ -883,72 +1290,49 @@ _version_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
             log_error("Software version result with unrecognised type attribute.");
         }
 
-        return 0;
+        return;
     }
 
-    const char *jid = xmpp_stanza_get_attribute(stanza, "from");
-
-    xmpp_stanza_t *query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
-    if (query == NULL) {
+    xmpp_stanza_t *version_query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    if (version_query == NULL) {
         log_error("Software version result received with no query element.");
-        return 0;
+        return;
     }
 
-    char *ns = xmpp_stanza_get_ns(query);
+    char *ns = xmpp_stanza_get_ns(version_query);
     if (g_strcmp0(ns, STANZA_NS_VERSION) != 0) {
         log_error("Software version result received without namespace.");
-        return 0;
-    }
-
-    char *name_str = NULL;
-    char *version_str = NULL;
-    char *os_str = NULL;
-    xmpp_stanza_t *name = xmpp_stanza_get_child_by_name(query, "name");
-    xmpp_stanza_t *version = xmpp_stanza_get_child_by_name(query, "version");
-    xmpp_stanza_t *os = xmpp_stanza_get_child_by_name(query, "os");
-
-    if (name) {
-        name_str = xmpp_stanza_get_text(name);
-    }
-    if (version) {
-        version_str = xmpp_stanza_get_text(version);
-    }
-    if (os) {
-        os_str = xmpp_stanza_get_text(os);
+        return;
     }
 
-    if (g_strcmp0(jid, (char*)userdata) != 0) {
+    if (g_strcmp0(from, query->jid) != 0) {
         log_warning("From attribute specified different JID, using original JID.");
     }
 
-    xmpp_ctx_t *ctx = xmpp_conn_get_context(conn);
+    IqQueryResult *result = _iq_query_result_new();
+    result->name = stanza_decoded_text(xmpp_stanza_get_child_by_name(version_query, "name"), NULL);
+    result->version = stanza_decoded_text(xmpp_stanza_get_child_by_name(version_query, "version"), NULL);
+    result->os = stanza_decoded_text(xmpp_stanza_get_child_by_name(version_query, "os"), NULL);
+    result_cache_add(software_versions, query->jid, caps_get_ver(query->jid), result, g_get_monotonic_time());
 
-    Jid *jidp = jid_create((char*)userdata);
-    const char *presence = NULL;
-    if (muc_active(jidp->barejid)) {
-        Occupant *occupant = muc_roster_item(jidp->barejid, jidp->resourcepart);
-        presence = string_from_resource_presence(occupant->presence);
-    } else {
-        PContact contact = roster_get_contact(jidp->barejid);
-        Resource *resource = p_contact_get_resource(contact, jidp->resourcepart);
-        if (!resource) {
-            ui_handle_software_version_error(jidp->fulljid, "Unknown resource");
-            if (name_str) xmpp_free(ctx, name_str);
-            if (version_str) xmpp_free(ctx, version_str);
-            if (os_str) xmpp_free(ctx, os_str);
-            return 0;
-        }
-        presence = string_from_resource_presence(resource->presence);
-    }
+    _software_version_show(query->jid, result->name, result->version, result->os);
+}
 
-    ui_show_software_version(jidp->fulljid, presence, name_str, version_str, os_str);
+static int
+_version_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
+    void *const userdata)
+{
+    char *id = xmpp_stanza_get_id(stanza);
 
-    jid_destroy(jidp);
-    free(userdata);
+    if (id) {
+        log_debug("IQ version result handler fired, id: %s.", id);
+    } else {
+        log_debug("IQ version result handler fired.");
+    }
 
-    if (name_str) xmpp_free(ctx, name_str);
-    if (version_str) xmpp_free(ctx, version_str);
-    if (os_str) xmpp_free(ctx, os_str);
+    IqQuery *query = (IqQuery*)userdata;
+    _version_result(stanza, query);
+    _iq_query_done(query);
 
     return 0;
 }
@@ -982,7 +1366,7 @@ _ping_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         xmpp_stanza_set_attribute(pong, STANZA_ATTR_ID, id);
     }
 
-    xmpp_send(conn, pong);
+    connection_send_priority(pong);
     xmpp_stanza_release(pong);
 
     return 1;
@@ -1042,7 +1426,7 @@ _version_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         xmpp_stanza_add_child(query, version);
         xmpp_stanza_add_child(response, query);
 
-        xmpp_send(conn, response);
+        connection_send(response);
 
         g_string_free(version_str, TRUE);
         xmpp_stanza_release(name_txt);
@@ -1080,7 +1464,7 @@ _disco_items_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
         xmpp_stanza_set_ns(query, XMPP_NS_DISCO_ITEMS);
         xmpp_stanza_add_child(response, query);
-        xmpp_send(conn, response);
+        connection_send(response);
 
         xmpp_stanza_release(response);
     }
@@ -1118,7 +1502,7 @@ _last_activity_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         xmpp_stanza_add_child(response, query);
         xmpp_stanza_release(query);
 
-        xmpp_send(conn, response);
+        connection_send(response);
 
         xmpp_stanza_release(response);
     } else {
@@ -1142,7 +1526,7 @@ _last_activity_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         xmpp_stanza_add_child(response, error);
         xmpp_stanza_release(error);
 
-        xmpp_send(conn, response);
+        connection_send(response);
 
         xmpp_stanza_release(response);
     }
@@ -1179,7 +1563,7 @@ _disco_info_get_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
             xmpp_stanza_set_attribute(query, STANZA_ATTR_NODE, node_str);
         }
         xmpp_stanza_add_child(response, query);
-        xmpp_send(conn, response);
+        connection_send(response);
 
         xmpp_stanza_release(query);
         xmpp_stanza_release(response);
@@ -1493,6 +1877,21 @@ _room_kick_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
     return 0;
 }
 
+static void
+_room_info_data_free(ProfRoomInfoData *cb_data)
+{
+    free(cb_data->room);
+    free(cb_data);
+}
+
+static void
+_privilege_set_free(struct privilege_set_t *privilege_set)
+{
+    free(privilege_set->item);
+    free(privilege_set->privilege);
+    free(privilege_set);
+}
+
 static void
 _identity_destroy(DiscoIdentity *identity)
 {
@@ -1595,15 +1994,14 @@ _room_info_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza
     return 0;
 }
 
-static int
-_last_activity_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
-    void *const userdata)
+static void
+_last_activity_response(xmpp_stanza_t *const stanza, IqQuery *query)
 {
     const char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
     if (!from) {
         cons_show_error("Invalid last activity response received.");
         log_info("Received last activity response with no from attribute.");
-        return 0;
+        return;
     }
 
     const char *type = xmpp_stanza_get_type(stanza);
@@ -1611,42 +2009,49 @@ _last_activity_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const st
     // handle error responses
     if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
         char *error_message = stanza_get_error_message(stanza);
-        if (from) {
-            cons_show_error("Last activity request failed for %s: %s", from, error_message);
-        } else {
-            cons_show_error("Last activity request failed: %s", error_message);
-        }
+        cons_show_error("Last activity request failed for %s: %s", from, error_message);
         free(error_message);
-        return 0;
+        return;
     }
 
-    xmpp_stanza_t *query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    xmpp_stanza_t *activity_query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
 
-    if (!query) {
+    if (!activity_query) {
         cons_show_error("Invalid last activity response received.");
         log_info("Received last activity response with no query element.");
-        return 0;
+        return;
     }
 
-    char *seconds_str = xmpp_stanza_get_attribute(query, "seconds");
+    char *seconds_str = xmpp_stanza_get_attribute(activity_query, "seconds");
     if (!seconds_str) {
         cons_show_error("Invalid last activity response received.");
         log_info("Received last activity response with no seconds attribute.");
-        return 0;
+        return;
     }
 
     int seconds = atoi(seconds_str);
     if (seconds < 0) {
         cons_show_error("Invalid last activity response received.");
         log_info("Received last activity response with negative value.");
-        return 0;
+        return;
     }
 
-    char *msg = xmpp_stanza_get_text(query);
+    IqQueryResult *result = _iq_query_result_new();
+    result->seconds = seconds;
+    result->msg = stanza_decoded_text(activity_query, NULL);
+    result_cache_add(last_activities, query->jid, caps_get_ver(query->jid), result, g_get_monotonic_time());
+
+    sv_ev_lastactivity_response(from, seconds, result->msg);
+}
 
-    sv_ev_lastactivity_response(from, seconds, msg);
+static int
+_last_activity_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
+    void *const userdata)
+{
+    IqQuery *query = (IqQuery*)userdata;
+    _last_activity_response(stanza, query);
+    _iq_query_done(query);
 
-    xmpp_free(connection_get_ctx(), msg);
     return 0;
 }
 
@@ -1728,51 +2133,95 @@ _disco_info_response_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanz
     return 0;
 }
 
+// each page is shown as it arrives, and the next asked for after the last
+// item in it, until a page comes back without an RSM set or empty
 static int
 _disco_items_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
     void *const userdata)
 {
+    DiscoItemsQuery *query = (DiscoItemsQuery*)userdata;
+    log_debug("Received disco#items response for %s", query->jid);
 
-    log_debug("Received diso#items response");
-    const char *id = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_ID);
-    const char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
-    GSList *items = NULL;
+    const char *type = xmpp_stanza_get_type(stanza);
+    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+        char *error_message = stanza_get_error_message(stanza);
+        cons_show_error("Service discovery failed for %s: %s", query->jid, error_message);
+        free(error_message);
+        _disco_items_query_free(query);
+        return 0;
+    }
 
-    if ((g_strcmp0(id, "confreq") == 0) || (g_strcmp0(id, "discoitemsreq") == 0)) {
-        log_debug("Response to query: %s", id);
-        xmpp_stanza_t *query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
-
-        if (query) {
-            xmpp_stanza_t *child = xmpp_stanza_get_children(query);
-            while (child) {
-                const char *stanza_name = xmpp_stanza_get_name(child);
-                if (stanza_name && (g_strcmp0(stanza_name, STANZA_NAME_ITEM) == 0)) {
-                    const char *item_jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
-                    if (item_jid) {
-                        DiscoItem *item = malloc(sizeof(struct disco_item_t));
-                        item->jid = strdup(item_jid);
-                        const char *item_name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
-                        if (item_name) {
-                            item->name = strdup(item_name);
-                        } else {
-                            item->name = NULL;
-                        }
-                        items = g_slist_append(items, item);
+    GSList *items = NULL;
+    char *last = NULL;
+    xmpp_stanza_t *query_stanza = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    if (query_stanza) {
+        xmpp_stanza_t *child = xmpp_stanza_get_children(query_stanza);
+        while (child) {
+            const char *stanza_name = xmpp_stanza_get_name(child);
+            if (stanza_name && (g_strcmp0(stanza_name, STANZA_NAME_ITEM) == 0)) {
+                const char *item_jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
+                if (item_jid) {
+                    DiscoItem *item = malloc(sizeof(struct disco_item_t));
+                    item->jid = strdup(item_jid);
+                    const char *item_name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
+                    if (item_name) {
+                        item->name = strdup(item_name);
+                    } else {
+                        item->name = NULL;
                     }
+                    items = g_slist_prepend(items, item);
                 }
-
-                child = xmpp_stanza_get_next(child);
             }
+
+            child = xmpp_stanza_get_next(child);
         }
+        items = g_slist_reverse(items);
+
+        xmpp_stanza_t *set = xmpp_stanza_get_child_by_ns(query_stanza, STANZA_NS_RSM);
+        xmpp_stanza_t *last_st = set ? xmpp_stanza_get_child_by_name(set, STANZA_NAME_LAST) : NULL;
+        last = stanza_decoded_text(last_st, NULL);
     }
 
-    if (g_strcmp0(id, "confreq") == 0) {
-        cons_show_room_list(items, from);
-    } else if (g_strcmp0(id, "discoitemsreq") == 0) {
-        cons_show_disco_items(items, from);
+    gboolean page_empty = items == NULL;
+    gboolean room_left = _disco_items_show(query, items);
+
+    // room lists are kept whole, other items are only shown
+    if (query->rooms) {
+        query->items = g_slist_concat(g_slist_reverse(items), query->items);
+    } else {
+        g_slist_free_full(items, (GDestroyNotify)_item_destroy);
     }
 
-    g_slist_free_full(items, (GDestroyNotify)_item_destroy);
+    if (!room_left) {
+        free(last);
+        _disco_items_done(query, TRUE);
+        _disco_items_query_free(query);
+        return 0;
+    }
 
-    return 1;
+    // a server repeating the same page would otherwise never finish
+    if (!page_empty && last && (g_strcmp0(last, query->after) != 0)) {
+        free(query->after);
+        query->after = last;
+        _disco_items_send(query);
+        return 0;
+    }
+    free(last);
+
+    _disco_items_done(query, FALSE);
+
+    if (query->rooms) {
+        if (room_lists == NULL) {
+            room_lists = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_room_list_free);
+        }
+        RoomList *room_list = malloc(sizeof(RoomList));
+        room_list->items = g_slist_reverse(query->items);
+        room_list->fetched = g_get_monotonic_time();
+        query->items = NULL;
+        g_hash_table_replace(room_lists, strdup(query->jid), room_list);
+    }
+
+    _disco_items_query_free(query);
+
+    return 0;
 }
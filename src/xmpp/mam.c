@@ -0,0 +1,360 @@
+/*
+ * mam.c
+ *
+ * Copyright (C) 2012 - 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#ifdef HAVE_LIBMESODE
+#include <mesode.h>
+#endif
+#ifdef HAVE_LIBSTROPHE
+#include <strophe.h>
+#endif
+
+#include "common.h"
+#include "jid.h"
+#include "log.h"
+#include "muc.h"
+#include "tools/sanitise.h"
+#include "event/server_events.h"
+#include "xmpp/connection.h"
+#include "xmpp/mam.h"
+#include "xmpp/stanza.h"
+#include "xmpp/xmpp.h"
+
+#define MAM_PAGE_SIZE 50
+
+// paging state per conversation, before is the RSM id of the oldest
+// message fetched so far
+typedef struct mam_archive_t {
+    char *before;
+    gboolean complete;
+    gboolean pending;
+} MamArchive;
+
+// a query in flight, messages are collected newest first
+typedef struct mam_query_t {
+    char *barejid;
+    gboolean muc;
+    GSList *messages;
+} MamQuery;
+
+static GHashTable *archives;
+static GHashTable *queries;
+
+static int _mam_fin_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static gboolean _valid_result_from(const MamQuery *const query, xmpp_stanza_t *const stanza);
+static void _archive_advance(MamArchive *archive, xmpp_stanza_t *const stanza, GSList *messages, int total,
+    int shown);
+static void _init(void);
+static void _archive_free(MamArchive *archive);
+static void _query_free(MamQuery *query);
+static void _archived_message_free(ArchivedMessage *message);
+
+void
+mam_fetch_older(const char *const barejid, gboolean muc, GDateTime *end)
+{
+    _init();
+
+    MamArchive *archive = g_hash_table_lookup(archives, barejid);
+    if (archive == NULL) {
+        archive = malloc(sizeof(MamArchive));
+        archive->before = NULL;
+        archive->complete = FALSE;
+        archive->pending = FALSE;
+        g_hash_table_insert(archives, strdup(barejid), archive);
+    }
+
+    // one page at a time, and nothing more once the archive is exhausted
+    if (archive->pending || archive->complete) {
+        return;
+    }
+
+    // the first page ends before the oldest message already in the window,
+    // later pages follow the RSM cursor
+    char *end_str = NULL;
+    if (archive->before == NULL && end) {
+        GDateTime *end_utc = g_date_time_to_utc(end);
+        GDateTime *end_prev = g_date_time_add_seconds(end_utc, -1);
+        end_str = g_date_time_format(end_prev, "%Y-%m-%dT%H:%M:%SZ");
+        g_date_time_unref(end_prev);
+        g_date_time_unref(end_utc);
+    }
+
+    xmpp_conn_t * const conn = connection_get_conn();
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+    char *id = create_unique_id("mam");
+
+    // room archives are queried on the room, chat archives on our account
+    xmpp_stanza_t *iq = stanza_create_mam_iq(ctx, id, muc ? barejid : NULL, muc ? NULL : barejid,
+        end_str, archive->before, MAM_PAGE_SIZE);
+
+    MamQuery *query = malloc(sizeof(MamQuery));
+    query->barejid = strdup(barejid);
+    query->muc = muc;
+    query->messages = NULL;
+    g_hash_table_insert(queries, strdup(id), query);
+    archive->pending = TRUE;
+
+    xmpp_id_handler_add(conn, _mam_fin_handler, id, NULL);
+
+    log_debug("Requesting archived messages for %s", barejid);
+    connection_send(iq);
+    xmpp_stanza_release(iq);
+    free(id);
+    g_free(end_str);
+}
+
+void
+mam_forget(const char *const barejid)
+{
+    if (archives) {
+        g_hash_table_remove(archives, barejid);
+    }
+}
+
+void
+mam_handle_result(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
+{
+    const char *queryid = xmpp_stanza_get_attribute(children->mam_result, STANZA_ATTR_QUERYID);
+    MamQuery *query = NULL;
+    if (queries && queryid) {
+        query = g_hash_table_lookup(queries, queryid);
+    }
+    if (query == NULL) {
+        log_debug("Ignoring archived message for unknown query");
+        return;
+    }
+
+    if (!_valid_result_from(query, stanza)) {
+        log_warning("Ignoring archived message from unexpected sender for %s", query->barejid);
+        return;
+    }
+
+    xmpp_stanza_t *forwarded = xmpp_stanza_get_child_by_ns(children->mam_result, STANZA_NS_FORWARD);
+    if (forwarded == NULL) {
+        return;
+    }
+    xmpp_stanza_t *message = xmpp_stanza_get_child_by_name(forwarded, STANZA_NAME_MESSAGE);
+    if (message == NULL) {
+        return;
+    }
+    xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(message, STANZA_NAME_BODY);
+    if (body == NULL) {
+        return;
+    }
+    const char *from = xmpp_stanza_get_attribute(message, STANZA_ATTR_FROM);
+    if (from == NULL) {
+        return;
+    }
+
+    GDateTime *timestamp = stanza_get_delay(forwarded);
+    if (timestamp == NULL) {
+        log_debug("Ignoring archived message without timestamp for %s", query->barejid);
+        return;
+    }
+
+    Jid *jidp = jid_create(from);
+    if (jidp == NULL) {
+        g_date_time_unref(timestamp);
+        return;
+    }
+
+    ArchivedMessage *archived = malloc(sizeof(ArchivedMessage));
+    const char *result_id = xmpp_stanza_get_attribute(children->mam_result, STANZA_ATTR_ID);
+    archived->id = result_id ? strdup(result_id) : NULL;
+    if (query->muc) {
+        char *mynick = muc_nick(query->barejid);
+        archived->from = strdup(jidp->resourcepart ? jidp->resourcepart : "");
+        archived->outgoing = mynick && (g_strcmp0(mynick, jidp->resourcepart) == 0);
+    } else {
+        Jid *myjid = jid_create(jabber_get_fulljid());
+        archived->from = strdup(jidp->barejid);
+        archived->outgoing = myjid && (g_strcmp0(myjid->barejid, jidp->barejid) == 0);
+        jid_destroy(myjid);
+    }
+    archived->message = stanza_decoded_text(body, "");
+    if (archived->message) {
+        sanitise_text(archived->message);
+    }
+    archived->timestamp = timestamp;
+    jid_destroy(jidp);
+
+    // results arrive oldest first
+    query->messages = g_slist_prepend(query->messages, archived);
+}
+
+void
+mam_clear(void)
+{
+    if (queries) {
+        g_hash_table_destroy(queries);
+        queries = NULL;
+    }
+    if (archives) {
+        g_hash_table_destroy(archives);
+        archives = NULL;
+    }
+}
+
+static int
+_mam_fin_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    const char *id = xmpp_stanza_get_id(stanza);
+    MamQuery *query = NULL;
+    if (queries && id) {
+        query = g_hash_table_lookup(queries, id);
+    }
+    if (query == NULL) {
+        return 0;
+    }
+
+    // the window may have been closed while the query was in flight
+    MamArchive *archive = g_hash_table_lookup(archives, query->barejid);
+
+    const char *type = xmpp_stanza_get_type(stanza);
+    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+        char *error_message = stanza_get_error_message(stanza);
+        log_debug("Archive query failed for %s: %s", query->barejid, error_message);
+        free(error_message);
+        if (archive) {
+            archive->pending = FALSE;
+            archive->complete = TRUE;
+        }
+        g_hash_table_remove(queries, id);
+        return 0;
+    }
+
+    int total = g_slist_length(query->messages);
+    int shown = 0;
+    if (query->messages) {
+        shown = sv_ev_history_page(query->barejid, query->muc, query->messages);
+    }
+
+    if (archive) {
+        archive->pending = FALSE;
+        _archive_advance(archive, stanza, query->messages, total, shown);
+    }
+    g_hash_table_remove(queries, id);
+
+    return 0;
+}
+
+// the cursor only moves past the messages the window took, a page that
+// did not fit is asked for again from after the oldest message shown
+static void
+_archive_advance(MamArchive *archive, xmpp_stanza_t *const stanza, GSList *messages, int total, int shown)
+{
+    if (shown < total) {
+        ArchivedMessage *oldest_shown = shown > 0 ? g_slist_nth_data(messages, shown - 1) : NULL;
+        if (oldest_shown && oldest_shown->id) {
+            free(archive->before);
+            archive->before = strdup(oldest_shown->id);
+        }
+        return;
+    }
+
+    xmpp_stanza_t *fin = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_FIN);
+    xmpp_stanza_t *set = fin ? xmpp_stanza_get_child_by_name(fin, STANZA_NAME_SET) : NULL;
+    xmpp_stanza_t *first = set ? xmpp_stanza_get_child_by_name(set, STANZA_NAME_FIRST) : NULL;
+    char *first_id = stanza_decoded_text(first, NULL);
+    if (first_id) {
+        free(archive->before);
+        archive->before = first_id;
+    }
+    const char *complete = fin ? xmpp_stanza_get_attribute(fin, STANZA_ATTR_COMPLETE) : NULL;
+    if (!first_id || (g_strcmp0(complete, "true") == 0)) {
+        archive->complete = TRUE;
+    }
+}
+
+static gboolean
+_valid_result_from(const MamQuery *const query, xmpp_stanza_t *const stanza)
+{
+    const char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
+
+    if (query->muc) {
+        return (g_strcmp0(from, query->barejid) == 0);
+    }
+
+    // our own archive, sent by the server without a from or from our bare jid
+    if (from == NULL) {
+        return TRUE;
+    }
+    Jid *myjid = jid_create(jabber_get_fulljid());
+    gboolean result = myjid && (g_strcmp0(from, myjid->barejid) == 0);
+    jid_destroy(myjid);
+
+    return result;
+}
+
+static void
+_init(void)
+{
+    if (archives == NULL) {
+        archives = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_archive_free);
+    }
+    if (queries == NULL) {
+        queries = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_query_free);
+    }
+}
+
+static void
+_archive_free(MamArchive *archive)
+{
+    free(archive->before);
+    free(archive);
+}
+
+static void
+_query_free(MamQuery *query)
+{
+    free(query->barejid);
+    g_slist_free_full(query->messages, (GDestroyNotify)_archived_message_free);
+    free(query);
+}
+
+static void
+_archived_message_free(ArchivedMessage *message)
+{
+    free(message->id);
+    free(message->from);
+    free(message->message);
+    g_date_time_unref(message->timestamp);
+    free(message);
+}
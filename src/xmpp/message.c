@@ -52,36 +52,155 @@
 #include "ui/ui.h"
 #include "event/server_events.h"
 #include "xmpp/connection.h"
+#include "xmpp/mam.h"
 #include "xmpp/message.h"
 #include "xmpp/roster.h"
 #include "roster_list.h"
+#include "tools/sanitise.h"
 #include "xmpp/stanza.h"
 #include "xmpp/xmpp.h"
 #include "pgp/gpg.h"
-
-#define HANDLE(ns, type, func) xmpp_handler_add(conn, func, ns, STANZA_NAME_MESSAGE, type, ctx)
-
-static int _groupchat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
-static int _chat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
-static int _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
-static int _conference_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
-static int _captcha_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
-static int _message_error_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
-static int _receipt_received_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+#include "tools/dedup.h"
+#include "tools/stats.h"
+#include "tools/trace.h"
+#include "tools/watchdog.h"
+
+#define HANDLE(ns, type, func) connection_handler_add(func, ns, STANZA_NAME_MESSAGE, type, ctx, "message")
+
+// messages seen again within this time, as carbons, room history on a
+// rejoin or resends, are dropped before they are shown or logged
+#define MESSAGE_SEEN_MAX 1000
+#define MESSAGE_SEEN_AGE ((gint64)60 * 60 * G_USEC_PER_SEC)
+
+static int _message_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+
+static void _message_error_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _groupchat_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _chat_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _muc_user_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _conference_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _captcha_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _receipt_received_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static void _marker_received_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+static gboolean _message_is_duplicate(const char *const kind, const char *const from, const char *const id,
+    const char *const body);
+static char* _message_text(xmpp_stanza_t *const child, const char *const from);
+static void _message_sent(const char *const id);
+static void _message_attach_receipt_request(xmpp_ctx_t *const ctx, xmpp_stanza_t *const message,
+    const char *const jid);
+static gboolean _message_sent_by_us(const char *const from, const char *const id);
+
+static Dedup seen_messages = NULL;
+
+// ids of chat messages sent from this client, so their carbons, reflected
+// by servers that copy to every resource, can be dropped unread
+static Dedup sent_messages = NULL;
+
+typedef enum {
+    MESSAGE_IGNORED,
+    MESSAGE_ERROR,
+    MESSAGE_GROUPCHAT,
+    MESSAGE_CHAT,
+    MESSAGE_MUC_INVITE,
+    MESSAGE_CONFERENCE,
+    MESSAGE_CAPTCHA,
+    MESSAGE_RECEIPT,
+    MESSAGE_MARKER,
+    MESSAGE_MAM_RESULT
+} message_kind_t;
+
+typedef void (*message_handler_t)(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+
+static const message_handler_t message_handlers[] = {
+    [MESSAGE_IGNORED]       = NULL,
+    [MESSAGE_ERROR]         = _message_error_handler,
+    [MESSAGE_GROUPCHAT]     = _groupchat_handler,
+    [MESSAGE_CHAT]          = _chat_handler,
+    [MESSAGE_MUC_INVITE]    = _muc_user_handler,
+    [MESSAGE_CONFERENCE]    = _conference_handler,
+    [MESSAGE_CAPTCHA]       = _captcha_handler,
+    [MESSAGE_RECEIPT]       = _receipt_received_handler,
+    [MESSAGE_MARKER]        = _marker_received_handler,
+    [MESSAGE_MAM_RESULT]    = mam_handle_result
+};
+
+static const stats_t message_stats[] = {
+    [MESSAGE_ERROR]         = STATS_MESSAGE_ERROR,
+    [MESSAGE_GROUPCHAT]     = STATS_MESSAGE_GROUPCHAT,
+    [MESSAGE_CHAT]          = STATS_MESSAGE_CHAT,
+    [MESSAGE_MUC_INVITE]    = STATS_MESSAGE_MUC_INVITE,
+    [MESSAGE_CONFERENCE]    = STATS_MESSAGE_CONFERENCE,
+    [MESSAGE_CAPTCHA]       = STATS_MESSAGE_CAPTCHA,
+    [MESSAGE_RECEIPT]       = STATS_MESSAGE_RECEIPT,
+    [MESSAGE_MARKER]        = STATS_MESSAGE_MARKER,
+    [MESSAGE_MAM_RESULT]    = STATS_MESSAGE_MAM_RESULT
+};
 
 void
 message_add_handlers(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
-    HANDLE(NULL,                 STANZA_TYPE_ERROR,      _message_error_handler);
-    HANDLE(NULL,                 STANZA_TYPE_GROUPCHAT,  _groupchat_handler);
-    HANDLE(NULL,                 NULL,                   _chat_handler);
-    HANDLE(STANZA_NS_MUC_USER,   NULL,                   _muc_user_handler);
-    HANDLE(STANZA_NS_CONFERENCE, NULL,                   _conference_handler);
-    HANDLE(STANZA_NS_CAPTCHA,    NULL,                   _captcha_handler);
-    HANDLE(STANZA_NS_RECEIPTS,   NULL,                   _receipt_received_handler);
+    HANDLE(NULL, NULL, _message_handler);
+}
+
+// classify the stanza once by type and first level namespaces, a stanza is
+// passed to at most one handler
+static message_kind_t
+_message_kind(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
+{
+    char *type = xmpp_stanza_get_type(stanza);
+
+    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+        return MESSAGE_ERROR;
+    }
+    if (children->mam_result) {
+        return MESSAGE_MAM_RESULT;
+    }
+    if (children->conference) {
+        return MESSAGE_CONFERENCE;
+    }
+    if (children->captcha) {
+        return MESSAGE_CAPTCHA;
+    }
+    if (children->muc_invite) {
+        return MESSAGE_MUC_INVITE;
+    }
+    if (children->receipt && (g_strcmp0(xmpp_stanza_get_name(children->receipt), "received") == 0)) {
+        return MESSAGE_RECEIPT;
+    }
+    if (children->marker && !children->body && (g_strcmp0(xmpp_stanza_get_name(children->marker), "markable") != 0)) {
+        return MESSAGE_MARKER;
+    }
+    if (g_strcmp0(type, STANZA_TYPE_GROUPCHAT) == 0) {
+        return MESSAGE_GROUPCHAT;
+    }
+    if ((type == NULL) || (g_strcmp0(type, STANZA_TYPE_CHAT) == 0)) {
+        return MESSAGE_CHAT;
+    }
+
+    return MESSAGE_IGNORED;
+}
+
+static int
+_message_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    StanzaChildren children;
+    stanza_decode(stanza, &children);
+
+    message_kind_t kind = _message_kind(stanza, &children);
+    message_handler_t handler = message_handlers[kind];
+    if (handler) {
+        gint64 start = stats_start();
+        gint64 trace = trace_start();
+        gint64 watch = watchdog_start();
+        handler(stanza, &children);
+        connection_watchdog_check(stats_name(message_stats[kind]), stanza, watch);
+        trace_record(stats_name(message_stats[kind]), trace);
+        stats_record(message_stats[kind], start);
+    }
+
+    return 1;
 }
 
 static char*
@@ -121,71 +240,61 @@ _session_state(const char *const barejid)
 char*
 message_send_chat(const char *const barejid, const char *const msg)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
+    char *id = create_unique_id("msg");
+    message_send_chat_with_id(barejid, msg, id);
+
+    return id;
+}
+
+// for messages given an id before sending, such as those queued while
+// disconnected
+void
+message_send_chat_with_id(const char *const barejid, const char *const msg, const char *const id)
+{
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
     char *state = _session_state(barejid);
     char *jid = _session_jid(barejid);
-    char *id = create_unique_id("msg");
 
     xmpp_stanza_t *message = stanza_create_message(ctx, id, jid, STANZA_TYPE_CHAT, msg);
-    free(jid);
 
     if (state) {
         stanza_attach_state(ctx, message, state);
     }
 
-    if (prefs_get_boolean(PREF_RECEIPTS_REQUEST)) {
-        stanza_attach_receipt_request(ctx, message);
+    _message_attach_receipt_request(ctx, message, jid);
+    free(jid);
+
+    if (prefs_get_boolean(PREF_CHAT_MARKERS)) {
+        stanza_attach_markable(ctx, message);
     }
 
-    xmpp_send(conn, message);
+    _message_sent(id);
+    connection_send(message);
     xmpp_stanza_release(message);
-
-    return id;
 }
 
-char*
-message_send_chat_pgp(const char *const barejid, const char *const msg)
+static void
+_message_send_chat_pgp_stanza(const char *const id, const char *const jid, const char *const state,
+    const char *const msg, const char *const encrypted)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
-    char *state = _session_state(barejid);
-    char *jid = _session_jid(barejid);
-    char *id = create_unique_id("msg");
-
     xmpp_stanza_t *message = NULL;
-#ifdef HAVE_LIBGPGME
-    char *account_name = jabber_get_account_name();
-    ProfAccount *account = accounts_get_account(account_name);
-    if (account->pgp_keyid) {
-        Jid *jidp = jid_create(jid);
-        char *encrypted = p_gpg_encrypt(jidp->barejid, msg);
-        if (encrypted) {
-            message = stanza_create_message(ctx, id, jid, STANZA_TYPE_CHAT, "This message is encrypted.");
-            xmpp_stanza_t *x = xmpp_stanza_new(ctx);
-            xmpp_stanza_set_name(x, STANZA_NAME_X);
-            xmpp_stanza_set_ns(x, STANZA_NS_ENCRYPTED);
-            xmpp_stanza_t *enc_st = xmpp_stanza_new(ctx);
-            xmpp_stanza_set_text(enc_st, encrypted);
-            xmpp_stanza_add_child(x, enc_st);
-            xmpp_stanza_release(enc_st);
-            xmpp_stanza_add_child(message, x);
-            xmpp_stanza_release(x);
-            free(encrypted);
-        } else {
-            message = stanza_create_message(ctx, id, jid, STANZA_TYPE_CHAT, msg);
-        }
-        jid_destroy(jidp);
+    if (encrypted) {
+        message = stanza_create_message(ctx, id, jid, STANZA_TYPE_CHAT, "This message is encrypted.");
+        xmpp_stanza_t *x = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_name(x, STANZA_NAME_X);
+        xmpp_stanza_set_ns(x, STANZA_NS_ENCRYPTED);
+        xmpp_stanza_t *enc_st = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_text(enc_st, encrypted);
+        xmpp_stanza_add_child(x, enc_st);
+        xmpp_stanza_release(enc_st);
+        xmpp_stanza_add_child(message, x);
+        xmpp_stanza_release(x);
     } else {
         message = stanza_create_message(ctx, id, jid, STANZA_TYPE_CHAT, msg);
     }
-    account_free(account);
-#else
-    message = stanza_create_message(ctx, id, jid, STANZA_TYPE_CHAT, msg);
-#endif
-    free(jid);
 
     if (state) {
         stanza_attach_state(ctx, message, state);
@@ -193,12 +302,90 @@ message_send_chat_pgp(const char *const barejid, const char *const msg)
 
     stanza_attach_carbons_private(ctx, message);
 
-    if (prefs_get_boolean(PREF_RECEIPTS_REQUEST)) {
-        stanza_attach_receipt_request(ctx, message);
+    _message_attach_receipt_request(ctx, message, jid);
+
+    if (prefs_get_boolean(PREF_CHAT_MARKERS)) {
+        stanza_attach_markable(ctx, message);
     }
 
-    xmpp_send(conn, message);
+    connection_send(message);
     xmpp_stanza_release(message);
+}
+
+#ifdef HAVE_LIBGPGME
+// a message waiting on its encryption, sent from the callback
+typedef struct pgp_outgoing_t {
+    char *barejid;
+    char *jid;
+    char *id;
+    char *state;
+    char *message;
+} PgpOutgoing;
+
+static void
+_message_pgp_encrypted(const char *const cipher, void *userdata)
+{
+    PgpOutgoing *outgoing = userdata;
+
+    // never fall back to plain text once encryption was started, the
+    // message is left shown as pending
+    if (cipher == NULL) {
+        log_error("PGP message %s to %s was not sent", outgoing->id, outgoing->barejid);
+        sv_ev_outgoing_pgp_failed(outgoing->barejid, outgoing->id);
+    } else if (jabber_get_connection_status() != JABBER_CONNECTED) {
+        log_warning("PGP message %s to %s dropped, no longer connected", outgoing->id, outgoing->barejid);
+        sv_ev_outgoing_pgp_failed(outgoing->barejid, outgoing->id);
+    } else {
+        _message_send_chat_pgp_stanza(outgoing->id, outgoing->jid, outgoing->state, NULL, cipher);
+        sv_ev_outgoing_pgp_sent(outgoing->barejid, outgoing->message, outgoing->id);
+    }
+
+    free(outgoing->barejid);
+    free(outgoing->jid);
+    free(outgoing->id);
+    free(outgoing->message);
+    free(outgoing);
+}
+#endif
+
+// with a key for the contact the message is sent once a worker has
+// encrypted it and pending is set, without one it goes now as plain text
+char*
+message_send_chat_pgp(const char *const barejid, const char *const msg, gboolean *pending)
+{
+    *pending = FALSE;
+    char *state = _session_state(barejid);
+    char *jid = _session_jid(barejid);
+    char *id = create_unique_id("msg");
+
+#ifdef HAVE_LIBGPGME
+    char *account_name = jabber_get_account_name();
+    const ProfAccount *account = accounts_peek_account(account_name);
+    if (account->pgp_keyid) {
+        Jid *jidp = jid_create(jid);
+        PgpOutgoing *outgoing = malloc(sizeof(PgpOutgoing));
+        outgoing->barejid = strdup(jidp->barejid);
+        outgoing->jid = jid;
+        outgoing->id = strdup(id);
+        outgoing->state = state;
+        outgoing->message = strdup(msg);
+        gboolean started = p_gpg_encrypt_async(jidp->barejid, msg, _message_pgp_encrypted, outgoing);
+        jid_destroy(jidp);
+
+        if (started) {
+            *pending = TRUE;
+            return id;
+        }
+
+        free(outgoing->barejid);
+        free(outgoing->id);
+        free(outgoing->message);
+        free(outgoing);
+    }
+#endif
+
+    _message_send_chat_pgp_stanza(id, jid, state, msg, NULL);
+    free(jid);
 
     return id;
 }
@@ -206,7 +393,6 @@ message_send_chat_pgp(const char *const barejid, const char *const msg)
 char*
 message_send_chat_otr(const char *const barejid, const char *const msg)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
     char *state = _session_state(barejid);
@@ -224,11 +410,13 @@ message_send_chat_otr(const char *const barejid, const char *const msg)
     stanza_attach_hints_no_copy(ctx, message);
     stanza_attach_hints_no_store(ctx, message);
 
-    if (prefs_get_boolean(PREF_RECEIPTS_REQUEST)) {
-        stanza_attach_receipt_request(ctx, message);
+    _message_attach_receipt_request(ctx, message, barejid);
+
+    if (prefs_get_boolean(PREF_CHAT_MARKERS)) {
+        stanza_attach_markable(ctx, message);
     }
 
-    xmpp_send(conn, message);
+    connection_send(message);
     xmpp_stanza_release(message);
 
     return id;
@@ -237,37 +425,34 @@ message_send_chat_otr(const char *const barejid, const char *const msg)
 void
 message_send_private(const char *const fulljid, const char *const msg)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     char *id = create_unique_id("prv");
     xmpp_stanza_t *message = stanza_create_message(ctx, id, fulljid, STANZA_TYPE_CHAT, msg);
     free(id);
 
-    xmpp_send(conn, message);
+    connection_send(message);
     xmpp_stanza_release(message);
 }
 
 void
 message_send_groupchat(const char *const roomjid, const char *const msg)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     char *id = create_unique_id("muc");
     xmpp_stanza_t *message = stanza_create_message(ctx, id, roomjid, STANZA_TYPE_GROUPCHAT, msg);
     free(id);
 
-    xmpp_send(conn, message);
+    connection_send(message);
     xmpp_stanza_release(message);
 }
 
 void
 message_send_groupchat_subject(const char *const roomjid, const char *const subject)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *message = stanza_create_room_subject_message(ctx, roomjid, subject);
 
-    xmpp_send(conn, message);
+    connection_send(message);
     xmpp_stanza_release(message);
 }
 
@@ -275,7 +460,6 @@ void
 message_send_invite(const char *const roomjid, const char *const contact,
     const char *const reason)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *stanza;
 
@@ -290,55 +474,44 @@ message_send_invite(const char *const roomjid, const char *const contact,
         stanza = stanza_create_mediated_invite(ctx, roomjid, contact, reason);
     }
 
-    xmpp_send(conn, stanza);
+    connection_send(stanza);
     xmpp_stanza_release(stanza);
 }
 
+static void
+_message_send_chat_state(const char *const jid, const char *const state)
+{
+    gchar *text = stanza_text_chat_state(jid, state);
+    connection_send_text(text, STANZA_NAME_MESSAGE, STANZA_TYPE_CHAT, STANZA_NS_CHATSTATES, jid);
+    g_free(text);
+}
+
 void
 message_send_composing(const char *const jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-
-    xmpp_stanza_t *stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_COMPOSING);
-    xmpp_send(conn, stanza);
-    xmpp_stanza_release(stanza);
-
+    _message_send_chat_state(jid, STANZA_NAME_COMPOSING);
 }
 
 void
 message_send_paused(const char *const jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_PAUSED);
-    xmpp_send(conn, stanza);
-    xmpp_stanza_release(stanza);
+    _message_send_chat_state(jid, STANZA_NAME_PAUSED);
 }
 
 void
 message_send_inactive(const char *const jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_INACTIVE);
-
-    xmpp_send(conn, stanza);
-    xmpp_stanza_release(stanza);
+    _message_send_chat_state(jid, STANZA_NAME_INACTIVE);
 }
 
 void
 message_send_gone(const char *const jid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_GONE);
-    xmpp_send(conn, stanza);
-    xmpp_stanza_release(stanza);
+    _message_send_chat_state(jid, STANZA_NAME_GONE);
 }
 
-static int
-_message_error_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+static void
+_message_error_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
     char *id = xmpp_stanza_get_id(stanza);
     char *jid = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
@@ -383,37 +556,30 @@ _message_error_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, voi
     }
 
     free(err_msg);
-
-    return 1;
 }
 
-static int
-_muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+static void
+_muc_user_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
     xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_stanza_t *xns_muc_user = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
     char *room = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
 
     if (!room) {
         log_warning("Message received with no from attribute, ignoring");
-        return 1;
+        return;
     }
 
     // XEP-0045
-    xmpp_stanza_t *invite = xmpp_stanza_get_child_by_name(xns_muc_user, STANZA_NAME_INVITE);
-    if (!invite) {
-        return 1;
-    }
-
+    xmpp_stanza_t *invite = children->muc_invite;
     char *invitor_jid = xmpp_stanza_get_attribute(invite, STANZA_ATTR_FROM);
     if (!invitor_jid) {
         log_warning("Chat room invite received with no from attribute");
-        return 1;
+        return;
     }
 
     Jid *jidp = jid_create(invitor_jid);
     if (!jidp) {
-        return 1;
+        return;
     }
     char *invitor = jidp->barejid;
 
@@ -424,7 +590,7 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
     }
 
     char *password = NULL;
-    xmpp_stanza_t *password_st = xmpp_stanza_get_child_by_name(xns_muc_user, STANZA_NAME_PASSWORD);
+    xmpp_stanza_t *password_st = xmpp_stanza_get_child_by_name(children->muc_user, STANZA_NAME_PASSWORD);
     if (password_st) {
         password = xmpp_stanza_get_text(password_st);
     }
@@ -437,31 +603,29 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
     if (password) {
         xmpp_free(ctx, password);
     }
-
-    return 1;
 }
 
-static int
-_conference_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+static void
+_conference_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
-    xmpp_stanza_t *xns_conference = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CONFERENCE);
+    xmpp_stanza_t *xns_conference = children->conference;
 
     char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
     if (!from) {
         log_warning("Message received with no from attribute, ignoring");
-        return 1;
+        return;
     }
 
     Jid *jidp = jid_create(from);
     if (!jidp) {
-        return 1;
+        return;
     }
 
     // XEP-0249
     char *room = xmpp_stanza_get_attribute(xns_conference, STANZA_ATTR_JID);
     if (!room) {
         jid_destroy(jidp);
-        return 1;
+        return;
     }
 
     char *reason = xmpp_stanza_get_attribute(xns_conference, STANZA_ATTR_REASON);
@@ -469,40 +633,35 @@ _conference_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *
 
     sv_ev_room_invite(INVITE_DIRECT, jidp->barejid, room, reason, password);
     jid_destroy(jidp);
-
-    return 1;
 }
 
-static int
-_captcha_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+static void
+_captcha_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
     xmpp_ctx_t *ctx = connection_get_ctx();
     char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
 
     if (!from) {
         log_warning("Message received with no from attribute, ignoring");
-        return 1;
+        return;
     }
 
     // XEP-0158
-    xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
-    if (!body) {
-        return 1;
+    if (!children->body) {
+        return;
     }
 
-    char *message = xmpp_stanza_get_text(body);
+    char *message = _message_text(children->body, from);
     if (!message) {
-        return 1;
+        return;
     }
 
     sv_ev_room_broadcast(from, message);
     xmpp_free(ctx, message);
-
-    return 1;
 }
 
-static int
-_groupchat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+static void
+_groupchat_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
     xmpp_ctx_t *ctx = connection_get_ctx();
     char *message = NULL;
@@ -510,66 +669,68 @@ _groupchat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *c
     Jid *jid = jid_create(room_jid);
 
     // handle room subject
-    xmpp_stanza_t *subject = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_SUBJECT);
-    if (subject) {
-        message = xmpp_stanza_get_text(subject);
+    if (children->subject) {
+        message = _message_text(children->subject, room_jid);
         sv_ev_room_subject(jid->barejid, jid->resourcepart, message);
         xmpp_free(ctx, message);
 
         jid_destroy(jid);
-        return 1;
+        return;
     }
 
     // handle room broadcasts
     if (!jid->resourcepart) {
-        xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
-        if (!body) {
+        if (!children->body) {
             jid_destroy(jid);
-            return 1;
+            return;
         }
 
-        message = xmpp_stanza_get_text(body);
+        message = _message_text(children->body, room_jid);
         if (!message) {
             jid_destroy(jid);
-            return 1;
+            return;
         }
 
         sv_ev_room_broadcast(room_jid, message);
         xmpp_free(ctx, message);
 
         jid_destroy(jid);
-        return 1;
+        return;
     }
 
     if (!jid_is_valid_room_form(jid)) {
         log_error("Invalid room JID: %s", jid->str);
         jid_destroy(jid);
-        return 1;
+        return;
     }
 
     // room not active in profanity
     if (!muc_active(jid->barejid)) {
         log_error("Message received for inactive chat room: %s", jid->str);
         jid_destroy(jid);
-        return 1;
+        return;
     }
 
-    xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
-
     // check for and deal with message
-    if (!body) {
+    if (!children->body) {
         jid_destroy(jid);
-        return 1;
+        return;
     }
 
-    message = xmpp_stanza_get_text(body);
+    message = _message_text(children->body, room_jid);
     if (!message) {
         jid_destroy(jid);
-        return 1;
+        return;
+    }
+
+    if (_message_is_duplicate("groupchat", room_jid, stanza_decoded_message_id(stanza, children), message)) {
+        xmpp_free(ctx, message);
+        jid_destroy(jid);
+        return;
     }
 
     // determine if the notifications happened whilst offline
-    GDateTime *timestamp = stanza_get_delay(stanza);
+    GDateTime *timestamp = stanza_decoded_delay(children);
     if (timestamp) {
         sv_ev_room_history(jid->barejid, jid->resourcepart, timestamp, message);
         g_date_time_unref(timestamp);
@@ -579,62 +740,99 @@ _groupchat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *c
 
     xmpp_free(ctx, message);
     jid_destroy(jid);
+}
 
-    return 1;
+// a resource is only asked for a receipt when its capabilities list them,
+// with a bare JID the resource that answers is not known so it always is
+static void
+_message_attach_receipt_request(xmpp_ctx_t *const ctx, xmpp_stanza_t *const message, const char *const jid)
+{
+    if (!prefs_get_boolean(PREF_RECEIPTS_REQUEST)) {
+        return;
+    }
+    if (strchr(jid, '/') && !caps_jid_has_feature(jid, STANZA_NS_RECEIPTS)) {
+        return;
+    }
+
+    stanza_attach_receipt_request(ctx, message);
 }
 
 void
 _message_send_receipt(const char *const fulljid, const char *const message_id)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *message = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(message, STANZA_NAME_MESSAGE);
-    char *id = create_unique_id("receipt");
-    xmpp_stanza_set_id(message, id);
-    free(id);
-    xmpp_stanza_set_attribute(message, STANZA_ATTR_TO, fulljid);
+    gchar *text = stanza_text_receipt(fulljid, message_id);
+    connection_send_text(text, STANZA_NAME_MESSAGE, NULL, STANZA_NS_RECEIPTS, fulljid);
+    g_free(text);
+}
 
-    xmpp_stanza_t *receipt = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(receipt, "received");
-    xmpp_stanza_set_ns(receipt, STANZA_NS_RECEIPTS);
-    xmpp_stanza_set_attribute(receipt, STANZA_ATTR_ID, message_id);
+static void
+_receipt_received_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
+{
+    char *id = xmpp_stanza_get_attribute(children->receipt, STANZA_ATTR_ID);
+    if (!id) {
+        return;
+    }
 
-    xmpp_stanza_add_child(message, receipt);
-    xmpp_stanza_release(receipt);
+    char *fulljid = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
+    if (!fulljid) {
+        return;
+    }
 
-    xmpp_send(conn, message);
-    xmpp_stanza_release(message);
+    Jid *jidp = jid_create(fulljid);
+    sv_ev_message_receipt(jidp->barejid, id);
+    jid_destroy(jidp);
 }
 
-static int
-_receipt_received_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+// a marker acknowledges the message it names and every one before it
+static void
+_marker_received_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
-    xmpp_stanza_t *receipt = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
-    char *name = xmpp_stanza_get_name(receipt);
-    if (g_strcmp0(name, "received") != 0) {
-        return 1;
-    }
-
-    char *id = xmpp_stanza_get_attribute(receipt, STANZA_ATTR_ID);
+    char *id = xmpp_stanza_get_attribute(children->marker, STANZA_ATTR_ID);
     if (!id) {
-        return 1;
+        return;
     }
 
     char *fulljid = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
     if (!fulljid) {
-        return 1;
+        return;
     }
 
     Jid *jidp = jid_create(fulljid);
-    sv_ev_message_receipt(jidp->barejid, id);
+    sv_ev_message_marker(jidp->barejid, id);
     jid_destroy(jidp);
+}
 
-    return 1;
+void
+message_send_displayed(const char *const fulljid, const char *const message_id)
+{
+    gchar *text = stanza_text_marker(fulljid, "displayed", message_id);
+    connection_send_text(text, STANZA_NAME_MESSAGE, NULL, STANZA_NS_CHAT_MARKERS, fulljid);
+    g_free(text);
+}
+
+// only the latest markable message is remembered, marked displayed once
+// its window is viewed
+static void
+_markable_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children, Jid *jid)
+{
+    if (!prefs_get_boolean(PREF_CHAT_MARKERS)) {
+        return;
+    }
+
+    if (!children->marker || (g_strcmp0(xmpp_stanza_get_name(children->marker), "markable") != 0)) {
+        return;
+    }
+
+    char *id = xmpp_stanza_get_id(stanza);
+    if (!id || !jid->fulljid) {
+        return;
+    }
+
+    sv_ev_message_markable(jid->barejid, jid->fulljid, id);
 }
 
 void
-_receipt_request_handler(xmpp_stanza_t *const stanza)
+_receipt_request_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
     if (!prefs_get_boolean(PREF_RECEIPTS_SEND)) {
         return;
@@ -645,12 +843,11 @@ _receipt_request_handler(xmpp_stanza_t *const stanza)
         return;
     }
 
-    xmpp_stanza_t *receipts = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
-    if (!receipts) {
+    if (!children->receipt) {
         return;
     }
 
-    char *receipts_name = xmpp_stanza_get_name(receipts);
+    char *receipts_name = xmpp_stanza_get_name(children->receipt);
     if (g_strcmp0(receipts_name, "request") != 0) {
         return;
     }
@@ -662,19 +859,18 @@ _receipt_request_handler(xmpp_stanza_t *const stanza)
 }
 
 void
-_private_chat_handler(xmpp_stanza_t *const stanza, const char *const fulljid)
+_private_chat_handler(const StanzaChildren *const children, const char *const fulljid)
 {
-    xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
-    if (!body) {
+    if (!children->body) {
         return;
     }
 
-    char *message = xmpp_stanza_get_text(body);
+    char *message = _message_text(children->body, fulljid);
     if (!message) {
         return;
     }
 
-    GDateTime *timestamp = stanza_get_delay(stanza);
+    GDateTime *timestamp = stanza_decoded_delay(children);
     if (timestamp) {
         sv_ev_delayed_private_message(fulljid, message, timestamp);
         g_date_time_unref(timestamp);
@@ -687,9 +883,8 @@ _private_chat_handler(xmpp_stanza_t *const stanza, const char *const fulljid)
 }
 
 static gboolean
-_handle_carbons(xmpp_stanza_t *const stanza)
+_handle_carbons(xmpp_stanza_t *const carbons)
 {
-    xmpp_stanza_t *carbons = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CARBONS);
     if (!carbons) {
         return FALSE;
     }
@@ -698,6 +893,16 @@ _handle_carbons(xmpp_stanza_t *const stanza)
     if ((g_strcmp0(name, "received") == 0) || (g_strcmp0(name, "sent")) == 0) {
         xmpp_stanza_t *forwarded = xmpp_stanza_get_child_by_ns(carbons, STANZA_NS_FORWARD);
         xmpp_stanza_t *message = xmpp_stanza_get_child_by_name(forwarded, STANZA_NAME_MESSAGE);
+        if (!message) {
+            return TRUE;
+        }
+
+        // already shown and logged when it was sent
+        if ((g_strcmp0(name, "sent") == 0) &&
+                _message_sent_by_us(xmpp_stanza_get_attribute(message, STANZA_ATTR_FROM), xmpp_stanza_get_id(message))) {
+            log_debug("Dropped carbon of message sent from this client");
+            return TRUE;
+        }
 
         xmpp_ctx_t *ctx = connection_get_ctx();
 
@@ -711,20 +916,27 @@ _handle_carbons(xmpp_stanza_t *const stanza)
         Jid *jid_to = jid_create(to);
         Jid *my_jid = jid_create(jabber_get_fulljid());
 
+        StanzaChildren forwarded_children;
+        stanza_decode(message, &forwarded_children);
+        const char *id = stanza_decoded_message_id(message, &forwarded_children);
+
         // check for and deal with message
-        xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(message, STANZA_NAME_BODY);
-        if (body) {
-            char *message = xmpp_stanza_get_text(body);
-            if (message) {
+        if (forwarded_children.body) {
+            char *body = _message_text(forwarded_children.body, from);
+            if (body) {
                 // if we are the recipient, treat as standard incoming message
-                if(g_strcmp0(my_jid->barejid, jid_to->barejid) == 0){
-                    sv_ev_incoming_carbon(jid_from->barejid, jid_from->resourcepart, message);
+                if (jid_bare_equal(my_jid, jid_to)) {
+                    if (!_message_is_duplicate("chat", from, id, body)) {
+                        sv_ev_incoming_carbon(jid_from->barejid, jid_from->resourcepart, body);
+                    }
                 }
                 // else treat as a sent message
                 else{
-                    sv_ev_outgoing_carbon(jid_to->barejid, message);
+                    if (!_message_is_duplicate("sent", from, id, body)) {
+                        sv_ev_outgoing_carbon(jid_to->barejid, body);
+                    }
                 }
-                xmpp_free(ctx, message);
+                xmpp_free(ctx, body);
             }
         }
 
@@ -738,35 +950,20 @@ _handle_carbons(xmpp_stanza_t *const stanza)
     return FALSE;
 }
 
-static int
-_chat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+static void
+_chat_handler(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
 {
-    // ignore if type not chat or absent
-    char *type = xmpp_stanza_get_type(stanza);
-    if (!(g_strcmp0(type, "chat") == 0 || type == NULL)) {
-        return 1;
-    }
-
     // check if carbon message
-    gboolean res = _handle_carbons(stanza);
+    gboolean res = _handle_carbons(children->carbons);
     if (res) {
-        return 1;
-    }
-
-    // ignore handled namespaces
-    xmpp_stanza_t *conf = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CONFERENCE);
-    xmpp_stanza_t *captcha = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CAPTCHA);
-    if (conf || captcha) {
-        return 1;
+        return;
     }
 
     // some clients send the mucuser namespace with private messages
     // if the namespace exists, and the stanza contains a body element, assume its a private message
     // otherwise exit the handler
-    xmpp_stanza_t *mucuser = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
-    xmpp_stanza_t *body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
-    if (mucuser && body == NULL) {
-        return 1;
+    if (children->muc_user && children->body == NULL) {
+        return;
     }
 
     gchar *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
@@ -774,26 +971,29 @@ _chat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const
 
     // private message from chat room use full jid (room/nick)
     if (muc_active(jid->barejid)) {
-        _private_chat_handler(stanza, jid->fulljid);
+        _private_chat_handler(children, jid->fulljid);
         jid_destroy(jid);
-        return 1;
+        return;
     }
 
     // standard chat message, use jid without resource
     xmpp_ctx_t *ctx = connection_get_ctx();
-    GDateTime *timestamp = stanza_get_delay(stanza);
-    if (body) {
-        char *message = xmpp_stanza_get_text(body);
+    GDateTime *timestamp = stanza_decoded_delay(children);
+    if (children->body) {
+        char *message = _message_text(children->body, from);
         if (message) {
             char *enc_message = NULL;
-            xmpp_stanza_t *x = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_ENCRYPTED);
-            if (x) {
-                enc_message = xmpp_stanza_get_text(x);
+            if (children->encrypted) {
+                enc_message = xmpp_stanza_get_text(children->encrypted);
+            }
+            if (!_message_is_duplicate("chat", from, stanza_decoded_message_id(stanza, children), message)) {
+                sv_ev_incoming_message(jid->barejid, jid->resourcepart, message, enc_message, timestamp);
+                _markable_handler(stanza, children, jid);
             }
-            sv_ev_incoming_message(jid->barejid, jid->resourcepart, message, enc_message, timestamp);
             xmpp_free(ctx, enc_message);
 
-            _receipt_request_handler(stanza);
+            // a resend is still waiting for its receipt
+            _receipt_request_handler(stanza, children);
 
             xmpp_free(ctx, message);
         }
@@ -801,19 +1001,16 @@ _chat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const
 
     // handle chat sessions and states
     if (!timestamp && jid->resourcepart) {
-        gboolean gone = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_GONE) != NULL;
-        gboolean typing = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_COMPOSING) != NULL;
-        gboolean paused = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_PAUSED) != NULL;
-        gboolean inactive = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_INACTIVE) != NULL;
-        if (gone) {
+        const char *state = children->chat_state;
+        if (g_strcmp0(state, STANZA_NAME_GONE) == 0) {
             sv_ev_gone(jid->barejid, jid->resourcepart);
-        } else if (typing) {
+        } else if (g_strcmp0(state, STANZA_NAME_COMPOSING) == 0) {
             sv_ev_typing(jid->barejid, jid->resourcepart);
-        } else if (paused) {
+        } else if (g_strcmp0(state, STANZA_NAME_PAUSED) == 0) {
             sv_ev_paused(jid->barejid, jid->resourcepart);
-        } else if (inactive) {
+        } else if (g_strcmp0(state, STANZA_NAME_INACTIVE) == 0) {
             sv_ev_inactive(jid->barejid, jid->resourcepart);
-        } else if (stanza_contains_chat_state(stanza)) {
+        } else if (state) {
             sv_ev_activity(jid->barejid, jid->resourcepart, TRUE);
         } else {
             sv_ev_activity(jid->barejid, jid->resourcepart, FALSE);
@@ -822,5 +1019,78 @@ _chat_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const
 
     if (timestamp) g_date_time_unref(timestamp);
     jid_destroy(jid);
-    return 1;
+}
+
+// kind keeps the ids of messages sent and received by a jid apart, a
+// message without an id is never a duplicate. Clients that number their
+// messages start again after a restart, so the body is part of the key and
+// a new message reusing an old id is still shown.
+static gboolean
+_message_is_duplicate(const char *const kind, const char *const from, const char *const id,
+    const char *const body)
+{
+    if (!from || !id || !body) {
+        return FALSE;
+    }
+
+    if (seen_messages == NULL) {
+        seen_messages = dedup_new(MESSAGE_SEEN_MAX, MESSAGE_SEEN_AGE);
+    }
+
+    char *key = g_strdup_printf("%s\n%s\n%s\n%08x", kind, from, id, g_str_hash(body));
+    gboolean duplicate = dedup_seen(seen_messages, key, g_get_monotonic_time());
+    g_free(key);
+
+    if (duplicate) {
+        log_debug("Dropped duplicate %s message %s from %s", kind, id, from);
+    }
+
+    return duplicate;
+}
+
+// text of a body or subject element, cleaned of terminal control sequences
+// and invalid UTF-8 before anything draws or logs it
+static char*
+_message_text(xmpp_stanza_t *const child, const char *const from)
+{
+    char *text = xmpp_stanza_get_text(child);
+    if (text && (sanitise_text(text) & SANITISE_CHANGED)) {
+        log_debug("Removed control characters or invalid UTF-8 from message from %s", from);
+    }
+
+    return text;
+}
+
+// another client on the account, or another profanity with the same
+// message counter, can use the same ids, so they are kept with our full
+// jid and a sent carbon only matches when it came from this resource
+static void
+_message_sent(const char *const id)
+{
+    const char *fulljid = jabber_get_fulljid();
+    if (!id || !fulljid) {
+        return;
+    }
+
+    if (sent_messages == NULL) {
+        sent_messages = dedup_new(MESSAGE_SEEN_MAX, MESSAGE_SEEN_AGE);
+    }
+
+    char *key = g_strdup_printf("%s\n%s", fulljid, id);
+    dedup_seen(sent_messages, key, g_get_monotonic_time());
+    g_free(key);
+}
+
+static gboolean
+_message_sent_by_us(const char *const from, const char *const id)
+{
+    if (!from || !id || !sent_messages) {
+        return FALSE;
+    }
+
+    char *key = g_strdup_printf("%s\n%s", from, id);
+    gboolean sent = dedup_contains(sent_messages, key, g_get_monotonic_time());
+    g_free(key);
+
+    return sent;
 }
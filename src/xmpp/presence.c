@@ -53,6 +53,7 @@
 #include "log.h"
 #include "muc.h"
 #include "profanity.h"
+#include "roster_list.h"
 #include "ui/ui.h"
 #include "event/server_events.h"
 #include "xmpp/capabilities.h"
@@ -60,9 +61,24 @@
 #include "xmpp/stanza.h"
 #include "xmpp/xmpp.h"
 
+// pending subscription requests by bare jid, the autocompleter keeps the
+// same jids sorted for completion and listing
+static GHashTable *sub_requests;
 static Autocomplete sub_requests_ac;
 
-#define HANDLE(ns, type, func) xmpp_handler_add(conn, func, ns, STANZA_NAME_PRESENCE, type, ctx)
+// last presence broadcast on this connection, repeats are not sent
+static struct {
+    gboolean sent;
+    resource_presence_t type;
+    char *status;
+    int priority;
+    int idle;
+} last_sent;
+
+#define HANDLE(ns, type, func, stat) { \
+    static const TimedHandler timed = { func, stat }; \
+    connection_handler_add(connection_timed_handler, ns, STANZA_NAME_PRESENCE, type, (void*)&timed, stats_name(stat)); \
+}
 
 static int _unavailable_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 static int _subscribe_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
@@ -74,26 +90,33 @@ static int _presence_error_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const
 
 void _send_caps_request(char *node, char *caps_key, char *id, char *from);
 static void _send_room_presence(xmpp_conn_t *conn, xmpp_stanza_t *presence);
+static void _attach_muc_history(xmpp_ctx_t *ctx, xmpp_stanza_t *presence, const char *const room);
+static void _last_sent_clear(void);
+static gboolean _presence_unchanged(XMPPPresence *xmpp_presence);
+static void _sub_request_add(const char *const barejid);
+static void _sub_request_remove(const char *const barejid);
+static void _send_subscription(const char *const barejid, const jabber_subscr_t action);
 
 void
 presence_sub_requests_init(void)
 {
+    sub_requests = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
     sub_requests_ac = autocomplete_new();
 }
 
 void
 presence_add_handlers(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
-    xmpp_ctx_t * const ctx = connection_get_ctx();
-
-    HANDLE(NULL,               STANZA_TYPE_ERROR,        _presence_error_handler);
-    HANDLE(STANZA_NS_MUC_USER, NULL,                     _muc_user_handler);
-    HANDLE(NULL,               STANZA_TYPE_UNAVAILABLE,  _unavailable_handler);
-    HANDLE(NULL,               STANZA_TYPE_SUBSCRIBE,    _subscribe_handler);
-    HANDLE(NULL,               STANZA_TYPE_SUBSCRIBED,   _subscribed_handler);
-    HANDLE(NULL,               STANZA_TYPE_UNSUBSCRIBED, _unsubscribed_handler);
-    HANDLE(NULL,               NULL,                     _available_handler);
+    // new connection, the server has no presence from us yet
+    _last_sent_clear();
+
+    HANDLE(NULL,               STANZA_TYPE_ERROR,        _presence_error_handler,   STATS_PRESENCE_ERROR);
+    HANDLE(STANZA_NS_MUC_USER, NULL,                     _muc_user_handler,         STATS_PRESENCE_MUC_USER);
+    HANDLE(NULL,               STANZA_TYPE_UNAVAILABLE,  _unavailable_handler,      STATS_PRESENCE_UNAVAILABLE);
+    HANDLE(NULL,               STANZA_TYPE_SUBSCRIBE,    _subscribe_handler,        STATS_PRESENCE_SUBSCRIBE);
+    HANDLE(NULL,               STANZA_TYPE_SUBSCRIBED,   _subscribed_handler,       STATS_PRESENCE_SUBSCRIBED);
+    HANDLE(NULL,               STANZA_TYPE_UNSUBSCRIBED, _unsubscribed_handler,     STATS_PRESENCE_UNSUBSCRIBED);
+    HANDLE(NULL,               NULL,                     _available_handler,        STATS_PRESENCE_AVAILABLE);
 }
 
 void
@@ -101,30 +124,68 @@ presence_subscription(const char *const jid, const jabber_subscr_t action)
 {
     assert(jid != NULL);
 
+    Jid *jidp = jid_create(jid);
+    _send_subscription(jidp->barejid, action);
+    jid_destroy(jidp);
+}
+
+// answer every pending request from a jid matching the glob pattern, the
+// presences are queued together and written in one flush
+int
+presence_subscription_batch(const char *const pattern, const jabber_subscr_t action)
+{
+    GPatternSpec *spec = g_pattern_spec_new(pattern);
+    GSList *matched = NULL;
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, sub_requests);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (g_pattern_match_string(spec, key)) {
+            matched = g_slist_prepend(matched, strdup(key));
+        }
+    }
+    g_pattern_spec_free(spec);
+
+    int count = 0;
+    GSList *curr = matched;
+    while (curr) {
+        _send_subscription(curr->data, action);
+        count++;
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(matched, free);
+
+    if (count > 0) {
+        connection_flush();
+    }
+
+    return count;
+}
+
+static void
+_send_subscription(const char *const barejid, const jabber_subscr_t action)
+{
     xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_conn_t * const conn = connection_get_conn();
     const char *type = NULL;
 
-    Jid *jidp = jid_create(jid);
-
-    autocomplete_remove(sub_requests_ac, jidp->barejid);
+    _sub_request_remove(barejid);
 
     switch (action)
     {
         case PRESENCE_SUBSCRIBE:
-            log_debug("Sending presence subscribe: %s", jid);
+            log_debug("Sending presence subscribe: %s", barejid);
             type = STANZA_TYPE_SUBSCRIBE;
             break;
         case PRESENCE_SUBSCRIBED:
-            log_debug("Sending presence subscribed: %s", jid);
+            log_debug("Sending presence subscribed: %s", barejid);
             type = STANZA_TYPE_SUBSCRIBED;
             break;
         case PRESENCE_UNSUBSCRIBED:
-            log_debug("Sending presence usubscribed: %s", jid);
+            log_debug("Sending presence usubscribed: %s", barejid);
             type = STANZA_TYPE_UNSUBSCRIBED;
             break;
         default:
-            log_warning("Attempt to send unknown subscription action: %s", jid);
+            log_warning("Attempt to send unknown subscription action: %s", barejid);
             break;
     }
 
@@ -133,14 +194,30 @@ presence_subscription(const char *const jid, const jabber_subscr_t action)
     xmpp_stanza_set_id(presence, id);
     xmpp_stanza_set_name(presence, STANZA_NAME_PRESENCE);
     xmpp_stanza_set_type(presence, type);
-    xmpp_stanza_set_attribute(presence, STANZA_ATTR_TO, jidp->barejid);
-    xmpp_send(conn, presence);
+    xmpp_stanza_set_attribute(presence, STANZA_ATTR_TO, barejid);
+    connection_send(presence);
     xmpp_stanza_release(presence);
 
-    jid_destroy(jidp);
     free(id);
 }
 
+static void
+_sub_request_add(const char *const barejid)
+{
+    if (!g_hash_table_contains(sub_requests, barejid)) {
+        g_hash_table_add(sub_requests, strdup(barejid));
+        autocomplete_add(sub_requests_ac, barejid);
+    }
+}
+
+static void
+_sub_request_remove(const char *const barejid)
+{
+    if (g_hash_table_remove(sub_requests, barejid)) {
+        autocomplete_remove(sub_requests_ac, barejid);
+    }
+}
+
 GSList*
 presence_get_subscription_requests(void)
 {
@@ -150,12 +227,13 @@ presence_get_subscription_requests(void)
 gint
 presence_sub_request_count(void)
 {
-    return autocomplete_length(sub_requests_ac);
+    return g_hash_table_size(sub_requests);
 }
 
 void
 presence_clear_sub_requests(void)
 {
+    g_hash_table_remove_all(sub_requests);
     autocomplete_clear(sub_requests_ac);
 }
 
@@ -168,23 +246,7 @@ presence_sub_request_find(const char *const search_str)
 gboolean
 presence_sub_request_exists(const char *const bare_jid)
 {
-    gboolean result = FALSE;
-    GSList *requests_p = autocomplete_create_list(sub_requests_ac);
-    GSList *requests = requests_p;
-
-    while (requests) {
-        if (strcmp(requests->data, bare_jid) == 0) {
-            result = TRUE;
-            break;
-        }
-        requests = g_slist_next(requests);
-    }
-
-    if (requests_p) {
-        g_slist_free_full(requests_p, free);
-    }
-
-    return result;
+    return g_hash_table_contains(sub_requests, bare_jid);
 }
 
 void
@@ -212,6 +274,18 @@ presence_send(const resource_presence_t presence_type, const char *const msg, co
     const int pri = accounts_get_priority_for_presence_type(jabber_get_account_name(), presence_type);
     const char *show = stanza_get_presence_string_from_type(presence_type);
 
+    if (last_sent.sent && (last_sent.type == presence_type) && (last_sent.priority == pri) &&
+            (last_sent.idle == idle) && (g_strcmp0(last_sent.status, msg) == 0)) {
+        log_debug("Presence unchanged, not sending");
+        return;
+    }
+    _last_sent_clear();
+    last_sent.sent = TRUE;
+    last_sent.type = presence_type;
+    last_sent.status = msg ? strdup(msg) : NULL;
+    last_sent.priority = pri;
+    last_sent.idle = idle;
+
     connection_set_presence_message(msg);
     connection_set_priority(pri);
 
@@ -239,7 +313,7 @@ presence_send(const resource_presence_t presence_type, const char *const msg, co
         stanza_attach_last_activity(ctx, presence, idle);
     }
     stanza_attach_caps(ctx, presence);
-    xmpp_send(conn, presence);
+    connection_send(presence);
     _send_room_presence(conn, presence);
     xmpp_stanza_release(presence);
 
@@ -254,6 +328,40 @@ presence_send(const resource_presence_t presence_type, const char *const msg, co
     free(id);
 }
 
+static void
+_last_sent_clear(void)
+{
+    free(last_sent.status);
+    last_sent.status = NULL;
+    last_sent.sent = FALSE;
+}
+
+// request only the room history the account settings allow, and with
+// history.since only what arrived after the last message we logged
+static void
+_attach_muc_history(xmpp_ctx_t *ctx, xmpp_stanza_t *presence, const char *const room)
+{
+    char *account_name = jabber_get_account_name();
+    int maxstanzas = accounts_get_muc_history(account_name, "maxstanzas");
+    int maxchars = accounts_get_muc_history(account_name, "maxchars");
+    int seconds = accounts_get_muc_history(account_name, "seconds");
+
+    gchar *since = NULL;
+    const Jid *jid = jabber_get_jid();
+    if (accounts_get_muc_history(account_name, "since") == 1 && jid) {
+        GDateTime *last = groupchat_log_get_last_time(jid->barejid, room);
+        if (last) {
+            GDateTime *last_utc = g_date_time_to_utc(last);
+            since = g_date_time_format(last_utc, "%Y-%m-%dT%H:%M:%SZ");
+            g_date_time_unref(last_utc);
+            g_date_time_unref(last);
+        }
+    }
+
+    stanza_attach_muc_history(ctx, presence, maxstanzas, maxchars, seconds, since);
+    g_free(since);
+}
+
 static void
 _send_room_presence(xmpp_conn_t *conn, xmpp_stanza_t *presence)
 {
@@ -269,7 +377,7 @@ _send_room_presence(xmpp_conn_t *conn, xmpp_stanza_t *presence)
 
             xmpp_stanza_set_attribute(presence, STANZA_ATTR_TO, full_room_jid);
             log_debug("Sending presence to room: %s", full_room_jid);
-            xmpp_send(conn, presence);
+            connection_send(presence);
             free(full_room_jid);
         }
 
@@ -288,7 +396,6 @@ presence_join_room(char *room, char *nick, char * passwd)
 
     log_debug("Sending room join presence to: %s", jid->fulljid);
     xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_conn_t *conn = connection_get_conn();
     resource_presence_t presence_type =
         accounts_get_last_presence(jabber_get_account_name());
     const char *show = stanza_get_presence_string_from_type(presence_type);
@@ -301,8 +408,9 @@ presence_join_room(char *room, char *nick, char * passwd)
     stanza_attach_status(ctx, presence, status);
     stanza_attach_priority(ctx, presence, pri);
     stanza_attach_caps(ctx, presence);
+    _attach_muc_history(ctx, presence, room);
 
-    xmpp_send(conn, presence);
+    connection_send(presence);
     xmpp_stanza_release(presence);
 
     jid_destroy(jid);
@@ -316,7 +424,6 @@ presence_change_room_nick(const char *const room, const char *const nick)
 
     log_debug("Sending room nickname change to: %s, nick: %s", room, nick);
     xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_conn_t *conn = connection_get_conn();
     resource_presence_t presence_type =
         accounts_get_last_presence(jabber_get_account_name());
     const char *show = stanza_get_presence_string_from_type(presence_type);
@@ -332,7 +439,7 @@ presence_change_room_nick(const char *const room, const char *const nick)
     stanza_attach_priority(ctx, presence, pri);
     stanza_attach_caps(ctx, presence);
 
-    xmpp_send(conn, presence);
+    connection_send(presence);
     xmpp_stanza_release(presence);
 
     free(full_room_jid);
@@ -345,13 +452,12 @@ presence_leave_chat_room(const char *const room_jid)
 
     log_debug("Sending room leave presence to: %s", room_jid);
     xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_conn_t *conn = connection_get_conn();
     char *nick = muc_nick(room_jid);
 
     if (nick) {
         xmpp_stanza_t *presence = stanza_create_room_leave_presence(ctx, room_jid,
             nick);
-        xmpp_send(conn, presence);
+        connection_send(presence);
         xmpp_stanza_release(presence);
     }
 }
@@ -387,10 +493,7 @@ _presence_error_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         }
 
         log_info("Error joining room: %s, reason: %s", fulljid->barejid, error_cond);
-        if (muc_active(fulljid->barejid)) {
-            muc_leave(fulljid->barejid);
-        }
-        cons_show_error("Error joining room %s, reason: %s", fulljid->barejid, error_cond);
+        sv_ev_room_join_error(fulljid->barejid, error_cond);
         jid_destroy(fulljid);
         return 1;
     }
@@ -439,7 +542,7 @@ _unsubscribed_handler(xmpp_conn_t *const conn,
     log_debug("Unsubscribed presence handler fired for %s", from);
 
     sv_ev_subscription(from_jid->barejid, PRESENCE_UNSUBSCRIBED);
-    autocomplete_remove(sub_requests_ac, from_jid->barejid);
+    _sub_request_remove(from_jid->barejid);
 
     jid_destroy(from_jid);
 
@@ -455,7 +558,7 @@ _subscribed_handler(xmpp_conn_t *const conn,
     log_debug("Subscribed presence handler fired for %s", from);
 
     sv_ev_subscription(from_jid->barejid, PRESENCE_SUBSCRIBED);
-    autocomplete_remove(sub_requests_ac, from_jid->barejid);
+    _sub_request_remove(from_jid->barejid);
 
     jid_destroy(from_jid);
 
@@ -475,7 +578,7 @@ _subscribe_handler(xmpp_conn_t *const conn,
     }
 
     sv_ev_subscription(from_jid->barejid, PRESENCE_SUBSCRIBE);
-    autocomplete_add(sub_requests_ac, from_jid->barejid);
+    _sub_request_add(from_jid->barejid);
 
     jid_destroy(from_jid);
 
@@ -502,7 +605,10 @@ _unavailable_handler(xmpp_conn_t *const conn,
 
     char *status_str = stanza_get_status(stanza, NULL);
 
-    if (strcmp(my_jid->barejid, from_jid->barejid) !=0) {
+    // also seen for room occupants, whose full jid is the room and nick
+    iq_forget_results(jid_fulljid_or_barejid(from_jid));
+
+    if (!jid_bare_equal(my_jid, from_jid)) {
         if (from_jid->resourcepart) {
             sv_ev_contact_offline(from_jid->barejid, from_jid->resourcepart, status_str);
 
@@ -523,8 +629,10 @@ _unavailable_handler(xmpp_conn_t *const conn,
     return 1;
 }
 
+// lazy only records what jid advertises, the capabilities are requested the
+// first time they are looked up
 static void
-_handle_caps(char *jid, XMPPCaps *caps)
+_handle_caps(char *jid, XMPPCaps *caps, gboolean lazy)
 {
     // hash supported, xep-0115, cache against ver
     if (g_strcmp0(caps->hash, "sha-1") == 0) {
@@ -533,15 +641,17 @@ _handle_caps(char *jid, XMPPCaps *caps)
             if (caps_contains(caps->ver)) {
                 log_info("Capabilities cache hit: %s, for %s.", caps->ver, jid);
                 caps_map_jid_to_ver(jid, caps->ver);
+            } else if (lazy) {
+                caps_defer(caps->ver, jid, caps->node, caps->ver, FALSE);
             } else {
-                log_info("Capabilities cache miss: %s, for %s, sending service discovery request", caps->ver, jid);
-                char *id = create_unique_id("caps");
-                iq_send_caps_request(jid, id, caps->node, caps->ver);
-                free(id);
+                log_info("Capabilities cache miss: %s, for %s", caps->ver, jid);
+                caps_request(caps->ver, jid, caps->node, caps->ver, FALSE);
             }
         }
 
     // unsupported hash, xep-0115, associate with JID, no cache
+    } else if (caps->hash && lazy) {
+        log_info("Hash %s not supported: %s, not requesting capabilities", caps->hash, jid);
     } else if (caps->hash) {
         log_info("Hash %s not supported: %s, sending service discovery request", caps->hash, jid);
         char *id = create_unique_id("caps");
@@ -551,9 +661,15 @@ _handle_caps(char *jid, XMPPCaps *caps)
    // no hash, legacy caps, cache against node#ver
    } else if (caps->node && caps->ver) {
         log_info("No hash specified: %s, legacy request made for %s#%s", jid, caps->node, caps->ver);
-        char *id = create_unique_id("caps");
-        iq_send_caps_request_legacy(jid, id, caps->node, caps->ver);
-        free(id);
+        gchar *node_ver = g_strdup_printf("%s#%s", caps->node, caps->ver);
+        if (caps_contains(node_ver)) {
+            caps_map_jid_to_ver(jid, node_ver);
+        } else if (lazy) {
+            caps_defer(node_ver, jid, caps->node, caps->ver, TRUE);
+        } else {
+            caps_request(node_ver, jid, caps->node, caps->ver, TRUE);
+        }
+        g_free(node_ver);
     } else {
         log_info("No hash specified: %s, could not create ver string, not sending service disovery request.", jid);
     }
@@ -578,13 +694,16 @@ _available_handler(xmpp_conn_t *const conn,
         return 1;
     }
 
+    StanzaChildren children;
+    stanza_decode(stanza, &children);
+
     // handler still fires for muc presence
-    if (stanza_is_muc_presence(stanza)) {
+    if (children.muc_user) {
         return 1;
     }
 
     int err = 0;
-    XMPPPresence *xmpp_presence = stanza_parse_presence(stanza, &err);
+    XMPPPresence *xmpp_presence = stanza_parse_presence(stanza, &children, &err);
 
     if (!xmpp_presence) {
         char *from = NULL;
@@ -609,13 +728,21 @@ _available_handler(xmpp_conn_t *const conn,
     const char *my_jid_str = xmpp_conn_get_jid(conn);
     Jid *my_jid = jid_create(my_jid_str);
 
-    XMPPCaps *caps = stanza_parse_caps(stanza);
+    XMPPCaps *caps = stanza_decoded_caps(&children);
     if ((g_strcmp0(my_jid->fulljid, xmpp_presence->jid->fulljid) != 0) && caps) {
         log_info("Presence contains capabilities.");
         char *jid = jid_fulljid_or_barejid(xmpp_presence->jid);
-        _handle_caps(jid, caps);
+        _handle_caps(jid, caps, FALSE);
     }
-    stanza_free_caps(caps);
+
+    if ((g_strcmp0(xmpp_presence->jid->barejid, my_jid->barejid) != 0) && _presence_unchanged(xmpp_presence)) {
+        log_debug("Presence unchanged for %s, ignoring", xmpp_presence->jid->fulljid);
+        jid_destroy(my_jid);
+        stanza_free_presence(xmpp_presence);
+        return 1;
+    }
+
+    iq_forget_results(jid_fulljid_or_barejid(xmpp_presence->jid));
 
     Resource *resource = stanza_resource_from_presence(xmpp_presence);
 
@@ -623,9 +750,8 @@ _available_handler(xmpp_conn_t *const conn,
         connection_add_available_resource(resource);
     } else {
         char *pgpsig = NULL;
-        xmpp_stanza_t *x = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_SIGNED);
-        if (x) {
-            pgpsig = xmpp_stanza_get_text(x);
+        if (children.signature) {
+            pgpsig = xmpp_stanza_get_text(children.signature);
         }
         sv_ev_contact_online(xmpp_presence->jid->barejid, resource, xmpp_presence->last_activity, pgpsig);
         xmpp_ctx_t *ctx = connection_get_ctx();
@@ -638,18 +764,41 @@ _available_handler(xmpp_conn_t *const conn,
     return 1;
 }
 
+// a repeat of the show, status and priority already stored for the
+// contact resource needs no roster or UI update
+static gboolean
+_presence_unchanged(XMPPPresence *xmpp_presence)
+{
+    PContact contact = roster_get_contact(xmpp_presence->jid->barejid);
+    if (contact == NULL) {
+        return FALSE;
+    }
+
+    const char *resource_name = xmpp_presence->jid->resourcepart;
+    if (resource_name == NULL) {
+        resource_name = "__prof_default";
+    }
+    Resource *current = p_contact_get_resource(contact, resource_name);
+    if (current == NULL) {
+        return FALSE;
+    }
+
+    return (current->presence == resource_presence_from_string(xmpp_presence->show)) &&
+        (current->priority == xmpp_presence->priority) &&
+        (g_strcmp0(current->status, xmpp_presence->status) == 0);
+}
+
 void
 _send_caps_request(char *node, char *caps_key, char *id, char *from)
 {
     xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_conn_t *conn = connection_get_conn();
 
     if (node) {
         log_debug("Node string: %s.", node);
         if (!caps_contains(caps_key)) {
             log_debug("Capabilities not cached for '%s', sending discovery IQ.", from);
             xmpp_stanza_t *iq = stanza_create_disco_info_iq(ctx, id, from, node);
-            xmpp_send(conn, iq);
+            connection_send(iq);
             xmpp_stanza_release(iq);
         } else {
             log_debug("Capabilities already cached, for %s", caps_key);
@@ -682,21 +831,20 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
     char *room = from_jid->barejid;
     char *nick = from_jid->resourcepart;
 
-    char *show_str = stanza_get_show(stanza, "online");
-    char *status_str = stanza_get_status(stanza, NULL);
+    StanzaChildren children;
+    stanza_decode(stanza, &children);
+
+    char *show_str = stanza_decoded_text(children.show, "online");
+    char *status_str = stanza_decoded_text(children.status, NULL);
 
     char *jid = NULL;
     char *role = NULL;
     char *affiliation = NULL;
 
-    xmpp_stanza_t *x = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
-    if (x) {
-        xmpp_stanza_t *item = xmpp_stanza_get_child_by_name(x, STANZA_NAME_ITEM);
-        if (item) {
-            jid = xmpp_stanza_get_attribute(item, "jid");
-            role = xmpp_stanza_get_attribute(item, "role");
-            affiliation = xmpp_stanza_get_attribute(item, "affiliation");
-        }
+    if (children.muc_item) {
+        jid = xmpp_stanza_get_attribute(children.muc_item, "jid");
+        role = xmpp_stanza_get_attribute(children.muc_item, "role");
+        affiliation = xmpp_stanza_get_attribute(children.muc_item, "affiliation");
     }
 
     // handle self presence
@@ -711,8 +859,6 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
             if (new_nick) {
                 muc_nick_change_start(room, new_nick);
             } else {
-                GSList *status_codes = stanza_get_status_codes_by_ns(stanza, STANZA_NS_MUC_USER);
-
                 // room destroyed
                 if (stanza_room_destroyed(stanza)) {
                     char *new_jid = stanza_get_muc_destroy_alternative_room(stanza);
@@ -723,14 +869,14 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
                     free(reason);
 
                 // kicked from room
-                } else if (g_slist_find_custom(status_codes, "307", (GCompareFunc)g_strcmp0)) {
+                } else if (stanza_decoded_has_status_code(&children, "307")) {
                     char *actor = stanza_get_actor(stanza);
                     char *reason = stanza_get_reason(stanza);
                     sv_ev_room_kicked(room, actor, reason);
                     free(reason);
 
                 // banned from room
-                } else if (g_slist_find_custom(status_codes, "301", (GCompareFunc)g_strcmp0)) {
+                } else if (stanza_decoded_has_status_code(&children, "301")) {
                     char *actor = stanza_get_actor(stanza);
                     char *reason = stanza_get_reason(stanza);
                     sv_ev_room_banned(room, actor, reason);
@@ -740,8 +886,6 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
                 } else {
                     sv_ev_leave_room(room);
                 }
-
-                g_slist_free_full(status_codes, free);
             }
 
         // self online
@@ -765,17 +909,15 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
 
             // handle left room
             } else {
-                GSList *status_codes = stanza_get_status_codes_by_ns(stanza, STANZA_NS_MUC_USER);
-
                 // kicked from room
-                if (g_slist_find_custom(status_codes, "307", (GCompareFunc)g_strcmp0)) {
+                if (stanza_decoded_has_status_code(&children, "307")) {
                     char *actor = stanza_get_actor(stanza);
                     char *reason = stanza_get_reason(stanza);
                     sv_ev_room_occupent_kicked(room, nick, actor, reason);
                     free(reason);
 
                 // banned from room
-                } else if (g_slist_find_custom(status_codes, "301", (GCompareFunc)g_strcmp0)) {
+                } else if (stanza_decoded_has_status_code(&children, "301")) {
                     char *actor = stanza_get_actor(stanza);
                     char *reason = stanza_get_reason(stanza);
                     sv_ev_room_occupent_banned(room, nick, actor, reason);
@@ -785,19 +927,16 @@ _muc_user_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *co
                 } else {
                     sv_ev_room_occupant_offline(room, nick, "offline", status_str);
                 }
-
-                g_slist_free_full(status_codes, free);
             }
 
         // room occupant online
         } else {
             // send disco info for capabilities, if not cached
-            XMPPCaps *caps = stanza_parse_caps(stanza);
+            XMPPCaps *caps = stanza_decoded_caps(&children);
             if (caps) {
                 log_info("Presence contains capabilities.");
-                _handle_caps(from, caps);
+                _handle_caps(from, caps, TRUE);
             }
-            stanza_free_caps(caps);
 
             char *actor = stanza_get_actor(stanza);
             char *reason = stanza_get_reason(stanza);
@@ -0,0 +1,421 @@
+/*
+ * replay.c
+ *
+ * Copyright (C) 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#ifdef HAVE_LIBMESODE
+#include <mesode.h>
+#endif
+#ifdef HAVE_LIBSTROPHE
+#include <strophe.h>
+#endif
+
+#include "log.h"
+#include "event/server_events.h"
+#include "tools/arena.h"
+#include "ui/ui.h"
+#include "xmpp/connection.h"
+#include "xmpp/xmpp.h"
+
+// time spent in one stanza handler over the replay
+typedef struct replay_cost_t {
+    const char *label;
+    guint calls;
+    gint64 total;
+    gint64 max;
+} ReplayCost;
+
+// a stanza being rebuilt from the capture, complete once its root element
+// has been closed
+typedef struct replay_builder_t {
+    GMarkupParseContext *context;
+    xmpp_stanza_t *root;
+    GSList *open;
+    gboolean done;
+} ReplayBuilder;
+
+static struct {
+    GHashTable *costs;
+    guint stanzas;
+    guint unhandled;
+    guint skipped;
+    gint64 busy;
+    gint64 elapsed;
+} replay;
+
+static void
+_replay_start_element(GMarkupParseContext *context, const gchar *element_name, const gchar **attribute_names,
+    const gchar **attribute_values, gpointer user_data, GError **error)
+{
+    ReplayBuilder *builder = user_data;
+    if (builder->done) {
+        return;
+    }
+
+    xmpp_stanza_t *stanza = xmpp_stanza_new(connection_get_ctx());
+    xmpp_stanza_set_name(stanza, element_name);
+    int i;
+    for (i = 0; attribute_names[i]; i++) {
+        xmpp_stanza_set_attribute(stanza, attribute_names[i], attribute_values[i]);
+    }
+
+    if (builder->open) {
+        // libstrophe's parser gives children their parent's namespace
+        xmpp_stanza_t *parent = builder->open->data;
+        char *ns = xmpp_stanza_get_ns(parent);
+        if (ns && xmpp_stanza_get_ns(stanza) == NULL) {
+            xmpp_stanza_set_ns(stanza, ns);
+        }
+        xmpp_stanza_add_child(parent, stanza);
+        xmpp_stanza_release(stanza);
+    } else {
+        builder->root = stanza;
+    }
+    builder->open = g_slist_prepend(builder->open, stanza);
+}
+
+static void
+_replay_end_element(GMarkupParseContext *context, const gchar *element_name, gpointer user_data, GError **error)
+{
+    ReplayBuilder *builder = user_data;
+    if (builder->done || builder->open == NULL) {
+        return;
+    }
+
+    builder->open = g_slist_delete_link(builder->open, builder->open);
+    if (builder->open == NULL) {
+        builder->done = TRUE;
+    }
+}
+
+static void
+_replay_text(GMarkupParseContext *context, const gchar *text, gsize text_len, gpointer user_data, GError **error)
+{
+    ReplayBuilder *builder = user_data;
+    if (builder->done || builder->open == NULL) {
+        return;
+    }
+
+    xmpp_stanza_t *stanza = xmpp_stanza_new(connection_get_ctx());
+    xmpp_stanza_set_text_with_size(stanza, text, text_len);
+    xmpp_stanza_add_child(builder->open->data, stanza);
+    xmpp_stanza_release(stanza);
+}
+
+static const GMarkupParser replay_parser = {
+    _replay_start_element,
+    _replay_end_element,
+    _replay_text,
+    NULL,
+    NULL
+};
+
+static ReplayBuilder*
+_replay_builder_new(void)
+{
+    ReplayBuilder *builder = malloc(sizeof(ReplayBuilder));
+    builder->context = g_markup_parse_context_new(&replay_parser, 0, builder, NULL);
+    builder->root = NULL;
+    builder->open = NULL;
+    builder->done = FALSE;
+
+    return builder;
+}
+
+static void
+_replay_builder_free(ReplayBuilder *builder)
+{
+    g_markup_parse_context_free(builder->context);
+    g_slist_free(builder->open);
+    if (builder->root) {
+        xmpp_stanza_release(builder->root);
+    }
+    free(builder);
+}
+
+// a stanza logged with newlines in it continues over the following lines
+static gboolean
+_replay_builder_feed(ReplayBuilder *builder, const char *const text)
+{
+    GError *error = NULL;
+    if (!g_markup_parse_context_parse(builder->context, text, -1, &error)
+            || !g_markup_parse_context_parse(builder->context, "\n", 1, &error)) {
+        log_debug("Benchmark skipped stanza: %s", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// the seconds since the epoch stamped on a profanity log line, or 0
+static gint64
+_replay_line_stamp(const char *const line)
+{
+    int day, month, year, hour, minute, second;
+    if (sscanf(line, "%2d/%2d/%4d %2d:%2d:%2d: ", &day, &month, &year, &hour, &minute, &second) != 6) {
+        return 0;
+    }
+
+    GDateTime *dt = g_date_time_new_local(year, month, day, hour, minute, second);
+    if (dt == NULL) {
+        return 0;
+    }
+    gint64 stamp = g_date_time_to_unix(dt);
+    g_date_time_unref(dt);
+
+    return stamp;
+}
+
+static void
+_replay_cost_add(const char *const label, gint64 elapsed)
+{
+    ReplayCost *cost = g_hash_table_lookup(replay.costs, label);
+    if (cost == NULL) {
+        cost = malloc(sizeof(ReplayCost));
+        cost->label = label;
+        cost->calls = 0;
+        cost->total = 0;
+        cost->max = 0;
+        g_hash_table_insert(replay.costs, (gpointer)label, cost);
+    }
+
+    cost->calls++;
+    cost->total += elapsed;
+    if (elapsed > cost->max) {
+        cost->max = elapsed;
+    }
+}
+
+// matched as libstrophe matches handlers, ns is either the stanza's own
+// namespace or that of one of its children
+static gboolean
+_replay_handler_matches(ConnectionHandler *handler, xmpp_stanza_t *const stanza)
+{
+    if (handler->ns && g_strcmp0(xmpp_stanza_get_ns(stanza), handler->ns) != 0
+            && xmpp_stanza_get_child_by_ns(stanza, handler->ns) == NULL) {
+        return FALSE;
+    }
+    if (handler->name && g_strcmp0(xmpp_stanza_get_name(stanza), handler->name) != 0) {
+        return FALSE;
+    }
+    if (handler->type && g_strcmp0(xmpp_stanza_get_type(stanza), handler->type) != 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+_replay_stanza(xmpp_stanza_t *const stanza)
+{
+    gint64 start = g_get_monotonic_time();
+    xmpp_conn_t *conn = connection_get_conn();
+    gboolean handled = FALSE;
+
+    // the next handler is taken first, a handler returning 0 is removed
+    arena_begin();
+    GSList *curr = connection_get_handlers();
+    while (curr) {
+        ConnectionHandler *handler = curr->data;
+        curr = g_slist_next(curr);
+        if (!_replay_handler_matches(handler, stanza)) {
+            continue;
+        }
+
+        handled = TRUE;
+        gint64 handler_start = g_get_monotonic_time();
+        int keep = handler->handler(conn, stanza, handler->userdata);
+        _replay_cost_add(handler->label, g_get_monotonic_time() - handler_start);
+        if (!keep) {
+            connection_handler_remove(handler);
+        }
+    }
+    sv_ev_flush();
+    arena_end();
+
+    connection_flush();
+    ui_update();
+
+    replay.stanzas++;
+    if (!handled) {
+        replay.unhandled++;
+    }
+    replay.busy += g_get_monotonic_time() - start;
+}
+
+// stanzas follow RECV: as the libstrophe logger writes them to the profanity
+// log, or on the lines after it as copied from the xml console, anything else
+// is ignored, only stanzas handled by connection_handler_add handlers are
+// fired, responses to our own requests are not matched by id, with realtime
+// the gaps between stamped log lines are kept to the second
+void
+jabber_bench_replay(const char *const path, gboolean realtime)
+{
+    gchar *contents = NULL;
+    GError *error = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, &error)) {
+        log_error("Benchmark could not read %s: %s", path, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    if (replay.costs == NULL) {
+        replay.costs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free);
+    }
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    ReplayBuilder *builder = NULL;
+    gint64 builder_stamp = 0;
+    gint64 last_stamp = 0;
+    gint64 start = g_get_monotonic_time();
+    int i;
+    for (i = 0; lines[i]; i++) {
+        const char *line = lines[i];
+        gint64 stamp = _replay_line_stamp(line);
+
+        // a new log line means the stanza was cut short
+        if (builder && stamp) {
+            _replay_builder_free(builder);
+            builder = NULL;
+            replay.skipped++;
+        }
+
+        if (builder == NULL) {
+            const char *recv = strstr(line, "RECV:");
+            if (recv == NULL) {
+                continue;
+            }
+            recv += strlen("RECV:");
+            while (*recv == ' ') {
+                recv++;
+            }
+            // the stream element is never closed
+            if (g_str_has_prefix(recv, "<?xml") || g_str_has_prefix(recv, "<stream:stream")
+                    || g_str_has_prefix(recv, "</stream:stream")) {
+                continue;
+            }
+            builder = _replay_builder_new();
+            builder_stamp = stamp;
+            line = recv;
+        }
+
+        if (!_replay_builder_feed(builder, line)) {
+            _replay_builder_free(builder);
+            builder = NULL;
+            replay.skipped++;
+            continue;
+        }
+
+        if (builder->done) {
+            if (realtime && builder_stamp) {
+                if (last_stamp && builder_stamp > last_stamp) {
+                    g_usleep((builder_stamp - last_stamp) * G_USEC_PER_SEC);
+                }
+                last_stamp = builder_stamp;
+            }
+            _replay_stanza(builder->root);
+            _replay_builder_free(builder);
+            builder = NULL;
+        }
+    }
+
+    if (builder) {
+        _replay_builder_free(builder);
+        replay.skipped++;
+    }
+    replay.elapsed += g_get_monotonic_time() - start;
+
+    g_strfreev(lines);
+}
+
+static gint
+_cmp_cost(gconstpointer a, gconstpointer b)
+{
+    const ReplayCost *first = a;
+    const ReplayCost *second = b;
+
+    if (first->total > second->total) {
+        return -1;
+    } else if (first->total < second->total) {
+        return 1;
+    } else {
+        return g_strcmp0(first->label, second->label);
+    }
+}
+
+// throughput counts the time spent handling and drawing stanzas, not the
+// waits of a realtime replay
+void
+jabber_bench_replay_report(FILE *stream)
+{
+    if (replay.costs == NULL) {
+        return;
+    }
+
+    double busy_sec = (double)replay.busy / G_USEC_PER_SEC;
+    fprintf(stream, "\nreplayed %u stanzas in %.1f ms, %.0f stanzas/s, %u unhandled, %u skipped\n",
+        replay.stanzas,
+        (double)replay.elapsed / 1000,
+        busy_sec > 0 ? replay.stanzas / busy_sec : 0,
+        replay.unhandled,
+        replay.skipped);
+
+    fprintf(stream, "%-28s %8s %10s %8s %8s\n", "handler", "calls", "totalus", "meanus", "maxus");
+    GList *costs = g_list_sort(g_hash_table_get_values(replay.costs), _cmp_cost);
+    GList *curr = costs;
+    while (curr) {
+        ReplayCost *cost = curr->data;
+        fprintf(stream, "%-28s %8u %10" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT "\n",
+            cost->label,
+            cost->calls,
+            cost->total,
+            cost->total / cost->calls,
+            cost->max);
+        curr = g_list_next(curr);
+    }
+    g_list_free(costs);
+
+    g_hash_table_destroy(replay.costs);
+    replay.costs = NULL;
+}
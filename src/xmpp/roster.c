@@ -54,13 +54,14 @@
 #include "event/client_events.h"
 #include "tools/autocomplete.h"
 #include "config/preferences.h"
+#include "config/rostercache.h"
 #include "xmpp/connection.h"
 #include "xmpp/roster.h"
 #include "roster_list.h"
 #include "xmpp/stanza.h"
 #include "xmpp/xmpp.h"
 
-#define HANDLE(type, func) xmpp_handler_add(conn, func, XMPP_NS_ROSTER, STANZA_NAME_IQ, type, ctx)
+#define HANDLE(type, func) connection_handler_add(func, XMPP_NS_ROSTER, STANZA_NAME_IQ, type, ctx, "iq.roster_" type)
 
 // callback data for group commands
 typedef struct _group_data {
@@ -77,12 +78,12 @@ static int _group_add_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stan
 static int _group_remove_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
 
 // helper functions
+static void _roster_result_full(xmpp_stanza_t *const query);
 GSList* _get_groups_from_item(xmpp_stanza_t *item);
 
 void
 roster_add_handlers(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
 
     HANDLE(STANZA_TYPE_SET,    _roster_set_handler);
@@ -92,44 +93,59 @@ roster_add_handlers(void)
 void
 roster_request(void)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
+    // show the cached roster straight away, the server then only sends
+    // the changes since the cached version
+    Jid *my_jid = jid_create(jabber_get_fulljid());
+    rostercache_on_connect(my_jid->barejid);
+    jid_destroy(my_jid);
+    if (rostercache_load()) {
+        sv_ev_roster_received();
+    }
+
+    // versions are only sent to a server that offers them, an empty one
+    // asks it to start one
+    const char *ver = NULL;
+    if (connection_stream_feature(STANZA_NS_ROSTERVER)) {
+        ver = rostercache_get_version();
+        if (ver == NULL) {
+            ver = "";
+        }
+    }
+
     xmpp_ctx_t * const ctx = connection_get_ctx();
-    xmpp_stanza_t *iq = stanza_create_roster_iq(ctx);
-    xmpp_send(conn, iq);
+    xmpp_stanza_t *iq = stanza_create_roster_iq(ctx, ver);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 roster_send_add_new(const char *const barejid, const char *const name)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     char *id = create_unique_id("roster");
     xmpp_stanza_t *iq = stanza_create_roster_set(ctx, id, barejid, name, NULL);
     free(id);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 roster_send_remove(const char *const barejid)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     xmpp_stanza_t *iq = stanza_create_roster_remove_set(ctx, barejid);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
 void
 roster_send_name_change(const char *const barejid, const char *const new_name, GSList *groups)
 {
-    xmpp_conn_t * const conn = connection_get_conn();
     xmpp_ctx_t * const ctx = connection_get_ctx();
     char *id = create_unique_id("roster");
     xmpp_stanza_t *iq = stanza_create_roster_set(ctx, id, barejid, new_name, groups);
     free(id);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
 }
 
@@ -159,7 +175,7 @@ roster_send_add_to_group(const char *const group, PContact contact)
     xmpp_id_handler_add(conn, _group_add_handler, unique_id, data);
     xmpp_stanza_t *iq = stanza_create_roster_set(ctx, unique_id, p_contact_barejid(contact),
         p_contact_name(contact), new_groups);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
     free(unique_id);
 }
@@ -206,7 +222,7 @@ roster_send_remove_from_group(const char *const group, PContact contact)
     xmpp_id_handler_add(conn, _group_remove_handler, unique_id, data);
     xmpp_stanza_t *iq = stanza_create_roster_set(ctx, unique_id, p_contact_barejid(contact),
         p_contact_name(contact), new_groups);
-    xmpp_send(conn, iq);
+    connection_send(iq);
     xmpp_stanza_release(iq);
     free(unique_id);
 }
@@ -266,6 +282,7 @@ _roster_set_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         }
         roster_remove(name, barejid_lower);
         ui_roster_remove(barejid_lower);
+        rostercache_remove(barejid_lower);
 
     // otherwise update local roster
     } else {
@@ -277,6 +294,7 @@ _roster_set_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
         }
 
         GSList *groups = _get_groups_from_item(item);
+        rostercache_update(barejid_lower, name, groups, sub, pending_out);
 
         // update the local roster
         PContact contact = roster_get_contact(barejid_lower);
@@ -292,6 +310,8 @@ _roster_set_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza,
 
     g_free(barejid_lower);
 
+    rostercache_set_version(xmpp_stanza_get_attribute(query, STANZA_ATTR_VER));
+
     return 1;
 }
 
@@ -304,34 +324,11 @@ _roster_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, voi
         return 1;
     }
 
-    // handle initial roster response
+    // handle initial roster response, an empty result means the cached
+    // roster is current and the changes will follow as roster pushes
     xmpp_stanza_t *query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
-    xmpp_stanza_t *item = xmpp_stanza_get_children(query);
-
-    while (item) {
-        const char *barejid = xmpp_stanza_get_attribute(item, STANZA_ATTR_JID);
-        gchar *barejid_lower = g_utf8_strdown(barejid, -1);
-        const char *name = xmpp_stanza_get_attribute(item, STANZA_ATTR_NAME);
-        const char *sub = xmpp_stanza_get_attribute(item, STANZA_ATTR_SUBSCRIPTION);
-
-        // do not set nickname to empty string, set to NULL instead
-        if (name && (strlen(name) == 0)) name = NULL;
-
-        gboolean pending_out = FALSE;
-        const char *ask = xmpp_stanza_get_attribute(item, STANZA_ATTR_ASK);
-        if (g_strcmp0(ask, "subscribe") == 0) {
-            pending_out = TRUE;
-        }
-
-        GSList *groups = _get_groups_from_item(item);
-
-        gboolean added = roster_add(barejid_lower, name, groups, sub, pending_out);
-        if (!added) {
-            log_warning("Attempt to add contact twice: %s", barejid_lower);
-        }
-
-        g_free(barejid_lower);
-        item = xmpp_stanza_get_next(item);
+    if (query) {
+        _roster_result_full(query);
     }
 
     sv_ev_roster_received();
@@ -368,6 +365,47 @@ _roster_result_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, voi
     return 1;
 }
 
+static void
+_roster_result_full(xmpp_stanza_t *const query)
+{
+    // replaces any contacts loaded from the cache
+    roster_clear();
+    rostercache_clear();
+
+    xmpp_stanza_t *item = xmpp_stanza_get_children(query);
+
+    roster_batch_begin();
+    while (item) {
+        const char *barejid = xmpp_stanza_get_attribute(item, STANZA_ATTR_JID);
+        gchar *barejid_lower = g_utf8_strdown(barejid, -1);
+        const char *name = xmpp_stanza_get_attribute(item, STANZA_ATTR_NAME);
+        const char *sub = xmpp_stanza_get_attribute(item, STANZA_ATTR_SUBSCRIPTION);
+
+        // do not set nickname to empty string, set to NULL instead
+        if (name && (strlen(name) == 0)) name = NULL;
+
+        gboolean pending_out = FALSE;
+        const char *ask = xmpp_stanza_get_attribute(item, STANZA_ATTR_ASK);
+        if (g_strcmp0(ask, "subscribe") == 0) {
+            pending_out = TRUE;
+        }
+
+        GSList *groups = _get_groups_from_item(item);
+        rostercache_update(barejid_lower, name, groups, sub, pending_out);
+
+        gboolean added = roster_add(barejid_lower, name, groups, sub, pending_out);
+        if (!added) {
+            log_warning("Attempt to add contact twice: %s", barejid_lower);
+        }
+
+        g_free(barejid_lower);
+        item = xmpp_stanza_get_next(item);
+    }
+    roster_batch_end();
+
+    rostercache_set_version(xmpp_stanza_get_attribute(query, STANZA_ATTR_VER));
+}
+
 GSList*
 _get_groups_from_item(xmpp_stanza_t *item)
 {
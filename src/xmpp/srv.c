@@ -0,0 +1,580 @@
+/*
+ * srv.c
+ *
+ * Copyright (C) 2012 - 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#ifdef HAVE_RES_QUERY
+#include <arpa/nameser.h>
+#include <resolv.h>
+#endif
+
+#include <glib.h>
+
+#include "log.h"
+#include "xmpp/srv.h"
+
+// how many SRV targets and addresses take part in a race
+#define SRV_RACE_TARGETS 3
+#define SRV_RACE_ADDRESSES 8
+// Happy Eyeballs connection attempt delay, RFC 8305
+#define SRV_RACE_STAGGER_MS 250
+#define SRV_RACE_TIMEOUT_MS 10000
+
+typedef struct srv_target_t {
+    char *host;
+    int port;
+    int priority;
+    int weight;
+} SrvTarget;
+
+typedef struct srv_cache_entry_t {
+    GSList *targets;
+    time_t expires;
+} SrvCacheEntry;
+
+typedef struct srv_attempt_t {
+    int fd;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    int port;
+} SrvAttempt;
+
+// a race run by a worker, only the worker touches it until it is pushed
+// to the raced queue, except for cancelled, the outcome is logged by
+// srv_process as the log is only written from the main thread
+typedef struct srv_race_t {
+    char *domain;
+    char *host;
+    int port;
+    gboolean unreachable;
+    volatile gint cancelled;
+    srv_raced_cb callback;
+    GAsyncQueue *raced;
+} SrvRace;
+
+// SRV answers by domain, kept until their TTL runs out so reconnects do
+// not wait on DNS, the lock is never held across a query
+static GHashTable *srv_cache;
+G_LOCK_DEFINE_STATIC(srv_cache);
+
+// races finished by the workers, handed back by srv_process
+static GAsyncQueue *raced;
+// the race whose result is still wanted
+static SrvRace *current;
+
+static gpointer _srv_race_run(SrvRace *race);
+static void _srv_race_free(SrvRace *race);
+static gboolean _srv_race_targets(SrvRace *race);
+static GSList* _srv_lookup(const char *const domain);
+static GSList* _srv_query(const char *const domain, time_t *expires);
+static GSList* _srv_targets_copy(GSList *targets);
+static GSList* _srv_attempts(GSList *targets);
+static gboolean _srv_race(GSList *attempts, volatile gint *cancelled, SrvAttempt **winner);
+static gint _srv_compare_targets(gconstpointer a, gconstpointer b);
+static void _srv_target_free(SrvTarget *target);
+static void _srv_cache_entry_free(SrvCacheEntry *entry);
+
+// DNS and the connection race run on a worker thread, the callback is
+// called from srv_process once it is done, a race already running is
+// cancelled
+void
+srv_race_start(const char *const domain, srv_raced_cb callback)
+{
+    srv_race_cancel();
+
+    if (raced == NULL) {
+        raced = g_async_queue_new();
+    }
+
+    SrvRace *race = calloc(1, sizeof(SrvRace));
+    race->domain = strdup(domain);
+    race->callback = callback;
+    race->raced = g_async_queue_ref(raced);
+    current = race;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+    GError *error = NULL;
+    GThread *thread = g_thread_try_new("srv race", (GThreadFunc)_srv_race_run, race, &error);
+    if (thread) {
+        g_thread_unref(thread);
+        return;
+    }
+    log_warning("SRV race could not start a thread, running it now. %s", error->message);
+    g_error_free(error);
+#endif
+
+    _srv_race_run(race);
+}
+
+// the result of a race still running is dropped when it finishes
+void
+srv_race_cancel(void)
+{
+    if (current) {
+        g_atomic_int_set(&current->cancelled, 1);
+        current = NULL;
+    }
+}
+
+// calls back for the race that finished, from the main loop
+void
+srv_process(void)
+{
+    if (raced == NULL) {
+        return;
+    }
+
+    SrvRace *race = NULL;
+    while ((race = g_async_queue_try_pop(raced)) != NULL) {
+        if (race->host) {
+            log_info("SRV race for %s won by %s:%d", race->domain, race->host, race->port);
+        } else if (race->unreachable) {
+            log_info("SRV race for %s found no reachable target", race->domain);
+        }
+        if (race == current) {
+            current = NULL;
+            race->callback(race->host, race->port);
+        }
+        _srv_race_free(race);
+    }
+}
+
+static gpointer
+_srv_race_run(SrvRace *race)
+{
+    if (!_srv_race_targets(race)) {
+        free(race->host);
+        race->host = NULL;
+        race->port = 0;
+    }
+
+    GAsyncQueue *queue = race->raced;
+    race->raced = NULL;
+    g_async_queue_push(queue, race);
+    g_async_queue_unref(queue);
+
+    return NULL;
+}
+
+static void
+_srv_race_free(SrvRace *race)
+{
+    free(race->domain);
+    free(race->host);
+    free(race);
+}
+
+// race connections to the top client SRV targets of the domain and their
+// address families, the address that connected first is returned for
+// libstrophe to connect to, FALSE when there are no SRV records and the
+// domain should be connected to as usual
+static gboolean
+_srv_race_targets(SrvRace *race)
+{
+    GSList *targets = _srv_lookup(race->domain);
+    if (targets == NULL) {
+        return FALSE;
+    }
+
+    GSList *attempts = _srv_attempts(targets);
+    g_slist_free_full(targets, (GDestroyNotify)_srv_target_free);
+    if (attempts == NULL) {
+        return FALSE;
+    }
+
+    SrvAttempt *winner = NULL;
+    gboolean result = _srv_race(attempts, &race->cancelled, &winner);
+    if (result) {
+        char addr_str[NI_MAXHOST];
+        if (getnameinfo((struct sockaddr*)&winner->addr, winner->addrlen, addr_str, sizeof(addr_str),
+                NULL, 0, NI_NUMERICHOST) == 0) {
+            race->host = strdup(addr_str);
+            race->port = winner->port;
+        } else {
+            result = FALSE;
+        }
+    } else {
+        race->unreachable = TRUE;
+    }
+
+    g_slist_free_full(attempts, free);
+
+    return result;
+}
+
+void
+srv_cache_clear(void)
+{
+    G_LOCK(srv_cache);
+    if (srv_cache) {
+        g_hash_table_destroy(srv_cache);
+        srv_cache = NULL;
+    }
+    G_UNLOCK(srv_cache);
+}
+
+// returns a copy of the targets for the domain, called from a worker
+static GSList*
+_srv_lookup(const char *const domain)
+{
+    GSList *result = NULL;
+
+    G_LOCK(srv_cache);
+    SrvCacheEntry *entry = srv_cache ? g_hash_table_lookup(srv_cache, domain) : NULL;
+    if (entry && (entry->expires > time(NULL))) {
+        result = _srv_targets_copy(entry->targets);
+        G_UNLOCK(srv_cache);
+        return result;
+    }
+    G_UNLOCK(srv_cache);
+
+    time_t expires = 0;
+    GSList *targets = _srv_query(domain, &expires);
+
+    G_LOCK(srv_cache);
+    if (srv_cache == NULL) {
+        srv_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_srv_cache_entry_free);
+    }
+    if (targets == NULL) {
+        g_hash_table_remove(srv_cache, domain);
+    } else {
+        entry = malloc(sizeof(SrvCacheEntry));
+        entry->targets = targets;
+        entry->expires = expires;
+        g_hash_table_replace(srv_cache, strdup(domain), entry);
+        result = _srv_targets_copy(targets);
+    }
+    G_UNLOCK(srv_cache);
+
+    return result;
+}
+
+static GSList*
+_srv_targets_copy(GSList *targets)
+{
+    GSList *result = NULL;
+    GSList *curr = targets;
+    while (curr) {
+        SrvTarget *target = curr->data;
+        SrvTarget *copy = malloc(sizeof(SrvTarget));
+        copy->host = strdup(target->host);
+        copy->port = target->port;
+        copy->priority = target->priority;
+        copy->weight = target->weight;
+        result = g_slist_append(result, copy);
+        curr = g_slist_next(curr);
+    }
+
+    return result;
+}
+
+#ifdef HAVE_RES_QUERY
+static GSList*
+_srv_query(const char *const domain, time_t *expires)
+{
+    unsigned char answer[NS_PACKETSZ * 4];
+    char *name = g_strdup_printf("_xmpp-client._tcp.%s", domain);
+    int len = res_query(name, ns_c_in, ns_t_srv, answer, sizeof(answer));
+    g_free(name);
+    if (len < 0) {
+        return NULL;
+    }
+
+    ns_msg msg;
+    if (ns_initparse(answer, len, &msg) < 0) {
+        return NULL;
+    }
+
+    GSList *targets = NULL;
+    guint32 ttl = G_MAXUINT32;
+    int count = ns_msg_count(msg, ns_s_an);
+    int i;
+    for (i = 0; i < count; i++) {
+        ns_rr rr;
+        if ((ns_parserr(&msg, ns_s_an, i, &rr) < 0) || (ns_rr_type(rr) != ns_t_srv) || (ns_rr_rdlen(rr) < 7)) {
+            continue;
+        }
+
+        const unsigned char *rdata = ns_rr_rdata(rr);
+        char target_name[NS_MAXDNAME];
+        if (dn_expand(ns_msg_base(msg), ns_msg_end(msg), rdata + 6, target_name, sizeof(target_name)) < 0) {
+            continue;
+        }
+
+        // a single "." target means the service is not offered
+        if ((target_name[0] == '\0') || (g_strcmp0(target_name, ".") == 0)) {
+            continue;
+        }
+
+        SrvTarget *target = malloc(sizeof(SrvTarget));
+        target->priority = ns_get16(rdata);
+        target->weight = ns_get16(rdata + 2);
+        target->port = ns_get16(rdata + 4);
+        target->host = strdup(target_name);
+        targets = g_slist_insert_sorted(targets, target, _srv_compare_targets);
+
+        if (ns_rr_ttl(rr) < ttl) {
+            ttl = ns_rr_ttl(rr);
+        }
+    }
+
+    *expires = time(NULL) + ttl;
+
+    return targets;
+}
+#else
+static GSList*
+_srv_query(const char *const domain, time_t *expires)
+{
+    return NULL;
+}
+#endif
+
+// addresses of the top targets, within a target the address families
+// are interleaved so a broken IPv6 path does not hold up IPv4
+static GSList*
+_srv_attempts(GSList *targets)
+{
+    GSList *attempts = NULL;
+    int count = 0;
+    int targets_used = 0;
+
+    GSList *curr = targets;
+    while (curr && (targets_used < SRV_RACE_TARGETS) && (count < SRV_RACE_ADDRESSES)) {
+        SrvTarget *target = curr->data;
+        targets_used++;
+
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        char port_str[8];
+        snprintf(port_str, sizeof(port_str), "%d", target->port);
+
+        struct addrinfo *res = NULL;
+        if (getaddrinfo(target->host, port_str, &hints, &res) != 0) {
+            curr = g_slist_next(curr);
+            continue;
+        }
+
+        GSList *inet6 = NULL;
+        GSList *inet = NULL;
+        struct addrinfo *ai;
+        for (ai = res; ai; ai = ai->ai_next) {
+            if ((ai->ai_family != AF_INET6) && (ai->ai_family != AF_INET)) {
+                continue;
+            }
+            SrvAttempt *attempt = malloc(sizeof(SrvAttempt));
+            attempt->fd = -1;
+            memcpy(&attempt->addr, ai->ai_addr, ai->ai_addrlen);
+            attempt->addrlen = ai->ai_addrlen;
+            attempt->port = target->port;
+            if (ai->ai_family == AF_INET6) {
+                inet6 = g_slist_append(inet6, attempt);
+            } else {
+                inet = g_slist_append(inet, attempt);
+            }
+        }
+        freeaddrinfo(res);
+
+        GSList *curr6 = inet6;
+        GSList *curr4 = inet;
+        while (curr6 || curr4) {
+            if (curr6) {
+                attempts = g_slist_append(attempts, curr6->data);
+                curr6 = g_slist_next(curr6);
+            }
+            if (curr4) {
+                attempts = g_slist_append(attempts, curr4->data);
+                curr4 = g_slist_next(curr4);
+            }
+        }
+        g_slist_free(inet6);
+        g_slist_free(inet);
+        count = g_slist_length(attempts);
+
+        curr = g_slist_next(curr);
+    }
+
+    // keep the race bounded
+    while (g_slist_length(attempts) > SRV_RACE_ADDRESSES) {
+        GSList *last = g_slist_last(attempts);
+        free(last->data);
+        attempts = g_slist_delete_link(attempts, last);
+    }
+
+    return attempts;
+}
+
+// start a non blocking connect every SRV_RACE_STAGGER_MS in order, the
+// first to complete wins, all sockets are closed as libstrophe makes its
+// own connection, a cancel is noticed within SRV_RACE_STAGGER_MS
+static gboolean
+_srv_race(GSList *attempts, volatile gint *cancelled, SrvAttempt **winner)
+{
+    int total = g_slist_length(attempts);
+    SrvAttempt *started[SRV_RACE_ADDRESSES];
+    int num_started = 0;
+    int num_failed = 0;
+    GSList *next = attempts;
+    GTimer *timer = g_timer_new();
+    gulong next_start_ms = 0;
+
+    *winner = NULL;
+    while (*winner == NULL) {
+        gulong elapsed_ms = g_timer_elapsed(timer, NULL) * 1000;
+        if ((elapsed_ms >= SRV_RACE_TIMEOUT_MS) || g_atomic_int_get(cancelled)) {
+            break;
+        }
+
+        // start the next attempt when due, or straight away when all
+        // running attempts have failed
+        if (next && ((elapsed_ms >= next_start_ms) || (num_failed == num_started))) {
+            SrvAttempt *attempt = next->data;
+            next = g_slist_next(next);
+            next_start_ms = elapsed_ms + SRV_RACE_STAGGER_MS;
+
+            attempt->fd = socket(attempt->addr.ss_family, SOCK_STREAM, 0);
+            if (attempt->fd >= 0) {
+                fcntl(attempt->fd, F_SETFL, fcntl(attempt->fd, F_GETFL, 0) | O_NONBLOCK);
+                if ((connect(attempt->fd, (struct sockaddr*)&attempt->addr, attempt->addrlen) == 0)) {
+                    *winner = attempt;
+                } else if (errno != EINPROGRESS) {
+                    close(attempt->fd);
+                    attempt->fd = -1;
+                }
+            }
+            started[num_started++] = attempt;
+            if (attempt->fd < 0) {
+                num_failed++;
+            }
+            continue;
+        }
+
+        if (num_failed == total) {
+            break;
+        }
+
+        struct pollfd fds[SRV_RACE_ADDRESSES];
+        SrvAttempt *polled[SRV_RACE_ADDRESSES];
+        int nfds = 0;
+        int i;
+        for (i = 0; i < num_started; i++) {
+            if (started[i]->fd >= 0) {
+                fds[nfds].fd = started[i]->fd;
+                fds[nfds].events = POLLOUT;
+                fds[nfds].revents = 0;
+                polled[nfds] = started[i];
+                nfds++;
+            }
+        }
+
+        int timeout_ms = SRV_RACE_TIMEOUT_MS - elapsed_ms;
+        if (next && (next_start_ms - elapsed_ms < timeout_ms)) {
+            timeout_ms = next_start_ms - elapsed_ms;
+        }
+        if (timeout_ms > SRV_RACE_STAGGER_MS) {
+            timeout_ms = SRV_RACE_STAGGER_MS;
+        }
+        if (poll(fds, nfds, timeout_ms) <= 0) {
+            continue;
+        }
+
+        for (i = 0; i < nfds && *winner == NULL; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if ((getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0) && (error == 0)) {
+                *winner = polled[i];
+            } else {
+                close(polled[i]->fd);
+                polled[i]->fd = -1;
+                num_failed++;
+            }
+        }
+    }
+
+    int i;
+    for (i = 0; i < num_started; i++) {
+        if (started[i]->fd >= 0) {
+            close(started[i]->fd);
+            started[i]->fd = -1;
+        }
+    }
+    g_timer_destroy(timer);
+
+    return (*winner != NULL);
+}
+
+// lowest priority first, then highest weight
+static gint
+_srv_compare_targets(gconstpointer a, gconstpointer b)
+{
+    const SrvTarget *target_a = a;
+    const SrvTarget *target_b = b;
+
+    if (target_a->priority != target_b->priority) {
+        return target_a->priority - target_b->priority;
+    }
+
+    return target_b->weight - target_a->weight;
+}
+
+static void
+_srv_target_free(SrvTarget *target)
+{
+    free(target->host);
+    free(target);
+}
+
+static void
+_srv_cache_entry_free(SrvCacheEntry *entry)
+{
+    g_slist_free_full(entry->targets, (GDestroyNotify)_srv_target_free);
+    free(entry);
+}
@@ -52,9 +52,13 @@
 #include "xmpp/stanza.h"
 #include "xmpp/capabilities.h"
 #include "xmpp/form.h"
+#include "tools/arena.h"
 
 #include "muc.h"
 
+static gboolean _is_chat_state(const char *const name);
+static void _decode_muc_user(xmpp_stanza_t *const muc_user, StanzaChildren *const children);
+
 #if 0
 xmpp_stanza_t*
 stanza_create_bookmarks_pubsub_request(xmpp_ctx_t *ctx)
@@ -249,25 +253,272 @@ stanza_disable_carbons(xmpp_ctx_t *ctx)
 }
 
 xmpp_stanza_t*
-stanza_create_chat_state(xmpp_ctx_t *ctx, const char *const fulljid, const char *const state)
+stanza_create_sm_enable(xmpp_ctx_t *ctx)
 {
-    xmpp_stanza_t *msg, *chat_state;
+    xmpp_stanza_t *enable = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(enable, STANZA_NAME_ENABLE);
+    xmpp_stanza_set_ns(enable, STANZA_NS_SM);
 
-    msg = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(msg, STANZA_NAME_MESSAGE);
-    xmpp_stanza_set_type(msg, STANZA_TYPE_CHAT);
-    xmpp_stanza_set_attribute(msg, STANZA_ATTR_TO, fulljid);
+    return enable;
+}
+
+xmpp_stanza_t*
+stanza_create_sm_request(xmpp_ctx_t *ctx)
+{
+    xmpp_stanza_t *request = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(request, STANZA_NAME_SM_REQUEST);
+    xmpp_stanza_set_ns(request, STANZA_NS_SM);
+
+    return request;
+}
+
+xmpp_stanza_t*
+stanza_create_sm_ack(xmpp_ctx_t *ctx, guint32 handled)
+{
+    xmpp_stanza_t *ack = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(ack, STANZA_NAME_SM_ACK);
+    xmpp_stanza_set_ns(ack, STANZA_NS_SM);
+
+    char *h_str = g_strdup_printf("%u", handled);
+    xmpp_stanza_set_attribute(ack, STANZA_ATTR_H, h_str);
+    g_free(h_str);
+
+    return ack;
+}
+
+xmpp_stanza_t*
+stanza_create_csi(xmpp_ctx_t *ctx, gboolean active)
+{
+    xmpp_stanza_t *csi = xmpp_stanza_new(ctx);
+    if (active) {
+        xmpp_stanza_set_name(csi, STANZA_NAME_ACTIVE);
+    } else {
+        xmpp_stanza_set_name(csi, STANZA_NAME_INACTIVE);
+    }
+    xmpp_stanza_set_ns(csi, STANZA_NS_CSI);
+
+    return csi;
+}
+
+static void
+_add_form_field(xmpp_ctx_t *ctx, xmpp_stanza_t *x, const char *const var, const char *const type,
+    const char *const value)
+{
+    xmpp_stanza_t *field = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(field, STANZA_NAME_FIELD);
+    xmpp_stanza_set_attribute(field, STANZA_ATTR_VAR, var);
+    if (type) {
+        xmpp_stanza_set_attribute(field, STANZA_ATTR_TYPE, type);
+    }
+
+    xmpp_stanza_t *value_st = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(value_st, STANZA_NAME_VALUE);
+    xmpp_stanza_t *value_text = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_text(value_text, value);
+    xmpp_stanza_add_child(value_st, value_text);
+    xmpp_stanza_release(value_text);
+    xmpp_stanza_add_child(field, value_st);
+    xmpp_stanza_release(value_st);
+
+    xmpp_stanza_add_child(x, field);
+    xmpp_stanza_release(field);
+}
+
+// XEP-0313 query for the page of at most max messages before the RSM id
+// before, an empty before asks for the last page, the id is also used as
+// the queryid so results can be matched to the query
+xmpp_stanza_t*
+stanza_create_mam_iq(xmpp_ctx_t *ctx, const char *const id, const char *const to,
+    const char *const with, const char *const end, const char *const before, int max)
+{
+    xmpp_stanza_t *iq = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(iq, STANZA_NAME_IQ);
+    xmpp_stanza_set_type(iq, STANZA_TYPE_SET);
+    xmpp_stanza_set_id(iq, id);
+    if (to) {
+        xmpp_stanza_set_attribute(iq, STANZA_ATTR_TO, to);
+    }
+
+    xmpp_stanza_t *query = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
+    xmpp_stanza_set_ns(query, STANZA_NS_MAM2);
+    xmpp_stanza_set_attribute(query, STANZA_ATTR_QUERYID, id);
+
+    xmpp_stanza_t *x = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(x, STANZA_NAME_X);
+    xmpp_stanza_set_ns(x, STANZA_NS_DATA);
+    xmpp_stanza_set_attribute(x, STANZA_ATTR_TYPE, "submit");
+    _add_form_field(ctx, x, "FORM_TYPE", "hidden", STANZA_NS_MAM2);
+    if (with) {
+        _add_form_field(ctx, x, "with", NULL, with);
+    }
+    if (end) {
+        _add_form_field(ctx, x, "end", NULL, end);
+    }
+    xmpp_stanza_add_child(query, x);
+    xmpp_stanza_release(x);
+
+    xmpp_stanza_t *set = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(set, STANZA_NAME_SET);
+    xmpp_stanza_set_ns(set, STANZA_NS_RSM);
+
+    char max_str[16];
+    snprintf(max_str, sizeof(max_str), "%d", max);
+    xmpp_stanza_t *max_st = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(max_st, STANZA_NAME_MAX);
+    xmpp_stanza_t *max_text = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_text(max_text, max_str);
+    xmpp_stanza_add_child(max_st, max_text);
+    xmpp_stanza_release(max_text);
+    xmpp_stanza_add_child(set, max_st);
+    xmpp_stanza_release(max_st);
+
+    xmpp_stanza_t *before_st = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(before_st, STANZA_NAME_BEFORE);
+    if (before && strlen(before) > 0) {
+        xmpp_stanza_t *before_text = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_text(before_text, before);
+        xmpp_stanza_add_child(before_st, before_text);
+        xmpp_stanza_release(before_text);
+    }
+    xmpp_stanza_add_child(set, before_st);
+    xmpp_stanza_release(before_st);
+
+    xmpp_stanza_add_child(query, set);
+    xmpp_stanza_release(set);
+
+    xmpp_stanza_add_child(iq, query);
+    xmpp_stanza_release(query);
+
+    return iq;
+}
+
+// asks the upload service for a slot to put a file of size bytes
+xmpp_stanza_t*
+stanza_create_http_upload_request(xmpp_ctx_t *ctx, const char *const id, const char *const to,
+    const char *const filename, goffset size)
+{
+    xmpp_stanza_t *iq = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(iq, STANZA_NAME_IQ);
+    xmpp_stanza_set_type(iq, STANZA_TYPE_GET);
+    xmpp_stanza_set_id(iq, id);
+    xmpp_stanza_set_attribute(iq, STANZA_ATTR_TO, to);
+
+    char size_str[32];
+    snprintf(size_str, sizeof(size_str), "%" G_GOFFSET_FORMAT, size);
+
+    xmpp_stanza_t *request = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(request, STANZA_NAME_REQUEST);
+    xmpp_stanza_set_ns(request, STANZA_NS_HTTP_UPLOAD);
+    xmpp_stanza_set_attribute(request, STANZA_ATTR_FILENAME, filename);
+    xmpp_stanza_set_attribute(request, STANZA_ATTR_SIZE, size_str);
+
+    xmpp_stanza_add_child(iq, request);
+    xmpp_stanza_release(request);
+
+    return iq;
+}
+
+// appends value as it may appear in an attribute
+static void
+_stanza_text_escape(GString *text, const char *const value)
+{
+    const char *curr = NULL;
+    for (curr = value; *curr; curr++) {
+        switch (*curr)
+        {
+            case '&':
+                g_string_append(text, "&amp;");
+                break;
+            case '<':
+                g_string_append(text, "&lt;");
+                break;
+            case '>':
+                g_string_append(text, "&gt;");
+                break;
+            case '"':
+                g_string_append(text, "&quot;");
+                break;
+            default:
+                g_string_append_c(text, *curr);
+                break;
+        }
+    }
+}
+
+static void
+_stanza_text_attribute(GString *text, const char *const name, const char *const value)
+{
+    g_string_append_c(text, ' ');
+    g_string_append(text, name);
+    g_string_append(text, "=\"");
+    _stanza_text_escape(text, value);
+    g_string_append_c(text, '"');
+}
+
+// the stanza_text functions write the fixed shape stanzas sent most often
+// straight to text for connection_send_text, without building them first
+gchar*
+stanza_text_chat_state(const char *const fulljid, const char *const state)
+{
+    GString *text = g_string_sized_new(160);
+    g_string_append(text, "<" STANZA_NAME_MESSAGE);
+    _stanza_text_attribute(text, STANZA_ATTR_TYPE, STANZA_TYPE_CHAT);
+    _stanza_text_attribute(text, STANZA_ATTR_TO, fulljid);
     char *id = create_unique_id(NULL);
-    xmpp_stanza_set_id(msg, id);
+    _stanza_text_attribute(text, STANZA_ATTR_ID, id);
     free(id);
+    g_string_append_printf(text, "><%s xmlns=\"" STANZA_NS_CHATSTATES "\"/></" STANZA_NAME_MESSAGE ">", state);
 
-    chat_state = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(chat_state, state);
-    xmpp_stanza_set_ns(chat_state, STANZA_NS_CHATSTATES);
-    xmpp_stanza_add_child(msg, chat_state);
-    xmpp_stanza_release(chat_state);
+    return g_string_free(text, FALSE);
+}
 
-    return msg;
+gchar*
+stanza_text_receipt(const char *const fulljid, const char *const message_id)
+{
+    GString *text = g_string_sized_new(160);
+    g_string_append(text, "<" STANZA_NAME_MESSAGE);
+    char *id = create_unique_id("receipt");
+    _stanza_text_attribute(text, STANZA_ATTR_ID, id);
+    free(id);
+    _stanza_text_attribute(text, STANZA_ATTR_TO, fulljid);
+    g_string_append(text, "><received xmlns=\"" STANZA_NS_RECEIPTS "\"");
+    _stanza_text_attribute(text, STANZA_ATTR_ID, message_id);
+    g_string_append(text, "/></" STANZA_NAME_MESSAGE ">");
+
+    return g_string_free(text, FALSE);
+}
+
+// marker is one of received, displayed or acknowledged
+gchar*
+stanza_text_marker(const char *const fulljid, const char *const marker, const char *const message_id)
+{
+    GString *text = g_string_sized_new(160);
+    g_string_append(text, "<" STANZA_NAME_MESSAGE);
+    char *id = create_unique_id("marker");
+    _stanza_text_attribute(text, STANZA_ATTR_ID, id);
+    free(id);
+    _stanza_text_attribute(text, STANZA_ATTR_TO, fulljid);
+    g_string_append_printf(text, "><%s xmlns=\"" STANZA_NS_CHAT_MARKERS "\"", marker);
+    _stanza_text_attribute(text, STANZA_ATTR_ID, message_id);
+    g_string_append(text, "/></" STANZA_NAME_MESSAGE ">");
+
+    return g_string_free(text, FALSE);
+}
+
+gchar*
+stanza_text_ping_iq(const char *const id, const char *const target)
+{
+    GString *text = g_string_sized_new(128);
+    g_string_append(text, "<" STANZA_NAME_IQ);
+    _stanza_text_attribute(text, STANZA_ATTR_TYPE, STANZA_TYPE_GET);
+    if (target) {
+        _stanza_text_attribute(text, STANZA_ATTR_TO, target);
+    }
+    _stanza_text_attribute(text, STANZA_ATTR_ID, id);
+    g_string_append(text, "><" STANZA_NAME_PING " xmlns=\"" STANZA_NS_PING "\"/></" STANZA_NAME_IQ ">");
+
+    return g_string_free(text, FALSE);
 }
 
 xmpp_stanza_t*
@@ -354,7 +605,19 @@ stanza_attach_receipt_request(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza)
 }
 
 xmpp_stanza_t*
-stanza_create_message(xmpp_ctx_t *ctx, char *id, const char *const recipient,
+stanza_attach_markable(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza)
+{
+    xmpp_stanza_t *markable = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(markable, "markable");
+    xmpp_stanza_set_ns(markable, STANZA_NS_CHAT_MARKERS);
+    xmpp_stanza_add_child(stanza, markable);
+    xmpp_stanza_release(markable);
+
+    return stanza;
+}
+
+xmpp_stanza_t*
+stanza_create_message(xmpp_ctx_t *ctx, const char *const id, const char *const recipient,
     const char *const type, const char *const message)
 {
     xmpp_stanza_t *msg, *body, *text;
@@ -907,7 +1170,7 @@ stanza_create_software_version_iq(xmpp_ctx_t *ctx, const char *const fulljid)
 }
 
 xmpp_stanza_t*
-stanza_create_roster_iq(xmpp_ctx_t *ctx)
+stanza_create_roster_iq(xmpp_ctx_t *ctx, const char *const ver)
 {
     xmpp_stanza_t *iq = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(iq, STANZA_NAME_IQ);
@@ -917,6 +1180,9 @@ stanza_create_roster_iq(xmpp_ctx_t *ctx)
     xmpp_stanza_t *query = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
     xmpp_stanza_set_ns(query, XMPP_NS_ROSTER);
+    if (ver) {
+        xmpp_stanza_set_attribute(query, STANZA_ATTR_VER, ver);
+    }
 
     xmpp_stanza_add_child(iq, query);
     xmpp_stanza_release(query);
@@ -947,9 +1213,11 @@ stanza_create_disco_info_iq(xmpp_ctx_t *ctx, const char *const id, const char *c
     return iq;
 }
 
+// XEP-0059 asks for a page of at most max items after the RSM id after,
+// or the first page when after is NULL, servers without RSM send them all
 xmpp_stanza_t*
 stanza_create_disco_items_iq(xmpp_ctx_t *ctx, const char *const id,
-    const char *const jid)
+    const char *const jid, int max, const char *const after)
 {
     xmpp_stanza_t *iq = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(iq, STANZA_NAME_IQ);
@@ -961,6 +1229,35 @@ stanza_create_disco_items_iq(xmpp_ctx_t *ctx, const char *const id,
     xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
     xmpp_stanza_set_ns(query, XMPP_NS_DISCO_ITEMS);
 
+    xmpp_stanza_t *set = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(set, STANZA_NAME_SET);
+    xmpp_stanza_set_ns(set, STANZA_NS_RSM);
+
+    char max_str[16];
+    snprintf(max_str, sizeof(max_str), "%d", max);
+    xmpp_stanza_t *max_st = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(max_st, STANZA_NAME_MAX);
+    xmpp_stanza_t *max_text = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_text(max_text, max_str);
+    xmpp_stanza_add_child(max_st, max_text);
+    xmpp_stanza_release(max_text);
+    xmpp_stanza_add_child(set, max_st);
+    xmpp_stanza_release(max_st);
+
+    if (after) {
+        xmpp_stanza_t *after_st = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_name(after_st, STANZA_NAME_AFTER);
+        xmpp_stanza_t *after_text = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_text(after_text, after);
+        xmpp_stanza_add_child(after_st, after_text);
+        xmpp_stanza_release(after_text);
+        xmpp_stanza_add_child(set, after_st);
+        xmpp_stanza_release(after_st);
+    }
+
+    xmpp_stanza_add_child(query, set);
+    xmpp_stanza_release(set);
+
     xmpp_stanza_add_child(iq, query);
     xmpp_stanza_release(query);
 
@@ -1011,92 +1308,157 @@ stanza_create_room_config_submit_iq(xmpp_ctx_t *ctx, const char *const room, Dat
     return iq;
 }
 
-gboolean
-stanza_contains_chat_state(xmpp_stanza_t *stanza)
+void
+stanza_decode(xmpp_stanza_t *const stanza, StanzaChildren *const children)
 {
-    return ((xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_ACTIVE) != NULL) ||
-            (xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_COMPOSING) != NULL) ||
-            (xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_PAUSED) != NULL) ||
-            (xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_GONE) != NULL) ||
-            (xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_INACTIVE) != NULL));
+    memset(children, 0, sizeof(StanzaChildren));
+
+    xmpp_stanza_t *child = xmpp_stanza_get_children(stanza);
+    while (child) {
+        char *name = xmpp_stanza_get_name(child);
+        if (name == NULL) {
+            child = xmpp_stanza_get_next(child);
+            continue;
+        }
+        char *ns = xmpp_stanza_get_ns(child);
+
+        if (!children->body && (strcmp(name, STANZA_NAME_BODY) == 0)) {
+            children->body = child;
+        } else if (!children->subject && (strcmp(name, STANZA_NAME_SUBJECT) == 0)) {
+            children->subject = child;
+        } else if (!children->show && (strcmp(name, STANZA_NAME_SHOW) == 0)) {
+            children->show = child;
+        } else if (!children->status && (strcmp(name, STANZA_NAME_STATUS) == 0)) {
+            children->status = child;
+        } else if (!children->priority && (strcmp(name, STANZA_NAME_PRIORITY) == 0)) {
+            children->priority = child;
+        } else if (!children->chat_state && _is_chat_state(name)) {
+            children->chat_state = name;
+        } else if (ns) {
+            if (!children->delay && (strcmp(name, STANZA_NAME_DELAY) == 0) && (strcmp(ns, "urn:xmpp:delay") == 0)) {
+                children->delay = child;
+            } else if (!children->legacy_delay && (strcmp(name, STANZA_NAME_X) == 0) && (strcmp(ns, "jabber:x:delay") == 0)) {
+                children->legacy_delay = child;
+            } else if (!children->caps && (strcmp(name, STANZA_NAME_C) == 0) && (strcmp(ns, STANZA_NS_CAPS) == 0)) {
+                children->caps = child;
+            } else if (!children->last_activity && (strcmp(name, STANZA_NAME_QUERY) == 0) && (strcmp(ns, STANZA_NS_LASTACTIVITY) == 0)) {
+                children->last_activity = child;
+            } else if (!children->receipt && (strcmp(ns, STANZA_NS_RECEIPTS) == 0)) {
+                children->receipt = child;
+            } else if (!children->marker && (strcmp(ns, STANZA_NS_CHAT_MARKERS) == 0)) {
+                children->marker = child;
+            } else if (!children->carbons && (strcmp(ns, STANZA_NS_CARBONS) == 0)) {
+                children->carbons = child;
+            } else if (!children->conference && (strcmp(ns, STANZA_NS_CONFERENCE) == 0)) {
+                children->conference = child;
+            } else if (!children->captcha && (strcmp(ns, STANZA_NS_CAPTCHA) == 0)) {
+                children->captcha = child;
+            } else if (!children->encrypted && (strcmp(ns, STANZA_NS_ENCRYPTED) == 0)) {
+                children->encrypted = child;
+            } else if (!children->signature && (strcmp(ns, STANZA_NS_SIGNED) == 0)) {
+                children->signature = child;
+            } else if (!children->mam_result && (strcmp(name, STANZA_NAME_RESULT) == 0) && (strcmp(ns, STANZA_NS_MAM2) == 0)) {
+                children->mam_result = child;
+            } else if (!children->stanza_id && (strcmp(name, STANZA_NAME_STANZA_ID) == 0) && (strcmp(ns, STANZA_NS_STABLE_ID) == 0)) {
+                children->stanza_id = child;
+            } else if (!children->origin_id && (strcmp(name, STANZA_NAME_ORIGIN_ID) == 0) && (strcmp(ns, STANZA_NS_STABLE_ID) == 0)) {
+                children->origin_id = child;
+            } else if (!children->muc_user && (strcmp(ns, STANZA_NS_MUC_USER) == 0)) {
+                children->muc_user = child;
+                _decode_muc_user(child, children);
+            }
+        }
+
+        child = xmpp_stanza_get_next(child);
+    }
 }
 
-xmpp_stanza_t*
-stanza_create_ping_iq(xmpp_ctx_t *ctx, const char *const target)
+GDateTime*
+stanza_decoded_delay(const StanzaChildren *const children)
 {
-    xmpp_stanza_t *iq = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(iq, STANZA_NAME_IQ);
-    xmpp_stanza_set_type(iq, STANZA_TYPE_GET);
-    if (target) {
-        xmpp_stanza_set_attribute(iq, STANZA_ATTR_TO, target);
+    // prefer XEP-0203 delayed delivery over XEP-0091 legacy delayed delivery
+    // legacy stamp format : CCYYMMDDThh:mm:ss
+    xmpp_stanza_t *delay = children->delay ? children->delay : children->legacy_delay;
+    if (!delay) {
+        return NULL;
     }
-    char *id = create_unique_id("ping");
-    xmpp_stanza_set_id(iq, id);
-    free(id);
 
-    xmpp_stanza_t *ping = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(ping, STANZA_NAME_PING);
+    GTimeVal utc_stamp;
+    char *stamp = xmpp_stanza_get_attribute(delay, STANZA_ATTR_STAMP);
+    if (stamp && (g_time_val_from_iso8601(stamp, &utc_stamp))) {
+        GDateTime *utc_datetime = g_date_time_new_from_timeval_utc(&utc_stamp);
+        GDateTime *local_datetime = g_date_time_to_local(utc_datetime);
+        g_date_time_unref(utc_datetime);
+        return local_datetime;
+    }
 
-    xmpp_stanza_set_ns(ping, STANZA_NS_PING);
+    return NULL;
+}
 
-    xmpp_stanza_add_child(iq, ping);
-    xmpp_stanza_release(ping);
+// the id its sender gave a message where there is one, which stays the
+// same over carbons, room history and resends, otherwise the id a server
+// gave it, see XEP-0359
+const char*
+stanza_decoded_message_id(xmpp_stanza_t *const stanza, const StanzaChildren *const children)
+{
+    const char *id = NULL;
+    if (children->origin_id) {
+        id = xmpp_stanza_get_attribute(children->origin_id, STANZA_ATTR_ID);
+    }
+    if (!id) {
+        id = xmpp_stanza_get_id(stanza);
+    }
+    if (!id && children->stanza_id) {
+        id = xmpp_stanza_get_attribute(children->stanza_id, STANZA_ATTR_ID);
+    }
 
-    return iq;
+    return id;
 }
 
-GDateTime*
-stanza_get_delay(xmpp_stanza_t *const stanza)
+XMPPCaps*
+stanza_decoded_caps(const StanzaChildren *const children)
 {
-    GTimeVal utc_stamp;
-    // first check for XEP-0203 delayed delivery
-    xmpp_stanza_t *delay = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_DELAY);
-    if (delay) {
-        char *xmlns = xmpp_stanza_get_attribute(delay, STANZA_ATTR_XMLNS);
-        if (xmlns && (strcmp(xmlns, "urn:xmpp:delay") == 0)) {
-            char *stamp = xmpp_stanza_get_attribute(delay, STANZA_ATTR_STAMP);
-            if (stamp && (g_time_val_from_iso8601(stamp, &utc_stamp))) {
-                GDateTime *utc_datetime = g_date_time_new_from_timeval_utc(&utc_stamp);
-                GDateTime *local_datetime = g_date_time_to_local(utc_datetime);
-                g_date_time_unref(utc_datetime);
-                return local_datetime;
-            }
-        }
+    if (!children->caps) {
+        return NULL;
     }
 
-    // otherwise check for XEP-0091 legacy delayed delivery
-    // stanp format : CCYYMMDDThh:mm:ss
-    xmpp_stanza_t *x = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_X);
-    if (x) {
-        char *xmlns = xmpp_stanza_get_attribute(x, STANZA_ATTR_XMLNS);
-        if (xmlns && (strcmp(xmlns, "jabber:x:delay") == 0)) {
-            char *stamp = xmpp_stanza_get_attribute(x, STANZA_ATTR_STAMP);
-            if (stamp && (g_time_val_from_iso8601(stamp, &utc_stamp))) {
-                GDateTime *utc_datetime = g_date_time_new_from_timeval_utc(&utc_stamp);
-                GDateTime *local_datetime = g_date_time_to_local(utc_datetime);
-                g_date_time_unref(utc_datetime);
-                return local_datetime;
-            }
-        }
+    char *hash = xmpp_stanza_get_attribute(children->caps, STANZA_ATTR_HASH);
+    char *node = xmpp_stanza_get_attribute(children->caps, STANZA_ATTR_NODE);
+    char *ver = xmpp_stanza_get_attribute(children->caps, STANZA_ATTR_VER);
+
+    XMPPCaps *caps = arena_alloc(sizeof(XMPPCaps));
+    caps->hash = arena_strdup(hash);
+    caps->node = arena_strdup(node);
+    caps->ver = arena_strdup(ver);
+
+    return caps;
+}
+
+static char*
+_stanza_arena_text(xmpp_stanza_t *const child, const char *const def)
+{
+    if (child == NULL) {
+        return arena_strdup(def);
     }
 
-    return NULL;
+    char *text = xmpp_stanza_get_text(child);
+    char *result = arena_strdup(text);
+    xmpp_free(connection_get_ctx(), text);
+
+    return result;
 }
 
 char*
-stanza_get_status(xmpp_stanza_t *stanza, char *def)
+stanza_decoded_text(xmpp_stanza_t *const child, char *def)
 {
-    xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_stanza_t *status =
-        xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_STATUS);
-
-    if (status) {
+    if (child) {
         // xmpp_free and free may be different functions so convert all to
         // libc malloc
         char *s1, *s2 = NULL;
-        s1 = xmpp_stanza_get_text(status);
+        s1 = xmpp_stanza_get_text(child);
         if (s1) {
             s2 = strdup(s1);
+            xmpp_ctx_t *ctx = connection_get_ctx();
             xmpp_free(ctx, s1);
         }
         return s2;
@@ -1107,28 +1469,51 @@ stanza_get_status(xmpp_stanza_t *stanza, char *def)
     }
 }
 
+gboolean
+stanza_decoded_has_status_code(const StanzaChildren *const children, const char *const code)
+{
+    int i;
+    for (i = 0; i < children->muc_status_count; i++) {
+        if (g_strcmp0(children->muc_status_codes[i], code) == 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+gboolean
+stanza_contains_chat_state(xmpp_stanza_t *stanza)
+{
+    StanzaChildren children;
+    stanza_decode(stanza, &children);
+
+    return children.chat_state != NULL;
+}
+
+GDateTime*
+stanza_get_delay(xmpp_stanza_t *const stanza)
+{
+    StanzaChildren children;
+    stanza_decode(stanza, &children);
+
+    return stanza_decoded_delay(&children);
+}
+
+char*
+stanza_get_status(xmpp_stanza_t *stanza, char *def)
+{
+    xmpp_stanza_t *status = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_STATUS);
+
+    return stanza_decoded_text(status, def);
+}
+
 char*
 stanza_get_show(xmpp_stanza_t *stanza, char *def)
 {
-    xmpp_ctx_t *ctx = connection_get_ctx();
-    xmpp_stanza_t *show =
-        xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_SHOW);
+    xmpp_stanza_t *show = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_SHOW);
 
-    if (show) {
-        // xmpp_free and free may be different functions so convert all to
-        // libc malloc
-        char *s1, *s2 = NULL;
-        s1 = xmpp_stanza_get_text(show);
-        if (s1) {
-            s2 = strdup(s1);
-            xmpp_free(ctx, s1);
-        }
-        return s2;
-    } else if (def) {
-        return strdup(def);
-    } else {
-        return NULL;
-    }
+    return stanza_decoded_text(show, def);
 }
 
 gboolean
@@ -1491,27 +1876,10 @@ stanza_get_idle_time(xmpp_stanza_t *const stanza)
 XMPPCaps*
 stanza_parse_caps(xmpp_stanza_t *const stanza)
 {
-    xmpp_stanza_t *caps_st = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_C);
-
-    if (!caps_st) {
-        return NULL;
-    }
-
-    char *ns = xmpp_stanza_get_ns(caps_st);
-    if (g_strcmp0(ns, STANZA_NS_CAPS) != 0) {
-        return NULL;
-    }
+    StanzaChildren children;
+    stanza_decode(stanza, &children);
 
-    char *hash = xmpp_stanza_get_attribute(caps_st, STANZA_ATTR_HASH);
-    char *node = xmpp_stanza_get_attribute(caps_st, STANZA_ATTR_NODE);
-    char *ver = xmpp_stanza_get_attribute(caps_st, STANZA_ATTR_VER);
-
-    XMPPCaps *caps = (XMPPCaps *)malloc(sizeof(XMPPCaps));
-    caps->hash = hash ? strdup(hash) : NULL;
-    caps->node = node ? strdup(node) : NULL;
-    caps->ver = ver ? strdup(ver) : NULL;
-
-    return caps;
+    return stanza_decoded_caps(&children);
 }
 
 char*
@@ -1628,6 +1996,44 @@ stanza_attach_priority(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence,
     }
 }
 
+// limits the history a room sends on join, negative values are left out
+void
+stanza_attach_muc_history(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence,
+    const int maxstanzas, const int maxchars, const int seconds, const char *const since)
+{
+    if (maxstanzas < 0 && maxchars < 0 && seconds < 0 && since == NULL) {
+        return;
+    }
+
+    xmpp_stanza_t *x = xmpp_stanza_get_child_by_ns(presence, STANZA_NS_MUC);
+    if (x == NULL) {
+        return;
+    }
+
+    xmpp_stanza_t *history = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(history, STANZA_NAME_HISTORY);
+
+    char value[16];
+    if (maxstanzas >= 0) {
+        snprintf(value, sizeof(value), "%d", maxstanzas);
+        xmpp_stanza_set_attribute(history, STANZA_ATTR_MAXSTANZAS, value);
+    }
+    if (maxchars >= 0) {
+        snprintf(value, sizeof(value), "%d", maxchars);
+        xmpp_stanza_set_attribute(history, STANZA_ATTR_MAXCHARS, value);
+    }
+    if (seconds >= 0) {
+        snprintf(value, sizeof(value), "%d", seconds);
+        xmpp_stanza_set_attribute(history, STANZA_ATTR_SECONDS, value);
+    }
+    if (since) {
+        xmpp_stanza_set_attribute(history, STANZA_ATTR_SINCE, since);
+    }
+
+    xmpp_stanza_add_child(x, history);
+    xmpp_stanza_release(history);
+}
+
 void
 stanza_attach_show(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence,
     const char *const show)
@@ -1724,23 +2130,6 @@ stanza_resource_from_presence(XMPPPresence *presence)
     return resource;
 }
 
-void
-stanza_free_caps(XMPPCaps *caps)
-{
-    if (caps) {
-        if (caps->hash) {
-            free(caps->hash);
-        }
-        if (caps->node) {
-            free(caps->node);
-        }
-        if (caps->ver) {
-            free(caps->ver);
-        }
-        FREE_SET_NULL(caps);
-    }
-}
-
 void
 stanza_free_presence(XMPPPresence *presence)
 {
@@ -1751,18 +2140,11 @@ stanza_free_presence(XMPPPresence *presence)
         if (presence->last_activity) {
             g_date_time_unref(presence->last_activity);
         }
-        if (presence->show) {
-            free(presence->show);
-        }
-        if (presence->status) {
-            free(presence->status);
-        }
-        FREE_SET_NULL(presence);
     }
 }
 
 XMPPPresence*
-stanza_parse_presence(xmpp_stanza_t *stanza, int *err)
+stanza_parse_presence(xmpp_stanza_t *stanza, const StanzaChildren *const children, int *err)
 {
     char *from = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_FROM);
     if (!from) {
@@ -1776,13 +2158,19 @@ stanza_parse_presence(xmpp_stanza_t *stanza, int *err)
         return NULL;
     }
 
-    XMPPPresence *result = (XMPPPresence *)malloc(sizeof(XMPPPresence));
+    XMPPPresence *result = arena_alloc(sizeof(XMPPPresence));
     result->jid = from_jid;
 
-    result->show = stanza_get_show(stanza, "online");
-    result->status = stanza_get_status(stanza, NULL);
+    result->show = _stanza_arena_text(children->show, "online");
+    result->status = _stanza_arena_text(children->status, NULL);
 
-    int idle_seconds = stanza_get_idle_time(stanza);
+    int idle_seconds = 0;
+    if (children->last_activity) {
+        char *seconds_str = xmpp_stanza_get_attribute(children->last_activity, STANZA_ATTR_SECONDS);
+        if (seconds_str) {
+            idle_seconds = atoi(seconds_str);
+        }
+    }
     if (idle_seconds > 0) {
         GDateTime *now = g_date_time_new_now_local();
         result->last_activity = g_date_time_add_seconds(now, 0 - idle_seconds);
@@ -1792,9 +2180,8 @@ stanza_parse_presence(xmpp_stanza_t *stanza, int *err)
     }
 
     result->priority = 0;
-    xmpp_stanza_t *priority_stanza = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_PRIORITY);
-    if (priority_stanza) {
-        char *priority_str = xmpp_stanza_get_text(priority_stanza);
+    if (children->priority) {
+        char *priority_str = xmpp_stanza_get_text(children->priority);
         if (priority_str) {
             result->priority = atoi(priority_str);
         }
@@ -1803,3 +2190,33 @@ stanza_parse_presence(xmpp_stanza_t *stanza, int *err)
 
     return result;
 }
+
+static gboolean
+_is_chat_state(const char *const name)
+{
+    return ((strcmp(name, STANZA_NAME_ACTIVE) == 0) ||
+            (strcmp(name, STANZA_NAME_COMPOSING) == 0) ||
+            (strcmp(name, STANZA_NAME_PAUSED) == 0) ||
+            (strcmp(name, STANZA_NAME_GONE) == 0) ||
+            (strcmp(name, STANZA_NAME_INACTIVE) == 0));
+}
+
+static void
+_decode_muc_user(xmpp_stanza_t *const muc_user, StanzaChildren *const children)
+{
+    xmpp_stanza_t *child = xmpp_stanza_get_children(muc_user);
+    while (child) {
+        char *name = xmpp_stanza_get_name(child);
+        if (g_strcmp0(name, STANZA_NAME_STATUS) == 0) {
+            char *code = xmpp_stanza_get_attribute(child, STANZA_ATTR_CODE);
+            if (code && children->muc_status_count < STANZA_MAX_STATUS_CODES) {
+                children->muc_status_codes[children->muc_status_count++] = code;
+            }
+        } else if (!children->muc_item && (g_strcmp0(name, STANZA_NAME_ITEM) == 0)) {
+            children->muc_item = child;
+        } else if (!children->muc_invite && (g_strcmp0(name, STANZA_NAME_INVITE) == 0)) {
+            children->muc_invite = child;
+        }
+        child = xmpp_stanza_get_next(child);
+    }
+}
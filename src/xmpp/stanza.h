@@ -81,12 +81,33 @@
 #define STANZA_NAME_STORAGE "storage"
 #define STANZA_NAME_NICK "nick"
 #define STANZA_NAME_PASSWORD "password"
+#define STANZA_NAME_HISTORY "history"
 #define STANZA_NAME_CONFERENCE "conference"
 #define STANZA_NAME_VALUE "value"
 #define STANZA_NAME_DESTROY "destroy"
 #define STANZA_NAME_ACTOR "actor"
 #define STANZA_NAME_ENABLE "enable"
+#define STANZA_NAME_ENABLED "enabled"
+#define STANZA_NAME_FAILED "failed"
+#define STANZA_NAME_SM_REQUEST "r"
+#define STANZA_NAME_SM_ACK "a"
 #define STANZA_NAME_DISABLE "disable"
+#define STANZA_NAME_RESULT "result"
+#define STANZA_NAME_FIN "fin"
+#define STANZA_NAME_FORWARDED "forwarded"
+#define STANZA_NAME_SET "set"
+#define STANZA_NAME_MAX "max"
+#define STANZA_NAME_BEFORE "before"
+#define STANZA_NAME_STANZA_ID "stanza-id"
+#define STANZA_NAME_ORIGIN_ID "origin-id"
+#define STANZA_NAME_FIRST "first"
+#define STANZA_NAME_LAST "last"
+#define STANZA_NAME_AFTER "after"
+#define STANZA_NAME_REQUEST "request"
+#define STANZA_NAME_SLOT "slot"
+#define STANZA_NAME_PUT "put"
+#define STANZA_NAME_GET "get"
+#define STANZA_NAME_HEADER "header"
 
 // error conditions
 #define STANZA_NAME_BAD_REQUEST "bad-request"
@@ -126,6 +147,7 @@
 #define STANZA_ATTR_TO "to"
 #define STANZA_ATTR_FROM "from"
 #define STANZA_ATTR_STAMP "stamp"
+#define STANZA_ATTR_H "h"
 #define STANZA_ATTR_TYPE "type"
 #define STANZA_ATTR_CODE "code"
 #define STANZA_ATTR_JID "jid"
@@ -136,6 +158,11 @@
 #define STANZA_ATTR_ASK "ask"
 #define STANZA_ATTR_ID "id"
 #define STANZA_ATTR_SECONDS "seconds"
+#define STANZA_ATTR_MAXSTANZAS "maxstanzas"
+#define STANZA_ATTR_MAXCHARS "maxchars"
+#define STANZA_ATTR_SINCE "since"
+#define STANZA_ATTR_QUERYID "queryid"
+#define STANZA_ATTR_COMPLETE "complete"
 #define STANZA_ATTR_NODE "node"
 #define STANZA_ATTR_VER "ver"
 #define STANZA_ATTR_VAR "var"
@@ -144,6 +171,9 @@
 #define STANZA_ATTR_REASON "reason"
 #define STANZA_ATTR_AUTOJOIN "autojoin"
 #define STANZA_ATTR_PASSWORD "password"
+#define STANZA_ATTR_URL "url"
+#define STANZA_ATTR_FILENAME "filename"
+#define STANZA_ATTR_SIZE "size"
 
 #define STANZA_TEXT_AWAY "away"
 #define STANZA_TEXT_DND "dnd"
@@ -166,11 +196,19 @@
 #define STANZA_NS_CAPTCHA "urn:xmpp:captcha"
 #define STANZA_NS_PUBSUB "http://jabber.org/protocol/pubsub"
 #define STANZA_NS_CARBONS "urn:xmpp:carbons:2"
+#define STANZA_NS_SM "urn:xmpp:sm:3"
+#define STANZA_NS_ROSTERVER "urn:xmpp:features:rosterver"
+#define STANZA_NS_CSI "urn:xmpp:csi:0"
 #define STANZA_NS_HINTS "urn:xmpp:hints"
 #define STANZA_NS_FORWARD "urn:xmpp:forward:0"
+#define STANZA_NS_MAM2 "urn:xmpp:mam:2"
+#define STANZA_NS_RSM "http://jabber.org/protocol/rsm"
 #define STANZA_NS_RECEIPTS "urn:xmpp:receipts"
+#define STANZA_NS_CHAT_MARKERS "urn:xmpp:chat-markers:0"
 #define STANZA_NS_SIGNED "jabber:x:signed"
 #define STANZA_NS_ENCRYPTED "jabber:x:encrypted"
+#define STANZA_NS_STABLE_ID "urn:xmpp:sid:0"
+#define STANZA_NS_HTTP_UPLOAD "urn:xmpp:http:upload:0"
 
 #define STANZA_DATAFORM_SOFTWARE "urn:xmpp:dataforms:softwareinfo"
 
@@ -188,6 +226,38 @@ typedef struct presence_stanza_t {
     GDateTime *last_activity;
 } XMPPPresence;
 
+#define STANZA_MAX_STATUS_CODES 8
+
+// children of a message or presence stanza, found in a single walk by
+// stanza_decode, pointers are owned by the stanza
+typedef struct stanza_children_t {
+    xmpp_stanza_t *body;
+    xmpp_stanza_t *subject;
+    xmpp_stanza_t *delay;
+    xmpp_stanza_t *legacy_delay;
+    const char *chat_state;
+    xmpp_stanza_t *receipt;
+    xmpp_stanza_t *marker;
+    xmpp_stanza_t *carbons;
+    xmpp_stanza_t *conference;
+    xmpp_stanza_t *captcha;
+    xmpp_stanza_t *encrypted;
+    xmpp_stanza_t *signature;
+    xmpp_stanza_t *caps;
+    xmpp_stanza_t *show;
+    xmpp_stanza_t *status;
+    xmpp_stanza_t *priority;
+    xmpp_stanza_t *last_activity;
+    xmpp_stanza_t *muc_user;
+    xmpp_stanza_t *muc_item;
+    xmpp_stanza_t *muc_invite;
+    xmpp_stanza_t *mam_result;
+    xmpp_stanza_t *stanza_id;
+    xmpp_stanza_t *origin_id;
+    const char *muc_status_codes[STANZA_MAX_STATUS_CODES];
+    int muc_status_count;
+} StanzaChildren;
+
 typedef enum {
     STANZA_PARSE_ERROR_NO_FROM,
     STANZA_PARSE_ERROR_INVALID_FROM
@@ -199,16 +269,28 @@ xmpp_stanza_t* stanza_enable_carbons(xmpp_ctx_t *ctx);
 
 xmpp_stanza_t* stanza_disable_carbons(xmpp_ctx_t *ctx);
 
-xmpp_stanza_t* stanza_create_chat_state(xmpp_ctx_t *ctx,
-    const char *const fulljid, const char *const state);
+xmpp_stanza_t* stanza_create_sm_enable(xmpp_ctx_t *ctx);
+xmpp_stanza_t* stanza_create_sm_request(xmpp_ctx_t *ctx);
+xmpp_stanza_t* stanza_create_sm_ack(xmpp_ctx_t *ctx, guint32 handled);
+xmpp_stanza_t* stanza_create_csi(xmpp_ctx_t *ctx, gboolean active);
+xmpp_stanza_t* stanza_create_mam_iq(xmpp_ctx_t *ctx, const char *const id, const char *const to,
+    const char *const with, const char *const end, const char *const before, int max);
+xmpp_stanza_t* stanza_create_http_upload_request(xmpp_ctx_t *ctx, const char *const id, const char *const to,
+    const char *const filename, goffset size);
+
+gchar* stanza_text_chat_state(const char *const fulljid, const char *const state);
+gchar* stanza_text_receipt(const char *const fulljid, const char *const message_id);
+gchar* stanza_text_marker(const char *const fulljid, const char *const marker, const char *const message_id);
+gchar* stanza_text_ping_iq(const char *const id, const char *const target);
 
 xmpp_stanza_t* stanza_attach_state(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza, const char *const state);
 xmpp_stanza_t* stanza_attach_carbons_private(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza);
 xmpp_stanza_t* stanza_attach_hints_no_copy(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza);
 xmpp_stanza_t* stanza_attach_hints_no_store(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza);
 xmpp_stanza_t* stanza_attach_receipt_request(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza);
+xmpp_stanza_t* stanza_attach_markable(xmpp_ctx_t *ctx, xmpp_stanza_t *stanza);
 
-xmpp_stanza_t* stanza_create_message(xmpp_ctx_t *ctx, char *id,
+xmpp_stanza_t* stanza_create_message(xmpp_ctx_t *ctx, const char *const id,
     const char *const recipient, const char *const type, const char *const message);
 
 xmpp_stanza_t* stanza_create_room_join_presence(xmpp_ctx_t *const ctx,
@@ -222,8 +304,7 @@ xmpp_stanza_t* stanza_create_room_leave_presence(xmpp_ctx_t *ctx,
 
 xmpp_stanza_t* stanza_create_presence(xmpp_ctx_t *const ctx);
 
-xmpp_stanza_t* stanza_create_roster_iq(xmpp_ctx_t *ctx);
-xmpp_stanza_t* stanza_create_ping_iq(xmpp_ctx_t *ctx, const char *const target);
+xmpp_stanza_t* stanza_create_roster_iq(xmpp_ctx_t *ctx, const char *const ver);
 xmpp_stanza_t* stanza_create_disco_info_iq(xmpp_ctx_t *ctx, const char *const id,
     const char *const to, const char *const node);
 
@@ -235,6 +316,14 @@ xmpp_stanza_t* stanza_create_invite(xmpp_ctx_t *ctx, const char *const room,
 xmpp_stanza_t* stanza_create_mediated_invite(xmpp_ctx_t *ctx, const char *const room,
     const char *const contact, const char *const reason);
 
+void stanza_decode(xmpp_stanza_t *const stanza, StanzaChildren *const children);
+GDateTime* stanza_decoded_delay(const StanzaChildren *const children);
+const char* stanza_decoded_message_id(xmpp_stanza_t *const stanza, const StanzaChildren *const children);
+// allocated from the stanza arena, see tools/arena.h
+XMPPCaps* stanza_decoded_caps(const StanzaChildren *const children);
+char* stanza_decoded_text(xmpp_stanza_t *const child, char *def);
+gboolean stanza_decoded_has_status_code(const StanzaChildren *const children, const char *const code);
+
 gboolean stanza_contains_chat_state(xmpp_stanza_t *stanza);
 
 GDateTime* stanza_get_delay(xmpp_stanza_t *const stanza);
@@ -270,6 +359,8 @@ DataForm* stanza_create_form(xmpp_stanza_t *const stanza);
 void stanza_destroy_form(DataForm *form);
 
 void stanza_attach_priority(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence, const int pri);
+void stanza_attach_muc_history(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence, const int maxstanzas,
+    const int maxchars, const int seconds, const char *const since);
 void stanza_attach_last_activity(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence, const int idle);
 void stanza_attach_caps(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence);
 void stanza_attach_show(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence, const char *const show);
@@ -277,7 +368,8 @@ void stanza_attach_status(xmpp_ctx_t *const ctx, xmpp_stanza_t *const presence,
 
 const char* stanza_get_presence_string_from_type(resource_presence_t presence_type);
 xmpp_stanza_t* stanza_create_software_version_iq(xmpp_ctx_t *ctx, const char *const fulljid);
-xmpp_stanza_t* stanza_create_disco_items_iq(xmpp_ctx_t *ctx, const char *const id, const char *const jid);
+xmpp_stanza_t* stanza_create_disco_items_iq(xmpp_ctx_t *ctx, const char *const id, const char *const jid,
+    int max, const char *const after);
 
 char* stanza_get_status(xmpp_stanza_t *stanza, char *def);
 char* stanza_get_show(xmpp_stanza_t *stanza, char *def);
@@ -297,10 +389,11 @@ char* stanza_get_actor(xmpp_stanza_t *stanza);
 char* stanza_get_reason(xmpp_stanza_t *stanza);
 
 Resource* stanza_resource_from_presence(XMPPPresence *presence);
-XMPPPresence* stanza_parse_presence(xmpp_stanza_t *stanza, int *err);
+// from the stanza arena, stanza_free_presence releases the jid and
+// last activity it owns
+XMPPPresence* stanza_parse_presence(xmpp_stanza_t *stanza, const StanzaChildren *const children, int *err);
 void stanza_free_presence(XMPPPresence *presence);
 
 XMPPCaps* stanza_parse_caps(xmpp_stanza_t *const stanza);
-void stanza_free_caps(XMPPCaps *caps);
 
 #endif
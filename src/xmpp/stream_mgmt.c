@@ -0,0 +1,311 @@
+/*
+ * stream_mgmt.c
+ *
+ * Copyright (C) 2012 - 2015 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#ifdef HAVE_LIBMESODE
+#include <mesode.h>
+#endif
+#ifdef HAVE_LIBSTROPHE
+#include <strophe.h>
+#endif
+
+#include "log.h"
+#include "config/preferences.h"
+#include "xmpp/connection.h"
+#include "xmpp/stanza.h"
+#include "xmpp/stream_mgmt.h"
+
+// XEP-0198 acks, libstrophe binds a new resource before the stream is
+// handed to us and a resume has to replace that bind, so streams are never
+// resumed, instead messages the server had not acked when the connection
+// dropped are sent again once a new stream is enabled
+typedef struct sm_unacked_t {
+    guint32 seq;
+    char *message;
+} SmUnacked;
+
+static struct {
+    gboolean requested;
+    gboolean enabled;
+    guint32 inbound;
+    guint32 outbound;
+    GQueue *unacked;
+} sm;
+
+static int _sm_enabled_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _sm_failed_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _sm_request_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _sm_ack_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static int _sm_inbound_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata);
+static void _sm_resend(GQueue *pending);
+static void _sm_acked(GQueue *queue, xmpp_stanza_t *const stanza);
+static void _sm_queue(guint32 seq, char *message);
+static void _sm_unacked_free(SmUnacked *unacked);
+static gboolean _sm_counted(const char *const name);
+static void _sm_sent(char *message);
+
+void
+stream_mgmt_init(void)
+{
+    sm.requested = FALSE;
+    sm.enabled = FALSE;
+    sm.inbound = 0;
+    sm.outbound = 0;
+    sm.unacked = g_queue_new();
+}
+
+void
+stream_mgmt_add_handlers(void)
+{
+    xmpp_conn_t * const conn = connection_get_conn();
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+
+    xmpp_handler_add(conn, _sm_enabled_handler, STANZA_NS_SM, STANZA_NAME_ENABLED, NULL, ctx);
+    xmpp_handler_add(conn, _sm_failed_handler, STANZA_NS_SM, STANZA_NAME_FAILED, NULL, ctx);
+    xmpp_handler_add(conn, _sm_request_handler, STANZA_NS_SM, STANZA_NAME_SM_REQUEST, NULL, ctx);
+    xmpp_handler_add(conn, _sm_ack_handler, STANZA_NS_SM, STANZA_NAME_SM_ACK, NULL, ctx);
+    xmpp_handler_add(conn, _sm_inbound_handler, NULL, NULL, NULL, ctx);
+}
+
+void
+stream_mgmt_enable(void)
+{
+    if (!prefs_get_boolean(PREF_STREAM_MGMT)) {
+        stream_mgmt_clear();
+        return;
+    }
+
+    xmpp_ctx_t * const ctx = connection_get_ctx();
+    xmpp_stanza_t *enable = stanza_create_sm_enable(ctx);
+    connection_send_nonza(enable);
+    xmpp_stanza_release(enable);
+
+    // the server counts from the enable request
+    sm.requested = TRUE;
+    sm.enabled = FALSE;
+    sm.inbound = 0;
+    sm.outbound = 0;
+
+    GQueue *pending = sm.unacked;
+    sm.unacked = g_queue_new();
+    _sm_resend(pending);
+}
+
+static void
+_sm_resend(GQueue *pending)
+{
+    if (!g_queue_is_empty(pending)) {
+        log_info("Stream management: resending %d unacknowledged stanzas", g_queue_get_length(pending));
+    }
+
+    SmUnacked *unacked = g_queue_pop_head(pending);
+    while (unacked) {
+        if (unacked->message) {
+            connection_send_raw(unacked->message);
+            _sm_queue(++sm.outbound, unacked->message);
+            unacked->message = NULL;
+        }
+        _sm_unacked_free(unacked);
+        unacked = g_queue_pop_head(pending);
+    }
+    g_queue_free(pending);
+}
+
+void
+stream_mgmt_sent(xmpp_stanza_t *const stanza)
+{
+    if (!sm.requested || !_sm_counted(xmpp_stanza_get_name(stanza))) {
+        return;
+    }
+
+    char *message = NULL;
+    if (g_strcmp0(xmpp_stanza_get_name(stanza), STANZA_NAME_MESSAGE) == 0) {
+        char *buf = NULL;
+        size_t len = 0;
+
+        // only messages with a body are worth sending again
+        if (xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY) &&
+                xmpp_stanza_to_text(stanza, &buf, &len) == XMPP_EOK) {
+            message = g_strndup(buf, len);
+            xmpp_free(connection_get_ctx(), buf);
+        }
+    }
+    _sm_sent(message);
+}
+
+// as stream_mgmt_sent, for a stanza already written as text, these are
+// states, receipts and pings so they are counted but never sent again
+void
+stream_mgmt_sent_text(const char *const name, const char *const text)
+{
+    if (!sm.requested || !_sm_counted(name)) {
+        return;
+    }
+
+    _sm_sent(NULL);
+}
+
+static void
+_sm_sent(char *message)
+{
+    _sm_queue(++sm.outbound, message);
+
+    // ask for an ack for each message, so the queue stays short
+    if (message) {
+        xmpp_stanza_t *request = stanza_create_sm_request(connection_get_ctx());
+        connection_send_nonza(request);
+        xmpp_stanza_release(request);
+    }
+}
+
+// connection lost, unacked messages are kept for the next session
+void
+stream_mgmt_disconnected(void)
+{
+    sm.requested = FALSE;
+    sm.enabled = FALSE;
+}
+
+void
+stream_mgmt_clear(void)
+{
+    stream_mgmt_disconnected();
+    if (sm.unacked) {
+        SmUnacked *unacked = g_queue_pop_head(sm.unacked);
+        while (unacked) {
+            _sm_unacked_free(unacked);
+            unacked = g_queue_pop_head(sm.unacked);
+        }
+    }
+}
+
+static int
+_sm_enabled_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    log_info("Stream management enabled");
+    sm.enabled = TRUE;
+    sm.inbound = 0;
+
+    return 1;
+}
+
+static int
+_sm_failed_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    log_warning("Stream management not available on this server");
+    stream_mgmt_clear();
+
+    return 1;
+}
+
+static int
+_sm_request_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    if (sm.enabled) {
+        xmpp_stanza_t *ack = stanza_create_sm_ack(connection_get_ctx(), sm.inbound);
+        connection_send_nonza(ack);
+        xmpp_stanza_release(ack);
+    }
+
+    return 1;
+}
+
+static int
+_sm_ack_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    _sm_acked(sm.unacked, stanza);
+
+    return 1;
+}
+
+// drop what the h attribute says the server has handled
+static void
+_sm_acked(GQueue *queue, xmpp_stanza_t *const stanza)
+{
+    char *h_str = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_H);
+    if (!h_str) {
+        return;
+    }
+
+    guint32 h = (guint32)strtoul(h_str, NULL, 10);
+    SmUnacked *unacked = g_queue_peek_head(queue);
+
+    // sequence numbers wrap at 2^32
+    while (unacked && ((gint32)(unacked->seq - h) <= 0)) {
+        _sm_unacked_free(g_queue_pop_head(queue));
+        unacked = g_queue_peek_head(queue);
+    }
+}
+
+static int
+_sm_inbound_handler(xmpp_conn_t *const conn, xmpp_stanza_t *const stanza, void *const userdata)
+{
+    if (sm.enabled && _sm_counted(xmpp_stanza_get_name(stanza))) {
+        sm.inbound++;
+    }
+
+    return 1;
+}
+
+static void
+_sm_queue(guint32 seq, char *message)
+{
+    SmUnacked *unacked = malloc(sizeof(SmUnacked));
+    unacked->seq = seq;
+    unacked->message = message;
+    g_queue_push_tail(sm.unacked, unacked);
+}
+
+static void
+_sm_unacked_free(SmUnacked *unacked)
+{
+    if (unacked) {
+        g_free(unacked->message);
+        free(unacked);
+    }
+}
+
+static gboolean
+_sm_counted(const char *const name)
+{
+    return ((g_strcmp0(name, STANZA_NAME_MESSAGE) == 0) ||
+            (g_strcmp0(name, STANZA_NAME_PRESENCE) == 0) ||
+            (g_strcmp0(name, STANZA_NAME_IQ) == 0));
+}
@@ -37,6 +37,8 @@
 
 #include "config.h"
 
+#include <stdio.h>
+
 #ifdef HAVE_LIBMESODE
 #include <mesode.h>
 #endif
@@ -49,6 +51,7 @@
 #include "contact.h"
 #include "jid.h"
 #include "tools/autocomplete.h"
+#include "tools/traffic.h"
 
 #define JABBER_PRIORITY_MIN -128
 #define JABBER_PRIORITY_MAX 127
@@ -73,6 +76,8 @@ typedef enum {
     INVITE_MEDIATED
 } jabber_invite_t;
 
+// shared by the cache and every lookup, never changed once created, each
+// reference is released with caps_destroy
 typedef struct capabilities_t {
     char *category;
     char *type;
@@ -82,6 +87,8 @@ typedef struct capabilities_t {
     char *os;
     char *os_version;
     GSList *features;
+    GHashTable *feature_set;
+    int refs;
 } Capabilities;
 
 typedef struct disco_item_t {
@@ -126,6 +133,16 @@ typedef struct form_field_t {
     Autocomplete value_ac;
 } FormField;
 
+// a message fetched from a server archive, from is the bare jid in chats
+// and the nick in rooms, id is its RSM id in the archive
+typedef struct archived_message_t {
+    char *id;
+    char *from;
+    char *message;
+    GDateTime *timestamp;
+    gboolean outgoing;
+} ArchivedMessage;
+
 typedef struct data_form_t {
     char *type;
     char *title;
@@ -133,6 +150,8 @@ typedef struct data_form_t {
     GSList *fields;
     GHashTable *var_to_tag;
     GHashTable *tag_to_var;
+    GHashTable *tag_to_field;
+    GSList *sorted_fields;
     Autocomplete tag_ac;
     gboolean modified;
 } DataForm;
@@ -144,8 +163,14 @@ jabber_conn_status_t jabber_connect_with_details(const char *const jid, const ch
 jabber_conn_status_t jabber_connect_with_account(const ProfAccount *const account);
 void jabber_disconnect(void);
 void jabber_shutdown(void);
+void jabber_bench_connect(const char *const fulljid);
+void jabber_bench_disconnect(void);
+void jabber_bench_replay(const char *const path, gboolean realtime);
+void jabber_bench_replay_report(FILE *stream);
 void jabber_process_events(int millis);
+gboolean jabber_events_pending(void);
 const char* jabber_get_fulljid(void);
+const Jid* jabber_get_jid(void);
 const char* jabber_get_domain(void);
 jabber_conn_status_t jabber_get_connection_status(void);
 char* jabber_get_presence_message(void);
@@ -157,11 +182,19 @@ void jabber_free_uuid(char *uuid);
 TLSCertificate* jabber_get_tls_peer_cert(void);
 #endif
 gboolean jabber_conn_is_secured(void);
+void jabber_set_client_active(gboolean active);
+void jabber_expire_requests(void);
+
+// sees the text of every stanza sent or received while it is added
+typedef void (*jabber_tap_t)(traffic_dir_t dir, const char *const text);
+void jabber_tap_add(jabber_tap_t tap);
+void jabber_tap_remove(jabber_tap_t tap);
 
 // message functions
 char* message_send_chat(const char *const barejid, const char *const msg);
+void message_send_chat_with_id(const char *const barejid, const char *const msg, const char *const id);
 char* message_send_chat_otr(const char *const barejid, const char *const msg);
-char* message_send_chat_pgp(const char *const barejid, const char *const msg);
+char* message_send_chat_pgp(const char *const barejid, const char *const msg, gboolean *pending);
 void message_send_private(const char *const fulljid, const char *const msg);
 void message_send_groupchat(const char *const roomjid, const char *const msg);
 void message_send_groupchat_subject(const char *const roomjid, const char *const subject);
@@ -171,10 +204,12 @@ void message_send_composing(const char *const jid);
 void message_send_paused(const char *const jid);
 void message_send_gone(const char *const jid);
 
+void message_send_displayed(const char *const fulljid, const char *const message_id);
 void message_send_invite(const char *const room, const char *const contact, const char *const reason);
 
 // presence functions
 void presence_subscription(const char *const jid, const jabber_subscr_t action);
+int presence_subscription_batch(const char *const pattern, const jabber_subscr_t action);
 GSList* presence_get_subscription_requests(void);
 gint presence_sub_request_count(void);
 void presence_reset_sub_request_search(void);
@@ -189,10 +224,11 @@ gboolean presence_sub_request_exists(const char *const bare_jid);
 void iq_enable_carbons(void);
 void iq_disable_carbons(void);
 void iq_send_software_version(const char *const fulljid);
-void iq_room_list_request(gchar *conferencejid);
+void iq_room_list_request(gchar *conferencejid, gchar *filter);
 void iq_disco_info_request(gchar *jid);
 void iq_disco_items_request(gchar *jid);
 void iq_last_activity_request(gchar *jid);
+void iq_forget_results(const char *const jid);
 void iq_set_autoping(int seconds);
 void iq_confirm_instant_room(const char *const room_jid);
 void iq_destroy_room(const char *const room_jid);
@@ -214,7 +250,12 @@ void iq_room_role_set(const char *const room, const char *const nick, char *role
 void iq_room_role_list(const char * const room, char *role);
 
 // caps functions
+#define CAPS_SAVE_INTERVAL_MS 5000
+
 Capabilities* caps_lookup(const char *const jid);
+gboolean caps_jid_has_feature(const char *const jid, const char *const feature);
+void caps_flush(void);
+void caps_check_requests(void);
 void caps_close(void);
 void caps_destroy(Capabilities *caps);
 
@@ -224,8 +265,17 @@ gboolean bookmark_remove(const char *jid);
 gboolean bookmark_join(const char *jid);
 const GList* bookmark_get_list(void);
 char* bookmark_find(const char *const search_str);
+void bookmark_touch(const char *const jid);
 void bookmark_autocomplete_reset(void);
 
+void mam_fetch_older(const char *const barejid, gboolean muc, GDateTime *end);
+void mam_forget(const char *const barejid);
+
+// run when an upload is done with the url to fetch it from, or NULL and why
+typedef void (*http_upload_callback)(const char *const filename, const char *const url, const char *const error,
+    void *userdata);
+void http_upload_file(const char *const path, http_upload_callback callback, void *userdata);
+
 void roster_send_name_change(const char *const barejid, const char *const new_name, GSList *groups);
 void roster_send_add_to_group(const char *const group, PContact contact);
 void roster_send_remove_from_group(const char *const group, PContact contact);
@@ -0,0 +1,424 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "config.h"
+#include "helpers.h"
+#include "common.h"
+#include "jid.h"
+#include "muc.h"
+#include "roster_list.h"
+#include "config/theme.h"
+#include "tools/autocomplete.h"
+#include "tools/p_sha1.h"
+#include "tools/parser.h"
+#include "ui/buffer.h"
+
+// each benchmark runs for at least this long, doubling the iterations
+#define BENCH_MIN_US 200000
+
+#define BENCH_CONTACTS 5000
+#define BENCH_OCCUPANTS 1000
+#define BENCH_NAMES 10000
+#define BENCH_ROOM "room@conference.example.com"
+
+// the verification string of a client with a typical set of features
+#define BENCH_CAPS_STR \
+    "client/pc//Profanity 0.5.0<" \
+    "http://jabber.org/protocol/caps<" \
+    "http://jabber.org/protocol/chatstates<" \
+    "http://jabber.org/protocol/disco#info<" \
+    "http://jabber.org/protocol/disco#items<" \
+    "http://jabber.org/protocol/muc<" \
+    "jabber:iq:last<" \
+    "jabber:iq:version<" \
+    "urn:xmpp:ping<" \
+    "urn:xmpp:receipts<" \
+    "urn:xmpp:carbons:2<" \
+    "urn:xmpp:dataforms:softwareinfo<" \
+    "ip_version<ipv4<ipv6<" \
+    "os<Linux<" \
+    "os_version<4.3.0<" \
+    "software<Profanity<" \
+    "software_version<0.5.0<"
+
+typedef struct bench_t {
+    const char *name;
+    void (*setup)(void);
+    void (*run)(guint64 i);
+    void (*teardown)(void);
+} Bench;
+
+// counts every allocation made through malloc, including those from glib,
+// only possible where the C library lets them be forwarded
+#ifdef __GLIBC__
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void *ptr, size_t size);
+
+static guint64 allocations = 0;
+
+void*
+malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+#define ALLOCATIONS_COUNTED TRUE
+#else
+static guint64 allocations = 0;
+#define ALLOCATIONS_COUNTED FALSE
+#endif
+
+static char *names[BENCH_NAMES];
+static GString *long_input;
+static Autocomplete ac;
+static ProfBuff buffer;
+static GDateTime *now;
+
+static void
+_names_create(void)
+{
+    int i;
+    for (i = 0; i < BENCH_NAMES; i++) {
+        names[i] = g_strdup_printf("contact%d@example.com", i);
+    }
+}
+
+static void
+_names_free(void)
+{
+    int i;
+    for (i = 0; i < BENCH_NAMES; i++) {
+        g_free(names[i]);
+        names[i] = NULL;
+    }
+}
+
+static void
+_ac_setup(void)
+{
+    ac = autocomplete_new();
+}
+
+static void
+_ac_filled_setup(void)
+{
+    ac = autocomplete_new();
+    int i;
+    for (i = 0; i < BENCH_OCCUPANTS; i++) {
+        autocomplete_add(ac, names[i]);
+    }
+}
+
+static void
+_ac_large_setup(void)
+{
+    ac = autocomplete_new();
+    int i;
+    for (i = 0; i < BENCH_NAMES; i++) {
+        autocomplete_add(ac, names[i]);
+    }
+}
+
+static void
+_ac_teardown(void)
+{
+    autocomplete_free(ac);
+    ac = NULL;
+}
+
+static void
+_autocomplete_add(guint64 i)
+{
+    if (i % BENCH_OCCUPANTS == 0) {
+        autocomplete_clear(ac);
+    }
+    autocomplete_add(ac, names[(i * 7919) % BENCH_OCCUPANTS]);
+}
+
+static void
+_autocomplete_complete(guint64 i)
+{
+    free(autocomplete_complete(ac, "contact55", FALSE));
+    autocomplete_reset(ac);
+}
+
+static void
+_autocomplete_complete_fuzzy(guint64 i)
+{
+    free(autocomplete_complete_fuzzy(ac, "ct55", FALSE));
+    autocomplete_reset(ac);
+}
+
+static void
+_parse_args(guint64 i)
+{
+    gboolean result = FALSE;
+    gchar **args = parse_args("/join room@conference.example.com nick \"bob smith\"", 1, 3, &result);
+    parse_args_free(args);
+}
+
+// a pasted 10KB line
+static void
+_long_input_setup(void)
+{
+    long_input = g_string_new("/msg bob@server.org \"quoted nick\" ");
+    while (long_input->len < 10240) {
+        g_string_append(long_input, "w\xc3\xb6rd ");
+    }
+    g_string_truncate(long_input, long_input->len - 1);
+}
+
+static void
+_long_input_teardown(void)
+{
+    g_string_free(long_input, TRUE);
+    long_input = NULL;
+}
+
+static void
+_parse_args_10k(guint64 i)
+{
+    gboolean result = FALSE;
+    gchar **args = parse_args(long_input->str, 0, 10240, &result);
+    parse_args_free(args);
+}
+
+static void
+_parse_args_with_freetext_10k(guint64 i)
+{
+    gboolean result = FALSE;
+    gchar **args = parse_args_with_freetext(long_input->str, 1, 2, &result);
+    parse_args_free(args);
+}
+
+static void
+_roster_setup(void)
+{
+    roster_init();
+    roster_batch_begin();
+    int i;
+    for (i = 0; i < BENCH_CONTACTS; i++) {
+        roster_add(names[i], NULL, NULL, "both", FALSE);
+    }
+    roster_batch_end();
+}
+
+static void
+_roster_teardown(void)
+{
+    roster_free();
+}
+
+static void
+_roster_get_contact(guint64 i)
+{
+    roster_get_contact(names[(i * 7919) % BENCH_CONTACTS]);
+}
+
+static void
+_roster_get_contacts(guint64 i)
+{
+    g_slist_free(roster_get_contacts());
+}
+
+static void
+_muc_setup(void)
+{
+    muc_init();
+    muc_join(BENCH_ROOM, "bench", NULL, FALSE);
+    int i;
+    for (i = 0; i < BENCH_OCCUPANTS; i++) {
+        muc_roster_add(BENCH_ROOM, names[i], NULL, "participant", "member", NULL, NULL);
+    }
+}
+
+static void
+_muc_teardown(void)
+{
+    muc_close();
+}
+
+static void
+_muc_roster_add(guint64 i)
+{
+    muc_roster_add(BENCH_ROOM, names[(i * 7919) % BENCH_OCCUPANTS], NULL, "participant", "member", "away", NULL);
+}
+
+static void
+_muc_roster_item(guint64 i)
+{
+    muc_roster_item(BENCH_ROOM, names[(i * 7919) % BENCH_OCCUPANTS]);
+}
+
+static void
+_jid_create(guint64 i)
+{
+    jid_destroy(jid_create("alice@example.com/laptop"));
+}
+
+static void
+_buffer_setup(void)
+{
+    buffer = buffer_create();
+    now = g_date_time_new_now_local();
+    int i;
+    for (i = 0; i < BUFF_SIZE; i++) {
+        buffer_push(buffer, '-', 0, now, 0, THEME_TEXT, "alice", names[i], NULL);
+    }
+}
+
+static void
+_buffer_teardown(void)
+{
+    buffer_free(buffer);
+    buffer = NULL;
+    g_date_time_unref(now);
+    now = NULL;
+}
+
+static void
+_buffer_push(guint64 i)
+{
+    buffer_push(buffer, '-', 0, now, 0, THEME_TEXT, "alice", "a message of an ordinary length", NULL);
+}
+
+static void
+_buffer_yield_entry(guint64 i)
+{
+    buffer_yield_entry(buffer, (i * 7919) % BUFF_SIZE);
+}
+
+static void
+_width_utf8_ascii(guint64 i)
+{
+    utf8_display_len("a message of an ordinary length, written in plain ASCII text");
+}
+
+static void
+_width_utf8_cjk(guint64 i)
+{
+    utf8_display_len("\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\xa1\xe3\x83\x83\xe3\x82\xbb"
+        "\xe3\x83\xbc\xe3\x82\xb8 mixed with some ASCII \xe4\xb8\xad\xe6\x96\x87");
+}
+
+static void
+_p_sha1_hash(guint64 i)
+{
+    free(p_sha1_hash(BENCH_CAPS_STR));
+}
+
+static void
+_p_sha1_portable_setup(void)
+{
+    P_SHA1_Accelerate(0);
+}
+
+static void
+_p_sha1_portable_teardown(void)
+{
+    P_SHA1_Accelerate(1);
+}
+
+static const Bench benches[] = {
+    { "autocomplete_add", _ac_setup, _autocomplete_add, _ac_teardown },
+    { "autocomplete_complete", _ac_filled_setup, _autocomplete_complete, _ac_teardown },
+    { "autocomplete_complete_fuzzy", _ac_filled_setup, _autocomplete_complete_fuzzy, _ac_teardown },
+    { "autocomplete_complete_10000", _ac_large_setup, _autocomplete_complete, _ac_teardown },
+    { "parse_args", NULL, _parse_args, NULL },
+    { "parse_args_10k", _long_input_setup, _parse_args_10k, _long_input_teardown },
+    { "parse_args_with_freetext_10k", _long_input_setup, _parse_args_with_freetext_10k, _long_input_teardown },
+    { "roster_get_contact", _roster_setup, _roster_get_contact, _roster_teardown },
+    { "roster_get_contacts", _roster_setup, _roster_get_contacts, _roster_teardown },
+    { "muc_roster_add", _muc_setup, _muc_roster_add, _muc_teardown },
+    { "muc_roster_item", _muc_setup, _muc_roster_item, _muc_teardown },
+    { "jid_create", NULL, _jid_create, NULL },
+    { "buffer_push", _buffer_setup, _buffer_push, _buffer_teardown },
+    { "buffer_yield_entry", _buffer_setup, _buffer_yield_entry, _buffer_teardown },
+    { "width_utf8_ascii", NULL, _width_utf8_ascii, NULL },
+    { "width_utf8_cjk", NULL, _width_utf8_cjk, NULL },
+    { "p_sha1_hash", NULL, _p_sha1_hash, NULL },
+    { "p_sha1_hash_portable", _p_sha1_portable_setup, _p_sha1_hash, _p_sha1_portable_teardown },
+};
+
+static void
+_bench_run(const Bench *bench, const char *const filter)
+{
+    if (filter && !strstr(bench->name, filter)) {
+        return;
+    }
+
+    if (bench->setup) {
+        bench->setup();
+    }
+
+    guint64 iterations = 1;
+    gint64 elapsed = 0;
+    guint64 allocated = 0;
+    while (TRUE) {
+        guint64 i;
+        guint64 allocations_start = allocations;
+        gint64 start = g_get_monotonic_time();
+        for (i = 0; i < iterations; i++) {
+            bench->run(i);
+        }
+        elapsed = g_get_monotonic_time() - start;
+        allocated = allocations - allocations_start;
+        if (elapsed >= BENCH_MIN_US) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    if (bench->teardown) {
+        bench->teardown();
+    }
+
+    if (ALLOCATIONS_COUNTED) {
+        printf("%s\t%" G_GUINT64_FORMAT "\t%.1f\t%.2f\n", bench->name, iterations,
+            (double)elapsed * 1000 / iterations, (double)allocated / iterations);
+    } else {
+        printf("%s\t%" G_GUINT64_FORMAT "\t%.1f\t-\n", bench->name, iterations,
+            (double)elapsed * 1000 / iterations);
+    }
+}
+
+// prints one tab separated line per benchmark, an argument only runs the
+// benchmarks with names containing it
+int main(int argc, char* argv[]) {
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    load_preferences(NULL);
+    _names_create();
+
+    printf("name\titerations\tns_per_op\tallocs_per_op\n");
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(benches); i++) {
+        _bench_run(&benches[i], filter);
+    }
+
+    _names_free();
+    close_preferences(NULL);
+
+    return 0;
+}
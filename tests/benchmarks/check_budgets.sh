@@ -0,0 +1,101 @@
+#!/bin/sh
+
+# Compares the tab separated output of a benchmark harness, read from stdin,
+# with the budgets for that harness and fails if any is exceeded.
+#
+#   tests/benchmarks/benchmarks | check_budgets.sh budgets benchmarks
+#
+# BUDGET_TOLERANCE is how far over budget in percent a result may be before
+# it fails, 50 by default, for slower or busier machines than the budgets
+# were set on.
+
+budgets="$1"
+harness="$2"
+tolerance="${BUDGET_TOLERANCE:-50}"
+
+if [ -z "$budgets" ] || [ -z "$harness" ]; then
+    echo "usage: $0 <budgets> <harness>" >&2
+    exit 2
+fi
+
+awk -F '\t' -v budgets="$budgets" -v harness="$harness" -v tolerance="$tolerance" '
+BEGIN {
+    count = 0
+    while ((getline line < budgets) > 0) {
+        if (line ~ /^[ \t]*(#|$)/) {
+            continue
+        }
+        n = split(line, field, /[ \t]+/)
+        if (n != 5 || (field[4] != "<" && field[4] != ">")) {
+            print "Bad budget line: " line > "/dev/stderr"
+            failed = 1
+            continue
+        }
+        if (field[1] != harness) {
+            continue
+        }
+        count++
+        row[count] = field[2]
+        column[count] = field[3]
+        op[count] = field[4]
+        limit[count] = field[5]
+        found[count] = 0
+    }
+    close(budgets)
+}
+
+# the first line names the columns, rows are matched by column=value pairs
+NR == 1 {
+    for (i = 1; i <= NF; i++) {
+        index_of[$i] = i
+    }
+    columns = NF
+    next
+}
+
+NF == columns {
+    for (b = 1; b <= count; b++) {
+        if (!(column[b] in index_of) || !_matches(row[b])) {
+            continue
+        }
+        found[b] = 1
+        value = $index_of[column[b]]
+        if (value == "-") {
+            continue
+        }
+        if (op[b] == "<") {
+            allowed = limit[b] * (100 + tolerance) / 100
+            over = value + 0 > allowed
+        } else {
+            allowed = limit[b] * 100 / (100 + tolerance)
+            over = value + 0 < allowed
+        }
+        status = over ? "OVER BUDGET" : "ok"
+        printf "%-12s %s %s %s, budget %s %s\n", status, row[b], column[b], value, op[b], limit[b]
+        if (over) {
+            failed = 1
+        }
+    }
+}
+
+function _matches(spec,    pairs, n, i, kv) {
+    n = split(spec, pairs, ",")
+    for (i = 1; i <= n; i++) {
+        split(pairs[i], kv, "=")
+        if (!(kv[1] in index_of) || $index_of[kv[1]] != kv[2]) {
+            return 0
+        }
+    }
+    return 1
+}
+
+END {
+    for (b = 1; b <= count; b++) {
+        if (!found[b]) {
+            print "No result for budget: " row[b] " " column[b] > "/dev/stderr"
+            failed = 1
+        }
+    }
+    exit failed
+}
+'
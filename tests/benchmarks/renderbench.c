@@ -0,0 +1,211 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "config.h"
+
+#ifdef HAVE_NCURSESW_NCURSES_H
+#include <ncursesw/ncurses.h>
+#elif HAVE_NCURSES_H
+#include <ncurses.h>
+#endif
+
+#include "helpers.h"
+#include "common.h"
+#include "log.h"
+#include "config/preferences.h"
+#include "config/theme.h"
+#include "ui/ui.h"
+#include "ui/window.h"
+
+// messages printed by each scenario, more than the window buffer holds
+#define RENDER_MESSAGES 2000
+#define RENDER_ROWS 50
+
+#define RENDER_DATA_HOME "./tests/files/xdg_data_home"
+
+typedef struct render_mix_t {
+    const char *name;
+    const char *messages[4];
+} RenderMix;
+
+static const RenderMix mixes[] = {
+    { "ascii", {
+        "a message of an ordinary length, written in plain ASCII text",
+        "ok",
+        "a longer message that goes on for a while, long enough that most terminals will have to wrap it at least "
+            "once, and narrow ones more than that",
+        NULL } },
+    { "cjk", {
+        "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\xa1\xe3\x83\x83\xe3\x82\xbb\xe3\x83\xbc\xe3\x82\xb8"
+            "\xe3\x81\xa7\xe3\x81\x99\xe3\x80\x82\xe4\xb8\xad\xe6\x96\x87\xe6\xb6\x88\xe6\x81\xaf\xe3\x80\x82"
+            "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4 \xeb\xa9\x94\xec\x8b\x9c\xec\xa7\x80",
+        "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\xa1\xe3\x83\x83\xe3\x82\xbb\xe3\x83\xbc\xe3\x82\xb8"
+            "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\xa1\xe3\x83\x83\xe3\x82\xbb\xe3\x83\xbc\xe3\x82\xb8"
+            "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\xa1\xe3\x83\x83\xe3\x82\xbb\xe3\x83\xbc\xe3\x82\xb8"
+            "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\xa1\xe3\x83\x83\xe3\x82\xbb\xe3\x83\xbc\xe3\x82\xb8",
+        NULL } },
+    { "emoji", {
+        "\xf0\x9f\x98\x80 \xf0\x9f\x8e\x89 \xf0\x9f\x91\x8d well done \xf0\x9f\x91\x8f\xf0\x9f\x91\x8f\xf0\x9f\x91\x8f",
+        "\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82"
+            "\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82\xf0\x9f\x98\x82",
+        NULL } },
+    { "url", {
+        "https://example.com/a/very/long/path/that/keeps/going/on/and/on/index.html?query=with&lots=of&parameters=that"
+            "&nobody=reads&but=everyone&pastes=anyway&session=0123456789abcdef0123456789abcdef#and-a-fragment-too",
+        "see https://example.org/short for details",
+        NULL } },
+    { "code", {
+        "```\n"
+        "static int\n"
+        "_count_lines(const char *const text)\n"
+        "{\n"
+        "    int lines = 1;\n"
+        "    while (*text) {\n"
+        "        if (*text++ == '\\n') {\n"
+        "            lines++;\n"
+        "        }\n"
+        "    }\n"
+        "    return lines;\n"
+        "}\n"
+        "```",
+        NULL } },
+};
+
+static const int widths[] = { 80, 120, 200 };
+
+static FILE *term_out = NULL;
+static FILE *term_in = NULL;
+static SCREEN *screen = NULL;
+
+static const RenderMix*
+_mix_find(const char *const name)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(mixes); i++) {
+        if (g_strcmp0(mixes[i].name, name) == 0) {
+            return &mixes[i];
+        }
+    }
+
+    return NULL;
+}
+
+// what doupdate has written to the terminal so far
+static long
+_term_bytes(void)
+{
+    fflush(term_out);
+    return ftell(term_out);
+}
+
+// each message is drawn as ui_update would draw it, then the whole buffer
+// is redrawn as on a resize
+static void
+_render_run(const RenderMix *mix, int cols, gboolean wrap)
+{
+    resizeterm(RENDER_ROWS, cols);
+    prefs_set_boolean(PREF_WRAP, wrap);
+    ProfWin *window = win_create_chat("alice@example.com");
+    GDateTime *now = g_date_time_new_now_local();
+
+    int count = 0;
+    while (mix->messages[count]) {
+        count++;
+    }
+
+    long bytes_start = _term_bytes();
+    gint64 start = g_get_monotonic_time();
+    int i;
+    for (i = 0; i < RENDER_MESSAGES; i++) {
+        win_print(window, '-', 0, now, 0, THEME_TEXT, "alice", mix->messages[i % count]);
+        win_move_to_end(window);
+        win_update_virtual(window);
+        doupdate();
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+    long bytes = _term_bytes() - bytes_start;
+
+    gint64 redraw_start = g_get_monotonic_time();
+    win_redraw(window);
+    gint64 redraw = g_get_monotonic_time() - redraw_start;
+
+    printf("%s\t%d\t%s\t%.0f\t%.1f\t%" G_GINT64_FORMAT "\n", mix->name, cols, wrap ? "on" : "off",
+        (double)RENDER_MESSAGES * G_USEC_PER_SEC / elapsed,
+        (double)bytes / RENDER_MESSAGES,
+        redraw);
+
+    g_date_time_unref(now);
+    win_free(window);
+}
+
+static void
+_render_init(void)
+{
+    setlocale(LC_ALL, "");
+    load_preferences(NULL);
+
+    setenv("XDG_DATA_HOME", RENDER_DATA_HOME, 1);
+    mkdir_recursive(RENDER_DATA_HOME "/profanity/logs");
+    log_init(PROF_LEVEL_ERROR);
+    theme_init("default");
+
+    // the terminal writes to a file so the bytes it emits can be counted
+    term_out = tmpfile();
+    term_in = fopen("/dev/null", "r");
+    screen = newterm("xterm-256color", term_out, term_in);
+    set_term(screen);
+    ui_load_colours();
+}
+
+static void
+_render_close(void)
+{
+    endwin();
+    delscreen(screen);
+    fclose(term_out);
+    fclose(term_in);
+
+    theme_close();
+    remove(get_log_file_location());
+    log_close();
+    rmdir(RENDER_DATA_HOME "/profanity/logs");
+    rmdir(RENDER_DATA_HOME "/profanity");
+    rmdir(RENDER_DATA_HOME);
+    close_preferences(NULL);
+}
+
+// prints one tab separated line per message mix, width and wrap setting,
+// an argument only runs the mix with that name
+int main(int argc, char* argv[]) {
+    const char *filter = argc > 1 ? argv[1] : NULL;
+    if (filter && _mix_find(filter) == NULL) {
+        fprintf(stderr, "Unknown message mix: %s\n", filter);
+        return 1;
+    }
+
+    _render_init();
+
+    printf("mix\tcols\twrap\tlines_per_sec\tbytes_per_line\tredraw_us\n");
+    int i, j;
+    for (i = 0; i < G_N_ELEMENTS(mixes); i++) {
+        if (filter && g_strcmp0(mixes[i].name, filter) != 0) {
+            continue;
+        }
+        for (j = 0; j < G_N_ELEMENTS(widths); j++) {
+            _render_run(&mixes[i], widths[j], TRUE);
+            _render_run(&mixes[i], widths[j], FALSE);
+        }
+    }
+
+    _render_close();
+
+    return 0;
+}
@@ -20,6 +20,7 @@
 #include "test_receipts.h"
 #include "test_roster.h"
 #include "test_software.h"
+#include "test_mam.h"
 
 #define PROF_FUNC_TEST(test) unit_test_setup_teardown(test, init_prof_test, close_prof_test)
 
@@ -71,6 +72,8 @@ int main(int argc, char* argv[]) {
 
         PROF_FUNC_TEST(send_receipt_request),
         PROF_FUNC_TEST(send_receipt_on_request),
+        PROF_FUNC_TEST(send_markable_with_markers),
+        PROF_FUNC_TEST(send_displayed_marker_when_window_viewed),
         PROF_FUNC_TEST(sends_new_item),
         PROF_FUNC_TEST(sends_new_item_nick),
         PROF_FUNC_TEST(sends_remove_item),
@@ -82,6 +85,9 @@ int main(int argc, char* argv[]) {
         PROF_FUNC_TEST(display_software_version_result_when_from_domainpart),
         PROF_FUNC_TEST(show_message_in_chat_window_when_no_resource),
         PROF_FUNC_TEST(display_software_version_result_in_chat),
+
+        PROF_FUNC_TEST(page_up_requests_archive),
+        PROF_FUNC_TEST(page_up_follows_archive_cursor),
     };
 
     return run_tests(all_tests);
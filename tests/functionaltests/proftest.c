@@ -209,6 +209,13 @@ prof_input(char *input)
     g_string_free(inp_str, TRUE);
 }
 
+// sent as typed, without ending the line
+void
+prof_keys(char *keys)
+{
+    write(fd, keys, strlen(keys));
+}
+
 int
 prof_output_exact(char *text)
 {
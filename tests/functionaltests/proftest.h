@@ -11,6 +11,7 @@ void prof_start(void);
 void prof_connect(void);
 void prof_connect_with_roster(char *roster);
 void prof_input(char *input);
+void prof_keys(char *keys);
 
 int prof_output_exact(char *text);
 int prof_output_regex(char *text);
@@ -0,0 +1,77 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stabber.h>
+#include <expect.h>
+
+#include "proftest.h"
+
+#define PAGE_UP "\033[5~"
+
+void
+page_up_requests_archive(void **state)
+{
+    prof_connect();
+
+    prof_input("/msg buddy1@localhost Hi there");
+    prof_keys(PAGE_UP);
+
+    assert_true(stbbr_received(
+        "<iq id=\"*\" type=\"set\">"
+            "<query xmlns=\"urn:xmpp:mam:2\" queryid=\"*\">"
+                "<x xmlns=\"jabber:x:data\" type=\"submit\">"
+                    "<field var=\"with\">"
+                        "<value>buddy1@localhost</value>"
+                    "</field>"
+                "</x>"
+                "<set xmlns=\"http://jabber.org/protocol/rsm\">"
+                    "<max>50</max>"
+                "</set>"
+            "</query>"
+        "</iq>"
+    ));
+}
+
+void
+page_up_follows_archive_cursor(void **state)
+{
+    stbbr_for_query("urn:xmpp:mam:2",
+        "<iq id=\"*\" type=\"result\" to=\"stabber@localhost/profanity\">"
+            "<fin xmlns=\"urn:xmpp:mam:2\">"
+                "<set xmlns=\"http://jabber.org/protocol/rsm\">"
+                    "<first>page2</first>"
+                    "<last>page2last</last>"
+                "</set>"
+            "</fin>"
+        "</iq>"
+    );
+
+    prof_connect();
+
+    prof_input("/msg buddy1@localhost Hi there");
+    prof_keys(PAGE_UP);
+    assert_true(stbbr_received(
+        "<iq id=\"*\" type=\"set\">"
+            "<query xmlns=\"urn:xmpp:mam:2\" queryid=\"*\"/>"
+        "</iq>"
+    ));
+
+    // one page at a time, the next is only asked for once this one is in
+    g_usleep(G_USEC_PER_SEC / 2);
+    prof_keys(PAGE_UP);
+
+    assert_true(stbbr_received(
+        "<iq id=\"*\" type=\"set\">"
+            "<query xmlns=\"urn:xmpp:mam:2\" queryid=\"*\">"
+                "<set xmlns=\"http://jabber.org/protocol/rsm\">"
+                    "<before>page2</before>"
+                "</set>"
+            "</query>"
+        "</iq>"
+    ));
+}
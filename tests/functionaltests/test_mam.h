@@ -0,0 +1,2 @@
+void page_up_requests_archive(void **state);
+void page_up_follows_archive_cursor(void **state);
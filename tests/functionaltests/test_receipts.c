@@ -48,3 +48,48 @@ send_receipt_on_request(void **state)
         "</message>"
     ));
 }
+
+void
+send_markable_with_markers(void **state)
+{
+    prof_input("/receipts markers on");
+
+    prof_connect();
+
+    prof_input("/msg somejid@someserver.com Hi there");
+
+    assert_true(stbbr_received(
+        "<message id=\"*\" type=\"chat\" to=\"somejid@someserver.com\">"
+            "<body>Hi there</body>"
+            "<markable xmlns=\"urn:xmpp:chat-markers:0\"/>"
+        "</message>"
+    ));
+}
+
+void
+send_displayed_marker_when_window_viewed(void **state)
+{
+    prof_input("/receipts markers on");
+
+    prof_connect();
+
+    stbbr_send(
+        "<message id=\"msg1\" type=\"chat\" to=\"stabber@localhost/profanity\" from=\"someuser@server.org/laptop\">"
+            "<body>First</body>"
+            "<markable xmlns=\"urn:xmpp:chat-markers:0\"/>"
+        "</message>"
+        "<message id=\"msg2\" type=\"chat\" to=\"stabber@localhost/profanity\" from=\"someuser@server.org/laptop\">"
+            "<body>Second</body>"
+            "<markable xmlns=\"urn:xmpp:chat-markers:0\"/>"
+        "</message>"
+    );
+    assert_true(prof_output_exact("<< incoming from someuser@server.org/laptop (2)"));
+
+    prof_input("/win 2");
+
+    assert_true(stbbr_received(
+        "<message id=\"*\" to=\"someuser@server.org/laptop\">"
+            "<displayed id=\"msg2\" xmlns=\"urn:xmpp:chat-markers:0\"/>"
+        "</message>"
+    ));
+}
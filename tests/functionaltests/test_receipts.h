@@ -1,3 +1,5 @@
 void send_receipt_request(void **state);
 void send_receipt_on_request(void **state);
+void send_markable_with_markers(void **state);
+void send_displayed_marker_when_window_viewed(void **state);
 
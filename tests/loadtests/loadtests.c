@@ -0,0 +1,280 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <stabber.h>
+#include <expect.h>
+
+#include "config.h"
+
+#include "proftest.h"
+
+#define LOAD_CONTACTS 5000
+#define LOAD_STORM_CONTACTS 500
+#define LOAD_STORM_RESOURCES 4
+#define LOAD_OCCUPANTS 1000
+#define LOAD_HISTORY 100
+#define LOAD_MESSAGES 1000
+#define LOAD_MESSAGES_PER_SEC 100
+
+#define LOAD_ROOM "loadroom@conference.localhost"
+
+#define LOAD_TEST(test) unit_test_setup_teardown(test, init_prof_test, close_load_test)
+
+static const char *scenario = NULL;
+static gint64 started = 0;
+static gint64 elapsed = 0;
+
+static void
+_load_start(const char *const name)
+{
+    scenario = name;
+    elapsed = 0;
+    started = g_get_monotonic_time();
+}
+
+static void
+_load_done(void)
+{
+    elapsed = g_get_monotonic_time() - started;
+}
+
+static gint64
+_timeval_ms(struct timeval *tv)
+{
+    return (gint64)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
+// profanity is only accounted for once it has quit and been reaped, the peak
+// RSS is the largest of any profanity run so far by this process
+static void
+close_load_test(void **state)
+{
+    struct rusage before;
+    getrusage(RUSAGE_CHILDREN, &before);
+
+    close_prof_test(state);
+
+    struct rusage after;
+    getrusage(RUSAGE_CHILDREN, &after);
+
+    gint64 cpu_ms = _timeval_ms(&after.ru_utime) - _timeval_ms(&before.ru_utime) +
+        _timeval_ms(&after.ru_stime) - _timeval_ms(&before.ru_stime);
+
+    printf("%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%ld\n", scenario, elapsed / 1000, cpu_ms,
+        after.ru_maxrss);
+    fflush(stdout);
+}
+
+static void
+_join_room(const char *const occupants, const char *const history)
+{
+    prof_input("/join " LOAD_ROOM);
+    stbbr_wait_for("prof_join_*");
+
+    GString *join = g_string_new(occupants);
+    g_string_append(join,
+        "<presence to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "/stabber\">"
+            "<x xmlns=\"http://jabber.org/protocol/muc#user\">"
+                "<item affiliation=\"none\" role=\"participant\"/>"
+                "<status code=\"110\"/>"
+            "</x>"
+        "</presence>"
+    );
+    if (history) {
+        g_string_append(join, history);
+    }
+    g_string_append(join,
+        "<message type=\"groupchat\" to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "\">"
+            "<subject>Load test</subject>"
+        "</message>"
+    );
+    stbbr_send(join->str);
+    g_string_free(join, TRUE);
+
+    assert_true(prof_output_exact("-> You have joined the room as stabber"));
+    assert_true(prof_output_exact("Load test"));
+}
+
+void
+load_roster(void **state)
+{
+    GString *roster = g_string_new("");
+    int i;
+    for (i = 0; i < LOAD_CONTACTS; i++) {
+        g_string_append_printf(roster,
+            "<item jid=\"contact%d@localhost\" subscription=\"both\" name=\"Contact%d\"><group>Group%d</group></item>",
+            i, i, i % 50);
+    }
+
+    _load_start("roster");
+    prof_connect_with_roster(roster->str);
+    _load_done();
+
+    g_string_free(roster, TRUE);
+}
+
+void
+load_presence_storm(void **state)
+{
+    GString *roster = g_string_new("");
+    GString *storm = g_string_new("");
+    int i, j;
+    for (i = 0; i < LOAD_STORM_CONTACTS; i++) {
+        g_string_append_printf(roster, "<item jid=\"contact%d@localhost\" subscription=\"both\"/>", i);
+        for (j = 0; j < LOAD_STORM_RESOURCES; j++) {
+            g_string_append_printf(storm,
+                "<presence to=\"stabber@localhost\" from=\"contact%d@localhost/resource%d\">"
+                    "<show>%s</show>"
+                    "<priority>%d</priority>"
+                    "<status>Resource %d</status>"
+                "</presence>",
+                i, j, j % 2 ? "away" : "dnd", j, j);
+        }
+    }
+
+    // a message waits behind the presences of its sender, the last sender
+    // of the storm waits behind all of it, so the message is shown once the
+    // whole storm has been processed
+    g_string_append_printf(storm,
+        "<message id=\"loaddone\" to=\"stabber@localhost\" from=\"contact%d@localhost/resource%d\" type=\"chat\">"
+            "<body>Storm over</body>"
+        "</message>",
+        LOAD_STORM_CONTACTS - 1, LOAD_STORM_RESOURCES - 1);
+
+    prof_connect_with_roster(roster->str);
+
+    exp_timeout = 60;
+    _load_start("presence_storm");
+    stbbr_send(storm->str);
+    gchar *incoming = g_strdup_printf("<< incoming from contact%d@localhost/resource%d (2)",
+        LOAD_STORM_CONTACTS - 1, LOAD_STORM_RESOURCES - 1);
+    assert_true(prof_output_exact(incoming));
+    _load_done();
+    exp_timeout = 10;
+
+    g_free(incoming);
+    g_string_free(roster, TRUE);
+    g_string_free(storm, TRUE);
+}
+
+void
+load_muc_join(void **state)
+{
+    GString *occupants = g_string_new("");
+    GString *history = g_string_new("");
+    int i;
+    for (i = 0; i < LOAD_OCCUPANTS - 1; i++) {
+        g_string_append_printf(occupants,
+            "<presence to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "/occupant%d\">"
+                "<x xmlns=\"http://jabber.org/protocol/muc#user\">"
+                    "<item affiliation=\"%s\" role=\"participant\"/>"
+                "</x>"
+            "</presence>",
+            i, i % 10 ? "none" : "member");
+    }
+    for (i = 0; i < LOAD_HISTORY; i++) {
+        g_string_append_printf(history,
+            "<message type=\"groupchat\" to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "/occupant%d\">"
+                "<body>History message %d</body>"
+                "<delay xmlns=\"urn:xmpp:delay\" from=\"" LOAD_ROOM "\" stamp=\"2015-12-19T23:%02d:00Z\"/>"
+            "</message>",
+            i % (LOAD_OCCUPANTS - 1), i, i % 60);
+    }
+
+    prof_connect();
+
+    exp_timeout = 60;
+    _load_start("muc_join");
+    _join_room(occupants->str, history->str);
+    _load_done();
+    exp_timeout = 10;
+
+    g_string_free(occupants, TRUE);
+    g_string_free(history, TRUE);
+}
+
+void
+load_muc_messages(void **state)
+{
+    prof_input("/grlog on");
+    assert_true(prof_output_exact("Groupchat logging enabled."));
+
+    prof_connect();
+    _join_room(
+        "<presence to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "/occupant0\">"
+            "<x xmlns=\"http://jabber.org/protocol/muc#user\">"
+                "<item affiliation=\"none\" role=\"participant\"/>"
+            "</x>"
+        "</presence>",
+        NULL);
+
+    // sent at a fixed rate, the elapsed time beyond LOAD_MESSAGES /
+    // LOAD_MESSAGES_PER_SEC is how far profanity fell behind
+    _load_start("muc_messages");
+    int i;
+    for (i = 0; i < LOAD_MESSAGES; i++) {
+        char *message = g_strdup_printf(
+            "<message type=\"groupchat\" to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "/occupant0\">"
+                "<body>Flood message %d</body>"
+            "</message>",
+            i);
+        stbbr_send(message);
+        g_free(message);
+        g_usleep(G_USEC_PER_SEC / LOAD_MESSAGES_PER_SEC);
+    }
+    stbbr_send(
+        "<message type=\"groupchat\" to=\"stabber@localhost/profanity\" from=\"" LOAD_ROOM "/occupant0\">"
+            "<body>Flood over</body>"
+        "</message>"
+    );
+    exp_timeout = 60;
+    assert_true(prof_output_exact("Flood over"));
+    _load_done();
+    exp_timeout = 10;
+}
+
+// prints one tab separated line per scenario, an argument only runs the
+// scenarios with names containing it, running each scenario on its own
+// gives a peak RSS for that scenario alone
+int main(int argc, char* argv[]) {
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    const char *names[] = {
+        "roster",
+        "presence_storm",
+        "muc_join",
+        "muc_messages",
+    };
+
+    const UnitTest all_tests[] = {
+        LOAD_TEST(load_roster),
+        LOAD_TEST(load_presence_storm),
+        LOAD_TEST(load_muc_join),
+        LOAD_TEST(load_muc_messages),
+    };
+
+    // each scenario is a setup, test and teardown entry
+    UnitTest tests[G_N_ELEMENTS(all_tests)];
+    size_t count = 0;
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(names); i++) {
+        if (filter && !strstr(names[i], filter)) {
+            continue;
+        }
+        memcpy(&tests[count], &all_tests[i * 3], sizeof(UnitTest) * 3);
+        count += 3;
+    }
+
+    printf("scenario\twall_ms\tcpu_ms\tpeak_rss_kb\n");
+    fflush(stdout);
+
+    return _run_tests(tests, count);
+}
@@ -8,6 +8,11 @@
 
 void accounts_load(void) {}
 void accounts_close(void) {}
+void accounts_flush(void) {}
+guint accounts_generation(void)
+{
+    return 0;
+}
 
 char * accounts_find_all(char *prefix)
 {
@@ -45,6 +50,12 @@ ProfAccount* accounts_get_account(const char * const name)
     return (ProfAccount*)mock();
 }
 
+const ProfAccount* accounts_peek_account(const char * const name)
+{
+    check_expected(name);
+    return (ProfAccount*)mock();
+}
+
 gboolean accounts_enable(const char * const name)
 {
     check_expected(name);
@@ -187,6 +198,29 @@ gint accounts_get_priority_for_presence_type(const char * const account_name,
     return 0;
 }
 
+void accounts_set_compression(const char * const account_name, gboolean value)
+{
+    check_expected(account_name);
+    check_expected(value);
+}
+
+gboolean accounts_get_compression(const char * const account_name)
+{
+    return FALSE;
+}
+
+void accounts_set_muc_history(const char * const account_name, const char * const setting, const gint value)
+{
+    check_expected(account_name);
+    check_expected(setting);
+    check_expected(value);
+}
+
+gint accounts_get_muc_history(const char * const account_name, const char * const setting)
+{
+    return -1;
+}
+
 void accounts_clear_password(const char * const account_name) {}
 void accounts_clear_eval_password(const char * const account_name) {}
 void accounts_clear_server(const char * const account_name) {}
@@ -194,4 +228,5 @@ void accounts_clear_port(const char * const account_name) {}
 void accounts_clear_otr(const char * const account_name) {}
 void accounts_clear_pgp_keyid(const char * const account_name) {}
 void accounts_clear_script_start(const char * const account_name) {}
+void accounts_clear_muc_history(const char * const account_name) {}
 void accounts_add_otr_policy(const char * const account_name, const char * const contact_jid, const char * const policy) {}
@@ -11,6 +11,7 @@
 #include "helpers.h"
 #include "config/preferences.h"
 #include "chat_session.h"
+#include "command/command.h"
 
 void create_config_dir(void **state)
 {
@@ -86,6 +87,13 @@ void close_chat_sessions(void **state)
     close_preferences(NULL);
 }
 
+// for tests that call cmd_init themselves, once their preferences are set
+void close_commands(void **state)
+{
+    cmd_uninit();
+    close_preferences(NULL);
+}
+
 int
 utf8_pos_to_col(char *str, int utf8_pos)
 {
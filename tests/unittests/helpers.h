@@ -3,9 +3,14 @@
 void load_preferences(void **state);
 void close_preferences(void **state);
 
+void create_data_dir(void **state);
+void remove_data_dir(void **state);
+
 void init_chat_sessions(void **state);
 void close_chat_sessions(void **state);
 
+void close_commands(void **state);
+
 int utf8_pos_to_col(char *str, int utf8_pos);
 
 void glist_set_cmp(GCompareFunc func);
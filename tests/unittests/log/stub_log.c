@@ -52,24 +52,89 @@ log_level_t log_level_from_string(char *log_level)
 void log_stderr_init(log_level_t level) {}
 void log_stderr_close(void) {}
 void log_stderr_handler(void) {}
+int log_stderr_fd(void) { return -1; }
 
 void chat_log_init(void) {}
 
-void chat_log_msg_out(const char * const barejid, const char * const msg) {}
-void chat_log_otr_msg_out(const char * const barejid, const char * const msg) {}
-void chat_log_pgp_msg_out(const char * const barejid, const char * const msg) {}
+void chat_log_msg_out(const char * const barejid, const char * const msg, const char * const id) {}
+void chat_log_otr_msg_out(const char * const barejid, const char * const msg, const char * const id) {}
+void chat_log_pgp_msg_out(const char * const barejid, const char * const msg, const char * const id) {}
 
 void chat_log_msg_in(const char * const barejid, const char * const msg, GDateTime *timestamp) {}
 void chat_log_otr_msg_in(const char * const barejid, const char * const msg, gboolean was_decrypted, GDateTime *timestamp) {}
 void chat_log_pgp_msg_in(const char * const barejid, const char * const msg, GDateTime *timestamp) {}
 
+guint64 chat_log_written(const char *const jid)
+{
+    return 0;
+}
+
+void chat_log_flush(void) {}
+void chat_log_retention(void) {}
+void log_async_start(void) {}
+void log_async_stop(void) {}
+gboolean log_async_running(void)
+{
+    return FALSE;
+}
+int log_async_queue_depth(void)
+{
+    return 0;
+}
+guint log_async_queue_full_count(void)
+{
+    return 0;
+}
+gboolean log_area_set(const char *const area, const char *const setting, const char *const value)
+{
+    return TRUE;
+}
+void log_area_clear(const char *const area) {}
+GList* log_area_list(void)
+{
+    return NULL;
+}
+gchar* log_area_describe(const char *const area)
+{
+    return NULL;
+}
+int log_async_error_count(void)
+{
+    return 0;
+}
+void chat_log_receipt(const char * const barejid, const char * const id) {}
 void chat_log_close(void) {}
 GSList * chat_log_get_previous(const gchar * const login,
-    const gchar * const recipient)
+    const gchar * const recipient, int max_lines)
 {
     return mock_ptr_type(GSList *);
 }
+void chat_log_get_previous_async(const gchar * const login, const gchar * const recipient, int max_lines,
+    ChatLogHistoryFunc func, gpointer data) {}
+void chat_log_history_process(void) {}
+gboolean chat_log_history_pending(void)
+{
+    return FALSE;
+}
+
+GSList * chat_log_search(const gchar * const login,
+    const gchar * const query, int max_results)
+{
+    return NULL;
+}
+int chat_log_index_all(const gchar * const login)
+{
+    return 0;
+}
+int chat_log_convert(const gchar * const login)
+{
+    return 0;
+}
 
 void groupchat_log_init(void) {}
 void groupchat_log_chat(const gchar * const login, const gchar * const room,
     const gchar * const nick, const gchar * const msg) {}
+GDateTime* groupchat_log_get_last_time(const gchar * const login, const gchar * const room)
+{
+    return NULL;
+}
@@ -23,6 +23,13 @@ const char* p_gpg_libver(void)
 
 void p_gpg_verify(const char * const barejid, const char *const sign) {}
 
+gboolean p_gpg_pending(void)
+{
+    return FALSE;
+}
+
+void p_gpg_process(void) {}
+
 char* p_gpg_sign(const char * const str, const char * const fp)
 {
     return NULL;
@@ -42,6 +49,7 @@ char * p_gpg_decrypt(const char * const cipher)
     return NULL;
 }
 
+void p_gpg_preload(const char * const barejid) {}
 void p_gpg_on_connect(const char * const barejid) {}
 void p_gpg_on_disconnect(void) {}
 
@@ -0,0 +1,13 @@
+#include <glib.h>
+
+#include "plugins/plugins.h"
+
+void plugins_init(void) {}
+void plugins_close(void) {}
+
+gboolean plugins_pending(void)
+{
+    return FALSE;
+}
+
+void plugins_process(void) {}
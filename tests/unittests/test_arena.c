@@ -0,0 +1,65 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/arena.h"
+
+void arena_allocations_are_aligned(void **state)
+{
+    arena_begin();
+
+    arena_alloc(3);
+    void *second = arena_alloc(sizeof(double));
+
+    assert_int_equal(0, (uintptr_t)second % sizeof(void*));
+
+    arena_end();
+}
+
+void arena_strdup_copies(void **state)
+{
+    arena_begin();
+
+    char original[] = "away";
+    char *copy = arena_strdup(original);
+    original[0] = 'A';
+
+    assert_string_equal("away", copy);
+    assert_null(arena_strdup(NULL));
+
+    arena_end();
+}
+
+void arena_released_when_outermost_scope_ends(void **state)
+{
+    arena_begin();
+    arena_alloc(100);
+    arena_begin();
+    arena_alloc(100);
+    arena_end();
+
+    assert_true(arena_used() >= 200);
+
+    arena_end();
+
+    assert_int_equal(0, arena_used());
+}
+
+void arena_large_allocation_gets_own_block(void **state)
+{
+    arena_begin();
+    arena_alloc(16);
+    char *large = arena_alloc(100000);
+    memset(large, 'x', 100000);
+
+    assert_int_equal(2, arena_blocks());
+
+    arena_end();
+
+    assert_int_equal(1, arena_blocks());
+}
@@ -0,0 +1,4 @@
+void arena_allocations_are_aligned(void **state);
+void arena_strdup_copies(void **state);
+void arena_released_when_outermost_scope_ends(void **state);
+void arena_large_allocation_gets_own_block(void **state);
@@ -117,3 +117,248 @@ void add_two_same_updates(void **state)
     autocomplete_clear(ac);
     g_slist_free_full(result, g_free);
 }
+
+void add_out_of_order_lists_sorted(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Charlie");
+    autocomplete_add(ac, "Alpha");
+    autocomplete_add(ac, "Bravo");
+    GSList *result = autocomplete_create_list(ac);
+
+    assert_int_equal(3, g_slist_length(result));
+    assert_string_equal("Alpha", g_slist_nth_data(result, 0));
+    assert_string_equal("Bravo", g_slist_nth_data(result, 1));
+    assert_string_equal("Charlie", g_slist_nth_data(result, 2));
+
+    autocomplete_free(ac);
+    g_slist_free_full(result, g_free);
+}
+
+void complete_cycles_back_to_first(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Hello");
+    autocomplete_add(ac, "Help");
+    autocomplete_add(ac, "Other");
+
+    char *result1 = autocomplete_complete(ac, "He", FALSE);
+    char *result2 = autocomplete_complete(ac, result1, FALSE);
+    char *result3 = autocomplete_complete(ac, result2, FALSE);
+
+    assert_string_equal("Hello", result1);
+    assert_string_equal("Help", result2);
+    assert_string_equal("Hello", result3);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+    free(result3);
+}
+
+void contains_after_remove_returns_false(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Hello");
+    autocomplete_add(ac, "Help");
+    autocomplete_remove(ac, "Hello");
+
+    assert_false(autocomplete_contains(ac, "Hello"));
+    assert_true(autocomplete_contains(ac, "Help"));
+    assert_int_equal(1, autocomplete_length(ac));
+
+    autocomplete_free(ac);
+}
+
+void complete_after_adding_before_last_found_returns_next(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Hello");
+    autocomplete_add(ac, "Help");
+
+    char *result1 = autocomplete_complete(ac, "He", FALSE);
+    autocomplete_add(ac, "Aaron");
+    char *result2 = autocomplete_complete(ac, result1, FALSE);
+
+    assert_string_equal("Hello", result1);
+    assert_string_equal("Help", result2);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+}
+
+void add_all_sorts_and_removes_duplicates(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Bravo");
+    GSList *items = NULL;
+    items = g_slist_append(items, "Charlie");
+    items = g_slist_append(items, "Alpha");
+    items = g_slist_append(items, "Bravo");
+    items = g_slist_append(items, "Alpha");
+    autocomplete_add_all(ac, items);
+    GSList *result = autocomplete_create_list(ac);
+
+    assert_int_equal(3, g_slist_length(result));
+    assert_string_equal("Alpha", g_slist_nth_data(result, 0));
+    assert_string_equal("Bravo", g_slist_nth_data(result, 1));
+    assert_string_equal("Charlie", g_slist_nth_data(result, 2));
+
+    autocomplete_free(ac);
+    g_slist_free(items);
+    g_slist_free_full(result, g_free);
+}
+
+void add_all_then_complete(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    GSList *items = NULL;
+    items = g_slist_append(items, "Help");
+    items = g_slist_append(items, "Hello");
+    autocomplete_add_all(ac, items);
+
+    char *result = autocomplete_complete(ac, "Hel", FALSE);
+
+    assert_string_equal("Hello", result);
+
+    autocomplete_free(ac);
+    g_slist_free(items);
+    free(result);
+}
+
+void fuzzy_complete_matches_subsequence(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "alice@server.org");
+    autocomplete_add(ac, "bob@server.org");
+    autocomplete_add(ac, "carol@jabber.org");
+
+    char *result1 = autocomplete_complete_fuzzy(ac, "bsr", FALSE);
+    char *result2 = autocomplete_complete_fuzzy(ac, "bsr", FALSE);
+
+    assert_string_equal("bob@server.org", result1);
+    assert_null(result2);
+
+    autocomplete_free(ac);
+    free(result1);
+}
+
+void fuzzy_complete_ranks_best_match_first(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "xxab");
+    autocomplete_add(ac, "ab");
+    autocomplete_add(ac, "a_b");
+
+    char *result1 = autocomplete_complete_fuzzy(ac, "ab", FALSE);
+    char *result2 = autocomplete_complete_fuzzy(ac, "ab", FALSE);
+    char *result3 = autocomplete_complete_fuzzy(ac, "ab", FALSE);
+
+    assert_string_equal("a_b", result1);
+    assert_string_equal("ab", result2);
+    assert_string_equal("xxab", result3);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+    free(result3);
+}
+
+void fuzzy_complete_ignores_case(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Bob");
+
+    char *result1 = autocomplete_complete_fuzzy(ac, "bB", FALSE);
+    autocomplete_reset(ac);
+    char *result2 = autocomplete_complete_fuzzy(ac, "OB", FALSE);
+
+    assert_string_equal("Bob", result1);
+    assert_string_equal("Bob", result2);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+}
+
+void fuzzy_complete_ranks_touched_higher(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "bob1");
+    autocomplete_add(ac, "bob2");
+
+    char *result1 = autocomplete_complete_fuzzy(ac, "bob", FALSE);
+    autocomplete_reset(ac);
+    autocomplete_touch(ac, "bob2");
+    char *result2 = autocomplete_complete_fuzzy(ac, "bob", FALSE);
+
+    assert_string_equal("bob1", result1);
+    assert_string_equal("bob2", result2);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+}
+
+void fuzzy_complete_quotes_items_with_spaces(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Bob Smith");
+
+    char *result = autocomplete_complete_fuzzy(ac, "bsm", TRUE);
+
+    assert_string_equal("\"Bob Smith\"", result);
+
+    autocomplete_free(ac);
+    free(result);
+}
+
+void fuzzy_complete_sees_items_added_since_last_search(void **state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "alice");
+
+    char *result1 = autocomplete_complete_fuzzy(ac, "bo", FALSE);
+    autocomplete_add(ac, "bob");
+    autocomplete_reset(ac);
+    char *result2 = autocomplete_complete_fuzzy(ac, "bo", FALSE);
+
+    assert_null(result1);
+    assert_string_equal("bob", result2);
+
+    autocomplete_free(ac);
+    free(result2);
+}
+
+void static_complete_cycles_through_items(void **state)
+{
+    static const char *const items[] = { "off", "on", "once" };
+    Autocomplete ac = autocomplete_new_static(items, 3);
+
+    char *result1 = autocomplete_complete(ac, "on", FALSE);
+    char *result2 = autocomplete_complete(ac, "on", FALSE);
+
+    assert_string_equal("on", result1);
+    assert_string_equal("once", result2);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+}
+
+void static_ignores_changes(void **state)
+{
+    static const char *const items[] = { "off", "on" };
+    Autocomplete ac = autocomplete_new_static(items, 2);
+
+    autocomplete_add(ac, "auto");
+    autocomplete_remove(ac, "on");
+    autocomplete_clear(ac);
+
+    assert_int_equal(2, autocomplete_length(ac));
+    assert_false(autocomplete_contains(ac, "auto"));
+    assert_true(autocomplete_contains(ac, "on"));
+
+    autocomplete_free(ac);
+}
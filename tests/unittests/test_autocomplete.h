@@ -8,3 +8,17 @@ void add_two_and_complete_returns_second(void **state);
 void add_two_adds_two(void **state);
 void add_two_same_adds_one(void **state);
 void add_two_same_updates(void **state);
+void add_out_of_order_lists_sorted(void **state);
+void complete_cycles_back_to_first(void **state);
+void contains_after_remove_returns_false(void **state);
+void complete_after_adding_before_last_found_returns_next(void **state);
+void add_all_sorts_and_removes_duplicates(void **state);
+void add_all_then_complete(void **state);
+void fuzzy_complete_matches_subsequence(void **state);
+void fuzzy_complete_ranks_best_match_first(void **state);
+void fuzzy_complete_ignores_case(void **state);
+void fuzzy_complete_ranks_touched_higher(void **state);
+void fuzzy_complete_quotes_items_with_spaces(void **state);
+void fuzzy_complete_sees_items_added_since_last_search(void **state);
+void static_complete_cycles_through_items(void **state);
+void static_ignores_changes(void **state);
@@ -0,0 +1,189 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tools/binlog.h"
+
+#define TEXT_LOG "./binlog_test.log"
+#define BINARY_LOG "./binlog_test.plog"
+
+void encode_then_decode_message(void **state)
+{
+    GDateTime *timestamp = g_date_time_new_utc(2015, 6, 1, 12, 30, 15);
+    BinlogEntry *entry = binlog_message_new(timestamp, BINLOG_OUT, BINLOG_FLAG_OTR,
+        BINLOG_RECEIPT_PENDING, "id1", "me", "hello");
+    GString *out = g_string_new("");
+    binlog_encode(entry, out);
+
+    gsize pos = 0;
+    BinlogEntry *decoded = binlog_decode(out->str, out->len, &pos);
+
+    assert_non_null(decoded);
+    assert_int_equal(out->len, pos);
+    assert_int_equal(BINLOG_MESSAGE, decoded->type);
+    assert_true(entry->timestamp == decoded->timestamp);
+    assert_true(g_date_time_to_unix(timestamp) * G_USEC_PER_SEC == decoded->timestamp);
+    assert_int_equal(BINLOG_OUT, decoded->direction);
+    assert_int_equal(BINLOG_FLAG_OTR, decoded->flags);
+    assert_int_equal(BINLOG_RECEIPT_PENDING, decoded->receipt);
+    assert_string_equal("id1", decoded->id);
+    assert_string_equal("me", decoded->from);
+    assert_string_equal("hello", decoded->message);
+
+    binlog_entry_free(decoded);
+    binlog_entry_free(entry);
+    g_string_free(out, TRUE);
+    g_date_time_unref(timestamp);
+}
+
+void encode_then_decode_receipt(void **state)
+{
+    BinlogEntry *entry = binlog_receipt_new("id1");
+    GString *out = g_string_new("");
+    binlog_encode(entry, out);
+
+    gsize pos = 0;
+    BinlogEntry *decoded = binlog_decode(out->str, out->len, &pos);
+
+    assert_int_equal(BINLOG_RECEIPT, decoded->type);
+    assert_string_equal("id1", decoded->id);
+    assert_null(decoded->message);
+
+    binlog_entry_free(decoded);
+    binlog_entry_free(entry);
+    g_string_free(out, TRUE);
+}
+
+void decode_truncated_record_returns_null(void **state)
+{
+    GDateTime *timestamp = g_date_time_new_now_local();
+    BinlogEntry *entry = binlog_message_new(timestamp, BINLOG_IN, 0, BINLOG_RECEIPT_NONE,
+        NULL, "bob@server.org", "hello");
+    GString *out = g_string_new("");
+    binlog_encode(entry, out);
+
+    gsize pos = 0;
+    BinlogEntry *decoded = binlog_decode(out->str, out->len - 1, &pos);
+
+    assert_null(decoded);
+    assert_int_equal(0, pos);
+
+    binlog_entry_free(entry);
+    g_string_free(out, TRUE);
+    g_date_time_unref(timestamp);
+}
+
+void decode_skips_unknown_record_type(void **state)
+{
+    GString *out = g_string_new_len("\x02\x00\x00\x00\x7f\x00", 6);
+    BinlogEntry *entry = binlog_receipt_new("id1");
+    binlog_encode(entry, out);
+
+    gsize pos = 0;
+    BinlogEntry *decoded = binlog_decode(out->str, out->len, &pos);
+
+    assert_non_null(decoded);
+    assert_string_equal("id1", decoded->id);
+
+    binlog_entry_free(decoded);
+    binlog_entry_free(entry);
+    g_string_free(out, TRUE);
+}
+
+void parse_text_line_incoming(void **state)
+{
+    GDateTime *day = g_date_time_new_local(2015, 6, 1, 0, 0, 0);
+
+    BinlogEntry *entry = binlog_parse_text_line("12:30:15 - bob@server.org: hi: there", day, "bob@server.org");
+
+    GDateTime *expected = g_date_time_new_local(2015, 6, 1, 12, 30, 15);
+    assert_non_null(entry);
+    assert_true(g_date_time_to_unix(expected) * G_USEC_PER_SEC == entry->timestamp);
+    assert_int_equal(BINLOG_IN, entry->direction);
+    assert_string_equal("bob@server.org", entry->from);
+    assert_string_equal("hi: there", entry->message);
+
+    binlog_entry_free(entry);
+    g_date_time_unref(expected);
+    g_date_time_unref(day);
+}
+
+void parse_text_line_outgoing_me(void **state)
+{
+    GDateTime *day = g_date_time_new_local(2015, 6, 1, 0, 0, 0);
+
+    BinlogEntry *entry = binlog_parse_text_line("12:30:15 - *me waves", day, "bob@server.org");
+
+    assert_int_equal(BINLOG_OUT, entry->direction);
+    assert_string_equal("me", entry->from);
+    assert_string_equal("/me waves", entry->message);
+
+    binlog_entry_free(entry);
+    g_date_time_unref(day);
+}
+
+void parse_text_line_not_a_message_returns_null(void **state)
+{
+    GDateTime *day = g_date_time_new_local(2015, 6, 1, 0, 0, 0);
+
+    BinlogEntry *entry = binlog_parse_text_line("second line of a message", day, "bob@server.org");
+
+    assert_null(entry);
+
+    g_date_time_unref(day);
+}
+
+void convert_file_then_read_joins_multiline_messages(void **state)
+{
+    FILE *f = fopen(TEXT_LOG, "w");
+    fputs("10:00:00 - bob@server.org: first line\nsecond line\n10:00:05 - me: reply\n", f);
+    fclose(f);
+    GDateTime *day = g_date_time_new_local(2015, 6, 1, 0, 0, 0);
+
+    gboolean result = binlog_convert_file(TEXT_LOG, BINARY_LOG, day, "bob@server.org");
+    GSList *entries = binlog_read_file(BINARY_LOG);
+
+    assert_true(result);
+    assert_int_equal(2, g_slist_length(entries));
+    BinlogEntry *entry = entries->data;
+    assert_string_equal("first line\nsecond line", entry->message);
+    entry = entries->next->data;
+    assert_int_equal(BINLOG_OUT, entry->direction);
+    assert_string_equal("reply", entry->message);
+
+    g_slist_free_full(entries, (GDestroyNotify)binlog_entry_free);
+    g_date_time_unref(day);
+    unlink(TEXT_LOG);
+    unlink(BINARY_LOG);
+}
+
+void read_file_applies_receipts(void **state)
+{
+    GDateTime *timestamp = g_date_time_new_now_local();
+    GString *out = g_string_new_len(BINLOG_MAGIC, BINLOG_MAGIC_LEN);
+    BinlogEntry *message = binlog_message_new(timestamp, BINLOG_OUT, 0, BINLOG_RECEIPT_PENDING,
+        "id1", "me", "hello");
+    BinlogEntry *receipt = binlog_receipt_new("id1");
+    binlog_encode(message, out);
+    binlog_encode(receipt, out);
+    g_file_set_contents(BINARY_LOG, out->str, out->len, NULL);
+
+    GSList *entries = binlog_read_file(BINARY_LOG);
+
+    assert_int_equal(1, g_slist_length(entries));
+    BinlogEntry *entry = entries->data;
+    assert_int_equal(BINLOG_RECEIPT_RECEIVED, entry->receipt);
+
+    g_slist_free_full(entries, (GDestroyNotify)binlog_entry_free);
+    binlog_entry_free(message);
+    binlog_entry_free(receipt);
+    g_string_free(out, TRUE);
+    g_date_time_unref(timestamp);
+    unlink(BINARY_LOG);
+}
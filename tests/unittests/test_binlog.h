@@ -0,0 +1,9 @@
+void encode_then_decode_message(void **state);
+void encode_then_decode_receipt(void **state);
+void decode_truncated_record_returns_null(void **state);
+void decode_skips_unknown_record_type(void **state);
+void parse_text_line_incoming(void **state);
+void parse_text_line_outgoing_me(void **state);
+void parse_text_line_not_a_message_returns_null(void **state);
+void convert_file_then_read_joins_multiline_messages(void **state);
+void read_file_applies_receipts(void **state);
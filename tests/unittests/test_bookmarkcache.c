@@ -0,0 +1,144 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "config/bookmarkcache.h"
+#include "xmpp/bookmark.h"
+
+#define BOOKMARKCACHE_DIR "./tests/files/xdg_data_home/profanity/bookmarks"
+#define BOOKMARKCACHE_FILE "./tests/files/xdg_data_home/profanity/bookmarks/me_at_server.org"
+
+static Bookmark*
+_bookmark(const char *const jid, const char *const nick, const char *const password, gboolean autojoin)
+{
+    Bookmark *item = malloc(sizeof(*item));
+    item->jid = strdup(jid);
+    item->nick = nick ? strdup(nick) : NULL;
+    item->password = password ? strdup(password) : NULL;
+    item->autojoin = autojoin;
+
+    return item;
+}
+
+static void
+_bookmark_free(gpointer data)
+{
+    Bookmark *item = data;
+    free(item->jid);
+    free(item->nick);
+    free(item->password);
+    free(item);
+}
+
+void init_bookmarkcache(void **state)
+{
+    create_data_dir(state);
+    bookmarkcache_on_connect("me@server.org");
+}
+
+void close_bookmarkcache(void **state)
+{
+    bookmarkcache_on_disconnect();
+    remove(BOOKMARKCACHE_FILE);
+    rmdir(BOOKMARKCACHE_DIR);
+    remove_data_dir(state);
+    rmdir("./tests/files");
+}
+
+void bookmarkcache_load_without_file_returns_null(void **state)
+{
+    assert_null(bookmarkcache_load());
+}
+
+void bookmarkcache_load_returns_saved(void **state)
+{
+    GList *bookmarks = NULL;
+    bookmarks = g_list_append(bookmarks, _bookmark("room1@conference.server.org", "me", "secret", TRUE));
+    bookmarks = g_list_append(bookmarks, _bookmark("room2@conference.server.org", NULL, NULL, FALSE));
+    bookmarkcache_save(bookmarks);
+    g_list_free_full(bookmarks, _bookmark_free);
+
+    GList *loaded = bookmarkcache_load();
+    assert_int_equal(2, g_list_length(loaded));
+
+    Bookmark *first = loaded->data;
+    assert_string_equal("room1@conference.server.org", first->jid);
+    assert_string_equal("me", first->nick);
+    assert_string_equal("secret", first->password);
+    assert_true(first->autojoin);
+
+    Bookmark *second = loaded->next->data;
+    assert_string_equal("room2@conference.server.org", second->jid);
+    assert_null(second->nick);
+    assert_null(second->password);
+    assert_false(second->autojoin);
+
+    g_list_free_full(loaded, _bookmark_free);
+}
+
+void bookmarkcache_save_replaces_previous(void **state)
+{
+    GList *bookmarks = g_list_append(NULL, _bookmark("room1@conference.server.org", NULL, NULL, TRUE));
+    bookmarkcache_save(bookmarks);
+    g_list_free_full(bookmarks, _bookmark_free);
+
+    bookmarks = g_list_append(NULL, _bookmark("room2@conference.server.org", NULL, NULL, TRUE));
+    bookmarkcache_save(bookmarks);
+    g_list_free_full(bookmarks, _bookmark_free);
+
+    GList *loaded = bookmarkcache_load();
+    assert_int_equal(1, g_list_length(loaded));
+    assert_string_equal("room2@conference.server.org", ((Bookmark*)loaded->data)->jid);
+
+    g_list_free_full(loaded, _bookmark_free);
+}
+
+void bookmarkcache_not_saved_after_disconnect(void **state)
+{
+    bookmarkcache_on_disconnect();
+
+    GList *bookmarks = g_list_append(NULL, _bookmark("room1@conference.server.org", NULL, NULL, TRUE));
+    bookmarkcache_save(bookmarks);
+    g_list_free_full(bookmarks, _bookmark_free);
+
+    assert_int_equal(-1, access(BOOKMARKCACHE_FILE, F_OK));
+}
+
+void bookmarkcache_autojoin_dropped_returns_removed_and_not_autojoined(void **state)
+{
+    GList *joined = NULL;
+    joined = g_list_append(joined, "room1@conference.server.org");
+    joined = g_list_append(joined, "room2@conference.server.org");
+    joined = g_list_append(joined, "room3@conference.server.org");
+
+    GList *bookmarks = NULL;
+    bookmarks = g_list_append(bookmarks, _bookmark("room1@conference.server.org", NULL, NULL, TRUE));
+    bookmarks = g_list_append(bookmarks, _bookmark("room3@conference.server.org", NULL, NULL, FALSE));
+
+    GList *dropped = bookmarkcache_autojoin_dropped(joined, bookmarks);
+    assert_int_equal(2, g_list_length(dropped));
+    assert_string_equal("room2@conference.server.org", dropped->data);
+    assert_string_equal("room3@conference.server.org", dropped->next->data);
+
+    g_list_free(dropped);
+    g_list_free_full(bookmarks, _bookmark_free);
+    g_list_free(joined);
+}
+
+void bookmarkcache_autojoin_dropped_empty_when_all_kept(void **state)
+{
+    GList *joined = g_list_append(NULL, "room1@conference.server.org");
+    GList *bookmarks = g_list_append(NULL, _bookmark("room1@conference.server.org", NULL, NULL, TRUE));
+
+    assert_null(bookmarkcache_autojoin_dropped(joined, bookmarks));
+
+    g_list_free_full(bookmarks, _bookmark_free);
+    g_list_free(joined);
+}
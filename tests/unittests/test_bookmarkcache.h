@@ -0,0 +1,8 @@
+void init_bookmarkcache(void **state);
+void close_bookmarkcache(void **state);
+void bookmarkcache_load_without_file_returns_null(void **state);
+void bookmarkcache_load_returns_saved(void **state);
+void bookmarkcache_save_replaces_previous(void **state);
+void bookmarkcache_not_saved_after_disconnect(void **state);
+void bookmarkcache_autojoin_dropped_returns_removed_and_not_autojoined(void **state);
+void bookmarkcache_autojoin_dropped_empty_when_all_kept(void **state);
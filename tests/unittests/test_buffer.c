@@ -0,0 +1,499 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ui/buffer.h"
+
+static void
+_push_message(ProfBuff buffer, const char *const message)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    buffer_push(buffer, '-', 0, now, 0, 0, "", message, NULL);
+    g_date_time_unref(now);
+}
+
+static void
+_push_message_with_receipt(ProfBuff buffer, const char *const message, const char *const id)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    DeliveryReceipt *receipt = malloc(sizeof(struct delivery_receipt_t));
+    receipt->id = strdup(id);
+    receipt->received = FALSE;
+    buffer_push(buffer, '-', 0, now, 0, 0, "me", message, receipt);
+    g_date_time_unref(now);
+}
+
+void buffer_empty_after_create(void **state)
+{
+    ProfBuff buffer = buffer_create();
+
+    assert_int_equal(0, buffer_size(buffer));
+
+    buffer_free(buffer);
+}
+
+void buffer_push_adds_entry(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "hello");
+
+    assert_int_equal(1, buffer_size(buffer));
+    assert_string_equal("hello", buffer_yield_entry(buffer, 0)->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_yield_returns_entries_in_order(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+    _push_message(buffer, "third");
+
+    assert_string_equal("first", buffer_yield_entry(buffer, 0)->message);
+    assert_string_equal("second", buffer_yield_entry(buffer, 1)->message);
+    assert_string_equal("third", buffer_yield_entry(buffer, 2)->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_yield_out_of_range_returns_null(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+
+    assert_null(buffer_yield_entry(buffer, 1));
+    assert_null(buffer_yield_entry(buffer, -1));
+
+    buffer_free(buffer);
+}
+
+void buffer_full_evicts_oldest(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    int i;
+    for (i = 0; i < BUFF_SIZE + 5; i++) {
+        char *message = g_strdup_printf("message %d", i);
+        _push_message(buffer, message);
+        g_free(message);
+    }
+
+    assert_int_equal(BUFF_SIZE, buffer_size(buffer));
+    assert_string_equal("message 5", buffer_yield_entry(buffer, 0)->message);
+    assert_string_equal("message 1204", buffer_yield_entry(buffer, BUFF_SIZE - 1)->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_iter_walks_all_entries(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+
+    ProfBuffIter iter;
+    buffer_iter_init(&iter, buffer);
+
+    assert_string_equal("first", buffer_iter_next(&iter)->message);
+    assert_string_equal("second", buffer_iter_next(&iter)->message);
+    assert_null(buffer_iter_next(&iter));
+
+    buffer_free(buffer);
+}
+
+void buffer_iter_walks_all_entries_after_wrap(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    int i;
+    for (i = 0; i < BUFF_SIZE * 2; i++) {
+        char *message = g_strdup_printf("message %d", i);
+        _push_message(buffer, message);
+        g_free(message);
+    }
+
+    ProfBuffIter iter;
+    ProfBuffEntry *entry = NULL;
+    int count = 0;
+    buffer_iter_init(&iter, buffer);
+    while ((entry = buffer_iter_next(&iter))) {
+        char *expected = g_strdup_printf("message %d", BUFF_SIZE + count);
+        assert_string_equal(expected, entry->message);
+        g_free(expected);
+        count++;
+    }
+
+    assert_int_equal(BUFF_SIZE, count);
+
+    buffer_free(buffer);
+}
+
+void buffer_mark_received_marks_entry(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message_with_receipt(buffer, "hello", "id1");
+    _push_message_with_receipt(buffer, "world", "id2");
+
+    gboolean result = buffer_mark_received(buffer, "id2");
+
+    assert_true(result);
+    assert_false(buffer_yield_entry(buffer, 0)->receipt->received);
+    assert_true(buffer_yield_entry(buffer, 1)->receipt->received);
+
+    buffer_free(buffer);
+}
+
+void buffer_mark_received_upto_marks_earlier_entries(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message_with_receipt(buffer, "one", "id1");
+    _push_message(buffer, "incoming");
+    _push_message_with_receipt(buffer, "two", "id2");
+    _push_message_with_receipt(buffer, "three", "id3");
+
+    int marked = buffer_mark_received_upto(buffer, "id2");
+
+    assert_int_equal(2, marked);
+    assert_true(buffer_yield_entry(buffer, 0)->receipt->received);
+    assert_null(buffer_yield_entry(buffer, 1)->receipt);
+    assert_true(buffer_yield_entry(buffer, 2)->receipt->received);
+    assert_false(buffer_yield_entry(buffer, 3)->receipt->received);
+    assert_int_equal(0, buffer_mark_received_upto(buffer, "id1"));
+
+    buffer_free(buffer);
+}
+
+void buffer_mark_received_upto_ignores_unknown_id(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message_with_receipt(buffer, "one", "id1");
+
+    assert_int_equal(0, buffer_mark_received_upto(buffer, "id2"));
+    assert_false(buffer_yield_entry(buffer, 0)->receipt->received);
+
+    buffer_free(buffer);
+}
+
+void buffer_mark_received_returns_false_when_not_found(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message_with_receipt(buffer, "hello", "id1");
+
+    gboolean result = buffer_mark_received(buffer, "id2");
+
+    assert_false(result);
+
+    buffer_free(buffer);
+}
+
+void buffer_get_entry_by_id_returns_entry(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message_with_receipt(buffer, "hello", "id1");
+    _push_message(buffer, "no receipt");
+    _push_message_with_receipt(buffer, "world", "id2");
+
+    ProfBuffEntry *entry = buffer_get_entry_by_id(buffer, "id2");
+
+    assert_non_null(entry);
+    assert_string_equal("world", entry->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_get_entry_by_id_returns_null_after_eviction(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message_with_receipt(buffer, "hello", "id1");
+    int i;
+    for (i = 0; i < BUFF_SIZE; i++) {
+        _push_message(buffer, "filler");
+    }
+
+    assert_null(buffer_get_entry_by_id(buffer, "id1"));
+    assert_false(buffer_mark_received(buffer, "id1"));
+
+    buffer_free(buffer);
+}
+
+static void
+_prepend_message(ProfBuff buffer, const char *const message)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    buffer_prepend(buffer, '-', 0, now, 0, 0, "", message);
+    g_date_time_unref(now);
+}
+
+void buffer_prepend_adds_oldest_entry(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "second");
+    _push_message(buffer, "third");
+    _prepend_message(buffer, "first");
+
+    assert_int_equal(3, buffer_size(buffer));
+    assert_string_equal("first", buffer_yield_entry(buffer, 0)->message);
+    assert_string_equal("second", buffer_yield_entry(buffer, 1)->message);
+    assert_string_equal("third", buffer_yield_entry(buffer, 2)->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_prepend_returns_null_when_full(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    int i;
+    for (i = 0; i < BUFF_SIZE + 5; i++) {
+        _push_message(buffer, "old");
+    }
+
+    GDateTime *now = g_date_time_new_now_local();
+    assert_null(buffer_prepend(buffer, '-', 0, now, 0, 0, "", "older"));
+    g_date_time_unref(now);
+    assert_int_equal(BUFF_SIZE, buffer_size(buffer));
+
+    buffer_free(buffer);
+}
+
+void buffer_prepend_to_empty_buffer(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _prepend_message(buffer, "second");
+    _prepend_message(buffer, "first");
+    _push_message(buffer, "third");
+
+    ProfBuffIter iter;
+    buffer_iter_init(&iter, buffer);
+    assert_string_equal("first", buffer_iter_next(&iter)->message);
+    assert_string_equal("second", buffer_iter_next(&iter)->message);
+    assert_string_equal("third", buffer_iter_next(&iter)->message);
+    assert_null(buffer_iter_next(&iter));
+
+    buffer_free(buffer);
+}
+
+void buffer_reused_entry_holds_new_text(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    GDateTime *now = g_date_time_new_now_local();
+    int i;
+    for (i = 0; i < BUFF_SIZE; i++) {
+        buffer_push(buffer, '-', 0, now, 0, 0, "someone with a long name", "a message that is longer", NULL);
+    }
+
+    GDateTime *later = g_date_time_add_seconds(now, 90);
+    buffer_push(buffer, '!', 0, later, 0, 0, "bob", "a much longer message than any of those before it", NULL);
+
+    ProfBuffEntry *entry = buffer_yield_entry(buffer, BUFF_SIZE - 1);
+    assert_int_equal('!', entry->show_char);
+    assert_string_equal("bob", entry->from);
+    assert_string_equal("a much longer message than any of those before it", entry->message);
+    assert_null(entry->layout);
+    assert_null(entry->date_fmt);
+
+    GDateTime *time = buffer_entry_datetime(entry);
+    assert_true(g_date_time_equal(later, time));
+
+    g_date_time_unref(time);
+    g_date_time_unref(later);
+    g_date_time_unref(now);
+    buffer_free(buffer);
+}
+
+void buffer_evict_oldest_frees_bytes(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+    _push_message(buffer, "third");
+    size_t total = buffer_total_bytes();
+    size_t bytes = buffer_bytes(buffer);
+
+    assert_int_equal(1, buffer_evict_oldest(buffer, 1, 0));
+
+    assert_int_equal(2, buffer_size(buffer));
+    assert_string_equal("second", buffer_yield_entry(buffer, 0)->message);
+    assert_true(buffer_bytes(buffer) < bytes);
+    assert_int_equal(total - (bytes - buffer_bytes(buffer)), buffer_total_bytes());
+
+    buffer_free(buffer);
+}
+
+void buffer_evict_oldest_keeps_newest(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+    _push_message(buffer, "third");
+
+    assert_int_equal(2, buffer_evict_oldest(buffer, 1000000, 1));
+
+    assert_int_equal(1, buffer_size(buffer));
+    assert_string_equal("third", buffer_yield_entry(buffer, 0)->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_free_returns_total_bytes(void **state)
+{
+    size_t total = buffer_total_bytes();
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "hello");
+
+    assert_true(buffer_total_bytes() > total);
+
+    buffer_free(buffer);
+
+    assert_int_equal(total, buffer_total_bytes());
+}
+
+void buffer_forget_layouts_keeps_messages(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+    ProfBuffEntry *entry = buffer_yield_entry(buffer, 0);
+    entry->layout = malloc(sizeof(ProfBuffLayout));
+    entry->layout->text = strdup("first");
+    entry->date_fmt = g_strdup("12:00");
+    entry->y_start_pos = 0;
+    entry->y_end_pos = 1;
+    size_t bytes = buffer_bytes(buffer);
+
+    buffer_forget_layouts(buffer);
+
+    assert_int_equal(2, buffer_size(buffer));
+    assert_null(entry->layout);
+    assert_null(entry->date_fmt);
+    assert_int_equal(-1, entry->y_start_pos);
+    assert_int_equal(-1, entry->y_end_pos);
+    assert_string_equal("first", entry->message);
+    assert_int_equal(bytes, buffer_bytes(buffer));
+
+    buffer_free(buffer);
+}
+
+void buffer_update_last_replaces_newest_message(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    GDateTime *now = g_date_time_new_now_local();
+    buffer_push(buffer, '-', 0, now, 0, 0, "alice", "hi", NULL);
+    ProfBuffEntry *entry = buffer_yield_entry(buffer, 1);
+    entry->date_fmt = g_strdup("12:00");
+    size_t bytes = buffer_bytes(buffer);
+
+    ProfBuffEntry *updated = buffer_update_last(buffer, now, "a much longer message than before");
+
+    assert_ptr_equal(entry, updated);
+    assert_int_equal(2, buffer_size(buffer));
+    assert_string_equal("alice", entry->from);
+    assert_string_equal("a much longer message than before", entry->message);
+    assert_null(entry->date_fmt);
+    assert_string_equal("first", buffer_yield_entry(buffer, 0)->message);
+    assert_true(buffer_bytes(buffer) > bytes);
+
+    g_date_time_unref(now);
+    buffer_free(buffer);
+}
+
+void buffer_update_last_on_empty_buffer_returns_null(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    GDateTime *now = g_date_time_new_now_local();
+
+    assert_null(buffer_update_last(buffer, now, "message"));
+
+    g_date_time_unref(now);
+    buffer_free(buffer);
+}
+
+void buffer_pushed_counts_past_full_buffer(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    GDateTime *now = g_date_time_new_now_local();
+    buffer_prepend(buffer, '-', 0, now, 0, 0, "", "older");
+    g_date_time_unref(now);
+
+    int i;
+    for (i = 0; i < BUFF_SIZE + 10; i++) {
+        _push_message(buffer, "message");
+    }
+
+    assert_int_equal(BUFF_SIZE + 10, buffer_pushed(buffer));
+    assert_int_equal(BUFF_SIZE, buffer_size(buffer));
+
+    buffer_free(buffer);
+}
+
+void buffer_set_id_finds_entry_by_id(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+    ProfBuffEntry *entry = buffer_yield_entry(buffer, 0);
+
+    buffer_set_id(buffer, entry, "msg1");
+
+    assert_ptr_equal(entry, buffer_get_entry_by_id(buffer, "msg1"));
+    assert_string_equal("msg1", entry->id);
+    assert_false(buffer_mark_received(buffer, "msg1"));
+
+    buffer_free(buffer);
+}
+
+void buffer_set_id_on_later_entry_replaces_earlier(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    _push_message(buffer, "second");
+    buffer_set_id(buffer, buffer_yield_entry(buffer, 0), "msg1");
+
+    buffer_set_id(buffer, buffer_yield_entry(buffer, 1), "msg1");
+
+    assert_ptr_equal(buffer_yield_entry(buffer, 1), buffer_get_entry_by_id(buffer, "msg1"));
+
+    buffer_free(buffer);
+}
+
+void buffer_replace_by_id_replaces_message(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    GDateTime *now = g_date_time_new_now_local();
+    buffer_push(buffer, '-', 0, now, 0, 0, "alice", "helo", NULL);
+    g_date_time_unref(now);
+    _push_message(buffer, "second");
+    ProfBuffEntry *entry = buffer_yield_entry(buffer, 0);
+    buffer_set_id(buffer, entry, "msg1");
+    gint64 time = entry->time;
+
+    ProfBuffEntry *replaced = buffer_replace_by_id(buffer, "msg1", "hello, with a longer message than before");
+
+    assert_ptr_equal(entry, replaced);
+    assert_string_equal("alice", entry->from);
+    assert_string_equal("hello, with a longer message than before", entry->message);
+    assert_true(entry->time == time);
+    assert_string_equal("second", buffer_yield_entry(buffer, 1)->message);
+
+    buffer_free(buffer);
+}
+
+void buffer_replace_by_id_returns_null_after_reuse(void **state)
+{
+    ProfBuff buffer = buffer_create();
+    _push_message(buffer, "first");
+    buffer_set_id(buffer, buffer_yield_entry(buffer, 0), "msg1");
+
+    int i;
+    for (i = 0; i < BUFF_SIZE; i++) {
+        _push_message(buffer, "message");
+    }
+
+    assert_null(buffer_replace_by_id(buffer, "msg1", "corrected"));
+    assert_null(buffer_get_entry_by_id(buffer, "msg1"));
+
+    buffer_free(buffer);
+}
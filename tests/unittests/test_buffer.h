@@ -0,0 +1,28 @@
+void buffer_empty_after_create(void **state);
+void buffer_push_adds_entry(void **state);
+void buffer_yield_returns_entries_in_order(void **state);
+void buffer_yield_out_of_range_returns_null(void **state);
+void buffer_full_evicts_oldest(void **state);
+void buffer_iter_walks_all_entries(void **state);
+void buffer_iter_walks_all_entries_after_wrap(void **state);
+void buffer_mark_received_marks_entry(void **state);
+void buffer_mark_received_returns_false_when_not_found(void **state);
+void buffer_mark_received_upto_marks_earlier_entries(void **state);
+void buffer_mark_received_upto_ignores_unknown_id(void **state);
+void buffer_get_entry_by_id_returns_entry(void **state);
+void buffer_get_entry_by_id_returns_null_after_eviction(void **state);
+void buffer_prepend_adds_oldest_entry(void **state);
+void buffer_prepend_returns_null_when_full(void **state);
+void buffer_prepend_to_empty_buffer(void **state);
+void buffer_reused_entry_holds_new_text(void **state);
+void buffer_evict_oldest_frees_bytes(void **state);
+void buffer_evict_oldest_keeps_newest(void **state);
+void buffer_free_returns_total_bytes(void **state);
+void buffer_forget_layouts_keeps_messages(void **state);
+void buffer_update_last_replaces_newest_message(void **state);
+void buffer_update_last_on_empty_buffer_returns_null(void **state);
+void buffer_pushed_counts_past_full_buffer(void **state);
+void buffer_set_id_finds_entry_by_id(void **state);
+void buffer_set_id_on_later_entry_replaces_earlier(void **state);
+void buffer_replace_by_id_replaces_message(void **state);
+void buffer_replace_by_id_returns_null_after_reuse(void **state);
@@ -0,0 +1,56 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "chat_state.h"
+#include "config/preferences.h"
+
+void typing_sets_composing(void **state)
+{
+    prefs_set_boolean(PREF_STATES, TRUE);
+    prefs_set_boolean(PREF_OUTTYPE, TRUE);
+    ChatState *chat_state = chat_state_new("bob@server.org");
+
+    chat_state_handle_typing("bob@server.org", chat_state);
+
+    assert_int_equal(CHAT_STATE_COMPOSING, chat_state->type);
+    chat_state_free(chat_state);
+}
+
+void typing_when_throttled_leaves_state(void **state)
+{
+    prefs_set_boolean(PREF_STATES, TRUE);
+    prefs_set_boolean(PREF_OUTTYPE, TRUE);
+    ChatState *chat_state = chat_state_new("bob@server.org");
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        chat_state_handle_typing("bob@server.org", chat_state);
+        assert_int_equal(CHAT_STATE_COMPOSING, chat_state->type);
+        chat_state_active(chat_state);
+    }
+
+    chat_state_handle_typing("bob@server.org", chat_state);
+
+    assert_int_equal(CHAT_STATE_ACTIVE, chat_state->type);
+    chat_state_free(chat_state);
+}
+
+void typing_without_outtype_is_not_throttled(void **state)
+{
+    prefs_set_boolean(PREF_STATES, TRUE);
+    prefs_set_boolean(PREF_OUTTYPE, FALSE);
+    ChatState *chat_state = chat_state_new("bob@server.org");
+
+    int i;
+    for (i = 0; i < 5; i++) {
+        chat_state_handle_typing("bob@server.org", chat_state);
+        assert_int_equal(CHAT_STATE_COMPOSING, chat_state->type);
+        chat_state_active(chat_state);
+    }
+
+    chat_state_free(chat_state);
+}
@@ -0,0 +1,3 @@
+void typing_sets_composing(void **state);
+void typing_when_throttled_leaves_state(void **state);
+void typing_without_outtype_is_not_throttled(void **state);
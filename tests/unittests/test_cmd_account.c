@@ -518,6 +518,85 @@ void cmd_account_set_nick_sets_nick(void **state)
     assert_true(result);
 }
 
+void cmd_account_set_history_maxstanzas_sets_value(void **state)
+{
+    gchar *args[] = { "set", "a_account", "history.maxstanzas", "20", NULL };
+
+    expect_any(accounts_account_exists, account_name);
+    will_return(accounts_account_exists, TRUE);
+
+    expect_string(accounts_set_muc_history, account_name, "a_account");
+    expect_string(accounts_set_muc_history, setting, "maxstanzas");
+    expect_value(accounts_set_muc_history, value, 20);
+
+    expect_cons_show("Updated history.maxstanzas for account a_account: 20");
+    expect_cons_show("");
+
+    gboolean result = cmd_account(NULL, CMD_ACCOUNT, args);
+    assert_true(result);
+}
+
+void cmd_account_set_history_since_sets_value(void **state)
+{
+    gchar *args[] = { "set", "a_account", "history.since", "on", NULL };
+
+    expect_any(accounts_account_exists, account_name);
+    will_return(accounts_account_exists, TRUE);
+
+    expect_string(accounts_set_muc_history, account_name, "a_account");
+    expect_string(accounts_set_muc_history, setting, "since");
+    expect_value(accounts_set_muc_history, value, 1);
+
+    expect_cons_show("Updated history.since for account a_account: on");
+    expect_cons_show("");
+
+    gboolean result = cmd_account(NULL, CMD_ACCOUNT, args);
+    assert_true(result);
+}
+
+void cmd_account_set_history_since_shows_message_when_invalid(void **state)
+{
+    gchar *args[] = { "set", "a_account", "history.since", "maybe", NULL };
+
+    expect_any(accounts_account_exists, account_name);
+    will_return(accounts_account_exists, TRUE);
+
+    expect_cons_show("History since must be one of: on or off.");
+
+    gboolean result = cmd_account(NULL, CMD_ACCOUNT, args);
+    assert_true(result);
+}
+
+void cmd_account_set_compression_sets_value(void **state)
+{
+    gchar *args[] = { "set", "a_account", "compression", "on", NULL };
+
+    expect_any(accounts_account_exists, account_name);
+    will_return(accounts_account_exists, TRUE);
+
+    expect_string(accounts_set_compression, account_name, "a_account");
+    expect_value(accounts_set_compression, value, TRUE);
+
+    expect_cons_show("Updated compression for account a_account: on");
+    expect_cons_show("");
+
+    gboolean result = cmd_account(NULL, CMD_ACCOUNT, args);
+    assert_true(result);
+}
+
+void cmd_account_set_compression_shows_message_when_invalid(void **state)
+{
+    gchar *args[] = { "set", "a_account", "compression", "zlib", NULL };
+
+    expect_any(accounts_account_exists, account_name);
+    will_return(accounts_account_exists, TRUE);
+
+    expect_cons_show("Compression must be one of: on or off.");
+
+    gboolean result = cmd_account(NULL, CMD_ACCOUNT, args);
+    assert_true(result);
+}
+
 void cmd_account_show_message_for_missing_otr_policy(void **state)
 {
     gchar *args[] = { "set", "a_account", "otr", NULL };
@@ -803,8 +882,8 @@ void cmd_account_set_priority_updates_presence_when_account_connected_with_prese
         NULL, NULL, 10, 10, 10, 10, 10, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
 
     will_return(jabber_get_account_name, "a_account");
-    expect_any(accounts_get_account, name);
-    will_return(accounts_get_account, account);
+    expect_any(accounts_peek_account, name);
+    will_return(accounts_peek_account, account);
 #endif
 
     will_return(jabber_get_presence_message, "Free to chat");
@@ -819,6 +898,10 @@ void cmd_account_set_priority_updates_presence_when_account_connected_with_prese
 
     gboolean result = cmd_account(NULL, CMD_ACCOUNT, args);
     assert_true(result);
+
+#ifdef HAVE_LIBGPGME
+    account_free(account);
+#endif
 }
 
 void cmd_account_clear_shows_usage_when_no_args(void **state)
@@ -32,6 +32,11 @@ void cmd_account_set_password_when_eval_password_set(void **state);
 void cmd_account_set_eval_password_when_password_set(void **state);
 void cmd_account_set_muc_sets_muc(void **state);
 void cmd_account_set_nick_sets_nick(void **state);
+void cmd_account_set_history_maxstanzas_sets_value(void **state);
+void cmd_account_set_history_since_sets_value(void **state);
+void cmd_account_set_history_since_shows_message_when_invalid(void **state);
+void cmd_account_set_compression_sets_value(void **state);
+void cmd_account_set_compression_shows_message_when_invalid(void **state);
 void cmd_account_show_message_for_missing_otr_policy(void **state);
 void cmd_account_show_message_for_invalid_otr_policy(void **state);
 void cmd_account_set_otr_sets_otr(void **state);
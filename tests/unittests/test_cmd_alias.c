@@ -126,3 +126,34 @@ void cmd_alias_list_shows_all_aliases(void **state)
     gboolean result = cmd_alias(NULL, CMD_ALIAS, args);
     assert_true(result);
 }
+
+void cmd_alias_add_runs_alias(void **state)
+{
+    gchar *args[] = { "add", "ab", "/about", NULL };
+    char inp[] = "/ab";
+
+    cmd_init();
+
+    expect_cons_show("Command alias added /ab -> /about");
+
+    gboolean result = cmd_alias(NULL, CMD_ALIAS, args);
+    assert_true(result);
+
+    expect_cons_show("");
+
+    result = cmd_process_input(NULL, inp);
+    assert_true(result);
+}
+
+void cmd_init_loads_aliases_to_run(void **state)
+{
+    char inp[] = "/ab";
+
+    prefs_add_alias("ab", "/about");
+    cmd_init();
+
+    expect_cons_show("");
+
+    gboolean result = cmd_process_input(NULL, inp);
+    assert_true(result);
+}
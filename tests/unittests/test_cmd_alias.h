@@ -7,3 +7,5 @@ void cmd_alias_add_shows_message_when_exists(void **state);
 void cmd_alias_remove_removes_alias(void **state);
 void cmd_alias_remove_shows_message_when_no_alias(void **state);
 void cmd_alias_list_shows_all_aliases(void **state);
+void cmd_alias_add_runs_alias(void **state);
+void cmd_init_loads_aliases_to_run(void **state);
@@ -152,6 +152,36 @@ void cmd_connect_shows_usage_when_no_server_value(void **state)
     assert_true(result);
 }
 
+void cmd_connect_connects_once_eval_password_done(void **state)
+{
+    gchar *args[] = { "jabber_org", NULL };
+    ProfAccount *account = account_new("jabber_org", "me@jabber.org", NULL, "echo password",
+        TRUE, NULL, 0, NULL, NULL, NULL, 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+
+    will_return(jabber_get_connection_status, JABBER_DISCONNECTED);
+
+    expect_any(accounts_get_account, name);
+    will_return(accounts_get_account, account);
+
+    expect_cons_show("Evaluating password for jabber_org...");
+
+    gboolean result = cmd_connect(NULL, CMD_CONNECT, args);
+    assert_true(result);
+    assert_true(account_eval_pending());
+
+    will_return(jabber_get_connection_status, JABBER_DISCONNECTED);
+    expect_cons_show("Connecting with account jabber_org as me@jabber.org");
+    expect_any(jabber_connect_with_account, account);
+    will_return(jabber_connect_with_account, JABBER_CONNECTING);
+
+    gint64 start = g_get_monotonic_time();
+    while (account_eval_pending() && (g_get_monotonic_time() - start < 10 * G_USEC_PER_SEC)) {
+        account_eval_process();
+        g_usleep(1000);
+    }
+    assert_false(account_eval_pending());
+}
+
 void cmd_connect_shows_usage_when_server_no_port_value(void **state)
 {
     gchar *args[] = { "user@server.org", "server", "aserver", "port", NULL };
@@ -0,0 +1,56 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "ui/ui.h"
+#include "ui/stub_ui.h"
+
+#include "command/command.h"
+#include "command/commands.h"
+
+#define CMD_HELP "/help"
+
+void cmd_get_finds_command(void **state)
+{
+    Command *pcmd = cmd_get("/about");
+
+    assert_non_null(pcmd);
+    assert_string_equal("/about", pcmd->cmd);
+}
+
+void cmd_get_returns_null_for_unknown_command(void **state)
+{
+    assert_null(cmd_get("/nosuchcommand"));
+    assert_null(cmd_get("about"));
+    assert_null(cmd_get(NULL));
+}
+
+void cmd_get_ordered_sorted_by_name(void **state)
+{
+    guint count = 0;
+    Command **ordered = cmd_get_ordered(&count);
+
+    assert_true(count > 0);
+    guint i;
+    for (i = 1; i < count; i++) {
+        assert_true(strcmp(ordered[i - 1]->cmd, ordered[i]->cmd) < 0);
+    }
+    for (i = 0; i < count; i++) {
+        assert_ptr_equal(ordered[i], cmd_get(ordered[i]->cmd));
+    }
+}
+
+void cmd_help_shows_message_when_no_such_command(void **state)
+{
+    gchar *args[] = { "nosuchcommand", NULL };
+
+    expect_cons_show("No such command.");
+    expect_cons_show("");
+
+    gboolean result = cmd_help(NULL, CMD_HELP, args);
+    assert_true(result);
+}
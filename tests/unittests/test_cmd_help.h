@@ -0,0 +1,4 @@
+void cmd_get_finds_command(void **state);
+void cmd_get_returns_null_for_unknown_command(void **state);
+void cmd_get_ordered_sorted_by_name(void **state);
+void cmd_help_shows_message_when_no_such_command(void **state);
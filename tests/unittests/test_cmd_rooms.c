@@ -64,6 +64,7 @@ void cmd_rooms_uses_account_default_when_no_arg(void **state)
     will_return(accounts_get_account, account);
 
     expect_string(iq_room_list_request, conferencejid, "default_conf_server");
+    expect_value(iq_room_list_request, filter, NULL);
 
     gboolean result = cmd_rooms(NULL, CMD_ROOMS, args);
     assert_true(result);
@@ -71,11 +72,56 @@ void cmd_rooms_uses_account_default_when_no_arg(void **state)
 
 void cmd_rooms_arg_used_when_passed(void **state)
 {
-    gchar *args[] = { "conf_server_arg" };
+    gchar *args[] = { "conf_server_arg", NULL };
 
     will_return(jabber_get_connection_status, JABBER_CONNECTED);
 
     expect_string(iq_room_list_request, conferencejid, "conf_server_arg");
+    expect_value(iq_room_list_request, filter, NULL);
+
+    gboolean result = cmd_rooms(NULL, CMD_ROOMS, args);
+    assert_true(result);
+}
+
+void cmd_rooms_filter_uses_account_default(void **state)
+{
+    gchar *args[] = { "filter", "linux", NULL };
+
+    ProfAccount *account = account_new("testaccount", NULL, NULL, NULL, TRUE, NULL, 0, NULL, NULL, NULL,
+        0, 0, 0, 0, 0, strdup("default_conf_server"), NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+
+    will_return(jabber_get_connection_status, JABBER_CONNECTED);
+    will_return(jabber_get_account_name, "account_name");
+    expect_any(accounts_get_account, name);
+    will_return(accounts_get_account, account);
+
+    expect_string(iq_room_list_request, conferencejid, "default_conf_server");
+    expect_string(iq_room_list_request, filter, "linux");
+
+    gboolean result = cmd_rooms(NULL, CMD_ROOMS, args);
+    assert_true(result);
+}
+
+void cmd_rooms_filter_with_service(void **state)
+{
+    gchar *args[] = { "conf_server_arg", "filter", "linux", NULL };
+
+    will_return(jabber_get_connection_status, JABBER_CONNECTED);
+
+    expect_string(iq_room_list_request, conferencejid, "conf_server_arg");
+    expect_string(iq_room_list_request, filter, "linux");
+
+    gboolean result = cmd_rooms(NULL, CMD_ROOMS, args);
+    assert_true(result);
+}
+
+void cmd_rooms_shows_usage_when_filter_has_no_text(void **state)
+{
+    gchar *args[] = { "conf_server_arg", "filter", NULL };
+
+    will_return(jabber_get_connection_status, JABBER_CONNECTED);
+
+    expect_string(cons_bad_cmd_usage, cmd, CMD_ROOMS);
 
     gboolean result = cmd_rooms(NULL, CMD_ROOMS, args);
     assert_true(result);
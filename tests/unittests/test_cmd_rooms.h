@@ -5,3 +5,6 @@ void cmd_rooms_shows_message_when_started(void **state);
 void cmd_rooms_shows_message_when_undefined(void **state);
 void cmd_rooms_uses_account_default_when_no_arg(void **state);
 void cmd_rooms_arg_used_when_passed(void **state);
+void cmd_rooms_filter_uses_account_default(void **state);
+void cmd_rooms_filter_with_service(void **state);
+void cmd_rooms_shows_usage_when_filter_has_no_text(void **state);
@@ -0,0 +1,54 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "xmpp/xmpp.h"
+
+#include "ui/ui.h"
+#include "ui/stub_ui.h"
+
+#include "command/commands.h"
+
+#define CMD_SENDFILE "/sendfile"
+
+static void test_with_connection_status(jabber_conn_status_t status)
+{
+    gchar *args[] = { "/tmp/file.txt", NULL };
+    ProfWin window;
+    window.type = WIN_CHAT;
+
+    will_return(jabber_get_connection_status, status);
+
+    expect_cons_show("You are not currently connected.");
+
+    gboolean result = cmd_sendfile(&window, CMD_SENDFILE, args);
+    assert_true(result);
+}
+
+void cmd_sendfile_shows_message_when_disconnected(void **state)
+{
+    test_with_connection_status(JABBER_DISCONNECTED);
+}
+
+void cmd_sendfile_shows_message_when_connecting(void **state)
+{
+    test_with_connection_status(JABBER_CONNECTING);
+}
+
+void cmd_sendfile_shows_message_when_not_in_chat_window(void **state)
+{
+    gchar *args[] = { "/tmp/file.txt", NULL };
+    ProfWin window;
+    window.type = WIN_CONSOLE;
+
+    will_return(jabber_get_connection_status, JABBER_CONNECTED);
+
+    expect_cons_show("/sendfile can only be used in chat windows");
+
+    gboolean result = cmd_sendfile(&window, CMD_SENDFILE, args);
+    assert_true(result);
+}
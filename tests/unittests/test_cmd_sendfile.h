@@ -0,0 +1,3 @@
+void cmd_sendfile_shows_message_when_disconnected(void **state);
+void cmd_sendfile_shows_message_when_connecting(void **state);
+void cmd_sendfile_shows_message_when_not_in_chat_window(void **state);
@@ -38,3 +38,35 @@ void cmd_sub_shows_usage_when_no_arg(void **state)
     gboolean result = cmd_sub(NULL, CMD_SUB, args);
     assert_true(result);
 }
+
+void cmd_sub_allow_all_answers_every_request(void **state)
+{
+    gchar *args[] = { "allow", "all", NULL };
+
+    will_return(jabber_get_connection_status, JABBER_CONNECTED);
+
+    expect_string(presence_subscription_batch, pattern, "*");
+    expect_value(presence_subscription_batch, action, PRESENCE_SUBSCRIBED);
+    will_return(presence_subscription_batch, 3);
+
+    expect_cons_show("Accepted 3 subscription requests.");
+
+    gboolean result = cmd_sub(NULL, CMD_SUB, args);
+    assert_true(result);
+}
+
+void cmd_sub_deny_pattern_answers_matching_requests(void **state)
+{
+    gchar *args[] = { "deny", "*@spam.example.com", NULL };
+
+    will_return(jabber_get_connection_status, JABBER_CONNECTED);
+
+    expect_string(presence_subscription_batch, pattern, "*@spam.example.com");
+    expect_value(presence_subscription_batch, action, PRESENCE_UNSUBSCRIBED);
+    will_return(presence_subscription_batch, 0);
+
+    expect_cons_show("No subscription requests match *@spam.example.com.");
+
+    gboolean result = cmd_sub(NULL, CMD_SUB, args);
+    assert_true(result);
+}
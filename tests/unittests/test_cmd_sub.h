@@ -1,2 +1,4 @@
 void cmd_sub_shows_message_when_not_connected(void **state);
 void cmd_sub_shows_usage_when_no_arg(void **state);
+void cmd_sub_allow_all_answers_every_request(void **state);
+void cmd_sub_deny_pattern_answers_matching_requests(void **state);
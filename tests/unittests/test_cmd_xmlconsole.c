@@ -0,0 +1,57 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "ui/ui.h"
+#include "ui/stub_ui.h"
+
+#include "command/commands.h"
+
+#define CMD_XMLCONSOLE "/xmlconsole"
+
+void cmd_xmlconsole_shows_usage_when_invalid_subcmd(void **state)
+{
+    gchar *args[] = { "badcmd", NULL };
+
+    expect_string(cons_bad_cmd_usage, cmd, CMD_XMLCONSOLE);
+
+    gboolean result = cmd_xmlconsole(NULL, CMD_XMLCONSOLE, args);
+    assert_true(result);
+}
+
+void cmd_xmlconsole_filter_add_shows_usage_when_no_value(void **state)
+{
+    gchar *args[] = { "filter", "add", NULL };
+
+    expect_string(cons_bad_cmd_usage, cmd, CMD_XMLCONSOLE);
+
+    gboolean result = cmd_xmlconsole(NULL, CMD_XMLCONSOLE, args);
+    assert_true(result);
+}
+
+void cmd_xmlconsole_filter_add_adds_filter(void **state)
+{
+    gchar *args[] = { "filter", "add", "message", NULL };
+
+    expect_string(xmlwin_filter_add, filter, "message");
+    expect_cons_show("XML console filter added: message");
+
+    gboolean result = cmd_xmlconsole(NULL, CMD_XMLCONSOLE, args);
+    assert_true(result);
+}
+
+void cmd_xmlconsole_filter_remove_shows_message_when_not_found(void **state)
+{
+    gchar *args[] = { "filter", "remove", "urn:xmpp:mam:1", NULL };
+
+    expect_string(xmlwin_filter_remove, filter, "urn:xmpp:mam:1");
+    will_return(xmlwin_filter_remove, FALSE);
+    expect_cons_show("No XML console filter: urn:xmpp:mam:1");
+
+    gboolean result = cmd_xmlconsole(NULL, CMD_XMLCONSOLE, args);
+    assert_true(result);
+}
@@ -0,0 +1,4 @@
+void cmd_xmlconsole_shows_usage_when_invalid_subcmd(void **state);
+void cmd_xmlconsole_filter_add_shows_usage_when_no_value(void **state);
+void cmd_xmlconsole_filter_add_adds_filter(void **state);
+void cmd_xmlconsole_filter_remove_shows_message_when_not_found(void **state);
@@ -4,6 +4,10 @@
 #include <setjmp.h>
 #include <cmocka.h>
 #include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "tools/p_sha1.h"
 
 void replace_one_substr(void **state)
 {
@@ -545,6 +549,51 @@ void test_p_sha1_hash7(void **state)
     assert_string_equal(result, "bNfKVfqEOGmzlH8M+e8FYTB46SU=");
 }
 
+void test_p_sha1_portable_matches_accelerated(void **state)
+{
+    uint8_t data[1000];
+    int i;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    // either side of the block size, split across updates
+    size_t len;
+    for (len = 0; len < sizeof(data); len += (len < 200 ? 1 : 61)) {
+        uint8_t accelerated[P_SHA1_DIGEST_SIZE];
+        uint8_t portable[P_SHA1_DIGEST_SIZE];
+        P_SHA1_CTX ctx;
+
+        P_SHA1_Accelerate(1);
+        P_SHA1_Init(&ctx);
+        P_SHA1_Update(&ctx, data, len / 3);
+        P_SHA1_Update(&ctx, data + len / 3, len - len / 3);
+        P_SHA1_Final(&ctx, accelerated);
+
+        P_SHA1_Accelerate(0);
+        P_SHA1_Init(&ctx);
+        P_SHA1_Update(&ctx, data, len);
+        P_SHA1_Final(&ctx, portable);
+
+        assert_memory_equal(accelerated, portable, P_SHA1_DIGEST_SIZE);
+    }
+
+    P_SHA1_Accelerate(1);
+}
+
+void test_p_sha1_hash_leaves_input_unchanged(void **state)
+{
+    char *inp = g_strnfill(200, 'a');
+    char *result = p_sha1_hash(inp);
+
+    char *expected = g_strnfill(200, 'a');
+    assert_string_equal(inp, expected);
+
+    g_free(expected);
+    g_free(result);
+    g_free(inp);
+}
+
 void utf8_display_len_null_str(void **state)
 {
     int result = utf8_display_len(NULL);
@@ -694,3 +743,74 @@ void str_empty_not_contains_str_empty(void **state)
 
     assert_false(str_contains_str(main, occur));
 }
+
+void str_intern_returns_same_pointer(void **state)
+{
+    char *first = strdup("mobile");
+    char *second = strdup("mobile");
+
+    const char *interned_first = str_intern(first);
+    const char *interned_second = str_intern(second);
+
+    assert_ptr_equal(interned_first, interned_second);
+    assert_string_equal("mobile", interned_first);
+
+    str_unintern(interned_first);
+    str_unintern(interned_second);
+    free(first);
+    free(second);
+}
+
+void str_unintern_frees_after_last_user(void **state)
+{
+    guint count = str_interned_count();
+
+    const char *first = str_intern("Profanity");
+    const char *second = str_intern("Profanity");
+    assert_int_equal(count + 1, str_interned_count());
+
+    str_unintern(first);
+    assert_int_equal(count + 1, str_interned_count());
+    assert_string_equal("Profanity", second);
+
+    str_unintern(second);
+    assert_int_equal(count, str_interned_count());
+}
+
+#define FILE_STAMP_TEST_FILE "./tests/file_stamp_test"
+
+void file_stamp_unchanged_when_missing(void **state)
+{
+    FileStamp stamp = { 0, 0 };
+    remove(FILE_STAMP_TEST_FILE);
+
+    assert_false(file_stamp_changed(FILE_STAMP_TEST_FILE, &stamp));
+}
+
+void file_stamp_changed_after_write(void **state)
+{
+    FileStamp stamp = { 0, 0 };
+
+    g_file_set_contents(FILE_STAMP_TEST_FILE, "abc", -1, NULL);
+    assert_true(file_stamp_changed(FILE_STAMP_TEST_FILE, &stamp));
+    assert_false(file_stamp_changed(FILE_STAMP_TEST_FILE, &stamp));
+
+    // within the same second the size still shows the write
+    g_file_set_contents(FILE_STAMP_TEST_FILE, "abcdef", -1, NULL);
+    assert_true(file_stamp_changed(FILE_STAMP_TEST_FILE, &stamp));
+    assert_int_equal(6, stamp.size);
+
+    remove(FILE_STAMP_TEST_FILE);
+}
+
+void file_stamp_changed_when_removed(void **state)
+{
+    FileStamp stamp = { 0, 0 };
+
+    g_file_set_contents(FILE_STAMP_TEST_FILE, "abc", -1, NULL);
+    file_stamp_changed(FILE_STAMP_TEST_FILE, &stamp);
+    remove(FILE_STAMP_TEST_FILE);
+
+    assert_true(file_stamp_changed(FILE_STAMP_TEST_FILE, &stamp));
+    assert_int_equal(0, stamp.size);
+}
@@ -46,6 +46,8 @@ void test_p_sha1_hash5(void **state);
 void test_p_sha1_hash6(void **state);
 void test_p_sha1_hash6(void **state);
 void test_p_sha1_hash7(void **state);
+void test_p_sha1_portable_matches_accelerated(void **state);
+void test_p_sha1_hash_leaves_input_unchanged(void **state);
 void utf8_display_len_null_str(void **state);
 void utf8_display_len_1_non_wide(void **state);
 void utf8_display_len_1_wide(void **state);
@@ -64,3 +66,8 @@ void str_contains_str_whole(void **state);
 void str_empty_not_contains_str(void **state);
 void str_not_contains_str_empty(void **state);
 void str_empty_not_contains_str_empty(void **state);
+void str_intern_returns_same_pointer(void **state);
+void str_unintern_frees_after_last_user(void **state);
+void file_stamp_unchanged_when_missing(void **state);
+void file_stamp_changed_after_write(void **state);
+void file_stamp_changed_when_removed(void **state);
@@ -405,3 +405,119 @@ void contact_available_when_highest_priority_chat(void **state)
 
     p_contact_free(contact);
 }
+
+void contact_version_changes_when_presence_set(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, NULL,
+        "is offline", FALSE);
+    int version = p_contact_version(contact);
+
+    Resource *resource = resource_new("resource", RESOURCE_ONLINE, NULL, 10);
+    p_contact_set_presence(contact, resource);
+
+    assert_int_not_equal(version, p_contact_version(contact));
+
+    p_contact_free(contact);
+}
+
+void contact_version_changes_when_resource_removed(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, NULL,
+        "is offline", FALSE);
+    Resource *resource = resource_new("resource", RESOURCE_ONLINE, NULL, 10);
+    p_contact_set_presence(contact, resource);
+    int version = p_contact_version(contact);
+
+    p_contact_remove_resource(contact, "resource");
+
+    assert_int_not_equal(version, p_contact_version(contact));
+
+    p_contact_free(contact);
+}
+
+void contact_version_unchanged_when_subscription_set(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, NULL,
+        "is offline", FALSE);
+    int version = p_contact_version(contact);
+
+    p_contact_set_subscription(contact, "both");
+
+    assert_int_equal(version, p_contact_version(contact));
+
+    p_contact_free(contact);
+}
+
+void contact_presence_follows_removed_resource(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, "both",
+        "is offline", FALSE);
+    Resource *resource10 = resource_new("resource10", RESOURCE_AWAY, "back soon", 10);
+    Resource *resource20 = resource_new("resource20", RESOURCE_CHAT, "chatty", 20);
+    p_contact_set_presence(contact, resource10);
+    p_contact_set_presence(contact, resource20);
+
+    p_contact_remove_resource(contact, "resource20");
+
+    assert_string_equal("away", p_contact_presence(contact));
+    assert_string_equal("back soon", p_contact_status(contact));
+
+    p_contact_remove_resource(contact, "resource10");
+
+    assert_string_equal("offline", p_contact_presence(contact));
+    assert_string_equal("is offline", p_contact_status(contact));
+
+    p_contact_free(contact);
+}
+
+void contact_presence_follows_replaced_resource(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, "both",
+        "is offline", FALSE);
+    p_contact_set_presence(contact, resource_new("resource", RESOURCE_ONLINE, NULL, 10));
+    p_contact_set_presence(contact, resource_new("resource", RESOURCE_DND, "busy", 10));
+
+    assert_string_equal("dnd", p_contact_presence(contact));
+    assert_string_equal("busy", p_contact_status(contact));
+    assert_false(p_contact_is_available(contact));
+
+    p_contact_free(contact);
+}
+
+void contact_resource_ac_has_resources_set_before(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, "both",
+        "is offline", FALSE);
+    p_contact_set_presence(contact, resource_new("laptop", RESOURCE_ONLINE, NULL, 10));
+    p_contact_set_presence(contact, resource_new("phone", RESOURCE_AWAY, NULL, 5));
+    p_contact_remove_resource(contact, "laptop");
+
+    Autocomplete ac = p_contact_resource_ac(contact);
+    char *found = autocomplete_complete(ac, "p", FALSE);
+
+    assert_string_equal("phone", found);
+    assert_int_equal(1, autocomplete_length(ac));
+
+    free(found);
+    p_contact_free(contact);
+}
+
+void contact_resource_iter_in_order_of_availability(void **state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, "both",
+        "is offline", FALSE);
+    p_contact_set_presence(contact, resource_new("away", RESOURCE_AWAY, NULL, 10));
+    p_contact_set_presence(contact, resource_new("low", RESOURCE_CHAT, NULL, 5));
+    p_contact_set_presence(contact, resource_new("chat", RESOURCE_CHAT, NULL, 10));
+    p_contact_set_presence(contact, resource_new("low", RESOURCE_DND, NULL, 20));
+
+    PContactResourceIter iter;
+    p_contact_resource_iter_init(&iter, contact);
+
+    assert_string_equal("low", p_contact_resource_iter_next(&iter)->name);
+    assert_string_equal("chat", p_contact_resource_iter_next(&iter)->name);
+    assert_string_equal("away", p_contact_resource_iter_next(&iter)->name);
+    assert_null(p_contact_resource_iter_next(&iter));
+
+    p_contact_free(contact);
+}
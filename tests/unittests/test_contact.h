@@ -22,3 +22,10 @@ void contact_not_available_when_highest_priority_xa(void **state);
 void contact_not_available_when_highest_priority_dnd(void **state);
 void contact_available_when_highest_priority_online(void **state);
 void contact_available_when_highest_priority_chat(void **state);
+void contact_version_changes_when_presence_set(void **state);
+void contact_version_changes_when_resource_removed(void **state);
+void contact_version_unchanged_when_subscription_set(void **state);
+void contact_presence_follows_removed_resource(void **state);
+void contact_presence_follows_replaced_resource(void **state);
+void contact_resource_ac_has_resources_set_before(void **state);
+void contact_resource_iter_in_order_of_availability(void **state);
@@ -0,0 +1,66 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/dedup.h"
+
+void dedup_drops_key_seen_again(void **state)
+{
+    Dedup dedup = dedup_new(10, 1000);
+
+    assert_false(dedup_seen(dedup, "alice@example.com/laptop\nid1", 0));
+    assert_true(dedup_seen(dedup, "alice@example.com/laptop\nid1", 10));
+    assert_false(dedup_seen(dedup, "alice@example.com/phone\nid1", 20));
+    assert_int_equal(2, dedup_size(dedup));
+
+    dedup_free(dedup);
+}
+
+void dedup_forgets_key_after_max_age(void **state)
+{
+    Dedup dedup = dedup_new(10, 1000);
+
+    assert_false(dedup_seen(dedup, "id1", 0));
+    assert_false(dedup_seen(dedup, "id2", 500));
+    assert_false(dedup_seen(dedup, "id1", 1000));
+    assert_true(dedup_seen(dedup, "id2", 1100));
+    assert_int_equal(2, dedup_size(dedup));
+
+    dedup_free(dedup);
+}
+
+void dedup_evicts_least_recently_seen(void **state)
+{
+    Dedup dedup = dedup_new(2, 1000);
+
+    dedup_seen(dedup, "id1", 0);
+    dedup_seen(dedup, "id2", 1);
+    assert_true(dedup_seen(dedup, "id1", 2));
+    dedup_seen(dedup, "id3", 3);
+
+    assert_int_equal(2, dedup_size(dedup));
+    assert_true(dedup_seen(dedup, "id1", 4));
+    assert_false(dedup_seen(dedup, "id2", 5));
+
+    dedup_free(dedup);
+}
+
+void dedup_contains_does_not_record_key(void **state)
+{
+    Dedup dedup = dedup_new(2, 1000);
+
+    dedup_seen(dedup, "id1", 0);
+    dedup_seen(dedup, "id2", 1);
+
+    assert_false(dedup_contains(dedup, "id3", 2));
+    assert_false(dedup_contains(dedup, "id4", 3));
+    assert_true(dedup_contains(dedup, "id1", 4));
+    assert_true(dedup_contains(dedup, "id2", 5));
+    assert_false(dedup_contains(dedup, "id1", 1000));
+    assert_int_equal(2, dedup_size(dedup));
+
+    dedup_free(dedup);
+}
@@ -0,0 +1,4 @@
+void dedup_drops_key_seen_again(void **state);
+void dedup_forgets_key_after_max_age(void **state);
+void dedup_evicts_least_recently_seen(void **state);
+void dedup_contains_does_not_record_key(void **state);
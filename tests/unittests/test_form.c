@@ -22,6 +22,8 @@ _new_form(void)
     form->fields = NULL;
     form->var_to_tag = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
     form->tag_to_var = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    form->tag_to_field = NULL;
+    form->sorted_fields = NULL;
     form->tag_ac = NULL;
 
     return form;
@@ -725,3 +727,47 @@ void remove_text_multi_value_removes_when_many(void **state)
     form_destroy(form);
 }
 
+
+void get_field_by_tag_returns_indexed_field(void **state)
+{
+    DataForm *form = _new_form();
+    g_hash_table_insert(form->tag_to_var, strdup("tag1"), strdup("var1"));
+    g_hash_table_insert(form->tag_to_var, strdup("tag2"), strdup("var2"));
+
+    FormField *field1 = _new_field();
+    field1->var = strdup("var1");
+    form->fields = g_slist_append(form->fields, field1);
+    FormField *field2 = _new_field();
+    field2->var = strdup("var2");
+    form->fields = g_slist_append(form->fields, field2);
+
+    assert_ptr_equal(form_get_field_by_tag(form, "tag2"), field2);
+    assert_ptr_equal(form_get_field_by_tag(form, "tag1"), field1);
+    assert_null(form_get_field_by_tag(form, "tag3"));
+
+    form_destroy(form);
+}
+
+void non_form_type_fields_sorted_by_var(void **state)
+{
+    DataForm *form = _new_form();
+
+    FormField *field1 = _new_field();
+    field1->var = strdup("var2");
+    form->fields = g_slist_append(form->fields, field1);
+    FormField *field2 = _new_field();
+    field2->var = strdup("FORM_TYPE");
+    form->fields = g_slist_append(form->fields, field2);
+    FormField *field3 = _new_field();
+    field3->var = strdup("var1");
+    form->fields = g_slist_append(form->fields, field3);
+
+    GSList *sorted = form_get_non_form_type_fields_sorted(form);
+
+    assert_int_equal(g_slist_length(sorted), 2);
+    assert_ptr_equal(sorted->data, field3);
+    assert_ptr_equal(sorted->next->data, field1);
+    assert_ptr_equal(form_get_non_form_type_fields_sorted(form), sorted);
+
+    form_destroy(form);
+}
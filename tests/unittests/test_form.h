@@ -19,3 +19,5 @@ void remove_text_multi_value_does_nothing_when_none(void **state);
 void remove_text_multi_value_does_nothing_when_doesnt_exist(void **state);
 void remove_text_multi_value_removes_when_one(void **state);
 void remove_text_multi_value_removes_when_many(void **state);
+void get_field_by_tag_returns_indexed_field(void **state);
+void non_form_type_fields_sorted_by_var(void **state);
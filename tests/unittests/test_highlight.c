@@ -0,0 +1,99 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/highlight.h"
+
+void highlight_matches_any_word(void **state)
+{
+    Highlight highlight = highlight_new(FALSE, FALSE);
+    highlight_add(highlight, "bob");
+    highlight_add(highlight, "release");
+    highlight_add(highlight, "oncall");
+
+    assert_int_equal(3, highlight_size(highlight));
+    assert_true(highlight_match(highlight, "who is oncall tonight?"));
+    assert_true(highlight_match(highlight, "the release is out"));
+    assert_true(highlight_match(highlight, "bob"));
+    assert_false(highlight_match(highlight, "nothing to see here"));
+
+    highlight_free(highlight);
+}
+
+void highlight_matches_overlapping_words(void **state)
+{
+    Highlight highlight = highlight_new(FALSE, FALSE);
+    highlight_add(highlight, "she");
+    highlight_add(highlight, "hers");
+    highlight_add(highlight, "his");
+
+    assert_true(highlight_match(highlight, "ushers"));
+    assert_true(highlight_match(highlight, "ahishe"));
+    assert_false(highlight_match(highlight, "shh her"));
+
+    highlight_free(highlight);
+}
+
+void highlight_case_insensitive(void **state)
+{
+    Highlight highlight = highlight_new(FALSE, FALSE);
+    highlight_add(highlight, "Kristof");
+
+    assert_true(highlight_match(highlight, "hey KRISTOF"));
+    assert_true(highlight_match(highlight, "hey kristof"));
+
+    highlight_free(highlight);
+}
+
+void highlight_case_sensitive(void **state)
+{
+    Highlight highlight = highlight_new(TRUE, FALSE);
+    highlight_add(highlight, "Kristof");
+
+    assert_true(highlight_match(highlight, "hey Kristof"));
+    assert_false(highlight_match(highlight, "hey kristof"));
+
+    highlight_free(highlight);
+}
+
+void highlight_whole_word(void **state)
+{
+    Highlight highlight = highlight_new(FALSE, TRUE);
+    highlight_add(highlight, "bob");
+    highlight_add(highlight, "bobby");
+
+    assert_true(highlight_match(highlight, "bob: ping"));
+    assert_true(highlight_match(highlight, "ask bob."));
+    assert_true(highlight_match(highlight, "bobbob bobby"));
+    assert_false(highlight_match(highlight, "bobbing along"));
+    assert_false(highlight_match(highlight, "kebob_"));
+
+    highlight_free(highlight);
+}
+
+void highlight_whole_word_utf8(void **state)
+{
+    Highlight highlight = highlight_new(FALSE, TRUE);
+    highlight_add(highlight, "jos\xc3\xa9");
+
+    assert_true(highlight_match(highlight, "\xc3\xa0 JOS\xc3\x89!"));
+    assert_false(highlight_match(highlight, "\xc3\xa9jos\xc3\xa9"));
+
+    highlight_free(highlight);
+}
+
+void highlight_empty_matches_nothing(void **state)
+{
+    Highlight highlight = highlight_new(FALSE, FALSE);
+    highlight_add(highlight, "");
+    highlight_add(highlight, NULL);
+
+    assert_int_equal(0, highlight_size(highlight));
+    assert_false(highlight_match(highlight, "anything"));
+
+    highlight_free(highlight);
+}
@@ -0,0 +1,7 @@
+void highlight_matches_any_word(void **state);
+void highlight_matches_overlapping_words(void **state);
+void highlight_case_insensitive(void **state);
+void highlight_case_sensitive(void **state);
+void highlight_whole_word(void **state);
+void highlight_whole_word_utf8(void **state);
+void highlight_empty_matches_nothing(void **state);
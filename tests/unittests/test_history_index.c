@@ -0,0 +1,243 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tools/history_index.h"
+
+#define HISTORY_DIR "./tests/files/chatlogs"
+
+static long
+_append_line(const char *const file, const char *const line)
+{
+    gchar *dir = g_strdup_printf("%s/%s", HISTORY_DIR, file);
+    *strrchr(dir, '/') = '\0';
+    g_mkdir_with_parents(dir, S_IRWXU);
+    g_free(dir);
+
+    gchar *path = g_strdup_printf("%s/%s", HISTORY_DIR, file);
+    FILE *f = fopen(path, "a");
+    fseek(f, 0, SEEK_END);
+    long offset = ftell(f);
+    fputs(line, f);
+    fclose(f);
+    g_free(path);
+
+    return offset;
+}
+
+static void
+_add_line(HistoryIndex index, const char *const file, const char *const line)
+{
+    long offset = _append_line(file, line);
+    history_index_add(index, file, offset, line);
+}
+
+void init_history_index_dir(void **state)
+{
+    g_mkdir_with_parents(HISTORY_DIR, S_IRWXU);
+}
+
+void remove_history_index_dir(void **state)
+{
+    assert_int_equal(0, system("rm -rf ./tests/files"));
+}
+
+void search_empty_index_returns_null(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+
+    GSList *matches = history_index_search(index, "hello", 10);
+
+    assert_null(matches);
+    history_index_close(index);
+}
+
+void search_finds_added_line(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: hello there\n");
+    _add_line(index, "bob/2015_01_01.log", "10:00:01 - me: something else\n");
+
+    GSList *matches = history_index_search(index, "hello", 10);
+
+    assert_int_equal(1, g_slist_length(matches));
+    HistoryMatch *match = matches->data;
+    assert_string_equal("bob/2015_01_01.log", match->file);
+    assert_int_equal(0, match->offset);
+    assert_string_equal("10:00:00 - bob: hello there", match->line);
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void search_requires_every_word(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: the release is out\n");
+    _add_line(index, "bob/2015_01_01.log", "10:00:01 - me: which release\n");
+    _add_line(index, "bob/2015_01_01.log", "10:00:02 - bob: it is out now\n");
+
+    GSList *matches = history_index_search(index, "release out", 10);
+
+    assert_int_equal(1, g_slist_length(matches));
+    HistoryMatch *match = matches->data;
+    assert_string_equal("10:00:00 - bob: the release is out", match->line);
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void search_ignores_case(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "rooms/room_at_conf/2015_01_01.log", "10:00:00 - alice: Profanity rocks\n");
+
+    GSList *matches = history_index_search(index, "PROFANITY", 10);
+
+    assert_int_equal(1, g_slist_length(matches));
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void search_finds_lines_after_reopen(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: first\n");
+    _add_line(index, "bob/2015_01_02.log", "10:00:00 - bob: second first\n");
+    history_index_close(index);
+
+    index = history_index_open(HISTORY_DIR);
+    GSList *matches = history_index_search(index, "first", 10);
+
+    assert_int_equal(2, g_slist_length(matches));
+    HistoryMatch *match = matches->data;
+    assert_string_equal("bob/2015_01_01.log", match->file);
+    match = matches->next->data;
+    assert_string_equal("bob/2015_01_02.log", match->file);
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void add_indexes_earlier_lines_in_file(void **state)
+{
+    _append_line("bob/2015_01_01.log", "09:00:00 - bob: written earlier\n");
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: written now\n");
+
+    GSList *matches = history_index_search(index, "written", 10);
+
+    assert_int_equal(2, g_slist_length(matches));
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void scan_indexes_existing_logs(void **state)
+{
+    _append_line("bob/2015_01_01.log", "09:00:00 - bob: old news\n");
+    _append_line("rooms/room_at_conf/2015_01_01.log", "09:00:00 - alice: more news\n");
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+
+    int updated = history_index_scan(index);
+    GSList *matches = history_index_search(index, "news", 10);
+
+    assert_int_equal(2, updated);
+    assert_int_equal(2, g_slist_length(matches));
+    assert_int_equal(0, history_index_scan(index));
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void rename_keeps_lines_under_new_path(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: before the roll\n");
+    history_index_flush(index);
+    assert_int_equal(0, system("mv " HISTORY_DIR "/bob/2015_01_01.log " HISTORY_DIR "/bob/2015_01_01.1.log"));
+    history_index_rename(index, "bob/2015_01_01.log", "bob/2015_01_01.1.log");
+    _add_line(index, "bob/2015_01_01.log", "10:00:01 - bob: after the roll\n");
+    history_index_close(index);
+
+    index = history_index_open(HISTORY_DIR);
+    GSList *matches = history_index_search(index, "roll", 10);
+
+    assert_int_equal(2, g_slist_length(matches));
+    HistoryMatch *match = matches->data;
+    assert_string_equal("bob/2015_01_01.1.log", match->file);
+    assert_string_equal("10:00:00 - bob: before the roll", match->line);
+    match = matches->next->data;
+    assert_string_equal("bob/2015_01_01.log", match->file);
+    assert_int_equal(0, match->offset);
+    assert_string_equal("10:00:01 - bob: after the roll", match->line);
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void scan_reindexes_replaced_log(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: a rather long line about the weather\n");
+    history_index_close(index);
+
+    assert_int_equal(0, system("rm " HISTORY_DIR "/bob/2015_01_01.log"));
+    _append_line("bob/2015_01_01.log", "11:00:00 - bob: new weather\n");
+
+    index = history_index_open(HISTORY_DIR);
+    assert_int_equal(1, history_index_scan(index));
+    GSList *matches = history_index_search(index, "weather", 10);
+
+    assert_int_equal(1, g_slist_length(matches));
+    HistoryMatch *match = matches->data;
+    assert_string_equal("11:00:00 - bob: new weather", match->line);
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void search_returns_newest_by_log_time(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_02.log", "09:00:00 - bob: lunch tomorrow\n");
+    _add_line(index, "alice/2015_01_03.log", "08:00:00 - alice: lunch today\n");
+    _add_line(index, "bob/2015_01_01.log", "23:00:00 - bob: lunch soon\n");
+
+    GSList *matches = history_index_search(index, "lunch", 2);
+
+    assert_int_equal(2, g_slist_length(matches));
+    HistoryMatch *first = matches->data;
+    assert_string_equal("bob/2015_01_02.log", first->file);
+    HistoryMatch *second = matches->next->data;
+    assert_string_equal("alice/2015_01_03.log", second->file);
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
+
+void open_drops_index_of_other_version(void **state)
+{
+    HistoryIndex index = history_index_open(HISTORY_DIR);
+    _add_line(index, "bob/2015_01_01.log", "10:00:00 - bob: hello there\n");
+    history_index_close(index);
+
+    g_file_set_contents(HISTORY_DIR "/.index/version", "1", -1, NULL);
+
+    index = history_index_open(HISTORY_DIR);
+    assert_null(history_index_search(index, "hello", 10));
+    assert_int_equal(1, history_index_scan(index));
+
+    GSList *matches = history_index_search(index, "hello", 10);
+    assert_int_equal(1, g_slist_length(matches));
+
+    g_slist_free_full(matches, (GDestroyNotify)history_match_free);
+    history_index_close(index);
+}
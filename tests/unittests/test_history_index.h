@@ -0,0 +1,13 @@
+void init_history_index_dir(void **state);
+void remove_history_index_dir(void **state);
+void search_empty_index_returns_null(void **state);
+void search_finds_added_line(void **state);
+void search_requires_every_word(void **state);
+void search_ignores_case(void **state);
+void search_finds_lines_after_reopen(void **state);
+void add_indexes_earlier_lines_in_file(void **state);
+void scan_indexes_existing_logs(void **state);
+void rename_keeps_lines_under_new_path(void **state);
+void scan_reindexes_replaced_log(void **state);
+void search_returns_newest_by_log_time(void **state);
+void open_drops_index_of_other_version(void **state);
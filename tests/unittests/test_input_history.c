@@ -0,0 +1,175 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tools/input_history.h"
+
+#define INPUT_HISTORY_DIR "./tests/files/inputhistory"
+#define INPUT_HISTORY_FILE "./tests/files/inputhistory/me_at_server.org"
+
+void init_input_history_dir(void **state)
+{
+    g_mkdir_with_parents(INPUT_HISTORY_DIR, S_IRWXU);
+}
+
+void remove_input_history_dir(void **state)
+{
+    assert_int_equal(0, system("rm -rf ./tests/files"));
+}
+
+void add_then_get_returns_lines(void **state)
+{
+    InputHistory history = input_history_open(NULL);
+    input_history_add(history, "/connect me@server.org");
+    input_history_add(history, "hello");
+
+    assert_int_equal(2, input_history_size(history));
+    assert_string_equal("/connect me@server.org", input_history_get(history, 0));
+    assert_string_equal("hello", input_history_get(history, 1));
+    assert_null(input_history_get(history, 2));
+
+    input_history_close(history);
+}
+
+void add_skips_repeated_and_empty_lines(void **state)
+{
+    InputHistory history = input_history_open(NULL);
+    input_history_add(history, "hello");
+    input_history_add(history, "hello");
+    input_history_add(history, "");
+    input_history_add(history, "bye");
+    input_history_add(history, "hello");
+
+    assert_int_equal(3, input_history_size(history));
+    assert_string_equal("hello", input_history_get(history, 2));
+
+    input_history_close(history);
+}
+
+void open_loads_stored_lines(void **state)
+{
+    InputHistory history = input_history_open(INPUT_HISTORY_FILE);
+    input_history_add(history, "/join room@conference.server.org");
+    input_history_add(history, "hi all");
+    input_history_close(history);
+
+    history = input_history_open(INPUT_HISTORY_FILE);
+    input_history_add(history, "/close");
+    input_history_close(history);
+
+    history = input_history_open(INPUT_HISTORY_FILE);
+    assert_int_equal(3, input_history_size(history));
+    assert_string_equal("/join room@conference.server.org", input_history_get(history, 0));
+    assert_string_equal("hi all", input_history_get(history, 1));
+    assert_string_equal("/close", input_history_get(history, 2));
+
+    input_history_close(history);
+}
+
+void open_ignores_partial_last_line(void **state)
+{
+    FILE *f = fopen(INPUT_HISTORY_FILE, "w");
+    fputs("first\nsecond\nthi", f);
+    fclose(f);
+
+    InputHistory history = input_history_open(INPUT_HISTORY_FILE);
+
+    assert_int_equal(2, input_history_size(history));
+    assert_string_equal("second", input_history_get(history, 1));
+
+    input_history_close(history);
+}
+
+void open_creates_file_private(void **state)
+{
+    InputHistory history = input_history_open(INPUT_HISTORY_FILE);
+    input_history_add(history, "hello");
+    input_history_close(history);
+
+    struct stat st;
+    assert_int_equal(0, stat(INPUT_HISTORY_FILE, &st));
+    assert_int_equal(S_IRUSR | S_IWUSR, st.st_mode & 0777);
+}
+
+void add_skips_secret_commands(void **state)
+{
+    InputHistory history = input_history_open(INPUT_HISTORY_FILE);
+    input_history_add(history, "/account set me@server.org password secret");
+    input_history_add(history, "/account set me@server.org eval_password pass show xmpp");
+    input_history_add(history, "/connect me@server.org password secret");
+    input_history_add(history, "/join room@conference.server.org password secret");
+    input_history_add(history, "/otr secret fiffi");
+    input_history_add(history, "/otr question \"My rabbit?\" fiffi");
+    input_history_add(history, "/otr answer fiffi");
+    input_history_add(history, "/pgp setkey me@server.org 0123456789ABCDEF");
+    input_history_add(history, "/account set me@server.org resource laptop");
+    input_history_add(history, "/pgpfoo");
+    input_history_close(history);
+
+    history = input_history_open(INPUT_HISTORY_FILE);
+    assert_int_equal(2, input_history_size(history));
+    assert_string_equal("/account set me@server.org resource laptop", input_history_get(history, 0));
+    assert_string_equal("/pgpfoo", input_history_get(history, 1));
+
+    input_history_close(history);
+}
+
+void search_finds_newest_match(void **state)
+{
+    InputHistory history = input_history_open(NULL);
+    input_history_add(history, "/msg bob@server.org hello");
+    input_history_add(history, "/msg alice@server.org hi");
+    input_history_add(history, "/msg bob@server.org again");
+    input_history_add(history, "/close");
+
+    assert_int_equal(2, input_history_search(history, "bob", -1));
+    assert_int_equal(3, input_history_search(history, "/c", -1));
+
+    input_history_close(history);
+}
+
+void search_before_finds_older_match(void **state)
+{
+    InputHistory history = input_history_open(NULL);
+    input_history_add(history, "/msg bob@server.org hello");
+    input_history_add(history, "/msg alice@server.org hi");
+    input_history_add(history, "/msg bob@server.org again");
+
+    assert_int_equal(0, input_history_search(history, "bob@", 2));
+    assert_int_equal(-1, input_history_search(history, "bob@", 0));
+    assert_int_equal(0, input_history_search(history, "b", 2));
+
+    input_history_close(history);
+}
+
+void search_without_match_returns_minus_one(void **state)
+{
+    InputHistory history = input_history_open(NULL);
+    input_history_add(history, "/msg bob@server.org hello");
+
+    assert_int_equal(-1, input_history_search(history, "carol", -1));
+    assert_int_equal(-1, input_history_search(history, "hellohello", -1));
+    assert_int_equal(-1, input_history_search(history, "x", -1));
+
+    input_history_close(history);
+}
+
+void search_finds_lines_added_after_search(void **state)
+{
+    InputHistory history = input_history_open(NULL);
+    input_history_add(history, "/msg bob@server.org hello");
+    assert_int_equal(-1, input_history_search(history, "status", -1));
+
+    input_history_add(history, "/status bob@server.org");
+
+    assert_int_equal(1, input_history_search(history, "status", -1));
+    assert_int_equal(1, input_history_search(history, "bob@server", -1));
+
+    input_history_close(history);
+}
@@ -0,0 +1,12 @@
+void init_input_history_dir(void **state);
+void remove_input_history_dir(void **state);
+void add_then_get_returns_lines(void **state);
+void add_skips_repeated_and_empty_lines(void **state);
+void open_loads_stored_lines(void **state);
+void open_ignores_partial_last_line(void **state);
+void open_creates_file_private(void **state);
+void add_skips_secret_commands(void **state);
+void search_finds_newest_match(void **state);
+void search_before_finds_older_match(void **state);
+void search_without_match_returns_minus_one(void **state);
+void search_finds_lines_added_after_search(void **state);
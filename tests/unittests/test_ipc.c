@@ -0,0 +1,238 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tools/ipc.h"
+
+static char *path = NULL;
+
+static int
+_client_connect(void)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert_int_equal(0, connect(fd, (struct sockaddr*)&addr, sizeof(addr)));
+    ipc_process();
+
+    return fd;
+}
+
+static void
+_client_send(int fd, const char *const line)
+{
+    assert_int_equal(strlen(line), write(fd, line, strlen(line)));
+    ipc_process();
+}
+
+// whatever the client has been sent so far, empty when nothing
+static char*
+_client_read(int fd)
+{
+    ipc_process();
+
+    GString *read = g_string_new("");
+    char buf[1024];
+    ssize_t len = 0;
+    while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        g_string_append_len(read, buf, len);
+    }
+
+    return g_string_free(read, FALSE);
+}
+
+void init_ipc(void **state)
+{
+    path = g_strdup_printf("%s/prof_test_ipc_%d.sock", g_get_tmp_dir(), getpid());
+    assert_true(ipc_open(path));
+}
+
+void close_ipc(void **state)
+{
+    ipc_close();
+    g_free(path);
+    path = NULL;
+}
+
+void ipc_sends_no_events_without_request(void **state)
+{
+    int fd = _client_connect();
+
+    ipc_emit(IPC_MESSAGE, "chat", "from", "alice@example.com", "body", "hello", NULL);
+
+    char *read = _client_read(fd);
+    assert_string_equal("", read);
+    g_free(read);
+    close(fd);
+}
+
+void ipc_sends_requested_events(void **state)
+{
+    int fd = _client_connect();
+    _client_send(fd, "!events message\n");
+    char *read = _client_read(fd);
+    assert_string_equal("{\"event\":\"done\",\"input\":\"!events message\"}\n", read);
+    g_free(read);
+
+    ipc_emit(IPC_MESSAGE, "chat", "from", "alice@example.com", "resource", NULL, "body", "say \"hi\"\\\n", NULL);
+
+    read = _client_read(fd);
+    assert_string_equal(
+        "{\"event\":\"chat\",\"from\":\"alice@example.com\",\"resource\":null,\"body\":\"say \\\"hi\\\"\\\\\\n\"}\n",
+        read);
+    g_free(read);
+    close(fd);
+}
+
+void ipc_filters_events_per_client(void **state)
+{
+    int messages = _client_connect();
+    int presence = _client_connect();
+    _client_send(messages, "!events message\n");
+    _client_send(presence, "!events presence muc\n");
+    g_free(_client_read(messages));
+    g_free(_client_read(presence));
+
+    ipc_emit(IPC_MESSAGE, "chat", "body", "hello", NULL);
+    ipc_emit(IPC_PRESENCE, "offline", "jid", "bob@example.com", NULL);
+
+    char *read = _client_read(messages);
+    assert_string_equal("{\"event\":\"chat\",\"body\":\"hello\"}\n", read);
+    g_free(read);
+    read = _client_read(presence);
+    assert_string_equal("{\"event\":\"offline\",\"jid\":\"bob@example.com\"}\n", read);
+    g_free(read);
+
+    close(messages);
+    close(presence);
+}
+
+void ipc_withholds_decrypted_body_unless_requested(void **state)
+{
+    int messages = _client_connect();
+    int decrypted = _client_connect();
+    _client_send(messages, "!events message\n");
+    _client_send(decrypted, "!events message decrypted\n");
+    g_free(_client_read(messages));
+    g_free(_client_read(decrypted));
+
+    ipc_emit(IPC_MESSAGE, "chat", "body", "secret", "encryption", "otr", NULL);
+    ipc_emit(IPC_MESSAGE, "chat", "body", "hello", "encryption", NULL, NULL);
+
+    char *read = _client_read(messages);
+    assert_string_equal(
+        "{\"event\":\"chat\",\"body\":null,\"encryption\":\"otr\"}\n"
+        "{\"event\":\"chat\",\"body\":\"hello\",\"encryption\":null}\n",
+        read);
+    g_free(read);
+    read = _client_read(decrypted);
+    assert_string_equal(
+        "{\"event\":\"chat\",\"body\":\"secret\",\"encryption\":\"otr\"}\n"
+        "{\"event\":\"chat\",\"body\":\"hello\",\"encryption\":null}\n",
+        read);
+    g_free(read);
+
+    close(messages);
+    close(decrypted);
+}
+
+void ipc_replies_error_to_unknown_request(void **state)
+{
+    int fd = _client_connect();
+    _client_send(fd, "!events everything\n!subscribe\n");
+
+    char *read = _client_read(fd);
+    assert_string_equal(
+        "{\"event\":\"error\",\"input\":\"!events everything\",\"error\":\"Unknown event\"}\n"
+        "{\"event\":\"error\",\"input\":\"!subscribe\",\"error\":\"Unknown request\"}\n",
+        read);
+    g_free(read);
+    close(fd);
+}
+
+void ipc_removes_socket_on_close(void **state)
+{
+    ipc_close();
+
+    assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+}
+
+static void
+_listener(ipc_event_t type, const char *const name, const char *const *keys, const char *const *values, int count,
+    gpointer data)
+{
+    GString *seen = data;
+    g_string_append(seen, name);
+    int i;
+    for (i = 0; i < count; i++) {
+        g_string_append_printf(seen, " %s=%s", keys[i], values[i] ? values[i] : "null");
+    }
+    g_string_append_c(seen, '\n');
+}
+
+void ipc_gives_listened_events_to_listeners(void **state)
+{
+    GString *seen = g_string_new("");
+    ipc_listen(IPC_MESSAGE | IPC_INPUT, _listener, seen);
+
+    ipc_emit(IPC_MESSAGE, "chat", "from", "alice@example.com", "resource", NULL, NULL);
+    ipc_emit(IPC_PRESENCE, "offline", "jid", "bob@example.com", NULL);
+    ipc_emit(IPC_INPUT, "input", "to", "bob@example.com", "body", "hi", NULL);
+    ipc_unlisten(_listener, seen);
+    ipc_emit(IPC_MESSAGE, "chat", "from", "alice@example.com", NULL);
+
+    assert_string_equal("chat from=alice@example.com resource=null\ninput to=bob@example.com body=hi\n", seen->str);
+    g_string_free(seen, TRUE);
+}
+
+void ipc_gives_decrypted_body_to_listeners_asking(void **state)
+{
+    GString *seen = g_string_new("");
+    GString *seen_decrypted = g_string_new("");
+    ipc_listen(IPC_MESSAGE, _listener, seen);
+    ipc_listen(IPC_MESSAGE | IPC_DECRYPTED, _listener, seen_decrypted);
+
+    ipc_emit(IPC_MESSAGE, "chat", "body", "secret", "encryption", "pgp", NULL);
+    ipc_unlisten(_listener, seen);
+    ipc_unlisten(_listener, seen_decrypted);
+
+    assert_string_equal("chat body=null encryption=pgp\n", seen->str);
+    assert_string_equal("chat body=secret encryption=pgp\n", seen_decrypted->str);
+    g_string_free(seen, TRUE);
+    g_string_free(seen_decrypted, TRUE);
+}
+
+static void
+_once_listener(ipc_event_t type, const char *const name, const char *const *keys, const char *const *values,
+    int count, gpointer data)
+{
+    _listener(type, name, keys, values, count, data);
+    ipc_unlisten(_once_listener, data);
+}
+
+void ipc_listener_can_unlisten_itself(void **state)
+{
+    GString *once = g_string_new("");
+    GString *seen = g_string_new("");
+    ipc_listen(IPC_MESSAGE, _once_listener, once);
+    ipc_listen(IPC_MESSAGE, _listener, seen);
+
+    ipc_emit(IPC_MESSAGE, "chat", "from", "alice@example.com", NULL);
+    ipc_emit(IPC_MESSAGE, "chat", "from", "bob@example.com", NULL);
+    ipc_unlisten(_listener, seen);
+
+    assert_string_equal("chat from=alice@example.com\n", once->str);
+    assert_string_equal("chat from=alice@example.com\nchat from=bob@example.com\n", seen->str);
+    g_string_free(once, TRUE);
+    g_string_free(seen, TRUE);
+}
@@ -0,0 +1,11 @@
+void init_ipc(void **state);
+void close_ipc(void **state);
+void ipc_sends_no_events_without_request(void **state);
+void ipc_sends_requested_events(void **state);
+void ipc_filters_events_per_client(void **state);
+void ipc_withholds_decrypted_body_unless_requested(void **state);
+void ipc_replies_error_to_unknown_request(void **state);
+void ipc_removes_socket_on_close(void **state);
+void ipc_gives_listened_events_to_listeners(void **state);
+void ipc_gives_decrypted_body_to_listeners_asking(void **state);
+void ipc_listener_can_unlisten_itself(void **state);
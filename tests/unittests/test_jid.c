@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include "jid.h"
+#include "common.h"
 
 void create_jid_from_null_returns_null(void **state)
 {
@@ -182,4 +183,60 @@ void returns_barejid_when_fulljid_not_exists(void **state)
     char *result = jid_fulljid_or_barejid(jid);
 
     assert_string_equal("localpart@domainpart", result);
-}
\ No newline at end of file
+}
+void create_same_jid_twice_returns_shared_jid(void **state)
+{
+    Jid *jid1 = jid_create("localpart@domainpart/shared");
+    Jid *jid2 = jid_create("localpart@domainpart/shared");
+
+    assert_true(jid1 == jid2);
+
+    jid_destroy(jid1);
+    jid_destroy(jid2);
+}
+
+void create_after_destroy_returns_new_jid(void **state)
+{
+    Jid *jid = jid_create("localpart@domainpart/destroyed");
+    jid_destroy(jid);
+
+    Jid *result = jid_create("localpart@domainpart/destroyed");
+
+    assert_string_equal("localpart@domainpart/destroyed", result->fulljid);
+    jid_destroy(result);
+}
+
+void bare_equal_when_resources_differ(void **state)
+{
+    Jid *jid1 = jid_create("LocalPart@domainpart/laptop");
+    Jid *jid2 = jid_create("localpart@domainpart/phone");
+
+    assert_true(jid_bare_equal(jid1, jid2));
+
+    jid_destroy(jid1);
+    jid_destroy(jid2);
+}
+
+void bare_not_equal_when_bare_jids_differ(void **state)
+{
+    Jid *jid1 = jid_create("localpart@domainpart/laptop");
+    Jid *jid2 = jid_create("other@domainpart/laptop");
+
+    assert_false(jid_bare_equal(jid1, jid2));
+
+    jid_destroy(jid1);
+    jid_destroy(jid2);
+}
+
+void destroy_releases_bare_jid(void **state)
+{
+    guint count = str_interned_count();
+    Jid *jid1 = jid_create("released@domainpart/laptop");
+    Jid *jid2 = jid_create("released@domainpart/phone");
+    assert_int_equal(count + 1, str_interned_count());
+
+    jid_destroy(jid1);
+    assert_int_equal(count + 1, str_interned_count());
+    jid_destroy(jid2);
+    assert_int_equal(count, str_interned_count());
+}
@@ -23,3 +23,8 @@ void create_with_at_and_slash_in_resource(void **state);
 void create_full_with_trailing_slash(void **state);
 void returns_fulljid_when_exists(void **state);
 void returns_barejid_when_fulljid_not_exists(void **state);
+void create_same_jid_twice_returns_shared_jid(void **state);
+void create_after_destroy_returns_new_jid(void **state);
+void bare_equal_when_resources_differ(void **state);
+void bare_not_equal_when_bare_jids_differ(void **state);
+void destroy_releases_bare_jid(void **state);
@@ -0,0 +1,134 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tools/log_export.h"
+
+#define EXPORT_DIR "./tests/files/export"
+
+static void
+_write_log(const char *const file, const char *const contents)
+{
+    gchar *path = g_strdup_printf("%s/%s", EXPORT_DIR, file);
+    gchar *dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, S_IRWXU);
+    g_file_set_contents(path, contents, -1, NULL);
+    g_free(dir);
+    g_free(path);
+}
+
+// what an export wrote, and how many messages it reported
+static gchar*
+_export(const LogExport *const export, int *written)
+{
+    FILE *out = tmpfile();
+    *written = log_export_run(EXPORT_DIR, export, out);
+
+    long len = ftell(out);
+    gchar *result = g_malloc0(len + 1);
+    rewind(out);
+    if (len > 0) {
+        assert_int_equal(1, fread(result, len, 1, out));
+    }
+    fclose(out);
+
+    return result;
+}
+
+void init_export_dir(void **state)
+{
+    g_mkdir_with_parents(EXPORT_DIR, S_IRWXU);
+    _write_log("me_at_example.com/alice_at_example.com/2016_01_01.log",
+        "10:00:00 - alice@example.com: morning\n"
+        "12:00:00 - me: lunch?\n");
+    _write_log("me_at_example.com/bob_at_example.com/2016_01_01.log",
+        "11:00:00 - bob@example.com: hello\n");
+    _write_log("me_at_example.com/bob_at_example.com/2016_01_02.log",
+        "09:00:00 - me: again\n");
+}
+
+void remove_export_dir(void **state)
+{
+    assert_int_equal(0, system("rm -rf ./tests/files"));
+}
+
+void export_merges_contacts_in_time_order(void **state)
+{
+    LogExport export = { NULL, NULL, 0, 0, NULL, 2 };
+    int written = 0;
+
+    gchar *out = _export(&export, &written);
+
+    assert_int_equal(4, written);
+    assert_string_equal(
+        "2016-01-01 10:00:00\tme@example.com\talice@example.com\talice@example.com\tmorning\n"
+        "2016-01-01 11:00:00\tme@example.com\tbob@example.com\tbob@example.com\thello\n"
+        "2016-01-01 12:00:00\tme@example.com\talice@example.com\tme\tlunch?\n"
+        "2016-01-02 09:00:00\tme@example.com\tbob@example.com\tme\tagain\n",
+        out);
+    g_free(out);
+}
+
+void export_filters_by_contact_and_day(void **state)
+{
+    LogExport export = { "me@example.com", "bob@example.com", 20160102, 20160102, NULL, 0 };
+    int written = 0;
+
+    gchar *out = _export(&export, &written);
+
+    assert_int_equal(1, written);
+    assert_string_equal("2016-01-02 09:00:00\tme@example.com\tbob@example.com\tme\tagain\n", out);
+    g_free(out);
+}
+
+void export_filters_by_regex(void **state)
+{
+    GRegex *regex = g_regex_new("^(hello|again)$", 0, 0, NULL);
+    LogExport export = { NULL, NULL, 0, 0, regex, 0 };
+    int written = 0;
+
+    gchar *out = _export(&export, &written);
+
+    assert_int_equal(2, written);
+    assert_non_null(strstr(out, "\thello\n"));
+    assert_non_null(strstr(out, "\tagain\n"));
+    g_free(out);
+    g_regex_unref(regex);
+}
+
+void export_escapes_multi_line_messages(void **state)
+{
+    _write_log("me_at_example.com/carol_at_example.com/2016_01_03.log",
+        "08:00:00 - carol@example.com: first\n"
+        "second\tline\n");
+    LogExport export = { NULL, "carol@example.com", 0, 0, NULL, 0 };
+    int written = 0;
+
+    gchar *out = _export(&export, &written);
+
+    assert_int_equal(1, written);
+    assert_string_equal("2016-01-03 08:00:00\tme@example.com\tcarol@example.com\tcarol@example.com\t"
+        "first\\nsecond\\tline\n", out);
+    g_free(out);
+}
+
+void export_missing_dir_fails(void **state)
+{
+    LogExport export = { NULL, NULL, 0, 0, NULL, 0 };
+
+    assert_int_equal(-1, log_export_run("./tests/files/no_such_dir", &export, stdout));
+}
+
+void export_parse_day_checks_date(void **state)
+{
+    assert_int_equal(20160229, log_export_parse_day("2016-02-29"));
+    assert_int_equal(0, log_export_parse_day("2015-02-29"));
+    assert_int_equal(0, log_export_parse_day("2016-01-01x"));
+    assert_int_equal(0, log_export_parse_day("yesterday"));
+}
@@ -0,0 +1,8 @@
+void init_export_dir(void **state);
+void remove_export_dir(void **state);
+void export_merges_contacts_in_time_order(void **state);
+void export_filters_by_contact_and_day(void **state);
+void export_filters_by_regex(void **state);
+void export_escapes_multi_line_messages(void **state);
+void export_missing_dir_fails(void **state);
+void export_parse_day_checks_date(void **state);
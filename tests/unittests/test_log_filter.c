@@ -0,0 +1,106 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "tools/log_filter.h"
+
+void log_filter_uses_own_level(void **state)
+{
+    LogFilter filter = log_filter_new();
+    assert_true(log_filter_set(filter, "level", "WARN", 0));
+
+    assert_false(log_filter_enabled(filter, PROF_LEVEL_INFO, PROF_LEVEL_DEBUG));
+    assert_true(log_filter_enabled(filter, PROF_LEVEL_WARN, PROF_LEVEL_DEBUG));
+    assert_true(log_filter_enabled(NULL, PROF_LEVEL_INFO, PROF_LEVEL_DEBUG));
+    assert_false(log_filter_enabled(NULL, PROF_LEVEL_INFO, PROF_LEVEL_ERROR));
+
+    log_filter_free(filter);
+}
+
+void log_filter_samples_one_in_n(void **state)
+{
+    LogFilter filter = log_filter_new();
+    assert_true(log_filter_set(filter, "sample", "3", 0));
+
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+    assert_false(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+    assert_false(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+    assert_false(log_filter_admit(filter, PROF_LEVEL_INFO, 0));
+
+    assert_int_equal(3, log_filter_take_suppressed(filter));
+    assert_int_equal(0, log_filter_take_suppressed(filter));
+    assert_int_equal(3, log_filter_dropped(filter));
+
+    log_filter_free(filter);
+}
+
+void log_filter_rate_limits_per_second(void **state)
+{
+    LogFilter filter = log_filter_new();
+    assert_true(log_filter_set(filter, "rate", "2", 0));
+
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+    assert_false(log_filter_admit(filter, PROF_LEVEL_DEBUG, 0));
+
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, G_USEC_PER_SEC / 2));
+    assert_false(log_filter_admit(filter, PROF_LEVEL_DEBUG, G_USEC_PER_SEC / 2));
+
+    // idle time refills no more than a second's worth
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, 10 * G_USEC_PER_SEC));
+    assert_true(log_filter_admit(filter, PROF_LEVEL_DEBUG, 10 * G_USEC_PER_SEC));
+    assert_false(log_filter_admit(filter, PROF_LEVEL_DEBUG, 10 * G_USEC_PER_SEC));
+
+    assert_int_equal(3, log_filter_dropped(filter));
+
+    log_filter_free(filter);
+}
+
+void log_filter_always_admits_warnings(void **state)
+{
+    LogFilter filter = log_filter_new();
+    assert_true(log_filter_set(filter, "rate", "1", 0));
+    assert_true(log_filter_set(filter, "sample", "10", 0));
+
+    int i;
+    for (i = 0; i < 5; i++) {
+        assert_true(log_filter_admit(filter, PROF_LEVEL_WARN, 0));
+        assert_true(log_filter_admit(filter, PROF_LEVEL_ERROR, 0));
+    }
+    assert_int_equal(0, log_filter_dropped(filter));
+
+    log_filter_free(filter);
+}
+
+void log_filter_rejects_bad_settings(void **state)
+{
+    LogFilter filter = log_filter_new();
+
+    assert_false(log_filter_set(filter, "level", "TRACE", 0));
+    assert_false(log_filter_set(filter, "rate", "ten", 0));
+    assert_false(log_filter_set(filter, "rate", "-1", 0));
+    assert_false(log_filter_set(filter, "sample", "", 0));
+    assert_false(log_filter_set(filter, "colour", "red", 0));
+
+    gchar *spec = log_filter_spec(filter);
+    assert_string_equal("", spec);
+    g_free(spec);
+
+    log_filter_free(filter);
+}
+
+void log_filter_spec_round_trips(void **state)
+{
+    LogFilter filter = log_filter_parse("sample=2 bogus=1 level=INFO rate=10 rate", 0);
+
+    gchar *spec = log_filter_spec(filter);
+    assert_string_equal("level=INFO rate=10 sample=2", spec);
+    g_free(spec);
+
+    log_filter_free(filter);
+}
@@ -0,0 +1,6 @@
+void log_filter_uses_own_level(void **state);
+void log_filter_samples_one_in_n(void **state);
+void log_filter_rate_limits_per_second(void **state);
+void log_filter_always_admits_warnings(void **state);
+void log_filter_rejects_bad_settings(void **state);
+void log_filter_spec_round_trips(void **state);
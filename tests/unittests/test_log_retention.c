@@ -0,0 +1,140 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tools/log_retention.h"
+
+#define RETENTION_DIR "./tests/files/retention"
+
+static void
+_write_file(const char *const name, const char *const contents)
+{
+    gchar *path = g_strdup_printf("%s/%s", RETENTION_DIR, name);
+    g_file_set_contents(path, contents, -1, NULL);
+    g_free(path);
+}
+
+static gboolean
+_file_exists(const char *const name)
+{
+    gchar *path = g_strdup_printf("%s/%s", RETENTION_DIR, name);
+    gboolean result = g_file_test(path, G_FILE_TEST_EXISTS);
+    g_free(path);
+
+    return result;
+}
+
+void init_retention_dir(void **state)
+{
+    g_mkdir_with_parents(RETENTION_DIR, S_IRWXU);
+}
+
+void remove_retention_dir(void **state)
+{
+    assert_int_equal(0, system("rm -rf ./tests/files"));
+}
+
+void retention_removes_days_older_than_max_age(void **state)
+{
+    _write_file("2016_01_01.log", "10:00:00 - me: old\n");
+    _write_file("2016_01_01.log.idx", "idx");
+    _write_file("2016_01_09.log", "10:00:00 - me: recent\n");
+    GDateTime *now = g_date_time_new_local(2016, 1, 10, 12, 0, 0);
+    LogRetention policy = { 7, 0, 0 };
+
+    int changed = log_retention_apply(RETENTION_DIR, &policy, now, NULL);
+
+    assert_int_equal(2, changed);
+    assert_false(_file_exists("2016_01_01.log"));
+    assert_false(_file_exists("2016_01_01.log.idx"));
+    assert_true(_file_exists("2016_01_09.log"));
+    g_date_time_unref(now);
+}
+
+void retention_never_removes_todays_files(void **state)
+{
+    _write_file("2016_01_10.log", "10:00:00 - me: today\n");
+    GDateTime *now = g_date_time_new_local(2016, 1, 10, 12, 0, 0);
+    LogRetention policy = { 1, 1, 0 };
+
+    int changed = log_retention_apply(RETENTION_DIR, &policy, now, NULL);
+
+    assert_int_equal(0, changed);
+    assert_true(_file_exists("2016_01_10.log"));
+    g_date_time_unref(now);
+}
+
+void retention_removes_oldest_days_over_max_size(void **state)
+{
+    _write_file("2016_01_07.log", "0123456789");
+    _write_file("2016_01_08.log", "0123456789");
+    _write_file("2016_01_08.1.log", "0123456789");
+    _write_file("2016_01_09.log", "0123456789");
+    GDateTime *now = g_date_time_new_local(2016, 1, 10, 12, 0, 0);
+    LogRetention policy = { 0, 15, 0 };
+
+    int changed = log_retention_apply(RETENTION_DIR, &policy, now, NULL);
+
+    assert_int_equal(3, changed);
+    assert_false(_file_exists("2016_01_07.log"));
+    assert_false(_file_exists("2016_01_08.log"));
+    assert_false(_file_exists("2016_01_08.1.log"));
+    assert_true(_file_exists("2016_01_09.log"));
+    g_date_time_unref(now);
+}
+
+void retention_ignores_files_not_named_by_date(void **state)
+{
+    _write_file("notes.txt", "keep me");
+    GDateTime *now = g_date_time_new_local(2016, 1, 10, 12, 0, 0);
+    LogRetention policy = { 1, 1, 0 };
+
+    int changed = log_retention_apply(RETENTION_DIR, &policy, now, NULL);
+
+    assert_int_equal(0, changed);
+    assert_true(_file_exists("notes.txt"));
+    g_date_time_unref(now);
+}
+
+void archive_then_read_returns_contents(void **state)
+{
+    if (!log_archive_supported()) {
+        assert_false(log_archive_file(RETENTION_DIR "/2016_01_01.log"));
+        return;
+    }
+    _write_file("2016_01_01.log", "10:00:00 - me: archived\n");
+
+    gboolean archived = log_archive_file(RETENTION_DIR "/2016_01_01.log");
+    gsize len = 0;
+    gchar *contents = log_archive_read(RETENTION_DIR "/2016_01_01.log", &len);
+
+    assert_true(archived);
+    assert_false(_file_exists("2016_01_01.log"));
+    assert_true(_file_exists("2016_01_01.log.gz"));
+    assert_int_equal(strlen("10:00:00 - me: archived\n"), len);
+    assert_string_equal("10:00:00 - me: archived\n", contents);
+    g_free(contents);
+}
+
+void retention_lists_files_gone(void **state)
+{
+    _write_file("2016_01_01.log", "10:00:00 - me: old\n");
+    _write_file("2016_01_09.log", "10:00:00 - me: recent\n");
+    GDateTime *now = g_date_time_new_local(2016, 1, 10, 12, 0, 0);
+    LogRetention policy = { 7, 0, 0 };
+    GSList *gone = NULL;
+
+    int changed = log_retention_apply(RETENTION_DIR, &policy, now, &gone);
+
+    assert_int_equal(1, changed);
+    assert_int_equal(1, g_slist_length(gone));
+    assert_string_equal(RETENTION_DIR "/2016_01_01.log", gone->data);
+    g_slist_free_full(gone, g_free);
+    g_date_time_unref(now);
+}
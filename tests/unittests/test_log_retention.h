@@ -0,0 +1,8 @@
+void init_retention_dir(void **state);
+void remove_retention_dir(void **state);
+void retention_removes_days_older_than_max_age(void **state);
+void retention_never_removes_todays_files(void **state);
+void retention_removes_oldest_days_over_max_size(void **state);
+void retention_ignores_files_not_named_by_date(void **state);
+void archive_then_read_returns_contents(void **state);
+void retention_lists_files_gone(void **state);
@@ -3,8 +3,12 @@
 #include <setjmp.h>
 #include <cmocka.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "muc.h"
+#include "config/preferences.h"
+#include "ui/win_types.h"
+#include "helpers.h"
 
 void muc_before_test(void **state)
 {
@@ -16,6 +20,47 @@ void muc_after_test(void **state)
     muc_close();
 }
 
+void muc_prefs_before_test(void **state)
+{
+    load_preferences(state);
+    muc_init();
+}
+
+void muc_prefs_after_test(void **state)
+{
+    muc_close();
+    close_preferences(state);
+}
+
+static ProfWin*
+_muc_window(const char *const room)
+{
+    ProfMucWin *mucwin = malloc(sizeof(ProfMucWin));
+    memset(mucwin, 0, sizeof(ProfMucWin));
+    mucwin->window.type = WIN_MUC;
+    mucwin->roomjid = strdup(room);
+    mucwin->memcheck = PROFMUCWIN_MEMCHECK;
+
+    return (ProfWin*)mucwin;
+}
+
+static void
+_muc_window_free(ProfWin *window)
+{
+    free(((ProfMucWin*)window)->roomjid);
+    free(window);
+}
+
+static void
+_muc_join_with_occupants(const char *const room)
+{
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "alice", NULL, "participant", "member", NULL, NULL);
+    muc_roster_add(room, "adam", NULL, "participant", "member", NULL, NULL);
+    muc_roster_add(room, "anna", NULL, "participant", "member", NULL, NULL);
+    muc_roster_set_complete(room);
+}
+
 void test_muc_invites_add(void **state)
 {
     char *room = "room@conf.server";
@@ -76,3 +121,289 @@ void test_muc_active(void **state)
 
     assert_true(room_is_active);
 }
+
+void test_muc_roster_ac_built_when_roster_complete(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "alice", "alice@server.org/laptop", "participant", "member", NULL, NULL);
+    muc_roster_add(room, "carol", NULL, "participant", "none", NULL, NULL);
+
+    assert_int_equal(0, autocomplete_length(muc_roster_ac(room)));
+
+    muc_roster_add(room, "bob", NULL, "moderator", "owner", NULL, NULL);
+    muc_roster_set_complete(room);
+
+    assert_int_equal(3, autocomplete_length(muc_roster_ac(room)));
+    assert_true(autocomplete_contains(muc_roster_ac(room), "alice"));
+    assert_true(autocomplete_contains(muc_roster_jid_ac(room), "alice@server.org"));
+}
+
+void test_muc_roster_ac_updated_after_roster_complete(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "bob", NULL, "moderator", "owner", NULL, NULL);
+    muc_roster_set_complete(room);
+
+    muc_roster_add(room, "dave", "dave@server.org/phone", "participant", "none", NULL, NULL);
+
+    assert_true(autocomplete_contains(muc_roster_ac(room), "dave"));
+    assert_true(autocomplete_contains(muc_roster_jid_ac(room), "dave@server.org"));
+}
+
+void test_muc_roster_sorted_by_nick(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "carol", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "alice", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "bob", NULL, "moderator", "owner", NULL, NULL);
+
+    GList *occupants = muc_roster(room);
+
+    assert_int_equal(3, g_list_length(occupants));
+    assert_string_equal("alice", ((Occupant*)g_list_nth_data(occupants, 0))->nick);
+    assert_string_equal("bob", ((Occupant*)g_list_nth_data(occupants, 1))->nick);
+    assert_string_equal("carol", ((Occupant*)g_list_nth_data(occupants, 2))->nick);
+    g_list_free(occupants);
+}
+
+void test_muc_occupants_by_role_sorted(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "carol", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "bob", NULL, "moderator", "owner", NULL, NULL);
+    muc_roster_add(room, "alice", NULL, "participant", "member", NULL, NULL);
+
+    GSList *participants = muc_occupants_by_role(room, MUC_ROLE_PARTICIPANT);
+
+    assert_int_equal(2, g_slist_length(participants));
+    assert_string_equal("alice", ((Occupant*)g_slist_nth_data(participants, 0))->nick);
+    assert_string_equal("carol", ((Occupant*)g_slist_nth_data(participants, 1))->nick);
+    g_slist_free(participants);
+}
+
+void test_muc_occupants_by_role_follows_role_change(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "alice", NULL, "participant", "member", NULL, NULL);
+    muc_roster_add(room, "alice", NULL, "moderator", "admin", NULL, NULL);
+
+    GSList *participants = muc_occupants_by_role(room, MUC_ROLE_PARTICIPANT);
+    GSList *moderators = muc_occupants_by_role(room, MUC_ROLE_MODERATOR);
+    GSList *admins = muc_occupants_by_affiliation(room, MUC_AFFILIATION_ADMIN);
+
+    assert_null(participants);
+    assert_int_equal(1, g_slist_length(moderators));
+    assert_int_equal(1, g_slist_length(admins));
+    g_slist_free(moderators);
+    g_slist_free(admins);
+}
+
+void test_muc_occupants_by_affiliation_after_remove(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "alice", NULL, "participant", "member", NULL, NULL);
+    muc_roster_add(room, "carol", NULL, "participant", "member", NULL, NULL);
+    muc_roster_remove(room, "alice");
+
+    GSList *members = muc_occupants_by_affiliation(room, MUC_AFFILIATION_MEMBER);
+    GList *occupants = muc_roster(room);
+
+    assert_int_equal(1, g_slist_length(members));
+    assert_string_equal("carol", ((Occupant*)members->data)->nick);
+    assert_int_equal(1, g_list_length(occupants));
+    g_slist_free(members);
+    g_list_free(occupants);
+}
+
+void test_muc_autocomplete_offers_recent_speakers_first(void **state)
+{
+    char *room = "room@server.org";
+    _muc_join_with_occupants(room);
+    ProfWin *window = _muc_window(room);
+    muc_nick_touch(room, "anna");
+    muc_nick_touch(room, "adam");
+
+    char *result1 = muc_autocomplete(window, "a");
+    char *result2 = muc_autocomplete(window, "a");
+    char *result3 = muc_autocomplete(window, "a");
+
+    assert_string_equal("adam: ", result1);
+    assert_string_equal("anna: ", result2);
+    assert_string_equal("alice: ", result3);
+
+    free(result1);
+    free(result2);
+    free(result3);
+    _muc_window_free(window);
+}
+
+void test_muc_autocomplete_moves_speaker_to_front(void **state)
+{
+    char *room = "room@server.org";
+    _muc_join_with_occupants(room);
+    ProfWin *window = _muc_window(room);
+    muc_nick_touch(room, "alice");
+    muc_nick_touch(room, "anna");
+    muc_nick_touch(room, "alice");
+
+    char *result1 = muc_autocomplete(window, "a");
+    char *result2 = muc_autocomplete(window, "a");
+    char *result3 = muc_autocomplete(window, "a");
+
+    assert_string_equal("alice: ", result1);
+    assert_string_equal("anna: ", result2);
+    assert_string_equal("adam: ", result3);
+
+    free(result1);
+    free(result2);
+    free(result3);
+    _muc_window_free(window);
+}
+
+void test_muc_autocomplete_forgets_speaker_who_left(void **state)
+{
+    char *room = "room@server.org";
+    _muc_join_with_occupants(room);
+    ProfWin *window = _muc_window(room);
+    muc_nick_touch(room, "anna");
+    muc_roster_remove(room, "anna");
+    muc_nick_touch(room, "zed");
+
+    char *result1 = muc_autocomplete(window, "a");
+    char *result2 = muc_autocomplete(window, "a");
+    char *result3 = muc_autocomplete(window, "a");
+
+    assert_string_equal("adam: ", result1);
+    assert_string_equal("alice: ", result2);
+    assert_string_equal("adam: ", result3);
+
+    free(result1);
+    free(result2);
+    free(result3);
+    _muc_window_free(window);
+}
+
+void test_muc_nick_change_keeps_speaker_place(void **state)
+{
+    char *room = "room@server.org";
+    _muc_join_with_occupants(room);
+    ProfWin *window = _muc_window(room);
+    muc_nick_touch(room, "anna");
+    muc_nick_touch(room, "alice");
+
+    muc_occupant_nick_change_start(room, "aaron", "anna");
+
+    assert_null(muc_roster_item(room, "anna"));
+    Occupant *occupant = muc_roster_item(room, "aaron");
+    assert_non_null(occupant);
+    assert_string_equal("aaron", occupant->nick);
+
+    char *result1 = muc_autocomplete(window, "a");
+    char *result2 = muc_autocomplete(window, "a");
+    char *result3 = muc_autocomplete(window, "a");
+
+    assert_string_equal("alice: ", result1);
+    assert_string_equal("aaron: ", result2);
+    assert_string_equal("adam: ", result3);
+
+    free(result1);
+    free(result2);
+    free(result3);
+    _muc_window_free(window);
+}
+
+void test_muc_nick_change_complete_returns_old_nick(void **state)
+{
+    char *room = "room@server.org";
+    _muc_join_with_occupants(room);
+    muc_occupant_nick_change_start(room, "aaron", "anna");
+
+    muc_roster_add(room, "aaron", NULL, "participant", "member", NULL, NULL);
+    char *old_nick = muc_roster_nick_change_complete(room, "aaron");
+    GList *occupants = muc_roster(room);
+
+    assert_string_equal("anna", old_nick);
+    assert_int_equal(3, g_list_length(occupants));
+    assert_string_equal("aaron", ((Occupant*)g_list_nth_data(occupants, 0))->nick);
+
+    free(old_nick);
+    g_list_free(occupants);
+}
+
+void test_muc_roster_iter_starts_at_position(void **state)
+{
+    char *room = "room@server.org";
+    _muc_join_with_occupants(room);
+
+    MucRosterIter iter;
+    muc_roster_iter_init(&iter, room, 1);
+    Occupant *first = muc_roster_iter_next(&iter);
+    Occupant *second = muc_roster_iter_next(&iter);
+
+    assert_int_equal(3, muc_roster_size(room));
+    assert_string_equal("alice", first->nick);
+    assert_string_equal("anna", second->nick);
+    assert_null(muc_roster_iter_next(&iter));
+}
+
+void test_muc_large_room_drops_occupant_details(void **state)
+{
+    char *room = "room@server.org";
+    muc_set_large(3);
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "bob", "bob@server.org/laptop", "participant", "member", NULL, "here");
+    muc_roster_add(room, "alice", "alice@server.org/home", "participant", "member", NULL, "busy");
+    muc_roster_add(room, "mod", "mod@server.org/work", "moderator", "member", NULL, "watching");
+    muc_roster_add(room, "adam", "adam@server.org/desk", "participant", "none", NULL, "hi");
+
+    Occupant *alice = muc_roster_item(room, "alice");
+    Occupant *adam = muc_roster_item(room, "adam");
+
+    assert_true(muc_roster_large(room));
+    assert_int_equal(4, muc_roster_size(room));
+    assert_null(alice->jid);
+    assert_null(alice->status);
+    assert_null(adam->jid);
+    assert_null(adam->status);
+    assert_string_equal("bob@server.org/laptop", muc_roster_item(room, "bob")->jid);
+    assert_string_equal("mod@server.org/work", muc_roster_item(room, "mod")->jid);
+
+    muc_set_large(0);
+}
+
+void test_muc_large_room_keeps_wanted_details(void **state)
+{
+    char *room = "room@server.org";
+    muc_set_large(2);
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "alice", "alice@server.org/home", "participant", "member", NULL, "busy");
+    muc_roster_add(room, "adam", "adam@server.org/desk", "participant", "none", NULL, "hi");
+
+    assert_true(muc_occupant_want_details(room, "alice"));
+    assert_false(muc_occupant_want_details(room, "alice"));
+    muc_roster_add(room, "alice", "alice@server.org/home", "participant", "member", "away", "lunch");
+
+    Occupant *alice = muc_roster_item(room, "alice");
+    assert_string_equal("alice@server.org/home", alice->jid);
+    assert_string_equal("lunch", alice->status);
+    assert_null(muc_roster_item(room, "adam")->jid);
+
+    muc_set_large(0);
+}
+
+void test_muc_small_room_keeps_occupant_details(void **state)
+{
+    char *room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "alice", "alice@server.org/home", "participant", "member", NULL, "busy");
+
+    assert_false(muc_roster_large(room));
+    assert_false(muc_occupant_want_details(room, "alice"));
+    assert_string_equal("busy", muc_roster_item(room, "alice")->status);
+}
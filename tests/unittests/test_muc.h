@@ -1,5 +1,7 @@
 void muc_before_test(void **state);
 void muc_after_test(void **state);
+void muc_prefs_before_test(void **state);
+void muc_prefs_after_test(void **state);
 
 void test_muc_invites_add(void **state);
 void test_muc_remove_invite(void **state);
@@ -7,3 +9,18 @@ void test_muc_invites_count_0(void **state);
 void test_muc_invites_count_5(void **state);
 void test_muc_room_is_not_active(void **state);
 void test_muc_active(void **state);
+void test_muc_roster_ac_built_when_roster_complete(void **state);
+void test_muc_roster_ac_updated_after_roster_complete(void **state);
+void test_muc_roster_sorted_by_nick(void **state);
+void test_muc_occupants_by_role_sorted(void **state);
+void test_muc_occupants_by_role_follows_role_change(void **state);
+void test_muc_occupants_by_affiliation_after_remove(void **state);
+void test_muc_autocomplete_offers_recent_speakers_first(void **state);
+void test_muc_autocomplete_moves_speaker_to_front(void **state);
+void test_muc_autocomplete_forgets_speaker_who_left(void **state);
+void test_muc_nick_change_keeps_speaker_place(void **state);
+void test_muc_nick_change_complete_returns_old_nick(void **state);
+void test_muc_roster_iter_starts_at_position(void **state);
+void test_muc_large_room_drops_occupant_details(void **state);
+void test_muc_large_room_keeps_wanted_details(void **state);
+void test_muc_small_room_keeps_occupant_details(void **state);
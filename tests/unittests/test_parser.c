@@ -3,6 +3,8 @@
 #include <setjmp.h>
 #include <cmocka.h>
 #include <stdlib.h>
+#include <string.h>
+#include <glib.h>
 
 #include "tools/parser.h"
 
@@ -15,7 +17,7 @@ parse_null_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -27,7 +29,7 @@ parse_empty_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -39,7 +41,7 @@ parse_space_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -51,7 +53,7 @@ parse_cmd_no_args_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -63,7 +65,7 @@ parse_cmd_with_space_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -75,7 +77,7 @@ parse_cmd_with_too_few_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -87,7 +89,7 @@ parse_cmd_with_too_many_returns_null(void **state)
 
     assert_false(result);
     assert_null(args);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -100,7 +102,7 @@ parse_cmd_one_arg(void **state)
     assert_true(result);
     assert_int_equal(1, g_strv_length(args));
     assert_string_equal("arg1", args[0]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -114,7 +116,7 @@ parse_cmd_two_args(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("arg1", args[0]);
     assert_string_equal("arg2", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -129,7 +131,7 @@ parse_cmd_three_args(void **state)
     assert_string_equal("arg1", args[0]);
     assert_string_equal("arg2", args[1]);
     assert_string_equal("arg3", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -144,7 +146,7 @@ parse_cmd_three_args_with_spaces(void **state)
     assert_string_equal("arg1", args[0]);
     assert_string_equal("arg2", args[1]);
     assert_string_equal("arg3", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -157,7 +159,7 @@ parse_cmd_with_freetext(void **state)
     assert_true(result);
     assert_int_equal(1, g_strv_length(args));
     assert_string_equal("this is some free text", args[0]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -171,7 +173,7 @@ parse_cmd_one_arg_with_freetext(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("arg1", args[0]);
     assert_string_equal("this is some free text", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -186,7 +188,7 @@ parse_cmd_two_args_with_freetext(void **state)
     assert_string_equal("arg1", args[0]);
     assert_string_equal("arg2", args[1]);
     assert_string_equal("this is some free text", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -199,7 +201,7 @@ parse_cmd_min_zero(void **state)
     assert_true(result);
     assert_int_equal(0, g_strv_length(args));
     assert_null(args[0]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -212,7 +214,7 @@ parse_cmd_min_zero_with_freetext(void **state)
     assert_true(result);
     assert_int_equal(0, g_strv_length(args));
     assert_null(args[0]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -226,7 +228,7 @@ parse_cmd_with_quoted(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("arg1", args[0]);
     assert_string_equal("arg2", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -240,7 +242,7 @@ parse_cmd_with_quoted_and_space(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("the arg1", args[0]);
     assert_string_equal("arg2", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -254,7 +256,7 @@ parse_cmd_with_quoted_and_many_spaces(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("the arg1 is here", args[0]);
     assert_string_equal("arg2", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -268,7 +270,7 @@ parse_cmd_with_many_quoted_and_many_spaces(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("the arg1 is here", args[0]);
     assert_string_equal("and arg2 is right here", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -283,7 +285,7 @@ parse_cmd_freetext_with_quoted(void **state)
     assert_string_equal("arg1", args[0]);
     assert_string_equal("arg2", args[1]);
     assert_string_equal("hello there whats up", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -298,7 +300,7 @@ parse_cmd_freetext_with_quoted_and_space(void **state)
     assert_string_equal("the arg1", args[0]);
     assert_string_equal("arg2", args[1]);
     assert_string_equal("another bit of freetext", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -313,7 +315,7 @@ parse_cmd_freetext_with_quoted_and_many_spaces(void **state)
     assert_string_equal("the arg1 is here", args[0]);
     assert_string_equal("arg2", args[1]);
     assert_string_equal("some more freetext", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -328,7 +330,7 @@ parse_cmd_freetext_with_many_quoted_and_many_spaces(void **state)
     assert_string_equal("the arg1 is here", args[0]);
     assert_string_equal("and arg2 is right here", args[1]);
     assert_string_equal("and heres the free text", args[2]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -342,7 +344,7 @@ parse_cmd_with_quoted_freetext(void **state)
     assert_int_equal(2, g_strv_length(args));
     assert_string_equal("arg1", args[0]);
     assert_string_equal("here is \"some\" quoted freetext", args[1]);
-    g_strfreev(args);
+    parse_args_free(args);
 }
 
 void
@@ -659,4 +661,45 @@ parse_options_with_duplicated_option_sets_error(void **state)
     assert_false(res);
 
     options_destroy(options);
-}
\ No newline at end of file
+}
+static GString*
+_long_input(const char *const start)
+{
+    GString *inp = g_string_new(start);
+    while (inp->len < 10240) {
+        g_string_append(inp, "w\xc3\xb6rd ");
+    }
+    g_string_truncate(inp, inp->len - 1);
+
+    return inp;
+}
+
+void
+parse_long_input_returns_all_args(void **state)
+{
+    GString *inp = _long_input("/cmd ");
+    gboolean result = FALSE;
+    gchar **args = parse_args(inp->str, 0, 10240, &result);
+
+    assert_true(result);
+    assert_int_equal(1706, g_strv_length(args));
+    assert_string_equal("w\xc3\xb6rd", args[0]);
+    assert_string_equal("w\xc3\xb6rd", args[1705]);
+    parse_args_free(args);
+    g_string_free(inp, TRUE);
+}
+
+void
+parse_long_freetext_returns_whole_message(void **state)
+{
+    GString *inp = _long_input("/msg bob@server.org ");
+    gboolean result = FALSE;
+    gchar **args = parse_args_with_freetext(inp->str, 1, 2, &result);
+
+    assert_true(result);
+    assert_int_equal(2, g_strv_length(args));
+    assert_string_equal("bob@server.org", args[0]);
+    assert_string_equal(&inp->str[strlen("/msg bob@server.org ")], args[1]);
+    parse_args_free(args);
+    g_string_free(inp, TRUE);
+}
@@ -48,3 +48,5 @@ void parse_options_when_opt3_no_val_sets_error(void **state);
 void parse_options_when_three_returns_map(void **state);
 void parse_options_when_unknown_opt_sets_error(void **state);
 void parse_options_with_duplicated_option_sets_error(void **state);
+void parse_long_input_returns_all_args(void **state);
+void parse_long_freetext_returns_whole_message(void **state);
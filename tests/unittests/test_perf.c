@@ -0,0 +1,65 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/perf.h"
+
+// records a sample of at least ms milliseconds
+static void
+_record_ms(perf_stage_t stage, int ms)
+{
+    perf_record(stage, g_get_monotonic_time() - (ms * 1000));
+}
+
+void init_perf_samples(void **state)
+{
+    perf_enable();
+}
+
+void remove_perf_samples(void **state)
+{
+    perf_disable();
+}
+
+void percentiles_are_zero_without_samples(void **state)
+{
+    assert_int_equal(0, perf_count(PERF_PARSE));
+    assert_true(perf_percentile(PERF_PARSE, 50) == 0);
+    assert_true(perf_percentile(PERF_PARSE, 100) == 0);
+}
+
+void record_ignored_when_disabled(void **state)
+{
+    perf_disable();
+    assert_true(perf_start() == 0);
+    _record_ms(PERF_HANDLER, 5);
+
+    perf_enable();
+    perf_record(PERF_HANDLER, 0);
+
+    assert_int_equal(0, perf_count(PERF_HANDLER));
+}
+
+void percentiles_use_nearest_rank(void **state)
+{
+    int i;
+    for (i = 100; i > 0; i--) {
+        _record_ms(PERF_LOG, i);
+    }
+
+    assert_int_equal(100, perf_count(PERF_LOG));
+    assert_int_equal(0, perf_count(PERF_RENDER));
+
+    // each sample is its recorded delay plus a little, never a neighbour's
+    gint64 p50 = perf_percentile(PERF_LOG, 50);
+    gint64 p99 = perf_percentile(PERF_LOG, 99);
+    gint64 max = perf_percentile(PERF_LOG, 100);
+    assert_true(p50 >= 50000 && p50 < 51000);
+    assert_true(p99 >= 99000 && p99 < 100000);
+    assert_true(max >= 100000);
+    assert_true(perf_percentile(PERF_LOG, 0) >= 1000);
+    assert_true(perf_percentile(PERF_LOG, 0) < 2000);
+}
@@ -0,0 +1,5 @@
+void init_perf_samples(void **state);
+void remove_perf_samples(void **state);
+void percentiles_are_zero_without_samples(void **state);
+void record_ignored_when_disabled(void **state);
+void percentiles_use_nearest_rank(void **state);
@@ -31,3 +31,62 @@ void statuses_muc_defaults_to_all(void **state)
     assert_non_null(setting);
     assert_string_equal("all", setting);
 }
+
+void peek_string_returns_default(void **state)
+{
+    const char *setting = prefs_peek_string(PREF_ROSTER_BY);
+
+    assert_string_equal("presence", setting);
+}
+
+void peek_string_returns_updated_value(void **state)
+{
+    prefs_peek_string(PREF_ROSTER_BY);
+    prefs_set_string(PREF_ROSTER_BY, "group");
+
+    const char *setting = prefs_peek_string(PREF_ROSTER_BY);
+
+    assert_string_equal("group", setting);
+}
+
+void get_string_returns_copy_of_cached_value(void **state)
+{
+    prefs_set_string(PREF_ROSTER_BY, "group");
+
+    char *setting = prefs_get_string(PREF_ROSTER_BY);
+
+    assert_string_equal("group", setting);
+    assert_true(setting != prefs_peek_string(PREF_ROSTER_BY));
+    prefs_free_string(setting);
+}
+
+void get_boolean_returns_updated_value(void **state)
+{
+    assert_true(prefs_get_boolean(PREF_WRAP));
+
+    prefs_set_boolean(PREF_WRAP, FALSE);
+
+    assert_false(prefs_get_boolean(PREF_WRAP));
+}
+
+void room_policy_removed_when_set_to_null(void **state)
+{
+    prefs_set_room_policy("room@conference.example.com", "digest");
+
+    char *policy = prefs_get_room_policy("room@conference.example.com");
+    assert_string_equal("digest", policy);
+    prefs_free_string(policy);
+
+    prefs_set_room_policy("room@conference.example.com", NULL);
+
+    assert_null(prefs_get_room_policy("room@conference.example.com"));
+}
+
+void autoping_misses_defaults_to_two(void **state)
+{
+    assert_int_equal(2, prefs_get_autoping_misses());
+
+    prefs_set_autoping_misses(5);
+
+    assert_int_equal(5, prefs_get_autoping_misses());
+}
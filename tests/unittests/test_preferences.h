@@ -1,3 +1,9 @@
 void statuses_console_defaults_to_all(void **state);
 void statuses_chat_defaults_to_all(void **state);
 void statuses_muc_defaults_to_all(void **state);
+void peek_string_returns_default(void **state);
+void peek_string_returns_updated_value(void **state);
+void get_string_returns_copy_of_cached_value(void **state);
+void get_boolean_returns_updated_value(void **state);
+void room_policy_removed_when_set_to_null(void **state);
+void autoping_misses_defaults_to_two(void **state);
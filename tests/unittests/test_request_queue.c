@@ -0,0 +1,98 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/request_queue.h"
+
+static void
+_send(gpointer request, gpointer userdata)
+{
+    GPtrArray *sent = userdata;
+    g_ptr_array_add(sent, request);
+}
+
+void request_queue_sends_up_to_parallel(void **state)
+{
+    GPtrArray *sent = g_ptr_array_new();
+    RequestQueue queue = request_queue_new(2, _send, sent, NULL);
+
+    request_queue_add(queue, "one");
+    request_queue_add(queue, "two");
+    request_queue_add(queue, "three");
+
+    assert_int_equal(2, sent->len);
+    assert_string_equal("one", g_ptr_array_index(sent, 0));
+    assert_string_equal("two", g_ptr_array_index(sent, 1));
+    assert_int_equal(2, request_queue_active(queue));
+    assert_int_equal(1, request_queue_waiting(queue));
+
+    request_queue_free(queue);
+    g_ptr_array_free(sent, TRUE);
+}
+
+void request_queue_done_sends_next_in_order(void **state)
+{
+    GPtrArray *sent = g_ptr_array_new();
+    RequestQueue queue = request_queue_new(1, _send, sent, NULL);
+
+    request_queue_add(queue, "one");
+    request_queue_add(queue, "two");
+    request_queue_add(queue, "three");
+
+    request_queue_done(queue);
+    assert_int_equal(2, sent->len);
+    assert_string_equal("two", g_ptr_array_index(sent, 1));
+
+    request_queue_done(queue);
+    assert_int_equal(3, sent->len);
+    assert_string_equal("three", g_ptr_array_index(sent, 2));
+
+    request_queue_done(queue);
+    assert_int_equal(0, request_queue_active(queue));
+    assert_int_equal(0, request_queue_waiting(queue));
+
+    request_queue_free(queue);
+    g_ptr_array_free(sent, TRUE);
+}
+
+void request_queue_done_when_idle_stays_at_zero(void **state)
+{
+    GPtrArray *sent = g_ptr_array_new();
+    RequestQueue queue = request_queue_new(1, _send, sent, NULL);
+
+    request_queue_done(queue);
+    request_queue_add(queue, "one");
+    request_queue_add(queue, "two");
+
+    assert_int_equal(1, sent->len);
+    assert_int_equal(1, request_queue_active(queue));
+
+    request_queue_free(queue);
+    g_ptr_array_free(sent, TRUE);
+}
+
+void request_queue_clear_frees_waiting(void **state)
+{
+    GPtrArray *sent = g_ptr_array_new_with_free_func(free);
+    RequestQueue queue = request_queue_new(1, _send, sent, free);
+
+    request_queue_add(queue, strdup("one"));
+    request_queue_add(queue, strdup("two"));
+    request_queue_add(queue, strdup("three"));
+
+    request_queue_clear(queue);
+    assert_int_equal(0, request_queue_active(queue));
+    assert_int_equal(0, request_queue_waiting(queue));
+
+    // room again for a full batch once cleared
+    request_queue_add(queue, strdup("four"));
+    assert_int_equal(2, sent->len);
+    assert_int_equal(0, request_queue_waiting(queue));
+
+    request_queue_free(queue);
+    g_ptr_array_free(sent, TRUE);
+}
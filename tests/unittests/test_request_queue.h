@@ -0,0 +1,4 @@
+void request_queue_sends_up_to_parallel(void **state);
+void request_queue_done_sends_next_in_order(void **state);
+void request_queue_done_when_idle_stays_at_zero(void **state);
+void request_queue_clear_frees_waiting(void **state);
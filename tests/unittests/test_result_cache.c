@@ -0,0 +1,76 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/result_cache.h"
+
+void result_cache_returns_added_result(void **state)
+{
+    ResultCache cache = result_cache_new(1000, free);
+    result_cache_add(cache, "bob@server.org/laptop", "ver1", strdup("Profanity"), 100);
+
+    gint64 fetched = 0;
+    char *result = result_cache_lookup(cache, "bob@server.org/laptop", "ver1", 200, &fetched);
+
+    assert_string_equal("Profanity", result);
+    assert_int_equal(100, fetched);
+    assert_null(result_cache_lookup(cache, "bob@server.org/phone", "ver1", 200, NULL));
+
+    result_cache_free(cache);
+}
+
+void result_cache_drops_result_after_max_age(void **state)
+{
+    ResultCache cache = result_cache_new(1000, free);
+    result_cache_add(cache, "bob@server.org/laptop", NULL, strdup("Profanity"), 100);
+
+    assert_non_null(result_cache_lookup(cache, "bob@server.org/laptop", NULL, 1099, NULL));
+    assert_null(result_cache_lookup(cache, "bob@server.org/laptop", NULL, 1100, NULL));
+    assert_int_equal(0, result_cache_size(cache));
+
+    result_cache_free(cache);
+}
+
+void result_cache_drops_result_when_tag_changes(void **state)
+{
+    ResultCache cache = result_cache_new(1000, free);
+    result_cache_add(cache, "bob@server.org/laptop", "ver1", strdup("Profanity"), 100);
+
+    assert_null(result_cache_lookup(cache, "bob@server.org/laptop", "ver2", 200, NULL));
+    assert_null(result_cache_lookup(cache, "bob@server.org/laptop", "ver1", 200, NULL));
+
+    result_cache_free(cache);
+}
+
+void result_cache_add_replaces_result(void **state)
+{
+    ResultCache cache = result_cache_new(1000, free);
+    result_cache_add(cache, "bob@server.org", NULL, strdup("first"), 100);
+    result_cache_add(cache, "bob@server.org", NULL, strdup("second"), 200);
+
+    assert_string_equal("second", result_cache_lookup(cache, "bob@server.org", NULL, 300, NULL));
+    assert_int_equal(1, result_cache_size(cache));
+
+    result_cache_free(cache);
+}
+
+void result_cache_remove_forgets_only_that_jid(void **state)
+{
+    ResultCache cache = result_cache_new(1000, free);
+    result_cache_add(cache, "bob@server.org", NULL, strdup("bare"), 100);
+    result_cache_add(cache, "bob@server.org/laptop", NULL, strdup("full"), 100);
+
+    result_cache_remove(cache, "bob@server.org");
+
+    assert_null(result_cache_lookup(cache, "bob@server.org", NULL, 200, NULL));
+    assert_string_equal("full", result_cache_lookup(cache, "bob@server.org/laptop", NULL, 200, NULL));
+
+    result_cache_clear(cache);
+    assert_int_equal(0, result_cache_size(cache));
+
+    result_cache_free(cache);
+}
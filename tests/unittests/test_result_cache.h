@@ -0,0 +1,5 @@
+void result_cache_returns_added_result(void **state);
+void result_cache_drops_result_after_max_age(void **state);
+void result_cache_drops_result_when_tag_changes(void **state);
+void result_cache_add_replaces_result(void **state);
+void result_cache_remove_forgets_only_that_jid(void **state);
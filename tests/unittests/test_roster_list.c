@@ -269,3 +269,214 @@ void find_twice_returns_first_when_two_match_and_reset(void **state)
     free(result2);
     roster_free();
 }
+
+void find_after_batch_add(void **state)
+{
+    roster_init();
+    roster_batch_begin();
+    roster_add("James", NULL, NULL, NULL, FALSE);
+    roster_add("Dave", NULL, NULL, NULL, FALSE);
+    roster_add("Bob", NULL, NULL, NULL, FALSE);
+    roster_batch_end();
+
+    char *result = roster_contact_autocomplete("D");
+    assert_string_equal("Dave", result);
+    free(result);
+    roster_free();
+}
+
+void batch_add_adds_groups_once(void **state)
+{
+    roster_init();
+    GSList *groups1 = g_slist_append(NULL, strdup("friends"));
+    GSList *groups2 = g_slist_append(NULL, strdup("friends"));
+    roster_batch_begin();
+    roster_add("James", NULL, groups1, NULL, FALSE);
+    roster_add("Dave", NULL, groups2, NULL, FALSE);
+    roster_batch_end();
+
+    GSList *groups = roster_get_groups();
+    assert_int_equal(1, g_slist_length(groups));
+    assert_string_equal("friends", groups->data);
+
+    g_slist_free_full(groups, free);
+    roster_free();
+}
+
+void get_group_returns_sorted_members(void **state)
+{
+    roster_init();
+    GSList *groups1 = g_slist_append(NULL, strdup("friends"));
+    GSList *groups2 = g_slist_append(NULL, strdup("friends"));
+    roster_add("James", NULL, groups1, NULL, FALSE);
+    roster_add("Dave", NULL, NULL, NULL, FALSE);
+    roster_add("Bob", NULL, groups2, NULL, FALSE);
+
+    GSList *list = roster_get_group("friends");
+    assert_int_equal(2, g_slist_length(list));
+    assert_string_equal("Bob", p_contact_barejid(list->data));
+    assert_string_equal("James", p_contact_barejid(g_slist_next(list)->data));
+
+    GSList *nogroup = roster_get_nogroup();
+    assert_int_equal(1, g_slist_length(nogroup));
+    assert_string_equal("Dave", p_contact_barejid(nogroup->data));
+
+    g_slist_free(list);
+    g_slist_free(nogroup);
+    roster_free();
+}
+
+void get_by_presence_follows_presence_updates(void **state)
+{
+    roster_init();
+    roster_add("james", NULL, NULL, NULL, FALSE);
+    roster_add("dave", NULL, NULL, NULL, FALSE);
+    Resource *resource = resource_new("laptop", RESOURCE_AWAY, NULL, 0);
+    roster_update_presence("james", resource, NULL);
+
+    GSList *away = roster_get_contacts_by_presence("away");
+    GSList *offline = roster_get_contacts_by_presence("offline");
+    assert_int_equal(1, g_slist_length(away));
+    assert_string_equal("james", p_contact_barejid(away->data));
+    assert_int_equal(1, g_slist_length(offline));
+    assert_string_equal("dave", p_contact_barejid(offline->data));
+    g_slist_free(away);
+    g_slist_free(offline);
+
+    roster_contact_offline("james", "laptop", NULL);
+
+    away = roster_get_contacts_by_presence("away");
+    offline = roster_get_contacts_by_presence("offline");
+    assert_int_equal(0, g_slist_length(away));
+    assert_int_equal(2, g_slist_length(offline));
+    g_slist_free(away);
+    g_slist_free(offline);
+    roster_free();
+}
+
+void change_name_reorders_contacts(void **state)
+{
+    roster_init();
+    roster_add("james", NULL, NULL, NULL, FALSE);
+    roster_add("dave", NULL, NULL, NULL, FALSE);
+    roster_change_name(roster_get_contact("james"), "aaron");
+
+    GSList *list = roster_get_contacts();
+    assert_string_equal("james", p_contact_barejid(list->data));
+    assert_string_equal("dave", p_contact_barejid(g_slist_next(list)->data));
+
+    g_slist_free(list);
+    roster_free();
+}
+
+void roster_received_after_set(void **state)
+{
+    roster_init();
+    roster_set_received();
+
+    assert_true(roster_received());
+
+    roster_clear();
+    roster_free();
+}
+
+void roster_not_received_after_clear(void **state)
+{
+    roster_init();
+    roster_set_received();
+    roster_clear();
+
+    assert_false(roster_received());
+
+    roster_free();
+}
+
+void group_size_follows_membership(void **state)
+{
+    roster_init();
+    GSList *groups1 = g_slist_append(NULL, strdup("friends"));
+    GSList *groups2 = g_slist_append(NULL, strdup("friends"));
+    roster_add("James", NULL, groups1, NULL, FALSE);
+    roster_add("Bob", NULL, groups2, NULL, FALSE);
+
+    assert_int_equal(2, roster_group_size("friends"));
+    assert_int_equal(0, roster_group_size("enemies"));
+
+    roster_remove("James", "James");
+
+    assert_int_equal(1, roster_group_size("friends"));
+
+    roster_free();
+}
+
+void query_matches_presence_class_and_group(void **state)
+{
+    roster_init();
+    GSList *groups1 = g_slist_append(NULL, strdup("friends"));
+    GSList *groups2 = g_slist_append(NULL, strdup("friends"));
+    roster_add("james", NULL, groups1, NULL, FALSE);
+    roster_add("bob", NULL, groups2, NULL, FALSE);
+    roster_add("dave", NULL, NULL, NULL, FALSE);
+    roster_update_presence("james", resource_new("laptop", RESOURCE_AWAY, NULL, 0), NULL);
+    roster_update_presence("dave", resource_new("phone", RESOURCE_CHAT, NULL, 0), NULL);
+
+    RosterQuery online = { "online", NULL, NULL, NULL };
+    GSList *result = roster_query(&online);
+    assert_int_equal(2, g_slist_length(result));
+    assert_string_equal("dave", p_contact_barejid(result->data));
+    assert_string_equal("james", p_contact_barejid(result->next->data));
+    g_slist_free(result);
+
+    RosterQuery friends_unavailable = { "unavailable", "friends", NULL, NULL };
+    result = roster_query(&friends_unavailable);
+    assert_int_equal(2, g_slist_length(result));
+    assert_string_equal("bob", p_contact_barejid(result->data));
+    assert_string_equal("james", p_contact_barejid(result->next->data));
+    g_slist_free(result);
+
+    RosterQuery friends_chat = { "chat", "friends", NULL, NULL };
+    assert_null(roster_query(&friends_chat));
+
+    RosterQuery no_group = { NULL, "enemies", NULL, NULL };
+    assert_null(roster_query(&no_group));
+
+    roster_free();
+}
+
+void query_matches_subscription(void **state)
+{
+    roster_init();
+    roster_add("james", NULL, NULL, "both", FALSE);
+    roster_add("bob", NULL, NULL, "from", FALSE);
+    roster_add("dave", NULL, NULL, "both", FALSE);
+
+    RosterQuery both = { NULL, NULL, "both", NULL };
+    GSList *result = roster_query(&both);
+    assert_int_equal(2, g_slist_length(result));
+    assert_string_equal("dave", p_contact_barejid(result->data));
+    assert_string_equal("james", p_contact_barejid(result->next->data));
+    g_slist_free(result);
+
+    roster_free();
+}
+
+void query_matches_text_in_name_or_jid(void **state)
+{
+    roster_init();
+    roster_add("james@example.com", "Jimmy", NULL, NULL, FALSE);
+    roster_add("bob@example.org", NULL, NULL, NULL, FALSE);
+    roster_add("dave@example.com", "Davey", NULL, NULL, FALSE);
+
+    RosterQuery jim = { NULL, NULL, NULL, "JIM" };
+    GSList *result = roster_query(&jim);
+    assert_int_equal(1, g_slist_length(result));
+    assert_string_equal("james@example.com", p_contact_barejid(result->data));
+    g_slist_free(result);
+
+    RosterQuery com = { NULL, NULL, NULL, "example.com" };
+    result = roster_query(&com);
+    assert_int_equal(2, g_slist_length(result));
+    g_slist_free(result);
+
+    roster_free();
+}
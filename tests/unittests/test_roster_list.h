@@ -16,3 +16,14 @@ void find_on_empty_returns_null(void **state);
 void find_twice_returns_second_when_two_match(void **state);
 void find_five_times_finds_fifth(void **state);
 void find_twice_returns_first_when_two_match_and_reset(void **state);
+void find_after_batch_add(void **state);
+void batch_add_adds_groups_once(void **state);
+void get_group_returns_sorted_members(void **state);
+void get_by_presence_follows_presence_updates(void **state);
+void change_name_reorders_contacts(void **state);
+void roster_received_after_set(void **state);
+void roster_not_received_after_clear(void **state);
+void group_size_follows_membership(void **state);
+void query_matches_presence_class_and_group(void **state);
+void query_matches_subscription(void **state);
+void query_matches_text_in_name_or_jid(void **state);
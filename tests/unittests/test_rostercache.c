@@ -0,0 +1,133 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "contact.h"
+#include "roster_list.h"
+#include "config/rostercache.h"
+
+#define ROSTERCACHE_DIR "./tests/files/xdg_data_home/profanity/roster"
+#define ROSTERCACHE_FILE "./tests/files/xdg_data_home/profanity/roster/me_at_server.org"
+
+static void
+_reconnect(void)
+{
+    rostercache_on_disconnect();
+    rostercache_on_connect("me@server.org");
+}
+
+void init_rostercache(void **state)
+{
+    create_data_dir(state);
+    roster_init();
+    rostercache_on_connect("me@server.org");
+}
+
+void close_rostercache(void **state)
+{
+    rostercache_on_disconnect();
+    roster_free();
+    remove(ROSTERCACHE_FILE);
+    rmdir(ROSTERCACHE_DIR);
+    remove_data_dir(state);
+    rmdir("./tests/files");
+}
+
+void rostercache_load_without_version_returns_false(void **state)
+{
+    rostercache_update("buddy@server.org", "Buddy", NULL, "both", FALSE);
+
+    assert_null(rostercache_get_version());
+    assert_false(rostercache_load());
+    assert_null(roster_get_contacts());
+}
+
+void rostercache_load_adds_saved_contacts(void **state)
+{
+    GSList *groups = g_slist_append(NULL, "friends");
+    rostercache_update("buddy@server.org", "Buddy", groups, "both", FALSE);
+    rostercache_update("other@server.org", NULL, NULL, "none", TRUE);
+    g_slist_free(groups);
+    rostercache_set_version("ver14");
+
+    _reconnect();
+
+    assert_string_equal("ver14", rostercache_get_version());
+    assert_true(rostercache_load());
+    assert_int_equal(2, g_slist_length(roster_get_contacts()));
+
+    PContact buddy = roster_get_contact("buddy@server.org");
+    assert_non_null(buddy);
+    assert_string_equal("Buddy", p_contact_name(buddy));
+    assert_string_equal("both", p_contact_subscription(buddy));
+    assert_true(p_contact_in_group(buddy, "friends"));
+    assert_false(p_contact_pending_out(buddy));
+
+    PContact other = roster_get_contact("other@server.org");
+    assert_non_null(other);
+    assert_null(p_contact_name(other));
+    assert_true(p_contact_pending_out(other));
+}
+
+void rostercache_no_version_invalidates_cache(void **state)
+{
+    rostercache_update("buddy@server.org", "Buddy", NULL, "both", FALSE);
+    rostercache_set_version("ver14");
+    rostercache_set_version(NULL);
+
+    _reconnect();
+
+    assert_null(rostercache_get_version());
+    assert_false(rostercache_load());
+}
+
+void rostercache_remove_drops_contact(void **state)
+{
+    rostercache_update("buddy@server.org", "Buddy", NULL, "both", FALSE);
+    rostercache_update("other@server.org", "Other", NULL, "both", FALSE);
+    rostercache_remove("buddy@server.org");
+    rostercache_set_version("ver15");
+
+    _reconnect();
+
+    assert_true(rostercache_load());
+    assert_null(roster_get_contact("buddy@server.org"));
+    assert_non_null(roster_get_contact("other@server.org"));
+}
+
+void rostercache_clear_drops_contacts_and_version(void **state)
+{
+    rostercache_update("buddy@server.org", "Buddy", NULL, "both", FALSE);
+    rostercache_set_version("ver14");
+    rostercache_clear();
+
+    assert_null(rostercache_get_version());
+
+    rostercache_update("other@server.org", "Other", NULL, "both", FALSE);
+    rostercache_set_version("ver16");
+
+    _reconnect();
+
+    assert_true(rostercache_load());
+    assert_null(roster_get_contact("buddy@server.org"));
+    assert_non_null(roster_get_contact("other@server.org"));
+}
+
+void rostercache_not_saved_after_disconnect(void **state)
+{
+    rostercache_on_disconnect();
+    rostercache_update("buddy@server.org", "Buddy", NULL, "both", FALSE);
+    rostercache_set_version("ver14");
+
+    rostercache_on_connect("me@server.org");
+
+    assert_null(rostercache_get_version());
+    assert_false(rostercache_load());
+}
@@ -0,0 +1,8 @@
+void init_rostercache(void **state);
+void close_rostercache(void **state);
+void rostercache_load_without_version_returns_false(void **state);
+void rostercache_load_adds_saved_contacts(void **state);
+void rostercache_no_version_invalidates_cache(void **state);
+void rostercache_remove_drops_contact(void **state);
+void rostercache_clear_drops_contacts_and_version(void **state);
+void rostercache_not_saved_after_disconnect(void **state);
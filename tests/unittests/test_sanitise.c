@@ -0,0 +1,100 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/sanitise.h"
+
+void sanitise_text_printable_ascii_unchanged(void **state)
+{
+    char text[] = "a message of an ordinary length, written in plain ASCII text";
+
+    int result = sanitise_text(text);
+
+    assert_int_equal(SANITISE_ASCII, result);
+    assert_string_equal("a message of an ordinary length, written in plain ASCII text", text);
+}
+
+void sanitise_text_keeps_newlines_and_tabs(void **state)
+{
+    char text[] = "line one\n\tline two";
+
+    int result = sanitise_text(text);
+
+    assert_int_equal(SANITISE_ASCII, result);
+    assert_string_equal("line one\n\tline two", text);
+}
+
+void sanitise_text_strips_csi_sequence(void **state)
+{
+    char text[] = "plain \x1b[2J\x1b[31mred\x1b[0m text";
+
+    int result = sanitise_text(text);
+
+    assert_true(result & SANITISE_CHANGED);
+    assert_string_equal("plain red text", text);
+}
+
+void sanitise_text_strips_osc_sequence(void **state)
+{
+    char text[] = "before\x1b]0;new title\x07 middle\x1b]8;;http://example.com\x1b\\ after";
+
+    sanitise_text(text);
+
+    assert_string_equal("before middle after", text);
+}
+
+void sanitise_text_drops_control_characters(void **state)
+{
+    char text[] = "bell\x07 back\x08space\x7f done\r";
+
+    int result = sanitise_text(text);
+
+    assert_true(result & SANITISE_CHANGED);
+    assert_string_equal("bell backspace done", text);
+}
+
+void sanitise_text_keeps_valid_utf8(void **state)
+{
+    char text[] = "caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80";
+
+    int result = sanitise_text(text);
+
+    assert_int_equal(0, result);
+    assert_string_equal("caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80", text);
+}
+
+void sanitise_text_replaces_invalid_utf8(void **state)
+{
+    char text[] = "bad \xff byte and truncated \xe6\x97";
+
+    int result = sanitise_text(text);
+
+    assert_true(result & SANITISE_CHANGED);
+    assert_string_equal("bad ? byte and truncated ??", text);
+}
+
+void sanitise_text_replaces_overlong_and_surrogates(void **state)
+{
+    char text[] = "\xc0\xaf \xed\xa0\x80 \xf4\x90\x80\x80";
+
+    sanitise_text(text);
+
+    assert_true(g_utf8_validate(text, -1, NULL));
+    assert_null(strchr(text, '\xc0'));
+    assert_null(strchr(text, '\xed'));
+    assert_null(strchr(text, '\xf4'));
+}
+
+void sanitise_text_drops_c1_controls(void **state)
+{
+    char text[] = "csi\xc2\x9b" "31m here \xc2\xa0nbsp";
+
+    int result = sanitise_text(text);
+
+    assert_true(result & SANITISE_CHANGED);
+    assert_string_equal("csi31m here \xc2\xa0nbsp", text);
+}
@@ -0,0 +1,9 @@
+void sanitise_text_printable_ascii_unchanged(void **state);
+void sanitise_text_keeps_newlines_and_tabs(void **state);
+void sanitise_text_strips_csi_sequence(void **state);
+void sanitise_text_strips_osc_sequence(void **state);
+void sanitise_text_drops_control_characters(void **state);
+void sanitise_text_keeps_valid_utf8(void **state);
+void sanitise_text_replaces_invalid_utf8(void **state);
+void sanitise_text_replaces_overlong_and_surrogates(void **state);
+void sanitise_text_drops_c1_controls(void **state);
@@ -27,6 +27,7 @@ void console_shows_online_presence_when_set_online(void **state)
     expect_value(ui_contact_online, last_activity, NULL);
 
     sv_ev_contact_online(barejid, resource, NULL, NULL);
+    sv_ev_flush();
 
     roster_clear();
 }
@@ -44,6 +45,7 @@ void console_shows_online_presence_when_set_all(void **state)
     expect_value(ui_contact_online, last_activity, NULL);
 
     sv_ev_contact_online(barejid, resource, NULL, NULL);
+    sv_ev_flush();
 
     roster_clear();
 }
@@ -61,6 +63,28 @@ void console_shows_dnd_presence_when_set_all(void **state)
     expect_value(ui_contact_online, last_activity, NULL);
 
     sv_ev_contact_online(barejid, resource, NULL, NULL);
+    sv_ev_flush();
+
+    roster_clear();
+}
+
+void console_shows_latest_presence_once_per_flush(void **state)
+{
+    prefs_set_string(PREF_STATUSES_CONSOLE, "all");
+    roster_init();
+    char *barejid = "test1@server";
+    roster_add(barejid, "bob", NULL, "both", FALSE);
+    Resource *away = resource_new("resource", RESOURCE_AWAY, NULL, 10);
+    Resource *online = resource_new("resource", RESOURCE_ONLINE, NULL, 10);
+
+    sv_ev_contact_online(barejid, away, NULL, NULL);
+    sv_ev_contact_online(barejid, online, NULL, NULL);
+
+    expect_memory(ui_contact_online, barejid, barejid, sizeof(barejid));
+    expect_memory(ui_contact_online, resource, online, sizeof(online));
+    expect_value(ui_contact_online, last_activity, NULL);
+
+    sv_ev_flush();
 
     roster_clear();
 }
@@ -76,6 +100,7 @@ void handle_offline_removes_chat_session(void **state)
     roster_update_presence(barejid, resourcep, NULL);
     chat_session_recipient_active(barejid, resource, FALSE);
     sv_ev_contact_offline(barejid, resource, NULL);
+    sv_ev_flush();
     ChatSession *session = chat_session_get(barejid);
 
     assert_null(session);
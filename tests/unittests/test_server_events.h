@@ -4,6 +4,7 @@ void console_shows_online_presence_when_set_all(void **state);
 void console_doesnt_show_dnd_presence_when_set_none(void **state);
 void console_doesnt_show_dnd_presence_when_set_online(void **state);
 void console_shows_dnd_presence_when_set_all(void **state);
+void console_shows_latest_presence_once_per_flush(void **state);
 void handle_message_error_when_no_recipient(void **state);
 void handle_message_error_when_recipient_cancel(void **state);
 void handle_message_error_when_recipient_cancel_disables_chat_session(void **state);
@@ -0,0 +1,168 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "xmpp/stanza.h"
+#include "tools/arena.h"
+
+static xmpp_ctx_t *ctx = NULL;
+
+void init_stanza(void **state)
+{
+    ctx = xmpp_ctx_new(NULL, NULL);
+}
+
+void close_stanza(void **state)
+{
+    xmpp_ctx_free(ctx);
+    ctx = NULL;
+}
+
+static xmpp_stanza_t*
+_stanza(const char *const name)
+{
+    xmpp_stanza_t *stanza = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(stanza, name);
+
+    return stanza;
+}
+
+// the parent keeps the only reference
+static xmpp_stanza_t*
+_child(xmpp_stanza_t *const parent, const char *const name, const char *const ns)
+{
+    xmpp_stanza_t *child = _stanza(name);
+    if (ns) {
+        xmpp_stanza_set_ns(child, ns);
+    }
+    xmpp_stanza_add_child(parent, child);
+    xmpp_stanza_release(child);
+
+    return child;
+}
+
+void stanza_decode_finds_message_children(void **state)
+{
+    xmpp_stanza_t *message = _stanza(STANZA_NAME_MESSAGE);
+    xmpp_stanza_set_id(message, "id1");
+    xmpp_stanza_t *body = _child(message, STANZA_NAME_BODY, NULL);
+    _child(message, STANZA_NAME_COMPOSING, STANZA_NS_CHATSTATES);
+    xmpp_stanza_t *receipt = _child(message, "request", STANZA_NS_RECEIPTS);
+    xmpp_stanza_t *delay = _child(message, STANZA_NAME_DELAY, "urn:xmpp:delay");
+    xmpp_stanza_set_attribute(delay, STANZA_ATTR_STAMP, "2015-12-19T23:55:25Z");
+    xmpp_stanza_t *origin_id = _child(message, STANZA_NAME_ORIGIN_ID, STANZA_NS_STABLE_ID);
+    xmpp_stanza_set_attribute(origin_id, STANZA_ATTR_ID, "origin1");
+
+    StanzaChildren children;
+    stanza_decode(message, &children);
+
+    assert_ptr_equal(body, children.body);
+    assert_string_equal("composing", children.chat_state);
+    assert_ptr_equal(receipt, children.receipt);
+    assert_ptr_equal(delay, children.delay);
+    assert_null(children.subject);
+    assert_null(children.muc_user);
+    assert_string_equal("origin1", stanza_decoded_message_id(message, &children));
+
+    GDateTime *timestamp = stanza_decoded_delay(&children);
+    assert_non_null(timestamp);
+    g_date_time_unref(timestamp);
+
+    xmpp_stanza_release(message);
+}
+
+void stanza_decode_finds_presence_children(void **state)
+{
+    xmpp_stanza_t *presence = _stanza(STANZA_NAME_PRESENCE);
+    xmpp_stanza_t *show = _child(presence, STANZA_NAME_SHOW, NULL);
+    xmpp_stanza_t *status = _child(presence, STANZA_NAME_STATUS, NULL);
+    xmpp_stanza_t *priority = _child(presence, STANZA_NAME_PRIORITY, NULL);
+    xmpp_stanza_t *c = _child(presence, STANZA_NAME_C, STANZA_NS_CAPS);
+    xmpp_stanza_set_attribute(c, STANZA_ATTR_HASH, "sha-1");
+    xmpp_stanza_set_attribute(c, STANZA_ATTR_NODE, "http://profanity-im.github.io");
+    xmpp_stanza_set_attribute(c, STANZA_ATTR_VER, "ver1");
+
+    StanzaChildren children;
+    stanza_decode(presence, &children);
+
+    assert_ptr_equal(show, children.show);
+    assert_ptr_equal(status, children.status);
+    assert_ptr_equal(priority, children.priority);
+    assert_ptr_equal(c, children.caps);
+    assert_null(children.body);
+    assert_null(children.chat_state);
+
+    arena_begin();
+    XMPPCaps *caps = stanza_decoded_caps(&children);
+    assert_string_equal("sha-1", caps->hash);
+    assert_string_equal("http://profanity-im.github.io", caps->node);
+    assert_string_equal("ver1", caps->ver);
+    arena_end();
+
+    xmpp_stanza_release(presence);
+}
+
+void stanza_decode_collects_muc_user_children(void **state)
+{
+    xmpp_stanza_t *presence = _stanza(STANZA_NAME_PRESENCE);
+    xmpp_stanza_t *x = _child(presence, STANZA_NAME_X, STANZA_NS_MUC_USER);
+    xmpp_stanza_t *item = _child(x, STANZA_NAME_ITEM, NULL);
+    xmpp_stanza_t *status = _child(x, STANZA_NAME_STATUS, NULL);
+    xmpp_stanza_set_attribute(status, STANZA_ATTR_CODE, "110");
+    status = _child(x, STANZA_NAME_STATUS, NULL);
+    xmpp_stanza_set_attribute(status, STANZA_ATTR_CODE, "201");
+
+    StanzaChildren children;
+    stanza_decode(presence, &children);
+
+    assert_ptr_equal(x, children.muc_user);
+    assert_ptr_equal(item, children.muc_item);
+    assert_int_equal(2, children.muc_status_count);
+    assert_true(stanza_decoded_has_status_code(&children, "110"));
+    assert_true(stanza_decoded_has_status_code(&children, "201"));
+    assert_false(stanza_decoded_has_status_code(&children, "303"));
+
+    xmpp_stanza_release(presence);
+}
+
+void stanza_decode_keeps_first_of_each_child(void **state)
+{
+    xmpp_stanza_t *message = _stanza(STANZA_NAME_MESSAGE);
+    xmpp_stanza_t *body = _child(message, STANZA_NAME_BODY, NULL);
+    _child(message, STANZA_NAME_BODY, NULL);
+    _child(message, STANZA_NAME_ACTIVE, STANZA_NS_CHATSTATES);
+    _child(message, STANZA_NAME_PAUSED, STANZA_NS_CHATSTATES);
+
+    StanzaChildren children;
+    stanza_decode(message, &children);
+
+    assert_ptr_equal(body, children.body);
+    assert_string_equal("active", children.chat_state);
+
+    xmpp_stanza_release(message);
+}
+
+void stanza_decode_ignores_unknown_children(void **state)
+{
+    xmpp_stanza_t *message = _stanza(STANZA_NAME_MESSAGE);
+    xmpp_stanza_set_id(message, "id1");
+    _child(message, "thread", NULL);
+    _child(message, "x", "urn:example:unknown");
+
+    StanzaChildren children;
+    stanza_decode(message, &children);
+
+    assert_null(children.body);
+    assert_null(children.chat_state);
+    assert_null(children.receipt);
+    assert_null(children.delay);
+    assert_null(children.muc_user);
+    assert_int_equal(0, children.muc_status_count);
+    assert_string_equal("id1", stanza_decoded_message_id(message, &children));
+    assert_null(stanza_decoded_delay(&children));
+
+    xmpp_stanza_release(message);
+}
@@ -0,0 +1,7 @@
+void init_stanza(void **state);
+void close_stanza(void **state);
+void stanza_decode_finds_message_children(void **state);
+void stanza_decode_finds_presence_children(void **state);
+void stanza_decode_collects_muc_user_children(void **state);
+void stanza_decode_keeps_first_of_each_child(void **state);
+void stanza_decode_ignores_unknown_children(void **state);
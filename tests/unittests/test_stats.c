@@ -0,0 +1,124 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tools/autocomplete.h"
+#include "tools/stats.h"
+
+static gchar*
+_report(gboolean histograms)
+{
+    GString *report = g_string_new("");
+    stats_report(report, histograms);
+    return g_string_free(report, FALSE);
+}
+
+void init_stats(void **state)
+{
+    stats_reset();
+}
+
+void remove_stats(void **state)
+{
+    stats_reset();
+}
+
+void stats_report_is_header_only_when_nothing_recorded(void **state)
+{
+    gchar *report = _report(TRUE);
+
+    assert_true(g_str_has_prefix(report, "stat "));
+    assert_true(strchr(report, '\n') == report + strlen(report) - 1);
+
+    g_free(report);
+}
+
+void stats_record_counts_in_bucket(void **state)
+{
+    stats_record(STATS_WIN_PRINT, stats_start() - 3000);
+    stats_record(STATS_WIN_PRINT, stats_start() - 3000);
+
+    gchar *report = _report(TRUE);
+
+    assert_true(strstr(report, "\nwin.print ") != NULL);
+    assert_true(strstr(report, " <4096us:2\n") != NULL);
+    assert_true(strstr(report, "win.redraw") == NULL);
+
+    g_free(report);
+}
+
+void stats_reset_clears_recorded(void **state)
+{
+    stats_record(STATS_LOG_WRITE, stats_start());
+    stats_reset();
+
+    gchar *report = _report(FALSE);
+
+    assert_true(strstr(report, "log.write") == NULL);
+
+    g_free(report);
+}
+
+// live count and bytes for a tag, from its line of the memory report
+static void
+_live(const char *const tag, gint64 *count, gint64 *bytes)
+{
+    GString *report = g_string_new("");
+    stats_memory_report(report);
+
+    gchar *prefix = g_strdup_printf("\n%s ", tag);
+    char *line = strstr(report->str, prefix);
+    assert_true(line != NULL);
+    assert_int_equal(2, sscanf(line + strlen(prefix), "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT, count, bytes));
+
+    g_free(prefix);
+    g_string_free(report, TRUE);
+}
+
+void stats_memory_counts_live_allocations(void **state)
+{
+    gint64 count, bytes;
+    _live("occupant", &count, &bytes);
+
+    stats_alloc(STATS_MEM_OCCUPANT, 100);
+    stats_alloc(STATS_MEM_OCCUPANT, 20);
+
+    gint64 after_count, after_bytes;
+    _live("occupant", &after_count, &after_bytes);
+    assert_true(after_count == count + 2);
+    assert_true(after_bytes == bytes + 120);
+
+    stats_free(STATS_MEM_OCCUPANT, 100);
+    stats_free(STATS_MEM_OCCUPANT, 20);
+
+    _live("occupant", &after_count, &after_bytes);
+    assert_true(after_count == count);
+    assert_true(after_bytes == bytes);
+}
+
+void stats_memory_autocomplete_items_returned(void **state)
+{
+    gint64 count, bytes;
+    _live("autocomplete", &count, &bytes);
+
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "alice");
+    autocomplete_add(ac, "bob");
+
+    gint64 after_count, after_bytes;
+    _live("autocomplete", &after_count, &after_bytes);
+    assert_true(after_count == count + 2);
+    assert_true(after_bytes == bytes + 10);
+
+    autocomplete_remove(ac, "bob");
+    autocomplete_free(ac);
+
+    _live("autocomplete", &after_count, &after_bytes);
+    assert_true(after_count == count);
+    assert_true(after_bytes == bytes);
+}
@@ -0,0 +1,7 @@
+void init_stats(void **state);
+void remove_stats(void **state);
+void stats_report_is_header_only_when_nothing_recorded(void **state);
+void stats_record_counts_in_bucket(void **state);
+void stats_reset_clears_recorded(void **state);
+void stats_memory_counts_live_allocations(void **state);
+void stats_memory_autocomplete_items_returned(void **state);
@@ -0,0 +1,106 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "config/tlscerts.h"
+
+#define TLSCERTS_FILE "./tests/files/xdg_data_home/profanity/tlscerts"
+
+static void
+_add(const char *const fingerprint, const char *const commonname)
+{
+    char *subjectname = g_strdup_printf("/C=GB/CN=%s", commonname);
+    TLSCertificate *cert = tlscerts_new(fingerprint, 3, "1234", subjectname, "/C=GB/CN=issuer", "start", "end",
+        "rsa", "sha256");
+    tlscerts_add(cert);
+    tlscerts_free(cert);
+    g_free(subjectname);
+}
+
+void init_tlscerts(void **state)
+{
+    create_data_dir(state);
+    tlscerts_init();
+}
+
+void close_tlscerts(void **state)
+{
+    tlscerts_close();
+    remove(TLSCERTS_FILE);
+    remove_data_dir(state);
+    rmdir("./tests/files");
+}
+
+void tlscerts_exists_after_add(void **state)
+{
+    assert_false(tlscerts_exists("AA:BB"));
+
+    _add("AA:BB", "one.example.com");
+
+    assert_true(tlscerts_exists("AA:BB"));
+    assert_false(tlscerts_exists("CC:DD"));
+}
+
+void tlscerts_list_returns_added_in_order(void **state)
+{
+    _add("AA:BB", "one.example.com");
+    _add("CC:DD", "two.example.com");
+
+    GList *certs = tlscerts_list();
+
+    assert_int_equal(2, g_list_length(certs));
+    TLSCertificate *first = certs->data;
+    TLSCertificate *second = certs->next->data;
+    assert_string_equal("AA:BB", first->fingerprint);
+    assert_string_equal("one.example.com", first->subject_commonname);
+    assert_string_equal("CC:DD", second->fingerprint);
+    assert_string_equal("two.example.com", second->subject_commonname);
+}
+
+void tlscerts_revoke_removes_from_list(void **state)
+{
+    _add("AA:BB", "one.example.com");
+    _add("CC:DD", "two.example.com");
+
+    assert_true(tlscerts_revoke("AA:BB"));
+
+    assert_false(tlscerts_exists("AA:BB"));
+    GList *certs = tlscerts_list();
+    assert_int_equal(1, g_list_length(certs));
+    TLSCertificate *cert = certs->data;
+    assert_string_equal("CC:DD", cert->fingerprint);
+}
+
+void tlscerts_add_replaces_same_fingerprint(void **state)
+{
+    _add("AA:BB", "one.example.com");
+    _add("AA:BB", "other.example.com");
+
+    GList *certs = tlscerts_list();
+    assert_int_equal(1, g_list_length(certs));
+    TLSCertificate *cert = certs->data;
+    assert_string_equal("other.example.com", cert->subject_commonname);
+}
+
+void tlscerts_reloaded_after_flush(void **state)
+{
+    _add("AA:BB", "one.example.com");
+    tlscerts_close();
+
+    tlscerts_init();
+
+    assert_true(tlscerts_exists("AA:BB"));
+    GList *certs = tlscerts_list();
+    assert_int_equal(1, g_list_length(certs));
+    TLSCertificate *cert = certs->data;
+    assert_int_equal(3, cert->version);
+    assert_string_equal("one.example.com", cert->subject_commonname);
+    assert_string_equal("issuer", cert->issuer_commonname);
+}
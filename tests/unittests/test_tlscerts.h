@@ -0,0 +1,7 @@
+void init_tlscerts(void **state);
+void close_tlscerts(void **state);
+void tlscerts_exists_after_add(void **state);
+void tlscerts_list_returns_added_in_order(void **state);
+void tlscerts_revoke_removes_from_list(void **state);
+void tlscerts_add_replaces_same_fingerprint(void **state);
+void tlscerts_reloaded_after_flush(void **state);
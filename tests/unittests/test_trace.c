@@ -0,0 +1,52 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tools/trace.h"
+
+void trace_start_is_zero_when_not_tracing(void **state)
+{
+    gint64 start = trace_start();
+    trace_record("ignored", start);
+
+    assert_true(start == 0);
+}
+
+void trace_records_complete_events(void **state)
+{
+    char *path = NULL;
+    int fd = g_file_open_tmp("prof_trace_XXXXXX", &path, NULL);
+    assert_true(fd != -1);
+    close(fd);
+
+    assert_true(trace_open(path));
+    gint64 first = trace_start();
+    assert_true(first != 0);
+    trace_record("first", first);
+    trace_record("second", trace_start());
+    trace_close();
+
+    assert_true(trace_start() == 0);
+
+    char *contents = NULL;
+    assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+    assert_true(g_str_has_prefix(contents, "[\n{\"name\":\"first\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"));
+    assert_non_null(strstr(contents, "},\n{\"name\":\"second\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"));
+    assert_true(g_str_has_suffix(contents, "}\n]\n"));
+
+    g_free(contents);
+    g_unlink(path);
+    g_free(path);
+}
+
+void trace_open_fails_for_bad_path(void **state)
+{
+    assert_false(trace_open("/nonexistent/prof_trace.json"));
+    assert_true(trace_start() == 0);
+}
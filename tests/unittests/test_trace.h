@@ -0,0 +1,3 @@
+void trace_start_is_zero_when_not_tracing(void **state);
+void trace_records_complete_events(void **state);
+void trace_open_fails_for_bad_path(void **state);
@@ -0,0 +1,77 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/traffic.h"
+
+void init_traffic(void **state)
+{
+    traffic_reset();
+}
+
+static gchar*
+_report(int top)
+{
+    GString *report = g_string_new("");
+    traffic_report(report, top);
+    return g_string_free(report, FALSE);
+}
+
+void traffic_counts_received_text(void **state)
+{
+    const char *text = "<message type='chat' from='alice@example.com/laptop'>"
+        "<body>hi</body><active xmlns='http://jabber.org/protocol/chatstates'/></message>";
+    traffic_record_text(TRAFFIC_RECEIVED, text, strlen(text));
+
+    gchar *report = _report(10);
+
+    assert_non_null(strstr(report, "received 1 stanzas"));
+    assert_non_null(strstr(report, "message chat"));
+    assert_non_null(strstr(report, "http://jabber.org/protocol/chatstates"));
+    assert_non_null(strstr(report, "alice@example.com "));
+    assert_null(strstr(report, "laptop"));
+    g_free(report);
+}
+
+void traffic_counts_sent_by_recipient(void **state)
+{
+    traffic_record_text(TRAFFIC_SENT, "<presence to=\"room@conference.example.com/me\"/>", 44);
+    traffic_record(TRAFFIC_SENT, "iq", "get", "jabber:iq:roster", NULL, 60);
+
+    gchar *report = _report(10);
+
+    assert_non_null(strstr(report, "sent 2 stanzas, 104 bytes"));
+    assert_non_null(strstr(report, "room@conference.example.com"));
+    assert_non_null(strstr(report, "server"));
+    assert_non_null(strstr(report, "iq get"));
+    assert_non_null(strstr(report, "none"));
+    g_free(report);
+}
+
+void traffic_report_limits_top(void **state)
+{
+    traffic_record(TRAFFIC_RECEIVED, "message", "chat", NULL, "small@example.com", 10);
+    traffic_record(TRAFFIC_RECEIVED, "message", "chat", NULL, "big@example.com", 1000);
+
+    gchar *report = _report(1);
+
+    assert_non_null(strstr(report, "big@example.com"));
+    assert_null(strstr(report, "small@example.com"));
+    g_free(report);
+}
+
+void traffic_reset_clears_counts(void **state)
+{
+    traffic_record(TRAFFIC_RECEIVED, "message", "chat", NULL, "alice@example.com", 10);
+    traffic_reset();
+
+    gchar *report = _report(10);
+
+    assert_non_null(strstr(report, "received 0 stanzas, 0 bytes"));
+    assert_null(strstr(report, "alice@example.com"));
+    g_free(report);
+}
@@ -0,0 +1,5 @@
+void init_traffic(void **state);
+void traffic_counts_received_text(void **state);
+void traffic_counts_sent_by_recipient(void **state);
+void traffic_report_limits_top(void **state);
+void traffic_reset_clears_counts(void **state);
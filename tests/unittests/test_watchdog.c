@@ -0,0 +1,80 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/watchdog.h"
+
+void init_watchdog(void **state)
+{
+    watchdog_init();
+}
+
+void remove_watchdog(void **state)
+{
+    watchdog_set_threshold(0);
+}
+
+void watchdog_start_is_zero_when_off(void **state)
+{
+    watchdog_set_threshold(0);
+
+    assert_true(watchdog_start() == 0);
+    assert_null(watchdog_describe("command", "/msg", 0));
+}
+
+void watchdog_quick_operation_not_described(void **state)
+{
+    watchdog_set_threshold(10000);
+
+    gint64 start = watchdog_start();
+
+    assert_false(watchdog_exceeded(start));
+    assert_null(watchdog_describe("command", "/msg", start));
+}
+
+void watchdog_slow_operation_described(void **state)
+{
+    watchdog_set_threshold(1);
+
+    gint64 start = watchdog_start();
+    g_usleep(2000);
+
+    assert_true(watchdog_exceeded(start));
+    gchar *description = watchdog_describe("command", "/msg", start);
+    assert_true(g_str_has_prefix(description, "Slow command /msg: "));
+    assert_true(g_str_has_suffix(description, "ms"));
+    g_free(description);
+}
+
+void watchdog_slow_operation_names_tags(void **state)
+{
+    watchdog_set_threshold(1);
+
+    gint64 start = watchdog_start();
+    watchdog_tag(WATCHDOG_DISK);
+    watchdog_tag(WATCHDOG_CURL);
+    g_usleep(2000);
+
+    gchar *description = watchdog_describe("main loop iteration", NULL, start);
+    assert_true(g_str_has_prefix(description, "Slow main loop iteration: "));
+    assert_true(g_str_has_suffix(description, "ms, during disk, curl"));
+    g_free(description);
+}
+
+void watchdog_tag_before_start_not_named(void **state)
+{
+    watchdog_set_threshold(1);
+
+    watchdog_tag(WATCHDOG_GPGME);
+    g_usleep(10);
+    gint64 start = watchdog_start();
+    g_usleep(2000);
+
+    gchar *description = watchdog_describe("timer.prefs_flush", NULL, start);
+    assert_null(strstr(description, "gpgme"));
+    g_free(description);
+}
@@ -0,0 +1,7 @@
+void init_watchdog(void **state);
+void remove_watchdog(void **state);
+void watchdog_start_is_zero_when_off(void **state);
+void watchdog_quick_operation_not_described(void **state);
+void watchdog_slow_operation_described(void **state);
+void watchdog_slow_operation_names_tags(void **state);
+void watchdog_tag_before_start_not_named(void **state);
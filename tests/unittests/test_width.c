@@ -0,0 +1,109 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/width.h"
+
+void width_char_ascii_is_narrow(void **state)
+{
+    assert_int_equal(1, width_char('a'));
+    assert_int_equal(1, width_char(' '));
+}
+
+void width_char_cjk_is_wide(void **state)
+{
+    assert_int_equal(2, width_char(0x56DB));
+    assert_int_equal(2, width_char(0x3072));
+}
+
+void width_char_combining_is_zero(void **state)
+{
+    assert_int_equal(0, width_char(0x0301));
+}
+
+void width_char_agrees_with_glib(void **state)
+{
+    gunichar ch;
+    for (ch = 0x80; ch < 0x30000; ch++) {
+        int expected = g_unichar_iszerowidth(ch) ? 0 : (g_unichar_iswide(ch) ? 2 : 1);
+        assert_int_equal(expected, width_char(ch));
+    }
+}
+
+void width_utf8_char_sets_length(void **state)
+{
+    size_t len = 0;
+
+    assert_int_equal(1, width_utf8_char("a", &len));
+    assert_int_equal(1, len);
+    assert_int_equal(1, width_utf8_char("é", &len));
+    assert_int_equal(2, len);
+    assert_int_equal(2, width_utf8_char("四", &len));
+    assert_int_equal(3, len);
+}
+
+void width_utf8_char_invalid_is_one_byte(void **state)
+{
+    size_t len = 0;
+
+    assert_int_equal(1, width_utf8_char("\xe5\x9b", &len));
+    assert_int_equal(1, len);
+    assert_int_equal(1, width_utf8_char("\x80", &len));
+    assert_int_equal(1, len);
+}
+
+void width_utf8_mixed(void **state)
+{
+    const char *str = "12三四56";
+
+    assert_int_equal(8, width_utf8(str, strlen(str)));
+}
+
+void width_utf8_only_counts_len_bytes(void **state)
+{
+    const char *str = "ab三四";
+
+    assert_int_equal(4, width_utf8(str, 5));
+}
+
+void width_utf8_wide_after_long_ascii(void **state)
+{
+    GString *str = g_string_new("");
+    int i;
+    for (i = 0; i < 70; i++) {
+        g_string_append_c(str, 'x');
+    }
+    g_string_append(str, "四e\xcc\x81");
+
+    assert_int_equal(73, width_utf8(str->str, str->len));
+
+    g_string_free(str, TRUE);
+}
+
+void width_ascii_len_stops_at_first_non_ascii(void **state)
+{
+    int i;
+    for (i = 0; i < 40; i++) {
+        GString *str = g_string_new("");
+        int j;
+        for (j = 0; j < i; j++) {
+            g_string_append_c(str, 'a');
+        }
+        g_string_append(str, "ü and more text that is long enough to fill a vector");
+
+        assert_int_equal(i, width_ascii_len(str->str, str->len));
+
+        g_string_free(str, TRUE);
+    }
+}
+
+void width_ascii_len_all_ascii(void **state)
+{
+    const char *str = "a string of plain ASCII text that is longer than 32 bytes";
+
+    assert_int_equal(strlen(str), width_ascii_len(str, strlen(str)));
+}
@@ -0,0 +1,11 @@
+void width_char_ascii_is_narrow(void **state);
+void width_char_cjk_is_wide(void **state);
+void width_char_combining_is_zero(void **state);
+void width_char_agrees_with_glib(void **state);
+void width_utf8_char_sets_length(void **state);
+void width_utf8_char_invalid_is_one_byte(void **state);
+void width_utf8_mixed(void **state);
+void width_utf8_only_counts_len_bytes(void **state);
+void width_utf8_wide_after_long_ascii(void **state);
+void width_ascii_len_stops_at_first_non_ascii(void **state);
+void width_ascii_len_all_ascii(void **state);
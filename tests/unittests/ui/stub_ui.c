@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <string.h>
 #include <wchar.h>
 
 #include <setjmp.h>
@@ -58,9 +59,18 @@ expect_ui_current_print_formatted_line(char show_char, int attrs, char *message)
 
 // stubs
 
-void ui_init(void) {}
+void ui_init(gboolean headless) {}
+gboolean ui_is_headless(void)
+{
+    return FALSE;
+}
 void ui_load_colours(void) {}
 void ui_update(void) {}
+gboolean ui_render_pending(void)
+{
+    return FALSE;
+}
+void ui_mark_dirty(void) {}
 void ui_close(void) {}
 void ui_redraw(void) {}
 void ui_resize(void) {}
@@ -89,6 +99,8 @@ ProfChatWin* chatwin_new(const char * const barejid)
     return NULL;
 }
 
+void chatwin_display_settings_changed(void) {}
+
 void ui_print_system_msg_from_recipient(const char * const barejid, const char *message) {}
 
 void ui_close_connected_win(int index) {}
@@ -145,7 +157,21 @@ char *ui_get_line(void)
     return NULL;
 }
 
-void xmlwin_show(ProfXMLWin *xmlwin, const char * const msg) {}
+void xmlwin_show(ProfXMLWin *xmlwin, gboolean sent, const char * const text) {}
+void xmlwin_filter_add(const char *const filter)
+{
+    check_expected(filter);
+}
+gboolean xmlwin_filter_remove(const char *const filter)
+{
+    check_expected(filter);
+    return (gboolean)mock();
+}
+void xmlwin_filter_clear(void) {}
+GSList* xmlwin_filter_list(void)
+{
+    return NULL;
+}
 
 // ui events
 void ui_contact_online(char *barejid, Resource *resource, GDateTime *last_activity)
@@ -158,17 +184,30 @@ void ui_contact_online(char *barejid, Resource *resource, GDateTime *last_activi
 void ui_contact_typing(const char * const barejid, const char * const resource) {}
 void chatwin_incoming_msg(ProfChatWin *chatwin, const char * const resource, const char * const message, GDateTime *timestamp, gboolean win_created, prof_enc_t enc_mode) {}
 void chatwin_receipt_received(ProfChatWin *chatwin, const char * const id) {}
+void chatwin_marker_received(ProfChatWin *chatwin, const char * const id) {}
+void chatwin_markable(ProfChatWin *chatwin, const char * const fulljid, const char * const id) {}
+void chatwin_send_marker(ProfChatWin *chatwin) {}
 
 void privwin_incoming_msg(ProfPrivateWin *privatewin, const char * const message, GDateTime *timestamp) {}
 
 void ui_disconnected(void) {}
+void ui_show_progress(const char *const msg) {}
+void ui_clear_progress(void) {}
 void chatwin_recipient_gone(ProfChatWin *chatwin) {}
 
 void chatwin_outgoing_msg(ProfChatWin *chatwin, const char * const message, char *id, prof_enc_t enc_mode) {}
 void chatwin_outgoing_carbon(ProfChatWin *chatwin, const char * const message) {}
+void chatwin_outgoing_pending(ProfChatWin *chatwin, const char * const message, const char * const id,
+    prof_enc_t enc_mode) {}
+void chatwin_outgoing_queued(ProfChatWin *chatwin, const char * const message, const char * const id) {}
+int chatwin_history_page(ProfChatWin *chatwin, GSList *messages)
+{
+    return 0;
+}
 void privwin_outgoing_msg(ProfPrivateWin *privwin, const char * const message) {}
 
 void ui_room_join(const char * const roomjid, gboolean focus) {}
+void ui_rooms_autojoined(GSList *roomjids) {}
 void ui_switch_to_room(const char * const roomjid) {}
 
 void mucwin_role_change(ProfMucWin *mucwin, const char * const role, const char * const actor,
@@ -185,7 +224,22 @@ void mucwin_occupant_role_and_affiliation_change(ProfMucWin *mucwin, const char
     const char * const affiliation, const char * const actor, const char * const reason) {}
 void mucwin_roster(ProfMucWin *mucwin, GList *occupants, const char * const presence) {}
 void mucwin_history(ProfMucWin *mucwin, const char * const nick, GDateTime *timestamp, const char * const message) {}
+int mucwin_history_page(ProfMucWin *mucwin, GSList *messages)
+{
+    return 0;
+}
 void mucwin_message(ProfMucWin *mucwin, const char * const nick, const char * const message) {}
+void mucwin_mention_settings_changed(void) {}
+room_policy_t mucwin_policy_from_name(const char *const name)
+{
+    return ROOM_POLICY_LIVE;
+}
+const char* mucwin_policy_name(room_policy_t policy)
+{
+    return NULL;
+}
+void mucwin_set_policy(ProfMucWin *mucwin, room_policy_t policy) {}
+void mucwin_digest(ProfMucWin *mucwin) {}
 void mucwin_subject(ProfMucWin *mucwin, const char * const nick, const char * const subject) {}
 void mucwin_requires_config(ProfMucWin *mucwin) {}
 void ui_room_destroy(const char * const roomjid) {}
@@ -285,6 +339,7 @@ char* inp_readline(void)
 }
 
 void inp_nonblocking(gboolean reset) {}
+void inp_history_load(const char *const account_name) {}
 
 void ui_inp_history_append(char *inp) {}
 
@@ -359,6 +414,7 @@ cons_bad_cmd_usage(const char * const cmd)
 
 void cons_show_roster_group(const char * const group, GSList * list) {}
 void cons_show_wins(void) {}
+void cons_show_wins_stats(void) {}
 void cons_show_status(const char * const barejid) {}
 void cons_show_info(PContact pcontact) {}
 void cons_show_caps(const char * const fulljid, resource_presence_t presence) {}
@@ -381,14 +437,19 @@ void cons_show_account_list(gchar **accounts)
     check_expected(accounts);
 }
 
-void cons_show_room_list(GSList *room, const char * const conference_node) {}
+void cons_show_room_list(GSList *rooms, const char * const conference_node, int shown) {}
+void cons_show_room_list_end(const char * const conference_node, const char * const filter, int shown,
+    gboolean truncated) {}
 
 void cons_show_bookmarks(const GList *list)
 {
     check_expected(list);
 }
 
-void cons_show_disco_items(GSList *items, const char * const jid) {}
+void cons_show_history_search(const char *const query, GSList *matches) {}
+
+void cons_show_disco_items(GSList *items, const char * const jid, int shown) {}
+void cons_show_disco_items_end(const char * const jid, int shown, gboolean truncated) {}
 void cons_show_disco_info(const char *from, GSList *identities, GSList *features) {}
 void cons_show_room_invite(const char * const invitor, const char * const room,
     const char * const reason) {}
@@ -399,10 +460,13 @@ void cons_show_room_invites(GSList *invites) {}
 void cons_show_received_subs(void) {}
 void cons_show_sent_subs(void) {}
 void cons_alert(void) {}
+void cons_batch_begin(void) {}
+void cons_batch_end(void) {}
 void cons_theme_setting(void) {}
 void cons_privileges_setting(void) {}
 void cons_beep_setting(void) {}
 void cons_flash_setting(void) {}
+void cons_fuzzy_setting(void) {}
 void cons_splash_setting(void) {}
 void cons_vercheck_setting(void) {}
 void cons_resource_setting(void) {}
@@ -423,6 +487,8 @@ void cons_intype_setting(void) {}
 void cons_gone_setting(void) {}
 void cons_history_setting(void) {}
 void cons_carbons_setting(void) {}
+void cons_sm_setting(void) {}
+void cons_csi_setting(void) {}
 void cons_receipts_setting(void) {}
 void cons_log_setting(void) {}
 void cons_chlog_setting(void) {}
@@ -455,9 +521,15 @@ void status_bar_set_all_inactive(void) {}
 
 // roster window
 void rosterwin_roster(void) {}
+void rosterwin_draw_pending(void) {}
+
+void snapshot_save(void) {}
+void snapshot_restore(const char *const account_name) {}
+void snapshot_clear(void) {}
 
 // occupants window
 void occupantswin_occupants(const char * const room) {}
+void occupantswin_draw_pending(void) {}
 
 // window interface
 ProfWin* win_create_console(void)
@@ -486,6 +558,10 @@ ProfWin* win_create_private(const char * const fulljid)
 }
 
 void win_update_virtual(ProfWin *window) {}
+gboolean win_render_held(ProfWin *window)
+{
+    return FALSE;
+}
 void win_free(ProfWin *window) {}
 int win_unread(ProfWin *window)
 {
@@ -493,6 +569,19 @@ int win_unread(ProfWin *window)
 }
 
 void win_resize(ProfWin *window) {}
+void win_mark_stale(ProfWin *window) {}
+void win_hibernate(ProfWin *window) {}
+void win_wake(ProfWin *window) {}
+gboolean win_is_hibernated(ProfWin *window)
+{
+    return FALSE;
+}
+void win_usage(ProfWin *window, ProfWinUsage *usage)
+{
+    memset(usage, 0, sizeof(ProfWinUsage));
+}
+void win_usage_sample(ProfWin *window) {}
+void win_resize_if_stale(ProfWin *window) {}
 void win_hide_subwin(ProfWin *window) {}
 void win_show_subwin(ProfWin *window) {}
 void win_refresh_without_subwin(ProfWin *window) {}
@@ -510,6 +599,15 @@ void win_show_info(ProfWin *window, PContact contact) {}
 void win_println(ProfWin *window, int pad, const char * const message) {}
 void win_vprintln_ch(ProfWin *window, char ch, const char *const message, ...) {}
 void win_clear(ProfWin *window) {}
+gboolean win_search(ProfWin *window, const char *const query, gboolean older)
+{
+    return FALSE;
+}
+const char* win_search_query(ProfWin *window)
+{
+    return NULL;
+}
+void win_search_clear(ProfWin *window) {}
 
 // desktop notifier actions
 void notifier_uninit(void) {}
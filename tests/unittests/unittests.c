@@ -12,7 +12,32 @@
 
 #include "helpers.h"
 #include "test_autocomplete.h"
+#include "test_history_index.h"
+#include "test_input_history.h"
+#include "test_perf.h"
+#include "test_stats.h"
+#include "test_tlscerts.h"
+#include "test_bookmarkcache.h"
+#include "test_rostercache.h"
+#include "test_trace.h"
+#include "test_watchdog.h"
+#include "test_traffic.h"
+#include "test_dedup.h"
+#include "test_result_cache.h"
+#include "test_request_queue.h"
+#include "test_log_filter.h"
+#include "test_stanza.h"
+#include "test_ipc.h"
+#include "test_arena.h"
+#include "test_highlight.h"
+#include "test_width.h"
+#include "test_sanitise.h"
+#include "test_binlog.h"
+#include "test_log_retention.h"
+#include "test_log_export.h"
+#include "test_buffer.h"
 #include "test_chat_session.h"
+#include "test_chat_state.h"
 #include "test_common.h"
 #include "test_contact.h"
 #include "test_cmd_connect.h"
@@ -28,12 +53,15 @@
 #include "test_preferences.h"
 #include "test_server_events.h"
 #include "test_cmd_alias.h"
+#include "test_cmd_help.h"
 #include "test_cmd_bookmark.h"
 #include "test_cmd_join.h"
+#include "test_cmd_sendfile.h"
 #include "test_muc.h"
 #include "test_cmd_roster.h"
 #include "test_cmd_disconnect.h"
 #include "test_form.h"
+#include "test_cmd_xmlconsole.h"
 
 int main(int argc, char* argv[]) {
     const UnitTest all_tests[] = {
@@ -85,6 +113,8 @@ int main(int argc, char* argv[]) {
         unit_test(test_p_sha1_hash5),
         unit_test(test_p_sha1_hash6),
         unit_test(test_p_sha1_hash7),
+        unit_test(test_p_sha1_portable_matches_accelerated),
+        unit_test(test_p_sha1_hash_leaves_input_unchanged),
         unit_test(utf8_display_len_null_str),
         unit_test(utf8_display_len_1_non_wide),
         unit_test(utf8_display_len_1_wide),
@@ -103,6 +133,11 @@ int main(int argc, char* argv[]) {
         unit_test(str_empty_not_contains_str),
         unit_test(str_not_contains_str_empty),
         unit_test(str_empty_not_contains_str_empty),
+        unit_test(str_intern_returns_same_pointer),
+        unit_test(str_unintern_frees_after_last_user),
+        unit_test(file_stamp_unchanged_when_missing),
+        unit_test(file_stamp_changed_after_write),
+        unit_test(file_stamp_changed_when_removed),
 
         unit_test(clear_empty),
         unit_test(reset_after_create),
@@ -114,6 +149,373 @@ int main(int argc, char* argv[]) {
         unit_test(add_two_adds_two),
         unit_test(add_two_same_adds_one),
         unit_test(add_two_same_updates),
+        unit_test(add_out_of_order_lists_sorted),
+        unit_test(complete_cycles_back_to_first),
+        unit_test(contains_after_remove_returns_false),
+        unit_test(complete_after_adding_before_last_found_returns_next),
+        unit_test(add_all_sorts_and_removes_duplicates),
+        unit_test(add_all_then_complete),
+        unit_test(fuzzy_complete_matches_subsequence),
+        unit_test(fuzzy_complete_ranks_best_match_first),
+        unit_test(fuzzy_complete_ignores_case),
+        unit_test(fuzzy_complete_ranks_touched_higher),
+        unit_test(fuzzy_complete_quotes_items_with_spaces),
+        unit_test(fuzzy_complete_sees_items_added_since_last_search),
+        unit_test(static_complete_cycles_through_items),
+        unit_test(static_ignores_changes),
+
+        unit_test_setup_teardown(search_empty_index_returns_null,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(search_finds_added_line,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(search_requires_every_word,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(search_ignores_case,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(search_finds_lines_after_reopen,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(add_indexes_earlier_lines_in_file,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(scan_indexes_existing_logs,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(rename_keeps_lines_under_new_path,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(scan_reindexes_replaced_log,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(search_returns_newest_by_log_time,
+            init_history_index_dir,
+            remove_history_index_dir),
+        unit_test_setup_teardown(open_drops_index_of_other_version,
+            init_history_index_dir,
+            remove_history_index_dir),
+
+        unit_test_setup_teardown(percentiles_are_zero_without_samples,
+            init_perf_samples,
+            remove_perf_samples),
+        unit_test_setup_teardown(record_ignored_when_disabled,
+            init_perf_samples,
+            remove_perf_samples),
+        unit_test_setup_teardown(percentiles_use_nearest_rank,
+            init_perf_samples,
+            remove_perf_samples),
+
+        unit_test_setup_teardown(stats_report_is_header_only_when_nothing_recorded,
+            init_stats,
+            remove_stats),
+#ifdef HAVE_STATS
+        unit_test_setup_teardown(stats_record_counts_in_bucket,
+            init_stats,
+            remove_stats),
+        unit_test_setup_teardown(stats_reset_clears_recorded,
+            init_stats,
+            remove_stats),
+#endif
+#ifdef HAVE_ALLOC_STATS
+        unit_test(stats_memory_counts_live_allocations),
+        unit_test(stats_memory_autocomplete_items_returned),
+#endif
+
+        unit_test_setup_teardown(tlscerts_exists_after_add,
+            init_tlscerts,
+            close_tlscerts),
+        unit_test_setup_teardown(tlscerts_list_returns_added_in_order,
+            init_tlscerts,
+            close_tlscerts),
+        unit_test_setup_teardown(tlscerts_revoke_removes_from_list,
+            init_tlscerts,
+            close_tlscerts),
+        unit_test_setup_teardown(tlscerts_add_replaces_same_fingerprint,
+            init_tlscerts,
+            close_tlscerts),
+        unit_test_setup_teardown(tlscerts_reloaded_after_flush,
+            init_tlscerts,
+            close_tlscerts),
+
+        unit_test_setup_teardown(bookmarkcache_load_without_file_returns_null,
+            init_bookmarkcache,
+            close_bookmarkcache),
+        unit_test_setup_teardown(bookmarkcache_load_returns_saved,
+            init_bookmarkcache,
+            close_bookmarkcache),
+        unit_test_setup_teardown(bookmarkcache_save_replaces_previous,
+            init_bookmarkcache,
+            close_bookmarkcache),
+        unit_test_setup_teardown(bookmarkcache_not_saved_after_disconnect,
+            init_bookmarkcache,
+            close_bookmarkcache),
+        unit_test_setup_teardown(bookmarkcache_autojoin_dropped_returns_removed_and_not_autojoined,
+            init_bookmarkcache,
+            close_bookmarkcache),
+        unit_test_setup_teardown(bookmarkcache_autojoin_dropped_empty_when_all_kept,
+            init_bookmarkcache,
+            close_bookmarkcache),
+
+        unit_test_setup_teardown(rostercache_load_without_version_returns_false,
+            init_rostercache,
+            close_rostercache),
+        unit_test_setup_teardown(rostercache_load_adds_saved_contacts,
+            init_rostercache,
+            close_rostercache),
+        unit_test_setup_teardown(rostercache_no_version_invalidates_cache,
+            init_rostercache,
+            close_rostercache),
+        unit_test_setup_teardown(rostercache_remove_drops_contact,
+            init_rostercache,
+            close_rostercache),
+        unit_test_setup_teardown(rostercache_clear_drops_contacts_and_version,
+            init_rostercache,
+            close_rostercache),
+        unit_test_setup_teardown(rostercache_not_saved_after_disconnect,
+            init_rostercache,
+            close_rostercache),
+
+        unit_test(trace_start_is_zero_when_not_tracing),
+        unit_test(trace_records_complete_events),
+        unit_test(trace_open_fails_for_bad_path),
+
+        unit_test_setup_teardown(watchdog_start_is_zero_when_off,
+            init_watchdog,
+            remove_watchdog),
+        unit_test_setup_teardown(watchdog_quick_operation_not_described,
+            init_watchdog,
+            remove_watchdog),
+        unit_test_setup_teardown(watchdog_slow_operation_described,
+            init_watchdog,
+            remove_watchdog),
+        unit_test_setup_teardown(watchdog_slow_operation_names_tags,
+            init_watchdog,
+            remove_watchdog),
+        unit_test_setup_teardown(watchdog_tag_before_start_not_named,
+            init_watchdog,
+            remove_watchdog),
+
+        unit_test_setup_teardown(traffic_counts_received_text,
+            init_traffic,
+            init_traffic),
+        unit_test_setup_teardown(traffic_counts_sent_by_recipient,
+            init_traffic,
+            init_traffic),
+        unit_test_setup_teardown(traffic_report_limits_top,
+            init_traffic,
+            init_traffic),
+        unit_test_setup_teardown(traffic_reset_clears_counts,
+            init_traffic,
+            init_traffic),
+
+        unit_test(dedup_drops_key_seen_again),
+        unit_test(dedup_forgets_key_after_max_age),
+        unit_test(dedup_evicts_least_recently_seen),
+        unit_test(dedup_contains_does_not_record_key),
+
+        unit_test(result_cache_returns_added_result),
+        unit_test(result_cache_drops_result_after_max_age),
+        unit_test(result_cache_drops_result_when_tag_changes),
+        unit_test(result_cache_add_replaces_result),
+        unit_test(result_cache_remove_forgets_only_that_jid),
+
+        unit_test(request_queue_sends_up_to_parallel),
+        unit_test(request_queue_done_sends_next_in_order),
+        unit_test(request_queue_done_when_idle_stays_at_zero),
+        unit_test(request_queue_clear_frees_waiting),
+
+        unit_test(log_filter_uses_own_level),
+        unit_test(log_filter_samples_one_in_n),
+        unit_test(log_filter_rate_limits_per_second),
+        unit_test(log_filter_always_admits_warnings),
+        unit_test(log_filter_rejects_bad_settings),
+        unit_test(log_filter_spec_round_trips),
+
+        unit_test_setup_teardown(stanza_decode_finds_message_children,
+            init_stanza,
+            close_stanza),
+        unit_test_setup_teardown(stanza_decode_finds_presence_children,
+            init_stanza,
+            close_stanza),
+        unit_test_setup_teardown(stanza_decode_collects_muc_user_children,
+            init_stanza,
+            close_stanza),
+        unit_test_setup_teardown(stanza_decode_keeps_first_of_each_child,
+            init_stanza,
+            close_stanza),
+        unit_test_setup_teardown(stanza_decode_ignores_unknown_children,
+            init_stanza,
+            close_stanza),
+
+        unit_test_setup_teardown(ipc_sends_no_events_without_request,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_sends_requested_events,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_filters_events_per_client,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_withholds_decrypted_body_unless_requested,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_replies_error_to_unknown_request,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_removes_socket_on_close,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_gives_listened_events_to_listeners,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_gives_decrypted_body_to_listeners_asking,
+            init_ipc,
+            close_ipc),
+        unit_test_setup_teardown(ipc_listener_can_unlisten_itself,
+            init_ipc,
+            close_ipc),
+
+        unit_test(arena_allocations_are_aligned),
+        unit_test(arena_strdup_copies),
+        unit_test(arena_released_when_outermost_scope_ends),
+        unit_test(arena_large_allocation_gets_own_block),
+
+        unit_test(highlight_matches_any_word),
+        unit_test(highlight_matches_overlapping_words),
+        unit_test(highlight_case_insensitive),
+        unit_test(highlight_case_sensitive),
+        unit_test(highlight_whole_word),
+        unit_test(highlight_whole_word_utf8),
+        unit_test(highlight_empty_matches_nothing),
+
+        unit_test(width_char_ascii_is_narrow),
+        unit_test(width_char_cjk_is_wide),
+        unit_test(width_char_combining_is_zero),
+        unit_test(width_char_agrees_with_glib),
+        unit_test(width_utf8_char_sets_length),
+        unit_test(width_utf8_char_invalid_is_one_byte),
+        unit_test(width_utf8_mixed),
+        unit_test(width_utf8_only_counts_len_bytes),
+        unit_test(width_utf8_wide_after_long_ascii),
+        unit_test(width_ascii_len_stops_at_first_non_ascii),
+        unit_test(width_ascii_len_all_ascii),
+
+        unit_test(sanitise_text_printable_ascii_unchanged),
+        unit_test(sanitise_text_keeps_newlines_and_tabs),
+        unit_test(sanitise_text_strips_csi_sequence),
+        unit_test(sanitise_text_strips_osc_sequence),
+        unit_test(sanitise_text_drops_control_characters),
+        unit_test(sanitise_text_keeps_valid_utf8),
+        unit_test(sanitise_text_replaces_invalid_utf8),
+        unit_test(sanitise_text_replaces_overlong_and_surrogates),
+        unit_test(sanitise_text_drops_c1_controls),
+
+        unit_test_setup_teardown(add_then_get_returns_lines,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(add_skips_repeated_and_empty_lines,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(open_loads_stored_lines,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(open_ignores_partial_last_line,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(open_creates_file_private,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(add_skips_secret_commands,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(search_finds_newest_match,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(search_before_finds_older_match,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(search_without_match_returns_minus_one,
+            init_input_history_dir,
+            remove_input_history_dir),
+        unit_test_setup_teardown(search_finds_lines_added_after_search,
+            init_input_history_dir,
+            remove_input_history_dir),
+
+        unit_test(encode_then_decode_message),
+        unit_test(encode_then_decode_receipt),
+        unit_test(decode_truncated_record_returns_null),
+        unit_test(decode_skips_unknown_record_type),
+        unit_test(parse_text_line_incoming),
+        unit_test(parse_text_line_outgoing_me),
+        unit_test(parse_text_line_not_a_message_returns_null),
+        unit_test(convert_file_then_read_joins_multiline_messages),
+        unit_test(read_file_applies_receipts),
+
+        unit_test_setup_teardown(retention_removes_days_older_than_max_age,
+            init_retention_dir,
+            remove_retention_dir),
+        unit_test_setup_teardown(retention_never_removes_todays_files,
+            init_retention_dir,
+            remove_retention_dir),
+        unit_test_setup_teardown(retention_removes_oldest_days_over_max_size,
+            init_retention_dir,
+            remove_retention_dir),
+        unit_test_setup_teardown(retention_ignores_files_not_named_by_date,
+            init_retention_dir,
+            remove_retention_dir),
+        unit_test_setup_teardown(retention_lists_files_gone,
+            init_retention_dir,
+            remove_retention_dir),
+        unit_test_setup_teardown(archive_then_read_returns_contents,
+            init_retention_dir,
+            remove_retention_dir),
+
+        unit_test_setup_teardown(export_merges_contacts_in_time_order,
+            init_export_dir,
+            remove_export_dir),
+        unit_test_setup_teardown(export_filters_by_contact_and_day,
+            init_export_dir,
+            remove_export_dir),
+        unit_test_setup_teardown(export_filters_by_regex,
+            init_export_dir,
+            remove_export_dir),
+        unit_test_setup_teardown(export_escapes_multi_line_messages,
+            init_export_dir,
+            remove_export_dir),
+        unit_test(export_missing_dir_fails),
+        unit_test(export_parse_day_checks_date),
+
+        unit_test(buffer_empty_after_create),
+        unit_test(buffer_push_adds_entry),
+        unit_test(buffer_yield_returns_entries_in_order),
+        unit_test(buffer_yield_out_of_range_returns_null),
+        unit_test(buffer_full_evicts_oldest),
+        unit_test(buffer_iter_walks_all_entries),
+        unit_test(buffer_iter_walks_all_entries_after_wrap),
+        unit_test(buffer_mark_received_marks_entry),
+        unit_test(buffer_mark_received_returns_false_when_not_found),
+        unit_test(buffer_mark_received_upto_marks_earlier_entries),
+        unit_test(buffer_mark_received_upto_ignores_unknown_id),
+        unit_test(buffer_get_entry_by_id_returns_entry),
+        unit_test(buffer_get_entry_by_id_returns_null_after_eviction),
+        unit_test(buffer_prepend_adds_oldest_entry),
+        unit_test(buffer_prepend_returns_null_when_full),
+        unit_test(buffer_prepend_to_empty_buffer),
+        unit_test(buffer_reused_entry_holds_new_text),
+        unit_test(buffer_evict_oldest_frees_bytes),
+        unit_test(buffer_evict_oldest_keeps_newest),
+        unit_test(buffer_free_returns_total_bytes),
+        unit_test(buffer_forget_layouts_keeps_messages),
+        unit_test(buffer_update_last_replaces_newest_message),
+        unit_test(buffer_update_last_on_empty_buffer_returns_null),
+        unit_test(buffer_pushed_counts_past_full_buffer),
+        unit_test(buffer_set_id_finds_entry_by_id),
+        unit_test(buffer_set_id_on_later_entry_replaces_earlier),
+        unit_test(buffer_replace_by_id_replaces_message),
+        unit_test(buffer_replace_by_id_returns_null_after_reuse),
 
         unit_test(create_jid_from_null_returns_null),
         unit_test(create_jid_from_empty_string_returns_null),
@@ -140,6 +542,11 @@ int main(int argc, char* argv[]) {
         unit_test(create_full_with_trailing_slash),
         unit_test(returns_fulljid_when_exists),
         unit_test(returns_barejid_when_fulljid_not_exists),
+        unit_test(create_same_jid_twice_returns_shared_jid),
+        unit_test(create_after_destroy_returns_new_jid),
+        unit_test(bare_equal_when_resources_differ),
+        unit_test(bare_not_equal_when_bare_jids_differ),
+        unit_test(destroy_releases_bare_jid),
 
         unit_test(parse_null_returns_null),
         unit_test(parse_empty_returns_null),
@@ -191,6 +598,8 @@ int main(int argc, char* argv[]) {
         unit_test(parse_options_when_three_returns_map),
         unit_test(parse_options_when_unknown_opt_sets_error),
         unit_test(parse_options_with_duplicated_option_sets_error),
+        unit_test(parse_long_input_returns_all_args),
+        unit_test(parse_long_freetext_returns_whole_message),
 
         unit_test(empty_list_when_none_added),
         unit_test(contains_one_element),
@@ -210,6 +619,17 @@ int main(int argc, char* argv[]) {
         unit_test(find_twice_returns_second_when_two_match),
         unit_test(find_five_times_finds_fifth),
         unit_test(find_twice_returns_first_when_two_match_and_reset),
+        unit_test(find_after_batch_add),
+        unit_test(batch_add_adds_groups_once),
+        unit_test(get_group_returns_sorted_members),
+        unit_test(group_size_follows_membership),
+        unit_test(get_by_presence_follows_presence_updates),
+        unit_test(query_matches_presence_class_and_group),
+        unit_test(query_matches_subscription),
+        unit_test(query_matches_text_in_name_or_jid),
+        unit_test(change_name_reorders_contacts),
+        unit_test(roster_received_after_set),
+        unit_test(roster_not_received_after_clear),
 
         unit_test_setup_teardown(returns_false_when_chat_session_does_not_exist,
             init_chat_sessions,
@@ -224,6 +644,16 @@ int main(int argc, char* argv[]) {
             init_chat_sessions,
             close_chat_sessions),
 
+        unit_test_setup_teardown(typing_sets_composing,
+            init_chat_sessions,
+            close_chat_sessions),
+        unit_test_setup_teardown(typing_when_throttled_leaves_state,
+            init_chat_sessions,
+            close_chat_sessions),
+        unit_test_setup_teardown(typing_without_outtype_is_not_throttled,
+            init_chat_sessions,
+            close_chat_sessions),
+
         unit_test_setup_teardown(cmd_connect_shows_message_when_disconnecting,
             load_preferences,
             close_preferences),
@@ -257,6 +687,9 @@ int main(int argc, char* argv[]) {
         unit_test_setup_teardown(cmd_connect_connects_with_account,
             load_preferences,
             close_preferences),
+        unit_test_setup_teardown(cmd_connect_connects_once_eval_password_done,
+            load_preferences,
+            close_preferences),
         unit_test_setup_teardown(cmd_connect_shows_usage_when_server_no_port_value,
             load_preferences,
             close_preferences),
@@ -307,6 +740,9 @@ int main(int argc, char* argv[]) {
         unit_test(cmd_rooms_shows_message_when_undefined),
         unit_test(cmd_rooms_uses_account_default_when_no_arg),
         unit_test(cmd_rooms_arg_used_when_passed),
+        unit_test(cmd_rooms_filter_uses_account_default),
+        unit_test(cmd_rooms_filter_with_service),
+        unit_test(cmd_rooms_shows_usage_when_filter_has_no_text),
 
         unit_test(cmd_account_shows_usage_when_not_connected_and_no_args),
         unit_test(cmd_account_shows_account_when_connected_and_no_args),
@@ -342,6 +778,11 @@ int main(int argc, char* argv[]) {
         unit_test(cmd_account_set_eval_password_when_password_set),
         unit_test(cmd_account_set_muc_sets_muc),
         unit_test(cmd_account_set_nick_sets_nick),
+        unit_test(cmd_account_set_history_maxstanzas_sets_value),
+        unit_test(cmd_account_set_history_since_sets_value),
+        unit_test(cmd_account_set_history_since_shows_message_when_invalid),
+        unit_test(cmd_account_set_compression_sets_value),
+        unit_test(cmd_account_set_compression_shows_message_when_invalid),
 #ifdef HAVE_LIBOTR
         unit_test(cmd_account_show_message_for_missing_otr_policy),
         unit_test(cmd_account_show_message_for_invalid_otr_policy),
@@ -369,6 +810,8 @@ int main(int argc, char* argv[]) {
 
         unit_test(cmd_sub_shows_message_when_not_connected),
         unit_test(cmd_sub_shows_usage_when_no_arg),
+        unit_test(cmd_sub_allow_all_answers_every_request),
+        unit_test(cmd_sub_deny_pattern_answers_matching_requests),
 
         unit_test(contact_in_group),
         unit_test(contact_not_in_group),
@@ -394,6 +837,13 @@ int main(int argc, char* argv[]) {
         unit_test(contact_not_available_when_highest_priority_dnd),
         unit_test(contact_available_when_highest_priority_online),
         unit_test(contact_available_when_highest_priority_chat),
+        unit_test(contact_version_changes_when_presence_set),
+        unit_test(contact_version_changes_when_resource_removed),
+        unit_test(contact_presence_follows_removed_resource),
+        unit_test(contact_presence_follows_replaced_resource),
+        unit_test(contact_resource_ac_has_resources_set_before),
+        unit_test(contact_version_unchanged_when_subscription_set),
+        unit_test(contact_resource_iter_in_order_of_availability),
 
         unit_test(cmd_statuses_shows_usage_when_bad_subcmd),
         unit_test(cmd_statuses_shows_usage_when_bad_console_setting),
@@ -436,6 +886,24 @@ int main(int argc, char* argv[]) {
         unit_test_setup_teardown(statuses_muc_defaults_to_all,
             load_preferences,
             close_preferences),
+        unit_test_setup_teardown(peek_string_returns_default,
+            load_preferences,
+            close_preferences),
+        unit_test_setup_teardown(peek_string_returns_updated_value,
+            load_preferences,
+            close_preferences),
+        unit_test_setup_teardown(get_string_returns_copy_of_cached_value,
+            load_preferences,
+            close_preferences),
+        unit_test_setup_teardown(get_boolean_returns_updated_value,
+            load_preferences,
+            close_preferences),
+        unit_test_setup_teardown(room_policy_removed_when_set_to_null,
+            load_preferences,
+            close_preferences),
+        unit_test_setup_teardown(autoping_misses_defaults_to_two,
+            load_preferences,
+            close_preferences),
 
         unit_test_setup_teardown(console_shows_online_presence_when_set_online,
             load_preferences,
@@ -446,6 +914,9 @@ int main(int argc, char* argv[]) {
         unit_test_setup_teardown(console_shows_dnd_presence_when_set_all,
             load_preferences,
             close_preferences),
+        unit_test_setup_teardown(console_shows_latest_presence_once_per_flush,
+            load_preferences,
+            close_preferences),
         unit_test(handle_offline_removes_chat_session),
         unit_test(lost_connection_clears_chat_sessions),
 
@@ -458,7 +929,7 @@ int main(int argc, char* argv[]) {
             close_preferences),
         unit_test_setup_teardown(cmd_alias_add_shows_message_when_exists,
             load_preferences,
-            close_preferences),
+            close_commands),
         unit_test_setup_teardown(cmd_alias_remove_removes_alias,
             load_preferences,
             close_preferences),
@@ -468,6 +939,17 @@ int main(int argc, char* argv[]) {
         unit_test_setup_teardown(cmd_alias_list_shows_all_aliases,
             load_preferences,
             close_preferences),
+        unit_test_setup_teardown(cmd_alias_add_runs_alias,
+            load_preferences,
+            close_commands),
+        unit_test_setup_teardown(cmd_init_loads_aliases_to_run,
+            load_preferences,
+            close_commands),
+
+        unit_test(cmd_get_finds_command),
+        unit_test(cmd_get_returns_null_for_unknown_command),
+        unit_test(cmd_get_ordered_sorted_by_name),
+        unit_test(cmd_help_shows_message_when_no_such_command),
 
         unit_test_setup_teardown(test_muc_invites_add, muc_before_test, muc_after_test),
         unit_test_setup_teardown(test_muc_remove_invite, muc_before_test, muc_after_test),
@@ -475,6 +957,21 @@ int main(int argc, char* argv[]) {
         unit_test_setup_teardown(test_muc_invites_count_5, muc_before_test, muc_after_test),
         unit_test_setup_teardown(test_muc_room_is_not_active, muc_before_test, muc_after_test),
         unit_test_setup_teardown(test_muc_active, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_ac_built_when_roster_complete, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_ac_updated_after_roster_complete, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_sorted_by_nick, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_occupants_by_role_sorted, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_occupants_by_role_follows_role_change, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_occupants_by_affiliation_after_remove, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_autocomplete_offers_recent_speakers_first, muc_prefs_before_test, muc_prefs_after_test),
+        unit_test_setup_teardown(test_muc_autocomplete_moves_speaker_to_front, muc_prefs_before_test, muc_prefs_after_test),
+        unit_test_setup_teardown(test_muc_autocomplete_forgets_speaker_who_left, muc_prefs_before_test, muc_prefs_after_test),
+        unit_test_setup_teardown(test_muc_nick_change_keeps_speaker_place, muc_prefs_before_test, muc_prefs_after_test),
+        unit_test_setup_teardown(test_muc_nick_change_complete_returns_old_nick, muc_prefs_before_test, muc_prefs_after_test),
+        unit_test_setup_teardown(test_muc_roster_iter_starts_at_position, muc_prefs_before_test, muc_prefs_after_test),
+        unit_test_setup_teardown(test_muc_large_room_drops_occupant_details, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_large_room_keeps_wanted_details, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_small_room_keeps_occupant_details, muc_before_test, muc_after_test),
 
         unit_test(cmd_bookmark_shows_message_when_disconnected),
         unit_test(cmd_bookmark_shows_message_when_disconnecting),
@@ -569,6 +1066,10 @@ int main(int argc, char* argv[]) {
         unit_test(cmd_join_uses_account_nick_when_not_supplied),
         unit_test(cmd_join_uses_password_when_supplied),
 
+        unit_test(cmd_sendfile_shows_message_when_disconnected),
+        unit_test(cmd_sendfile_shows_message_when_connecting),
+        unit_test(cmd_sendfile_shows_message_when_not_in_chat_window),
+
         unit_test(cmd_roster_shows_message_when_disconnecting),
         unit_test(cmd_roster_shows_message_when_connecting),
         unit_test(cmd_roster_shows_message_when_disconnected),
@@ -607,8 +1108,15 @@ int main(int argc, char* argv[]) {
         unit_test(remove_text_multi_value_does_nothing_when_doesnt_exist),
         unit_test(remove_text_multi_value_removes_when_one),
         unit_test(remove_text_multi_value_removes_when_many),
+        unit_test(get_field_by_tag_returns_indexed_field),
+        unit_test(non_form_type_fields_sorted_by_var),
 
         unit_test(clears_chat_sessions),
+
+        unit_test(cmd_xmlconsole_shows_usage_when_invalid_subcmd),
+        unit_test(cmd_xmlconsole_filter_add_shows_usage_when_no_value),
+        unit_test(cmd_xmlconsole_filter_add_adds_filter),
+        unit_test(cmd_xmlconsole_filter_remove_shows_message_when_not_found),
     };
 
     return run_tests(all_tests);
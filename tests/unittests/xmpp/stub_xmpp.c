@@ -4,10 +4,19 @@
 #include <cmocka.h>
 
 #include "xmpp/xmpp.h"
+#include "xmpp/capabilities.h"
+#include "xmpp/connection.h"
 
 // connection functions
 void jabber_init(void) {}
 
+// for stanza.c, which only builds stanzas with a context given to it in
+// the functions under test
+xmpp_ctx_t* connection_get_ctx(void)
+{
+    return NULL;
+}
+
 jabber_conn_status_t jabber_connect_with_details(const char * const jid,
     const char * const passwd, const char * const altdomain, const int port, const char *const tls_policy)
 {
@@ -26,12 +35,21 @@ jabber_conn_status_t jabber_connect_with_account(const ProfAccount * const accou
 
 void jabber_disconnect(void) {}
 void jabber_shutdown(void) {}
+void jabber_bench_connect(const char *const fulljid) {}
+void jabber_bench_disconnect(void) {}
+void jabber_bench_replay(const char *const path, gboolean realtime) {}
+void jabber_bench_replay_report(FILE *stream) {}
 void jabber_process_events(int millis) {}
 const char * jabber_get_fulljid(void)
 {
     return (char *)mock();
 }
 
+const Jid* jabber_get_jid(void)
+{
+    return NULL;
+}
+
 const char * jabber_get_domain(void)
 {
     return NULL;
@@ -64,6 +82,12 @@ GList * jabber_get_available_resources(void)
     return NULL;
 }
 
+void jabber_set_client_active(gboolean active) {}
+void jabber_expire_requests(void) {}
+void jabber_tap_add(jabber_tap_t tap) {}
+gboolean jabber_events_pending(void) { return FALSE; }
+void jabber_tap_remove(jabber_tap_t tap) {}
+
 // message functions
 char* message_send_chat(const char * const barejid, const char * const msg)
 {
@@ -72,6 +96,8 @@ char* message_send_chat(const char * const barejid, const char * const msg)
     return NULL;
 }
 
+void message_send_chat_with_id(const char * const barejid, const char * const msg, const char * const id) {}
+
 char* message_send_chat_otr(const char * const barejid, const char * const msg)
 {
     check_expected(barejid);
@@ -79,7 +105,7 @@ char* message_send_chat_otr(const char * const barejid, const char * const msg)
     return NULL;
 }
 
-char* message_send_chat_pgp(const char * const barejid, const char * const msg)
+char* message_send_chat_pgp(const char * const barejid, const char * const msg, gboolean *pending)
 {
     return NULL;
 }
@@ -93,12 +119,20 @@ void message_send_composing(const char * const barejid) {}
 void message_send_paused(const char * const barejid) {}
 void message_send_gone(const char * const barejid) {}
 
+void message_send_displayed(const char * const fulljid, const char * const message_id) {}
 void message_send_invite(const char * const room, const char * const contact,
     const char * const reason) {}
 
 // presence functions
 void presence_subscription(const char * const jid, const jabber_subscr_t action) {}
 
+int presence_subscription_batch(const char * const pattern, const jabber_subscr_t action)
+{
+    check_expected(pattern);
+    check_expected(action);
+    return mock_type(int);
+}
+
 GSList* presence_get_subscription_requests(void)
 {
     return NULL;
@@ -144,9 +178,10 @@ void iq_disable_carbons() {};
 void iq_enable_carbons() {};
 void iq_send_software_version(const char * const fulljid) {}
 
-void iq_room_list_request(gchar *conferencejid)
+void iq_room_list_request(gchar *conferencejid, gchar *filter)
 {
     check_expected(conferencejid);
+    check_expected(filter);
 }
 
 void iq_disco_info_request(gchar *jid) {}
@@ -173,6 +208,7 @@ void iq_room_role_set(const char * const room, const char * const nick, char *ro
     const char * const reason) {}
 void iq_room_role_list(const char * const room, char *role) {}
 void iq_last_activity_request(gchar *jid) {}
+void iq_forget_results(const char *const fulljid) {}
 
 // caps functions
 Capabilities* caps_lookup(const char * const jid)
@@ -180,9 +216,26 @@ Capabilities* caps_lookup(const char * const jid)
     return NULL;
 }
 
+gboolean caps_jid_has_feature(const char *const jid, const char *const feature)
+{
+    return FALSE;
+}
+
+void caps_flush(void) {}
+void caps_check_requests(void) {}
 void caps_close(void) {}
 void caps_destroy(Capabilities *caps) {}
 
+xmpp_stanza_t* caps_create_query_response_stanza(xmpp_ctx_t *const ctx)
+{
+    return NULL;
+}
+
+char* caps_get_my_sha1(xmpp_ctx_t *const ctx)
+{
+    return NULL;
+}
+
 gboolean bookmark_add(const char *jid, const char *nick, const char *password, const char *autojoin_str)
 {
     check_expected(jid);
@@ -208,6 +261,11 @@ gboolean bookmark_join(const char *jid)
     return FALSE;
 }
 
+void mam_fetch_older(const char *const barejid, gboolean muc, GDateTime *end) {}
+void mam_forget(const char *const barejid) {}
+
+void http_upload_file(const char *const path, http_upload_callback callback, void *userdata) {}
+
 const GList * bookmark_get_list(void)
 {
     return (GList *)mock();
@@ -219,6 +277,7 @@ char * bookmark_find(const char * const search_str)
 }
 
 void bookmark_autocomplete_reset(void) {}
+void bookmark_touch(const char *const jid) {}
 
 void roster_send_name_change(const char * const barejid, const char * const new_name, GSList *groups)
 {